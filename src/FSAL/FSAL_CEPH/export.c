@@ -73,7 +73,8 @@ static void release(struct fsal_export *export_pub)
 	fsal_detach_export(export->export.fsal, &export->export.exports);
 	free_export_ops(&export->export);
 
-	ceph_shutdown(export->cmount);
+	ceph_mount_put(export->cm);
+	export->cm = NULL;
 	export->cmount = NULL;
 	gsh_free(export);
 	export = NULL;
@@ -142,18 +143,19 @@ static fsal_status_t lookup_path(struct fsal_export *export_pub,
 		return status;
 	}
 
-	/* Advance past the export's fullpath */
-	realpath += strlen(op_ctx->ctx_export->fullpath);
-
 	/* special case the root */
-	if (strcmp(realpath, "/") == 0) {
+	if (realpath[strlen(op_ctx->ctx_export->fullpath)] == '\0' ||
+	    strcmp(realpath + strlen(op_ctx->ctx_export->fullpath), "/") == 0) {
 		assert(export->root);
 		*pub_handle = &export->root->handle;
 		return status;
 	}
 
+	/* The mount may be shared, walk from its root */
+	realpath = ceph_mount_relpath(export->cm->cmount_path, realpath);
+
 	rc = fsal_ceph_ll_walk(export->cmount, realpath, &i, &stx,
-				!!attrs_out, op_ctx->creds);
+				ceph_statx_want(attrs_out), op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
@@ -253,8 +255,7 @@ static fsal_status_t create_handle(struct fsal_export *export_pub,
 	}
 
 	rc = fsal_ceph_ll_getattr(export->cmount, i, &stx,
-		attrs_out ? CEPH_STATX_ATTR_MASK : CEPH_STATX_HANDLE_MASK,
-		op_ctx->creds);
+				  ceph_statx_want(attrs_out), op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
@@ -317,6 +318,10 @@ void ceph_prepare_unexport(struct fsal_export *export_pub)
 	/* Flush all buffers */
 	ceph_sync_fs(export->cmount);
 
+	/* Other exports go on using a shared mount */
+	if (!ceph_mount_last_ref(export->cm))
+		return;
+
 #if USE_FSAL_CEPH_ABORT_CONN
 	/*
 	 * If we're still a member of the cluster, do a hard abort on the
@@ -46,6 +46,7 @@
 #include "sal_data.h"
 #include "statx_compat.h"
 #include "linux/falloc.h"
+#include "fridgethr.h"
 
 /**
  * @brief Release an object
@@ -98,7 +99,7 @@ static fsal_status_t ceph_fsal_lookup(struct fsal_obj_handle *dir_pub,
 	LogFullDebug(COMPONENT_FSAL, "Lookup %s", path);
 
 	rc = fsal_ceph_ll_lookup(export->cmount, dir->i, path, &i, &stx,
-					!!attrs_out, op_ctx->creds);
+				 ceph_statx_want(attrs_out), op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
@@ -312,7 +313,7 @@ static fsal_status_t ceph_fsal_mkdir(struct fsal_obj_handle *dir_hdl,
 		& ~op_ctx->fsal_export->exp_ops.fs_umask(op_ctx->fsal_export);
 
 	rc = fsal_ceph_ll_mkdir(export->cmount, dir->i, name, unix_mode, &i,
-			&stx, !!attrs_out, op_ctx->creds);
+			&stx, ceph_statx_want(attrs_out), op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
@@ -426,7 +427,8 @@ static fsal_status_t ceph_fsal_mknode(struct fsal_obj_handle *dir_hdl,
 	}
 
 	rc = fsal_ceph_ll_mknod(export->cmount, dir->i, name, unix_mode,
-			unix_dev, &i, &stx, !!attrs_out, op_ctx->creds);
+			unix_dev, &i, &stx, ceph_statx_want(attrs_out),
+			op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
@@ -513,7 +515,8 @@ static fsal_status_t ceph_fsal_symlink(struct fsal_obj_handle *dir_hdl,
 	fsal_status_t status;
 
 	rc = fsal_ceph_ll_symlink(export->cmount, dir->i, name, link_path,
-			      &i, &stx, !!attrs_out, op_ctx->creds);
+			      &i, &stx, ceph_statx_want(attrs_out),
+			      op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
@@ -624,7 +627,7 @@ static fsal_status_t ceph_fsal_getattrs(struct fsal_obj_handle *handle_pub,
 	struct ceph_statx stx;
 
 	rc = fsal_ceph_ll_getattr(export->cmount, handle->i, &stx,
-				CEPH_STATX_ATTR_MASK, op_ctx->creds);
+				ceph_statx_want(attrs), op_ctx->creds);
 	if (rc < 0)
 		goto out_err;
 
@@ -827,12 +830,37 @@ static fsal_status_t ceph_open_my_fd(struct ceph_handle *myself,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_IO
+/* Protects async_ios of every handle, ceph_async_done is signalled as
+ * they drop to 0 */
+static pthread_mutex_t ceph_async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ceph_async_done = PTHREAD_COND_INITIALIZER;
+
+/**
+ * @brief Wait for the nonblocking I/Os of a handle
+ *
+ * Those I/Os no longer hold the locks that kept their descriptor open,
+ * so whoever closes a descriptor of the handle waits for them first.
+ */
+static void ceph_async_wait(struct ceph_handle *handle)
+{
+	PTHREAD_MUTEX_lock(&ceph_async_lock);
+	while (handle->async_ios != 0)
+		pthread_cond_wait(&ceph_async_done, &ceph_async_lock);
+	PTHREAD_MUTEX_unlock(&ceph_async_lock);
+}
+#endif
+
 static fsal_status_t ceph_close_my_fd(struct ceph_handle *handle,
 				      struct ceph_fd *my_fd)
 {
 	int rc = 0;
 	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
 
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_IO
+	ceph_async_wait(handle);
+#endif
+
 	if (my_fd->fd != NULL && my_fd->openflags != FSAL_O_CLOSED) {
 		rc = ceph_ll_close(handle->export->cmount, my_fd->fd);
 		if (rc < 0)
@@ -1173,7 +1201,8 @@ static fsal_status_t ceph_fsal_open2(struct fsal_obj_handle *obj_hdl,
 		if (createmode >= FSAL_EXCLUSIVE || truncated) {
 			/* Refresh the attributes */
 			retval = fsal_ceph_ll_getattr(export->cmount,
-					myself->i, &stx, !!attrs_out,
+					myself->i, &stx,
+					ceph_statx_want(attrs_out),
 					op_ctx->creds);
 
 			if (retval == 0) {
@@ -1319,7 +1348,7 @@ static fsal_status_t ceph_fsal_open2(struct fsal_obj_handle *obj_hdl,
 
 	retval = fsal_ceph_ll_create(export->cmount,  myself->i, name,
 				unix_mode, posix_flags, &i, &fd, &stx,
-				!!attrs_out, op_ctx->creds);
+				ceph_statx_want(attrs_out), op_ctx->creds);
 
 	if (retval < 0) {
 		LogFullDebug(COMPONENT_FSAL,
@@ -1341,7 +1370,8 @@ static fsal_status_t ceph_fsal_open2(struct fsal_obj_handle *obj_hdl,
 		posix_flags &= ~O_EXCL;
 		retval = fsal_ceph_ll_create(export->cmount,  myself->i,
 				name, unix_mode, posix_flags, &i, &fd,
-				&stx, !!attrs_out, op_ctx->creds);
+				&stx, ceph_statx_want(attrs_out),
+				op_ctx->creds);
 		if (retval < 0) {
 			LogFullDebug(COMPONENT_FSAL,
 				     "Non-exclusive Create %s failed with %s",
@@ -1602,6 +1632,134 @@ static fsal_status_t ceph_find_fd(Fh **fd,
 	return status;
 }
 
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_IO
+/**
+ * A nonblocking read or write, from submission to done_cb
+ */
+struct ceph_async_io {
+	struct ceph_ll_io_info io_info;
+	struct ceph_handle *myself;
+	bool closefd;		/*< io_info.fh is ours to close */
+	fsal_async_cb done_cb;
+	struct fsal_io_arg *io_arg;
+	void *caller_arg;
+	struct req_op_context ctx;	/*< The caller's, for done_cb */
+};
+
+/**
+ * @brief Finish a nonblocking I/O on an I/O thread
+ *
+ * The COMPOUND resumes from done_cb, which must not run on a libcephfs
+ * thread.
+ */
+static void ceph_async_io_done(struct fridgethr_context *ctx)
+{
+	struct ceph_async_io *aio = ctx->arg;
+	struct ceph_handle *myself = aio->myself;
+	struct fsal_io_arg *io_arg = aio->io_arg;
+	struct req_op_context *saved_ctx = op_ctx;
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	if (aio->io_info.result < 0) {
+		status = ceph2fsal_error(aio->io_info.result);
+		if (aio->io_info.write)
+			io_arg->fsal_stable = false;
+	} else {
+		io_arg->io_amount = aio->io_info.result;
+		if (!aio->io_info.write)
+			io_arg->end_of_file = aio->io_info.result == 0;
+	}
+
+	if (aio->closefd)
+		(void) ceph_ll_close(myself->export->cmount, aio->io_info.fh);
+
+	/* Before done_cb, which may go on to close the file */
+	PTHREAD_MUTEX_lock(&ceph_async_lock);
+	if (--myself->async_ios == 0)
+		pthread_cond_broadcast(&ceph_async_done);
+	PTHREAD_MUTEX_unlock(&ceph_async_lock);
+
+	op_ctx = &aio->ctx;
+	aio->done_cb(&myself->handle, status, io_arg, aio->caller_arg);
+	op_ctx = saved_ctx;
+
+	gsh_free(aio);
+}
+
+/* Called by libcephfs once the OSDs have answered */
+static void ceph_async_io_cb(struct ceph_ll_io_info *io_info)
+{
+	struct ceph_async_io *aio =
+			container_of(io_info, struct ceph_async_io, io_info);
+	struct fridgethr_context ctx = { .arg = aio };
+
+	if (fridgethr_submit(CephFSM.io_fridge, ceph_async_io_done,
+			     aio) != 0) {
+		/* No thread to hand it to, only when shutting down */
+		ceph_async_io_done(&ctx);
+	}
+}
+
+/**
+ * @brief Start a read or write that completes through done_cb
+ *
+ * Done when nonblocking I/O is on and the caller can take done_cb from
+ * another thread.  The descriptor stays open until the I/O is done, so
+ * on success the caller drops its locks and returns at once.
+ *
+ * @return true if the I/O was started.
+ */
+static bool ceph_async_io_start(struct ceph_handle *myself, Fh *my_fd,
+				bool closefd, bool write,
+				fsal_async_cb done_cb,
+				struct fsal_io_arg *io_arg, void *caller_arg)
+{
+	struct ceph_async_io *aio;
+	int64_t rc;
+
+	if (CephFSM.io_fridge == NULL || !op_ctx->async_io)
+		return false;
+
+	aio = gsh_calloc(1, sizeof(*aio));
+	aio->io_info.callback = ceph_async_io_cb;
+	aio->io_info.fh = my_fd;
+	aio->io_info.iov = io_arg->iov;
+	aio->io_info.iovcnt = io_arg->iov_count;
+	aio->io_info.off = io_arg->offset;
+	aio->io_info.write = write;
+	aio->io_info.fsync = write && io_arg->fsal_stable;
+	aio->myself = myself;
+	aio->closefd = closefd;
+	aio->done_cb = done_cb;
+	aio->io_arg = io_arg;
+	aio->caller_arg = caller_arg;
+	fsal_async_ctx_save(&aio->ctx);
+
+	io_arg->io_amount = 0;
+
+	PTHREAD_MUTEX_lock(&ceph_async_lock);
+	myself->async_ios++;
+	PTHREAD_MUTEX_unlock(&ceph_async_lock);
+
+	rc = ceph_ll_nonblocking_readv_writev(myself->export->cmount,
+					      &aio->io_info);
+	if (rc >= 0)
+		return true;
+
+	/* The callback won't come, let the synchronous path have a go */
+	LogDebug(COMPONENT_FSAL, "nonblocking %s failed: %" PRId64,
+		 write ? "write" : "read", rc);
+
+	PTHREAD_MUTEX_lock(&ceph_async_lock);
+	if (--myself->async_ios == 0)
+		pthread_cond_broadcast(&ceph_async_done);
+	PTHREAD_MUTEX_unlock(&ceph_async_lock);
+
+	gsh_free(aio);
+	return false;
+}
+#endif
+
 /**
  * @brief Read data from a file
  *
@@ -1662,6 +1820,18 @@ static void ceph_fsal_read2(struct fsal_obj_handle *obj_hdl, bool bypass,
 	if (FSAL_IS_ERROR(status))
 		goto out;
 
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_IO
+	if (ceph_async_io_start(myself, my_fd, closefd, false, done_cb,
+				read_arg, caller_arg)) {
+		/* The I/O keeps my_fd open, our locks can go */
+		if (ceph_fd)
+			PTHREAD_RWLOCK_unlock(&ceph_fd->fdlock);
+		if (has_lock)
+			PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+		return;
+	}
+#endif
+
 	read_arg->io_amount = 0;
 
 	for (i = 0; i < read_arg->iov_count; i++) {
@@ -1775,6 +1945,18 @@ static void ceph_fsal_write2(struct fsal_obj_handle *obj_hdl, bool bypass,
 		goto out;
 	}
 
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_IO
+	if (ceph_async_io_start(myself, my_fd, closefd, true, done_cb,
+				write_arg, caller_arg)) {
+		/* The I/O keeps my_fd open, our locks can go */
+		if (ceph_fd)
+			PTHREAD_RWLOCK_unlock(&ceph_fd->fdlock);
+		if (has_lock)
+			PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+		return;
+	}
+#endif
+
 	for (i = 0; i < write_arg->iov_count; i++) {
 		nb_written =
 			ceph_ll_write(export->cmount, my_fd, offset,
@@ -134,6 +134,33 @@ attrmask2ceph_want(attrmask_t mask)
 	return want;
 }
 
+/**
+ * @brief Work out the statx mask for an operation returning attributes
+ *
+ * The handle fields are always needed. Beyond that only ask libcephfs for
+ * what the caller's request_mask names, so we don't make the MDS hand out
+ * (and later recall) caps for attributes nobody will look at.
+ *
+ * @param[in] attrs  Attributes the caller wants back, may be NULL
+ *
+ * @return Mask to pass to the fsal_ceph_ll_* wrappers.
+ */
+unsigned int ceph_statx_want(const struct attrlist *attrs)
+{
+	unsigned int want;
+
+	if (attrs == NULL)
+		return CEPH_STATX_HANDLE_MASK;
+
+	want = attrmask2ceph_want(attrs->request_mask);
+
+	/* A caller that set up attrs but named nothing we map gets the lot */
+	if (want == 0)
+		return CEPH_STATX_ATTR_MASK;
+
+	return CEPH_STATX_HANDLE_MASK | want;
+}
+
 void ceph2fsal_attributes(const struct ceph_statx *stx,
 			  struct attrlist *fsalattr)
 {
@@ -62,9 +62,35 @@ struct ceph_fsal_module {
 	struct fsal_module fsal;
 	struct fsal_obj_ops handle_ops;
 	char *conf_path;
+	uint32_t async_io_threads;
+	/** Completes the nonblocking I/Os, NULL if they are off */
+	struct fridgethr *io_fridge;
+	/** Protects mounts */
+	pthread_mutex_t mounts_lock;
+	/** The struct ceph_mount shared by the exports */
+	struct glist_head mounts;
 };
 extern struct ceph_fsal_module CephFSM;
 
+/**
+ * A libcephfs mount, shared by the exports of the same filesystem
+ *
+ * Exports with the same cephx user, key, filesystem and cmount_path
+ * use one MDS session and client cache.  Every export has its own
+ * root handle below the mount's root.
+ */
+
+struct ceph_mount {
+	struct glist_head cm_list;	/*< On CephFSM.mounts */
+	struct ceph_mount_info *cmount;	/*< The libcephfs mount */
+	uint32_t refcnt;		/*< Exports on it, under mounts_lock */
+	bool dying;			/*< Being torn down, not to be shared */
+	char *user_id;
+	char *secret_key;
+	char *fs_name;
+	char *cmount_path;
+};
+
 /**
  * Ceph private export object
  */
@@ -74,9 +100,12 @@ struct ceph_export {
 	struct ceph_mount_info *cmount;	/*< The mount object used to
 					   access all Ceph methods on
 					   this export. */
+	struct ceph_mount *cm;		/*< The mount cmount comes from */
 	struct ceph_handle *root;	/*< The root handle */
 	char *user_id;			/* cephx user_id for this mount */
 	char *secret_key;
+	char *fs_name;			/* ceph filesystem, if not default */
+	char *cmount_path;		/* path in the filesystem to mount */
 	char *sec_label_xattr;		/* name of xattr for security label */
 };
 
@@ -107,6 +136,8 @@ struct ceph_handle {
 	struct ceph_export *export;
 	vinodeno_t vi;		/*< The object identifier */
 	struct fsal_share share;
+	/** Nonblocking I/Os in flight, see ceph_async_wait() */
+	uint32_t async_ios;
 #ifdef CEPH_PNFS
 	uint64_t rd_issued;
 	uint64_t rd_serial;
@@ -174,9 +205,14 @@ static inline fsal_status_t ceph2fsal_error(const int ceph_errorcode)
 }
 
 unsigned int attrmask2ceph_want(attrmask_t mask);
+unsigned int ceph_statx_want(const struct attrlist *attrs);
 void ceph2fsal_attributes(const struct ceph_statx *stx,
 			  struct attrlist *fsalattr);
 
+void ceph_mount_put(struct ceph_mount *cm);
+bool ceph_mount_last_ref(struct ceph_mount *cm);
+const char *ceph_mount_relpath(const char *cmount_path, const char *path);
+
 void export_ops_init(struct export_ops *ops);
 void handle_ops_init(struct fsal_obj_ops *ops);
 #ifdef CEPH_PNFS
@@ -49,6 +49,7 @@
 #include "statx_compat.h"
 #include "nfs_core.h"
 #include "sal_functions.h"
+#include "fridgethr.h"
 
 /**
  * The name of this module.
@@ -98,6 +99,8 @@ static struct config_item ceph_items[] = {
 		ceph_fsal_module, conf_path),
 	CONF_ITEM_MODE("umask", 0,
 			ceph_fsal_module, fsal.fs_info.umask),
+	CONF_ITEM_UI32("Async_IO_Threads", 0, 256, 4,
+		       ceph_fsal_module, async_io_threads),
 	CONFIG_EOL
 };
 
@@ -135,6 +138,25 @@ static fsal_status_t init_config(struct fsal_module *module_in,
 	if (!config_error_is_harmless(err_type))
 		return fsalstat(ERR_FSAL_INVAL, 0);
 
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_IO
+	if (myself->async_io_threads != 0 && myself->io_fridge == NULL) {
+		struct fridgethr_params frp;
+		int rc;
+
+		memset(&frp, 0, sizeof(struct fridgethr_params));
+		frp.thr_max = myself->async_io_threads;
+		frp.deferment = fridgethr_defer_queue;
+
+		rc = fridgethr_init(&myself->io_fridge, "ceph_io", &frp);
+		if (rc != 0) {
+			/* I/O just blocks the workers then */
+			LogCrit(COMPONENT_FSAL,
+				"Unable to start Ceph I/O threads: %d", rc);
+			myself->io_fridge = NULL;
+		}
+	}
+#endif
+
 	display_fsinfo(&myself->fsal);
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
@@ -162,6 +184,9 @@ static struct config_item export_params[] = {
 			secret_key),
 	CONF_ITEM_STR("sec_label_xattr", 0, 256, "security.selinux",
 			ceph_export, sec_label_xattr),
+	CONF_ITEM_STR("filesystem", 0, NAME_MAX, NULL, ceph_export, fs_name),
+	CONF_ITEM_PATH("cmount_path", 1, MAXPATHLEN, "/",
+			ceph_export, cmount_path),
 	CONFIG_EOL
 };
 
@@ -214,7 +239,7 @@ static inline void enable_delegations(struct ceph_export *export)
 
 #ifdef USE_FSAL_CEPH_RECLAIM_RESET
 #define RECLAIM_UUID_PREFIX		"ganesha-"
-static int reclaim_reset(struct ceph_export *export)
+static int reclaim_reset(struct ceph_mount_info *cmount)
 {
 	int		ceph_status;
 	char		*nodeid, *uuid;
@@ -224,7 +249,7 @@ static int reclaim_reset(struct ceph_export *export)
 	 * Set long timeout for the session to ensure that MDS doesn't lose
 	 * state before server can come back and do recovery.
 	 */
-	ceph_set_session_timeout(export->cmount, 300);
+	ceph_set_session_timeout(cmount, 300);
 
 	/*
 	 * For the uuid here, we just use whatever ganesha- + whatever
@@ -241,106 +266,123 @@ static int reclaim_reset(struct ceph_export *export)
 	snprintf(uuid, len, RECLAIM_UUID_PREFIX "%s", nodeid);
 
 	/* If this fails, log a message but soldier on */
-	ceph_status = ceph_start_reclaim(export->cmount, nodeid,
+	ceph_status = ceph_start_reclaim(cmount, nodeid,
 						CEPH_RECLAIM_RESET);
 	if (ceph_status)
 		LogEvent(COMPONENT_FSAL, "start_reclaim failed: %d",
 				ceph_status);
-	ceph_finish_reclaim(export->cmount);
-	ceph_set_uuid(export->cmount, nodeid);
+	ceph_finish_reclaim(cmount);
+	ceph_set_uuid(cmount, nodeid);
 	gsh_free(nodeid);
 	gsh_free(uuid);
 	return 0;
 }
 #undef RECLAIM_UUID_PREFIX
 #else
-static inline int reclaim_reset(struct ceph_export *export)
+static inline int reclaim_reset(struct ceph_mount_info *cmount)
 {
 	return 0;
 }
 #endif
 
+static bool ceph_str_eq(const char *a, const char *b)
+{
+	if (a == NULL || b == NULL)
+		return a == b;
+	return strcmp(a, b) == 0;
+}
+
 /**
- * @brief Create a new export under this FSAL
+ * @brief Length of a cmount_path, less any trailing '/'
+ */
+static size_t ceph_mount_path_len(const char *cmount_path)
+{
+	size_t len = strlen(cmount_path);
+
+	while (len > 0 && cmount_path[len - 1] == '/')
+		len--;
+	return len;
+}
+
+/**
+ * @brief Path of an export relative to the root of its mount
  *
- * This function creates a new export object for the Ceph FSAL.
+ * @param[in] cmount_path  Path the mount's root is at
+ * @param[in] path         Full path in the filesystem
  *
- * @todo ACE: We do not handle re-exports of the same cluster in a
- * sane way.  Currently we create multiple handles and cache objects
- * pointing to the same one.  This is not necessarily wrong, but it is
- * inefficient.  It may also not be something we expect to use enough
- * to care about.
+ * @return The part of path below cmount_path, "" for the mount's root,
+ * or NULL if path is not below it.
+ */
+const char *ceph_mount_relpath(const char *cmount_path, const char *path)
+{
+	size_t len = ceph_mount_path_len(cmount_path);
+
+	if (strncmp(path, cmount_path, len) != 0 ||
+	    (path[len] != '\0' && path[len] != '/'))
+		return NULL;
+
+	return path + len;
+}
+
+/**
+ * @brief Free a mount that no export uses any longer
+ */
+static void ceph_mount_free(struct ceph_mount *cm)
+{
+	if (cm->cmount)
+		ceph_shutdown(cm->cmount);
+	gsh_free(cm->user_id);
+	gsh_free(cm->secret_key);
+	gsh_free(cm->fs_name);
+	gsh_free(cm->cmount_path);
+	gsh_free(cm);
+}
+
+/**
+ * @brief Mount a Ceph filesystem for an export
  *
- * @param[in]     module_in  The supplied module handle
- * @param[in]     path       The path to export
- * @param[in]     options    Export specific options for the FSAL
- * @param[in,out] list_entry Our entry in the export list
- * @param[in]     next_fsal  Next stacked FSAL
- * @param[out]    pub_export Newly created FSAL export object
+ * @param[in]  export  Export with the mount parameters
+ * @param[out] status  Status on failure
  *
- * @return FSAL status.
+ * @return The new mount, with a reference, or NULL.
  */
-
-static fsal_status_t create_export(struct fsal_module *module_in,
-				   void *parse_node,
-				   struct config_error_type *err_type,
-				   const struct fsal_up_vector *up_ops)
+static struct ceph_mount *ceph_mount_new(struct ceph_export *export,
+					 fsal_status_t *status)
 {
-	/* The status code to return */
-	fsal_status_t status = { ERR_FSAL_NO_ERROR, 0 };
-	/* The internal export object */
-	struct ceph_export *export = gsh_calloc(1, sizeof(struct ceph_export));
-	/* The 'private' root handle */
-	struct ceph_handle *handle = NULL;
-	/* Root inode */
-	struct Inode *i = NULL;
-	/* Stat for root */
-	struct ceph_statx stx;
-	/* Return code */
-	int rc;
-	/* Return code from Ceph calls */
+	struct ceph_mount *cm = gsh_calloc(1, sizeof(struct ceph_mount));
 	int ceph_status;
 
-	fsal_export_init(&export->export);
-	export_ops_init(&export->export.exp_ops);
-
-	/* get params for this export, if any */
-	if (parse_node) {
-		rc = load_config_from_node(parse_node,
-					   &export_param_block,
-					   export,
-					   true,
-					   err_type);
-		if (rc != 0) {
-			gsh_free(export);
-			return fsalstat(ERR_FSAL_INVAL, 0);
-		}
-	}
+	cm->refcnt = 1;
+	cm->user_id = export->user_id ? gsh_strdup(export->user_id) : NULL;
+	cm->secret_key = export->secret_key ?
+				gsh_strdup(export->secret_key) : NULL;
+	cm->fs_name = export->fs_name ? gsh_strdup(export->fs_name) : NULL;
+	cm->cmount_path = gsh_strdup(export->cmount_path);
 
 	/* allocates ceph_mount_info */
-	ceph_status = ceph_create(&export->cmount, export->user_id);
+	ceph_status = ceph_create(&cm->cmount, cm->user_id);
 	if (ceph_status != 0) {
-		status.major = ERR_FSAL_SERVERFAULT;
+		cm->cmount = NULL;
+		status->major = ERR_FSAL_SERVERFAULT;
 		LogCrit(COMPONENT_FSAL,
 			"Unable to create Ceph handle for %s.",
 			op_ctx->ctx_export->fullpath);
 		goto error;
 	}
 
-	ceph_status = ceph_conf_read_file(export->cmount, CephFSM.conf_path);
+	ceph_status = ceph_conf_read_file(cm->cmount, CephFSM.conf_path);
 	if (ceph_status != 0) {
-		status.major = ERR_FSAL_SERVERFAULT;
+		status->major = ERR_FSAL_SERVERFAULT;
 		LogCrit(COMPONENT_FSAL,
 			"Unable to read Ceph configuration for %s.",
 			op_ctx->ctx_export->fullpath);
 		goto error;
 	}
 
-	if (export->secret_key) {
-		ceph_status = ceph_conf_set(export->cmount, "key",
-					    export->secret_key);
+	if (cm->secret_key) {
+		ceph_status = ceph_conf_set(cm->cmount, "key", cm->secret_key);
 		if (ceph_status) {
-			status.major = ERR_FSAL_INVAL;
+			status->major = ERR_FSAL_INVAL;
 			LogCrit(COMPONENT_FSAL,
 				"Unable to set Ceph secret key for %s: %d",
 				op_ctx->ctx_export->fullpath, ceph_status);
@@ -348,48 +390,235 @@ static fsal_status_t create_export(struct fsal_module *module_in,
 		}
 	}
 
+	if (cm->fs_name) {
+		ceph_status = ceph_conf_set(cm->cmount, "client_mds_namespace",
+					    cm->fs_name);
+		if (ceph_status) {
+			status->major = ERR_FSAL_INVAL;
+			LogCrit(COMPONENT_FSAL,
+				"Unable to set Ceph filesystem %s for %s: %d",
+				cm->fs_name, op_ctx->ctx_export->fullpath,
+				ceph_status);
+			goto error;
+		}
+	}
+
 	/*
 	 * Workaround for broken libcephfs that doesn't handle the path
 	 * given in ceph_mount properly. Should be harmless for fixed
 	 * libcephfs as well (see http://tracker.ceph.com/issues/18254).
 	 */
-	ceph_status = ceph_conf_set(export->cmount, "client_mountpoint",
-				    op_ctx->ctx_export->fullpath);
+	ceph_status = ceph_conf_set(cm->cmount, "client_mountpoint",
+				    cm->cmount_path);
 	if (ceph_status) {
-		status.major = ERR_FSAL_INVAL;
+		status->major = ERR_FSAL_INVAL;
 		LogCrit(COMPONENT_FSAL,
 			"Unable to set Ceph client_mountpoint for %s: %d",
 			op_ctx->ctx_export->fullpath, ceph_status);
 		goto error;
 	}
 
-	ceph_status = ceph_init(export->cmount);
+	ceph_status = ceph_init(cm->cmount);
 	if (ceph_status != 0) {
-		status.major = ERR_FSAL_SERVERFAULT;
+		status->major = ERR_FSAL_SERVERFAULT;
 		LogCrit(COMPONENT_FSAL,
 			"Unable to init Ceph handle for %s.",
 			op_ctx->ctx_export->fullpath);
 		goto error;
 	}
 
-	ceph_status = reclaim_reset(export);
+	ceph_status = reclaim_reset(cm->cmount);
 	if (ceph_status != 0) {
-		status.major = ERR_FSAL_SERVERFAULT;
+		status->major = ERR_FSAL_SERVERFAULT;
 		LogCrit(COMPONENT_FSAL,
 			"Unable to do reclaim_reset for %s.",
 			op_ctx->ctx_export->fullpath);
 		goto error;
 	}
 
-	ceph_status = ceph_mount(export->cmount, op_ctx->ctx_export->fullpath);
+	ceph_status = ceph_mount(cm->cmount, cm->cmount_path);
 	if (ceph_status != 0) {
-		status.major = ERR_FSAL_SERVERFAULT;
+		status->major = ERR_FSAL_SERVERFAULT;
 		LogCrit(COMPONENT_FSAL,
-			"Unable to mount Ceph cluster for %s.",
-			op_ctx->ctx_export->fullpath);
+			"Unable to mount Ceph cluster at %s for %s.",
+			cm->cmount_path, op_ctx->ctx_export->fullpath);
 		goto error;
 	}
 
+	LogInfo(COMPONENT_FSAL, "Mounted Ceph filesystem %s at %s",
+		cm->fs_name ? cm->fs_name : "(default)", cm->cmount_path);
+	return cm;
+
+ error:
+	ceph_mount_free(cm);
+	return NULL;
+}
+
+/**
+ * @brief Get the mount an export is to use
+ *
+ * Shares the mount of an earlier export with the same parameters, or
+ * makes a new one.
+ *
+ * @param[in]  export  Export with the mount parameters
+ * @param[out] status  Status on failure
+ *
+ * @return The mount, with a reference, or NULL.
+ */
+static struct ceph_mount *ceph_mount_get(struct ceph_export *export,
+					 fsal_status_t *status)
+{
+	struct glist_head *glist;
+	struct ceph_mount *cm;
+	size_t len = ceph_mount_path_len(export->cmount_path);
+
+	PTHREAD_MUTEX_lock(&CephFSM.mounts_lock);
+
+	glist_for_each(glist, &CephFSM.mounts) {
+		cm = glist_entry(glist, struct ceph_mount, cm_list);
+
+		if (cm->dying ||
+		    !ceph_str_eq(cm->user_id, export->user_id) ||
+		    !ceph_str_eq(cm->secret_key, export->secret_key) ||
+		    !ceph_str_eq(cm->fs_name, export->fs_name) ||
+		    ceph_mount_path_len(cm->cmount_path) != len ||
+		    strncmp(cm->cmount_path, export->cmount_path, len) != 0)
+			continue;
+
+		cm->refcnt++;
+		PTHREAD_MUTEX_unlock(&CephFSM.mounts_lock);
+		LogDebug(COMPONENT_FSAL, "Export %s shares the mount at %s",
+			 op_ctx->ctx_export->fullpath, cm->cmount_path);
+		return cm;
+	}
+
+	/* Exports are created one at a time, holding the lock while
+	 * mounting costs nothing.
+	 */
+	cm = ceph_mount_new(export, status);
+	if (cm != NULL)
+		glist_add_tail(&CephFSM.mounts, &cm->cm_list);
+
+	PTHREAD_MUTEX_unlock(&CephFSM.mounts_lock);
+	return cm;
+}
+
+/**
+ * @brief Release an export's reference on its mount
+ *
+ * The last reference unmounts.
+ *
+ * @param[in] cm  The mount
+ */
+void ceph_mount_put(struct ceph_mount *cm)
+{
+	PTHREAD_MUTEX_lock(&CephFSM.mounts_lock);
+	if (--cm->refcnt != 0) {
+		PTHREAD_MUTEX_unlock(&CephFSM.mounts_lock);
+		return;
+	}
+	glist_del(&cm->cm_list);
+	PTHREAD_MUTEX_unlock(&CephFSM.mounts_lock);
+
+	ceph_mount_free(cm);
+}
+
+/**
+ * @brief Check whether an export going away is the last on its mount
+ *
+ * If so, the mount is no longer given to new exports, so that it may
+ * be torn down.
+ *
+ * @param[in] cm  The mount
+ *
+ * @return true if no other export uses the mount.
+ */
+bool ceph_mount_last_ref(struct ceph_mount *cm)
+{
+	bool last;
+
+	PTHREAD_MUTEX_lock(&CephFSM.mounts_lock);
+	last = cm->refcnt == 1;
+	if (last)
+		cm->dying = true;
+	PTHREAD_MUTEX_unlock(&CephFSM.mounts_lock);
+
+	return last;
+}
+
+/**
+ * @brief Create a new export under this FSAL
+ *
+ * This function creates a new export object for the Ceph FSAL.
+ *
+ * Exports of the same filesystem share one libcephfs mount, see
+ * struct ceph_mount, and each one looks up its own root below it.
+ *
+ * @param[in]     module_in  The supplied module handle
+ * @param[in]     path       The path to export
+ * @param[in]     options    Export specific options for the FSAL
+ * @param[in,out] list_entry Our entry in the export list
+ * @param[in]     next_fsal  Next stacked FSAL
+ * @param[out]    pub_export Newly created FSAL export object
+ *
+ * @return FSAL status.
+ */
+
+static fsal_status_t create_export(struct fsal_module *module_in,
+				   void *parse_node,
+				   struct config_error_type *err_type,
+				   const struct fsal_up_vector *up_ops)
+{
+	/* The status code to return */
+	fsal_status_t status = { ERR_FSAL_NO_ERROR, 0 };
+	/* The internal export object */
+	struct ceph_export *export = gsh_calloc(1, sizeof(struct ceph_export));
+	/* The 'private' root handle */
+	struct ceph_handle *handle = NULL;
+	/* Root inode */
+	struct Inode *i = NULL;
+	/* Stat for root */
+	struct ceph_statx stx;
+	/* Return code */
+	int rc;
+	/* Export path below the mount's root */
+	const char *relpath;
+	bool attached = false;
+
+	fsal_export_init(&export->export);
+	export_ops_init(&export->export.exp_ops);
+
+	/* get params for this export, if any */
+	if (parse_node) {
+		rc = load_config_from_node(parse_node,
+					   &export_param_block,
+					   export,
+					   true,
+					   err_type);
+		if (rc != 0) {
+			gsh_free(export);
+			return fsalstat(ERR_FSAL_INVAL, 0);
+		}
+	}
+
+	if (export->cmount_path == NULL)
+		export->cmount_path = gsh_strdup("/");
+
+	relpath = ceph_mount_relpath(export->cmount_path,
+				     op_ctx->ctx_export->fullpath);
+	if (relpath == NULL) {
+		LogCrit(COMPONENT_FSAL,
+			"Export path %s is not below cmount_path %s.",
+			op_ctx->ctx_export->fullpath, export->cmount_path);
+		gsh_free(export);
+		return fsalstat(ERR_FSAL_INVAL, 0);
+	}
+
+	export->cm = ceph_mount_get(export, &status);
+	if (export->cm == NULL)
+		goto error;
+	export->cmount = export->cm->cmount;
+
 	enable_delegations(export);
 
 	if (fsal_attach_export(module_in, &export->export.exports) != 0) {
@@ -399,6 +628,7 @@ static fsal_status_t create_export(struct fsal_module *module_in,
 			op_ctx->ctx_export->fullpath);
 		goto error;
 	}
+	attached = true;
 
 	export->export.fsal = module_in;
 	export->export.up_ops = up_ops;
@@ -406,14 +636,21 @@ static fsal_status_t create_export(struct fsal_module *module_in,
 	LogDebug(COMPONENT_FSAL, "Ceph module export %s.",
 		 op_ctx->ctx_export->fullpath);
 
-	status = find_cephfs_root(export->cmount, &i);
-	if (FSAL_IS_ERROR(status))
-		goto error;
-
-	rc = fsal_ceph_ll_getattr(export->cmount, i, &stx,
-				CEPH_STATX_HANDLE_MASK, op_ctx->creds);
+	if (relpath[0] == '\0' || strcmp(relpath, "/") == 0) {
+		status = find_cephfs_root(export->cmount, &i);
+		if (FSAL_IS_ERROR(status))
+			goto error;
+		rc = fsal_ceph_ll_getattr(export->cmount, i, &stx,
+					CEPH_STATX_HANDLE_MASK, op_ctx->creds);
+	} else {
+		rc = fsal_ceph_ll_walk(export->cmount, relpath, &i, &stx,
+				       CEPH_STATX_HANDLE_MASK, op_ctx->creds);
+	}
 	if (rc < 0) {
 		status = ceph2fsal_error(rc);
+		LogCrit(COMPONENT_FSAL,
+			"Unable to find export root %s: %d",
+			op_ctx->ctx_export->fullpath, rc);
 		goto error;
 	}
 
@@ -428,11 +665,12 @@ static fsal_status_t create_export(struct fsal_module *module_in,
 	if (i)
 		ceph_ll_put(export->cmount, i);
 
-	if (export) {
-		if (export->cmount)
-			ceph_shutdown(export->cmount);
-		gsh_free(export);
-	}
+	if (attached)
+		fsal_detach_export(module_in, &export->export.exports);
+
+	if (export->cm)
+		ceph_mount_put(export->cm);
+	gsh_free(export);
 	return status;
 }
 
@@ -460,6 +698,9 @@ MODULE_INIT void init(void)
 			"Ceph module failed to register.");
 	}
 
+	PTHREAD_MUTEX_init(&CephFSM.mounts_lock, NULL);
+	glist_init(&CephFSM.mounts);
+
 	/* Set up module operations */
 #ifdef CEPH_PNFS
 	myself->m_ops.fsal_pnfs_ds_ops = pnfs_ds_ops_init;
@@ -484,9 +725,24 @@ MODULE_FINI void finish(void)
 	LogDebug(COMPONENT_FSAL,
 		 "Ceph module finishing.");
 
+	if (CephFSM.io_fridge != NULL) {
+		int rc = fridgethr_sync_command(CephFSM.io_fridge,
+						fridgethr_comm_stop, 120);
+
+		if (rc == ETIMEDOUT) {
+			LogMajor(COMPONENT_FSAL,
+				 "Shutdown timed out, cancelling threads.");
+			fridgethr_cancel(CephFSM.io_fridge);
+		}
+		fridgethr_destroy(CephFSM.io_fridge);
+		CephFSM.io_fridge = NULL;
+	}
+
 	if (unregister_fsal(&CephFSM.fsal) != 0) {
 		LogCrit(COMPONENT_FSAL,
 			"Unable to unload Ceph FSAL.  Dying with extreme prejudice.");
 		abort();
 	}
+
+	PTHREAD_MUTEX_destroy(&CephFSM.mounts_lock);
 }
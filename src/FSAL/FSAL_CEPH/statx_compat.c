@@ -51,7 +51,7 @@ static void posix2ceph_statx(struct stat *st, struct ceph_statx *stx)
 }
 
 int fsal_ceph_ll_walk(struct ceph_mount_info *cmount, const char *name,
-			Inode **i, struct ceph_statx *stx, bool full,
+			Inode **i, struct ceph_statx *stx, unsigned int want,
 			const struct user_cred *cred)
 {
 	int		rc;
@@ -79,7 +79,7 @@ int fsal_ceph_ll_getattr(struct ceph_mount_info *cmount, struct Inode *in,
 
 int fsal_ceph_ll_lookup(struct ceph_mount_info *cmount, Inode *parent,
 			const char *name, Inode **out, struct ceph_statx *stx,
-			bool full, const struct user_cred *cred)
+			unsigned int want, const struct user_cred *cred)
 {
 	int		rc;
 	struct stat	st;
@@ -93,7 +93,7 @@ int fsal_ceph_ll_lookup(struct ceph_mount_info *cmount, Inode *parent,
 
 int fsal_ceph_ll_mkdir(struct ceph_mount_info *cmount, Inode *parent,
 			const char *name, mode_t mode, Inode **out,
-			struct ceph_statx *stx, bool full,
+			struct ceph_statx *stx, unsigned int want,
 			const struct user_cred *cred)
 {
 	int		rc;
@@ -109,7 +109,7 @@ int fsal_ceph_ll_mkdir(struct ceph_mount_info *cmount, Inode *parent,
 #ifdef USE_FSAL_CEPH_MKNOD
 int fsal_ceph_ll_mknod(struct ceph_mount_info *cmount, Inode *parent,
 			const char *name, mode_t mode, dev_t rdev,
-			Inode **out, struct ceph_statx *stx, bool full,
+			Inode **out, struct ceph_statx *stx, unsigned int want,
 			const struct user_cred *cred)
 {
 	int		rc;
@@ -125,7 +125,7 @@ int fsal_ceph_ll_mknod(struct ceph_mount_info *cmount, Inode *parent,
 
 int fsal_ceph_ll_symlink(struct ceph_mount_info *cmount, Inode *parent,
 			const char *name, const char *link_path,
-			Inode **out, struct ceph_statx *stx, bool full,
+			Inode **out, struct ceph_statx *stx, unsigned int want,
 			const struct user_cred *cred)
 {
 	int		rc;
@@ -141,7 +141,7 @@ int fsal_ceph_ll_symlink(struct ceph_mount_info *cmount, Inode *parent,
 int fsal_ceph_ll_create(struct ceph_mount_info *cmount, Inode *parent,
 			const char *name, mode_t mode, int oflags,
 			Inode **outp, Fh **fhp, struct ceph_statx *stx,
-			bool full, const struct user_cred *cred)
+			unsigned int want, const struct user_cred *cred)
 {
 	int		rc;
 	struct stat	st;
@@ -195,7 +195,7 @@ int fsal_ceph_readdirplus(struct ceph_mount_info *cmount,
 		posix2ceph_statx(&st, stx);
 	} else {
 		rc = fsal_ceph_ll_lookup(cmount, dir, de->d_name, out, stx,
-					 true, cred);
+					 want, cred);
 		if (rc >= 0)
 			rc = 1;
 	}
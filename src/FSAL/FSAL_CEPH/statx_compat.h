@@ -30,7 +30,9 @@
 /*
  * Depending on what we'll be doing with the resulting statx structure, we
  * either set the mask for the minimum that construct_handle requires, or a
- * full set of attributes.
+ * full set of attributes. Callers that know which attributes they want pass
+ * a narrower mask built by ceph_statx_want(), so that libcephfs need not
+ * acquire caps (e.g. for size or mtime) nobody is going to look at.
  *
  * Note that even though construct_handle accesses the stx_mode field, we
  * don't need to request CEPH_STATX_MODE here, as the type bits are always
@@ -51,7 +53,7 @@ user_cred2ceph(const struct user_cred *cred)
 
 static inline int
 fsal_ceph_ll_walk(struct ceph_mount_info *cmount, const char *name,
-			Inode **i, struct ceph_statx *stx, bool full,
+			Inode **i, struct ceph_statx *stx, unsigned int want,
 			const struct user_cred *creds)
 {
 	int ret;
@@ -61,7 +63,7 @@ fsal_ceph_ll_walk(struct ceph_mount_info *cmount, const char *name,
 		return -ENOMEM;
 
 	ret = ceph_ll_walk(cmount, name, i, stx,
-		full ? CEPH_STATX_ATTR_MASK : CEPH_STATX_HANDLE_MASK, 0, perms);
+		want, 0, perms);
 	ceph_userperm_destroy(perms);
 	return ret;
 }
@@ -85,7 +87,7 @@ fsal_ceph_ll_getattr(struct ceph_mount_info *cmount, struct Inode *in,
 static inline int
 fsal_ceph_ll_lookup(struct ceph_mount_info *cmount, Inode *parent,
 			const char *name, Inode **out, struct ceph_statx *stx,
-			bool full, const struct user_cred *creds)
+			unsigned int want, const struct user_cred *creds)
 {
 	int ret;
 	UserPerm *perms = user_cred2ceph(creds);
@@ -94,8 +96,7 @@ fsal_ceph_ll_lookup(struct ceph_mount_info *cmount, Inode *parent,
 		return -ENOMEM;
 
 	ret = ceph_ll_lookup(cmount, parent, name, out, stx,
-			full ? CEPH_STATX_ATTR_MASK : CEPH_STATX_HANDLE_MASK,
-			0, perms);
+			want, 0, perms);
 	ceph_userperm_destroy(perms);
 	return ret;
 }
@@ -103,7 +104,7 @@ fsal_ceph_ll_lookup(struct ceph_mount_info *cmount, Inode *parent,
 static inline int
 fsal_ceph_ll_mkdir(struct ceph_mount_info *cmount, Inode *parent,
 			const char *name, mode_t mode, Inode **out,
-			struct ceph_statx *stx, bool full,
+			struct ceph_statx *stx, unsigned int want,
 			const struct user_cred *creds)
 {
 	int ret;
@@ -113,8 +114,7 @@ fsal_ceph_ll_mkdir(struct ceph_mount_info *cmount, Inode *parent,
 		return -ENOMEM;
 
 	ret = ceph_ll_mkdir(cmount, parent, name, mode, out, stx,
-			full ? CEPH_STATX_ATTR_MASK : CEPH_STATX_HANDLE_MASK,
-			0, perms);
+			want, 0, perms);
 	ceph_userperm_destroy(perms);
 	return ret;
 }
@@ -122,7 +122,7 @@ fsal_ceph_ll_mkdir(struct ceph_mount_info *cmount, Inode *parent,
 static inline int
 fsal_ceph_ll_mknod(struct ceph_mount_info *cmount, Inode *parent,
 			const char *name, mode_t mode, dev_t rdev,
-			Inode **out, struct ceph_statx *stx, bool full,
+			Inode **out, struct ceph_statx *stx, unsigned int want,
 			const struct user_cred *creds)
 {
 	int ret;
@@ -132,8 +132,7 @@ fsal_ceph_ll_mknod(struct ceph_mount_info *cmount, Inode *parent,
 		return -ENOMEM;
 
 	ret = ceph_ll_mknod(cmount, parent, name, mode, rdev, out, stx,
-			full ? CEPH_STATX_ATTR_MASK : CEPH_STATX_HANDLE_MASK,
-			0, perms);
+			want, 0, perms);
 	ceph_userperm_destroy(perms);
 	return ret;
 }
@@ -141,7 +140,7 @@ fsal_ceph_ll_mknod(struct ceph_mount_info *cmount, Inode *parent,
 static inline int
 fsal_ceph_ll_symlink(struct ceph_mount_info *cmount, Inode *parent,
 			const char *name, const char *link_path,
-			Inode **out, struct ceph_statx *stx, bool full,
+			Inode **out, struct ceph_statx *stx, unsigned int want,
 			const struct user_cred *creds)
 {
 	int ret;
@@ -151,8 +150,7 @@ fsal_ceph_ll_symlink(struct ceph_mount_info *cmount, Inode *parent,
 		return -ENOMEM;
 
 	ret = ceph_ll_symlink(cmount, parent, name, link_path, out, stx,
-			full ? CEPH_STATX_ATTR_MASK : CEPH_STATX_HANDLE_MASK,
-			0, perms);
+			want, 0, perms);
 	ceph_userperm_destroy(perms);
 	return ret;
 }
@@ -176,7 +174,7 @@ static inline int
 fsal_ceph_ll_create(struct ceph_mount_info *cmount, Inode *parent,
 			const char *name, mode_t mode, int oflags,
 			Inode **outp, Fh **fhp, struct ceph_statx *stx,
-			bool full, const struct user_cred *creds)
+			unsigned int want, const struct user_cred *creds)
 {
 	int ret;
 	UserPerm *perms = user_cred2ceph(creds);
@@ -185,9 +183,7 @@ fsal_ceph_ll_create(struct ceph_mount_info *cmount, Inode *parent,
 		return -ENOMEM;
 
 	ret = ceph_ll_create(cmount, parent, name, mode, oflags, outp,
-			fhp, stx,
-			full ? CEPH_STATX_ATTR_MASK : CEPH_STATX_HANDLE_MASK,
-			0, perms);
+			fhp, stx, want, 0, perms);
 	ceph_userperm_destroy(perms);
 	return ret;
 }
@@ -402,32 +398,32 @@ struct ceph_statx {
 #define CEPH_STATX_ALL_STATS	0x00001fffU     /* All supported stats */
 
 int fsal_ceph_ll_walk(struct ceph_mount_info *cmount, const char *name,
-			Inode **i, struct ceph_statx *stx, bool full,
+			Inode **i, struct ceph_statx *stx, unsigned int want,
 			const struct user_cred *cred);
 int fsal_ceph_ll_getattr(struct ceph_mount_info *cmount, struct Inode *in,
 			struct ceph_statx *stx, unsigned int want,
 			const struct user_cred *cred);
 int fsal_ceph_ll_lookup(struct ceph_mount_info *cmount, Inode *parent,
 			const char *name, Inode **out, struct ceph_statx *stx,
-			bool full, const struct user_cred *cred);
+			unsigned int want, const struct user_cred *cred);
 int fsal_ceph_ll_mkdir(struct ceph_mount_info *cmount, Inode *parent,
 			const char *name, mode_t mode, Inode **out,
-			struct ceph_statx *stx, bool full,
+			struct ceph_statx *stx, unsigned int want,
 			const struct user_cred *cred);
 #ifdef USE_FSAL_CEPH_MKNOD
 int fsal_ceph_ll_mknod(struct ceph_mount_info *cmount, Inode *parent,
 			const char *name, mode_t mode, dev_t rdev,
-			Inode **out, struct ceph_statx *stx, bool full,
+			Inode **out, struct ceph_statx *stx, unsigned int want,
 			const struct user_cred *cred);
 #endif /* USE_FSAL_CEPH_MKNOD */
 int fsal_ceph_ll_symlink(struct ceph_mount_info *cmount, Inode *parent,
 			const char *name, const char *link_path,
-			Inode **out, struct ceph_statx *stx, bool full,
+			Inode **out, struct ceph_statx *stx, unsigned int want,
 			const struct user_cred *cred);
 int fsal_ceph_ll_create(struct ceph_mount_info *cmount, Inode *parent,
 			const char *name, mode_t mode, int oflags,
 			Inode **outp, Fh **fhp, struct ceph_statx *stx,
-			bool full, const struct user_cred *cred);
+			unsigned int want, const struct user_cred *cred);
 int fsal_ceph_ll_setattr(struct ceph_mount_info *cmount, Inode *i,
 			 struct ceph_statx *stx, unsigned int mask,
 			 const struct user_cred *cred);
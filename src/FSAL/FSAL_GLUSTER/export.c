@@ -496,6 +496,7 @@ struct glexport_params {
 	char *glvolpath;
 	char *glfs_log;
 	uint64_t up_poll_usec;
+	uint32_t upcall_queue_depth;
 	bool enable_upcall;
 	enum transport gltransport;
 };
@@ -518,6 +519,8 @@ static struct config_item export_params[] = {
 		       glexport_params, glfs_log),
 	CONF_ITEM_UI64("up_poll_usec", 1, 60*1000*1000, 10,
 		       glexport_params, up_poll_usec),
+	CONF_ITEM_UI32("upcall_queue_depth", 1, 1024 * 1024, 1024,
+		       glexport_params, upcall_queue_depth),
 	CONF_ITEM_BOOL("enable_upcall", true, glexport_params,
 		       enable_upcall),
 	CONF_ITEM_TOKEN("transport", GLUSTER_TCP_VOL, transportformats,
@@ -570,21 +573,9 @@ glusterfs_free_fs(struct glusterfs_fs *gl_fs)
 	/* Cancel upcall readiness if not yet done */
 	up_ready_cancel((struct fsal_up_vector *)gl_fs->up_ops);
 
-#ifndef USE_GLUSTER_UPCALL_REGISTER
-	int *retval = NULL;
-	/* Wait for up_thread to exit */
-	err = pthread_join(gl_fs->up_thread, (void **)&retval);
-
-	if (retval && *retval) {
-		LogDebug(COMPONENT_FSAL, "Up_thread join returned value %d",
-			 *retval);
-	}
+	/* Release a callback waiting for room, and up_thread */
+	gluster_upq_shutdown(gl_fs);
 
-	if (err) {
-		LogWarn(COMPONENT_FSAL, "Up_thread join failed (%s)",
-			strerror(err));
-	}
-#else
 	err = glfs_upcall_unregister(gl_fs->fs, GLFS_EVENT_ANY);
 
 	if ((err < 0) || (!(err & GLFS_EVENT_INODE_INVALIDATE))) {
@@ -594,7 +585,14 @@ glusterfs_free_fs(struct glusterfs_fs *gl_fs)
 			"Unable to unregister for upcalls. Volume: %s",
 			gl_fs->volname);
 	}
-#endif
+
+	/* Wait for up_thread to exit */
+	err = pthread_join(gl_fs->up_thread, NULL);
+	if (err) {
+		LogWarn(COMPONENT_FSAL, "Up_thread join failed (%s)",
+			strerror(err));
+	}
+	gluster_upq_destroy(gl_fs);
 
 skip_upcall:
 	/* Gluster and memory cleanup */
@@ -675,7 +673,6 @@ glusterfs_get_fs(struct glexport_params params,
 	gl_fs->fs = fs;
 	gl_fs->volname = strdup(params.glvolname);
 	gl_fs->destroy_mode = 0;
-	gl_fs->up_poll_usec = params.up_poll_usec;
 
 	gl_fs->up_ops = up_ops;
 
@@ -684,15 +681,27 @@ glusterfs_get_fs(struct glexport_params params,
 	if (!gl_fs->enable_upcall)
 		goto skip_upcall;
 
-#ifndef USE_GLUSTER_UPCALL_REGISTER
+	rc = glfs_get_volumeid(fs, gl_fs->vol_uuid, GLAPI_UUID_LENGTH);
+	if (rc < 0) {
+		LogCrit(COMPONENT_FSAL,
+			"Unable to get volume id. Volume: %s",
+			params.glvolname);
+		goto out;
+	}
+
+	/* The gfapi callback queues what to invalidate, up_thread does
+	 * it.
+	 */
+	gluster_upq_init(gl_fs, params.upcall_queue_depth);
 	rc = initiate_up_thread(gl_fs);
 	if (rc != 0) {
 		LogCrit(COMPONENT_FSAL,
 			"Unable to create GLUSTERFSAL_UP_Thread. Volume: %s",
 			params.glvolname);
+		gluster_upq_destroy(gl_fs);
 		goto out;
 	}
-#else
+
 	/* We are mainly interested in INODE_INVALIDATE for now. Still
 	 * register for all the events
 	 */
@@ -705,9 +714,12 @@ glusterfs_get_fs(struct glexport_params params,
 		LogCrit(COMPONENT_FSAL,
 			"Unable to register for upcalls. Volume: %s",
 			params.glvolname);
+		atomic_inc_int8_t(&gl_fs->destroy_mode);
+		gluster_upq_shutdown(gl_fs);
+		(void)pthread_join(gl_fs->up_thread, NULL);
+		gluster_upq_destroy(gl_fs);
 		goto out;
 	}
-#endif
 
 skip_upcall:
 	glist_add(&GlusterFS.fs_obj, &gl_fs->fs_obj);
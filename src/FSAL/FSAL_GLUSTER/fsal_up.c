@@ -32,71 +32,195 @@
 #include "fsal_up.h"
 #include "gluster_internal.h"
 #include "fsal_convert.h"
+#include "export_mgr.h"
+#include "mdcache.h"
 #include <sys/types.h>
 #include <unistd.h>
 #include <utime.h>
 #include <sys/time.h>
 
-int upcall_inode_invalidate(struct glusterfs_fs *gl_fs,
-			     struct glfs_object *object)
-{
-	int	     rc                             = -1;
-	glfs_t          *fs                         = NULL;
-	char            vol_uuid[GLAPI_UUID_LENGTH] = {'\0'};
-	unsigned char   globjhdl[GLAPI_HANDLE_LENGTH];
-	struct gsh_buffdesc         key;
-	const struct fsal_up_vector *event_func;
-	fsal_status_t fsal_status = {0, 0};
+/** Keys up_thread takes from the queue at once */
+#define GLUSTER_UPQ_BATCH 64
 
-	fs = gl_fs->fs;
-	if (!fs) {
-		LogCrit(COMPONENT_FSAL_UP,
-			"Invalid fs object of the glusterfs_fs(%p)",
-			 gl_fs);
-		goto out;
-	}
+/*
+ * gfapi calls gluster_process_upcall() on its own event thread.  So
+ * that a slow invalidate doesn't hold gluster back, the callback only
+ * turns the objects into cache keys and queues them; the volume's
+ * up_thread takes them in batches and invalidates them.  The queue is
+ * bounded by upcall_queue_depth.  The callback never waits: gluster's
+ * event thread is also the one that completes the glfs_close an
+ * invalidate may be waiting on.  Once the queue is full, further keys
+ * are dropped and up_thread invalidates the whole export instead.
+ */
 
-	rc = glfs_h_extract_handle(object, globjhdl+GLAPI_UUID_LENGTH,
+/**
+ * @brief Make the cache key of a gluster object
+ *
+ * @param[in]  gl_fs	Volume of the object
+ * @param[in]  object	Object
+ * @param[out] key	GLAPI_HANDLE_LENGTH bytes
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+static int upcall_make_key(struct glusterfs_fs *gl_fs,
+			   struct glfs_object *object, unsigned char *key)
+{
+	int rc;
+
+	rc = glfs_h_extract_handle(object, key + GLAPI_UUID_LENGTH,
 				   GFAPI_HANDLE_LENGTH);
 	if (rc < 0) {
 		LogDebug(COMPONENT_FSAL_UP,
 			 "glfs_h_extract_handle failed %p",
-			 fs);
-		goto out;
-	}
-
-	rc = glfs_get_volumeid(fs, vol_uuid,
-			       GLAPI_UUID_LENGTH);
-	if (rc < 0) {
-		LogDebug(COMPONENT_FSAL_UP,
-			 "glfs_get_volumeid failed %p",
-			 fs);
-		goto out;
+			 gl_fs->fs);
+		return -1;
 	}
 
-	memcpy(globjhdl, vol_uuid, GLAPI_UUID_LENGTH);
-	key.addr = &globjhdl;
-	key.len = GLAPI_HANDLE_LENGTH;
+	memcpy(key, gl_fs->vol_uuid, GLAPI_UUID_LENGTH);
+	return 0;
+}
 
-	LogDebug(COMPONENT_FSAL_UP, "Received event to process for %p",
-		 fs);
+/**
+ * @brief Invalidate the cache entry of a key
+ *
+ * @param[in] gl_fs	Volume of the object
+ * @param[in] globjhdl	Key, GLAPI_HANDLE_LENGTH bytes
+ *
+ * @return 0 or the FSAL error.
+ */
+static int upcall_invalidate_key(struct glusterfs_fs *gl_fs,
+				 unsigned char *globjhdl)
+{
+	struct gsh_buffdesc         key;
+	const struct fsal_up_vector *event_func = gl_fs->up_ops;
+	fsal_status_t fsal_status;
 
-	event_func = gl_fs->up_ops;
+	key.addr = globjhdl;
+	key.len = GLAPI_HANDLE_LENGTH;
 
 	fsal_status = event_func->invalidate_close(
 					event_func,
 					&key,
 					FSAL_UP_INVALIDATE_CACHE);
 
-	rc = fsal_status.major;
 	if (FSAL_IS_ERROR(fsal_status) && fsal_status.major != ERR_FSAL_NOENT) {
 		LogWarn(COMPONENT_FSAL_UP,
 			"Inode_Invalidate event could not be processed for fd %p, rc %d",
-			gl_fs->fs, rc);
+			gl_fs->fs, fsal_status.major);
+	}
+
+	return fsal_status.major;
+}
+
+int upcall_inode_invalidate(struct glusterfs_fs *gl_fs,
+			     struct glfs_object *object)
+{
+	unsigned char   globjhdl[GLAPI_HANDLE_LENGTH];
+
+	if (!gl_fs->fs) {
+		LogCrit(COMPONENT_FSAL_UP,
+			"Invalid fs object of the glusterfs_fs(%p)",
+			 gl_fs);
+		return -1;
+	}
+
+	if (upcall_make_key(gl_fs, object, globjhdl) != 0)
+		return -1;
+
+	LogDebug(COMPONENT_FSAL_UP, "Received event to process for %p",
+		 gl_fs->fs);
+
+	return upcall_invalidate_key(gl_fs, globjhdl);
+}
+
+/**
+ * @brief Set up the invalidate queue of a volume
+ *
+ * @param[in] gl_fs	Volume
+ * @param[in] depth	Most keys queued
+ */
+void gluster_upq_init(struct glusterfs_fs *gl_fs, uint32_t depth)
+{
+	PTHREAD_MUTEX_init(&gl_fs->upq.mtx, NULL);
+	PTHREAD_COND_init(&gl_fs->upq.more, NULL);
+	gl_fs->upq.keys = gsh_calloc(depth, GLAPI_HANDLE_LENGTH);
+	gl_fs->upq.depth = depth;
+	gl_fs->upq.head = 0;
+	gl_fs->upq.count = 0;
+	gl_fs->upq.overflow = false;
+}
+
+/**
+ * @brief Wake up_thread to see destroy_mode
+ *
+ * @param[in] gl_fs	Volume being torn down
+ */
+void gluster_upq_shutdown(struct glusterfs_fs *gl_fs)
+{
+	PTHREAD_MUTEX_lock(&gl_fs->upq.mtx);
+	pthread_cond_broadcast(&gl_fs->upq.more);
+	PTHREAD_MUTEX_unlock(&gl_fs->upq.mtx);
+}
+
+/**
+ * @brief Free the invalidate queue, once up_thread is gone
+ *
+ * @param[in] gl_fs	Volume
+ */
+void gluster_upq_destroy(struct glusterfs_fs *gl_fs)
+{
+	PTHREAD_COND_destroy(&gl_fs->upq.more);
+	PTHREAD_MUTEX_destroy(&gl_fs->upq.mtx);
+	gsh_free(gl_fs->upq.keys);
+	gl_fs->upq.keys = NULL;
+}
+
+/**
+ * @brief Queue an object for up_thread to invalidate
+ *
+ * Never waits.  An object queued last already is not queued again;
+ * nothing is queued once the queue is full or has overflowed, and
+ * up_thread is told to invalidate everything instead.
+ *
+ * @param[in] gl_fs	Volume of the object
+ * @param[in] object	Object
+ */
+static void upq_add(struct glusterfs_fs *gl_fs, struct glfs_object *object)
+{
+	unsigned char key[GLAPI_HANDLE_LENGTH];
+	uint32_t tail;
+
+	if (upcall_make_key(gl_fs, object, key) != 0)
+		return;
+
+	PTHREAD_MUTEX_lock(&gl_fs->upq.mtx);
+
+	if (gl_fs->upq.overflow || atomic_fetch_int8_t(&gl_fs->destroy_mode))
+		goto out;
+
+	if (gl_fs->upq.count != 0) {
+		tail = (gl_fs->upq.head + gl_fs->upq.count - 1) %
+		       gl_fs->upq.depth;
+		if (memcmp(gl_fs->upq.keys[tail], key, sizeof(key)) == 0)
+			goto out;
 	}
 
+	if (gl_fs->upq.count == gl_fs->upq.depth) {
+		LogInfo(COMPONENT_FSAL_UP,
+			"Upcall queue of %s full, invalidating all of it",
+			gl_fs->volname);
+		gl_fs->upq.overflow = true;
+		pthread_cond_signal(&gl_fs->upq.more);
+		goto out;
+	}
+
+	tail = (gl_fs->upq.head + gl_fs->upq.count) % gl_fs->upq.depth;
+	memcpy(gl_fs->upq.keys[tail], key, sizeof(key));
+	gl_fs->upq.count++;
+	pthread_cond_signal(&gl_fs->upq.more);
+
 out:
-	return rc;
+	PTHREAD_MUTEX_unlock(&gl_fs->upq.mtx);
 }
 
 void *GLUSTERFSAL_UP_Thread(void *Arg)
@@ -104,16 +228,8 @@ void *GLUSTERFSAL_UP_Thread(void *Arg)
 	struct glusterfs_fs         *gl_fs              = Arg;
 	struct fsal_up_vector *event_func;
 	char                        thr_name[16];
-	int                         rc                  = 0;
-	struct glfs_upcall          *cbk                = NULL;
-	struct glfs_upcall_inode    *in_arg             = NULL;
-	enum glfs_upcall_reason     reason              = 0;
-	int                         retry               = 0;
-	int                         errsv               = 0;
-	struct glfs_object          *object             = NULL;
-	struct glfs_object          *p_object           = NULL;
-	struct glfs_object          *oldp_object        = NULL;
-
+	unsigned char batch[GLUSTER_UPQ_BATCH][GLAPI_HANDLE_LENGTH];
+	uint32_t n, i;
 
 	snprintf(thr_name, sizeof(thr_name),
 		 "fsal_up_%p",
@@ -126,122 +242,60 @@ void *GLUSTERFSAL_UP_Thread(void *Arg)
 	if (event_func == NULL) {
 		LogFatal(COMPONENT_FSAL_UP,
 			 "FSAL up vector does not exist. Can not continue.");
-		gsh_free(Arg);
 		return NULL;
 	}
 
-	LogFullDebug(COMPONENT_FSAL_UP,
-		     "Initializing FSAL Callback context for %p.",
-		     gl_fs->fs);
-
-	if (!gl_fs->fs) {
-		LogCrit(COMPONENT_FSAL_UP,
-			"FSAL Callback interface - Null glfs context.");
-		goto out;
-	}
-
-	/* wait for upcall readiness */
+	/* wait for upcall readiness, events queue up meanwhile */
 	up_ready_wait(event_func);
 
-	/* Start querying for events and processing. */
-	/** @todo : Do batch processing instead */
+	PTHREAD_MUTEX_lock(&gl_fs->upq.mtx);
 	while (!atomic_fetch_int8_t(&gl_fs->destroy_mode)) {
-		LogFullDebug(COMPONENT_FSAL_UP,
-			     "Requesting event from FSAL Callback interface for %p.",
-			     gl_fs->fs);
-
-		reason = 0;
-
-		rc = glfs_h_poll_upcall(gl_fs->fs, &cbk);
-		errsv = errno;
-
-		if (rc != 0) {
-			/* if ENOMEM retry for couple of times
-			 * and then exit
-			 */
-			if ((errsv == ENOMEM) && (retry < 10)) {
-				sleep(1);
-				retry++;
-				continue;
-			} else {
-				switch (errsv) {
-				case ENOMEM:
-					LogMajor(COMPONENT_FSAL_UP,
-						 "Memory allocation failed during poll_upcall for (%p).",
-						 gl_fs->fs);
-					abort();
-
-				case ENOTSUP:
-					LogEvent(COMPONENT_FSAL_UP,
-						 "Upcall feature is not supported for (%p).",
-						 gl_fs->fs);
-					break;
-				default:
-					LogCrit(COMPONENT_FSAL_UP,
-						"Poll upcall failed for %p. rc %d errno %d (%s) reason %d",
-						gl_fs->fs, rc, errsv,
-						strerror(errsv), reason);
-				}
-				return NULL;
-			}
-		}
+		if (gl_fs->upq.overflow) {
+			/* What was queued is covered by the whole export */
+			gl_fs->upq.overflow = false;
+			gl_fs->upq.head = 0;
+			gl_fs->upq.count = 0;
+			PTHREAD_MUTEX_unlock(&gl_fs->upq.mtx);
 
-		retry = 0;
-
-		LogFullDebug(COMPONENT_FSAL_UP,
-			     "Received upcall event: reason(%d)",
-			     reason);
+			(void)mdcache_export_invalidate(
+						event_func->up_gsh_export);
 
-		if (!cbk) {
-			usleep(gl_fs->up_poll_usec);
+			PTHREAD_MUTEX_lock(&gl_fs->upq.mtx);
 			continue;
 		}
 
-		reason = glfs_upcall_get_reason(cbk);
-		/* Decide what type of event this is
-		 * inode update / invalidate? */
-		switch (reason) {
-		case GLFS_UPCALL_EVENT_NULL:
-			usleep(gl_fs->up_poll_usec);
-			continue;
-		case GLFS_UPCALL_INODE_INVALIDATE:
-			in_arg = glfs_upcall_get_event(cbk);
-
-			if (!in_arg) {
-				/* Could be ENOMEM issues. continue */
-				LogWarn(COMPONENT_FSAL_UP,
-					"Received NULL upcall event arg");
-				break;
-			}
-
-			object = glfs_upcall_inode_get_object(in_arg);
-			if (object)
-				upcall_inode_invalidate(gl_fs, object);
-			p_object = glfs_upcall_inode_get_pobject(in_arg);
-			if (p_object)
-				upcall_inode_invalidate(gl_fs, p_object);
-			oldp_object = glfs_upcall_inode_get_oldpobject(in_arg);
-			if (oldp_object)
-				upcall_inode_invalidate(gl_fs, oldp_object);
-			break;
-		default:
-			LogWarn(COMPONENT_FSAL_UP, "Unknown event: %d", reason);
+		if (gl_fs->upq.count == 0) {
+			pthread_cond_wait(&gl_fs->upq.more, &gl_fs->upq.mtx);
 			continue;
 		}
-		if (cbk) {
-			glfs_free(cbk);
-			cbk = NULL;
+
+		for (n = 0; n < GLUSTER_UPQ_BATCH && gl_fs->upq.count != 0;
+		     n++) {
+			memcpy(batch[n], gl_fs->upq.keys[gl_fs->upq.head],
+			       GLAPI_HANDLE_LENGTH);
+			gl_fs->upq.head = (gl_fs->upq.head + 1) %
+					  gl_fs->upq.depth;
+			gl_fs->upq.count--;
 		}
+		PTHREAD_MUTEX_unlock(&gl_fs->upq.mtx);
+
+		LogFullDebug(COMPONENT_FSAL_UP,
+			     "Invalidating %" PRIu32 " objects of %p",
+			     n, gl_fs->fs);
+
+		for (i = 0; i < n; i++)
+			(void)upcall_invalidate_key(gl_fs, batch[i]);
+
+		PTHREAD_MUTEX_lock(&gl_fs->upq.mtx);
 	}
+	PTHREAD_MUTEX_unlock(&gl_fs->upq.mtx);
 
-out:
 	return NULL;
 }				/* GLUSTERFSFSAL_UP_Thread */
 
 void gluster_process_upcall(struct glfs_upcall *cbk, void *data)
 {
 	struct glusterfs_fs         *gl_fs              = data;
-	struct fsal_up_vector *event_func;
 	struct glfs_upcall_inode    *in_arg             = NULL;
 	enum glfs_upcall_reason     reason              = 0;
 	struct glfs_object          *object             = NULL;
@@ -253,24 +307,12 @@ void gluster_process_upcall(struct glfs_upcall *cbk, void *data)
 		return;
 	}
 
-	/* Set the FSAL UP functions that will be used to process events. */
-	event_func = (struct fsal_up_vector *)gl_fs->up_ops;
-
-	if (!event_func) {
-		LogFatal(COMPONENT_FSAL_UP,
-			 "FSAL up vector does not exist. Can not continue.");
-		goto out;
-	}
-
 	if (!gl_fs->fs) {
 		LogCrit(COMPONENT_FSAL_UP,
 			"FSAL Callback interface - Null glfs context.");
 		goto out;
 	}
 
-	/* wait for upcall readiness */
-	up_ready_wait(event_func);
-
 	reason = glfs_upcall_get_reason(cbk);
 
 	/* Decide what type of event this is
@@ -288,15 +330,15 @@ void gluster_process_upcall(struct glfs_upcall *cbk, void *data)
 
 		object = glfs_upcall_inode_get_object(in_arg);
 		if (object)
-			upcall_inode_invalidate(gl_fs, object);
+			upq_add(gl_fs, object);
 
 		p_object = glfs_upcall_inode_get_pobject(in_arg);
 		if (p_object)
-			upcall_inode_invalidate(gl_fs, p_object);
+			upq_add(gl_fs, p_object);
 
 		oldp_object = glfs_upcall_inode_get_oldpobject(in_arg);
 		if (oldp_object)
-			upcall_inode_invalidate(gl_fs, oldp_object);
+			upq_add(gl_fs, oldp_object);
 		break;
 	default:
 		LogWarn(COMPONENT_FSAL_UP, "Unknown event: %d", reason);
@@ -127,6 +127,9 @@ struct glusterfs_fsal_module {
 	struct fsal_obj_ops handle_ops;
 	struct glist_head  fs_obj; /* list of glusterfs_fs filesystem objects */
 	pthread_mutex_t   lock; /* lock to protect above list */
+	uint32_t async_io_threads;
+	/** Completes the async I/Os, NULL if they are off */
+	struct fridgethr *io_fridge;
 };
 extern struct glusterfs_fsal_module GlusterFS;
 
@@ -138,8 +141,20 @@ struct glusterfs_fs {
 	int64_t    refcnt;
 	pthread_t  up_thread; /* upcall thread */
 	int8_t destroy_mode;
-	uint64_t up_poll_usec;
 	bool   enable_upcall;
+	char vol_uuid[GLAPI_UUID_LENGTH];	/*< Volume id, key prefix */
+	/** Handles to invalidate, queued by the gfapi upcall callback
+	    for up_thread, see fsal_up.c */
+	struct {
+		pthread_mutex_t mtx;
+		pthread_cond_t more;	/*< Signalled when keys are queued */
+		unsigned char (*keys)[GLAPI_HANDLE_LENGTH];
+		uint32_t depth;		/*< Room in keys */
+		uint32_t head;		/*< Oldest queued key */
+		uint32_t count;		/*< Keys queued */
+		bool overflow;		/*< Keys were dropped, invalidate
+					    everything */
+	} upq;
 };
 
 struct glusterfs_export {
@@ -308,6 +323,9 @@ nfsstat4 getdeviceinfo(struct fsal_module *fsal_hdl,
 /* UP thread routines */
 void *GLUSTERFSAL_UP_Thread(void *Arg);
 int initiate_up_thread(struct glusterfs_fs *gl_fs);
+void gluster_upq_init(struct glusterfs_fs *gl_fs, uint32_t depth);
+void gluster_upq_shutdown(struct glusterfs_fs *gl_fs);
+void gluster_upq_destroy(struct glusterfs_fs *gl_fs);
 int upcall_inode_invalidate(struct glusterfs_fs *gl_fs,
 			    struct glfs_object *object);
 void gluster_process_upcall(struct glfs_upcall *cbk, void *data);
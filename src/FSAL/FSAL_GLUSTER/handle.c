@@ -33,6 +33,7 @@
 #include "pnfs_utils.h"
 #include "nfs_exports.h"
 #include "sal_data.h"
+#include "fridgethr.h"
 
 /* fsal_obj_handle common methods
  */
@@ -1834,6 +1835,147 @@ static fsal_status_t glusterfs_reopen2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/**
+ * An async read or write, from submission to done_cb
+ */
+struct glusterfs_async_io {
+	struct glusterfs_handle *myself;
+	struct glusterfs_fd my_fd;	/*< Ours, closed when done */
+	bool write;
+	ssize_t ret;
+	int err;		/*< errno when ret is -1 */
+	fsal_async_cb done_cb;
+	struct fsal_io_arg *io_arg;
+	void *caller_arg;
+	struct req_op_context ctx;	/*< The caller's, for done_cb */
+};
+
+/**
+ * @brief Finish an async I/O on an I/O thread
+ *
+ * The COMPOUND resumes from done_cb, which must not run on a gfapi
+ * thread.
+ */
+static void glusterfs_async_io_done(struct fridgethr_context *ctx)
+{
+	struct glusterfs_async_io *aio = ctx->arg;
+	struct fsal_io_arg *io_arg = aio->io_arg;
+	struct req_op_context *saved_ctx = op_ctx;
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	size_t total_size = 0;
+	int i;
+
+	if (aio->ret < 0) {
+		status = fsalstat(posix2fsal_error(aio->err), aio->err);
+		if (aio->write)
+			io_arg->fsal_stable = false;
+	} else {
+		io_arg->io_amount = aio->ret;
+		if (!aio->write) {
+			for (i = 0; i < io_arg->iov_count; i++)
+				total_size += io_arg->iov[i].iov_len;
+			io_arg->end_of_file = aio->ret < total_size;
+		}
+	}
+
+	op_ctx = &aio->ctx;
+	glusterfs_close_my_fd(&aio->my_fd);
+	aio->done_cb(&aio->myself->handle, status, io_arg, aio->caller_arg);
+	op_ctx = saved_ctx;
+
+	gsh_free(aio);
+}
+
+/* Called by gfapi once the bricks have answered */
+#ifdef USE_GLUSTER_STAT_FETCH_API
+static void glusterfs_async_io_cb(glfs_fd_t *fd, ssize_t ret,
+				  struct glfs_stat *prestat,
+				  struct glfs_stat *poststat, void *data)
+#else
+static void glusterfs_async_io_cb(glfs_fd_t *fd, ssize_t ret, void *data)
+#endif
+{
+	struct glusterfs_async_io *aio = data;
+	struct fridgethr_context ctx = { .arg = aio };
+
+	aio->ret = ret;
+	aio->err = ret < 0 ? errno : 0;
+
+	if (fridgethr_submit(GlusterFS.io_fridge, glusterfs_async_io_done,
+			     aio) != 0) {
+		/* No thread to hand it to, only when shutting down */
+		glusterfs_async_io_done(&ctx);
+	}
+}
+
+/**
+ * @brief Start a read or write that completes through done_cb
+ *
+ * Done when async I/O is on and the caller can take done_cb from
+ * another thread.  The I/O gets a glfs_dup() of my_fd, or my_fd itself
+ * when that is temporary, so on success the caller drops its locks and
+ * returns at once, without closing my_fd.
+ *
+ * @return true if the I/O was started.
+ */
+static bool glusterfs_async_io_start(struct glusterfs_handle *myself,
+				     struct glusterfs_fd *my_fd,
+				     bool closefd, bool write,
+				     fsal_async_cb done_cb,
+				     struct fsal_io_arg *io_arg,
+				     void *caller_arg)
+{
+	struct glusterfs_async_io *aio;
+	int rc;
+
+	if (GlusterFS.io_fridge == NULL || !op_ctx->async_io)
+		return false;
+
+	aio = gsh_calloc(1, sizeof(*aio));
+	aio->my_fd = *my_fd;
+	if (!closefd) {
+		aio->my_fd.glfd = glfs_dup(my_fd->glfd);
+		if (aio->my_fd.glfd == NULL) {
+			gsh_free(aio);
+			return false;
+		}
+		if (my_fd->creds.caller_glen)
+			aio->my_fd.creds.caller_garray =
+				gsh_memdup(my_fd->creds.caller_garray,
+					   my_fd->creds.caller_glen *
+					   sizeof(gid_t));
+	}
+	aio->myself = myself;
+	aio->write = write;
+	aio->done_cb = done_cb;
+	aio->io_arg = io_arg;
+	aio->caller_arg = caller_arg;
+	fsal_async_ctx_save(&aio->ctx);
+
+	io_arg->io_amount = 0;
+
+	if (write)
+		rc = glfs_pwritev_async(aio->my_fd.glfd, io_arg->iov,
+					io_arg->iov_count, io_arg->offset,
+					io_arg->fsal_stable ? O_SYNC : 0,
+					glusterfs_async_io_cb, aio);
+	else
+		rc = glfs_preadv_async(aio->my_fd.glfd, io_arg->iov,
+				       io_arg->iov_count, io_arg->offset, 0,
+				       glusterfs_async_io_cb, aio);
+	if (rc == 0)
+		return true;
+
+	/* The callback won't come, let the synchronous path have a go */
+	LogDebug(COMPONENT_FSAL, "async %s failed: %s",
+		 write ? "write" : "read", strerror(errno));
+
+	if (!closefd)
+		glusterfs_close_my_fd(&aio->my_fd);
+	gsh_free(aio);
+	return false;
+}
+
 /* read2
  */
 
@@ -1843,6 +1985,8 @@ static void glusterfs_read2(struct fsal_obj_handle *obj_hdl,
 			    struct fsal_io_arg *read_arg,
 			    void *caller_arg)
 {
+	struct glusterfs_handle *myself =
+	    container_of(obj_hdl, struct glusterfs_handle, handle);
 	struct glusterfs_fd my_fd = {0};
 	ssize_t nb_read;
 	fsal_status_t status;
@@ -1896,7 +2040,16 @@ static void glusterfs_read2(struct fsal_obj_handle *obj_hdl,
 			  op_ctx->creds->caller_glen,
 			  op_ctx->creds->caller_garray);
 
-	/* XXX dang switch to preadv_async once async supported */
+	if (glusterfs_async_io_start(myself, &my_fd, closefd, false, done_cb,
+				     read_arg, caller_arg)) {
+		SET_GLUSTER_CREDS(glfs_export, NULL, NULL, 0, NULL);
+		if (glusterfs_fd)
+			PTHREAD_RWLOCK_unlock(&glusterfs_fd->fdlock);
+		if (has_lock)
+			PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+		return;
+	}
+
 	nb_read = glfs_preadv(my_fd.glfd, read_arg->iov, read_arg->iov_count,
 			      seek_descriptor, 0);
 
@@ -1956,6 +2109,8 @@ static void glusterfs_write2(struct fsal_obj_handle *obj_hdl,
 			     struct fsal_io_arg *write_arg,
 			     void *caller_arg)
 {
+	struct glusterfs_handle *myself =
+	    container_of(obj_hdl, struct glusterfs_handle, handle);
 	ssize_t nb_written;
 	fsal_status_t status;
 	int retval = 0;
@@ -2007,7 +2162,16 @@ static void glusterfs_write2(struct fsal_obj_handle *obj_hdl,
 			  op_ctx->creds->caller_glen,
 			  op_ctx->creds->caller_garray);
 
-	/* XXX dang switch to pwritev_async once async supported */
+	if (glusterfs_async_io_start(myself, &my_fd, closefd, true, done_cb,
+				     write_arg, caller_arg)) {
+		SET_GLUSTER_CREDS(glfs_export, NULL, NULL, 0, NULL);
+		if (glusterfs_fd)
+			PTHREAD_RWLOCK_unlock(&glusterfs_fd->fdlock);
+		if (has_lock)
+			PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+		return;
+	}
+
 	nb_written = glfs_pwritev(my_fd.glfd, write_arg->iov,
 				  write_arg->iov_count, write_arg->offset,
 				  (write_arg->fsal_stable ? O_SYNC : 0));
@@ -2131,6 +2295,126 @@ static fsal_status_t seek2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+#ifdef USE_GLUSTER_COPY_FILE_RANGE
+/** One side of a glusterfs_copy */
+struct glusterfs_copy_fd {
+	struct fsal_obj_handle *obj_hdl;
+	struct state_t *state;
+	fsal_openflags_t openflags;
+	struct glusterfs_fd *state_fd;
+	struct glusterfs_fd my_fd;
+	bool has_lock;
+	bool closefd;
+};
+
+static fsal_status_t glusterfs_copy_get_fd(struct glusterfs_copy_fd *cfd)
+{
+	/* Acquire state's fdlock to prevent OPEN upgrade closing the
+	 * file descriptor while we use it.
+	 */
+	if (cfd->state) {
+		cfd->state_fd = &container_of(cfd->state,
+					      struct glusterfs_state_fd,
+					      state)->glusterfs_fd;
+
+		PTHREAD_RWLOCK_rdlock(&cfd->state_fd->fdlock);
+	}
+
+	return find_fd(&cfd->my_fd, cfd->obj_hdl, false, cfd->state,
+		       cfd->openflags, &cfd->has_lock, &cfd->closefd, false);
+}
+
+static void glusterfs_copy_put_fd(struct glusterfs_copy_fd *cfd)
+{
+	if (cfd->state_fd)
+		PTHREAD_RWLOCK_unlock(&cfd->state_fd->fdlock);
+
+	if (cfd->closefd)
+		glusterfs_close_my_fd(&cfd->my_fd);
+
+	if (cfd->has_lock)
+		PTHREAD_RWLOCK_unlock(&cfd->obj_hdl->obj_lock);
+}
+
+/**
+ * @brief Implements GLUSTER FSAL objectoperation copy
+ *
+ * glfs_copy_file_range lets the bricks copy without the data coming
+ * through ganesha.  The file descriptors are taken in address order of
+ * the handles, as two copies may go opposite ways between two files.
+ */
+static fsal_status_t glusterfs_copy(struct fsal_obj_handle *dst_hdl,
+				    struct state_t *dst_state,
+				    uint64_t dst_offset,
+				    struct fsal_obj_handle *src_hdl,
+				    struct state_t *src_state,
+				    uint64_t src_offset,
+				    uint64_t count, uint64_t *copied)
+{
+	struct glusterfs_copy_fd cfd[2] = {
+		{ .obj_hdl = src_hdl, .state = src_state,
+		  .openflags = FSAL_O_READ },
+		{ .obj_hdl = dst_hdl, .state = dst_state,
+		  .openflags = FSAL_O_WRITE },
+	};
+	int first = src_hdl < dst_hdl ? 0 : 1;
+	off64_t src_off = src_offset;
+	off64_t dst_off = dst_offset;
+	fsal_status_t status;
+	ssize_t nb_copied;
+	struct glusterfs_export *glfs_export =
+	   container_of(op_ctx->fsal_export, struct glusterfs_export, export);
+
+	/* Within one file the obj_lock would be taken twice, leave that to
+	 * read2 and write2.
+	 */
+	if (src_hdl == dst_hdl)
+		return fsalstat(ERR_FSAL_NOTSUPP, 0);
+
+	status = glusterfs_copy_get_fd(&cfd[first]);
+
+	if (FSAL_IS_ERROR(status))
+		goto out_first;
+
+	status = glusterfs_copy_get_fd(&cfd[!first]);
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	SET_GLUSTER_CREDS(glfs_export, &op_ctx->creds->caller_uid,
+			  &op_ctx->creds->caller_gid,
+			  op_ctx->creds->caller_glen,
+			  op_ctx->creds->caller_garray);
+
+	nb_copied = glfs_copy_file_range(cfd[0].my_fd.glfd, &src_off,
+					 cfd[1].my_fd.glfd, &dst_off,
+					 count, 0, NULL, NULL, NULL);
+
+	/* restore credentials */
+	SET_GLUSTER_CREDS(glfs_export, NULL, NULL, 0, NULL);
+
+	if (nb_copied == -1) {
+		if (errno == ENOSYS || errno == EXDEV || errno == EOPNOTSUPP)
+			status = fsalstat(ERR_FSAL_NOTSUPP, errno);
+		else
+			status = gluster2fsal_error(errno);
+		goto out;
+	}
+
+	*copied = nb_copied;
+
+ out:
+
+	glusterfs_copy_put_fd(&cfd[!first]);
+
+ out_first:
+
+	glusterfs_copy_put_fd(&cfd[first]);
+
+	return status;
+}
+#endif
+
 
 /* commit2
  */
@@ -2889,6 +3173,9 @@ void handle_ops_init(struct fsal_obj_ops *ops)
 	ops->setattr2 = glusterfs_setattr2;
 	ops->close2 = glusterfs_close2;
 	ops->seek2 = seek2;
+#ifdef USE_GLUSTER_COPY_FILE_RANGE
+	ops->copy = glusterfs_copy;
+#endif
 
 
 	/* pNFS related ops */
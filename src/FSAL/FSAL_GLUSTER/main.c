@@ -35,6 +35,7 @@
 #include "FSAL/fsal_init.h"
 #include "gluster_internal.h"
 #include "FSAL/fsal_commonlib.h"
+#include "fridgethr.h"
 
 /* GLUSTERFS FSAL module private storage
  */
@@ -79,9 +80,11 @@ struct glusterfs_fsal_module GlusterFS = {
 
 static struct config_item glfs_params[] = {
 	CONF_ITEM_BOOL("pnfs_mds", false,
-		       fsal_staticfsinfo_t, pnfs_mds),
+		       glusterfs_fsal_module, fsal.fs_info.pnfs_mds),
 	CONF_ITEM_BOOL("pnfs_ds", true,
-		       fsal_staticfsinfo_t, pnfs_ds),
+		       glusterfs_fsal_module, fsal.fs_info.pnfs_ds),
+	CONF_ITEM_UI32("Async_IO_Threads", 0, 256, 4,
+		       glusterfs_fsal_module, async_io_threads),
 	CONFIG_EOL
 };
 
@@ -103,7 +106,7 @@ static fsal_status_t init_config(struct fsal_module *fsal_hdl,
 
 	(void) load_config_from_parse(config_struct,
 				      &glfs_param,
-					  &glfsal_module->fsal.fs_info,
+				      glfsal_module,
 				      true,
 				      err_type);
 
@@ -115,6 +118,25 @@ static fsal_status_t init_config(struct fsal_module *fsal_hdl,
 	if (!config_error_is_harmless(err_type))
 		LogDebug(COMPONENT_FSAL, "Parsing Export Block failed");
 
+	if (glfsal_module->async_io_threads != 0 &&
+	    glfsal_module->io_fridge == NULL) {
+		struct fridgethr_params frp;
+		int rc;
+
+		memset(&frp, 0, sizeof(struct fridgethr_params));
+		frp.thr_max = glfsal_module->async_io_threads;
+		frp.deferment = fridgethr_defer_queue;
+
+		rc = fridgethr_init(&glfsal_module->io_fridge, "gluster_io",
+				    &frp);
+		if (rc != 0) {
+			/* I/O just blocks the workers then */
+			LogCrit(COMPONENT_FSAL,
+				"Unable to start Gluster I/O threads: %d", rc);
+			glfsal_module->io_fridge = NULL;
+		}
+	}
+
 	display_fsinfo(&glfsal_module->fsal);
 
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
@@ -157,6 +179,19 @@ MODULE_INIT void glusterfs_init(void)
 
 MODULE_FINI void glusterfs_unload(void)
 {
+	if (GlusterFS.io_fridge != NULL) {
+		int rc = fridgethr_sync_command(GlusterFS.io_fridge,
+						fridgethr_comm_stop, 120);
+
+		if (rc == ETIMEDOUT) {
+			LogMajor(COMPONENT_FSAL,
+				 "Shutdown timed out, cancelling threads.");
+			fridgethr_cancel(GlusterFS.io_fridge);
+		}
+		fridgethr_destroy(GlusterFS.io_fridge);
+		GlusterFS.io_fridge = NULL;
+	}
+
 	if (unregister_fsal(&GlusterFS.fsal) != 0) {
 		LogCrit(COMPONENT_FSAL,
 			"FSAL Gluster unable to unload.  Dying ...");
@@ -750,6 +750,84 @@ gpfs_write_plus_fd(int my_fd, uint64_t offset,
 	}
 }
 
+/**
+ * @brief Read into each vector in turn
+ *
+ * Stops at end of file or on a short read.  An error after some data
+ * was read is reported as a short read.
+ */
+static fsal_status_t gpfs_readv(int fd, struct fsal_io_arg *read_arg,
+				int export_fd)
+{
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	size_t amount;
+	int i;
+
+	read_arg->io_amount = 0;
+	read_arg->end_of_file = false;
+
+	for (i = 0; i < read_arg->iov_count && !read_arg->end_of_file; i++) {
+		status = GPFSFSAL_read(fd,
+				       read_arg->offset + read_arg->io_amount,
+				       read_arg->iov[i].iov_len,
+				       read_arg->iov[i].iov_base,
+				       &amount, &read_arg->end_of_file,
+				       export_fd);
+		if (FSAL_IS_ERROR(status))
+			break;
+		read_arg->io_amount += amount;
+	}
+
+	if (FSAL_IS_ERROR(status) && read_arg->io_amount != 0)
+		status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	return status;
+}
+
+/**
+ * @brief Write each vector in turn
+ *
+ * Stops on a short write.  An error after some data was written is
+ * reported as a short write.  The write is only reported stable if
+ * every piece of it was.
+ */
+static fsal_status_t gpfs_writev(int fd, struct fsal_io_arg *write_arg,
+				 int export_fd)
+{
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	bool stable_wanted = write_arg->fsal_stable;
+	bool stable_got = true;
+	bool stable;
+	size_t amount;
+	int i;
+
+	write_arg->io_amount = 0;
+
+	for (i = 0; i < write_arg->iov_count; i++) {
+		uint64_t offset = write_arg->offset + write_arg->io_amount;
+
+		stable = stable_wanted;
+		status = GPFSFSAL_write(fd, offset,
+					write_arg->iov[i].iov_len,
+					write_arg->iov[i].iov_base,
+					&amount, &stable, op_ctx, export_fd);
+		if (FSAL_IS_ERROR(status))
+			break;
+		write_arg->io_amount += amount;
+		stable_got = stable_got && stable;
+		if (amount < write_arg->iov[i].iov_len)
+			break;
+	}
+
+	if (FSAL_IS_ERROR(status) && write_arg->io_amount != 0)
+		status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	if (!FSAL_IS_ERROR(status))
+		write_arg->fsal_stable = stable_got;
+
+	return status;
+}
+
 /**
  * @brief Read data from a file
  *
@@ -759,7 +837,7 @@ gpfs_write_plus_fd(int my_fd, uint64_t offset,
  * an (optionally) asynchronous call.  When the I/O is complete, the done
  * callback is called with the results.
  *
- * @note This does not handle iovecs larger than 1
+ * @note READ_PLUS does not handle iovecs larger than 1
  *
  * @param[in]     obj_hdl	File on which to operate
  * @param[in]     bypass	If state doesn't indicate a share reservation,
@@ -813,9 +891,8 @@ gpfs_read2(struct fsal_obj_handle *obj_hdl, bool bypass, fsal_async_cb done_cb,
 		return;
 	}
 
-	assert(read_arg->iov_count == 1);
-
-	if (read_arg->info)
+	if (read_arg->info) {
+		assert(read_arg->iov_count == 1);
 		status = gpfs_read_plus_fd(my_fd, read_arg->offset,
 					   read_arg->iov[0].iov_len,
 					   read_arg->iov[0].iov_base,
@@ -823,12 +900,9 @@ gpfs_read2(struct fsal_obj_handle *obj_hdl, bool bypass, fsal_async_cb done_cb,
 					   &read_arg->end_of_file,
 					   read_arg->info,
 					   export_fd);
-	else
-		status = GPFSFSAL_read(my_fd, read_arg->offset,
-				       read_arg->iov[0].iov_len,
-				       read_arg->iov[0].iov_base,
-				       &read_arg->io_amount,
-				       &read_arg->end_of_file, export_fd);
+	} else {
+		status = gpfs_readv(my_fd, read_arg, export_fd);
+	}
 
 	if (gpfs_fd)
 		PTHREAD_RWLOCK_unlock(&gpfs_fd->fdlock);
@@ -931,12 +1005,7 @@ gpfs_write2(struct fsal_obj_handle *obj_hdl,
 					    &write_arg->fsal_stable,
 					    write_arg->info, export_fd);
 	else
-		status = GPFSFSAL_write(my_fd, write_arg->offset,
-					write_arg->iov[0].iov_len,
-					write_arg->iov[0].iov_base,
-					&write_arg->io_amount,
-					&write_arg->fsal_stable,
-					op_ctx, export_fd);
+		status = gpfs_writev(my_fd, write_arg, export_fd);
 
 	if (gpfs_fd)
 		PTHREAD_RWLOCK_unlock(&gpfs_fd->fdlock);
@@ -27,67 +27,476 @@
 #include "fsal_convert.h"
 #include "gpfs_methods.h"
 #include "nfs_init.h"
+#include "export_mgr.h"
+#include "city.h"
 #include <sys/types.h>
 #include <unistd.h>
 #include <utime.h>
 #include <sys/time.h>
 
-/* Setup up_vector. File system's upvector_mutex must be held */
-static bool setup_up_vector(struct gpfs_filesystem *gpfs_fs)
+/* An upcall, as received from GPFS */
+struct gpfs_up_event {
+	struct glist_head q;
+	int reason;
+	int flags;
+	uint32_t expire_time_attr;
+	struct stat buf;
+	struct glock fl;
+	struct pnfs_deviceid devid;
+	struct gpfs_file_handle handle;
+};
+
+/**
+ * @brief Process one upcall
+ *
+ * @param[in] gpfs_fs     File system it came from
+ * @param[in] event_func  Up ops of one of its exports
+ * @param[in] ev          The upcall
+ */
+static void gpfs_up_process(struct gpfs_filesystem *gpfs_fs,
+			    const struct fsal_up_vector *event_func,
+			    struct gpfs_up_event *ev)
 {
+	struct gsh_buffdesc key;
+	uint32_t upflags;
+	fsal_status_t fsal_status = {0,};
+
+	/* Here is where we decide what type of event this is
+	 * ... open,close,read,...,invalidate? */
+	key.addr = &ev->handle;
+	key.len = ev->handle.handle_key_size;
+
+	switch (ev->reason) {
+	case INODE_LOCK_GRANTED:	/* Lock Event */
+	case INODE_LOCK_AGAIN:	/* Lock Event */
+		{
+			LogMidDebug(COMPONENT_FSAL_UP,
+				    "%s: owner %p pid %d type %d start %lld len %lld",
+				    ev->reason ==
+				    INODE_LOCK_GRANTED ?
+				    "inode lock granted" :
+				    "inode lock again", ev->fl.lock_owner,
+				    ev->fl.flock.l_pid, ev->fl.flock.l_type,
+				    (long long)ev->fl.flock.l_start,
+				    (long long)ev->fl.flock.l_len);
+
+			fsal_lock_param_t lockdesc = {
+				.lock_sle_type = FSAL_POSIX_LOCK,
+				.lock_type = ev->fl.flock.l_type,
+				.lock_start = ev->fl.flock.l_start,
+				.lock_length = ev->fl.flock.l_len
+			};
+			if (ev->reason == INODE_LOCK_AGAIN)
+				fsal_status = up_async_lock_avail(
+						 general_fridge,
+						 event_func,
+						 &key,
+						 ev->fl.lock_owner,
+						 &lockdesc, NULL, NULL);
+			else
+				fsal_status = up_async_lock_grant(
+						 general_fridge,
+						 event_func,
+						 &key,
+						 ev->fl.lock_owner,
+						 &lockdesc, NULL, NULL);
+		}
+		break;
+
+	case BREAK_DELEGATION:	/* Delegation Event */
+		LogDebug(COMPONENT_FSAL_UP,
+			 "delegation recall: flags:%x ino %" PRId64,
+			 ev->flags, ev->buf.st_ino);
+		fsal_status = up_async_delegrecall(general_fridge,
+					  event_func,
+					  &key, NULL, NULL);
+		break;
+
+	case LAYOUT_FILE_RECALL:	/* Layout file recall Event */
+		{
+			struct pnfs_segment segment = {
+				.offset = 0,
+				.length = UINT64_MAX,
+				.io_mode = LAYOUTIOMODE4_ANY
+			};
+			LogDebug(COMPONENT_FSAL_UP,
+				 "layout file recall: flags:%x ino %"
+				 PRId64, ev->flags, ev->buf.st_ino);
+
+			fsal_status = up_async_layoutrecall(
+						general_fridge,
+						event_func,
+						&key,
+						LAYOUT4_NFSV4_1_FILES,
+						false, &segment,
+						NULL, NULL, NULL,
+						NULL);
+		}
+		break;
+
+	case LAYOUT_RECALL_ANY:	/* Recall all layouts Event */
+		LogDebug(COMPONENT_FSAL_UP,
+			 "layout recall any: flags:%x ino %" PRId64,
+			 ev->flags, ev->buf.st_ino);
+
+		/* An FSID recall, rather than RECALL_ANY, only
+		 * yanks the layouts of this filesystem.
+		 */
+		fsal_status = up_async_layoutrecall_fsid(
+						general_fridge,
+						event_func,
+						LAYOUT4_NFSV4_1_FILES,
+						false,
+						LAYOUTIOMODE4_ANY,
+						&gpfs_fs->fs->fsid,
+						NULL, NULL);
+		break;
+
+	case LAYOUT_NOTIFY_DEVICEID:	/* Device update Event */
+		LogDebug(COMPONENT_FSAL_UP,
+			 "layout dev update: flags:%x ino %"
+			 PRId64 " seq %d fd %d fsid 0x%" PRIx64,
+			 ev->flags,
+			ev->buf.st_ino,
+			ev->devid.device_id2,
+			ev->devid.device_id4,
+			ev->devid.devid);
+
+		memset(&ev->devid, 0, sizeof(ev->devid));
+		ev->devid.fsal_id = FSAL_ID_GPFS;
+
+		fsal_status = up_async_notify_device(general_fridge,
+					event_func,
+					NOTIFY_DEVICEID4_DELETE_MASK,
+					LAYOUT4_NFSV4_1_FILES,
+					&ev->devid,
+					true, NULL,
+					NULL);
+		break;
+
+	case INODE_UPDATE:	/* Update Event */
+		{
+			struct attrlist attr;
+
+			LogMidDebug(COMPONENT_FSAL_UP,
+				    "inode update: flags:%x update ino %"
+				    PRId64 " n_link:%d",
+				    ev->flags, ev->buf.st_ino,
+				    (int)ev->buf.st_nlink);
+
+			/** @todo: This notification is completely
+			 * asynchronous.  If we happen to change some
+			 * of the attributes later, we end up over
+			 * writing those with these possibly stale
+			 * values as we don't know when we get to
+			 * update with these up call values. We should
+			 * probably use time stamp or let the up call
+			 * always provide UP_TIMES flag in which case
+			 * we can compare the current ctime vs up call
+			 * provided ctime before updating the
+			 * attributes.
+			 *
+			 * For now, we think size attribute is more
+			 * important than others, so invalidate the
+			 * attributes and let ganesha fetch attributes
+			 * as needed if this update includes a size
+			 * change. We are careless for other attribute
+			 * changes, and we may end up with stale values
+			 * until this gets fixed!
+			 */
+			if (ev->flags & (UP_SIZE | UP_SIZE_BIG)) {
+				fsal_status = event_func->invalidate(
+					event_func, &key,
+					FSAL_UP_INVALIDATE_CACHE);
+				break;
+			}
+
+			/* Check for accepted flags, any other changes
+			   just invalidate. */
+			if (ev->flags &
+			    ~(UP_SIZE | UP_NLINK | UP_MODE | UP_OWN |
+			     UP_TIMES | UP_ATIME | UP_SIZE_BIG)) {
+				fsal_status = event_func->invalidate(
+					event_func, &key,
+					FSAL_UP_INVALIDATE_CACHE);
+			} else {
+				/* buf may not have all attributes set.
+				 * Set the mask to what is changed
+				 */
+				attr.valid_mask = 0;
+				attr.acl = NULL;
+				upflags = 0;
+				if (ev->flags & UP_SIZE)
+					attr.valid_mask |=
+					   ATTR_CHGTIME | ATTR_CHANGE |
+					   ATTR_SIZE | ATTR_SPACEUSED;
+				if (ev->flags & UP_SIZE_BIG) {
+					attr.valid_mask |=
+					   ATTR_CHGTIME | ATTR_CHANGE |
+					   ATTR_SIZE | ATTR_SPACEUSED;
+					upflags |=
+					   fsal_up_update_filesize_inc |
+					   fsal_up_update_spaceused_inc;
+				}
+				if (ev->flags & UP_MODE)
+					attr.valid_mask |=
+					   ATTR_CHGTIME | ATTR_CHANGE |
+					   ATTR_MODE;
+				if (ev->flags & UP_OWN)
+					attr.valid_mask |=
+					   ATTR_CHGTIME | ATTR_CHANGE |
+					   ATTR_OWNER | ATTR_GROUP |
+					   ATTR_MODE;
+				if (ev->flags & UP_TIMES)
+					attr.valid_mask |=
+					   ATTR_CHGTIME | ATTR_CHANGE |
+					   ATTR_ATIME | ATTR_CTIME |
+					    ATTR_MTIME;
+				if (ev->flags & UP_ATIME)
+					attr.valid_mask |=
+					   ATTR_CHGTIME | ATTR_CHANGE |
+					   ATTR_ATIME;
+				if (ev->flags & UP_NLINK)
+					attr.valid_mask |=
+						ATTR_NUMLINKS;
+				attr.request_mask = attr.valid_mask;
+
+				attr.expire_time_attr =
+				    ev->expire_time_attr;
+
+				posix2fsal_attributes(&ev->buf, &attr);
+				fsal_status = event_func->update(
+						event_func, &key,
+						&attr, upflags);
+
+				if ((ev->flags & UP_NLINK)
+				    && (attr.numlinks == 0)) {
+					upflags = fsal_up_nlink;
+					attr.valid_mask = 0;
+					attr.request_mask = 0;
+					fsal_status = up_async_update
+					    (general_fridge,
+					     event_func,
+					     &key, &attr,
+					     upflags, NULL, NULL);
+				}
+			}
+		}
+		break;
+
+	case INODE_INVALIDATE:
+		LogMidDebug(COMPONENT_FSAL_UP,
+			    "inode invalidate: flags:%x update ino %"
+			    PRId64, ev->flags, ev->buf.st_ino);
+
+		upflags = FSAL_UP_INVALIDATE_CACHE;
+		fsal_status = event_func->invalidate_close(
+					event_func,
+					&key,
+					upflags);
+		break;
+
+	default:
+		LogWarn(COMPONENT_FSAL_UP, "Unknown event: %d", ev->reason);
+		return;
+	}
+
+	if (FSAL_IS_ERROR(fsal_status) &&
+	    fsal_status.major != ERR_FSAL_NOENT) {
+		LogWarn(COMPONENT_FSAL_UP,
+			"Event %d could not be processed for fd %d rc %s",
+			ev->reason, gpfs_fs->root_fd,
+			fsal_err_txt(fsal_status));
+	}
+}
+
+/**
+ * @brief Upcall processing thread
+ *
+ * Takes all the upcalls queued to it at once and processes them with
+ * the up ops of one export, which is held for the whole batch instead
+ * of holding upvector_mutex.
+ *
+ * @param[in] arg  The worker
+ */
+static void *gpfs_up_worker_thread(void *arg)
+{
+	struct gpfs_up_worker *worker = arg;
+	struct gpfs_filesystem *gpfs_fs = worker->gpfs_fs;
 	struct gpfs_filesystem_export_map *map;
+	struct fsal_up_vector *event_func = NULL;
+	struct glist_head batch, *glist, *glistn;
+	struct gpfs_up_event *ev;
+	struct gsh_export *export = NULL;
+	char thr_name[32];
+
+	snprintf(thr_name, sizeof(thr_name),
+		 "fsal_up_%"PRIu64".%"PRIu64".%u",
+		 gpfs_fs->fs->dev.major, gpfs_fs->fs->dev.minor,
+		 worker->index);
+	SetNameFunction(thr_name);
+
+	glist_init(&batch);
+
+	while (1) {
+		PTHREAD_MUTEX_lock(&worker->mtx);
 
-	map = glist_first_entry(&gpfs_fs->exports,
-				struct gpfs_filesystem_export_map, on_exports);
-	if (!map)
-		return false;
+		while (glist_empty(&worker->events) && !worker->stop)
+			pthread_cond_wait(&worker->cond, &worker->mtx);
 
-	gpfs_fs->up_vector = (struct fsal_up_vector *)map->exp->export.up_ops;
+		if (glist_empty(&worker->events)) {
+			PTHREAD_MUTEX_unlock(&worker->mtx);
+			break;
+		}
+
+		glist_splice_tail(&batch, &worker->events);
+
+		PTHREAD_MUTEX_unlock(&worker->mtx);
+
+		/* We need valid up_vector while processing some of the
+		 * events below. Hold the export until the whole batch is
+		 * processed.
+		 */
+		PTHREAD_MUTEX_lock(&gpfs_fs->upvector_mutex);
+
+		map = glist_first_entry(&gpfs_fs->exports,
+					struct gpfs_filesystem_export_map,
+					on_exports);
+		if (map != NULL) {
+			event_func = (struct fsal_up_vector *)
+						map->exp->export.up_ops;
+
+			/* wait for upcall readiness */
+			up_ready_wait(event_func);
 
-	/* wait for upcall readiness */
-	up_ready_wait(gpfs_fs->up_vector);
+			export = event_func->up_gsh_export;
+			get_gsh_export_ref(export);
+		}
+
+		PTHREAD_MUTEX_unlock(&gpfs_fs->upvector_mutex);
+
+		if (map != NULL) {
+			/* Set up op_ctx for the thread */
+			op_ctx = &worker->req_ctx;
+			op_ctx->fsal_export = event_func->up_fsal_export;
+			op_ctx->ctx_export = export;
+		} else {
+			LogDebug(COMPONENT_FSAL_UP,
+				 "Dropping upcalls for %d, no export left",
+				 gpfs_fs->root_fd);
+		}
+
+		glist_for_each_safe(glist, glistn, &batch) {
+			ev = glist_entry(glist, struct gpfs_up_event, q);
+			glist_del(&ev->q);
 
-	/* Set up op_ctx for the thread */
-	op_ctx = &gpfs_fs->req_ctx;
-	op_ctx->fsal_export = gpfs_fs->up_vector->up_fsal_export;
-	op_ctx->ctx_export = gpfs_fs->up_vector->up_gsh_export;
+			if (map != NULL)
+				gpfs_up_process(gpfs_fs, event_func, ev);
 
-	return true;
+			gsh_free(ev);
+		}
+
+		if (map != NULL) {
+			op_ctx = NULL;
+			put_gsh_export(export);
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Start the threads processing a file system's upcalls
+ */
+static void gpfs_up_workers_start(struct gpfs_filesystem *gpfs_fs)
+{
+	struct gpfs_up_worker *worker;
+	unsigned int i;
+	int rc;
+
+	for (i = 0; i < GPFS_UP_WORKERS; i++) {
+		worker = &gpfs_fs->up_workers[i];
+		memset(worker, 0, sizeof(*worker));
+		worker->gpfs_fs = gpfs_fs;
+		worker->index = i;
+		PTHREAD_MUTEX_init(&worker->mtx, NULL);
+		PTHREAD_COND_init(&worker->cond, NULL);
+		glist_init(&worker->events);
+
+		rc = pthread_create(&worker->thr, NULL, gpfs_up_worker_thread,
+				    worker);
+		if (rc != 0)
+			LogFatal(COMPONENT_THREAD,
+				 "Could not create GPFS upcall worker, error = %d (%s)",
+				 rc, strerror(rc));
+	}
+}
+
+/**
+ * @brief Stop the threads processing a file system's upcalls
+ *
+ * Upcalls already queued are processed first.
+ */
+static void gpfs_up_workers_stop(struct gpfs_filesystem *gpfs_fs)
+{
+	struct gpfs_up_worker *worker;
+	unsigned int i;
+
+	for (i = 0; i < GPFS_UP_WORKERS; i++) {
+		worker = &gpfs_fs->up_workers[i];
+		PTHREAD_MUTEX_lock(&worker->mtx);
+		worker->stop = true;
+		pthread_cond_signal(&worker->cond);
+		PTHREAD_MUTEX_unlock(&worker->mtx);
+	}
+
+	for (i = 0; i < GPFS_UP_WORKERS; i++) {
+		worker = &gpfs_fs->up_workers[i];
+		pthread_join(worker->thr, NULL);
+		PTHREAD_COND_destroy(&worker->cond);
+		PTHREAD_MUTEX_destroy(&worker->mtx);
+	}
+}
+
+/**
+ * @brief Queue an upcall to the worker for its file
+ */
+static void gpfs_up_queue(struct gpfs_filesystem *gpfs_fs,
+			  struct gpfs_up_event *ev)
+{
+	struct gpfs_up_worker *worker;
+	uint64_t hash;
+
+	/* the same bytes the up ops use as the file's key */
+	hash = CityHash64((char *)&ev->handle,
+			  MIN(ev->handle.handle_key_size, sizeof(ev->handle)));
+	worker = &gpfs_fs->up_workers[hash % GPFS_UP_WORKERS];
+
+	PTHREAD_MUTEX_lock(&worker->mtx);
+	glist_add_tail(&worker->events, &ev->q);
+	pthread_cond_signal(&worker->cond);
+	PTHREAD_MUTEX_unlock(&worker->mtx);
 }
 
 /**
  * @brief Up Thread
  *
+ * Receives the upcalls of a file system and hands them to its workers,
+ * so that GPFS can be asked for the next upcall right away.
+ *
  * @param Arg reference to void
  *
  */
 void *GPFSFSAL_UP_Thread(void *Arg)
 {
 	struct gpfs_filesystem *gpfs_fs = Arg;
-	struct fsal_up_vector *event_func;
+	struct gpfs_up_event *ev;
 	char thr_name[16];
 	int rc = 0;
-	struct pnfs_deviceid devid;
-	struct stat buf;
-	struct glock fl;
 	struct callback_arg callback;
-	struct gpfs_file_handle handle;
-	int reason = 0;
-	int flags = 0;
 	unsigned int *fhP;
 	int retry = 0;
-	struct gsh_buffdesc key;
-	uint32_t expire_time_attr = 0;
-	uint32_t upflags;
 	int errsv = 0;
-	fsal_status_t fsal_status = {0,};
-
-#ifdef _VALGRIND_MEMCHECK
-		memset(&handle, 0, sizeof(handle));
-		memset(&buf, 0, sizeof(buf));
-		memset(&fl, 0, sizeof(fl));
-		memset(&devid, 0, sizeof(devid));
-#endif
 
 	snprintf(thr_name, sizeof(thr_name),
 		 "fsal_up_%"PRIu64".%"PRIu64,
@@ -103,27 +512,31 @@ void *GPFSFSAL_UP_Thread(void *Arg)
 	 */
 	nfs_init_wait();
 
+	gpfs_up_workers_start(gpfs_fs);
+
 	/* Start querying for events and processing. */
 	while (1) {
 		LogFullDebug(COMPONENT_FSAL_UP,
 			     "Requesting event from FSAL Callback interface for %d.",
 			     gpfs_fs->root_fd);
 
-		handle.handle_size = GPFS_MAX_FH_SIZE;
-		handle.handle_key_size = OPENHANDLE_KEY_LEN;
-		handle.handle_version = OPENHANDLE_VERSION;
+		ev = gsh_calloc(1, sizeof(*ev));
+
+		ev->handle.handle_size = GPFS_MAX_FH_SIZE;
+		ev->handle.handle_key_size = OPENHANDLE_KEY_LEN;
+		ev->handle.handle_version = OPENHANDLE_VERSION;
 
 		callback.interface_version =
 		    GPFS_INTERFACE_VERSION + GPFS_INTERFACE_SUB_VER;
 
 		callback.mountdirfd = gpfs_fs->root_fd;
-		callback.handle = &handle;
-		callback.reason = &reason;
-		callback.flags = &flags;
-		callback.buf = &buf;
-		callback.fl = &fl;
-		callback.dev_id = &devid;
-		callback.expire_attr = &expire_time_attr;
+		callback.handle = &ev->handle;
+		callback.reason = &ev->reason;
+		callback.flags = &ev->flags;
+		callback.buf = &ev->buf;
+		callback.fl = &ev->fl;
+		callback.dev_id = &ev->devid;
+		callback.expire_attr = &ev->expire_time_attr;
 
 		rc = gpfs_ganesha(OPENHANDLE_INODE_UPDATE, &callback);
 		errsv = errno;
@@ -137,13 +550,16 @@ void *GPFSFSAL_UP_Thread(void *Arg)
 				return NULL;
 			}
 
-			if (errsv == EINTR)
+			if (errsv == EINTR) {
+				gsh_free(ev);
 				continue;
+			}
 
 			LogCrit(COMPONENT_FSAL_UP,
 				"OPENHANDLE_INODE_UPDATE failed for %d. rc %d, errno %d (%s) reason %d",
 				gpfs_fs->root_fd, rc, errsv,
-				strerror(errsv), reason);
+				strerror(errsv), ev->reason);
+			gsh_free(ev);
 
 			/* @todo 1000 retry logic will go away once the
 			 * OPENHANDLE_INODE_UPDATE ioctl separates EINTR
@@ -164,12 +580,12 @@ void *GPFSFSAL_UP_Thread(void *Arg)
 		 * 2 bytes! Workaround this until the kernel module
 		 * gets fixed.
 		 */
-		flags = flags & 0xffff;
+		ev->flags = ev->flags & 0xffff;
 
 		LogDebug(COMPONENT_FSAL_UP,
 			 "inode update: rc %d reason %d update ino %"
 			 PRId64 " flags:%x",
-			 rc, reason, callback.buf->st_ino, flags);
+			 rc, ev->reason, ev->buf.st_ino, ev->flags);
 
 		LogFullDebug(COMPONENT_FSAL_UP,
 			     "inode update: flags:%x callback.handle:%p handle size = %u handle_type:%d handle_version:%d key_size = %u handle_fsid=%X.%X f_handle:%p expire: %d",
@@ -180,7 +596,7 @@ void *GPFSFSAL_UP_Thread(void *Arg)
 			     callback.handle->handle_key_size,
 			     callback.handle->handle_fsid[0],
 			     callback.handle->handle_fsid[1],
-			     callback.handle->f_handle, expire_time_attr);
+			     callback.handle->f_handle, ev->expire_time_attr);
 
 		callback.handle->handle_version = OPENHANDLE_VERSION;
 
@@ -190,282 +606,29 @@ void *GPFSFSAL_UP_Thread(void *Arg)
 			     fhP[0], fhP[1], fhP[2], fhP[3], fhP[4], fhP[5],
 			     fhP[6]);
 
-		/* Here is where we decide what type of event this is
-		 * ... open,close,read,...,invalidate? */
-		key.addr = &handle;
-		key.len = handle.handle_key_size;
-
 		LogDebug(COMPONENT_FSAL_UP, "Received event to process for %d",
 			 gpfs_fs->root_fd);
 
-		/* We need valid up_vector while processing some of the
-		 * events below. Setup up vector and hold the mutex while
-		 * processing the event for the entire duration.
-		 */
-		PTHREAD_MUTEX_lock(&gpfs_fs->upvector_mutex);
-		if (!setup_up_vector(gpfs_fs)) {
-			PTHREAD_MUTEX_unlock(&gpfs_fs->upvector_mutex);
-			return NULL;
-		}
-		event_func = gpfs_fs->up_vector;
-
-		switch (reason) {
-		case INODE_LOCK_GRANTED:	/* Lock Event */
-		case INODE_LOCK_AGAIN:	/* Lock Event */
-			{
-				LogMidDebug(COMPONENT_FSAL_UP,
-					    "%s: owner %p pid %d type %d start %lld len %lld",
-					    reason ==
-					    INODE_LOCK_GRANTED ?
-					    "inode lock granted" :
-					    "inode lock again", fl.lock_owner,
-					    fl.flock.l_pid, fl.flock.l_type,
-					    (long long)fl.flock.l_start,
-					    (long long)fl.flock.l_len);
-
-				fsal_lock_param_t lockdesc = {
-					.lock_sle_type = FSAL_POSIX_LOCK,
-					.lock_type = fl.flock.l_type,
-					.lock_start = fl.flock.l_start,
-					.lock_length = fl.flock.l_len
-				};
-				if (reason == INODE_LOCK_AGAIN)
-					fsal_status = up_async_lock_avail(
-							 general_fridge,
-							 event_func,
-							 &key,
-							 fl.lock_owner,
-							 &lockdesc, NULL, NULL);
-				else
-					fsal_status = up_async_lock_grant(
-							 general_fridge,
-							 event_func,
-							 &key,
-							 fl.lock_owner,
-							 &lockdesc, NULL, NULL);
-			}
-			break;
-
-		case BREAK_DELEGATION:	/* Delegation Event */
-			LogDebug(COMPONENT_FSAL_UP,
-				 "delegation recall: flags:%x ino %" PRId64,
-				 flags, callback.buf->st_ino);
-			fsal_status = up_async_delegrecall(general_fridge,
-						  event_func,
-						  &key, NULL, NULL);
-			break;
-
-		case LAYOUT_FILE_RECALL:	/* Layout file recall Event */
-			{
-				struct pnfs_segment segment = {
-					.offset = 0,
-					.length = UINT64_MAX,
-					.io_mode = LAYOUTIOMODE4_ANY
-				};
-				LogDebug(COMPONENT_FSAL_UP,
-					 "layout file recall: flags:%x ino %"
-					 PRId64, flags, callback.buf->st_ino);
-
-				fsal_status = up_async_layoutrecall(
-							general_fridge,
-							event_func,
-							&key,
-							LAYOUT4_NFSV4_1_FILES,
-							false, &segment,
-							NULL, NULL, NULL,
-							NULL);
-			}
-			break;
-
-		case LAYOUT_RECALL_ANY:	/* Recall all layouts Event */
-			LogDebug(COMPONENT_FSAL_UP,
-				 "layout recall any: flags:%x ino %" PRId64,
-				 flags, callback.buf->st_ino);
-
-	    /**
-	     * @todo This functionality needs to be implemented as a
-	     * bulk FSID CB_LAYOUTRECALL.  RECALL_ANY isn't suitable
-	     * since it can't be restricted to just one FSAL.  Also
-	     * an FSID LAYOUTRECALL lets you have multiplke
-	     * filesystems exported from one FSAL and not yank layouts
-	     * on all of them when you only need to recall them for one.
-	     */
-			break;
-
-		case LAYOUT_NOTIFY_DEVICEID:	/* Device update Event */
-			LogDebug(COMPONENT_FSAL_UP,
-				 "layout dev update: flags:%x ino %"
-				 PRId64 " seq %d fd %d fsid 0x%" PRIx64,
-				 flags,
-				callback.buf->st_ino,
-				devid.device_id2,
-				devid.device_id4,
-				devid.devid);
-
-			memset(&devid, 0, sizeof(devid));
-			devid.fsal_id = FSAL_ID_GPFS;
-
-			fsal_status = up_async_notify_device(general_fridge,
-						event_func,
-						NOTIFY_DEVICEID4_DELETE_MASK,
-						LAYOUT4_NFSV4_1_FILES,
-						&devid,
-						true, NULL,
-						NULL);
-			break;
-
-		case INODE_UPDATE:	/* Update Event */
-			{
-				struct attrlist attr;
-
-				LogMidDebug(COMPONENT_FSAL_UP,
-					    "inode update: flags:%x update ino %"
-					    PRId64 " n_link:%d",
-					    flags, callback.buf->st_ino,
-					    (int)callback.buf->st_nlink);
-
-				/** @todo: This notification is completely
-				 * asynchronous.  If we happen to change some
-				 * of the attributes later, we end up over
-				 * writing those with these possibly stale
-				 * values as we don't know when we get to
-				 * update with these up call values. We should
-				 * probably use time stamp or let the up call
-				 * always provide UP_TIMES flag in which case
-				 * we can compare the current ctime vs up call
-				 * provided ctime before updating the
-				 * attributes.
-				 *
-				 * For now, we think size attribute is more
-				 * important than others, so invalidate the
-				 * attributes and let ganesha fetch attributes
-				 * as needed if this update includes a size
-				 * change. We are careless for other attribute
-				 * changes, and we may end up with stale values
-				 * until this gets fixed!
-				 */
-				if (flags & (UP_SIZE | UP_SIZE_BIG)) {
-					fsal_status = event_func->invalidate(
-						event_func, &key,
-						FSAL_UP_INVALIDATE_CACHE);
-					break;
-				}
-
-				/* Check for accepted flags, any other changes
-				   just invalidate. */
-				if (flags &
-				    ~(UP_SIZE | UP_NLINK | UP_MODE | UP_OWN |
-				     UP_TIMES | UP_ATIME | UP_SIZE_BIG)) {
-					fsal_status = event_func->invalidate(
-						event_func, &key,
-						FSAL_UP_INVALIDATE_CACHE);
-				} else {
-					/* buf may not have all attributes set.
-					 * Set the mask to what is changed
-					 */
-					attr.valid_mask = 0;
-					attr.acl = NULL;
-					upflags = 0;
-					if (flags & UP_SIZE)
-						attr.valid_mask |=
-						   ATTR_CHGTIME | ATTR_CHANGE |
-						   ATTR_SIZE | ATTR_SPACEUSED;
-					if (flags & UP_SIZE_BIG) {
-						attr.valid_mask |=
-						   ATTR_CHGTIME | ATTR_CHANGE |
-						   ATTR_SIZE | ATTR_SPACEUSED;
-						upflags |=
-						   fsal_up_update_filesize_inc |
-						   fsal_up_update_spaceused_inc;
-					}
-					if (flags & UP_MODE)
-						attr.valid_mask |=
-						   ATTR_CHGTIME | ATTR_CHANGE |
-						   ATTR_MODE;
-					if (flags & UP_OWN)
-						attr.valid_mask |=
-						   ATTR_CHGTIME | ATTR_CHANGE |
-						   ATTR_OWNER | ATTR_GROUP |
-						   ATTR_MODE;
-					if (flags & UP_TIMES)
-						attr.valid_mask |=
-						   ATTR_CHGTIME | ATTR_CHANGE |
-						   ATTR_ATIME | ATTR_CTIME |
-						    ATTR_MTIME;
-					if (flags & UP_ATIME)
-						attr.valid_mask |=
-						   ATTR_CHGTIME | ATTR_CHANGE |
-						   ATTR_ATIME;
-					if (flags & UP_NLINK)
-						attr.valid_mask |=
-							ATTR_NUMLINKS;
-					attr.request_mask = attr.valid_mask;
-
-					attr.expire_time_attr =
-					    expire_time_attr;
-
-					posix2fsal_attributes(&buf, &attr);
-					fsal_status = event_func->update(
-							event_func, &key,
-							&attr, upflags);
-
-					if ((flags & UP_NLINK)
-					    && (attr.numlinks == 0)) {
-						upflags = fsal_up_nlink;
-						attr.valid_mask = 0;
-						attr.request_mask = 0;
-						fsal_status = up_async_update
-						    (general_fridge,
-						     event_func,
-						     &key, &attr,
-						     upflags, NULL, NULL);
-					}
-				}
-			}
-			break;
-
+		switch (ev->reason) {
 		case THREAD_STOP:  /* We wanted to terminate this thread */
 			LogDebug(COMPONENT_FSAL_UP,
 				"Terminating the GPFS up call thread for %d",
 				gpfs_fs->root_fd);
-			PTHREAD_MUTEX_unlock(&gpfs_fs->upvector_mutex);
+			gsh_free(ev);
+			gpfs_up_workers_stop(gpfs_fs);
 			return NULL;
 
-		case INODE_INVALIDATE:
-			LogMidDebug(COMPONENT_FSAL_UP,
-				    "inode invalidate: flags:%x update ino %"
-				    PRId64, flags, callback.buf->st_ino);
-
-			upflags = FSAL_UP_INVALIDATE_CACHE;
-			fsal_status = event_func->invalidate_close(
-						event_func,
-						&key,
-						upflags);
-			break;
-
 		case THREAD_PAUSE:
 			/* File system image is probably going away, but
 			 * we don't need to do anything here as we
 			 * eventually get other errors that stop this
 			 * thread.
 			 */
-			PTHREAD_MUTEX_unlock(&gpfs_fs->upvector_mutex);
+			gsh_free(ev);
 			continue; /* get next event */
 
 		default:
-			PTHREAD_MUTEX_unlock(&gpfs_fs->upvector_mutex);
-			LogWarn(COMPONENT_FSAL_UP, "Unknown event: %d", reason);
-			continue;
-		}
-
-		PTHREAD_MUTEX_unlock(&gpfs_fs->upvector_mutex);
-
-		if (FSAL_IS_ERROR(fsal_status) &&
-		    fsal_status.major != ERR_FSAL_NOENT) {
-			LogWarn(COMPONENT_FSAL_UP,
-				"Event %d could not be processed for fd %d rc %s",
-				reason, gpfs_fs->root_fd,
-				fsal_err_txt(fsal_status));
+			gpfs_up_queue(gpfs_fs, ev);
 		}
 	}
 
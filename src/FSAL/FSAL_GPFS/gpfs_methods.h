@@ -38,6 +38,25 @@ struct gpfs_fsal_export {
 	bool use_acl;
 };
 
+/* Threads processing the upcalls of a file system */
+#define GPFS_UP_WORKERS 4
+
+/*
+ * One of the threads processing the upcalls of a file system.  Upcalls
+ * of a file always go to the same one, so they are processed in the
+ * order GPFS sent them.
+ */
+struct gpfs_up_worker {
+	struct gpfs_filesystem *gpfs_fs;
+	unsigned int index;
+	pthread_t thr;
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	struct glist_head events;	/* protected by mtx */
+	bool stop;			/* protected by mtx */
+	struct req_op_context req_ctx;
+};
+
 /*
  * GPFS internal filesystem
  */
@@ -48,15 +67,14 @@ struct gpfs_filesystem {
 	bool up_thread_started;
 	pthread_t up_thread; /* upcall thread */
 
-	/* we have an upcall thread for each file system. The upcall
-	 * thread needs a valid export/op_ctx for processing some of the
-	 * upcall requests. We use upvector_mutex to get an export from
-	 * the list of exports in a file system. The following
-	 * up_vector points to up_ops in such an export.
+	/* we have an upcall thread for each file system, which hands
+	 * the upcalls it receives to up_workers. Those need a valid
+	 * export/op_ctx for processing some of the upcall requests. We
+	 * use upvector_mutex to get an export from the list of exports
+	 * in a file system, and use the up_ops of that export.
 	 */
 	pthread_mutex_t upvector_mutex;
-	struct fsal_up_vector *up_vector;
-	struct req_op_context req_ctx;
+	struct gpfs_up_worker up_workers[GPFS_UP_WORKERS];
 };
 
 /*
@@ -0,0 +1,325 @@
+/*
+ * vim:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file   FSAL_MEM/mem_async.c
+ *
+ * @brief Synthetic latency
+ *
+ * Make MEM look like a backend that takes time, for measuring the
+ * protocol layers on their own.  Metadata operations just sleep, as
+ * a synchronous backend would.  Reads and writes from callers that can
+ * take their callback on another thread are queued instead, and a
+ * completion thread calls done_cb once the latency has passed, so a
+ * worker is not held for it.
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <time.h>
+#include "fsal.h"
+#include "fsal_convert.h"
+#include "fridgethr.h"
+#include "mem_int.h"
+
+/** A read or write waiting for its latency to pass */
+struct mem_async_op {
+	struct glist_head list;		/*< Entry in mem_async_queue ops */
+	struct timespec due;		/*< When to complete */
+	struct fsal_obj_handle *obj_hdl;
+	fsal_async_cb done_cb;
+	struct fsal_io_arg *io_arg;
+	void *caller_arg;
+	struct req_op_context ctx;	/*< The caller's, for done_cb */
+};
+
+/** Operations for one completion thread, in order of due time */
+struct mem_async_queue {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct glist_head ops;
+	GSH_CACHE_PAD(0);
+};
+
+static struct fridgethr *mem_async_fridge;
+static struct mem_async_queue *mem_async_queues;
+static uint32_t mem_async_nqueues;
+/** Next queue to give a thread, then an operation */
+static uint32_t mem_async_next_thread;
+static uint32_t mem_async_next_op;
+
+/**
+ * @brief Sleep for a while
+ *
+ * @param[in] latency	Microseconds, 0 to return at once
+ */
+void mem_inject_latency(uint32_t latency)
+{
+	struct timespec ts;
+
+	if (likely(latency == 0))
+		return;
+
+	ts.tv_sec = latency / 1000000;
+	ts.tv_nsec = (latency % 1000000) * 1000;
+
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+		;
+}
+
+/**
+ * @brief Call done_cb for a queued operation
+ *
+ * @param[in] op	Operation, freed
+ */
+static void mem_async_done(struct mem_async_op *op)
+{
+	struct req_op_context *saved_ctx = op_ctx;
+
+	op_ctx = &op->ctx;
+	op->done_cb(op->obj_hdl, fsalstat(ERR_FSAL_NO_ERROR, 0), op->io_arg,
+		    op->caller_arg);
+	op_ctx = saved_ctx;
+
+	gsh_free(op);
+}
+
+/**
+ * @brief Complete a read or write after a latency
+ *
+ * The I/O itself is done; only the call to done_cb is put off.
+ *
+ * @param[in] obj_hdl		Object the I/O was on
+ * @param[in] done_cb		Callback of the caller
+ * @param[in] io_arg		I/O arguments and results
+ * @param[in] caller_arg	Argument for done_cb
+ * @param[in] latency		Microseconds to wait
+ */
+void mem_async_complete(struct fsal_obj_handle *obj_hdl,
+			fsal_async_cb done_cb, struct fsal_io_arg *io_arg,
+			void *caller_arg, uint32_t latency)
+{
+	struct mem_async_queue *q;
+	struct mem_async_op *op;
+	struct glist_head *glist;
+
+	if (latency == 0 || mem_async_fridge == NULL || !op_ctx->async_io) {
+		/* Wait here, done_cb is expected on this thread */
+		mem_inject_latency(latency);
+		done_cb(obj_hdl, fsalstat(ERR_FSAL_NO_ERROR, 0), io_arg,
+			caller_arg);
+		return;
+	}
+
+	op = gsh_malloc(sizeof(*op));
+	now(&op->due);
+	timespec_add_nsecs((nsecs_elapsed_t) latency * NS_PER_USEC, &op->due);
+	op->obj_hdl = obj_hdl;
+	op->done_cb = done_cb;
+	op->io_arg = io_arg;
+	op->caller_arg = caller_arg;
+	fsal_async_ctx_save(&op->ctx);
+
+	q = &mem_async_queues[atomic_postinc_uint32_t(&mem_async_next_op) %
+			      mem_async_nqueues];
+
+	PTHREAD_MUTEX_lock(&q->lock);
+
+	/* Latencies are per type of I/O, so this is nearly always the tail */
+	for (glist = q->ops.prev; glist != &q->ops; glist = glist->prev) {
+		struct mem_async_op *prev =
+			glist_entry(glist, struct mem_async_op, list);
+
+		if (gsh_time_cmp(&prev->due, &op->due) <= 0)
+			break;
+	}
+	glist_add(glist, &op->list);
+
+	if (q->ops.next == &op->list) {
+		/* New first due, the thread may be sleeping for another */
+		pthread_cond_signal(&q->cond);
+	}
+
+	PTHREAD_MUTEX_unlock(&q->lock);
+}
+
+/**
+ * @brief Run a completion thread
+ *
+ * Each thread takes a queue of its own, and calls done_cb for its
+ * operations as they fall due.  When stopping, what is left is completed
+ * at once.
+ *
+ * @param[in] ctx	Thread context
+ */
+static void mem_async_run(struct fridgethr_context *ctx)
+{
+	struct mem_async_queue *q;
+	struct mem_async_op *op;
+	struct timespec ts, limit;
+
+	q = &mem_async_queues[atomic_postinc_uint32_t(&mem_async_next_thread) %
+			      mem_async_nqueues];
+
+	PTHREAD_MUTEX_lock(&q->lock);
+
+	while (!fridgethr_you_should_break(ctx)) {
+		/* Wake up now and then to see if we should stop */
+		now(&limit);
+		limit.tv_sec++;
+
+		op = glist_first_entry(&q->ops, struct mem_async_op, list);
+		if (op == NULL) {
+			pthread_cond_timedwait(&q->cond, &q->lock, &limit);
+			continue;
+		}
+
+		now(&ts);
+		if (gsh_time_cmp(&op->due, &ts) > 0) {
+			if (gsh_time_cmp(&op->due, &limit) < 0)
+				limit = op->due;
+			pthread_cond_timedwait(&q->cond, &q->lock, &limit);
+			continue;
+		}
+
+		glist_del(&op->list);
+		PTHREAD_MUTEX_unlock(&q->lock);
+		mem_async_done(op);
+		PTHREAD_MUTEX_lock(&q->lock);
+	}
+
+	while ((op = glist_first_entry(&q->ops, struct mem_async_op, list))) {
+		glist_del(&op->list);
+		PTHREAD_MUTEX_unlock(&q->lock);
+		mem_async_done(op);
+		PTHREAD_MUTEX_lock(&q->lock);
+	}
+
+	PTHREAD_MUTEX_unlock(&q->lock);
+}
+
+/**
+ * Initialize subsystem
+ */
+fsal_status_t
+mem_async_pkginit(void)
+{
+	/* Return code from system calls */
+	int code = 0;
+	struct fridgethr_params frp;
+	uint32_t i;
+
+	if (MEM.async_threads == 0 ||
+	    (MEM.read_latency == 0 && MEM.write_latency == 0)) {
+		/* Nothing to put off */
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	if (mem_async_fridge) {
+		/* Already initialized */
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	mem_async_nqueues = MEM.async_threads;
+	mem_async_queues = gsh_calloc(mem_async_nqueues,
+				      sizeof(*mem_async_queues));
+	for (i = 0; i < mem_async_nqueues; i++) {
+		PTHREAD_MUTEX_init(&mem_async_queues[i].lock, NULL);
+		PTHREAD_COND_init(&mem_async_queues[i].cond, NULL);
+		glist_init(&mem_async_queues[i].ops);
+	}
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = mem_async_nqueues;
+	frp.thr_min = mem_async_nqueues;
+	frp.flavor = fridgethr_flavor_worker;
+
+	code = fridgethr_init(&mem_async_fridge, "MEM_ASYNC_fridge", &frp);
+	if (code != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Unable to initialize MEM_ASYNC fridge, error code %d.",
+			 code);
+		goto out;
+	}
+
+	code = fridgethr_populate(mem_async_fridge, mem_async_run, NULL);
+	if (code != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Unable to start MEM_ASYNC threads, error code %d.",
+			 code);
+		fridgethr_destroy(mem_async_fridge);
+		mem_async_fridge = NULL;
+		goto out;
+	}
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+out:
+	for (i = 0; i < mem_async_nqueues; i++) {
+		PTHREAD_MUTEX_destroy(&mem_async_queues[i].lock);
+		PTHREAD_COND_destroy(&mem_async_queues[i].cond);
+	}
+	gsh_free(mem_async_queues);
+	mem_async_queues = NULL;
+	return posix2fsal_status(code);
+}
+
+/**
+ * Shutdown subsystem
+ *
+ * @return FSAL status
+ */
+fsal_status_t
+mem_async_pkgshutdown(void)
+{
+	uint32_t i;
+	int rc;
+
+	if (!mem_async_fridge) {
+		/* Latency wasn't configured */
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	rc = fridgethr_sync_command(mem_async_fridge, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_FSAL,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(mem_async_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Failed shutting down MEM_ASYNC threads: %d", rc);
+	}
+
+	fridgethr_destroy(mem_async_fridge);
+	mem_async_fridge = NULL;
+
+	for (i = 0; i < mem_async_nqueues; i++) {
+		PTHREAD_MUTEX_destroy(&mem_async_queues[i].lock);
+		PTHREAD_COND_destroy(&mem_async_queues[i].cond);
+	}
+	gsh_free(mem_async_queues);
+	mem_async_queues = NULL;
+
+	return fsalstat(posix2fsal_error(rc), rc);
+}
@@ -76,13 +76,13 @@ static void mem_release_export(struct fsal_export *exp_hdl)
 			 "Releasing hdl=%p, name=%s",
 			 myself->root_handle, myself->root_handle->m_name);
 
-		PTHREAD_RWLOCK_wrlock(&myself->mfe_exp_lock);
 		mem_free_handle(myself->root_handle);
-		PTHREAD_RWLOCK_unlock(&myself->mfe_exp_lock);
 
 		myself->root_handle = NULL;
 	}
 
+	mem_fini_shards(myself);
+
 	fsal_detach_export(exp_hdl->fsal, &exp_hdl->exports);
 	free_export_ops(exp_hdl);
 
@@ -204,18 +204,10 @@ fsal_status_t mem_create_export(struct fsal_module *fsal_hdl,
 {
 	struct mem_fsal_export *myself;
 	int retval = 0;
-	pthread_rwlockattr_t attrs;
 
 	myself = gsh_calloc(1, sizeof(struct mem_fsal_export));
 
-	glist_init(&myself->mfe_objs);
-	pthread_rwlockattr_init(&attrs);
-#ifdef GLIBC
-	pthread_rwlockattr_setkind_np(&attrs,
-		PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
-#endif
-	PTHREAD_RWLOCK_init(&myself->mfe_exp_lock, &attrs);
-	pthread_rwlockattr_destroy(&attrs);
+	mem_init_shards(myself);
 	fsal_export_init(&myself->export);
 	mem_export_ops_init(&myself->export.exp_ops);
 
@@ -226,6 +218,7 @@ fsal_status_t mem_create_export(struct fsal_module *fsal_hdl,
 		LogMajor(COMPONENT_FSAL,
 			 "Could not attach export");
 		free_export_ops(&myself->export);
+		mem_fini_shards(myself);
 		gsh_free(myself);	/* elvis has left the building */
 
 		return fsalstat(posix2fsal_error(retval), retval);
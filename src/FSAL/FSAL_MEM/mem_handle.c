@@ -78,6 +78,58 @@ mem_i_cmpf(const struct avltree_node *lhs,
 	return 1;
 }
 
+static inline int
+mem_h_cmpf(const struct avltree_node *lhs,
+		const struct avltree_node *rhs)
+{
+	struct mem_fsal_obj_handle *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct mem_fsal_obj_handle,
+				  mfo_handle_node);
+	rk = avltree_container_of(rhs, struct mem_fsal_obj_handle,
+				  mfo_handle_node);
+
+	return memcmp(lk->handle, rk->handle, V4_FH_OPAQUE_SIZE);
+}
+
+/**
+ * @brief Set up the object shards of a new export
+ *
+ * @param[in] mfe	MEM export
+ */
+void mem_init_shards(struct mem_fsal_export *mfe)
+{
+	pthread_rwlockattr_t attrs;
+	int i;
+
+	pthread_rwlockattr_init(&attrs);
+#ifdef GLIBC
+	pthread_rwlockattr_setkind_np(&attrs,
+		PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+	for (i = 0; i < MEM_OBJ_SHARDS; i++) {
+		struct mem_obj_shard *shard = &mfe->mfe_shards[i];
+
+		PTHREAD_RWLOCK_init(&shard->lock, &attrs);
+		glist_init(&shard->objs);
+		avltree_init(&shard->handles, mem_h_cmpf, 0);
+	}
+	pthread_rwlockattr_destroy(&attrs);
+}
+
+/**
+ * @brief Tear down the object shards of an export
+ *
+ * @param[in] mfe	MEM export
+ */
+void mem_fini_shards(struct mem_fsal_export *mfe)
+{
+	int i;
+
+	for (i = 0; i < MEM_OBJ_SHARDS; i++)
+		PTHREAD_RWLOCK_destroy(&mfe->mfe_shards[i].lock);
+}
+
 /**
  * @brief Clean up and free an object handle
  *
@@ -128,9 +180,7 @@ static void mem_cleanup(struct mem_fsal_obj_handle *myself)
 		break;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&mfe->mfe_exp_lock);
 	mem_free_handle(myself);
-	PTHREAD_RWLOCK_unlock(&mfe->mfe_exp_lock);
 }
 
 #define mem_int_get_ref(myself) _mem_int_get_ref(myself, __func__, __LINE__)
@@ -547,10 +597,11 @@ _mem_alloc_handle(struct mem_fsal_obj_handle *parent,
 		  const char *func, int line)
 {
 	struct mem_fsal_obj_handle *hdl;
+	struct mem_obj_shard *shard;
 	size_t isize;
 
 	isize = sizeof(struct mem_fsal_obj_handle);
-	if (type == REGULAR_FILE) {
+	if (type == REGULAR_FILE && !MEM.null_data) {
 		/* Regular files need space to read/write */
 		isize += MEM.inode_size;
 	}
@@ -560,13 +611,16 @@ _mem_alloc_handle(struct mem_fsal_obj_handle *parent,
 	/* Establish tree details for this directory */
 	hdl->m_name = gsh_strdup(name);
 	hdl->obj_handle.fileid = atomic_postinc_uint64_t(&mem_inode_number);
-	hdl->datasize = MEM.inode_size;
+	hdl->datasize = MEM.null_data ? 0 : MEM.inode_size;
 	glist_init(&hdl->dirents);
-	PTHREAD_RWLOCK_wrlock(&mfe->mfe_exp_lock);
-	glist_add_tail(&mfe->mfe_objs, &hdl->mfo_exp_entry);
-	hdl->mfo_exp = mfe;
-	PTHREAD_RWLOCK_unlock(&mfe->mfe_exp_lock);
 	package_mem_handle(hdl);
+	shard = mem_obj_shard(mfe, hdl->handle);
+	PTHREAD_RWLOCK_wrlock(&shard->lock);
+	glist_add_tail(&shard->objs, &hdl->mfo_exp_entry);
+	/* The fileid in the hash keeps handles unique */
+	avltree_insert(&hdl->mfo_handle_node, &shard->handles);
+	hdl->mfo_exp = mfe;
+	PTHREAD_RWLOCK_unlock(&shard->lock);
 
 	/* Fills the output struct */
 	hdl->obj_handle.type = type;
@@ -785,6 +839,8 @@ static fsal_status_t mem_lookup(struct fsal_obj_handle *parent,
 	struct mem_fsal_obj_handle *myself, *hdl = NULL;
 	fsal_status_t status;
 
+	mem_inject_latency(MEM.meta_latency);
+
 	myself = container_of(parent,
 			      struct mem_fsal_obj_handle,
 			      obj_handle);
@@ -845,6 +901,8 @@ static fsal_status_t mem_readdir(struct fsal_obj_handle *dir_hdl,
 	enum fsal_dir_result cb_rc;
 	int count = 0;
 
+	mem_inject_latency(MEM.meta_latency);
+
 	myself = container_of(dir_hdl,
 			      struct mem_fsal_obj_handle,
 			      obj_handle);
@@ -947,6 +1005,8 @@ static fsal_status_t mem_mkdir(struct fsal_obj_handle *dir_hdl,
 	struct mem_fsal_obj_handle *parent =
 		container_of(dir_hdl, struct mem_fsal_obj_handle, obj_handle);
 
+	mem_inject_latency(MEM.meta_latency);
+
 	LogDebug(COMPONENT_FSAL, "mkdir %s", name);
 
 #ifdef USE_LTTNG
@@ -980,6 +1040,8 @@ static fsal_status_t mem_mknode(struct fsal_obj_handle *dir_hdl,
 		container_of(dir_hdl, struct mem_fsal_obj_handle, obj_handle);
 	fsal_status_t status;
 
+	mem_inject_latency(MEM.meta_latency);
+
 	LogDebug(COMPONENT_FSAL, "mknode %s", name);
 
 	status = mem_create_obj(parent, nodetype, name, attrs_in, new_obj,
@@ -1017,6 +1079,8 @@ static fsal_status_t mem_symlink(struct fsal_obj_handle *dir_hdl,
 		container_of(dir_hdl, struct mem_fsal_obj_handle, obj_handle);
 	fsal_status_t status;
 
+	mem_inject_latency(MEM.meta_latency);
+
 	LogDebug(COMPONENT_FSAL, "symlink %s", name);
 
 	status = mem_create_obj(parent, SYMBOLIC_LINK, name, attrs_in, new_obj,
@@ -1046,6 +1110,8 @@ static fsal_status_t mem_readlink(struct fsal_obj_handle *obj_hdl,
 	struct mem_fsal_obj_handle *myself =
 		container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
 
+	mem_inject_latency(MEM.meta_latency);
+
 	if (obj_hdl->type != SYMBOLIC_LINK) {
 		LogCrit(COMPONENT_FSAL,
 			"Handle is not a symlink. hdl = 0x%p",
@@ -1072,6 +1138,8 @@ static fsal_status_t mem_getattrs(struct fsal_obj_handle *obj_hdl,
 	struct mem_fsal_obj_handle *myself =
 		container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
 
+	mem_inject_latency(MEM.meta_latency);
+
 	if (!myself->is_export && glist_empty(&myself->dirents)) {
 		/* Removed entry - stale */
 		LogDebug(COMPONENT_FSAL,
@@ -1123,6 +1191,8 @@ fsal_status_t mem_setattr2(struct fsal_obj_handle *obj_hdl,
 	struct mem_fsal_obj_handle *myself =
 		container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
 
+	mem_inject_latency(MEM.meta_latency);
+
 	/* apply umask, if mode attribute is to be changed */
 	if (FSAL_TEST_MASK(attrs_set->valid_mask, ATTR_MODE))
 		attrs_set->mode &=
@@ -1168,6 +1238,8 @@ fsal_status_t mem_link(struct fsal_obj_handle *obj_hdl,
 	struct mem_fsal_obj_handle *hdl;
 	fsal_status_t status = {0, 0};
 
+	mem_inject_latency(MEM.meta_latency);
+
 	status = mem_int_lookup(dir, name, &hdl);
 	if (!FSAL_IS_ERROR(status)) {
 		/* It already exists */
@@ -1190,16 +1262,16 @@ fsal_status_t mem_link(struct fsal_obj_handle *obj_hdl,
 }
 
 /**
- * @brief Unlink a file
+ * @brief Unlink a file, for unlink and rename
  *
  * @param[in] dir_hdl	Parent directory handle
  * @param[in] obj_hdl	Object being removed
  * @param[in] name	Name of object to remove
  * @return FSAL status
  */
-static fsal_status_t mem_unlink(struct fsal_obj_handle *dir_hdl,
-				struct fsal_obj_handle *obj_hdl,
-				const char *name)
+static fsal_status_t mem_int_unlink(struct fsal_obj_handle *dir_hdl,
+				    struct fsal_obj_handle *obj_hdl,
+				    const char *name)
 {
 	struct mem_fsal_obj_handle *parent, *myself;
 	fsal_status_t status = {0, 0};
@@ -1265,6 +1337,23 @@ unlock:
 	return status;
 }
 
+/**
+ * @brief Unlink a file
+ *
+ * @param[in] dir_hdl	Parent directory handle
+ * @param[in] obj_hdl	Object being removed
+ * @param[in] name	Name of object to remove
+ * @return FSAL status
+ */
+static fsal_status_t mem_unlink(struct fsal_obj_handle *dir_hdl,
+				struct fsal_obj_handle *obj_hdl,
+				const char *name)
+{
+	mem_inject_latency(MEM.meta_latency);
+
+	return mem_int_unlink(dir_hdl, obj_hdl, name);
+}
+
 /**
  * @brief Close a file's global descriptor
  *
@@ -1323,6 +1412,8 @@ static fsal_status_t mem_rename(struct fsal_obj_handle *obj_hdl,
 	struct mem_fsal_obj_handle *mem_lookup_dst = NULL;
 	fsal_status_t status;
 
+	mem_inject_latency(MEM.meta_latency);
+
 	status = mem_int_lookup(mem_newdir, new_name, &mem_lookup_dst);
 	if (!FSAL_IS_ERROR(status)) {
 		uint32_t numkids;
@@ -1349,8 +1440,8 @@ static fsal_status_t mem_rename(struct fsal_obj_handle *obj_hdl,
 		}
 
 		/* Unlink destination */
-		status = mem_unlink(newdir_hdl, &mem_lookup_dst->obj_handle,
-				    new_name);
+		status = mem_int_unlink(newdir_hdl,
+					&mem_lookup_dst->obj_handle, new_name);
 		if (FSAL_IS_ERROR(status)) {
 			return status;
 		}
@@ -1411,6 +1502,8 @@ fsal_status_t mem_open2(struct fsal_obj_handle *obj_hdl,
 	bool created = false;
 	struct attrlist verifier_attr;
 
+	mem_inject_latency(MEM.meta_latency);
+
 	if (state != NULL)
 		my_fd = (struct fsal_fd *)(state + 1);
 
@@ -1642,6 +1735,8 @@ fsal_status_t mem_reopen2(struct fsal_obj_handle *obj_hdl,
 	struct fsal_fd *my_fd = (struct fsal_fd *)(state + 1);
 	fsal_openflags_t old_openflags;
 
+	mem_inject_latency(MEM.meta_latency);
+
 #ifdef USE_LTTNG
 	tracepoint(fsalmem, mem_open, __func__, __LINE__, obj_hdl,
 			   myself->m_name, state, openflags & FSAL_O_TRUNC,
@@ -1741,7 +1836,10 @@ void mem_read2(struct fsal_obj_handle *obj_hdl,
 		if (offset +  bufsize > myself->attrs.filesize) {
 			bufsize = myself->attrs.filesize - offset;
 		}
-		if (offset < myself->datasize) {
+		if (MEM.null_data) {
+			/* Nothing kept, so nothing to copy */
+			memset(read_arg->iov[i].iov_base, 0, bufsize);
+		} else if (offset < myself->datasize) {
 			size_t readsize;
 
 			/* Data to read */
@@ -1769,7 +1867,8 @@ void mem_read2(struct fsal_obj_handle *obj_hdl,
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
 
-	done_cb(obj_hdl, fsalstat(ERR_FSAL_NO_ERROR, 0), read_arg, caller_arg);
+	mem_async_complete(obj_hdl, done_cb, read_arg, caller_arg,
+			   MEM.read_latency);
 }
 
 /**
@@ -1839,6 +1938,7 @@ void mem_write2(struct fsal_obj_handle *obj_hdl,
 			myself->attrs.filesize = myself->attrs.spaceused =
 				offset + bufsize;
 		}
+		/* With Null_Data there is no data, and datasize is 0 */
 		if (offset < myself->datasize) {
 			size_t writesize;
 
@@ -1866,7 +1966,8 @@ void mem_write2(struct fsal_obj_handle *obj_hdl,
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
 
-	done_cb(obj_hdl, fsalstat(ERR_FSAL_NO_ERROR, 0), write_arg, caller_arg);
+	mem_async_complete(obj_hdl, done_cb, write_arg, caller_arg,
+			   MEM.write_latency);
 }
 
 /**
@@ -1890,6 +1991,8 @@ fsal_status_t mem_commit2(struct fsal_obj_handle *obj_hdl,
 			  off_t offset,
 			  size_t len)
 {
+	mem_inject_latency(MEM.meta_latency);
+
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
@@ -1992,6 +2095,8 @@ fsal_status_t mem_close2(struct fsal_obj_handle *obj_hdl,
 				  struct mem_fsal_obj_handle, obj_handle);
 	fsal_status_t status;
 
+	mem_inject_latency(MEM.meta_latency);
+
 #ifdef USE_LTTNG
 	tracepoint(fsalmem, mem_close, __func__, __LINE__, obj_hdl,
 		   myself->m_name, state);
@@ -2273,12 +2378,16 @@ fsal_status_t mem_create_handle(struct fsal_export *exp_hdl,
 				struct fsal_obj_handle **obj_hdl,
 				struct attrlist *attrs_out)
 {
-	struct glist_head *glist;
-	struct fsal_obj_handle *hdl;
-	struct mem_fsal_obj_handle *my_hdl;
+	struct mem_fsal_export *mfe =
+		container_of(exp_hdl, struct mem_fsal_export, export);
+	struct mem_obj_shard *shard;
+	struct mem_fsal_obj_handle key, *my_hdl;
+	struct avltree_node *node;
 
 	*obj_hdl = NULL;
 
+	mem_inject_latency(MEM.meta_latency);
+
 	if (hdl_desc->len != V4_FH_OPAQUE_SIZE) {
 		LogCrit(COMPONENT_FSAL,
 			"Invalid handle size %zu expected %lu",
@@ -2288,43 +2397,38 @@ fsal_status_t mem_create_handle(struct fsal_export *exp_hdl,
 		return fsalstat(ERR_FSAL_BADHANDLE, 0);
 	}
 
-	PTHREAD_RWLOCK_rdlock(&exp_hdl->fsal->lock);
+	memcpy(key.handle, hdl_desc->addr, V4_FH_OPAQUE_SIZE);
+	shard = mem_obj_shard(mfe, key.handle);
 
-	glist_for_each(glist, &exp_hdl->fsal->handles) {
-		hdl = glist_entry(glist, struct fsal_obj_handle, handles);
+	PTHREAD_RWLOCK_rdlock(&shard->lock);
 
-		my_hdl = container_of(hdl,
-				      struct mem_fsal_obj_handle,
-				      obj_handle);
+	node = avltree_lookup(&key.mfo_handle_node, &shard->handles);
+	if (node == NULL) {
+		PTHREAD_RWLOCK_unlock(&shard->lock);
 
-		if (memcmp(my_hdl->handle,
-			   hdl_desc->addr,
-			   V4_FH_OPAQUE_SIZE) == 0) {
-			LogDebug(COMPONENT_FSAL,
-				 "Found hdl=%p name=%s",
-				 my_hdl, my_hdl->m_name);
+		LogDebug(COMPONENT_FSAL,
+			"Could not find handle");
 
-#ifdef USE_LTTNG
-			tracepoint(fsalmem, mem_create_handle, __func__,
-				   __LINE__, hdl, my_hdl->m_name);
-#endif
-			*obj_hdl = hdl;
+		return fsalstat(ERR_FSAL_STALE, ESTALE);
+	}
 
-			PTHREAD_RWLOCK_unlock(&exp_hdl->fsal->lock);
+	my_hdl = avltree_container_of(node, struct mem_fsal_obj_handle,
+				      mfo_handle_node);
 
-			if (attrs_out != NULL) {
-				fsal_copy_attrs(attrs_out, &my_hdl->attrs,
-						false);
-			}
+	LogDebug(COMPONENT_FSAL,
+		 "Found hdl=%p name=%s",
+		 my_hdl, my_hdl->m_name);
 
-			return fsalstat(ERR_FSAL_NO_ERROR, 0);
-		}
-	}
+#ifdef USE_LTTNG
+	tracepoint(fsalmem, mem_create_handle, __func__,
+		   __LINE__, &my_hdl->obj_handle, my_hdl->m_name);
+#endif
+	*obj_hdl = &my_hdl->obj_handle;
 
-	LogDebug(COMPONENT_FSAL,
-		"Could not find handle");
+	PTHREAD_RWLOCK_unlock(&shard->lock);
 
-	PTHREAD_RWLOCK_unlock(&exp_hdl->fsal->lock);
+	if (attrs_out != NULL)
+		fsal_copy_attrs(attrs_out, &my_hdl->attrs, false);
 
-	return fsalstat(ERR_FSAL_STALE, ESTALE);
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
@@ -28,12 +28,32 @@
 
 #include "avltree.h"
 #include "gsh_list.h"
+#include "gsh_intrinsic.h"
 #ifdef USE_LTTNG
 #include "gsh_lttng/fsal_mem.h"
 #endif
 
 struct mem_fsal_obj_handle;
 
+/** Shards of the object table of an export, a power of 2 */
+#define MEM_OBJ_SHARDS 64
+
+/**
+ * @brief One shard of the objects of an export
+ *
+ * Objects are spread by the hash that starts their handle, so creates
+ * and handle lookups on different objects rarely share a lock.
+ */
+struct mem_obj_shard {
+	/** Lock protecting objs and handles */
+	pthread_rwlock_t lock;
+	/** Objects in this shard */
+	struct glist_head objs;
+	/** The same objects, by handle */
+	struct avltree handles;
+	GSH_CACHE_PAD(0);
+};
+
 /**
  * MEM internal export
  */
@@ -46,10 +66,8 @@ struct mem_fsal_export {
 	struct mem_fsal_obj_handle *root_handle;
 	/** Entry into list of exports */
 	struct glist_head export_entry;
-	/** Lock protecting mfe_objs */
-	pthread_rwlock_t mfe_exp_lock;
-	/** List of all the objects in this export */
-	struct glist_head mfe_objs;
+	/** All the objects in this export */
+	struct mem_obj_shard mfe_shards[MEM_OBJ_SHARDS];
 };
 
 fsal_status_t mem_lookup_path(struct fsal_export *exp_hdl,
@@ -94,7 +112,8 @@ struct mem_fsal_obj_handle {
 		} mh_symlink;
 	};
 	struct glist_head dirents; /**< List of dirents pointing to obj */
-	struct glist_head mfo_exp_entry; /**< Link into mfs_objs */
+	struct glist_head mfo_exp_entry; /**< Link into shard objs */
+	struct avltree_node mfo_handle_node; /**< Link into shard handles */
 	struct mem_fsal_export *mfo_exp; /**< Export owning object */
 	char *m_name;	/**< Base name of obj, for debugging */
 	uint32_t datasize;
@@ -137,21 +156,43 @@ fsal_status_t mem_create_export(struct fsal_module *fsal_hdl,
 				const struct fsal_up_vector *up_ops);
 
 
+/**
+ * @brief Find the shard of an export holding a handle
+ *
+ * @param[in] mfe	MEM export
+ * @param[in] handle	Wire handle, starting with its hash
+ * @return The shard
+ */
+static inline struct mem_obj_shard *
+mem_obj_shard(struct mem_fsal_export *mfe, const char *handle)
+{
+	uint64_t hashkey;
+
+	memcpy(&hashkey, handle, sizeof(hashkey));
+	return &mfe->mfe_shards[hashkey & (MEM_OBJ_SHARDS - 1)];
+}
+
 #define mem_free_handle(h) _mem_free_handle(h, __func__, __LINE__)
 /**
  * @brief Free a MEM handle
  *
- * @note mfe_exp_lock MUST be held for write
+ * Takes the lock of the handle's shard.
+ *
  * @param[in] hdl	Handle to free
  */
 static inline void _mem_free_handle(struct mem_fsal_obj_handle *hdl,
 				    const char *func, int line)
 {
+	struct mem_obj_shard *shard = mem_obj_shard(hdl->mfo_exp, hdl->handle);
+
 #ifdef USE_LTTNG
 	tracepoint(fsalmem, mem_free, func, line, hdl, hdl->m_name);
 #endif
 
+	PTHREAD_RWLOCK_wrlock(&shard->lock);
 	glist_del(&hdl->mfo_exp_entry);
+	avltree_remove(&hdl->mfo_handle_node, &shard->handles);
+	PTHREAD_RWLOCK_unlock(&shard->lock);
 	hdl->mfo_exp = NULL;
 
 	if (hdl->m_name != NULL) {
@@ -162,6 +203,8 @@ static inline void _mem_free_handle(struct mem_fsal_obj_handle *hdl,
 	gsh_free(hdl);
 }
 
+void mem_init_shards(struct mem_fsal_export *mfe);
+void mem_fini_shards(struct mem_fsal_export *mfe);
 void mem_clean_export(struct mem_fsal_obj_handle *root);
 void mem_clean_all_dirents(struct mem_fsal_obj_handle *parent);
 
@@ -179,6 +222,16 @@ struct mem_fsal_module {
 	uint32_t inode_size;
 	/** Config - Interval for UP call thread */
 	uint32_t up_interval;
+	/** Config - Keep no data: reads return zeroes, writes are dropped */
+	bool null_data;
+	/** Config - Microseconds added to each read */
+	uint32_t read_latency;
+	/** Config - Microseconds added to each write */
+	uint32_t write_latency;
+	/** Config - Microseconds added to each metadata operation */
+	uint32_t meta_latency;
+	/** Config - Threads completing delayed reads and writes */
+	uint32_t async_threads;
 	/** Next unused inode */
 	uint64_t next_inode;
 };
@@ -188,4 +241,12 @@ struct mem_fsal_module {
 fsal_status_t mem_up_pkginit(void);
 fsal_status_t mem_up_pkgshutdown(void);
 
+/* Latency injection */
+fsal_status_t mem_async_pkginit(void);
+fsal_status_t mem_async_pkgshutdown(void);
+void mem_async_complete(struct fsal_obj_handle *obj_hdl,
+			fsal_async_cb done_cb, struct fsal_io_arg *io_arg,
+			void *caller_arg, uint32_t latency);
+void mem_inject_latency(uint32_t latency);
+
 extern struct mem_fsal_module MEM;
@@ -83,6 +83,16 @@ static struct config_item mem_items[] = {
 		       mem_fsal_module, inode_size),
 	CONF_ITEM_UI32("Up_Test_Interval", 0, UINT32_MAX, 0,
 		       mem_fsal_module, up_interval),
+	CONF_ITEM_BOOL("Null_Data", false,
+		       mem_fsal_module, null_data),
+	CONF_ITEM_UI32("Read_Latency", 0, 10000000, 0,
+		       mem_fsal_module, read_latency),
+	CONF_ITEM_UI32("Write_Latency", 0, 10000000, 0,
+		       mem_fsal_module, write_latency),
+	CONF_ITEM_UI32("Meta_Latency", 0, 10000000, 0,
+		       mem_fsal_module, meta_latency),
+	CONF_ITEM_UI32("Async_Threads", 0, 256, 4,
+		       mem_fsal_module, async_threads),
 	CONFIG_EOL
 };
 
@@ -133,6 +143,15 @@ static fsal_status_t mem_init_config(struct fsal_module *fsal_hdl,
 		return status;
 	}
 
+	/* Initialize latency injection */
+	status = mem_async_pkginit();
+	if (FSAL_IS_ERROR(status)) {
+		LogMajor(COMPONENT_FSAL,
+			 "Failed to initialize FSAL_MEM async package %s",
+			 fsal_err_txt(status));
+		return status;
+	}
+
 	display_fsinfo(&mem_me->fsal);
 	LogFullDebug(COMPONENT_FSAL,
 		     "Supported attributes constant = 0x%" PRIx64,
@@ -189,6 +208,9 @@ MODULE_FINI void finish(void)
 	/* Shutdown UP calls */
 	mem_up_pkgshutdown();
 
+	/* Complete what is still delayed */
+	mem_async_pkgshutdown();
+
 	retval = unregister_fsal(&MEM.fsal);
 	if (retval != 0) {
 		LogCrit(COMPONENT_FSAL,
@@ -150,14 +150,23 @@ struct mem_fsal_obj_handle *
 mem_rand_obj(struct mem_fsal_export *mfe)
 {
 	struct mem_fsal_obj_handle *res = NULL;
+	struct mem_obj_shard *shard;
 	struct glist_head *glist, *glistn;
 	uint32_t n = 2;
+	uint32_t first = rand(), i;
 
-	if (glist_empty(&mfe->mfe_objs))
+	/* Pick within the first non-empty shard from a random one */
+	for (i = 0; i < MEM_OBJ_SHARDS; i++) {
+		shard = &mfe->mfe_shards[(first + i) & (MEM_OBJ_SHARDS - 1)];
+		if (!glist_empty(&shard->objs))
+			break;
+	}
+
+	if (i == MEM_OBJ_SHARDS)
 		return NULL;
 
-	PTHREAD_RWLOCK_rdlock(&mfe->mfe_exp_lock);
-	glist_for_each_safe(glist, glistn, &mfe->mfe_objs) {
+	PTHREAD_RWLOCK_rdlock(&shard->lock);
+	glist_for_each_safe(glist, glistn, &shard->objs) {
 		if (res == NULL) {
 			/* Grab first entry */
 			res = glist_entry(glist, struct mem_fsal_obj_handle,
@@ -173,7 +182,7 @@ mem_rand_obj(struct mem_fsal_export *mfe)
 		}
 		n++;
 	}
-	PTHREAD_RWLOCK_unlock(&mfe->mfe_exp_lock);
+	PTHREAD_RWLOCK_unlock(&shard->lock);
 
 	return res;
 }
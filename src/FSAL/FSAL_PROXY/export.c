@@ -65,6 +65,18 @@ static struct config_item proxy_export_params[] = {
 		       pxy_client_params, use_privileged_client_port),
 	CONF_ITEM_UI32("RPC_Client_Timeout", 1, 60*4, 60,
 		       pxy_client_params, srv_timeout),
+	CONF_ITEM_UI32("Num_Connections", 1, 16, 1,
+		       pxy_client_params, num_connections),
+	CONF_ITEM_UI32("Session_Slots", 1, 256, 16,
+		       pxy_client_params, session_slots),
+	CONF_ITEM_UI32("Readahead_Pages", 0, 64, 0,
+		       pxy_client_params, readahead_pages),
+	CONF_ITEM_UI32("Data_Cache_Pages", 1, 4096, 64,
+		       pxy_client_params, data_cache_pages),
+	CONF_ITEM_UI32("Data_Cache_Expiration", 0, 3600, 10,
+		       pxy_client_params, data_cache_expiration),
+	CONF_ITEM_BOOL("Write_Behind", false,
+		       pxy_client_params, write_behind),
 #ifdef _USE_GSSRPC
 	CONF_ITEM_STR("Remote_PrincipalName", 0, MAXNAMLEN, NULL,
 		      pxy_client_params, remote_principal),
@@ -45,9 +45,10 @@ do {gsh_free(argcompound.argarray_val); } while (0)
 
 /**
  * Notice about NFS4_OP_SEQUENCE argop filling :
- * As rpc_context and slot are mutualized, sa_slotid and related sa_sequenceid
- * are place holder filled later on pxy_compoundv4_execute function, only when
- * the free pxy_rpc_io_context is chosen.
+ * As rpc_context and slot are mutualized, sa_slotid, the related
+ * sa_sequenceid and sa_highest_slotid are place holder filled later on
+ * pxy_compoundv4_execute function, only when the free pxy_rpc_io_context
+ * is chosen.
  */
 #define COMPOUNDV4_ARG_ADD_OP_SEQUENCE(opcnt, argarray, sessionid, nb_slot) \
 do {									\
@@ -85,7 +86,7 @@ do {									\
 	fore_attrs->ca_maxresponsesize = info->srv_recvsize;		\
 	fore_attrs->ca_maxresponsesize_cached = info->srv_recvsize;	\
 	fore_attrs->ca_maxoperations = NB_MAX_OPERATIONS;		\
-	fore_attrs->ca_maxrequests = NB_RPC_SLOT;			\
+	fore_attrs->ca_maxrequests = info->session_slots;		\
 	fore_attrs->ca_rdma_ird.ca_rdma_ird_len = 0;			\
 	fore_attrs->ca_rdma_ird.ca_rdma_ird_val = NULL;			\
 	back_attrs = &opcreate_session->csa_back_chan_attrs;		\
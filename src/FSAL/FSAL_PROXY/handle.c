@@ -44,12 +44,19 @@
 #include "nfs_proto_tools.h"
 #include "export_mgr.h"
 #include "common_utils.h"
+#include "fridgethr.h"
 
 #define FSAL_PROXY_NFS_V4 4
 #define FSAL_PROXY_NFS_V4_MINOR 1
 #define NB_RPC_SLOT 16
 #define NB_MAX_OPERATIONS 10
 
+/* Slot id bits at the bottom of an xid, Session_Slots is at most this */
+#define PXY_XID_SLOT_BITS 8
+#define PXY_MAX_SLOTS (1U << PXY_XID_SLOT_BITS)
+/* Marks pending, so xid 0 can be awaited too */
+#define PXY_XID_PENDING (1ULL << 32)
+
 /* NB! nfs_prog is just an easy way to get this info into the call
  *     It should really be fetched via export pointer */
 /**
@@ -59,7 +66,10 @@ struct pxy_rpc_io_context {
 	pthread_mutex_t iolock;
 	pthread_cond_t iowait;
 	struct glist_head calls;
+	struct pxy_rpc_conn *conn;
 	uint32_t rpc_xid;
+	/** PXY_XID_PENDING | rpc_xid while its reply is awaited, else 0 */
+	uint64_t pending;
 	bool iodone;
 	int ioresult;
 	unsigned int nfs_prog;
@@ -69,6 +79,7 @@ struct pxy_rpc_io_context {
 	char *recvbuf;
 	slotid4 slotid;
 	sequenceid4 seqid;
+	uint32_t session_gen;
 };
 
 /* Use this to estimate storage requirements for fattr4 blob */
@@ -106,9 +117,32 @@ struct pxy_handle_blob {
 	uint8_t bytes[0];
 };
 
+/*
+ * Read-ahead pages and background writes of a file.
+ *
+ * lock protects all of it and comes before the export's dc.lock.
+ * io_done is signalled as background reads and writes complete.
+ */
+struct pxy_file_cache {
+	pthread_mutex_t lock;
+	pthread_cond_t io_done;
+	struct pxy_export *pxy_exp;
+	struct glist_head pages;
+	struct glist_head write_jobs;
+	uint64_t next_offset;	/*< Where a sequential read goes on */
+	uint32_t sequential;	/*< Sequential reads in a row */
+	uint32_t inflight;	/*< Background reads and writes */
+	uint32_t writes;	/*< Background writes */
+	nfsstat4 write_error;	/*< First failed background write */
+	verifier4 verf;		/*< Write verifier of the unstable writes */
+	bool verf_set;
+	bool unstable;		/*< Background writes await a COMMIT */
+};
+
 struct pxy_obj_handle {
 	struct fsal_obj_handle obj;
 	nfs_fh4 fh4;
+	struct pxy_file_cache fc;
 #ifdef PROXY_HANDLE_MAPPING
 	nfs23_map_handle_t h23;
 #endif
@@ -271,6 +305,23 @@ static struct bitmap4 pxy_bitmap_getattr = {
 	.bitmap4_len = 2
 };
 
+/* READDIR also asks for the filehandles, saving a LOOKUP per entry */
+static struct bitmap4 pxy_bitmap_readdir = {
+	.map[0] =
+	    (PXY_ATTR_BIT(FATTR4_SUPPORTED_ATTRS) |
+	     PXY_ATTR_BIT(FATTR4_TYPE) | PXY_ATTR_BIT(FATTR4_CHANGE) |
+	     PXY_ATTR_BIT(FATTR4_SIZE) | PXY_ATTR_BIT(FATTR4_FSID) |
+	     PXY_ATTR_BIT(FATTR4_FILEHANDLE) | PXY_ATTR_BIT(FATTR4_FILEID)),
+	.map[1] =
+	    (PXY_ATTR_BIT2(FATTR4_MODE) | PXY_ATTR_BIT2(FATTR4_NUMLINKS) |
+	     PXY_ATTR_BIT2(FATTR4_OWNER) | PXY_ATTR_BIT2(FATTR4_OWNER_GROUP) |
+	     PXY_ATTR_BIT2(FATTR4_SPACE_USED) |
+	     PXY_ATTR_BIT2(FATTR4_TIME_ACCESS) |
+	     PXY_ATTR_BIT2(FATTR4_TIME_METADATA) |
+	     PXY_ATTR_BIT2(FATTR4_TIME_MODIFY) | PXY_ATTR_BIT2(FATTR4_RAWDEV)),
+	.bitmap4_len = 2
+};
+
 static struct bitmap4 pxy_bitmap_fsinfo = {
 	.map[0] =
 	    (PXY_ATTR_BIT(FATTR4_FILES_AVAIL) | PXY_ATTR_BIT(FATTR4_FILES_FREE)
@@ -362,10 +413,16 @@ static int pxy_got_rpc_reply(struct pxy_rpc_io_context *ctx, int sock, int sz,
 	char *repbuf = ctx->recvbuf;
 	int size;
 
-	if (sz > ctx->recvbuf_sz)
+	PTHREAD_MUTEX_lock(&ctx->iolock);
+	if (sz > ctx->recvbuf_sz) {
+		/* Fail the call rather than leave it waiting */
+		ctx->ioresult = -E2BIG;
+		ctx->iodone = true;
+		pthread_cond_signal(&ctx->iowait);
+		PTHREAD_MUTEX_unlock(&ctx->iolock);
 		return -E2BIG;
+	}
 
-	PTHREAD_MUTEX_lock(&ctx->iolock);
 	memcpy(repbuf, &xid, sizeof(xid));
 	/*
 	 * sz includes 4 bytes of xid which have been processed
@@ -395,19 +452,44 @@ static int pxy_got_rpc_reply(struct pxy_rpc_io_context *ctx, int sock, int sz,
 	return size;
 }
 
-static int pxy_rpc_read_reply(struct pxy_export *pxy_exp)
+/**
+ * @brief Stop waiting for the reply to the last call sent from a slot
+ *
+ * @return false if a reply or a reconnect got to the call first.
+ */
+static inline bool pxy_rpc_disarm(struct pxy_rpc_io_context *ctx)
+{
+	return __sync_bool_compare_and_swap(&ctx->pending,
+					    PXY_XID_PENDING | ctx->rpc_xid, 0);
+}
+
+/**
+ * @brief Pick the xid of the next call sent from a slot
+ *
+ * The slot id goes in the low bits so the receive thread can find the
+ * call without a lookup.
+ */
+static inline uint32_t pxy_rpc_next_xid(struct pxy_export *pxy_exp,
+					struct pxy_rpc_io_context *ctx)
 {
+	return (atomic_postinc_uint32_t(&pxy_exp->rpc.rpc_xid)
+		<< PXY_XID_SLOT_BITS) | ctx->slotid;
+}
+
+static int pxy_rpc_read_reply(struct pxy_rpc_conn *conn)
+{
+	struct pxy_export *pxy_exp = conn->pxy_exp;
 	struct {
 		uint recmark;
 		uint xid;
 	} h;
 	char *buf = (char *)&h;
-	struct glist_head *c;
+	uint32_t slot;
 	char sink[256];
 	int cnt = 0;
 
 	while (cnt < 8) {
-		int bc = read(pxy_exp->rpc.rpc_sock, buf + cnt, 8 - cnt);
+		int bc = read(conn->sock, buf + cnt, 8 - cnt);
 
 		if (bc < 0)
 			return -errno;
@@ -421,27 +503,24 @@ static int pxy_rpc_read_reply(struct pxy_export *pxy_exp)
 	LogDebug(COMPONENT_FSAL, "Recmark %x, xid %u\n", h.recmark, h.xid);
 	h.recmark &= ~(1U << 31);
 
-	PTHREAD_MUTEX_lock(&pxy_exp->rpc.listlock);
-	glist_for_each(c, &pxy_exp->rpc.rpc_calls) {
-		struct pxy_rpc_io_context *ctx =
-		    container_of(c, struct pxy_rpc_io_context, calls);
+	slot = h.xid & (PXY_MAX_SLOTS - 1);
+	if (slot < pxy_exp->rpc.nslots) {
+		struct pxy_rpc_io_context *ctx = pxy_exp->rpc.slots[slot];
 
-		if (ctx->rpc_xid == h.xid) {
-			glist_del(c);
-			PTHREAD_MUTEX_unlock(&pxy_exp->rpc.listlock);
-			return pxy_got_rpc_reply(ctx, pxy_exp->rpc.rpc_sock,
+		/* Claim the call, nobody else will complete it then */
+		if (__sync_bool_compare_and_swap(&ctx->pending,
+						 PXY_XID_PENDING | h.xid, 0))
+			return pxy_got_rpc_reply(ctx, conn->sock,
 						 h.recmark, h.xid);
-		}
 	}
-	PTHREAD_MUTEX_unlock(&pxy_exp->rpc.listlock);
 
 	cnt = h.recmark - 4;
-	LogDebug(COMPONENT_FSAL, "xid %u is not on the list, skip %d bytes\n",
+	LogDebug(COMPONENT_FSAL, "xid %u is not awaited, skip %d bytes\n",
 		 h.xid, cnt);
 	while (cnt > 0) {
 		int rb = (cnt > sizeof(sink)) ? sizeof(sink) : cnt;
 
-		rb = read(pxy_exp->rpc.rpc_sock, sink, rb);
+		rb = read(conn->sock, sink, rb);
 		if (rb <= 0)
 			return -errno;
 		cnt -= rb;
@@ -450,18 +529,20 @@ static int pxy_rpc_read_reply(struct pxy_export *pxy_exp)
 	return 0;
 }
 
-/* called with listlock */
-static void pxy_new_socket_ready(struct pxy_export *pxy_exp)
+/* called with conn->lock */
+static void pxy_new_socket_ready(struct pxy_rpc_conn *conn)
 {
-	struct glist_head *nxt;
-	struct glist_head *c;
+	struct pxy_export_rpc *rpc = &conn->pxy_exp->rpc;
+	uint32_t i;
 
 	/* If there are any outstanding calls then tell them to resend */
-	glist_for_each_safe(c, nxt, &pxy_exp->rpc.rpc_calls) {
-		struct pxy_rpc_io_context *ctx =
-		    container_of(c, struct pxy_rpc_io_context, calls);
+	for (i = conn->idx; i < rpc->nslots; i += rpc->nconns) {
+		struct pxy_rpc_io_context *ctx = rpc->slots[i];
+		uint64_t pending = atomic_fetch_uint64_t(&ctx->pending);
 
-		glist_del(c);
+		if (pending == 0 ||
+		    !__sync_bool_compare_and_swap(&ctx->pending, pending, 0))
+			continue;
 
 		PTHREAD_MUTEX_lock(&ctx->iolock);
 		ctx->iodone = true;
@@ -472,111 +553,116 @@ static void pxy_new_socket_ready(struct pxy_export *pxy_exp)
 
 	/* If there is anyone waiting for the socket then tell them
 	 * it's ready */
-	pthread_cond_broadcast(&pxy_exp->rpc.sockless);
+	pthread_cond_broadcast(&conn->sockless);
 }
 
-/* called with listlock */
-static int pxy_connect(struct pxy_export *pxy_exp,
-		       sockaddr_t *dest, uint16_t port)
+/* called with conn->lock */
+static int pxy_connect(struct pxy_rpc_conn *conn,
+		       const sockaddr_t *srv_addr, uint16_t port)
 {
+	struct pxy_export *pxy_exp = conn->pxy_exp;
+	sockaddr_t dest = *srv_addr;
 	int sock;
 	int socklen;
 
 	if (pxy_exp->info.use_privileged_client_port) {
 		int priv_port = 0;
 
-		sock = rresvport_af(&priv_port, dest->ss_family);
+		sock = rresvport_af(&priv_port, dest.ss_family);
 		if (sock < 0)
 			LogCrit(COMPONENT_FSAL,
 				"Cannot create TCP socket on privileged port");
 	} else {
-		sock = socket(dest->ss_family, SOCK_STREAM, IPPROTO_TCP);
+		sock = socket(dest.ss_family, SOCK_STREAM, IPPROTO_TCP);
 		if (sock < 0)
 			LogCrit(COMPONENT_FSAL, "Cannot create TCP socket - %d",
 				errno);
 	}
 
-	switch (dest->ss_family) {
+	switch (dest.ss_family) {
 	case AF_INET:
-		((struct sockaddr_in *)dest)->sin_port = htons(port);
+		((struct sockaddr_in *)&dest)->sin_port = htons(port);
 		socklen = sizeof(struct sockaddr_in);
 		break;
 	case AF_INET6:
-		((struct sockaddr_in6 *)dest)->sin6_port = htons(port);
+		((struct sockaddr_in6 *)&dest)->sin6_port = htons(port);
 		socklen = sizeof(struct sockaddr_in6);
 		break;
 	default:
 		LogCrit(COMPONENT_FSAL, "Unknown address family %d",
-			dest->ss_family);
+			dest.ss_family);
 		close(sock);
 		return -1;
 	}
 
 	if (sock >= 0) {
-		if (connect(sock, (struct sockaddr *)dest, socklen) < 0) {
+		if (connect(sock, (struct sockaddr *)&dest, socklen) < 0) {
 			close(sock);
 			sock = -1;
 		} else {
-			pxy_new_socket_ready(pxy_exp);
+			pxy_new_socket_ready(conn);
 		}
 	}
 	return sock;
 }
 
 /*
- * NB! rpc_sock can be closed by the sending thread but it will not be
- *     changing its value. Only this function will change rpc_sock which
+ * NB! sock can be closed by the sending thread but it will not be
+ *     changing its value. Only this function will change sock which
  *     means that it can look at the value without holding the lock.
  */
 static void *pxy_rpc_recv(void *arg)
 {
-	struct pxy_export *pxy_exp = arg;
+	struct pxy_rpc_conn *conn = arg;
+	struct pxy_export *pxy_exp = conn->pxy_exp;
 	char addr[INET6_ADDRSTRLEN];
+	char thr_name[16];
 	struct pollfd pfd;
 	int millisec = pxy_exp->info.srv_timeout * 1000;
 
-	SetNameFunction("pxy_rcv_thread");
+	snprintf(thr_name, sizeof(thr_name), "pxy_rcv_%"PRIu32, conn->idx);
+	SetNameFunction(thr_name);
 
 	while (!pxy_exp->rpc.close_thread) {
 		int nsleeps = 0;
 
-		PTHREAD_MUTEX_lock(&pxy_exp->rpc.listlock);
+		PTHREAD_MUTEX_lock(&conn->lock);
 		do {
-			pxy_exp->rpc.rpc_sock = pxy_connect(pxy_exp,
-						&pxy_exp->info.srv_addr,
-						pxy_exp->info.srv_port);
+			conn->sock = pxy_connect(conn,
+						 &pxy_exp->info.srv_addr,
+						 pxy_exp->info.srv_port);
 			/* early stop test */
 			if (pxy_exp->rpc.close_thread) {
-				PTHREAD_MUTEX_unlock(&pxy_exp->rpc.listlock);
+				PTHREAD_MUTEX_unlock(&conn->lock);
 				return NULL;
 			}
-			if (pxy_exp->rpc.rpc_sock < 0) {
+			if (conn->sock < 0) {
 				if (nsleeps == 0)
 					sprint_sockaddr(&pxy_exp->info.srv_addr,
 							addr, sizeof(addr));
 					LogCrit(COMPONENT_FSAL,
 						"Cannot connect to server %s:%u",
 						addr, pxy_exp->info.srv_port);
-				PTHREAD_MUTEX_unlock(&pxy_exp->rpc.listlock);
+				PTHREAD_MUTEX_unlock(&conn->lock);
 				sleep(pxy_exp->info.retry_sleeptime);
 				nsleeps++;
-				PTHREAD_MUTEX_lock(&pxy_exp->rpc.listlock);
+				PTHREAD_MUTEX_lock(&conn->lock);
 			} else {
 				LogDebug(COMPONENT_FSAL,
-					 "Connected after %d sleeps, resending outstanding calls",
-					 nsleeps);
+					 "Connection %"PRIu32
+					 " up after %d sleeps, resending outstanding calls",
+					 conn->idx, nsleeps);
 			}
-		} while (pxy_exp->rpc.rpc_sock < 0 &&
-						!pxy_exp->rpc.close_thread);
-		PTHREAD_MUTEX_unlock(&pxy_exp->rpc.listlock);
+		} while (conn->sock < 0 && !pxy_exp->rpc.close_thread);
+		PTHREAD_MUTEX_unlock(&conn->lock);
 		/* early stop test */
 		if (pxy_exp->rpc.close_thread)
 			return NULL;
 
-		pfd.fd = pxy_exp->rpc.rpc_sock;
+		pfd.fd = conn->sock;
 		pfd.events = POLLIN | POLLRDHUP;
 
-		while (pxy_exp->rpc.rpc_sock >= 0) {
+		while (conn->sock >= 0) {
 			switch (poll(&pfd, 1, millisec)) {
 			case 0:
 				LogDebug(COMPONENT_FSAL,
@@ -594,16 +680,16 @@ static void *pxy_rpc_recv(void *arg)
 					LogEvent(COMPONENT_FSAL,
 						 "Socket is closed");
 				} else {
-					if (pxy_rpc_read_reply(pxy_exp) >= 0)
+					if (pxy_rpc_read_reply(conn) >= 0)
 						continue;
 				}
 				break;
 			}
 
-			PTHREAD_MUTEX_lock(&pxy_exp->rpc.listlock);
-			close(pxy_exp->rpc.rpc_sock);
-			pxy_exp->rpc.rpc_sock = -1;
-			PTHREAD_MUTEX_unlock(&pxy_exp->rpc.listlock);
+			PTHREAD_MUTEX_lock(&conn->lock);
+			close(conn->sock);
+			conn->sock = -1;
+			PTHREAD_MUTEX_unlock(&conn->lock);
 		}
 	}
 
@@ -695,44 +781,58 @@ static enum clnt_stat pxy_process_reply(struct pxy_rpc_io_context *ctx,
 	return rc;
 }
 
-static inline int pxy_rpc_need_sock(struct pxy_export *pxy_exp)
+static inline int pxy_rpc_need_sock(struct pxy_rpc_conn *conn)
 {
-	PTHREAD_MUTEX_lock(&pxy_exp->rpc.listlock);
-	while (pxy_exp->rpc.rpc_sock < 0 && !pxy_exp->rpc.close_thread)
-		pthread_cond_wait(&pxy_exp->rpc.sockless,
-				  &pxy_exp->rpc.listlock);
-	PTHREAD_MUTEX_unlock(&pxy_exp->rpc.listlock);
+	struct pxy_export *pxy_exp = conn->pxy_exp;
+
+	PTHREAD_MUTEX_lock(&conn->lock);
+	while (conn->sock < 0 && !pxy_exp->rpc.close_thread)
+		pthread_cond_wait(&conn->sockless, &conn->lock);
+	PTHREAD_MUTEX_unlock(&conn->lock);
 	return pxy_exp->rpc.close_thread;
 }
 
+/* The session is renewed on the first connection, and redone when it
+ * reconnects */
 static inline int pxy_rpc_renewer_wait(int timeout, struct pxy_export *pxy_exp)
 {
+	struct pxy_rpc_conn *conn = &pxy_exp->rpc.conns[0];
 	struct timespec ts;
 	int rc;
 
-	PTHREAD_MUTEX_lock(&pxy_exp->rpc.listlock);
+	PTHREAD_MUTEX_lock(&conn->lock);
 	ts.tv_sec = time(NULL) + timeout;
 	ts.tv_nsec = 0;
 
-	rc = pthread_cond_timedwait(&pxy_exp->rpc.sockless,
-				    &pxy_exp->rpc.listlock, &ts);
-	PTHREAD_MUTEX_unlock(&pxy_exp->rpc.listlock);
+	rc = pthread_cond_timedwait(&conn->sockless, &conn->lock, &ts);
+	PTHREAD_MUTEX_unlock(&conn->lock);
 	return (rc == ETIMEDOUT);
 }
 
+/* Withdraw a call that could not be sent */
+static void pxy_rpc_cancel(struct pxy_rpc_io_context *ctx)
+{
+	if (pxy_rpc_disarm(ctx))
+		return;
+
+	/* A reconnect failed it already, forget that */
+	PTHREAD_MUTEX_lock(&ctx->iolock);
+	ctx->iodone = false;
+	PTHREAD_MUTEX_unlock(&ctx->iolock);
+}
+
 static int pxy_compoundv4_call(struct pxy_rpc_io_context *pcontext,
 			       const struct user_cred *cred,
 			       COMPOUND4args *args, COMPOUND4res *res,
 			       struct pxy_export *pxy_exp)
 {
+	struct pxy_rpc_conn *conn = pcontext->conn;
 	XDR x;
 	struct rpc_msg rmsg;
 	AUTH *au;
 	enum clnt_stat rc;
+	int first_try = 1;
 
-	PTHREAD_MUTEX_lock(&pxy_exp->rpc.listlock);
-	rmsg.rm_xid = pxy_exp->rpc.rpc_xid++;
-	PTHREAD_MUTEX_unlock(&pxy_exp->rpc.listlock);
 	rmsg.rm_direction = CALL;
 
 	rmsg.rm_call.cb_rpcvers = RPC_MSG_VERSION;
@@ -759,70 +859,122 @@ static int pxy_compoundv4_call(struct pxy_rpc_io_context *pcontext,
 	rmsg.cb_cred = au->ah_cred;
 	rmsg.cb_verf = au->ah_verf;
 
-	memset(&x, 0, sizeof(x));
-	xdrmem_create(&x, pcontext->sendbuf + 4, pcontext->sendbuf_sz,
-		      XDR_ENCODE);
-	if (xdr_callmsg(&x, &rmsg) && xdr_COMPOUND4args(&x, args)) {
-		u_int pos = xdr_getpos(&x);
-		u_int recmark = ntohl(pos | (1U << 31));
-		int first_try = 1;
+	/*
+	 * Each attempt goes out under a new xid: the session slot and
+	 * sequence id, not the xid, tell the server it is a retry.
+	 */
+	do {
+		u_int pos;
+		u_int recmark;
+		int bc = 0;
+		char *buf = pcontext->sendbuf;
+
+		if (!first_try && !pxy_rpc_disarm(pcontext)) {
+			/* The reply to the last attempt is on its way */
+			rc = pxy_process_reply(pcontext, res);
+			continue;
+		}
 
-		pcontext->rpc_xid = rmsg.rm_xid;
+		rmsg.rm_xid = pxy_rpc_next_xid(pxy_exp, pcontext);
+
+		memset(&x, 0, sizeof(x));
+		xdrmem_create(&x, pcontext->sendbuf + 4, pcontext->sendbuf_sz,
+			      XDR_ENCODE);
+		if (!xdr_callmsg(&x, &rmsg) || !xdr_COMPOUND4args(&x, args)) {
+			rc = RPC_CANTENCODEARGS;
+			break;
+		}
 
+		pos = xdr_getpos(&x);
+		recmark = ntohl(pos | (1U << 31));
 		memcpy(pcontext->sendbuf, &recmark, sizeof(recmark));
 		pos += 4;
 
-		do {
-			int bc = 0;
-			char *buf = pcontext->sendbuf;
-
-			LogDebug(COMPONENT_FSAL, "%ssend XID %u with %d bytes",
-				 (first_try ? "First attempt to " : "Re"),
-				 rmsg.rm_xid, pos);
-			PTHREAD_MUTEX_lock(&pxy_exp->rpc.listlock);
-			while (bc < pos) {
-				int wc = write(pxy_exp->rpc.rpc_sock, buf,
-					       pos - bc);
-
-				if (wc <= 0) {
-					close(pxy_exp->rpc.rpc_sock);
-					break;
-				}
-				bc += wc;
-				buf += wc;
-			}
+		LogDebug(COMPONENT_FSAL, "%ssend XID %u with %d bytes",
+			 (first_try ? "First attempt to " : "Re"),
+			 rmsg.rm_xid, pos);
 
-			if (bc == pos) {
-				if (first_try) {
-					glist_add_tail(&pxy_exp->rpc.rpc_calls,
-						       &pcontext->calls);
-					first_try = 0;
-				}
-			} else {
-				if (!first_try)
-					glist_del(&pcontext->calls);
+		/* Be ready for the reply before it can arrive */
+		pcontext->rpc_xid = rmsg.rm_xid;
+		atomic_store_uint64_t(&pcontext->pending,
+				      PXY_XID_PENDING | rmsg.rm_xid);
+		first_try = 0;
+
+		PTHREAD_MUTEX_lock(&conn->lock);
+		while (bc < pos) {
+			int wc = write(conn->sock, buf, pos - bc);
+
+			if (wc <= 0) {
+				close(conn->sock);
+				break;
 			}
-			PTHREAD_MUTEX_unlock(&pxy_exp->rpc.listlock);
+			bc += wc;
+			buf += wc;
+		}
+		PTHREAD_MUTEX_unlock(&conn->lock);
 
-			if (bc == pos)
-				rc = pxy_process_reply(pcontext, res);
-			else
-				rc = RPC_CANTSEND;
-		} while (rc == RPC_TIMEDOUT);
-	} else {
-		rc = RPC_CANTENCODEARGS;
-	}
+		if (bc == pos) {
+			rc = pxy_process_reply(pcontext, res);
+		} else {
+			pxy_rpc_cancel(pcontext);
+			rc = RPC_CANTSEND;
+		}
+	} while (rc == RPC_TIMEDOUT);
 
 	auth_destroy(au);
 	return rc;
 }
 
+/* called with context_lock */
+static struct pxy_rpc_io_context *pxy_rpc_get_slot(struct pxy_export *pxy_exp)
+{
+	struct glist_head *c;
+
+	glist_for_each(c, &pxy_exp->rpc.free_contexts) {
+		struct pxy_rpc_io_context *ctx =
+		    container_of(c, struct pxy_rpc_io_context, calls);
+
+		if (ctx->slotid < pxy_exp->rpc.slots_granted) {
+			glist_del(c);
+			return ctx;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Follow the number of slots the background server grants us
+ *
+ * @param[in] pxy_exp  The export
+ * @param[in] granted  Slots granted, from CREATE_SESSION or the target
+ *                     highest slot id of a SEQUENCE reply
+ */
+static void pxy_rpc_set_granted(struct pxy_export *pxy_exp, uint32_t granted)
+{
+	if (granted == 0)
+		granted = 1;
+	if (granted > pxy_exp->rpc.nslots)
+		granted = pxy_exp->rpc.nslots;
+
+	PTHREAD_MUTEX_lock(&pxy_exp->rpc.context_lock);
+	if (granted != pxy_exp->rpc.slots_granted) {
+		LogDebug(COMPONENT_FSAL, "Using %"PRIu32" of %"PRIu32" slots",
+			 granted, pxy_exp->rpc.nslots);
+		if (granted > pxy_exp->rpc.slots_granted)
+			pthread_cond_broadcast(&pxy_exp->rpc.need_context);
+		pxy_exp->rpc.slots_granted = granted;
+	}
+	PTHREAD_MUTEX_unlock(&pxy_exp->rpc.context_lock);
+}
+
 int pxy_compoundv4_execute(const char *caller, const struct user_cred *creds,
 			   uint32_t cnt, nfs_argop4 *argoparray,
 			   nfs_resop4 *resoparray, struct pxy_export *pxy_exp)
 {
 	enum clnt_stat rc;
 	struct pxy_rpc_io_context *ctx;
+	uint32_t granted;
 	COMPOUND4args arg = {
 		.minorversion = FSAL_PROXY_NFS_V4_MINOR,
 		.argarray.argarray_val = argoparray,
@@ -832,24 +984,33 @@ int pxy_compoundv4_execute(const char *caller, const struct user_cred *creds,
 		.resarray.resarray_val = resoparray,
 		.resarray.resarray_len = cnt
 	};
+	struct timespec start_time;
+
+	if (nfs_param.core_param.enable_FSALSTATS)
+		now(&start_time);
 
 	PTHREAD_MUTEX_lock(&pxy_exp->rpc.context_lock);
-	while (glist_empty(&pxy_exp->rpc.free_contexts))
+	while ((ctx = pxy_rpc_get_slot(pxy_exp)) == NULL)
 		pthread_cond_wait(&pxy_exp->rpc.need_context,
 				  &pxy_exp->rpc.context_lock);
-	ctx =
-	    glist_first_entry(&pxy_exp->rpc.free_contexts,
-			      struct pxy_rpc_io_context, calls);
-	glist_del(&ctx->calls);
+	granted = pxy_exp->rpc.slots_granted;
 	PTHREAD_MUTEX_unlock(&pxy_exp->rpc.context_lock);
 
 	/* fill slotid and sequenceid */
 	if (argoparray->argop == NFS4_OP_SEQUENCE) {
 		SEQUENCE4args *opsequence =
 					&argoparray->nfs_argop4_u.opsequence;
+		uint32_t gen = atomic_fetch_uint32_t(&pxy_exp->rpc.session_gen);
+
+		/* a new session starts every slot over */
+		if (ctx->session_gen != gen) {
+			ctx->session_gen = gen;
+			ctx->seqid = 0;
+		}
 
 		/* set slotid */
 		opsequence->sa_slotid = ctx->slotid;
+		opsequence->sa_highest_slotid = granted - 1;
 		/* increment and set sequence id */
 		opsequence->sa_sequenceid = ++ctx->seqid;
 	}
@@ -860,8 +1021,8 @@ int pxy_compoundv4_execute(const char *caller, const struct user_cred *creds,
 			LogDebug(COMPONENT_FSAL, "%s failed with %d", caller,
 				 rc);
 		if (rc == RPC_CANTSEND)
-			if (pxy_rpc_need_sock(pxy_exp))
-				return -1;
+			if (pxy_rpc_need_sock(ctx->conn))
+				break;
 	} while ((rc == RPC_CANTRECV && (ctx->ioresult == -EAGAIN))
 		 || (rc == RPC_CANTSEND));
 
@@ -870,6 +1031,21 @@ int pxy_compoundv4_execute(const char *caller, const struct user_cred *creds,
 	glist_add(&pxy_exp->rpc.free_contexts, &ctx->calls);
 	PTHREAD_MUTEX_unlock(&pxy_exp->rpc.context_lock);
 
+	if (nfs_param.core_param.enable_FSALSTATS)
+		pxy_stat_record(PXY_STAT_COMPOUND, &start_time);
+
+	if (rc == RPC_CANTSEND)
+		return -1;
+
+	if (rc == RPC_SUCCESS && argoparray->argop == NFS4_OP_SEQUENCE &&
+	    resoparray->nfs_resop4_u.opsequence.sr_status == NFS4_OK) {
+		SEQUENCE4resok *s_resok = &resoparray->nfs_resop4_u.opsequence
+						.SEQUENCE4res_u.sr_resok4;
+
+		pxy_rpc_set_granted(pxy_exp,
+				    s_resok->sr_target_highest_slotid + 1);
+	}
+
 	if (rc == RPC_SUCCESS)
 		return res.status;
 	return rc;
@@ -977,6 +1153,11 @@ static int pxy_setsessionid(sessionid4 new_sessionid, uint32_t *lease_time,
 	       res_ok->csr_sessionid,
 	       sizeof(sessionid4));
 
+	/* The slots of the new session start over at sequence id 1 */
+	(void) atomic_inc_uint32_t(&pxy_exp->rpc.session_gen);
+	pxy_rpc_set_granted(pxy_exp,
+			    res_ok->csr_fore_chan_attrs.ca_maxrequests);
+
 	/* Get the lease time */
 	opcnt = 0;
 	COMPOUNDV4_ARG_ADD_OP_SEQUENCE(opcnt, arg, new_sessionid, NB_RPC_SLOT);
@@ -1024,7 +1205,7 @@ static int pxy_setclientid(clientid4 *new_clientid, sequenceid4 *new_seqid,
 		 "Negotiating a new ClientId with the remote server");
 
 	/* prepare input */
-	if (getsockname(pxy_exp->rpc.rpc_sock, &sin, &slen))
+	if (getsockname(pxy_exp->rpc.conns[0].sock, &sin, &slen))
 		return -errno;
 
 	snprintf(clientid_name, MAXNAMLEN, "%s(%d) - GANESHA NFSv4 Proxy",
@@ -1136,7 +1317,7 @@ static void *pxy_clientid_renewer(void *arg)
 
 		/* We've either failed to renew or rpc socket has been
 		 * reconnected and we need new clientid or sessionid. */
-		if (pxy_rpc_need_sock(pxy_exp))
+		if (pxy_rpc_need_sock(&pxy_exp->rpc.conns[0]))
 			/* early stop test */
 			return NULL;
 
@@ -1182,17 +1363,780 @@ static void *pxy_clientid_renewer(void *arg)
 	return NULL;
 }
 
+/*
+ * Read-ahead and write-behind
+ *
+ * Once a file has been read sequentially PXY_RA_SEQUENTIAL times in a
+ * row, the pages after the current read are fetched by the export's
+ * I/O threads ahead of the client.  Pages are Page_Size long, at most
+ * Data_Cache_Pages of them are held per export and one is dropped once
+ * the reader has moved past it or after Data_Cache_Expiration seconds.
+ *
+ * With Write_Behind, UNSTABLE writes are copied and sent by the I/O
+ * threads while the client gets its reply.  COMMIT and CLOSE wait for
+ * them, and report the first one that failed, before committing.
+ * Overlapping writes are never in flight together, so they reach the
+ * backend in order.
+ */
+
+#define PXY_RA_SEQUENTIAL 2
+#define PXY_WB_MAX_WRITES 16
+
+static inline bool pxy_dc_enabled(struct pxy_export *pxy_exp)
+{
+	return pxy_exp->info.readahead_pages != 0 || pxy_exp->info.write_behind;
+}
+
+struct pxy_dc_page {
+	struct glist_head file_q;	/*< On the file's pages */
+	struct glist_head lru_q;	/*< On the export LRU once filled */
+	struct pxy_obj_handle *ph;
+	uint64_t offset;
+	uint32_t len;
+	bool filling;
+	bool stale;		/*< Overwritten while filling, drop it */
+	bool eof;
+	time_t loaded;
+	char data[];
+};
+
+struct pxy_dc_job {
+	struct pxy_obj_handle *ph;
+	struct pxy_dc_page *page;	/*< Page to fill, or NULL */
+	struct glist_head write_q;	/*< On the file's writes */
+	uint64_t offset;
+	uint32_t len;
+	char *buf;
+	char other[12];
+	struct user_cred creds;
+	gid_t garray[];
+};
+
+static struct pxy_dc_job *pxy_dc_job_alloc(struct pxy_obj_handle *ph,
+					   const struct user_cred *creds)
+{
+	unsigned int glen = creds ? creds->caller_glen : 0;
+	struct pxy_dc_job *job = gsh_calloc(1, sizeof(*job) +
+					    glen * sizeof(gid_t));
+
+	job->ph = ph;
+	if (creds) {
+		job->creds = *creds;
+		job->creds.caller_garray = job->garray;
+		memcpy(job->garray, creds->caller_garray,
+		       glen * sizeof(gid_t));
+	}
+	return job;
+}
+
+static inline const struct user_cred *pxy_dc_job_creds(struct pxy_dc_job *job)
+{
+	/* Jobs of callers without credentials go out as the server */
+	return job->creds.caller_garray ? &job->creds : NULL;
+}
+
+/* called with fc->lock */
+static void pxy_dc_free_page(struct pxy_export *pxy_exp,
+			     struct pxy_dc_page *page)
+{
+	PTHREAD_MUTEX_lock(&pxy_exp->dc.lock);
+	if (!page->filling)
+		glist_del(&page->lru_q);
+	pxy_exp->dc.npages--;
+	PTHREAD_MUTEX_unlock(&pxy_exp->dc.lock);
+
+	glist_del(&page->file_q);
+	gsh_free(page);
+}
+
+/* called with dc.lock, frees the least recently filled page that
+ * nobody is looking at */
+static bool pxy_dc_reclaim(struct pxy_export *pxy_exp)
+{
+	struct glist_head *c;
+
+	glist_for_each_prev(c, &pxy_exp->dc.lru) {
+		struct pxy_dc_page *page =
+		    container_of(c, struct pxy_dc_page, lru_q);
+		struct pxy_file_cache *fc = &page->ph->fc;
+
+		/* The file lock comes first, never wait for it here */
+		if (pthread_mutex_trylock(&fc->lock) != 0)
+			continue;
+
+		glist_del(&page->lru_q);
+		glist_del(&page->file_q);
+		pxy_exp->dc.npages--;
+		PTHREAD_MUTEX_unlock(&fc->lock);
+		gsh_free(page);
+		return true;
+	}
+
+	return false;
+}
+
+/* called with fc->lock */
+static struct pxy_dc_page *pxy_dc_alloc_page(struct pxy_export *pxy_exp,
+					     struct pxy_obj_handle *ph,
+					     uint64_t offset)
+{
+	struct pxy_dc_page *page;
+
+	PTHREAD_MUTEX_lock(&pxy_exp->dc.lock);
+	if (pxy_exp->dc.npages >= pxy_exp->info.data_cache_pages &&
+	    !pxy_dc_reclaim(pxy_exp)) {
+		PTHREAD_MUTEX_unlock(&pxy_exp->dc.lock);
+		return NULL;
+	}
+	pxy_exp->dc.npages++;
+	PTHREAD_MUTEX_unlock(&pxy_exp->dc.lock);
+
+	page = gsh_calloc(1, sizeof(*page) + pxy_exp->dc.page_size);
+	page->ph = ph;
+	page->offset = offset;
+	page->filling = true;
+	glist_add_tail(&ph->fc.pages, &page->file_q);
+
+	return page;
+}
+
+/* called with fc->lock */
+static struct pxy_dc_page *pxy_dc_find(struct pxy_export *pxy_exp,
+				       struct pxy_file_cache *fc,
+				       uint64_t offset)
+{
+	struct glist_head *c;
+
+	glist_for_each(c, &fc->pages) {
+		struct pxy_dc_page *page =
+		    container_of(c, struct pxy_dc_page, file_q);
+
+		if (offset >= page->offset &&
+		    offset - page->offset < pxy_exp->dc.page_size)
+			return page;
+	}
+
+	return NULL;
+}
+
+/* called with fc->lock, drops what a write to the range makes stale */
+static void pxy_dc_invalidate(struct pxy_export *pxy_exp,
+			      struct pxy_file_cache *fc,
+			      uint64_t offset, uint64_t len)
+{
+	struct glist_head *c, *n;
+
+	glist_for_each_safe(c, n, &fc->pages) {
+		struct pxy_dc_page *page =
+		    container_of(c, struct pxy_dc_page, file_q);
+
+		if (page->offset >= offset + len ||
+		    page->offset + pxy_exp->dc.page_size <= offset)
+			continue;
+
+		if (page->filling)
+			page->stale = true;
+		else
+			pxy_dc_free_page(pxy_exp, page);
+	}
+}
+
+static void pxy_dc_fill(struct fridgethr_context *ctx)
+{
+	struct pxy_dc_job *job = ctx->arg;
+	struct pxy_dc_page *page = job->page;
+	struct pxy_file_cache *fc = &job->ph->fc;
+	struct pxy_export *pxy_exp = fc->pxy_exp;
+	int rc;
+	int opcnt = 0;
+	sessionid4 sid;
+	nfs_argop4 argoparray[3]; /* SEQUENCE + PUTFH + READ */
+	nfs_resop4 resoparray[3];
+	READ4resok *rok;
+
+	pxy_get_client_sessionid_export(sid, pxy_exp);
+	COMPOUNDV4_ARG_ADD_OP_SEQUENCE(opcnt, argoparray, sid, NB_RPC_SLOT);
+	COMPOUNDV4_ARG_ADD_OP_PUTFH(opcnt, argoparray, job->ph->fh4);
+	rok = &resoparray[opcnt].nfs_resop4_u.opread.READ4res_u.resok4;
+	rok->data.data_val = page->data;
+	rok->data.data_len = pxy_exp->dc.page_size;
+	COMPOUNDV4_ARG_ADD_OP_READ_STATELESS(opcnt, argoparray, page->offset,
+					     pxy_exp->dc.page_size);
+
+	rc = pxy_compoundv4_execute(__func__, pxy_dc_job_creds(job), opcnt,
+				    argoparray, resoparray, pxy_exp);
+
+	PTHREAD_MUTEX_lock(&fc->lock);
+	if (rc == NFS4_OK && !page->stale) {
+		page->len = rok->data.data_len;
+		page->eof = rok->eof;
+		page->loaded = time(NULL);
+
+		PTHREAD_MUTEX_lock(&pxy_exp->dc.lock);
+		page->filling = false;
+		glist_add(&pxy_exp->dc.lru, &page->lru_q);
+		PTHREAD_MUTEX_unlock(&pxy_exp->dc.lock);
+	} else {
+		LogDebug(COMPONENT_FSAL,
+			 "Dropping read-ahead at %"PRIu64": %d%s",
+			 page->offset, rc, page->stale ? " (stale)" : "");
+		pxy_dc_free_page(pxy_exp, page);
+	}
+	fc->inflight--;
+	pthread_cond_broadcast(&fc->io_done);
+	PTHREAD_MUTEX_unlock(&fc->lock);
+
+	gsh_free(job);
+}
+
+/* called with fc->lock, starts filling the pages after offset */
+static void pxy_dc_readahead(struct pxy_export *pxy_exp,
+			     struct pxy_obj_handle *ph, uint64_t offset)
+{
+	struct pxy_file_cache *fc = &ph->fc;
+	uint32_t page_size = pxy_exp->dc.page_size;
+	uint64_t pos = offset - offset % page_size;
+	uint64_t end = pos + (uint64_t)pxy_exp->info.readahead_pages *
+		       page_size;
+
+	for (; pos < end; pos += page_size) {
+		struct pxy_dc_page *page = pxy_dc_find(pxy_exp, fc, pos);
+		struct pxy_dc_job *job;
+
+		if (page != NULL) {
+			if (page->eof)
+				return;
+			continue;
+		}
+
+		page = pxy_dc_alloc_page(pxy_exp, ph, pos);
+		if (page == NULL)
+			return;
+
+		job = pxy_dc_job_alloc(ph, op_ctx->creds);
+		job->page = page;
+		fc->inflight++;
+		if (fridgethr_submit(pxy_exp->dc.io_fridge, pxy_dc_fill,
+				     job) != 0) {
+			fc->inflight--;
+			pxy_dc_free_page(pxy_exp, page);
+			gsh_free(job);
+			return;
+		}
+	}
+}
+
+/**
+ * @brief Serve a read from read-ahead pages
+ *
+ * Also does the sequential detection and queues read-ahead.  Pages
+ * still being filled are waited for.
+ *
+ * @return true if the read was served.
+ */
+static bool pxy_dc_read(struct pxy_obj_handle *ph, struct fsal_io_arg *arg)
+{
+	struct pxy_file_cache *fc = &ph->fc;
+	struct pxy_export *pxy_exp = fc->pxy_exp;
+	uint64_t pos = arg->offset;
+	size_t left = arg->iov[0].iov_len;
+	char *dst = arg->iov[0].iov_base;
+	time_t expired = time(NULL) - pxy_exp->info.data_cache_expiration;
+	bool eof = false;
+	bool hit = true;
+	struct glist_head *c, *n;
+
+	if (!pxy_dc_enabled(pxy_exp))
+		return false;
+
+	PTHREAD_MUTEX_lock(&fc->lock);
+
+	/* Written data must be on the backend before anything is read */
+	while (fc->writes > 0)
+		pthread_cond_wait(&fc->io_done, &fc->lock);
+
+	if (pxy_exp->info.readahead_pages == 0) {
+		PTHREAD_MUTEX_unlock(&fc->lock);
+		return false;
+	}
+
+	if (arg->offset == fc->next_offset)
+		fc->sequential++;
+	else
+		fc->sequential = 0;
+	fc->next_offset = arg->offset + left;
+
+	while (left > 0 && !eof) {
+		struct pxy_dc_page *page = pxy_dc_find(pxy_exp, fc, pos);
+		uint64_t in;
+		size_t cnt;
+
+		while (page != NULL && page->filling) {
+			pthread_cond_wait(&fc->io_done, &fc->lock);
+			page = pxy_dc_find(pxy_exp, fc, pos);
+		}
+
+		if (page == NULL || page->loaded < expired) {
+			if (page != NULL)
+				pxy_dc_free_page(pxy_exp, page);
+			hit = false;
+			break;
+		}
+
+		in = pos - page->offset;
+		if (in >= page->len) {
+			/* A short page only ends the file if it says so */
+			hit = page->eof;
+			break;
+		}
+
+		cnt = MIN(left, page->len - in);
+		memcpy(dst, page->data + in, cnt);
+		dst += cnt;
+		pos += cnt;
+		left -= cnt;
+		eof = page->eof && in + cnt == page->len;
+	}
+
+	if (hit) {
+		arg->io_amount = arg->iov[0].iov_len - left;
+		arg->end_of_file = eof || left > 0;
+	}
+
+	/* Pages behind a sequential reader won't be wanted again */
+	glist_for_each_safe(c, n, &fc->pages) {
+		struct pxy_dc_page *page =
+		    container_of(c, struct pxy_dc_page, file_q);
+
+		if (!page->filling &&
+		    page->offset + pxy_exp->dc.page_size <= arg->offset)
+			pxy_dc_free_page(pxy_exp, page);
+	}
+
+	if (fc->sequential >= PXY_RA_SEQUENTIAL)
+		pxy_dc_readahead(pxy_exp, ph, arg->offset +
+					      arg->iov[0].iov_len);
+
+	PTHREAD_MUTEX_unlock(&fc->lock);
+	return hit;
+}
+
+/**
+ * @brief Steer read-ahead by IO_ADVISE hints
+ *
+ * SEQUENTIAL turns read-ahead on without waiting for the reads to show
+ * it, WILLNEED starts it at the offset right away, RANDOM turns it off
+ * until the reads look sequential again, and DONTNEED drops the pages
+ * of the range.
+ *
+ * @param[in]     obj_hdl  File to advise on
+ * @param[in]     state    Open state, unused
+ * @param[in,out] hints    Hints asked for, returned with those applied
+ *
+ * @return FSAL status.
+ */
+static fsal_status_t pxy_io_advise2(struct fsal_obj_handle *obj_hdl,
+				    struct state_t *state,
+				    struct io_hints *hints)
+{
+	struct pxy_obj_handle *ph =
+		container_of(obj_hdl, struct pxy_obj_handle, obj);
+	struct pxy_file_cache *fc = &ph->fc;
+	struct pxy_export *pxy_exp = fc->pxy_exp;
+	uint64_t end = hints->count == 0 ? UINT64_MAX
+					 : hints->offset + hints->count;
+	uint32_t applied = 0;
+	struct glist_head *c, *n;
+
+	if (pxy_exp->info.readahead_pages == 0) {
+		hints->hints = 0;
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	PTHREAD_MUTEX_lock(&fc->lock);
+
+	if (hints->hints & (1U << IO_ADVISE4_RANDOM)) {
+		fc->sequential = 0;
+		applied |= 1U << IO_ADVISE4_RANDOM;
+	} else if (hints->hints & (1U << IO_ADVISE4_SEQUENTIAL)) {
+		fc->sequential = PXY_RA_SEQUENTIAL;
+		fc->next_offset = hints->offset;
+		applied |= 1U << IO_ADVISE4_SEQUENTIAL;
+	}
+
+	if (hints->hints & (1U << IO_ADVISE4_DONTNEED)) {
+		glist_for_each_safe(c, n, &fc->pages) {
+			struct pxy_dc_page *page =
+			    container_of(c, struct pxy_dc_page, file_q);
+
+			if (!page->filling && page->offset >= hints->offset &&
+			    page->offset + pxy_exp->dc.page_size <= end)
+				pxy_dc_free_page(pxy_exp, page);
+		}
+		applied |= 1U << IO_ADVISE4_DONTNEED;
+	} else if (hints->hints & (1U << IO_ADVISE4_WILLNEED)) {
+		/* Written data must be on the backend before it is read */
+		while (fc->writes > 0)
+			pthread_cond_wait(&fc->io_done, &fc->lock);
+		pxy_dc_readahead(pxy_exp, ph, hints->offset);
+		applied |= 1U << IO_ADVISE4_WILLNEED;
+	}
+
+	PTHREAD_MUTEX_unlock(&fc->lock);
+
+	hints->hints = applied;
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/* called with fc->lock */
+static bool pxy_wb_overlaps(struct pxy_file_cache *fc, uint64_t offset,
+			    uint64_t len)
+{
+	struct glist_head *c;
+
+	glist_for_each(c, &fc->write_jobs) {
+		struct pxy_dc_job *job =
+		    container_of(c, struct pxy_dc_job, write_q);
+
+		if (job->offset < offset + len &&
+		    offset < job->offset + job->len)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Prepare for a write sent straight to the backend
+ *
+ * Waits for background writes to the range and drops cached pages.
+ */
+static void pxy_dc_write_begin(struct pxy_obj_handle *ph, uint64_t offset,
+			       uint64_t len)
+{
+	struct pxy_file_cache *fc = &ph->fc;
+
+	if (!pxy_dc_enabled(fc->pxy_exp))
+		return;
+
+	PTHREAD_MUTEX_lock(&fc->lock);
+	while (pxy_wb_overlaps(fc, offset, len))
+		pthread_cond_wait(&fc->io_done, &fc->lock);
+	pxy_dc_invalidate(fc->pxy_exp, fc, offset, len);
+	PTHREAD_MUTEX_unlock(&fc->lock);
+}
+
+static void pxy_wb_run(struct fridgethr_context *ctx)
+{
+	struct pxy_dc_job *job = ctx->arg;
+	struct pxy_file_cache *fc = &job->ph->fc;
+	struct pxy_export *pxy_exp = fc->pxy_exp;
+	int rc = NFS4_OK;
+	uint32_t done = 0;
+	sessionid4 sid;
+	nfs_argop4 argoparray[3]; /* SEQUENCE + PUTFH + WRITE */
+	nfs_resop4 resoparray[3];
+	WRITE4resok *wok;
+
+	while (done < job->len) {
+		int opcnt = 0;
+
+		pxy_get_client_sessionid_export(sid, pxy_exp);
+		COMPOUNDV4_ARG_ADD_OP_SEQUENCE(opcnt, argoparray, sid,
+					       NB_RPC_SLOT);
+		COMPOUNDV4_ARG_ADD_OP_PUTFH(opcnt, argoparray, job->ph->fh4);
+		wok = &resoparray[opcnt].nfs_resop4_u.opwrite
+						.WRITE4res_u.resok4;
+		COMPOUNDV4_ARG_ADD_OP_WRITE(opcnt, argoparray,
+					    job->offset + done,
+					    job->buf + done, job->len - done,
+					    UNSTABLE4, job->other);
+
+		rc = pxy_compoundv4_execute(__func__, pxy_dc_job_creds(job),
+					    opcnt, argoparray, resoparray,
+					    pxy_exp);
+		if (rc != NFS4_OK)
+			break;
+		if (wok->count == 0) {
+			rc = NFS4ERR_IO;
+			break;
+		}
+		done += wok->count;
+	}
+
+	PTHREAD_MUTEX_lock(&fc->lock);
+	if (rc == NFS4_OK) {
+		if (!fc->verf_set) {
+			memcpy(fc->verf, wok->writeverf, NFS4_VERIFIER_SIZE);
+			fc->verf_set = true;
+		} else if (memcmp(fc->verf, wok->writeverf,
+				  NFS4_VERIFIER_SIZE)) {
+			/* The backend lost earlier unstable writes */
+			rc = NFS4ERR_IO;
+		}
+	}
+	if (rc != NFS4_OK) {
+		LogInfo(COMPONENT_FSAL,
+			"Write-behind of %"PRIu32" bytes at %"PRIu64
+			" failed: %d", job->len, job->offset, rc);
+		if (fc->write_error == NFS4_OK)
+			fc->write_error = rc;
+	}
+	glist_del(&job->write_q);
+	fc->writes--;
+	fc->inflight--;
+	pthread_cond_broadcast(&fc->io_done);
+	PTHREAD_MUTEX_unlock(&fc->lock);
+
+	gsh_free(job->buf);
+	gsh_free(job);
+}
+
+/**
+ * @brief Queue an UNSTABLE write for the I/O threads
+ *
+ * @return true if the write was taken.
+ */
+static bool pxy_wb_write(struct pxy_obj_handle *ph, struct fsal_io_arg *arg,
+			 size_t len)
+{
+	struct pxy_file_cache *fc = &ph->fc;
+	struct pxy_export *pxy_exp = fc->pxy_exp;
+	struct pxy_dc_job *job;
+
+	job = pxy_dc_job_alloc(ph, op_ctx->creds);
+	job->offset = arg->offset;
+	job->len = len;
+	job->buf = gsh_malloc(len);
+	memcpy(job->buf, arg->iov[0].iov_base, len);
+	if (arg->state) {
+		struct pxy_state *pxy_state_id =
+		    container_of(arg->state, struct pxy_state, state);
+
+		memcpy(job->other, pxy_state_id->stateid.other,
+		       sizeof(job->other));
+	}
+
+	PTHREAD_MUTEX_lock(&fc->lock);
+	while (fc->writes >= PXY_WB_MAX_WRITES ||
+	       pxy_wb_overlaps(fc, job->offset, len))
+		pthread_cond_wait(&fc->io_done, &fc->lock);
+
+	pxy_dc_invalidate(pxy_exp, fc, job->offset, len);
+	glist_add_tail(&fc->write_jobs, &job->write_q);
+	fc->writes++;
+	fc->inflight++;
+	if (fridgethr_submit(pxy_exp->dc.io_fridge, pxy_wb_run, job) != 0) {
+		glist_del(&job->write_q);
+		fc->writes--;
+		fc->inflight--;
+		PTHREAD_MUTEX_unlock(&fc->lock);
+		gsh_free(job->buf);
+		gsh_free(job);
+		return false;
+	}
+	fc->unstable = true;
+	PTHREAD_MUTEX_unlock(&fc->lock);
+
+	return true;
+}
+
+/* Wait for the background writes of a file, e.g. before its size is
+ * looked at */
+static void pxy_wb_wait(struct pxy_obj_handle *ph)
+{
+	struct pxy_file_cache *fc = &ph->fc;
+
+	if (!fc->pxy_exp->info.write_behind)
+		return;
+
+	PTHREAD_MUTEX_lock(&fc->lock);
+	while (fc->writes > 0)
+		pthread_cond_wait(&fc->io_done, &fc->lock);
+	PTHREAD_MUTEX_unlock(&fc->lock);
+}
+
+/**
+ * @brief Wait for the background writes of a file
+ *
+ * @param[in]  ph        The file
+ * @param[out] unstable  Whether a COMMIT is owed for them, or NULL
+ *
+ * @return The first background write error, which is then cleared.
+ */
+static nfsstat4 pxy_wb_flush(struct pxy_obj_handle *ph, bool *unstable)
+{
+	struct pxy_file_cache *fc = &ph->fc;
+	nfsstat4 rc;
+
+	PTHREAD_MUTEX_lock(&fc->lock);
+	while (fc->writes > 0)
+		pthread_cond_wait(&fc->io_done, &fc->lock);
+	rc = fc->write_error;
+	fc->write_error = NFS4_OK;
+	if (unstable)
+		*unstable = fc->unstable;
+	PTHREAD_MUTEX_unlock(&fc->lock);
+
+	return rc;
+}
+
+/* Once the backend has committed, written data is safe */
+static void pxy_wb_committed(struct pxy_obj_handle *ph, verifier4 verf)
+{
+	struct pxy_file_cache *fc = &ph->fc;
+	nfsstat4 rc = NFS4_OK;
+
+	PTHREAD_MUTEX_lock(&fc->lock);
+	if (fc->verf_set && memcmp(fc->verf, verf, NFS4_VERIFIER_SIZE))
+		rc = NFS4ERR_IO;
+	if (fc->writes == 0) {
+		fc->unstable = false;
+		fc->verf_set = false;
+	}
+	if (rc != NFS4_OK && fc->write_error == NFS4_OK)
+		fc->write_error = rc;
+	PTHREAD_MUTEX_unlock(&fc->lock);
+}
+
+static void pxy_dc_file_init(struct pxy_obj_handle *ph,
+			     struct pxy_export *pxy_exp)
+{
+	struct pxy_file_cache *fc = &ph->fc;
+
+	PTHREAD_MUTEX_init(&fc->lock, NULL);
+	PTHREAD_COND_init(&fc->io_done, NULL);
+	glist_init(&fc->pages);
+	glist_init(&fc->write_jobs);
+	fc->pxy_exp = pxy_exp;
+	fc->write_error = NFS4_OK;
+}
+
+static void pxy_dc_file_fini(struct pxy_obj_handle *ph)
+{
+	struct pxy_file_cache *fc = &ph->fc;
+	struct glist_head *c, *n;
+
+	PTHREAD_MUTEX_lock(&fc->lock);
+	while (fc->inflight > 0)
+		pthread_cond_wait(&fc->io_done, &fc->lock);
+	glist_for_each_safe(c, n, &fc->pages)
+		pxy_dc_free_page(fc->pxy_exp,
+				 container_of(c, struct pxy_dc_page, file_q));
+	PTHREAD_MUTEX_unlock(&fc->lock);
+
+	PTHREAD_MUTEX_destroy(&fc->lock);
+	PTHREAD_COND_destroy(&fc->io_done);
+}
+
+static int pxy_dc_init(struct pxy_export *pxy_exp)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	PTHREAD_MUTEX_init(&pxy_exp->dc.lock, NULL);
+	glist_init(&pxy_exp->dc.lru);
+	pxy_exp->dc.page_size = MIN(pxy_exp->exp.fsal->fs_info.maxread,
+				    DEFAULT_MAX_WRITE_READ);
+
+	if (!pxy_dc_enabled(pxy_exp))
+		return 0;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = pxy_exp->info.session_slots;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&pxy_exp->dc.io_fridge, "pxy_io", &frp);
+	if (rc != 0) {
+		LogCrit(COMPONENT_FSAL,
+			"Unable to start proxy I/O threads: %d", rc);
+		pxy_exp->info.readahead_pages = 0;
+		pxy_exp->info.write_behind = false;
+	}
+
+	return rc;
+}
+
+static void pxy_dc_shutdown(struct pxy_export *pxy_exp)
+{
+	int rc;
+
+	if (pxy_exp->dc.io_fridge != NULL) {
+		rc = fridgethr_sync_command(pxy_exp->dc.io_fridge,
+					    fridgethr_comm_stop, 120);
+		if (rc == ETIMEDOUT) {
+			LogMajor(COMPONENT_FSAL,
+				 "Shutdown timed out, cancelling threads.");
+			fridgethr_cancel(pxy_exp->dc.io_fridge);
+		} else if (rc != 0) {
+			LogMajor(COMPONENT_FSAL,
+				 "Failed shutting down proxy I/O threads: %d",
+				 rc);
+		}
+		fridgethr_destroy(pxy_exp->dc.io_fridge);
+		pxy_exp->dc.io_fridge = NULL;
+	}
+	PTHREAD_MUTEX_destroy(&pxy_exp->dc.lock);
+}
+
 static void free_io_contexts(struct pxy_export *pxy_exp)
 {
-	struct glist_head *cur, *n;
+	uint32_t i;
 
-	glist_for_each_safe(cur, n, &pxy_exp->rpc.free_contexts) {
-		struct pxy_rpc_io_context *c =
-		    container_of(cur, struct pxy_rpc_io_context, calls);
+	for (i = 0; i < pxy_exp->rpc.nslots; i++) {
+		struct pxy_rpc_io_context *c = pxy_exp->rpc.slots[i];
 
-		glist_del(cur);
+		if (c == NULL)
+			continue;
+		glist_del(&c->calls);
+		PTHREAD_MUTEX_destroy(&c->iolock);
+		PTHREAD_COND_destroy(&c->iowait);
 		gsh_free(c);
 	}
+	gsh_free(pxy_exp->rpc.slots);
+	pxy_exp->rpc.slots = NULL;
+	pxy_exp->rpc.nslots = 0;
+
+	for (i = 0; i < pxy_exp->rpc.nconns; i++) {
+		PTHREAD_MUTEX_destroy(&pxy_exp->rpc.conns[i].lock);
+		PTHREAD_COND_destroy(&pxy_exp->rpc.conns[i].sockless);
+	}
+	gsh_free(pxy_exp->rpc.conns);
+	pxy_exp->rpc.conns = NULL;
+	pxy_exp->rpc.nconns = 0;
+}
+
+/* Wake up the threads of the first nconns connections and wait for
+ * their receive threads to end */
+static int pxy_stop_recv_threads(struct pxy_export *pxy_exp, uint32_t nconns)
+{
+	uint32_t i;
+	int rc = 0;
+
+	/* pxy_clientid_renewer is usually waiting on sockless cond : wake up */
+	/* pxy_rpc_recv is usually polling sock : wake up by closing it */
+	for (i = 0; i < nconns; i++) {
+		struct pxy_rpc_conn *conn = &pxy_exp->rpc.conns[i];
+
+		PTHREAD_MUTEX_lock(&conn->lock);
+		pthread_cond_broadcast(&conn->sockless);
+		if (conn->sock >= 0)
+			close(conn->sock);
+		PTHREAD_MUTEX_unlock(&conn->lock);
+	}
+
+	for (i = 0; i < nconns; i++) {
+		int r = pthread_join(pxy_exp->rpc.conns[i].recv_thread, NULL);
+
+		if (r) {
+			LogWarn(COMPONENT_FSAL,
+				"Error on waiting the pxy_recv_thread %"PRIu32
+				" end : %d", i, r);
+			rc = r;
+		}
+	}
+
+	return rc;
 }
 
 int pxy_close_thread(struct pxy_export *pxy_exp)
@@ -1203,63 +2147,66 @@ int pxy_close_thread(struct pxy_export *pxy_exp)
 	pxy_exp->rpc.close_thread = true;
 
 	/* waiting threads ends */
-	/* pxy_clientid_renewer is usually waiting on sockless cond : wake up */
-	/* pxy_rpc_recv is usually polling rpc_sock : wake up by closing it */
-	PTHREAD_MUTEX_lock(&pxy_exp->rpc.listlock);
-	pthread_cond_broadcast(&pxy_exp->rpc.sockless);
-	close(pxy_exp->rpc.rpc_sock);
-	PTHREAD_MUTEX_unlock(&pxy_exp->rpc.listlock);
-	rc = pthread_join(pxy_exp->rpc.pxy_renewer_thread, NULL);
-	if (rc) {
-		LogWarn(COMPONENT_FSAL,
-			"Error on waiting the pxy_renewer_thread end : %d", rc);
+	pxy_dc_shutdown(pxy_exp);
+	rc = pxy_stop_recv_threads(pxy_exp, pxy_exp->rpc.nconns);
+	if (rc)
 		return rc;
-	}
 
-	rc = pthread_join(pxy_exp->rpc.pxy_recv_thread, NULL);
+	rc = pthread_join(pxy_exp->rpc.pxy_renewer_thread, NULL);
 	if (rc) {
 		LogWarn(COMPONENT_FSAL,
-			"Error on waiting the pxy_recv_thread end : %d", rc);
+			"Error on waiting the pxy_renewer_thread end : %d", rc);
 		return rc;
 	}
 
+	free_io_contexts(pxy_exp);
 	return 0;
 }
 
 int pxy_init_rpc(struct pxy_export *pxy_exp)
 {
 	int rc;
-	int i = NB_RPC_SLOT-1;
-
-	PTHREAD_MUTEX_lock(&pxy_exp->rpc.listlock);
-	glist_init(&pxy_exp->rpc.rpc_calls);
-	PTHREAD_MUTEX_unlock(&pxy_exp->rpc.listlock);
+	uint32_t i;
+
+	pxy_exp->rpc.nslots = pxy_exp->info.session_slots;
+	pxy_exp->rpc.nconns = MIN(pxy_exp->info.num_connections,
+				  pxy_exp->rpc.nslots);
+
+	pxy_exp->rpc.conns = gsh_calloc(pxy_exp->rpc.nconns,
+					sizeof(*pxy_exp->rpc.conns));
+	for (i = 0; i < pxy_exp->rpc.nconns; i++) {
+		struct pxy_rpc_conn *conn = &pxy_exp->rpc.conns[i];
+
+		conn->pxy_exp = pxy_exp;
+		conn->idx = i;
+		conn->sock = -1;
+		PTHREAD_MUTEX_init(&conn->lock, NULL);
+		PTHREAD_COND_init(&conn->sockless, NULL);
+	}
 
 	PTHREAD_MUTEX_lock(&pxy_exp->rpc.context_lock);
 	glist_init(&pxy_exp->rpc.free_contexts);
+	pxy_exp->rpc.slots_granted = pxy_exp->rpc.nslots;
 	PTHREAD_MUTEX_unlock(&pxy_exp->rpc.context_lock);
 
-/**
- * @todo this lock is not really necessary so long as we can
- *       only do one export at a time.  This is a reminder that
- *       there is work to do to get this fnctn to truely be
- *       per export.
- */
-	PTHREAD_MUTEX_lock(&pxy_exp->rpc.listlock);
 	if (pxy_exp->rpc.rpc_xid == 0)
 		pxy_exp->rpc.rpc_xid = getpid() ^ time(NULL);
-	PTHREAD_MUTEX_unlock(&pxy_exp->rpc.listlock);
 	if (gethostname(pxy_exp->rpc.pxy_hostname,
 			sizeof(pxy_exp->rpc.pxy_hostname)))
 		strncpy(pxy_exp->rpc.pxy_hostname, "NFS-GANESHA/Proxy",
 			sizeof(pxy_exp->rpc.pxy_hostname));
 
-	for (i = NB_RPC_SLOT-1; i >= 0; i--) {
+	pxy_exp->rpc.slots = gsh_calloc(pxy_exp->rpc.nslots,
+					sizeof(*pxy_exp->rpc.slots));
+	for (i = 0; i < pxy_exp->rpc.nslots; i++) {
 		struct pxy_rpc_io_context *c =
 		    gsh_malloc(sizeof(*c) + pxy_exp->info.srv_sendsize +
 			       pxy_exp->info.srv_recvsize);
 		PTHREAD_MUTEX_init(&c->iolock, NULL);
 		PTHREAD_COND_init(&c->iowait, NULL);
+		c->conn = &pxy_exp->rpc.conns[i % pxy_exp->rpc.nconns];
+		c->rpc_xid = 0;
+		c->pending = 0;
 		c->nfs_prog = pxy_exp->info.srv_prognum;
 		c->sendbuf_sz = pxy_exp->info.srv_sendsize;
 		c->recvbuf_sz = pxy_exp->info.srv_recvsize;
@@ -1267,21 +2214,30 @@ int pxy_init_rpc(struct pxy_export *pxy_exp)
 		c->recvbuf = c->sendbuf + c->sendbuf_sz;
 		c->slotid = i;
 		c->seqid = 0;
+		c->session_gen = 0;
 		c->iodone = false;
+		pxy_exp->rpc.slots[i] = c;
 
 		PTHREAD_MUTEX_lock(&pxy_exp->rpc.context_lock);
-		glist_add(&pxy_exp->rpc.free_contexts, &c->calls);
+		glist_add_tail(&pxy_exp->rpc.free_contexts, &c->calls);
 		PTHREAD_MUTEX_unlock(&pxy_exp->rpc.context_lock);
 	}
 
-	rc = pthread_create(&pxy_exp->rpc.pxy_recv_thread, NULL, pxy_rpc_recv,
-			    (void *)pxy_exp);
-	if (rc) {
-		LogCrit(COMPONENT_FSAL,
-			"Cannot create proxy rpc receiver thread - %s",
-			strerror(rc));
-		free_io_contexts(pxy_exp);
-		return rc;
+	(void) pxy_dc_init(pxy_exp);
+
+	for (i = 0; i < pxy_exp->rpc.nconns; i++) {
+		rc = pthread_create(&pxy_exp->rpc.conns[i].recv_thread, NULL,
+				    pxy_rpc_recv, &pxy_exp->rpc.conns[i]);
+		if (rc) {
+			LogCrit(COMPONENT_FSAL,
+				"Cannot create proxy rpc receiver thread - %s",
+				strerror(rc));
+			pxy_exp->rpc.close_thread = true;
+			pxy_dc_shutdown(pxy_exp);
+			(void) pxy_stop_recv_threads(pxy_exp, i);
+			free_io_contexts(pxy_exp);
+			return rc;
+		}
 	}
 
 	rc = pthread_create(&pxy_exp->rpc.pxy_renewer_thread, NULL,
@@ -1290,6 +2246,9 @@ int pxy_init_rpc(struct pxy_export *pxy_exp)
 		LogCrit(COMPONENT_FSAL,
 			"Cannot create proxy clientid renewer thread - %s",
 			strerror(rc));
+		pxy_exp->rpc.close_thread = true;
+		pxy_dc_shutdown(pxy_exp);
+		(void) pxy_stop_recv_threads(pxy_exp, pxy_exp->rpc.nconns);
 		free_io_contexts(pxy_exp);
 	}
 	return rc;
@@ -1354,28 +2313,45 @@ static void pxy_check_maxread_maxwrite(struct fsal_export *export, fattr4 *f4)
  * else is supposed to provide a real parent pointer and matching
  * export
  */
-static fsal_status_t pxy_lookup_impl(struct fsal_obj_handle *parent,
-				     struct fsal_export *export,
-				     const struct user_cred *cred,
-				     const char *path,
-				     struct fsal_obj_handle **handle,
-				     struct attrlist *attrs_out)
+/* Most names looked up by one COMPOUND */
+#define PXY_LOOKUP_MAX_NAMES 8
+
+/**
+ * @brief Look up a chain of names in one COMPOUND
+ *
+ * "." names are skipped and ".." ones go up with LOOKUPP.  Only the
+ * last object gets a handle.
+ *
+ * @param[in]  parent    Directory to start from, NULL for the root
+ * @param[in]  names     The names, at most PXY_LOOKUP_MAX_NAMES
+ * @param[in]  nnames    How many there are, may be 0
+ * @param[out] handle    The last object
+ * @param[out] attrs_out Its attributes, may be NULL
+ */
+static fsal_status_t pxy_lookup_chain(struct fsal_obj_handle *parent,
+				      struct fsal_export *export,
+				      const struct user_cred *cred,
+				      const char *const *names,
+				      unsigned int nnames,
+				      struct fsal_obj_handle **handle,
+				      struct attrlist *attrs_out)
 {
 	int rc;
+	unsigned int i;
 	uint32_t opcnt = 0;
 	GETATTR4resok *atok;
 	GETATTR4resok *atok_per_file_system_attr = NULL;
 	GETFH4resok *fhok;
 	sessionid4 sid;
-	/* SEQUENCE PUTROOTFH/PUTFH LOOKUP GETFH GETATTR (GETATTR) */
-#define FSAL_LOOKUP_NB_OP_ALLOC 6
+	/* SEQUENCE PUTROOTFH/PUTFH LOOKUP... GETFH GETATTR (GETATTR) */
+#define FSAL_LOOKUP_NB_OP_ALLOC (5 + PXY_LOOKUP_MAX_NAMES)
 	nfs_argop4 argoparray[FSAL_LOOKUP_NB_OP_ALLOC];
 	nfs_resop4 resoparray[FSAL_LOOKUP_NB_OP_ALLOC];
 	char fattr_blob[FATTR_BLOB_SZ];
 	char fattr_blob_per_file_system_attr[FATTR_BLOB_SZ];
 	char padfilehandle[NFS4_FHSIZE];
 
-	if (!handle)
+	if (nnames > PXY_LOOKUP_MAX_NAMES)
 		return fsalstat(ERR_FSAL_INVAL, 0);
 
 	/* SEQUENCE */
@@ -1397,17 +2373,14 @@ static fsal_status_t pxy_lookup_impl(struct fsal_obj_handle *parent,
 		COMPOUNDV4_ARG_ADD_OP_PUTFH(opcnt, argoparray, pxy_obj->fh4);
 	}
 
-	if (path) {
-		if (!strcmp(path, ".")) {
-			if (!parent)
-				return fsalstat(ERR_FSAL_FAULT, 0);
-		} else if (!strcmp(path, "..")) {
-			if (!parent)
-				return fsalstat(ERR_FSAL_FAULT, 0);
+	for (i = 0; i < nnames; i++) {
+		if (!strcmp(names[i], "."))
+			continue;
+		if (!strcmp(names[i], ".."))
 			COMPOUNDV4_ARG_ADD_OP_LOOKUPP(opcnt, argoparray);
-		} else {
-			COMPOUNDV4_ARG_ADD_OP_LOOKUP(opcnt, argoparray, path);
-		}
+		else
+			COMPOUNDV4_ARG_ADD_OP_LOOKUP(opcnt, argoparray,
+						     names[i]);
 	}
 
 	fhok = &resoparray[opcnt].nfs_resop4_u.opgetfh.GETFH4res_u.resok4;
@@ -1446,6 +2419,24 @@ static fsal_status_t pxy_lookup_impl(struct fsal_obj_handle *parent,
 			       handle, attrs_out);
 }
 
+static fsal_status_t pxy_lookup_impl(struct fsal_obj_handle *parent,
+				     struct fsal_export *export,
+				     const struct user_cred *cred,
+				     const char *path,
+				     struct fsal_obj_handle **handle,
+				     struct attrlist *attrs_out)
+{
+	if (!handle)
+		return fsalstat(ERR_FSAL_INVAL, 0);
+
+	if (path && !parent &&
+	    (!strcmp(path, ".") || !strcmp(path, "..")))
+		return fsalstat(ERR_FSAL_FAULT, 0);
+
+	return pxy_lookup_chain(parent, export, cred, &path, path ? 1 : 0,
+				handle, attrs_out);
+}
+
 static fsal_status_t pxy_lookup(struct fsal_obj_handle *parent,
 				const char *path,
 				struct fsal_obj_handle **handle,
@@ -1790,7 +2781,7 @@ static fsal_status_t pxy_do_readdir(struct pxy_obj_handle *ph,
 	rdok->reply.entries = NULL;
 	/* READDIR */
 	COMPOUNDV4_ARG_ADD_OP_READDIR(opcnt, argoparray, *cookie,
-				      pxy_bitmap_getattr);
+				      pxy_bitmap_readdir);
 
 	rc = pxy_nfsv4_call(op_ctx->creds, opcnt, argoparray, resoparray);
 	if (rc != NFS4_OK)
@@ -1801,6 +2792,11 @@ static fsal_status_t pxy_do_readdir(struct pxy_obj_handle *ph,
 	for (e4 = rdok->reply.entries; e4; e4 = e4->nextentry) {
 		struct attrlist attrs;
 		char name[MAXNAMLEN + 1];
+		char padfilehandle[NFS4_FHSIZE];
+		nfs_fh4 fh4 = {
+			.nfs_fh4_val = padfilehandle,
+			.nfs_fh4_len = 0
+		};
 		struct fsal_obj_handle *handle;
 		enum fsal_dir_result cb_rc;
 
@@ -1810,7 +2806,7 @@ static fsal_status_t pxy_do_readdir(struct pxy_obj_handle *ph,
 		memcpy(name, e4->name.utf8string_val, e4->name.utf8string_len);
 		name[e4->name.utf8string_len] = '\0';
 
-		if (nfs4_Fattr_To_FSAL_attr(&attrs, &e4->attrs, NULL))
+		if (nfs4_Fattr_To_FSAL_attr_fh(&attrs, &e4->attrs, &fh4, NULL))
 			return fsalstat(ERR_FSAL_FAULT, 0);
 
 		/*
@@ -1823,15 +2819,21 @@ static fsal_status_t pxy_do_readdir(struct pxy_obj_handle *ph,
 			*eof = rdok->reply.eof && !e4->nextentry;
 		}
 
-		/** @todo FSF: this could be handled by getting handle as part
-		 *             of readdir attributes. However, if acl is
-		 *             requested, we might get it separately to
-		 *             avoid over large READDIR response.
-		 */
-		st = pxy_lookup_impl(&ph->obj, op_ctx->fsal_export,
-				     op_ctx->creds, name, &handle, NULL);
-		if (FSAL_IS_ERROR(st))
+		/* Servers that don't return the filehandle get a LOOKUP */
+		if (fh4.nfs_fh4_len != 0) {
+			st = pxy_make_object(op_ctx->fsal_export, &e4->attrs,
+					     &fh4, &handle, NULL);
+			if (!FSAL_IS_ERROR(st))
+				pxy_stat_saved(PXY_STAT_READDIR_SAVED, 1);
+		} else {
+			st = pxy_lookup_impl(&ph->obj, op_ctx->fsal_export,
+					     op_ctx->creds, name, &handle,
+					     NULL);
+		}
+		if (FSAL_IS_ERROR(st)) {
+			fsal_release_attrs(&attrs);
 			break;
+		}
 
 		cb_rc = cb(name, handle, &attrs, cbarg, e4->cookie);
 
@@ -1940,6 +2942,9 @@ static fsal_status_t pxy_getattrs(struct fsal_obj_handle *obj_hdl,
 
 	ph = container_of(obj_hdl, struct pxy_obj_handle, obj);
 
+	/* size and times must include the background writes */
+	pxy_wb_wait(ph);
+
 	/* SEQUENCE */
 	pxy_get_client_sessionid(sid);
 	COMPOUNDV4_ARG_ADD_OP_SEQUENCE(opcnt, argoparray, sid, NB_RPC_SLOT);
@@ -2059,6 +3064,7 @@ static void pxy_hdl_release(struct fsal_obj_handle *obj_hdl)
 	struct pxy_obj_handle *ph =
 	    container_of(obj_hdl, struct pxy_obj_handle, obj);
 
+	pxy_dc_file_fini(ph);
 	fsal_obj_handle_fini(obj_hdl);
 
 	gsh_free(ph);
@@ -2452,6 +3458,9 @@ static void pxy_read2(struct fsal_obj_handle *obj_hdl,
 	if (read_arg->iov[0].iov_len > maxReadSize)
 		read_arg->iov[0].iov_len = maxReadSize;
 
+	if (!bypass && pxy_dc_read(ph, read_arg))
+		goto out;
+
 	/* SEQUENCE */
 	pxy_get_client_sessionid(sid);
 	COMPOUNDV4_ARG_ADD_OP_SEQUENCE(opcnt, argoparray, sid, NB_RPC_SLOT);
@@ -2492,6 +3501,7 @@ static void pxy_read2(struct fsal_obj_handle *obj_hdl,
 
 	read_arg->end_of_file = rok->eof;
 	read_arg->io_amount = rok->data.data_len;
+out:
 	if (read_arg->info) {
 		read_arg->info->io_content.what = NFS4_CONTENT_DATA;
 		read_arg->info->io_content.data.d_offset = read_arg->offset +
@@ -2537,6 +3547,16 @@ static void pxy_write2(struct fsal_obj_handle *obj_hdl,
 	if (buffer_size > maxWriteSize)
 		buffer_size = maxWriteSize;
 
+	if (!write_arg->fsal_stable && buffer_size > 0 &&
+	    ph->fc.pxy_exp->info.write_behind &&
+	    pxy_wb_write(ph, write_arg, buffer_size)) {
+		write_arg->io_amount = buffer_size;
+		done_cb(obj_hdl, fsalstat(ERR_FSAL_NO_ERROR, 0), write_arg,
+			caller_arg);
+		return;
+	}
+	pxy_dc_write_begin(ph, write_arg->offset, buffer_size);
+
 	/* SEQUENCE */
 	pxy_get_client_sessionid(sid);
 	COMPOUNDV4_ARG_ADD_OP_SEQUENCE(opcnt, argoparray, sid, NB_RPC_SLOT);
@@ -2583,6 +3603,9 @@ static void pxy_write2(struct fsal_obj_handle *obj_hdl,
 	done_cb(obj_hdl, fsalstat(ERR_FSAL_NO_ERROR, 0), write_arg, caller_arg);
 }
 
+static fsal_status_t pxy_commit2(struct fsal_obj_handle *obj_hdl,
+				 off_t offset, size_t len);
+
 static fsal_status_t pxy_close2(struct fsal_obj_handle *obj_hdl,
 				struct state_t *state)
 {
@@ -2596,17 +3619,28 @@ static fsal_status_t pxy_close2(struct fsal_obj_handle *obj_hdl,
 	nfs_resop4 resoparray[FSAL_CLOSE_NB_OP_ALLOC];
 	char All_Zero[] = "\0\0\0\0\0\0\0\0\0\0\0\0";	/* 12 times \0 */
 	struct pxy_state *pxy_state_id = NULL;
+	fsal_status_t flushed = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	bool unstable = false;
 
 	ph = container_of(obj_hdl, struct pxy_obj_handle, obj);
 
+	/* Background writes reach the backend before the state goes away */
+	if (ph->fc.pxy_exp->info.write_behind) {
+		rc = pxy_wb_flush(ph, &unstable);
+		if (rc != NFS4_OK)
+			flushed = nfsstat4_to_fsal(rc);
+		else if (unstable)
+			flushed = pxy_commit2(obj_hdl, 0, 0);
+	}
+
 	/* Check if this was a "stateless" open,
 	 * then nothing is to be done at close */
 	if (!state) {
-		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+		return flushed;
 	} else {
 		pxy_state_id = container_of(state, struct pxy_state, state);
 		if (!memcmp(pxy_state_id->stateid.other, All_Zero, 12))
-			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+			return flushed;
 	}
 
 	/* SEQUENCE */
@@ -2631,7 +3665,7 @@ static fsal_status_t pxy_close2(struct fsal_obj_handle *obj_hdl,
 	if (state)
 		memset(&pxy_state_id->stateid, 0, sizeof(stateid4));
 
-	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	return flushed;
 }
 
 static fsal_status_t pxy_setattr2(struct fsal_obj_handle *obj_hdl,
@@ -2665,6 +3699,10 @@ static fsal_status_t pxy_setattr2(struct fsal_obj_handle *obj_hdl,
 
 	ph = container_of(obj_hdl, struct pxy_obj_handle, obj);
 
+	/* A new size makes every cached page and queued write suspect */
+	if (FSAL_TEST_MASK(attrib_set->valid_mask, ATTR_SIZE))
+		pxy_dc_write_begin(ph, 0, UINT64_MAX);
+
 	if (pxy_fsalattr_to_fattr4(attrib_set, &input_attr) == -1)
 		return fsalstat(ERR_FSAL_INVAL, EINVAL);
 
@@ -2730,9 +3768,17 @@ static fsal_status_t pxy_commit2(struct fsal_obj_handle *obj_hdl,
 #define FSAL_COMMIT2_NB_OP 3 /* SEQUENCE, PUTFH, COMMIT */
 	nfs_argop4 argoparray[FSAL_COMMIT2_NB_OP];
 	nfs_resop4 resoparray[FSAL_COMMIT2_NB_OP];
+	COMMIT4resok *cok;
 
 	ph = container_of(obj_hdl, struct pxy_obj_handle, obj);
 
+	/* Whatever is still being written behind goes in this COMMIT */
+	if (ph->fc.pxy_exp->info.write_behind) {
+		rc = pxy_wb_flush(ph, NULL);
+		if (rc != NFS4_OK)
+			return nfsstat4_to_fsal(rc);
+	}
+
 	/* SEQUENCE */
 	pxy_get_client_sessionid(sid);
 	COMPOUNDV4_ARG_ADD_OP_SEQUENCE(opcnt, argoparray, sid, NB_RPC_SLOT);
@@ -2740,6 +3786,7 @@ static fsal_status_t pxy_commit2(struct fsal_obj_handle *obj_hdl,
 	COMPOUNDV4_ARG_ADD_OP_PUTFH(opcnt, argoparray, ph->fh4);
 
 	/* prepare COMMIT */
+	cok = &resoparray[opcnt].nfs_resop4_u.opcommit.COMMIT4res_u.resok4;
 	COMPOUNDV4_ARG_ADD_OP_COMMIT(opcnt, argoparray, offset, len);
 
 	/* nfs call */
@@ -2747,6 +3794,13 @@ static fsal_status_t pxy_commit2(struct fsal_obj_handle *obj_hdl,
 	if (rc != NFS4_OK)
 		return nfsstat4_to_fsal(rc);
 
+	if (ph->fc.pxy_exp->info.write_behind) {
+		pxy_wb_committed(ph, cok->writeverf);
+		rc = pxy_wb_flush(ph, NULL);
+		if (rc != NFS4_OK)
+			return nfsstat4_to_fsal(rc);
+	}
+
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
@@ -2775,6 +3829,7 @@ void pxy_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->setattr2 = pxy_setattr2;
 	ops->status2 = pxy_status2;
 	ops->reopen2 = pxy_reopen2;
+	ops->io_advise2 = pxy_io_advise2;
 	ops->commit2 = pxy_commit2;
 }
 
@@ -2855,6 +3910,7 @@ static struct pxy_obj_handle *pxy_alloc_handle(struct fsal_export *exp,
 #endif
 
 	fsal_obj_handle_init(&n->obj, exp, attributes.type);
+	pxy_dc_file_init(n, container_of(exp, struct pxy_export, exp));
 	n->obj.fs = NULL;
 	n->obj.state_hdl = NULL;
 	n->obj.fsid = attributes.fsid;
@@ -2885,49 +3941,50 @@ fsal_status_t pxy_lookup_path(struct fsal_export *exp_hdl,
 	struct fsal_obj_handle *parent = NULL;
 	char *saved;
 	char *pcopy;
-	char *p, *pnext;
+	char *p;
 	struct user_cred *creds = op_ctx->creds;
 
 	pcopy = gsh_strdup(path);
 
 	p = strtok_r(pcopy, "/", &saved);
-	if (!p) {
-		fsal_status_t st = pxy_lookup_impl(parent, exp_hdl, creds,
-						   NULL, &next, attrs_out);
-		if (FSAL_IS_ERROR(st)) {
-			gsh_free(pcopy);
-			return st;
-		}
-	}
-	while (p) {
-		if (strcmp(p, "..") == 0) {
-			/* Don't allow lookup of ".." */
-			LogInfo(COMPONENT_FSAL,
-				"Attempt to use \"..\" element in path %s",
-				path);
-			gsh_free(pcopy);
-			return fsalstat(ERR_FSAL_ACCESS, EACCES);
+	do {
+		const char *names[PXY_LOOKUP_MAX_NAMES];
+		unsigned int nnames = 0;
+		fsal_status_t st;
+
+		/* Walk as many components as fit in one COMPOUND */
+		while (p && nnames < PXY_LOOKUP_MAX_NAMES) {
+			if (strcmp(p, "..") == 0) {
+				/* Don't allow lookup of ".." */
+				LogInfo(COMPONENT_FSAL,
+					"Attempt to use \"..\" element in path %s",
+					path);
+				if (parent)
+					parent->obj_ops->release(parent);
+				gsh_free(pcopy);
+				return fsalstat(ERR_FSAL_ACCESS, EACCES);
+			}
+			names[nnames++] = p;
+			p = strtok_r(NULL, "/", &saved);
 		}
-		/* Get the next token now, so we know if we are at the
-		 * terminal token or not.
-		 */
-		pnext = strtok_r(NULL, "/", &saved);
 
 		/* Note that if any element is a symlink, the following will
 		 * fail, thus no security exposure. Only pass back the
 		 * attributes of the terminal lookup.
 		 */
-		fsal_status_t st = pxy_lookup_impl(parent, exp_hdl, creds, p,
-						   &next, pnext == NULL ?
-						   attrs_out : NULL);
+		st = pxy_lookup_chain(parent, exp_hdl, creds, names, nnames,
+				      &next, p == NULL ? attrs_out : NULL);
+		if (parent)
+			parent->obj_ops->release(parent);
 		if (FSAL_IS_ERROR(st)) {
 			gsh_free(pcopy);
 			return st;
 		}
+		if (nnames > 1)
+			pxy_stat_saved(PXY_STAT_LOOKUP_SAVED, nnames - 1);
 
-		p = pnext;
 		parent = next;
-	}
+	} while (p);
 	/* The final element could be a symlink, but either way we are called
 	 * will not work with a symlink, so no security exposure there.
 	 */
@@ -220,6 +220,63 @@ int handle_mapping_hash_add(hash_table_t *p_hash, uint64_t object_id,
 	return HANDLEMAP_SUCCESS;
 }
 
+int handle_mapping_hash_del(hash_table_t *p_hash, uint64_t object_id,
+			    unsigned int handle_hash)
+{
+	int rc;
+	struct gsh_buffdesc buffkey, stored_buffkey;
+	struct gsh_buffdesc stored_buffval;
+	digest_pool_entry_t digest;
+
+	memset(&digest, 0, sizeof(digest));
+	digest.nfs23_digest.object_id = object_id;
+	digest.nfs23_digest.handle_hash = handle_hash;
+
+	buffkey.addr = &digest;
+	buffkey.len = sizeof(digest_pool_entry_t);
+
+	rc = HashTable_Del(p_hash, &buffkey, &stored_buffkey,
+			   &stored_buffval);
+
+	if (rc != HASHTABLE_SUCCESS)
+		return HANDLEMAP_STALE;
+
+	digest_free(stored_buffkey.addr);
+	handle_free(stored_buffval.addr);
+
+	return HANDLEMAP_SUCCESS;
+}
+
+struct hash_walk_arg {
+	void (*cb)(const nfs23_map_handle_t *digest, const void *data,
+		   uint32_t datalen, void *arg);
+	void *arg;
+};
+
+static void hash_walk_entry(struct hash_data *data, void *arg)
+{
+	struct hash_walk_arg *walk = arg;
+	digest_pool_entry_t *digest = data->key.addr;
+	handle_pool_entry_t *handle = data->val.addr;
+
+	walk->cb(&digest->nfs23_digest, handle->fh_data, handle->fh_len,
+		 walk->arg);
+}
+
+/**
+ * Call cb on each mapping of the hash table.
+ */
+void handle_mapping_hash_walk(hash_table_t *p_hash,
+			      void (*cb)(const nfs23_map_handle_t *digest,
+					 const void *data, uint32_t datalen,
+					 void *arg),
+			      void *arg)
+{
+	struct hash_walk_arg walk = { .cb = cb, .arg = arg };
+
+	hashtable_for_each(p_hash, hash_walk_entry, &walk);
+}
+
 /* DEFAULT PARAMETERS for hash table */
 static hash_parameter_t handle_hash_config = {
 	.index_size = 67,
@@ -380,32 +437,15 @@ int HandleMap_SetFH(nfs23_map_handle_t *p_in_nfs23_digest, const void *data,
 int HandleMap_DelFH(nfs23_map_handle_t *p_in_nfs23_digest)
 {
 	int rc;
-	struct gsh_buffdesc buffkey, stored_buffkey;
-	struct gsh_buffdesc stored_buffval;
-
-	digest_pool_entry_t digest;
-
-	digest_pool_entry_t *p_stored_digest;
-	handle_pool_entry_t *p_stored_handle;
 
 	/* first, delete it from hash table */
 
-	digest.nfs23_digest = *p_in_nfs23_digest;
-
-	buffkey.addr = &digest;
-	buffkey.len = sizeof(digest_pool_entry_t);
-
-	rc = HashTable_Del(handle_map_hash, &buffkey, &stored_buffkey,
-			   &stored_buffval);
-
-	if (rc != HASHTABLE_SUCCESS)
-		return HANDLEMAP_STALE;
-
-	p_stored_digest = (digest_pool_entry_t *) stored_buffkey.addr;
-	p_stored_handle = (handle_pool_entry_t *) stored_buffval.addr;
+	rc = handle_mapping_hash_del(handle_map_hash,
+				     p_in_nfs23_digest->object_id,
+				     p_in_nfs23_digest->handle_hash);
 
-	digest_free(p_stored_digest);
-	handle_free(p_stored_handle);
+	if (rc != HANDLEMAP_SUCCESS)
+		return rc;
 
 	/* then, submit the request to the database */
 
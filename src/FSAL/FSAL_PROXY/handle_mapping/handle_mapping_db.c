@@ -2,181 +2,121 @@
 #include "handle_mapping.h"
 #include "handle_mapping_db.h"
 #include "handle_mapping_internal.h"
+#include "city.h"
+#ifdef HAVE_SQLITE3
 #include <sqlite3.h>
+#endif
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/param.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <ctype.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <fnmatch.h>
+#include <inttypes.h>
 #include <pthread.h>
+#include <unistd.h>
 
-/* sqlite check macros */
-
-#define CheckTable(_p_conn_, _code_, _msg_str_, _result_) \
-do { \
-	if ((_code_) != SQLITE_OK) { \
-		LogCrit(COMPONENT_FSAL, \
-			"SQLite command failed in %s line %i", \
-			__func__, __LINE__);		\
-		LogCrit(COMPONENT_FSAL, "%s (%d)", \
-			(_msg_str_ ? _msg_str_ : sqlite3_errmsg(_p_conn_)), \
-			_code_);					\
-		if (_msg_str_) {					\
-			sqlite3_free(_msg_str_);			\
-			_msg_str_ = NULL;				\
-		}							\
-		if (_result_) {						\
-			sqlite3_free_table(_result_);			\
-			_result_ = NULL;				\
-		}							\
-		return HANDLEMAP_DB_ERROR;				\
-	}								\
-} while (0)
-
-#define CheckCommand(_p_conn_, _code_, _msg_str_) \
-do { \
-	if ((_code_) != SQLITE_OK) { \
-		LogCrit(COMPONENT_FSAL, \
-			"SQLite command failed in %s line %i", \
-			__func__, __LINE__);			\
-		LogCrit(COMPONENT_FSAL, "%s (%d)", \
-			(_msg_str_ ? _msg_str_ : sqlite3_errmsg(_p_conn_)), \
-			_code_);					\
-		if (_msg_str_) { \
-			sqlite3_free(_msg_str_); \
-			_msg_str_ = NULL; \
-		}			  \
-		return HANDLEMAP_DB_ERROR;	\
-	}					\
-} while (0)
-
-#define CheckPrepare(_p_conn_, _code_) \
-do { \
-	if ((_code_) != SQLITE_OK) {	\
-		LogCrit(COMPONENT_FSAL,					\
-			"SQLite prepare statement failed in %s line %i", \
-			__func__, __LINE__);				\
-		LogCrit(COMPONENT_FSAL, "%s (%d)",			\
-			sqlite3_errmsg(_p_conn_), _code_);		\
-		return HANDLEMAP_DB_ERROR;				\
-	}								\
-} while (0)
-
-#define CheckBind(_p_conn_, _code_, _stmt_) \
-do { \
-	if ((_code_) != SQLITE_OK) { \
-		LogCrit(COMPONENT_FSAL,				 \
-			"SQLite parameter binding failed in %s line %i", \
-			__func__, __LINE__);				\
-		LogCrit(COMPONENT_FSAL, "%s (%d)",			\
-			sqlite3_errmsg(_p_conn_), _code_);		\
-		sqlite3_clear_bindings(_stmt_);				\
-		return HANDLEMAP_DB_ERROR;				\
-	}								\
-} while (0)
-
-#define CheckStep(_p_conn_, _code_, _stmt_) \
-do { \
-	if ((_code_) != SQLITE_OK  && (_code_) != \
-	    SQLITE_ROW && (_code_) != SQLITE_DONE) {			\
-		LogCrit(COMPONENT_FSAL,					\
-			"SQLite command failed in %s line %i",		\
-			__func__, __LINE__);			\
-		LogCrit(COMPONENT_FSAL, "%s (%d)",			\
-			sqlite3_errmsg(_p_conn_), _code_);		\
-		sqlite3_reset(_stmt_);					\
-		return HANDLEMAP_DB_ERROR;				\
-	}								\
-} while (0)
-
-/* Type of DB operations */
-typedef enum {
-	LOAD = 1,
-	INSERT,
-	DELETE
-} db_op_type;
-
-/* DB operation arguments */
-typedef struct db_op_item__ {
-	db_op_type op_type;
-
-	/* operation info */
-
-	union {
-		struct hdlmap_tuple {
-			nfs23_map_handle_t nfs23_digest;
-			uint8_t fh4_len;
-			char fh4_data[NFS4_FHSIZE];
-		} fh_info;
-
-		hash_table_t *hash;
-	} op_arg;
-
-	/* for chained list */
-	struct db_op_item__ *p_next;
-
-} db_op_item_t;
-
-/* the queue for each DB flusher thread */
-typedef struct flusher_queue__ {
-	/* the queue for high priority operations */
-	db_op_item_t *highprio_first;
-	db_op_item_t *highprio_last;
-
-	/* the queue for low priority operations */
-	db_op_item_t *lowprio_first;
-	db_op_item_t *lowprio_last;
-
-	/* number of operations pending */
-	unsigned int nb_waiting;
-
-	pthread_mutex_t queues_mutex;
-
-	pthread_cond_t work_avail_condition;
-	pthread_cond_t work_done_condition;
-
-	/* status (used for work_done_condition) */
-	enum { NOT_READY, IDLE, WORKING, FINISHED } status;
-
-} flusher_queue_t;
-
-#define LOAD_ALL_STATEMENT  0
-#define INSERT_STATEMENT    1
-#define DELETE_STATEMENT    2
-
-#define STATEMENT_COUNT     3
-
-/* thread info */
-typedef struct db_thread_info__ {
-	pthread_t thr_id;
-	unsigned int thr_index;
+/*
+ * Each database is a log of fixed header records, in host byte order,
+ * each followed by the FSAL handle and padded to 8 bytes.  A mapping
+ * is added by an INSERT record and removed by a DELETE record for the
+ * same digest; the records of a digest always go to the same log.
+ */
 
-	flusher_queue_t work_queue;
+#define HDLMAP_REC_MAGIC	0x50414d48	/* "HMAP" */
 
-	/* SQLite database connection */
-	sqlite3 *db_conn;
+#define HDLMAP_REC_INSERT	1
+#define HDLMAP_REC_DELETE	2
 
-	/* prepared statement table */
-	sqlite3_stmt * prep_stmt[STATEMENT_COUNT];
+struct hdlmap_rec {
+	uint32_t magic;
+	/* CityHash64 of the rest of the record, truncated */
+	uint32_t checksum;
+	uint64_t object_id;
+	uint32_t handle_hash;
+	uint8_t op;
+	uint8_t fh_len;
+	uint16_t reserved;
+	char fh_data[];
+};
+
+/* Records are buffered this much before the writer must wait */
+#define HDLMAP_BUF_SIZE		(256 * 1024)
+
+/* A failed write is retried this many times, a second apart, before
+ * the log is given up on
+ */
+#define HDLMAP_WRITE_RETRIES	3
 
-	/* this pool is accessed by submitter
-	 * and by the db thread */
-	pthread_mutex_t pool_mutex;
-	pool_t *dbop_pool;
+/* A log is rewritten at start up once it holds more dead records than
+ * live ones, and at least this many
+ */
+#define HDLMAP_COMPACT_MIN	4096
 
-} db_thread_info_t;
+/* One log, its buffer and the thread writing it */
+struct hdlmap_log {
+	unsigned int index;
+	int fd;
+	pthread_t thr_id;
+
+	pthread_mutex_t mtx;
+	/* signaled when records are appended */
+	pthread_cond_t work_cond;
+	/* broadcast when the buffer is handed to the writer and when
+	 * it is written
+	 */
+	pthread_cond_t done_cond;
+
+	/* records not yet handed to the writer, protected by mtx */
+	char *buf;
+	size_t len;
+	/* records being written, owned by the writer */
+	char *spare;
+	bool writing;
+	/* records appended, and of those written, protected by mtx */
+	uint64_t appended;
+	uint64_t written;
+	/* set once the log cannot be written, protected by mtx */
+	int rc;
+	/* bytes of good records in the log, owned by the writer */
+	off_t size;
+
+	/* set up by the loader */
+	int load_rc;
+	uint64_t records;
+	uint64_t live;
+
+	/* rewritten log while compacting */
+	int compact_fd;
+	char *compact_buf;
+	size_t compact_len;
+	int compact_rc;
+};
 
 static char dbmap_dir[MAXPATHLEN + 1];
-static char db_tmpdir[MAXPATHLEN + 1];
 static unsigned int nb_db_threads;
 static int synchronous;
 
-/* used for clean shutdown */
-static int do_terminate;
+/* hash table the logs are being loaded to */
+static hash_table_t *load_hash;
+
+static struct hdlmap_log db_log[MAX_DB];
+
+unsigned int select_db_queue(const nfs23_map_handle_t *p_nfs23_digest)
+{
+	unsigned int h =
+	    ((p_nfs23_digest->object_id * 1049) ^ p_nfs23_digest->handle_hash) %
+	    2477;
+
+	h = h % nb_db_threads;
+
+	return h;
+}
 
-/* all information and context for threads */
-static db_thread_info_t db_thread[MAX_DB];
 
 /**
  * @brief Print memory to a a hex string
@@ -285,479 +225,613 @@ sscanmem(void *target, size_t tgt_size, const char *str_source)
 
 }
 
-/* Initialize basic structures for a thread */
-static int init_db_thread_info(db_thread_info_t *p_thr_info,
-			       unsigned int nb_dbop_prealloc)
+/* Size of a record holding a handle of len bytes */
+static inline size_t hdlmap_rec_size(uint32_t len)
 {
-	unsigned int i;
-
-	if (!p_thr_info)
-		return HANDLEMAP_INTERNAL_ERROR;
+	return roundup(sizeof(struct hdlmap_rec) + len, 8);
+}
 
-	memset(p_thr_info, 0, sizeof(db_thread_info_t));
+static inline uint32_t hdlmap_rec_checksum(const struct hdlmap_rec *rec)
+{
+	const char *start = (const char *)&rec->object_id;
 
-	p_thr_info->work_queue.highprio_first = NULL;
-	p_thr_info->work_queue.highprio_last = NULL;
-	p_thr_info->work_queue.lowprio_first = NULL;
-	p_thr_info->work_queue.lowprio_last = NULL;
+	return (uint32_t) CityHash64(start, rec->fh_data + rec->fh_len -
+					    start);
+}
 
-	p_thr_info->work_queue.nb_waiting = 0;
+static void hdlmap_log_path(char *path, unsigned int index,
+			    const char *suffix)
+{
+	snprintf(path, MAXPATHLEN, "%s/%s.%u%s", dbmap_dir, DB_FILE_PREFIX,
+		 index, suffix);
+}
 
-	if (pthread_mutex_init(&p_thr_info->work_queue.queues_mutex, NULL))
-		return HANDLEMAP_SYSTEM_ERROR;
+/* Write a whole buffer, retrying short writes */
+static int hdlmap_write(int fd, const char *buf, size_t len)
+{
+	ssize_t rc;
 
-	if (pthread_cond_init
-	    (&p_thr_info->work_queue.work_avail_condition, NULL))
-		return HANDLEMAP_SYSTEM_ERROR;
+	while (len > 0) {
+		rc = write(fd, buf, len);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		buf += rc;
+		len -= rc;
+	}
 
-	if (pthread_cond_init
-	    (&p_thr_info->work_queue.work_done_condition, NULL))
-		return HANDLEMAP_SYSTEM_ERROR;
+	return 0;
+}
 
-	/* init thread status */
-	p_thr_info->work_queue.status = NOT_READY;
+/**
+ * @brief Append a record to the log of its digest
+ *
+ * The record is only buffered, the log's thread writes it out along
+ * with whatever else was appended meanwhile.  With synchronous inserts
+ * the call returns once it is on disk.
+ */
+static int hdlmap_log_append(uint8_t op,
+			     const nfs23_map_handle_t *p_nfs23_digest,
+			     const void *data, uint32_t len)
+{
+	struct hdlmap_log *log = &db_log[select_db_queue(p_nfs23_digest)];
+	size_t size = hdlmap_rec_size(len);
+	struct hdlmap_rec *rec;
+	uint64_t seq;
 
-	p_thr_info->db_conn = NULL;
+	if (len > NFS4_FHSIZE)
+		return HANDLEMAP_INVALID_PARAM;
 
-	for (i = 0; i < STATEMENT_COUNT; i++)
-		p_thr_info->prep_stmt[i] = NULL;
+	PTHREAD_MUTEX_lock(&log->mtx);
 
-	/* init memory pool */
+	while (log->rc == 0 && log->len + size > HDLMAP_BUF_SIZE)
+		pthread_cond_wait(&log->done_cond, &log->mtx);
 
-	if (pthread_mutex_init(&p_thr_info->pool_mutex, NULL))
+	if (log->rc != 0) {
+		PTHREAD_MUTEX_unlock(&log->mtx);
 		return HANDLEMAP_SYSTEM_ERROR;
+	}
+
+	rec = (struct hdlmap_rec *)(log->buf + log->len);
+	memset(rec, 0, size);
+	rec->magic = HDLMAP_REC_MAGIC;
+	rec->object_id = p_nfs23_digest->object_id;
+	rec->handle_hash = p_nfs23_digest->handle_hash;
+	rec->op = op;
+	rec->fh_len = len;
+	if (len != 0)
+		memcpy(rec->fh_data, data, len);
+	rec->checksum = hdlmap_rec_checksum(rec);
+
+	log->len += size;
+	seq = ++log->appended;
+	pthread_cond_signal(&log->work_cond);
+
+	if (synchronous && op == HDLMAP_REC_INSERT) {
+		while (log->written < seq && log->rc == 0)
+			pthread_cond_wait(&log->done_cond, &log->mtx);
+		if (log->written < seq) {
+			PTHREAD_MUTEX_unlock(&log->mtx);
+			return HANDLEMAP_SYSTEM_ERROR;
+		}
+	}
 
-	p_thr_info->dbop_pool =
-	    pool_basic_init("drop_pool", sizeof(db_op_item_t));
+	PTHREAD_MUTEX_unlock(&log->mtx);
 
 	return HANDLEMAP_SUCCESS;
 }
 
-/* Called by a thread to initialize its database access.
- * After this call:
- *  - database connection is established
- *  - schema is created
- *  - prepared statements are ready to be used
+/**
+ * @brief Write a batch of records after the last good one
+ *
+ * What a failed write left of the batch is cut off, so that the log
+ * never holds a torn record followed by good ones, then the batch is
+ * written again.
  */
-static int init_database_access(db_thread_info_t *p_thr_info)
+static int hdlmap_log_write(struct hdlmap_log *log, const char *buf,
+			    size_t len)
 {
-	char db_file[MAXPATHLEN + 1];
-	int rc;
-	char **result = NULL;
-	int rows, cols;
-	char *errmsg = NULL;
-	const char *unparsed;
-
-	/* first open the database file */
-
-	snprintf(db_file, MAXPATHLEN, "%s/%s.%u", dbmap_dir, DB_FILE_PREFIX,
-		 p_thr_info->thr_index);
+	int retry, rc;
+
+	for (retry = 0; ; retry++) {
+		rc = hdlmap_write(log->fd, buf, len);
+		if (rc == 0 && synchronous)
+			rc = fdatasync(log->fd) ? errno : 0;
+		if (rc == 0) {
+			log->size += len;
+			return 0;
+		}
 
-	rc = sqlite3_open(db_file, &p_thr_info->db_conn);
+		LogCrit(COMPONENT_FSAL,
+			"ERROR: could not write handle map log %u: %s",
+			log->index, strerror(rc));
 
-	if (rc != 0) {
-		if (p_thr_info->db_conn) {
+		if (ftruncate(log->fd, log->size) != 0) {
 			LogCrit(COMPONENT_FSAL,
-				"ERROR: could not connect to SQLite3 database (file %s): %s",
-				db_file, sqlite3_errmsg(p_thr_info->db_conn));
-			sqlite3_close(p_thr_info->db_conn);
-		} else {
-			LogCrit(COMPONENT_FSAL,
-				"ERROR: could not connect to SQLite3 database (file %s): status=%d",
-				db_file, rc);
+				"ERROR: could not truncate handle map log %u: %s",
+				log->index, strerror(errno));
+			return rc;
 		}
-		return HANDLEMAP_DB_ERROR;
-	}
-
-	/* Now check, that the map table exists */
-	rc = sqlite3_get_table(p_thr_info->db_conn,
-			       "SELECT name FROM sqlite_master WHERE type = 'table' AND name = '"
-			       MAP_TABLE "'", &result, &rows, &cols, &errmsg);
 
-	CheckTable(p_thr_info->db_conn, rc, errmsg, result);
+		if (retry == HDLMAP_WRITE_RETRIES)
+			return rc;
 
-	/* no need for the result, just the number of rows returned */
-	sqlite3_free_table(result);
+		sleep(1);
+	}
+}
 
-	if (rows != 1) {
-		/* table must be created */
-		rc = sqlite3_exec(p_thr_info->db_conn,
-				  "CREATE TABLE " MAP_TABLE " ( " OBJID_FIELD
-				  "   BIGINT NOT NULL, " HASH_FIELD
-				  "    INT NOT NULL, " HANDLE_FIELD
-				  "  TEXT, PRIMARY KEY(" OBJID_FIELD ", "
-				  HASH_FIELD ") )", NULL, NULL, &errmsg);
+/* Thread writing out the records appended to a log */
+static void *hdlmap_log_writer(void *arg)
+{
+	struct hdlmap_log *log = arg;
+	char thread_name[256];
+	uint64_t seq;
+	size_t len;
+	char *buf;
+	int rc;
 
-		CheckCommand(p_thr_info->db_conn, rc, errmsg);
+	snprintf(thread_name, 256, "DB thread #%u", log->index);
+	SetNameFunction(thread_name);
 
-	}
+	PTHREAD_MUTEX_lock(&log->mtx);
 
-	/* Now, create prepared statements */
+	while (1) {
+		while (log->len == 0)
+			pthread_cond_wait(&log->work_cond, &log->mtx);
 
-	rc = sqlite3_prepare_v2(p_thr_info->db_conn,
-				"SELECT " OBJID_FIELD "," HASH_FIELD ","
-				HANDLE_FIELD " FROM " MAP_TABLE, -1,
-				&(p_thr_info->prep_stmt[LOAD_ALL_STATEMENT]),
-				&unparsed);
+		/* Take what was appended, appends go on in the other
+		 * buffer while this one is written.
+		 */
+		buf = log->buf;
+		len = log->len;
+		log->buf = log->spare;
+		log->len = 0;
+		log->spare = buf;
+		log->writing = true;
+		seq = log->appended;
+		pthread_cond_broadcast(&log->done_cond);
 
-	CheckPrepare(p_thr_info->db_conn, rc);
+		PTHREAD_MUTEX_unlock(&log->mtx);
 
-	rc = sqlite3_prepare_v2(p_thr_info->db_conn,
-				"INSERT INTO " MAP_TABLE "(" OBJID_FIELD ","
-				HASH_FIELD "," HANDLE_FIELD
-				") VALUES (?1, ?2, ?3 )", -1,
-				&(p_thr_info->prep_stmt[INSERT_STATEMENT]),
-				&unparsed);
+		rc = hdlmap_log_write(log, buf, len);
 
-	CheckPrepare(p_thr_info->db_conn, rc);
+		PTHREAD_MUTEX_lock(&log->mtx);
 
-	rc = sqlite3_prepare_v2(p_thr_info->db_conn,
-				"DELETE FROM " MAP_TABLE " WHERE " OBJID_FIELD
-				"=?1 AND " HASH_FIELD "=?2", -1,
-				&(p_thr_info->prep_stmt[DELETE_STATEMENT]),
-				&unparsed);
+		log->writing = false;
+		if (rc == 0) {
+			log->written = seq;
+		} else {
+			/* Give up on the log, what was appended since is
+			 * dropped and the callers waiting on it fail.
+			 */
+			LogCrit(COMPONENT_FSAL,
+				"ERROR: handle map log %u is not written anymore, %"
+				PRIu64 " records lost",
+				log->index, log->appended - log->written);
+			log->rc = rc;
+			log->len = 0;
+		}
+		pthread_cond_broadcast(&log->done_cond);
 
-	CheckPrepare(p_thr_info->db_conn, rc);
+		if (log->rc != 0)
+			break;
+	}
 
-	/* Everything is OK now ! */
-	return HANDLEMAP_SUCCESS;
+	PTHREAD_MUTEX_unlock(&log->mtx);
 
-}				/* init_database_access */
+	return NULL;
+}
 
-static int db_load_operation(db_thread_info_t *p_info, hash_table_t *p_hash)
+/**
+ * @brief Load a log into the hash table
+ *
+ * The log is mapped and read in one pass, replaying its inserts and
+ * deletes.  A torn or corrupt record ends the log: it and what follows
+ * are cut off, so that new records follow the last good one.
+ */
+static void *hdlmap_log_loader(void *arg)
 {
-	/* the object id to be inserted to hash table */
-	uint64_t object_id;
-	unsigned int handle_hash;
-	const char *fsal_handle_str;
-	char fh4_data[NFS4_FHSIZE];
-	unsigned int nb_loaded = 0;
-	int rc;
+	struct hdlmap_log *log = arg;
+	const struct hdlmap_rec *rec;
+	char *map = NULL;
+	struct stat st;
+	size_t file_size, off = 0, size;
 	struct timeval t1;
 	struct timeval t2;
 	struct timeval tdiff;
+	int rc;
 
 	gettimeofday(&t1, NULL);
 
-	rc = sqlite3_step(p_info->prep_stmt[LOAD_ALL_STATEMENT]);
-	CheckStep(p_info->db_conn, rc, p_info->prep_stmt[LOAD_ALL_STATEMENT]);
-
-	/* something to read */
-	while (rc == SQLITE_ROW) {
-		object_id =
-		    sqlite3_column_int64(p_info->prep_stmt[LOAD_ALL_STATEMENT],
-					 0);
-		handle_hash =
-		    sqlite3_column_int(p_info->prep_stmt[LOAD_ALL_STATEMENT],
-				       1);
-		fsal_handle_str =
-		    sqlite3_column_text(p_info->prep_stmt[LOAD_ALL_STATEMENT],
-					2);
-
-		if (fsal_handle_str) {
-			int len = strlen(fsal_handle_str);
-
-			if ((len & 1) || len > NFS4_FHSIZE * 2) {
-				LogEvent(COMPONENT_FSAL,
-					 "Bogus handle '%s' - wrong number of symbols",
-					 fsal_handle_str);
-			} else {
-				/* convert hexa string representation
-				 * to binary data */
-				if (sscanmem(fh4_data, len / 2, fsal_handle_str)
-				    != len) {
-					LogEvent(COMPONENT_FSAL,
-						 "Bogus entry '%s' - cannot convert",
-						 fsal_handle_str);
-				} else {
-					/* now insert it to the hash table */
-					rc = handle_mapping_hash_add(
-								p_hash,
-								object_id,
-								handle_hash,
-								fh4_data,
-								len / 2);
-
-					if (rc == 0)
-						nb_loaded++;
-					else
-						LogCrit(COMPONENT_FSAL,
-							"ERROR %d adding entry to hash table <object_id=%llu, FH_hash=%u, FSAL_Handle=%s>",
-							rc,
-							(unsigned long long)
-							object_id, handle_hash,
-							fsal_handle_str);
-				}
-			}
-		} else {
-			LogEvent(COMPONENT_FSAL,
-				 "Empty handle in object %lld, hash %d",
-				 (unsigned long long)object_id, handle_hash);
+	if (fstat(log->fd, &st) != 0) {
+		LogCrit(COMPONENT_FSAL,
+			"ERROR: could not stat handle map log %u: %s",
+			log->index, strerror(errno));
+		log->load_rc = HANDLEMAP_SYSTEM_ERROR;
+		return NULL;
+	}
+
+	file_size = st.st_size;
+	if (file_size != 0) {
+		map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, log->fd, 0);
+		if (map == MAP_FAILED) {
+			LogCrit(COMPONENT_FSAL,
+				"ERROR: could not map handle map log %u: %s",
+				log->index, strerror(errno));
+			log->load_rc = HANDLEMAP_SYSTEM_ERROR;
+			return NULL;
 		}
+		(void) madvise(map, file_size, MADV_SEQUENTIAL);
+	}
 
-		rc = sqlite3_step(p_info->prep_stmt[LOAD_ALL_STATEMENT]);
-		CheckStep(p_info->db_conn, rc,
-			  p_info->prep_stmt[LOAD_ALL_STATEMENT]);
+	while (off + sizeof(struct hdlmap_rec) <= file_size) {
+		rec = (const struct hdlmap_rec *)(map + off);
+		size = hdlmap_rec_size(rec->fh_len);
+
+		if (rec->magic != HDLMAP_REC_MAGIC ||
+		    rec->fh_len > NFS4_FHSIZE ||
+		    off + size > file_size ||
+		    rec->checksum != hdlmap_rec_checksum(rec))
+			break;
 
+		off += size;
+		log->records++;
+
+		switch (rec->op) {
+		case HDLMAP_REC_INSERT:
+			rc = handle_mapping_hash_add(load_hash,
+						     rec->object_id,
+						     rec->handle_hash,
+						     rec->fh_data,
+						     rec->fh_len);
+			if (rc == HANDLEMAP_SUCCESS)
+				log->live++;
+			else if (rc != HANDLEMAP_EXISTS)
+				LogCrit(COMPONENT_FSAL,
+					"ERROR %d adding entry to hash table <object_id=%"
+					PRIu64 ", FH_hash=%u>",
+					rc, rec->object_id, rec->handle_hash);
+			break;
+
+		case HDLMAP_REC_DELETE:
+			rc = handle_mapping_hash_del(load_hash,
+						     rec->object_id,
+						     rec->handle_hash);
+			if (rc == HANDLEMAP_SUCCESS)
+				log->live--;
+			break;
+
+		default:
+			LogEvent(COMPONENT_FSAL,
+				 "Bogus operation %u in handle map log %u",
+				 rec->op, log->index);
+		}
 	}
 
-	/* clear results */
-	sqlite3_reset(p_info->prep_stmt[LOAD_ALL_STATEMENT]);
+	if (map != NULL)
+		munmap(map, file_size);
 
-	/* print time and item count */
+	if (off != file_size) {
+		LogWarn(COMPONENT_FSAL,
+			"Handle map log %u is torn or corrupt at offset %zu, discarding its last %zu bytes",
+			log->index, off, file_size - off);
+		if (ftruncate(log->fd, off) != 0) {
+			LogCrit(COMPONENT_FSAL,
+				"ERROR: could not truncate handle map log %u: %s",
+				log->index, strerror(errno));
+			log->load_rc = HANDLEMAP_SYSTEM_ERROR;
+			return NULL;
+		}
+	}
+
+	log->size = off;
 
 	gettimeofday(&t2, NULL);
 	timersub(&t2, &t1, &tdiff);
 
-	LogEvent(COMPONENT_FSAL, "Reloaded %u items in %d.%06ds", nb_loaded,
+	LogEvent(COMPONENT_FSAL,
+		 "Reloaded %" PRIu64 " items from %" PRIu64
+		 " records of log %u in %d.%06ds",
+		 log->live, log->records, log->index,
 		 (int)tdiff.tv_sec, (int)tdiff.tv_usec);
 
-	return HANDLEMAP_SUCCESS;
-
-}				/* db_load_operation */
+	return NULL;
+}
 
-static int db_insert_operation(db_thread_info_t *p_info,
-			       struct hdlmap_tuple *data)
+/* Copy a live mapping to the rewritten log of its digest, if any */
+static void hdlmap_compact_entry(const nfs23_map_handle_t *p_nfs23_digest,
+				 const void *data, uint32_t len, void *arg)
 {
-	int rc;
-	char handle_str[2 * NFS4_FHSIZE + 1];
-
-	rc = sqlite3_bind_int64(p_info->prep_stmt[INSERT_STATEMENT], 1,
-				data->nfs23_digest.object_id);
-	CheckBind(p_info->db_conn, rc, p_info->prep_stmt[INSERT_STATEMENT]);
+	struct hdlmap_log *log = &db_log[select_db_queue(p_nfs23_digest)];
+	size_t size = hdlmap_rec_size(len);
+	struct hdlmap_rec *rec;
+
+	if (log->compact_fd < 0 || log->compact_rc != 0)
+		return;
+
+	if (log->compact_len + size > HDLMAP_BUF_SIZE) {
+		log->compact_rc = hdlmap_write(log->compact_fd,
+					       log->compact_buf,
+					       log->compact_len);
+		log->compact_len = 0;
+	}
 
-	rc = sqlite3_bind_int(p_info->prep_stmt[INSERT_STATEMENT], 2,
-			      data->nfs23_digest.handle_hash);
-	CheckBind(p_info->db_conn, rc, p_info->prep_stmt[INSERT_STATEMENT]);
+	rec = (struct hdlmap_rec *)(log->compact_buf + log->compact_len);
+	memset(rec, 0, size);
+	rec->magic = HDLMAP_REC_MAGIC;
+	rec->object_id = p_nfs23_digest->object_id;
+	rec->handle_hash = p_nfs23_digest->handle_hash;
+	rec->op = HDLMAP_REC_INSERT;
+	rec->fh_len = len;
+	memcpy(rec->fh_data, data, len);
+	rec->checksum = hdlmap_rec_checksum(rec);
+
+	log->compact_len += size;
+}
 
-	snprintmem(handle_str, sizeof(handle_str), data->fh4_data,
-		   data->fh4_len);
+/* Put a rewritten log in place of the old one */
+static void hdlmap_compact_finish(struct hdlmap_log *log)
+{
+	char path[MAXPATHLEN + 1];
+	char tmp_path[MAXPATHLEN + 1];
+	int fd = -1;
+	int rc = log->compact_rc;
+
+	hdlmap_log_path(path, log->index, "");
+	hdlmap_log_path(tmp_path, log->index, ".compact");
+
+	if (rc == 0)
+		rc = hdlmap_write(log->compact_fd, log->compact_buf,
+				  log->compact_len);
+	if (rc == 0 && fsync(log->compact_fd) != 0)
+		rc = errno;
+	close(log->compact_fd);
+	log->compact_fd = -1;
+	gsh_free(log->compact_buf);
+	log->compact_buf = NULL;
+
+	if (rc == 0 && rename(tmp_path, path) != 0)
+		rc = errno;
+	if (rc == 0) {
+		fd = open(path, O_RDWR | O_APPEND);
+		if (fd < 0)
+			rc = errno;
+	}
+	if (rc == 0) {
+		/* make the rename itself durable */
+		int dir_fd = open(dbmap_dir, O_RDONLY | O_DIRECTORY);
 
-	rc = sqlite3_bind_text(p_info->prep_stmt[INSERT_STATEMENT], 3,
-			       handle_str, -1, SQLITE_STATIC);
-	CheckBind(p_info->db_conn, rc, p_info->prep_stmt[INSERT_STATEMENT]);
+		if (dir_fd >= 0) {
+			(void) fsync(dir_fd);
+			close(dir_fd);
+		}
+	}
 
-	rc = sqlite3_step(p_info->prep_stmt[INSERT_STATEMENT]);
-	CheckStep(p_info->db_conn, rc, p_info->prep_stmt[INSERT_STATEMENT]);
+	if (rc != 0) {
+		LogWarn(COMPONENT_FSAL,
+			"Could not compact handle map log %u: %s",
+			log->index, strerror(rc));
+		(void) unlink(tmp_path);
+		return;
+	}
 
-	/* clear results */
-	sqlite3_reset(p_info->prep_stmt[INSERT_STATEMENT]);
+	PTHREAD_MUTEX_lock(&log->mtx);
+	close(log->fd);
+	log->fd = fd;
+	log->size = lseek(fd, 0, SEEK_END);
+	PTHREAD_MUTEX_unlock(&log->mtx);
 
-	return HANDLEMAP_SUCCESS;
+	LogEvent(COMPONENT_FSAL,
+		 "Compacted handle map log %u from %" PRIu64 " to %" PRIu64
+		 " records", log->index, log->records, log->live);
 
-}				/* db_insert_operation */
+	log->records = log->live;
+}
 
-static int db_delete_operation(db_thread_info_t *p_info,
-			       nfs23_map_handle_t *p_nfs23_digest)
+/**
+ * @brief Rewrite the logs mostly made of dead records
+ *
+ * All of them are rewritten from one walk of the hash table, then
+ * renamed over the old ones.
+ */
+static void hdlmap_compact(hash_table_t *target_hash)
 {
-	int rc;
-
-	rc = sqlite3_bind_int64(p_info->prep_stmt[DELETE_STATEMENT], 1,
-				p_nfs23_digest->object_id);
-	CheckBind(p_info->db_conn, rc, p_info->prep_stmt[DELETE_STATEMENT]);
+	char tmp_path[MAXPATHLEN + 1];
+	struct hdlmap_log *log;
+	bool any = false;
+	unsigned int i;
 
-	rc = sqlite3_bind_int(p_info->prep_stmt[DELETE_STATEMENT], 2,
-			      p_nfs23_digest->handle_hash);
-	CheckBind(p_info->db_conn, rc, p_info->prep_stmt[DELETE_STATEMENT]);
+	for (i = 0; i < nb_db_threads; i++) {
+		log = &db_log[i];
+		log->compact_fd = -1;
+
+		if (log->records - log->live < HDLMAP_COMPACT_MIN ||
+		    log->records - log->live <= log->live)
+			continue;
+
+		hdlmap_log_path(tmp_path, i, ".compact");
+		log->compact_fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC,
+				       0600);
+		if (log->compact_fd < 0) {
+			LogWarn(COMPONENT_FSAL,
+				"Could not compact handle map log %u: %s",
+				i, strerror(errno));
+			continue;
+		}
 
-	rc = sqlite3_step(p_info->prep_stmt[DELETE_STATEMENT]);
-	CheckStep(p_info->db_conn, rc, p_info->prep_stmt[DELETE_STATEMENT]);
+		log->compact_buf = gsh_malloc(HDLMAP_BUF_SIZE);
+		log->compact_len = 0;
+		log->compact_rc = 0;
+		any = true;
+	}
 
-	/* clear results */
-	sqlite3_reset(p_info->prep_stmt[DELETE_STATEMENT]);
+	if (!any)
+		return;
 
-	return HANDLEMAP_SUCCESS;
+	handle_mapping_hash_walk(target_hash, hdlmap_compact_entry, NULL);
 
-}				/* db_delete_operation */
+	for (i = 0; i < nb_db_threads; i++) {
+		if (db_log[i].compact_fd >= 0)
+			hdlmap_compact_finish(&db_log[i]);
+	}
+}
 
-/* push a task to the queue */
-static int dbop_push(flusher_queue_t *p_queue, db_op_item_t *p_op)
+/**
+ * @brief Import the SQLite database of an earlier version
+ *
+ * Its mappings are added to the hash table and logged like new ones.
+ * Mappings already loaded from the logs are skipped, so an import that
+ * was cut short can be run again.
+ *
+ * @param[in]  target_hash  Hash table being loaded
+ * @param[in]  path         Database to import
+ * @param[out] count        Incremented for each mapping imported
+ */
+static int hdlmap_import_db(hash_table_t *target_hash, const char *path,
+			    uint64_t *count)
 {
-	PTHREAD_MUTEX_lock(&p_queue->queues_mutex);
-
-	/* add an item at the end of the queue */
-	switch (p_op->op_type) {
-	case LOAD:
-	case INSERT:
-
-		/* high priority operations */
+#ifdef HAVE_SQLITE3
+	nfs23_map_handle_t digest;
+	char fh_data[NFS4_FHSIZE];
+	sqlite3_stmt *stmt = NULL;
+	sqlite3 *conn = NULL;
+	const char *str;
+	struct hdlmap_log *log;
+	size_t len;
+	int rc, hrc = HANDLEMAP_SUCCESS;
+
+	rc = sqlite3_open_v2(path, &conn, SQLITE_OPEN_READONLY, NULL);
+	if (rc == SQLITE_OK)
+		rc = sqlite3_prepare_v2(conn,
+					"SELECT ObjectId,HandleHash,FSALHandle "
+					"FROM HandleMap", -1, &stmt, NULL);
+	if (rc != SQLITE_OK) {
+		LogCrit(COMPONENT_FSAL,
+			"ERROR: could not read handle map database %s: %s",
+			path, conn ? sqlite3_errmsg(conn) : strerror(ENOMEM));
+		sqlite3_close(conn);
+		return HANDLEMAP_DB_ERROR;
+	}
 
-		p_op->p_next = NULL;
+	while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+		digest.object_id = sqlite3_column_int64(stmt, 0);
+		digest.handle_hash = sqlite3_column_int(stmt, 1);
+		str = (const char *)sqlite3_column_text(stmt, 2);
+		len = str != NULL ? strlen(str) : 0;
 
-		if (p_queue->highprio_last == NULL) {
-			/* first operation */
-			p_queue->highprio_first = p_op;
-			p_queue->highprio_last = p_op;
-		} else {
-			p_queue->highprio_last->p_next = p_op;
-			p_queue->highprio_last = p_op;
+		if (len == 0 || (len & 1) || len > NFS4_FHSIZE * 2 ||
+		    sscanmem(fh_data, len / 2, str) != len) {
+			LogEvent(COMPONENT_FSAL,
+				 "Bogus handle in %s for <object_id=%" PRIu64
+				 ", FH_hash=%u>, not imported",
+				 path, digest.object_id, digest.handle_hash);
+			continue;
 		}
 
-		p_queue->nb_waiting++;
-
-		break;
-
-	case DELETE:
-
-		/* low priority operation */
-
-		p_op->p_next = NULL;
-
-		if (p_queue->lowprio_last == NULL) {
-			/* first operation */
-			p_queue->lowprio_first = p_op;
-			p_queue->lowprio_last = p_op;
-		} else {
-			p_queue->lowprio_last->p_next = p_op;
-			p_queue->lowprio_last = p_op;
+		hrc = handle_mapping_hash_add(target_hash, digest.object_id,
+					      digest.handle_hash, fh_data,
+					      len / 2);
+		if (hrc == HANDLEMAP_EXISTS) {
+			hrc = HANDLEMAP_SUCCESS;
+			continue;
+		}
+		if (hrc == HANDLEMAP_SUCCESS)
+			hrc = hdlmap_log_append(HDLMAP_REC_INSERT, &digest,
+						fh_data, len / 2);
+		if (hrc != HANDLEMAP_SUCCESS) {
+			LogCrit(COMPONENT_FSAL,
+				"ERROR %d importing <object_id=%" PRIu64
+				", FH_hash=%u> from %s",
+				hrc, digest.object_id, digest.handle_hash,
+				path);
+			break;
 		}
 
-		p_queue->nb_waiting++;
-
-		break;
+		log = &db_log[select_db_queue(&digest)];
+		log->records++;
+		log->live++;
+		(*count)++;
+	}
 
-	default:
+	if (hrc == HANDLEMAP_SUCCESS && rc != SQLITE_DONE) {
 		LogCrit(COMPONENT_FSAL,
-			"ERROR in dbop push: Invalid operation type %d",
-			p_op->op_type);
+			"ERROR: could not read handle map database %s: %s",
+			path, sqlite3_errmsg(conn));
+		hrc = HANDLEMAP_DB_ERROR;
 	}
 
-	/* there now some work available */
-	pthread_cond_signal(&p_queue->work_avail_condition);
-
-	PTHREAD_MUTEX_unlock(&p_queue->queues_mutex);
-
-	return HANDLEMAP_SUCCESS;
+	sqlite3_finalize(stmt);
+	sqlite3_close(conn);
 
+	return hrc;
+#else
+	LogCrit(COMPONENT_FSAL,
+		"ERROR: %s holds the handle map of an earlier version, which this build cannot import without sqlite3",
+		path);
+	return HANDLEMAP_DB_ERROR;
+#endif
 }
 
-static void *database_worker_thread(void *arg)
+/**
+ * @brief Import the SQLite databases of earlier versions, once
+ *
+ * Once the logs they were imported to are synced, each is renamed to
+ * OLD_DB_FILE_PREFIX.N.imported so it is not read again.  Start up
+ * fails while one cannot be imported, rather than serve stale handles.
+ */
+static int hdlmap_import(hash_table_t *target_hash)
 {
-	db_thread_info_t *p_info = (db_thread_info_t *) arg;
+	char path[MAXPATHLEN + 1];
+	char new_path[MAXPATHLEN + 1];
+	bool found[MAX_DB];
+	bool any = false;
+	uint64_t count = 0;
+	unsigned int i;
 	int rc;
-	db_op_item_t *to_be_done = NULL;
-	char thread_name[256];
 
-	/* initialize logging */
-	snprintf(thread_name, 256, "DB thread #%u", p_info->thr_index);
-	SetNameFunction(thread_name);
-
-	/* initialize memory management */
+	for (i = 0; i < MAX_DB; i++) {
+		snprintf(path, MAXPATHLEN, "%s/%s.%u", dbmap_dir,
+			 OLD_DB_FILE_PREFIX, i);
+		found[i] = access(path, F_OK) == 0;
+		if (!found[i])
+			continue;
 
-	rc = init_database_access(p_info);
-
-	if (rc != HANDLEMAP_SUCCESS) {
-		/* Failed init */
-		LogCrit(COMPONENT_FSAL,
-			"ERROR: Database initialization error %d", rc);
-		exit(rc);
+		any = true;
+		rc = hdlmap_import_db(target_hash, path, &count);
+		if (rc != HANDLEMAP_SUCCESS)
+			return rc;
 	}
 
-	/* main loop */
-	while (1) {
-
-		/* Is "work done" or "work available" condition verified ? */
-
-		PTHREAD_MUTEX_lock(&p_info->work_queue.queues_mutex);
-
-		/* nothing to be done ? */
-		while (p_info->work_queue.highprio_first == NULL
-		       && p_info->work_queue.lowprio_first == NULL) {
-			to_be_done = NULL;
-			p_info->work_queue.status = IDLE;
-			pthread_cond_signal(
-				&p_info->work_queue.work_done_condition);
-
-			/* if termination is requested, exit */
-			if (do_terminate) {
-				p_info->work_queue.status = FINISHED;
-				PTHREAD_MUTEX_unlock(&p_info->work_queue
-								.queues_mutex);
-				return (void *)p_info;
-			}
-
-			/* else, wait for something to do */
-			pthread_cond_wait(
-				&p_info->work_queue.work_avail_condition,
-				&p_info->work_queue.queues_mutex);
-
-		}
+	if (!any)
+		return HANDLEMAP_SUCCESS;
 
-		/* there is something to do:
-		 * first check the highest priority list,
-		 * then the lower priority.
-		 */
-
-		if (p_info->work_queue.highprio_first != NULL) {
-			/* take the next item in the list */
-			to_be_done = p_info->work_queue.highprio_first;
-			p_info->work_queue.highprio_first = to_be_done->p_next;
-
-			/* still any entries in the list ? */
-			if (p_info->work_queue.highprio_first == NULL)
-				p_info->work_queue.highprio_last = NULL;
-			/* it it the last entry ? */
-			else if (p_info->work_queue.highprio_first->p_next ==
-				 NULL)
-				p_info->work_queue.highprio_last =
-				    p_info->work_queue.highprio_first;
-
-			/* something to do */
-			p_info->work_queue.status = WORKING;
-		} else if (p_info->work_queue.lowprio_first != NULL) {
-			/* take the next item in the list */
-			to_be_done = p_info->work_queue.lowprio_first;
-			p_info->work_queue.lowprio_first = to_be_done->p_next;
-
-			/* still any entries in the list ? */
-			if (p_info->work_queue.lowprio_first == NULL)
-				p_info->work_queue.lowprio_last = NULL;
-			/* it it the last entry ? */
-			else if (p_info->work_queue.lowprio_first->p_next ==
-				 NULL)
-				p_info->work_queue.lowprio_last =
-				    p_info->work_queue.lowprio_first;
-
-			/* something to do */
-			p_info->work_queue.status = WORKING;
-		}
-
-		p_info->work_queue.nb_waiting--;
-
-		PTHREAD_MUTEX_unlock(&p_info->work_queue.queues_mutex);
-
-		/* PROCESS THE REQUEST */
-
-		switch (to_be_done->op_type) {
-		case LOAD:
-			db_load_operation(p_info, to_be_done->op_arg.hash);
-			break;
-
-		case INSERT:
-			db_insert_operation(p_info,
-					    &to_be_done->op_arg.fh_info);
-			break;
+	rc = handlemap_db_flush();
+	if (rc != HANDLEMAP_SUCCESS)
+		return rc;
 
-		case DELETE:
-			db_delete_operation(
-				p_info,
-				&to_be_done->op_arg.fh_info.nfs23_digest);
-			break;
+	for (i = 0; i < MAX_DB; i++) {
+		if (!found[i])
+			continue;
 
-		default:
+		snprintf(path, MAXPATHLEN, "%s/%s.%u", dbmap_dir,
+			 OLD_DB_FILE_PREFIX, i);
+		snprintf(new_path, MAXPATHLEN, "%s.imported", path);
+		if (rename(path, new_path) != 0) {
 			LogCrit(COMPONENT_FSAL,
-				"ERROR: Invalid operation type %d",
-				to_be_done->op_type);
+				"ERROR: could not rename imported handle map database %s: %s",
+				path, strerror(errno));
+			return HANDLEMAP_SYSTEM_ERROR;
 		}
+	}
 
-		/* free the db operation item */
-		PTHREAD_MUTEX_lock(&p_info->pool_mutex);
-		pool_free(p_info->dbop_pool, to_be_done);
-		PTHREAD_MUTEX_unlock(&p_info->pool_mutex);
-
-	}			/* loop forever */
+	LogEvent(COMPONENT_FSAL,
+		 "Imported %" PRIu64
+		 " mappings from the handle map databases of an earlier version",
+		 count);
 
-	return (void *)p_info;
+	return HANDLEMAP_SUCCESS;
 }
 
 /**
@@ -821,55 +895,55 @@ int handlemap_db_count(const char *dir)
 
 }				/* handlemap_db_count */
 
-unsigned int select_db_queue(const nfs23_map_handle_t *p_nfs23_digest)
-{
-	unsigned int h =
-	    ((p_nfs23_digest->object_id * 1049) ^ p_nfs23_digest->handle_hash) %
-	    2477;
-
-	h = h % nb_db_threads;
-
-	return h;
-}
-
 /**
  * Initialize databases access
- * - init DB queues
- * - start threads
- * - establish DB connections
- * - create db schema if it was empty
+ * - open or create the logs
+ * - start the threads writing them
+ *
+ * tmp_dir is not used anymore, logs are compacted next to themselves.
  */
 int handlemap_db_init(const char *db_dir, const char *tmp_dir,
 		      unsigned int db_count, int synchronous_insert)
 {
+	char path[MAXPATHLEN + 1];
+	struct hdlmap_log *log;
 	unsigned int i;
 	int rc;
 
 	/* first, save the parameters */
 
 	strncpy(dbmap_dir, db_dir, MAXPATHLEN);
-	strncpy(db_tmpdir, tmp_dir, MAXPATHLEN);
 
 	if (db_count > MAX_DB)
 		return HANDLEMAP_INVALID_PARAM;
 
 	nb_db_threads = db_count;
 	synchronous = synchronous_insert;
-	/* set global database engine info */
-
-	sqlite3_temp_directory = db_tmpdir;
 
-	/* initialize structures for each thread and launch it */
+	/* open each log and launch its thread */
 
 	for (i = 0; i < nb_db_threads; i++) {
-		rc = init_db_thread_info(&db_thread[i], 100);
-		if (rc)
-			return rc;
+		log = &db_log[i];
+		memset(log, 0, sizeof(*log));
+		log->index = i;
+		log->compact_fd = -1;
+
+		hdlmap_log_path(path, i, "");
+		log->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0600);
+		if (log->fd < 0) {
+			LogCrit(COMPONENT_FSAL,
+				"ERROR: could not open handle map log %s: %s",
+				path, strerror(errno));
+			return HANDLEMAP_SYSTEM_ERROR;
+		}
 
-		db_thread[i].thr_index = i;
+		PTHREAD_MUTEX_init(&log->mtx, NULL);
+		PTHREAD_COND_init(&log->work_cond, NULL);
+		PTHREAD_COND_init(&log->done_cond, NULL);
+		log->buf = gsh_malloc(HDLMAP_BUF_SIZE);
+		log->spare = gsh_malloc(HDLMAP_BUF_SIZE);
 
-		rc = pthread_create(&db_thread[i].thr_id, NULL,
-				    database_worker_thread, &db_thread[i]);
+		rc = pthread_create(&log->thr_id, NULL, hdlmap_log_writer, log);
 		if (rc)
 			return HANDLEMAP_SYSTEM_ERROR;
 	}
@@ -878,143 +952,68 @@ int handlemap_db_init(const char *db_dir, const char *tmp_dir,
 	return HANDLEMAP_SUCCESS;
 }
 
-/* wait that a thread has done all its jobs */
-static void wait_thread_jobs_finished(db_thread_info_t *p_thr_info)
-{
-
-	PTHREAD_MUTEX_lock(&p_thr_info->work_queue.queues_mutex);
-
-	/* wait until the thread has no more tasks in its queue
-	 * and it is no more working
-	 */
-	while (p_thr_info->work_queue.highprio_first != NULL
-	       || p_thr_info->work_queue.lowprio_first != NULL
-	       || p_thr_info->work_queue.status == WORKING)
-		pthread_cond_wait(&p_thr_info->work_queue.work_done_condition,
-				  &p_thr_info->work_queue.queues_mutex);
-
-	PTHREAD_MUTEX_unlock(&p_thr_info->work_queue.queues_mutex);
-
-}
-
 /**
- * Gives the order to each DB thread to reload
- * the content of its database and insert it
- * to the hash table.
- * The function blocks until all threads have loaded their data.
+ * Reload the content of all the logs to the hash table, one thread
+ * per log, then compact those that need it.
+ * The function blocks until all logs are loaded.
  */
 int handlemap_db_reaload_all(hash_table_t *target_hash)
 {
+	pthread_t loaders[MAX_DB];
+	bool started[MAX_DB];
 	unsigned int i;
-	db_op_item_t *new_task;
 	int rc;
 
-	/* give the job to all threads */
-	for (i = 0; i < nb_db_threads; i++) {
-		/* get a new db operation  */
-		PTHREAD_MUTEX_lock(&db_thread[i].pool_mutex);
-
-		new_task = pool_alloc(db_thread[i].dbop_pool);
+	load_hash = target_hash;
 
-		PTHREAD_MUTEX_unlock(&db_thread[i].pool_mutex);
-
-		/* can you fill it ? */
-		new_task->op_type = LOAD;
-		new_task->op_arg.hash = target_hash;
+	for (i = 0; i < nb_db_threads; i++) {
+		started[i] = pthread_create(&loaders[i], NULL,
+					    hdlmap_log_loader,
+					    &db_log[i]) == 0;
+		if (!started[i])
+			db_log[i].load_rc = HANDLEMAP_SYSTEM_ERROR;
+	}
 
-		rc = dbop_push(&db_thread[i].work_queue, new_task);
+	rc = HANDLEMAP_SUCCESS;
 
-		if (rc)
-			return rc;
+	for (i = 0; i < nb_db_threads; i++) {
+		if (started[i])
+			pthread_join(loaders[i], NULL);
+		if (db_log[i].load_rc != HANDLEMAP_SUCCESS)
+			rc = db_log[i].load_rc;
 	}
 
-	/* wait for all threads to finish their job */
+	if (rc == HANDLEMAP_SUCCESS)
+		rc = hdlmap_import(target_hash);
 
-	for (i = 0; i < nb_db_threads; i++)
-		wait_thread_jobs_finished(&db_thread[i]);
+	if (rc == HANDLEMAP_SUCCESS)
+		hdlmap_compact(target_hash);
 
-	return HANDLEMAP_SUCCESS;
+	return rc;
 
 }				/* handlemap_db_reaload_all */
 
 /**
- * Submit a db 'insert' request.
- * The request is inserted in the appropriate db queue.
+ * Log a mapping insert.
  */
 int handlemap_db_insert(nfs23_map_handle_t *p_in_nfs23_digest,
 			const void *data, uint32_t len)
 {
-	unsigned int i;
-	db_op_item_t *new_task;
-	int rc;
-
-	if (!synchronous) {
-		/* which thread is going to handle this inode ? */
-
-		i = select_db_queue(p_in_nfs23_digest);
-
-		/* get a new db operation  */
-		PTHREAD_MUTEX_lock(&db_thread[i].pool_mutex);
-
-		new_task = pool_alloc(db_thread[i].dbop_pool);
-
-		PTHREAD_MUTEX_unlock(&db_thread[i].pool_mutex);
-
-		/* fill the task info */
-		new_task->op_type = INSERT;
-		new_task->op_arg.fh_info.nfs23_digest = *p_in_nfs23_digest;
-		memcpy(new_task->op_arg.fh_info.fh4_data, data, len);
-		new_task->op_arg.fh_info.fh4_len = len;
-
-		rc = dbop_push(&db_thread[i].work_queue, new_task);
-
-		if (rc)
-			return rc;
-	}
-	/* else: @todo not supported yet */
-
-	return HANDLEMAP_SUCCESS;
-
+	return hdlmap_log_append(HDLMAP_REC_INSERT, p_in_nfs23_digest, data,
+				 len);
 }
 
 /**
- * Submit a db 'delete' request.
- * The request is inserted in the appropriate db queue.
- * (always asynchronous)
+ * Log a mapping delete (always asynchronous).
  */
 int handlemap_db_delete(nfs23_map_handle_t *p_in_nfs23_digest)
 {
-	unsigned int i;
-	db_op_item_t *new_task;
-	int rc;
-
-	/* which thread is going to handle this inode ? */
-
-	i = select_db_queue(p_in_nfs23_digest);
-
-	/* get a new db operation  */
-	PTHREAD_MUTEX_lock(&db_thread[i].pool_mutex);
-
-	new_task = pool_alloc(db_thread[i].dbop_pool);
-
-	PTHREAD_MUTEX_unlock(&db_thread[i].pool_mutex);
-
-	/* fill the task info */
-	new_task->op_type = DELETE;
-	new_task->op_arg.fh_info.nfs23_digest = *p_in_nfs23_digest;
-
-	rc = dbop_push(&db_thread[i].work_queue, new_task);
-
-	if (rc)
-		return rc;
-
-	return HANDLEMAP_SUCCESS;
-
+	return hdlmap_log_append(HDLMAP_REC_DELETE, p_in_nfs23_digest, NULL,
+				 0);
 }
 
 /**
- * Wait for all queues to be empty
- * and all current DB request to be done.
+ * Wait for all logged operations to be written and on disk.
  */
 int handlemap_db_flush(void)
 {
@@ -1022,21 +1021,40 @@ int handlemap_db_flush(void)
 	struct timeval t1;
 	struct timeval t2;
 	struct timeval tdiff;
-	unsigned int to_sync = 0;
+	uint64_t to_sync = 0;
+	struct hdlmap_log *log;
+	int rc = HANDLEMAP_SUCCESS;
 
-	for (i = 0; i < nb_db_threads; i++)
-		to_sync += db_thread[i].work_queue.nb_waiting;
+	for (i = 0; i < nb_db_threads; i++) {
+		log = &db_log[i];
+		PTHREAD_MUTEX_lock(&log->mtx);
+		to_sync += log->appended - log->written;
+		PTHREAD_MUTEX_unlock(&log->mtx);
+	}
 
 	LogEvent(COMPONENT_FSAL,
-		 "Waiting for database synchronization (%u operations pending)",
-		 to_sync);
+		 "Waiting for database synchronization (%" PRIu64
+		 " operations pending)", to_sync);
 
 	gettimeofday(&t1, NULL);
 
 	/* wait for all threads to finish their job */
 
-	for (i = 0; i < nb_db_threads; i++)
-		wait_thread_jobs_finished(&db_thread[i]);
+	for (i = 0; i < nb_db_threads; i++) {
+		log = &db_log[i];
+		PTHREAD_MUTEX_lock(&log->mtx);
+		while (log->len != 0 || log->writing)
+			pthread_cond_wait(&log->done_cond, &log->mtx);
+		if (log->rc != 0) {
+			rc = HANDLEMAP_SYSTEM_ERROR;
+		} else if (fdatasync(log->fd) != 0) {
+			LogCrit(COMPONENT_FSAL,
+				"ERROR: could not sync handle map log %u: %s",
+				i, strerror(errno));
+			rc = HANDLEMAP_SYSTEM_ERROR;
+		}
+		PTHREAD_MUTEX_unlock(&log->mtx);
+	}
 
 	gettimeofday(&t2, NULL);
 
@@ -1045,6 +1063,6 @@ int handlemap_db_flush(void)
 	LogEvent(COMPONENT_FSAL, "Database synchronized in %d.%06ds",
 		 (int)tdiff.tv_sec, (int)tdiff.tv_usec);
 
-	return HANDLEMAP_SUCCESS;
+	return rc;
 
 }
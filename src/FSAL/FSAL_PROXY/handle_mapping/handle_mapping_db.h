@@ -4,13 +4,9 @@
 #include "handle_mapping.h"
 #include "hashtable.h"
 
-#define DB_FILE_PREFIX "handlemap.sqlite"
-
-/* Database definition */
-#define MAP_TABLE      "HandleMap"
-#define OBJID_FIELD    "ObjectId"
-#define HASH_FIELD     "HandleHash"
-#define HANDLE_FIELD   "FSALHandle"
+#define DB_FILE_PREFIX "handlemap.log"
+/* SQLite databases of earlier versions, imported at start up */
+#define OLD_DB_FILE_PREFIX "handlemap.sqlite"
 
 #define MAX_DB  32
 
@@ -23,37 +19,35 @@ int handlemap_db_count(const char *dir);
 
 /**
  * Initialize databases access
- * (init DB queues, start threads, establish DB connections,
- * and create db schema if it was empty).
+ * (open or create the append-only logs and start the threads
+ * writing them).
  */
 int handlemap_db_init(const char *db_dir, const char *tmp_dir,
 		      unsigned int db_count, int synchronous_insert);
 
 /**
- * Gives the order to each DB thread to reload
- * the content of its database and insert it
- * to the hash table.
- * The function blocks until all threads have loaded their data.
+ * Reload the content of each log to the hash table, all logs at once,
+ * and compact those mostly made of deleted mappings.
+ * The function blocks until all logs are loaded.
  */
 int handlemap_db_reaload_all(hash_table_t *target_hash);
 
 /**
- * Submit a db 'insert' request.
- * The request is inserted in the appropriate db queue.
+ * Log a mapping insert.
+ * The record is buffered for the appropriate log's thread, which
+ * writes it unless inserts are synchronous.
  */
 int handlemap_db_insert(nfs23_map_handle_t *p_in_nfs23_digest,
 			const void *data, uint32_t len);
 
 /**
- * Submit a db 'delete' request.
- * The request is inserted in the appropriate db queue.
+ * Log a mapping delete.
  * (always asynchronous)
  */
 int handlemap_db_delete(nfs23_map_handle_t *p_in_nfs23_digest);
 
 /**
- * Wait for all queues to be empty
- * and all current DB request to be done.
+ * Wait for all logged operations to be written and synced.
  */
 int handlemap_db_flush(void);
 
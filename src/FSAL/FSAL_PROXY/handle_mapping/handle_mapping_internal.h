@@ -3,10 +3,18 @@
 #define _HANDLE_MAPPING_INTERNAL_H
 
 #include "hashtable.h"
+#include "handle_mapping.h"
 
 int handle_mapping_hash_add(hash_table_t *p_hash, uint64_t object_id,
 			    unsigned int handle_hash, const void *data,
 			    uint32_t datalen);
+int handle_mapping_hash_del(hash_table_t *p_hash, uint64_t object_id,
+			    unsigned int handle_hash);
+void handle_mapping_hash_walk(hash_table_t *p_hash,
+			      void (*cb)(const nfs23_map_handle_t *digest,
+					 const void *data, uint32_t datalen,
+					 void *arg),
+			      void *arg);
 int snprintmem(char *target, size_t tgt_size, const void *source,
 	       size_t mem_size);
 int sscanmem(void *target, size_t tgt_size, const char *str_source);
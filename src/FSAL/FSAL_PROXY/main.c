@@ -35,6 +35,12 @@
 
 #include "fsal.h"
 #include "FSAL/fsal_init.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#include "nfs_core.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
 #include "pxy_fsal_methods.h"
 
 #define PROXY_SUPPORTED_ATTRS ((const attrmask_t) (ATTRS_POSIX))
@@ -128,6 +134,109 @@ static fsal_status_t pxy_init_config(struct fsal_module *fsal_hdl,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+static struct fsal_op_stats pxy_op_stats[PXY_STAT_OPS];
+
+static struct fsal_stats pxy_stats = {
+	.total_ops = PXY_STAT_OPS,
+	.op_stats = pxy_op_stats
+};
+
+static const char *pxy_stat_names[PXY_STAT_OPS] = {
+	[PXY_STAT_COMPOUND] = "COMPOUND",
+	[PXY_STAT_LOOKUP_SAVED] = "LOOKUP_ROUNDTRIPS_SAVED",
+	[PXY_STAT_READDIR_SAVED] = "READDIR_LOOKUPS_SAVED",
+};
+
+/**
+ * @brief Account a call to the remote server that began at start
+ */
+void pxy_stat_record(enum pxy_stat_op op, const struct timespec *start)
+{
+	struct fsal_op_stats *st = &pxy_op_stats[op];
+	struct timespec stop;
+	nsecs_elapsed_t resp_time;
+
+	now(&stop);
+	resp_time = timespec_diff(start, &stop);
+
+	(void)atomic_inc_uint64_t(&st->num_ops);
+	(void)atomic_add_uint64_t(&st->resp_time, resp_time);
+	if (st->resp_time_max < resp_time)
+		st->resp_time_max = resp_time;
+	if (st->resp_time_min == 0 || st->resp_time_min > resp_time)
+		st->resp_time_min = resp_time;
+}
+
+/**
+ * @brief Account round trips that were not needed
+ */
+void pxy_stat_saved(enum pxy_stat_op op, uint64_t count)
+{
+	if (nfs_param.core_param.enable_FSALSTATS)
+		(void)atomic_add_uint64_t(&pxy_op_stats[op].num_ops, count);
+}
+
+#ifdef USE_DBUS
+static void pxy_extract_stats(struct fsal_module *fsal_hdl, void *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter struct_iter;
+	DBusMessageIter *iter1 = (DBusMessageIter *)iter;
+	char *message;
+	uint64_t total_ops, total_resp, min_resp, max_resp;
+	double res;
+	int i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	message = "PROXY";
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &message);
+
+	dbus_message_iter_open_container(iter1, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	for (i = 0; i < PXY_STAT_OPS; i++) {
+		total_ops = atomic_fetch_uint64_t(&pxy_op_stats[i].num_ops);
+		total_resp = atomic_fetch_uint64_t(&pxy_op_stats[i].resp_time);
+		min_resp = atomic_fetch_uint64_t(
+					&pxy_op_stats[i].resp_time_min);
+		max_resp = atomic_fetch_uint64_t(
+					&pxy_op_stats[i].resp_time_max);
+
+		/* The saved counters have no response times */
+		message = (char *)pxy_stat_names[i];
+		dbus_message_iter_append_basic(&struct_iter,
+			DBUS_TYPE_STRING, &message);
+		dbus_message_iter_append_basic(&struct_iter,
+			DBUS_TYPE_UINT64, &total_ops);
+		res = total_ops && total_resp ?
+			(double) total_resp * 0.000001 / total_ops : 0.0;
+		dbus_message_iter_append_basic(&struct_iter,
+			DBUS_TYPE_DOUBLE, &res);
+		res = (double) min_resp * 0.000001;
+		dbus_message_iter_append_basic(&struct_iter,
+			DBUS_TYPE_DOUBLE, &res);
+		res = (double) max_resp * 0.000001;
+		dbus_message_iter_append_basic(&struct_iter,
+			DBUS_TYPE_DOUBLE, &res);
+	}
+	dbus_message_iter_close_container(iter1, &struct_iter);
+	message = "OK";
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &message);
+}
+#endif
+
+static void pxy_reset_stats(struct fsal_module *fsal_hdl)
+{
+	int i;
+
+	for (i = 0; i < PXY_STAT_OPS; i++) {
+		atomic_store_uint64_t(&pxy_op_stats[i].num_ops, 0);
+		atomic_store_uint64_t(&pxy_op_stats[i].resp_time, 0);
+		atomic_store_uint64_t(&pxy_op_stats[i].resp_time_min, 0);
+		atomic_store_uint64_t(&pxy_op_stats[i].resp_time_max, 0);
+	}
+}
+
 MODULE_INIT void pxy_init(void)
 {
 	if (register_fsal(&PROXY.module, "PROXY", FSAL_MAJOR_VERSION,
@@ -135,6 +244,11 @@ MODULE_INIT void pxy_init(void)
 		return;
 	PROXY.module.m_ops.init_config = pxy_init_config;
 	PROXY.module.m_ops.create_export = pxy_create_export;
+#ifdef USE_DBUS
+	PROXY.module.m_ops.fsal_extract_stats = pxy_extract_stats;
+#endif
+	PROXY.module.m_ops.fsal_reset_stats = pxy_reset_stats;
+	PROXY.module.stats = &pxy_stats;
 
 	/* Initialize the fsal_obj_handle ops for FSAL PROXY */
 	pxy_handle_ops_init(&PROXY.handle_ops);
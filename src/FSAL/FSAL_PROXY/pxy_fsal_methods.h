@@ -62,6 +62,12 @@ struct pxy_client_params {
 	unsigned int cred_lifetime;
 	unsigned int sec_type;
 	bool active_krb5;
+	uint32_t num_connections;
+	uint32_t session_slots;
+	uint32_t readahead_pages;
+	uint32_t data_cache_pages;
+	uint32_t data_cache_expiration;
+	bool write_behind;
 
 	/* initialization info for handle mapping */
 	bool enable_handle_mapping;
@@ -71,6 +77,27 @@ struct pxy_client_params {
 #endif
 };
 
+struct pxy_export;
+struct pxy_rpc_io_context;
+struct fridgethr;
+
+/**
+ * One TCP connection to the background server, with its own receive
+ * thread.  Slot i of the session sends on connection i % nconns.
+ */
+struct pxy_rpc_conn {
+	struct pxy_export *pxy_exp;
+	pthread_t recv_thread;
+	uint32_t idx;
+	/**
+	 * lock protects sock and the sockless condition, and keeps the
+	 * records written to sock whole.
+	 */
+	int sock;
+	pthread_mutex_t lock;
+	pthread_cond_t sockless;
+};
+
 struct pxy_export_rpc {
 /**
  * pxy_clientid_mutex protects pxy_clientid, pxy_client_seqid,
@@ -84,32 +111,51 @@ struct pxy_export_rpc {
 	pthread_mutex_t pxy_clientid_mutex;
 
 	char pxy_hostname[MAXNAMLEN + 1];
-	pthread_t pxy_recv_thread;
 	pthread_t pxy_renewer_thread;
 
+	struct pxy_rpc_conn *conns;
+	uint32_t nconns;
+
 	/**
-	 * listlock protects rpc_sock and rpc_xid values, sockless condition and
-	 * rpc_calls list.
+	 * The session slot table, indexed by slot id.  A reply finds its
+	 * call through the slot id carried in the low bits of its xid.
 	 */
-	struct glist_head rpc_calls;
-	int rpc_sock;
+	struct pxy_rpc_io_context **slots;
+	uint32_t nslots;
+	/** Bumped for each new session, to start the slots over */
+	uint32_t session_gen;
 	uint32_t rpc_xid;
-	pthread_mutex_t listlock;
-	pthread_cond_t sockless;
 	bool close_thread;
 
 	/*
-	 * context_lock protects free_contexts list and need_context condition.
+	 * context_lock protects free_contexts list, slots_granted and
+	 * need_context condition.
 	 */
 	struct glist_head free_contexts;
+	/** Slots the background server lets us use */
+	uint32_t slots_granted;
 	pthread_cond_t need_context;
 	pthread_mutex_t context_lock;
 };
 
+/**
+ * The read-ahead pages of all the files of an export.  lock protects
+ * lru and npages, and is taken after the lock of a file.
+ */
+struct pxy_data_cache {
+	pthread_mutex_t lock;
+	struct glist_head lru;
+	uint32_t npages;
+	uint32_t page_size;
+	/** Runs the read-ahead and write-behind RPCs */
+	struct fridgethr *io_fridge;
+};
+
 struct pxy_export {
 	struct fsal_export exp;
 	struct pxy_client_params info;
 	struct pxy_export_rpc rpc;
+	struct pxy_data_cache dc;
 };
 
 static inline void pxy_export_init(struct pxy_export *pxy_exp)
@@ -117,15 +163,23 @@ static inline void pxy_export_init(struct pxy_export *pxy_exp)
 	pxy_exp->rpc.no_sessionid = true;
 	pthread_mutex_init(&pxy_exp->rpc.pxy_clientid_mutex, NULL);
 	pthread_cond_init(&pxy_exp->rpc.cond_sessionid, NULL);
-	pxy_exp->rpc.rpc_sock = -1;
-	pthread_mutex_init(&pxy_exp->rpc.listlock, NULL);
-	pthread_cond_init(&pxy_exp->rpc.sockless, NULL);
 	pthread_cond_init(&pxy_exp->rpc.need_context, NULL);
 	pthread_mutex_init(&pxy_exp->rpc.context_lock, NULL);
 }
 
 void pxy_handle_ops_init(struct fsal_obj_ops *ops);
 
+/* Counters reported by GetFSALStats */
+enum pxy_stat_op {
+	PXY_STAT_COMPOUND,	/*< COMPOUNDs sent to the remote server */
+	PXY_STAT_LOOKUP_SAVED,	/*< Round trips saved by path walk batching */
+	PXY_STAT_READDIR_SAVED,	/*< LOOKUPs saved by READDIR filehandles */
+	PXY_STAT_OPS
+};
+
+void pxy_stat_record(enum pxy_stat_op op, const struct timespec *start);
+void pxy_stat_saved(enum pxy_stat_op op, uint64_t count);
+
 int pxy_init_rpc(struct pxy_export *);
 
 fsal_status_t pxy_list_ext_attrs(struct fsal_obj_handle *obj_hdl,
@@ -69,6 +69,7 @@ static void release(struct fsal_export *exp_hdl)
 	myself = container_of(exp_hdl, struct pseudofs_fsal_export, export);
 
 	if (myself->root_handle != NULL) {
+		pseudofs_handle_unindex(myself->root_handle);
 		fsal_obj_handle_fini(&myself->root_handle->obj_handle);
 
 		LogDebug(COMPONENT_FSAL,
@@ -77,6 +77,21 @@ pseudofs_i_cmpf(const struct avltree_node *lhs,
 	return 1;
 }
 
+static inline int
+pseudofs_h_cmpf(const struct avltree_node *lhs,
+		const struct avltree_node *rhs)
+{
+	struct pseudo_fsal_obj_handle *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct pseudo_fsal_obj_handle, avl_h);
+	rk = avltree_container_of(rhs, struct pseudo_fsal_obj_handle, avl_h);
+
+	/* The handle starts with the hash of the path, so this mostly
+	 * compares the first 8 bytes.
+	 */
+	return memcmp(lk->handle, rk->handle, V4_FH_OPAQUE_SIZE);
+}
+
 static inline struct avltree_node *
 avltree_inline_name_lookup(const struct avltree_node *key,
 			   const struct avltree *tree)
@@ -166,6 +181,55 @@ static int fullpath(struct display_buffer *pathbuf,
 	return b_left;
 }
 
+/**
+ * @brief Make a handle findable by pseudofs_create_handle
+ *
+ * A directory removed and made again has the same handle as its old
+ * self, which may not be released yet; the new one takes its place.
+ *
+ * @param[in] hdl  The handle
+ */
+static void pseudofs_handle_index(struct pseudo_fsal_obj_handle *hdl)
+{
+	struct avltree_node *node;
+	struct pseudo_fsal_obj_handle *old;
+
+	PTHREAD_RWLOCK_wrlock(&PSEUDOFS.module.lock);
+
+	node = avltree_insert(&hdl->avl_h, &PSEUDOFS.handles);
+	if (node != NULL) {
+		old = avltree_container_of(node, struct pseudo_fsal_obj_handle,
+					   avl_h);
+		avltree_replace(node, &hdl->avl_h, &PSEUDOFS.handles);
+		old->inhandles = false;
+	}
+	hdl->inhandles = true;
+
+	PTHREAD_RWLOCK_unlock(&PSEUDOFS.module.lock);
+}
+
+/**
+ * @brief Stop pseudofs_create_handle finding a handle about to be freed
+ *
+ * @param[in] hdl  The handle
+ */
+void pseudofs_handle_unindex(struct pseudo_fsal_obj_handle *hdl)
+{
+	PTHREAD_RWLOCK_wrlock(&PSEUDOFS.module.lock);
+
+	if (hdl->inhandles) {
+		avltree_remove(&hdl->avl_h, &PSEUDOFS.handles);
+		hdl->inhandles = false;
+	}
+
+	PTHREAD_RWLOCK_unlock(&PSEUDOFS.module.lock);
+}
+
+void pseudofs_handles_init(void)
+{
+	avltree_init(&PSEUDOFS.handles, pseudofs_h_cmpf, 0 /* flags */);
+}
+
 /* alloc_handle
  * allocate and fill in a handle
  */
@@ -267,6 +331,7 @@ static struct pseudo_fsal_obj_handle
 
 	fsal_obj_handle_init(&hdl->obj_handle, exp_hdl, DIRECTORY);
 	hdl->obj_handle.obj_ops = &PSEUDOFS.handle_ops;
+	pseudofs_handle_index(hdl);
 
 	avltree_init(&hdl->avl_name, pseudofs_n_cmpf, 0 /* flags */);
 	avltree_init(&hdl->avl_index, pseudofs_i_cmpf, 0 /* flags */);
@@ -446,6 +511,7 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 				  bool *eof)
 {
 	struct pseudo_fsal_obj_handle *myself, *hdl;
+	struct pseudo_fsal_obj_handle key[1];
 	struct avltree_node *node;
 	fsal_cookie_t seekloc;
 	struct attrlist attrs;
@@ -473,13 +539,20 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 	 */
 	op_ctx->fsal_private = dir_hdl;
 
-	for (node = avltree_first(&myself->avl_index);
+	/* Indexes only ever grow, so the cookie is where to resume even
+	 * if entries were removed since.
+	 */
+	key->index = MIN(seekloc, UINT32_MAX);
+
+	for (node = avltree_sup(&key->avl_i, &myself->avl_index);
 	     node != NULL;
 	     node = avltree_next(node)) {
 		hdl = avltree_container_of(node,
 					   struct pseudo_fsal_obj_handle,
 					   avl_i);
-		/* skip entries before seekloc */
+		/* avltree_sup() may land before seekloc if nothing is past
+		 * it
+		 */
 		if (hdl->index < seekloc)
 			continue;
 
@@ -665,6 +738,7 @@ static void release(struct fsal_obj_handle *obj_hdl)
 		return;
 	}
 
+	pseudofs_handle_unindex(myself);
 	fsal_obj_handle_fini(obj_hdl);
 
 	LogDebug(COMPONENT_FSAL,
@@ -754,8 +828,8 @@ fsal_status_t pseudofs_create_handle(struct fsal_export *exp_hdl,
 				   struct fsal_obj_handle **handle,
 				   struct attrlist *attrs_out)
 {
-	struct glist_head *glist;
-	struct fsal_obj_handle *hdl;
+	struct pseudo_fsal_obj_handle key[1];
+	struct avltree_node *node;
 	struct pseudo_fsal_obj_handle *my_hdl;
 
 	*handle = NULL;
@@ -769,39 +843,33 @@ fsal_status_t pseudofs_create_handle(struct fsal_export *exp_hdl,
 		return fsalstat(ERR_FSAL_BADHANDLE, 0);
 	}
 
-	PTHREAD_RWLOCK_rdlock(&exp_hdl->fsal->lock);
+	key->handle = hdl_desc->addr;
 
-	glist_for_each(glist, &exp_hdl->fsal->handles) {
-		hdl = glist_entry(glist, struct fsal_obj_handle, handles);
+	PTHREAD_RWLOCK_rdlock(&PSEUDOFS.module.lock);
 
-		my_hdl = container_of(hdl,
-				      struct pseudo_fsal_obj_handle,
-				      obj_handle);
+	node = avltree_lookup(&key->avl_h, &PSEUDOFS.handles);
+	if (node == NULL) {
+		PTHREAD_RWLOCK_unlock(&PSEUDOFS.module.lock);
 
-		if (memcmp(my_hdl->handle,
-			   hdl_desc->addr,
-			   V4_FH_OPAQUE_SIZE) == 0) {
-			LogDebug(COMPONENT_FSAL,
-				 "Found hdl=%p name=%s",
-				 my_hdl, my_hdl->name);
+		LogDebug(COMPONENT_FSAL,
+			"Could not find handle");
 
-			*handle = hdl;
+		return fsalstat(ERR_FSAL_STALE, ESTALE);
+	}
 
-			PTHREAD_RWLOCK_unlock(&exp_hdl->fsal->lock);
+	my_hdl = avltree_container_of(node, struct pseudo_fsal_obj_handle,
+				      avl_h);
 
-			if (attrs_out != NULL) {
-				fsal_copy_attrs(attrs_out, &my_hdl->attributes,
-						false);
-			}
+	LogDebug(COMPONENT_FSAL,
+		 "Found hdl=%p name=%s",
+		 my_hdl, my_hdl->name);
 
-			return fsalstat(ERR_FSAL_NO_ERROR, 0);
-		}
-	}
+	*handle = &my_hdl->obj_handle;
 
-	LogDebug(COMPONENT_FSAL,
-		"Could not find handle");
+	PTHREAD_RWLOCK_unlock(&PSEUDOFS.module.lock);
 
-	PTHREAD_RWLOCK_unlock(&exp_hdl->fsal->lock);
+	if (attrs_out != NULL)
+		fsal_copy_attrs(attrs_out, &my_hdl->attributes, false);
 
-	return fsalstat(ERR_FSAL_STALE, ESTALE);
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
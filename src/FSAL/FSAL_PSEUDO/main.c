@@ -126,6 +126,7 @@ void pseudo_fsal_init(void)
 
 	/* Initialize the fsal_obj_handle ops for FSAL PSEUDO */
 	pseudofs_handle_ops_init(&PSEUDOFS.handle_ops);
+	pseudofs_handles_init();
 
 	/* initialize our config */
 	init_config(myself);
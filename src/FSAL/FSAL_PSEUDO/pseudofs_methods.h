@@ -39,6 +39,8 @@ struct pseudo_fsal_obj_handle;
 struct pseudo_fsal_module {
 	struct fsal_module module;
 	struct fsal_obj_ops handle_ops;
+	/** Handles by wire handle, protected by module.lock */
+	struct avltree handles;
 };
 
 extern struct pseudo_fsal_module PSEUDOFS;
@@ -79,11 +81,13 @@ struct pseudo_fsal_obj_handle {
 	struct avltree avl_index;
 	struct avltree_node avl_n;
 	struct avltree_node avl_i;
+	struct avltree_node avl_h;
 	uint32_t index; /* index in parent */
 	uint32_t next_i; /* next child index */
 	uint32_t numlinks;
 	char *name;
 	bool inavl;
+	bool inhandles; /* in PSEUDOFS.handles */
 };
 
 static inline bool pseudofs_unopenable_type(object_file_type_t type)
@@ -97,6 +101,8 @@ static inline bool pseudofs_unopenable_type(object_file_type_t type)
 }
 
 void pseudofs_handle_ops_init(struct fsal_obj_ops *ops);
+void pseudofs_handles_init(void);
+void pseudofs_handle_unindex(struct pseudo_fsal_obj_handle *hdl);
 
 /* Internal PSEUDOFS method linkage to export object
  */
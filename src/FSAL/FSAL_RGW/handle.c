@@ -35,6 +35,681 @@
 #include "internal.h"
 #include "nfs_exports.h"
 #include "FSAL/fsal_commonlib.h"
+#include "nfs_core.h"
+
+/*
+ * Staged writes and read-ahead
+ *
+ * librgw turns a run of rgw_write calls on an object into one upload,
+ * so what limits it is how much each call carries.  With a
+ * Write_Stage_Size, UNSTABLE writes that carry on where the last one
+ * stopped are copied into a part of that size and answered at once.
+ * Full parts are sent by one upload job at a time per object, in
+ * order, on the RGW I/O threads, while the client fills the next.
+ * Write_Stage_Depth parts may be queued before a writer waits.  Stable
+ * writes, writes elsewhere in the object, COMMIT, CLOSE and truncates
+ * send whatever is staged first, and report the first part that
+ * failed.
+ *
+ * A sequential reader gets a window of Readahead_Size read by
+ * Readahead_Ranges ranged reads in parallel.  A read waits only for
+ * the ranges it covers.  Any write to the object drops the window.
+ */
+
+#define RGW_RA_SEQUENTIAL 2
+
+struct rgw_io_part {
+	struct glist_head q;
+	uint64_t offset;
+	size_t len;
+	uint32_t flags;
+	char *buf;
+};
+
+struct rgw_ra_job {
+	struct rgw_handle *handle;
+	struct rgw_ra_range *range;
+	uint64_t offset;
+	char *buf;
+};
+
+static inline bool rgw_stage_enabled(struct rgw_export *export)
+{
+	return export->write_stage_size != 0 && RGWFSM.io_fridge != NULL;
+}
+
+static inline bool rgw_ra_enabled(struct rgw_export *export)
+{
+	return export->readahead_size != 0 && RGWFSM.io_fridge != NULL;
+}
+
+static inline bool rgw_io_pending(struct rgw_io_cache *io)
+{
+	return io->stage_len != 0 || io->nparts != 0;
+}
+
+/* called with io->lock and io->uploading set, sends the queued parts */
+static void rgw_wb_upload(struct rgw_handle *handle)
+{
+	struct rgw_io_cache *io = &handle->io;
+
+	while (!glist_empty(&io->parts)) {
+		struct rgw_io_part *part =
+		    glist_first_entry(&io->parts, struct rgw_io_part, q);
+		size_t nb_write = 0;
+		int rc;
+
+		PTHREAD_MUTEX_unlock(&io->lock);
+		rc = rgw_write(handle->export->rgw_fs, handle->rgw_fh,
+			       part->offset, part->len, &nb_write, part->buf,
+			       part->flags);
+		if (rc == 0 && nb_write != part->len)
+			rc = -EIO;
+		PTHREAD_MUTEX_lock(&io->lock);
+
+		if (rc < 0) {
+			LogDebug(COMPONENT_FSAL,
+				 "Staged write at %"PRIu64" failed: %d",
+				 part->offset, rc);
+			if (io->write_error == 0)
+				io->write_error = rc;
+		}
+
+		glist_del(&part->q);
+		io->nparts--;
+		gsh_free(part->buf);
+		gsh_free(part);
+		pthread_cond_broadcast(&io->io_done);
+	}
+
+	io->uploading = false;
+	pthread_cond_broadcast(&io->io_done);
+}
+
+static void rgw_wb_run(struct fridgethr_context *ctx)
+{
+	struct rgw_handle *handle = ctx->arg;
+
+	PTHREAD_MUTEX_lock(&handle->io.lock);
+	rgw_wb_upload(handle);
+	PTHREAD_MUTEX_unlock(&handle->io.lock);
+}
+
+/* called with io->lock, hands the part being filled to the uploader */
+static void rgw_stage_queue(struct rgw_handle *handle)
+{
+	struct rgw_io_cache *io = &handle->io;
+	struct rgw_io_part *part;
+
+	if (io->stage_len == 0)
+		return;
+
+	part = gsh_malloc(sizeof(*part));
+	part->offset = io->stage_offset;
+	part->len = io->stage_len;
+	part->flags = io->stage_flags;
+	part->buf = io->stage;
+	glist_add_tail(&io->parts, &part->q);
+	io->nparts++;
+
+	io->stage = NULL;
+	io->stage_len = 0;
+
+	if (io->uploading)
+		return;
+
+	io->uploading = true;
+	if (fridgethr_submit(RGWFSM.io_fridge, rgw_wb_run, handle) != 0) {
+		/* Send it ourselves then */
+		rgw_wb_upload(handle);
+	}
+}
+
+/* called with io->lock, sends everything staged and waits for it */
+static void rgw_io_flush(struct rgw_handle *handle)
+{
+	struct rgw_io_cache *io = &handle->io;
+
+	rgw_stage_queue(handle);
+	while (io->uploading || io->nparts != 0)
+		pthread_cond_wait(&io->io_done, &io->lock);
+}
+
+/* called with io->lock, waits out and frees the read-ahead window */
+static void rgw_ra_drop(struct rgw_io_cache *io)
+{
+	while (io->ra_filling != 0)
+		pthread_cond_wait(&io->io_done, &io->lock);
+
+	gsh_free(io->ra_buf);
+	gsh_free(io->ranges);
+	io->ra_buf = NULL;
+	io->ranges = NULL;
+	io->nranges = 0;
+}
+
+/**
+ * @brief Send staged writes of an object and forget what was read ahead
+ *
+ * @param[in] handle  Object to drain
+ *
+ * @return 0, or the error of the first staged write that failed since
+ *         the last time one was reported.
+ */
+static int rgw_io_drain(struct rgw_handle *handle)
+{
+	struct rgw_io_cache *io = &handle->io;
+	int rc;
+
+	PTHREAD_MUTEX_lock(&io->lock);
+	rgw_io_flush(handle);
+	if (io->ra_buf != NULL)
+		rgw_ra_drop(io);
+	rc = io->write_error;
+	io->write_error = 0;
+	PTHREAD_MUTEX_unlock(&io->lock);
+
+	return rc;
+}
+
+/*
+ * Listing cursors
+ *
+ * librgw lists a bucket onwards from the name given as whence, so each
+ * chunk MDCACHE fills used to start a listing of its own.  With a
+ * Readdir_Page_Size, a directory keeps a cursor instead: a page of
+ * names listed past the last one handed out, and the page after it,
+ * which the I/O threads list while the current one is handed out.  A
+ * readdir resuming where the cursor stopped is fed from it.  A change
+ * to the directory through this server, reaching the end, or
+ * RGW_RD_CURSOR_IDLE seconds without use drops the cursor.
+ */
+
+#define RGW_RD_CURSOR_IDLE 30
+
+struct rgw_dir_ent {
+	char *name;
+	uint64_t offset;
+	uint32_t flags;
+};
+
+struct rgw_dir_page {
+	struct rgw_dir_ent *ents;
+	uint32_t count;
+	int rc;
+	bool eof;
+};
+
+struct rgw_dir_cursor {
+	char *resume;			/*< Last name handed out, or NULL */
+	struct rgw_dir_page cur;	/*< Names following resume */
+	uint32_t next;			/*< First of cur not handed out */
+	struct rgw_dir_page ahead;	/*< Names following cur */
+	bool ahead_ready;
+	bool fetching;			/*< ahead is being listed */
+	bool busy;			/*< A readdir is walking the cursor */
+	bool stale;			/*< Drop once nobody uses it */
+	uint32_t page_size;
+	time_t used;
+};
+
+struct rgw_rd_fill {
+	struct rgw_dir_page *page;
+	uint32_t max;
+};
+
+static void rgw_rd_free_page(struct rgw_dir_page *page)
+{
+	uint32_t i;
+
+	for (i = 0; i < page->count; i++)
+		gsh_free(page->ents[i].name);
+	gsh_free(page->ents);
+	memset(page, 0, sizeof(*page));
+}
+
+/* called with io->lock, frees the cursor */
+static void rgw_rd_free(struct rgw_io_cache *io)
+{
+	struct rgw_dir_cursor *cursor = io->cursor;
+
+	io->cursor = NULL;
+	rgw_rd_free_page(&cursor->cur);
+	rgw_rd_free_page(&cursor->ahead);
+	gsh_free(cursor->resume);
+	gsh_free(cursor);
+}
+
+/* called with io->lock, drops the cursor now or once it is let go */
+static void rgw_rd_drop(struct rgw_io_cache *io)
+{
+	if (io->cursor == NULL)
+		return;
+
+	if (io->cursor->busy || io->cursor->fetching)
+		io->cursor->stale = true;
+	else
+		rgw_rd_free(io);
+}
+
+/**
+ * @brief Forget the listing cursor of a directory that changed
+ *
+ * @param[in] dir  Directory
+ */
+static void rgw_rd_forget(struct rgw_handle *dir)
+{
+	PTHREAD_MUTEX_lock(&dir->io.lock);
+	rgw_rd_drop(&dir->io);
+	PTHREAD_MUTEX_unlock(&dir->io.lock);
+}
+
+static bool rgw_rd_collect(const char *name, void *arg, uint64_t offset,
+			   uint32_t flags)
+{
+	struct rgw_rd_fill *fill = arg;
+	struct rgw_dir_ent *ent = &fill->page->ents[fill->page->count++];
+
+	ent->name = gsh_strdup(name);
+	ent->offset = offset;
+	ent->flags = flags;
+
+	return fill->page->count < fill->max;
+}
+
+/* lists up to page_size names following from into page */
+static void rgw_rd_list(struct rgw_handle *dir, const char *from,
+			struct rgw_dir_page *page, uint32_t page_size)
+{
+	struct rgw_rd_fill fill = { page, page_size };
+	struct timespec start_time;
+	bool eof = false;
+
+	page->ents = gsh_calloc(page_size, sizeof(*page->ents));
+	page->count = 0;
+
+	if (nfs_param.core_param.enable_FSALSTATS)
+		now(&start_time);
+
+	page->rc = rgw_readdir2(dir->export->rgw_fs, dir->rgw_fh, from,
+				rgw_rd_collect, &fill, &eof,
+				RGW_READDIR_FLAG_NONE);
+
+	if (nfs_param.core_param.enable_FSALSTATS)
+		rgw_stat_record(RGW_STAT_LISTING, &start_time);
+
+	/* An empty page that is not the end would have us loop */
+	page->eof = eof || page->count == 0;
+}
+
+static void rgw_rd_fetch(struct fridgethr_context *ctx)
+{
+	struct rgw_handle *dir = ctx->arg;
+	struct rgw_io_cache *io = &dir->io;
+	struct rgw_dir_cursor *cursor;
+	struct rgw_dir_page page;
+
+	/* The walker leaves cur alone while we are fetching */
+	PTHREAD_MUTEX_lock(&io->lock);
+	cursor = io->cursor;
+	PTHREAD_MUTEX_unlock(&io->lock);
+
+	memset(&page, 0, sizeof(page));
+	rgw_rd_list(dir, cursor->cur.ents[cursor->cur.count - 1].name, &page,
+		    cursor->page_size);
+
+	PTHREAD_MUTEX_lock(&io->lock);
+	cursor->ahead = page;
+	cursor->ahead_ready = true;
+	cursor->fetching = false;
+	if (cursor->stale && !cursor->busy)
+		rgw_rd_free(io);
+	pthread_cond_broadcast(&io->io_done);
+	PTHREAD_MUTEX_unlock(&io->lock);
+}
+
+/* called with io->lock, starts listing the page after cur */
+static void rgw_rd_prefetch(struct rgw_handle *dir)
+{
+	struct rgw_dir_cursor *cursor = dir->io.cursor;
+
+	if (cursor->cur.eof || cursor->fetching || cursor->ahead_ready ||
+	    RGWFSM.io_fridge == NULL)
+		return;
+
+	cursor->fetching = true;
+	if (fridgethr_submit(RGWFSM.io_fridge, rgw_rd_fetch, dir) != 0)
+		cursor->fetching = false;
+}
+
+static bool rgw_rd_resumes(struct rgw_dir_cursor *cursor, const char *whence)
+{
+	if (whence == NULL || cursor->resume == NULL)
+		return whence == cursor->resume;
+
+	return strcmp(whence, cursor->resume) == 0;
+}
+
+static void rgw_io_release(struct rgw_handle *handle)
+{
+	int rc = rgw_io_drain(handle);
+
+	if (rc < 0)
+		LogWarn(COMPONENT_FSAL,
+			"Staged write of released object %p lost: %d",
+			handle, rc);
+
+	PTHREAD_MUTEX_lock(&handle->io.lock);
+	while (handle->io.cursor != NULL && handle->io.cursor->fetching)
+		pthread_cond_wait(&handle->io.io_done, &handle->io.lock);
+	if (handle->io.cursor != NULL)
+		rgw_rd_free(&handle->io);
+	PTHREAD_MUTEX_unlock(&handle->io.lock);
+}
+
+/**
+ * @brief Stage a write
+ *
+ * @param[in]     export  Export the write came through
+ * @param[in]     handle  Object written
+ * @param[in,out] arg     The write
+ * @param[out]    rc      Result, if the write was dealt with
+ *
+ * @return true if the write was staged or failed, false if it is to be
+ *         sent inline.
+ */
+static bool rgw_stage_write(struct rgw_export *export,
+			    struct rgw_handle *handle,
+			    struct fsal_io_arg *arg, int *rc)
+{
+	struct rgw_io_cache *io = &handle->io;
+	uint64_t offset = arg->offset;
+	int i;
+
+	PTHREAD_MUTEX_lock(&io->lock);
+
+	if (io->ra_buf != NULL)
+		rgw_ra_drop(io);
+
+	if (!rgw_stage_enabled(export) || arg->fsal_stable ||
+	    (rgw_io_pending(io) && offset != io->write_end)) {
+		/* Goes out inline, behind whatever was staged */
+		rgw_io_flush(handle);
+		*rc = io->write_error;
+		io->write_error = 0;
+		PTHREAD_MUTEX_unlock(&io->lock);
+		return *rc < 0;
+	}
+
+	if (io->write_error != 0) {
+		*rc = io->write_error;
+		io->write_error = 0;
+		PTHREAD_MUTEX_unlock(&io->lock);
+		return true;
+	}
+
+	for (i = 0; i < arg->iov_count; i++) {
+		char *src = arg->iov[i].iov_base;
+		size_t left = arg->iov[i].iov_len;
+
+		while (left > 0) {
+			size_t cnt;
+
+			if (io->stage == NULL) {
+				io->stage_size = export->write_stage_size;
+				io->stage = gsh_malloc(io->stage_size);
+				io->stage_offset = offset;
+				io->stage_flags = RGW_OPEN_FLAG_NONE;
+			}
+			if (!arg->state)
+				io->stage_flags |= RGW_OPEN_FLAG_V3;
+
+			cnt = MIN(left, io->stage_size - io->stage_len);
+			memcpy(io->stage + io->stage_len, src, cnt);
+			io->stage_len += cnt;
+			src += cnt;
+			left -= cnt;
+			offset += cnt;
+
+			if (io->stage_len < io->stage_size)
+				continue;
+
+			while (io->nparts >= export->write_stage_depth)
+				pthread_cond_wait(&io->io_done, &io->lock);
+			rgw_stage_queue(handle);
+		}
+	}
+
+	io->write_end = offset;
+	arg->io_amount = offset - arg->offset;
+	*rc = 0;
+
+	PTHREAD_MUTEX_unlock(&io->lock);
+	return true;
+}
+
+static void rgw_ra_fill(struct fridgethr_context *ctx)
+{
+	struct rgw_ra_job *job = ctx->arg;
+	struct rgw_handle *handle = job->handle;
+	struct rgw_io_cache *io = &handle->io;
+	size_t nb_read = 0;
+	int rc;
+
+	rc = rgw_read(handle->export->rgw_fs, handle->rgw_fh, job->offset,
+		      job->range->len, &nb_read, job->buf,
+		      RGW_READ_FLAG_NONE);
+
+	PTHREAD_MUTEX_lock(&io->lock);
+	job->range->rc = rc;
+	job->range->got = rc < 0 ? 0 : nb_read;
+	job->range->done = true;
+	io->ra_filling--;
+	pthread_cond_broadcast(&io->io_done);
+	PTHREAD_MUTEX_unlock(&io->lock);
+
+	gsh_free(job);
+}
+
+/* called with io->lock, starts reading a new window at offset */
+static void rgw_ra_start(struct rgw_export *export,
+			 struct rgw_handle *handle, uint64_t offset)
+{
+	struct rgw_io_cache *io = &handle->io;
+	uint32_t n = export->readahead_ranges;
+	size_t chunk = export->readahead_size / n;
+	uint32_t i;
+
+	if (chunk == 0) {
+		chunk = export->readahead_size;
+		n = 1;
+	}
+
+	rgw_ra_drop(io);
+
+	io->ra_buf = gsh_malloc(chunk * n);
+	io->ranges = gsh_calloc(n, sizeof(*io->ranges));
+	io->nranges = n;
+	io->ra_offset = offset;
+
+	for (i = 0; i < n; i++) {
+		struct rgw_ra_range *range = &io->ranges[i];
+		struct rgw_ra_job *job = gsh_malloc(sizeof(*job));
+
+		range->offset = (uint64_t)i * chunk;
+		range->len = chunk;
+
+		job->handle = handle;
+		job->range = range;
+		job->offset = offset + range->offset;
+		job->buf = io->ra_buf + range->offset;
+
+		io->ra_filling++;
+		if (fridgethr_submit(RGWFSM.io_fridge, rgw_ra_fill,
+				     job) != 0) {
+			io->ra_filling--;
+			range->rc = -EAGAIN;
+			range->done = true;
+			gsh_free(job);
+		}
+	}
+}
+
+/**
+ * @brief Serve a read from the read-ahead window
+ *
+ * Also spots sequential readers and starts a new window when they
+ * read past the current one.
+ *
+ * @param[in]     export  Export the read came through
+ * @param[in]     handle  Object read
+ * @param[in,out] arg     The read
+ *
+ * @return true if the read was served.
+ */
+static bool rgw_ra_read(struct rgw_export *export, struct rgw_handle *handle,
+			struct fsal_io_arg *arg)
+{
+	struct rgw_io_cache *io = &handle->io;
+	uint64_t pos = arg->offset;
+	size_t left = arg->iov[0].iov_len;
+	char *dst = arg->iov[0].iov_base;
+	bool eof = false;
+
+	if (!rgw_ra_enabled(export) || arg->iov_count != 1)
+		return false;
+
+	PTHREAD_MUTEX_lock(&io->lock);
+
+	/* Staged data must reach RGW before anything is read back */
+	if (rgw_io_pending(io))
+		rgw_io_flush(handle);
+
+	if (arg->offset == io->next_offset && !io->random)
+		io->sequential++;
+	else
+		io->sequential = 0;
+	io->next_offset = arg->offset + left;
+
+	while (left > 0 && !eof) {
+		struct rgw_ra_range *range;
+		uint64_t in;
+		size_t cnt;
+
+		if (io->ra_buf == NULL || pos < io->ra_offset ||
+		    pos >= io->ra_offset +
+			   io->ranges[0].len * io->nranges) {
+			if (io->sequential < RGW_RA_SEQUENTIAL) {
+				PTHREAD_MUTEX_unlock(&io->lock);
+				return false;
+			}
+			rgw_ra_start(export, handle, pos);
+		}
+
+		range = &io->ranges[(pos - io->ra_offset) / io->ranges[0].len];
+		while (!range->done)
+			pthread_cond_wait(&io->io_done, &io->lock);
+
+		if (range->rc < 0) {
+			/* Read it inline and try again next time */
+			rgw_ra_drop(io);
+			PTHREAD_MUTEX_unlock(&io->lock);
+			return false;
+		}
+
+		in = pos - io->ra_offset - range->offset;
+		if (in >= range->got) {
+			/* A short range is the end of the object */
+			eof = true;
+			break;
+		}
+
+		cnt = MIN(left, range->got - in);
+		memcpy(dst, io->ra_buf + range->offset + in, cnt);
+		dst += cnt;
+		pos += cnt;
+		left -= cnt;
+		eof = range->got < range->len && in + cnt == range->got;
+	}
+
+	arg->io_amount = arg->iov[0].iov_len - left;
+	arg->end_of_file = eof;
+
+	PTHREAD_MUTEX_unlock(&io->lock);
+	return true;
+}
+
+/**
+ * @brief Steer read-ahead by IO_ADVISE hints
+ *
+ * SEQUENTIAL turns read-ahead on without waiting for the reads to show
+ * it, WILLNEED also fills a window at the offset unless one is already
+ * being read, RANDOM keeps it off until NORMAL or SEQUENTIAL, and
+ * DONTNEED drops the window.
+ *
+ * @param[in]     obj_hdl  Object to advise on
+ * @param[in]     state    Open state, unused
+ * @param[in,out] hints    Hints asked for, returned with those applied
+ *
+ * @return FSAL status.
+ */
+
+static fsal_status_t rgw_fsal_io_advise2(struct fsal_obj_handle *obj_hdl,
+					 struct state_t *state,
+					 struct io_hints *hints)
+{
+	struct rgw_export *export =
+		container_of(op_ctx->fsal_export, struct rgw_export, export);
+	struct rgw_handle *handle = container_of(obj_hdl, struct rgw_handle,
+						 handle);
+	struct rgw_io_cache *io = &handle->io;
+	uint32_t applied = 0;
+
+	if (!rgw_ra_enabled(export)) {
+		hints->hints = 0;
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	PTHREAD_MUTEX_lock(&io->lock);
+
+	if (hints->hints & (1U << IO_ADVISE4_RANDOM)) {
+		io->random = true;
+		io->sequential = 0;
+		applied |= 1U << IO_ADVISE4_RANDOM;
+	} else if (hints->hints & ((1U << IO_ADVISE4_NORMAL) |
+				   (1U << IO_ADVISE4_SEQUENTIAL) |
+				   (1U << IO_ADVISE4_WILLNEED))) {
+		io->random = false;
+		applied |= hints->hints & (1U << IO_ADVISE4_NORMAL);
+		if (hints->hints & ((1U << IO_ADVISE4_SEQUENTIAL) |
+				    (1U << IO_ADVISE4_WILLNEED))) {
+			io->sequential = RGW_RA_SEQUENTIAL;
+			io->next_offset = hints->offset;
+			applied |= hints->hints &
+				   (1U << IO_ADVISE4_SEQUENTIAL);
+		}
+	}
+
+	if (hints->hints & (1U << IO_ADVISE4_DONTNEED)) {
+		if (io->ra_buf != NULL)
+			rgw_ra_drop(io);
+		applied |= 1U << IO_ADVISE4_DONTNEED;
+	} else if (hints->hints & (1U << IO_ADVISE4_WILLNEED)) {
+		/* A window being read is left to rgw_ra_read to move on */
+		if (io->ra_buf == NULL) {
+			/* Staged data must reach RGW before it is read */
+			if (rgw_io_pending(io))
+				rgw_io_flush(handle);
+			rgw_ra_start(export, handle, hints->offset);
+		}
+		applied |= 1U << IO_ADVISE4_WILLNEED;
+	}
+
+	PTHREAD_MUTEX_unlock(&io->lock);
+
+	hints->hints = applied;
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
 
 /**
  * @brief Release an object
@@ -51,6 +726,8 @@ static void release(struct fsal_obj_handle *obj_hdl)
 		container_of(obj_hdl, struct rgw_handle, handle);
 	struct rgw_export *export = obj->export;
 
+	rgw_io_release(obj);
+
 	if (obj->rgw_fh != export->rgw_fs->root_fh) {
 		/* release RGW ref */
 		(void) rgw_fh_rele(export->rgw_fs, obj->rgw_fh,
@@ -131,6 +808,7 @@ struct rgw_cb_arg {
 	void *fsal_arg;
 	struct fsal_obj_handle *dir_hdl;
 	attrmask_t attrmask;
+	bool lookup_failed;
 };
 
 static bool rgw_cb(const char *name, void *arg, uint64_t offset, uint32_t flags)
@@ -147,8 +825,10 @@ static bool rgw_cb(const char *name, void *arg, uint64_t offset, uint32_t flags)
 	status = lookup_int(rgw_cb_arg->dir_hdl, name, &obj, &attrs,
 			RGW_LOOKUP_FLAG_RCB|
 			(flags & (RGW_LOOKUP_FLAG_DIR|RGW_LOOKUP_FLAG_FILE)));
-	if (FSAL_IS_ERROR(status))
+	if (FSAL_IS_ERROR(status)) {
+		rgw_cb_arg->lookup_failed = true;
 		return false;
+	}
 
 	/** @todo FSF - when rgw gains mark capability, need to change this
 	 *              code...
@@ -156,10 +836,127 @@ static bool rgw_cb(const char *name, void *arg, uint64_t offset, uint32_t flags)
 	cb_rc = rgw_cb_arg->cb(name, obj, &attrs, rgw_cb_arg->fsal_arg, offset);
 
 	fsal_release_attrs(&attrs);
+	rgw_stat_count(RGW_STAT_ENTRIES, 1);
 
 	return cb_rc <= DIR_READAHEAD;
 }
 
+/**
+ * @brief Read a directory through its listing cursor
+ *
+ * @param[in]  export  Export the readdir came through
+ * @param[in]  dir     The directory to read
+ * @param[in]  whence  Name to resume after, NULL to start
+ * @param[in]  arg     Where the entries go
+ * @param[out] eof     True if there are no more entries
+ * @param[out] status  Result, if the directory was read
+ *
+ * @return false if another readdir has the cursor, so the directory is
+ *         to be listed the plain way.
+ */
+static bool rgw_rd_readdir(struct rgw_export *export, struct rgw_handle *dir,
+			   const char *whence, struct rgw_cb_arg *arg,
+			   bool *eof, fsal_status_t *status)
+{
+	struct rgw_io_cache *io = &dir->io;
+	struct rgw_dir_cursor *cursor;
+	time_t now_time = time(NULL);
+
+	PTHREAD_MUTEX_lock(&io->lock);
+
+	cursor = io->cursor;
+	if (cursor != NULL && !cursor->busy &&
+	    (now_time - cursor->used > RGW_RD_CURSOR_IDLE ||
+	     !rgw_rd_resumes(cursor, whence)))
+		rgw_rd_drop(io);
+
+	cursor = io->cursor;
+	if (cursor != NULL && (cursor->busy || cursor->stale)) {
+		PTHREAD_MUTEX_unlock(&io->lock);
+		return false;
+	}
+
+	if (cursor == NULL) {
+		cursor = gsh_calloc(1, sizeof(*cursor));
+		cursor->resume = whence ? gsh_strdup(whence) : NULL;
+		cursor->page_size = export->readdir_page_size;
+		io->cursor = cursor;
+	}
+
+	cursor->busy = true;
+	cursor->used = now_time;
+	*status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	*eof = false;
+
+	for (;;) {
+		struct rgw_dir_ent *ent;
+		bool more;
+
+		if (cursor->next == cursor->cur.count) {
+			if (cursor->cur.eof) {
+				*eof = true;
+				cursor->stale = true;
+				break;
+			}
+
+			while (cursor->fetching)
+				pthread_cond_wait(&io->io_done, &io->lock);
+
+			if (!cursor->ahead_ready) {
+				const char *from = cursor->cur.count ?
+				    cursor->cur.ents[cursor->cur.count - 1].name
+				    : cursor->resume;
+
+				PTHREAD_MUTEX_unlock(&io->lock);
+				rgw_rd_list(dir, from, &cursor->ahead,
+					    cursor->page_size);
+				PTHREAD_MUTEX_lock(&io->lock);
+			}
+
+			rgw_rd_free_page(&cursor->cur);
+			cursor->cur = cursor->ahead;
+			memset(&cursor->ahead, 0, sizeof(cursor->ahead));
+			cursor->ahead_ready = false;
+			cursor->next = 0;
+
+			if (cursor->cur.rc < 0) {
+				*status = rgw2fsal_error(cursor->cur.rc);
+				cursor->stale = true;
+				break;
+			}
+
+			/* List the next page while this one is handed out */
+			rgw_rd_prefetch(dir);
+			continue;
+		}
+
+		ent = &cursor->cur.ents[cursor->next++];
+
+		PTHREAD_MUTEX_unlock(&io->lock);
+		more = rgw_cb(ent->name, arg, ent->offset, ent->flags);
+		PTHREAD_MUTEX_lock(&io->lock);
+
+		if (arg->lookup_failed) {
+			/* Gone since it was listed, the caller never saw it */
+			arg->lookup_failed = false;
+			continue;
+		}
+
+		gsh_free(cursor->resume);
+		cursor->resume = gsh_strdup(ent->name);
+
+		if (!more)
+			break;
+	}
+
+	cursor->busy = false;
+	if (cursor->stale && !cursor->fetching)
+		rgw_rd_free(io);
+
+	PTHREAD_MUTEX_unlock(&io->lock);
+	return true;
+}
+
 /**
  * @brief Read a directory
  *
@@ -185,6 +982,7 @@ static fsal_status_t rgw_fsal_readdir(struct fsal_obj_handle *dir_hdl,
 	int rc;
 	fsal_status_t fsal_status = {ERR_FSAL_NO_ERROR, 0};
 	struct rgw_cb_arg rgw_cb_arg = {cb, cb_arg, dir_hdl, attrmask};
+	struct timespec start_time;
 
 	/* when whence_is_name, whence is a char pointer cast to
 	 * fsal_cookie_t */
@@ -199,10 +997,22 @@ static fsal_status_t rgw_fsal_readdir(struct fsal_obj_handle *dir_hdl,
 	LogFullDebug(COMPONENT_FSAL,
 		"%s enter dir_hdl %p", __func__, dir_hdl);
 
+	if (export->readdir_page_size != 0 &&
+	    rgw_rd_readdir(export, dir, r_whence, &rgw_cb_arg, eof,
+			   &fsal_status))
+		return fsal_status;
+
+	if (nfs_param.core_param.enable_FSALSTATS)
+		now(&start_time);
+
 	rc = 0;
 	*eof = false;
 	rc = rgw_readdir2(export->rgw_fs, dir->rgw_fh, r_whence, rgw_cb,
 			  &rgw_cb_arg, eof, RGW_READDIR_FLAG_NONE);
+
+	if (nfs_param.core_param.enable_FSALSTATS)
+		rgw_stat_record(RGW_STAT_LISTING, &start_time);
+
 	if (rc < 0)
 		return rgw2fsal_error(rc);
 
@@ -345,6 +1155,8 @@ static fsal_status_t rgw_fsal_mkdir(struct fsal_obj_handle *dir_hdl,
 	if (rc < 0)
 		return rgw2fsal_error(rc);
 
+	rgw_rd_forget(dir);
+
 	rc = construct_handle(export, rgw_fh, &st, &obj);
 	if (rc < 0) {
 		return rgw2fsal_error(rc);
@@ -396,6 +1208,12 @@ static fsal_status_t getattrs(struct fsal_obj_handle *obj_hdl,
 		return rgw2fsal_error(rc);
 	}
 
+	/* Report the size staged writes will leave the object with */
+	PTHREAD_MUTEX_lock(&handle->io.lock);
+	if (rgw_io_pending(&handle->io) && handle->io.write_end > st.st_size)
+		st.st_size = handle->io.write_end;
+	PTHREAD_MUTEX_unlock(&handle->io.lock);
+
 	posix2fsal_attributes_all(&st, attrs);
 
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
@@ -483,6 +1301,12 @@ fsal_status_t rgw_fsal_setattr2(struct fsal_obj_handle *obj_hdl,
 	memset(&st, 0, sizeof(struct stat));
 
 	if (FSAL_TEST_MASK(attrib_set->valid_mask, ATTR_SIZE)) {
+		rc = rgw_io_drain(handle);
+		if (rc < 0) {
+			status = rgw2fsal_error(rc);
+			goto out;
+		}
+
 		rc = rgw_truncate(export->rgw_fs, handle->rgw_fh,
 				attrib_set->filesize, RGW_TRUNCATE_FLAG_NONE);
 
@@ -616,6 +1440,9 @@ static fsal_status_t rgw_fsal_rename(struct fsal_obj_handle *obj_hdl,
 	if (rc < 0)
 		return rgw2fsal_error(rc);
 
+	rgw_rd_forget(olddir);
+	rgw_rd_forget(newdir);
+
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
@@ -654,6 +1481,8 @@ static fsal_status_t rgw_fsal_unlink(struct fsal_obj_handle *dir_hdl,
 	if (rc < 0)
 		return rgw2fsal_error(rc);
 
+	rgw_rd_forget(dir);
+
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
@@ -1031,6 +1860,8 @@ fsal_status_t rgw_fsal_open2(struct fsal_obj_handle *obj_hdl,
 		return rgw2fsal_error(rc);
 	}
 
+	rgw_rd_forget(handle);
+
 	/* Remember if we were responsible for creating the file.
 	 * Note that in an UNCHECKED retry we MIGHT have re-created the
 	 * file and won't remember that. Oh well, so in that rare case we
@@ -1305,6 +2136,17 @@ void rgw_fsal_read2(struct fsal_obj_handle *obj_hdl,
 		return;
 	}
 
+	if (rgw_ra_read(export, handle, read_arg)) {
+		done_cb(obj_hdl, fsalstat(0, 0), read_arg, caller_arg);
+		return;
+	}
+
+	/* Staged data must reach RGW before anything is read back */
+	PTHREAD_MUTEX_lock(&handle->io.lock);
+	if (rgw_io_pending(&handle->io))
+		rgw_io_flush(handle);
+	PTHREAD_MUTEX_unlock(&handle->io.lock);
+
 	/* RGW does not support a file descriptor abstraction--so
 	 * reads are handle based */
 
@@ -1376,6 +2218,12 @@ void rgw_fsal_write2(struct fsal_obj_handle *obj_hdl,
 
 	/* XXX note no call to fsal_find_fd (or wrapper) */
 
+	if (rgw_stage_write(export, handle, write_arg, &rc)) {
+		done_cb(obj_hdl, rc < 0 ? rgw2fsal_error(rc) :
+			fsalstat(ERR_FSAL_NO_ERROR, 0), write_arg, caller_arg);
+		return;
+	}
+
 	for (i = 0; i < write_arg->iov_count; i++) {
 		size_t nb_write;
 
@@ -1440,6 +2288,10 @@ fsal_status_t rgw_fsal_commit2(struct fsal_obj_handle *obj_hdl,
 		"%s enter obj_hdl %p offset %"PRIx64" length %zx",
 		__func__, obj_hdl, (uint64_t) offset, length);
 
+	rc = rgw_io_drain(handle);
+	if (rc < 0)
+		return rgw2fsal_error(rc);
+
 	rc = rgw_commit(export->rgw_fs, handle->rgw_fh, offset, length,
 			RGW_FSYNC_FLAG_NONE);
 	if (rc < 0)
@@ -1486,7 +2338,7 @@ struct state_t *rgw_alloc_state(struct fsal_export *exp_hdl,
 fsal_status_t rgw_fsal_close2(struct fsal_obj_handle *obj_hdl,
 			struct state_t *state)
 {
-	int rc;
+	int rc, io_rc;
 	struct rgw_open_state *open_state;
 
 	struct rgw_export *export =
@@ -1522,12 +2374,18 @@ fsal_status_t rgw_fsal_close2(struct fsal_obj_handle *obj_hdl,
 		return fsalstat(ERR_FSAL_NOT_OPENED, 0);
 	}
 
+	/* The object is complete once closed, so it gets its last part */
+	io_rc = rgw_io_drain(handle);
+
 	rc = rgw_close(export->rgw_fs, handle->rgw_fh, RGW_CLOSE_FLAG_NONE);
 	if (rc < 0)
 		return rgw2fsal_error(rc);
 
 	handle->openflags = FSAL_O_CLOSED;
 
+	if (io_rc < 0)
+		return rgw2fsal_error(io_rc);
+
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
@@ -1645,6 +2503,7 @@ void handle_ops_init(struct fsal_obj_ops *ops)
 	ops->reopen2 = rgw_fsal_reopen2;
 	ops->read2 = rgw_fsal_read2;
 	ops->write2 = rgw_fsal_write2;
+	ops->io_advise2 = rgw_fsal_io_advise2;
 	ops->commit2 = rgw_fsal_commit2;
 	ops->setattr2 = rgw_fsal_setattr2;
 	ops->close2 = rgw_fsal_close2;
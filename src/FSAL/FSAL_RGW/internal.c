@@ -207,6 +207,10 @@ int construct_handle(struct rgw_export *export,
 
 	constructing->export = export;
 
+	PTHREAD_MUTEX_init(&constructing->io.lock, NULL);
+	PTHREAD_COND_init(&constructing->io.io_done, NULL);
+	glist_init(&constructing->io.parts);
+
 	*obj = constructing;
 
 	return 0;
@@ -214,6 +218,8 @@ int construct_handle(struct rgw_export *export,
 
 void deconstruct_handle(struct rgw_handle *obj)
 {
+	PTHREAD_MUTEX_destroy(&obj->io.lock);
+	PTHREAD_COND_destroy(&obj->io.io_done);
 	fsal_obj_handle_fini(&obj->handle);
 	gsh_free(obj);
 }
@@ -40,6 +40,8 @@
 #include "fsal_api.h"
 #include "fsal_convert.h"
 #include "sal_data.h"
+#include "fridgethr.h"
+#include "gsh_list.h"
 
 #include <include/rados/librgw.h>
 #include <include/rados/rgw_file.h>
@@ -61,6 +63,8 @@ struct rgw_fsal_module {
 	char *name;
 	char *cluster;
 	char *init_args;
+	uint32_t io_threads;		/*< Threads for staged I/O */
+	struct fridgethr *io_fridge;
 	librgw_t rgw;
 };
 extern struct rgw_fsal_module RGWFSM;
@@ -82,6 +86,58 @@ struct rgw_export {
 	char *rgw_user_id;
 	char *rgw_access_key_id;
 	char *rgw_secret_access_key;
+	uint64_t write_stage_size;	/*< Bytes of a staged write part */
+	uint32_t write_stage_depth;	/*< Parts queued per object */
+	uint64_t readahead_size;	/*< Bytes of a read-ahead window */
+	uint32_t readahead_ranges;	/*< Ranged reads filling a window */
+	uint32_t readdir_page_size;	/*< Names listed per page, 0 is off */
+};
+
+/**
+ * One ranged read filling part of a read-ahead window
+ */
+
+struct rgw_ra_range {
+	uint64_t offset;	/*< Start, relative to the window */
+	size_t len;		/*< Bytes asked for */
+	size_t got;		/*< Bytes read, short means end of object */
+	int rc;
+	bool done;
+};
+
+/**
+ * Staged writes and read-ahead of an object.
+ *
+ * Sequential writes are gathered into parts of write_stage_size that
+ * one upload job at a time sends, in order, while the client carries
+ * on.  A sequential reader gets a window of readahead_size filled by
+ * readahead_ranges ranged reads in parallel.  A directory keeps the
+ * cursor of its listing.  lock protects all of it, io_done is signalled
+ * as parts, ranges and listed pages complete.
+ */
+
+struct rgw_io_cache {
+	pthread_mutex_t lock;
+	pthread_cond_t io_done;
+	char *stage;			/*< Part being filled */
+	uint64_t stage_offset;
+	size_t stage_size;
+	size_t stage_len;
+	uint32_t stage_flags;		/*< rgw_write flags of the part */
+	struct glist_head parts;	/*< Full parts waiting to be sent */
+	uint32_t nparts;		/*< Queued and being sent */
+	bool uploading;			/*< An upload job is running */
+	uint64_t write_end;		/*< End of staged data */
+	int write_error;		/*< First failed part */
+	char *ra_buf;
+	uint64_t ra_offset;
+	struct rgw_ra_range *ranges;
+	uint32_t nranges;
+	uint32_t ra_filling;		/*< Ranges being read */
+	uint64_t next_offset;		/*< Where a sequential read goes on */
+	uint32_t sequential;		/*< Sequential reads in a row */
+	bool random;			/*< Advised not to read ahead */
+	struct rgw_dir_cursor *cursor;	/*< Listing of a directory */
 };
 
 /**
@@ -97,6 +153,7 @@ struct rgw_handle {
 					 *< belongs to */
 	struct fsal_share share;
 	fsal_openflags_t openflags;
+	struct rgw_io_cache io;
 };
 
 /**
@@ -144,4 +201,14 @@ struct state_t *rgw_alloc_state(struct fsal_export *exp_hdl,
 				enum state_type state_type,
 				struct state_t *related_state);
 void rgw_fs_invalidate(void *handle, struct rgw_fh_hk fh_hk);
+
+/* Counters reported by GetFSALStats */
+enum rgw_stat_op {
+	RGW_STAT_LISTING,	/*< rgw_readdir2 calls */
+	RGW_STAT_ENTRIES,	/*< Directory entries returned */
+	RGW_STAT_OPS
+};
+
+void rgw_stat_record(enum rgw_stat_op op, const struct timespec *start);
+void rgw_stat_count(enum rgw_stat_op op, uint64_t count);
 #endif				/* !FSAL_RGW_INTERNAL_INTERNAL */
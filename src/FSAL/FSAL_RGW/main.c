@@ -38,6 +38,12 @@
 #include "abstract_mem.h"
 #include "nfs_exports.h"
 #include "export_mgr.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#include "nfs_core.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
 
 static const char *module_name = "RGW";
 
@@ -97,6 +103,8 @@ static struct config_item rgw_items[] = {
 		rgw_fsal_module, init_args),
 	CONF_ITEM_MODE("umask", 0,
 			rgw_fsal_module, fsal.fs_info.umask),
+	CONF_ITEM_UI32("IO_Threads", 0, 256, 8,
+		       rgw_fsal_module, io_threads),
 	CONFIG_EOL
 };
 
@@ -136,6 +144,23 @@ static fsal_status_t init_config(struct fsal_module *module_in,
 	if (!config_error_is_harmless(err_type))
 		return fsalstat(ERR_FSAL_INVAL, 0);
 
+	if (myself->io_threads != 0 && myself->io_fridge == NULL) {
+		struct fridgethr_params frp;
+		int rc;
+
+		memset(&frp, 0, sizeof(struct fridgethr_params));
+		frp.thr_max = myself->io_threads;
+		frp.deferment = fridgethr_defer_queue;
+
+		rc = fridgethr_init(&myself->io_fridge, "rgw_io", &frp);
+		if (rc != 0) {
+			/* Staging and read-ahead are just off then */
+			LogCrit(COMPONENT_FSAL,
+				"Unable to start RGW I/O threads: %d", rc);
+			myself->io_fridge = NULL;
+		}
+	}
+
 	display_fsinfo(&myself->fsal);
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
@@ -169,6 +194,16 @@ static struct config_item export_params[] = {
 		      rgw_export, rgw_access_key_id),
 	CONF_MAND_STR("secret_access_key", 0, MAXSECRETLEN, NULL,
 		      rgw_export, rgw_secret_access_key),
+	CONF_ITEM_UI64("Write_Stage_Size", 0, 64 * 1024 * 1024, 0,
+		       rgw_export, write_stage_size),
+	CONF_ITEM_UI32("Write_Stage_Depth", 1, 64, 4,
+		       rgw_export, write_stage_depth),
+	CONF_ITEM_UI64("Readahead_Size", 0, 64 * 1024 * 1024, 0,
+		       rgw_export, readahead_size),
+	CONF_ITEM_UI32("Readahead_Ranges", 1, 32, 4,
+		       rgw_export, readahead_ranges),
+	CONF_ITEM_UI32("Readdir_Page_Size", 0, 65536, 0,
+		       rgw_export, readdir_page_size),
 	CONFIG_EOL
 };
 
@@ -385,6 +420,117 @@ static fsal_status_t create_export(struct fsal_module *module_in,
 	return status;
 }
 
+static struct fsal_op_stats rgw_op_stats[RGW_STAT_OPS];
+
+static struct fsal_stats rgw_stats = {
+	.total_ops = RGW_STAT_OPS,
+	.op_stats = rgw_op_stats
+};
+
+static const char *rgw_stat_names[RGW_STAT_OPS] = {
+	[RGW_STAT_LISTING] = "LISTING",
+	[RGW_STAT_ENTRIES] = "ENTRIES",
+};
+
+/**
+ * @brief Account a call to RGW that began at start
+ */
+void rgw_stat_record(enum rgw_stat_op op, const struct timespec *start)
+{
+	struct fsal_op_stats *st = &rgw_op_stats[op];
+	struct timespec stop;
+	nsecs_elapsed_t resp_time;
+
+	now(&stop);
+	resp_time = timespec_diff(start, &stop);
+
+	(void)atomic_inc_uint64_t(&st->num_ops);
+	(void)atomic_add_uint64_t(&st->resp_time, resp_time);
+	if (st->resp_time_max < resp_time)
+		st->resp_time_max = resp_time;
+	if (st->resp_time_min == 0 || st->resp_time_min > resp_time)
+		st->resp_time_min = resp_time;
+}
+
+/**
+ * @brief Account things that have no response time
+ */
+void rgw_stat_count(enum rgw_stat_op op, uint64_t count)
+{
+	if (nfs_param.core_param.enable_FSALSTATS)
+		(void)atomic_add_uint64_t(&rgw_op_stats[op].num_ops, count);
+}
+
+#ifdef USE_DBUS
+static void rgw_extract_stats(struct fsal_module *fsal_hdl, void *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter struct_iter;
+	DBusMessageIter *iter1 = (DBusMessageIter *)iter;
+	char *message;
+	char buf[64];
+	uint64_t total_ops, total_resp, min_resp, max_resp;
+	uint64_t listings, entries;
+	double res;
+	int i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	message = "RGW";
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &message);
+
+	dbus_message_iter_open_container(iter1, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	for (i = 0; i < RGW_STAT_OPS; i++) {
+		total_ops = atomic_fetch_uint64_t(&rgw_op_stats[i].num_ops);
+		total_resp = atomic_fetch_uint64_t(&rgw_op_stats[i].resp_time);
+		min_resp = atomic_fetch_uint64_t(
+					&rgw_op_stats[i].resp_time_min);
+		max_resp = atomic_fetch_uint64_t(
+					&rgw_op_stats[i].resp_time_max);
+
+		message = (char *)rgw_stat_names[i];
+		dbus_message_iter_append_basic(&struct_iter,
+			DBUS_TYPE_STRING, &message);
+		dbus_message_iter_append_basic(&struct_iter,
+			DBUS_TYPE_UINT64, &total_ops);
+		res = total_ops && total_resp ?
+			(double) total_resp * 0.000001 / total_ops : 0.0;
+		dbus_message_iter_append_basic(&struct_iter,
+			DBUS_TYPE_DOUBLE, &res);
+		res = (double) min_resp * 0.000001;
+		dbus_message_iter_append_basic(&struct_iter,
+			DBUS_TYPE_DOUBLE, &res);
+		res = (double) max_resp * 0.000001;
+		dbus_message_iter_append_basic(&struct_iter,
+			DBUS_TYPE_DOUBLE, &res);
+	}
+	dbus_message_iter_close_container(iter1, &struct_iter);
+
+	/* How well listings are paged, the lower the better */
+	listings = atomic_fetch_uint64_t(
+			&rgw_op_stats[RGW_STAT_LISTING].num_ops);
+	entries = atomic_fetch_uint64_t(
+			&rgw_op_stats[RGW_STAT_ENTRIES].num_ops);
+	snprintf(buf, sizeof(buf), "OK, %.2f listings per 1k entries",
+		 entries ? (double) listings * 1000 / entries : 0.0);
+	message = buf;
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &message);
+}
+#endif
+
+static void rgw_reset_stats(struct fsal_module *fsal_hdl)
+{
+	int i;
+
+	for (i = 0; i < RGW_STAT_OPS; i++) {
+		atomic_store_uint64_t(&rgw_op_stats[i].num_ops, 0);
+		atomic_store_uint64_t(&rgw_op_stats[i].resp_time, 0);
+		atomic_store_uint64_t(&rgw_op_stats[i].resp_time_min, 0);
+		atomic_store_uint64_t(&rgw_op_stats[i].resp_time_max, 0);
+	}
+}
+
 /**
  * @brief Initialize and register the FSAL
  *
@@ -412,6 +558,11 @@ MODULE_INIT void init(void)
 	/* Set up module operations */
 	myself->m_ops.create_export = create_export;
 	myself->m_ops.init_config = init_config;
+#ifdef USE_DBUS
+	myself->m_ops.fsal_extract_stats = rgw_extract_stats;
+#endif
+	myself->m_ops.fsal_reset_stats = rgw_reset_stats;
+	myself->stats = &rgw_stats;
 
 	/* Initialize the fsal_obj_handle ops for FSAL RGW */
 	handle_ops_init(&RGWFSM.handle_ops);
@@ -438,6 +589,19 @@ MODULE_FINI void finish(void)
 			"RGW: unregister_fsal failed (%d)", ret);
 	}
 
+	if (RGWFSM.io_fridge != NULL) {
+		ret = fridgethr_sync_command(RGWFSM.io_fridge,
+					     fridgethr_comm_stop, 120);
+
+		if (ret == ETIMEDOUT) {
+			LogMajor(COMPONENT_FSAL,
+				 "Shutdown timed out, cancelling threads.");
+			fridgethr_cancel(RGWFSM.io_fridge);
+		}
+		fridgethr_destroy(RGWFSM.io_fridge);
+		RGWFSM.io_fridge = NULL;
+	}
+
 	/* release the library */
 	if (RGWFSM.rgw) {
 		librgw_shutdown(RGWFSM.rgw);
@@ -318,8 +318,10 @@ void vfs_export_ops_init(struct export_ops *ops)
 
 void free_vfs_filesystem(struct vfs_filesystem *vfs_fs)
 {
+	vfs_reclaim_fs_fini(vfs_fs);
 	if (vfs_fs->root_fd >= 0)
 		close(vfs_fs->root_fd);
+	vfs_commit_batch_fini(&vfs_fs->commits);
 	gsh_free(vfs_fs);
 }
 
@@ -351,6 +353,8 @@ int vfs_claim_filesystem(struct fsal_filesystem *fs, struct fsal_export *exp)
 
 	glist_init(&vfs_fs->exports);
 	vfs_fs->root_fd = -1;
+	vfs_fs->reclaim_fd = -1;
+	vfs_commit_batch_init(&vfs_fs->commits);
 
 	vfs_fs->fs = fs;
 
@@ -366,6 +370,8 @@ int vfs_claim_filesystem(struct fsal_filesystem *fs, struct fsal_export *exp)
 		goto errout;
 	}
 
+	vfs_reclaim_fs_init(vfs_fs);
+
 	fs->private_data = vfs_fs;
 
 already_claimed:
@@ -471,6 +477,7 @@ fsal_status_t vfs_create_export(struct fsal_module *fsal_hdl,
 	fsal_status_t fsal_status = {0, 0};
 
 	vfs_state_init();
+	vfs_state_fd_init();
 
 	myself = gsh_calloc(1, sizeof(struct vfs_fsal_export));
 
@@ -0,0 +1,603 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/* fdcache.c
+ * VFS cache of idle file descriptors
+ *
+ * NFSv3 I/O carries no open state, so every READ, WRITE and GETATTR
+ * that can't use the global fd opens a temporary descriptor and closes
+ * it again, and the MDCACHE reaper closes global fds whenever it runs
+ * above FD_HWMark only for the next request to reopen them.  Rather
+ * than closing, those descriptors are parked here, keyed by object and
+ * open mode, and handed back out by the next open of the same object.
+ * A parked fd holds a lease of FD_Cache_Lease seconds; a thread of its
+ * own closes fds whose lease has run out.
+ *
+ * Parked fds are still open, so they count in open_fd_count until they
+ * are really closed: the cache adds one as it takes an fd and drops one
+ * as it hands it back or closes it, and the caller's own accounting of
+ * global fds is unchanged.  The MDCACHE reaper thus sees them, and while
+ * it is above FD_HWMark the cache parks nothing and gives up idle fds.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "gsh_list.h"
+#include "abstract_atomic.h"
+#include "fridgethr.h"
+#include "fsal.h"
+#include "vfs_methods.h"
+#include "mdcache.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+#define VFS_FDCACHE_SHARDS 16
+#define VFS_FDCACHE_BUCKETS 64
+
+struct vfs_cached_fd {
+	struct glist_head hash;		/*< Bucket chain */
+	struct glist_head lru;		/*< Shard LRU, most recent first */
+	struct vfs_fsal_obj_handle *hdl;	/*< Object the fd is open on */
+	fsal_openflags_t openflags;	/*< FSAL_O_READ, WRITE or RDWR, and
+					    VFS_O_DIRECT */
+	int fd;
+	time_t expire;			/*< End of the lease */
+};
+
+struct vfs_fdcache_shard {
+	pthread_mutex_t mtx;
+	struct glist_head lru;
+	struct glist_head buckets[VFS_FDCACHE_BUCKETS];
+	uint32_t count;
+};
+
+static struct vfs_fdcache {
+	struct vfs_fdcache_shard shards[VFS_FDCACHE_SHARDS];
+	struct fridgethr *fridge;
+	uint32_t shard_max;	/*< Parked fds per shard, 0 if disabled */
+	uint32_t lease;		/*< Seconds an idle fd is kept */
+	/* Counters, atomic */
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t parked;
+	uint64_t evicted;
+	uint64_t expired;
+} fdcache;
+
+static inline uint64_t fdcache_hash(struct vfs_fsal_obj_handle *hdl)
+{
+	uint64_t key = (uintptr_t) hdl;
+
+	key ^= key >> 17;
+	return key * 0x9E3779B97F4A7C15ULL;
+}
+
+static inline struct vfs_fdcache_shard *
+fdcache_shard(uint64_t hash)
+{
+	return &fdcache.shards[(hash >> 32) % VFS_FDCACHE_SHARDS];
+}
+
+static inline struct glist_head *
+fdcache_bucket(struct vfs_fdcache_shard *shard, uint64_t hash)
+{
+	return &shard->buckets[hash % VFS_FDCACHE_BUCKETS];
+}
+
+/**
+ * @brief Drop parked fds from open_fd_count
+ *
+ * @param[in] count  Fds handed back or closed
+ */
+static inline void fdcache_uncount(size_t count)
+{
+	ssize_t open = atomic_sub_size_t(&open_fd_count, count);
+
+	if (open < 0)
+		LogCrit(COMPONENT_FSAL, "open_fd_count is negative: %zd",
+			open);
+}
+
+static inline void fdcache_unlink(struct vfs_fdcache_shard *shard,
+				  struct vfs_cached_fd *cfd)
+{
+	glist_del(&cfd->hash);
+	glist_del(&cfd->lru);
+	shard->count--;
+	fdcache_uncount(1);
+}
+
+/**
+ * @brief Close and free a list of entries taken out of the cache
+ *
+ * @param[in] list  Entries, chained through lru
+ */
+static void fdcache_close_list(struct glist_head *list)
+{
+	struct vfs_cached_fd *cfd;
+	struct glist_head *glist, *glistn;
+
+	glist_for_each_safe(glist, glistn, list) {
+		cfd = glist_entry(glist, struct vfs_cached_fd, lru);
+		glist_del(&cfd->lru);
+		LogFullDebug(COMPONENT_FSAL, "Closing cached fd %d", cfd->fd);
+		close(cfd->fd);
+		gsh_free(cfd);
+	}
+}
+
+/**
+ * @brief Take an idle fd from the cache
+ *
+ * An fd open for reading and writing serves either.  The fd belongs to
+ * the caller from here on.
+ *
+ * @param[in] hdl        Object to be opened
+ * @param[in] openflags  Mode wanted
+ *
+ * @return The fd, or -1 if none is cached.
+ */
+int vfs_fdcache_get(struct vfs_fsal_obj_handle *hdl,
+		    fsal_openflags_t openflags)
+{
+	uint64_t hash;
+	struct vfs_fdcache_shard *shard;
+	struct vfs_cached_fd *cfd;
+	struct glist_head *glist;
+	fsal_openflags_t want = openflags & (FSAL_O_RDWR | VFS_O_DIRECT);
+	time_t now;
+	int fd = -1;
+
+	if (fdcache.shard_max == 0 || (openflags & FSAL_O_TRUNC) != 0)
+		return -1;
+
+	hash = fdcache_hash(hdl);
+	shard = fdcache_shard(hash);
+	now = time(NULL);
+
+	PTHREAD_MUTEX_lock(&shard->mtx);
+
+	glist_for_each(glist, fdcache_bucket(shard, hash)) {
+		cfd = glist_entry(glist, struct vfs_cached_fd, hash);
+		if (cfd->hdl == hdl && (cfd->openflags & want) == want &&
+		    ((cfd->openflags ^ want) & VFS_O_DIRECT) == 0 &&
+		    cfd->expire > now) {
+			fdcache_unlink(shard, cfd);
+			fd = cfd->fd;
+			break;
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&shard->mtx);
+
+	if (fd < 0) {
+		(void) atomic_inc_uint64_t(&fdcache.misses);
+		return -1;
+	}
+
+	(void) atomic_inc_uint64_t(&fdcache.hits);
+	gsh_free(cfd);
+
+	LogFullDebug(COMPONENT_FSAL, "Reusing cached fd %d for %p", fd, hdl);
+
+	return fd;
+}
+
+/**
+ * @brief Park an fd the caller is done with
+ *
+ * The least recently parked fd of the shard is closed if it is full.
+ * Nothing is parked while open fds are above FD_HWMark.
+ *
+ * @param[in] hdl        Object the fd is open on
+ * @param[in] openflags  Mode the fd was opened with
+ * @param[in] fd         The fd
+ *
+ * @return true if the cache took the fd, false if the caller must
+ *	   close it.
+ */
+bool vfs_fdcache_put(struct vfs_fsal_obj_handle *hdl,
+		     fsal_openflags_t openflags, int fd)
+{
+	uint64_t hash;
+	struct vfs_fdcache_shard *shard;
+	struct vfs_cached_fd *cfd, *victim = NULL;
+
+	if (fdcache.shard_max == 0 || fd < 0 || mdcache_lru_fds_excess() != 0)
+		return false;
+
+	cfd = gsh_malloc(sizeof(*cfd));
+	cfd->hdl = hdl;
+	cfd->fd = fd;
+	/* FSAL_O_ANY opens read only */
+	cfd->openflags = openflags & (FSAL_O_RDWR | VFS_O_DIRECT);
+	if ((cfd->openflags & FSAL_O_RDWR) == 0)
+		cfd->openflags |= FSAL_O_READ;
+	cfd->expire = time(NULL) + fdcache.lease;
+
+	hash = fdcache_hash(hdl);
+	shard = fdcache_shard(hash);
+
+	PTHREAD_MUTEX_lock(&shard->mtx);
+
+	if (shard->count >= fdcache.shard_max) {
+		victim = glist_last_entry(&shard->lru, struct vfs_cached_fd,
+					  lru);
+		fdcache_unlink(shard, victim);
+	}
+
+	glist_add(fdcache_bucket(shard, hash), &cfd->hash);
+	glist_add(&shard->lru, &cfd->lru);
+	shard->count++;
+	(void) atomic_inc_size_t(&open_fd_count);
+
+	PTHREAD_MUTEX_unlock(&shard->mtx);
+
+	(void) atomic_inc_uint64_t(&fdcache.parked);
+
+	if (victim != NULL) {
+		(void) atomic_inc_uint64_t(&fdcache.evicted);
+		close(victim->fd);
+		gsh_free(victim);
+	}
+
+	return true;
+}
+
+/**
+ * @brief Finish with a temporary fd returned by find_fd
+ *
+ * Regular files go back to the cache; anything else, or an fd the
+ * cache won't take, is closed.
+ *
+ * @param[in] obj_hdl    Object the fd is open on
+ * @param[in] openflags  Mode passed to find_fd
+ * @param[in] fd         The fd
+ */
+void vfs_fdcache_done(struct fsal_obj_handle *obj_hdl,
+		      fsal_openflags_t openflags, int fd)
+{
+	struct vfs_fsal_obj_handle *myself =
+		container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
+
+	if (obj_hdl->type == REGULAR_FILE &&
+	    vfs_fdcache_put(myself, openflags, fd))
+		return;
+
+	LogFullDebug(COMPONENT_FSAL, "Closing Opened fd %d", fd);
+	close(fd);
+}
+
+/**
+ * @brief Close every fd cached for an object
+ *
+ * Called when the object handle goes away or the file is unlinked, so
+ * a parked fd neither outlives its handle nor pins a removed inode.
+ *
+ * @param[in] hdl  The object
+ */
+void vfs_fdcache_purge(struct vfs_fsal_obj_handle *hdl)
+{
+	uint64_t hash;
+	struct vfs_fdcache_shard *shard;
+	struct vfs_cached_fd *cfd;
+	struct glist_head *glist, *glistn;
+	struct glist_head purged;
+
+	if (fdcache.shard_max == 0)
+		return;
+
+	glist_init(&purged);
+	hash = fdcache_hash(hdl);
+	shard = fdcache_shard(hash);
+
+	PTHREAD_MUTEX_lock(&shard->mtx);
+
+	glist_for_each_safe(glist, glistn, fdcache_bucket(shard, hash)) {
+		cfd = glist_entry(glist, struct vfs_cached_fd, hash);
+		if (cfd->hdl == hdl) {
+			fdcache_unlink(shard, cfd);
+			glist_add(&purged, &cfd->lru);
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&shard->mtx);
+
+	fdcache_close_list(&purged);
+}
+
+/**
+ * @brief Close fds whose lease has run out
+ *
+ * While open fds are above FD_HWMark, the oldest fds of each shard are
+ * closed too, enough to bring them back to FD_LWMark if the cache can.
+ *
+ * @param[in] ctx  Fridge context
+ */
+static void fdcache_run(struct fridgethr_context *ctx)
+{
+	struct vfs_fdcache_shard *shard;
+	struct vfs_cached_fd *cfd;
+	struct glist_head expired;
+	time_t now = time(NULL);
+	uint64_t count = 0, shed = 0, hits, misses;
+	size_t excess;
+	int i;
+
+	SetNameFunction("vfs_fdcache");
+
+	glist_init(&expired);
+
+	for (i = 0; i < VFS_FDCACHE_SHARDS; i++) {
+		shard = &fdcache.shards[i];
+
+		PTHREAD_MUTEX_lock(&shard->mtx);
+
+		/* Oldest at the tail; stop at the first live lease */
+		while (!glist_empty(&shard->lru)) {
+			cfd = glist_last_entry(&shard->lru,
+					       struct vfs_cached_fd, lru);
+			if (cfd->expire > now)
+				break;
+			fdcache_unlink(shard, cfd);
+			glist_add(&expired, &cfd->lru);
+			count++;
+		}
+
+		PTHREAD_MUTEX_unlock(&shard->mtx);
+	}
+
+	/* Give up idle fds while the reaper is short of them */
+	excess = mdcache_lru_fds_excess();
+	excess = (excess + VFS_FDCACHE_SHARDS - 1) / VFS_FDCACHE_SHARDS;
+
+	for (i = 0; excess != 0 && i < VFS_FDCACHE_SHARDS; i++) {
+		uint64_t n = 0;
+
+		shard = &fdcache.shards[i];
+
+		PTHREAD_MUTEX_lock(&shard->mtx);
+
+		while (n < excess && !glist_empty(&shard->lru)) {
+			cfd = glist_last_entry(&shard->lru,
+					       struct vfs_cached_fd, lru);
+			fdcache_unlink(shard, cfd);
+			glist_add(&expired, &cfd->lru);
+			n++;
+		}
+
+		PTHREAD_MUTEX_unlock(&shard->mtx);
+
+		shed += n;
+	}
+
+	fdcache_close_list(&expired);
+
+	(void) atomic_add_uint64_t(&fdcache.expired, count);
+	(void) atomic_add_uint64_t(&fdcache.evicted, shed);
+
+	hits = atomic_fetch_uint64_t(&fdcache.hits);
+	misses = atomic_fetch_uint64_t(&fdcache.misses);
+
+	LogDebug(COMPONENT_FSAL,
+		 "fd cache closed %" PRIu64 " expired and %" PRIu64
+		 " idle fds, hits %" PRIu64 " misses %" PRIu64
+		 " hit ratio %.1f%%",
+		 count, shed, hits, misses,
+		 hits + misses == 0 ? 0.0 : hits * 100.0 / (hits + misses));
+}
+
+/**
+ * @brief Set up the fd cache and start its reaper
+ *
+ * @param[in] size   Fds to keep at most, 0 to disable the cache
+ * @param[in] lease  Seconds an idle fd is kept
+ *
+ * @return 0 on success, POSIX errors on failure.
+ */
+int vfs_fdcache_init(uint32_t size, uint32_t lease)
+{
+	struct fridgethr_params frp;
+	int i, j, rc;
+
+	if (size == 0 || fdcache.shard_max != 0)
+		return 0;
+
+	for (i = 0; i < VFS_FDCACHE_SHARDS; i++) {
+		PTHREAD_MUTEX_init(&fdcache.shards[i].mtx, NULL);
+		glist_init(&fdcache.shards[i].lru);
+		for (j = 0; j < VFS_FDCACHE_BUCKETS; j++)
+			glist_init(&fdcache.shards[i].buckets[j]);
+		fdcache.shards[i].count = 0;
+	}
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = lease > 1 ? lease / 2 : 1;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&fdcache.fridge, "VFS_fdcache", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Unable to initialize fd cache fridge, error code %d.",
+			 rc);
+		return rc;
+	}
+
+	rc = fridgethr_submit(fdcache.fridge, fdcache_run, NULL);
+	if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Unable to start fd cache thread, error code %d.",
+			 rc);
+		return rc;
+	}
+
+	fdcache.lease = lease;
+	fdcache.shard_max = size / VFS_FDCACHE_SHARDS;
+	if (fdcache.shard_max == 0)
+		fdcache.shard_max = 1;
+
+	LogInfo(COMPONENT_FSAL,
+		"VFS fd cache enabled, %" PRIu32 " fds with a %" PRIu32
+		" second lease", fdcache.shard_max * VFS_FDCACHE_SHARDS,
+		lease);
+
+	return 0;
+}
+
+/**
+ * @brief Stop the reaper and close every cached fd
+ */
+void vfs_fdcache_shutdown(void)
+{
+	struct vfs_fdcache_shard *shard;
+	struct glist_head all;
+	int i, rc;
+
+	if (fdcache.shard_max == 0)
+		return;
+
+	rc = fridgethr_sync_command(fdcache.fridge, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_FSAL,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(fdcache.fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Failed shutting down fd cache thread: %d", rc);
+	}
+
+	fdcache.shard_max = 0;
+	glist_init(&all);
+
+	for (i = 0; i < VFS_FDCACHE_SHARDS; i++) {
+		shard = &fdcache.shards[i];
+
+		PTHREAD_MUTEX_lock(&shard->mtx);
+		glist_splice_tail(&all, &shard->lru);
+		fdcache_uncount(shard->count);
+		shard->count = 0;
+		PTHREAD_MUTEX_unlock(&shard->mtx);
+
+		PTHREAD_MUTEX_destroy(&shard->mtx);
+	}
+
+	fdcache_close_list(&all);
+	fridgethr_destroy(fdcache.fridge);
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Append a row of GetFSALStats
+ *
+ * @param[in] iter   DBus struct iterator
+ * @param[in] name   Name of the row
+ * @param[in] count  Count
+ * @param[in] avg    First figure, usually an average
+ * @param[in] min    Second figure
+ * @param[in] max    Third figure
+ */
+void vfs_append_stat(void *iter, const char *name, uint64_t count,
+		     double avg, double min, double max)
+{
+	DBusMessageIter *struct_iter = iter;
+
+	dbus_message_iter_append_basic(struct_iter, DBUS_TYPE_STRING, &name);
+	dbus_message_iter_append_basic(struct_iter, DBUS_TYPE_UINT64, &count);
+	dbus_message_iter_append_basic(struct_iter, DBUS_TYPE_DOUBLE, &avg);
+	dbus_message_iter_append_basic(struct_iter, DBUS_TYPE_DOUBLE, &min);
+	dbus_message_iter_append_basic(struct_iter, DBUS_TYPE_DOUBLE, &max);
+}
+
+static void fdcache_append_stat(DBusMessageIter *struct_iter, char *name,
+				uint64_t count, double ratio)
+{
+	vfs_append_stat(struct_iter, name, count, ratio, 0.0, 0.0);
+}
+
+/**
+ * @brief Report fd cache counters for GetFSALStats
+ *
+ * The hit ratio, as a percentage, rides in the first figure of the
+ * hit and miss rows.  The COMMIT and direct I/O rows follow.
+ *
+ * @param[in] fsal_hdl  FSAL module
+ * @param[in] iter      opaque pointer to DBusMessageIter
+ */
+void vfs_fdcache_extract_stats(struct fsal_module *fsal_hdl, void *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter struct_iter;
+	DBusMessageIter *iter1 = (DBusMessageIter *)iter;
+	char *message = (char *) fsal_hdl->name;
+	uint64_t hits = atomic_fetch_uint64_t(&fdcache.hits);
+	uint64_t misses = atomic_fetch_uint64_t(&fdcache.misses);
+	double ratio = hits + misses == 0 ? 0.0
+					 : hits * 100.0 / (hits + misses);
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &message);
+
+	dbus_message_iter_open_container(iter1, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	fdcache_append_stat(&struct_iter, "FD_CACHE_HIT", hits, ratio);
+	fdcache_append_stat(&struct_iter, "FD_CACHE_MISS", misses,
+			    100.0 - ratio);
+	fdcache_append_stat(&struct_iter, "FD_CACHE_PARKED",
+			    atomic_fetch_uint64_t(&fdcache.parked), 0.0);
+	fdcache_append_stat(&struct_iter, "FD_CACHE_EVICTED",
+			    atomic_fetch_uint64_t(&fdcache.evicted), 0.0);
+	fdcache_append_stat(&struct_iter, "FD_CACHE_EXPIRED",
+			    atomic_fetch_uint64_t(&fdcache.expired), 0.0);
+	vfs_commit_extract_stats(&struct_iter);
+	vfs_direct_extract_stats(&struct_iter);
+	dbus_message_iter_close_container(iter1, &struct_iter);
+
+	message = fdcache.shard_max != 0 ? "OK" : "fd cache disabled";
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_STRING, &message);
+}
+#endif				/* USE_DBUS */
+
+/**
+ * @brief Zero the fd cache counters
+ *
+ * @param[in] fsal_hdl  FSAL module
+ */
+void vfs_fdcache_reset_stats(struct fsal_module *fsal_hdl)
+{
+	atomic_store_uint64_t(&fdcache.hits, 0);
+	atomic_store_uint64_t(&fdcache.misses, 0);
+	atomic_store_uint64_t(&fdcache.parked, 0);
+	atomic_store_uint64_t(&fdcache.evicted, 0);
+	atomic_store_uint64_t(&fdcache.expired, 0);
+	vfs_commit_reset_stats();
+	vfs_direct_reset_stats();
+}
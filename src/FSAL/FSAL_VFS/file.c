@@ -39,9 +39,19 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/uio.h>
+#include <sys/syscall.h>
+#ifdef LINUX
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
 #include "vfs_methods.h"
 #include "os/subr.h"
 #include "sal_data.h"
+#include "fridgethr.h"
+#include "gsh_iobuf.h"
+
+/** Threads finishing reads that missed the page cache, NULL if none */
+static struct fridgethr *read_fridge;
 
 fsal_status_t vfs_open_my_fd(struct vfs_fsal_obj_handle *myself,
 			     fsal_openflags_t openflags,
@@ -119,14 +129,23 @@ static fsal_status_t vfs_open_func(struct fsal_obj_handle *obj_hdl,
 				   struct fsal_fd *fd)
 {
 	struct vfs_fsal_obj_handle *myself;
+	struct vfs_fd *my_fd = (struct vfs_fd *)fd;
 	int posix_flags = 0;
+	int cached_fd;
 
 	myself = container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
 
+	/* An idle fd left by an earlier temporary or reaped open will do */
+	cached_fd = vfs_fdcache_get(myself, openflags);
+	if (cached_fd >= 0) {
+		my_fd->fd = cached_fd;
+		my_fd->openflags = openflags;
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
 	fsal2posix_openflags(openflags, &posix_flags);
 
-	return vfs_open_my_fd(myself, openflags, posix_flags,
-			      (struct vfs_fd *)fd);
+	return vfs_open_my_fd(myself, openflags, posix_flags, my_fd);
 }
 
 /**
@@ -171,19 +190,52 @@ fsal_status_t vfs_close(struct fsal_obj_handle *obj_hdl)
 	 */
 	PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
 
-	status = vfs_close_my_fd(&myself->u.file.fd);
+	/* Park the fd rather than close it; the next request for this
+	 * file will likely want it back.
+	 */
+	if (vfs_fdcache_put(myself, myself->u.file.fd.openflags,
+			    myself->u.file.fd.fd)) {
+		myself->u.file.fd.fd = -1;
+		myself->u.file.fd.openflags = FSAL_O_CLOSED;
+		status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	} else {
+		status = vfs_close_my_fd(&myself->u.file.fd);
+	}
 
 	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
 
 	return status;
 }
 
+/** Share states, the one state of every open, sized for their type */
+static pool_t *vfs_share_state_pool;
+
+/**
+ * @brief Create the pool of share states
+ *
+ * Called on creating each export, the pool is shared by all of them.
+ */
+void vfs_state_fd_init(void)
+{
+	if (vfs_share_state_pool != NULL)
+		return;
+
+	vfs_share_state_pool =
+		pool_basic_init("VFS Share State Pool",
+				offsetof(struct vfs_state_fd, state) +
+				sizeof_state(STATE_TYPE_SHARE));
+	pool_set_mem_tag(vfs_share_state_pool, MEM_TAG_STATE);
+}
+
 /**
  * @brief Allocate a state_t structure
  *
  * Note that this is not expected to fail since memory allocation is
  * expected to abort on failure.
  *
+ * Share states come from a pool, other states are allocated as large
+ * as their type needs.
+ *
  * @param[in] exp_hdl               Export state_t will be associated with
  * @param[in] state_type            Type of state to allocate
  * @param[in] related_state         Related state if appropriate
@@ -195,13 +247,20 @@ struct state_t *vfs_alloc_state(struct fsal_export *exp_hdl,
 				enum state_type state_type,
 				struct state_t *related_state)
 {
+	struct vfs_state_fd *state_fd;
 	struct state_t *state;
 	struct vfs_fd *my_fd;
 
-	state = init_state(gsh_calloc(1, sizeof(struct vfs_state_fd)),
-			   exp_hdl, state_type, related_state);
+	if (state_type == STATE_TYPE_SHARE)
+		state_fd = pool_alloc(vfs_share_state_pool);
+	else
+		state_fd = gsh_calloc(1, offsetof(struct vfs_state_fd, state) +
+					 sizeof_state(state_type));
+
+	state = init_state(&state_fd->state, exp_hdl, state_type,
+			   related_state);
 
-	my_fd = &container_of(state, struct vfs_state_fd, state)->vfs_fd;
+	my_fd = &state_fd->vfs_fd;
 
 	my_fd->fd = -1;
 	my_fd->openflags = FSAL_O_CLOSED;
@@ -225,7 +284,10 @@ void vfs_free_state(struct fsal_export *exp_hdl, struct state_t *state)
 
 	PTHREAD_RWLOCK_destroy(&my_fd->fdlock);
 
-	gsh_free(state_fd);
+	if (state->state_type == STATE_TYPE_SHARE)
+		pool_free(vfs_share_state_pool, state_fd);
+	else
+		gsh_free(state_fd);
 }
 
 /**
@@ -365,6 +427,7 @@ static fsal_status_t vfs_open2_by_handle(struct fsal_obj_handle *obj_hdl,
 					 bool *caller_perm_check)
 {
 	fsal_status_t status = {0, 0};
+	fsal_status_t close_status;
 	struct vfs_fd *my_fd = NULL;
 	int posix_flags = 0;
 	bool truncated;
@@ -394,28 +457,31 @@ static fsal_status_t vfs_open2_by_handle(struct fsal_obj_handle *obj_hdl,
 		 * called with a valid state (if state is NULL the caller is a
 		 * stateless create such as NFS v3 CREATE).
 		 */
+		if (!update_share_counters_shared(obj_hdl,
+						  &myself->u.file.share,
+						  FSAL_O_CLOSED, openflags,
+						  &status)) {
+			/* This can block over an I/O operation. */
+			PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
+
+			/* Check share reservation conflicts. */
+			status = check_share_conflict(&myself->u.file.share,
+						      openflags,
+						      false);
+
+			/* Take the share reservation now by updating the
+			 * counters.
+			 */
+			if (!FSAL_IS_ERROR(status))
+				update_share_counters(&myself->u.file.share,
+						      FSAL_O_CLOSED,
+						      openflags);
 
-		/* This can block over an I/O operation. */
-		PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
-
-		/* Check share reservation conflicts. */
-		status = check_share_conflict(&myself->u.file.share,
-					      openflags,
-					      false);
-
-		if (FSAL_IS_ERROR(status)) {
 			PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
-			return status;
 		}
 
-		/* Take the share reservation now by updating the
-		 * counters.
-		 */
-		update_share_counters(&myself->u.file.share,
-				      FSAL_O_CLOSED,
-				      openflags);
-
-		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+		if (FSAL_IS_ERROR(status))
+			return status;
 	} else {
 		/* We need to use the global fd to continue, and take
 		 * the lock to protect it.
@@ -525,6 +591,11 @@ undo_share:
 	 * and undo the update of the share counters.
 	 * This can block over an I/O operation.
 	 */
+	if (update_share_counters_shared(obj_hdl, &myself->u.file.share,
+					 openflags, FSAL_O_CLOSED,
+					 &close_status))
+		return status;
+
 	PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
 
 	update_share_counters(&myself->u.file.share,
@@ -1159,6 +1230,468 @@ fsal_status_t find_fd(int *fd,
 	return status;
 }
 
+/**
+ * @brief Describe the data to read by file extent rather than copy it
+ *
+ * The caller gets its own descriptor for the file, so it can send the
+ * data after read2 returns and whatever fd we used has been put back.
+ *
+ * @param[in]     fd       Descriptor the read would use
+ * @param[in,out] read_arg Info about read
+ *
+ * @return true if read_arg now holds the result, false to do a normal read
+ */
+static bool vfs_read_extent(int fd, struct fsal_io_arg *read_arg)
+{
+	struct stat st;
+	size_t len = 0;
+	int zfd;
+	int i;
+
+	for (i = 0; i < read_arg->iov_count; i++)
+		len += read_arg->iov[i].iov_len;
+
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+		return false;
+
+	if (read_arg->offset >= (uint64_t) st.st_size) {
+		read_arg->io_amount = 0;
+		read_arg->end_of_file = true;
+		return true;
+	}
+
+	if (len > (uint64_t) st.st_size - read_arg->offset)
+		len = st.st_size - read_arg->offset;
+
+	zfd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (zfd < 0)
+		return false;
+
+	read_arg->extent.fd = zfd;
+	read_arg->extent.offset = read_arg->offset;
+	read_arg->extent.length = len;
+	read_arg->io_amount = len;
+	read_arg->end_of_file =
+		read_arg->offset + len >= (uint64_t) st.st_size;
+
+	return true;
+}
+
+/**
+ * @brief Read for READ_PLUS, describing a hole rather than reading it
+ *
+ * SEEK_DATA and SEEK_HOLE split the range at the first change between
+ * data and hole.  A hole at the offset is returned as a hole, up to
+ * where the data starts; otherwise the data up to the next hole is
+ * read.  The client asks again for the rest.  Filesystems without hole
+ * support report the whole file as data, as do systems without
+ * SEEK_DATA.
+ *
+ * @param[in]     fd       Descriptor to read with
+ * @param[in,out] read_arg Info about read, with a single iovec
+ *
+ * @return 0 or an errno.
+ */
+static int vfs_read_plus(int fd, struct fsal_io_arg *read_arg)
+{
+	struct io_info *info = read_arg->info;
+	off_t offset = read_arg->offset;
+	size_t want = read_arg->iov[0].iov_len;
+	off_t size;
+#ifdef SEEK_DATA
+	off_t data, hole;
+	uint64_t len;
+#endif
+	ssize_t nb_read;
+
+	size = lseek(fd, 0, SEEK_END);
+	if (size == -1)
+		return errno;
+
+	read_arg->io_amount = 0;
+
+	if (offset < size) {
+#ifdef SEEK_DATA
+		data = lseek(fd, offset, SEEK_DATA);
+		if (data == -1) {
+			/* ENXIO is no data past offset, the rest is a hole */
+			if (errno != ENXIO)
+				return errno;
+			data = size;
+		}
+
+		if (data > offset) {
+			len = MIN((uint64_t) (data - offset), want);
+			info->io_content.what = NFS4_CONTENT_HOLE;
+			info->io_content.hole.di_offset = offset;
+			info->io_content.hole.di_length = len;
+			read_arg->end_of_file = offset + len >= size;
+			return 0;
+		}
+
+		hole = lseek(fd, offset, SEEK_HOLE);
+		if (hole == -1)
+			return errno;
+
+		if ((uint64_t) (hole - offset) < want)
+			want = hole - offset;
+#endif
+
+		nb_read = pread(fd, read_arg->iov[0].iov_base, want, offset);
+		if (nb_read == -1)
+			return errno;
+
+		read_arg->io_amount = nb_read;
+	}
+
+	info->io_content.what = NFS4_CONTENT_DATA;
+	info->io_content.data.d_offset = offset;
+	info->io_content.data.d_data.data_len = read_arg->io_amount;
+	info->io_content.data.d_data.data_val = read_arg->iov[0].iov_base;
+	read_arg->end_of_file = offset + read_arg->io_amount >= size;
+
+	return 0;
+}
+
+/**
+ * A read that missed the page cache, handed to a read thread
+ */
+struct vfs_async_read {
+	int fd;			/*< Our own dup of the file's fd */
+	struct fsal_obj_handle *obj_hdl;
+	fsal_async_cb done_cb;
+	struct fsal_io_arg *read_arg;
+	void *caller_arg;
+	struct req_op_context ctx;	/*< The caller's, for done_cb */
+};
+
+/**
+ * @brief Read on a read thread and call done_cb
+ */
+static void vfs_async_read_run(struct fridgethr_context *ctx)
+{
+	struct vfs_async_read *ar = ctx->arg;
+	struct fsal_io_arg *read_arg = ar->read_arg;
+	struct req_op_context *saved_ctx = op_ctx;
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	ssize_t nb_read;
+
+	nb_read = preadv(ar->fd, read_arg->iov, read_arg->iov_count,
+			 read_arg->offset);
+	if (nb_read == -1) {
+		status = fsalstat(posix2fsal_error(errno), errno);
+	} else {
+		read_arg->io_amount = nb_read;
+		read_arg->end_of_file = (nb_read == 0);
+	}
+
+	close(ar->fd);
+
+	op_ctx = &ar->ctx;
+	ar->done_cb(ar->obj_hdl, status, read_arg, ar->caller_arg);
+	op_ctx = saved_ctx;
+
+	gsh_free(ar);
+}
+
+/**
+ * @brief Read from the page cache, or else hand the read to a thread
+ *
+ * Done when there are read threads and the caller can take done_cb
+ * from another thread.  The read is first tried with RWF_NOWAIT, which
+ * returns what the page cache holds without blocking; only when none of
+ * the range is cached does a read thread do the blocking read.  That
+ * thread reads through a dup of the fd, so the caller releases the fd
+ * and its locks at once, whatever happens to them meanwhile.
+ *
+ * @return true if done_cb was or will be called.
+ */
+static bool vfs_read_nowait(struct fsal_obj_handle *obj_hdl, int fd,
+			    fsal_async_cb done_cb, struct fsal_io_arg *read_arg,
+			    void *caller_arg)
+{
+#ifdef RWF_NOWAIT
+	struct vfs_async_read *ar;
+	ssize_t nb_read;
+
+	if (read_fridge == NULL || !op_ctx->async_io)
+		return false;
+
+	nb_read = preadv2(fd, read_arg->iov, read_arg->iov_count,
+			  read_arg->offset, RWF_NOWAIT);
+	if (nb_read >= 0) {
+		/* A partly cached range makes a short read, which the
+		 * client goes on from.
+		 */
+		read_arg->io_amount = nb_read;
+		read_arg->end_of_file = (nb_read == 0);
+		done_cb(obj_hdl, fsalstat(ERR_FSAL_NO_ERROR, 0), read_arg,
+			caller_arg);
+		return true;
+	}
+
+	/* Anything but a miss, RWF_NOWAIT unsupported included, is left
+	 * to the plain read.
+	 */
+	if (errno != EAGAIN)
+		return false;
+
+	ar = gsh_malloc(sizeof(*ar));
+	ar->fd = dup(fd);
+	if (ar->fd == -1) {
+		gsh_free(ar);
+		return false;
+	}
+	ar->obj_hdl = obj_hdl;
+	ar->done_cb = done_cb;
+	ar->read_arg = read_arg;
+	ar->caller_arg = caller_arg;
+	fsal_async_ctx_save(&ar->ctx);
+
+	if (fridgethr_submit(read_fridge, vfs_async_read_run, ar) != 0) {
+		/* All threads busy, read here */
+		close(ar->fd);
+		gsh_free(ar);
+		return false;
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * @brief Start the read threads
+ *
+ * @param[in] threads  Threads, 0 to read on the caller's thread only
+ *
+ * @return 0 on success, POSIX errors on failure.
+ */
+int vfs_read_init(uint32_t threads)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (threads == 0 || read_fridge != NULL)
+		return 0;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = threads;
+	frp.thr_min = 0;
+	frp.thread_delay = 60;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_fail;
+
+	rc = fridgethr_init(&read_fridge, "VFS_read", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Unable to initialize read fridge, error code %d.",
+			 rc);
+		read_fridge = NULL;
+		return rc;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Stop the read threads
+ */
+void vfs_read_shutdown(void)
+{
+	int rc;
+
+	if (read_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(read_fridge, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_FSAL,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(read_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Failed shutting down read threads: %d", rc);
+	}
+
+	fridgethr_destroy(read_fridge);
+	read_fridge = NULL;
+}
+
+/** Direct I/O counters, atomic */
+static struct {
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t bounced;	/*< Writes copied to an aligned buffer */
+} direct_stats;
+
+/**
+ * @brief Whether an I/O should bypass the page cache
+ *
+ * Offset and length must be aligned for O_DIRECT.  So must the
+ * buffers of a read; READ replies come from the I/O buffer pool which
+ * aligns them.  Those of a write are copied if need be.
+ *
+ * With VFS_DIRECT_AUTO only I/O of at least Direct_IO_Size that goes
+ * on from the previous such I/O of the file is done direct: streams
+ * are, while the scattered I/O that gains from the cache is not.
+ *
+ * @param[in] myself  File
+ * @param[in] arg     The I/O
+ * @param[in] write   Whether it is a write
+ * @param[out] len    Its length
+ *
+ * @return true to do it direct.
+ */
+static bool vfs_direct_wanted(struct vfs_fsal_obj_handle *myself,
+			      struct fsal_io_arg *arg, bool write,
+			      size_t *len)
+{
+	struct vfs_fsal_export *exp = EXPORT_VFS_FROM_FSAL(op_ctx->fsal_export);
+	uint64_t next;
+	int i;
+
+	if (exp->direct_io == VFS_DIRECT_NONE ||
+	    arg->offset % VFS_DIRECT_ALIGN != 0)
+		return false;
+
+	*len = 0;
+	for (i = 0; i < arg->iov_count; i++) {
+		if (arg->iov[i].iov_len % VFS_DIRECT_ALIGN != 0)
+			return false;
+		if (!write &&
+		    (uintptr_t) arg->iov[i].iov_base % VFS_DIRECT_ALIGN != 0)
+			return false;
+		*len += arg->iov[i].iov_len;
+	}
+
+	if (*len == 0)
+		return false;
+
+	if (exp->direct_io == VFS_DIRECT_ALWAYS)
+		return true;
+
+	if (*len < exp->direct_io_size)
+		return false;
+
+	next = atomic_fetch_uint64_t(&myself->u.file.io.direct_next);
+	atomic_store_uint64_t(&myself->u.file.io.direct_next,
+			      arg->offset + *len);
+
+	return arg->offset == next;
+}
+
+/**
+ * @brief Get an fd of a file opened O_DIRECT
+ *
+ * The fd found by find_fd has already checked the share reservations
+ * and stays held, this one is only used for the data.
+ *
+ * @param[in] myself     File
+ * @param[in] openflags  FSAL_O_READ or FSAL_O_WRITE
+ *
+ * @return The fd, to be given to vfs_fdcache_done() with
+ *	   VFS_O_DIRECT, or -1 if the file can't be opened O_DIRECT.
+ */
+static int vfs_direct_open(struct vfs_fsal_obj_handle *myself,
+			   fsal_openflags_t openflags)
+{
+	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
+	int posix_flags = 0;
+	int fd;
+
+	fd = vfs_fdcache_get(myself, openflags | VFS_O_DIRECT);
+	if (fd >= 0)
+		return fd;
+
+	fsal2posix_openflags(openflags, &posix_flags);
+
+	fd = vfs_fsal_open(myself, posix_flags | O_DIRECT, &fsal_error);
+	if (fd < 0) {
+		LogDebug(COMPONENT_FSAL, "O_DIRECT open failed %s",
+			 msg_fsal_err(fsal_error));
+		return -1;
+	}
+
+	return fd;
+}
+
+/**
+ * @brief Write bypassing the page cache
+ *
+ * Buffers not aligned for O_DIRECT are first copied to one from the
+ * I/O buffer pool.  A buffered write would have copied them to the
+ * page cache all the same.
+ *
+ * @param[in] fd   File opened O_DIRECT
+ * @param[in] arg  The write
+ * @param[in] len  Its length
+ *
+ * @return Bytes written, or -1 with errno set.
+ */
+static ssize_t vfs_direct_write(int fd, struct fsal_io_arg *arg, size_t len)
+{
+	struct iovec iov;
+	ssize_t nb_written;
+	char *p;
+	int i;
+
+	for (i = 0; i < arg->iov_count; i++)
+		if ((uintptr_t) arg->iov[i].iov_base % VFS_DIRECT_ALIGN != 0)
+			break;
+
+	if (i == arg->iov_count)
+		return pwritev(fd, arg->iov, arg->iov_count, arg->offset);
+
+	iov.iov_base = iobuf_alloc(len);
+	iov.iov_len = len;
+
+	for (i = 0, p = iov.iov_base; i < arg->iov_count; i++) {
+		memcpy(p, arg->iov[i].iov_base, arg->iov[i].iov_len);
+		p += arg->iov[i].iov_len;
+	}
+
+	(void) atomic_inc_uint64_t(&direct_stats.bounced);
+
+	nb_written = pwritev(fd, &iov, 1, arg->offset);
+
+	iobuf_free(iov.iov_base);
+
+	return nb_written;
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report the direct I/O counters for GetFSALStats
+ *
+ * @param[in] iter  DBus struct iterator
+ */
+void vfs_direct_extract_stats(void *iter)
+{
+	vfs_append_stat(iter, "DIRECT_READ",
+			atomic_fetch_uint64_t(&direct_stats.reads),
+			0.0, 0.0, 0.0);
+	vfs_append_stat(iter, "DIRECT_WRITE",
+			atomic_fetch_uint64_t(&direct_stats.writes),
+			0.0, 0.0, 0.0);
+	vfs_append_stat(iter, "DIRECT_BOUNCED",
+			atomic_fetch_uint64_t(&direct_stats.bounced),
+			0.0, 0.0, 0.0);
+}
+#endif
+
+/**
+ * @brief Zero the direct I/O counters
+ */
+void vfs_direct_reset_stats(void)
+{
+	atomic_store_uint64_t(&direct_stats.reads, 0);
+	atomic_store_uint64_t(&direct_stats.writes, 0);
+	atomic_store_uint64_t(&direct_stats.bounced, 0);
+}
+
 /**
  * @brief Read data from a file
  *
@@ -1184,7 +1717,11 @@ void vfs_read2(struct fsal_obj_handle *obj_hdl,
 	       struct fsal_io_arg *read_arg,
 	       void *caller_arg)
 {
+	struct vfs_fsal_obj_handle *myself =
+		container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
 	int my_fd = -1;
+	int direct_fd = -1;
+	size_t len;
 	ssize_t nb_read;
 	fsal_status_t status = {0, 0};
 	int retval = 0;
@@ -1192,13 +1729,6 @@ void vfs_read2(struct fsal_obj_handle *obj_hdl,
 	bool closefd = false;
 	struct vfs_fd *vfs_fd = NULL;
 
-	if (read_arg->info != NULL) {
-		/* Currently we don't support READ_PLUS */
-		done_cb(obj_hdl, fsalstat(ERR_FSAL_NOTSUPP, 0), read_arg,
-			caller_arg);
-		return;
-	}
-
 	if (obj_hdl->fsal != obj_hdl->fs->fsal) {
 		LogDebug(COMPONENT_FSAL,
 			 "FSAL %s operation for handle belonging to FSAL %s, return EXDEV",
@@ -1227,8 +1757,32 @@ void vfs_read2(struct fsal_obj_handle *obj_hdl,
 	if (FSAL_IS_ERROR(status))
 		goto out;
 
-	nb_read = preadv(my_fd, read_arg->iov, read_arg->iov_count,
-			 read_arg->offset);
+	if (read_arg->info == NULL &&
+	    vfs_direct_wanted(myself, read_arg, false, &len))
+		direct_fd = vfs_direct_open(myself, FSAL_O_READ);
+
+	if (direct_fd < 0 && read_arg->extent.want &&
+	    vfs_read_extent(my_fd, read_arg))
+		goto out;
+
+	if (read_arg->info != NULL) {
+		retval = vfs_read_plus(my_fd, read_arg);
+		if (retval != 0)
+			status = fsalstat(posix2fsal_error(retval), retval);
+		goto out;
+	}
+
+	if (direct_fd >= 0) {
+		/* Straight to the reply buffers, past the page cache */
+		(void) atomic_inc_uint64_t(&direct_stats.reads);
+	} else if (vfs_read_nowait(obj_hdl, my_fd, done_cb, read_arg,
+				   caller_arg)) {
+		done_cb = NULL;
+		goto out;
+	}
+
+	nb_read = preadv(direct_fd >= 0 ? direct_fd : my_fd, read_arg->iov,
+			 read_arg->iov_count, read_arg->offset);
 
 	if (read_arg->offset == -1 || nb_read == -1) {
 		retval = errno;
@@ -1240,36 +1794,52 @@ void vfs_read2(struct fsal_obj_handle *obj_hdl,
 
 	read_arg->end_of_file = (nb_read == 0);
 
-#if 0
-	/** @todo
-	 *
-	 * Is this all we really need to do to support READ_PLUS? Will anyone
-	 * ever get upset that we don't return holes, even for blocks of all
-	 * zeroes?
-	 *
-	 */
-	if (info != NULL) {
-		info->io_content.what = NFS4_CONTENT_DATA;
-		info->io_content.data.d_offset = offset + nb_read;
-		info->io_content.data.d_data.data_len = nb_read;
-		info->io_content.data.d_data.data_val = buffer;
-	}
-#endif
-
  out:
 
+	if (direct_fd >= 0)
+		vfs_fdcache_done(obj_hdl, FSAL_O_READ | VFS_O_DIRECT,
+				 direct_fd);
+
 	if (vfs_fd)
 		PTHREAD_RWLOCK_unlock(&vfs_fd->fdlock);
 
-	if (closefd) {
-		LogFullDebug(COMPONENT_FSAL, "Closing Opened fd %d", my_fd);
-		close(my_fd);
-	}
+	if (closefd)
+		vfs_fdcache_done(obj_hdl, FSAL_O_READ, my_fd);
 
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
 
-	done_cb(obj_hdl, status, read_arg, caller_arg);
+	if (done_cb != NULL)
+		done_cb(obj_hdl, status, read_arg, caller_arg);
+}
+
+/**
+ * @brief Write and flush the range written
+ *
+ * With RWF_SYNC only the range and the inode are flushed, not all of
+ * the file the way fsync does.
+ *
+ * @param[in]  fd      File
+ * @param[in]  arg     Write
+ * @param[out] synced  Whether the write was flushed
+ *
+ * @return Bytes written, or -1 with errno set.
+ */
+static ssize_t vfs_pwritev_sync(int fd, struct fsal_io_arg *arg, bool *synced)
+{
+#ifdef RWF_SYNC
+	ssize_t nb_written;
+
+	nb_written = pwritev2(fd, arg->iov, arg->iov_count, arg->offset,
+			      RWF_SYNC);
+	if (nb_written != -1 || errno != EOPNOTSUPP) {
+		*synced = true;
+		return nb_written;
+	}
+#endif
+	/* Kernel older than RWF_SYNC, fsync after */
+	*synced = false;
+	return pwritev(fd, arg->iov, arg->iov_count, arg->offset);
 }
 
 /**
@@ -1299,6 +1869,8 @@ void vfs_write2(struct fsal_obj_handle *obj_hdl,
 		struct fsal_io_arg *write_arg,
 		void *caller_arg)
 {
+	struct vfs_fsal_obj_handle *myself =
+		container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
 	ssize_t nb_written;
 	fsal_status_t status;
 	int retval = 0;
@@ -1307,6 +1879,9 @@ void vfs_write2(struct fsal_obj_handle *obj_hdl,
 	bool closefd = false;
 	fsal_openflags_t openflags = FSAL_O_WRITE;
 	struct vfs_fd *vfs_fd = NULL;
+	bool synced = false;
+	int direct_fd = -1;
+	size_t len;
 
 	if (write_arg->info != NULL) {
 		/* Currently we don't support WRITE_PLUS */
@@ -1346,14 +1921,33 @@ void vfs_write2(struct fsal_obj_handle *obj_hdl,
 		goto out;
 	}
 
+	if (vfs_direct_wanted(myself, write_arg, true, &len))
+		direct_fd = vfs_direct_open(myself, FSAL_O_WRITE);
+
 	if (!vfs_set_credentials(op_ctx->creds, obj_hdl->fsal)) {
 		retval = EPERM;
 		status = fsalstat(ERR_FSAL_PERM, EPERM);
 		goto out;
 	}
 
-	nb_written = pwritev(my_fd, write_arg->iov, write_arg->iov_count,
-			     write_arg->offset);
+	/* Writes stay on the worker: an UNSTABLE one lands in the page
+	 * cache and seldom blocks, and write gathering relies on its
+	 * writers waiting here.
+	 */
+	if (direct_fd >= 0) {
+		/* A stable one is made so by the fsync below */
+		(void) atomic_inc_uint64_t(&direct_stats.writes);
+		nb_written = vfs_direct_write(direct_fd, write_arg, len);
+	} else if (!write_arg->fsal_stable &&
+		   container_of(obj_hdl->fsal, struct vfs_fsal_module,
+				module)->write_gather) {
+		nb_written = vfs_gather_write(myself, my_fd, write_arg);
+	} else if (write_arg->fsal_stable) {
+		nb_written = vfs_pwritev_sync(my_fd, write_arg, &synced);
+	} else {
+		nb_written = pwritev(my_fd, write_arg->iov,
+				     write_arg->iov_count, write_arg->offset);
+	}
 
 	if (nb_written == -1) {
 		retval = errno;
@@ -1363,7 +1957,7 @@ void vfs_write2(struct fsal_obj_handle *obj_hdl,
 
 	write_arg->io_amount = nb_written;
 
-	if (write_arg->fsal_stable) {
+	if (write_arg->fsal_stable && !synced) {
 		retval = fsync(my_fd);
 		if (retval == -1) {
 			retval = errno;
@@ -1376,13 +1970,14 @@ void vfs_write2(struct fsal_obj_handle *obj_hdl,
 
 	vfs_restore_ganesha_credentials(obj_hdl->fsal);
 
+	if (direct_fd >= 0)
+		vfs_fdcache_done(obj_hdl, openflags | VFS_O_DIRECT, direct_fd);
+
 	if (vfs_fd)
 		PTHREAD_RWLOCK_unlock(&vfs_fd->fdlock);
 
-	if (closefd) {
-		LogFullDebug(COMPONENT_FSAL, "Closing Opened fd %d", my_fd);
-		close(my_fd);
-	}
+	if (closefd)
+		vfs_fdcache_done(obj_hdl, openflags, my_fd);
 
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
@@ -1472,11 +2067,8 @@ fsal_status_t vfs_seek2(struct fsal_obj_handle *obj_hdl,
 
  out:
 
-	if (closefd) {
-		LogFullDebug(COMPONENT_FSAL,
-			     "Closing Opened fd %d", my_fd);
-		close(my_fd);
-	}
+	if (closefd)
+		vfs_fdcache_done(obj_hdl, openflags, my_fd);
 
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
@@ -1539,18 +2131,352 @@ fsal_status_t vfs_fallocate(struct fsal_obj_handle *obj_hdl,
 
  out:
 
-	if (closefd) {
-		LogFullDebug(COMPONENT_FSAL,
-			     "Closing Opened fd %d", my_fd);
-		close(my_fd);
+	if (closefd)
+		vfs_fdcache_done(obj_hdl, openflags, my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return status;
+}
+#endif
+
+/** IO_ADVISE4 hints and the posix_fadvise advice each one maps to */
+static const struct {
+	uint32_t hint;
+	int advice;
+} vfs_fadvise_map[] = {
+	{ IO_ADVISE4_NORMAL, POSIX_FADV_NORMAL },
+	{ IO_ADVISE4_SEQUENTIAL, POSIX_FADV_SEQUENTIAL },
+	{ IO_ADVISE4_RANDOM, POSIX_FADV_RANDOM },
+	{ IO_ADVISE4_WILLNEED, POSIX_FADV_WILLNEED },
+	{ IO_ADVISE4_DONTNEED, POSIX_FADV_DONTNEED },
+	{ IO_ADVISE4_NOREUSE, POSIX_FADV_NOREUSE },
+};
+
+/**
+ * @brief Pass IO_ADVISE hints to the kernel
+ *
+ * Each hint with a posix_fadvise counterpart is given to the kernel for
+ * the range, so WILLNEED starts its read-ahead and DONTNEED drops clean
+ * pages.  A file that won't be reused also has its idle fds closed rather
+ * than parked.
+ *
+ * @param[in]     obj_hdl  File on which to operate
+ * @param[in]     state    state_t to use for this operation
+ * @param[in,out] hints    Hints asked for, returned with those applied
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_io_advise2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state,
+			     struct io_hints *hints)
+{
+	struct vfs_fsal_obj_handle *myself =
+		container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
+	bool has_lock = false;
+	bool closefd = false;
+	fsal_openflags_t openflags = FSAL_O_ANY;
+	fsal_status_t status;
+	uint32_t applied = 0;
+	int my_fd = -1;
+	unsigned int i;
+	int rc;
+
+	status = find_fd(&my_fd, obj_hdl, false, state, openflags,
+			 &has_lock, &closefd, false);
+
+	if (FSAL_IS_ERROR(status)) {
+		hints->hints = 0;
+		goto out;
+	}
+
+	for (i = 0; i < sizeof(vfs_fadvise_map) / sizeof(vfs_fadvise_map[0]);
+	     i++) {
+		uint32_t bit = 1U << vfs_fadvise_map[i].hint;
+
+		if ((hints->hints & bit) == 0)
+			continue;
+
+		/* A count of 0 means to the end of the file for both */
+		rc = posix_fadvise(my_fd, hints->offset, hints->count,
+				   vfs_fadvise_map[i].advice);
+		if (rc == 0)
+			applied |= bit;
+		else
+			LogFullDebug(COMPONENT_FSAL,
+				     "posix_fadvise %d returned %s (%d)",
+				     vfs_fadvise_map[i].advice,
+				     strerror(rc), rc);
 	}
 
+	hints->hints = applied;
+
+	if (applied & ((1U << IO_ADVISE4_DONTNEED) |
+		       (1U << IO_ADVISE4_NOREUSE))) {
+		if (closefd) {
+			close(my_fd);
+			closefd = false;
+		}
+		vfs_fdcache_purge(myself);
+	}
+
+ out:
+
+	if (closefd)
+		vfs_fdcache_done(obj_hdl, openflags, my_fd);
+
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
 
 	return status;
 }
+
+/** One side of a vfs_copy */
+struct vfs_copy_fd {
+	struct fsal_obj_handle *obj_hdl;
+	struct state_t *state;
+	fsal_openflags_t openflags;
+	struct vfs_fd *vfs_fd;
+	int fd;
+	bool has_lock;
+	bool closefd;
+};
+
+static fsal_status_t vfs_copy_get_fd(struct vfs_copy_fd *cfd)
+{
+	/* Acquire state's fdlock to prevent OPEN upgrade closing the
+	 * file descriptor while we use it.
+	 */
+	if (cfd->state) {
+		cfd->vfs_fd = &container_of(cfd->state, struct vfs_state_fd,
+					    state)->vfs_fd;
+
+		PTHREAD_RWLOCK_rdlock(&cfd->vfs_fd->fdlock);
+	}
+
+	return find_fd(&cfd->fd, cfd->obj_hdl, false, cfd->state,
+		       cfd->openflags, &cfd->has_lock, &cfd->closefd, false);
+}
+
+static void vfs_copy_put_fd(struct vfs_copy_fd *cfd)
+{
+	if (cfd->vfs_fd)
+		PTHREAD_RWLOCK_unlock(&cfd->vfs_fd->fdlock);
+
+	if (cfd->closefd)
+		vfs_fdcache_done(cfd->obj_hdl, cfd->openflags, cfd->fd);
+
+	if (cfd->has_lock)
+		PTHREAD_RWLOCK_unlock(&cfd->obj_hdl->obj_lock);
+}
+
+/**
+ * @brief Copy data from one file into another
+ *
+ * Done with copy_file_range(2), so the data does not come up to user
+ * space and filesystems that can share extents or copy on the storage
+ * do so.  The file descriptors are taken in address order of the
+ * handles, so that two copies going opposite ways between the same
+ * files don't deadlock on the obj_locks.
+ *
+ * @param[in]  dst_hdl    File to copy into
+ * @param[in]  dst_state  state_t to write with (or NULL)
+ * @param[in]  dst_offset Offset to write at
+ * @param[in]  src_hdl    File to copy from
+ * @param[in]  src_state  state_t to read with (or NULL)
+ * @param[in]  src_offset Offset to read from
+ * @param[in]  count      Bytes to copy
+ * @param[out] copied     Bytes copied
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_copy(struct fsal_obj_handle *dst_hdl,
+		       struct state_t *dst_state, uint64_t dst_offset,
+		       struct fsal_obj_handle *src_hdl,
+		       struct state_t *src_state, uint64_t src_offset,
+		       uint64_t count, uint64_t *copied)
+{
+#ifdef __NR_copy_file_range
+	struct vfs_copy_fd cfd[2] = {
+		{ .obj_hdl = src_hdl, .state = src_state,
+		  .openflags = FSAL_O_READ, .fd = -1 },
+		{ .obj_hdl = dst_hdl, .state = dst_state,
+		  .openflags = FSAL_O_WRITE, .fd = -1 },
+	};
+	int first = src_hdl < dst_hdl ? 0 : 1;
+	loff_t src_off = src_offset;
+	loff_t dst_off = dst_offset;
+	fsal_status_t status;
+	ssize_t nb_copied;
+	int retval;
+
+	/* Within one file the obj_lock would be taken twice, leave that to
+	 * read2 and write2.
+	 */
+	if (src_hdl == dst_hdl)
+		return fsalstat(ERR_FSAL_NOTSUPP, 0);
+
+	if (src_hdl->fsal != src_hdl->fs->fsal ||
+	    dst_hdl->fsal != dst_hdl->fs->fsal)
+		return fsalstat(posix2fsal_error(EXDEV), EXDEV);
+
+	status = vfs_copy_get_fd(&cfd[first]);
+
+	if (FSAL_IS_ERROR(status))
+		goto out_first;
+
+	status = vfs_copy_get_fd(&cfd[!first]);
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	if (!vfs_set_credentials(op_ctx->creds, dst_hdl->fsal)) {
+		status = fsalstat(ERR_FSAL_PERM, EPERM);
+		goto out;
+	}
+
+	nb_copied = syscall(__NR_copy_file_range, cfd[0].fd, &src_off,
+			    cfd[1].fd, &dst_off, (size_t) count, 0);
+
+	if (nb_copied == -1) {
+		retval = errno;
+		LogFullDebug(COMPONENT_FSAL,
+			     "copy_file_range returned %s (%d)",
+			     strerror(retval), retval);
+
+		if (retval == ENOSYS || retval == EXDEV ||
+		    retval == EOPNOTSUPP) {
+			/* Old kernel, or across filesystems */
+			status = fsalstat(ERR_FSAL_NOTSUPP, retval);
+		} else {
+			status = fsalstat(posix2fsal_error(retval), retval);
+		}
+	} else {
+		*copied = nb_copied;
+	}
+
+	vfs_restore_ganesha_credentials(dst_hdl->fsal);
+
+ out:
+
+	vfs_copy_put_fd(&cfd[!first]);
+
+ out_first:
+
+	vfs_copy_put_fd(&cfd[first]);
+
+	return status;
+#else
+	return fsalstat(ERR_FSAL_NOTSUPP, 0);
+#endif
+}
+
+/**
+ * @brief Share the blocks of a range of one file with another
+ *
+ * Done with the FICLONERANGE ioctl, which XFS with reflink, Btrfs and
+ * OCFS2 support.  Within one file a single descriptor open for both
+ * reading and writing is used; otherwise they are taken in address
+ * order of the handles as for vfs_copy.
+ *
+ * @param[in] dst_hdl    File to clone into
+ * @param[in] dst_state  state_t to write with (or NULL)
+ * @param[in] dst_offset Offset to clone at
+ * @param[in] src_hdl    File to clone from
+ * @param[in] src_state  state_t to read with (or NULL)
+ * @param[in] src_offset Offset to clone from
+ * @param[in] count      Bytes to clone, 0 for up to the end of the source
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_clone2(struct fsal_obj_handle *dst_hdl,
+			 struct state_t *dst_state, uint64_t dst_offset,
+			 struct fsal_obj_handle *src_hdl,
+			 struct state_t *src_state, uint64_t src_offset,
+			 uint64_t count)
+{
+#ifdef FICLONERANGE
+	struct vfs_copy_fd cfd[2] = {
+		{ .obj_hdl = src_hdl, .state = src_state,
+		  .openflags = FSAL_O_READ, .fd = -1 },
+		{ .obj_hdl = dst_hdl, .state = dst_state,
+		  .openflags = FSAL_O_WRITE, .fd = -1 },
+	};
+	bool same = src_hdl == dst_hdl;
+	int first = src_hdl < dst_hdl ? 0 : 1;
+	struct file_clone_range range;
+	fsal_status_t status;
+	int retval;
+
+	if (src_hdl->fsal != src_hdl->fs->fsal ||
+	    dst_hdl->fsal != dst_hdl->fs->fsal)
+		return fsalstat(posix2fsal_error(EXDEV), EXDEV);
+
+	if (same) {
+		/* One descriptor, and the obj_lock taken once */
+		cfd[1].openflags = FSAL_O_RDWR;
+		first = 1;
+	}
+
+	status = vfs_copy_get_fd(&cfd[first]);
+
+	if (FSAL_IS_ERROR(status))
+		goto out_first;
+
+	if (!same) {
+		status = vfs_copy_get_fd(&cfd[!first]);
+
+		if (FSAL_IS_ERROR(status))
+			goto out;
+	}
+
+	range.src_fd = same ? cfd[1].fd : cfd[0].fd;
+	range.src_offset = src_offset;
+	range.src_length = count;
+	range.dest_offset = dst_offset;
+
+	if (!vfs_set_credentials(op_ctx->creds, dst_hdl->fsal)) {
+		status = fsalstat(ERR_FSAL_PERM, EPERM);
+		goto out;
+	}
+
+	retval = ioctl(cfd[1].fd, FICLONERANGE, &range);
+
+	if (retval == -1) {
+		retval = errno;
+		LogFullDebug(COMPONENT_FSAL,
+			     "FICLONERANGE returned %s (%d)",
+			     strerror(retval), retval);
+
+		if (retval == EOPNOTSUPP || retval == ENOTTY ||
+		    retval == EXDEV) {
+			/* The filesystem can't share blocks */
+			status = fsalstat(ERR_FSAL_NOTSUPP, retval);
+		} else {
+			status = fsalstat(posix2fsal_error(retval), retval);
+		}
+	}
+
+	vfs_restore_ganesha_credentials(dst_hdl->fsal);
+
+ out:
+
+	if (!same)
+		vfs_copy_put_fd(&cfd[!first]);
+
+ out_first:
+
+	vfs_copy_put_fd(&cfd[first]);
+
+	return status;
+#else
+	return fsalstat(ERR_FSAL_NOTSUPP, 0);
 #endif
+}
 
 /**
  * @brief Commit written data
@@ -1602,22 +2528,18 @@ fsal_status_t vfs_commit2(struct fsal_obj_handle *obj_hdl,
 			goto out;
 		}
 
-		retval = fsync(out_fd->fd);
+		/* Shared with COMMITs of the file arriving meanwhile */
+		retval = vfs_commit_fd(myself, out_fd->fd);
 
-		if (retval == -1) {
-			retval = errno;
+		if (retval != 0)
 			status = fsalstat(posix2fsal_error(retval), retval);
-		}
 
 		vfs_restore_ganesha_credentials(obj_hdl->fsal);
 	}
 
 out:
-	if (closefd) {
-		LogFullDebug(COMPONENT_FSAL,
-			     "Closing Opened fd %d", out_fd->fd);
-		close(out_fd->fd);
-	}
+	if (closefd)
+		vfs_fdcache_done(obj_hdl, FSAL_O_WRITE, out_fd->fd);
 
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
@@ -1893,10 +2815,8 @@ fsal_status_t vfs_getattr2(struct fsal_obj_handle *obj_hdl,
 
  out:
 
-	if (closefd) {
-		LogFullDebug(COMPONENT_FSAL, "Closing Opened fd %d", my_fd);
-		close(my_fd);
-	}
+	if (closefd)
+		vfs_fdcache_done(obj_hdl, FSAL_O_ANY, my_fd);
 
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
@@ -2188,10 +3108,8 @@ fsal_status_t vfs_setattr2(struct fsal_obj_handle *obj_hdl,
 	if (vfs_fd)
 		PTHREAD_RWLOCK_unlock(&vfs_fd->fdlock);
 
-	if (closefd) {
-		LogFullDebug(COMPONENT_FSAL, "Closing Opened fd %d", my_fd);
-		close(my_fd);
-	}
+	if (closefd)
+		vfs_fdcache_done(obj_hdl, openflags, my_fd);
 
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
@@ -2228,6 +3146,13 @@ fsal_status_t vfs_close2(struct fsal_obj_handle *obj_hdl,
 	    state->state_type == STATE_TYPE_NLM_SHARE ||
 	    state->state_type == STATE_TYPE_9P_FID) {
 		/* This is a share state, we must update the share counters */
+		fsal_status_t status;
+
+		if (update_share_counters_shared(obj_hdl,
+						 &myself->u.file.share,
+						 my_fd->openflags,
+						 FSAL_O_CLOSED, &status))
+			return vfs_close_my_fd(my_fd);
 
 		/* This can block over an I/O operation. */
 		PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
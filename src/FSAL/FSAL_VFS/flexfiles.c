@@ -0,0 +1,676 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/* flexfiles.c
+ * VFS pNFS metadata server handing out flex files layouts
+ *
+ * The data servers are Ganesha heads exporting the same shared
+ * filesystem under the same Export_Id, this one among them if it is
+ * listed.  A layout sends a client to one of them with the NFSv3 handle
+ * of the file, which every head decodes the same way, so reads and
+ * writes go straight to that head and the bandwidth of a file set
+ * scales past a single server.  The data servers are loosely coupled:
+ * they check the client's AUTH_SYS credentials as for any NFSv3 I/O, so
+ * only exports a client may use with AUTH_SYS give it layouts.  Clients
+ * send LAYOUTCOMMIT once they wrote, which is applied to the file here
+ * and tells MDCACHE its attributes are stale.
+ *
+ * Each layout goes to the data server with the least load, weighed by
+ * the layouts it has out and the latency clients report for it with
+ * LAYOUTSTATS.  One that a client reports a LAYOUTERROR for is left
+ * alone for Flex_Files_Fail_Time seconds.
+ */
+
+#include "config.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "gsh_list.h"
+#include "fsal.h"
+#include "fsal_convert.h"
+#include "pnfs_utils.h"
+#include "nfs_file_handle.h"
+#include "nfs_exports.h"
+#include "vfs_methods.h"
+
+/** Latency charged to a data server before any LAYOUTSTATS, in ns */
+#define VFS_FF_BASE_LATENCY 100000
+
+/** Stripe unit of the layouts; only one data server, so it is moot */
+#define VFS_FF_STRIPE_UNIT 0x400000
+
+static inline struct vfs_fsal_module *vfs_ff_module(struct fsal_module *fsal)
+{
+	return container_of(fsal, struct vfs_fsal_module, module);
+}
+
+/* Flex_Files_DS config blocks */
+
+struct config_item vfs_ff_ds_params[] = {
+	CONF_MAND_IP_ADDR("Address", "0.0.0.0", vfs_ff_ds, addr),
+	CONF_ITEM_UI16("Port", 1, UINT16_MAX, 2049, vfs_ff_ds, port),
+	CONFIG_EOL
+};
+
+/**
+ * @brief Allocate, or free, a Flex_Files_DS block
+ *
+ * @param[in] link_mem    ff_servers of the module, NULL at defaults
+ * @param[in] self_struct The block, NULL to allocate one
+ *
+ * @return The block, or NULL once freed.
+ */
+void *vfs_ff_ds_init(void *link_mem, void *self_struct)
+{
+	struct vfs_ff_ds *ds;
+
+	if (link_mem == NULL) {
+		/* Setting defaults, self_struct is the list */
+		glist_init(self_struct);
+		return self_struct;
+	} else if (self_struct == NULL) {
+		ds = gsh_calloc(1, sizeof(*ds));
+		glist_init(&ds->list);
+		return ds;
+	}
+
+	gsh_free(self_struct);
+	return NULL;
+}
+
+/**
+ * @brief Add a Flex_Files_DS block to the data servers
+ *
+ * Data servers are given device ids in the order they are configured.
+ *
+ * @param[in] node        Config node
+ * @param[in] link_mem    ff_servers of the module
+ * @param[in] self_struct The block
+ * @param[in] err_type    Error reporting
+ *
+ * @return 0, or the number of errors.
+ */
+int vfs_ff_ds_commit(void *node, void *link_mem, void *self_struct,
+		     struct config_error_type *err_type)
+{
+	struct glist_head *servers = link_mem;
+	struct vfs_ff_ds *ds = self_struct;
+	struct sockaddr_in *sin = (struct sockaddr_in *)&ds->addr;
+	struct glist_head *glist;
+	uint32_t addr;
+
+	if (ds->addr.ss_family != AF_INET) {
+		LogCrit(COMPONENT_CONFIG,
+			"Flex_Files_DS Address must be IPv4");
+		err_type->invalid = true;
+		return 1;
+	}
+
+	addr = ntohl(sin->sin_addr.s_addr);
+	(void) snprintf(ds->uaddr, sizeof(ds->uaddr), "%u.%u.%u.%u.%u.%u",
+			addr >> 24, (addr >> 16) & 0xff, (addr >> 8) & 0xff,
+			addr & 0xff, ds->port >> 8, ds->port & 0xff);
+
+	ds->id = 1;
+	glist_for_each(glist, servers)
+		ds->id++;
+
+	glist_add_tail(servers, &ds->list);
+	return 0;
+}
+
+/* Data server selection */
+
+static inline uint64_t vfs_ff_nsecs(const nfstime4 *t)
+{
+	if (t->seconds < 0)
+		return 0;
+
+	return t->seconds * NS_PER_SEC + t->nseconds;
+}
+
+/**
+ * @brief Find a data server by its device id
+ *
+ * @param[in] module   Our module
+ * @param[in] deviceid The device
+ *
+ * @return The data server, or NULL.
+ */
+static struct vfs_ff_ds *vfs_ff_ds_by_id(struct vfs_fsal_module *module,
+					 const struct pnfs_deviceid *deviceid)
+{
+	struct glist_head *glist;
+	struct vfs_ff_ds *ds;
+
+	if (deviceid->fsal_id != FSAL_ID_VFS)
+		return NULL;
+
+	glist_for_each(glist, &module->ff_servers) {
+		ds = glist_entry(glist, struct vfs_ff_ds, list);
+		if (ds->id == deviceid->devid)
+			return ds;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Find a data server by the universal address clients use
+ *
+ * @param[in] module Our module
+ * @param[in] uaddr  r_addr of a netaddr4
+ *
+ * @return The data server, or NULL.
+ */
+static struct vfs_ff_ds *vfs_ff_ds_by_uaddr(struct vfs_fsal_module *module,
+					    const char *uaddr)
+{
+	struct glist_head *glist;
+	struct vfs_ff_ds *ds;
+
+	if (uaddr == NULL)
+		return NULL;
+
+	glist_for_each(glist, &module->ff_servers) {
+		ds = glist_entry(glist, struct vfs_ff_ds, list);
+		if (strcmp(ds->uaddr, uaddr) == 0)
+			return ds;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Pick the data server for a new layout
+ *
+ * The load of a data server is its reported latency times the layouts
+ * it has out, one more for the one being granted.  Those that failed
+ * recently are passed over.
+ *
+ * @param[in] module Our module
+ *
+ * @return The least loaded data server, or NULL if none is usable.
+ */
+static struct vfs_ff_ds *vfs_ff_pick(struct vfs_fsal_module *module)
+{
+	struct vfs_ff_ds *best = NULL;
+	uint64_t best_load = UINT64_MAX;
+	uint64_t now_sec = time(NULL);
+	struct glist_head *glist;
+
+	glist_for_each(glist, &module->ff_servers) {
+		struct vfs_ff_ds *ds =
+			glist_entry(glist, struct vfs_ff_ds, list);
+		uint64_t failed = atomic_fetch_uint64_t(&ds->failed);
+		uint64_t load;
+
+		if (failed != 0 && now_sec < failed + module->ff_fail_time)
+			continue;
+
+		load = (atomic_fetch_uint64_t(&ds->latency) +
+			VFS_FF_BASE_LATENCY) *
+		       (atomic_fetch_uint32_t(&ds->layouts) + 1);
+
+		if (load < best_load) {
+			best = ds;
+			best_load = load;
+		}
+	}
+
+	return best;
+}
+
+/* Export operations */
+
+/**
+ * @brief Layout types we hand out
+ *
+ * @param[in]  exp_hdl Our export
+ * @param[out] count   Number of layout types
+ * @param[out] types   Static array of layout types
+ */
+static void vfs_ff_layouttypes(struct fsal_export *exp_hdl, int32_t *count,
+			       const layouttype4 **types)
+{
+	static const layouttype4 supported_layout_type = LAYOUT4_FLEX_FILES;
+
+	*types = &supported_layout_type;
+	*count = 1;
+}
+
+/**
+ * @brief Layout block size
+ *
+ * @param[in] exp_hdl Our export
+ *
+ * @return The stripe unit.
+ */
+static uint32_t vfs_ff_layout_blocksize(struct fsal_export *exp_hdl)
+{
+	return VFS_FF_STRIPE_UNIT;
+}
+
+/**
+ * @brief Maximum number of segments we will use
+ *
+ * @param[in] exp_hdl Our export
+ *
+ * @return 1, a layout covers the whole file.
+ */
+static uint32_t vfs_ff_maximum_segments(struct fsal_export *exp_hdl)
+{
+	return 1;
+}
+
+/**
+ * @brief Size of the buffer needed for a loc_body
+ *
+ * One data server, with an NFSv3 handle and two numeric ids.
+ *
+ * @param[in] exp_hdl Our export
+ *
+ * @return Size of the buffer needed for a loc_body
+ */
+static size_t vfs_ff_loc_body_size(struct fsal_export *exp_hdl)
+{
+	return 0x100;
+}
+
+/* Module operations */
+
+/**
+ * @brief Size of the buffer needed for a da_addr
+ *
+ * One netaddr4 and one ff_device_versions4.
+ *
+ * @param[in] fsal_hdl Our module
+ *
+ * @return Size of the buffer needed for a da_addr
+ */
+static size_t vfs_ff_da_addr_size(struct fsal_module *fsal_hdl)
+{
+	return 0x80;
+}
+
+/**
+ * @brief Describe a data server to the client
+ *
+ * @param[in]  fsal_hdl     Our module
+ * @param[out] da_addr_body Stream we write the result to
+ * @param[in]  type         Type of layout that gave the device
+ * @param[in]  deviceid     The device to look up
+ *
+ * @return Valid error codes in RFC 5661, p. 365.
+ */
+static nfsstat4 vfs_ff_getdeviceinfo(struct fsal_module *fsal_hdl,
+				     XDR *da_addr_body,
+				     const layouttype4 type,
+				     const struct pnfs_deviceid *deviceid)
+{
+	struct vfs_fsal_module *module = vfs_ff_module(fsal_hdl);
+	struct vfs_ff_ds *ds;
+	fsal_multipath_member_t host;
+
+	if (type != LAYOUT4_FLEX_FILES) {
+		LogMajor(COMPONENT_PNFS, "Unsupported layout type: %x", type);
+		return NFS4ERR_UNKNOWN_LAYOUTTYPE;
+	}
+
+	ds = vfs_ff_ds_by_id(module, deviceid);
+	if (ds == NULL)
+		return NFS4ERR_NOENT;
+
+	host.proto = IPPROTO_TCP;
+	host.addr = ntohl(((struct sockaddr_in *)&ds->addr)->sin_addr.s_addr);
+	host.port = ds->port;
+
+	return FSAL_encode_ff_device_versions4(da_addr_body, 1, 1, &host,
+				NFS_V3, 0,
+				MIN(fsal_hdl->fs_info.maxread, UINT32_MAX),
+				MIN(fsal_hdl->fs_info.maxwrite, UINT32_MAX),
+				false);
+}
+
+/* Object operations */
+
+/**
+ * @brief Grant a layout of the whole file on one data server
+ *
+ * The layout carries the uid and gid of the caller for the data server
+ * to use with AUTH_SYS.  A client that may not use AUTH_SYS on the
+ * export gets no layout and does its I/O through us with its own
+ * flavor.
+ *
+ * @param[in]     obj_hdl  The file
+ * @param[in]     req_ctx  Request context
+ * @param[out]    loc_body Stream the ff_layout4 is encoded to
+ * @param[in]     arg      Input arguments of the function
+ * @param[in,out] res      In/out and output arguments of the function
+ *
+ * @return Valid error codes in RFC 5661, pp. 366-7.
+ */
+static nfsstat4 vfs_ff_layoutget(struct fsal_obj_handle *obj_hdl,
+				 struct req_op_context *req_ctx,
+				 XDR *loc_body,
+				 const struct fsal_layoutget_arg *arg,
+				 struct fsal_layoutget_res *res)
+{
+	struct vfs_fsal_module *module = vfs_ff_module(obj_hdl->fsal);
+	struct pnfs_deviceid deviceid = DEVICE_ID_INIT_ZERO(FSAL_ID_VFS);
+	fsal_ff_ds_member_t member;
+	char fh_buf[NFS3_FHSIZE];
+	nfs_fh3 fh3;
+	struct vfs_ff_ds *ds;
+	nfsstat4 nfs_status;
+
+	if (arg->type != LAYOUT4_FLEX_FILES) {
+		LogMajor(COMPONENT_PNFS, "Unsupported layout type: %x",
+			 arg->type);
+		return NFS4ERR_UNKNOWN_LAYOUTTYPE;
+	}
+
+	if (!(op_ctx->export_perms->options & EXPORT_OPTION_AUTH_UNIX)) {
+		LogDebug(COMPONENT_PNFS,
+			 "No layout, export does not allow AUTH_SYS");
+		return NFS4ERR_LAYOUTUNAVAILABLE;
+	}
+
+	ds = vfs_ff_pick(module);
+	if (ds == NULL) {
+		/* I/O goes through us until a data server recovers */
+		return NFS4ERR_LAYOUTUNAVAILABLE;
+	}
+
+	fh3.data.data_val = fh_buf;
+	if (!nfs3_FSALToFhandle(false, &fh3, obj_hdl, req_ctx->ctx_export))
+		return NFS4ERR_SERVERFAULT;
+
+	deviceid.devid = ds->id;
+
+	memset(&member, 0, sizeof(member));
+	member.deviceid = deviceid;
+	member.fh.addr = fh3.data.data_val;
+	member.fh.len = fh3.data.data_len;
+	member.uid = req_ctx->creds->caller_uid;
+	member.gid = req_ctx->creds->caller_gid;
+
+	nfs_status = FSAL_encode_ff_layout(loc_body, VFS_FF_STRIPE_UNIT,
+					   1, &member, 0,
+					   module->ff_stats_hint);
+	if (nfs_status != NFS4_OK)
+		return nfs_status;
+
+	(void) atomic_inc_uint32_t(&ds->layouts);
+
+	res->segment.offset = 0;
+	res->segment.length = NFS4_UINT64_MAX;
+	res->fsal_seg_data = ds;
+	res->return_on_close = true;
+	res->last_segment = true;
+
+	LogFullDebug(COMPONENT_PNFS, "Layout of %p on data server %" PRIu32,
+		     obj_hdl, ds->id);
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Return a layout segment
+ *
+ * @param[in] obj_hdl  The file
+ * @param[in] req_ctx  Request context
+ * @param[in] lrf_body Nothing for us
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return Valid error codes in RFC 5661, p. 367.
+ */
+static nfsstat4 vfs_ff_layoutreturn(struct fsal_obj_handle *obj_hdl,
+				    struct req_op_context *req_ctx,
+				    XDR *lrf_body,
+				    const struct fsal_layoutreturn_arg *arg)
+{
+	struct vfs_ff_ds *ds = arg->fsal_seg_data;
+
+	if (arg->lo_type != LAYOUT4_FLEX_FILES) {
+		LogDebug(COMPONENT_PNFS, "Unsupported layout type: %x",
+			 arg->lo_type);
+		return NFS4ERR_UNKNOWN_LAYOUTTYPE;
+	}
+
+	if (arg->dispose && ds != NULL)
+		(void) atomic_dec_uint32_t(&ds->layouts);
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Commit a layout segment
+ *
+ * The data servers wrote the file itself, but another head of the
+ * shared filesystem may not show the size and mtime yet.  The file is
+ * grown to the last byte the client wrote and its mtime moved to the
+ * client's if those are later; MDCACHE drops the attributes it had.
+ *
+ * @param[in]     obj_hdl  The file
+ * @param[in]     req_ctx  Request context
+ * @param[in]     lou_body Nothing for us
+ * @param[in]     arg      Input arguments of the function
+ * @param[in,out] res      In/out and output arguments of the function
+ *
+ * @return Valid error codes in RFC 5661, p. 366.
+ */
+static nfsstat4 vfs_ff_layoutcommit(struct fsal_obj_handle *obj_hdl,
+				    struct req_op_context *req_ctx,
+				    XDR *lou_body,
+				    const struct fsal_layoutcommit_arg *arg,
+				    struct fsal_layoutcommit_res *res)
+{
+	struct vfs_fsal_obj_handle *myself =
+		container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
+	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
+	struct timespec times[2];
+	struct stat st;
+	int fd, retval = 0;
+
+	if (arg->type != LAYOUT4_FLEX_FILES)
+		return NFS4ERR_UNKNOWN_LAYOUTTYPE;
+
+	res->commit_done = true;
+
+	if (!arg->new_offset && !arg->time_changed)
+		return NFS4_OK;
+
+	fd = vfs_fsal_open(myself, O_WRONLY, &fsal_error);
+	if (fd < 0) {
+		LogDebug(COMPONENT_PNFS, "open for LAYOUTCOMMIT failed %s",
+			 strerror(-fd));
+		return posix2nfs4_error(-fd);
+	}
+
+	if (fstat(fd, &st) < 0) {
+		retval = errno;
+		goto out;
+	}
+
+	if (arg->new_offset && arg->last_write >= (uint64_t) st.st_size) {
+		if (ftruncate(fd, arg->last_write + 1) < 0) {
+			retval = errno;
+			goto out;
+		}
+		res->size_supplied = true;
+		res->new_size = arg->last_write + 1;
+	}
+
+	if (arg->time_changed &&
+	    (arg->new_time.seconds > st.st_mtim.tv_sec ||
+	     (arg->new_time.seconds == st.st_mtim.tv_sec &&
+	      arg->new_time.nseconds > st.st_mtim.tv_nsec))) {
+		times[0].tv_sec = 0;
+		times[0].tv_nsec = UTIME_OMIT;
+		times[1].tv_sec = arg->new_time.seconds;
+		times[1].tv_nsec = arg->new_time.nseconds;
+		if (futimens(fd, times) < 0)
+			retval = errno;
+	}
+
+out:
+	close(fd);
+
+	if (retval != 0) {
+		LogDebug(COMPONENT_PNFS, "LAYOUTCOMMIT of %p failed %s",
+			 obj_hdl, strerror(retval));
+		return posix2nfs4_error(retval);
+	}
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Weigh a data server by the latency a client saw
+ *
+ * The ff_layoutupdate4 names the data server by address and gives the
+ * time its I/Os took to complete, which is folded into its average.
+ *
+ * @param[in] obj_hdl  The file
+ * @param[in] req_ctx  Request context
+ * @param[in] lou_body The ff_layoutupdate4
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return Valid error codes in RFC 7862, p. 79.
+ */
+static nfsstat4 vfs_ff_layoutstats(struct fsal_obj_handle *obj_hdl,
+				   struct req_op_context *req_ctx,
+				   XDR *lou_body,
+				   const struct fsal_layoutstats_arg *arg)
+{
+	struct vfs_fsal_module *module = vfs_ff_module(obj_hdl->fsal);
+	ff_layoutupdate4 update;
+	struct vfs_ff_ds *ds;
+	uint64_t ops, busy, latency, old;
+
+	if (arg->type != LAYOUT4_FLEX_FILES)
+		return NFS4ERR_UNKNOWN_LAYOUTTYPE;
+
+	memset(&update, 0, sizeof(update));
+	if (!xdr_ff_layoutupdate4(lou_body, &update)) {
+		xdr_free((xdrproc_t) xdr_ff_layoutupdate4, &update);
+		return NFS4ERR_BADXDR;
+	}
+
+	ds = vfs_ff_ds_by_uaddr(module, update.ffl_addr.r_addr);
+	ops = update.ffl_read.ffil_ops_completed +
+	      update.ffl_write.ffil_ops_completed;
+
+	if (ds != NULL && ops != 0) {
+		busy = vfs_ff_nsecs(
+			&update.ffl_read.ffil_aggregate_completion_time) +
+		       vfs_ff_nsecs(
+			&update.ffl_write.ffil_aggregate_completion_time);
+		latency = busy / ops;
+
+		/* Moving average, weighing the new figure a quarter */
+		old = atomic_fetch_uint64_t(&ds->latency);
+		if (old != 0)
+			latency = (old * 3 + latency) / 4;
+		atomic_store_uint64_t(&ds->latency, latency);
+
+		LogFullDebug(COMPONENT_PNFS,
+			     "Data server %" PRIu32 " latency %" PRIu64 " ns",
+			     ds->id, latency);
+	}
+
+	xdr_free((xdrproc_t) xdr_ff_layoutupdate4, &update);
+	return NFS4_OK;
+}
+
+/**
+ * @brief Set a data server aside after a client failed I/O to it
+ *
+ * @param[in] obj_hdl  The file
+ * @param[in] req_ctx  Request context
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return Valid error codes in RFC 7862, p. 78.
+ */
+static nfsstat4 vfs_ff_layouterror(struct fsal_obj_handle *obj_hdl,
+				   struct req_op_context *req_ctx,
+				   const struct fsal_layouterror_arg *arg)
+{
+	struct vfs_fsal_module *module = vfs_ff_module(obj_hdl->fsal);
+	struct vfs_ff_ds *ds;
+
+	if (arg->type != LAYOUT4_FLEX_FILES)
+		return NFS4ERR_UNKNOWN_LAYOUTTYPE;
+
+	ds = vfs_ff_ds_by_id(module, &arg->deviceid);
+	if (ds == NULL || arg->status == NFS4_OK)
+		return NFS4_OK;
+
+	LogInfo(COMPONENT_PNFS,
+		"Data server %" PRIu32 " (%s) failed op %d with %d",
+		ds->id, ds->uaddr, arg->opnum, arg->status);
+
+	atomic_store_uint64_t(&ds->failed, time(NULL));
+	return NFS4_OK;
+}
+
+/**
+ * @brief Make an export a flex files metadata server
+ *
+ * @param[in] myself      The export
+ * @param[in] export_path Its path, for logging
+ */
+void vfs_ff_init_ops(struct vfs_fsal_export *myself, const char *export_path)
+{
+	struct fsal_module *fsal = myself->export.fsal;
+	struct vfs_fsal_module *module = vfs_ff_module(fsal);
+
+	if (glist_empty(&module->ff_servers)) {
+		LogWarn(COMPONENT_PNFS,
+			"PNFS_MDS is set but no Flex_Files_DS is, no layouts for [%s]",
+			export_path);
+		return;
+	}
+
+	LogInfo(COMPONENT_PNFS, "Flex files layouts enabled for [%s]",
+		export_path);
+
+	myself->export.exp_ops.fs_layouttypes = vfs_ff_layouttypes;
+	myself->export.exp_ops.fs_layout_blocksize = vfs_ff_layout_blocksize;
+	myself->export.exp_ops.fs_maximum_segments = vfs_ff_maximum_segments;
+	myself->export.exp_ops.fs_loc_body_size = vfs_ff_loc_body_size;
+
+	fsal->m_ops.getdeviceinfo = vfs_ff_getdeviceinfo;
+	fsal->m_ops.fs_da_addr_size = vfs_ff_da_addr_size;
+
+	module->handle_ops.layoutget = vfs_ff_layoutget;
+	module->handle_ops.layoutreturn = vfs_ff_layoutreturn;
+	module->handle_ops.layoutcommit = vfs_ff_layoutcommit;
+	module->handle_ops.layoutstats = vfs_ff_layoutstats;
+	module->handle_ops.layouterror = vfs_ff_layouterror;
+}
@@ -0,0 +1,581 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/* gather.c
+ * VFS write gathering and COMMIT batching
+ *
+ * Clients stream a file as many UNSTABLE WRITEs in flight at once, each
+ * of which would otherwise be its own pwritev.  With Write_Gather, one
+ * thread at a time writes a file; writes arriving meanwhile wait, and
+ * the next writer takes those adjacent to its own along in a single
+ * pwritev, completing them all.  A write that can't be merged, or whose
+ * part of a merged write came up short, is written on its own.
+ *
+ * COMMITs of a file share fsyncs: one arriving while an fsync runs waits
+ * for the next to start, and every COMMIT waiting by then is answered
+ * by that one.
+ *
+ * With Commit_Batch_Window, COMMITs are also batched per filesystem.  A
+ * COMMIT arriving while others on the filesystem are in progress
+ * gathers those coming in for the window, then the batch is flushed
+ * together: by a single syncfs once it holds Commit_Syncfs_Threshold
+ * COMMITs, or else by each COMMIT's own fsync, all at once.  The
+ * gathering is done by the first COMMIT of the batch rather than a
+ * thread of its own, its worker is waiting for it anyway.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "gsh_list.h"
+#include "fsal.h"
+#include "vfs_methods.h"
+
+/** Most writes merged into one pwritev */
+#define VFS_GATHER_MAX_WRITES 64
+
+enum vfs_gather_state {
+	VFS_GATHER_QUEUED,	/*< Waiting for the writer */
+	VFS_GATHER_LEAD,	/*< Writer now, take the others along */
+	VFS_GATHER_DONE,	/*< Written as part of a merged write */
+	VFS_GATHER_SELF,	/*< Not written, write it alone */
+};
+
+/** A write waiting on a file, on the stack of its caller */
+struct vfs_gather_write {
+	struct glist_head list;		/*< On vfs_file_io writes */
+	struct fsal_io_arg *arg;
+	const struct user_cred *creds;
+	uint64_t offset;
+	size_t len;
+	ssize_t written;
+	enum vfs_gather_state state;
+};
+
+/**
+ * @brief Set up the I/O state of a regular file
+ *
+ * @param[in] hdl  The file
+ */
+void vfs_file_io_init(struct vfs_fsal_obj_handle *hdl)
+{
+	struct vfs_file_io *io = &hdl->u.file.io;
+
+	PTHREAD_MUTEX_init(&io->mtx, NULL);
+	PTHREAD_COND_init(&io->cond, NULL);
+	glist_init(&io->writes);
+	io->writing = false;
+	io->syncing = false;
+	io->syncs_started = 0;
+	io->syncs_done = 0;
+	io->sync_error = 0;
+	io->direct_next = 0;
+}
+
+/**
+ * @brief Tear down the I/O state of a regular file
+ *
+ * @param[in] hdl  The file
+ */
+void vfs_file_io_fini(struct vfs_fsal_obj_handle *hdl)
+{
+	struct vfs_file_io *io = &hdl->u.file.io;
+
+	PTHREAD_MUTEX_destroy(&io->mtx);
+	PTHREAD_COND_destroy(&io->cond);
+}
+
+/* Writes are only merged for the same user, who pays for the blocks */
+static bool vfs_gather_same_creds(const struct user_cred *a,
+				  const struct user_cred *b)
+{
+	return a->caller_uid == b->caller_uid &&
+	       a->caller_gid == b->caller_gid &&
+	       a->caller_glen == b->caller_glen &&
+	       (a->caller_glen == 0 ||
+		memcmp(a->caller_garray, b->caller_garray,
+		       a->caller_glen * sizeof(gid_t)) == 0);
+}
+
+/**
+ * @brief Write a batch of waiting writes along with our own
+ *
+ * Called with io->mtx held and io->writing set, which drops the mutex
+ * over the pwritev.  Hands io->writing on to the first write still
+ * waiting, if any.
+ *
+ * @param[in]     io    I/O state of the file
+ * @param[in]     fd    Descriptor of the writer
+ * @param[in,out] self  Write of the writer, DONE or SELF on return
+ */
+static void vfs_gather_lead(struct vfs_file_io *io, int fd,
+			    struct vfs_gather_write *self)
+{
+	struct vfs_gather_write *batch[VFS_GATHER_MAX_WRITES];
+	struct vfs_gather_write *w;
+	struct glist_head *glist, *glistn;
+	struct iovec *iov;
+	uint64_t start = self->offset, end = self->offset + self->len;
+	int iovcnt = self->arg->iov_count;
+	int n = 1, first = 0, i, j, k;
+	ssize_t written;
+	bool found;
+
+	/* batch[first..first + n) is in file order, with room both ways */
+	first = VFS_GATHER_MAX_WRITES / 2;
+	batch[first] = self;
+
+	do {
+		found = false;
+		glist_for_each_safe(glist, glistn, &io->writes) {
+			w = glist_entry(glist, struct vfs_gather_write, list);
+
+			if (iovcnt + w->arg->iov_count > IOV_MAX ||
+			    !vfs_gather_same_creds(w->creds, self->creds))
+				continue;
+
+			if (w->offset == end &&
+			    first + n < VFS_GATHER_MAX_WRITES) {
+				batch[first + n] = w;
+				end += w->len;
+			} else if (w->offset + w->len == start && first > 0) {
+				batch[--first] = w;
+				start = w->offset;
+			} else {
+				continue;
+			}
+
+			glist_del(&w->list);
+			iovcnt += w->arg->iov_count;
+			n++;
+			found = true;
+		}
+	} while (found);
+
+	PTHREAD_MUTEX_unlock(&io->mtx);
+
+	if (n == 1) {
+		iov = self->arg->iov;
+	} else {
+		iov = gsh_malloc(iovcnt * sizeof(*iov));
+		for (i = first, k = 0; i < first + n; i++)
+			for (j = 0; j < batch[i]->arg->iov_count; j++)
+				iov[k++] = batch[i]->arg->iov[j];
+	}
+
+	written = pwritev(fd, iov, iovcnt, start);
+
+	if (n != 1)
+		gsh_free(iov);
+
+	PTHREAD_MUTEX_lock(&io->mtx);
+
+	if (n == 1 && written < 0) {
+		/* Try again alone, which leaves errno for our caller */
+		self->state = VFS_GATHER_SELF;
+	} else if (n == 1) {
+		self->written = written;
+		self->state = VFS_GATHER_DONE;
+	} else {
+		/* Complete those written in full, the rest go again alone */
+		for (i = first; i < first + n; i++) {
+			w = batch[i];
+			if (written >= (ssize_t) w->len) {
+				w->written = w->len;
+				w->state = VFS_GATHER_DONE;
+				written -= w->len;
+			} else {
+				w->state = VFS_GATHER_SELF;
+				written = 0;
+			}
+		}
+	}
+
+	w = glist_first_entry(&io->writes, struct vfs_gather_write, list);
+	if (w != NULL) {
+		glist_del(&w->list);
+		w->state = VFS_GATHER_LEAD;
+	} else {
+		io->writing = false;
+	}
+
+	pthread_cond_broadcast(&io->cond);
+}
+
+/**
+ * @brief Write, merged with adjacent writes of the same file
+ *
+ * @param[in]     hdl  File written
+ * @param[in]     fd   Descriptor open for writing
+ * @param[in,out] arg  The write
+ *
+ * @return Bytes written, or -1 with errno set.
+ */
+ssize_t vfs_gather_write(struct vfs_fsal_obj_handle *hdl, int fd,
+			 struct fsal_io_arg *arg)
+{
+	struct vfs_file_io *io = &hdl->u.file.io;
+	struct vfs_gather_write self;
+	int i;
+
+	memset(&self, 0, sizeof(self));
+	self.arg = arg;
+	self.creds = op_ctx->creds;
+	self.offset = arg->offset;
+	for (i = 0; i < arg->iov_count; i++)
+		self.len += arg->iov[i].iov_len;
+	self.state = VFS_GATHER_QUEUED;
+
+	PTHREAD_MUTEX_lock(&io->mtx);
+
+	if (io->writing) {
+		glist_add_tail(&io->writes, &self.list);
+		while (self.state == VFS_GATHER_QUEUED)
+			pthread_cond_wait(&io->cond, &io->mtx);
+	} else {
+		io->writing = true;
+	}
+
+	if (self.state != VFS_GATHER_DONE && self.state != VFS_GATHER_SELF)
+		vfs_gather_lead(io, fd, &self);
+
+	PTHREAD_MUTEX_unlock(&io->mtx);
+
+	if (self.state == VFS_GATHER_DONE)
+		return self.written;
+
+	return pwritev(fd, arg->iov, arg->iov_count, arg->offset);
+}
+
+/**
+ * @brief fsync a file, sharing the fsync with concurrent COMMITs
+ *
+ * An fsync already running may have missed writes completed before we
+ * were called, so only one started after counts.
+ *
+ * @param[in] hdl  File to commit
+ * @param[in] fd   Descriptor open on it
+ *
+ * @return 0 or the errno of the fsync.
+ */
+static int vfs_commit_file(struct vfs_fsal_obj_handle *hdl, int fd)
+{
+	struct vfs_file_io *io = &hdl->u.file.io;
+	uint64_t need, mine;
+	int rc;
+
+	PTHREAD_MUTEX_lock(&io->mtx);
+
+	need = io->syncs_started + 1;
+
+	while (io->syncs_done < need) {
+		if (io->syncing) {
+			pthread_cond_wait(&io->cond, &io->mtx);
+			continue;
+		}
+
+		io->syncing = true;
+		mine = ++io->syncs_started;
+		PTHREAD_MUTEX_unlock(&io->mtx);
+
+		rc = fsync(fd) == -1 ? errno : 0;
+
+		PTHREAD_MUTEX_lock(&io->mtx);
+		io->syncs_done = mine;
+		io->sync_error = rc;
+		io->syncing = false;
+		pthread_cond_broadcast(&io->cond);
+	}
+
+	rc = io->sync_error;
+
+	PTHREAD_MUTEX_unlock(&io->mtx);
+
+	return rc;
+}
+
+/** A COMMIT in a filesystem batch, on the stack of its caller */
+struct vfs_commit_wait {
+	struct glist_head list;		/*< On vfs_commit_batch waiting */
+	int rc;
+	bool done;			/*< Flushed by syncfs, rc is set */
+	bool released;			/*< Left to fsync the file itself */
+};
+
+/** COMMIT counters, for GetFSALStats */
+static struct {
+	pthread_mutex_t mtx;
+	uint64_t commits;
+	nsecs_elapsed_t latency;	/*< Total */
+	nsecs_elapsed_t min;
+	nsecs_elapsed_t max;
+	uint64_t batches;		/*< Batches of more than one COMMIT */
+	uint64_t batched;		/*< COMMITs in them */
+	uint64_t syncfs;		/*< Batches flushed by syncfs */
+} commit_stats = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/**
+ * @brief Set up the COMMIT batch of a filesystem
+ *
+ * @param[in] batch  Batch to set up
+ */
+void vfs_commit_batch_init(struct vfs_commit_batch *batch)
+{
+	PTHREAD_MUTEX_init(&batch->mtx, NULL);
+	PTHREAD_COND_init(&batch->cond, NULL);
+	glist_init(&batch->waiting);
+	batch->nwaiting = 0;
+	batch->inflight = 0;
+	batch->collecting = false;
+}
+
+/**
+ * @brief Tear down the COMMIT batch of a filesystem
+ *
+ * @param[in] batch  Batch to tear down
+ */
+void vfs_commit_batch_fini(struct vfs_commit_batch *batch)
+{
+	PTHREAD_MUTEX_destroy(&batch->mtx);
+	PTHREAD_COND_destroy(&batch->cond);
+}
+
+/**
+ * @brief Flush a batch of COMMITs
+ *
+ * Called with batch->mtx held, which is dropped over a syncfs.
+ *
+ * @param[in] vfs_fs  Filesystem of the batch
+ * @param[in] list    COMMITs of the batch, ours among them
+ * @param[in] n       How many
+ * @param[in] module  Our module, for the settings
+ */
+static void vfs_commit_flush(struct vfs_filesystem *vfs_fs,
+			     struct glist_head *list, uint32_t n,
+			     struct vfs_fsal_module *module)
+{
+	struct vfs_commit_batch *batch = &vfs_fs->commits;
+	struct vfs_commit_wait *w;
+	struct glist_head *glist, *glistn;
+	bool use_syncfs = false;
+	int rc = 0;
+
+#ifdef LINUX
+	use_syncfs = module->commit_syncfs_threshold != 0 &&
+		     n >= module->commit_syncfs_threshold &&
+		     vfs_fs->root_fd >= 0;
+#endif
+
+	if (use_syncfs) {
+		PTHREAD_MUTEX_unlock(&batch->mtx);
+#ifdef LINUX
+		rc = syncfs(vfs_fs->root_fd) == -1 ? errno : 0;
+#endif
+		PTHREAD_MUTEX_lock(&batch->mtx);
+	}
+
+	glist_for_each_safe(glist, glistn, list) {
+		w = glist_entry(glist, struct vfs_commit_wait, list);
+		glist_del(&w->list);
+		if (use_syncfs) {
+			w->rc = rc;
+			w->done = true;
+		} else {
+			w->released = true;
+		}
+	}
+
+	pthread_cond_broadcast(&batch->cond);
+
+	if (n > 1) {
+		PTHREAD_MUTEX_lock(&commit_stats.mtx);
+		commit_stats.batches++;
+		commit_stats.batched += n;
+		if (use_syncfs)
+			commit_stats.syncfs++;
+		PTHREAD_MUTEX_unlock(&commit_stats.mtx);
+	}
+}
+
+/**
+ * @brief Commit a file as part of a filesystem batch
+ *
+ * @param[in] vfs_fs  Filesystem of the file
+ * @param[in] hdl     File to commit
+ * @param[in] fd      Descriptor open on it
+ * @param[in] module  Our module
+ *
+ * @return 0 or an errno.
+ */
+static int vfs_commit_batched(struct vfs_filesystem *vfs_fs,
+			      struct vfs_fsal_obj_handle *hdl, int fd,
+			      struct vfs_fsal_module *module)
+{
+	struct vfs_commit_batch *batch = &vfs_fs->commits;
+	struct vfs_commit_wait self;
+	struct glist_head list;
+	struct timespec deadline;
+	uint32_t n;
+	int rc;
+
+	memset(&self, 0, sizeof(self));
+
+	PTHREAD_MUTEX_lock(&batch->mtx);
+
+	glist_add_tail(&batch->waiting, &self.list);
+	batch->nwaiting++;
+
+	if (!batch->collecting) {
+		batch->collecting = true;
+
+		/* A lone COMMIT has nobody to wait for */
+		if (batch->inflight != 0) {
+			now(&deadline);
+			timespec_add_nsecs((nsecs_elapsed_t)
+					   module->commit_batch_window *
+					   NS_PER_USEC, &deadline);
+			while (pthread_cond_timedwait(&batch->cond,
+						      &batch->mtx,
+						      &deadline) != ETIMEDOUT)
+				;
+		}
+
+		glist_init(&list);
+		glist_splice_tail(&list, &batch->waiting);
+		n = batch->nwaiting;
+		batch->nwaiting = 0;
+		batch->collecting = false;
+		batch->inflight += n;
+
+		vfs_commit_flush(vfs_fs, &list, n, module);
+	} else {
+		while (!self.done && !self.released)
+			pthread_cond_wait(&batch->cond, &batch->mtx);
+	}
+
+	PTHREAD_MUTEX_unlock(&batch->mtx);
+
+	rc = self.done ? self.rc : vfs_commit_file(hdl, fd);
+
+	PTHREAD_MUTEX_lock(&batch->mtx);
+	batch->inflight--;
+	PTHREAD_MUTEX_unlock(&batch->mtx);
+
+	return rc;
+}
+
+/**
+ * @brief Commit a file
+ *
+ * @param[in] hdl  File to commit
+ * @param[in] fd   Descriptor open on it
+ *
+ * @return 0 or an errno.
+ */
+int vfs_commit_fd(struct vfs_fsal_obj_handle *hdl, int fd)
+{
+	struct vfs_fsal_module *module =
+		container_of(hdl->obj_handle.fsal, struct vfs_fsal_module,
+			     module);
+	struct vfs_filesystem *vfs_fs = hdl->obj_handle.fs->private_data;
+	struct timespec start, end;
+	nsecs_elapsed_t latency;
+	int rc;
+
+	now(&start);
+
+	if (module->commit_batch_window != 0 && vfs_fs != NULL)
+		rc = vfs_commit_batched(vfs_fs, hdl, fd, module);
+	else
+		rc = vfs_commit_file(hdl, fd);
+
+	now(&end);
+	latency = timespec_diff(&start, &end);
+
+	PTHREAD_MUTEX_lock(&commit_stats.mtx);
+	commit_stats.commits++;
+	commit_stats.latency += latency;
+	if (commit_stats.min == 0 || latency < commit_stats.min)
+		commit_stats.min = latency;
+	if (latency > commit_stats.max)
+		commit_stats.max = latency;
+	PTHREAD_MUTEX_unlock(&commit_stats.mtx);
+
+	return rc;
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report COMMIT counters for GetFSALStats
+ *
+ * COMMIT has the average, least and greatest latency in milliseconds,
+ * COMMIT_BATCH the average number of COMMITs in a batch.
+ *
+ * @param[in] iter  DBus struct iterator
+ */
+void vfs_commit_extract_stats(void *iter)
+{
+	uint64_t commits, batches, batched, syncfs;
+	double avg, min, max, size;
+
+	PTHREAD_MUTEX_lock(&commit_stats.mtx);
+	commits = commit_stats.commits;
+	avg = commits == 0 ? 0.0
+			   : (double) commit_stats.latency / commits / 1000000;
+	min = (double) commit_stats.min / 1000000;
+	max = (double) commit_stats.max / 1000000;
+	batches = commit_stats.batches;
+	batched = commit_stats.batched;
+	syncfs = commit_stats.syncfs;
+	PTHREAD_MUTEX_unlock(&commit_stats.mtx);
+
+	size = batches == 0 ? 0.0 : (double) batched / batches;
+
+	vfs_append_stat(iter, "COMMIT", commits, avg, min, max);
+	vfs_append_stat(iter, "COMMIT_BATCH", batches, size, 0.0, 0.0);
+	vfs_append_stat(iter, "COMMIT_SYNCFS", syncfs, 0.0, 0.0, 0.0);
+}
+#endif
+
+/**
+ * @brief Zero the COMMIT counters
+ */
+void vfs_commit_reset_stats(void)
+{
+	PTHREAD_MUTEX_lock(&commit_stats.mtx);
+	commit_stats.commits = 0;
+	commit_stats.latency = 0;
+	commit_stats.min = 0;
+	commit_stats.max = 0;
+	commit_stats.batches = 0;
+	commit_stats.batched = 0;
+	commit_stats.syncfs = 0;
+	PTHREAD_MUTEX_unlock(&commit_stats.mtx);
+}
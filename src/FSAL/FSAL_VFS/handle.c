@@ -104,6 +104,7 @@ struct vfs_fsal_obj_handle *alloc_handle(int dirfd,
 	if (hdl->obj_handle.type == REGULAR_FILE) {
 		hdl->u.file.fd.fd = -1;	/* no open on this yet */
 		hdl->u.file.fd.openflags = FSAL_O_CLOSED;
+		vfs_file_io_init(hdl);
 	} else if (hdl->obj_handle.type == SYMBOLIC_LINK) {
 		ssize_t retlink;
 		size_t len = stat->st_size + 1;
@@ -206,33 +207,36 @@ out:
 	return status;
 }
 
-static fsal_status_t lookup_with_fd(struct vfs_fsal_obj_handle *parent_hdl,
-				    int dirfd, const char *path,
-				    struct fsal_obj_handle **handle,
-				    struct attrlist *attrs_out)
+/**
+ * @brief Make the handle of a looked up object
+ *
+ * @param[in]  parent_hdl  Directory
+ * @param[in]  dirfd       Directory fd
+ * @param[in]  path        Name of the object
+ * @param[in]  stat        stat(2) results of the object
+ * @param[in]  fh          Handle buffer
+ * @param[in]  have_fh     fh already holds the handle of the object, only
+ *                         if it is on the directory's device
+ * @param[out] handle      The object
+ * @param[out] attrs_out   Optional attributes of the object
+ *
+ * @return FSAL status.
+ */
+static fsal_status_t lookup_with_stat(struct vfs_fsal_obj_handle *parent_hdl,
+				      int dirfd, const char *path,
+				      struct stat *stat, vfs_file_handle_t *fh,
+				      bool have_fh,
+				      struct fsal_obj_handle **handle,
+				      struct attrlist *attrs_out)
 {
 	struct vfs_fsal_obj_handle *hdl;
 	int retval;
-	struct stat stat;
-	vfs_file_handle_t *fh = NULL;
 	fsal_dev_t dev;
 	struct fsal_filesystem *fs;
 	bool xfsal = false;
 	fsal_status_t status;
 
-	vfs_alloc_handle(fh);
-
-	retval = fstatat(dirfd, path, &stat, AT_SYMLINK_NOFOLLOW);
-
-	if (retval < 0) {
-		retval = errno;
-		LogDebug(COMPONENT_FSAL, "Failed to open stat %s: %s", path,
-			 msg_fsal_err(posix2fsal_error(retval)));
-		status = posix2fsal_status(retval);
-		return status;
-	}
-
-	dev = posix2fsal_devt(stat.st_dev);
+	dev = posix2fsal_devt(stat->st_dev);
 
 	fs = parent_hdl->obj_handle.fs;
 	if ((dev.minor != parent_hdl->dev.minor) ||
@@ -263,7 +267,8 @@ static fsal_status_t lookup_with_fd(struct vfs_fsal_obj_handle *parent_hdl,
 		}
 	}
 
-	if (xfsal || vfs_name_to_handle(dirfd, fs, path, fh) < 0) {
+	if (!have_fh &&
+	    (xfsal || vfs_name_to_handle(dirfd, fs, path, fh) < 0)) {
 		retval = errno;
 		if (((retval == ENOTTY) ||
 		     (retval == EOPNOTSUPP) ||
@@ -303,7 +308,7 @@ static fsal_status_t lookup_with_fd(struct vfs_fsal_obj_handle *parent_hdl,
 	}
 
 	/* allocate an obj_handle and fill it up */
-	hdl = alloc_handle(dirfd, fh, fs, &stat, parent_hdl->handle, path,
+	hdl = alloc_handle(dirfd, fh, fs, stat, parent_hdl->handle, path,
 			   op_ctx->fsal_export);
 
 	if (hdl == NULL) {
@@ -312,7 +317,7 @@ static fsal_status_t lookup_with_fd(struct vfs_fsal_obj_handle *parent_hdl,
 	}
 
 	if (attrs_out != NULL) {
-		posix2fsal_attributes_all(&stat, attrs_out);
+		posix2fsal_attributes_all(stat, attrs_out);
 	}
 
 	hdl->obj_handle.fsid = hdl->obj_handle.fs->fsid;
@@ -340,6 +345,33 @@ static fsal_status_t lookup_with_fd(struct vfs_fsal_obj_handle *parent_hdl,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+static fsal_status_t lookup_with_fd(struct vfs_fsal_obj_handle *parent_hdl,
+				    int dirfd, const char *path,
+				    struct fsal_obj_handle **handle,
+				    struct attrlist *attrs_out)
+{
+	int retval;
+	struct stat stat;
+	vfs_file_handle_t *fh = NULL;
+
+	vfs_alloc_handle(fh);
+
+	retval = fstatat(dirfd, path, &stat, AT_SYMLINK_NOFOLLOW);
+
+	if (retval < 0) {
+		retval = errno;
+		LogDebug(COMPONENT_FSAL, "Failed to open stat %s: %s", path,
+			 msg_fsal_err(posix2fsal_error(retval)));
+		return posix2fsal_status(retval);
+	}
+
+	if (vfs_reclaim_hidden(parent_hdl->obj_handle.fs, path, stat.st_ino))
+		return fsalstat(ERR_FSAL_NOENT, ENOENT);
+
+	return lookup_with_stat(parent_hdl, dirfd, path, &stat, fh, false,
+				handle, attrs_out);
+}
+
 /* handle methods
  */
 
@@ -1250,6 +1282,10 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 			    || strcmp(dentryp->vd_name, "..") == 0)
 				goto skip;	/* must skip '.' and '..' */
 
+			if (vfs_reclaim_hidden(dir_hdl->fs, dentryp->vd_name,
+					       dentryp->vd_ino))
+				goto skip;
+
 			fsal_prepare_attrs(&attrs, attrmask);
 
 			status = lookup_with_fd(myself, dirfd, dentryp->vd_name,
@@ -1282,6 +1318,190 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 	return status;
 }
 
+#ifndef __FreeBSD__
+/** Entries handed up at once by read_dirents_batch */
+#define VFS_READDIR_BATCH 64
+/** Size of the getdents buffer of read_dirents_batch */
+#define VFS_READDIR_BUF_SIZE 32768
+
+/**
+ * @brief Make the handle of a prefetched directory entry
+ *
+ * @param[in]  myself    Directory
+ * @param[in]  dirfd     Directory fd
+ * @param[in]  pf        The entry, from vfs_readdir_prefetch()
+ * @param[out] handle    Object of the entry
+ * @param[out] attrs     Attributes of the entry
+ *
+ * @return FSAL status.
+ */
+static fsal_status_t lookup_prefetched(struct vfs_fsal_obj_handle *myself,
+				       int dirfd,
+				       struct vfs_readdir_prefetch *pf,
+				       struct fsal_obj_handle **handle,
+				       struct attrlist *attrs)
+{
+	vfs_file_handle_t *fh = NULL;
+
+	if (pf->error != 0) {
+		LogDebug(COMPONENT_FSAL, "Failed to open stat %s: %s",
+			 pf->name, msg_fsal_err(posix2fsal_error(pf->error)));
+		return posix2fsal_status(pf->error);
+	}
+
+	vfs_alloc_handle(fh);
+
+	if (pf->have_fh)
+		memcpy(fh, &pf->fh, sizeof(vfs_file_handle_t));
+
+	return lookup_with_stat(myself, dirfd, pf->name, &pf->stat, fh,
+				pf->have_fh, handle, attrs);
+}
+
+/**
+ * read_dirents_batch
+ * read the directory and call through the callback function with
+ * batches of entries.  The fstatat and name_to_handle_at of a batch are
+ * made together by vfs_readdir_prefetch.
+ * @param dir_hdl [IN] the directory to read
+ * @param whence [IN] where to start (next)
+ * @param dir_state [IN] pass thru of state to callback
+ * @param cb [IN] callback function
+ * @param eof [OUT] eof marker true == end of dir
+ */
+
+static fsal_status_t read_dirents_batch(struct fsal_obj_handle *dir_hdl,
+					fsal_cookie_t *whence, void *dir_state,
+					fsal_readdir_batch_cb cb,
+					attrmask_t attrmask, bool *eof)
+{
+	struct vfs_fsal_obj_handle *myself;
+	int dirfd;
+	fsal_status_t status = {0, 0};
+	int retval = 0;
+	off_t seekloc = 0;
+	off_t baseloc = 0;
+	unsigned int bpos;
+	int nread;
+	struct vfs_dirent dentry, *dentryp = &dentry;
+	char *buf;
+	struct vfs_readdir_prefetch *pf;
+	struct fsal_readdir_entry *entries;
+	struct attrlist *attrs;
+
+	if (whence != NULL)
+		seekloc = (off_t) *whence;
+	myself = container_of(dir_hdl, struct vfs_fsal_obj_handle, obj_handle);
+	if (dir_hdl->fsal != dir_hdl->fs->fsal) {
+		LogDebug(COMPONENT_FSAL,
+			 "FSAL %s operation for handle belonging to FSAL %s, return EXDEV",
+			 dir_hdl->fsal->name,
+			 dir_hdl->fs->fsal != NULL
+				? dir_hdl->fs->fsal->name
+				: "(none)");
+		retval = EXDEV;
+		return posix2fsal_status(retval);
+	}
+	dirfd = vfs_fsal_open(myself, O_RDONLY | O_DIRECTORY, &status.major);
+	if (dirfd < 0) {
+		retval = -dirfd;
+		return posix2fsal_status(retval);
+	}
+	seekloc = lseek(dirfd, seekloc, SEEK_SET);
+	if (seekloc < 0) {
+		retval = errno;
+		close(dirfd);
+		return posix2fsal_status(retval);
+	}
+
+	buf = gsh_malloc(VFS_READDIR_BUF_SIZE);
+	pf = gsh_malloc(VFS_READDIR_BATCH * sizeof(*pf));
+	entries = gsh_malloc(VFS_READDIR_BATCH * sizeof(*entries));
+	attrs = gsh_malloc(VFS_READDIR_BATCH * sizeof(*attrs));
+
+	do {
+		baseloc = seekloc;
+		nread = vfs_readents(dirfd, buf, VFS_READDIR_BUF_SIZE,
+				     &seekloc);
+		if (nread < 0) {
+			retval = errno;
+			status = posix2fsal_status(retval);
+			goto done;
+		}
+		if (nread == 0)
+			break;
+
+		for (bpos = 0; bpos < nread;) {
+			unsigned int npf = 0, n, i, consumed = 0;
+			enum fsal_dir_result cb_rc = DIR_CONTINUE;
+
+			/* Gather the next batch of the buffer */
+			while (bpos < nread && npf < VFS_READDIR_BATCH) {
+				if (to_vfs_dirent(buf, bpos, dentryp, baseloc)
+				    && strcmp(dentryp->vd_name, ".") != 0
+				    && strcmp(dentryp->vd_name, "..") != 0
+				    && !vfs_reclaim_hidden(dir_hdl->fs,
+							   dentryp->vd_name,
+							   dentryp->vd_ino)) {
+					pf[npf].name = dentryp->vd_name;
+					pf[npf].cookie =
+					    (fsal_cookie_t) dentryp->vd_offset;
+					npf++;
+				}
+				bpos += dentryp->vd_reclen;
+			}
+
+			if (npf == 0)
+				continue;
+
+			vfs_readdir_prefetch(dirfd, myself, pf, npf);
+
+			/* Hand up the entries before any that failed */
+			for (n = 0; n < npf; n++) {
+				fsal_prepare_attrs(&attrs[n], attrmask);
+
+				status = lookup_prefetched(myself, dirfd,
+							   &pf[n],
+							   &entries[n].obj,
+							   &attrs[n]);
+				if (FSAL_IS_ERROR(status)) {
+					fsal_release_attrs(&attrs[n]);
+					break;
+				}
+
+				entries[n].name = pf[n].name;
+				entries[n].attrs = &attrs[n];
+				entries[n].cookie = pf[n].cookie;
+			}
+
+			/* callback to cache inode */
+			if (n != 0)
+				cb_rc = cb(entries, n, &consumed, dir_state);
+
+			for (i = 0; i < n; i++)
+				fsal_release_attrs(&attrs[i]);
+
+			if (FSAL_IS_ERROR(status))
+				goto done;
+
+			/* Read ahead not supported by this FSAL. */
+			if (cb_rc >= DIR_READAHEAD)
+				goto done;
+		}
+	} while (nread > 0);
+
+	*eof = true;
+ done:
+	gsh_free(buf);
+	gsh_free(pf);
+	gsh_free(entries);
+	gsh_free(attrs);
+	close(dirfd);
+
+	return status;
+}
+#endif /* __FreeBSD__ */
+
 static fsal_status_t renamefile(struct fsal_obj_handle *obj_hdl,
 				struct fsal_obj_handle *olddir_hdl,
 				const char *old_name,
@@ -1503,6 +1723,8 @@ static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
 {
 	struct vfs_fsal_obj_handle *myself;
 	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
+	char tname[VFS_RECLAIM_TMPLEN];
+	bool deferred;
 	struct stat stat;
 	int fd;
 	int retval = 0;
@@ -1536,13 +1758,26 @@ static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
 		goto errout;
 	}
 
+	if (vfs_reclaim_hidden(dir_hdl->fs, name, stat.st_ino)) {
+		retval = ENOENT;
+		fsal_error = ERR_FSAL_NOENT;
+		goto errout;
+	}
+
 	if (!vfs_set_credentials(op_ctx->creds, dir_hdl->fsal)) {
 		retval = EPERM;
 		fsal_error = posix2fsal_error(retval);
 		goto errout;
 	}
 
-	retval = unlinkat(fd, name, (S_ISDIR(stat.st_mode)) ? AT_REMOVEDIR : 0);
+	/* A large file is moved away to be freed in the background */
+	deferred = vfs_reclaim_defer(dir_hdl->fs->private_data, fd, name,
+				     &stat, tname);
+	if (deferred)
+		retval = 0;
+	else
+		retval = unlinkat(fd, name,
+				  (S_ISDIR(stat.st_mode)) ? AT_REMOVEDIR : 0);
 	if (retval < 0) {
 		retval = errno;
 		if (retval == ENOENT)
@@ -1552,6 +1787,18 @@ static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
 	}
 	vfs_restore_ganesha_credentials(dir_hdl->fsal);
 
+	if (deferred) {
+		retval = vfs_reclaim_move(dir_hdl->fs->private_data, fd, tname,
+					  &stat);
+		fsal_error = posix2fsal_error(retval);
+	}
+
+	/* Don't let parked fds keep the removed file's space in use */
+	if (retval == 0 && obj_hdl->type == REGULAR_FILE)
+		vfs_fdcache_purge(container_of(obj_hdl,
+					       struct vfs_fsal_obj_handle,
+					       obj_handle));
+
  errout:
 	close(fd);
  out:
@@ -1647,6 +1894,8 @@ static void release(struct fsal_obj_handle *obj_hdl)
 
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
 
+		vfs_fdcache_purge(myself);
+
 		if (FSAL_IS_ERROR(st)) {
 			LogCrit(COMPONENT_FSAL,
 				"Could not close hdl 0x%p, error %s(%d)",
@@ -1663,6 +1912,7 @@ static void release(struct fsal_obj_handle *obj_hdl)
 
 		handle_to_key(obj_hdl, &key);
 		vfs_state_release(&key);
+		vfs_file_io_fini(myself);
 	} else if (vfs_unopenable_type(type)) {
 		gsh_free(myself->u.unopenable.name);
 		gsh_free(myself->u.unopenable.dir);
@@ -1683,6 +1933,9 @@ void vfs_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->merge = vfs_merge;
 	ops->lookup = lookup;
 	ops->readdir = read_dirents;
+#ifndef __FreeBSD__
+	ops->readdir_batch = read_dirents_batch;
+#endif
 	ops->mkdir = makedir;
 	ops->mknode = makenode;
 	ops->symlink = makesymlink;
@@ -1695,6 +1948,8 @@ void vfs_handle_ops_init(struct fsal_obj_ops *ops)
 #ifdef FALLOC_FL_PUNCH_HOLE
 	ops->fallocate = vfs_fallocate;
 #endif
+	ops->copy = vfs_copy;
+	ops->clone2 = vfs_clone2;
 	ops->handle_to_wire = handle_to_wire;
 	ops->handle_to_key = handle_to_key;
 	ops->open2 = vfs_open2;
@@ -1704,6 +1959,7 @@ void vfs_handle_ops_init(struct fsal_obj_ops *ops)
 #ifdef __USE_GNU
 	ops->seek2 = vfs_seek2;
 #endif
+	ops->io_advise2 = vfs_io_advise2;
 	ops->commit2 = vfs_commit2;
 #ifdef F_OFD_GETLK
 	ops->lock_op2 = vfs_lock_op2;
@@ -0,0 +1,256 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/* readdir.c
+ * VFS readdir prefetch
+ *
+ * Handing a directory entry up takes an fstatat and a name_to_handle_at
+ * of it, which on a cold directory mostly wait on the disk.  The batch
+ * readdir gathers the entries of each getdents buffer and has those
+ * calls made here by the calling thread together with up to
+ * Readdir_Threads helpers, each claiming the next entry not yet done.
+ * Only the system calls are made by the helpers, the handles are built
+ * by the caller from the results.
+ *
+ * A helper is only asked for when one is idle; a busy pool leaves the
+ * work to the caller rather than making it wait.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "abstract_atomic.h"
+#include "fsal.h"
+#include "fsal_convert.h"
+#include "fridgethr.h"
+#include "vfs_methods.h"
+
+/** Entries each helper should at least have to do */
+#define VFS_READDIR_PER_THREAD 8
+
+static struct fridgethr *readdir_fridge;
+static uint32_t readdir_threads;
+
+/** A batch being prefetched, lives on the stack of the readdir */
+struct vfs_readdir_batch {
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	struct vfs_readdir_prefetch *entries;
+	uint32_t count;
+	uint32_t next;		/*< Next entry to claim */
+	uint32_t helpers;	/*< Helpers not done yet */
+	int dirfd;
+	struct fsal_filesystem *fs;
+	fsal_dev_t dev;		/*< Device of the directory */
+};
+
+/**
+ * @brief Stat an entry and get its handle
+ *
+ * Entries on another device don't get a handle, the lookup sorts out
+ * crossing into another filesystem.  Neither does one whose handle
+ * could not be had, the lookup tries again and reports the error.
+ *
+ * @param[in]     batch  The batch
+ * @param[in,out] pf     The entry
+ */
+static void prefetch_one(struct vfs_readdir_batch *batch,
+			 struct vfs_readdir_prefetch *pf)
+{
+	fsal_dev_t dev;
+
+	pf->have_fh = false;
+
+	if (fstatat(batch->dirfd, pf->name, &pf->stat,
+		    AT_SYMLINK_NOFOLLOW) < 0) {
+		pf->error = errno;
+		return;
+	}
+
+	pf->error = 0;
+
+	dev = posix2fsal_devt(pf->stat.st_dev);
+	if (dev.major != batch->dev.major || dev.minor != batch->dev.minor)
+		return;
+
+	if (vfs_name_to_handle(batch->dirfd, batch->fs, pf->name,
+			       &pf->fh) == 0)
+		pf->have_fh = true;
+}
+
+/**
+ * @brief Prefetch entries of a batch until none is left
+ *
+ * @param[in] batch  The batch
+ */
+static void prefetch_claim(struct vfs_readdir_batch *batch)
+{
+	uint32_t i;
+
+	while ((i = atomic_postinc_uint32_t(&batch->next)) < batch->count)
+		prefetch_one(batch, &batch->entries[i]);
+}
+
+/**
+ * @brief Helper thread body
+ *
+ * @param[in] ctx  Thread context, the batch as argument
+ */
+static void prefetch_run(struct fridgethr_context *ctx)
+{
+	struct vfs_readdir_batch *batch = ctx->arg;
+
+	prefetch_claim(batch);
+
+	/* The batch may be gone as soon as the mutex is dropped */
+	PTHREAD_MUTEX_lock(&batch->mtx);
+	if (--batch->helpers == 0)
+		pthread_cond_signal(&batch->cond);
+	PTHREAD_MUTEX_unlock(&batch->mtx);
+}
+
+/**
+ * @brief Stat entries of a directory and get their handles
+ *
+ * On return each entry has error set to the errno of its fstatat, or 0
+ * with stat filled in, and have_fh telling whether fh holds its handle.
+ *
+ * @param[in]     dirfd    Directory fd
+ * @param[in]     dir      The directory
+ * @param[in,out] entries  Entries, name set
+ * @param[in]     count    Number of entries
+ */
+void vfs_readdir_prefetch(int dirfd, struct vfs_fsal_obj_handle *dir,
+			  struct vfs_readdir_prefetch *entries,
+			  uint32_t count)
+{
+	struct vfs_readdir_batch batch;
+	uint32_t want = 0, i;
+
+	batch.entries = entries;
+	batch.count = count;
+	batch.next = 0;
+	batch.dirfd = dirfd;
+	batch.fs = dir->obj_handle.fs;
+	batch.dev = dir->dev;
+
+	if (readdir_fridge != NULL) {
+		want = count / VFS_READDIR_PER_THREAD;
+		if (want > readdir_threads)
+			want = readdir_threads;
+	}
+
+	if (want == 0) {
+		prefetch_claim(&batch);
+		return;
+	}
+
+	PTHREAD_MUTEX_init(&batch.mtx, NULL);
+	PTHREAD_COND_init(&batch.cond, NULL);
+	batch.helpers = want;
+
+	for (i = 0; i < want; i++) {
+		if (fridgethr_submit(readdir_fridge, prefetch_run,
+				     &batch) != 0)
+			break;
+	}
+
+	PTHREAD_MUTEX_lock(&batch.mtx);
+	batch.helpers -= want - i;
+	PTHREAD_MUTEX_unlock(&batch.mtx);
+
+	prefetch_claim(&batch);
+
+	PTHREAD_MUTEX_lock(&batch.mtx);
+	while (batch.helpers != 0)
+		pthread_cond_wait(&batch.cond, &batch.mtx);
+	PTHREAD_MUTEX_unlock(&batch.mtx);
+
+	PTHREAD_MUTEX_destroy(&batch.mtx);
+	PTHREAD_COND_destroy(&batch.cond);
+}
+
+/**
+ * @brief Start the readdir helpers
+ *
+ * @param[in] threads  Helpers, 0 to prefetch in the caller only
+ *
+ * @return 0 on success, POSIX errors on failure.
+ */
+int vfs_readdir_init(uint32_t threads)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (threads == 0 || readdir_fridge != NULL)
+		return 0;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = threads;
+	frp.thr_min = 0;
+	frp.thread_delay = 60;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_fail;
+
+	rc = fridgethr_init(&readdir_fridge, "VFS_readdir", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Unable to initialize readdir fridge, error code %d.",
+			 rc);
+		readdir_fridge = NULL;
+		return rc;
+	}
+
+	readdir_threads = threads;
+
+	return 0;
+}
+
+/**
+ * @brief Stop the readdir helpers
+ */
+void vfs_readdir_shutdown(void)
+{
+	int rc;
+
+	if (readdir_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(readdir_fridge, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_FSAL,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(readdir_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Failed shutting down readdir threads: %d", rc);
+	}
+
+	fridgethr_destroy(readdir_fridge);
+	readdir_fridge = NULL;
+}
@@ -0,0 +1,497 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/* reclaim.c
+ * VFS deferred reclaim of large removed files
+ *
+ * Dropping the last link of a file holding terabytes frees all of its
+ * extents inside the unlinkat, which on XFS or ext4 can take seconds of
+ * the worker's time.  With Deferred_Reclaim_Size set, a REMOVE of the
+ * last link of a regular file with at least that much allocated renames
+ * it instead into VFS_RECLAIM_DIR at the root of its filesystem, and
+ * a thread of our own frees its space from there, truncating it by at
+ * most Deferred_Reclaim_Rate bytes a second before unlinking it.
+ *
+ * The file is first renamed within its own directory with the
+ * credentials of the REMOVE, so the kernel checks that like the unlink
+ * it stands for, then moved into VFS_RECLAIM_DIR with ours; the
+ * directory is only accessible by root.  It is hidden from lookups and
+ * readdirs of the export.  A file that got another link meanwhile is
+ * only unlinked, and so is a file still open when its turn comes; the
+ * space is then freed by the last unlink or close as it would have
+ * been.  Files left over by a restart are taken up again when the
+ * filesystem is claimed.
+ */
+
+#include "config.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "gsh_list.h"
+#include "abstract_atomic.h"
+#include "fridgethr.h"
+#include "fsal.h"
+#include "vfs_methods.h"
+
+/** A file waiting in VFS_RECLAIM_DIR */
+struct vfs_reclaim_item {
+	struct glist_head list;
+	struct vfs_filesystem *vfs_fs;
+	ino_t ino;		/*< Inode the file was deferred as */
+	char name[VFS_RECLAIM_NAMELEN];
+};
+
+static struct vfs_reclaim {
+	/** Held over the work on an item, so its filesystem stays */
+	pthread_mutex_t work_mtx;
+	/** Protects queue */
+	pthread_mutex_t mtx;
+	struct glist_head queue;
+	struct fridgethr *fridge;
+	uint64_t size;		/*< Allocated bytes to defer, 0 if disabled */
+	uint64_t rate;		/*< Bytes freed a second */
+	/* Counters, atomic */
+	uint64_t deferred;
+	uint64_t freed;
+} reclaim = {
+	.work_mtx = PTHREAD_MUTEX_INITIALIZER,
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+	.queue = GLIST_HEAD_INIT(reclaim.queue),
+};
+
+static inline uint64_t allocated_bytes(const struct stat *st)
+{
+	return (uint64_t) st->st_blocks * S_BLKSIZE;
+}
+
+/**
+ * @brief Queue a file of VFS_RECLAIM_DIR to be freed
+ *
+ * @param[in] vfs_fs  Filesystem of the file
+ * @param[in] name    Its name in VFS_RECLAIM_DIR
+ * @param[in] ino     The inode it was deferred as
+ */
+static void reclaim_queue(struct vfs_filesystem *vfs_fs, const char *name,
+			  ino_t ino)
+{
+	struct vfs_reclaim_item *item = gsh_calloc(1, sizeof(*item));
+
+	item->vfs_fs = vfs_fs;
+	item->ino = ino;
+	(void) strlcpy(item->name, name, sizeof(item->name));
+
+	PTHREAD_MUTEX_lock(&reclaim.mtx);
+	glist_add_tail(&reclaim.queue, &item->list);
+	PTHREAD_MUTEX_unlock(&reclaim.mtx);
+}
+
+/**
+ * @brief Start removing a large file by renaming it aside
+ *
+ * Called by a REMOVE, with its credentials set, in place of the
+ * unlinkat.  The file is renamed to @a tname in its own directory,
+ * vfs_reclaim_move() is then to be called with our credentials.
+ *
+ * @param[in]  vfs_fs  Filesystem of the file
+ * @param[in]  dirfd   Directory of the file
+ * @param[in]  name    Name of the file
+ * @param[in]  st      The file, as found by fstatat
+ * @param[out] tname   Its new name, VFS_RECLAIM_TMPLEN bytes
+ *
+ * @return true if the file was renamed, false if it is to be unlinked.
+ */
+bool vfs_reclaim_defer(struct vfs_filesystem *vfs_fs, int dirfd,
+		       const char *name, const struct stat *st, char *tname)
+{
+	struct stat tst;
+
+	if (reclaim.size == 0 || vfs_fs == NULL || vfs_fs->reclaim_fd < 0 ||
+	    !S_ISREG(st->st_mode) || st->st_nlink != 1 ||
+	    allocated_bytes(st) < reclaim.size)
+		return false;
+
+	(void) snprintf(tname, VFS_RECLAIM_TMPLEN, "%s.%016" PRIx64,
+			VFS_RECLAIM_DIR, (uint64_t) st->st_ino);
+
+	/* Don't replace whatever has that name already */
+	if (fstatat(dirfd, tname, &tst, AT_SYMLINK_NOFOLLOW) == 0 ||
+	    errno != ENOENT)
+		return false;
+
+	if (renameat(dirfd, name, dirfd, tname) < 0) {
+		LogDebug(COMPONENT_FSAL,
+			 "Could not defer reclaim of %s, unlinking it: %s",
+			 name, strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Move a file renamed by vfs_reclaim_defer() to VFS_RECLAIM_DIR
+ *
+ * Called with our credentials.  The file is unlinked instead, as the
+ * REMOVE would have, if it is not the one deferred or has got another
+ * link since; it is not ours to free then.
+ *
+ * @param[in] vfs_fs  Filesystem of the file
+ * @param[in] dirfd   Directory of the file
+ * @param[in] tname   Name given by vfs_reclaim_defer()
+ * @param[in] st      The file, as found by fstatat before
+ *
+ * @return 0 on success, an errno if the file could not be removed.
+ */
+int vfs_reclaim_move(struct vfs_filesystem *vfs_fs, int dirfd,
+		     const char *tname, const struct stat *st)
+{
+	char rname[VFS_RECLAIM_NAMELEN];
+	struct stat tst;
+
+	/* An inode number is in VFS_RECLAIM_DIR once at most */
+	(void) snprintf(rname, sizeof(rname), "%016" PRIx64,
+			(uint64_t) st->st_ino);
+
+	if (fstatat(dirfd, tname, &tst, AT_SYMLINK_NOFOLLOW) < 0 ||
+	    tst.st_ino != st->st_ino || tst.st_nlink != 1 ||
+	    renameat(dirfd, tname, vfs_fs->reclaim_fd, rname) < 0) {
+		LogDebug(COMPONENT_FSAL,
+			 "Could not defer reclaim of %s, unlinking it",
+			 tname);
+		return unlinkat(dirfd, tname, 0) < 0 ? errno : 0;
+	}
+
+	(void) atomic_inc_uint64_t(&reclaim.deferred);
+	reclaim_queue(vfs_fs, rname, st->st_ino);
+
+	LogDebug(COMPONENT_FSAL,
+		 "Deferred reclaim of %s, %" PRIu64 " bytes, as %s",
+		 tname, allocated_bytes(st), rname);
+
+	return 0;
+}
+
+/**
+ * @brief Free part of a file of VFS_RECLAIM_DIR
+ *
+ * @param[in]     item    The file
+ * @param[in,out] budget  Bytes left to free this second
+ *
+ * @return true when the file is gone, false if it is to be resumed.
+ */
+static bool reclaim_item(struct vfs_reclaim_item *item, uint64_t *budget)
+{
+	int dirfd = item->vfs_fs->reclaim_fd;
+	struct stat st;
+	uint64_t alloc;
+	off_t size;
+	int fd;
+
+	/* Fails on a delegation, FSAL_VFS's own lease */
+	fd = openat(dirfd, item->name,
+		    O_WRONLY | O_NONBLOCK | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0) {
+		if (errno == ENOENT)
+			return true;
+		goto unlink;
+	}
+
+	/* Only to be had with the file open nowhere else */
+	if (fcntl(fd, F_SETLEASE, F_WRLCK) < 0) {
+		close(fd);
+		goto unlink;
+	}
+
+	/* Another link, or another file, is only unlinked */
+	if (fstat(fd, &st) < 0 || st.st_nlink != 1 ||
+	    st.st_ino != item->ino) {
+		(void) fcntl(fd, F_SETLEASE, F_UNLCK);
+		close(fd);
+		goto unlink;
+	}
+
+	alloc = allocated_bytes(&st);
+	if (alloc > *budget && (uint64_t) st.st_size > *budget)
+		size = st.st_size - *budget;
+	else
+		size = 0;
+
+	if (ftruncate(fd, size) < 0) {
+		(void) fcntl(fd, F_SETLEASE, F_UNLCK);
+		close(fd);
+		goto unlink;
+	}
+
+	if (fstat(fd, &st) == 0 && alloc > allocated_bytes(&st)) {
+		alloc -= allocated_bytes(&st);
+		(void) atomic_add_uint64_t(&reclaim.freed, alloc);
+	}
+	*budget = alloc < *budget ? *budget - alloc : 0;
+
+	(void) fcntl(fd, F_SETLEASE, F_UNLCK);
+	close(fd);
+
+	if (size != 0)
+		return false;
+
+ unlink:
+	if (unlinkat(dirfd, item->name, 0) < 0 && errno != ENOENT)
+		LogWarn(COMPONENT_FSAL,
+			"Could not unlink %s/%s/%s: %s",
+			item->vfs_fs->fs->path, VFS_RECLAIM_DIR, item->name,
+			strerror(errno));
+	return true;
+}
+
+/**
+ * @brief Free up to Deferred_Reclaim_Rate bytes of the queued files
+ *
+ * @param[in] ctx  Fridge context
+ */
+static void reclaim_run(struct fridgethr_context *ctx)
+{
+	struct vfs_reclaim_item *item;
+	uint64_t budget = reclaim.rate;
+	bool done;
+
+	SetNameFunction("vfs_reclaim");
+
+#ifdef SYS_gettid
+	/* Make way for the workers, the nice value is per thread */
+	(void) setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+#endif
+
+	while (budget > 0) {
+		PTHREAD_MUTEX_lock(&reclaim.work_mtx);
+		PTHREAD_MUTEX_lock(&reclaim.mtx);
+		item = glist_first_entry(&reclaim.queue,
+					 struct vfs_reclaim_item, list);
+		PTHREAD_MUTEX_unlock(&reclaim.mtx);
+
+		if (item == NULL) {
+			PTHREAD_MUTEX_unlock(&reclaim.work_mtx);
+			break;
+		}
+
+		done = reclaim_item(item, &budget);
+
+		if (done) {
+			PTHREAD_MUTEX_lock(&reclaim.mtx);
+			glist_del(&item->list);
+			PTHREAD_MUTEX_unlock(&reclaim.mtx);
+			gsh_free(item);
+		}
+
+		PTHREAD_MUTEX_unlock(&reclaim.work_mtx);
+	}
+}
+
+/**
+ * @brief Open VFS_RECLAIM_DIR of a filesystem and queue its files
+ *
+ * Called as the filesystem is claimed.  Deferred reclaim stays off for
+ * a filesystem the directory can't be made on.
+ *
+ * @param[in] vfs_fs  Filesystem
+ */
+void vfs_reclaim_fs_init(struct vfs_filesystem *vfs_fs)
+{
+	struct dirent *dentry;
+	struct stat st;
+	DIR *dir;
+	int fd;
+
+	if (reclaim.size == 0 || vfs_fs->root_fd < 0)
+		return;
+
+	if (mkdirat(vfs_fs->root_fd, VFS_RECLAIM_DIR, S_IRWXU) < 0 &&
+	    errno != EEXIST)
+		goto fail;
+
+	fd = openat(vfs_fs->root_fd, VFS_RECLAIM_DIR,
+		    O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0)
+		goto fail;
+
+	/* Only root's, also if made writable by all by older versions */
+	if (fstat(fd, &st) < 0 || st.st_uid != 0 ||
+	    fchmod(fd, S_IRWXU) < 0) {
+		close(fd);
+		goto fail;
+	}
+
+	vfs_fs->reclaim_fd = fd;
+	vfs_fs->reclaim_ino = st.st_ino;
+
+	dir = fdopendir(dup(fd));
+	if (dir == NULL)
+		return;
+
+	/* The name is the inode deferred, reclaim_item() checks it */
+	while ((dentry = readdir(dir)) != NULL) {
+		char *end;
+		unsigned long long ino;
+
+		if ((dentry->d_type != DT_REG &&
+		     dentry->d_type != DT_UNKNOWN) ||
+		    strlen(dentry->d_name) != VFS_RECLAIM_NAMELEN - 1)
+			continue;
+
+		ino = strtoull(dentry->d_name, &end, 16);
+		if (*end == '\0')
+			reclaim_queue(vfs_fs, dentry->d_name, ino);
+	}
+
+	closedir(dir);
+	return;
+
+ fail:
+	LogWarn(COMPONENT_FSAL,
+		"Deferred reclaim disabled on %s, no %s: %s",
+		vfs_fs->fs->path, VFS_RECLAIM_DIR, strerror(errno));
+}
+
+/**
+ * @brief Stop reclaiming the files of a filesystem
+ *
+ * Its files stay in VFS_RECLAIM_DIR for the next claim.
+ *
+ * @param[in] vfs_fs  Filesystem
+ */
+void vfs_reclaim_fs_fini(struct vfs_filesystem *vfs_fs)
+{
+	struct vfs_reclaim_item *item;
+	struct glist_head *glist, *glistn;
+
+	if (vfs_fs->reclaim_fd < 0)
+		return;
+
+	PTHREAD_MUTEX_lock(&reclaim.work_mtx);
+	PTHREAD_MUTEX_lock(&reclaim.mtx);
+
+	glist_for_each_safe(glist, glistn, &reclaim.queue) {
+		item = glist_entry(glist, struct vfs_reclaim_item, list);
+		if (item->vfs_fs == vfs_fs) {
+			glist_del(&item->list);
+			gsh_free(item);
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&reclaim.mtx);
+
+	close(vfs_fs->reclaim_fd);
+	vfs_fs->reclaim_fd = -1;
+
+	PTHREAD_MUTEX_unlock(&reclaim.work_mtx);
+}
+
+/**
+ * @brief Start the reclaim thread
+ *
+ * @param[in] size  Allocated bytes from which to defer, 0 to disable
+ * @param[in] rate  Bytes to free a second
+ *
+ * @return 0 on success, POSIX errors on failure.
+ */
+int vfs_reclaim_init(uint64_t size, uint64_t rate)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (size == 0 || reclaim.size != 0)
+		return 0;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = 1;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&reclaim.fridge, "VFS_reclaim", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Unable to initialize reclaim fridge, error code %d.",
+			 rc);
+		return rc;
+	}
+
+	rc = fridgethr_submit(reclaim.fridge, reclaim_run, NULL);
+	if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Unable to start reclaim thread, error code %d.",
+			 rc);
+		return rc;
+	}
+
+	reclaim.rate = rate;
+	reclaim.size = size;
+
+	LogInfo(COMPONENT_FSAL,
+		"VFS deferred reclaim of files of %" PRIu64
+		" bytes or more, freeing %" PRIu64 " bytes a second",
+		size, rate);
+
+	return 0;
+}
+
+/**
+ * @brief Stop the reclaim thread
+ *
+ * Files not yet freed stay in VFS_RECLAIM_DIR for the next start.
+ */
+void vfs_reclaim_shutdown(void)
+{
+	int rc;
+
+	if (reclaim.size == 0)
+		return;
+
+	rc = fridgethr_sync_command(reclaim.fridge, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_FSAL,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(reclaim.fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Failed shutting down reclaim thread: %d", rc);
+	}
+
+	fridgethr_destroy(reclaim.fridge);
+
+	LogInfo(COMPONENT_FSAL,
+		"VFS deferred reclaim of %" PRIu64 " files freed %" PRIu64
+		" bytes",
+		atomic_fetch_uint64_t(&reclaim.deferred),
+		atomic_fetch_uint64_t(&reclaim.freed));
+
+	reclaim.size = 0;
+}
@@ -81,11 +81,15 @@ static struct vfs_fsal_module VFS = {
 			.maxread = FSAL_MAXIOSIZE,
 			.maxwrite = FSAL_MAXIOSIZE,
 			.link_supports_permission_checks = false,
+			.read_plus = true,
 		}
 	},
 	.only_one_user = false
 };
 
+/* Only here so GetFSALStats reaches the fd cache counters */
+static struct fsal_stats vfs_stats;
+
 static struct config_item vfs_params[] = {
 	CONF_ITEM_BOOL("link_support", true, vfs_fsal_module,
 		       module.fs_info.link_support),
@@ -101,8 +105,37 @@ static struct config_item vfs_params[] = {
 		       module.fs_info.umask),
 	CONF_ITEM_BOOL("auth_xdev_export", false, vfs_fsal_module,
 		       module.fs_info.auth_exportpath_xdev),
+	CONF_ITEM_BOOL("clone_support", false, vfs_fsal_module,
+		       module.fs_info.clone),
 	CONF_ITEM_BOOL("only_one_user", false, vfs_fsal_module,
 		       only_one_user),
+	CONF_ITEM_UI32("FD_Cache_Size", 0, 1 << 20, 0,
+		       vfs_fsal_module, fd_cache_size),
+	CONF_ITEM_UI32("FD_Cache_Lease", 1, 3600, 10,
+		       vfs_fsal_module, fd_cache_lease),
+	CONF_ITEM_BOOL("Write_Gather", true, vfs_fsal_module,
+		       write_gather),
+	CONF_ITEM_UI32("Commit_Batch_Window", 0, 100000, 2000,
+		       vfs_fsal_module, commit_batch_window),
+	CONF_ITEM_UI32("Commit_Syncfs_Threshold", 0, UINT32_MAX, 64,
+		       vfs_fsal_module, commit_syncfs_threshold),
+	CONF_ITEM_UI32("Readdir_Threads", 0, 64, 4,
+		       vfs_fsal_module, readdir_threads),
+	CONF_ITEM_UI32("Read_Threads", 0, 256, 8,
+		       vfs_fsal_module, read_threads),
+	CONF_ITEM_UI64("Deferred_Reclaim_Size", 0, UINT64_MAX, 0,
+		       vfs_fsal_module, deferred_reclaim_size),
+	CONF_ITEM_UI64("Deferred_Reclaim_Rate", 1024 * 1024, UINT64_MAX,
+		       1024 * 1024 * 1024,
+		       vfs_fsal_module, deferred_reclaim_rate),
+	CONF_ITEM_BOOL("PNFS_MDS", false, vfs_fsal_module,
+		       module.fs_info.pnfs_mds),
+	CONF_ITEM_BLOCK("Flex_Files_DS", vfs_ff_ds_params, vfs_ff_ds_init,
+			vfs_ff_ds_commit, vfs_fsal_module, ff_servers),
+	CONF_ITEM_UI32("Flex_Files_Stats_Hint", 0, 3600, 10,
+		       vfs_fsal_module, ff_stats_hint),
+	CONF_ITEM_UI32("Flex_Files_Fail_Time", 0, 86400, 60,
+		       vfs_fsal_module, ff_fail_time),
 	CONFIG_EOL
 };
 
@@ -182,6 +215,16 @@ static fsal_status_t init_config(struct fsal_module *vfs_fsal_module,
 	if (!config_error_is_harmless(err_type))
 		return fsalstat(ERR_FSAL_INVAL, 0);
 	display_fsinfo(&vfs_module->module);
+	if (vfs_fdcache_init(vfs_module->fd_cache_size,
+			     vfs_module->fd_cache_lease) != 0)
+		return fsalstat(ERR_FSAL_FAULT, 0);
+	if (vfs_readdir_init(vfs_module->readdir_threads) != 0)
+		return fsalstat(ERR_FSAL_FAULT, 0);
+	if (vfs_read_init(vfs_module->read_threads) != 0)
+		return fsalstat(ERR_FSAL_FAULT, 0);
+	if (vfs_reclaim_init(vfs_module->deferred_reclaim_size,
+			     vfs_module->deferred_reclaim_rate) != 0)
+		return fsalstat(ERR_FSAL_FAULT, 0);
 	LogFullDebug(COMPONENT_FSAL,
 		     "Supported attributes constant = 0x%" PRIx64,
 		     VFS_SUPPORTED_ATTRIBUTES);
@@ -221,6 +264,11 @@ MODULE_INIT void vfs_init(void)
 	}
 	myself->m_ops.create_export = vfs_create_export;
 	myself->m_ops.init_config = init_config;
+#ifdef USE_DBUS
+	myself->m_ops.fsal_extract_stats = vfs_fdcache_extract_stats;
+#endif
+	myself->m_ops.fsal_reset_stats = vfs_fdcache_reset_stats;
+	myself->stats = &vfs_stats;
 
 	/* Initialize the fsal_obj_handle ops for FSAL VFS/LUSTRE */
 	vfs_handle_ops_init(&VFS.handle_ops);
@@ -230,6 +278,11 @@ MODULE_FINI void vfs_unload(void)
 {
 	int retval;
 
+	vfs_fdcache_shutdown();
+	vfs_readdir_shutdown();
+	vfs_read_shutdown();
+	vfs_reclaim_shutdown();
+
 	retval = unregister_fsal(&VFS.module);
 	if (retval != 0) {
 		fprintf(stderr, "VFS module failed to unregister");
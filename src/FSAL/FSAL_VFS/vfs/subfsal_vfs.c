@@ -48,6 +48,13 @@ static struct config_item_list fsid_types[] = {
 	CONFIG_LIST_EOL
 };
 
+static struct config_item_list direct_io_modes[] = {
+	CONFIG_LIST_TOK("None", VFS_DIRECT_NONE),
+	CONFIG_LIST_TOK("Auto", VFS_DIRECT_AUTO),
+	CONFIG_LIST_TOK("Always", VFS_DIRECT_ALWAYS),
+	CONFIG_LIST_EOL
+};
+
 static struct config_item export_params[] = {
 	CONF_ITEM_NOOP("name"),
 	CONF_ITEM_TOKEN("fsid_type", FSID_NO_TYPE,
@@ -55,6 +62,12 @@ static struct config_item export_params[] = {
 			vfs_fsal_export, fsid_type),
 	CONF_ITEM_BOOL("async_hsm_restore", true,
 		       vfs_fsal_export, async_hsm_restore),
+	CONF_ITEM_TOKEN("Direct_IO", VFS_DIRECT_NONE,
+			direct_io_modes,
+			vfs_fsal_export, direct_io),
+	CONF_ITEM_UI32("Direct_IO_Size", VFS_DIRECT_ALIGN, FSAL_MAXIOSIZE,
+		       1024 * 1024,
+		       vfs_fsal_export, direct_io_size),
 	CONFIG_EOL
 };
 
@@ -78,6 +91,8 @@ void vfs_sub_fini(struct vfs_fsal_export *myself)
 void vfs_sub_init_export_ops(struct vfs_fsal_export *myself,
 			      const char *export_path)
 {
+	if (myself->export.fsal->fs_info.pnfs_mds)
+		vfs_ff_init_ops(myself, export_path);
 }
 
 int vfs_sub_init_export(struct vfs_fsal_export *myself)
@@ -39,6 +39,20 @@ struct vfs_fsal_obj_handle;
 struct vfs_fsal_export;
 struct vfs_filesystem;
 
+/**
+ * A flex files data server, from a Flex_Files_DS block
+ */
+struct vfs_ff_ds {
+	struct glist_head list;		/*< On vfs_fsal_module ff_servers */
+	sockaddr_t addr;
+	uint16_t port;
+	uint32_t id;			/*< Device id, by order in the config */
+	char uaddr[SOCK_NAME_MAX];	/*< Address as in its netaddr4 */
+	uint64_t latency;		/*< Average ns an I/O takes */
+	uint64_t failed;		/*< When it last failed a client */
+	uint32_t layouts;		/*< Layouts out on it */
+};
+
 /*
  * VFS internal module
  */
@@ -46,17 +60,52 @@ struct vfs_fsal_module {
 	struct fsal_module module;
 	struct fsal_obj_ops handle_ops;
 	bool only_one_user;
+	/** Idle fds to keep open, 0 to disable the fd cache */
+	uint32_t fd_cache_size;
+	/** Seconds an idle fd is kept */
+	uint32_t fd_cache_lease;
+	/** Merge adjacent UNSTABLE writes of a file into one pwritev */
+	bool write_gather;
+	/** Microseconds to gather COMMITs of a filesystem, 0 to not batch */
+	uint32_t commit_batch_window;
+	/** COMMITs in a batch to flush by syncfs, 0 for never */
+	uint32_t commit_syncfs_threshold;
+	/** Threads helping readdir stat entries, 0 for none */
+	uint32_t readdir_threads;
+	/** Threads for reads missing the page cache, 0 for none */
+	uint32_t read_threads;
+	/** Allocated bytes from which removed files are freed later, 0 off */
+	uint64_t deferred_reclaim_size;
+	/** Bytes of those files freed a second */
+	uint64_t deferred_reclaim_rate;
+	/** Flex files data servers, struct vfs_ff_ds */
+	struct glist_head ff_servers;
+	/** Seconds between LAYOUTSTATS asked of clients */
+	uint32_t ff_stats_hint;
+	/** Seconds a data server is avoided after a LAYOUTERROR */
+	uint32_t ff_fail_time;
 };
 
 /*
  * VFS internal export
  */
+/** When an export's I/O bypasses the page cache */
+enum vfs_direct_io {
+	VFS_DIRECT_NONE,	/*< Never */
+	VFS_DIRECT_AUTO,	/*< Large aligned sequential I/O */
+	VFS_DIRECT_ALWAYS,	/*< All aligned I/O */
+};
+
 struct vfs_fsal_export {
 	struct fsal_export export;
 	struct fsal_filesystem *root_fs;
 	struct glist_head filesystems;
 	int fsid_type;
 	bool async_hsm_restore;
+	/** CFG: enum vfs_direct_io */
+	uint32_t direct_io;
+	/** CFG: Smallest I/O done direct with VFS_DIRECT_AUTO */
+	uint32_t direct_io_size;
 };
 
 #define EXPORT_VFS_FROM_FSAL(fsal) \
@@ -65,10 +114,23 @@ struct vfs_fsal_export {
 /*
  * VFS internal filesystem
  */
+/** COMMITs of a filesystem being gathered, see gather.c */
+struct vfs_commit_batch {
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	struct glist_head waiting;	/*< COMMITs of the batch gathering */
+	uint32_t nwaiting;
+	uint32_t inflight;		/*< COMMITs flushing */
+	bool collecting;		/*< A batch is gathering */
+};
+
 struct vfs_filesystem {
 	struct fsal_filesystem *fs;
 	int root_fd;
 	struct glist_head exports;
+	struct vfs_commit_batch commits;
+	int reclaim_fd;		/*< VFS_RECLAIM_DIR, -1 if none */
+	ino_t reclaim_ino;
 };
 
 /*
@@ -139,9 +201,12 @@ struct vfs_fd {
 	int fd;
 };
 
+/* The state goes last so share states need not carry the whole
+ * state_data union, see vfs_alloc_state().
+ */
 struct vfs_state_fd {
-	struct state_t state;
 	struct vfs_fd vfs_fd;
+	struct state_t state;
 };
 
 /*
@@ -158,6 +223,25 @@ struct vfs_state_fd {
  * this, we save the args that were used to mknod or lookup the socket.
  */
 
+/*
+ * Writes being gathered and fsyncs being shared on a regular file,
+ * see gather.c.  mtx protects all of it.
+ */
+struct vfs_file_io {
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	struct glist_head writes;	/*< Writes waiting for the writer */
+	bool writing;			/*< A thread is writing the file */
+	bool syncing;			/*< A thread is in fsync */
+	uint64_t syncs_started;
+	uint64_t syncs_done;
+	int sync_error;			/*< errno of the last fsync */
+	/** End of the last large I/O, to spot streams.  Atomic, not
+	 *  under mtx.
+	 */
+	uint64_t direct_next;
+};
+
 struct vfs_fsal_obj_handle {
 	struct fsal_obj_handle obj_handle;
 	fsal_dev_t dev;
@@ -171,6 +255,7 @@ struct vfs_fsal_obj_handle {
 		struct {
 			struct fsal_share share;
 			struct vfs_fd fd;
+			struct vfs_file_io io;
 		} file;
 		struct {
 			unsigned char *link_content;
@@ -264,6 +349,7 @@ struct closefd vfs_fsal_open_and_stat(struct fsal_export *exp,
 
 /* State storage */
 void vfs_state_init(void);
+void vfs_state_fd_init(void);
 void vfs_state_release(struct gsh_buffdesc *key);
 struct state_hdl *vfs_state_locate(struct fsal_obj_handle *obj);
 
@@ -272,6 +358,108 @@ fsal_status_t vfs_close_my_fd(struct vfs_fd *my_fd);
 
 fsal_status_t vfs_close(struct fsal_obj_handle *obj_hdl);
 
+/* Idle fd cache */
+int vfs_fdcache_init(uint32_t size, uint32_t lease);
+void vfs_fdcache_shutdown(void);
+int vfs_fdcache_get(struct vfs_fsal_obj_handle *hdl,
+		    fsal_openflags_t openflags);
+bool vfs_fdcache_put(struct vfs_fsal_obj_handle *hdl,
+		     fsal_openflags_t openflags, int fd);
+void vfs_fdcache_done(struct fsal_obj_handle *obj_hdl,
+		      fsal_openflags_t openflags, int fd);
+void vfs_fdcache_purge(struct vfs_fsal_obj_handle *hdl);
+#ifdef USE_DBUS
+void vfs_fdcache_extract_stats(struct fsal_module *fsal_hdl, void *iter);
+void vfs_append_stat(void *iter, const char *name, uint64_t count,
+		     double avg, double min, double max);
+#endif
+void vfs_fdcache_reset_stats(struct fsal_module *fsal_hdl);
+
+/* I/O bypassing the page cache */
+
+/** Mode bit of fds opened O_DIRECT, kept apart in the fd cache */
+#define VFS_O_DIRECT 0x8000
+
+/** Alignment O_DIRECT needs, good for 512 byte and 4k sectors */
+#define VFS_DIRECT_ALIGN 4096
+
+#ifdef USE_DBUS
+void vfs_direct_extract_stats(void *iter);
+#endif
+void vfs_direct_reset_stats(void);
+
+/* Flex files layouts */
+extern struct config_item vfs_ff_ds_params[];
+void *vfs_ff_ds_init(void *link_mem, void *self_struct);
+int vfs_ff_ds_commit(void *node, void *link_mem, void *self_struct,
+		     struct config_error_type *err_type);
+void vfs_ff_init_ops(struct vfs_fsal_export *myself, const char *export_path);
+
+/* Write gathering and shared fsyncs */
+void vfs_file_io_init(struct vfs_fsal_obj_handle *hdl);
+void vfs_file_io_fini(struct vfs_fsal_obj_handle *hdl);
+ssize_t vfs_gather_write(struct vfs_fsal_obj_handle *hdl, int fd,
+			 struct fsal_io_arg *arg);
+int vfs_commit_fd(struct vfs_fsal_obj_handle *hdl, int fd);
+void vfs_commit_batch_init(struct vfs_commit_batch *batch);
+void vfs_commit_batch_fini(struct vfs_commit_batch *batch);
+#ifdef USE_DBUS
+void vfs_commit_extract_stats(void *iter);
+#endif
+void vfs_commit_reset_stats(void);
+
+/* Deferred reclaim of large removed files */
+#define VFS_RECLAIM_DIR ".ganesha_reclaim"
+/** Length of the names in VFS_RECLAIM_DIR, the inode number in hex */
+#define VFS_RECLAIM_NAMELEN 17
+/** Length of the name a file is renamed to before it is moved there */
+#define VFS_RECLAIM_TMPLEN (sizeof(VFS_RECLAIM_DIR) + VFS_RECLAIM_NAMELEN)
+int vfs_reclaim_init(uint64_t size, uint64_t rate);
+void vfs_reclaim_shutdown(void);
+void vfs_reclaim_fs_init(struct vfs_filesystem *vfs_fs);
+void vfs_reclaim_fs_fini(struct vfs_filesystem *vfs_fs);
+bool vfs_reclaim_defer(struct vfs_filesystem *vfs_fs, int dirfd,
+		       const char *name, const struct stat *st, char *tname);
+int vfs_reclaim_move(struct vfs_filesystem *vfs_fs, int dirfd,
+		     const char *tname, const struct stat *st);
+
+/**
+ * @brief Whether a directory entry is VFS_RECLAIM_DIR, kept from clients
+ *
+ * @param[in] fs    Filesystem of the directory
+ * @param[in] name  Name of the entry
+ * @param[in] ino   Its inode number
+ */
+static inline bool vfs_reclaim_hidden(struct fsal_filesystem *fs,
+				      const char *name, uint64_t ino)
+{
+	struct vfs_filesystem *vfs_fs = fs != NULL ? fs->private_data : NULL;
+
+	return vfs_fs != NULL && vfs_fs->reclaim_fd >= 0 &&
+	       ino == vfs_fs->reclaim_ino &&
+	       strcmp(name, VFS_RECLAIM_DIR) == 0;
+}
+
+/** An entry of a readdir batch, see readdir.c */
+struct vfs_readdir_prefetch {
+	const char *name;
+	fsal_cookie_t cookie;
+	struct stat stat;
+	vfs_file_handle_t fh;
+	int error;		/*< errno of the fstatat, 0 on success */
+	bool have_fh;		/*< fh holds the handle */
+};
+
+int vfs_readdir_init(uint32_t threads);
+void vfs_readdir_shutdown(void);
+
+/* Reads missing the page cache */
+int vfs_read_init(uint32_t threads);
+void vfs_read_shutdown(void);
+void vfs_readdir_prefetch(int dirfd, struct vfs_fsal_obj_handle *dir,
+			  struct vfs_readdir_prefetch *entries,
+			  uint32_t count);
+
 /* Multiple file descriptor methods */
 struct state_t *vfs_alloc_state(struct fsal_export *exp_hdl,
 				enum state_type state_type,
@@ -320,6 +508,21 @@ fsal_status_t vfs_fallocate(struct fsal_obj_handle *obj_hdl,
 			    uint64_t length, bool allocate);
 #endif
 
+fsal_status_t vfs_io_advise2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state,
+			     struct io_hints *hints);
+
+fsal_status_t vfs_copy(struct fsal_obj_handle *dst_hdl,
+		       struct state_t *dst_state, uint64_t dst_offset,
+		       struct fsal_obj_handle *src_hdl,
+		       struct state_t *src_state, uint64_t src_offset,
+		       uint64_t count, uint64_t *copied);
+fsal_status_t vfs_clone2(struct fsal_obj_handle *dst_hdl,
+			 struct state_t *dst_state, uint64_t dst_offset,
+			 struct fsal_obj_handle *src_hdl,
+			 struct state_t *src_state, uint64_t src_offset,
+			 uint64_t count);
+
 fsal_status_t vfs_commit2(struct fsal_obj_handle *obj_hdl,
 			  off_t offset,
 			  size_t len);
@@ -78,6 +78,7 @@ static struct vfs_fsal_module XFS = {
 			.maxread = FSAL_MAXIOSIZE,
 			.maxwrite = FSAL_MAXIOSIZE,
 			.link_supports_permission_checks = false,
+			.read_plus = true,
 		}
 	},
 	.only_one_user = false
@@ -98,8 +99,25 @@ static struct config_item xfs_params[] = {
 		       module.fs_info.umask),
 	CONF_ITEM_BOOL("auth_xdev_export", false, vfs_fsal_module,
 		       module.fs_info.auth_exportpath_xdev),
+	CONF_ITEM_BOOL("clone_support", true, vfs_fsal_module,
+		       module.fs_info.clone),
 	CONF_ITEM_BOOL("only_one_user", false, vfs_fsal_module,
 		       only_one_user),
+	CONF_ITEM_BOOL("Write_Gather", true, vfs_fsal_module,
+		       write_gather),
+	CONF_ITEM_UI32("Commit_Batch_Window", 0, 100000, 2000,
+		       vfs_fsal_module, commit_batch_window),
+	CONF_ITEM_UI32("Commit_Syncfs_Threshold", 0, UINT32_MAX, 64,
+		       vfs_fsal_module, commit_syncfs_threshold),
+	CONF_ITEM_UI32("Readdir_Threads", 0, 64, 4,
+		       vfs_fsal_module, readdir_threads),
+	CONF_ITEM_UI32("Read_Threads", 0, 256, 8,
+		       vfs_fsal_module, read_threads),
+	CONF_ITEM_UI64("Deferred_Reclaim_Size", 0, UINT64_MAX, 0,
+		       vfs_fsal_module, deferred_reclaim_size),
+	CONF_ITEM_UI64("Deferred_Reclaim_Rate", 1024 * 1024, UINT64_MAX,
+		       1024 * 1024 * 1024,
+		       vfs_fsal_module, deferred_reclaim_rate),
 	CONFIG_EOL
 };
 
@@ -181,6 +199,13 @@ static fsal_status_t init_config(struct fsal_module *xfs_fsal_module,
 	if (!config_error_is_harmless(err_type))
 		return fsalstat(ERR_FSAL_INVAL, 0);
 	display_fsinfo(&xfs_module->module);
+	if (vfs_readdir_init(xfs_module->readdir_threads) != 0)
+		return fsalstat(ERR_FSAL_FAULT, 0);
+	if (vfs_read_init(xfs_module->read_threads) != 0)
+		return fsalstat(ERR_FSAL_FAULT, 0);
+	if (vfs_reclaim_init(xfs_module->deferred_reclaim_size,
+			     xfs_module->deferred_reclaim_rate) != 0)
+		return fsalstat(ERR_FSAL_FAULT, 0);
 	LogFullDebug(COMPONENT_FSAL,
 		     "Supported attributes constant = 0x%" PRIx64,
 		     XFS_SUPPORTED_ATTRIBUTES);
@@ -228,6 +253,10 @@ MODULE_FINI void xfs_unload(void)
 {
 	int retval;
 
+	vfs_readdir_shutdown();
+	vfs_read_shutdown();
+	vfs_reclaim_shutdown();
+
 	retval = unregister_fsal(&XFS.module);
 	if (retval != 0) {
 		fprintf(stderr, "XFS module failed to unregister");
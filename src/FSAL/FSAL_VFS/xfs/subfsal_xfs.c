@@ -35,8 +35,21 @@
 
 /* Export */
 
+static struct config_item_list direct_io_modes[] = {
+	CONFIG_LIST_TOK("None", VFS_DIRECT_NONE),
+	CONFIG_LIST_TOK("Auto", VFS_DIRECT_AUTO),
+	CONFIG_LIST_TOK("Always", VFS_DIRECT_ALWAYS),
+	CONFIG_LIST_EOL
+};
+
 static struct config_item export_params[] = {
 	CONF_ITEM_NOOP("name"),
+	CONF_ITEM_TOKEN("Direct_IO", VFS_DIRECT_NONE,
+			direct_io_modes,
+			vfs_fsal_export, direct_io),
+	CONF_ITEM_UI32("Direct_IO_Size", VFS_DIRECT_ALIGN, FSAL_MAXIOSIZE,
+		       1024 * 1024,
+		       vfs_fsal_export, direct_io_size),
 	CONFIG_EOL
 };
 
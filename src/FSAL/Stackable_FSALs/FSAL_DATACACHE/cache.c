@@ -0,0 +1,638 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @file  cache.c
+ * @brief DATACACHE block cache
+ *
+ * File data is cached in Block_Size pieces, keyed by block index in a
+ * tree per file.  All the blocks of an export share one LRU bounded by
+ * Cache_Size.  Only whole blocks are cached, except for the last block
+ * of a file, which is marked as holding end of file so that reads
+ * reaching it can be answered without the sub-FSAL.
+ *
+ * Blocks belong to the change attribute the file had when they were
+ * read.  A different change attribute seen by a getattrs, or an
+ * invalidate upcall from the sub-FSAL, drops every block of the file.
+ */
+
+#include "config.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include "fsal.h"
+#include "FSAL/fsal_commonlib.h"
+#include "dcache_methods.h"
+
+/**
+ * @brief One cached block of a file
+ */
+struct dcache_block {
+	struct avltree_node node;	/*< On dcache_file.blocks */
+	struct glist_head lru;		/*< On ram_lru or disk_lru */
+	struct dcache_file *file;	/*< File the block belongs to */
+	uint64_t index;			/*< Offset of the block / Block_Size */
+	uint32_t len;			/*< Bytes of data in the block */
+	bool eof;			/*< Block ends the file */
+	char *data;			/*< Contents, NULL if in backing file */
+	uint32_t slot;			/*< Backing file slot if data is NULL */
+};
+
+static int dcache_block_cmpf(const struct avltree_node *lhs,
+			     const struct avltree_node *rhs)
+{
+	struct dcache_block *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct dcache_block, node);
+	rk = avltree_container_of(rhs, struct dcache_block, node);
+
+	if (lk->index < rk->index)
+		return -1;
+	if (lk->index > rk->index)
+		return 1;
+	return 0;
+}
+
+static int dcache_file_cmpf(const struct avltree_node *lhs,
+			    const struct avltree_node *rhs)
+{
+	struct dcache_file *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct dcache_file, node_key);
+	rk = avltree_container_of(rhs, struct dcache_file, node_key);
+
+	if (lk->key.len != rk->key.len)
+		return lk->key.len < rk->key.len ? -1 : 1;
+	return memcmp(lk->key.addr, rk->key.addr, lk->key.len);
+}
+
+/**
+ * @brief Copy data into an iovec, starting at @a pos bytes into it
+ */
+void dcache_iov_copy(struct iovec *iov, int iov_count, size_t pos,
+		     const char *src, size_t len)
+{
+	int i;
+
+	for (i = 0; i < iov_count && len != 0; i++) {
+		size_t n;
+
+		if (pos >= iov[i].iov_len) {
+			pos -= iov[i].iov_len;
+			continue;
+		}
+
+		n = MIN(iov[i].iov_len - pos, len);
+		memcpy((char *)iov[i].iov_base + pos, src, n);
+		src += n;
+		len -= n;
+		pos = 0;
+	}
+}
+
+/**
+ * @brief Free a block
+ *
+ * The file leaves the export's tree with its last block.  Must be
+ * called with the cache lock held.
+ */
+static void dcache_block_free(struct dcache_cache *cache,
+			      struct dcache_block *block)
+{
+	struct dcache_file *file = block->file;
+
+	avltree_remove(&block->node, &file->blocks);
+	glist_del(&block->lru);
+
+	if (block->data != NULL) {
+		cache->ram_blocks--;
+		gsh_free(block->data);
+	} else {
+		cache->free_slots[cache->nfree_slots++] = block->slot;
+	}
+	gsh_free(block);
+
+	if (file->registered && avltree_first(&file->blocks) == NULL) {
+		avltree_remove(&file->node_key, &cache->files);
+		file->registered = false;
+	}
+}
+
+/**
+ * @brief Drop every block of a file
+ *
+ * Must be called with the cache lock held.
+ */
+static void dcache_file_drop(struct dcache_cache *cache,
+			     struct dcache_file *file)
+{
+	struct avltree_node *node;
+
+	while ((node = avltree_first(&file->blocks)) != NULL)
+		dcache_block_free(cache,
+				  avltree_container_of(node,
+						       struct dcache_block,
+						       node));
+	file->gen++;
+	file->change_valid = false;
+}
+
+/**
+ * @brief Move a block out of memory into the backing file
+ *
+ * Takes the slot of the coldest block in the backing file when there is
+ * no free one.  Must be called with the cache lock held.
+ *
+ * @return true if the block is now in the backing file.
+ */
+static bool dcache_block_spill(struct dcache_cache *cache,
+			       struct dcache_block *block,
+			       uint32_t block_size)
+{
+	uint32_t slot;
+	ssize_t n;
+
+	if (cache->nfree_slots == 0) {
+		if (glist_empty(&cache->disk_lru))
+			return false;
+		dcache_block_free(cache,
+				  glist_last_entry(&cache->disk_lru,
+						   struct dcache_block, lru));
+	}
+
+	slot = cache->free_slots[--cache->nfree_slots];
+	n = pwrite(cache->backing_fd, block->data, block->len,
+		   (off_t) slot * block_size);
+	if (n != (ssize_t) block->len) {
+		cache->free_slots[cache->nfree_slots++] = slot;
+		return false;
+	}
+
+	gsh_free(block->data);
+	block->data = NULL;
+	block->slot = slot;
+	cache->ram_blocks--;
+	glist_del(&block->lru);
+	glist_add(&cache->disk_lru, &block->lru);
+	return true;
+}
+
+/**
+ * @brief Bring the cache back under Cache_Size
+ *
+ * Must be called with the cache lock held.
+ */
+static void dcache_evict(struct dcache_cache *cache, uint32_t block_size)
+{
+	while (cache->ram_blocks > cache->ram_max) {
+		struct dcache_block *block;
+
+		block = glist_last_entry(&cache->ram_lru, struct dcache_block,
+					 lru);
+		if (cache->backing_fd < 0 ||
+		    !dcache_block_spill(cache, block, block_size))
+			dcache_block_free(cache, block);
+	}
+}
+
+/**
+ * @brief Find a block, reading it back in if it is in the backing file
+ *
+ * The block becomes the hottest one.  Must be called with the cache
+ * lock held.
+ */
+static struct dcache_block *dcache_block_get(struct dcache_cache *cache,
+					     struct dcache_file *file,
+					     uint64_t index,
+					     uint32_t block_size)
+{
+	struct dcache_block key, *block;
+	struct avltree_node *node;
+
+	key.index = index;
+	node = avltree_lookup(&key.node, &file->blocks);
+	if (node == NULL)
+		return NULL;
+
+	block = avltree_container_of(node, struct dcache_block, node);
+
+	if (block->data == NULL) {
+		char *data = gsh_malloc(block_size);
+		ssize_t n;
+
+		n = pread(cache->backing_fd, data, block->len,
+			  (off_t) block->slot * block_size);
+		if (n != (ssize_t) block->len) {
+			gsh_free(data);
+			dcache_block_free(cache, block);
+			return NULL;
+		}
+
+		cache->free_slots[cache->nfree_slots++] = block->slot;
+		block->data = data;
+		cache->ram_blocks++;
+	}
+
+	glist_del(&block->lru);
+	glist_add(&cache->ram_lru, &block->lru);
+	return block;
+}
+
+/**
+ * @brief Set up the cache of an export
+ *
+ * A backing file that cannot be opened leaves the cache memory only.
+ */
+void dcache_cache_init(struct dcache_fsal_export *export)
+{
+	struct dcache_cache *cache = &export->cache;
+	uint64_t nslots, i;
+
+	PTHREAD_MUTEX_init(&cache->lock, NULL);
+	glist_init(&cache->ram_lru);
+	glist_init(&cache->disk_lru);
+	avltree_init(&cache->files, dcache_file_cmpf, 0);
+	cache->ram_max = MAX(export->cache_size / export->block_size, 1);
+	cache->backing_fd = -1;
+
+	if (export->cache_size == 0 || export->backing_file == NULL)
+		return;
+
+	nslots = MIN(export->backing_size / export->block_size, UINT32_MAX);
+	if (nslots == 0)
+		return;
+
+	cache->backing_fd = open(export->backing_file,
+				 O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (cache->backing_fd < 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Could not open data cache backing file %s: %s",
+			 export->backing_file, strerror(errno));
+		return;
+	}
+
+	cache->free_slots = gsh_malloc(nslots * sizeof(uint32_t));
+	for (i = 0; i < nslots; i++)
+		cache->free_slots[i] = nslots - 1 - i;
+	cache->nfree_slots = nslots;
+}
+
+/**
+ * @brief Tear down the cache of an export
+ *
+ * Every handle of the export has been released by now, which emptied
+ * the cache.
+ */
+void dcache_cache_fini(struct dcache_fsal_export *export)
+{
+	struct dcache_cache *cache = &export->cache;
+
+	LogDebug(COMPONENT_FSAL,
+		 "Data cache hits %"PRIu64" misses %"PRIu64,
+		 cache->hits, cache->misses);
+
+	if (cache->backing_fd >= 0) {
+		close(cache->backing_fd);
+		unlink(export->backing_file);
+	}
+	gsh_free(cache->free_slots);
+	PTHREAD_MUTEX_destroy(&cache->lock);
+}
+
+/**
+ * @brief Set up the cached data of a new handle
+ *
+ * The sub-FSAL handle key is kept so that an upcall can find the file.
+ */
+void dcache_file_init(struct dcache_fsal_export *export,
+		      struct dcache_fsal_obj_handle *handle)
+{
+	struct dcache_file *file = &handle->file;
+	struct gsh_buffdesc key;
+
+	avltree_init(&file->blocks, dcache_block_cmpf, 0);
+
+	if (!dcache_cache_enabled(export, &handle->obj_handle))
+		return;
+
+	op_ctx->fsal_export = export->export.sub_export;
+	handle->sub_handle->obj_ops->handle_to_key(handle->sub_handle, &key);
+	op_ctx->fsal_export = &export->export;
+
+	file->key.addr = gsh_malloc(key.len);
+	memcpy(file->key.addr, key.addr, key.len);
+	file->key.len = key.len;
+}
+
+void dcache_file_release(struct dcache_fsal_export *export,
+			 struct dcache_fsal_obj_handle *handle)
+{
+	struct dcache_cache *cache = &export->cache;
+	struct dcache_file *file = &handle->file;
+
+	if (file->key.addr == NULL)
+		return;
+
+	PTHREAD_MUTEX_lock(&cache->lock);
+	dcache_file_drop(cache, file);
+	PTHREAD_MUTEX_unlock(&cache->lock);
+
+	gsh_free(file->key.addr);
+	file->key.addr = NULL;
+}
+
+/**
+ * @brief Answer a read from the cache
+ *
+ * @return true if the whole read was filled from cached blocks, with
+ *         @c io_amount and @c end_of_file set.  Otherwise the contents
+ *         of the iovec are undefined.
+ */
+bool dcache_cache_read(struct dcache_fsal_export *export,
+		       struct dcache_fsal_obj_handle *handle,
+		       struct fsal_io_arg *read_arg)
+{
+	struct dcache_cache *cache = &export->cache;
+	struct dcache_file *file = &handle->file;
+	uint32_t block_size = export->block_size;
+	size_t want = 0, done = 0;
+	bool eof = false, hit;
+	int i;
+
+	for (i = 0; i < read_arg->iov_count; i++)
+		want += read_arg->iov[i].iov_len;
+
+	PTHREAD_MUTEX_lock(&cache->lock);
+
+	while (done < want) {
+		uint64_t pos = read_arg->offset + done;
+		struct dcache_block *block;
+		uint32_t skip;
+		size_t n;
+
+		block = dcache_block_get(cache, file, pos / block_size,
+					 block_size);
+		if (block == NULL)
+			break;
+
+		skip = pos % block_size;
+		if (skip >= block->len) {
+			/* Past the data of the last block */
+			eof = block->eof;
+			break;
+		}
+
+		n = MIN(block->len - skip, want - done);
+		dcache_iov_copy(read_arg->iov, read_arg->iov_count, done,
+				block->data + skip, n);
+		done += n;
+
+		if (block->eof && skip + n == block->len) {
+			eof = true;
+			break;
+		}
+	}
+
+	hit = want != 0 && (done == want || eof);
+	if (hit) {
+		cache->hits++;
+		read_arg->io_amount = done;
+		read_arg->end_of_file = eof;
+	} else {
+		cache->misses++;
+	}
+
+	dcache_evict(cache, block_size);
+	PTHREAD_MUTEX_unlock(&cache->lock);
+
+	return hit;
+}
+
+/**
+ * @brief Add one block to a file
+ *
+ * Must be called with the cache lock held.
+ */
+static void dcache_block_add(struct dcache_cache *cache,
+			     struct dcache_file *file, uint64_t index,
+			     const char *data, uint32_t len, bool eof,
+			     uint32_t block_size)
+{
+	struct dcache_block *block;
+
+	block = gsh_calloc(1, sizeof(*block));
+	block->file = file;
+	block->index = index;
+
+	if (avltree_insert(&block->node, &file->blocks) != NULL) {
+		/* Already cached */
+		gsh_free(block);
+		return;
+	}
+
+	block->len = len;
+	block->eof = eof;
+	block->data = gsh_malloc(block_size);
+	memcpy(block->data, data, len);
+	glist_add(&cache->ram_lru, &block->lru);
+	cache->ram_blocks++;
+}
+
+/**
+ * @brief Cache data read from the sub-FSAL
+ *
+ * @param[in] gen	Generation of the file when the read was issued
+ * @param[in] offset	Block aligned offset of @a buf in the file
+ * @param[in] buf	Data read
+ * @param[in] len	Bytes in @a buf
+ * @param[in] eof	The read reached end of file
+ *
+ * A trailing partial block is only kept when it ends the file.
+ */
+void dcache_cache_fill(struct dcache_fsal_export *export,
+		       struct dcache_fsal_obj_handle *handle,
+		       uint64_t gen, uint64_t offset,
+		       const char *buf, size_t len, bool eof)
+{
+	struct dcache_cache *cache = &export->cache;
+	struct dcache_file *file = &handle->file;
+	uint32_t block_size = export->block_size;
+	uint64_t index = offset / block_size;
+	size_t pos = 0;
+
+	PTHREAD_MUTEX_lock(&cache->lock);
+
+	if (file->gen != gen)
+		goto out;
+
+	if (!file->registered) {
+		if (avltree_insert(&file->node_key, &cache->files) != NULL) {
+			/* Another handle for the same object caches it */
+			goto out;
+		}
+		file->registered = true;
+	}
+
+	for (; pos + block_size <= len; pos += block_size, index++)
+		dcache_block_add(cache, file, index, buf + pos, block_size,
+				 eof && pos + block_size == len, block_size);
+
+	if (eof && (pos < len || len == 0))
+		dcache_block_add(cache, file, index, buf + pos, len - pos,
+				 true, block_size);
+
+	if (avltree_first(&file->blocks) == NULL) {
+		avltree_remove(&file->node_key, &cache->files);
+		file->registered = false;
+	}
+
+	dcache_evict(cache, block_size);
+
+out:
+	PTHREAD_MUTEX_unlock(&cache->lock);
+}
+
+/**
+ * @brief Drop the blocks a write, truncate or hole punch touches
+ *
+ * The block that ended the file goes too, since the file may have grown
+ * past it.  Our own change to the change attribute is not held against
+ * the blocks that remain: the next one seen is taken as theirs.
+ */
+void dcache_cache_invalidate(struct dcache_fsal_export *export,
+			     struct dcache_fsal_obj_handle *handle,
+			     uint64_t offset, uint64_t length)
+{
+	struct dcache_cache *cache = &export->cache;
+	struct dcache_file *file = &handle->file;
+	uint32_t block_size = export->block_size;
+	uint64_t last = length > UINT64_MAX - offset
+				? UINT64_MAX : offset + length;
+	struct dcache_block key, *block;
+	struct avltree_node *node;
+
+	PTHREAD_MUTEX_lock(&cache->lock);
+
+	file->gen++;
+	file->change_valid = false;
+
+	key.index = offset / block_size;
+	node = avltree_sup(&key.node, &file->blocks);
+	while (node != NULL) {
+		block = avltree_container_of(node, struct dcache_block, node);
+		if (block->index * block_size >= last)
+			break;
+		node = avltree_next(node);
+		dcache_block_free(cache, block);
+	}
+
+	node = avltree_last(&file->blocks);
+	if (node != NULL) {
+		block = avltree_container_of(node, struct dcache_block, node);
+		if (block->eof)
+			dcache_block_free(cache, block);
+	}
+
+	PTHREAD_MUTEX_unlock(&cache->lock);
+}
+
+/**
+ * @brief Check blocks against a change attribute from the sub-FSAL
+ */
+void dcache_cache_note_change(struct dcache_fsal_export *export,
+			      struct dcache_fsal_obj_handle *handle,
+			      const struct attrlist *attrs)
+{
+	struct dcache_cache *cache = &export->cache;
+	struct dcache_file *file = &handle->file;
+
+	if (!FSAL_TEST_MASK(attrs->valid_mask, ATTR_CHANGE))
+		return;
+
+	PTHREAD_MUTEX_lock(&cache->lock);
+
+	if (file->change_valid && file->change != attrs->change) {
+		LogFullDebug(COMPONENT_FSAL,
+			     "Change %"PRIu64" -> %"PRIu64", dropping blocks",
+			     file->change, attrs->change);
+		dcache_file_drop(cache, file);
+	}
+
+	file->change = attrs->change;
+	file->change_valid = true;
+	file->validated = time(NULL);
+
+	PTHREAD_MUTEX_unlock(&cache->lock);
+}
+
+/**
+ * @brief Whether the change attribute was checked recently enough
+ */
+bool dcache_cache_fresh(struct dcache_fsal_export *export,
+			struct dcache_fsal_obj_handle *handle)
+{
+	struct dcache_cache *cache = &export->cache;
+	struct dcache_file *file = &handle->file;
+	bool fresh;
+
+	PTHREAD_MUTEX_lock(&cache->lock);
+	fresh = file->change_valid &&
+		time(NULL) - file->validated < export->validate_interval;
+	PTHREAD_MUTEX_unlock(&cache->lock);
+
+	return fresh;
+}
+
+uint64_t dcache_cache_gen(struct dcache_fsal_export *export,
+			  struct dcache_fsal_obj_handle *handle)
+{
+	struct dcache_cache *cache = &export->cache;
+	uint64_t gen;
+
+	PTHREAD_MUTEX_lock(&cache->lock);
+	gen = handle->file.gen;
+	PTHREAD_MUTEX_unlock(&cache->lock);
+
+	return gen;
+}
+
+/**
+ * @brief Drop the blocks of the file an upcall names
+ */
+void dcache_cache_upcall(struct dcache_fsal_export *export,
+			 struct gsh_buffdesc *key)
+{
+	struct dcache_cache *cache = &export->cache;
+	struct dcache_file probe;
+	struct avltree_node *node;
+
+	probe.key = *key;
+
+	PTHREAD_MUTEX_lock(&cache->lock);
+	node = avltree_lookup(&probe.node_key, &cache->files);
+	if (node != NULL)
+		dcache_file_drop(cache,
+				 avltree_container_of(node, struct dcache_file,
+						      node_key));
+	PTHREAD_MUTEX_unlock(&cache->lock);
+}
@@ -0,0 +1,310 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) Panasas Inc., 2011
+ * Author: Jim Lieb jlieb@panasas.com
+ *
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published
+ *   by the Free Software Foundation; either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @brief DCACHE methods for handles
+ */
+
+/* DCACHE methods for handles
+ */
+
+#ifndef DCACHE_METHODS_H
+#define DCACHE_METHODS_H
+
+#include "avltree.h"
+#include "gsh_list.h"
+#include "fsal_up.h"
+
+struct dcache_fsal_module {
+	struct fsal_module module;
+	struct fsal_obj_ops handle_ops;
+};
+
+extern struct dcache_fsal_module DCACHE;
+
+struct dcache_fsal_obj_handle;
+
+/**
+ * Structure used to store data for read_dirents callback.
+ *
+ * Before executing the upper level callback (it might be another
+ * stackable fsal or the inode cache), the context has to be restored.
+ */
+struct dcache_readdir_state {
+	fsal_readdir_cb cb; /*< Callback to the upper layer. */
+	struct dcache_fsal_export *exp; /*< Export of the current dcachefsal. */
+	void *dir_state; /*< State to be sent to the next callback. */
+};
+
+extern struct fsal_up_vector fsal_up_top;
+void dcache_handle_ops_init(struct fsal_obj_ops *ops);
+
+/**
+ * @brief Block cache of one export
+ *
+ * Blocks held in memory are on @c ram_lru.  When a backing file is
+ * configured, blocks pushed out of memory are written to a slot of
+ * that file and kept on @c disk_lru until the slot is needed again.
+ * Everything is protected by @c lock.
+ */
+struct dcache_cache {
+	pthread_mutex_t lock;
+	struct glist_head ram_lru;	/*< Blocks in memory, hottest first */
+	struct glist_head disk_lru;	/*< Blocks in the backing file */
+	struct avltree files;		/*< Files with blocks, by handle key */
+	uint64_t ram_blocks;		/*< Blocks on ram_lru */
+	uint64_t ram_max;		/*< Cache_Size in blocks */
+	int backing_fd;			/*< Backing file, or -1 */
+	uint32_t *free_slots;		/*< Stack of unused backing slots */
+	uint32_t nfree_slots;
+	uint64_t hits;
+	uint64_t misses;
+};
+
+/*
+ * DCACHE internal export
+ */
+struct dcache_fsal_export {
+	struct fsal_export export;
+	uint32_t block_size;		/*< Block_Size */
+	uint64_t cache_size;		/*< Cache_Size, 0 turns caching off */
+	uint32_t validate_interval;	/*< Validate_Interval in seconds */
+	char *backing_file;		/*< Backing_File */
+	uint64_t backing_size;		/*< Backing_Size */
+	struct dcache_cache cache;
+	/** Upcalls from the sub-FSAL come through here */
+	struct fsal_up_vector up_ops;
+	/** Upcall vector of the layer above us */
+	const struct fsal_up_vector *super_up_ops;
+};
+
+fsal_status_t dcache_lookup_path(struct fsal_export *exp_hdl,
+				 const char *path,
+				 struct fsal_obj_handle **handle,
+				 struct attrlist *attrs_out);
+
+fsal_status_t dcache_create_handle(struct fsal_export *exp_hdl,
+				   struct gsh_buffdesc *hdl_desc,
+				   struct fsal_obj_handle **handle,
+				   struct attrlist *attrs_out);
+
+fsal_status_t dcache_alloc_and_check_handle(
+		struct dcache_fsal_export *export,
+		struct fsal_obj_handle *sub_handle,
+		struct fsal_filesystem *fs,
+		struct fsal_obj_handle **new_handle,
+		fsal_status_t subfsal_status);
+
+/*
+ * DCACHE internal object handle
+ *
+ * It contains a pointer to the fsal_obj_handle used by the subfsal.
+ *
+ * AF_UNIX sockets are strange ducks.  I personally cannot see why they
+ * are here except for the ability of a client to see such an animal with
+ * an 'ls' or get rid of one with an 'rm'.  You can't open them in the
+ * usual file way so open_by_handle_at leads to a deadend.  To work around
+ * this, we save the args that were used to mknod or lookup the socket.
+ */
+
+/**
+ * @brief Cached data of one regular file
+ *
+ * Protected by the lock of the export's cache.  The file is on the
+ * export's @c files tree while it holds blocks, so that an upcall for
+ * its key can find it.  @c gen is bumped by every invalidation so that
+ * a fill racing with a write or truncate is thrown away.
+ */
+struct dcache_file {
+	struct avltree blocks;		/*< Cached blocks, by index */
+	struct avltree_node node_key;	/*< On dcache_cache.files */
+	struct gsh_buffdesc key;	/*< Copy of the sub-FSAL handle key */
+	bool registered;		/*< On dcache_cache.files */
+	bool change_valid;		/*< change is known */
+	uint64_t change;		/*< Change attribute blocks belong to */
+	time_t validated;		/*< When change was last checked */
+	uint64_t gen;			/*< Invalidation generation */
+};
+
+struct dcache_fsal_obj_handle {
+	struct fsal_obj_handle obj_handle; /*< Handle containing dcache data.*/
+	struct fsal_obj_handle *sub_handle; /*< Handle of the sub fsal.*/
+	int32_t refcnt;		/*< Reference count.  This is signed to make
+				   mistakes easy to see. */
+	struct dcache_file file;	/*< Cached data, regular files only */
+	struct fsal_share share;	/*< Share counters of the sub-FSAL's
+					    opens, for reads from the cache.
+					    Protected by obj_lock */
+};
+
+/* Block cache */
+void dcache_cache_init(struct dcache_fsal_export *export);
+void dcache_cache_fini(struct dcache_fsal_export *export);
+void dcache_iov_copy(struct iovec *iov, int iov_count, size_t pos,
+		     const char *src, size_t len);
+void dcache_file_init(struct dcache_fsal_export *export,
+		      struct dcache_fsal_obj_handle *handle);
+void dcache_file_release(struct dcache_fsal_export *export,
+			 struct dcache_fsal_obj_handle *handle);
+bool dcache_cache_read(struct dcache_fsal_export *export,
+		       struct dcache_fsal_obj_handle *handle,
+		       struct fsal_io_arg *read_arg);
+void dcache_cache_fill(struct dcache_fsal_export *export,
+		       struct dcache_fsal_obj_handle *handle,
+		       uint64_t gen, uint64_t offset,
+		       const char *buf, size_t len, bool eof);
+void dcache_cache_invalidate(struct dcache_fsal_export *export,
+			     struct dcache_fsal_obj_handle *handle,
+			     uint64_t offset, uint64_t length);
+void dcache_cache_note_change(struct dcache_fsal_export *export,
+			      struct dcache_fsal_obj_handle *handle,
+			      const struct attrlist *attrs);
+bool dcache_cache_fresh(struct dcache_fsal_export *export,
+			struct dcache_fsal_obj_handle *handle);
+uint64_t dcache_cache_gen(struct dcache_fsal_export *export,
+			  struct dcache_fsal_obj_handle *handle);
+void dcache_cache_upcall(struct dcache_fsal_export *export,
+			 struct gsh_buffdesc *key);
+
+static inline bool dcache_cache_enabled(struct dcache_fsal_export *export,
+					struct fsal_obj_handle *obj_hdl)
+{
+	return export->cache_size != 0 && obj_hdl->type == REGULAR_FILE;
+}
+
+/* Upcalls */
+void dcache_up_ops_init(struct dcache_fsal_export *export,
+			const struct fsal_up_vector *super_up_ops);
+
+int dcache_fsal_open(struct dcache_fsal_obj_handle *, int, fsal_errors_t *);
+int dcache_fsal_readlink(struct dcache_fsal_obj_handle *, fsal_errors_t *);
+
+static inline bool dcache_unopenable_type(object_file_type_t type)
+{
+	if ((type == SOCKET_FILE) || (type == CHARACTER_FILE)
+	    || (type == BLOCK_FILE)) {
+		return true;
+	} else {
+		return false;
+	}
+}
+
+/* I/O management */
+fsal_status_t dcache_close(struct fsal_obj_handle *obj_hdl);
+
+/* Multi-FD */
+fsal_status_t dcache_open2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   fsal_openflags_t openflags,
+			   enum fsal_create_mode createmode,
+			   const char *name,
+			   struct attrlist *attrs_in,
+			   fsal_verifier_t verifier,
+			   struct fsal_obj_handle **new_obj,
+			   struct attrlist *attrs_out,
+			   bool *caller_perm_check);
+bool dcache_check_verifier(struct fsal_obj_handle *obj_hdl,
+			   fsal_verifier_t verifier);
+fsal_openflags_t dcache_status2(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state);
+fsal_status_t dcache_reopen2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state,
+			     fsal_openflags_t openflags);
+void dcache_read2(struct fsal_obj_handle *obj_hdl,
+		  bool bypass,
+		  fsal_async_cb done_cb,
+		  struct fsal_io_arg *read_arg,
+		  void *caller_arg);
+void dcache_write2(struct fsal_obj_handle *obj_hdl,
+		   bool bypass,
+		   fsal_async_cb done_cb,
+		   struct fsal_io_arg *write_arg,
+		   void *caller_arg);
+fsal_status_t dcache_seek2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   struct io_info *info);
+fsal_status_t dcache_io_advise2(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state,
+				struct io_hints *hints);
+fsal_status_t dcache_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
+			     size_t len);
+fsal_status_t dcache_lock_op2(struct fsal_obj_handle *obj_hdl,
+			      struct state_t *state,
+			      void *p_owner,
+			      fsal_lock_op_t lock_op,
+			      fsal_lock_param_t *req_lock,
+			      fsal_lock_param_t *conflicting_lock);
+fsal_status_t dcache_close2(struct fsal_obj_handle *obj_hdl,
+			    struct state_t *state);
+fsal_status_t dcache_merge(struct fsal_obj_handle *orig_hdl,
+			   struct fsal_obj_handle *dupe_hdl);
+fsal_status_t dcache_fallocate(struct fsal_obj_handle *obj_hdl,
+			       struct state_t *state, uint64_t offset,
+			       uint64_t length, bool allocate);
+fsal_status_t dcache_copy(struct fsal_obj_handle *dst_hdl,
+			  struct state_t *dst_state, uint64_t dst_offset,
+			  struct fsal_obj_handle *src_hdl,
+			  struct state_t *src_state, uint64_t src_offset,
+			  uint64_t count, uint64_t *copied);
+fsal_status_t dcache_clone2(struct fsal_obj_handle *dst_hdl,
+			    struct state_t *dst_state, uint64_t dst_offset,
+			    struct fsal_obj_handle *src_hdl,
+			    struct state_t *src_state, uint64_t src_offset,
+			    uint64_t count);
+
+/* extended attributes management */
+fsal_status_t dcache_list_ext_attrs(struct fsal_obj_handle *obj_hdl,
+				    unsigned int cookie,
+				    fsal_xattrent_t *xattrs_tab,
+				    unsigned int xattrs_tabsize,
+				    unsigned int *p_nb_returned,
+				    int *end_of_list);
+fsal_status_t dcache_getextattr_id_by_name(struct fsal_obj_handle *obj_hdl,
+					   const char *xattr_name,
+					   unsigned int *pxattr_id);
+fsal_status_t dcache_getextattr_value_by_name(struct fsal_obj_handle *obj_hdl,
+					      const char *xattr_name,
+					      void *buffer_addr,
+					      size_t buffer_size,
+					      size_t *p_output_size);
+fsal_status_t dcache_getextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
+					    unsigned int xattr_id,
+					    void *buffer_addr,
+					    size_t buffer_size,
+					    size_t *p_output_size);
+fsal_status_t dcache_setextattr_value(struct fsal_obj_handle *obj_hdl,
+				      const char *xattr_name,
+				      void *buffer_addr,
+				      size_t buffer_size,
+				      int create);
+fsal_status_t dcache_setextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
+					    unsigned int xattr_id,
+					    void *buffer_addr,
+					    size_t buffer_size);
+fsal_status_t dcache_remove_extattr_by_id(struct fsal_obj_handle *obj_hdl,
+					  unsigned int xattr_id);
+fsal_status_t dcache_remove_extattr_by_name(struct fsal_obj_handle *obj_hdl,
+					    const char *xattr_name);
+
+#endif			/* DCACHE_METHODS_H */
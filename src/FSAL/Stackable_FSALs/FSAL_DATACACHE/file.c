@@ -0,0 +1,829 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) Panasas Inc., 2011
+ * Author: Jim Lieb jlieb@panasas.com
+ *
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* file.c
+ * File I/O methods for DATACACHE module
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include "fsal.h"
+#include "FSAL/access_check.h"
+#include "fsal_convert.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include "FSAL/fsal_commonlib.h"
+#include "dcache_methods.h"
+
+/**
+ * @brief Callback arg for DATACACHE async callbacks
+ *
+ * DATACACHE needs to know what its object is related to the sub-FSAL's object.
+ * This wraps the given callback arg with DATACACHE specific info
+ */
+struct dcache_async_arg {
+	struct fsal_obj_handle *obj_hdl;	/**< DATACACHE's handle */
+	fsal_async_cb cb;			/**< Wrapped callback */
+	void *cb_arg;				/**< Wrapped callback data */
+};
+
+/**
+ * @brief Callback for DATACACHE async calls
+ *
+ * Unstack, and call up.
+ *
+ * @param[in] obj		Object being acted on
+ * @param[in] ret		Return status of call
+ * @param[in] obj_data		Data for call
+ * @param[in] caller_data	Data for caller
+ */
+void dcache_async_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+		     void *obj_data, void *caller_data)
+{
+	struct fsal_export *save_exp = op_ctx->fsal_export;
+	struct dcache_async_arg *arg = caller_data;
+
+	op_ctx->fsal_export = save_exp->super_export;
+	arg->cb(arg->obj_hdl, ret, obj_data, arg->cb_arg);
+	op_ctx->fsal_export = save_exp;
+
+	gsh_free(arg);
+}
+
+/**
+ * @brief Mirror the change of an open's mode in a handle's share counters
+ *
+ * The sub-FSAL checks share reservations as files are opened and read;
+ * DATACACHE keeps the same counters to check those it reads from the
+ * cache.
+ *
+ * @param[in] obj_hdl	DATACACHE's handle
+ * @param[in] old	Previous mode of the open
+ * @param[in] new	New mode of the open
+ */
+static void dcache_share_update(struct fsal_obj_handle *obj_hdl,
+				fsal_openflags_t old, fsal_openflags_t new)
+{
+	struct dcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+
+	PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
+	update_share_counters(&handle->share, old, new);
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+}
+
+static inline bool dcache_share_state(struct state_t *state)
+{
+	return state->state_type == STATE_TYPE_SHARE ||
+	       state->state_type == STATE_TYPE_NLM_SHARE ||
+	       state->state_type == STATE_TYPE_9P_FID;
+}
+
+/* dcache_close
+ * Close the file if it is still open.
+ * Yes, we ignor lock status.  Closing a file in POSIX
+ * releases all locks but that is state and cache inode's problem.
+ */
+
+fsal_status_t dcache_close(struct fsal_obj_handle *obj_hdl)
+{
+	struct dcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct dcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct dcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->close(handle->sub_handle);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t dcache_open2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   fsal_openflags_t openflags,
+			   enum fsal_create_mode createmode,
+			   const char *name,
+			   struct attrlist *attrs_in,
+			   fsal_verifier_t verifier,
+			   struct fsal_obj_handle **new_obj,
+			   struct attrlist *attrs_out,
+			   bool *caller_perm_check)
+{
+	struct dcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+	struct dcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct dcache_fsal_export,
+			     export);
+	struct fsal_obj_handle *sub_handle = NULL;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->open2(handle->sub_handle, state,
+						  openflags, createmode, name,
+						  attrs_in, verifier,
+						  &sub_handle, attrs_out,
+						  caller_perm_check);
+	op_ctx->fsal_export = &export->export;
+
+	if (name == NULL && (openflags & FSAL_O_TRUNC) &&
+	    dcache_cache_enabled(export, obj_hdl))
+		dcache_cache_invalidate(export, handle, 0, UINT64_MAX);
+
+	if (sub_handle) {
+		/* wrap the subfsal handle in a dcache handle. */
+		status = dcache_alloc_and_check_handle(export, sub_handle,
+						       obj_hdl->fs, new_obj,
+						       status);
+		if (!FSAL_IS_ERROR(status) && state != NULL)
+			dcache_share_update(*new_obj, FSAL_O_CLOSED,
+					    openflags);
+		return status;
+	}
+
+	/* Stateless (global fd) opens take no share reservation */
+	if (!FSAL_IS_ERROR(status) && state != NULL)
+		dcache_share_update(obj_hdl, FSAL_O_CLOSED, openflags);
+
+	return status;
+}
+
+bool dcache_check_verifier(struct fsal_obj_handle *obj_hdl,
+			   fsal_verifier_t verifier)
+{
+	struct dcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct dcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct dcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	bool result =
+		handle->sub_handle->obj_ops->check_verifier(handle->sub_handle,
+							   verifier);
+	op_ctx->fsal_export = &export->export;
+
+	return result;
+}
+
+fsal_openflags_t dcache_status2(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state)
+{
+	struct dcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct dcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct dcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_openflags_t result =
+		handle->sub_handle->obj_ops->status2(handle->sub_handle,
+						    state);
+	op_ctx->fsal_export = &export->export;
+
+	return result;
+}
+
+fsal_status_t dcache_reopen2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state,
+			     fsal_openflags_t openflags)
+{
+	struct dcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct dcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct dcache_fsal_export,
+			     export);
+
+	fsal_openflags_t old_openflags;
+	fsal_status_t status;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	old_openflags = handle->sub_handle->obj_ops->status2(
+						handle->sub_handle, state);
+	status = handle->sub_handle->obj_ops->reopen2(handle->sub_handle,
+						      state, openflags);
+	op_ctx->fsal_export = &export->export;
+
+	if (!FSAL_IS_ERROR(status))
+		dcache_share_update(obj_hdl, old_openflags, openflags);
+
+	if ((openflags & FSAL_O_TRUNC) && dcache_cache_enabled(export, obj_hdl))
+		dcache_cache_invalidate(export, handle, 0, UINT64_MAX);
+
+	return status;
+}
+
+/**
+ * @brief Context of a read that missed the cache
+ */
+struct dcache_read_arg {
+	struct fsal_obj_handle *obj_hdl;	/**< DATACACHE's handle */
+	struct dcache_fsal_export *export;	/**< DATACACHE's export */
+	fsal_async_cb cb;			/**< Wrapped callback */
+	void *cb_arg;				/**< Wrapped callback data */
+	struct fsal_io_arg *read_arg;		/**< Read being answered */
+	uint64_t gen;				/**< File generation at issue */
+	char *buf;				/**< Block aligned data */
+	struct fsal_io_arg *sub_arg;		/**< Read of the blocks */
+};
+
+/**
+ * @brief Callback for the block read of a cache miss
+ *
+ * Caches the blocks, then answers the original read from them.
+ *
+ * @param[in] obj		Object being acted on
+ * @param[in] ret		Return status of call
+ * @param[in] obj_data		Data for call
+ * @param[in] caller_data	Data for caller
+ */
+static void dcache_read_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			   void *obj_data, void *caller_data)
+{
+	struct fsal_export *save_exp = op_ctx->fsal_export;
+	struct dcache_read_arg *arg = caller_data;
+	struct dcache_fsal_obj_handle *handle =
+		container_of(arg->obj_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+	struct fsal_io_arg *read_arg = arg->read_arg;
+	struct fsal_io_arg *sub_arg = arg->sub_arg;
+
+	if (!FSAL_IS_ERROR(ret)) {
+		size_t skip = read_arg->offset - sub_arg->offset;
+		size_t got = sub_arg->io_amount;
+		size_t want = 0, n = 0;
+		int i;
+
+		for (i = 0; i < read_arg->iov_count; i++)
+			want += read_arg->iov[i].iov_len;
+
+		dcache_cache_fill(arg->export, handle, arg->gen,
+				  sub_arg->offset, arg->buf, got,
+				  sub_arg->end_of_file);
+
+		if (got > skip) {
+			n = MIN(got - skip, want);
+			dcache_iov_copy(read_arg->iov, read_arg->iov_count, 0,
+					arg->buf + skip, n);
+		}
+		read_arg->io_amount = n;
+		read_arg->end_of_file = sub_arg->end_of_file &&
+					skip + n >= got;
+	}
+
+	op_ctx->fsal_export = &arg->export->export;
+	arg->cb(arg->obj_hdl, ret, read_arg, arg->cb_arg);
+	op_ctx->fsal_export = save_exp;
+
+	gsh_free(arg->buf);
+	gsh_free(arg->sub_arg);
+	gsh_free(arg);
+}
+
+/**
+ * @brief Check that a read may be answered from the cache
+ *
+ * These are the checks the sub-FSAL's read makes as it picks the fd to
+ * read with: the state is open for read, or the open state of a lock
+ * state is, or else no share reservation on the file denies reads.
+ *
+ * @note op_ctx->fsal_export must be the sub-FSAL's export.
+ */
+static fsal_status_t dcache_read_check(struct dcache_fsal_obj_handle *handle,
+				       struct state_t *state, bool bypass)
+{
+	struct fsal_obj_handle *sub_handle = handle->sub_handle;
+	fsal_status_t status;
+
+	if (state != NULL) {
+		if (open_correct(sub_handle->obj_ops->status2(sub_handle,
+							      state),
+				 FSAL_O_READ))
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+		if ((state->state_type == STATE_TYPE_LOCK ||
+		     state->state_type == STATE_TYPE_NLM_LOCK) &&
+		    state->state_data.lock.openstate != NULL &&
+		    open_correct(sub_handle->obj_ops->status2(
+					sub_handle,
+					state->state_data.lock.openstate),
+				 FSAL_O_READ))
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	PTHREAD_RWLOCK_rdlock(&handle->obj_handle.obj_lock);
+	status = check_share_conflict(&handle->share, FSAL_O_READ, bypass);
+	PTHREAD_RWLOCK_unlock(&handle->obj_handle.obj_lock);
+
+	return status;
+}
+
+/**
+ * @brief Check the change attribute of a file once Validate_Interval
+ *        has passed
+ */
+static void dcache_revalidate(struct dcache_fsal_export *export,
+			      struct dcache_fsal_obj_handle *handle)
+{
+	struct attrlist attrs;
+	fsal_status_t status;
+
+	if (dcache_cache_fresh(export, handle))
+		return;
+
+	fsal_prepare_attrs(&attrs, ATTR_CHANGE);
+
+	op_ctx->fsal_export = export->export.sub_export;
+	status = handle->sub_handle->obj_ops->getattrs(handle->sub_handle,
+						       &attrs);
+	op_ctx->fsal_export = &export->export;
+
+	if (FSAL_IS_ERROR(status))
+		dcache_cache_invalidate(export, handle, 0, UINT64_MAX);
+	else
+		dcache_cache_note_change(export, handle, &attrs);
+
+	fsal_release_attrs(&attrs);
+}
+
+static void dcache_read_through(struct dcache_fsal_export *export,
+				struct dcache_fsal_obj_handle *handle,
+				bool bypass,
+				fsal_async_cb done_cb,
+				struct fsal_io_arg *read_arg,
+				void *caller_arg)
+{
+	struct dcache_async_arg *arg;
+
+	/* Set up async callback */
+	arg = gsh_calloc(1, sizeof(*arg));
+	arg->obj_hdl = &handle->obj_handle;
+	arg->cb = done_cb;
+	arg->cb_arg = caller_arg;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	handle->sub_handle->obj_ops->read2(handle->sub_handle, bypass,
+					  dcache_async_cb, read_arg, arg);
+	op_ctx->fsal_export = &export->export;
+}
+
+/**
+ * @brief Read from the cache, or read the blocks covering the request
+ *
+ * READ_PLUS style reads, which want hole information, and reads too
+ * large to round out to whole blocks go straight to the sub-FSAL.
+ */
+void dcache_read2(struct fsal_obj_handle *obj_hdl,
+		  bool bypass,
+		  fsal_async_cb done_cb,
+		  struct fsal_io_arg *read_arg,
+		  void *caller_arg)
+{
+	struct dcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+	struct dcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct dcache_fsal_export,
+			     export);
+	struct fsal_export *sub_export = export->export.sub_export;
+	uint32_t block_size = export->block_size;
+	struct dcache_read_arg *arg;
+	fsal_status_t status;
+	uint64_t start, end;
+	size_t want = 0;
+	int i;
+
+	if (!dcache_cache_enabled(export, obj_hdl) || read_arg->info != NULL) {
+		dcache_read_through(export, handle, bypass, done_cb, read_arg,
+				    caller_arg);
+		return;
+	}
+
+	dcache_revalidate(export, handle);
+
+	/* A read the sub-FSAL would refuse goes to it to be refused */
+	op_ctx->fsal_export = sub_export;
+	status = dcache_read_check(handle, read_arg->state, bypass);
+	op_ctx->fsal_export = &export->export;
+
+	if (!FSAL_IS_ERROR(status) &&
+	    dcache_cache_read(export, handle, read_arg)) {
+		done_cb(obj_hdl, fsalstat(ERR_FSAL_NO_ERROR, 0), read_arg,
+			caller_arg);
+		return;
+	}
+
+	for (i = 0; i < read_arg->iov_count; i++)
+		want += read_arg->iov[i].iov_len;
+
+	start = read_arg->offset - read_arg->offset % block_size;
+	end = read_arg->offset + want;
+	end += (block_size - end % block_size) % block_size;
+
+	op_ctx->fsal_export = sub_export;
+	if (end - start > sub_export->exp_ops.fs_maxread(sub_export)) {
+		op_ctx->fsal_export = &export->export;
+		dcache_read_through(export, handle, bypass, done_cb, read_arg,
+				    caller_arg);
+		return;
+	}
+	op_ctx->fsal_export = &export->export;
+
+	arg = gsh_calloc(1, sizeof(*arg));
+	arg->obj_hdl = obj_hdl;
+	arg->export = export;
+	arg->cb = done_cb;
+	arg->cb_arg = caller_arg;
+	arg->read_arg = read_arg;
+	arg->gen = dcache_cache_gen(export, handle);
+	arg->buf = gsh_malloc(end - start);
+	arg->sub_arg = gsh_calloc(1, sizeof(struct fsal_io_arg) +
+				     sizeof(struct iovec));
+	arg->sub_arg->state = read_arg->state;
+	arg->sub_arg->offset = start;
+	arg->sub_arg->iov_count = 1;
+	arg->sub_arg->iov[0].iov_base = arg->buf;
+	arg->sub_arg->iov[0].iov_len = end - start;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = sub_export;
+	handle->sub_handle->obj_ops->read2(handle->sub_handle, bypass,
+					  dcache_read_cb, arg->sub_arg, arg);
+	op_ctx->fsal_export = &export->export;
+}
+
+/**
+ * @brief Callback for writes, dropping the blocks written
+ *
+ * The blocks are dropped again here because a miss may have read them
+ * back while the write was in flight.
+ *
+ * @param[in] obj		Object being acted on
+ * @param[in] ret		Return status of call
+ * @param[in] obj_data		Data for call
+ * @param[in] caller_data	Data for caller
+ */
+static void dcache_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			    void *obj_data, void *caller_data)
+{
+	struct dcache_async_arg *arg = caller_data;
+	struct fsal_io_arg *write_arg = obj_data;
+	struct dcache_fsal_obj_handle *handle =
+		container_of(arg->obj_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+	struct dcache_fsal_export *export =
+		container_of(op_ctx->fsal_export->super_export,
+			     struct dcache_fsal_export, export);
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < write_arg->iov_count; i++)
+		len += write_arg->iov[i].iov_len;
+
+	dcache_cache_invalidate(export, handle, write_arg->offset, len);
+
+	dcache_async_cb(obj, ret, obj_data, caller_data);
+}
+
+void dcache_write2(struct fsal_obj_handle *obj_hdl,
+		   bool bypass,
+		   fsal_async_cb done_cb,
+		   struct fsal_io_arg *write_arg,
+		   void *caller_arg)
+{
+	struct dcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct dcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct dcache_fsal_export,
+			     export);
+	struct dcache_async_arg *arg;
+	fsal_async_cb cb = dcache_async_cb;
+
+	if (dcache_cache_enabled(export, obj_hdl)) {
+		size_t len = 0;
+		int i;
+
+		for (i = 0; i < write_arg->iov_count; i++)
+			len += write_arg->iov[i].iov_len;
+
+		dcache_cache_invalidate(export, handle, write_arg->offset,
+					len);
+		cb = dcache_write_cb;
+	}
+
+	/* Set up async callback */
+	arg = gsh_calloc(1, sizeof(*arg));
+	arg->obj_hdl = obj_hdl;
+	arg->cb = done_cb;
+	arg->cb_arg = caller_arg;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	handle->sub_handle->obj_ops->write2(handle->sub_handle, bypass,
+					   cb, write_arg, arg);
+	op_ctx->fsal_export = &export->export;
+}
+
+fsal_status_t dcache_seek2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   struct io_info *info)
+{
+	struct dcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct dcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct dcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->seek2(handle->sub_handle, state,
+						  info);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t dcache_io_advise2(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state,
+				struct io_hints *hints)
+{
+	struct dcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct dcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct dcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->io_advise2(handle->sub_handle,
+						       state, hints);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t dcache_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
+			     size_t len)
+{
+	struct dcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct dcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct dcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->commit2(handle->sub_handle, offset,
+						    len);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t dcache_lock_op2(struct fsal_obj_handle *obj_hdl,
+			      struct state_t *state,
+			      void *p_owner,
+			      fsal_lock_op_t lock_op,
+			      fsal_lock_param_t *req_lock,
+			      fsal_lock_param_t *conflicting_lock)
+{
+	struct dcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct dcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct dcache_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->lock_op2(handle->sub_handle, state,
+						     p_owner, lock_op, req_lock,
+						     conflicting_lock);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t dcache_close2(struct fsal_obj_handle *obj_hdl,
+			    struct state_t *state)
+{
+	struct dcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct dcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct dcache_fsal_export,
+			     export);
+
+	fsal_openflags_t old_openflags = FSAL_O_CLOSED;
+	fsal_status_t status;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	if (dcache_share_state(state))
+		old_openflags = handle->sub_handle->obj_ops->status2(
+						handle->sub_handle, state);
+	status = handle->sub_handle->obj_ops->close2(handle->sub_handle,
+						     state);
+	op_ctx->fsal_export = &export->export;
+
+	if (old_openflags != FSAL_O_CLOSED)
+		dcache_share_update(obj_hdl, old_openflags, FSAL_O_CLOSED);
+
+	return status;
+}
+
+/**
+ * @brief Merge a duplicate handle with an original handle
+ *
+ * The sub-FSAL merges its own, the share counters kept for the cache
+ * are merged the same way.
+ *
+ * @param[in]  orig_hdl  Original handle
+ * @param[in]  dupe_hdl Handle to merge into original
+ *
+ * @return FSAL status.
+ */
+fsal_status_t dcache_merge(struct fsal_obj_handle *orig_hdl,
+			   struct fsal_obj_handle *dupe_hdl)
+{
+	struct dcache_fsal_obj_handle *orig =
+		container_of(orig_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+	struct dcache_fsal_obj_handle *dupe =
+		container_of(dupe_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+	struct dcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct dcache_fsal_export,
+			     export);
+	fsal_status_t status;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	status = orig->sub_handle->obj_ops->merge(orig->sub_handle,
+						  dupe->sub_handle);
+	op_ctx->fsal_export = &export->export;
+
+	if (!FSAL_IS_ERROR(status) && orig_hdl->type == REGULAR_FILE &&
+	    dupe_hdl->type == REGULAR_FILE) {
+		PTHREAD_RWLOCK_wrlock(&orig_hdl->obj_lock);
+		status = merge_share(&orig->share, &dupe->share);
+		PTHREAD_RWLOCK_unlock(&orig_hdl->obj_lock);
+	}
+
+	return status;
+}
+
+fsal_status_t dcache_fallocate(struct fsal_obj_handle *obj_hdl,
+			       struct state_t *state, uint64_t offset,
+			       uint64_t length, bool allocate)
+{
+	struct dcache_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct dcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct dcache_fsal_export,
+			     export);
+	fsal_status_t status;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	status = handle->sub_handle->obj_ops->fallocate(handle->sub_handle,
+							state, offset, length,
+							allocate);
+	op_ctx->fsal_export = &export->export;
+
+	if (dcache_cache_enabled(export, obj_hdl))
+		dcache_cache_invalidate(export, handle, offset, length);
+
+	return status;
+}
+
+fsal_status_t dcache_copy(struct fsal_obj_handle *dst_hdl,
+			  struct state_t *dst_state, uint64_t dst_offset,
+			  struct fsal_obj_handle *src_hdl,
+			  struct state_t *src_state, uint64_t src_offset,
+			  uint64_t count, uint64_t *copied)
+{
+	struct dcache_fsal_obj_handle *dst =
+		container_of(dst_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+	struct dcache_fsal_obj_handle *src =
+		container_of(src_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct dcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct dcache_fsal_export,
+			     export);
+	fsal_status_t status;
+
+	if (dst->sub_handle->fsal != src->sub_handle->fsal)
+		return fsalstat(ERR_FSAL_XDEV, 0);
+
+	/* calling subfsal method, writes go straight through so the source
+	 * below is current
+	 */
+	op_ctx->fsal_export = export->export.sub_export;
+	status = dst->sub_handle->obj_ops->copy(dst->sub_handle, dst_state,
+						dst_offset, src->sub_handle,
+						src_state, src_offset, count,
+						copied);
+	op_ctx->fsal_export = &export->export;
+
+	if (dcache_cache_enabled(export, dst_hdl))
+		dcache_cache_invalidate(export, dst, dst_offset, count);
+
+	return status;
+}
+
+fsal_status_t dcache_clone2(struct fsal_obj_handle *dst_hdl,
+			    struct state_t *dst_state, uint64_t dst_offset,
+			    struct fsal_obj_handle *src_hdl,
+			    struct state_t *src_state, uint64_t src_offset,
+			    uint64_t count)
+{
+	struct dcache_fsal_obj_handle *dst =
+		container_of(dst_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+	struct dcache_fsal_obj_handle *src =
+		container_of(src_hdl, struct dcache_fsal_obj_handle,
+			     obj_handle);
+
+	struct dcache_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct dcache_fsal_export,
+			     export);
+	fsal_status_t status;
+
+	if (dst->sub_handle->fsal != src->sub_handle->fsal)
+		return fsalstat(ERR_FSAL_XDEV, 0);
+
+	/* calling subfsal method, as for copy the source below is current */
+	op_ctx->fsal_export = export->export.sub_export;
+	status = dst->sub_handle->obj_ops->clone2(dst->sub_handle, dst_state,
+						  dst_offset, src->sub_handle,
+						  src_state, src_offset,
+						  count);
+	op_ctx->fsal_export = &export->export;
+
+	if (dcache_cache_enabled(export, dst_hdl))
+		dcache_cache_invalidate(export, dst, dst_offset,
+					count != 0 ? count : UINT64_MAX);
+
+	return status;
+}
@@ -0,0 +1,180 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @file  up.c
+ * @brief DATACACHE upcalls
+ *
+ * The sub-FSAL is given our own upcall vector.  Invalidations and
+ * attribute updates drop the cached data of the file before being
+ * passed up; everything else is passed up unchanged, with the vector of
+ * the layer above.
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include "fsal_up.h"
+#include "FSAL/fsal_commonlib.h"
+#include "dcache_methods.h"
+
+static inline struct dcache_fsal_export *
+dcache_up_export(const struct fsal_up_vector *vec)
+{
+	return container_of(vec->up_fsal_export, struct dcache_fsal_export,
+			    export);
+}
+
+static fsal_status_t dcache_up_invalidate(const struct fsal_up_vector *vec,
+					  struct gsh_buffdesc *obj,
+					  uint32_t flags)
+{
+	struct dcache_fsal_export *export = dcache_up_export(vec);
+
+	if (flags & (FSAL_UP_INVALIDATE_ATTRS | FSAL_UP_INVALIDATE_CONTENT))
+		dcache_cache_upcall(export, obj);
+
+	return export->super_up_ops->invalidate(export->super_up_ops, obj,
+						flags);
+}
+
+static fsal_status_t dcache_up_update(const struct fsal_up_vector *vec,
+				      struct gsh_buffdesc *obj,
+				      struct attrlist *attr,
+				      uint32_t flags)
+{
+	struct dcache_fsal_export *export = dcache_up_export(vec);
+
+	if (FSAL_TEST_MASK(attr->valid_mask,
+			   ATTR_SIZE | ATTR_CHANGE | ATTR_MTIME))
+		dcache_cache_upcall(export, obj);
+
+	return export->super_up_ops->update(export->super_up_ops, obj, attr,
+					    flags);
+}
+
+static fsal_status_t
+dcache_up_invalidate_close(const struct fsal_up_vector *vec,
+			   struct gsh_buffdesc *obj, uint32_t flags)
+{
+	struct dcache_fsal_export *export = dcache_up_export(vec);
+
+	if (flags & (FSAL_UP_INVALIDATE_ATTRS | FSAL_UP_INVALIDATE_CONTENT))
+		dcache_cache_upcall(export, obj);
+
+	return export->super_up_ops->invalidate_close(export->super_up_ops,
+						      obj, flags);
+}
+
+static state_status_t dcache_up_lock_grant(const struct fsal_up_vector *vec,
+					   struct gsh_buffdesc *file,
+					   void *owner,
+					   fsal_lock_param_t *lock_param)
+{
+	struct dcache_fsal_export *export = dcache_up_export(vec);
+
+	return export->super_up_ops->lock_grant(export->super_up_ops, file,
+						owner, lock_param);
+}
+
+static state_status_t dcache_up_lock_avail(const struct fsal_up_vector *vec,
+					   struct gsh_buffdesc *file,
+					   void *owner,
+					   fsal_lock_param_t *lock_param)
+{
+	struct dcache_fsal_export *export = dcache_up_export(vec);
+
+	return export->super_up_ops->lock_avail(export->super_up_ops, file,
+						owner, lock_param);
+}
+
+static state_status_t
+dcache_up_layoutrecall(const struct fsal_up_vector *vec,
+		       struct gsh_buffdesc *handle,
+		       layouttype4 layout_type,
+		       bool changed,
+		       const struct pnfs_segment *segment,
+		       void *cookie,
+		       struct layoutrecall_spec *spec)
+{
+	struct dcache_fsal_export *export = dcache_up_export(vec);
+
+	return export->super_up_ops->layoutrecall(export->super_up_ops,
+						  handle, layout_type,
+						  changed, segment, cookie,
+						  spec);
+}
+
+static state_status_t
+dcache_up_layoutrecall_fsid(const struct fsal_up_vector *vec,
+			    layouttype4 layout_type,
+			    bool changed,
+			    layoutiomode4 io_mode,
+			    const fsal_fsid_t *fsid)
+{
+	struct dcache_fsal_export *export = dcache_up_export(vec);
+
+	return export->super_up_ops->layoutrecall_fsid(export->super_up_ops,
+						       layout_type, changed,
+						       io_mode, fsid);
+}
+
+static state_status_t dcache_up_delegrecall(const struct fsal_up_vector *vec,
+					    struct gsh_buffdesc *handle)
+{
+	struct dcache_fsal_export *export = dcache_up_export(vec);
+
+	return export->super_up_ops->delegrecall(export->super_up_ops,
+						 handle);
+}
+
+/**
+ * @brief Set up the upcall vector handed to the sub-FSAL
+ *
+ * @param[in] export		Our export
+ * @param[in] super_up_ops	Upcall vector of the layer above
+ */
+void dcache_up_ops_init(struct dcache_fsal_export *export,
+			const struct fsal_up_vector *super_up_ops)
+{
+	struct fsal_up_vector *my_up_ops = &export->up_ops;
+
+	/* Init with super ops. Struct copy */
+	*my_up_ops = *super_up_ops;
+	export->super_up_ops = super_up_ops;
+
+	up_ready_init(my_up_ops);
+	my_up_ops->up_gsh_export = op_ctx->ctx_export;
+	my_up_ops->up_fsal_export = &export->export;
+
+	/* Replace cache-related calls */
+	my_up_ops->invalidate = dcache_up_invalidate;
+	my_up_ops->update = dcache_up_update;
+	my_up_ops->invalidate_close = dcache_up_invalidate_close;
+
+	/* These are pass-through calls */
+	my_up_ops->lock_grant = dcache_up_lock_grant;
+	my_up_ops->lock_avail = dcache_up_lock_avail;
+	my_up_ops->layoutrecall = dcache_up_layoutrecall;
+	my_up_ops->layoutrecall_fsid = dcache_up_layoutrecall_fsid;
+	my_up_ops->delegrecall = dcache_up_delegrecall;
+}
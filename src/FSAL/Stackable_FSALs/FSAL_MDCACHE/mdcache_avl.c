@@ -43,6 +43,7 @@
 #include "fsal.h"
 #include "mdcache_int.h"
 #include "mdcache_avl.h"
+#include "mdcache_lru.h"
 #include "murmur3.h"
 #include "city.h"
 
@@ -53,6 +54,64 @@
 #include <pthread.h>
 #include <assert.h>
 
+/** Negative dirents held by all directories */
+static uint32_t mdc_neg_dirents;
+
+/**
+ * @brief Hash a dirent name
+ *
+ * @param[in] name  The name
+ *
+ * @return The hash the name trees are ordered by
+ */
+static inline uint64_t mdcache_avl_namehash(const char *name)
+{
+#if AVL_HASH_MURMUR3
+	uint32_t hk[4];
+	uint64_t namehash;
+
+	MurmurHash3_x64_128(name, strlen(name), 67, hk);
+	memcpy(&namehash, hk, 8);
+	return namehash;
+#else
+	return CityHash64WithSeed(name, strlen(name), 67);
+#endif
+}
+
+static inline int avl_neg_cmpf(const struct avltree_node *lhs,
+			       const struct avltree_node *rhs)
+{
+	mdcache_neg_dirent_t *lk, *rk;
+
+	lk = avltree_container_of(lhs, mdcache_neg_dirent_t, node);
+	rk = avltree_container_of(rhs, mdcache_neg_dirent_t, node);
+
+	if (lk->namehash < rk->namehash)
+		return -1;
+
+	if (lk->namehash > rk->namehash)
+		return 1;
+
+	return strcmp(lk->name, rk->name);
+}
+
+static inline int avl_resume_cmpf(const struct avltree_node *lhs,
+				  const struct avltree_node *rhs)
+{
+	mdcache_resume_ck_t *lk, *rk;
+
+	lk = avltree_container_of(lhs, mdcache_resume_ck_t, node);
+	rk = avltree_container_of(rhs, mdcache_resume_ck_t, node);
+
+	if (lk->ck < rk->ck)
+		return -1;
+
+	if (lk->ck > rk->ck)
+		return 1;
+
+	return 0;
+}
+
 void
 mdcache_avl_init(mdcache_entry_t *entry)
 {
@@ -62,6 +121,15 @@ mdcache_avl_init(mdcache_entry_t *entry)
 		     0 /* flags */);
 	avltree_init(&entry->fsobj.fsdir.avl.sorted, avl_dirent_sorted_cmpf,
 		     0 /* flags */);
+	avltree_init(&entry->fsobj.fsdir.neg.t, avl_neg_cmpf, 0 /* flags */);
+	glist_init(&entry->fsobj.fsdir.neg.lru);
+	entry->fsobj.fsdir.neg.count = 0;
+	entry->fsobj.fsdir.neg.bloom = NULL;
+	entry->fsobj.fsdir.neg.bloom_ck = 0;
+	avltree_init(&entry->fsobj.fsdir.resume.t, avl_resume_cmpf,
+		     0 /* flags */);
+	glist_init(&entry->fsobj.fsdir.resume.lru);
+	entry->fsobj.fsdir.resume.count = 0;
 }
 
 static inline struct avltree_node *
@@ -151,6 +219,104 @@ avl_dirent_set_deleted(mdcache_entry_t *entry, mdcache_dir_entry_t *v)
 	}
 }
 
+/**
+ * @brief Drop a reference to a dirent block, freeing it on the last
+ *
+ * @param[in] block     The block
+ */
+static void mdcache_dir_block_put(struct dir_block *block)
+{
+	if (--block->refs != 0)
+		return;
+
+	(void) atomic_sub_int64_t(&lru_state.dirent_bytes, DIR_BLOCK_SIZE);
+	gsh_free_tag(MEM_TAG_MDCACHE, block, DIR_BLOCK_SIZE);
+}
+
+/**
+ * @brief Allocate a dirent read into a chunk
+ *
+ * The dirent is carved from the chunk's block, a new block being
+ * started when that one is full.  A name too long to pack well gets a
+ * dirent of its own.
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in] chunk     The chunk the dirent is read into
+ * @param[in] namesize  Size of the name, NUL included
+ *
+ * @return The zeroed dirent.
+ */
+mdcache_dir_entry_t *mdcache_dirent_carve(struct dir_chunk *chunk,
+					  size_t namesize)
+{
+	size_t size = roundup(sizeof(mdcache_dir_entry_t) + namesize,
+			      sizeof(void *));
+	struct dir_block *block = chunk->block;
+	mdcache_dir_entry_t *dirent;
+
+	if (size > DIR_BLOCK_SIZE / 8)
+		return gsh_calloc_tag(MEM_TAG_MDCACHE, 1,
+				      sizeof(mdcache_dir_entry_t) + namesize);
+
+	if (block == NULL || block->used + size > DIR_BLOCK_SIZE) {
+		mdcache_chunk_block_release(chunk);
+		block = gsh_malloc_tag(MEM_TAG_MDCACHE, DIR_BLOCK_SIZE);
+		block->used = roundup(sizeof(*block), sizeof(void *));
+		block->refs = 1;
+		chunk->block = block;
+		(void) atomic_add_int64_t(&lru_state.dirent_bytes,
+					  DIR_BLOCK_SIZE);
+	}
+
+	dirent = (mdcache_dir_entry_t *)((char *)block + block->used);
+	memset(dirent, 0, size);
+	dirent->block_off = block->used;
+	block->used += size;
+	block->refs++;
+
+	return dirent;
+}
+
+/**
+ * @brief Stop carving a chunk's dirents from its current block
+ *
+ * The block is freed once the dirents carved from it are.
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in] chunk     The chunk
+ */
+void mdcache_chunk_block_release(struct dir_chunk *chunk)
+{
+	if (chunk->block == NULL)
+		return;
+
+	mdcache_dir_block_put(chunk->block);
+	chunk->block = NULL;
+}
+
+/**
+ * @brief Free a dirent no tree or chunk holds any more
+ *
+ * @param[in] dirent    The dirent to free
+ */
+static void mdcache_dirent_free(mdcache_dir_entry_t *dirent)
+{
+	if (dirent->ckey.kv.len)
+		mdcache_key_delete(&dirent->ckey);
+
+	if (dirent->block_off != 0) {
+		mdcache_dir_block_put((struct dir_block *)
+				      ((char *)dirent - dirent->block_off));
+		return;
+	}
+
+	mdcache_lru_uncharge_dirent(dirent);
+	gsh_free_tag(MEM_TAG_MDCACHE, dirent,
+		     mdcache_lru_dirent_bytes(dirent));
+}
+
 /**
  * @brief Remove a dirent from a chunk.
  *
@@ -221,10 +387,7 @@ void mdcache_avl_remove(mdcache_entry_t *parent,
 		rmv_detached_dirent(parent, dirent);
 	}
 
-	if (dirent->ckey.kv.len)
-		mdcache_key_delete(&dirent->ckey);
-
-	gsh_free(dirent);
+	mdcache_dirent_free(dirent);
 
 	LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
 			"Just freed dirent %p from chunk %p parent %p",
@@ -273,6 +436,116 @@ int mdcache_avl_insert_ck(mdcache_entry_t *entry, mdcache_dir_entry_t *v)
 	return -1;
 }
 
+/**
+ * @brief Set the bits of a name hash in a bloom filter
+ *
+ * @param[in] bloom     The filter, Dir_Bloom_Bits long
+ * @param[in] namehash  Hash of the name
+ */
+static inline void mdcache_bloom_set(uint64_t *bloom, uint64_t namehash)
+{
+	uint32_t h1 = namehash, h2 = (namehash >> 32) | 1;
+	uint32_t bits = mdcache_param.dir.bloom_bits;
+	int i;
+
+	for (i = 0; i < MDCACHE_BLOOM_PROBES; i++, h1 += h2)
+		bloom[(h1 % bits) / 64] |= 1ULL << (h1 % 64);
+}
+
+/**
+ * @brief Test the bits of a name hash in a bloom filter
+ *
+ * @param[in] bloom     The filter, Dir_Bloom_Bits long
+ * @param[in] namehash  Hash of the name
+ *
+ * @retval false if the name was never added to the filter.
+ * @retval true if it may have been.
+ */
+static inline bool mdcache_bloom_test(uint64_t *bloom, uint64_t namehash)
+{
+	uint32_t h1 = namehash, h2 = (namehash >> 32) | 1;
+	uint32_t bits = mdcache_param.dir.bloom_bits;
+	int i;
+
+	for (i = 0; i < MDCACHE_BLOOM_PROBES; i++, h1 += h2)
+		if (!(bloom[(h1 % bits) / 64] & (1ULL << (h1 % 64))))
+			return false;
+
+	return true;
+}
+
+/**
+ * @brief Remove and free a negative dirent
+ *
+ * @param[in] parent  The directory
+ * @param[in] neg     The negative dirent
+ */
+static void mdcache_avl_neg_remove(mdcache_entry_t *parent,
+				   mdcache_neg_dirent_t *neg)
+{
+	avltree_remove(&neg->node, &parent->fsobj.fsdir.neg.t);
+	glist_del(&neg->lru);
+	parent->fsobj.fsdir.neg.count--;
+	(void) atomic_dec_uint32_t(&mdc_neg_dirents);
+	gsh_free(neg);
+}
+
+/**
+ * @brief Find a negative dirent
+ *
+ * @param[in] parent    The directory
+ * @param[in] namehash  Hash of the name
+ * @param[in] name      The name
+ *
+ * @return The negative dirent or NULL.
+ */
+static mdcache_neg_dirent_t *mdcache_avl_neg_find(mdcache_entry_t *parent,
+						  uint64_t namehash,
+						  const char *name)
+{
+	struct avltree_node *node;
+	mdcache_neg_dirent_t key;
+
+	key.namehash = namehash;
+	key.name = name;
+
+	node = avltree_inline_lookup(&key.node, &parent->fsobj.fsdir.neg.t,
+				     avl_neg_cmpf);
+
+	if (node == NULL)
+		return NULL;
+
+	return avltree_container_of(node, mdcache_neg_dirent_t, node);
+}
+
+/**
+ * @brief Note that a name has been found in a directory
+ *
+ * Forgets the name was ever missing and adds it to the bloom filter.
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in] parent    The directory
+ * @param[in] namehash  Hash of the name
+ * @param[in] name      The name
+ */
+static void mdcache_avl_neg_found(mdcache_entry_t *parent, uint64_t namehash,
+				  const char *name)
+{
+	mdcache_neg_dirent_t *neg;
+
+	if (parent->fsobj.fsdir.neg.bloom != NULL)
+		mdcache_bloom_set(parent->fsobj.fsdir.neg.bloom, namehash);
+
+	if (parent->fsobj.fsdir.neg.count == 0)
+		return;
+
+	neg = mdcache_avl_neg_find(parent, namehash, name);
+
+	if (neg != NULL)
+		mdcache_avl_neg_remove(parent, neg);
+}
+
 #define MIN_COOKIE_VAL 3
 
 /*
@@ -298,9 +571,6 @@ int
 mdcache_avl_insert(mdcache_entry_t *entry, mdcache_dir_entry_t **dirent)
 {
 	mdcache_dir_entry_t *v = *dirent, *v2;
-#if AVL_HASH_MURMUR3
-	uint32_t hk[4];
-#endif
 	struct avltree_node *node;
 	int code;
 
@@ -312,16 +582,12 @@ mdcache_avl_insert(mdcache_entry_t *entry, mdcache_dir_entry_t **dirent)
 #endif
 
 	/* compute hash */
-#if AVL_HASH_MURMUR3
-	MurmurHash3_x64_128(v->name, strlen(v->name), 67, hk);
-	memcpy(&v->namehash, hk, 8);
-#else
-	v->namehash = CityHash64WithSeed(v->name, strlen(v->name), 67);
-#endif
+	v->namehash = mdcache_avl_namehash(v->name);
 
 again:
 
-	node = avltree_insert(&v->node_name, &entry->fsobj.fsdir.avl.t);
+	node = avltree_inline_insert(&v->node_name, &entry->fsobj.fsdir.avl.t,
+				     avl_dirent_name_cmpf);
 
 	if (!node) {
 		/* success */
@@ -342,6 +608,9 @@ again:
 			}
 		}
 
+		/* The name exists now */
+		mdcache_avl_neg_found(entry, v->namehash, v->name);
+
 		if (isFullDebug(COMPONENT_CACHE_INODE) ||
 		    isFullDebug(COMPONENT_NFS_READDIR)) {
 			char str[LOG_BUFF_LEN] = "\0";
@@ -480,8 +749,7 @@ again:
 
 out:
 
-	mdcache_key_delete(&v->ckey);
-	gsh_free(v);
+	mdcache_dirent_free(v);
 	*dirent = v2;
 
 	return code;
@@ -541,26 +809,15 @@ mdcache_dir_entry_t *mdcache_avl_lookup(mdcache_entry_t *entry,
 	struct avltree_node *node;
 	mdcache_dir_entry_t *v2;
 	mdcache_dir_entry_t v;
-#if AVL_HASH_MURMUR3
-	uint32_t hashbuff[4];
-#endif
-	size_t namelen = strlen(name);
 
 	LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
 			"Lookup %s", name);
 
-#if AVL_HASH_MURMUR3
-	MurmurHash3_x64_128(name, namelen, 67, hashbuff);
-	/* This seems to be correct.  The avltree_lookup function looks
-	   as hk.k, but does no namecmp on its own, so there's no need to
-	   allocate space for or copy the name in the key. */
-	memcpy(&v.namehash, hashbuff, 8);
-#else
-	v.namehash = CityHash64WithSeed(name, namelen, 67);
-#endif
+	v.namehash = mdcache_avl_namehash(name);
 	v.name = name;
 
-	node = avltree_lookup(&v.node_name, &entry->fsobj.fsdir.avl.t);
+	node = avltree_inline_lookup_hk(&v.node_name,
+					&entry->fsobj.fsdir.avl.t);
 
 	if (node) {
 		/* return dirent */
@@ -597,6 +854,331 @@ void mdcache_avl_clean_trees(mdcache_entry_t *parent)
 
 		mdcache_avl_remove(parent, dirent);
 	}
+
+	mdcache_avl_neg_clean(parent);
+	mdcache_avl_resume_clean(parent);
+}
+
+/**
+ * @brief Check whether a name is known not to be in a directory
+ *
+ * Consults the negative dirents and, once complete, the bloom filter.
+ *
+ * @note The content lock MUST be held
+ *
+ * @param[in] parent  The directory
+ * @param[in] name    The name, not found in the name tree
+ *
+ * @retval true if the name does not exist.
+ * @retval false if the FSAL must be asked.
+ */
+bool mdcache_avl_neg_lookup(mdcache_entry_t *parent, const char *name)
+{
+	mdcache_neg_dirent_t *neg;
+	uint64_t namehash;
+	time_t now;
+
+	if (mdcache_param.dir.neg_ttl == 0 ||
+	    !test_mde_flags(parent, MDCACHE_DIR_NEGATIVE))
+		return false;
+
+	namehash = mdcache_avl_namehash(name);
+	now = time(NULL);
+
+	if (test_mde_flags(parent, MDCACHE_DIR_BLOOM) &&
+	    now < parent->fsobj.fsdir.neg.bloom_time +
+		  mdcache_param.dir.neg_ttl &&
+	    !mdcache_bloom_test(parent->fsobj.fsdir.neg.bloom, namehash)) {
+		LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
+				"%s not in bloom filter of %p", name, parent);
+		return true;
+	}
+
+	if (parent->fsobj.fsdir.neg.count == 0)
+		return false;
+
+	neg = mdcache_avl_neg_find(parent, namehash, name);
+
+	if (neg == NULL || now >= neg->expire)
+		return false;
+
+	LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
+			"%s negatively cached in %p", name, parent);
+	return true;
+}
+
+/**
+ * @brief Get a directory ready to hold negative dirents
+ *
+ * Throws away what is left from before an invalidation cleared
+ * MDCACHE_DIR_NEGATIVE.
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in] parent  The directory
+ */
+static void mdcache_avl_neg_trust(mdcache_entry_t *parent)
+{
+	if (test_mde_flags(parent, MDCACHE_DIR_NEGATIVE))
+		return;
+
+	mdcache_avl_neg_clean(parent);
+	atomic_set_uint32_t_bits(&parent->mde_flags, MDCACHE_DIR_NEGATIVE);
+}
+
+/**
+ * @brief Remember that a name does not exist in a directory
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in] parent  The directory
+ * @param[in] name    The name the FSAL failed to find
+ */
+void mdcache_avl_neg_insert(mdcache_entry_t *parent, const char *name)
+{
+	mdcache_neg_dirent_t *neg;
+	struct glist_head *lru = &parent->fsobj.fsdir.neg.lru;
+	size_t namesize = strlen(name) + 1;
+	uint64_t namehash;
+	time_t now = time(NULL);
+	bool expired;
+
+#ifdef DEBUG_MDCACHE
+	assert(parent->content_lock.__data.__writer);
+#endif
+	if (mdcache_param.dir.neg_ttl == 0)
+		return;
+
+	mdcache_avl_neg_trust(parent);
+
+	namehash = mdcache_avl_namehash(name);
+	neg = mdcache_avl_neg_find(parent, namehash, name);
+
+	if (neg != NULL) {
+		/* Looked up again after it expired */
+		glist_del(&neg->lru);
+		glist_add_tail(lru, &neg->lru);
+		neg->expire = now + mdcache_param.dir.neg_ttl;
+		return;
+	}
+
+	/* Age out what has expired, and the oldest if we are full */
+	while (!glist_empty(lru)) {
+		neg = glist_first_entry(lru, mdcache_neg_dirent_t, lru);
+		expired = now >= neg->expire;
+
+		if (!expired &&
+		    parent->fsobj.fsdir.neg.count < mdcache_param.dir.neg_max &&
+		    atomic_fetch_uint32_t(&mdc_neg_dirents) <
+						mdcache_param.dir.neg_hwmark)
+			break;
+
+		mdcache_avl_neg_remove(parent, neg);
+
+		if (!expired) {
+			/* That made room for this one */
+			break;
+		}
+	}
+
+	if (atomic_fetch_uint32_t(&mdc_neg_dirents) >=
+						mdcache_param.dir.neg_hwmark)
+		return;
+
+	neg = gsh_malloc(sizeof(*neg) + namesize);
+	neg->namehash = namehash;
+	neg->expire = now + mdcache_param.dir.neg_ttl;
+	memcpy(neg->name_buffer, name, namesize);
+	neg->name = neg->name_buffer;
+
+	avltree_inline_insert(&neg->node, &parent->fsobj.fsdir.neg.t,
+			      avl_neg_cmpf);
+	glist_add_tail(lru, &neg->lru);
+	parent->fsobj.fsdir.neg.count++;
+	(void) atomic_inc_uint32_t(&mdc_neg_dirents);
+
+	LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
+			"Negative dirent %s in %p", name, parent);
+}
+
+/**
+ * @brief Start building a bloom filter for a directory
+ *
+ * Called as a directory is read from its start.  Every name already
+ * cached is added, and every name cached from now on will be.
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in] parent  The directory
+ */
+void mdcache_avl_bloom_start(mdcache_entry_t *parent)
+{
+	struct avltree_node *node;
+	mdcache_dir_entry_t *dirent;
+
+	if (mdcache_param.dir.neg_ttl == 0 ||
+	    mdcache_param.dir.bloom_bits == 0)
+		return;
+
+	mdcache_avl_neg_trust(parent);
+
+	if (test_mde_flags(parent, MDCACHE_DIR_BLOOM)) {
+		if (time(NULL) < parent->fsobj.fsdir.neg.bloom_time +
+				 mdcache_param.dir.neg_ttl)
+			return;
+
+		/* Expired, build it again from scratch */
+		atomic_clear_uint32_t_bits(&parent->mde_flags,
+					   MDCACHE_DIR_BLOOM);
+		gsh_free(parent->fsobj.fsdir.neg.bloom);
+		parent->fsobj.fsdir.neg.bloom = NULL;
+	}
+
+	parent->fsobj.fsdir.neg.bloom_ck = 0;
+
+	if (parent->fsobj.fsdir.neg.bloom != NULL)
+		return;
+
+	parent->fsobj.fsdir.neg.bloom =
+			gsh_calloc(mdcache_param.dir.bloom_bits / 64,
+				   sizeof(uint64_t));
+
+	for (node = avltree_first(&parent->fsobj.fsdir.avl.t);
+	     node != NULL;
+	     node = avltree_next(node)) {
+		dirent = avltree_container_of(node, mdcache_dir_entry_t,
+					      node_name);
+		mdcache_bloom_set(parent->fsobj.fsdir.neg.bloom,
+				  dirent->namehash);
+	}
+}
+
+/**
+ * @brief Free the negative dirents and bloom filter of a directory
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in] parent  The directory
+ */
+void mdcache_avl_neg_clean(mdcache_entry_t *parent)
+{
+	mdcache_neg_dirent_t *neg;
+
+	while (!glist_empty(&parent->fsobj.fsdir.neg.lru)) {
+		neg = glist_first_entry(&parent->fsobj.fsdir.neg.lru,
+					mdcache_neg_dirent_t, lru);
+		mdcache_avl_neg_remove(parent, neg);
+	}
+
+	atomic_clear_uint32_t_bits(&parent->mde_flags, MDCACHE_DIR_BLOOM);
+	gsh_free(parent->fsobj.fsdir.neg.bloom);
+	parent->fsobj.fsdir.neg.bloom = NULL;
+	parent->fsobj.fsdir.neg.bloom_ck = 0;
+}
+
+/**
+ * @brief Find the resume point for a cookie
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in] parent  The directory
+ * @param[in] ck      Cookie a readdir continues from
+ *
+ * @return The name of the dirent with that cookie, or NULL.  It is
+ *         valid until the content lock is dropped.
+ */
+const char *mdcache_avl_resume_lookup(mdcache_entry_t *parent,
+				      fsal_cookie_t ck)
+{
+	struct avltree_node *node;
+	mdcache_resume_ck_t key;
+
+	if (parent->fsobj.fsdir.resume.count == 0)
+		return NULL;
+
+	key.ck = ck;
+
+	node = avltree_inline_lookup(&key.node, &parent->fsobj.fsdir.resume.t,
+				     avl_resume_cmpf);
+
+	if (node == NULL)
+		return NULL;
+
+	return avltree_container_of(node, mdcache_resume_ck_t, node)->name;
+}
+
+/**
+ * @brief Remember where a readdir left off
+ *
+ * @note The content lock MUST be held, for read is enough
+ *
+ * @param[in] parent  The directory
+ * @param[in] ck      Cookie of the last dirent returned
+ * @param[in] name    Its name
+ */
+void mdcache_avl_resume_insert(mdcache_entry_t *parent, fsal_cookie_t ck,
+			       const char *name)
+{
+	mdcache_resume_ck_t *resume, *old = NULL;
+	size_t namesize = strlen(name) + 1;
+	struct avltree_node *node;
+
+	if (mdcache_param.dir.resume_max == 0)
+		return;
+
+	resume = gsh_malloc(sizeof(*resume) + namesize);
+	resume->ck = ck;
+	memcpy(resume->name, name, namesize);
+
+	pthread_spin_lock(&parent->fsobj.fsdir.spin);
+
+	node = avltree_inline_insert(&resume->node,
+				     &parent->fsobj.fsdir.resume.t,
+				     avl_resume_cmpf);
+
+	if (node != NULL) {
+		/* Already known */
+		pthread_spin_unlock(&parent->fsobj.fsdir.spin);
+		gsh_free(resume);
+		return;
+	}
+
+	glist_add_tail(&parent->fsobj.fsdir.resume.lru, &resume->lru);
+
+	if (++parent->fsobj.fsdir.resume.count >
+					mdcache_param.dir.resume_max) {
+		old = glist_first_entry(&parent->fsobj.fsdir.resume.lru,
+					mdcache_resume_ck_t, lru);
+		avltree_remove(&old->node, &parent->fsobj.fsdir.resume.t);
+		glist_del(&old->lru);
+		parent->fsobj.fsdir.resume.count--;
+	}
+
+	pthread_spin_unlock(&parent->fsobj.fsdir.spin);
+
+	gsh_free(old);
+}
+
+/**
+ * @brief Forget where readdirs of a directory left off
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in] parent  The directory
+ */
+void mdcache_avl_resume_clean(mdcache_entry_t *parent)
+{
+	mdcache_resume_ck_t *resume;
+
+	while (!glist_empty(&parent->fsobj.fsdir.resume.lru)) {
+		resume = glist_first_entry(&parent->fsobj.fsdir.resume.lru,
+					   mdcache_resume_ck_t, lru);
+		avltree_remove(&resume->node, &parent->fsobj.fsdir.resume.t);
+		glist_del(&resume->lru);
+		gsh_free(resume);
+	}
+
+	parent->fsobj.fsdir.resume.count = 0;
 }
 
 /** @} */
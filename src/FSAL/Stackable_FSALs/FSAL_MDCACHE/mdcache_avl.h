@@ -130,7 +130,24 @@ mdcache_dir_entry_t *mdcache_avl_lookup(mdcache_entry_t *entry,
 					const char *name);
 void mdcache_avl_clean_trees(mdcache_entry_t *parent);
 
+/** Bits set in the bloom filter for each name */
+#define MDCACHE_BLOOM_PROBES 4
+
+bool mdcache_avl_neg_lookup(mdcache_entry_t *parent, const char *name);
+void mdcache_avl_neg_insert(mdcache_entry_t *parent, const char *name);
+void mdcache_avl_bloom_start(mdcache_entry_t *parent);
+void mdcache_avl_neg_clean(mdcache_entry_t *parent);
+
+const char *mdcache_avl_resume_lookup(mdcache_entry_t *parent,
+				      fsal_cookie_t ck);
+void mdcache_avl_resume_insert(mdcache_entry_t *parent, fsal_cookie_t ck,
+			       const char *name);
+void mdcache_avl_resume_clean(mdcache_entry_t *parent);
+
 void unchunk_dirent(mdcache_dir_entry_t *dirent);
+mdcache_dir_entry_t *mdcache_dirent_carve(struct dir_chunk *chunk,
+					  size_t namesize);
+void mdcache_chunk_block_release(struct dir_chunk *chunk);
 #endif				/* MDCACHE_AVL_H */
 
 /** @} */
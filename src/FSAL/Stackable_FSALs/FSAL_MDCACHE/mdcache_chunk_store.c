@@ -0,0 +1,492 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file  mdcache_chunk_store.c
+ * @brief Second tier for dirent chunks, in a file on local disk
+ *
+ * A chunk the LRU takes back is first written to Chunk_Store_File,
+ * keyed by its directory and the cookie it was read from.  When that
+ * part of the directory is read again, the chunk is put back from the
+ * file rather than read from the sub-FSAL, as long as the change
+ * attribute of the directory is still the one it was saved with and
+ * every entry it names is still cached.
+ *
+ * The file is a log written round and round.  An index in memory of
+ * MDC_CSTORE_WAYS slots a set maps key hashes to where a chunk was
+ * last written.  A record is good until the log comes round over it;
+ * nothing is ever deleted.  The file is started afresh at each start.
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include "fsal.h"
+#include "city.h"
+#include "mdcache_int.h"
+#include "mdcache_lru.h"
+
+#define MDC_CSTORE_MAGIC 0x4d444343	/* "MDCC" */
+#define MDC_CSTORE_WAYS 8
+#define MDC_CSTORE_ALIGN 64
+/** Bytes of log per slot of the index */
+#define MDC_CSTORE_SLOT_BYTES 4096
+
+struct mdc_cstore_rec {
+	uint32_t magic;
+	uint32_t len;		/*< Bytes of the whole record */
+	uint64_t hash;
+	uint64_t whence;	/*< Cookie the chunk was read from */
+	uint64_t change;	/*< Change attribute of the directory */
+	uint32_t count;		/*< Dirents that follow the key */
+	uint16_t keylen;	/*< Bytes of directory key that follow */
+	uint16_t eod;		/*< Last dirent ends the directory */
+};
+
+struct mdc_cstore_dirent {
+	uint64_t ck;
+	uint64_t hk;		/*< Hash of the key of the entry */
+	uint16_t namelen;	/*< Bytes of name that follow, NUL included */
+	uint16_t keylen;	/*< Bytes of entry key after the name */
+	uint32_t pad;
+};
+
+struct mdc_cstore_slot {
+	uint64_t hash;
+	uint64_t off;		/*< Of the record in the log, ever growing */
+	uint32_t len;		/*< 0 if the slot was never used */
+};
+
+static struct {
+	int fd;
+	uint64_t size;		/*< Bytes of the file used */
+	uint64_t head;		/*< Where the next record goes, ever growing */
+	uint32_t nsets;		/*< Sets in the index, a power of 2 */
+	struct mdc_cstore_slot *slots;
+	pthread_mutex_t mtx;	/*< Protects head and slots */
+} mdc_cstore = { .fd = -1 };
+
+static inline uint64_t mdc_cstore_hash(mdcache_entry_t *dir,
+				       fsal_cookie_t whence)
+{
+	return CityHash64WithSeed((const char *) &whence, sizeof(whence),
+				  dir->fh_hk.key.hk);
+}
+
+static inline struct mdc_cstore_slot *mdc_cstore_set(uint64_t hash)
+{
+	return &mdc_cstore.slots[(hash & (mdc_cstore.nsets - 1)) *
+				 MDC_CSTORE_WAYS];
+}
+
+/**
+ * @brief Whether the log has come round over a record
+ *
+ * @note mdc_cstore.mtx must be held
+ */
+static inline bool mdc_cstore_live(uint64_t off)
+{
+	return off + mdc_cstore.size >= mdc_cstore.head;
+}
+
+/**
+ * @brief Append a record to the log and index it
+ *
+ * @param[in] hash  Hash of the key of the record
+ * @param[in] buf   The record
+ * @param[in] len   Its length
+ *
+ * @return true if it was written.
+ */
+static bool mdc_cstore_write(uint64_t hash, const void *buf, uint32_t len)
+{
+	struct mdc_cstore_slot *set, *slot;
+	uint64_t off, pos;
+	ssize_t n;
+	int i;
+
+	PTHREAD_MUTEX_lock(&mdc_cstore.mtx);
+	pos = mdc_cstore.head % mdc_cstore.size;
+	if (pos + len > mdc_cstore.size) {
+		/* Go round rather than split the record */
+		mdc_cstore.head += mdc_cstore.size - pos;
+	}
+	off = mdc_cstore.head;
+	mdc_cstore.head += roundup(len, MDC_CSTORE_ALIGN);
+	PTHREAD_MUTEX_unlock(&mdc_cstore.mtx);
+
+	n = pwrite(mdc_cstore.fd, buf, len, off % mdc_cstore.size);
+	if (n != (ssize_t) len) {
+		LogDebug(COMPONENT_CACHE_INODE,
+			 "Could not write chunk store: %s",
+			 n < 0 ? strerror(errno) : "short write");
+		return false;
+	}
+
+	PTHREAD_MUTEX_lock(&mdc_cstore.mtx);
+
+	/* Take the slot of an older copy, else the oldest one */
+	set = mdc_cstore_set(hash);
+	slot = set;
+	for (i = 0; i < MDC_CSTORE_WAYS; i++) {
+		if (set[i].len != 0 && set[i].hash == hash) {
+			slot = &set[i];
+			break;
+		}
+		if (set[i].off < slot->off)
+			slot = &set[i];
+	}
+
+	slot->hash = hash;
+	slot->off = off;
+	slot->len = len;
+
+	PTHREAD_MUTEX_unlock(&mdc_cstore.mtx);
+
+	return true;
+}
+
+/**
+ * @brief Read the record of a key back
+ *
+ * @param[in]  hash  Hash of the key
+ * @param[out] len   Length of the record
+ *
+ * @return The record, to be freed, or NULL if there is none.
+ */
+static struct mdc_cstore_rec *mdc_cstore_read(uint64_t hash, uint32_t *len)
+{
+	struct mdc_cstore_slot *set;
+	struct mdc_cstore_rec *rec;
+	uint64_t off = 0;
+	bool live;
+	ssize_t n;
+	int i;
+
+	*len = 0;
+
+	PTHREAD_MUTEX_lock(&mdc_cstore.mtx);
+	set = mdc_cstore_set(hash);
+	for (i = 0; i < MDC_CSTORE_WAYS; i++) {
+		if (set[i].len != 0 && set[i].hash == hash &&
+		    mdc_cstore_live(set[i].off)) {
+			off = set[i].off;
+			*len = set[i].len;
+			break;
+		}
+	}
+	PTHREAD_MUTEX_unlock(&mdc_cstore.mtx);
+
+	if (*len == 0)
+		return NULL;
+
+	rec = gsh_malloc(*len);
+	n = pread(mdc_cstore.fd, rec, *len, off % mdc_cstore.size);
+
+	/* The log may have come round while it was read */
+	PTHREAD_MUTEX_lock(&mdc_cstore.mtx);
+	live = mdc_cstore_live(off);
+	PTHREAD_MUTEX_unlock(&mdc_cstore.mtx);
+
+	if (n != (ssize_t) *len || !live || rec->magic != MDC_CSTORE_MAGIC ||
+	    rec->hash != hash || rec->len != *len) {
+		gsh_free(rec);
+		return NULL;
+	}
+
+	return rec;
+}
+
+/**
+ * @brief Change attribute of a directory, if it's trusted
+ *
+ * Called with the content_lock held, so the attr_lock is only tried.
+ *
+ * @param[in]  dir     The directory
+ * @param[out] change  Its change attribute
+ *
+ * @return true if the attributes are trusted.
+ */
+static bool mdc_cstore_dir_change(mdcache_entry_t *dir, uint64_t *change)
+{
+	bool trusted;
+
+	if (pthread_rwlock_tryrdlock(&dir->attr_lock) != 0)
+		return false;
+
+	trusted = test_mde_flags(dir, MDCACHE_TRUST_ATTRS);
+	*change = dir->attrs.change;
+
+	PTHREAD_RWLOCK_unlock(&dir->attr_lock);
+
+	return trusted;
+}
+
+/**
+ * @brief Save a chunk the LRU is taking back
+ *
+ * @note The content_lock of @a dir must be held for write
+ *
+ * @param[in] dir    Directory the chunk belongs to
+ * @param[in] chunk  The chunk
+ */
+void mdc_cstore_chunk_put(mdcache_entry_t *dir, struct dir_chunk *chunk)
+{
+	struct mdc_cstore_rec *rec;
+	struct mdc_cstore_dirent *d;
+	struct glist_head *glist;
+	mdcache_dir_entry_t *dirent;
+	size_t len, keylen, namelen;
+	uint64_t change;
+	uint8_t *p;
+
+	if (mdc_cstore.fd < 0 || chunk->num_entries == 0 ||
+	    !mdc_cstore_dir_change(dir, &change))
+		return;
+
+	keylen = mdcache_key_len(&dir->fh_hk.key);
+	if (keylen > NFS4_FHSIZE)
+		return;
+
+	len = sizeof(*rec) + roundup(keylen, 8);
+	glist_for_each(glist, &chunk->dirents) {
+		dirent = glist_entry(glist, mdcache_dir_entry_t, chunk_list);
+		if (dirent->flags & DIR_ENTRY_FLAG_DELETED)
+			continue;
+		len += sizeof(*d) + roundup(strlen(dirent->name) + 1 +
+					    mdcache_key_len(&dirent->ckey), 8);
+	}
+
+	if (len > mdc_cstore.size / 4)
+		return;
+
+	rec = gsh_calloc(1, len);
+	rec->magic = MDC_CSTORE_MAGIC;
+	rec->len = len;
+	rec->hash = mdc_cstore_hash(dir, chunk->reload_ck);
+	rec->whence = chunk->reload_ck;
+	rec->change = change;
+	rec->keylen = keylen;
+
+	p = (uint8_t *) &rec[1];
+	mdcache_key_bytes(&dir->fh_hk.key, p);
+	p += roundup(keylen, 8);
+
+	glist_for_each(glist, &chunk->dirents) {
+		dirent = glist_entry(glist, mdcache_dir_entry_t, chunk_list);
+		if (dirent->eod)
+			rec->eod = true;
+		if (dirent->flags & DIR_ENTRY_FLAG_DELETED)
+			continue;
+
+		namelen = strlen(dirent->name) + 1;
+		d = (struct mdc_cstore_dirent *) p;
+		d->ck = dirent->ck;
+		d->hk = dirent->ckey.hk;
+		d->namelen = namelen;
+		d->keylen = mdcache_key_len(&dirent->ckey);
+		p += sizeof(*d);
+		memcpy(p, dirent->name, namelen);
+		mdcache_key_bytes(&dirent->ckey, p + namelen);
+		p += roundup(namelen + d->keylen, 8);
+
+		rec->count++;
+	}
+
+	if (mdc_cstore_write(rec->hash, rec, len))
+		mdcache_stat_inc(MDC_STAT_CHUNK_SPILL);
+
+	gsh_free(rec);
+}
+
+/**
+ * @brief Drop the references of a chunk read back
+ *
+ * @param[in] saved  The chunk
+ */
+void mdc_cstore_chunk_free(struct mdc_cstore_chunk *saved)
+{
+	uint32_t i;
+
+	for (i = 0; i < saved->count; i++) {
+		if (saved->ents[i].entry != NULL)
+			mdcache_put(saved->ents[i].entry);
+	}
+
+	gsh_free(saved->rec);
+	gsh_free(saved);
+}
+
+/**
+ * @brief Read back a chunk of a directory
+ *
+ * Only a chunk saved while the directory had the change attribute it
+ * has now, and whose entries are all still cached, is given back.
+ * Making an entry again would cost a call to the sub-FSAL for each,
+ * where reading the chunk from it costs one for all.
+ *
+ * @note The content_lock of @a dir must be held for write
+ *
+ * @param[in] dir     The directory
+ * @param[in] whence  Cookie the chunk is read from
+ *
+ * @return The chunk, its entries ref'd, or NULL.
+ */
+struct mdc_cstore_chunk *mdc_cstore_chunk_get(mdcache_entry_t *dir,
+					      fsal_cookie_t whence)
+{
+	struct mdc_cstore_chunk *saved = NULL;
+	struct mdc_cstore_rec *rec;
+	struct mdc_cstore_dirent *d;
+	uint8_t key[NFS4_FHSIZE];
+	mdcache_key_t ckey;
+	fsal_status_t status;
+	uint64_t change;
+	uint32_t len, i;
+	uint8_t *p, *end;
+
+	if (mdc_cstore.fd < 0 || !mdc_cstore_dir_change(dir, &change))
+		return NULL;
+
+	rec = mdc_cstore_read(mdc_cstore_hash(dir, whence), &len);
+	if (rec == NULL)
+		return NULL;
+
+	if (rec->whence != whence || rec->change != change ||
+	    rec->keylen != mdcache_key_len(&dir->fh_hk.key) ||
+	    rec->keylen > sizeof(key) ||
+	    sizeof(*rec) + roundup(rec->keylen, 8) > len)
+		goto out;
+
+	p = (uint8_t *) &rec[1];
+	mdcache_key_bytes(&dir->fh_hk.key, key);
+	if (memcmp(p, key, rec->keylen) != 0)
+		goto out;
+
+	p += roundup(rec->keylen, 8);
+	end = (uint8_t *) rec + len;
+
+	saved = gsh_calloc(1, sizeof(*saved) +
+			      rec->count * sizeof(saved->ents[0]));
+	saved->rec = rec;
+	saved->eod = rec->eod;
+
+	memset(&ckey, 0, sizeof(ckey));
+	ckey.fsal = dir->fh_hk.key.fsal;
+
+	for (i = 0; i < rec->count; i++) {
+		d = (struct mdc_cstore_dirent *) p;
+		if (p + sizeof(*d) > end ||
+		    p + sizeof(*d) + d->namelen + d->keylen > end ||
+		    d->namelen == 0 || d->keylen == 0)
+			goto miss;
+
+		p += sizeof(*d);
+		ckey.hk = d->hk;
+		ckey.kv.addr = p + d->namelen;
+		ckey.kv.len = d->keylen;
+
+		status = mdcache_find_keyed_reason(&ckey,
+						   &saved->ents[i].entry,
+						   MDC_REASON_SCAN);
+		if (FSAL_IS_ERROR(status))
+			goto miss;
+
+		saved->ents[i].name = (const char *) p;
+		saved->ents[i].ck = d->ck;
+		saved->count++;
+		p += roundup(d->namelen + d->keylen, 8);
+	}
+
+	return saved;
+
+ miss:
+	mdc_cstore_chunk_free(saved);
+	return NULL;
+
+ out:
+	gsh_free(rec);
+	return NULL;
+}
+
+/**
+ * @brief Open the chunk store, if there is to be one
+ */
+void mdcache_cstore_pkginit(void)
+{
+	uint64_t sets;
+
+	if (mdcache_param.chunk_store_file == NULL)
+		return;
+
+	mdc_cstore.size = mdcache_param.chunk_store_size -
+			  mdcache_param.chunk_store_size % MDC_CSTORE_ALIGN;
+	sets = mdc_cstore.size / (MDC_CSTORE_SLOT_BYTES * MDC_CSTORE_WAYS);
+	for (mdc_cstore.nsets = 1;
+	     mdc_cstore.nsets < sets && mdc_cstore.nsets < (1U << 31);
+	     mdc_cstore.nsets <<= 1)
+		;
+
+	mdc_cstore.fd = open(mdcache_param.chunk_store_file,
+			     O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (mdc_cstore.fd < 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Could not open chunk store %s: %s",
+			 mdcache_param.chunk_store_file, strerror(errno));
+		return;
+	}
+
+	PTHREAD_MUTEX_init(&mdc_cstore.mtx, NULL);
+	mdc_cstore.slots = gsh_calloc((size_t) mdc_cstore.nsets *
+				      MDC_CSTORE_WAYS,
+				      sizeof(struct mdc_cstore_slot));
+
+	LogEvent(COMPONENT_CACHE_INODE,
+		 "Chunk store %s of %" PRIu64 " bytes, %" PRIu32 " index sets",
+		 mdcache_param.chunk_store_file, mdc_cstore.size,
+		 mdc_cstore.nsets);
+}
+
+/**
+ * @brief Close the chunk store
+ */
+void mdcache_cstore_pkgshutdown(void)
+{
+	if (mdc_cstore.fd < 0)
+		return;
+
+	close(mdc_cstore.fd);
+	mdc_cstore.fd = -1;
+	gsh_free(mdc_cstore.slots);
+	mdc_cstore.slots = NULL;
+	PTHREAD_MUTEX_destroy(&mdc_cstore.mtx);
+}
+
+/** @} */
@@ -0,0 +1,542 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file  mdcache_cluster.c
+ * @brief Invalidates exchanged with the other nodes of a cluster
+ *
+ * Nodes serving the same backend, when it gives no upcalls, only see
+ * each other's changes once the cached attributes expire.  With
+ * Cluster_Invalidate_Group set, what a node changes through MDCACHE is
+ * multicast as the export id, sub-FSAL handle key and invalidate flags
+ * of each object, and what the other nodes send is passed to the
+ * export's invalidate upcall, as the backend would have.
+ *
+ * The changes are gathered in one datagram, a handle already in it just
+ * adding its flags, and sent when it is full or Cluster_Invalidate_Window
+ * after its first change.  A thread of its own sends it, woken by the
+ * first change, and reads what the peers send.  Delivery is not
+ * guaranteed; what is lost is only seen once the attributes expire, as
+ * without the bus.
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "fsal.h"
+#include "fsal_up.h"
+#include "fridgethr.h"
+#include "export_mgr.h"
+#include "city.h"
+#include "common_utils.h"
+#include "mdcache.h"
+#include "mdcache_int.h"
+
+#define MDC_CL_MAGIC 0x4d44434c	/* "MDCL" */
+#define MDC_CL_VERSION 1
+
+/** Largest datagram sent, kept under the usual MTU */
+#define MDC_CL_DGRAM_MAX 1400
+
+/** Longest the thread waits for a datagram when nothing is held, ms */
+#define MDC_CL_POLL_MAX 1000
+
+/* On the wire, in network byte order */
+
+struct mdc_cl_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t count;		/*< Records that follow */
+	uint64_t node;		/*< Sender, so a node skips its own */
+};
+
+struct mdc_cl_record {
+	uint16_t export_id;
+	uint16_t len;		/*< Bytes of handle key that follow */
+	uint32_t flags;		/*< FSAL_UP_INVALIDATE_* */
+};
+
+static struct {
+	struct fridgethr *fridge;
+	int fd;
+	int wake[2];		/*< Pipe the first change is told on */
+	sockaddr_t group;
+	socklen_t group_len;
+	uint64_t node;
+	pthread_mutex_t mtx;
+	/** Datagram being filled, protected by mtx */
+	char buf[MDC_CL_DGRAM_MAX];
+	size_t len;
+	uint16_t count;
+	struct timespec first;	/*< When its first change was added */
+	/* Counters, protected by mtx but for applied */
+	uint64_t sent;
+	uint64_t dropped;
+	uint64_t coalesced;
+	uint64_t applied;
+} mdc_cl = {
+	.fd = -1,
+	.wake = { -1, -1 },
+};
+
+/**
+ * @brief Send the datagram being filled
+ *
+ * A full socket buffer drops it rather than hold up the caller.
+ */
+
+static void mdc_cl_send_locked(void)
+{
+	struct mdc_cl_header hdr;
+
+	if (mdc_cl.count == 0)
+		return;
+
+	hdr.magic = htonl(MDC_CL_MAGIC);
+	hdr.version = htons(MDC_CL_VERSION);
+	hdr.count = htons(mdc_cl.count);
+	hdr.node = mdc_cl.node;
+	memcpy(mdc_cl.buf, &hdr, sizeof(hdr));
+
+	if (sendto(mdc_cl.fd, mdc_cl.buf, mdc_cl.len, MSG_DONTWAIT,
+		   (struct sockaddr *)&mdc_cl.group, mdc_cl.group_len) < 0) {
+		mdc_cl.dropped++;
+		LogDebug(COMPONENT_CACHE_INODE,
+			 "Could not send %" PRIu16 " invalidates: %s",
+			 mdc_cl.count, strerror(errno));
+	} else {
+		mdc_cl.sent++;
+	}
+
+	mdc_cl.len = sizeof(hdr);
+	mdc_cl.count = 0;
+}
+
+/**
+ * @brief Tell the other nodes an object changed
+ *
+ * Called once the sub-FSAL did the change, with op_ctx set.
+ *
+ * @param[in] entry  Entry that changed
+ * @param[in] flags  FSAL_UP_INVALIDATE* the peers should apply
+ */
+
+void mdc_cluster_publish(mdcache_entry_t *entry, uint32_t flags)
+{
+	struct mdc_cl_record rec, old;
+	struct gsh_buffdesc key;
+	size_t off, need;
+
+	if (mdc_cl.fd < 0 || op_ctx == NULL || op_ctx->ctx_export == NULL)
+		return;
+
+	entry->sub_handle->obj_ops->handle_to_key(entry->sub_handle, &key);
+	need = sizeof(rec) + key.len;
+	if (sizeof(struct mdc_cl_header) + need > MDC_CL_DGRAM_MAX)
+		return;
+
+	rec.export_id = htons(op_ctx->ctx_export->export_id);
+	rec.len = htons(key.len);
+
+	PTHREAD_MUTEX_lock(&mdc_cl.mtx);
+
+	for (off = sizeof(struct mdc_cl_header); off < mdc_cl.len;
+	     off += sizeof(old) + ntohs(old.len)) {
+		memcpy(&old, mdc_cl.buf + off, sizeof(old));
+		if (old.export_id == rec.export_id && old.len == rec.len &&
+		    memcmp(mdc_cl.buf + off + sizeof(old), key.addr,
+			   key.len) == 0) {
+			old.flags |= htonl(flags);
+			memcpy(mdc_cl.buf + off, &old, sizeof(old));
+			mdc_cl.coalesced++;
+			PTHREAD_MUTEX_unlock(&mdc_cl.mtx);
+			return;
+		}
+	}
+
+	if (mdc_cl.len + need > MDC_CL_DGRAM_MAX)
+		mdc_cl_send_locked();
+
+	if (mdc_cl.count == 0)
+		now(&mdc_cl.first);
+
+	rec.flags = htonl(flags);
+	memcpy(mdc_cl.buf + mdc_cl.len, &rec, sizeof(rec));
+	memcpy(mdc_cl.buf + mdc_cl.len + sizeof(rec), key.addr, key.len);
+	mdc_cl.len += need;
+	mdc_cl.count++;
+
+	if (mdcache_param.cluster_invalidate_window == 0)
+		mdc_cl_send_locked();
+
+	/* The thread sleeps until told there is something to send */
+	if (mdc_cl.count == 1 && mdc_cl.fd >= 0)
+		(void) write(mdc_cl.wake[1], "", 1);
+
+	PTHREAD_MUTEX_unlock(&mdc_cl.mtx);
+}
+
+/**
+ * @brief Apply the invalidates a peer sent
+ *
+ * Only what can be cached is dropped; a change elsewhere does not close
+ * what this node has open.
+ *
+ * @param[in] buf  Datagram
+ * @param[in] len  Its length
+ */
+
+static void mdc_cl_apply(char *buf, size_t len)
+{
+	struct mdc_cl_header hdr;
+	struct mdc_cl_record rec;
+	struct gsh_export *export;
+	const struct fsal_up_vector *up_ops;
+	struct gsh_buffdesc key;
+	uint16_t count, klen;
+	size_t off = sizeof(hdr);
+
+	if (len < sizeof(hdr))
+		return;
+
+	memcpy(&hdr, buf, sizeof(hdr));
+	if (ntohl(hdr.magic) != MDC_CL_MAGIC ||
+	    ntohs(hdr.version) != MDC_CL_VERSION ||
+	    hdr.node == mdc_cl.node)
+		return;
+
+	for (count = ntohs(hdr.count); count > 0; count--) {
+		if (off + sizeof(rec) > len)
+			break;
+		memcpy(&rec, buf + off, sizeof(rec));
+		klen = ntohs(rec.len);
+		if (off + sizeof(rec) + klen > len)
+			break;
+
+		export = get_gsh_export(ntohs(rec.export_id));
+		if (export != NULL &&
+		    export->fsal_export->fsal == &MDCACHE.module) {
+			up_ops = export->fsal_export->up_ops;
+			key.addr = buf + off + sizeof(rec);
+			key.len = klen;
+			(void) up_ops->invalidate(up_ops, &key,
+						  ntohl(rec.flags) &
+						  FSAL_UP_INVALIDATE_CACHE);
+			atomic_inc_uint64_t(&mdc_cl.applied);
+		}
+		if (export != NULL)
+			put_gsh_export(export);
+
+		off += sizeof(rec) + klen;
+	}
+}
+
+/**
+ * @brief Milliseconds until the held datagram is due, -1 for none
+ */
+
+static int mdc_cl_due_locked(void)
+{
+	struct timespec ts;
+	nsecs_elapsed_t held;
+	uint64_t window = mdcache_param.cluster_invalidate_window;
+
+	if (mdc_cl.count == 0)
+		return -1;
+
+	now(&ts);
+	held = timespec_diff(&mdc_cl.first, &ts) / NS_PER_MSEC;
+
+	return held >= window ? 0 : window - held;
+}
+
+/**
+ * @brief Read the peers' invalidates and send this node's
+ */
+
+static void mdc_cl_run(struct fridgethr_context *ctx)
+{
+	struct pollfd pfd[2] = {
+		{ .fd = mdc_cl.fd, .events = POLLIN },
+		{ .fd = mdc_cl.wake[0], .events = POLLIN },
+	};
+	char buf[MDC_CL_DGRAM_MAX];
+	ssize_t len;
+	int due;
+
+	while (!fridgethr_you_should_break(ctx)) {
+		PTHREAD_MUTEX_lock(&mdc_cl.mtx);
+		due = mdc_cl_due_locked();
+		if (due == 0) {
+			mdc_cl_send_locked();
+			due = -1;
+		}
+		PTHREAD_MUTEX_unlock(&mdc_cl.mtx);
+
+		/* Still wake up now and then to see if we should stop */
+		if (due < 0 || due > MDC_CL_POLL_MAX)
+			due = MDC_CL_POLL_MAX;
+
+		if (poll(pfd, 2, due) <= 0)
+			continue;
+
+		if (pfd[1].revents & POLLIN)
+			while (read(mdc_cl.wake[0], buf, sizeof(buf)) > 0)
+				;
+
+		if (pfd[0].revents & POLLIN)
+			while ((len = recv(mdc_cl.fd, buf, sizeof(buf),
+					   MSG_DONTWAIT)) > 0)
+				mdc_cl_apply(buf, len);
+	}
+
+	PTHREAD_MUTEX_lock(&mdc_cl.mtx);
+	mdc_cl_send_locked();
+	PTHREAD_MUTEX_unlock(&mdc_cl.mtx);
+}
+
+/**
+ * @brief Open the socket and join the group
+ *
+ * @return The socket, or -1.
+ */
+
+static int mdc_cl_socket(void)
+{
+	const char *group = mdcache_param.cluster_invalidate_group;
+	int ttl = mdcache_param.cluster_invalidate_ttl;
+	struct addrinfo hints, *res = NULL;
+	struct sockaddr_in6 any6 = { .sin6_family = AF_INET6 };
+	struct sockaddr_in any4 = { .sin_family = AF_INET };
+	struct ipv6_mreq mreq6;
+	struct ip_mreq mreq4;
+	char port[8];
+	int fd, one = 1, rc;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+	(void) snprintf(port, sizeof(port), "%" PRIu16,
+			mdcache_param.cluster_invalidate_port);
+
+	rc = getaddrinfo(group, port, &hints, &res);
+	if (rc != 0) {
+		LogCrit(COMPONENT_CACHE_INODE,
+			"Cluster_Invalidate_Group %s is not an address: %s",
+			group, gai_strerror(rc));
+		return -1;
+	}
+
+	memcpy(&mdc_cl.group, res->ai_addr, res->ai_addrlen);
+	mdc_cl.group_len = res->ai_addrlen;
+	freeaddrinfo(res);
+
+	if (!(mdc_cl.group.ss_family == AF_INET &&
+	      IN_MULTICAST(ntohl(((struct sockaddr_in *)
+				  &mdc_cl.group)->sin_addr.s_addr))) &&
+	    !(mdc_cl.group.ss_family == AF_INET6 &&
+	      IN6_IS_ADDR_MULTICAST(&((struct sockaddr_in6 *)
+				      &mdc_cl.group)->sin6_addr))) {
+		LogCrit(COMPONENT_CACHE_INODE,
+			"Cluster_Invalidate_Group %s is not a multicast group",
+			group);
+		return -1;
+	}
+
+	fd = socket(mdc_cl.group.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		goto err;
+
+	/* Other servers on the host may join the group too */
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0)
+		goto err;
+
+	if (mdc_cl.group.ss_family == AF_INET) {
+		any4.sin_port = htons(mdcache_param.cluster_invalidate_port);
+		mreq4.imr_multiaddr =
+			((struct sockaddr_in *)&mdc_cl.group)->sin_addr;
+		mreq4.imr_interface.s_addr = htonl(INADDR_ANY);
+		if (bind(fd, (struct sockaddr *)&any4, sizeof(any4)) < 0 ||
+		    setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq4,
+			       sizeof(mreq4)) < 0 ||
+		    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl,
+			       sizeof(ttl)) < 0)
+			goto err;
+	} else {
+		any6.sin6_port = htons(mdcache_param.cluster_invalidate_port);
+		mreq6.ipv6mr_multiaddr =
+			((struct sockaddr_in6 *)&mdc_cl.group)->sin6_addr;
+		mreq6.ipv6mr_interface = 0;
+		if (bind(fd, (struct sockaddr *)&any6, sizeof(any6)) < 0 ||
+		    setsockopt(fd, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mreq6,
+			       sizeof(mreq6)) < 0 ||
+		    setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &ttl,
+			       sizeof(ttl)) < 0)
+			goto err;
+	}
+
+	return fd;
+
+err:
+	LogCrit(COMPONENT_CACHE_INODE,
+		"Could not join Cluster_Invalidate_Group %s: %s",
+		group, strerror(errno));
+	if (fd >= 0)
+		close(fd);
+	return -1;
+}
+
+/**
+ * @brief Join the invalidation group, if one is configured
+ */
+
+void mdcache_cluster_pkginit(void)
+{
+	struct fridgethr_params frp;
+	struct {
+		char host[HOST_NAME_MAX + 1];
+		pid_t pid;
+		struct timespec ts;
+	} seed;
+	int rc;
+
+	if (mdcache_param.cluster_invalidate_group == NULL)
+		return;
+
+	PTHREAD_MUTEX_init(&mdc_cl.mtx, NULL);
+	mdc_cl.len = sizeof(struct mdc_cl_header);
+
+	/* Tells this node's datagrams from those of the other nodes,
+	 * and of other servers on the host.
+	 */
+	memset(&seed, 0, sizeof(seed));
+	(void) gethostname(seed.host, sizeof(seed.host) - 1);
+	seed.pid = getpid();
+	now(&seed.ts);
+	mdc_cl.node = CityHash64((char *)&seed, sizeof(seed));
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = 1;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&mdc_cl.fridge, "MDC_cluster", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to initialize cluster invalidate fridge, error code %d.",
+			 rc);
+		return;
+	}
+
+	if (pipe(mdc_cl.wake) != 0 ||
+	    fcntl(mdc_cl.wake[0], F_SETFL, O_NONBLOCK) != 0 ||
+	    fcntl(mdc_cl.wake[1], F_SETFL, O_NONBLOCK) != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to make cluster invalidate pipe: %s",
+			 strerror(errno));
+		goto out;
+	}
+
+	mdc_cl.fd = mdc_cl_socket();
+	if (mdc_cl.fd < 0)
+		goto out;
+
+	rc = fridgethr_submit(mdc_cl.fridge, mdc_cl_run, NULL);
+	if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to start cluster invalidate thread, error code %d.",
+			 rc);
+		close(mdc_cl.fd);
+		mdc_cl.fd = -1;
+		goto out;
+	}
+
+	LogEvent(COMPONENT_CACHE_INODE,
+		 "Exchanging invalidates with the cluster on %s port %" PRIu16,
+		 mdcache_param.cluster_invalidate_group,
+		 mdcache_param.cluster_invalidate_port);
+	return;
+
+out:
+	if (mdc_cl.wake[0] >= 0) {
+		close(mdc_cl.wake[0]);
+		close(mdc_cl.wake[1]);
+		mdc_cl.wake[0] = mdc_cl.wake[1] = -1;
+	}
+	fridgethr_destroy(mdc_cl.fridge);
+	mdc_cl.fridge = NULL;
+}
+
+/**
+ * @brief Send what is held and leave the group
+ */
+
+void mdcache_cluster_pkgshutdown(void)
+{
+	int fd = mdc_cl.fd;
+	int rc;
+
+	if (mdc_cl.fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(mdc_cl.fridge, fridgethr_comm_stop, 120);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(mdc_cl.fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Failed shutting down cluster invalidate thread: %d",
+			 rc);
+	}
+
+	PTHREAD_MUTEX_lock(&mdc_cl.mtx);
+	mdc_cl.fd = -1;
+	close(fd);
+	close(mdc_cl.wake[0]);
+	close(mdc_cl.wake[1]);
+	PTHREAD_MUTEX_unlock(&mdc_cl.mtx);
+
+	LogInfo(COMPONENT_CACHE_INODE,
+		"Cluster invalidates: %" PRIu64 " datagrams sent, %" PRIu64
+		" dropped, %" PRIu64 " folded, %" PRIu64 " applied from peers",
+		mdc_cl.sent, mdc_cl.dropped, mdc_cl.coalesced,
+		atomic_fetch_uint64_t(&mdc_cl.applied));
+}
+
+/** @} */
@@ -140,7 +140,7 @@ static void mdcache_unexport(struct fsal_export *exp_hdl,
 			 * close a race caused by lru_run_lane() taking a ref
 			 * before we call mdcache_lru_cleanup_try_push() below.
 			 * */
-			atomic_store_int32_t(&entry->first_export_id, -1);
+			mdc_set_first_export(entry, -1);
 
 			/* We must not hold entry->attr_lock across
 			 * try_cleanup_push (LRU lane lock order) */
@@ -152,8 +152,7 @@ static void mdcache_unexport(struct fsal_export *exp_hdl,
 			mdcache_lru_cleanup_try_push(entry);
 		} else {
 			/* Make sure first export pointer is still valid */
-			atomic_store_int32_t(
-				&entry->first_export_id,
+			mdc_set_first_export(entry,
 				(int32_t) expmap->exp->mfe_exp.export_id);
 
 			PTHREAD_RWLOCK_unlock(&exp->mdc_exp_lock);
@@ -172,6 +171,7 @@ static void mdcache_unexport(struct fsal_export *exp_hdl,
 	/* Unhash the root object */
 	rc = cih_remove_checked(root_entry);
 	assert(!rc);
+	fsal_obj_invalidate();
 }
 
 /**
@@ -508,6 +508,39 @@ static fsal_status_t mdcache_get_quota(struct fsal_export *exp_hdl,
 	return status;
 }
 
+/**
+ * @brief Get the quotas of several ids
+ *
+ * MDCACHE only caches metadata, so it imposes no restrictions itself.
+ *
+ * @param[in] exp_hdl	Export to query
+ * @param[in] filepath	Path to file to query
+ * @param[in] quota_type	Type of quota (user or group)
+ * @param[in] count	Number of ids
+ * @param[in] quota_ids	Ids for getting quota information
+ * @param[out] pquotas	Resulting quota information, one per id
+ * @param[out] pstatuses	Status of each id
+ * @return FSAL status
+ */
+static fsal_status_t mdcache_get_quotas(struct fsal_export *exp_hdl,
+					const char *filepath, int quota_type,
+					uint32_t count, const int *quota_ids,
+					fsal_quota_t *pquotas,
+					fsal_status_t *pstatuses)
+{
+	struct mdcache_fsal_export *exp = mdc_export(exp_hdl);
+	struct fsal_export *sub_export = exp->mfe_exp.sub_export;
+	fsal_status_t status;
+
+	subcall_raw(exp,
+		status = sub_export->exp_ops.get_quotas(sub_export, filepath,
+							quota_type, count,
+							quota_ids, pquotas,
+							pstatuses));
+
+	return status;
+}
+
 /**
  * @brief Set a quota for a file
  *
@@ -833,6 +866,7 @@ void mdcache_export_ops_init(struct export_ops *ops)
 	ops->fs_umask = mdcache_fs_umask;
 	ops->check_quota = mdcache_check_quota;
 	ops->get_quota = mdcache_get_quota;
+	ops->get_quotas = mdcache_get_quotas;
 	ops->set_quota = mdcache_set_quota;
 	ops->getdevicelist = mdcache_getdevicelist;
 	ops->fs_layouttypes = mdcache_fs_layouttypes;
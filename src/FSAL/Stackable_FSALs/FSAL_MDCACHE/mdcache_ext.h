@@ -42,6 +42,14 @@
  * @brief Structure to hold MDCACHE paramaters
  */
 
+/**
+ * @brief Replacement policies for the entry LRU
+ */
+enum mdcache_lru_policy {
+	MDCACHE_LRU_POLICY_LRU,	/*< Two level LRU */
+	MDCACHE_LRU_POLICY_2Q	/*< Scan resistant 2Q */
+};
+
 struct mdcache_parameter {
 	/** Partitions in the Cache_Inode tree.  Defaults to 7,
 	 * settable with NParts. */
@@ -52,15 +60,53 @@ struct mdcache_parameter {
 	/** Use getattr for directory invalidation.  Defaults to
 	    false.  Settable with Use_Getattr_Directory_Invalidation. */
 	bool getattr_dir_invalidation;
+	/** Keep attributes past Attr_Expiration_Time until an upcall
+	    invalidates them.  Defaults to false, settable with
+	    Attr_Trust_Upcalls. */
+	bool attr_trust_upcalls;
+	/** Milliseconds invalidate upcalls are held to be applied
+	    together, 0 applies each as it comes.  Defaults to 0,
+	    settable with Upcall_Batch_Window. */
+	uint32_t upcall_batch_window;
+	/** Lay what completed writes did to a file over its cached
+	    attributes, instead of fetching them again.  Defaults to
+	    false, settable with Lockless_Write_Attrs. */
+	bool lockless_write_attrs;
 	struct {
 		/** Size of per-directory dirent cache chunks, 0 means
 		 *  directory chunking is not enabled.
 		 */
 		uint32_t avl_chunk;
-		/** Size of a dirent chunk at which point the chunk should
-		 *  be split. Pre-computed for simplicity.
+		/** Largest size a chunk grows to while a directory is read
+		 *  sequentially.  Defaults to avl_chunk, settable with
+		 *  Dir_Chunk_Max.
+		 */
+		uint32_t avl_chunk_max;
+		/** Read the next chunk in the background while a directory
+		 *  is read sequentially.  Settable with Dir_Readahead.
+		 */
+		bool readahead;
+		/** Seconds a failed lookup is remembered, 0 to not
+		 *  remember them.  Settable with Dir_Negative_TTL.
+		 */
+		uint32_t neg_ttl;
+		/** Most failed lookups remembered per directory.
+		 *  Settable with Dir_Negative_Max.
+		 */
+		uint32_t neg_max;
+		/** Most failed lookups remembered in all.  Settable with
+		 *  Dir_Negative_HWMark.
+		 */
+		uint32_t neg_hwmark;
+		/** Bits in the per-directory bloom filter of names, 0 for
+		 *  none.  Settable with Dir_Bloom_Bits.
+		 */
+		uint32_t bloom_bits;
+		/** Readdir resume points remembered per directory for
+		 *  FSALs that resume by name.  Settable with
+		 *  Dir_Resume_Max.
 		 */
-		uint32_t avl_chunk_split;
+		uint32_t resume_max;
 		/** Detached dirent multiplier (of avl_chunk) */
 		uint32_t avl_detached_mult;
 		/** Computed max detached dirents */
@@ -97,6 +143,17 @@ struct mdcache_parameter {
 	/** The amount of work for the reaper thread to do per-lane
 	    under normal conditions. Settable with Repaper_Work_Per_Thread */
 	uint32_t reaper_work_per_lane;
+	/** Threads the reaper and chunk reaper each run on, one per
+	    group of lanes.  Settable with Reaper_Threads */
+	uint32_t reaper_threads;
+	/** Bytes entries, chunks and dirents may use together before
+	    they are reclaimed regardless of the high water marks, 0 for
+	    no limit.  Settable with Cache_Memory_Limit */
+	uint64_t cache_memory_limit;
+	/** Bytes the cache may use together with the other subsystems
+	    counted by ENABLE_MEM_ACCOUNTING, 0 for no limit.  Settable
+	    with Total_Memory_Limit */
+	uint64_t total_memory_limit;
 	/** The largest window (as a percentage of the system-imposed
 	    limit on FDs) of work that we will do in extremis.
 	    Defaults to 40, settable with Biggest_Window */
@@ -109,6 +166,53 @@ struct mdcache_parameter {
 	    we disable caching, when in extremis.  Defaults to 8,
 	    settable with Futility_Count */
 	uint32_t futility_count;
+	/** Replacement policy for cache entries.  Defaults to LRU,
+	    settable with LRU_Policy. */
+	enum mdcache_lru_policy lru_policy;
+	/** Number of recently evicted handles remembered by the 2Q
+	    policy.  Defaults to 100000, settable with
+	    LRU_Ghost_Entries. */
+	uint32_t lru_ghost_entries;
+	/** File the cached handles are saved to and read back from at
+	    startup, NULL for none.  Settable with Snapshot_File. */
+	char *snapshot_file;
+	/** Seconds between saves of the snapshot, 0 to only save at
+	    shutdown.  Defaults to 300, settable with Snapshot_Interval. */
+	uint32_t snapshot_interval;
+	/** Entries per second loaded back from the snapshot.  Defaults
+	    to 1000, settable with Snapshot_Prefetch_Rate. */
+	uint32_t snapshot_prefetch_rate;
+	/** File reaped dirent chunks are saved to, NULL for none.
+	    Settable with Chunk_Store_File. */
+	char *chunk_store_file;
+	/** Bytes of the chunk store.  Defaults to 1G, settable with
+	    Chunk_Store_Size. */
+	uint64_t chunk_store_size;
+	/** Largest window read ahead of a sequential reader, 0 to leave
+	    read-ahead to the sub-FSAL.  Defaults to 4M, settable with
+	    Read_Ahead_Max. */
+	uint64_t read_ahead_max;
+	/** Bytes of extended attributes cached over all entries, 0 to
+	    not cache them.  Defaults to 16M, settable with
+	    Xattr_Cache_Size. */
+	uint64_t xattr_cache_size;
+	/** Bytes of symlink content cached over all entries, 0 to not
+	    cache it.  Defaults to 4M, settable with
+	    Symlink_Cache_Size. */
+	uint64_t symlink_cache_size;
+	/** Multicast group invalidates are exchanged with peers on,
+	    NULL for none.  Settable with Cluster_Invalidate_Group. */
+	char *cluster_invalidate_group;
+	/** UDP port of the group.  Defaults to 20050, settable with
+	    Cluster_Invalidate_Port. */
+	uint16_t cluster_invalidate_port;
+	/** Milliseconds invalidates are held to send them together, 0
+	    to send each at once.  Defaults to 10, settable with
+	    Cluster_Invalidate_Window. */
+	uint32_t cluster_invalidate_window;
+	/** Hops invalidates are multicast over.  Defaults to 1,
+	    settable with Cluster_Invalidate_TTL. */
+	uint32_t cluster_invalidate_ttl;
 };
 
 extern struct mdcache_parameter mdcache_param;
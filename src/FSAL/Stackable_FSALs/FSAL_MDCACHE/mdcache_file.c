@@ -50,32 +50,70 @@ struct mdc_async_arg {
 };
 
 /**
+ * @brief Callback args of read2 and write2
  *
- * @brief Set a timestamp to the current time
- *
- * @param[out] time Pointer to time to be set
+ * One is needed for every I/O, so they come from a pool rather than
+ * from malloc.
+ */
+static pool_t *mdc_async_arg_pool;
+
+/**
+ * @brief Set up the I/O callback arg pool
+ */
+void mdcache_file_pkginit(void)
+{
+	mdc_async_arg_pool = pool_basic_init("MDCACHE Async Arg Pool",
+					     sizeof(struct mdc_async_arg));
+	pool_set_mem_tag(mdc_async_arg_pool, MEM_TAG_MDCACHE);
+}
+
+/**
+ * @brief Destroy the I/O callback arg pool
+ */
+void mdcache_file_pkgshutdown(void)
+{
+	pool_destroy(mdc_async_arg_pool);
+	mdc_async_arg_pool = NULL;
+}
+
+/**
+ * @brief Set up the callback arg of an I/O
+ */
+static inline struct mdc_async_arg *
+mdc_async_arg_get(struct fsal_obj_handle *obj_hdl, fsal_async_cb done_cb,
+		  void *caller_arg)
+{
+	struct mdc_async_arg *arg = pool_alloc(mdc_async_arg_pool);
+
+	arg->obj_hdl = obj_hdl;
+	arg->cb = done_cb;
+	arg->cb_arg = caller_arg;
+	return arg;
+}
+
+/**
+ * @brief Note that an entry was read
  *
- * @return true on success, false on failure
+ * The time is only looked at to the second with the coarse clock, and
+ * only stored when the second changed, so a file read many times a
+ * second doesn't dirty its entry for every read.
  *
+ * @param[in] entry	File read
  */
-bool
-mdc_set_time_current(struct timespec *time)
+static inline void mdc_touch_atime(mdcache_entry_t *entry)
 {
-	struct timeval t;
-
-	if (time == NULL)
-		return false;
+	struct timespec ts;
 
-	if (gettimeofday(&t, NULL) != 0)
-		return false;
+	if (clock_gettime(CLOCK_REALTIME_COARSE, &ts) != 0)
+		return;
 
-	time->tv_sec = t.tv_sec;
-	time->tv_nsec = 1000 * t.tv_usec;
+	if (entry->attrs.atime.tv_sec == ts.tv_sec)
+		return;
 
-	return true;
+	entry->attrs.atime.tv_sec = ts.tv_sec;
+	entry->attrs.atime.tv_nsec = 0;
 }
 
-
 /**
  * @brief IO Advise
  *
@@ -195,6 +233,7 @@ static fsal_status_t mdc_open2_by_name(mdcache_entry_t *mdc_parent,
 		/* Invalidate the attributes since we just truncated. */
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_cluster_publish(entry, FSAL_UP_INVALIDATE_ATTRS);
 	}
 
 	if (attrs_out) {
@@ -366,6 +405,9 @@ fsal_status_t mdcache_open2(struct fsal_obj_handle *obj_hdl,
 				& ~(ATTR_ACL | ATTR4_FS_LOCATIONS)) |
 				ATTR_RDATTR_ERR);
 
+	if (name)
+		mdcache_name_lock(mdc_parent, name);
+
 	subcall(
 		status = mdc_parent->sub_handle->obj_ops->open2(
 			mdc_parent->sub_handle, state, openflags, createmode,
@@ -383,6 +425,8 @@ fsal_status_t mdcache_open2(struct fsal_obj_handle *obj_hdl,
 			 */
 			mdcache_kill_entry(mdc_parent);
 		}
+		if (name)
+			mdcache_name_unlock(mdc_parent, name);
 		fsal_release_attrs(&attrs);
 		*new_obj = NULL;
 		return status;
@@ -396,6 +440,8 @@ fsal_status_t mdcache_open2(struct fsal_obj_handle *obj_hdl,
 			 */
 			atomic_clear_uint32_t_bits(&mdc_parent->mde_flags,
 						   MDCACHE_TRUST_ATTRS);
+			mdc_cluster_publish(mdc_parent,
+					    FSAL_UP_INVALIDATE_ATTRS);
 		}
 
 		LogFullDebug(COMPONENT_CACHE_INODE,
@@ -410,17 +456,15 @@ fsal_status_t mdcache_open2(struct fsal_obj_handle *obj_hdl,
 
 	invalidate = createmode != FSAL_NO_CREATE;
 
-	PTHREAD_RWLOCK_wrlock(&mdc_parent->content_lock);
-
 	/* We will invalidate parent attrs if we did any form of create. */
 	status = mdcache_alloc_and_check_handle(export, sub_handle,
 						new_obj, false,
 						&attrs, attrs_out,
 						"open2 ", mdc_parent, name,
-						&invalidate,
+						false, &invalidate,
 						state);
 
-	PTHREAD_RWLOCK_unlock(&mdc_parent->content_lock);
+	mdcache_name_unlock(mdc_parent, name);
 
 	fsal_release_attrs(&attrs);
 
@@ -513,6 +557,7 @@ fsal_status_t mdcache_reopen2(struct fsal_obj_handle *obj_hdl,
 	if (truncated && !FSAL_IS_ERROR(status)) {
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_cluster_publish(entry, FSAL_UP_INVALIDATE_ATTRS);
 	}
 
 	return status;
@@ -544,17 +589,88 @@ static void mdc_read_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 		 );
 
 	if (!FSAL_IS_ERROR(ret))
-		mdc_set_time_current(&entry->attrs.atime);
+		mdc_touch_atime(entry);
 	else if (ret.major == ERR_FSAL_DELAY)
 		mdcache_kill_entry(entry);
 
-	gsh_free(arg);
+	pool_free(mdc_async_arg_pool, arg);
+}
+
+/**
+ * @brief Read ahead of a sequential reader
+ *
+ * A read that starts where the last one ended is sequential.  From the
+ * second one in a row, the sub-FSAL is asked with a WILLNEED hint for
+ * a window of twice the read past it, and again for a window twice as
+ * large, up to Read_Ahead_Max, whenever the reader has got halfway
+ * through what was asked for.  Any other read starts over.
+ *
+ * A sub-FSAL that acts on no hint isn't asked again until the stream
+ * starts over.
+ *
+ * @param[in] entry	File being read
+ * @param[in] read_arg	The read
+ */
+static void mdc_read_ahead(mdcache_entry_t *entry,
+			   struct fsal_io_arg *read_arg)
+{
+	struct io_hints hints;
+	uint64_t offset = read_arg->offset;
+	uint64_t len = 0, end, start, ra_end, window;
+	int i;
+
+	if (mdcache_param.read_ahead_max == 0)
+		return;
+
+	for (i = 0; i < read_arg->iov_count; i++)
+		len += read_arg->iov[i].iov_len;
+	end = offset + len;
+
+	if (atomic_fetch_uint64_t(&entry->ra.next) != offset) {
+		atomic_store_uint64_t(&entry->ra.next, end);
+		atomic_store_uint64_t(&entry->ra.window, 0);
+		atomic_store_uint64_t(&entry->ra.end, 0);
+		return;
+	}
+	atomic_store_uint64_t(&entry->ra.next, end);
+
+	window = atomic_fetch_uint64_t(&entry->ra.window);
+	ra_end = atomic_fetch_uint64_t(&entry->ra.end);
+
+	if (window != 0 && end + window / 2 < ra_end)
+		return;
+
+	window = window == 0 ? 2 * len : 2 * window;
+	if (window > mdcache_param.read_ahead_max)
+		window = mdcache_param.read_ahead_max;
+
+	start = MAX(end, ra_end);
+	if (start >= end + window)
+		return;
+
+	atomic_store_uint64_t(&entry->ra.window, window);
+	atomic_store_uint64_t(&entry->ra.end, end + window);
+
+	hints.offset = start;
+	hints.count = end + window - start;
+	hints.hints = 1U << IO_ADVISE4_WILLNEED;
+
+	subcall(
+		(void) entry->sub_handle->obj_ops->io_advise2(
+			entry->sub_handle, read_arg->state, &hints)
+	       );
+
+	if (hints.hints == 0) {
+		/* Nobody reads ahead below, don't ask again */
+		atomic_store_uint64_t(&entry->ra.end, UINT64_MAX);
+	}
 }
 
 /**
  * @brief Read from a file (new style)
  *
- * Delegate to sub-FSAL
+ * Delegate to sub-FSAL, after reading ahead if the file is being read
+ * sequentially.
  *
  * @param[in]     obj_hdl	File on which to operate
  * @param[in]     bypass	If state doesn't indicate a share reservation,
@@ -576,10 +692,9 @@ void mdcache_read2(struct fsal_obj_handle *obj_hdl,
 	struct mdc_async_arg *arg;
 
 	/* Set up async callback */
-	arg = gsh_calloc(1, sizeof(*arg));
-	arg->obj_hdl = obj_hdl;
-	arg->cb = done_cb;
-	arg->cb_arg = caller_arg;
+	arg = mdc_async_arg_get(obj_hdl, done_cb, caller_arg);
+
+	mdc_read_ahead(entry, read_arg);
 
 	subcall(
 		entry->sub_handle->obj_ops->read2(entry->sub_handle, bypass,
@@ -601,12 +716,24 @@ static void mdc_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 			void *obj_data, void *caller_data)
 {
 	struct mdc_async_arg *arg = caller_data;
+	struct fsal_io_arg *write_arg = obj_data;
 	mdcache_entry_t *entry =
 		container_of(arg->obj_hdl, mdcache_entry_t, obj_handle);
 
+	if (ret.major == ERR_FSAL_NO_ERROR)
+		mdc_cluster_publish(entry, FSAL_UP_INVALIDATE_ATTRS);
+
 	if (ret.major == ERR_FSAL_STALE)
 		mdcache_kill_entry(entry);
-	else
+	else if (ret.major == ERR_FSAL_NO_ERROR &&
+		 mdcache_param.lockless_write_attrs)
+		mdc_write_attrs_record(entry, write_arg->offset +
+					      write_arg->io_amount);
+	else if (atomic_fetch_uint32_t(&entry->mde_flags) &
+		 MDCACHE_TRUST_ATTRS)
+		/* Only write the flags when they change, writers of a
+		 * busy file would otherwise all bounce them around.
+		 */
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
 
@@ -614,7 +741,7 @@ static void mdc_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 		  arg->cb(arg->obj_hdl, ret, obj_data, arg->cb_arg);
 		 );
 
-	gsh_free(arg);
+	pool_free(mdc_async_arg_pool, arg);
 }
 
 /**
@@ -639,10 +766,7 @@ void mdcache_write2(struct fsal_obj_handle *obj_hdl,
 	struct mdc_async_arg *arg;
 
 	/* Set up async callback */
-	arg = gsh_calloc(1, sizeof(*arg));
-	arg->obj_hdl = obj_hdl;
-	arg->cb = done_cb;
-	arg->cb_arg = caller_arg;
+	arg = mdc_async_arg_get(obj_hdl, done_cb, caller_arg);
 
 	subcall(
 		entry->sub_handle->obj_ops->write2(entry->sub_handle, bypass,
@@ -682,7 +806,8 @@ fsal_status_t mdcache_seek2(struct fsal_obj_handle *obj_hdl,
 /**
  * @brief Advise access pattern for a file (new style)
  *
- * Delegate to sub-FSAL
+ * Delegate to sub-FSAL, then move the entry in the LRU by how much
+ * longer the client says it will use the file.
  *
  * @param[in] obj_hdl	Object owning state
  * @param[in] state	Open file state to advise on
@@ -695,6 +820,7 @@ fsal_status_t mdcache_io_advise2(struct fsal_obj_handle *obj_hdl,
 {
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	uint32_t asked = hints->hints;
 	fsal_status_t status;
 
 	subcall(
@@ -702,8 +828,17 @@ fsal_status_t mdcache_io_advise2(struct fsal_obj_handle *obj_hdl,
 			entry->sub_handle, state, hints)
 	       );
 
-	if (status.major == ERR_FSAL_DELAY)
+	if (status.major == ERR_FSAL_DELAY) {
 		mdcache_kill_entry(entry);
+		return status;
+	}
+
+	/* Keep the entry as long as the data is wanted */
+	if (asked & ((1U << IO_ADVISE4_DONTNEED) |
+		     (1U << IO_ADVISE4_NOREUSE)))
+		mdcache_lru_demote(entry);
+	else if (asked & (1U << IO_ADVISE4_WILLNEED))
+		mdcache_lru_promote(entry);
 
 	return status;
 }
@@ -843,6 +978,9 @@ fsal_status_t mdcache_fallocate(struct fsal_obj_handle *obj_hdl,
 							allocate);
 	       );
 
+	if (!FSAL_IS_ERROR(status))
+		mdc_cluster_publish(entry, FSAL_UP_INVALIDATE_ATTRS);
+
 	if (status.major == ERR_FSAL_STALE)
 		mdcache_kill_entry(entry);
 	else
@@ -851,3 +989,73 @@ fsal_status_t mdcache_fallocate(struct fsal_obj_handle *obj_hdl,
 
 	return status;
 }
+
+fsal_status_t mdcache_copy(struct fsal_obj_handle *dst_hdl,
+			   struct state_t *dst_state, uint64_t dst_offset,
+			   struct fsal_obj_handle *src_hdl,
+			   struct state_t *src_state, uint64_t src_offset,
+			   uint64_t count, uint64_t *copied)
+{
+	mdcache_entry_t *dst =
+		container_of(dst_hdl, mdcache_entry_t, obj_handle);
+	mdcache_entry_t *src =
+		container_of(src_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	if (dst->sub_handle->fsal != src->sub_handle->fsal)
+		return fsalstat(ERR_FSAL_XDEV, 0);
+
+	subcall(
+		status = dst->sub_handle->obj_ops->copy(
+						dst->sub_handle, dst_state,
+						dst_offset, src->sub_handle,
+						src_state, src_offset, count,
+						copied);
+	       );
+
+	if (!FSAL_IS_ERROR(status))
+		mdc_cluster_publish(dst, FSAL_UP_INVALIDATE_ATTRS);
+
+	if (status.major == ERR_FSAL_STALE)
+		mdcache_kill_entry(dst);
+	else
+		atomic_clear_uint32_t_bits(&dst->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+
+	return status;
+}
+
+fsal_status_t mdcache_clone2(struct fsal_obj_handle *dst_hdl,
+			     struct state_t *dst_state, uint64_t dst_offset,
+			     struct fsal_obj_handle *src_hdl,
+			     struct state_t *src_state, uint64_t src_offset,
+			     uint64_t count)
+{
+	mdcache_entry_t *dst =
+		container_of(dst_hdl, mdcache_entry_t, obj_handle);
+	mdcache_entry_t *src =
+		container_of(src_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	if (dst->sub_handle->fsal != src->sub_handle->fsal)
+		return fsalstat(ERR_FSAL_XDEV, 0);
+
+	subcall(
+		status = dst->sub_handle->obj_ops->clone2(
+						dst->sub_handle, dst_state,
+						dst_offset, src->sub_handle,
+						src_state, src_offset,
+						count);
+	       );
+
+	if (!FSAL_IS_ERROR(status))
+		mdc_cluster_publish(dst, FSAL_UP_INVALIDATE_ATTRS);
+
+	if (status.major == ERR_FSAL_STALE)
+		mdcache_kill_entry(dst);
+	else
+		atomic_clear_uint32_t_bits(&dst->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+
+	return status;
+}
@@ -54,7 +54,8 @@
  * This function is a wrapper of mdcache_alloc_handle. It adds error checking
  * and logging. It also cleans objects allocated in the subfsal if it fails.
  *
- * @note the caller must hold the content lock on the parent.
+ * Unless @a parent_locked, the content lock of the parent is only taken
+ * to add the dirent, the new entry is made without it.
  *
  * This does not cause an ABBA lock conflict with the potential getattrs
  * if we lose a race to create the cache entry since our caller CAN NOT hold
@@ -74,6 +75,8 @@
  * @param[in,out] attrs_out      Optional attributes for newly created object.
  * @param[in]     parent         Parent directory to add dirent to.
  * @param[in]     name           Name of the dirent to add.
+ * @param[in]     parent_locked  The caller holds the parent's content lock
+ *                               for write.
  * @param[in,out] invalidate     Invalidate parent attr (and chunk cache)
  * @param[in]     state          Optional state_t representing open file.
  *
@@ -91,6 +94,7 @@ fsal_status_t mdcache_alloc_and_check_handle(
 		const char *tag,
 		mdcache_entry_t *parent,
 		const char *name,
+		bool parent_locked,
 		bool *invalidate,
 		struct state_t *state)
 {
@@ -117,14 +121,21 @@ fsal_status_t mdcache_alloc_and_check_handle(
 		 */
 		atomic_clear_uint32_t_bits(&parent->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_cluster_publish(parent, MDC_CLUSTER_DIR);
 	}
 
 	if (mdcache_param.dir.avl_chunk != 0) {
+		if (!parent_locked)
+			PTHREAD_RWLOCK_wrlock(&parent->content_lock);
+
 		/* Add this entry to the directory (also takes an internal ref)
 		 */
 		status = mdcache_dirent_add(parent, name, new_entry,
 					    invalidate);
 
+		if (!parent_locked)
+			PTHREAD_RWLOCK_unlock(&parent->content_lock);
+
 		if (FSAL_IS_ERROR(status)) {
 			LogDebug(COMPONENT_CACHE_INODE,
 				 "%s%s failed because add dirent failed",
@@ -219,6 +230,8 @@ static fsal_status_t mdcache_mkdir(struct fsal_obj_handle *dir_hdl,
 			   op_ctx->fsal_export->exp_ops.fs_supported_attrs(
 					op_ctx->fsal_export) & ~ATTR_ACL);
 
+	mdcache_name_lock(parent, name);
+
 	subcall_raw(export,
 		status = parent->sub_handle->obj_ops->mkdir(
 			parent->sub_handle, name, attrib, &sub_handle, &attrs)
@@ -236,19 +249,18 @@ static fsal_status_t mdcache_mkdir(struct fsal_obj_handle *dir_hdl,
 				 "FSAL returned STALE on mkdir");
 			mdcache_kill_entry(parent);
 		}
+		mdcache_name_unlock(parent, name);
 		*handle = NULL;
 		fsal_release_attrs(&attrs);
 		return status;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&parent->content_lock);
-
 	status = mdcache_alloc_and_check_handle(export, sub_handle, handle,
 						true, &attrs, attrs_out,
 						"mkdir ",  parent, name,
-						&invalidate, NULL);
+						false, &invalidate, NULL);
 
-	PTHREAD_RWLOCK_unlock(&parent->content_lock);
+	mdcache_name_unlock(parent, name);
 
 	fsal_release_attrs(&attrs);
 
@@ -298,6 +310,8 @@ static fsal_status_t mdcache_mknode(struct fsal_obj_handle *dir_hdl,
 			   op_ctx->fsal_export->exp_ops.fs_supported_attrs(
 					op_ctx->fsal_export) & ~ATTR_ACL);
 
+	mdcache_name_lock(parent, name);
+
 	subcall_raw(export,
 		status = parent->sub_handle->obj_ops->mknode(
 			parent->sub_handle, name, nodetype, attrib,
@@ -316,19 +330,18 @@ static fsal_status_t mdcache_mknode(struct fsal_obj_handle *dir_hdl,
 				 "FSAL returned STALE on mknod");
 			mdcache_kill_entry(parent);
 		}
+		mdcache_name_unlock(parent, name);
 		*handle = NULL;
 		fsal_release_attrs(&attrs);
 		return status;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&parent->content_lock);
-
 	status = mdcache_alloc_and_check_handle(export, sub_handle, handle,
 						false, &attrs, attrs_out,
 						"mknode ",  parent, name,
-						&invalidate, NULL);
+						false, &invalidate, NULL);
 
-	PTHREAD_RWLOCK_unlock(&parent->content_lock);
+	mdcache_name_unlock(parent, name);
 
 	fsal_release_attrs(&attrs);
 
@@ -378,6 +391,8 @@ static fsal_status_t mdcache_symlink(struct fsal_obj_handle *dir_hdl,
 			   op_ctx->fsal_export->exp_ops.fs_supported_attrs(
 					op_ctx->fsal_export) & ~ATTR_ACL);
 
+	mdcache_name_lock(parent, name);
+
 	subcall_raw(export,
 		status = parent->sub_handle->obj_ops->symlink(
 			parent->sub_handle, name, link_path, attrib,
@@ -396,19 +411,18 @@ static fsal_status_t mdcache_symlink(struct fsal_obj_handle *dir_hdl,
 				 "FSAL returned STALE on symlink");
 			mdcache_kill_entry(parent);
 		}
+		mdcache_name_unlock(parent, name);
 		*handle = NULL;
 		fsal_release_attrs(&attrs);
 		return status;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&parent->content_lock);
-
 	status = mdcache_alloc_and_check_handle(export, sub_handle, handle,
 						false, &attrs, attrs_out,
 						"symlink ",  parent, name,
-						&invalidate, NULL);
+						false, &invalidate, NULL);
 
-	PTHREAD_RWLOCK_unlock(&parent->content_lock);
+	mdcache_name_unlock(parent, name);
 
 	fsal_release_attrs(&attrs);
 
@@ -430,6 +444,99 @@ static fsal_status_t mdcache_symlink(struct fsal_obj_handle *dir_hdl,
  * @param[in] refresh	If true, refresh attributes on symlink
  * @return FSAL status
  */
+/**
+ * @brief Drop the cached content of a symlink
+ *
+ * @note The caller must hold the content_lock for write, or own the entry
+ *
+ * @param[in] entry	Entry to clear
+ */
+void mdc_symlink_clear(mdcache_entry_t *entry)
+{
+	if (entry->symlink.content == NULL)
+		return;
+
+	gsh_free_tag(MEM_TAG_MDCACHE, entry->symlink.content,
+		     entry->symlink.len);
+	(void) atomic_sub_int64_t(&lru_state.symlink_bytes,
+				  entry->symlink.len);
+	entry->symlink.content = NULL;
+	entry->symlink.len = 0;
+}
+
+/**
+ * @brief Check whether the cached content of a symlink can be used
+ *
+ * A symlink's content never changes, but a sub-FSAL may reuse a handle,
+ * so a change attribute known to have moved on discards it.
+ *
+ * @note The caller must hold the content_lock
+ *
+ * @param[in] entry		Entry to check
+ * @param[in] change_valid	The change attribute is trusted
+ * @param[in] change		The change attribute
+ *
+ * @return true if the content can be returned.
+ */
+static inline bool mdc_symlink_valid(mdcache_entry_t *entry,
+				     bool change_valid, uint64_t change)
+{
+	return entry->symlink.content != NULL &&
+	       test_mde_flags(entry, MDCACHE_TRUST_CONTENT) &&
+	       (!change_valid || entry->symlink.change == change);
+}
+
+/**
+ * @brief Copy the cached content of a symlink out
+ *
+ * @param[in]  entry		Entry with cached content
+ * @param[out] link_content	Copy, to be freed by the caller
+ */
+static void mdc_symlink_copy(mdcache_entry_t *entry,
+			     struct gsh_buffdesc *link_content)
+{
+	link_content->len = entry->symlink.len;
+	link_content->addr = gsh_malloc(entry->symlink.len);
+	memcpy(link_content->addr, entry->symlink.content,
+	       entry->symlink.len);
+	mdcache_stat_inc(MDC_STAT_SYMLINK_HIT);
+}
+
+/**
+ * @brief Cache the content of a symlink just read
+ *
+ * Nothing is cached once Symlink_Cache_Size is reached.
+ *
+ * @note The caller must hold the content_lock for write
+ *
+ * @param[in] entry		Entry of the symlink
+ * @param[in] link_content	Content read from the sub-FSAL
+ * @param[in] change		Change attribute before the read
+ */
+static void mdc_symlink_set(mdcache_entry_t *entry,
+			    const struct gsh_buffdesc *link_content,
+			    uint64_t change)
+{
+	mdc_symlink_clear(entry);
+
+	if (link_content->len == 0)
+		return;
+
+	if (atomic_add_int64_t(&lru_state.symlink_bytes, link_content->len) >
+	    mdcache_param.symlink_cache_size) {
+		(void) atomic_sub_int64_t(&lru_state.symlink_bytes,
+					  link_content->len);
+		return;
+	}
+
+	entry->symlink.content = gsh_malloc_tag(MEM_TAG_MDCACHE,
+						link_content->len);
+	memcpy(entry->symlink.content, link_content->addr,
+	       link_content->len);
+	entry->symlink.len = link_content->len;
+	entry->symlink.change = change;
+}
+
 static fsal_status_t mdcache_readlink(struct fsal_obj_handle *obj_hdl,
 				 struct gsh_buffdesc *link_content,
 				 bool refresh)
@@ -437,27 +544,51 @@ static fsal_status_t mdcache_readlink(struct fsal_obj_handle *obj_hdl,
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
+	bool change_valid;
+	uint64_t change;
+
+	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+	change_valid = mdcache_is_attrs_valid(entry, ATTR_CHANGE);
+	change = entry->attrs.change;
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
 
 	PTHREAD_RWLOCK_rdlock(&entry->content_lock);
-	if (!refresh && !test_mde_flags(entry, MDCACHE_TRUST_CONTENT)) {
-		/* Our data are stale.  Drop the lock, get a
-		   write-lock, load in new data, and copy it out to
-		   the caller. */
+	if (!refresh && mdc_symlink_valid(entry, change_valid, change)) {
+		mdc_symlink_copy(entry, link_content);
 		PTHREAD_RWLOCK_unlock(&entry->content_lock);
-		PTHREAD_RWLOCK_wrlock(&entry->content_lock);
-		/* Make sure nobody updated the content while we were
-		   waiting. */
-		refresh = !test_mde_flags(entry, MDCACHE_TRUST_CONTENT);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	/* Our data are stale or not cached.  Drop the lock, get a
+	   write-lock, load in new data, and copy it out to the
+	   caller. */
+	PTHREAD_RWLOCK_unlock(&entry->content_lock);
+	PTHREAD_RWLOCK_wrlock(&entry->content_lock);
+
+	/* Make sure nobody updated the content while we were
+	   waiting. */
+	if (!refresh && mdc_symlink_valid(entry, change_valid, change)) {
+		mdc_symlink_copy(entry, link_content);
+		PTHREAD_RWLOCK_unlock(&entry->content_lock);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
 	}
 
+	if (!refresh)
+		refresh = !test_mde_flags(entry, MDCACHE_TRUST_CONTENT);
+
+	mdcache_stat_inc(MDC_STAT_SYMLINK_MISS);
 	subcall(
 		status = entry->sub_handle->obj_ops->readlink(
 			entry->sub_handle, link_content, refresh)
 	       );
 
-	if (refresh && !(FSAL_IS_ERROR(status)))
+	if (FSAL_IS_ERROR(status)) {
+		mdc_symlink_clear(entry);
+	} else {
+		mdc_symlink_set(entry, link_content, change);
 		atomic_set_uint32_t_bits(&entry->mde_flags,
 					 MDCACHE_TRUST_CONTENT);
+	}
 
 	PTHREAD_RWLOCK_unlock(&entry->content_lock);
 
@@ -483,12 +614,15 @@ static fsal_status_t mdcache_link(struct fsal_obj_handle *obj_hdl,
 	fsal_status_t status;
 	bool invalidate = true;
 
+	mdcache_name_lock(dest, name);
+
 	subcall(
 		status = entry->sub_handle->obj_ops->link(
 			entry->sub_handle, dest->sub_handle, name)
 	       );
 
 	if (FSAL_IS_ERROR(status)) {
+		mdcache_name_unlock(dest, name);
 		LogFullDebug(COMPONENT_CACHE_INODE,
 			     "link failed %s",
 			     fsal_err_txt(status));
@@ -505,9 +639,14 @@ static fsal_status_t mdcache_link(struct fsal_obj_handle *obj_hdl,
 		PTHREAD_RWLOCK_unlock(&dest->content_lock);
 	}
 
+	mdcache_name_unlock(dest, name);
+
 	/* Invalidate attributes, so refresh will be forced */
 	atomic_clear_uint32_t_bits(&entry->mde_flags, MDCACHE_TRUST_ATTRS);
 
+	mdc_cluster_publish(entry, FSAL_UP_INVALIDATE_ATTRS);
+	mdc_cluster_publish(dest, MDC_CLUSTER_DIR);
+
 	if (FSAL_IS_SUCCESS(status) && !invalidate) {
 		/* Refresh destination directory attributes without
 		 * invalidating dirents.
@@ -536,6 +675,21 @@ static fsal_status_t mdcache_link(struct fsal_obj_handle *obj_hdl,
  *
  * @return FSAL status
  */
+struct mdc_readdir_entries_state {
+	fsal_readdir_cb cb;	/*< Per-entry callback to the upper layer */
+	void *dir_state;	/*< Its state */
+};
+
+static enum fsal_dir_result
+mdc_readdir_entries(struct fsal_readdir_entry *entries, unsigned int count,
+		    unsigned int *consumed, void *dir_state)
+{
+	struct mdc_readdir_entries_state *state = dir_state;
+
+	return fsal_readdir_entries(state->cb, entries, count, consumed,
+				    state->dir_state);
+}
+
 static fsal_status_t mdcache_readdir(struct fsal_obj_handle *dir_hdl,
 				  fsal_cookie_t *whence, void *dir_state,
 				  fsal_readdir_cb cb, attrmask_t attrmask,
@@ -543,6 +697,11 @@ static fsal_status_t mdcache_readdir(struct fsal_obj_handle *dir_hdl,
 {
 	mdcache_entry_t *directory = container_of(dir_hdl, mdcache_entry_t,
 						  obj_handle);
+	struct mdc_readdir_entries_state state = {
+		.cb = cb,
+		.dir_state = dir_state,
+	};
+
 	if (!(directory->obj_handle.type == DIRECTORY))
 		return fsalstat(ERR_FSAL_NOTDIR, 0);
 
@@ -558,11 +717,61 @@ static fsal_status_t mdcache_readdir(struct fsal_obj_handle *dir_hdl,
 
 		return mdcache_readdir_chunked(directory,
 					       whence ? *whence : (uint64_t) 0,
-					       dir_state, cb, attrmask,
-					       eod_met);
+					       &state, mdc_readdir_entries,
+					       attrmask, eod_met);
 	}
 }
 
+/**
+ * Read the contents of a directory in batches
+ *
+ * As mdcache_readdir(), but the callback is handed the entries of the
+ * dirent cache several at a time.
+ *
+ * @note The objects passed into the callback are ref'd and must be unref'd
+ * by the callback.
+ *
+ * @param[in] dir_hdl the directory to read
+ * @param[in] whence where to start (next)
+ * @param[in] dir_state pass thru of state to callback
+ * @param[in] cb batch callback function
+ * @param[in] attrmask Which attributes to fill
+ * @param[out] eod_met eod marker true == end of dir
+ *
+ * @return FSAL status
+ */
+static fsal_status_t mdcache_readdir_batch(struct fsal_obj_handle *dir_hdl,
+					   fsal_cookie_t *whence,
+					   void *dir_state,
+					   fsal_readdir_batch_cb cb,
+					   attrmask_t attrmask, bool *eod_met)
+{
+	mdcache_entry_t *directory = container_of(dir_hdl, mdcache_entry_t,
+						  obj_handle);
+	struct fsal_readdir_batch_state state = {
+		.cb = cb,
+		.dir_state = dir_state,
+	};
+
+	if (!(directory->obj_handle.type == DIRECTORY))
+		return fsalstat(ERR_FSAL_NOTDIR, 0);
+
+	if (mdcache_param.dir.avl_chunk == 0) {
+		/* Not caching dirents; the FSAL hands them over one by one */
+		return mdcache_readdir_uncached(directory, whence, &state,
+						fsal_readdir_batch_one,
+						attrmask, eod_met);
+	}
+
+	LogDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
+		    "Calling mdcache_readdir_chunked whence=%"PRIx64,
+		    whence ? *whence : (uint64_t) 0);
+
+	return mdcache_readdir_chunked(directory,
+				       whence ? *whence : (uint64_t) 0,
+				       dir_state, cb, attrmask, eod_met);
+}
+
 /**
  * @brief Check access for a given user against a given object
  *
@@ -629,9 +838,12 @@ static fsal_status_t mdcache_rename(struct fsal_obj_handle *obj_hdl,
 	mdcache_entry_t *mdc_obj =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	mdcache_entry_t *mdc_lookup_dst = NULL;
+	mdcache_entry_t *mdc_new = NULL;
 	struct fsal_export *sub_export = op_ctx->fsal_export->sub_export;
 	bool refresh = false;
+	bool refresh_old = false;
 	bool rename_change_key;
+	fsal_status_t lookup_status;
 	fsal_status_t status = {0, 0};
 
 	status = mdc_lookup(mdc_newdir, new_name, true, &mdc_lookup_dst, NULL);
@@ -647,8 +859,8 @@ static fsal_status_t mdcache_rename(struct fsal_obj_handle *obj_hdl,
 		}
 	}
 
-	/* Now update cached dirents.  Must take locks in the correct order */
-	mdcache_src_dest_lock(mdc_olddir, mdc_newdir);
+	/* The names, not the directories, are locked across the rename */
+	mdcache_name_lock2(mdc_olddir, old_name, mdc_newdir, new_name);
 
 	subcall(
 		status = mdc_olddir->sub_handle->obj_ops->rename(
@@ -657,7 +869,10 @@ static fsal_status_t mdcache_rename(struct fsal_obj_handle *obj_hdl,
 	       );
 
 	if (FSAL_IS_ERROR(status))
-		goto unlock;
+		goto unlock_names;
+
+	/* Now update cached dirents.  Must take locks in the correct order */
+	mdcache_src_dest_lock(mdc_olddir, mdc_newdir);
 
 	if (mdc_lookup_dst != NULL) {
 		/* Mark target file attributes as invalid */
@@ -678,6 +893,13 @@ static fsal_status_t mdcache_rename(struct fsal_obj_handle *obj_hdl,
 					   MDCACHE_TRUST_ATTRS);
 	}
 
+	if (mdc_lookup_dst != NULL)
+		mdc_cluster_publish(mdc_lookup_dst, FSAL_UP_INVALIDATE_ATTRS);
+	mdc_cluster_publish(mdc_obj, FSAL_UP_INVALIDATE_ATTRS);
+	mdc_cluster_publish(mdc_olddir, MDC_CLUSTER_DIR);
+	if (olddir_hdl != newdir_hdl)
+		mdc_cluster_publish(mdc_newdir, MDC_CLUSTER_DIR);
+
 	/* NOTE: Below we mostly don't check if the directory is not
 	 *       cached. The cache manipulation functions we call already
 	 *       bail out if we aren't cached. However, for rename into a
@@ -704,21 +926,32 @@ static fsal_status_t mdcache_rename(struct fsal_obj_handle *obj_hdl,
 			 "Rename (%p,%s)->(%p,%s) : key changing", mdc_olddir,
 			 old_name, mdc_newdir, new_name);
 
-		/* FSAL changes keys on rename.  Just remove the dirent(s) */
-
-		/* Old dirent first */
+		/* FSAL changes keys on rename.  Remove the old dirent, then
+		 * look the new name up, which caches the object under its
+		 * new key and places its dirent as any lookup would.
+		 */
 		mdcache_dirent_remove(mdc_olddir, old_name);
+		mdcache_dirent_remove(mdc_newdir, new_name);
 
-		/** @todo: With chunking and compute cookie, we can actually
-		 *         figure out which chunk the new dirent belongs to
-		 *         without a lookup, so we could just invalidate that
-		 *         chunk and the rest of the directory can remain
-		 *         cached.
-		 */
+		if (mdcache_param.dir.avl_chunk != 0) {
+			/* Protected by mdcache_src_dst_lock() above */
+			lookup_status = mdc_lookup_uncached(mdc_newdir,
+							    new_name, &mdc_new,
+							    NULL);
+		} else {
+			lookup_status = fsalstat(ERR_FSAL_NOTSUPP, 0);
+		}
 
-		/* Now new directory.  Here, we just need to invalidate dirents,
-		 * since we have a known missing dirent */
-		mdcache_dirent_invalidate_all(mdc_newdir);
+		if (FSAL_IS_ERROR(lookup_status)) {
+			/* There is a known missing dirent, so the only choice
+			 * is to throw out the cached directory.
+			 */
+			mdcache_dirent_invalidate_all(mdc_newdir);
+		} else {
+			mdcache_put(mdc_new);
+			refresh = true;
+			refresh_old = true;
+		}
 
 		/* Handle key is changing.  This means the old handle is
 		 * useless.  Mark it unreachable, forcing a lookup next time */
@@ -753,13 +986,17 @@ static fsal_status_t mdcache_rename(struct fsal_obj_handle *obj_hdl,
 			 */
 			refresh = true;
 		}
-	}
 
-unlock:
+		/* The old dirent went away in place too */
+		refresh_old = true;
+	}
 
 	/* unlock entries */
 	mdcache_src_dest_unlock(mdc_olddir, mdc_newdir);
 
+unlock_names:
+	mdcache_name_unlock2(mdc_olddir, old_name, mdc_newdir, new_name);
+
 out:
 	/* Refresh, if necessary.  Must be done without lock held */
 	if (FSAL_IS_SUCCESS(status)) {
@@ -776,6 +1013,13 @@ out:
 		if (refresh)
 			status =
 			       mdcache_refresh_attrs_no_invalidate(mdc_newdir);
+
+		/* Otherwise the mtime the rename moved would make the next
+		 * refresh of the source directory throw out all its dirents,
+		 * though the one that changed was already dealt with.
+		 */
+		if (refresh_old && mdc_olddir != mdc_newdir)
+			(void) mdcache_refresh_attrs_no_invalidate(mdc_olddir);
 	}
 
 	if (mdc_lookup_dst)
@@ -795,20 +1039,28 @@ out:
  * @param[in] entry		The mdcache entry to refresh attributes for.
  * @param[in] need_acl		Indicates if the ACL needs updating.
  * @param[in] need_fslocations	Indicates if the fslocations are needed.
+ * @param[in] need_seclabel	Indicates if the security label is needed.
  * @param[in] invalidate	Invalidate the dirent cache if the entry is a
  *				directory.
  */
 
 fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl,
-				    bool need_fslocations, bool invalidate)
+				    bool need_fslocations, bool need_seclabel,
+				    bool invalidate)
 {
 	struct attrlist attrs;
 	fsal_status_t status = {0, 0};
 	struct timespec oldmtime;
+	uint64_t change = 0;
 
 	/* Use this to detect if we should invalidate a directory. */
 	oldmtime = entry->attrs.mtime;
 
+	/* Writes recorded from here on may be missing from what we fetch */
+	if (entry->obj_handle.type == REGULAR_FILE &&
+	    mdcache_param.lockless_write_attrs)
+		change = mdc_write_attrs_reset(entry);
+
 	/* We always ask for all regular attributes, even if the caller was
 	 * only interested in the ACL.
 	 */
@@ -826,6 +1078,17 @@ fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl,
 		attrs.request_mask &= ~ATTR4_FS_LOCATIONS;
 	}
 
+	if (!need_seclabel) {
+		/* The label costs the sub-FSAL an extra xattr fetch, so only
+		 * get it when asked. Whatever label we hold is no longer
+		 * known to go with the attributes we are about to load, so
+		 * the next request for it will fetch it afresh.
+		 */
+		attrs.request_mask &= ~ATTR4_SEC_LABEL;
+		atomic_clear_uint32_t_bits(&entry->mde_flags,
+					   MDCACHE_TRUST_SEC_LABEL);
+	}
+
 	/* We will want all the requested attributes in the entry */
 	entry->attrs.request_mask = attrs.request_mask;
 
@@ -842,6 +1105,13 @@ fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl,
 	}
 
 	mdc_update_attr_cache(entry, &attrs);
+	entry->attr_generation++;
+
+	/* The sub-FSAL may count writes more coarsely than we did, never let
+	 * the change attribute go back.
+	 */
+	if (entry->attrs.change < change)
+		entry->attrs.change = change;
 
 	/* Done with the attrs (we didn't need to call this since the
 	 * fsal_copy_attrs preceding consumed all the references, but we
@@ -879,26 +1149,55 @@ static fsal_status_t mdcache_getattrs(struct fsal_obj_handle *obj_hdl,
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status = {0, 0};
+	struct mdc_write_attrs wattrs = {0};
+	bool writes = entry->obj_handle.type == REGULAR_FILE &&
+		      mdcache_param.lockless_write_attrs;
+	uint32_t generation;
 
 	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
 
-	if (mdcache_is_attrs_valid(entry, attrs_out->request_mask)) {
+	if (mdcache_is_attrs_valid(entry, attrs_out->request_mask) &&
+	    (!writes || mdc_write_attrs_get(entry, &wattrs))) {
 		/* Up-to-date */
+		mdcache_stat_inc(MDC_STAT_ATTR_HIT);
 		goto unlock;
 	}
 
-	/* Promote to write lock */
+	if (attrs_out->request_mask & ATTR_CACHED_ONLY) {
+		/* Caller would rather go without than have them fetched */
+		attrs_out->valid_mask = ATTR_RDATTR_ERR;
+		goto unlock_no_attrs;
+	}
+
+	/* Promote to write lock.  No refresh runs while we hold the read
+	 * lock, so one counted after it started after we came in.
+	 */
+	generation = entry->attr_generation;
 	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
 	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
 
-	if (mdcache_is_attrs_valid(entry, attrs_out->request_mask)) {
-		/* Someone beat us to it */
+	if ((mdcache_is_attrs_valid(entry, attrs_out->request_mask) ||
+	     (entry->attr_generation != generation &&
+	      mdcache_test_attrs_trust(entry, attrs_out->request_mask) &&
+	      entry->attrs.valid_mask != ATTR_RDATTR_ERR)) &&
+	    (!writes || mdc_write_attrs_get(entry, &wattrs))) {
+		/* Someone beat us to it, even if what they fetched has
+		 * already expired: every caller waiting on the lock takes
+		 * the one refresh.
+		 */
+		mdcache_stat_inc(MDC_STAT_ATTR_HIT);
 		goto unlock;
 	}
 
+	(void)atomic_inc_uint64_t(&cache_stp->attr_refreshed);
+	mdcache_stat_inc(MDC_STAT_ATTR_MISS);
+	if (mdcache_test_attrs_trust(entry, attrs_out->request_mask) &&
+	    entry->attrs.valid_mask != ATTR_RDATTR_ERR)
+		mdcache_stat_inc(MDC_STAT_ATTR_EXPIRED);
 	status = mdcache_refresh_attrs(
 			entry, (attrs_out->request_mask & ATTR_ACL) != 0,
 			(attrs_out->request_mask & ATTR4_FS_LOCATIONS) != 0,
+			(attrs_out->request_mask & ATTR4_SEC_LABEL) != 0,
 			true);
 
 	if (FSAL_IS_ERROR(status)) {
@@ -911,10 +1210,17 @@ static fsal_status_t mdcache_getattrs(struct fsal_obj_handle *obj_hdl,
 		goto unlock_no_attrs;
 	}
 
+	/* Writes recorded since the reset may or may not be in what was
+	 * fetched, laying them over it is right either way.
+	 */
+	if (writes && !mdc_write_attrs_get(entry, &wattrs))
+		memset(&wattrs, 0, sizeof(wattrs));
+
 unlock:
 
 	/* Struct copy */
 	fsal_copy_attrs(attrs_out, &entry->attrs, false);
+	mdc_write_attrs_apply(&wattrs, attrs_out);
 
 unlock_no_attrs:
 
@@ -947,7 +1253,7 @@ static fsal_status_t mdcache_setattr2(struct fsal_obj_handle *obj_hdl,
 	fsal_status_t status, status2;
 	uint64_t change;
 	bool need_acl = false, kill_entry = false;
-
+	bool need_seclabel = (attrs->valid_mask & ATTR4_SEC_LABEL) != 0;
 
 	change = entry->attrs.change;
 
@@ -962,6 +1268,10 @@ static fsal_status_t mdcache_setattr2(struct fsal_obj_handle *obj_hdl,
 		goto out;
 	}
 
+	mdc_cluster_publish(entry, FSAL_UP_INVALIDATE_ATTRS |
+				   FSAL_UP_INVALIDATE_ACL |
+				   FSAL_UP_INVALIDATE_SEC_LABEL);
+
 	/* In case of ACL enabled, any of the below attribute changes
 	 * result in change of ACL set as well.
 	 */
@@ -973,7 +1283,8 @@ static fsal_status_t mdcache_setattr2(struct fsal_obj_handle *obj_hdl,
 
 	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
 	status2 = mdcache_refresh_attrs(entry, need_acl,
-					false /*need_fslocations*/, false);
+					false /*need_fslocations*/,
+					need_seclabel, false);
 	if (FSAL_IS_ERROR(status2)) {
 		/* Assume that the cache is bogus now */
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
@@ -1026,12 +1337,15 @@ static fsal_status_t mdcache_unlink(struct fsal_obj_handle *dir_hdl,
 		return fsalstat(ERR_FSAL_XDEV, 0);
 	}
 
+	mdcache_name_lock(parent, name);
+
 	subcall(
 		status = parent->sub_handle->obj_ops->unlink(
 			parent->sub_handle, entry->sub_handle, name)
 	       );
 
 	if (FSAL_IS_ERROR(status)) {
+		mdcache_name_unlock(parent, name);
 		LogDebug(COMPONENT_CACHE_INODE,
 			 "unlink %s returned %s",
 			  name, fsal_err_txt(status));
@@ -1051,12 +1365,17 @@ static fsal_status_t mdcache_unlink(struct fsal_obj_handle *dir_hdl,
 		mdcache_dirent_remove(parent, name);
 		PTHREAD_RWLOCK_unlock(&parent->content_lock);
 
+		mdcache_name_unlock(parent, name);
+
 		/* Invalidate attributes of parent and entry */
 		atomic_clear_uint32_t_bits(&parent->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
 
+		mdc_cluster_publish(parent, MDC_CLUSTER_DIR);
+		mdc_cluster_publish(entry, FSAL_UP_INVALIDATE_ATTRS);
+
 		if (entry->obj_handle.type == DIRECTORY) {
 			PTHREAD_RWLOCK_wrlock(&entry->content_lock);
 			mdcache_free_fh(&entry->fsobj.fsdir.parent);
@@ -1253,6 +1572,58 @@ static nfsstat4 mdcache_layoutcommit(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/**
+ * @brief Pass I/O statistics for a layout to the sub-FSAL
+ *
+ * @param[in] obj_hdl  The object the layout is for
+ * @param[in] req_ctx  Request context
+ * @param[in] lou_body Layout type-specific statistics
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return Valid error codes in RFC 7862
+ */
+static nfsstat4 mdcache_layoutstats(struct fsal_obj_handle *obj_hdl,
+				    struct req_op_context *req_ctx,
+				    XDR *lou_body,
+				    const struct fsal_layoutstats_arg *arg)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	nfsstat4 status;
+
+	subcall(
+		status = entry->sub_handle->obj_ops->layoutstats(
+			entry->sub_handle, req_ctx, lou_body, arg)
+	       );
+
+	return status;
+}
+
+/**
+ * @brief Pass an error met through a layout to the sub-FSAL
+ *
+ * @param[in] obj_hdl  The object the layout is for
+ * @param[in] req_ctx  Request context
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return Valid error codes in RFC 7862
+ */
+static nfsstat4 mdcache_layouterror(struct fsal_obj_handle *obj_hdl,
+				    struct req_op_context *req_ctx,
+				    const struct fsal_layouterror_arg *arg)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	nfsstat4 status;
+
+	subcall(
+		status = entry->sub_handle->obj_ops->layouterror(
+			entry->sub_handle, req_ctx, arg)
+	       );
+
+	return status;
+}
+
 /**
  * @brief Get a reference to the handle
  *
@@ -1417,6 +1788,7 @@ void mdcache_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->merge = mdcache_merge;
 	ops->lookup = mdcache_lookup;
 	ops->readdir = mdcache_readdir;
+	ops->readdir_batch = mdcache_readdir_batch;
 	ops->mkdir = mdcache_mkdir;
 	ops->mknode = mdcache_mknode;
 	ops->symlink = mdcache_symlink;
@@ -1436,6 +1808,8 @@ void mdcache_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->layoutget = mdcache_layoutget;
 	ops->layoutreturn = mdcache_layoutreturn;
 	ops->layoutcommit = mdcache_layoutcommit;
+	ops->layoutstats = mdcache_layoutstats;
+	ops->layouterror = mdcache_layouterror;
 
 	/* Multi-FD */
 	ops->open2 = mdcache_open2;
@@ -1452,6 +1826,8 @@ void mdcache_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->setattr2 = mdcache_setattr2;
 	ops->close2 = mdcache_close2;
 	ops->fallocate = mdcache_fallocate;
+	ops->copy = mdcache_copy;
+	ops->clone2 = mdcache_clone2;
 
 	/* xattr related functions */
 	ops->list_ext_attrs = mdcache_list_ext_attrs;
@@ -1575,10 +1951,9 @@ fsal_status_t mdcache_create_handle(struct fsal_export *exp_hdl,
 	if (FSAL_IS_ERROR(status))
 		return status;
 
-	/* Make sure this entry has a parent pointer */
-	PTHREAD_RWLOCK_wrlock(&entry->content_lock);
-	mdc_get_parent(export, entry);
-	PTHREAD_RWLOCK_unlock(&entry->content_lock);
+	/* The parent pointer, if not known yet, is looked up when ".." is
+	 * first asked for, rather than for every handle a client puts.
+	 */
 
 	if (attrs_out != NULL) {
 		LogAttrlist(COMPONENT_CACHE_INODE, NIV_FULL_DEBUG,
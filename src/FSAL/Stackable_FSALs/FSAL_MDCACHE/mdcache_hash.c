@@ -63,6 +63,89 @@
 struct cih_lookup_table cih_fhcache;
 static bool initialized;
 
+/* Threads keep pointing at their slot, so these outlive the package */
+static struct cih_hazard cih_hazards[CIH_HAZARD_SLOTS];
+static pthread_once_t cih_hazard_once = PTHREAD_ONCE_INIT;
+static pthread_key_t cih_hazard_key;
+__thread struct cih_hazard *cih_my_hazard;
+static __thread bool cih_no_hazard;
+
+/**
+ * @brief Give back a thread's hazard slot when it exits
+ */
+static void cih_hazard_release(void *arg)
+{
+	struct cih_hazard *hp = arg;
+
+	atomic_store_voidptr(&hp->entry, NULL);
+	atomic_store_uint32_t(&hp->busy, 0);
+}
+
+static void cih_hazard_init(void)
+{
+	if (pthread_key_create(&cih_hazard_key, cih_hazard_release) != 0)
+		LogFatal(COMPONENT_CACHE_INODE,
+			 "Could not create hazard slot key");
+}
+
+/**
+ * @brief Claim a hazard slot for the calling thread
+ *
+ * @return The slot, or NULL if they are all taken.  A thread that
+ *         finds none doesn't try again.
+ */
+struct cih_hazard *cih_hazard_claim(void)
+{
+	struct cih_hazard *hp;
+	uint32_t ix, hw;
+
+	if (cih_no_hazard || !initialized)
+		return NULL;
+
+	for (ix = 0; ix < CIH_HAZARD_SLOTS; ++ix) {
+		hp = &cih_hazards[ix];
+		if (atomic_fetch_uint32_t(&hp->busy) != 0 ||
+		    !__sync_bool_compare_and_swap(&hp->busy, 0, 1))
+			continue;
+
+		/* Removers must scan this slot before we use it */
+		hw = atomic_fetch_uint32_t(&cih_fhcache.nhazard);
+		while (hw <= ix &&
+		       !__sync_bool_compare_and_swap(&cih_fhcache.nhazard,
+						     hw, ix + 1))
+			hw = atomic_fetch_uint32_t(&cih_fhcache.nhazard);
+
+		(void) pthread_setspecific(cih_hazard_key, hp);
+		cih_my_hazard = hp;
+		return hp;
+	}
+
+	LogDebug(COMPONENT_HASHTABLE_CACHE,
+		 "No hazard slot left, using locked lookups");
+	cih_no_hazard = true;
+	return NULL;
+}
+
+/**
+ * @brief Wait until no lockless reader is looking at an entry
+ *
+ * Readers only hold their slot for a few instructions and never block
+ * while doing so, so spinning is fine.
+ *
+ * @param[in] entry The entry being unhashed
+ */
+void cih_hazard_wait(void *entry)
+{
+	uint32_t n = atomic_fetch_uint32_t(&cih_fhcache.nhazard);
+	uint32_t ix;
+
+	for (ix = 0; ix < n; ++ix) {
+		while (atomic_fetch_voidptr(&cih_hazards[ix].entry) ==
+		       entry)
+			;
+	}
+}
+
 /**
  * @brief Initialize the package.
  */
@@ -95,6 +178,7 @@ cih_pkginit(void)
 			gsh_calloc(cih_fhcache.cache_sz,
 				sizeof(struct avltree_node *));
 	}
+	(void) pthread_once(&cih_hazard_once, cih_hazard_init);
 	initialized = true;
 }
 
@@ -121,4 +205,194 @@ cih_pkgdestroy(void)
 	initialized = false;
 }
 
+/* Open addressed index of mdcache_key_prefixes, by hash of the prefix */
+#define MDCACHE_KEY_PREFIX_SLOTS 512
+
+uint8_t mdcache_key_prefixes[MDCACHE_KEY_PREFIXES + 1][MDCACHE_KEY_PREFIX_LEN];
+static uint8_t key_prefix_slots[MDCACHE_KEY_PREFIX_SLOTS];
+static pthread_mutex_t key_prefix_mtx = PTHREAD_MUTEX_INITIALIZER;
+struct mdcache_key_stats mdcache_key_st;
+
+/**
+ * @brief Find the slot of a prefix
+ *
+ * @param[in]  head  The prefix
+ * @param[out] slot  Its slot, or the empty one ending the probe
+ *
+ * @return Number of the prefix, 0 if not interned.
+ */
+static uint8_t key_prefix_find(const uint8_t *head, uint32_t *slot)
+{
+	uint32_t h = CityHash64((const char *) head, MDCACHE_KEY_PREFIX_LEN);
+	uint32_t i;
+	uint8_t id;
+
+	for (i = 0; ; i++) {
+		*slot = (h + i) & (MDCACHE_KEY_PREFIX_SLOTS - 1);
+		id = atomic_fetch_uint8_t(&key_prefix_slots[*slot]);
+		if (id == 0 ||
+		    memcmp(mdcache_key_prefixes[id], head,
+			   MDCACHE_KEY_PREFIX_LEN) == 0)
+			return id;
+	}
+}
+
+/**
+ * @brief Intern the prefix of a handle
+ *
+ * Lookups take no lock, the prefixes are written before their slot and
+ * never change.  Once all are taken, no more prefixes are interned; an
+ * FSAL whose handles don't share their start just uses a few.
+ *
+ * @param[in] head  Start of the handle
+ *
+ * @return Number of the prefix, 0 if it could not be interned.
+ */
+static uint8_t key_prefix_intern(const uint8_t *head)
+{
+	uint32_t slot;
+	uint8_t id = key_prefix_find(head, &slot);
+
+	if (id != 0 ||
+	    atomic_fetch_uint32_t(&mdcache_key_st.prefixes) >=
+	    MDCACHE_KEY_PREFIXES)
+		return id;
+
+	PTHREAD_MUTEX_lock(&key_prefix_mtx);
+
+	/* Someone may have beaten us to it */
+	id = key_prefix_find(head, &slot);
+	if (id == 0 && mdcache_key_st.prefixes < MDCACHE_KEY_PREFIXES) {
+		id = mdcache_key_st.prefixes + 1;
+		memcpy(mdcache_key_prefixes[id], head, MDCACHE_KEY_PREFIX_LEN);
+		atomic_store_uint8_t(&key_prefix_slots[slot], id);
+		atomic_store_uint32_t(&mdcache_key_st.prefixes, id);
+	}
+
+	PTHREAD_MUTEX_unlock(&key_prefix_mtx);
+
+	return id;
+}
+
+/**
+ * @brief Set the bytes of a key after its prefix
+ *
+ * @param[in,out] key   The key, prefix set
+ * @param[in]     addr  The bytes
+ * @param[in]     len   Their length
+ */
+static void key_set_kv(mdcache_key_t *key, const void *addr, size_t len)
+{
+	key->kv.len = len;
+
+	if (len <= MDCACHE_KEY_INLINE) {
+		key->kv.addr = key->kv_inline;
+		(void) atomic_inc_uint64_t(&mdcache_key_st.inlined);
+	} else {
+		key->kv.addr = gsh_malloc(len);
+		(void) atomic_inc_uint64_t(&mdcache_key_st.allocated);
+		(void) atomic_add_uint64_t(&mdcache_key_st.allocated_bytes,
+					   len);
+	}
+
+	memcpy(key->kv.addr, addr, len);
+
+	if (key->prefix != 0)
+		(void) atomic_inc_uint64_t(&mdcache_key_st.prefixed);
+}
+
+/**
+ * @brief Keep a copy of a handle in a key
+ *
+ * A handle too long to be inlined whole has its prefix interned, so
+ * that only the rest is kept, inlined if it fits.
+ *
+ * @param[out] key   The key
+ * @param[in]  addr  The handle
+ * @param[in]  len   Its length
+ */
+void mdcache_key_store(mdcache_key_t *key, const void *addr, size_t len)
+{
+	key->prefix = 0;
+
+	if (len > MDCACHE_KEY_INLINE && len > MDCACHE_KEY_PREFIX_LEN)
+		key->prefix = key_prefix_intern(addr);
+
+	if (key->prefix != 0)
+		key_set_kv(key, (const uint8_t *) addr +
+				MDCACHE_KEY_PREFIX_LEN,
+			   len - MDCACHE_KEY_PREFIX_LEN);
+	else
+		key_set_kv(key, addr, len);
+}
+
+/**
+ * @brief Dup a cache key.
+ *
+ * Deep copies the key passed in src, to tgt, sharing its prefix.
+ *
+ * @param tgt [inout] Destination of copy
+ * @param src [in] Source of copy
+ */
+void mdcache_key_dup(mdcache_key_t *tgt, mdcache_key_t *src)
+{
+	if (src->prefix != 0) {
+		tgt->prefix = src->prefix;
+		key_set_kv(tgt, src->kv.addr, src->kv.len);
+	} else {
+		mdcache_key_store(tgt, src->kv.addr, src->kv.len);
+	}
+
+	tgt->hk = src->hk;
+	tgt->fsal = src->fsal;
+}
+
+/**
+ * @brief Delete a cache key.
+ *
+ * Delete a cache key. Safe to call even if key was not allocated.
+ *
+ * @param key [in] The key to delete
+ */
+void mdcache_key_delete(mdcache_key_t *key)
+{
+	if (key->kv.addr == NULL)
+		return;
+
+	if (key->kv.addr == key->kv_inline) {
+		(void) atomic_dec_uint64_t(&mdcache_key_st.inlined);
+	} else {
+		(void) atomic_dec_uint64_t(&mdcache_key_st.allocated);
+		(void) atomic_sub_uint64_t(&mdcache_key_st.allocated_bytes,
+					   key->kv.len);
+		gsh_free(key->kv.addr);
+	}
+
+	if (key->prefix != 0)
+		(void) atomic_dec_uint64_t(&mdcache_key_st.prefixed);
+
+	key->kv.len = 0;
+	key->kv.addr = NULL;
+	key->prefix = 0;
+}
+
+/**
+ * @brief Copy the whole handle of a key
+ *
+ * @param[in]  key  The key
+ * @param[out] buf  Room for mdcache_key_len() bytes
+ */
+void mdcache_key_bytes(const mdcache_key_t *key, void *buf)
+{
+	uint8_t *p = buf;
+
+	if (key->prefix != 0) {
+		memcpy(p, mdcache_key_prefixes[key->prefix],
+		       MDCACHE_KEY_PREFIX_LEN);
+		p += MDCACHE_KEY_PREFIX_LEN;
+	}
+
+	memcpy(p, key->kv.addr, key->kv.len);
+}
+
 /** @} */
@@ -39,6 +39,14 @@
  * This module exports an interface for efficient lookup of cache entries
  * by file handle, (etc?).  Refactored from the prior abstract HashTable
  * implementation.
+ *
+ * Lookups that hit the per-partition cache slot can go without the
+ * partition lock; see cih_get_by_key_lockless().  Removal from a
+ * partition bumps its generation and then waits for any lockless
+ * reader that announced the entry in its hazard slot, before the
+ * sentinel reference is dropped.  So a lockless reader that saw the
+ * generation unchanged after announcing itself may safely look at the
+ * entry and try to reference it.
  */
 
 #ifndef CACHE_INODE_HASH_H
@@ -65,6 +73,7 @@
 typedef struct cih_partition {
 	uint32_t part_ix;
 	pthread_rwlock_t lock;
+	uint64_t gen;		/*< Bumped on every removal */
 	struct avltree t;
 	struct avltree_node **cache;
 #ifdef ENABLE_LOCKTRACE
@@ -76,6 +85,18 @@ typedef struct cih_partition {
 	GSH_CACHE_PAD(0);
 } cih_partition_t;
 
+/**
+ * @brief Hazard slot of a thread doing lockless lookups
+ */
+struct cih_hazard {
+	void *entry;		/*< Entry being looked at, or NULL */
+	uint32_t busy;		/*< Slot owned by a thread */
+	GSH_CACHE_PAD(0);
+};
+
+/** Threads beyond this many just take the partition lock */
+#define CIH_HAZARD_SLOTS 1024
+
 /**
  * @brief The weakref table structure
  *
@@ -86,10 +107,28 @@ struct cih_lookup_table {
 	cih_partition_t *partition;
 	uint32_t npart;
 	uint32_t cache_sz;
+	uint32_t nhazard;	/*< High water mark of claimed slots */
 };
 
 /* Support inline lookups */
 extern struct cih_lookup_table cih_fhcache;
+extern __thread struct cih_hazard *cih_my_hazard;
+
+struct cih_hazard *cih_hazard_claim(void);
+void cih_hazard_wait(void *entry);
+
+/**
+ * @brief Get this thread's hazard slot
+ *
+ * @return The slot, or NULL if none could be had.
+ */
+static inline struct cih_hazard *cih_hazard_get(void)
+{
+	if (likely(cih_my_hazard != NULL))
+		return cih_my_hazard;
+
+	return cih_hazard_claim();
+}
 
 /**
  * @brief Initialize the package.
@@ -203,11 +242,9 @@ cih_hash_key(mdcache_key_t *key,
 	/* fh prototype fixup */
 	if (flags & CIH_HASH_KEY_PROTOTYPE) {
 		key->kv = *fh_desc;
+		key->prefix = 0;
 	} else {
-		/* XXX dups fh_desc */
-		key->kv.len = fh_desc->len;
-		key->kv.addr = gsh_malloc(fh_desc->len);
-		memcpy(key->kv.addr, fh_desc->addr, fh_desc->len);
+		mdcache_key_store(key, fh_desc->addr, fh_desc->len);
 	}
 
 	/* hash it */
@@ -270,29 +307,20 @@ cih_latch_entry(mdcache_key_t *key, cih_latch_t *latch, uint32_t flags,
 }
 
 /**
- * @brief Lookup cache entry by key
- *
- * Lookup cache entry by fh, optionally return with hash partition shared
- * or exclusive locked.  Differs from the fh variant in using the precomputed
- * hash stored with key.
+ * @brief Lookup cache entry by key in a latched partition
  *
  * @param key [in] Key being searched
- * @param latch [out] Pointer to partition
- * @param flags [in] Flags
+ * @param latch [in] Latch on the partition of key, held
  *
  * @return Pointer to cache entry if found, else NULL
  */
 static inline mdcache_entry_t *
-cih_get_by_key_latch(mdcache_key_t *key, cih_latch_t *latch,
-		       uint32_t flags, const char *func, int line)
+cih_lookup_latched(mdcache_key_t *key, cih_latch_t *latch)
 {
-	mdcache_entry_t k_entry, *entry = NULL;
+	mdcache_entry_t k_entry;
 	struct avltree_node *node;
 	void **cache_slot;
 
-	if (!cih_latch_entry(key, latch, flags, func, line))
-		return NULL;
-
 	k_entry.fh_hk.key = *key;
 
 	/* check cache */
@@ -312,10 +340,8 @@ cih_get_by_key_latch(mdcache_key_t *key, cih_latch_t *latch,
 	/* check AVL */
 	node = cih_fhcache_inline_lookup(&latch->cp->t, &k_entry.fh_hk.node_k);
 	if (!node) {
-		if (flags & CIH_GET_UNLOCK_ON_MISS)
-			cih_hash_release(latch);
 		LogDebug(COMPONENT_HASHTABLE_CACHE, "fdcache MISS");
-		goto out;
+		return NULL;
 	}
 
 	/* update cache */
@@ -325,9 +351,123 @@ cih_get_by_key_latch(mdcache_key_t *key, cih_latch_t *latch,
 		 cih_cache_offsetof(&cih_fhcache, key->hk));
 
  found:
+	return avltree_container_of(node, mdcache_entry_t, fh_hk.node_k);
+}
+
+/**
+ * @brief Lookup cache entry by key
+ *
+ * Lookup cache entry by fh, optionally return with hash partition shared
+ * or exclusive locked.  Differs from the fh variant in using the precomputed
+ * hash stored with key.
+ *
+ * @param key [in] Key being searched
+ * @param latch [out] Pointer to partition
+ * @param flags [in] Flags
+ *
+ * @return Pointer to cache entry if found, else NULL
+ */
+static inline mdcache_entry_t *
+cih_get_by_key_latch(mdcache_key_t *key, cih_latch_t *latch,
+		       uint32_t flags, const char *func, int line)
+{
+	mdcache_entry_t *entry;
+
+	if (!cih_latch_entry(key, latch, flags, func, line))
+		return NULL;
+
+	entry = cih_lookup_latched(key, latch);
+	if (!entry && (flags & CIH_GET_UNLOCK_ON_MISS))
+		cih_hash_release(latch);
+
+	return entry;
+}
+
+/**
+ * @brief Lookup cache entry by key without the partition lock
+ *
+ * Only the partition's cache slot is consulted; anything else, or any
+ * race with a removal, returns NULL and the caller should retry with
+ * cih_get_by_key_latch().  A found entry is returned with a plain
+ * reference taken, as if referenced under the latch.
+ *
+ * @param key [in] Key being searched
+ *
+ * @return Referenced entry, or NULL.
+ */
+static inline mdcache_entry_t *
+cih_get_by_key_lockless(mdcache_key_t *key)
+{
+	cih_partition_t *cp = cih_partition_of_scalar(&cih_fhcache, key->hk);
+	struct cih_hazard *hp = cih_hazard_get();
+	mdcache_entry_t k_entry, *entry;
+	struct avltree_node *node;
+	uint64_t gen;
+	int32_t refcnt, old;
+
+	if (unlikely(hp == NULL))
+		return NULL;
+
+	gen = atomic_fetch_uint64_t(&cp->gen);
+	node = atomic_fetch_voidptr((void **)
+		&cp->cache[cih_cache_offsetof(&cih_fhcache, key->hk)]);
+	if (node == NULL)
+		return NULL;
+
 	entry = avltree_container_of(node, mdcache_entry_t, fh_hk.node_k);
- out:
+	atomic_store_voidptr(&hp->entry, entry);
+
+	/* Nothing was removed since the slot was read, so the entry is
+	 * still hashed, and whoever removes it has to wait for us.
+	 */
+	if (atomic_fetch_uint64_t(&cp->gen) != gen)
+		goto fail;
+
+	k_entry.fh_hk.key = *key;
+	if (cih_fh_cmpf(&k_entry.fh_hk.node_k, node) != 0)
+		goto fail;
+
+	refcnt = atomic_fetch_int32_t(&entry->lru.refcnt);
+	do {
+		if (refcnt <= 0)
+			goto fail;
+		old = refcnt;
+		refcnt = __sync_val_compare_and_swap(&entry->lru.refcnt,
+						     old, old + 1);
+	} while (refcnt != old);
+
+	if (unlikely(atomic_fetch_uint64_t(&cp->gen) != gen)) {
+		/* Something in the partition was removed meanwhile.  If it
+		 * was this entry, the remover still holds the sentinel ref
+		 * while it waits for us, so this can't drop to zero.
+		 */
+		(void) atomic_dec_int32_t(&entry->lru.refcnt);
+		goto fail;
+	}
+
+	atomic_store_voidptr(&hp->entry, NULL);
+
+	LogDebug(COMPONENT_HASHTABLE_CACHE, "cih lockless hit slot %d",
+		 cih_cache_offsetof(&cih_fhcache, key->hk));
+
 	return entry;
+
+ fail:
+	atomic_store_voidptr(&hp->entry, NULL);
+	return NULL;
+}
+
+/**
+ * @brief Unpublish an entry before dropping its sentinel ref
+ *
+ * Called with the partition write locked, after the entry has left the
+ * tree and the cache slot.
+ */
+static inline void
+cih_unpublish(cih_partition_t *cp, mdcache_entry_t *entry)
+{
+	(void) atomic_inc_uint64_t(&cp->gen);
+	cih_hazard_wait(entry);
 }
 
 #define CIH_SET_NONE     0x0000
@@ -399,9 +539,11 @@ cih_remove_checked(mdcache_entry_t *entry)
 			   &entry->obj_handle, entry->lru.refcnt);
 #endif
 		avltree_remove(node, &cp->t);
-		cp->cache[cih_cache_offsetof(&cih_fhcache,
-					     entry->fh_hk.key.hk)] = NULL;
+		atomic_store_voidptr((void **)&cp->cache[
+			cih_cache_offsetof(&cih_fhcache, entry->fh_hk.key.hk)],
+			NULL);
 		entry->fh_hk.inavl = false;
+		cih_unpublish(cp, entry);
 		/* return sentinel ref */
 		freed = mdcache_lru_unref(entry);
 	}
@@ -436,9 +578,11 @@ cih_remove_latched(mdcache_entry_t *entry, cih_latch_t *latch, uint32_t flags)
 			   &entry->obj_handle, entry->lru.refcnt);
 #endif
 		avltree_remove(&entry->fh_hk.node_k, &cp->t);
-		cp->cache[cih_cache_offsetof(&cih_fhcache,
-					     entry->fh_hk.key.hk)] = NULL;
+		atomic_store_voidptr((void **)&cp->cache[
+			cih_cache_offsetof(&cih_fhcache, entry->fh_hk.key.hk)],
+			NULL);
 		entry->fh_hk.inavl = false;
+		cih_unpublish(cp, entry);
 		mdcache_lru_unref(entry);
 		if (flags & CIH_REMOVE_UNLOCK)
 			cih_hash_release(latch);
@@ -45,10 +45,13 @@
 #include <stdbool.h>
 
 #include "nfs_exports.h"
+#include "export_mgr.h"
+#include "fridgethr.h"
 
 #include "mdcache_lru.h"
 #include "mdcache_hash.h"
 #include "mdcache_avl.h"
+#include "city.h"
 #ifdef USE_LTTNG
 #include "gsh_lttng/mdcache.h"
 #endif
@@ -56,10 +59,24 @@
 #define mdc_chunk_first_dirent(c) \
 	glist_first_entry(&(c)->dirents, mdcache_dir_entry_t, chunk_list)
 
+/**
+ * @brief Check if the export of the request is Immutable
+ *
+ * Nothing changes behind the cache of an Immutable export until the
+ * export is invalidated or updated, so what is cached of it never
+ * expires.
+ */
+bool mdc_export_immutable(void)
+{
+	return op_ctx != NULL && op_ctx->ctx_export != NULL &&
+	       op_ctx_export_has_option(EXPORT_OPTION_IMMUTABLE);
+}
+
 static inline bool trust_negative_cache(mdcache_entry_t *parent)
 {
 	bool trust = op_ctx_export_has_option(
-				  EXPORT_OPTION_TRUST_READIR_NEGATIVE_CACHE) &&
+				  EXPORT_OPTION_TRUST_READIR_NEGATIVE_CACHE |
+				  EXPORT_OPTION_IMMUTABLE) &&
 		test_mde_flags(parent, MDCACHE_DIR_POPULATED);
 
 	if (trust)
@@ -247,7 +264,7 @@ void mdc_clean_entry(mdcache_entry_t *entry)
 	}
 
 	/* Clear out first_export */
-	atomic_store_int32_t(&entry->first_export_id, -1);
+	mdc_set_first_export(entry, -1);
 
 	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
 
@@ -349,7 +366,7 @@ again:
 
 	/* If export_list is empty, store this export as first */
 	if (glist_empty(&entry->export_list)) {
-		atomic_store_int32_t(&entry->first_export_id,
+		mdc_set_first_export(entry,
 				     (int32_t) op_ctx->ctx_export->export_id);
 	}
 
@@ -457,6 +474,9 @@ void mdcache_clean_dirent_chunk(struct dir_chunk *chunk)
 	/* Remove chunk from directory. */
 	glist_del(&chunk->chunks);
 
+	/* Its block goes with the last dirent carved from it */
+	mdcache_chunk_block_release(chunk);
+
 	/* At this point the following is true about the chunk:
 	 *
 	 * chunks is {NULL, NULL} do to the glist_del
@@ -524,136 +544,77 @@ void mdcache_dirent_invalidate_all(mdcache_entry_t *entry)
 }
 
 /**
- * @brief Adds a new entry to the cache
+ * @brief Take the entry that won the race to be added
  *
- * This function adds a new entry to the cache.  It will allocate
- * entries of any kind.
+ * @note The partition of the entry MUST be latched
  *
- * The caller is responsible for releasing attrs_in, however, the references
- * will have been transferred to the new mdcache entry. fsal_copy_attrs leaves
- * the state of the source attributes still safe to call fsal_release_attrs,
- * so all will be well.
+ * @param[in] oentry     Entry already in the cache
+ * @param[in] sub_handle Handle the caller was adding
  *
- * @param[in]     export         Export for this cache
- * @param[in]     sub_handle     Handle for sub-FSAL
- * @param[in]     attrs_in       Attributes provided for the object
- * @param[in,out] attrs_out      Attributes requested for the object
- * @param[in]     new_directory  Indicate a new directory was created
- * @param[out]    entry          Newly instantiated cache entry
- * @param[in]     state          Optional state_t representing open file.
- *
- * @note This returns an INITIAL ref'd entry on success
- *
- * @return FSAL status
+ * @return FSAL status of taking the INITIAL ref.
  */
-fsal_status_t
-mdcache_new_entry(struct mdcache_fsal_export *export,
-		  struct fsal_obj_handle *sub_handle,
-		  struct attrlist *attrs_in,
-		  struct attrlist *attrs_out,
-		  bool new_directory,
-		  mdcache_entry_t **entry,
-		  struct state_t *state,
-		  mdc_reason_t reason)
+static fsal_status_t mdc_new_entry_raced(mdcache_entry_t *oentry,
+					 struct fsal_obj_handle *sub_handle)
 {
 	fsal_status_t status;
-	mdcache_entry_t *oentry, *nentry = NULL;
-	struct gsh_buffdesc fh_desc;
-	cih_latch_t latch;
-	bool has_hashkey = false;
-	int rc = 0;
-	mdcache_key_t key;
-
-	*entry = NULL;
 
-	/* Get FSAL-specific key */
-	subcall_raw(export,
-		    sub_handle->obj_ops->handle_to_key(sub_handle, &fh_desc)
-		   );
+	/* Entry is already in the cache, do not add it. */
+	LogDebug(COMPONENT_CACHE_INODE,
+		 "lost race to add entry %p type: %d, New type: %d",
+		 oentry, oentry->obj_handle.type, sub_handle->type);
 
-	(void) cih_hash_key(&key, export->mfe_exp.sub_export->fsal, &fh_desc,
-			    CIH_HASH_KEY_PROTOTYPE);
-
-	/* Check if the entry already exists.  We allow the following race
-	 * because mdcache_lru_get has a slow path, and the latch is a
-	 * shared lock. */
-	status = mdcache_find_keyed(&key, entry);
+	/* Ref it */
+	status = mdcache_lru_ref(oentry, LRU_REQ_INITIAL);
 	if (!FSAL_IS_ERROR(status)) {
-		LogDebug(COMPONENT_CACHE_INODE,
-			 "Trying to add an already existing entry. Found entry %p type: %d, New type: %d",
-			 *entry, (*entry)->obj_handle.type, sub_handle->type);
-
-		/* If it was unreachable before, mark it reachable */
-		atomic_clear_uint32_t_bits(&(*entry)->mde_flags,
-					 MDCACHE_UNREACHABLE);
-
-		/* Don't need a new sub_handle ref */
-		goto out_no_new_entry_yet;
-	} else if (status.major != ERR_FSAL_NOENT) {
-		/* Real error , don't need a new sub_handle ref */
-		goto out_no_new_entry_yet;
-	}
-
-	/* !LATCHED */
-
-	/* We did not find the object.  Pull an entry off the LRU. The entry
-	 * will already be mapped.
-	 */
-	nentry = mdcache_alloc_handle(export, sub_handle, sub_handle->fs,
-				      reason);
-
-	if (nentry == NULL) {
-		/* We didn't get an entry because of unexport in progress,
-		 * go ahead and bail out now.
+		/* We used to return ERR_FSAL_EXIST but all callers
+		 * just converted that to ERR_FSAL_NO_ERROR, so
+		 * leave the status alone.
 		 */
-		status = fsalstat(ERR_FSAL_STALE, 0);
-		goto out_no_new_entry_yet;
+		(void)atomic_inc_uint64_t(&cache_stp->inode_conf);
 	}
 
-	/* See if someone raced us. */
-	oentry = cih_get_by_key_latch(&key, &latch, CIH_GET_WLOCK, __func__,
-					__LINE__);
-	if (oentry) {
-		/* Entry is already in the cache, do not add it. */
-		LogDebug(COMPONENT_CACHE_INODE,
-			 "lost race to add entry %p type: %d, New type: %d",
-			 oentry, oentry->obj_handle.type, sub_handle->type);
-		*entry = oentry;
-
-		/* Ref it */
-		status = mdcache_lru_ref(*entry, LRU_REQ_INITIAL);
-		if (!FSAL_IS_ERROR(status)) {
-			/* We used to return ERR_FSAL_EXIST but all callers
-			 * just converted that to ERR_FSAL_NO_ERROR, so
-			 * leave the status alone.
-			 */
-			(void)atomic_inc_uint64_t(&cache_stp->inode_conf);
-		}
+	/* It it was unreachable before, mark it reachable */
+	atomic_clear_uint32_t_bits(&oentry->mde_flags, MDCACHE_UNREACHABLE);
 
-		/* It it was unreachable before, mark it reachable */
-		atomic_clear_uint32_t_bits(&(*entry)->mde_flags,
-					 MDCACHE_UNREACHABLE);
-
-		/* Release the subtree hash table lock */
-		cih_hash_release(&latch);
-
-		goto out_release_new_entry;
-	}
+	return status;
+}
 
-	/* We won the race. */
+/**
+ * @brief Set up a new entry and hash it
+ *
+ * @note The partition of the entry MUST be write latched, and stays so
+ *
+ * @param[in]     export         Export for this cache
+ * @param[in]     nentry         Entry from mdcache_alloc_handle
+ * @param[in]     fh_desc        Key of the sub-FSAL handle
+ * @param[in]     attrs_in       Attributes provided for the object
+ * @param[in,out] attrs_out      Attributes requested for the object
+ * @param[in]     new_directory  Indicate a new directory was created
+ * @param[in]     latch          Latch on the partition
+ *
+ * @return FSAL status
+ */
+static fsal_status_t mdc_new_entry_insert(struct mdcache_fsal_export *export,
+					  mdcache_entry_t *nentry,
+					  struct gsh_buffdesc *fh_desc,
+					  struct attrlist *attrs_in,
+					  struct attrlist *attrs_out,
+					  bool new_directory,
+					  cih_latch_t *latch)
+{
+	bool has_hashkey = false;
+	int rc = 0;
 
 	/* Set cache key */
 
 	has_hashkey = cih_hash_key(&nentry->fh_hk.key,
 				   export->mfe_exp.sub_export->fsal,
-				   &fh_desc, CIH_HASH_NONE);
+				   fh_desc, CIH_HASH_NONE);
 
 	if (!has_hashkey) {
-		cih_hash_release(&latch);
 		LogCrit(COMPONENT_CACHE_INODE,
 			"Could not hash new entry");
-		status = fsalstat(ERR_FSAL_NOMEM, 0);
-		goto out_release_new_entry;
+		return fsalstat(ERR_FSAL_NOMEM, 0);
 	}
 
 	switch (nentry->obj_handle.type) {
@@ -699,11 +660,9 @@ mdcache_new_entry(struct mdcache_fsal_export *export,
 
 	default:
 		/* Should never happen */
-		cih_hash_release(&latch);
-		status = fsalstat(ERR_FSAL_INVAL, 0);
 		LogMajor(COMPONENT_CACHE_INODE, "unknown type %u provided",
 			 nentry->obj_handle.type);
-		goto out_release_new_entry;
+		return fsalstat(ERR_FSAL_INVAL, 0);
 	}
 
 	/* nentry not reachable yet; no need to lock */
@@ -728,24 +687,35 @@ mdcache_new_entry(struct mdcache_fsal_export *export,
 
 	/* Validate the attributes we just set. */
 	mdc_fixup_md(nentry, &nentry->attrs);
+	mdcache_lru_account_entry(nentry);
 
 	/* Hash and insert entry, after this would need attr_lock to
 	 * access attributes.
 	 */
-	rc = cih_set_latched(nentry, &latch,
-			     op_ctx->fsal_export->fsal, &fh_desc,
-			     CIH_SET_UNLOCK | CIH_SET_HASHED);
+	rc = cih_set_latched(nentry, latch,
+			     op_ctx->fsal_export->fsal, fh_desc,
+			     CIH_SET_HASHED);
 	if (unlikely(rc)) {
 		LogCrit(COMPONENT_CACHE_INODE,
 			"entry could not be added to hash, rc=%d", rc);
-		status = fsalstat(ERR_FSAL_NOMEM, 0);
 		if (attrs_out != NULL) {
 			/* Release the attrs we just copied. */
 			fsal_release_attrs(attrs_out);
 		}
-		goto out_release_new_entry;
+		return fsalstat(ERR_FSAL_NOMEM, 0);
 	}
 
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Put a new entry, now hashed, on the LRU
+ *
+ * @param[in] nentry The entry
+ * @param[in] reason Reason it was created
+ */
+static void mdc_new_entry_added(mdcache_entry_t *nentry, mdc_reason_t reason)
+{
 	if (isFullDebug(COMPONENT_CACHE_INODE)) {
 		char str[LOG_BUFF_LEN] = "\0";
 		struct display_buffer dspbuf = {sizeof(str), str, str };
@@ -759,23 +729,45 @@ mdcache_new_entry(struct mdcache_fsal_export *export,
 		LogDebug(COMPONENT_CACHE_INODE, "New entry %p added", nentry);
 	}
 	mdcache_lru_insert(nentry, reason);
-	*entry = nentry;
 	(void)atomic_inc_uint64_t(&cache_stp->inode_added);
-	return fsalstat(ERR_FSAL_NO_ERROR, 0);
-
- out_release_new_entry:
+}
 
-	/* We raced or failed, release the new entry we acquired, this will
-	 * result in inline deconstruction. This will release the attributes, we
-	 * may not have copied yet, in which case mask and acl are 0/NULL.  This
-	 * entry is not yet in the hash or LRU, so just put it's sentinal ref.
-	 */
+/**
+ * @brief Drop a new entry that was not added
+ *
+ * This will result in inline deconstruction.  It releases the
+ * attributes, which may not have been copied yet, in which case mask
+ * and acl are 0/NULL.  The entry is not in the hash or LRU, so just
+ * put its sentinel ref.  The sub-FSAL handle is left to the caller.
+ *
+ * @param[in] nentry The entry
+ */
+static void mdc_new_entry_drop(mdcache_entry_t *nentry)
+{
 	nentry->sub_handle = NULL;
 	mdcache_put(nentry);
 	mdcache_put(nentry);
+}
 
- out_no_new_entry_yet:
-
+/**
+ * @brief Finish adding an object that was already cached, or failed
+ *
+ * @param[in]     export         Export for this cache
+ * @param[in]     sub_handle     Handle for sub-FSAL, released here
+ * @param[in,out] attrs_out      Attributes requested for the object
+ * @param[in,out] entry          Entry found, set to NULL on failure
+ * @param[in]     state          Optional state_t representing open file.
+ * @param[in]     status         Status so far
+ *
+ * @return FSAL status
+ */
+static fsal_status_t mdc_new_entry_finish(struct mdcache_fsal_export *export,
+					  struct fsal_obj_handle *sub_handle,
+					  struct attrlist *attrs_out,
+					  mdcache_entry_t **entry,
+					  struct state_t *state,
+					  fsal_status_t status)
+{
 	/* If attributes were requested, fetch them now if we still have a
 	 * success return since we did not actually create a new object and
 	 * use the provided attributes (we can't trust that the provided
@@ -797,64 +789,350 @@ mdcache_new_entry(struct mdcache_fsal_export *export,
 		}
 	}
 
-	if (!FSAL_IS_ERROR(status)) {
-		/* Give the FSAL a chance to merge new_obj into
-		 * oentry->obj_handle since we will be using
-		 * oentry->obj_handle for all access to the oject.
-		 */
-		struct fsal_obj_handle *old_sub_handle = (*entry)->sub_handle;
+	if (!FSAL_IS_ERROR(status)) {
+		/* Give the FSAL a chance to merge new_obj into
+		 * oentry->obj_handle since we will be using
+		 * oentry->obj_handle for all access to the oject.
+		 */
+		struct fsal_obj_handle *old_sub_handle = (*entry)->sub_handle;
+
+		subcall_raw(export,
+			    status =
+			    old_sub_handle->obj_ops->merge(old_sub_handle,
+							  sub_handle)
+			   );
+
+		if (FSAL_IS_ERROR(status)) {
+			/* Report this error and unref the entry */
+			LogDebug(COMPONENT_CACHE_INODE,
+				 "Merge of object handles after race returned %s",
+				 fsal_err_txt(status));
+
+			mdcache_put(*entry);
+			*entry = NULL;
+		}
+	}
+
+	if (FSAL_IS_ERROR(status) && state != NULL) {
+		/* Our caller passed in a state for an open file, since
+		 * there is not a valid entry to use, or a merge failed
+		 * we must close that file before disposing of new_obj.
+		 */
+		fsal_status_t cstatus;
+
+		subcall_raw(export,
+			    cstatus = sub_handle->obj_ops->close2(sub_handle,
+								 state)
+			   );
+
+		LogDebug(COMPONENT_CACHE_INODE,
+			 "Close of state during error processing returned %s",
+			 fsal_err_txt(cstatus));
+	}
+
+	/* must free sub_handle if no new entry was created to reference it. */
+	subcall_raw(export,
+		    sub_handle->obj_ops->release(sub_handle)
+		   );
+
+	return status;
+}
+
+/**
+ * @brief Adds a new entry to the cache
+ *
+ * This function adds a new entry to the cache.  It will allocate
+ * entries of any kind.
+ *
+ * The caller is responsible for releasing attrs_in, however, the references
+ * will have been transferred to the new mdcache entry. fsal_copy_attrs leaves
+ * the state of the source attributes still safe to call fsal_release_attrs,
+ * so all will be well.
+ *
+ * @param[in]     export         Export for this cache
+ * @param[in]     sub_handle     Handle for sub-FSAL
+ * @param[in]     attrs_in       Attributes provided for the object
+ * @param[in,out] attrs_out      Attributes requested for the object
+ * @param[in]     new_directory  Indicate a new directory was created
+ * @param[out]    entry          Newly instantiated cache entry
+ * @param[in]     state          Optional state_t representing open file.
+ *
+ * @note This returns an INITIAL ref'd entry on success
+ *
+ * @return FSAL status
+ */
+fsal_status_t
+mdcache_new_entry(struct mdcache_fsal_export *export,
+		  struct fsal_obj_handle *sub_handle,
+		  struct attrlist *attrs_in,
+		  struct attrlist *attrs_out,
+		  bool new_directory,
+		  mdcache_entry_t **entry,
+		  struct state_t *state,
+		  mdc_reason_t reason)
+{
+	fsal_status_t status;
+	mdcache_entry_t *oentry, *nentry = NULL;
+	struct gsh_buffdesc fh_desc;
+	cih_latch_t latch;
+	mdcache_key_t key;
+
+	*entry = NULL;
+
+	/* Get FSAL-specific key */
+	subcall_raw(export,
+		    sub_handle->obj_ops->handle_to_key(sub_handle, &fh_desc)
+		   );
+
+	(void) cih_hash_key(&key, export->mfe_exp.sub_export->fsal, &fh_desc,
+			    CIH_HASH_KEY_PROTOTYPE);
+
+	/* Check if the entry already exists.  We allow the following race
+	 * because mdcache_lru_get has a slow path, and the latch is a
+	 * shared lock. */
+	status = mdcache_find_keyed(&key, entry);
+	if (!FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_CACHE_INODE,
+			 "Trying to add an already existing entry. Found entry %p type: %d, New type: %d",
+			 *entry, (*entry)->obj_handle.type, sub_handle->type);
+
+		/* If it was unreachable before, mark it reachable */
+		atomic_clear_uint32_t_bits(&(*entry)->mde_flags,
+					 MDCACHE_UNREACHABLE);
+
+		/* Don't need a new sub_handle ref */
+		goto out_no_new_entry_yet;
+	} else if (status.major != ERR_FSAL_NOENT) {
+		/* Real error , don't need a new sub_handle ref */
+		goto out_no_new_entry_yet;
+	}
+
+	/* !LATCHED */
+
+	/* We did not find the object.  Pull an entry off the LRU. The entry
+	 * will already be mapped.
+	 */
+	nentry = mdcache_alloc_handle(export, sub_handle, sub_handle->fs,
+				      reason);
+
+	if (nentry == NULL) {
+		/* We didn't get an entry because of unexport in progress,
+		 * go ahead and bail out now.
+		 */
+		status = fsalstat(ERR_FSAL_STALE, 0);
+		goto out_no_new_entry_yet;
+	}
+
+	/* See if someone raced us. */
+	oentry = cih_get_by_key_latch(&key, &latch, CIH_GET_WLOCK, __func__,
+					__LINE__);
+	if (oentry) {
+		*entry = oentry;
+		status = mdc_new_entry_raced(oentry, sub_handle);
+
+		/* Release the subtree hash table lock */
+		cih_hash_release(&latch);
+
+		goto out_release_new_entry;
+	}
+
+	/* We won the race. */
+	status = mdc_new_entry_insert(export, nentry, &fh_desc, attrs_in,
+				      attrs_out, new_directory, &latch);
+	cih_hash_release(&latch);
+
+	if (FSAL_IS_ERROR(status))
+		goto out_release_new_entry;
+
+	mdc_new_entry_added(nentry, reason);
+	*entry = nentry;
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+ out_release_new_entry:
+
+	/* We raced or failed, release the new entry we acquired. */
+	mdc_new_entry_drop(nentry);
+
+ out_no_new_entry_yet:
+
+	return mdc_new_entry_finish(export, sub_handle, attrs_out, entry,
+				    state, status);
+}
+
+/** A new entry of mdcache_new_entries() */
+struct mdc_new_entry {
+	mdcache_key_t key;
+	struct gsh_buffdesc fh_desc;
+	mdcache_entry_t *nentry;
+	cih_partition_t *cp;
+	unsigned int idx;
+};
+
+static int mdc_new_entry_part_cmpf(const void *a, const void *b)
+{
+	const struct mdc_new_entry *na = a, *nb = b;
+
+	if (na->cp != nb->cp)
+		return na->cp < nb->cp ? -1 : 1;
+
+	return na->idx < nb->idx ? -1 : na->idx > nb->idx;
+}
+
+/**
+ * @brief Adds a batch of new entries to the cache
+ *
+ * This does what mdcache_new_entry() does for each object, without
+ * attrs_out or state, but takes the write latch of each partition of
+ * the hash only once for all the objects that land in it.  Readdir
+ * uses it for the objects of a chunk, which are mostly new.
+ *
+ * @param[in]  export      Export for this cache
+ * @param[in]  count       Number of objects
+ * @param[in]  sub_handles Handles for sub-FSAL, consumed
+ * @param[in]  attrs_in    Attributes provided for each object
+ * @param[out] entries     Entry of each object, NULL on failure
+ * @param[out] statuses    Status of each object
+ * @param[in]  reason      Reason the entries are created
+ *
+ * @note Each entry is returned INITIAL ref'd on success
+ */
+void mdcache_new_entries(struct mdcache_fsal_export *export,
+			 unsigned int count,
+			 struct fsal_obj_handle **sub_handles,
+			 struct attrlist **attrs_in,
+			 mdcache_entry_t **entries,
+			 fsal_status_t *statuses,
+			 mdc_reason_t reason)
+{
+	struct mdc_new_entry *news = gsh_calloc(count, sizeof(*news));
+	unsigned int nnew = 0, i, j, first;
+	struct mdc_new_entry *ne;
+	cih_latch_t latch;
+
+	for (i = 0; i < count; i++) {
+		struct fsal_obj_handle *sub_handle = sub_handles[i];
+
+		ne = &news[nnew];
+		entries[i] = NULL;
 
 		subcall_raw(export,
-			    status =
-			    old_sub_handle->obj_ops->merge(old_sub_handle,
-							  sub_handle)
+			    sub_handle->obj_ops->handle_to_key(sub_handle,
+							       &ne->fh_desc)
 			   );
 
-		if (FSAL_IS_ERROR(status)) {
-			/* Report this error and unref the entry */
-			LogDebug(COMPONENT_CACHE_INODE,
-				 "Merge of object handles after race returned %s",
-				 fsal_err_txt(status));
+		(void) cih_hash_key(&ne->key, export->mfe_exp.sub_export->fsal,
+				    &ne->fh_desc, CIH_HASH_KEY_PROTOTYPE);
 
-			mdcache_put(*entry);
-			*entry = NULL;
+		statuses[i] = mdcache_find_keyed(&ne->key, &entries[i]);
+		if (!FSAL_IS_ERROR(statuses[i])) {
+			atomic_clear_uint32_t_bits(&entries[i]->mde_flags,
+						   MDCACHE_UNREACHABLE);
+			statuses[i] = mdc_new_entry_finish(export, sub_handle,
+							   NULL, &entries[i],
+							   NULL, statuses[i]);
+			continue;
 		}
-	}
 
-	if (FSAL_IS_ERROR(status) && state != NULL) {
-		/* Our caller passed in a state for an open file, since
-		 * there is not a valid entry to use, or a merge failed
-		 * we must close that file before disposing of new_obj.
-		 */
-		fsal_status_t cstatus;
+		if (statuses[i].major != ERR_FSAL_NOENT) {
+			statuses[i] = mdc_new_entry_finish(export, sub_handle,
+							   NULL, &entries[i],
+							   NULL, statuses[i]);
+			continue;
+		}
 
-		subcall_raw(export,
-			    cstatus = sub_handle->obj_ops->close2(sub_handle,
-								 state)
-			   );
+		/* Allocate outside of any latch */
+		ne->nentry = mdcache_alloc_handle(export, sub_handle,
+						  sub_handle->fs, reason);
+		if (ne->nentry == NULL) {
+			statuses[i] = mdc_new_entry_finish(
+						export, sub_handle, NULL,
+						&entries[i], NULL,
+						fsalstat(ERR_FSAL_STALE, 0));
+			continue;
+		}
 
-		LogDebug(COMPONENT_CACHE_INODE,
-			 "Close of state during error processing returned %s",
-			 fsal_err_txt(cstatus));
+		ne->cp = cih_partition_of_scalar(&cih_fhcache, ne->key.hk);
+		ne->idx = i;
+		nnew++;
 	}
 
-	/* must free sub_handle if no new entry was created to reference it. */
-	subcall_raw(export,
-		    sub_handle->obj_ops->release(sub_handle)
-		   );
+	/* In partition order, so each latch is taken once.  Within a
+	 * partition the objects stay in their order, a name that appears
+	 * twice (a hard link) is found by the second lookup.
+	 */
+	qsort(news, nnew, sizeof(*news), mdc_new_entry_part_cmpf);
 
-	return status;
+	for (first = 0; first < nnew; first = j) {
+		(void) cih_latch_entry(&news[first].key, &latch,
+				       CIH_GET_WLOCK, __func__, __LINE__);
+
+		for (j = first; j < nnew && news[j].cp == news[first].cp;
+		     j++) {
+			mdcache_entry_t *oentry;
+
+			ne = &news[j];
+			i = ne->idx;
+
+			oentry = cih_lookup_latched(&ne->key, &latch);
+			if (oentry != NULL) {
+				entries[i] = oentry;
+				statuses[i] = mdc_new_entry_raced(
+							oentry, sub_handles[i]);
+				continue;
+			}
+
+			statuses[i] = mdc_new_entry_insert(export, ne->nentry,
+							   &ne->fh_desc,
+							   attrs_in[i], NULL,
+							   false, &latch);
+			if (!FSAL_IS_ERROR(statuses[i])) {
+				entries[i] = ne->nentry;
+				ne->nentry = NULL;
+			}
+		}
+
+		cih_hash_release(&latch);
+
+		/* Finish outside of the latch */
+		for (j = first; j < nnew && news[j].cp == news[first].cp;
+		     j++) {
+			ne = &news[j];
+			i = ne->idx;
+
+			if (ne->nentry == NULL) {
+				mdc_new_entry_added(entries[i], reason);
+				continue;
+			}
+
+			mdc_new_entry_drop(ne->nentry);
+			statuses[i] = mdc_new_entry_finish(export,
+							   sub_handles[i],
+							   NULL, &entries[i],
+							   NULL, statuses[i]);
+		}
+	}
+
+	gsh_free(news);
 }
 
 int display_mdcache_key(struct display_buffer *dspbuf, mdcache_key_t *key)
 {
+	void *bytes;
 	int b_left = display_printf(dspbuf, "hk=%"PRIx64" fsal=%p key=",
 				    key->hk, key->fsal);
 
 	if (b_left <= 0)
 		return b_left;
 
-	return display_opaque_bytes(dspbuf, key->kv.addr, key->kv.len);
+	if (key->prefix == 0)
+		return display_opaque_bytes(dspbuf, key->kv.addr, key->kv.len);
+
+	bytes = gsh_malloc(mdcache_key_len(key));
+	mdcache_key_bytes(key, bytes);
+	b_left = display_opaque_bytes(dspbuf, bytes, mdcache_key_len(key));
+	gsh_free(bytes);
+
+	return b_left;
 }
 
 /**
@@ -875,6 +1153,7 @@ mdcache_find_keyed_reason(mdcache_key_t *key, mdcache_entry_t **entry,
 			  mdc_reason_t reason)
 {
 	cih_latch_t latch;
+	fsal_status_t status;
 
 	if (key->kv.addr == NULL) {
 		LogDebug(COMPONENT_CACHE_INODE,
@@ -892,49 +1171,59 @@ mdcache_find_keyed_reason(mdcache_key_t *key, mdcache_entry_t **entry,
 			     "Looking for %s", str);
 	}
 
+	/* Try without the partition lock first; a hit comes with a ref */
+	*entry = cih_get_by_key_lockless(key);
+	if (likely(*entry)) {
+		if (reason != MDC_REASON_SCAN)
+			mdcache_lru_promote(*entry);
+		goto found;
+	}
+
 	*entry = cih_get_by_key_latch(key, &latch,
 					CIH_GET_RLOCK | CIH_GET_UNLOCK_ON_MISS,
 					__func__, __LINE__);
-	if (likely(*entry)) {
-		fsal_status_t status;
-
-		/* Initial Ref on entry */
-		status = mdcache_lru_ref(*entry, (reason != MDC_REASON_SCAN) ?
-					 LRU_REQ_INITIAL : LRU_FLAG_NONE);
-		/* Release the subtree hash table lock */
-		cih_hash_release(&latch);
-		if (FSAL_IS_ERROR(status)) {
-			/* Return error instead of entry */
-			LogFullDebug(COMPONENT_CACHE_INODE,
-				     "Found entry %p, but could not ref error %s",
-				     entry, fsal_err_txt(status));
+	if (!*entry) {
+		(void)atomic_inc_uint64_t(&cache_stp->inode_miss);
+		mdc_count_lookup(false);
+		return fsalstat(ERR_FSAL_NOENT, 0);
+	}
 
-			*entry = NULL;
-			return status;
-		}
+	/* Initial Ref on entry */
+	status = mdcache_lru_ref(*entry, (reason != MDC_REASON_SCAN) ?
+				 LRU_REQ_INITIAL : LRU_FLAG_NONE);
+	/* Release the subtree hash table lock */
+	cih_hash_release(&latch);
+	if (FSAL_IS_ERROR(status)) {
+		/* Return error instead of entry */
+		LogFullDebug(COMPONENT_CACHE_INODE,
+			     "Found entry %p, but could not ref error %s",
+			     entry, fsal_err_txt(status));
 
-		status = mdc_check_mapping(*entry);
+		*entry = NULL;
+		return status;
+	}
 
-		if (unlikely(FSAL_IS_ERROR(status))) {
-			/* Export is in the process of being removed, don't
-			 * add this entry to the export, and bail out of the
-			 * operation sooner than later.
-			 */
-			mdcache_put(*entry);
-			*entry = NULL;
-			return status;
-		}
+ found:
+	status = mdc_check_mapping(*entry);
 
-		LogFullDebug(COMPONENT_CACHE_INODE,
-			     "Found entry %p",
-			     *entry);
+	if (unlikely(FSAL_IS_ERROR(status))) {
+		/* Export is in the process of being removed, don't
+		 * add this entry to the export, and bail out of the
+		 * operation sooner than later.
+		 */
+		mdcache_put(*entry);
+		*entry = NULL;
+		return status;
+	}
 
-		(void)atomic_inc_uint64_t(&cache_stp->inode_hit);
+	LogFullDebug(COMPONENT_CACHE_INODE,
+		     "Found entry %p",
+		     *entry);
 
-		return fsalstat(ERR_FSAL_NO_ERROR, 0);
-	}
+	(void)atomic_inc_uint64_t(&cache_stp->inode_hit);
+	mdc_count_lookup(true);
 
-	return fsalstat(ERR_FSAL_NOENT, 0);
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
 /**
@@ -1082,8 +1371,10 @@ fsal_status_t mdc_try_get_cached(mdcache_entry_t *mdc_parent,
 			bump_detached_dirent(mdc_parent, dirent);
 		}
 		status = mdcache_find_keyed(&dirent->ckey, entry);
-		if (!FSAL_IS_ERROR(status))
+		if (!FSAL_IS_ERROR(status)) {
+			mdcache_stat_inc(MDC_STAT_LOOKUP_HIT);
 			return status;
+		}
 		LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
 				"mdcache_find_keyed %s failed %s",
 				name, fsal_err_txt(status));
@@ -1096,9 +1387,17 @@ fsal_status_t mdc_try_get_cached(mdcache_entry_t *mdc_parent,
 		if (trust_negative_cache(mdc_parent)) {
 			/* If the dirent cache is both fully populated and
 			 * valid, it can serve negative lookups. */
+			mdcache_stat_inc(MDC_STAT_LOOKUP_NEG_HIT);
+			return fsalstat(ERR_FSAL_NOENT, 0);
+		}
+		if (mdcache_avl_neg_lookup(mdc_parent, name)) {
+			/* Recently looked up and not found, or not in the
+			 * directory's bloom filter. */
+			mdcache_stat_inc(MDC_STAT_LOOKUP_NEG_HIT);
 			return fsalstat(ERR_FSAL_NOENT, 0);
 		}
 	}
+	mdcache_stat_inc(MDC_STAT_LOOKUP_MISS);
 	return fsalstat(ERR_FSAL_STALE, 0);
 }
 
@@ -1129,6 +1428,11 @@ fsal_status_t mdc_try_get_cached(mdcache_entry_t *mdc_parent,
  * @note This returns an INITIAL ref'd entry on success
  * @return FSAL status
  */
+static fsal_status_t mdc_lookup_shared(mdcache_entry_t *mdc_parent,
+				       const char *name,
+				       mdcache_entry_t **new_entry,
+				       struct attrlist *attrs_out);
+
 fsal_status_t mdc_lookup(mdcache_entry_t *mdc_parent, const char *name,
 			 bool uncached, mdcache_entry_t **new_entry,
 			 struct attrlist *attrs_out)
@@ -1149,11 +1453,18 @@ fsal_status_t mdc_lookup(mdcache_entry_t *mdc_parent, const char *name,
 		LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
 				"Lookup parent (..) of %p", mdc_parent);
 
+		/* The parent key is recorded whenever the directory is
+		 * reached through its parent, so ".." only goes to the
+		 * sub-FSAL for directories found by handle.
+		 */
 		if (mdc_parent->fsobj.fsdir.parent.len == 0) {
 			/* we need write lock */
 			PTHREAD_RWLOCK_unlock(&mdc_parent->content_lock);
 			PTHREAD_RWLOCK_wrlock(&mdc_parent->content_lock);
 			mdc_get_parent(export, mdc_parent);
+			mdcache_stat_inc(MDC_STAT_PARENT_MISS);
+		} else {
+			mdcache_stat_inc(MDC_STAT_PARENT_HIT);
 		}
 
 		/* We need to drop the content lock around the locate, as that
@@ -1181,8 +1492,13 @@ fsal_status_t mdc_lookup(mdcache_entry_t *mdc_parent, const char *name,
 		 *       since we are operating uncached here, ultimately there
 		 *       will be no addition to the dirent cache, and thus no
 		 *       need to hold the write lock.
+		 *
+		 *       Lookups of the same name are coalesced then, which
+		 *       the write lock does when caching.
 		 */
-		goto uncached;
+		status = mdc_lookup_shared(mdc_parent, name, new_entry,
+					   attrs_out);
+		goto out;
 	}
 
 	/* We first try avltree_lookup by name.  If that fails, we dispatch to
@@ -1245,9 +1561,14 @@ fsal_status_t mdc_lookup(mdcache_entry_t *mdc_parent, const char *name,
 	LogDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
 		    "Cache Miss detected for %s", name);
 
-uncached:
 	status = mdc_lookup_uncached(mdc_parent, name, new_entry, attrs_out);
 
+	if (status.major == ERR_FSAL_NOENT &&
+	    mdcache_param.dir.avl_chunk != 0) {
+		/* We hold the write lock; remember the name is missing */
+		mdcache_avl_neg_insert(mdc_parent, name);
+	}
+
 out:
 	PTHREAD_RWLOCK_unlock(&mdc_parent->content_lock);
 	if (status.major == ERR_FSAL_STALE)
@@ -1315,7 +1636,7 @@ fsal_status_t mdc_lookup_uncached(mdcache_entry_t *mdc_parent,
 	status = mdcache_alloc_and_check_handle(export, sub_handle, &new_obj,
 						false, &attrs, attrs_out,
 						"lookup ", mdc_parent, name,
-						&invalidate, NULL);
+						true, &invalidate, NULL);
 
 	fsal_release_attrs(&attrs);
 
@@ -1328,6 +1649,221 @@ fsal_status_t mdc_lookup_uncached(mdcache_entry_t *mdc_parent,
 	return status;
 }
 
+/**
+ * Creates, links, unlinks and renames hold the name lock of each name
+ * they change from the sub-FSAL call until the dirent cache has been
+ * updated.  Changes to one name then reach the cache in the order the
+ * sub-FSAL made them, while the directory's content_lock is only held
+ * for the update itself, so changes to different names of a directory
+ * only serialize on that.  Names are striped over MDC_NAME_LOCKS
+ * mutexes by a hash of the directory and the name.
+ */
+static struct {
+	pthread_mutex_t mtx;
+} __attribute__((__aligned__(GSH_CACHE_LINE_SIZE)))
+	mdc_name_locks[MDC_NAME_LOCKS];
+
+void mdcache_name_locks_init(void)
+{
+	int i;
+
+	for (i = 0; i < MDC_NAME_LOCKS; i++)
+		PTHREAD_MUTEX_init(&mdc_name_locks[i].mtx, NULL);
+}
+
+static inline uint32_t mdc_name_lock_ix(mdcache_entry_t *dir,
+					const char *name)
+{
+	return CityHash64WithSeed(name, strlen(name), (uintptr_t) dir) %
+		MDC_NAME_LOCKS;
+}
+
+/**
+ * @brief Lock a name of a directory
+ *
+ * @param[in] dir   Directory
+ * @param[in] name  Name that will be changed
+ */
+void mdcache_name_lock(mdcache_entry_t *dir, const char *name)
+{
+	PTHREAD_MUTEX_lock(&mdc_name_locks[mdc_name_lock_ix(dir, name)].mtx);
+}
+
+void mdcache_name_unlock(mdcache_entry_t *dir, const char *name)
+{
+	PTHREAD_MUTEX_unlock(&mdc_name_locks[mdc_name_lock_ix(dir, name)].mtx);
+}
+
+/**
+ * @brief Lock the two names of a rename
+ *
+ * Stripes are taken lowest first, and once if both names hash to the
+ * same stripe.
+ *
+ * @param[in] src    Source directory
+ * @param[in] sname  Source name
+ * @param[in] dest   Destination directory
+ * @param[in] dname  Destination name
+ */
+void mdcache_name_lock2(mdcache_entry_t *src, const char *sname,
+			mdcache_entry_t *dest, const char *dname)
+{
+	uint32_t lo = mdc_name_lock_ix(src, sname);
+	uint32_t hi = mdc_name_lock_ix(dest, dname);
+
+	if (lo > hi) {
+		uint32_t ix = lo;
+
+		lo = hi;
+		hi = ix;
+	}
+
+	PTHREAD_MUTEX_lock(&mdc_name_locks[lo].mtx);
+	if (hi != lo)
+		PTHREAD_MUTEX_lock(&mdc_name_locks[hi].mtx);
+}
+
+void mdcache_name_unlock2(mdcache_entry_t *src, const char *sname,
+			  mdcache_entry_t *dest, const char *dname)
+{
+	uint32_t six = mdc_name_lock_ix(src, sname);
+	uint32_t dix = mdc_name_lock_ix(dest, dname);
+
+	PTHREAD_MUTEX_unlock(&mdc_name_locks[six].mtx);
+	if (dix != six)
+		PTHREAD_MUTEX_unlock(&mdc_name_locks[dix].mtx);
+}
+
+/**
+ * A sub-FSAL lookup others are waiting on, on its caller's stack
+ */
+struct mdc_lookup_flight {
+	struct glist_head list;		/*< Entry in its stripe's flights */
+	mdcache_entry_t *parent;
+	const char *name;
+	uint32_t waiters;		/*< Callers waiting on the result */
+	bool done;
+	fsal_status_t status;
+	mdcache_entry_t *entry;		/*< Result, ref held by the caller */
+};
+
+/**
+ * Lookups in flight, striped like the name locks
+ */
+static struct mdc_lookup_stripe {
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	struct glist_head flights;
+} __attribute__((__aligned__(GSH_CACHE_LINE_SIZE)))
+	mdc_lookup_flights[MDC_NAME_LOCKS];
+
+void mdcache_lookup_flights_init(void)
+{
+	int i;
+
+	for (i = 0; i < MDC_NAME_LOCKS; i++) {
+		PTHREAD_MUTEX_init(&mdc_lookup_flights[i].mtx, NULL);
+		PTHREAD_COND_init(&mdc_lookup_flights[i].cond, NULL);
+		glist_init(&mdc_lookup_flights[i].flights);
+	}
+}
+
+/**
+ * @brief Look up a name in the sub-FSAL, once for all concurrent callers
+ *
+ * The first caller for a name does the lookup, others coming while it
+ * runs wait and share its result.  That keeps a directory whose names
+ * just went out of the cache from sending the sub-FSAL the same lookup
+ * from every client at once.
+ *
+ * @note mdc_parent MUST have its content_lock held for reading
+ *
+ * @param[in]     mdc_parent	Parent entry
+ * @param[in]     name		Name of entry to find
+ * @param[out]    new_entry	New entry to return;
+ * @param[in,out] attrs_out     Optional attributes for entry
+ *
+ * @note This returns an INITIAL ref'd entry on success
+ *
+ * @return FSAL status
+ */
+static fsal_status_t mdc_lookup_shared(mdcache_entry_t *mdc_parent,
+				       const char *name,
+				       mdcache_entry_t **new_entry,
+				       struct attrlist *attrs_out)
+{
+	struct mdc_lookup_stripe *stripe =
+		&mdc_lookup_flights[mdc_name_lock_ix(mdc_parent, name)];
+	struct mdc_lookup_flight self, *flight = NULL;
+	struct glist_head *glist;
+	fsal_status_t status;
+
+	PTHREAD_MUTEX_lock(&stripe->mtx);
+
+	glist_for_each(glist, &stripe->flights) {
+		flight = glist_entry(glist, struct mdc_lookup_flight, list);
+		if (flight->parent == mdc_parent &&
+		    strcmp(flight->name, name) == 0)
+			break;
+		flight = NULL;
+	}
+
+	if (flight != NULL) {
+		flight->waiters++;
+		while (!flight->done)
+			pthread_cond_wait(&stripe->cond, &stripe->mtx);
+
+		status = flight->status;
+		*new_entry = flight->entry;
+		if (*new_entry != NULL)
+			status = mdcache_get(*new_entry);
+
+		if (--flight->waiters == 0)
+			pthread_cond_broadcast(&stripe->cond);
+		PTHREAD_MUTEX_unlock(&stripe->mtx);
+
+		if (FSAL_IS_ERROR(status)) {
+			*new_entry = NULL;
+			return status;
+		}
+
+		/* Ours may want other attributes than the lookup got */
+		status = get_optional_attrs(&(*new_entry)->obj_handle,
+					    attrs_out);
+		if (FSAL_IS_ERROR(status)) {
+			mdcache_put(*new_entry);
+			*new_entry = NULL;
+		}
+		return status;
+	}
+
+	memset(&self, 0, sizeof(self));
+	self.parent = mdc_parent;
+	self.name = name;
+	glist_add_tail(&stripe->flights, &self.list);
+
+	PTHREAD_MUTEX_unlock(&stripe->mtx);
+
+	status = mdc_lookup_uncached(mdc_parent, name, new_entry, attrs_out);
+
+	PTHREAD_MUTEX_lock(&stripe->mtx);
+
+	glist_del(&self.list);
+	self.status = status;
+	self.entry = *new_entry;
+	self.done = true;
+	if (self.waiters != 0) {
+		pthread_cond_broadcast(&stripe->cond);
+		/* They take their references from ours */
+		while (self.waiters != 0)
+			pthread_cond_wait(&stripe->cond, &stripe->mtx);
+	}
+
+	PTHREAD_MUTEX_unlock(&stripe->mtx);
+
+	return status;
+}
+
 /**
  * @brief Lock two directories in order
  *
@@ -1457,12 +1993,14 @@ mdcache_dirent_add(mdcache_entry_t *parent, const char *name,
 #endif
 
 	/* in cache avl, we always insert on pentry_parent */
-	new_dir_entry = gsh_calloc(1, sizeof(mdcache_dir_entry_t) + namesize);
+	new_dir_entry = gsh_calloc_tag(MEM_TAG_MDCACHE, 1,
+				       sizeof(mdcache_dir_entry_t) + namesize);
 	new_dir_entry->flags = DIR_ENTRY_FLAG_NONE;
 	allocated_dir_entry = new_dir_entry;
 
 	memcpy(&new_dir_entry->name_buffer, name, namesize);
 	new_dir_entry->name = new_dir_entry->name_buffer;
+	mdcache_lru_charge_dirent(new_dir_entry);
 	mdcache_key_dup(&new_dir_entry->ckey, &entry->fh_hk.key);
 
 	/* add to avl */
@@ -1982,16 +2520,17 @@ void place_new_dirent(mdcache_entry_t *parent_dir,
 	/* And bump the chunk in the LRU */
 	lru_bump_chunk(chunk);
 
-	if (chunk->num_entries == mdcache_param.dir.avl_chunk_split) {
+	if (chunk->num_entries == mdc_chunk_split(chunk)) {
 		/* Create a new chunk */
 		struct dir_chunk *split;
 		struct glist_head *glist;
 		mdcache_dir_entry_t *here = NULL;
 		int i = 0;
-		uint32_t split_count = mdcache_param.dir.avl_chunk_split / 2;
+		uint32_t split_count = mdc_chunk_split(chunk) / 2;
 
 		split = mdcache_get_chunk(parent_dir, chunk, 0);
 		split->next_ck = chunk->next_ck;
+		split->size = chunk->size;
 
 		LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
 				"Split next_ck=%"PRIx64,
@@ -2062,37 +2601,33 @@ out:
 }
 
 /**
- * @brief Handle adding an element to a dirent chunk
+ * @brief Add a cached object to a dirent chunk
  *
- * Cache a sindle object, and add it to the directory chunk in progress.
+ * Add the object of a directory entry to the directory chunk in
+ * progress, starting a new one if it is full.
  *
  * @param[in]     name       Name of the directory entry
- * @param[in]     sub_handle Object for entry
- * @param[in]     attrs      Attributes requested for the object
- * @param[in,out] dir_state  Callback state
+ * @param[in]     new_entry  Object for entry, INITIAL ref'd
+ * @param[in,out] state      Callback state
  * @param[in]     cookie     Directory cookie
  *
  * @returns fsal_dir_result
  */
 
 static enum fsal_dir_result
-mdc_readdir_chunk_object(const char *name, struct fsal_obj_handle *sub_handle,
-			 struct attrlist *attrs_in, void *dir_state,
-			 fsal_cookie_t cookie)
+mdc_readdir_chunk_add(const char *name, mdcache_entry_t *new_entry,
+		      struct mdcache_populate_cb_state *state,
+		      fsal_cookie_t cookie)
 {
-	struct mdcache_populate_cb_state *state = dir_state;
 	struct dir_chunk *chunk = state->last_chunk;
 	mdcache_entry_t *mdc_parent = container_of(&state->dir->obj_handle,
 						   mdcache_entry_t, obj_handle);
-	struct mdcache_fsal_export *export = mdc_cur_export();
-	mdcache_entry_t *new_entry = NULL;
 	mdcache_dir_entry_t *new_dir_entry = NULL, *allocated_dir_entry = NULL;
 	size_t namesize = strlen(name) + 1;
 	int code = 0;
-	fsal_status_t status;
 	enum fsal_dir_result result = DIR_CONTINUE;
 
-	if (chunk->num_entries == mdcache_param.dir.avl_chunk) {
+	if (chunk->num_entries == chunk->size) {
 		/* We are being called readahead. */
 		LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
 				"Readdir readahead first entry in new chunk %s",
@@ -2107,22 +2642,6 @@ mdc_readdir_chunk_object(const char *name, struct fsal_obj_handle *sub_handle,
 		/* And start accepting entries into the new chunk. */
 	}
 
-	LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
-			"Creating cache entry for %s cookie=0x%"PRIx64
-			" sub_handle=0x%p",
-			name, cookie, sub_handle);
-
-	status = mdcache_new_entry(export, sub_handle, attrs_in, NULL,
-				   false, &new_entry, NULL, MDC_REASON_SCAN);
-
-	if (FSAL_IS_ERROR(status)) {
-		*state->status = status;
-		LogInfoAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
-			   "mdcache_new_entry failed on %s in dir %p with %s",
-			   name, mdc_parent, fsal_err_txt(status));
-		return DIR_TERMINATE;
-	}
-
 	/* Entry was found in the FSAL, add this entry to the parent directory
 	 */
 
@@ -2131,7 +2650,7 @@ mdc_readdir_chunk_object(const char *name, struct fsal_obj_handle *sub_handle,
 			new_entry, name, new_entry->sub_handle->fsal->name);
 
 	/* in cache avl, we always insert on mdc_parent */
-	new_dir_entry = gsh_calloc(1, sizeof(mdcache_dir_entry_t) + namesize);
+	new_dir_entry = mdcache_dirent_carve(chunk, namesize);
 	new_dir_entry->flags = DIR_ENTRY_FLAG_NONE;
 	new_dir_entry->chunk = chunk;
 	new_dir_entry->ck = cookie;
@@ -2147,6 +2666,7 @@ mdc_readdir_chunk_object(const char *name, struct fsal_obj_handle *sub_handle,
 
 	memcpy(&new_dir_entry->name_buffer, name, namesize);
 	new_dir_entry->name = new_dir_entry->name_buffer;
+	mdcache_lru_charge_dirent(new_dir_entry);
 	mdcache_key_dup(&new_dir_entry->ckey, &new_entry->fh_hk.key);
 
 	/* add to avl */
@@ -2327,7 +2847,7 @@ mdc_readdir_chunk_object(const char *name, struct fsal_obj_handle *sub_handle,
 					"keeping non-empty Chunk %p", chunk);
 			chunk->next_ck = cookie;
 		}
-	} else if (chunk->num_entries == mdcache_param.dir.avl_chunk) {
+	} else if (chunk->num_entries == chunk->size) {
 		/* Chunk is full. Since dirent is pointing to the existing
 		 * dirent and the one we allocated above has been freed we don't
 		 * need to do any cleanup.
@@ -2340,22 +2860,150 @@ mdc_readdir_chunk_object(const char *name, struct fsal_obj_handle *sub_handle,
 		result = DIR_READAHEAD;
 	}
 
-	if (new_entry->obj_handle.type == DIRECTORY) {
-		/* Insert Parent's key */
-		PTHREAD_RWLOCK_wrlock(&new_entry->content_lock);
-		mdc_dir_add_parent(new_entry, mdc_parent);
-		PTHREAD_RWLOCK_unlock(&new_entry->content_lock);
+	if (new_entry->obj_handle.type == DIRECTORY) {
+		/* Insert Parent's key */
+		PTHREAD_RWLOCK_wrlock(&new_entry->content_lock);
+		mdc_dir_add_parent(new_entry, mdc_parent);
+		PTHREAD_RWLOCK_unlock(&new_entry->content_lock);
+	}
+
+	LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
+			"About to put entry %p refcnt=%"PRIi32,
+			new_entry,
+			atomic_fetch_int32_t(&new_entry->lru.refcnt));
+
+	/* Note that this entry is ref'd, so that mdcache_readdir_chunked can
+	 * un-ref it.  Keep the ref from above for this puropes */
+	new_dir_entry->flags |= DIR_ENTRY_REFFED;
+
+
+	return result;
+}
+
+/**
+ * @brief Handle adding an element to a dirent chunk
+ *
+ * Cache a sindle object, and add it to the directory chunk in progress.
+ *
+ * @param[in]     name       Name of the directory entry
+ * @param[in]     sub_handle Object for entry
+ * @param[in]     attrs      Attributes requested for the object
+ * @param[in,out] state      Callback state
+ * @param[in]     cookie     Directory cookie
+ *
+ * @returns fsal_dir_result
+ */
+
+static enum fsal_dir_result
+mdc_readdir_chunk_object(const char *name, struct fsal_obj_handle *sub_handle,
+			 struct attrlist *attrs_in,
+			 struct mdcache_populate_cb_state *state,
+			 fsal_cookie_t cookie)
+{
+	struct mdcache_fsal_export *export = mdc_cur_export();
+	mdcache_entry_t *new_entry = NULL;
+	fsal_status_t status;
+
+	LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
+			"Creating cache entry for %s cookie=0x%"PRIx64
+			" sub_handle=0x%p",
+			name, cookie, sub_handle);
+
+	status = mdcache_new_entry(export, sub_handle, attrs_in, NULL,
+				   false, &new_entry, NULL, MDC_REASON_SCAN);
+
+	if (FSAL_IS_ERROR(status)) {
+		*state->status = status;
+		LogInfoAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
+			   "mdcache_new_entry failed on %s in dir %p with %s",
+			   name, state->dir, fsal_err_txt(status));
+		return DIR_TERMINATE;
+	}
+
+	return mdc_readdir_chunk_add(name, new_entry, state, cookie);
+}
+
+/**
+ * @brief Handle a batch of elements for a dirent chunk
+ *
+ * The objects of the whole batch are cached at once with
+ * mdcache_new_entries(), then added to the chunk in order.
+ *
+ * @param[in]     dirents   The directory entries
+ * @param[in]     count     Number of entries
+ * @param[out]    consumed  Number of entries added
+ * @param[in,out] state     Callback state
+ *
+ * @returns fsal_dir_result of the last entry handled
+ */
+
+static enum fsal_dir_result
+mdc_readdir_chunk_batch(struct fsal_readdir_entry *dirents,
+			unsigned int count, unsigned int *consumed,
+			struct mdcache_populate_cb_state *state)
+{
+	struct mdcache_fsal_export *export = mdc_cur_export();
+	struct fsal_obj_handle **sub_handles;
+	struct attrlist **attrs;
+	mdcache_entry_t **entries;
+	fsal_status_t *statuses;
+	enum fsal_dir_result result = DIR_CONTINUE;
+	unsigned int i;
+
+	if (count == 1) {
+		result = mdc_readdir_chunk_object(dirents->name, dirents->obj,
+						  dirents->attrs, state,
+						  dirents->cookie);
+		if (result < DIR_TERMINATE)
+			(*consumed)++;
+		return result;
+	}
+
+	sub_handles = gsh_malloc(count * sizeof(*sub_handles));
+	attrs = gsh_malloc(count * sizeof(*attrs));
+	entries = gsh_malloc(count * sizeof(*entries));
+	statuses = gsh_malloc(count * sizeof(*statuses));
+
+	for (i = 0; i < count; i++) {
+		sub_handles[i] = dirents[i].obj;
+		attrs[i] = dirents[i].attrs;
 	}
 
 	LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
-			"About to put entry %p refcnt=%"PRIi32,
-			new_entry,
-			atomic_fetch_int32_t(&new_entry->lru.refcnt));
+			"Creating %u cache entries from %s cookie=0x%"PRIx64,
+			count, dirents->name, dirents->cookie);
 
-	/* Note that this entry is ref'd, so that mdcache_readdir_chunked can
-	 * un-ref it.  Keep the ref from above for this puropes */
-	new_dir_entry->flags |= DIR_ENTRY_REFFED;
+	mdcache_new_entries(export, count, sub_handles, attrs, entries,
+			    statuses, MDC_REASON_SCAN);
+
+	for (i = 0; i < count; i++) {
+		if (FSAL_IS_ERROR(statuses[i])) {
+			*state->status = statuses[i];
+			LogInfoAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
+				   "mdcache_new_entries failed on %s in dir %p with %s",
+				   dirents[i].name, state->dir,
+				   fsal_err_txt(statuses[i]));
+			result = DIR_TERMINATE;
+			break;
+		}
+
+		result = mdc_readdir_chunk_add(dirents[i].name, entries[i],
+					       state, dirents[i].cookie);
+		if (result >= DIR_TERMINATE)
+			break;
+		(*consumed)++;
+	}
 
+	/* The objects were all cached, drop those not gotten to */
+	for (i++; i < count; i++) {
+		if (!FSAL_IS_ERROR(statuses[i]))
+			mdcache_put(entries[i]);
+	}
+
+	gsh_free(sub_handles);
+	gsh_free(attrs);
+	gsh_free(entries);
+	gsh_free(statuses);
 
 	return result;
 }
@@ -2366,32 +3014,73 @@ mdc_readdir_chunk_object(const char *name, struct fsal_obj_handle *sub_handle,
  * This is a supercall wrapper around the function above that actually does
  * the work.
  *
- * @param[in]     name       Name of the directory entry
- * @param[in]     sub_handle Object for entry
- * @param[in]     attrs      Attributes requested for the object
+ * @param[in]     dirents    The directory entries
+ * @param[in]     count      Number of entries
+ * @param[out]    consumed   Number of entries added
  * @param[in,out] dir_state  Callback state
- * @param[in]     cookie     Directory cookie
  *
  * @returns fsal_dir_result
  */
 
 static enum fsal_dir_result
-mdc_readdir_chunked_cb(const char *name, struct fsal_obj_handle *sub_handle,
-		       struct attrlist *attrs, void *dir_state,
-		       fsal_cookie_t cookie)
+mdc_readdir_chunked_cb(struct fsal_readdir_entry *dirents, unsigned int count,
+		       unsigned int *consumed, void *dir_state)
 {
 	struct mdcache_populate_cb_state *state = dir_state;
 	enum fsal_dir_result result;
 
 	/* This is in the middle of a subcall. Do a supercall */
 	supercall_raw(state->export,
-		result = mdc_readdir_chunk_object(name, sub_handle, attrs,
-						  dir_state, cookie)
+		result = mdc_readdir_chunk_batch(dirents, count, consumed,
+						 state)
 	);
 
 	return result;
 }
 
+/**
+ * @brief Fill a chunk from the chunk store rather than the sub-FSAL
+ *
+ * The dirents are added just as if the sub-FSAL had given them.
+ *
+ * @param[in,out] state    Callback state
+ * @param[in]     whence   Cookie the chunk is read from
+ * @param[out]    eod_met  The end of the directory was reached
+ *
+ * @return true if the chunk was in the store.
+ */
+
+static bool mdc_readdir_chunk_restore(struct mdcache_populate_cb_state *state,
+				      fsal_cookie_t whence, bool *eod_met)
+{
+	struct mdc_cstore_chunk *saved;
+	enum fsal_dir_result result = DIR_CONTINUE;
+	uint32_t i;
+
+	saved = mdc_cstore_chunk_get(state->dir, whence);
+	if (saved == NULL)
+		return false;
+
+	LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
+			"Restoring %"PRIu32" dirents from cookie 0x%"PRIx64,
+			saved->count, whence);
+
+	for (i = 0; i < saved->count && result < DIR_TERMINATE; i++) {
+		/* The dirent takes the ref, or drops it */
+		result = mdc_readdir_chunk_add(saved->ents[i].name,
+					       saved->ents[i].entry, state,
+					       saved->ents[i].ck);
+		saved->ents[i].entry = NULL;
+	}
+
+	*eod_met = saved->eod && result < DIR_TERMINATE;
+
+	mdc_cstore_chunk_free(saved);
+	mdcache_stat_inc(MDC_STAT_CHUNK_RESTORE);
+
+	return true;
+}
+
 /**
  * @brief Skip directory chunks while re-filling dirent cache in search of
  *        a specific cookie that is not in cache.
@@ -2418,6 +3107,62 @@ static struct dir_chunk *mdcache_skip_chunks(mdcache_entry_t *directory,
 	return chunk;
 }
 
+/**
+ * @brief Extend a directory's bloom filter over the chunks just read
+ *
+ * The filter is complete once the chunks read since it was started
+ * reach the end of the directory without a gap.
+ *
+ * @note The content lock MUST be held for write
+ *
+ * @param[in] directory  The directory
+ * @param[in] whence     Cookie the chunks were read from
+ * @param[in] chunk      Last chunk read, NULL if there was none
+ * @param[in] eod_met    The end of directory was reached
+ */
+static void mdc_bloom_progress(mdcache_entry_t *directory,
+			       fsal_cookie_t whence, struct dir_chunk *chunk,
+			       bool eod_met)
+{
+	mdcache_dir_entry_t *last;
+	struct dir_chunk *next;
+
+	if (directory->fsobj.fsdir.neg.bloom == NULL ||
+	    test_mde_flags(directory, MDCACHE_DIR_BLOOM) ||
+	    whence != directory->fsobj.fsdir.neg.bloom_ck)
+		return;
+
+	if (!test_mde_flags(directory, MDCACHE_DIR_NEGATIVE)) {
+		/* The directory changed while the filter was being built */
+		mdcache_avl_neg_clean(directory);
+		return;
+	}
+
+	if (chunk != NULL) {
+		if (chunk->next_ck != 0) {
+			/* We ran into cached chunks, their names are already
+			 * in the filter.
+			 */
+			next = mdcache_skip_chunks(directory, chunk->next_ck);
+			if (next != NULL)
+				chunk = next;
+		}
+
+		last = glist_last_entry(&chunk->dirents, mdcache_dir_entry_t,
+					chunk_list);
+		directory->fsobj.fsdir.neg.bloom_ck = last->ck;
+		eod_met |= last->eod;
+	}
+
+	if (eod_met) {
+		LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
+				"Bloom filter of %p complete", directory);
+		directory->fsobj.fsdir.neg.bloom_time = time(NULL);
+		atomic_set_uint32_t_bits(&directory->mde_flags,
+					 MDCACHE_DIR_BLOOM);
+	}
+}
+
 /**
  * @brief Read the next chunk of a directory
  *
@@ -2448,9 +3193,13 @@ fsal_status_t mdcache_populate_dir_chunk(mdcache_entry_t *directory,
 	struct dir_chunk *chunk;
 	attrmask_t attrmask;
 	fsal_cookie_t *whence_ptr = &whence;
+	const char *resume_name = NULL;
 
 	chunk = mdcache_get_chunk(directory, prev_chunk, whence);
 
+	if (whence == 0 && prev_chunk == NULL)
+		mdcache_avl_bloom_start(directory);
+
 	attrmask = op_ctx->fsal_export->exp_ops.fs_supported_attrs(
 					op_ctx->fsal_export) | ATTR_RDATTR_ERR;
 
@@ -2466,6 +3215,15 @@ fsal_status_t mdcache_populate_dir_chunk(mdcache_entry_t *directory,
 	state.whence_search = state.whence_is_name && whence != 0 &&
 							prev_chunk == NULL;
 
+	if (state.whence_search) {
+		/* If a readdir left off at whence, carry on from the name
+		 * of its dirent rather than searching from the start.
+		 */
+		resume_name = mdcache_avl_resume_lookup(directory, whence);
+		if (resume_name != NULL)
+			state.whence_search = false;
+	}
+
 	if (state.whence_is_name) {
 		LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
 				"whence_is_name %s cookie %"
@@ -2505,6 +3263,13 @@ again:
 						"Calling FSAL readdir whence = %s, no search",
 						last->name);
 			}
+		} else if (resume_name != NULL) {
+			/* Start from where a previous readdir left off */
+			whence_ptr = (fsal_cookie_t *)resume_name;
+			LogFullDebugAlt(COMPONENT_NFS_READDIR,
+					COMPONENT_CACHE_INODE,
+					"Calling FSAL readdir whence = %s, resume %"
+					PRIx64, resume_name, whence);
 		} else {
 			/* Signal start from beginning by passing NULL pointer.
 			 */
@@ -2531,19 +3296,27 @@ again:
 		   __func__, __LINE__, &directory->obj_handle,
 		   directory->sub_handle, whence);
 #endif
-	subcall(
-		readdir_status = directory->sub_handle->obj_ops->readdir(
-			directory->sub_handle, whence_ptr, &state,
-			mdc_readdir_chunked_cb, attrmask, eod_met)
-	       );
+	if (state.whence_is_name ||
+	    !mdc_readdir_chunk_restore(&state, whence, eod_met)) {
+		subcall(
+			readdir_status =
+				directory->sub_handle->obj_ops->readdir_batch(
+					directory->sub_handle, whence_ptr,
+					&state, mdc_readdir_chunked_cb,
+					attrmask, eod_met)
+		       );
+
+		if (FSAL_IS_ERROR(readdir_status)) {
+			LogDebugAlt(COMPONENT_NFS_READDIR,
+				    COMPONENT_CACHE_INODE,
+				    "FSAL readdir status=%s",
+				    fsal_err_txt(readdir_status));
+			*dirent = NULL;
+			lru_remove_chunk(chunk);
+			return readdir_status;
+		}
 
-	if (FSAL_IS_ERROR(readdir_status)) {
-		LogDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
-			    "FSAL readdir status=%s",
-			    fsal_err_txt(readdir_status));
-		*dirent = NULL;
-		lru_remove_chunk(chunk);
-		return readdir_status;
+		mdcache_stat_inc(MDC_STAT_CHUNK_FILL);
 	}
 
 	if (FSAL_IS_ERROR(status)) {
@@ -2597,6 +3370,9 @@ again:
 			/* We really got nothing on this readdir, so don't
 			 * return a dirent.
 			 */
+			if (!state.whence_search)
+				mdc_bloom_progress(directory, whence, cur_prev,
+						   *eod_met);
 			*dirent = NULL;
 			LogDebugAlt(COMPONENT_NFS_READDIR,
 				    COMPONENT_CACHE_INODE,
@@ -2629,6 +3405,9 @@ again:
 				*eod_met ? " EOD" : "");
 	}
 
+	if (!state.whence_search)
+		mdc_bloom_progress(directory, whence, chunk, *eod_met);
+
 	if (state.whence_search && *dirent == NULL) {
 		if (*eod_met) {
 			/* Did not find cookie. */
@@ -2706,6 +3485,228 @@ again:
 	return status;
 }
 
+struct mdc_dir_readahead {
+	mdcache_entry_t *directory;	/*< Directory, ref'd */
+	struct gsh_export *export;	/*< Export it was read through, ref'd */
+	fsal_cookie_t whence;		/*< Last cookie of the chunk before */
+};
+
+/**
+ * @brief Read the next chunk of a directory in the background
+ *
+ * Only done if the chunk before is still the last one cached and
+ * nothing else has filled in what follows it.
+ *
+ * @param[in] ctx  Thread context, arg is a struct mdc_dir_readahead
+ */
+static void mdc_readahead_run(struct fridgethr_context *ctx)
+{
+	struct mdc_dir_readahead *ra = ctx->arg;
+	mdcache_entry_t *directory = ra->directory;
+	struct root_op_context root_op_context;
+	mdcache_dir_entry_t *last = NULL, *first = NULL;
+	fsal_status_t status;
+	bool eod = false;
+
+	init_root_op_context(&root_op_context, ra->export,
+			     ra->export->fsal_export, 0, 0, UNKNOWN_REQUEST);
+
+	PTHREAD_RWLOCK_wrlock(&directory->content_lock);
+
+	if (test_mde_flags(directory, MDCACHE_TRUST_CONTENT |
+				      MDCACHE_TRUST_DIR_CHUNKS) &&
+	    mdcache_avl_lookup_ck(directory, ra->whence, &last) &&
+	    !last->eod && last->chunk->next_ck == 0 &&
+	    glist_last_entry(&last->chunk->dirents, mdcache_dir_entry_t,
+			     chunk_list) == last) {
+		status = mdcache_populate_dir_chunk(directory, ra->whence,
+						    &first, last->chunk, &eod);
+
+		/* As in mdcache_readdir_chunked() after populating a
+		 * chunk that does not start the directory.
+		 */
+		if (!FSAL_IS_ERROR(status))
+			atomic_clear_uint32_t_bits(&directory->mde_flags,
+						   MDCACHE_DIR_POPULATED);
+
+		LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
+				"Readahead of %p after %"PRIx64" status=%s%s",
+				directory, ra->whence, fsal_err_txt(status),
+				eod ? " EOD" : "");
+	}
+
+	PTHREAD_RWLOCK_unlock(&directory->content_lock);
+
+	atomic_clear_uint32_t_bits(&directory->mde_flags,
+				   MDCACHE_DIR_READAHEAD);
+
+	release_root_op_context();
+	put_gsh_export(ra->export);
+	mdcache_put(directory);
+	gsh_free(ra);
+}
+
+/**
+ * @brief Queue a background read of the chunk after this one
+ *
+ * Called with the content_lock held as a readdir enters a chunk.  At
+ * most one read ahead is queued per directory.
+ *
+ * @param[in] directory  The directory
+ * @param[in] chunk      The chunk being read
+ */
+static void mdc_readahead(mdcache_entry_t *directory, struct dir_chunk *chunk)
+{
+	struct mdc_dir_readahead *ra;
+	mdcache_dir_entry_t *last;
+	int rc;
+
+	if (chunk->next_ck != 0)
+		return;	/* Next chunk is cached */
+
+	last = glist_last_entry(&chunk->dirents, mdcache_dir_entry_t,
+				chunk_list);
+	if (last == NULL || last->eod)
+		return;
+
+	if (atomic_postset_uint32_t_bits(&directory->mde_flags,
+					 MDCACHE_DIR_READAHEAD) &
+	    MDCACHE_DIR_READAHEAD)
+		return;	/* Already queued */
+
+	if (FSAL_IS_ERROR(mdcache_get(directory))) {
+		atomic_clear_uint32_t_bits(&directory->mde_flags,
+					   MDCACHE_DIR_READAHEAD);
+		return;
+	}
+
+	ra = gsh_malloc(sizeof(*ra));
+	ra->directory = directory;
+	ra->export = op_ctx->ctx_export;
+	ra->whence = last->ck;
+	get_gsh_export_ref(ra->export);
+
+	rc = fridgethr_submit(general_fridge, mdc_readahead_run, ra);
+	if (rc != 0) {
+		LogDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
+			    "Could not queue readahead of %p, rc=%d",
+			    directory, rc);
+		put_gsh_export(ra->export);
+		mdcache_put(directory);
+		gsh_free(ra);
+		atomic_clear_uint32_t_bits(&directory->mde_flags,
+					   MDCACHE_DIR_READAHEAD);
+	}
+}
+
+/** Entries gathered before calling a batched readdir callback */
+#define MDC_READDIR_BATCH 32
+
+struct mdc_readdir_batch {
+	fsal_readdir_batch_cb cb;	/*< Callback to the upper layer */
+	void *dir_state;		/*< Its state */
+	unsigned int count;		/*< Entries gathered */
+	bool eod;			/*< The last entry ends the directory */
+	fsal_cookie_t last_ck;		/*< Cookie of the last entry consumed */
+	const char *last_name;		/*< And its name */
+	struct fsal_readdir_entry entries[MDC_READDIR_BATCH];
+};
+
+/**
+ * @brief Hand the entries gathered by readdir to the callback
+ *
+ * Must be called with the content_lock held, the names belong to the
+ * dirents.
+ *
+ * @param[in]  batch    The batch
+ * @param[out] eod_met  Set to the eod marker when readdir is done
+ *
+ * @return true if readdir is done.
+ */
+static bool mdc_readdir_flush(struct mdc_readdir_batch *batch, bool *eod_met)
+{
+	enum fsal_dir_result cb_result;
+	unsigned int consumed = 0;
+	unsigned int count = batch->count;
+	bool eod = batch->eod;
+
+	if (count == 0)
+		return false;
+
+	batch->count = 0;
+	batch->eod = false;
+
+	cb_result = batch->cb(batch->entries, count, &consumed,
+			      batch->dir_state);
+
+	if (consumed != 0) {
+		batch->last_ck = batch->entries[consumed - 1].cookie;
+		batch->last_name = batch->entries[consumed - 1].name;
+	}
+
+	LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
+			"batch of %u, consumed %u, cb_result = %s, eod = %s",
+			count, consumed, fsal_dir_result_str(cb_result),
+			eod ? "true" : "false");
+
+	if (cb_result < DIR_TERMINATE && !eod)
+		return false;
+
+	/* Caller is done, or we have reached the end of the directory.
+	 *
+	 * If cb_result is DIR_TERMINATE, the callback did not consume an
+	 * entry, so we can not have reached end of directory.
+	 */
+	*eod_met = cb_result != DIR_TERMINATE && eod;
+	return true;
+}
+
+/**
+ * @brief Finish a chunked readdir that the callback is done with
+ *
+ * @param[in] directory  The directory, content_lock held
+ * @param[in] whence     Where the readdir started
+ * @param[in] batch      The batch, flushed
+ * @param[in] eod_met    Whether the end of directory was reached
+ *
+ * @return FSAL status
+ */
+static fsal_status_t mdc_readdir_done(mdcache_entry_t *directory,
+				      fsal_cookie_t whence,
+				      struct mdc_readdir_batch *batch,
+				      bool eod_met)
+{
+	/* The next readdir of a sequential reader starts here */
+	atomic_store_uint64_t(&directory->fsobj.fsdir.last_ck,
+			      batch->last_ck);
+
+	if (!eod_met && batch->last_name != NULL &&
+	    op_ctx->fsal_export->exp_ops.fs_supports(op_ctx->fsal_export,
+						     fso_whence_is_name)) {
+		/* The client will come back with this cookie, maybe after
+		 * its chunk has been reaped.
+		 */
+		mdcache_avl_resume_insert(directory, batch->last_ck,
+					  batch->last_name);
+	}
+
+	if (eod_met && whence == 0) {
+		/* Since eod is true and whence is 0, we know
+		 * the entire directory is populated.
+		 */
+		atomic_set_uint32_t_bits(&directory->mde_flags,
+					 MDCACHE_DIR_POPULATED);
+	}
+
+	LogDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
+		    "readdir completed, eod = %s",
+		    eod_met ? "true" : "false");
+
+	PTHREAD_RWLOCK_unlock(&directory->content_lock);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
 /**
  * @brief Read the contents of a directory
  *
@@ -2743,7 +3744,7 @@ again:
  * @param[in] directory  The directory to read
  * @param[in] whence     Where to start (next)
  * @param[in] dir_state  Pass thru of state to callback
- * @param[in] cb         Callback function
+ * @param[in] cb         Batch callback function
  * @param[in] attrmask   Which attributes to fill
  * @param[out] eod_met   eod marker true == end of dir
  *
@@ -2753,7 +3754,7 @@ again:
 fsal_status_t mdcache_readdir_chunked(mdcache_entry_t *directory,
 				      fsal_cookie_t whence,
 				      void *dir_state,
-				      fsal_readdir_cb cb,
+				      fsal_readdir_batch_cb cb,
 				      attrmask_t attrmask,
 				      bool *eod_met)
 {
@@ -2764,6 +3765,11 @@ fsal_status_t mdcache_readdir_chunked(mdcache_entry_t *directory,
 	bool first_pass = true;
 	bool eod = false;
 	bool reload_chunk = false;
+	bool sequential;
+	struct mdc_readdir_batch batch = {
+		.cb = cb,
+		.dir_state = dir_state,
+	};
 
 #ifdef USE_LTTNG
 	tracepoint(mdcache, mdc_readdir,
@@ -2802,6 +3808,11 @@ fsal_status_t mdcache_readdir_chunked(mdcache_entry_t *directory,
 	/* We need to know if we need to set first_ck. */
 	set_first_ck = whence == 0 && look_ck == 0;
 
+	/* Carrying on from where the last readdir stopped */
+	sequential = mdcache_param.dir.readahead && whence != 0 &&
+		     whence == atomic_fetch_uint64_t(
+					&directory->fsobj.fsdir.last_ck);
+
 again:
 	/* Get here on first pass, retry if we don't hold the write lock,
 	 * and repeated passes if we need to fetch another chunk.
@@ -2833,7 +3844,8 @@ again:
 
 		if (op_ctx->fsal_export->exp_ops.fs_supports(
 				op_ctx->fsal_export, fso_whence_is_name)
-		    && first_pass && directory->fsobj.fsdir.first_ck != 0) {
+		    && first_pass && directory->fsobj.fsdir.first_ck != 0
+		    && mdcache_avl_resume_lookup(directory, next_ck) == NULL) {
 			/* If whence must be the directory entry name we wish
 			 * to continue from, we need to start at the beginning
 			 * of the directory and readdir until we find the
@@ -2961,6 +3973,7 @@ again:
 		 * something went wrong at some point. That chunk is valid,
 		 */
 		chunk = dirent->chunk;
+		mdcache_stat_inc(MDC_STAT_CHUNK_HIT);
 
 		LogFullDebugAlt(COMPONENT_NFS_READDIR,
 				COMPONENT_CACHE_INODE,
@@ -2971,6 +3984,10 @@ again:
 	/* Bump the chunk in the LRU */
 	lru_bump_chunk(chunk);
 
+	/* Get the next chunk going while the caller reads this one */
+	if (sequential)
+		mdc_readahead(directory, chunk);
+
 	LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
 			"About to read directory=%p cookie=%" PRIx64,
 			directory, next_ck);
@@ -2985,9 +4002,9 @@ again:
 				       chunk_list,
 				       &dirent->chunk_list)) {
 		fsal_status_t status;
-		enum fsal_dir_result cb_result;
 		mdcache_entry_t *entry = NULL;
 		struct attrlist attrs;
+		struct fsal_readdir_entry *out;
 
 		if (dirent->flags & DIR_ENTRY_FLAG_DELETED) {
 			/* Skip deleted entries */
@@ -3005,6 +4022,14 @@ again:
 					"Lookup by key for %s failed, lookup by name now",
 					dirent->name);
 
+			/* Whatever happens next may drop the lock or change
+			 * the chunk, deliver what we have while the names are
+			 * still good.
+			 */
+			if (mdc_readdir_flush(&batch, eod_met))
+				return mdc_readdir_done(directory, whence,
+							&batch, *eod_met);
+
 			/* mdc_lookup_uncached needs write lock, dropping the
 			 * read lock means we can no longer trust the dirent or
 			 * the chunk.
@@ -3120,20 +4145,29 @@ again:
 
 		status = entry->obj_handle.obj_ops->getattrs(&entry->obj_handle,
 							    &attrs);
-		if (FSAL_IS_ERROR(status)) {
-			PTHREAD_RWLOCK_unlock(&directory->content_lock);
 
+		/* The callback is given the cached attributes, the copy was
+		 * only to make sure they are valid.
+		 */
+		fsal_release_attrs(&attrs);
+
+		if (dirent->flags & DIR_ENTRY_REFFED) {
+			/* Put mdc_readdir_chunk_object()'s ref */
+			mdcache_put(entry);
+			dirent->flags &= ~DIR_ENTRY_REFFED;
+		}
+
+		if (FSAL_IS_ERROR(status)) {
 			LogFullDebugAlt(COMPONENT_NFS_READDIR,
 					COMPONENT_CACHE_INODE,
 					"getattrs failed status=%s",
 					fsal_err_txt(status));
 
-			if (dirent->flags & DIR_ENTRY_REFFED) {
-				/* Put mdc_readdir_chunk_object()'s ref */
-				mdcache_put(entry);
-				dirent->flags &= ~DIR_ENTRY_REFFED;
-			}
 			mdcache_put(entry);
+
+			/* Entries before this one were read fine */
+			(void) mdc_readdir_flush(&batch, eod_met);
+			PTHREAD_RWLOCK_unlock(&directory->content_lock);
 			return status;
 		}
 
@@ -3142,55 +4176,34 @@ again:
 		   __func__, __LINE__, dirent->name, &entry->obj_handle,
 		   entry->sub_handle, entry->lru.refcnt);
 #endif
-		cb_result = cb(dirent->name, &entry->obj_handle, &entry->attrs,
-			       dir_state, next_ck);
-
-		fsal_release_attrs(&attrs);
-
-		if (dirent->flags & DIR_ENTRY_REFFED) {
-			/* Put mdc_readdir_chunk_object()'s ref */
-			mdcache_put(entry);
-			dirent->flags &= ~DIR_ENTRY_REFFED;
-		}
+		out = &batch.entries[batch.count++];
+		out->name = dirent->name;
+		out->obj = &entry->obj_handle;
+		out->attrs = &entry->attrs;
+		out->cookie = next_ck;
+		batch.eod = dirent->eod;
 
 		LogFullDebugAlt(COMPONENT_NFS_READDIR, COMPONENT_CACHE_INODE,
-				"dirent = %p %s, cb_result = %s, eod = %s",
-				dirent, dirent->name,
-				fsal_dir_result_str(cb_result),
+				"dirent = %p %s, batch = %u, eod = %s",
+				dirent, dirent->name, batch.count,
 				dirent->eod ? "true" : "false");
 
-		if (cb_result >= DIR_TERMINATE || dirent->eod) {
-			/* Caller is done, or we have reached the end of
-			 * the directory, no need to get another dirent.
-			 */
-
-			/* If cb_result is DIR_TERMINATE, the callback did
-			 * not consume this entry, so we can not have reached
-			 * end of directory.
-			 */
-			*eod_met = cb_result != DIR_TERMINATE && dirent->eod;
-
-			if (*eod_met && whence == 0) {
-				/* Since eod is true and whence is 0, we know
-				 * the entire directory is populated.
-				 */
-				atomic_set_uint32_t_bits(&directory->mde_flags,
-							 MDCACHE_DIR_POPULATED);
-			}
-
-			LogDebugAlt(COMPONENT_NFS_READDIR,
-				    COMPONENT_CACHE_INODE,
-				    "readdir completed, eod = %s",
-				    *eod_met ? "true" : "false");
-
-			PTHREAD_RWLOCK_unlock(&directory->content_lock);
-
-			return status;
-		}
+		/* At the end of the directory there is no need to get
+		 * another dirent.
+		 */
+		if ((batch.count == MDC_READDIR_BATCH || dirent->eod) &&
+		    mdc_readdir_flush(&batch, eod_met))
+			return mdc_readdir_done(directory, whence, &batch,
+					*eod_met);
 
 		reload_chunk = false;
 	}
 
+	/* Getting the next chunk may change this one */
+	if (mdc_readdir_flush(&batch, eod_met))
+		return mdc_readdir_done(directory, whence, &batch,
+					*eod_met);
+
 	if (chunk->next_ck != 0) {
 		/* If the chunk has a known chunk following it, use the first
 		 * cookie in that chunk for AVL tree lookup, which will succeed
@@ -3267,6 +4280,7 @@ _mdcache_kill_entry(mdcache_entry_t *entry,
 	}
 
 	freed = cih_remove_checked(entry); /* !reachable, drop sentinel ref */
+	fsal_obj_invalidate();
 #ifdef USE_LTTNG
 	tracepoint(mdcache, mdc_kill_entry,
 		   function, line, &entry->obj_handle, entry->lru.refcnt,
@@ -3373,6 +4387,9 @@ void mdc_update_attr_cache(mdcache_entry_t *entry, struct attrlist *attrs)
 	 * FSAL provided one for us gratis.
 	 */
 	mdc_fixup_md(entry, &entry->attrs);
+
+	/* A new ACL, fs_locations or label changes what the entry holds */
+	mdcache_lru_account_entry(entry);
 }
 
 /** @} */
@@ -40,6 +40,9 @@
 #include "fsal_up.h"
 #include "fsal_convert.h"
 #include "display.h"
+#include "common_utils.h"
+#include "gsh_intrinsic.h"
+#include "abstract_atomic.h"
 
 typedef struct mdcache_fsal_obj_handle mdcache_entry_t;
 
@@ -78,32 +81,110 @@ struct mdcache_fsal_export {
 	uint8_t flags;
 };
 
+/** Handle bytes a key holds in itself rather than allocating */
+#define MDCACHE_KEY_INLINE 22
+/** Length of the handle prefix keys share, see mdcache_key_store() */
+#define MDCACHE_KEY_PREFIX_LEN 16
+/** Prefixes that can be interned */
+#define MDCACHE_KEY_PREFIXES 255
+
 /**
  * @brief Structure representing a cache key.
  *
- * Wraps an underlying FSAL-specific key.
+ * Wraps an underlying FSAL-specific key.  A key made to look something
+ * up (a prototype) points kv at the caller's handle.  A key kept by an
+ * entry or a dirent owns its bytes.  When the handle starts with an
+ * interned prefix, such as the fsid the handles of a filesystem all
+ * begin with, prefix names it and kv only holds the rest.  Bytes that
+ * fit in kv_inline are kept there, others are allocated.
  */
 typedef struct mdcache_key {
 	uint64_t hk;		/* hash key */
 	void *fsal;		/*< sub-FSAL module */
-	struct gsh_buffdesc kv;		/*< fsal handle */
+	struct gsh_buffdesc kv;		/*< fsal handle, past the prefix */
+	uint8_t prefix;		/*< Interned prefix, 0 for none */
+	uint8_t kv_inline[MDCACHE_KEY_INLINE];	/*< Short kv */
 } mdcache_key_t;
 
+/** Interned prefixes, by number, 0 unused.  Never change once set. */
+extern uint8_t
+mdcache_key_prefixes[MDCACHE_KEY_PREFIXES + 1][MDCACHE_KEY_PREFIX_LEN];
+
+/** Counts of the keys kept, by how their bytes are stored */
+struct mdcache_key_stats {
+	uint64_t inlined;	/*< Keys held in kv_inline */
+	uint64_t allocated;	/*< Keys allocated */
+	uint64_t allocated_bytes;	/*< Bytes allocated */
+	uint64_t prefixed;	/*< Keys sharing an interned prefix */
+	uint32_t prefixes;	/*< Prefixes interned */
+};
+
+extern struct mdcache_key_stats mdcache_key_st;
+
 int display_mdcache_key(struct display_buffer *dspbuf, mdcache_key_t *key);
 
+/**
+ * @brief Length of the handle of a key
+ *
+ * @param[in] key  The key
+ *
+ * @return Length, prefix included.
+ */
+static inline size_t mdcache_key_len(const struct mdcache_key *key)
+{
+	return key->prefix != 0 ? MDCACHE_KEY_PREFIX_LEN + key->kv.len
+				: key->kv.len;
+}
+
+/**
+ * @brief Compare the handles of keys stored differently
+ *
+ * At least one has a prefix, so they are longer than one.
+ *
+ * @param[in] k1   A key
+ * @param[in] k2   Another, of the same length
+ * @param[in] len  That length
+ *
+ * @return As memcmp() of the whole handles.
+ */
+static inline int mdcache_key_cmp_split(const struct mdcache_key *k1,
+					const struct mdcache_key *k2,
+					size_t len)
+{
+	const uint8_t *h1 = k1->prefix != 0 ? mdcache_key_prefixes[k1->prefix]
+					    : (const uint8_t *) k1->kv.addr;
+	const uint8_t *h2 = k2->prefix != 0 ? mdcache_key_prefixes[k2->prefix]
+					    : (const uint8_t *) k2->kv.addr;
+	const uint8_t *t1 = k1->prefix != 0 ? (const uint8_t *) k1->kv.addr
+					    : h1 + MDCACHE_KEY_PREFIX_LEN;
+	const uint8_t *t2 = k2->prefix != 0 ? (const uint8_t *) k2->kv.addr
+					    : h2 + MDCACHE_KEY_PREFIX_LEN;
+	int rc = memcmp(h1, h2, MDCACHE_KEY_PREFIX_LEN);
+
+	if (rc != 0)
+		return rc;
+
+	return memcmp(t1, t2, len - MDCACHE_KEY_PREFIX_LEN);
+}
+
 static inline int mdcache_key_cmp(const struct mdcache_key *k1,
 				  const struct mdcache_key *k2)
 {
+	size_t len1, len2;
+
 	if (likely(k1->hk < k2->hk))
 		return -1;
 
 	if (likely(k1->hk > k2->hk))
 		return 1;
 
-	if (unlikely(k1->kv.len < k2->kv.len))
+	len1 = mdcache_key_len(k1);
+	len2 = mdcache_key_len(k2);
+
+	if (unlikely(len1 < len2))
 		return -1;
 
-	if (unlikely(k1->kv.len > k2->kv.len))
+	if (unlikely(len1 > len2))
 		return 1;
 
 	if (unlikely(k1->fsal < k2->fsal))
@@ -112,10 +193,25 @@ static inline int mdcache_key_cmp(const struct mdcache_key *k1,
 	if (unlikely(k1->fsal > k2->fsal))
 		return 1;
 
-	/* deep compare */
-	return memcmp(k1->kv.addr,
-		      k2->kv.addr,
-		      k1->kv.len);
+	/* deep compare, the rest when the prefixes are the same */
+	if (likely(k1->prefix == k2->prefix))
+		return memcmp(k1->kv.addr,
+			      k2->kv.addr,
+			      k1->kv.len);
+
+	return mdcache_key_cmp_split(k1, k2, len1);
+}
+
+/**
+ * @brief Bytes allocated for a key
+ *
+ * @param[in] key  The key, owning its bytes
+ *
+ * @return Bytes.
+ */
+static inline size_t mdcache_key_allocated(const struct mdcache_key *key)
+{
+	return key->kv.addr != key->kv_inline ? key->kv.len : 0;
 }
 
 /**
@@ -134,6 +230,7 @@ enum lru_q_id {
 
 #define LRU_CLEANUP 0x00000001 /* Entry is on cleanup queue */
 #define LRU_CLEANED 0x00000002 /* Entry has been cleaned */
+#define LRU_PROBATION 0x00000004 /* 2Q: entry not yet seen reused */
 
 typedef struct mdcache_lru__ {
 	struct glist_head q;	/*< Link in the physical deque
@@ -148,6 +245,9 @@ typedef struct mdcache_lru__ {
 				 *< decrement the correct counter when moving
 				 *< or deleting the entry. */
 	uint32_t cf;		/*< Confounder */
+	uint32_t epoch;		/*< LRU thread pass at insertion, so the
+				 *< 2Q policy can tell a reuse from
+				 *< correlated references. */
 } mdcache_lru_t;
 
 /**
@@ -160,10 +260,74 @@ struct mdcache_stats {
 	uint64_t inode_conf;
 	uint64_t inode_added;
 	uint64_t inode_mapping;
+	uint64_t lru_2q_hit;	/*< Probationary entries found reused */
+	uint64_t lru_2q_miss;	/*< New entries put on probation */
+	uint64_t lru_2q_ghost_hit; /*< New entries recently evicted */
+	uint64_t attr_trusted;	/*< Attributes served past their expiry */
+	uint64_t attr_refreshed; /*< Getattrs that went to the sub-FSAL */
+	uint64_t xattr_hit;	/*< Xattr gets and lists served cached */
+	uint64_t xattr_miss;	/*< Xattr gets and lists that went down */
 };
 
 extern struct mdcache_stats *cache_stp;
 
+/**
+ * What the cache saved the sub-FSAL, and why entries leave it.
+ *
+ * These are counted on the hot paths, so unlike mdcache_stats each
+ * thread counts in its own shard and ShowCacheInode adds them up.
+ */
+enum mdcache_stat {
+	MDC_STAT_LOOKUP_HIT,	/*< Names found in the dirent cache */
+	MDC_STAT_LOOKUP_MISS,	/*< Names looked up in the sub-FSAL */
+	MDC_STAT_LOOKUP_NEG_HIT, /*< Names the cache knew did not exist */
+	MDC_STAT_ATTR_HIT,	/*< Getattrs served from the cache */
+	MDC_STAT_ATTR_MISS,	/*< Getattrs that refreshed the attributes */
+	MDC_STAT_ATTR_EXPIRED,	/*< Of those, refreshes of trusted
+				 *< attributes that timed out */
+	MDC_STAT_CHUNK_HIT,	/*< Readdir chunks found cached */
+	MDC_STAT_CHUNK_FILL,	/*< Readdir chunks read from the sub-FSAL */
+	MDC_STAT_REAP_ALLOC,	/*< Entries recycled to make a new one */
+	MDC_STAT_REAP_TRIM,	/*< Entries freed by the LRU thread */
+	MDC_STAT_DEMOTE,	/*< Entries moved from L1 to L2 */
+	MDC_STAT_FD_RECLAIM,	/*< Files closed on demotion */
+	MDC_STAT_CHUNK_REAP,	/*< Chunks recycled to make a new one */
+	MDC_STAT_SYMLINK_HIT,	/*< Readlinks served from the cache */
+	MDC_STAT_SYMLINK_MISS,	/*< Readlinks that went to the sub-FSAL */
+	MDC_STAT_PARENT_HIT,	/*< ".." resolved from the parent key */
+	MDC_STAT_PARENT_MISS,	/*< ".." looked up in the sub-FSAL */
+	MDC_STAT_CHUNK_SPILL,	/*< Reaped chunks saved to the chunk store */
+	MDC_STAT_CHUNK_RESTORE,	/*< Chunks read back from the chunk store */
+	MDC_STAT_COUNT
+};
+
+#define MDC_STAT_SHARDS 16
+
+struct mdcache_stat_shard {
+	uint64_t count[MDC_STAT_COUNT];
+} __attribute__((__aligned__(GSH_CACHE_LINE_SIZE)));
+
+extern struct mdcache_stat_shard mdcache_stat_shards[MDC_STAT_SHARDS];
+extern __thread int mdcache_stat_shard_ix;
+
+int mdcache_stat_pick_shard(void);
+uint64_t mdcache_stat_get(enum mdcache_stat stat);
+
+/**
+ * @brief Count an event in the calling thread's shard
+ *
+ * @param[in] stat  What happened
+ */
+static inline void mdcache_stat_inc(enum mdcache_stat stat)
+{
+	int ix = mdcache_stat_shard_ix;
+
+	if (unlikely(ix < 0))
+		ix = mdcache_stat_pick_shard();
+
+	(void)atomic_inc_uint64_t(&mdcache_stat_shards[ix].count[stat]);
+}
+
 /**
  * @brief Represents one of the many-many links between inodes and exports.
  *
@@ -198,8 +362,16 @@ struct entry_export_map {
 #define MDCACHE_TRUST_FS_LOCATIONS FSAL_UP_INVALIDATE_FS_LOCATIONS
 /** The sec_labels are considered valid */
 #define MDCACHE_TRUST_SEC_LABEL FSAL_UP_INVALIDATE_SEC_LABEL
+/** The cached xattrs are considered valid */
+#define MDCACHE_TRUST_XATTRS FSAL_UP_INVALIDATE_XATTRS
 /** The entry has been removed, but not unhashed due to state */
 static const uint32_t MDCACHE_UNREACHABLE = 0x100;
+/** A background read of the next directory chunk is queued */
+static const uint32_t MDCACHE_DIR_READAHEAD = 0x1000;
+/** Negative dirents and the bloom filter may answer lookups */
+static const uint32_t MDCACHE_DIR_NEGATIVE = 0x2000;
+/** The bloom filter holds every name in the directory */
+static const uint32_t MDCACHE_DIR_BLOOM = 0x4000;
 
 
 /**
@@ -220,7 +392,12 @@ static const uint32_t MDCACHE_UNREACHABLE = 0x100;
  *     content of a symlink or when NULLing the object.symlink pointer
  *     preparatory to freeing the link structure.  It must be held for
  *     READ when dereferencing the object.symlink pointer or reading
- *     cached content. XXX dang symlink content is in FSAL now
+ *     cached content.  The content is in the symlink field.
+ *
+ * (4) Creates, links, unlinks and renames hold the name locks of the
+ *     names they change across the sub-FSAL call, and only take the
+ *     content_lock of a directory to update its dirents afterwards.
+ *     Name locks are taken before any content_lock.
  *
  * The handle, cache key, and type fields are unprotected, as they are
  * considered to be immutable throughout the life of the object.
@@ -244,6 +421,24 @@ static const uint32_t MDCACHE_UNREACHABLE = 0x100;
  * stuff the the fsal has to manage, i.e. filesystem bits.
  */
 
+/**
+ * @brief Attributes completed writes changed
+ *
+ * With Lockless_Write_Attrs, a write that completes records what it did
+ * to a regular file here with atomics, instead of making the cached
+ * attributes untrusted, and GETATTR lays it over the cached attributes.
+ * Writers bump begin before updating the fields and end after, so a
+ * reader that reads end, then the fields, then finds begin equal to it
+ * has a snapshot no write was in the middle of.
+ */
+struct mdc_write_attrs {
+	uint64_t begin;		/*< Writes that started recording */
+	uint64_t end;		/*< Writes done recording */
+	uint64_t size;		/*< Highest offset + length written */
+	uint64_t time;		/*< Latest write, ns since the epoch */
+	uint64_t writes;	/*< Writes recorded */
+};
+
 struct mdcache_fsal_obj_handle {
 	/** Reader-writer lock for attributes */
 	pthread_rwlock_t attr_lock;
@@ -263,10 +458,48 @@ struct mdcache_fsal_obj_handle {
 	uint32_t mde_flags;
 	/** Time at which we last refreshed attributes. */
 	time_t attr_time;
+	/** Attribute refreshes done, under attr_lock */
+	uint32_t attr_generation;
 	/** Time at which we last refreshed acl. */
 	time_t acl_time;
 	/** Time at which we last refreshed fs locations */
 	time_t fs_locations_time;
+	/** Bytes charged to lru_state.entry_bytes for this entry */
+	size_t mem_bytes;
+	/** Read stream of a regular file, updated atomically without a
+	    lock.  Racing readers can only make a guess worse. */
+	struct {
+		/** Offset a sequential read would come next at */
+		uint64_t next;
+		/** End of what the sub-FSAL was asked to read ahead */
+		uint64_t end;
+		/** Bytes read ahead of the reader, 0 until sequential */
+		uint64_t window;
+	} ra;
+	/** What writes did since the attributes were fetched, see
+	    mdc_write_attrs_record() */
+	struct mdc_write_attrs wattrs;
+	/** Extended attributes, protected by attr_lock */
+	struct {
+		/** Cached xattrs, and names known absent */
+		struct glist_head list;
+		/** Bytes charged to lru_state.xattr_bytes for the list */
+		size_t bytes;
+		/** Change attribute the list was read at */
+		uint64_t change;
+		/** The list holds every xattr of the file, so a name not on
+		    it is absent */
+		bool complete;
+	} xattrs;
+	/** Content of a symlink, protected by content_lock */
+	struct {
+		/** Cached target, NULL if not cached */
+		char *content;
+		/** Bytes of content, charged to lru_state.symlink_bytes */
+		size_t len;
+		/** Change attribute the content was read at */
+		uint64_t change;
+	} symlink;
 	/** New style LRU link */
 	mdcache_lru_t lru;
 	/** Exports per entry (protected by attr_lock) */
@@ -314,6 +547,10 @@ struct mdcache_fsal_obj_handle {
 			 *  0 if not known.
 			 */
 			fsal_cookie_t first_ck;
+			/** Cookie of the last entry the previous readdir
+			 *  returned, to spot sequential reads.
+			 */
+			fsal_cookie_t last_ck;
 			struct {
 				/** Children by name hash */
 				struct avltree t;
@@ -324,6 +561,34 @@ struct mdcache_fsal_obj_handle {
 				/** Heuristic. Expect 0. */
 				uint32_t collisions;
 			} avl;
+			struct {
+				/** Names known not to exist, by name hash */
+				struct avltree t;
+				/** The same, oldest first */
+				struct glist_head lru;
+				/** Number of negative dirents */
+				uint32_t count;
+				/** Bloom filter of the names in the directory,
+				 *  Dir_Bloom_Bits long, or NULL.
+				 */
+				uint64_t *bloom;
+				/** Cookie the filter has been built up to */
+				fsal_cookie_t bloom_ck;
+				/** Time at which the filter was completed */
+				time_t bloom_time;
+			} neg;
+			struct {
+				/** Cookies handed out at the end of a readdir,
+				 *  by cookie, with the name of their dirent.
+				 *  Protected by spin for insertion under the
+				 *  content_lock held for read.
+				 */
+				struct avltree t;
+				/** The same, oldest first */
+				struct glist_head lru;
+				/** Number of resume points */
+				uint32_t count;
+			} resume;
 		} fsdir;		/**< DIRECTORY data */
 	} fsobj;
 };
@@ -345,8 +610,43 @@ struct dir_chunk {
 	fsal_cookie_t next_ck;
 	/** Number of entries in chunk */
 	int num_entries;
+	/** Number of entries at which the chunk is full */
+	uint32_t size;
+	/** Block the dirents read into this chunk are carved from */
+	struct dir_block *block;
+};
+
+/** Bytes of each block dirents are carved from */
+#define DIR_BLOCK_SIZE (32 * 1024)
+
+/**
+ * @brief A block the dirents read into a chunk are carved from
+ *
+ * The dirents a readdir fills a chunk with are packed, names and all,
+ * into the chunk's block instead of being allocated one by one.  The
+ * block counts the dirents carved from it that are not freed yet, plus
+ * one while it is the block of its chunk, and is freed when that drops
+ * to zero.  Dirents moved to another chunk by a split thus keep their
+ * block, and reaping a chunk frees its blocks with its last dirents.
+ * Like the dirents, it is protected by the directory's content lock.
+ */
+struct dir_block {
+	/** Bytes carved, this header included */
+	uint32_t used;
+	/** Dirents not freed yet, plus one while current in its chunk */
+	uint32_t refs;
 };
 
+/**
+ * @brief Number of entries at which a chunk should be split
+ *
+ * Make sure it's a multiple of two.
+ */
+static inline uint32_t mdc_chunk_split(struct dir_chunk *chunk)
+{
+	return ((chunk->size * 3) / 2) & (UINT32_MAX - 1);
+}
+
 #define mdc_prev_chunk(c) glist_prev_entry(&(c)->parent->fsobj.fsdir.chunks, \
 			struct dir_chunk, chunks, &(c)->chunks)
 
@@ -364,34 +664,75 @@ struct dir_chunk {
 #define DIR_ENTRY_SORTED        0x0004
 
 typedef struct mdcache_dir_entry__ {
-	/** This dirent is part of a chunk */
-	struct glist_head chunk_list;
-	/** The chunk this entry belongs to */
-	struct dir_chunk *chunk;
+	/* The tree nodes come first, each followed by the key it is
+	 * ordered by, so a descent of the name or cookie tree touches one
+	 * cache line per level rather than two.
+	 */
 	/** node in tree by name */
 	struct avltree_node node_name;
+	/** Name Hash */
+	uint64_t namehash;
 	/** AVL node in tree by cookie */
 	struct avltree_node node_ck;
-	/** AVL node in tree by sorted order */
-	struct avltree_node node_sorted;
 	/** Cookie value from FSAL
 	 *  This is the coookie that is the "key" to find THIS entry, however
 	 *  a readdir with whence will be looking for the NEXT entry.
 	 */
 	uint64_t ck;
+	/** AVL node in tree by sorted order */
+	struct avltree_node node_sorted;
+	/** This dirent is part of a chunk */
+	struct glist_head chunk_list;
+	/** The chunk this entry belongs to */
+	struct dir_chunk *chunk;
+	/** Key of cache entry */
+	mdcache_key_t ckey;
+	/** Flags */
+	uint16_t flags;
 	/** Indicates if this dirent is the last dirent in a chunked directory.
 	 */
 	bool eod;
+	/** Offset of this dirent in its dir_block, 0 if allocated alone */
+	uint32_t block_off;
+	const char *name;
+	/** The NUL-terminated filename */
+	char name_buffer[];
+} mdcache_dir_entry_t;
+
+/**
+ * @brief A name a directory is known not to hold
+ */
+typedef struct mdcache_neg_dirent {
+	/** AVL node in tree by name hash */
+	struct avltree_node node;
+	/** Position on the directory's list, oldest first */
+	struct glist_head lru;
 	/** Name Hash */
 	uint64_t namehash;
-	/** Key of cache entry */
-	mdcache_key_t ckey;
-	/** Flags */
-	uint32_t flags;
+	/** Time after which the name must be looked up again */
+	time_t expire;
 	const char *name;
 	/** The NUL-terminated filename */
 	char name_buffer[];
-} mdcache_dir_entry_t;
+} mdcache_neg_dirent_t;
+
+/**
+ * @brief Where a readdir left off, kept after its chunk is reaped
+ *
+ * An FSAL that takes the name of the last dirent as whence can resume
+ * from it directly instead of reading the directory from the start to
+ * find the cookie.
+ */
+typedef struct mdcache_resume_ck {
+	/** AVL node in tree by cookie */
+	struct avltree_node node;
+	/** Position on the directory's list, oldest first */
+	struct glist_head lru;
+	/** Cookie handed out */
+	fsal_cookie_t ck;
+	/** The NUL-terminated name of the dirent with that cookie */
+	char name[];
+} mdcache_resume_ck_t;
 
 /**
  * @brief Move a detached dirent to MRU postion in LRU list.
@@ -444,12 +785,21 @@ fsal_status_t mdcache_alloc_and_check_handle(
 		const char *tag,
 		mdcache_entry_t *parent,
 		const char *name,
+		bool parent_locked,
 		bool *invalidate,
 		struct state_t *state);
 
 fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl,
-				    bool need_fslocations, bool invalidate);
-
+				    bool need_fslocations, bool need_seclabel,
+				    bool invalidate);
+
+void mdcache_new_entries(struct mdcache_fsal_export *export,
+			 unsigned int count,
+			 struct fsal_obj_handle **sub_handles,
+			 struct attrlist **attrs_in,
+			 mdcache_entry_t **entries,
+			 fsal_status_t *statuses,
+			 mdc_reason_t reason);
 fsal_status_t mdcache_new_entry(struct mdcache_fsal_export *exp,
 				struct fsal_obj_handle *sub_handle,
 				struct attrlist *attrs_in,
@@ -476,6 +826,17 @@ fsal_status_t mdc_lookup_uncached(mdcache_entry_t *mdc_parent,
 				  const char *name,
 				  mdcache_entry_t **new_entry,
 				  struct attrlist *attrs_out);
+/** Stripes of the name locks */
+#define MDC_NAME_LOCKS 1024
+
+void mdcache_name_locks_init(void);
+void mdcache_lookup_flights_init(void);
+void mdcache_name_lock(mdcache_entry_t *dir, const char *name);
+void mdcache_name_unlock(mdcache_entry_t *dir, const char *name);
+void mdcache_name_lock2(mdcache_entry_t *src, const char *sname,
+			mdcache_entry_t *dest, const char *dname);
+void mdcache_name_unlock2(mdcache_entry_t *src, const char *sname,
+			  mdcache_entry_t *dest, const char *dname);
 void mdcache_src_dest_lock(mdcache_entry_t *src, mdcache_entry_t *dest);
 void mdcache_src_dest_unlock(mdcache_entry_t *src, mdcache_entry_t *dest);
 void mdcache_dirent_remove(mdcache_entry_t *parent, const char *name);
@@ -496,7 +857,7 @@ void place_new_dirent(mdcache_entry_t *parent_dir,
 fsal_status_t mdcache_readdir_chunked(mdcache_entry_t *directory,
 				      fsal_cookie_t whence,
 				      void *dir_state,
-				      fsal_readdir_cb cb,
+				      fsal_readdir_batch_cb cb,
 				      attrmask_t attrmask,
 				      bool *eod_met);
 
@@ -532,6 +893,7 @@ static inline struct mdcache_fsal_export *mdc_cur_export(void)
 
 void mdc_clean_entry(mdcache_entry_t *entry);
 fsal_status_t mdc_check_mapping(mdcache_entry_t *entry);
+bool mdc_export_immutable(void);
 void _mdcache_kill_entry(mdcache_entry_t *entry,
 			 char *file, int line, char *function);
 
@@ -548,20 +910,74 @@ mdc_get_parent_handle(struct mdcache_fsal_export *exp,
 
 extern struct config_block mdcache_param_blk;
 
+/**
+ * @brief Start timing a sub-FSAL call, for the request stages
+ *
+ * Calls the sub-FSAL makes back up into MDCACHE are part of the one
+ * it was called with, so only the outermost call is timed.
+ *
+ * @param[out] start	When the call starts
+ *
+ * @return true if the call is timed.
+ */
+static inline bool mdc_fsal_time_start(struct timespec *start)
+{
+	if (likely(op_ctx == NULL || !op_ctx->time_fsal) || op_ctx->in_fsal)
+		return false;
+
+	op_ctx->in_fsal = true;
+	now(start);
+	return true;
+}
+
+/**
+ * @brief Account for a timed sub-FSAL call
+ *
+ * @param[in] start	When the call started
+ * @param[in] func	Function that made it, for the slow request log
+ */
+static inline void mdc_fsal_time_end(const struct timespec *start,
+				     const char *func)
+{
+	struct timespec end;
+	nsecs_elapsed_t duration;
+
+	now(&end);
+	duration = timespec_diff(start, &end);
+	op_ctx->fsal_time += duration;
+	op_ctx->in_fsal = false;
+
+	if (op_ctx->fsal_calls == NULL)
+		return;
+	if (op_ctx->fsal_ncalls < REQ_FSAL_CALLS) {
+		op_ctx->fsal_calls[op_ctx->fsal_ncalls].func = func;
+		op_ctx->fsal_calls[op_ctx->fsal_ncalls].duration = duration;
+	}
+	op_ctx->fsal_ncalls++;
+}
+
 /* Call a sub-FSAL function using it's export, safe for use during shutdown */
 #define subcall_shutdown_raw(myexp, call) do { \
+	struct timespec __start; \
+	bool __timed = mdc_fsal_time_start(&__start); \
 	if (op_ctx) \
 		op_ctx->fsal_export = (myexp)->mfe_exp.sub_export; \
 	call; \
 	if (op_ctx) \
 		op_ctx->fsal_export = &(myexp)->mfe_exp; \
+	if (__timed) \
+		mdc_fsal_time_end(&__start, __func__); \
 } while (0)
 
 /* Call a sub-FSAL function using it's export */
 #define subcall_raw(myexp, call) do { \
+	struct timespec __start; \
+	bool __timed = mdc_fsal_time_start(&__start); \
 	op_ctx->fsal_export = (myexp)->mfe_exp.sub_export; \
 	call; \
 	op_ctx->fsal_export = &(myexp)->mfe_exp; \
+	if (__timed) \
+		mdc_fsal_time_end(&__start, __func__); \
 } while (0)
 
 /* Call a sub-FSAL function using it's export */
@@ -596,29 +1012,10 @@ typedef struct {
 	int		 count;
 } mdc_lock_context_t;
 
-/**
- * @brief Dup a cache key.
- *
- * Deep copies the key passed in src, to tgt.  On return, tgt->kv.addr
- * is overwritten with a new buffer of length src->kv.len, and the buffer
- * is copied.
- *
- * @param tgt [inout] Destination of copy
- * @param src [in] Source of copy
- *
- * @return 0 on success.
- */
-static inline void
-mdcache_key_dup(mdcache_key_t *tgt,
-		    mdcache_key_t *src)
-{
-	tgt->kv.len = src->kv.len;
-	tgt->kv.addr = gsh_malloc(src->kv.len);
-
-	memcpy(tgt->kv.addr, src->kv.addr, src->kv.len);
-	tgt->hk = src->hk;
-	tgt->fsal = src->fsal;
-}
+void mdcache_key_store(mdcache_key_t *key, const void *addr, size_t len);
+void mdcache_key_dup(mdcache_key_t *tgt, mdcache_key_t *src);
+void mdcache_key_delete(mdcache_key_t *key);
+void mdcache_key_bytes(const mdcache_key_t *key, void *buf);
 
 /**
  * @brief Set the parent key of an entry
@@ -640,23 +1037,6 @@ mdc_dir_add_parent(mdcache_entry_t *entry, mdcache_entry_t *mdc_parent)
 	}
 }
 
-/**
- * @brief Delete a cache key.
- *
- * Delete a cache key. Safe to call even if key was not allocated.
- *
- * @param key [in] The key to delete
- *
- * @return void.
- */
-static inline void
-mdcache_key_delete(mdcache_key_t *key)
-{
-	key->kv.len = 0;
-	gsh_free(key->kv.addr);
-	key->kv.addr = NULL;
-}
-
 /* Create a copy of host-handle */
 static inline void
 mdcache_copy_fh(struct gsh_buffdesc *dest, struct gsh_buffdesc *src)
@@ -784,6 +1164,30 @@ mdcache_test_attrs_trust(mdcache_entry_t *entry, attrmask_t mask)
 	return true;
 }
 
+/**
+ * @brief Check if expired attributes can still be served
+ *
+ * Nothing changes the attributes behind MDCACHE's back when the
+ * sub-FSAL sends an invalidate or update upcall for every change
+ * (Attr_Trust_Upcalls), or while a delegation is outstanding on the
+ * file, since the lease behind it must be recalled first, nor on an
+ * Immutable export.  Either way, the flags tested by
+ * mdcache_test_attrs_trust() are what says the attributes are stale,
+ * not the clock.
+ *
+ * @param[in] entry     The entry to check
+ */
+
+static inline bool mdcache_attrs_until_invalidated(mdcache_entry_t *entry)
+{
+	if (mdcache_param.attr_trust_upcalls || mdc_export_immutable())
+		return true;
+
+	return entry->obj_handle.type == REGULAR_FILE &&
+	       atomic_fetch_uint32_t(&entry->obj_handle.state_hdl->file
+				     .fdeleg_stats.fds_curr_delegations) > 0;
+}
+
 /**
  * @brief Check if attributes are valid
  *
@@ -795,6 +1199,8 @@ mdcache_test_attrs_trust(mdcache_entry_t *entry, attrmask_t mask)
 static inline bool
 mdcache_is_attrs_valid(mdcache_entry_t *entry, attrmask_t mask)
 {
+	bool expired = false;
+
 	if (!mdcache_test_attrs_trust(entry, mask))
 		return false;
 
@@ -802,7 +1208,8 @@ mdcache_is_attrs_valid(mdcache_entry_t *entry, attrmask_t mask)
 		return false;
 
 	if (entry->obj_handle.type == DIRECTORY
-	    && mdcache_param.getattr_dir_invalidation)
+	    && mdcache_param.getattr_dir_invalidation
+	    && !mdc_export_immutable())
 		return false;
 
 	if ((mask & ~ATTR_ACL) != 0 && entry->attrs.expire_time_attr == 0)
@@ -813,7 +1220,7 @@ mdcache_is_attrs_valid(mdcache_entry_t *entry, attrmask_t mask)
 
 		if (current_time - entry->attr_time >
 		    entry->attrs.expire_time_attr)
-			return false;
+			expired = true;
 	}
 
 	if ((mask & ATTR_ACL) != 0 && entry->attrs.expire_time_attr == 0)
@@ -824,12 +1231,132 @@ mdcache_is_attrs_valid(mdcache_entry_t *entry, attrmask_t mask)
 
 		if (current_time - entry->acl_time >
 		    entry->attrs.expire_time_attr)
+			expired = true;
+	}
+
+	if (expired) {
+		if (!mdcache_attrs_until_invalidated(entry))
 			return false;
+		(void)atomic_inc_uint64_t(&cache_stp->attr_trusted);
 	}
 
 	return true;
 }
 
+/** Tries a reader makes at a write attributes snapshot */
+#define MDC_WRITE_ATTRS_TRIES 8
+
+static inline void mdc_atomic_max(uint64_t *var, uint64_t val)
+{
+	uint64_t cur = atomic_fetch_uint64_t(var);
+
+	while (cur < val && !__sync_bool_compare_and_swap(var, cur, val))
+		cur = atomic_fetch_uint64_t(var);
+}
+
+/**
+ * @brief Record a completed write without the attr_lock
+ *
+ * @param[in] entry  Regular file written to
+ * @param[in] end    Offset of the end of the write
+ */
+static inline void mdc_write_attrs_record(mdcache_entry_t *entry,
+					  uint64_t end)
+{
+	struct mdc_write_attrs *w = &entry->wattrs;
+	struct timespec ts;
+
+	now(&ts);
+
+	(void)atomic_inc_uint64_t(&w->begin);
+	mdc_atomic_max(&w->size, end);
+	mdc_atomic_max(&w->time, timespec_to_nsecs(&ts));
+	(void)atomic_inc_uint64_t(&w->writes);
+	(void)atomic_inc_uint64_t(&w->end);
+}
+
+/**
+ * @brief Take a snapshot of the recorded writes
+ *
+ * @param[in]  entry  Regular file
+ * @param[out] snap   Snapshot
+ *
+ * @return false if writes kept recording through every try.
+ */
+static inline bool mdc_write_attrs_get(mdcache_entry_t *entry,
+				       struct mdc_write_attrs *snap)
+{
+	struct mdc_write_attrs *w = &entry->wattrs;
+	int i;
+
+	for (i = 0; i < MDC_WRITE_ATTRS_TRIES; i++) {
+		snap->end = atomic_fetch_uint64_t(&w->end);
+		snap->size = atomic_fetch_uint64_t(&w->size);
+		snap->time = atomic_fetch_uint64_t(&w->time);
+		snap->writes = atomic_fetch_uint64_t(&w->writes);
+		if (atomic_fetch_uint64_t(&w->begin) == snap->end)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Lay recorded writes over attributes
+ *
+ * The size only grows and the times only move forward.  The change
+ * attribute goes up by one for each write.
+ *
+ * @param[in]     snap   Snapshot of the recorded writes
+ * @param[in,out] attrs  Attributes
+ */
+static inline void mdc_write_attrs_apply(const struct mdc_write_attrs *snap,
+					 struct attrlist *attrs)
+{
+	struct timespec ts;
+
+	if (snap->writes == 0)
+		return;
+
+	if ((attrs->valid_mask & ATTR_SIZE) && attrs->filesize < snap->size)
+		attrs->filesize = snap->size;
+
+	if (attrs->valid_mask & ATTR_CHANGE)
+		attrs->change += snap->writes;
+
+	nsecs_to_timespec(snap->time, &ts);
+	if ((attrs->valid_mask & ATTR_MTIME) &&
+	    gsh_time_cmp(&attrs->mtime, &ts) < 0)
+		attrs->mtime = ts;
+	if ((attrs->valid_mask & ATTR_CTIME) &&
+	    gsh_time_cmp(&attrs->ctime, &ts) < 0)
+		attrs->ctime = ts;
+}
+
+/**
+ * @brief Start over recording writes
+ *
+ * Called with the attr_lock held for write before the attributes are
+ * fetched, so every write recorded so far is in what is fetched.
+ *
+ * @param[in] entry  Regular file
+ *
+ * @return The change attribute GETATTR could have returned so far.
+ */
+static inline uint64_t mdc_write_attrs_reset(mdcache_entry_t *entry)
+{
+	struct mdc_write_attrs *w = &entry->wattrs;
+	uint64_t writes;
+
+	(void)atomic_inc_uint64_t(&w->begin);
+	(void)atomic_postclear_uint64_t_bits(&w->size, UINT64_MAX);
+	(void)atomic_postclear_uint64_t_bits(&w->time, UINT64_MAX);
+	writes = atomic_postclear_uint64_t_bits(&w->writes, UINT64_MAX);
+	(void)atomic_inc_uint64_t(&w->end);
+
+	return entry->attrs.change + writes;
+}
+
 /**
  * @brief Remove an export <-> entry mapping
  *
@@ -1010,6 +1537,16 @@ fsal_status_t mdcache_close2(struct fsal_obj_handle *obj_hdl,
 fsal_status_t mdcache_fallocate(struct fsal_obj_handle *obj_hdl,
 				struct state_t *state, uint64_t offset,
 				uint64_t length, bool allocate);
+fsal_status_t mdcache_copy(struct fsal_obj_handle *dst_hdl,
+			   struct state_t *dst_state, uint64_t dst_offset,
+			   struct fsal_obj_handle *src_hdl,
+			   struct state_t *src_state, uint64_t src_offset,
+			   uint64_t count, uint64_t *copied);
+fsal_status_t mdcache_clone2(struct fsal_obj_handle *dst_hdl,
+			     struct state_t *dst_state, uint64_t dst_offset,
+			     struct fsal_obj_handle *src_hdl,
+			     struct state_t *src_state, uint64_t src_offset,
+			     uint64_t count);
 
 /* extended attributes management */
 fsal_status_t mdcache_list_ext_attrs(struct fsal_obj_handle *obj_hdl,
@@ -1055,6 +1592,8 @@ fsal_status_t mdcache_listxattrs(struct fsal_obj_handle *obj_hdl,
 				 count4 len, nfs_cookie4 *cookie,
 				 verifier4 *verf, bool_t *eof,
 				 xattrlist4 *names);
+void mdc_xattrs_clear(mdcache_entry_t *entry);
+void mdc_symlink_clear(mdcache_entry_t *entry);
 
 /* Handle functions */
 void mdcache_handle_ops_init(struct fsal_obj_ops *ops);
@@ -1062,16 +1601,74 @@ void mdcache_handle_ops_init(struct fsal_obj_ops *ops);
 /* Export functions */
 void mdcache_export_ops_init(struct export_ops *ops);
 
+/* Snapshot functions */
+void mdcache_snapshot_pkginit(void);
+void mdcache_snapshot_pkgshutdown(void);
+
+/* Cache warm functions */
+
+/** Where the last cache warm is */
+enum mdc_warm_state {
+	MDC_WARM_IDLE,		/*< None started yet */
+	MDC_WARM_RUNNING,
+	MDC_WARM_DONE,		/*< Whole subtree read */
+	MDC_WARM_CANCELLED,	/*< Cancelled, or shutting down */
+	MDC_WARM_FULL,		/*< Stopped with the cache full */
+	MDC_WARM_FAILED		/*< Top of the subtree not found */
+};
+
+void mdcache_warm_pkginit(void);
+void mdcache_warm_pkgshutdown(void);
+
+/* Cluster invalidate functions */
+
+/** What the other nodes drop of a directory whose names changed */
+#define MDC_CLUSTER_DIR (FSAL_UP_INVALIDATE_ATTRS | \
+			 FSAL_UP_INVALIDATE_CONTENT | \
+			 FSAL_UP_INVALIDATE_DIR_POPULATED | \
+			 FSAL_UP_INVALIDATE_DIR_CHUNKS)
+
+void mdcache_cluster_pkginit(void);
+void mdcache_cluster_pkgshutdown(void);
+void mdc_cluster_publish(mdcache_entry_t *entry, uint32_t flags);
+
+/* Chunk store functions */
+
+/** A chunk read back from the chunk store */
+struct mdc_cstore_chunk {
+	void *rec;		/*< The record, names point into it */
+	uint32_t count;		/*< Dirents */
+	bool eod;		/*< The last one ends the directory */
+	struct {
+		const char *name;
+		fsal_cookie_t ck;
+		mdcache_entry_t *entry;	/*< ref'd, NULL once handed on */
+	} ents[];
+};
+
+void mdcache_cstore_pkginit(void);
+void mdcache_cstore_pkgshutdown(void);
+void mdc_cstore_chunk_put(mdcache_entry_t *dir, struct dir_chunk *chunk);
+struct mdc_cstore_chunk *mdc_cstore_chunk_get(mdcache_entry_t *dir,
+					      fsal_cookie_t whence);
+void mdc_cstore_chunk_free(struct mdc_cstore_chunk *saved);
+
+/* File functions */
+void mdcache_file_pkginit(void);
+void mdcache_file_pkgshutdown(void);
+
 /* Upcall functions */
+void mdcache_up_pkginit(void);
+void mdcache_up_pkgshutdown(void);
 fsal_status_t mdcache_export_up_ops_init(struct fsal_up_vector *my_up_ops,
 				 const struct fsal_up_vector *super_up_ops);
 
 /* Debug functions */
 #define MDC_LOG_KEY(key) do { \
-	LogFullDebugOpaque(COMPONENT_CACHE_INODE, \
-			   "FSAL key: %s", 128, (key)->kv.addr, \
-			   (key)->kv.len); \
-	LogFullDebug(COMPONENT_CACHE_INODE, "hash key: %lx", (key)->hk); \
+	char str[LOG_BUFF_LEN] = "\0"; \
+	struct display_buffer dspbuf = { sizeof(str), str, str }; \
+	(void) display_mdcache_key(&dspbuf, (key)); \
+	LogFullDebug(COMPONENT_CACHE_INODE, "key: %s", str); \
 } while (0)
 
 static inline
@@ -1082,7 +1679,8 @@ fsal_status_t mdcache_refresh_attrs_no_invalidate(mdcache_entry_t *entry)
 	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
 
 	status = mdcache_refresh_attrs(entry, false /*need_acl*/,
-				       false /*need_fslocations*/, false);
+				       false /*need_fslocations*/,
+				       false /*need_seclabel*/, false);
 
 	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
 
@@ -151,6 +151,17 @@ struct lru_q_lane {
 static struct lru_q_lane LRU[LRU_N_Q_LANES];
 static struct lru_q_lane CHUNK_LRU[LRU_N_Q_LANES];
 
+/* The 2Q policy keeps new entries on probation at the MRU of L2, where
+ * a scan cycles through them without disturbing L1.  An entry leaves
+ * probation when it is referenced again after the LRU thread has made
+ * another pass, or when it comes back soon after being evicted from
+ * probation.  The latter is tracked by remembering the hash keys of
+ * evicted entries in a direct mapped table; a collision just forgets
+ * an older key.
+ */
+static uint64_t *lru_ghost;
+static uint32_t lru_epoch;
+
 /**
  * The refcount mechanism distinguishes 3 key object states:
  *
@@ -586,6 +597,8 @@ mdcache_lru_clean(mdcache_entry_t *entry)
 
 	/* Done with the attrs */
 	fsal_release_attrs(&entry->attrs);
+	mdc_xattrs_clear(entry);
+	mdc_symlink_clear(entry);
 
 	/* Clean out the export mapping before deconstruction */
 	mdc_clean_entry(entry);
@@ -597,6 +610,8 @@ mdcache_lru_clean(mdcache_entry_t *entry)
 	 * destroy the rw locks.
 	 */
 	mdcache_key_delete(&entry->fh_hk.key);
+	(void) atomic_sub_int64_t(&lru_state.entry_bytes, entry->mem_bytes);
+	entry->mem_bytes = 0;
 	PTHREAD_RWLOCK_destroy(&entry->content_lock);
 	PTHREAD_RWLOCK_destroy(&entry->attr_lock);
 
@@ -625,94 +640,332 @@ mdcache_lru_clean(mdcache_entry_t *entry)
 
 static uint32_t reap_lane;
 
+/**
+ * @brief Remember the key of an entry evicted from probation
+ *
+ * @param[in] entry  The entry being reaped
+ */
+static inline void lru_ghost_remember(mdcache_entry_t *entry)
+{
+	uint64_t hk = entry->fh_hk.key.hk;
+
+	atomic_store_uint64_t(&lru_ghost[hk % mdcache_param.lru_ghost_entries],
+			      hk);
+}
+
+/**
+ * @brief Check for, and forget, a recently evicted entry
+ *
+ * @param[in] entry  The entry being inserted
+ *
+ * @return true if the entry was evicted from probation recently
+ */
+static inline bool lru_ghost_forget(mdcache_entry_t *entry)
+{
+	uint64_t hk = entry->fh_hk.key.hk;
+
+	return hk != 0 &&
+	       __sync_bool_compare_and_swap(
+			&lru_ghost[hk % mdcache_param.lru_ghost_entries],
+			hk, 0);
+}
+
+/** Entries from the head of a queue a reap looking for an export over
+ *  its share goes through
+ */
+#define LRU_SHARE_SCAN 16
+
+/** Cache use of each export, by export id */
+static struct mdc_export_share *mdc_shares[UINT16_MAX + 1];
+
+/** Some export has been given a Cache_Share */
+static uint32_t mdc_shares_on;
+
+static inline struct mdc_export_share *mdc_share_of(int32_t export_id)
+{
+	if (export_id < 0)
+		return NULL;
+
+	return atomic_fetch_voidptr((void **)&mdc_shares[export_id]);
+}
+
+/**
+ * @brief Get the share of an export
+ *
+ * @param[in] export_id  The export
+ *
+ * @return The share, NULL if the export never had an entry looked up.
+ */
+struct mdc_export_share *mdc_export_share(uint16_t export_id)
+{
+	return mdc_share_of(export_id);
+}
+
+/**
+ * @brief Get the share of an export, making it if need be
+ *
+ * @param[in] export_id  The export
+ *
+ * @return The share.
+ */
+static struct mdc_export_share *mdc_share_make(uint16_t export_id)
+{
+	struct mdc_export_share *share = mdc_share_of(export_id);
+
+	if (likely(share != NULL))
+		return share;
+
+	share = gsh_calloc(1, sizeof(*share));
+	if (__sync_bool_compare_and_swap(&mdc_shares[export_id], NULL, share))
+		return share;
+
+	/* Someone else made it */
+	gsh_free(share);
+	return mdc_share_of(export_id);
+}
+
+/**
+ * @brief Get the share of the export of the current request
+ *
+ * Also picks up a change of the export's Cache_Share.
+ *
+ * @return The share, NULL when there is no export.
+ */
+static struct mdc_export_share *mdc_share_ctx(void)
+{
+	struct gsh_export *export;
+	struct mdc_export_share *share;
+	uint64_t min_entries;
+
+	if (op_ctx == NULL || op_ctx->ctx_export == NULL)
+		return NULL;
+
+	export = op_ctx->ctx_export;
+	share = mdc_share_make(export->export_id);
+	min_entries = lru_state.entries_hiwat *
+		      atomic_fetch_uint32_t(&export->cache_share) / 100;
+
+	if (atomic_fetch_uint64_t(&share->min_entries) != min_entries) {
+		atomic_store_uint64_t(&share->min_entries, min_entries);
+		if (min_entries != 0)
+			atomic_store_uint32_t(&mdc_shares_on, 1);
+	}
+
+	return share;
+}
+
+/**
+ * @brief Change the first export of an entry
+ *
+ * Moves the entry's charge from the old first export to the new one.
+ *
+ * @param[in] entry      The entry
+ * @param[in] export_id  New first export, -1 for none
+ */
+void mdc_set_first_export(mdcache_entry_t *entry, int32_t export_id)
+{
+	struct mdc_export_share *share;
+	int32_t old = atomic_fetch_int32_t(&entry->first_export_id);
+	int32_t prev;
+
+	while ((prev = __sync_val_compare_and_swap(&entry->first_export_id,
+						   old, export_id)) != old)
+		old = prev;
+
+	if (old == export_id)
+		return;
+
+	share = mdc_share_of(old);
+	if (share != NULL)
+		(void) atomic_dec_int64_t(&share->entries);
+
+	if (export_id >= 0) {
+		share = mdc_share_make(export_id);
+		(void) atomic_inc_int64_t(&share->entries);
+	}
+}
+
+/**
+ * @brief Count a lookup against the export of the current request
+ *
+ * @param[in] hit  The entry was found in the cache
+ */
+void mdc_count_lookup(bool hit)
+{
+	struct mdc_export_share *share = mdc_share_ctx();
+
+	if (share != NULL)
+		(void) atomic_inc_uint64_t(hit ? &share->hits
+					       : &share->misses);
+}
+
+/**
+ * @brief Check whether an entry is within its export's share
+ *
+ * @param[in] entry  The entry
+ *
+ * @return true if the reaper should leave it alone.
+ */
+static inline bool mdc_share_kept(mdcache_entry_t *entry)
+{
+	struct mdc_export_share *share =
+		mdc_share_of(atomic_fetch_int32_t(&entry->first_export_id));
+	uint64_t min_entries;
+
+	if (share == NULL)
+		return false;
+
+	min_entries = atomic_fetch_uint64_t(&share->min_entries);
+	return min_entries != 0 &&
+	       atomic_fetch_int64_t(&share->entries) <= (int64_t) min_entries;
+}
+
+/**
+ * @brief Find an entry of an export over its share near a queue's head
+ *
+ * @note The lane lock MUST be held
+ *
+ * @param[in] lq  The queue
+ *
+ * @return The entry, or NULL if the first LRU_SHARE_SCAN are all kept.
+ */
+static inline mdcache_lru_t *lru_share_victim(struct lru_q *lq)
+{
+	struct glist_head *glist;
+	mdcache_lru_t *lru;
+	int scanned = 0;
+
+	glist_for_each(glist, &lq->q) {
+		lru = glist_entry(glist, mdcache_lru_t, q);
+		if (!mdc_share_kept(container_of(lru, mdcache_entry_t, lru)))
+			return lru;
+		if (++scanned == LRU_SHARE_SCAN)
+			break;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Try to reclaim the entry at the head of one lane's queue
+ *
+ * @param[in] qlane   The lane
+ * @param[in] qid     L1 or L2
+ * @param[in] shares  Pass over entries within their export's share
+ *
+ * @return The entry, holding only the sentinel ref, or NULL.
+ */
 static inline mdcache_lru_t *
-lru_reap_impl(enum lru_q_id qid)
+lru_reap_lane_one(struct lru_q_lane *qlane, enum lru_q_id qid, bool shares)
 {
-	uint32_t lane;
-	struct lru_q_lane *qlane;
 	struct lru_q *lq;
 	mdcache_lru_t *lru;
 	mdcache_entry_t *entry;
 	uint32_t refcnt;
 	cih_latch_t latch;
-	int ix;
 
-	lane = LRU_NEXT(reap_lane);
-	for (ix = 0; ix < LRU_N_Q_LANES; ++ix, lane = LRU_NEXT(reap_lane)) {
-		qlane = &LRU[lane];
-		lq = (qid == LRU_ENTRY_L1) ? &qlane->L1 : &qlane->L2;
+	lq = (qid == LRU_ENTRY_L1) ? &qlane->L1 : &qlane->L2;
 
-		QLOCK(qlane);
+	QLOCK(qlane);
+	if (shares)
+		lru = lru_share_victim(lq);
+	else
 		lru = glist_first_entry(&lq->q, mdcache_lru_t, q);
-		if (!lru) {
-			QUNLOCK(qlane);
-			continue;
-		}
-		refcnt = atomic_inc_int32_t(&lru->refcnt);
-		entry = container_of(lru, mdcache_entry_t, lru);
+	if (!lru) {
+		QUNLOCK(qlane);
+		return NULL;
+	}
+	refcnt = atomic_inc_int32_t(&lru->refcnt);
+	entry = container_of(lru, mdcache_entry_t, lru);
 #ifdef USE_LTTNG
 	tracepoint(mdcache, mdc_lru_ref,
 		   __func__, __LINE__, &entry->obj_handle, entry->sub_handle,
 		   refcnt);
 #endif
-		QUNLOCK(qlane);
+	QUNLOCK(qlane);
 
-		if (unlikely(refcnt != (LRU_SENTINEL_REFCOUNT + 1))) {
-			/* cant use it. */
-			mdcache_put(entry);
-			continue;
-		}
-		/* potentially reclaimable */
-		/* entry must be unreachable from CIH when recycled */
-		if (cih_latch_entry(&entry->fh_hk.key, &latch, CIH_GET_WLOCK,
-				    __func__, __LINE__)) {
-			QLOCK(qlane);
-			refcnt = atomic_fetch_int32_t(&entry->lru.refcnt);
-			/* there are two cases which permit reclaim,
-			 * entry is:
-			 * 1. reachable but unref'd (refcnt==2)
-			 * 2. unreachable, being removed (plus refcnt==0)
-			 *  for safety, take only the former
-			 */
-			if (LRU_ENTRY_RECLAIMABLE(entry, refcnt)) {
-				/* it worked */
-				struct lru_q *q = lru_queue_of(entry);
+	if (unlikely(refcnt != (LRU_SENTINEL_REFCOUNT + 1))) {
+		/* cant use it. */
+		mdcache_put(entry);
+		return NULL;
+	}
+	/* potentially reclaimable */
+	/* entry must be unreachable from CIH when recycled */
+	if (cih_latch_entry(&entry->fh_hk.key, &latch, CIH_GET_WLOCK,
+			    __func__, __LINE__)) {
+		QLOCK(qlane);
+		refcnt = atomic_fetch_int32_t(&entry->lru.refcnt);
+		/* there are two cases which permit reclaim,
+		 * entry is:
+		 * 1. reachable but unref'd (refcnt==2)
+		 * 2. unreachable, being removed (plus refcnt==0)
+		 *  for safety, take only the former
+		 */
+		if (LRU_ENTRY_RECLAIMABLE(entry, refcnt)) {
+			/* it worked */
+			struct lru_q *q = lru_queue_of(entry);
 
 #ifdef USE_LTTNG
-				tracepoint(mdcache, mdc_lru_reap, __func__,
-					   __LINE__, &entry->obj_handle,
-					   entry->lru.refcnt);
+			tracepoint(mdcache, mdc_lru_reap, __func__,
+				   __LINE__, &entry->obj_handle,
+				   entry->lru.refcnt);
 #endif
-				LRU_DQ_SAFE(lru, q);
-				entry->lru.qid = LRU_ENTRY_NONE;
-				QUNLOCK(qlane);
-				cih_remove_latched(entry, &latch,
-						   CIH_REMOVE_UNLOCK);
-				/* Note, we're not releasing our ref here.
-				 * cih_remove_latched() called
-				 * mdcache_lru_unref(), which released the
-				 * sentinal ref, leaving just the one ref we
-				 * took earlier.  Returning this as is leaves it
-				 * with a ref of 1 (ie, just the sentinal ref)
-				 * */
-				goto out;
-			}
-			cih_hash_release(&latch);
+			LRU_DQ_SAFE(lru, q);
+			entry->lru.qid = LRU_ENTRY_NONE;
 			QUNLOCK(qlane);
-			/* return the ref we took above--unref deals
-			 * correctly with reclaim case */
-			mdcache_lru_unref(entry);
-		} else {
-			/* ! QLOCKED but needs to be Unref'ed */
-			mdcache_lru_unref(entry);
-			continue;
+			if (entry->lru.flags & LRU_PROBATION)
+				lru_ghost_remember(entry);
+			cih_remove_latched(entry, &latch,
+					   CIH_REMOVE_UNLOCK);
+			/* A lockless lookup may have got a ref just
+			 * before the entry was unhashed.  Then it
+			 * isn't ours to recycle; the last unref will
+			 * free it.
+			 */
+			if (unlikely(atomic_fetch_int32_t(
+					&entry->lru.refcnt) !=
+				     LRU_SENTINEL_REFCOUNT)) {
+				mdcache_lru_unref(entry);
+				return NULL;
+			}
+			/* Note, we're not releasing our ref here.
+			 * cih_remove_latched() called
+			 * mdcache_lru_unref(), which released the
+			 * sentinal ref, leaving just the one ref we
+			 * took earlier.  Returning this as is leaves it
+			 * with a ref of 1 (ie, just the sentinal ref)
+			 * */
+			return lru;
 		}
+		cih_hash_release(&latch);
+		QUNLOCK(qlane);
+		/* return the ref we took above--unref deals
+		 * correctly with reclaim case */
+		mdcache_lru_unref(entry);
+	} else {
+		/* ! QLOCKED but needs to be Unref'ed */
+		mdcache_lru_unref(entry);
+	}
+
+	return NULL;
+}
+
+static inline mdcache_lru_t *
+lru_reap_impl(enum lru_q_id qid, bool shares)
+{
+	uint32_t lane;
+	mdcache_lru_t *lru;
+	int ix;
+
+	lane = LRU_NEXT(reap_lane);
+	for (ix = 0; ix < LRU_N_Q_LANES; ++ix, lane = LRU_NEXT(reap_lane)) {
+		lru = lru_reap_lane_one(&LRU[lane], qid, shares);
+		if (lru)
+			return lru;
 	}			/* foreach lane */
 
 	/* ! reclaimable */
-	lru = NULL;
- out:
-	return lru;
+	return NULL;
 }
 
 static inline mdcache_lru_t *
@@ -720,13 +973,23 @@ lru_try_reap_entry(void)
 {
 	mdcache_lru_t *lru;
 
-	if (lru_state.entries_used < lru_state.entries_hiwat)
+	if (lru_state.entries_used < lru_state.entries_hiwat &&
+	    !mdcache_lru_over_memory())
 		return NULL;
 
+	/* Exports over their share go first */
+	if (atomic_fetch_uint32_t(&mdc_shares_on)) {
+		lru = lru_reap_impl(LRU_ENTRY_L2, true);
+		if (!lru)
+			lru = lru_reap_impl(LRU_ENTRY_L1, true);
+		if (lru)
+			return lru;
+	}
+
 	/* XXX dang why not start with the cleanup list? */
-	lru = lru_reap_impl(LRU_ENTRY_L2);
+	lru = lru_reap_impl(LRU_ENTRY_L2, false);
 	if (!lru)
-		lru = lru_reap_impl(LRU_ENTRY_L1);
+		lru = lru_reap_impl(LRU_ENTRY_L1, false);
 
 	return lru;
 }
@@ -831,9 +1094,10 @@ lru_reap_chunk_impl(enum lru_q_id qid, mdcache_entry_t *parent,
 					   &entry->obj_handle, chunk);
 #endif
 
-			/* Clean the chunk out and indicate the directory is no
-			 * longer completely populated.
+			/* Save the chunk, clean it out and indicate the
+			 * directory is no longer completely populated.
 			 */
+			mdc_cstore_chunk_put(entry, chunk);
 			mdcache_clean_dirent_chunk(chunk);
 			atomic_clear_uint32_t_bits(&entry->mde_flags,
 						   MDCACHE_DIR_POPULATED);
@@ -887,7 +1151,8 @@ struct dir_chunk *mdcache_get_chunk(mdcache_entry_t *parent,
 	mdcache_lru_t *lru = NULL;
 	struct dir_chunk *chunk = NULL;
 
-	if (lru_state.chunks_used >= lru_state.chunks_hiwat) {
+	if (lru_state.chunks_used >= lru_state.chunks_hiwat ||
+	    mdcache_lru_over_memory()) {
 		lru = lru_reap_chunk_impl(LRU_ENTRY_L2, parent, prev_chunk);
 		if (!lru)
 			lru = lru_reap_chunk_impl(
@@ -899,15 +1164,19 @@ struct dir_chunk *mdcache_get_chunk(mdcache_entry_t *parent,
 		 * The dirents list is effectively properly initialized.
 		 */
 		chunk = container_of(lru, struct dir_chunk, chunk_lru);
+		mdcache_stat_inc(MDC_STAT_CHUNK_REAP);
 		LogFullDebug(COMPONENT_CACHE_INODE,
 			     "Recycling chunk at %p.", chunk);
 	} else {
 		/* alloc chunk (if fails, aborts) */
-		chunk = gsh_calloc(1, sizeof(struct dir_chunk));
+		chunk = gsh_calloc_tag(MEM_TAG_MDCACHE, 1,
+				       sizeof(struct dir_chunk));
 		glist_init(&chunk->dirents);
 		LogFullDebug(COMPONENT_CACHE_INODE,
 			     "New chunk %p.", chunk);
 		(void) atomic_inc_int64_t(&lru_state.chunks_used);
+		(void) atomic_add_int64_t(&lru_state.chunk_bytes,
+					  sizeof(struct dir_chunk));
 	}
 
 	/* Set the chunk's parent and insert */
@@ -917,9 +1186,17 @@ struct dir_chunk *mdcache_get_chunk(mdcache_entry_t *parent,
 		chunk->reload_ck = glist_last_entry(&prev_chunk->dirents,
 						    mdcache_dir_entry_t,
 						    chunk_list)->ck;
+		/* Reading on from a chunk, so the directory is at least
+		 * this big; grow the chunks until Dir_Chunk_Max.
+		 */
+		chunk->size = prev_chunk->size * 2;
+		if (chunk->size > mdcache_param.dir.avl_chunk_max ||
+		    chunk->size < prev_chunk->size)
+			chunk->size = mdcache_param.dir.avl_chunk_max;
 	} else {
 		glist_add(&chunk->parent->fsobj.fsdir.chunks, &chunk->chunks);
 		chunk->reload_ck = whence;
+		chunk->size = mdcache_param.dir.avl_chunk;
 	}
 
 	/* Chunk refcnt is not used (chunks are always protected by content_lock
@@ -1034,10 +1311,11 @@ mdcache_lru_cleanup_try_push(mdcache_entry_t *entry)
 			/* Now we can safely clean out the first_export_id to
 			 * indicate this entry is unmapped.
 			 */
-			atomic_store_int32_t(&entry->first_export_id, -1);
+			mdc_set_first_export(entry, -1);
 
 			QUNLOCK(qlane);
 			cih_remove_latched(entry, &latch, CIH_REMOVE_NONE);
+			fsal_obj_invalidate();
 		} else {
 			QUNLOCK(qlane);
 		}
@@ -1050,13 +1328,15 @@ mdcache_lru_cleanup_try_push(mdcache_entry_t *entry)
  * @brief Function that executes in the lru thread to process one lane
  *
  * @param[in]     lane          The lane to process
+ * @param[in]     budget        Entries to examine at most
  * @param[in,out] totalclosed   Track the number of file closes
  *
  * @returns the number of files worked on (workdone)
  *
  */
 
-static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
+static inline size_t lru_run_lane(size_t lane, uint32_t budget,
+				  uint64_t *const totalclosed)
 {
 	struct lru_q *q;
 	/* The amount of work done on this lane on this pass. */
@@ -1076,8 +1356,8 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 	q = &qlane->L1;
 
 	LogDebug(COMPONENT_CACHE_INODE_LRU,
-		 "Reaping up to %d entries from lane %zd",
-		 lru_state.per_lane_work, lane);
+		 "Reaping up to %" PRIu32 " entries from lane %zd",
+		 budget, lane);
 
 	/* ACTIVE */
 	QLOCK(qlane);
@@ -1094,7 +1374,7 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 		struct gsh_export *export;
 
 		/* check per-lane work */
-		if (workdone >= lru_state.per_lane_work)
+		if (workdone >= budget)
 			goto next_lane;
 
 		lru = glist_entry(qlane->iter.glist, mdcache_lru_t, q);
@@ -1163,6 +1443,7 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 		lru->qid = LRU_ENTRY_L2;
 		q = &qlane->L2;
 		lru_insert(lru, q, LRU_MRU);
+		mdcache_stat_inc(MDC_STAT_DEMOTE);
 
 		/* Drop the lane lock while performing (slow) operations on
 		 * entry */
@@ -1177,6 +1458,8 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 		} else {
 			++(*totalclosed);
 			++closed;
+			if (entry->obj_handle.type == REGULAR_FILE)
+				mdcache_stat_inc(MDC_STAT_FD_RECLAIM);
 		}
 
 		mdcache_lru_unref(entry);
@@ -1199,6 +1482,83 @@ next_lane:
 	return workdone;
 }
 
+/**
+ * @brief Work each lane gets on this pass
+ *
+ * Reaper_Work_Per_Lane is the budget at or below the high water mark.
+ * Above it, the budget grows with the overshoot, reaching
+ * LRU_MAX_WORK_SCALE times as much once the count is double the mark.
+ *
+ * @param[in] used   Current count
+ * @param[in] hiwat  High water mark for the count
+ *
+ * @returns the per-lane budget.
+ */
+static inline uint32_t lru_lane_budget(uint64_t used, uint64_t hiwat)
+{
+	uint64_t scale, budget;
+
+	if (hiwat == 0 || used <= hiwat)
+		return lru_state.per_lane_work;
+
+	scale = 1 + (used - hiwat) * (LRU_MAX_WORK_SCALE - 1) / hiwat;
+	if (scale > LRU_MAX_WORK_SCALE)
+		scale = LRU_MAX_WORK_SCALE;
+
+	budget = lru_state.per_lane_work * scale;
+
+	return budget > UINT32_MAX ? UINT32_MAX : budget;
+}
+
+/**
+ * @brief Check whether entries should be freed
+ *
+ * @returns true if above Entries_HWMark or Cache_Memory_Limit.
+ */
+static inline bool lru_over_entries(void)
+{
+	return atomic_fetch_uint64_t(&lru_state.entries_used) >
+	       lru_state.entries_hiwat || mdcache_lru_over_memory();
+}
+
+/**
+ * @brief Free unused entries from one lane while over the high water mark
+ *
+ * @param[in] lane    The lane to trim
+ * @param[in] budget  Entries to free at most
+ *
+ * @returns the number of entries freed.
+ */
+static size_t lru_trim_lane(size_t lane, uint32_t budget)
+{
+	mdcache_lru_t *lru;
+	size_t freed = 0;
+
+	while (freed < budget && lru_over_entries()) {
+		lru = NULL;
+		if (atomic_fetch_uint32_t(&mdc_shares_on)) {
+			lru = lru_reap_lane_one(&LRU[lane], LRU_ENTRY_L2, true);
+			if (!lru)
+				lru = lru_reap_lane_one(&LRU[lane],
+							LRU_ENTRY_L1, true);
+		}
+		if (!lru)
+			lru = lru_reap_lane_one(&LRU[lane], LRU_ENTRY_L2,
+						false);
+		if (!lru)
+			lru = lru_reap_lane_one(&LRU[lane], LRU_ENTRY_L1,
+						false);
+		if (!lru)
+			break;
+
+		mdcache_lru_unref(container_of(lru, mdcache_entry_t, lru));
+		mdcache_stat_inc(MDC_STAT_REAP_TRIM);
+		++freed;
+	}
+
+	return freed;
+}
+
 /**
  * @brief Function that executes in the lru thread
  *
@@ -1243,6 +1603,16 @@ next_lane:
  *  - If we fall below the low water mark and FD caching has been
  *    temporarily disabled, re-enable it.
  *
+ *  - While the entry count is above Entries_HWMark, free unreferenced
+ *    entries from our lanes instead of waiting for new entries to
+ *    recycle them.
+ *
+ * Reaper_Threads threads run this function, each over its own group of
+ * lanes, lane group + n * Reaper_Threads.  Group 0 also keeps the fd
+ * state, futility count and sleep time that the others follow.  The
+ * per-lane budget starts at Reaper_Work_Per_Lane and grows with how far
+ * entries or open fds are over their high water mark.
+ *
  * This function uses the lock discipline for functions accessing LRU
  * entries through a queue partition.
  *
@@ -1254,6 +1624,11 @@ lru_run(struct fridgethr_context *ctx)
 {
 	/* Index */
 	size_t lane = 0;
+	/* Lane group this thread reaps */
+	size_t group = (uintptr_t) ctx->arg;
+	uint32_t nthreads = mdcache_param.reaper_threads;
+	/* Group 0 also keeps the shared fd bookkeeping */
+	bool leader = group == 0;
 	/* True if we were explicitly awakened. */
 	bool woke = ctx->woke;
 	/* Finalized */
@@ -1267,11 +1642,25 @@ lru_run(struct fridgethr_context *ctx)
 	 */
 	size_t totalwork = 0;
 	uint64_t totalclosed = 0;
+	/* Entries freed because we are above Entries_HWMark */
+	size_t totalfreed = 0;
+	/* Per-lane work for this run */
+	uint32_t budget, fd_budget;
 	/* The current count (after reaping) of open FDs */
 	size_t currentopen = 0;
 	time_t new_thread_wait;
+	char thr_name[16];
+
+	if (leader) {
+		SetNameFunction("cache_lru");
+	} else {
+		snprintf(thr_name, sizeof(thr_name), "cache_lru%zu", group);
+		SetNameFunction(thr_name);
+	}
 
-	SetNameFunction("cache_lru");
+	/* Start a new 2Q reference period */
+	if (leader)
+		(void) atomic_inc_uint32_t(&lru_epoch);
 
 	fds_avg = (lru_state.fds_hiwat - lru_state.fds_lowat) / 2;
 
@@ -1279,7 +1668,7 @@ lru_run(struct fridgethr_context *ctx)
 
 	LogFullDebug(COMPONENT_CACHE_INODE_LRU, "LRU awakes.");
 
-	if (!woke) {
+	if (!woke && leader) {
 		/* If we make it all the way through a timed sleep
 		   without being woken, we assume we aren't racing
 		   against the impossible. */
@@ -1293,6 +1682,20 @@ lru_run(struct fridgethr_context *ctx)
 	LogFullDebug(COMPONENT_CACHE_INODE_LRU, "lru entries: %" PRIu64,
 		     lru_state.entries_used);
 
+	/* The further over a high water mark we are, the more each lane
+	 * is worked.
+	 */
+	budget = lru_lane_budget(atomic_fetch_uint64_t(&lru_state.entries_used),
+				 lru_state.entries_hiwat);
+	fd_budget = lru_lane_budget(atomic_fetch_size_t(&open_fd_count),
+				    lru_state.fds_hiwat);
+	if (fd_budget > budget)
+		budget = fd_budget;
+	fd_budget = lru_lane_budget(mdcache_lru_memory(),
+				    mdcache_param.cache_memory_limit);
+	if (fd_budget > budget)
+		budget = fd_budget;
+
 	/* Reap file descriptors.  This is a preliminary example of the
 	   L2 functionality rather than something we expect to be
 	   permanent.  (It will have to adapt heavily to the new FSAL
@@ -1305,7 +1708,8 @@ lru_run(struct fridgethr_context *ctx)
 			 "FD count is %zd and low water mark is %d: not reaping.",
 			 atomic_fetch_size_t(&open_fd_count),
 			 lru_state.fds_lowat);
-		if (atomic_fetch_uint32_t(&lru_state.fd_state) > FD_LOW) {
+		if (leader &&
+		    atomic_fetch_uint32_t(&lru_state.fd_state) > FD_LOW) {
 			LogEvent(COMPONENT_CACHE_INODE_LRU,
 				 "Return to normal fd reaping.");
 			atomic_store_uint32_t(&lru_state.fd_state, FD_LOW);
@@ -1320,7 +1724,7 @@ lru_run(struct fridgethr_context *ctx)
 		size_t workpass = 0;
 		time_t curr_time = time(NULL);
 
-		if (currentopen < lru_state.fds_hiwat &&
+		if (leader && currentopen < lru_state.fds_hiwat &&
 		    atomic_fetch_uint32_t(&lru_state.fd_state) == FD_LIMIT) {
 			LogEvent(COMPONENT_CACHE_INODE_LRU,
 				 "Count of fd is below high water mark.");
@@ -1349,24 +1753,27 @@ lru_run(struct fridgethr_context *ctx)
 		/* Total fds closed between all lanes and all current runs. */
 		do {
 			workpass = 0;
-			for (lane = 0; lane < LRU_N_Q_LANES; ++lane) {
+			for (lane = group; lane < LRU_N_Q_LANES;
+			     lane += nthreads) {
 				LogDebug(COMPONENT_CACHE_INODE_LRU,
-					 "Reaping up to %d entries from lane %zd",
-					 lru_state.per_lane_work, lane);
+					 "Reaping up to %" PRIu32
+					 " entries from lane %zd",
+					 budget, lane);
 
 				LogFullDebug(COMPONENT_CACHE_INODE_LRU,
 					     "formeropen=%zd totalwork=%zd workpass=%zd totalclosed:%"
 					     PRIu64, formeropen, totalwork,
 					     workpass, totalclosed);
 
-				workpass += lru_run_lane(lane, &totalclosed);
+				workpass += lru_run_lane(lane, budget,
+							 &totalclosed);
 			}
 			totalwork += workpass;
-		} while (extremis && (workpass >= lru_state.per_lane_work)
-			 && (totalwork < lru_state.biggest_window));
+		} while (extremis && (workpass >= budget)
+			 && (totalwork < lru_state.biggest_window / nthreads));
 
 		currentopen = atomic_fetch_size_t(&open_fd_count);
-		if (extremis
+		if (leader && extremis
 		    && ((currentopen > formeropen)
 			|| (formeropen - currentopen <
 			    (((formeropen -
@@ -1381,6 +1788,26 @@ lru_run(struct fridgethr_context *ctx)
 		}
 	}
 
+	/* Free what we can of our lanes while above Entries_HWMark or
+	 * Cache_Memory_Limit, rather than leaving it to the next
+	 * allocations to recycle.
+	 */
+	if (lru_over_entries()) {
+		for (lane = group; lane < LRU_N_Q_LANES; lane += nthreads)
+			totalfreed += lru_trim_lane(lane, budget);
+	}
+
+	if (!leader) {
+		/* Sleep as long as the leader does */
+		fridgethr_setwait(ctx, atomic_fetch_time_t(
+						&lru_state.reaper_wait));
+		LogDebug(COMPONENT_CACHE_INODE_LRU,
+			 "Lane group %zd closed %" PRIu64
+			 " fds and freed %zd entries, budget %" PRIu32,
+			 group, totalclosed, totalfreed, budget);
+		return;
+	}
+
 	/* The following calculation will progressively garbage collect
 	 * more frequently as these two factors increase:
 	 * 1. current number of open file descriptors
@@ -1409,13 +1836,15 @@ lru_run(struct fridgethr_context *ctx)
 		new_thread_wait = mdcache_param.lru_run_interval / 10;
 
 	fridgethr_setwait(ctx, new_thread_wait);
+	atomic_store_time_t(&lru_state.reaper_wait, new_thread_wait);
 
 	LogDebug(COMPONENT_CACHE_INODE_LRU,
 		 "After work, open_fd_count:%zd  count:%" PRIu64
-		 " fdrate:%u new_thread_wait=%" PRIu64,
+		 " fdrate:%u new_thread_wait=%" PRIu64 " freed=%zd budget=%"
+		 PRIu32,
 		 atomic_fetch_size_t(&open_fd_count),
 		 lru_state.entries_used, fdratepersec,
-		 ((uint64_t) new_thread_wait));
+		 ((uint64_t) new_thread_wait), totalfreed, budget);
 	LogFullDebug(COMPONENT_CACHE_INODE_LRU,
 		     "currentopen=%zd futility=%d totalwork=%zd biggest_window=%d extremis=%d lanes=%d fds_lowat=%d ",
 		     currentopen, lru_state.futility, totalwork,
@@ -1429,12 +1858,13 @@ lru_run(struct fridgethr_context *ctx)
  * This function really just demotes chunks from L1 to L2, so very simple.
  *
  * @param[in]     lane          The lane to process
+ * @param[in]     budget        Chunks to demote at most
  *
  * @returns the number of chunks worked on (workdone)
  *
  */
 
-static inline size_t chunk_lru_run_lane(size_t lane)
+static inline size_t chunk_lru_run_lane(size_t lane, uint32_t budget)
 {
 	struct lru_q *q;
 	/* The amount of work done on this lane on this pass. */
@@ -1447,8 +1877,8 @@ static inline size_t chunk_lru_run_lane(size_t lane)
 	q = &qlane->L1;
 
 	LogFullDebug(COMPONENT_CACHE_INODE_LRU,
-		 "Reaping up to %d chunks from lane %zd",
-		 lru_state.per_lane_work, lane);
+		 "Reaping up to %" PRIu32 " chunks from lane %zd",
+		 budget, lane);
 
 	/* ACTIVE */
 	QLOCK(qlane);
@@ -1461,7 +1891,7 @@ static inline size_t chunk_lru_run_lane(size_t lane)
 		struct lru_q *q;
 
 		/* check per-lane work */
-		if (workdone >= lru_state.per_lane_work)
+		if (workdone >= budget)
 			goto next_lane;
 
 		lru = glist_entry(qlane->iter.glist, mdcache_lru_t, q);
@@ -1490,7 +1920,8 @@ next_lane:
  * @brief Function that executes in the lru thread
  *
  * This function reorganizes the L1 and L2 queues, demoting least recently
- * used L1 chunks to L2.
+ * used L1 chunks to L2.  Each of the Reaper_Threads threads works its own
+ * group of lanes, lane group + n * Reaper_Threads.
  *
  * This function uses the lock discipline for functions accessing LRU
  * entries through a queue partition.
@@ -1510,20 +1941,39 @@ static void chunk_lru_run(struct fridgethr_context *ctx)
 	time_t new_thread_wait;
 	/* Total work done (number of chunks demoted) across all lanes. */
 	size_t totalwork = 0;
-
-	SetNameFunction("chunk_lru");
+	/* Lane group this thread reaps */
+	size_t group = (uintptr_t) ctx->arg;
+	/* Per-lane work for this run */
+	uint32_t budget, mem_budget;
+	char thr_name[16];
+
+	if (group == 0) {
+		SetNameFunction("chunk_lru");
+	} else {
+		snprintf(thr_name, sizeof(thr_name), "chunk_lru%zu", group);
+		SetNameFunction(thr_name);
+	}
 
 	LogFullDebug(COMPONENT_CACHE_INODE_LRU,
 		     "LRU awakes, lru chunks used: %" PRIu64,
 		     lru_state.chunks_used);
 
+	budget = lru_lane_budget(atomic_fetch_uint64_t(&lru_state.chunks_used),
+				 lru_state.chunks_hiwat);
+	mem_budget = lru_lane_budget(mdcache_lru_memory(),
+				     mdcache_param.cache_memory_limit);
+	if (mem_budget > budget)
+		budget = mem_budget;
+
 	/* Total chunks demoted to L2 between all lanes and all current runs. */
-	for (lane = 0; lane < LRU_N_Q_LANES; ++lane) {
+	for (lane = group; lane < LRU_N_Q_LANES;
+	     lane += mdcache_param.reaper_threads) {
 		LogFullDebug(COMPONENT_CACHE_INODE_LRU,
-			 "Reaping up to %d chunks from lane %zd totalwork=%zd",
-			 lru_state.per_lane_work, lane, totalwork);
+			 "Reaping up to %" PRIu32
+			 " chunks from lane %zd totalwork=%zd",
+			 budget, lane, totalwork);
 
-		totalwork += chunk_lru_run_lane(lane);
+		totalwork += chunk_lru_run_lane(lane, budget);
 	}
 
 	/* Run more frequently the closer to max number of chunks we are. */
@@ -1680,15 +2130,17 @@ mdcache_lru_pkginit(void)
 	/* Return code from system calls */
 	int code = 0;
 	struct fridgethr_params frp;
+	uint32_t group;
 
 	memset(&frp, 0, sizeof(struct fridgethr_params));
-	frp.thr_max = 2;
-	frp.thr_min = 2;
+	frp.thr_max = 2 * mdcache_param.reaper_threads;
+	frp.thr_min = 2 * mdcache_param.reaper_threads;
 	frp.thread_delay = mdcache_param.lru_run_interval;
 	frp.flavor = fridgethr_flavor_looper;
 
 	atomic_store_size_t(&open_fd_count, 0);
 	lru_state.prev_fd_count = 0;
+	lru_state.reaper_wait = mdcache_param.lru_run_interval;
 	atomic_store_uint32_t(&lru_state.fd_state, FD_LOW);
 	init_fds_limit();
 
@@ -1702,10 +2154,20 @@ mdcache_lru_pkginit(void)
 	lru_state.chunks_hiwat = mdcache_param.chunks_hwmark;
 	lru_state.chunks_used = 0;
 
+	lru_state.entry_bytes = 0;
+	lru_state.chunk_bytes = 0;
+	lru_state.dirent_bytes = 0;
+	lru_state.xattr_bytes = 0;
+	lru_state.symlink_bytes = 0;
+
 
 	/* init queue complex */
 	lru_init_queues();
 
+	if (mdcache_param.lru_policy == MDCACHE_LRU_POLICY_2Q)
+		lru_ghost = gsh_calloc(mdcache_param.lru_ghost_entries,
+				       sizeof(*lru_ghost));
+
 	/* spawn LRU background thread */
 	code = fridgethr_init(&lru_fridge, "LRU_fridge", &frp);
 	if (code != 0) {
@@ -1715,20 +2177,24 @@ mdcache_lru_pkginit(void)
 		return fsalstat(posix2fsal_error(code), code);
 	}
 
-	code = fridgethr_submit(lru_fridge, lru_run, NULL);
-	if (code != 0) {
-		LogMajor(COMPONENT_CACHE_INODE_LRU,
-			 "Unable to start Entry LRU thread, error code %d.",
-			 code);
-		return fsalstat(posix2fsal_error(code), code);
-	}
+	for (group = 0; group < mdcache_param.reaper_threads; group++) {
+		code = fridgethr_submit(lru_fridge, lru_run,
+					(void *) (uintptr_t) group);
+		if (code != 0) {
+			LogMajor(COMPONENT_CACHE_INODE_LRU,
+				 "Unable to start Entry LRU thread, error code %d.",
+				 code);
+			return fsalstat(posix2fsal_error(code), code);
+		}
 
-	code = fridgethr_submit(lru_fridge, chunk_lru_run, NULL);
-	if (code != 0) {
-		LogMajor(COMPONENT_CACHE_INODE_LRU,
-			 "Unable to start Chunk LRU thread, error code %d.",
-			 code);
-		return fsalstat(posix2fsal_error(code), code);
+		code = fridgethr_submit(lru_fridge, chunk_lru_run,
+					(void *) (uintptr_t) group);
+		if (code != 0) {
+			LogMajor(COMPONENT_CACHE_INODE_LRU,
+				 "Unable to start Chunk LRU thread, error code %d.",
+				 code);
+			return fsalstat(posix2fsal_error(code), code);
+		}
 	}
 
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
@@ -1764,6 +2230,108 @@ static inline void init_rw_locks(mdcache_entry_t *entry)
 	PTHREAD_RWLOCK_init(&entry->content_lock, NULL);
 }
 
+/**
+ * @brief Recount the bytes an entry holds
+ *
+ * Counts the entry itself, its key and the variable sized attributes it
+ * caches: ACL, fs_locations and security label.  Call whenever those
+ * change; the caller must have the entry to itself or hold its
+ * attr_lock for write.
+ *
+ * @param[in] entry  The entry
+ */
+void mdcache_lru_account_entry(mdcache_entry_t *entry)
+{
+	size_t bytes = sizeof(*entry) +
+		       mdcache_key_allocated(&entry->fh_hk.key);
+	fsal_fs_locations_t *fs_locations = entry->attrs.fs_locations;
+	uint32_t i;
+
+	if (entry->attrs.acl != NULL)
+		bytes += sizeof(fsal_acl_t) +
+			 entry->attrs.acl->naces * sizeof(fsal_ace_t);
+
+	if (fs_locations != NULL) {
+		bytes += sizeof(*fs_locations) +
+			 fs_locations->nservers * sizeof(utf8string);
+		if (fs_locations->fs_root != NULL)
+			bytes += strlen(fs_locations->fs_root) + 1;
+		if (fs_locations->rootpath != NULL)
+			bytes += strlen(fs_locations->rootpath) + 1;
+		for (i = 0; i < fs_locations->nservers; i++)
+			bytes += fs_locations->server[i].utf8string_len;
+	}
+
+	bytes += entry->attrs.sec_label.slai_data.slai_data_len;
+
+	(void) atomic_add_int64_t(&lru_state.entry_bytes,
+				  (int64_t) bytes - (int64_t) entry->mem_bytes);
+	entry->mem_bytes = bytes;
+}
+
+/**
+ * @brief Reference the cached entries, hottest first
+ *
+ * L1 comes before L2.  Within a queue the lanes are interleaved MRU
+ * first, so position in the result follows recency across lanes.
+ * Every entry returned carries a reference the caller must put.
+ *
+ * @param[out] count  Number of entries returned
+ *
+ * @return Array of entries, to be freed with gsh_free().
+ */
+mdcache_entry_t **mdcache_lru_hot_entries(size_t *count)
+{
+	mdcache_entry_t **ents = NULL, **lane_ents[LRU_N_Q_LANES];
+	size_t lane_n[LRU_N_Q_LANES], total, depth, lane, n = 0;
+	struct glist_head *glist;
+	int level;
+
+	for (level = 0; level < 2; level++) {
+		total = 0;
+		for (lane = 0; lane < LRU_N_Q_LANES; lane++) {
+			struct lru_q_lane *qlane = &LRU[lane];
+			struct lru_q *lq = level == 0 ? &qlane->L1
+						      : &qlane->L2;
+			size_t i = 0;
+
+			QLOCK(qlane);
+			lane_ents[lane] = gsh_malloc((lq->size + 1) *
+						     sizeof(*ents));
+			for (glist = lq->q.prev; glist != &lq->q;
+			     glist = glist->prev) {
+				mdcache_lru_t *lru =
+				    glist_entry(glist, mdcache_lru_t, q);
+				mdcache_entry_t *entry =
+				    container_of(lru, mdcache_entry_t, lru);
+
+				(void) mdcache_lru_ref(entry, LRU_FLAG_NONE);
+				lane_ents[lane][i++] = entry;
+			}
+			QUNLOCK(qlane);
+
+			lane_n[lane] = i;
+			total += i;
+		}
+
+		ents = gsh_realloc(ents, (n + total + 1) * sizeof(*ents));
+		for (depth = 0; total > 0; depth++) {
+			for (lane = 0; lane < LRU_N_Q_LANES; lane++) {
+				if (depth >= lane_n[lane])
+					continue;
+				ents[n++] = lane_ents[lane][depth];
+				total--;
+			}
+		}
+
+		for (lane = 0; lane < LRU_N_Q_LANES; lane++)
+			gsh_free(lane_ents[lane]);
+	}
+
+	*count = n;
+	return ents;
+}
+
 mdcache_entry_t *alloc_cache_entry(void)
 {
 	mdcache_entry_t *nentry;
@@ -1800,19 +2368,25 @@ mdcache_entry_t *mdcache_lru_get(struct fsal_obj_handle *sub_handle)
 	if (lru) {
 		/* we uniquely hold entry */
 		nentry = container_of(lru, mdcache_entry_t, lru);
+		mdcache_stat_inc(MDC_STAT_REAP_ALLOC);
 		mdcache_lru_clean(nentry);
 		memset(&nentry->attrs, 0, sizeof(nentry->attrs));
+		memset(&nentry->ra, 0, sizeof(nentry->ra));
+		memset(&nentry->wattrs, 0, sizeof(nentry->wattrs));
 		init_rw_locks(nentry);
 	} else {
 		/* alloc entry (if fails, aborts) */
 		nentry = alloc_cache_entry();
 	}
+	glist_init(&nentry->xattrs.list);
+	memset(&nentry->symlink, 0, sizeof(nentry->symlink));
 
 	/* Since the entry isn't in a queue, nobody can bump refcnt. */
 	nentry->lru.refcnt = 2;
 	nentry->lru.cf = 0;
 	nentry->lru.lane = lru_lane_of(nentry);
 	nentry->sub_handle = sub_handle;
+	mdcache_lru_account_entry(nentry);
 
 #ifdef USE_LTTNG
 	tracepoint(mdcache, mdc_lru_get,
@@ -1829,22 +2403,122 @@ mdcache_entry_t *mdcache_lru_get(struct fsal_obj_handle *sub_handle)
  * having entries recycled before they're used during readdir.  For everything
  * else, insert into LRU of L1, so that a single ref promotes to the MRU of L1.
  *
+ * With the 2Q policy, everything except a recently evicted entry goes on
+ * probation at the MRU of L2.
+ *
  * @param [in] entry  Entry to insert.
  * @param [in] reason Reason we're inserting
  */
 void mdcache_lru_insert(mdcache_entry_t *entry, mdc_reason_t reason)
 {
+	struct lru_q_lane *qlane = &LRU[entry->lru.lane];
+
+	atomic_clear_uint32_t_bits(&entry->lru.flags, LRU_PROBATION);
+
+	if (mdcache_param.lru_policy == MDCACHE_LRU_POLICY_2Q) {
+		if (reason == MDC_REASON_DEFAULT && lru_ghost_forget(entry)) {
+			(void)atomic_inc_uint64_t(&cache_stp->lru_2q_ghost_hit);
+			lru_insert_entry(entry, &qlane->L1, LRU_LRU);
+			return;
+		}
+		(void)atomic_inc_uint64_t(&cache_stp->lru_2q_miss);
+		entry->lru.epoch = atomic_fetch_uint32_t(&lru_epoch);
+		atomic_set_uint32_t_bits(&entry->lru.flags, LRU_PROBATION);
+		lru_insert_entry(entry, &qlane->L2, LRU_MRU);
+		return;
+	}
+
 	/* Enqueue. */
 	switch (reason) {
 	case MDC_REASON_DEFAULT:
-		lru_insert_entry(entry, &LRU[entry->lru.lane].L1, LRU_LRU);
+		lru_insert_entry(entry, &qlane->L1, LRU_LRU);
 		break;
 	case MDC_REASON_SCAN:
-		lru_insert_entry(entry, &LRU[entry->lru.lane].L2, LRU_MRU);
+		lru_insert_entry(entry, &qlane->L2, LRU_MRU);
 		break;
 	}
 }
 
+/**
+ * @brief Adjust LRU for an initial reference
+ *
+ * This is the queue motion done by an LRU_REQ_INITIAL reference, for
+ * callers that already got their reference some other way.
+ *
+ * @param[in] entry  The referenced entry
+ */
+void mdcache_lru_promote(mdcache_entry_t *entry)
+{
+	mdcache_lru_t *lru = &entry->lru;
+	struct lru_q_lane *qlane = &LRU[lru->lane];
+	struct lru_q *q;
+
+	QLOCK(qlane);
+
+	switch (lru->qid) {
+	case LRU_ENTRY_L1:
+		q = lru_queue_of(entry);
+		/* advance entry to MRU (of L1) */
+		LRU_DQ_SAFE(lru, q);
+		lru_insert(lru, q, LRU_MRU);
+		break;
+	case LRU_ENTRY_L2:
+		if (lru->flags & LRU_PROBATION) {
+			/* 2Q: references in the same period are
+			 * correlated, and don't show reuse.
+			 */
+			if (lru->epoch == atomic_fetch_uint32_t(&lru_epoch))
+				break;
+			atomic_clear_uint32_t_bits(&lru->flags,
+						   LRU_PROBATION);
+			(void)atomic_inc_uint64_t(&cache_stp->lru_2q_hit);
+		}
+		q = lru_queue_of(entry);
+		/* move entry to LRU of L1 */
+		glist_del(&lru->q);	/* skip L1 fixups */
+		--(q->size);
+		q = &qlane->L1;
+		lru_insert(lru, q, LRU_LRU);
+		break;
+	default:
+		/* do nothing */
+		break;
+	}		/* switch qid */
+	QUNLOCK(qlane);
+}
+
+/**
+ * @brief Make an entry the next to be reaped
+ *
+ * For an entry the client has said it won't use again, such as a file
+ * read once by a backup.  It goes to the LRU of L2 without waiting to
+ * age out, so it doesn't push hotter entries out first.
+ *
+ * @param[in] entry  The entry
+ */
+void mdcache_lru_demote(mdcache_entry_t *entry)
+{
+	mdcache_lru_t *lru = &entry->lru;
+	struct lru_q_lane *qlane = &LRU[lru->lane];
+	struct lru_q *q;
+
+	QLOCK(qlane);
+
+	switch (lru->qid) {
+	case LRU_ENTRY_L1:
+	case LRU_ENTRY_L2:
+		q = lru_queue_of(entry);
+		LRU_DQ_SAFE(lru, q);
+		lru_insert(lru, &qlane->L2, LRU_LRU);
+		break;
+	default:
+		/* do nothing */
+		break;
+	}		/* switch qid */
+
+	QUNLOCK(qlane);
+}
+
 /**
  * @brief Get a reference
  *
@@ -1868,9 +2542,6 @@ fsal_status_t
 _mdcache_lru_ref(mdcache_entry_t *entry, uint32_t flags, const char *func,
 		 int line)
 {
-	mdcache_lru_t *lru = &entry->lru;
-	struct lru_q_lane *qlane = &LRU[lru->lane];
-	struct lru_q *q;
 #ifdef USE_LTTNG
 	int32_t refcnt =
 #endif
@@ -1882,31 +2553,8 @@ _mdcache_lru_ref(mdcache_entry_t *entry, uint32_t flags, const char *func,
 #endif
 
 	/* adjust LRU on initial refs */
-	if (flags & LRU_REQ_INITIAL) {
-
-		QLOCK(qlane);
-
-		switch (lru->qid) {
-		case LRU_ENTRY_L1:
-			q = lru_queue_of(entry);
-			/* advance entry to MRU (of L1) */
-			LRU_DQ_SAFE(lru, q);
-			lru_insert(lru, q, LRU_MRU);
-			break;
-		case LRU_ENTRY_L2:
-			q = lru_queue_of(entry);
-			/* move entry to LRU of L1 */
-			glist_del(&lru->q);	/* skip L1 fixups */
-			--(q->size);
-			q = &qlane->L1;
-			lru_insert(lru, q, LRU_LRU);
-			break;
-		default:
-			/* do nothing */
-			break;
-		}		/* switch qid */
-		QUNLOCK(qlane);
-	}			/* initial ref */
+	if (flags & LRU_REQ_INITIAL)
+		mdcache_lru_promote(entry);
 
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
@@ -2038,7 +2686,9 @@ void lru_remove_chunk(struct dir_chunk *chunk)
 
 	/* And now we can free the chunk. */
 	LogFullDebug(COMPONENT_CACHE_INODE, "Freeing chunk %p", chunk);
-	gsh_free(chunk);
+	(void) atomic_sub_int64_t(&lru_state.chunk_bytes,
+				  sizeof(struct dir_chunk));
+	gsh_free_tag(MEM_TAG_MDCACHE, chunk, sizeof(struct dir_chunk));
 }
 
 /**
@@ -2127,4 +2777,22 @@ bool mdcache_lru_fds_available(void)
 	return true;
 }
 
+/**
+ * @brief Say how many fds the reaper would have closed
+ *
+ * A FSAL that keeps idle fds open, counted in open_fd_count, gives them
+ * up while this is non-zero.
+ *
+ * @return Open fds above FD_LWMark once above FD_HWMark, else 0.
+ */
+size_t mdcache_lru_fds_excess(void)
+{
+	size_t open = atomic_fetch_size_t(&open_fd_count);
+
+	if (open < lru_state.fds_hiwat)
+		return 0;
+
+	return open - lru_state.fds_lowat;
+}
+
 /** @} */
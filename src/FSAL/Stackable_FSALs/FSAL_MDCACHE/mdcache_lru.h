@@ -36,6 +36,7 @@
 #define MDCACHE_LRU_H
 
 #include "config.h"
+#include <string.h>
 #include "log.h"
 #include "mdcache_int.h"
 
@@ -89,6 +90,15 @@ struct lru_state {
 	uint64_t prev_fd_count;	/* previous # of open fds */
 	time_t prev_time;	/* previous time the gc thread was run. */
 	uint32_t fd_state;
+	/** Sleep time the lane group 0 reaper chose, for the others */
+	time_t reaper_wait;
+	/** Bytes held by each kind of cached object, counted against
+	    Cache_Memory_Limit */
+	int64_t entry_bytes;
+	int64_t chunk_bytes;
+	int64_t dirent_bytes;
+	int64_t xattr_bytes;
+	int64_t symlink_bytes;
 };
 
 extern struct lru_state lru_state;
@@ -142,6 +152,10 @@ extern pool_t *mdcache_entry_pool;
  */
 #define LRU_N_Q_LANES  17
 
+/** Most the reaper budget grows to above a high water mark, as a
+ *  multiple of Reaper_Work_Per_Lane */
+#define LRU_MAX_WORK_SCALE 16
+
 fsal_status_t mdcache_lru_pkginit(void);
 fsal_status_t mdcache_lru_pkgshutdown(void);
 
@@ -152,6 +166,8 @@ void mdcache_lru_insert(mdcache_entry_t *entry, mdc_reason_t reason);
 #define mdcache_lru_ref(e, f) _mdcache_lru_ref(e, f, __func__, __LINE__)
 fsal_status_t _mdcache_lru_ref(mdcache_entry_t *entry, uint32_t flags,
 			       const char *func, int line);
+void mdcache_lru_promote(mdcache_entry_t *entry);
+void mdcache_lru_demote(mdcache_entry_t *entry);
 
 /* XXX */
 void mdcache_lru_kill(mdcache_entry_t *entry);
@@ -202,6 +218,92 @@ struct dir_chunk *mdcache_get_chunk(mdcache_entry_t *parent,
 				    struct dir_chunk *prev_chunk,
 				    fsal_cookie_t whence);
 void lru_bump_chunk(struct dir_chunk *chunk);
+void mdcache_lru_account_entry(mdcache_entry_t *entry);
+mdcache_entry_t **mdcache_lru_hot_entries(size_t *count);
+
+/**
+ * @brief Bytes held by all cached entries, chunks, dirents, xattrs and
+ * symlinks
+ */
+static inline uint64_t mdcache_lru_memory(void)
+{
+	int64_t bytes = atomic_fetch_int64_t(&lru_state.entry_bytes) +
+			atomic_fetch_int64_t(&lru_state.chunk_bytes) +
+			atomic_fetch_int64_t(&lru_state.dirent_bytes) +
+			atomic_fetch_int64_t(&lru_state.xattr_bytes) +
+			atomic_fetch_int64_t(&lru_state.symlink_bytes);
+
+	return bytes > 0 ? bytes : 0;
+}
+
+/**
+ * @brief Check whether the cache is over Cache_Memory_Limit
+ *
+ * Or whether, with what the other subsystems use, it is over
+ * Total_Memory_Limit.  The cache's own bytes are always exact, so
+ * reclaiming it shows at once.
+ */
+static inline bool mdcache_lru_over_memory(void)
+{
+	uint64_t limit = mdcache_param.total_memory_limit;
+
+	if (mdcache_param.cache_memory_limit != 0 &&
+	    mdcache_lru_memory() > mdcache_param.cache_memory_limit)
+		return true;
+
+	return limit != 0 &&
+	       mdcache_lru_memory() + mem_acct_bytes_except(MEM_TAG_MDCACHE) >
+	       limit;
+}
+
+/**
+ * @brief Bytes a dirent is charged, its name included
+ */
+static inline size_t mdcache_lru_dirent_bytes(mdcache_dir_entry_t *dirent)
+{
+	return sizeof(*dirent) + strlen(dirent->name_buffer) + 1;
+}
+
+/* Dirents carved from a dir_block are charged with their block */
+static inline void mdcache_lru_charge_dirent(mdcache_dir_entry_t *dirent)
+{
+	if (dirent->block_off != 0)
+		return;
+
+	(void) atomic_add_int64_t(&lru_state.dirent_bytes,
+				  mdcache_lru_dirent_bytes(dirent));
+}
+
+static inline void mdcache_lru_uncharge_dirent(mdcache_dir_entry_t *dirent)
+{
+	if (dirent->block_off != 0)
+		return;
+
+	(void) atomic_sub_int64_t(&lru_state.dirent_bytes,
+				  mdcache_lru_dirent_bytes(dirent));
+}
+
+/**
+ * @brief An export's use of the cache
+ *
+ * An entry is charged to its first export.  One per export id, made
+ * the first time the id is seen and never freed, so the reaper can
+ * look at the share of an entry's export without a reference on it.
+ */
+struct mdc_export_share {
+	/** Entries whose first export this is */
+	int64_t entries;
+	/** Entries the reaper leaves alone, from the export's Cache_Share
+	    and Entries_HWMark */
+	uint64_t min_entries;
+	/** Lookups that found an entry, and that did not */
+	uint64_t hits;
+	uint64_t misses;
+};
+
+struct mdc_export_share *mdc_export_share(uint16_t export_id);
+void mdc_set_first_export(mdcache_entry_t *entry, int32_t export_id);
+void mdc_count_lookup(bool hit);
 
 #endif				/* MDCACHE_LRU_H */
 /** @} */
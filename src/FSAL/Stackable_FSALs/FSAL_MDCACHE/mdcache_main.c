@@ -53,6 +53,44 @@ pool_t *mdcache_entry_pool;
 struct mdcache_stats cache_st;
 struct mdcache_stats *cache_stp = &cache_st;
 
+struct mdcache_stat_shard mdcache_stat_shards[MDC_STAT_SHARDS];
+
+/** Shard used by this thread, -1 until its first count */
+__thread int mdcache_stat_shard_ix = -1;
+
+static uint32_t mdcache_stat_next_shard;
+
+/**
+ * @brief Give the calling thread its shard, round robin
+ *
+ * @return The shard index
+ */
+int mdcache_stat_pick_shard(void)
+{
+	mdcache_stat_shard_ix =
+		atomic_inc_uint32_t(&mdcache_stat_next_shard) % MDC_STAT_SHARDS;
+	return mdcache_stat_shard_ix;
+}
+
+/**
+ * @brief Add up a counter over the shards
+ *
+ * @param[in] stat  Counter to read
+ *
+ * @return The total
+ */
+uint64_t mdcache_stat_get(enum mdcache_stat stat)
+{
+	uint64_t total = 0;
+	int i;
+
+	for (i = 0; i < MDC_STAT_SHARDS; i++)
+		total += atomic_fetch_uint64_t(
+				&mdcache_stat_shards[i].count[stat]);
+
+	return total;
+}
+
 /* FSAL name determines name of shared library: libfsal<name>.so */
 const char mdcachename[] = "MDCACHE";
 
@@ -254,6 +292,15 @@ mdcache_fsal_unload(struct fsal_module *fsal_hdl)
 	fsal_status_t status;
 	int retval;
 
+	mdcache_snapshot_pkgshutdown();
+	mdcache_cluster_pkgshutdown();
+	mdcache_warm_pkgshutdown();
+	mdcache_file_pkgshutdown();
+	mdcache_cstore_pkgshutdown();
+
+	/* Apply invalidates still held for batching */
+	mdcache_up_pkgshutdown();
+
 	/* Destroy the cache inode AVL tree */
 	cih_pkgdestroy();
 
@@ -310,6 +357,7 @@ fsal_status_t mdcache_pkginit(void)
 
 	mdcache_entry_pool = pool_basic_init("MDCACHE Entry Pool",
 					     sizeof(mdcache_entry_t));
+	pool_set_mem_tag(mdcache_entry_pool, MEM_TAG_MDCACHE);
 
 	status = mdcache_lru_pkginit();
 	if (FSAL_IS_ERROR(status)) {
@@ -319,16 +367,49 @@ fsal_status_t mdcache_pkginit(void)
 	}
 
 	cih_pkginit();
+	mdcache_name_locks_init();
+	mdcache_lookup_flights_init();
+	mdcache_up_pkginit();
+	mdcache_snapshot_pkginit();
+	mdcache_cluster_pkginit();
+	mdcache_warm_pkginit();
+	mdcache_file_pkginit();
+	mdcache_cstore_pkginit();
 
 	return status;
 }
 
 #ifdef USE_DBUS
+/** Names ShowCacheInode gives the mdcache_stat counters */
+static const char * const mdcache_stat_names[MDC_STAT_COUNT] = {
+	[MDC_STAT_LOOKUP_HIT] = "lookup_hit",
+	[MDC_STAT_LOOKUP_MISS] = "lookup_miss",
+	[MDC_STAT_LOOKUP_NEG_HIT] = "lookup_negative_hit",
+	[MDC_STAT_ATTR_HIT] = "attr_hit",
+	[MDC_STAT_ATTR_MISS] = "attr_miss",
+	[MDC_STAT_ATTR_EXPIRED] = "attr_expired",
+	[MDC_STAT_CHUNK_HIT] = "chunk_hit",
+	[MDC_STAT_CHUNK_FILL] = "chunk_fill",
+	[MDC_STAT_REAP_ALLOC] = "reap_alloc",
+	[MDC_STAT_REAP_TRIM] = "reap_trim",
+	[MDC_STAT_DEMOTE] = "lru_demote",
+	[MDC_STAT_FD_RECLAIM] = "fd_reclaim",
+	[MDC_STAT_CHUNK_REAP] = "chunk_reap",
+	[MDC_STAT_SYMLINK_HIT] = "symlink_hit",
+	[MDC_STAT_SYMLINK_MISS] = "symlink_miss",
+	[MDC_STAT_PARENT_HIT] = "parent_hit",
+	[MDC_STAT_PARENT_MISS] = "parent_miss",
+	[MDC_STAT_CHUNK_SPILL] = "chunk_spill",
+	[MDC_STAT_CHUNK_RESTORE] = "chunk_restore",
+};
+
 void mdcache_dbus_show(DBusMessageIter *iter)
 {
 	struct timespec timestamp;
 	DBusMessageIter struct_iter;
 	char *type;
+	uint64_t bytes;
+	int i;
 
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
@@ -359,9 +440,150 @@ void mdcache_dbus_show(DBusMessageIter *iter)
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
 					&cache_st.inode_mapping);
+	type = "lru_2q_hit";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.lru_2q_hit);
+	type = "lru_2q_miss";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.lru_2q_miss);
+	type = "lru_2q_ghost_hit";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.lru_2q_ghost_hit);
+	type = "entry_bytes";
+	bytes = atomic_fetch_int64_t(&lru_state.entry_bytes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &bytes);
+	type = "chunk_bytes";
+	bytes = atomic_fetch_int64_t(&lru_state.chunk_bytes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &bytes);
+	type = "dirent_bytes";
+	bytes = atomic_fetch_int64_t(&lru_state.dirent_bytes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &bytes);
+	type = "xattr_bytes";
+	bytes = atomic_fetch_int64_t(&lru_state.xattr_bytes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &bytes);
+	type = "memory_limit";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&mdcache_param.cache_memory_limit);
+	type = "attr_trusted";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.attr_trusted);
+	type = "attr_refreshed";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.attr_refreshed);
+	type = "xattr_hit";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.xattr_hit);
+	type = "xattr_miss";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.xattr_miss);
+	type = "entry_size";
+	bytes = sizeof(mdcache_entry_t);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &bytes);
+	type = "dirent_size";
+	bytes = sizeof(mdcache_dir_entry_t);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &bytes);
+	type = "key_inlined";
+	bytes = atomic_fetch_uint64_t(&mdcache_key_st.inlined);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &bytes);
+	type = "key_allocated";
+	bytes = atomic_fetch_uint64_t(&mdcache_key_st.allocated);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &bytes);
+	type = "key_allocated_bytes";
+	bytes = atomic_fetch_uint64_t(&mdcache_key_st.allocated_bytes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &bytes);
+	type = "key_prefixed";
+	bytes = atomic_fetch_uint64_t(&mdcache_key_st.prefixed);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &bytes);
+	type = "key_prefixes";
+	bytes = atomic_fetch_uint32_t(&mdcache_key_st.prefixes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &bytes);
+
+	for (i = 0; i < MDC_STAT_COUNT; i++) {
+		bytes = mdcache_stat_get(i);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &mdcache_stat_names[i]);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &bytes);
+	}
 
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
+
+/**
+ * @brief Report each export's use of the cache
+ *
+ * array of struct share {
+ *	uint16_t export_id;
+ *	uint64_t entries;	(entries charged to the export)
+ *	uint64_t min_entries;	(entries kept from the reaper)
+ *	uint64_t hits;
+ *	uint64_t misses;
+ * }
+ *
+ * @param iter   [IN] iterator in reply stream to fill
+ */
+void mdcache_dbus_shares(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter, struct_iter;
+	struct mdc_export_share *share;
+	struct timespec timestamp;
+	uint16_t export_id;
+	uint64_t val;
+	int64_t entries;
+	uint32_t i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(qtttt)",
+					 &array_iter);
+	for (i = 0; i <= UINT16_MAX; i++) {
+		share = mdc_export_share(i);
+		if (share == NULL)
+			continue;
+
+		export_id = i;
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT16,
+					       &export_id);
+		entries = atomic_fetch_int64_t(&share->entries);
+		val = entries > 0 ? entries : 0;
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &val);
+		val = atomic_fetch_uint64_t(&share->min_entries);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &val);
+		val = atomic_fetch_uint64_t(&share->hits);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &val);
+		val = atomic_fetch_uint64_t(&share->misses);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &val);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+}
 #endif /* USE_DBUS */
 
 /** @} */
@@ -38,9 +38,11 @@
 #include "hashtable.h"
 #include "fsal.h"
 #include "mdcache_int.h"
+#include "mdcache_lru.h"
 #include "config_parsing.h"
 
 #include <unistd.h>
+#include <netinet/in.h>
 #include <sys/types.h>
 #include <sys/param.h>
 #include <time.h>
@@ -52,6 +54,12 @@
 
 struct mdcache_parameter mdcache_param;
 
+static struct config_item_list lru_policies[] = {
+	CONFIG_LIST_TOK("LRU", MDCACHE_LRU_POLICY_LRU),
+	CONFIG_LIST_TOK("2Q", MDCACHE_LRU_POLICY_2Q),
+	CONFIG_LIST_EOL
+};
+
 static struct config_item mdcache_params[] = {
 	CONF_ITEM_UI32("NParts", 1, 32633, 7,
 		       mdcache_parameter, nparts),
@@ -59,8 +67,28 @@ static struct config_item mdcache_params[] = {
 		       mdcache_parameter, cache_size),
 	CONF_ITEM_BOOL("Use_Getattr_Directory_Invalidation", false,
 		       mdcache_parameter, getattr_dir_invalidation),
+	CONF_ITEM_BOOL("Attr_Trust_Upcalls", false,
+		       mdcache_parameter, attr_trust_upcalls),
+	CONF_ITEM_UI32("Upcall_Batch_Window", 0, 1000, 0,
+		       mdcache_parameter, upcall_batch_window),
+	CONF_ITEM_BOOL("Lockless_Write_Attrs", false,
+		       mdcache_parameter, lockless_write_attrs),
 	CONF_ITEM_UI32("Dir_Chunk", 0, UINT32_MAX, 128,
 		       mdcache_parameter, dir.avl_chunk),
+	CONF_ITEM_UI32("Dir_Chunk_Max", 0, UINT32_MAX, 0,
+		       mdcache_parameter, dir.avl_chunk_max),
+	CONF_ITEM_BOOL("Dir_Readahead", false,
+		       mdcache_parameter, dir.readahead),
+	CONF_ITEM_UI32("Dir_Negative_TTL", 0, 3600, 0,
+		       mdcache_parameter, dir.neg_ttl),
+	CONF_ITEM_UI32("Dir_Negative_Max", 1, UINT32_MAX, 256,
+		       mdcache_parameter, dir.neg_max),
+	CONF_ITEM_UI32("Dir_Negative_HWMark", 1, UINT32_MAX, 100000,
+		       mdcache_parameter, dir.neg_hwmark),
+	CONF_ITEM_UI32("Dir_Bloom_Bits", 0, 1 << 24, 0,
+		       mdcache_parameter, dir.bloom_bits),
+	CONF_ITEM_UI32("Dir_Resume_Max", 0, UINT32_MAX, 1024,
+		       mdcache_parameter, dir.resume_max),
 	CONF_ITEM_UI32("Detached_Mult", 1, UINT32_MAX, 1,
 		       mdcache_parameter, dir.avl_detached_mult),
 	CONF_ITEM_UI32("Entries_HWMark", 1, UINT32_MAX, 100000,
@@ -79,12 +107,48 @@ static struct config_item mdcache_params[] = {
 		       mdcache_parameter, reaper_work),
 	CONF_ITEM_UI32("Reaper_Work_Per_Lane", 1, UINT32_MAX, 50,
 		       mdcache_parameter, reaper_work_per_lane),
+	CONF_ITEM_UI32("Reaper_Threads", 1, LRU_N_Q_LANES, 1,
+		       mdcache_parameter, reaper_threads),
+	CONF_ITEM_UI64("Cache_Memory_Limit", 0, UINT64_MAX, 0,
+		       mdcache_parameter, cache_memory_limit),
+	CONF_ITEM_UI64("Total_Memory_Limit", 0, UINT64_MAX, 0,
+		       mdcache_parameter, total_memory_limit),
 	CONF_ITEM_UI32("Biggest_Window", 1, 100, 40,
 		       mdcache_parameter, biggest_window),
 	CONF_ITEM_UI32("Required_Progress", 1, 50, 5,
 		       mdcache_parameter, required_progress),
 	CONF_ITEM_UI32("Futility_Count", 1, 50, 8,
 		       mdcache_parameter, futility_count),
+	CONF_ITEM_TOKEN("LRU_Policy", MDCACHE_LRU_POLICY_LRU, lru_policies,
+			mdcache_parameter, lru_policy),
+	CONF_ITEM_UI32("LRU_Ghost_Entries", 1, UINT32_MAX, 100000,
+		       mdcache_parameter, lru_ghost_entries),
+	CONF_ITEM_PATH("Snapshot_File", 1, MAXPATHLEN, NULL,
+		       mdcache_parameter, snapshot_file),
+	CONF_ITEM_UI32("Snapshot_Interval", 0, 24 * 3600, 300,
+		       mdcache_parameter, snapshot_interval),
+	CONF_ITEM_UI32("Snapshot_Prefetch_Rate", 1, 1000000, 1000,
+		       mdcache_parameter, snapshot_prefetch_rate),
+	CONF_ITEM_PATH("Chunk_Store_File", 1, MAXPATHLEN, NULL,
+		       mdcache_parameter, chunk_store_file),
+	CONF_ITEM_UI64("Chunk_Store_Size", 1024 * 1024, UINT64_MAX,
+		       1024 * 1024 * 1024,
+		       mdcache_parameter, chunk_store_size),
+	CONF_ITEM_UI64("Read_Ahead_Max", 0, 1024 * 1024 * 1024,
+		       4 * 1024 * 1024,
+		       mdcache_parameter, read_ahead_max),
+	CONF_ITEM_UI64("Xattr_Cache_Size", 0, UINT64_MAX, 16 * 1024 * 1024,
+		       mdcache_parameter, xattr_cache_size),
+	CONF_ITEM_UI64("Symlink_Cache_Size", 0, UINT64_MAX, 4 * 1024 * 1024,
+		       mdcache_parameter, symlink_cache_size),
+	CONF_ITEM_STR("Cluster_Invalidate_Group", 1, INET6_ADDRSTRLEN, NULL,
+		      mdcache_parameter, cluster_invalidate_group),
+	CONF_ITEM_UI16("Cluster_Invalidate_Port", 1, UINT16_MAX, 20050,
+		       mdcache_parameter, cluster_invalidate_port),
+	CONF_ITEM_UI32("Cluster_Invalidate_Window", 0, 1000, 10,
+		       mdcache_parameter, cluster_invalidate_window),
+	CONF_ITEM_UI32("Cluster_Invalidate_TTL", 1, 255, 1,
+		       mdcache_parameter, cluster_invalidate_ttl),
 	CONFIG_EOL
 };
 
@@ -119,11 +183,13 @@ int mdcache_set_param_from_conf(config_file_t parse_tree,
 		return -1;
 	}
 
-	/* Compute avl_chunk_split after reading config, make sure it's a
-	 * multiple of two.
-	 */
-	mdcache_param.dir.avl_chunk_split =
-		((mdcache_param.dir.avl_chunk * 3) / 2) & (UINT32_MAX - 1);
+	/* Chunks never shrink below Dir_Chunk */
+	if (mdcache_param.dir.avl_chunk_max < mdcache_param.dir.avl_chunk)
+		mdcache_param.dir.avl_chunk_max = mdcache_param.dir.avl_chunk;
+
+	/* The bloom filter is kept in whole words */
+	mdcache_param.dir.bloom_bits = (mdcache_param.dir.bloom_bits + 63) &
+				       ~63U;
 
 	/* Compute avl_detached_max from avl_chunk and avl_detached_mult */
 	mdcache_param.dir.avl_detached_max =
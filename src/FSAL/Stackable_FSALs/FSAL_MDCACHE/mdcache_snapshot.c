@@ -0,0 +1,412 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file  mdcache_snapshot.c
+ * @brief Saved set of cached handles, for warming the cache at startup
+ *
+ * The snapshot is the export id and wire handle of each cached entry,
+ * L1 before L2 and most recently used first.  A thread of its own reads
+ * it back once the server is up, looking every handle up again at
+ * Snapshot_Prefetch_Rate, then saves a fresh one every
+ * Snapshot_Interval.  The last save is made at shutdown, before the
+ * exports go away.  A snapshot is written to a temporary file that is
+ * renamed over the old one, so a crash never leaves half of one.
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "fsal.h"
+#include "fridgethr.h"
+#include "nfs_core.h"
+#include "nfs_init.h"
+#include "export_mgr.h"
+#include "mdcache.h"
+#include "mdcache_int.h"
+#include "mdcache_lru.h"
+
+#define MDC_SNAP_MAGIC 0x4d444353	/* "MDCS" */
+#define MDC_SNAP_VERSION 1
+
+struct mdc_snap_header {
+	uint32_t magic;
+	uint32_t version;
+};
+
+struct mdc_snap_record {
+	uint32_t export_id;
+	uint32_t len;		/*< Bytes of wire handle that follow */
+};
+
+static struct {
+	struct fridgethr *fridge;
+	pthread_mutex_t mtx;	/*< Serializes saves */
+	bool loaded;		/*< Snapshot has been read back */
+	time_t last_save;
+} mdc_snap;
+
+/**
+ * @brief Find an export, keeping the last one found
+ *
+ * Entries of an export tend to come together, so this spares most of
+ * the lookups.
+ *
+ * @param[in]     export_id  Export to find
+ * @param[in,out] export     Export last found, referenced, or NULL
+ *
+ * @return The export, or NULL if it's gone or not cached.
+ */
+
+static struct gsh_export *mdc_snap_export(uint16_t export_id,
+					  struct gsh_export **export)
+{
+	if (*export != NULL && (*export)->export_id == export_id)
+		return *export;
+
+	if (*export != NULL)
+		put_gsh_export(*export);
+
+	*export = get_gsh_export(export_id);
+	if (*export != NULL &&
+	    (*export)->fsal_export->fsal != &MDCACHE.module) {
+		put_gsh_export(*export);
+		*export = NULL;
+	}
+
+	return *export;
+}
+
+/**
+ * @brief Write a snapshot of the cached handles
+ *
+ * @param[in] snap  Open file to write to
+ *
+ * @return Number of handles written, or -1 on a write error.
+ */
+
+static ssize_t mdc_snap_write(FILE *snap)
+{
+	struct mdc_snap_header hdr = { MDC_SNAP_MAGIC, MDC_SNAP_VERSION };
+	struct gsh_export *export = NULL;
+	struct root_op_context root_op_context;
+	mdcache_entry_t **ents;
+	size_t count, i;
+	ssize_t written = 0;
+
+	if (fwrite(&hdr, sizeof(hdr), 1, snap) != 1)
+		return -1;
+
+	ents = mdcache_lru_hot_entries(&count);
+
+	for (i = 0; i < count; i++) {
+		mdcache_entry_t *entry = ents[i];
+		int32_t export_id;
+		char buf[NFS4_FHSIZE];
+		struct gsh_buffdesc fh_desc = { buf, sizeof(buf) };
+		struct mdc_snap_record rec;
+		fsal_status_t status;
+
+		export_id = atomic_fetch_int32_t(&entry->first_export_id);
+		if (written < 0 || export_id < 0 ||
+		    mdc_snap_export(export_id, &export) == NULL)
+			goto put;
+
+		init_root_op_context(&root_op_context, export,
+				     export->fsal_export, 0, 0,
+				     UNKNOWN_REQUEST);
+		status = entry->obj_handle.obj_ops->handle_to_wire(
+					&entry->obj_handle, FSAL_DIGEST_NFSV4,
+					&fh_desc);
+		release_root_op_context();
+
+		if (FSAL_IS_ERROR(status))
+			goto put;
+
+		rec.export_id = export_id;
+		rec.len = fh_desc.len;
+		if (fwrite(&rec, sizeof(rec), 1, snap) != 1 ||
+		    fwrite(buf, fh_desc.len, 1, snap) != 1)
+			written = -1;
+		else
+			written++;
+put:
+		mdcache_put(entry);
+	}
+
+	gsh_free(ents);
+	if (export != NULL)
+		put_gsh_export(export);
+
+	return written;
+}
+
+/**
+ * @brief Save the cache snapshot, if one is configured
+ *
+ * Nothing is saved until the previous snapshot has been read back, so
+ * one taken while the cache is still warming can't replace it.
+ */
+
+void mdcache_snapshot_save(void)
+{
+	const char *path = mdcache_param.snapshot_file;
+	char tmp[MAXPATHLEN + 8];
+	FILE *snap;
+	ssize_t written;
+
+	if (mdc_snap.fridge == NULL)
+		return;
+
+	PTHREAD_MUTEX_lock(&mdc_snap.mtx);
+
+	if (!mdc_snap.loaded)
+		goto out;
+
+	mdc_snap.last_save = time(NULL);
+	(void) snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	snap = fopen(tmp, "w");
+	if (snap == NULL) {
+		LogCrit(COMPONENT_CACHE_INODE,
+			"Could not create cache snapshot %s: %s",
+			tmp, strerror(errno));
+		goto out;
+	}
+
+	written = mdc_snap_write(snap);
+
+	if (fclose(snap) != 0 || written < 0) {
+		LogCrit(COMPONENT_CACHE_INODE,
+			"Could not write cache snapshot %s", tmp);
+		(void) unlink(tmp);
+		goto out;
+	}
+
+	if (rename(tmp, path) != 0) {
+		LogCrit(COMPONENT_CACHE_INODE,
+			"Could not rename cache snapshot %s to %s: %s",
+			tmp, path, strerror(errno));
+		(void) unlink(tmp);
+		goto out;
+	}
+
+	LogInfo(COMPONENT_CACHE_INODE,
+		"Saved %zd cached handles to %s", written, path);
+
+out:
+	PTHREAD_MUTEX_unlock(&mdc_snap.mtx);
+}
+
+/**
+ * @brief Look the handles of the snapshot up again
+ *
+ * Stops early at shutdown, or once the cache is as full as the
+ * Reaper lets it get.
+ */
+
+static void mdc_snap_load(void)
+{
+	const char *path = mdcache_param.snapshot_file;
+	uint32_t rate = mdcache_param.snapshot_prefetch_rate;
+	struct gsh_export *export = NULL;
+	struct root_op_context root_op_context;
+	struct mdc_snap_header hdr;
+	struct mdc_snap_record rec;
+	char buf[NFS4_FHSIZE];
+	uint64_t tried = 0, loaded = 0;
+	FILE *snap;
+
+	snap = fopen(path, "r");
+	if (snap == NULL) {
+		LogInfo(COMPONENT_CACHE_INODE,
+			"No cache snapshot to load from %s: %s",
+			path, strerror(errno));
+		return;
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, snap) != 1 ||
+	    hdr.magic != MDC_SNAP_MAGIC || hdr.version != MDC_SNAP_VERSION) {
+		LogWarn(COMPONENT_CACHE_INODE,
+			"Ignoring cache snapshot %s, bad header", path);
+		goto out;
+	}
+
+	while (!admin_shutdown &&
+	       fread(&rec, sizeof(rec), 1, snap) == 1) {
+		struct gsh_buffdesc fh_desc = { buf, rec.len };
+		mdcache_entry_t *entry;
+		fsal_status_t status;
+
+		if (rec.len > sizeof(buf) ||
+		    fread(buf, rec.len, 1, snap) != 1) {
+			LogWarn(COMPONENT_CACHE_INODE,
+				"Cache snapshot %s is truncated", path);
+			break;
+		}
+
+		if (atomic_fetch_uint64_t(&lru_state.entries_used) >=
+		    lru_state.entries_hiwat || mdcache_lru_over_memory())
+			break;
+
+		if (tried != 0 && tried % rate == 0)
+			sleep(1);
+		tried++;
+
+		if (mdc_snap_export(rec.export_id, &export) == NULL)
+			continue;
+
+		init_root_op_context(&root_op_context, export,
+				     export->fsal_export, 0, 0,
+				     UNKNOWN_REQUEST);
+
+		status = export->fsal_export->exp_ops.wire_to_host(
+				export->fsal_export, FSAL_DIGEST_NFSV4,
+				&fh_desc, 0);
+		if (!FSAL_IS_ERROR(status))
+			status = mdcache_locate_host(
+				&fh_desc, mdc_export(export->fsal_export),
+				&entry, NULL);
+		if (!FSAL_IS_ERROR(status)) {
+			mdcache_put(entry);
+			loaded++;
+		}
+
+		release_root_op_context();
+	}
+
+	LogEvent(COMPONENT_CACHE_INODE,
+		 "Loaded %" PRIu64 " of %" PRIu64
+		 " handles tried from cache snapshot %s",
+		 loaded, tried, path);
+
+out:
+	if (export != NULL)
+		put_gsh_export(export);
+	(void) fclose(snap);
+}
+
+/**
+ * @brief Snapshot thread
+ *
+ * The first pass waits for the exports and loads the snapshot, the
+ * following ones save it.
+ *
+ * @param[in] ctx  Fridge context
+ */
+
+static void mdc_snap_run(struct fridgethr_context *ctx)
+{
+	bool loaded;
+
+	SetNameFunction("cache_snap");
+
+	PTHREAD_MUTEX_lock(&mdc_snap.mtx);
+	loaded = mdc_snap.loaded;
+	PTHREAD_MUTEX_unlock(&mdc_snap.mtx);
+
+	if (!loaded) {
+		nfs_init_wait();
+		mdc_snap_load();
+
+		PTHREAD_MUTEX_lock(&mdc_snap.mtx);
+		mdc_snap.loaded = true;
+		mdc_snap.last_save = time(NULL);
+		PTHREAD_MUTEX_unlock(&mdc_snap.mtx);
+	} else if (mdcache_param.snapshot_interval != 0 &&
+		   time(NULL) - mdc_snap.last_save >=
+				mdcache_param.snapshot_interval) {
+		mdcache_snapshot_save();
+	}
+
+	fridgethr_setwait(ctx, mdcache_param.snapshot_interval != 0 ?
+				mdcache_param.snapshot_interval : 3600);
+}
+
+/**
+ * @brief Start the snapshot thread, if a snapshot is configured
+ */
+
+void mdcache_snapshot_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (mdcache_param.snapshot_file == NULL)
+		return;
+
+	PTHREAD_MUTEX_init(&mdc_snap.mtx, NULL);
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = 1;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&mdc_snap.fridge, "MDC_snapshot", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to initialize cache snapshot fridge, error code %d.",
+			 rc);
+		return;
+	}
+
+	rc = fridgethr_submit(mdc_snap.fridge, mdc_snap_run, NULL);
+	if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to start cache snapshot thread, error code %d.",
+			 rc);
+		fridgethr_destroy(mdc_snap.fridge);
+		mdc_snap.fridge = NULL;
+	}
+}
+
+/**
+ * @brief Stop the snapshot thread
+ */
+
+void mdcache_snapshot_pkgshutdown(void)
+{
+	int rc;
+
+	if (mdc_snap.fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(mdc_snap.fridge, fridgethr_comm_stop, 120);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(mdc_snap.fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Failed shutting down cache snapshot thread: %d", rc);
+	}
+}
+
+/** @} */
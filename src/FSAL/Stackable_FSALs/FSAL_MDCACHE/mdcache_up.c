@@ -37,11 +37,84 @@
 #include "nfs4_acls.h"
 #include "mdcache_hash.h"
 #include "mdcache_int.h"
+#include "mdcache.h"
 #include "nfs4_fs_locations.h"
+#include "fsal_up.h"
+#include "fridgethr.h"
+#include "delayed_exec.h"
+#include "sal_data.h"
+
+/**
+ * @brief Drop the cached state an invalidate upcall names
+ *
+ * @param[in] entry  Entry to invalidate
+ * @param[in] flags  FSAL_UP_INVALIDATE*
+ */
+
+static void mdc_up_clear(mdcache_entry_t *entry, uint32_t flags)
+{
+	atomic_clear_uint32_t_bits(&entry->mde_flags,
+				   flags & FSAL_UP_INVALIDATE_CACHE);
+
+	/* Names missing from the directory may exist now */
+	if (flags & (FSAL_UP_INVALIDATE_CONTENT |
+		     FSAL_UP_INVALIDATE_DIR_POPULATED))
+		atomic_clear_uint32_t_bits(&entry->mde_flags,
+					   MDCACHE_DIR_NEGATIVE);
+
+	/* The directory changed behind our back, nobody was notified */
+	if (entry->obj_handle.type == DIRECTORY &&
+	    (flags & FSAL_UP_INVALIDATE_CONTENT) &&
+	    entry->obj_handle.state_hdl != NULL &&
+	    atomic_fetch_uint32_t(
+		&entry->obj_handle.state_hdl->dir.dir_delegations) != 0)
+		(void)async_delegrecall(general_fridge, &entry->obj_handle);
+}
+
+/**
+ * @brief Drop what is cached of an export
+ *
+ * Every entry of the export is invalidated as by an upcall naming all
+ * of its cached state, so the next use of each fetches it again.  This
+ * is how what was published behind an Immutable export is made
+ * visible.
+ *
+ * @param[in] export  Export to invalidate
+ *
+ * @return Number of entries invalidated.
+ */
+
+uint64_t mdcache_export_invalidate(struct gsh_export *export)
+{
+	struct mdcache_fsal_export *exp;
+	struct entry_export_map *expmap;
+	struct glist_head *glist;
+	uint64_t count = 0;
+
+	if (export->fsal_export->fsal != &MDCACHE.module)
+		return 0;
+
+	exp = mdc_export(export->fsal_export);
+
+	PTHREAD_RWLOCK_rdlock(&exp->mdc_exp_lock);
+	glist_for_each(glist, &exp->entry_list) {
+		expmap = glist_entry(glist, struct entry_export_map,
+				     entry_per_export);
+		mdc_up_clear(expmap->entry, FSAL_UP_INVALIDATE_CACHE);
+		count++;
+	}
+	PTHREAD_RWLOCK_unlock(&exp->mdc_exp_lock);
+
+	LogEvent(COMPONENT_CACHE_INODE,
+		 "Invalidated %" PRIu64 " cached entries of export %" PRIu16,
+		 count, export->export_id);
+
+	return count;
+}
 
 static fsal_status_t
-mdc_up_invalidate(const struct fsal_up_vector *vec, struct gsh_buffdesc *handle,
-		  uint32_t flags)
+mdc_up_invalidate_now(const struct fsal_up_vector *vec,
+		      struct gsh_buffdesc *handle, uint32_t flags)
 {
 	mdcache_entry_t *entry;
 	fsal_status_t status;
@@ -67,8 +140,7 @@ mdc_up_invalidate(const struct fsal_up_vector *vec, struct gsh_buffdesc *handle,
 		goto out;
 	}
 
-	atomic_clear_uint32_t_bits(&entry->mde_flags,
-				   flags & FSAL_UP_INVALIDATE_CACHE);
+	mdc_up_clear(entry, flags);
 
 	if (flags & FSAL_UP_INVALIDATE_CLOSE)
 		status = fsal_close(&entry->obj_handle);
@@ -80,6 +152,306 @@ out:
 	return status;
 }
 
+/* Batched invalidation
+ *
+ * With Upcall_Batch_Window set, invalidates are parked here instead of
+ * being applied as they come.  Repeats for a handle fold into one, and
+ * a single flush per window walks them a hash partition at a time, so
+ * a storm of upcalls costs one thread handoff and one partition lock
+ * per window instead of one of each per upcall.
+ */
+
+/** Buckets used to find a pending invalidate of the same handle */
+#define MDC_UP_BATCH_BUCKETS 1024
+
+/** Pending invalidates at which the upcall applies the batch itself */
+#define MDC_UP_BATCH_MAX 65536
+
+struct mdc_up_pending {
+	struct glist_head bucket;	/*< On the bucket for its hash */
+	struct glist_head q;		/*< On the batch, then a partition */
+	struct gsh_export *export;	/*< Reference held until applied */
+	struct fsal_export *fsal_export;
+	mdcache_entry_t *entry;		/*< Referenced entry to close */
+	mdcache_key_t key;
+	uint32_t flags;
+	char handle[];
+};
+
+static struct {
+	pthread_mutex_t mtx;
+	struct glist_head buckets[MDC_UP_BATCH_BUCKETS];
+	struct glist_head pending;
+	uint32_t count;
+	uint64_t coalesced;	/*< Upcalls folded into a pending one */
+	bool queued;		/*< A flush has been submitted */
+} mdc_up_batch;
+
+/**
+ * @brief Apply a batch of pending invalidates
+ *
+ * Upcalls were answered when they were parked, so errors here are only
+ * logged.
+ *
+ * @param[in] batch  Pending invalidates, emptied on return
+ */
+
+static void mdc_up_batch_apply(struct glist_head *batch)
+{
+	uint32_t npart = cih_fhcache.npart, ix;
+	struct glist_head *parts, *glist, *glistn;
+	struct glist_head closing;
+	struct mdc_up_pending *pend;
+	struct req_op_context *save_ctx, req_ctx = {0};
+	cih_latch_t latch;
+	fsal_status_t status;
+
+	parts = gsh_malloc(npart * sizeof(*parts));
+	for (ix = 0; ix < npart; ix++)
+		glist_init(&parts[ix]);
+	glist_init(&closing);
+
+	glist_for_each_safe(glist, glistn, batch) {
+		pend = glist_entry(glist, struct mdc_up_pending, q);
+		latch.cp = cih_partition_of_scalar(&cih_fhcache, pend->key.hk);
+		glist_del(&pend->q);
+		glist_add_tail(&parts[latch.cp->part_ix], &pend->q);
+	}
+
+	for (ix = 0; ix < npart; ix++) {
+		if (glist_empty(&parts[ix]))
+			continue;
+
+		latch.cp = &cih_fhcache.partition[ix];
+		PTHREAD_RWLOCK_rdlock(&latch.cp->lock);
+
+		glist_for_each_safe(glist, glistn, &parts[ix]) {
+			pend = glist_entry(glist, struct mdc_up_pending, q);
+			glist_del(&pend->q);
+			pend->entry = cih_lookup_latched(&pend->key, &latch);
+
+			/* The partition lock keeps a hashed entry alive;
+			 * only a close needs it past the lock.
+			 */
+			if (pend->entry) {
+				mdc_up_clear(pend->entry, pend->flags);
+				if ((pend->flags & FSAL_UP_INVALIDATE_CLOSE) &&
+				    !FSAL_IS_ERROR(mdcache_lru_ref(
+						pend->entry, LRU_FLAG_NONE))) {
+					glist_add_tail(&closing, &pend->q);
+					continue;
+				}
+			}
+
+			put_gsh_export(pend->export);
+			gsh_free(pend);
+		}
+
+		cih_hash_release(&latch);
+	}
+
+	gsh_free(parts);
+
+	save_ctx = op_ctx;
+	op_ctx = &req_ctx;
+
+	glist_for_each_safe(glist, glistn, &closing) {
+		pend = glist_entry(glist, struct mdc_up_pending, q);
+		glist_del(&pend->q);
+
+		req_ctx.ctx_export = pend->export;
+		req_ctx.fsal_export = pend->fsal_export;
+		status = fsal_close(&pend->entry->obj_handle);
+		if (FSAL_IS_ERROR(status))
+			LogDebug(COMPONENT_CACHE_INODE,
+				 "Close of entry %p for invalidate failed: %s",
+				 pend->entry, fsal_err_txt(status));
+
+		mdcache_put(pend->entry);
+		put_gsh_export(pend->export);
+		gsh_free(pend);
+	}
+
+	op_ctx = save_ctx;
+}
+
+/**
+ * @brief Take the pending invalidates off the batch
+ *
+ * @param[out] batch  List to move them to
+ *
+ * @return Number of invalidates taken
+ */
+
+static uint32_t mdc_up_batch_take(struct glist_head *batch)
+{
+	uint32_t count, ix;
+
+	glist_init(batch);
+
+	PTHREAD_MUTEX_lock(&mdc_up_batch.mtx);
+
+	glist_splice_tail(batch, &mdc_up_batch.pending);
+	count = mdc_up_batch.count;
+	mdc_up_batch.count = 0;
+	mdc_up_batch.queued = false;
+	if (count != 0) {
+		for (ix = 0; ix < MDC_UP_BATCH_BUCKETS; ix++)
+			glist_init(&mdc_up_batch.buckets[ix]);
+	}
+
+	PTHREAD_MUTEX_unlock(&mdc_up_batch.mtx);
+
+	return count;
+}
+
+/**
+ * @brief Apply whatever the batch holds
+ */
+
+static void mdc_up_batch_flush(void)
+{
+	struct glist_head batch;
+	uint32_t count;
+
+	count = mdc_up_batch_take(&batch);
+	if (count == 0)
+		return;
+
+	LogDebug(COMPONENT_CACHE_INODE,
+		 "Applying %"PRIu32" batched invalidates, %"PRIu64
+		 " folded so far", count,
+		 atomic_fetch_uint64_t(&mdc_up_batch.coalesced));
+
+	mdc_up_batch_apply(&batch);
+}
+
+/**
+ * @brief Flush the batch on a general_fridge thread
+ */
+
+static void mdc_up_batch_run(struct fridgethr_context *ctx)
+{
+	mdc_up_batch_flush();
+}
+
+/**
+ * @brief The batch window has passed
+ *
+ * Runs on the delayed executor, so hand the flush off rather than
+ * holding that thread for a partition walk.
+ */
+
+static void mdc_up_batch_due(void *arg)
+{
+	int rc;
+
+	rc = fridgethr_submit(general_fridge, mdc_up_batch_run, NULL);
+	if (rc != 0) {
+		LogDebug(COMPONENT_CACHE_INODE,
+			 "Could not submit invalidate flush: %d", rc);
+		mdc_up_batch_flush();
+	}
+}
+
+/**
+ * @brief Park an invalidate on the batch
+ *
+ * An invalidate of a handle already waiting just adds its flags.
+ *
+ * @param[in] vec    Up ops vector
+ * @param[in] handle Handle of the object
+ * @param[in] flags  FSAL_UP_INVALIDATE*
+ *
+ * @return FSAL status
+ */
+
+static fsal_status_t
+mdc_up_batch_add(const struct fsal_up_vector *vec,
+		 struct gsh_buffdesc *handle, uint32_t flags)
+{
+	struct fsal_module *fsal = vec->up_fsal_export->sub_export->fsal;
+	struct mdc_up_pending *pend;
+	struct glist_head *bucket, *glist;
+	mdcache_key_t key;
+	bool submit, full;
+	int rc;
+
+	(void) cih_hash_key(&key, fsal, handle, CIH_HASH_KEY_PROTOTYPE);
+
+	PTHREAD_MUTEX_lock(&mdc_up_batch.mtx);
+
+	bucket = &mdc_up_batch.buckets[key.hk % MDC_UP_BATCH_BUCKETS];
+	glist_for_each(glist, bucket) {
+		pend = glist_entry(glist, struct mdc_up_pending, bucket);
+		if (pend->export == vec->up_gsh_export &&
+		    mdcache_key_cmp(&pend->key, &key) == 0) {
+			pend->flags |= flags;
+			mdc_up_batch.coalesced++;
+			PTHREAD_MUTEX_unlock(&mdc_up_batch.mtx);
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+		}
+	}
+
+	pend = gsh_malloc(sizeof(*pend) + handle->len);
+	memcpy(pend->handle, handle->addr, handle->len);
+	pend->key = key;
+	pend->key.kv.addr = pend->handle;
+	pend->flags = flags;
+	pend->entry = NULL;
+	pend->export = vec->up_gsh_export;
+	pend->fsal_export = vec->up_fsal_export;
+	get_gsh_export_ref(pend->export);
+
+	glist_add_tail(bucket, &pend->bucket);
+	glist_add_tail(&mdc_up_batch.pending, &pend->q);
+	mdc_up_batch.count++;
+
+	full = mdc_up_batch.count >= MDC_UP_BATCH_MAX;
+	submit = !mdc_up_batch.queued;
+	mdc_up_batch.queued = true;
+
+	PTHREAD_MUTEX_unlock(&mdc_up_batch.mtx);
+
+	/* Don't let a storm grow the batch without bound */
+	if (full)
+		mdc_up_batch_flush();
+
+	if (!submit)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	rc = delayed_submit(mdc_up_batch_due, NULL,
+			    mdcache_param.upcall_batch_window * NS_PER_MSEC);
+	if (rc != 0) {
+		/* No flush coming; apply what is pending here */
+		LogDebug(COMPONENT_CACHE_INODE,
+			 "Could not schedule invalidate flush: %d", rc);
+		mdc_up_batch_flush();
+	}
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Invalidate a cached entry
+ *
+ * @param[in] vec    Up ops vector
+ * @param[in] handle Handle of the object
+ * @param[in] flags  FSAL_UP_INVALIDATE*
+ *
+ * @return FSAL status
+ */
+
+static fsal_status_t
+mdc_up_invalidate(const struct fsal_up_vector *vec, struct gsh_buffdesc *handle,
+		  uint32_t flags)
+{
+	if (mdcache_param.upcall_batch_window != 0)
+		return mdc_up_batch_add(vec, handle, flags);
+
+	return mdc_up_invalidate_now(vec, handle, flags);
+}
+
 /**
  * @brief Update cached attributes
  *
@@ -149,7 +521,8 @@ mdc_up_update(const struct fsal_up_vector *vec, struct gsh_buffdesc *handle,
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS |
 					   MDCACHE_TRUST_CONTENT |
-					   MDCACHE_DIR_POPULATED);
+					   MDCACHE_DIR_POPULATED |
+					   MDCACHE_DIR_NEGATIVE);
 
 		status = fsal_close(&entry->obj_handle);
 
@@ -301,7 +674,8 @@ mdc_up_update(const struct fsal_up_vector *vec, struct gsh_buffdesc *handle,
 				     entry);
 			atomic_clear_uint32_t_bits(&entry->mde_flags,
 						   MDCACHE_TRUST_CONTENT |
-						   MDCACHE_DIR_POPULATED);
+						   MDCACHE_DIR_POPULATED |
+						   MDCACHE_DIR_NEGATIVE);
 		}
 		status = fsalstat(ERR_FSAL_NO_ERROR, 0);
 	} else {
@@ -337,6 +711,10 @@ mdc_up_invalidate_close(const struct fsal_up_vector *vec,
 {
 	fsal_status_t status;
 
+	if (mdcache_param.upcall_batch_window != 0)
+		return mdc_up_batch_add(vec, key,
+					flags | FSAL_UP_INVALIDATE_CLOSE);
+
 	status = up_async_invalidate(general_fridge, vec, key,
 				     flags | FSAL_UP_INVALIDATE_CLOSE,
 				     NULL, NULL);
@@ -448,6 +826,41 @@ state_status_t mdc_up_layoutrecall(const struct fsal_up_vector *vec,
 	return rc;
 }
 
+/** Perform a layoutrecall on a whole filesystem
+ *
+ * Pass to upper layer
+ *
+ * @param[in] vec	   Up ops vector
+ * @param[in] layout_type  The type of layout to recall
+ * @param[in] changed      Whether the layout has changed and the
+ *                         client ought to finish writes through MDS
+ * @param[in] io_mode      Iomode of the layouts to recall
+ * @param[in] fsid         Filesystem to recall, NULL for all of them
+ *
+ */
+state_status_t mdc_up_layoutrecall_fsid(const struct fsal_up_vector *vec,
+					layouttype4 layout_type,
+					bool changed,
+					layoutiomode4 io_mode,
+					const fsal_fsid_t *fsid)
+{
+	struct mdcache_fsal_export *myself = mdc_export(vec->up_fsal_export);
+	state_status_t rc;
+	struct req_op_context *save_ctx, req_ctx = {0};
+
+	req_ctx.ctx_export = vec->up_gsh_export;
+	req_ctx.fsal_export = vec->up_fsal_export;
+	save_ctx = op_ctx;
+	op_ctx = &req_ctx;
+
+	rc = myself->super_up_ops.layoutrecall_fsid(vec, layout_type, changed,
+						    io_mode, fsid);
+
+	op_ctx = save_ctx;
+
+	return rc;
+}
+
 /** Recall a delegation
  *
  * Pass to upper layer
@@ -474,6 +887,27 @@ state_status_t mdc_up_delegrecall(const struct fsal_up_vector *vec,
 	return rc;
 }
 
+/**
+ * @brief Set up invalidate batching
+ */
+void mdcache_up_pkginit(void)
+{
+	uint32_t ix;
+
+	PTHREAD_MUTEX_init(&mdc_up_batch.mtx, NULL);
+	glist_init(&mdc_up_batch.pending);
+	for (ix = 0; ix < MDC_UP_BATCH_BUCKETS; ix++)
+		glist_init(&mdc_up_batch.buckets[ix]);
+}
+
+/**
+ * @brief Apply any invalidates still waiting on the batch
+ */
+void mdcache_up_pkgshutdown(void)
+{
+	mdc_up_batch_flush();
+}
+
 fsal_status_t
 mdcache_export_up_ops_init(struct fsal_up_vector *my_up_ops,
 			   const struct fsal_up_vector *super_up_ops)
@@ -492,6 +926,7 @@ mdcache_export_up_ops_init(struct fsal_up_vector *my_up_ops,
 	my_up_ops->lock_grant = mdc_up_lock_grant;
 	my_up_ops->lock_avail = mdc_up_lock_avail;
 	my_up_ops->layoutrecall = mdc_up_layoutrecall;
+	my_up_ops->layoutrecall_fsid = mdc_up_layoutrecall_fsid;
 	/* notify_device cannot call into MDCACHE */
 	my_up_ops->delegrecall = mdc_up_delegrecall;
 
@@ -0,0 +1,647 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file  mdcache_warm.c
+ * @brief Warming the cache with a subtree, asked for over DBus
+ *
+ * A warm reads every directory of a subtree of an export, breadth
+ * first and down to a given depth, through the cache itself, so that
+ * the entries, their attributes and the dirent chunks are all cached,
+ * and can read the targets of the symlinks found too.  It runs on a
+ * thread of its own, at most so many entries a second, and stops at
+ * shutdown, when cancelled, or once the cache is as full as the Reaper
+ * lets it get.  One warm runs at a time; its progress is kept until
+ * the next one starts.
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include "fsal.h"
+#include "fridgethr.h"
+#include "nfs_core.h"
+#include "nfs_exports.h"
+#include "export_mgr.h"
+#include "mdcache.h"
+#include "mdcache_int.h"
+#include "mdcache_lru.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#include "server_stats_private.h"
+#endif
+
+/**
+ * @brief A directory waiting to be read, referenced
+ */
+struct mdc_warm_obj {
+	struct glist_head list;
+	struct fsal_obj_handle *obj;
+	uint32_t depth;		/*< Levels below the top of the warm */
+};
+
+static struct {
+	struct fridgethr *fridge;
+	pthread_mutex_t mtx;	/*< Protects all but the counters */
+	enum mdc_warm_state state;
+	bool cancel;		/*< Asked to stop */
+	uint16_t export_id;
+	char *path;
+	uint32_t depth;		/*< Levels to read, 0 for all */
+	uint32_t rate;		/*< Entries a second */
+	bool symlinks;		/*< Read the symlink targets too */
+	struct timespec start;
+	struct timespec end;
+	uint64_t dirs;
+	uint64_t entries;
+	uint64_t links;
+	uint64_t errors;
+	uint64_t queued;	/*< Directories waiting to be read */
+} mdc_warm;
+
+static const char * const mdc_warm_state_str[] = {
+	[MDC_WARM_IDLE] = "idle",
+	[MDC_WARM_RUNNING] = "running",
+	[MDC_WARM_DONE] = "done",
+	[MDC_WARM_CANCELLED] = "cancelled",
+	[MDC_WARM_FULL] = "cache full",
+	[MDC_WARM_FAILED] = "failed",
+};
+
+/**
+ * @brief State of one warm, for the readdir callback
+ */
+struct mdc_warm_job {
+	struct fridgethr_context *ctx;
+	struct glist_head dirs;		/*< Directories to read */
+	struct glist_head links;	/*< Symlinks of the last read */
+	uint32_t budget;		/*< Entries left this second */
+	uint32_t depth;			/*< Depth of the directory read */
+	fsal_cookie_t cookie;		/*< Last entry taken */
+	bool stop;
+};
+
+/**
+ * @brief Whether to stop the warm, and why
+ */
+
+static bool mdc_warm_stop(struct mdc_warm_job *job)
+{
+	enum mdc_warm_state state = MDC_WARM_RUNNING;
+
+	if (job->stop)
+		return true;
+
+	if (admin_shutdown || fridgethr_you_should_break(job->ctx))
+		state = MDC_WARM_CANCELLED;
+	else if (atomic_fetch_uint64_t(&lru_state.entries_used) >=
+		 lru_state.entries_hiwat || mdcache_lru_over_memory())
+		state = MDC_WARM_FULL;
+
+	PTHREAD_MUTEX_lock(&mdc_warm.mtx);
+	if (mdc_warm.cancel)
+		state = MDC_WARM_CANCELLED;
+	if (state != MDC_WARM_RUNNING) {
+		mdc_warm.state = state;
+		job->stop = true;
+	}
+	PTHREAD_MUTEX_unlock(&mdc_warm.mtx);
+
+	return job->stop;
+}
+
+/**
+ * @brief Wait out the second once its entries are used up
+ */
+
+static void mdc_warm_throttle(struct mdc_warm_job *job)
+{
+	if (job->budget != 0)
+		return;
+
+	sleep(1);
+	job->budget = mdc_warm.rate;
+}
+
+/**
+ * @brief Queue an object to be read, or release it
+ *
+ * @param[in] job    The warm
+ * @param[in] obj    Object, referenced
+ * @param[in] depth  Its depth
+ */
+
+static void mdc_warm_queue(struct mdc_warm_job *job,
+			   struct fsal_obj_handle *obj, uint32_t depth)
+{
+	struct mdc_warm_obj *item;
+	struct glist_head *list = NULL;
+
+	if (obj->type == DIRECTORY &&
+	    (mdc_warm.depth == 0 || depth < mdc_warm.depth))
+		list = &job->dirs;
+	else if (obj->type == SYMBOLIC_LINK && mdc_warm.symlinks)
+		list = &job->links;
+
+	if (list == NULL) {
+		obj->obj_ops->put_ref(obj);
+		return;
+	}
+
+	item = gsh_malloc(sizeof(*item));
+	item->obj = obj;
+	item->depth = depth;
+	glist_add_tail(list, &item->list);
+
+	if (list == &job->dirs)
+		atomic_inc_uint64_t(&mdc_warm.queued);
+}
+
+/**
+ * @brief Take each entry of a directory read
+ *
+ * The batch ends once the entries of this second are used up, so the
+ * content lock of the directory is never held while waiting; the read
+ * goes on from the last entry taken.
+ */
+
+static enum fsal_dir_result mdc_warm_cb(const char *name,
+					struct fsal_obj_handle *obj,
+					struct attrlist *attrs,
+					void *dir_state,
+					fsal_cookie_t cookie)
+{
+	struct mdc_warm_job *job = dir_state;
+
+	if (job->budget == 0 || mdc_warm_stop(job)) {
+		obj->obj_ops->put_ref(obj);
+		return DIR_TERMINATE;
+	}
+
+	job->budget--;
+	job->cookie = cookie;
+	atomic_inc_uint64_t(&mdc_warm.entries);
+
+	mdc_warm_queue(job, obj, job->depth + 1);
+
+	return DIR_CONTINUE;
+}
+
+/**
+ * @brief Read the targets of the symlinks queued
+ */
+
+static void mdc_warm_links(struct mdc_warm_job *job)
+{
+	struct mdc_warm_obj *item;
+	struct gsh_buffdesc link;
+	fsal_status_t status;
+
+	while ((item = glist_first_entry(&job->links, struct mdc_warm_obj,
+					 list)) != NULL) {
+		glist_del(&item->list);
+
+		if (!mdc_warm_stop(job)) {
+			mdc_warm_throttle(job);
+			job->budget--;
+
+			status = item->obj->obj_ops->readlink(item->obj, &link,
+							       false);
+			if (FSAL_IS_ERROR(status)) {
+				atomic_inc_uint64_t(&mdc_warm.errors);
+			} else {
+				atomic_inc_uint64_t(&mdc_warm.links);
+				gsh_free(link.addr);
+			}
+		}
+
+		item->obj->obj_ops->put_ref(item->obj);
+		gsh_free(item);
+	}
+}
+
+/**
+ * @brief Read a directory into the cache
+ *
+ * @param[in] job  The warm
+ * @param[in] dir  Directory
+ */
+
+static void mdc_warm_dir(struct mdc_warm_job *job,
+			 struct fsal_obj_handle *dir)
+{
+	fsal_status_t status;
+	bool eod = false;
+	fsal_cookie_t *whence = NULL;
+
+	job->cookie = 0;
+
+	while (!eod && !mdc_warm_stop(job)) {
+		mdc_warm_throttle(job);
+
+		status = dir->obj_ops->readdir(dir, whence, job, mdc_warm_cb,
+					       ATTRS_NFS3, &eod);
+		if (FSAL_IS_ERROR(status)) {
+			LogDebug(COMPONENT_CACHE_INODE,
+				 "Cache warm could not read a directory: %s",
+				 msg_fsal_err(status.major));
+			atomic_inc_uint64_t(&mdc_warm.errors);
+			break;
+		}
+
+		if (job->cookie != 0)
+			whence = &job->cookie;
+
+		mdc_warm_links(job);
+	}
+
+	/* Release the symlinks of a read cut short */
+	mdc_warm_links(job);
+
+	atomic_inc_uint64_t(&mdc_warm.dirs);
+}
+
+/**
+ * @brief Look the top of the warm up from the root of the export
+ *
+ * @param[in]  export  Export
+ * @param[out] obj     Object found, referenced
+ *
+ * @return FSAL status.
+ */
+
+static fsal_status_t mdc_warm_lookup(struct gsh_export *export,
+				     struct fsal_obj_handle **obj)
+{
+	struct fsal_obj_handle *next;
+	fsal_status_t status;
+	char *path, *name, *save = NULL;
+
+	status = nfs_export_get_root_entry(export, obj);
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	path = gsh_strdup(mdc_warm.path);
+
+	for (name = strtok_r(path, "/", &save); name != NULL;
+	     name = strtok_r(NULL, "/", &save)) {
+		if (strcmp(name, ".") == 0)
+			continue;
+
+		if (strcmp(name, "..") == 0) {
+			status = fsalstat(ERR_FSAL_INVAL, 0);
+		} else if ((*obj)->type != DIRECTORY) {
+			status = fsalstat(ERR_FSAL_NOTDIR, 0);
+		} else {
+			status = (*obj)->obj_ops->lookup(*obj, name, &next,
+							 NULL);
+		}
+
+		(*obj)->obj_ops->put_ref(*obj);
+		*obj = NULL;
+
+		if (FSAL_IS_ERROR(status))
+			break;
+
+		*obj = next;
+	}
+
+	gsh_free(path);
+
+	return status;
+}
+
+/**
+ * @brief Warm thread
+ *
+ * @param[in] ctx  Fridge context
+ */
+
+static void mdc_warm_run(struct fridgethr_context *ctx)
+{
+	struct gsh_export *export;
+	struct root_op_context root_op_context;
+	struct mdc_warm_job job;
+	struct mdc_warm_obj *item;
+	struct fsal_obj_handle *top = NULL;
+	fsal_status_t status;
+
+	SetNameFunction("cache_warm");
+
+	memset(&job, 0, sizeof(job));
+	job.ctx = ctx;
+	job.budget = mdc_warm.rate;
+	glist_init(&job.dirs);
+	glist_init(&job.links);
+
+	export = get_gsh_export(mdc_warm.export_id);
+	if (export == NULL) {
+		status = fsalstat(ERR_FSAL_STALE, 0);
+		goto out;
+	}
+
+	init_root_op_context(&root_op_context, export, export->fsal_export,
+			     0, 0, UNKNOWN_REQUEST);
+
+	status = mdc_warm_lookup(export, &top);
+	if (!FSAL_IS_ERROR(status)) {
+		mdc_warm_queue(&job, top, 0);
+		if (top->type != DIRECTORY)
+			mdc_warm_links(&job);
+	}
+
+	while ((item = glist_first_entry(&job.dirs, struct mdc_warm_obj,
+					 list)) != NULL) {
+		glist_del(&item->list);
+		atomic_dec_uint64_t(&mdc_warm.queued);
+
+		if (!mdc_warm_stop(&job)) {
+			job.depth = item->depth;
+			mdc_warm_dir(&job, item->obj);
+		}
+
+		item->obj->obj_ops->put_ref(item->obj);
+		gsh_free(item);
+	}
+
+	release_root_op_context();
+	put_gsh_export(export);
+
+out:
+	PTHREAD_MUTEX_lock(&mdc_warm.mtx);
+	now(&mdc_warm.end);
+	if (FSAL_IS_ERROR(status))
+		mdc_warm.state = MDC_WARM_FAILED;
+	else if (mdc_warm.state == MDC_WARM_RUNNING)
+		mdc_warm.state = MDC_WARM_DONE;
+
+	if (FSAL_IS_ERROR(status)) {
+		LogWarn(COMPONENT_CACHE_INODE,
+			"Could not warm the cache with %s of export %"
+			PRIu16 ": %s",
+			mdc_warm.path, mdc_warm.export_id,
+			msg_fsal_err(status.major));
+	} else {
+		LogEvent(COMPONENT_CACHE_INODE,
+			 "Cache warm with %s of export %" PRIu16
+			 " %s after %" PRIu64 " directories, %" PRIu64
+			 " entries",
+			 mdc_warm.path, mdc_warm.export_id,
+			 mdc_warm_state_str[mdc_warm.state],
+			 atomic_fetch_uint64_t(&mdc_warm.dirs),
+			 atomic_fetch_uint64_t(&mdc_warm.entries));
+	}
+
+	PTHREAD_MUTEX_unlock(&mdc_warm.mtx);
+}
+
+/**
+ * @brief Start warming the cache with a subtree of an export
+ *
+ * @param[in]  export_id  Export
+ * @param[in]  path       Top of the subtree, from the root of the export
+ * @param[in]  depth      Levels of directories to read, 0 for all
+ * @param[in]  rate       Entries to read a second
+ * @param[in]  symlinks   Read the targets of the symlinks found
+ * @param[out] errormsg   Why it can't be started
+ *
+ * @return true if the warm was started.
+ */
+
+bool mdcache_warm_start(uint16_t export_id, const char *path,
+			uint32_t depth, uint32_t rate, bool symlinks,
+			char **errormsg)
+{
+	struct gsh_export *export;
+	bool started = false;
+	int rc;
+
+	if (mdc_warm.fridge == NULL) {
+		*errormsg = "Cache warming is not available";
+		return false;
+	}
+
+	if (rate == 0) {
+		*errormsg = "Rate must be at least one entry a second";
+		return false;
+	}
+
+	export = get_gsh_export(export_id);
+	if (export == NULL) {
+		*errormsg = "Export id not found";
+		return false;
+	}
+
+	if (export->fsal_export->fsal != &MDCACHE.module) {
+		*errormsg = "Export is not cached";
+		goto out;
+	}
+
+	PTHREAD_MUTEX_lock(&mdc_warm.mtx);
+
+	if (mdc_warm.state == MDC_WARM_RUNNING) {
+		PTHREAD_MUTEX_unlock(&mdc_warm.mtx);
+		*errormsg = "A cache warm is already running";
+		goto out;
+	}
+
+	gsh_free(mdc_warm.path);
+	mdc_warm.path = gsh_strdup(path);
+	mdc_warm.export_id = export_id;
+	mdc_warm.depth = depth;
+	mdc_warm.rate = rate;
+	mdc_warm.symlinks = symlinks;
+	mdc_warm.cancel = false;
+	mdc_warm.dirs = 0;
+	mdc_warm.entries = 0;
+	mdc_warm.links = 0;
+	mdc_warm.errors = 0;
+	mdc_warm.queued = 0;
+	now(&mdc_warm.start);
+	mdc_warm.end = mdc_warm.start;
+	mdc_warm.state = MDC_WARM_RUNNING;
+
+	rc = fridgethr_submit(mdc_warm.fridge, mdc_warm_run, NULL);
+	if (rc != 0) {
+		mdc_warm.state = MDC_WARM_FAILED;
+		*errormsg = "Could not start the cache warm thread";
+	} else {
+		started = true;
+	}
+
+	PTHREAD_MUTEX_unlock(&mdc_warm.mtx);
+
+	if (started)
+		LogEvent(COMPONENT_CACHE_INODE,
+			 "Warming the cache with %s of export %" PRIu16
+			 ", depth %" PRIu32 ", %" PRIu32 " entries a second",
+			 path, export_id, depth, rate);
+
+out:
+	put_gsh_export(export);
+	return started;
+}
+
+/**
+ * @brief Stop the running cache warm, if any
+ *
+ * @return true if a warm was running.
+ */
+
+bool mdcache_warm_cancel(void)
+{
+	bool running;
+
+	PTHREAD_MUTEX_lock(&mdc_warm.mtx);
+	running = mdc_warm.state == MDC_WARM_RUNNING;
+	if (running)
+		mdc_warm.cancel = true;
+	PTHREAD_MUTEX_unlock(&mdc_warm.mtx);
+
+	return running;
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report the progress of the last cache warm
+ *
+ * struct progress {
+ *	char *state;
+ *	uint16_t export_id;
+ *	char *path;
+ *	uint64_t dirs;		(directories read)
+ *	uint64_t entries;	(entries read)
+ *	uint64_t symlinks;	(symlink targets read)
+ *	uint64_t errors;
+ *	uint64_t queued;	(directories waiting to be read)
+ *	uint64_t elapsed;	(milliseconds)
+ * }
+ *
+ * @param iter   [IN] iterator in reply stream to fill
+ */
+void mdcache_dbus_warm(DBusMessageIter *iter)
+{
+	DBusMessageIter struct_iter;
+	struct timespec timestamp;
+	const char *state, *path;
+	uint16_t export_id;
+	uint64_t val;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	PTHREAD_MUTEX_lock(&mdc_warm.mtx);
+
+	state = mdc_warm_state_str[mdc_warm.state];
+	path = mdc_warm.path != NULL ? mdc_warm.path : "";
+	export_id = mdc_warm.export_id;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &state);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT16,
+				       &export_id);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &path);
+	val = atomic_fetch_uint64_t(&mdc_warm.dirs);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&mdc_warm.entries);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&mdc_warm.links);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&mdc_warm.errors);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = atomic_fetch_uint64_t(&mdc_warm.queued);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	val = timespec_diff(&mdc_warm.start,
+			    mdc_warm.state == MDC_WARM_RUNNING ?
+				&timestamp : &mdc_warm.end) / NS_PER_MSEC;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &val);
+	dbus_message_iter_close_container(iter, &struct_iter);
+
+	PTHREAD_MUTEX_unlock(&mdc_warm.mtx);
+}
+#endif /* USE_DBUS */
+
+/**
+ * @brief Set up the cache warm fridge
+ */
+
+void mdcache_warm_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	PTHREAD_MUTEX_init(&mdc_warm.mtx, NULL);
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 0;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&mdc_warm.fridge, "MDC_warm", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to initialize cache warm fridge, error code %d.",
+			 rc);
+		mdc_warm.fridge = NULL;
+	}
+}
+
+/**
+ * @brief Stop the cache warm thread
+ *
+ * A warm still running stops at its next entry.
+ */
+
+void mdcache_warm_pkgshutdown(void)
+{
+	int rc;
+
+	if (mdc_warm.fridge == NULL)
+		return;
+
+	(void) mdcache_warm_cancel();
+
+	rc = fridgethr_sync_command(mdc_warm.fridge, fridgethr_comm_stop, 120);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(mdc_warm.fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Failed shutting down cache warm thread: %d", rc);
+	}
+
+	fridgethr_destroy(mdc_warm.fridge);
+	mdc_warm.fridge = NULL;
+	gsh_free(mdc_warm.path);
+	mdc_warm.path = NULL;
+}
+
+/** @} */
@@ -39,6 +39,7 @@
 #include "fsal_convert.h"
 #include "FSAL/fsal_commonlib.h"
 #include "mdcache_int.h"
+#include "mdcache_lru.h"
 
 /**
  * @brief List extended attributes on a file
@@ -277,10 +278,323 @@ fsal_status_t mdcache_remove_extattr_by_name(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/** Value buffer tried first when reading an xattr from the sub-FSAL */
+#define MDC_XATTR_VALUE_SIZE 1024
+/** Room for the names of all the xattrs of a file */
+#define MDC_XATTR_LIST_SIZE (64 * 1024)
+
+/**
+ * @brief A cached xattr, or a name the file is known not to have
+ */
+struct mdcache_xattr {
+	struct glist_head link;	/*< Entry in the entry's xattrs.list */
+	uint32_t name_len;	/*< As the sub-FSAL listed it, or as asked */
+	uint32_t value_len;
+	bool negative;		/*< The file has no xattr of this name */
+	char data[];		/*< Name, then value */
+};
+
+/**
+ * @brief Length of an xattr name, not counting a trailing NUL
+ *
+ * Listed names carry their NUL, names asked for usually don't.
+ *
+ * @param[in] name	The name
+ * @param[in] len	Its length
+ *
+ * @return Length to compare.
+ */
+static inline uint32_t mdc_xattr_name_len(const char *name, uint32_t len)
+{
+	if (len > 0 && name[len - 1] == '\0')
+		return len - 1;
+	return len;
+}
+
+/**
+ * @brief Look an xattr up in the cache
+ *
+ * @note The caller must hold the attr_lock
+ *
+ * @param[in] entry	Entry to search
+ * @param[in] name	Name to look for
+ *
+ * @return The cached xattr, or NULL if it's not cached.
+ */
+static struct mdcache_xattr *mdc_xattr_find(mdcache_entry_t *entry,
+					    const xattrname4 *name)
+{
+	uint32_t len = mdc_xattr_name_len(name->utf8string_val,
+					  name->utf8string_len);
+	struct glist_head *glist;
+
+	glist_for_each(glist, &entry->xattrs.list) {
+		struct mdcache_xattr *xattr =
+			glist_entry(glist, struct mdcache_xattr, link);
+
+		if (mdc_xattr_name_len(xattr->data, xattr->name_len) == len &&
+		    memcmp(xattr->data, name->utf8string_val, len) == 0)
+			return xattr;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Add an xattr to the cache
+ *
+ * @note The caller must hold the attr_lock for write
+ *
+ * @param[in] entry	Entry to add to
+ * @param[in] name	Name of the xattr
+ * @param[in] value	Its value, or NULL if the file hasn't got it
+ *
+ * @return false if there was no room under Xattr_Cache_Size.
+ */
+static bool mdc_xattr_add(mdcache_entry_t *entry, const xattrname4 *name,
+			  const xattrvalue4 *value)
+{
+	uint32_t value_len = value != NULL ? value->utf8string_len : 0;
+	size_t size = sizeof(struct mdcache_xattr) + name->utf8string_len +
+		      value_len;
+	struct mdcache_xattr *xattr;
+
+	if (atomic_add_int64_t(&lru_state.xattr_bytes, size) >
+	    mdcache_param.xattr_cache_size) {
+		(void) atomic_sub_int64_t(&lru_state.xattr_bytes, size);
+		return false;
+	}
+
+	xattr = gsh_malloc(size);
+	xattr->name_len = name->utf8string_len;
+	xattr->value_len = value_len;
+	xattr->negative = value == NULL;
+	memcpy(xattr->data, name->utf8string_val, name->utf8string_len);
+	if (value_len != 0)
+		memcpy(xattr->data + xattr->name_len, value->utf8string_val,
+		       value_len);
+
+	glist_add_tail(&entry->xattrs.list, &xattr->link);
+	entry->xattrs.bytes += size;
+
+	return true;
+}
+
+/**
+ * @brief Drop the cached xattrs of an entry
+ *
+ * @note The caller must hold the attr_lock for write, or own the entry
+ *
+ * @param[in] entry	Entry to clear
+ */
+void mdc_xattrs_clear(mdcache_entry_t *entry)
+{
+	struct glist_head *glist, *glistn;
+
+	glist_for_each_safe(glist, glistn, &entry->xattrs.list) {
+		struct mdcache_xattr *xattr =
+			glist_entry(glist, struct mdcache_xattr, link);
+
+		glist_del(&xattr->link);
+		gsh_free(xattr);
+	}
+
+	(void) atomic_sub_int64_t(&lru_state.xattr_bytes,
+				  entry->xattrs.bytes);
+	entry->xattrs.bytes = 0;
+	entry->xattrs.complete = false;
+	atomic_clear_uint32_t_bits(&entry->mde_flags, MDCACHE_TRUST_XATTRS);
+}
+
+/**
+ * @brief Check whether the cached xattrs can be used
+ *
+ * @note The caller must hold the attr_lock
+ *
+ * @param[in] entry	Entry to check
+ *
+ * @return true if they were read at the current change attribute.
+ */
+static inline bool mdc_xattrs_valid(mdcache_entry_t *entry)
+{
+	return test_mde_flags(entry, MDCACHE_TRUST_XATTRS) &&
+	       mdcache_is_attrs_valid(entry, ATTR_CHANGE) &&
+	       entry->xattrs.change == entry->attrs.change;
+}
+
+/**
+ * @brief Read the value of an xattr from the sub-FSAL
+ *
+ * @param[in] entry	Entry to read
+ * @param[in] name	Name of the xattr
+ * @param[out] value	Value, in a buffer the caller must free
+ *
+ * @return FSAL status
+ */
+static fsal_status_t mdc_xattr_fetch(mdcache_entry_t *entry,
+				     xattrname4 *name, xattrvalue4 *value)
+{
+	fsal_status_t status;
+
+	value->utf8string_len = MDC_XATTR_VALUE_SIZE;
+	value->utf8string_val = gsh_malloc(MDC_XATTR_VALUE_SIZE);
+
+	subcall(
+		status = entry->sub_handle->obj_ops->getxattrs(
+			entry->sub_handle, name, value)
+	       );
+
+	if (status.major == ERR_FSAL_TOOSMALL) {
+		/* Ask for the size, then try again with enough room */
+		value->utf8string_len = 0;
+		subcall(
+			status = entry->sub_handle->obj_ops->getxattrs(
+				entry->sub_handle, name, value)
+		       );
+		if (!FSAL_IS_ERROR(status)) {
+			value->utf8string_val = gsh_realloc(
+				value->utf8string_val, value->utf8string_len);
+			subcall(
+				status = entry->sub_handle->obj_ops->getxattrs(
+					entry->sub_handle, name, value)
+			       );
+		}
+	}
+
+	if (FSAL_IS_ERROR(status)) {
+		gsh_free(value->utf8string_val);
+		value->utf8string_val = NULL;
+		value->utf8string_len = 0;
+	}
+
+	return status;
+}
+
+/**
+ * @brief Read all the xattrs of a file into the cache
+ *
+ * One LISTXATTRS and a get of each name.  If it all fits, the list is
+ * complete and answers for names the file hasn't got as well; if not,
+ * what was read stays cached by name.
+ *
+ * @note The caller must hold the attr_lock for write
+ *
+ * @param[in] entry	Entry to fill
+ */
+static void mdc_xattrs_fill(mdcache_entry_t *entry)
+{
+	xattrlist4 list;
+	xattrvalue4 value;
+	nfs_cookie4 cookie = 0;
+	verifier4 verf;
+	bool_t eof = false;
+	fsal_status_t status;
+	uint32_t i;
+
+	memset(verf, 0, sizeof(verf));
+	list.entryCount = 0;
+	list.entries = gsh_malloc(2 * MDC_XATTR_LIST_SIZE);
+
+	subcall(
+		status = entry->sub_handle->obj_ops->listxattrs(
+			entry->sub_handle, MDC_XATTR_LIST_SIZE, &cookie,
+			&verf, &eof, &list)
+	       );
+	if (FSAL_IS_ERROR(status) || !eof)
+		goto out;
+
+	for (i = 0; i < list.entryCount; i++) {
+		status = mdc_xattr_fetch(entry, &list.entries[i], &value);
+		if (status.major == ERR_FSAL_NOENT) {
+			/* Removed since it was listed, leave it out */
+			continue;
+		}
+		if (FSAL_IS_ERROR(status))
+			goto out;
+
+		if (!mdc_xattr_add(entry, &list.entries[i], &value)) {
+			gsh_free(value.utf8string_val);
+			goto out;
+		}
+		gsh_free(value.utf8string_val);
+	}
+
+	entry->xattrs.complete = true;
+
+out:
+	gsh_free(list.entries);
+}
+
+/**
+ * @brief Bring the cached xattrs up to date
+ *
+ * Refresh the attributes if need be, and if the change attribute has
+ * moved on since the xattrs were read, read them again.
+ *
+ * @note The caller must hold the attr_lock for write
+ *
+ * @param[in] entry	Entry to revalidate
+ *
+ * @return FSAL status
+ */
+static fsal_status_t mdc_xattrs_revalidate(mdcache_entry_t *entry)
+{
+	fsal_status_t status;
+
+	if (!mdcache_is_attrs_valid(entry, ATTR_CHANGE)) {
+		status = mdcache_refresh_attrs(entry, false, false, false,
+					       false);
+		if (FSAL_IS_ERROR(status))
+			return status;
+	}
+
+	/* With no attribute caching, each check costs a getattr but no
+	 * more than that
+	 */
+	if (!test_mde_flags(entry, MDCACHE_TRUST_XATTRS) ||
+	    entry->xattrs.change != entry->attrs.change) {
+		mdc_xattrs_clear(entry);
+		entry->xattrs.change = entry->attrs.change;
+		/* Set first, so an invalidate while filling is kept */
+		atomic_set_uint32_t_bits(&entry->mde_flags,
+					 MDCACHE_TRUST_XATTRS);
+		mdc_xattrs_fill(entry);
+	}
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Copy a cached xattr out as getxattrs would
+ *
+ * @param[in] xattr	Cached xattr, NULL if the file hasn't got it
+ * @param[in,out] value	Buffer, of length 0 to only ask the size
+ *
+ * @return FSAL status
+ */
+static fsal_status_t mdc_xattr_copy(struct mdcache_xattr *xattr,
+				    xattrvalue4 *value)
+{
+	if (xattr == NULL || xattr->negative)
+		return fsalstat(ERR_FSAL_NOENT, 0);
+
+	if (value->utf8string_len != 0) {
+		if (value->utf8string_len < xattr->value_len)
+			return fsalstat(ERR_FSAL_TOOSMALL, 0);
+		memcpy(value->utf8string_val, xattr->data + xattr->name_len,
+		       xattr->value_len);
+	}
+	value->utf8string_len = xattr->value_len;
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
 /**
  * @brief Get an Extended Attribute
  *
- * Pass through to sub-FSAL
+ * Served from the cache when the xattrs of the file have been read at
+ * its current change attribute.  Otherwise they are read, all at once
+ * if they fit.
  *
  * @param[in] obj_hdl	File to search
  * @param[in] name	Name of attribute
@@ -290,14 +604,77 @@ fsal_status_t mdcache_remove_extattr_by_name(struct fsal_obj_handle *obj_hdl,
 fsal_status_t mdcache_getxattrs(struct fsal_obj_handle *obj_hdl,
 				xattrname4 *name, xattrvalue4 *value)
 {
-	struct mdcache_fsal_obj_handle *handle =
-		container_of(obj_hdl, struct mdcache_fsal_obj_handle,
-			     obj_handle);
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct mdcache_xattr *xattr;
+	xattrvalue4 fetched;
 	fsal_status_t status;
 
+	if (mdcache_param.xattr_cache_size == 0)
+		goto passthrough;
+
+	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+
+	if (mdc_xattrs_valid(entry)) {
+		xattr = mdc_xattr_find(entry, name);
+		if (xattr != NULL || entry->xattrs.complete) {
+			status = mdc_xattr_copy(xattr, value);
+			PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+			(void) atomic_inc_uint64_t(&cache_stp->xattr_hit);
+			return status;
+		}
+	}
+
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+
+	(void) atomic_inc_uint64_t(&cache_stp->xattr_miss);
+
+	status = mdc_xattrs_revalidate(entry);
+	if (FSAL_IS_ERROR(status)) {
+		PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+		if (status.major == ERR_FSAL_STALE)
+			mdcache_kill_entry(entry);
+		return status;
+	}
+
+	xattr = mdc_xattr_find(entry, name);
+	if (xattr != NULL || entry->xattrs.complete) {
+		status = mdc_xattr_copy(xattr, value);
+		PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+		return status;
+	}
+
+	/* Not read with the others, read it by itself */
+	status = mdc_xattr_fetch(entry, name, &fetched);
+	if (status.major == ERR_FSAL_NOENT) {
+		(void) mdc_xattr_add(entry, name, NULL);
+	} else if (!FSAL_IS_ERROR(status)) {
+		(void) mdc_xattr_add(entry, name, &fetched);
+	}
+
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	if (value->utf8string_len != 0) {
+		if (value->utf8string_len < fetched.utf8string_len) {
+			gsh_free(fetched.utf8string_val);
+			return fsalstat(ERR_FSAL_TOOSMALL, 0);
+		}
+		memcpy(value->utf8string_val, fetched.utf8string_val,
+		       fetched.utf8string_len);
+	}
+	value->utf8string_len = fetched.utf8string_len;
+	gsh_free(fetched.utf8string_val);
+
+	return status;
+
+passthrough:
 	subcall(
-		status = handle->sub_handle->obj_ops->getxattrs(
-			handle->sub_handle, name, value)
+		status = entry->sub_handle->obj_ops->getxattrs(
+			entry->sub_handle, name, value)
 	       );
 
 	return status;
@@ -306,7 +683,7 @@ fsal_status_t mdcache_getxattrs(struct fsal_obj_handle *obj_hdl,
 /**
  * @brief Set an Extended Attribute
  *
- * Pass through to sub-FSAL
+ * Pass through to sub-FSAL, then drop the cached xattrs
  *
  * @param[in] obj_hdl	File to search
  * @param[in] type	Type of attribute
@@ -318,23 +695,29 @@ fsal_status_t mdcache_setxattrs(struct fsal_obj_handle *obj_hdl,
 				setxattr_type4 type, xattrname4 *name,
 				xattrvalue4 *value)
 {
-	struct mdcache_fsal_obj_handle *handle =
-		container_of(obj_hdl, struct mdcache_fsal_obj_handle,
-			     obj_handle);
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
 
 	subcall(
-		status = handle->sub_handle->obj_ops->setxattrs(
-			handle->sub_handle, type, name, value)
+		status = entry->sub_handle->obj_ops->setxattrs(
+			entry->sub_handle, type, name, value)
 	       );
 
+	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+	mdc_xattrs_clear(entry);
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	if (!FSAL_IS_ERROR(status))
+		mdc_cluster_publish(entry, FSAL_UP_INVALIDATE_XATTRS);
+
 	return status;
 }
 
 /**
  * @brief Remove an Extended Attribute
  *
- * Pass through to sub-FSAL
+ * Pass through to sub-FSAL, then drop the cached xattrs
  *
  * @param[in] obj_hdl	File to search
  * @param[in] name	Type of attribute
@@ -343,23 +726,91 @@ fsal_status_t mdcache_setxattrs(struct fsal_obj_handle *obj_hdl,
 fsal_status_t mdcache_removexattrs(struct fsal_obj_handle *obj_hdl,
 				   xattrname4 *name)
 {
-	struct mdcache_fsal_obj_handle *handle =
-		container_of(obj_hdl, struct mdcache_fsal_obj_handle,
-			     obj_handle);
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
 
 	subcall(
-		status = handle->sub_handle->obj_ops->removexattrs(
-			handle->sub_handle, name)
+		status = entry->sub_handle->obj_ops->removexattrs(
+			entry->sub_handle, name)
 	       );
 
+	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+	mdc_xattrs_clear(entry);
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	if (!FSAL_IS_ERROR(status))
+		mdc_cluster_publish(entry, FSAL_UP_INVALIDATE_XATTRS);
+
 	return status;
 }
 
+/**
+ * @brief List the cached xattrs as listxattrs would
+ *
+ * Names go at the start of @a names, their strings @a len bytes on;
+ * the cookie is the index of the next name.
+ *
+ * @note The caller must hold the attr_lock
+ *
+ * @param[in] entry	Entry to list
+ * @param[in] len	Room for names, and for their strings
+ * @param[in,out] cookie Index of the first name
+ * @param[out] eof	set if no more extended attributes
+ * @param[out] names	list of extended attribute names
+ * @return FSAL status
+ */
+static fsal_status_t mdc_xattrs_list(mdcache_entry_t *entry, count4 len,
+				     nfs_cookie4 *cookie, bool_t *eof,
+				     xattrlist4 *names)
+{
+	component4 *out = names->entries;
+	char *val = (char *)names->entries + len;
+	size_t used = 0;
+	nfs_cookie4 index = 0;
+	struct glist_head *glist;
+
+	names->entryCount = 0;
+
+	glist_for_each(glist, &entry->xattrs.list) {
+		struct mdcache_xattr *xattr =
+			glist_entry(glist, struct mdcache_xattr, link);
+
+		if (xattr->negative)
+			continue;
+
+		if (index++ < *cookie)
+			continue;
+
+		if ((names->entryCount + 1) * sizeof(component4) > len ||
+		    used + xattr->name_len > len) {
+			*eof = false;
+			*cookie = index - 1;
+			if (names->entryCount == 0)
+				return fsalstat(ERR_FSAL_TOOSMALL, 0);
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+		}
+
+		out->utf8string_len = xattr->name_len;
+		out->utf8string_val = val;
+		memcpy(val, xattr->data, xattr->name_len);
+		val += xattr->name_len;
+		used += xattr->name_len;
+		out++;
+		names->entryCount++;
+	}
+
+	*eof = true;
+	*cookie = 0;
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
 /**
  * @brief List Extended Attributes
  *
- * Pass through to sub-FSAL
+ * Served from the cache when it holds every xattr of the file,
+ * otherwise passed through to the sub-FSAL
  *
  * @param[in] obj_hdl	File to search
  * @param[in] len	Length of names buffer
@@ -374,14 +825,45 @@ fsal_status_t mdcache_listxattrs(struct fsal_obj_handle *obj_hdl,
 				 verifier4 *verf, bool_t *eof,
 				 xattrlist4 *names)
 {
-	struct mdcache_fsal_obj_handle *handle =
-		container_of(obj_hdl, struct mdcache_fsal_obj_handle,
-			     obj_handle);
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
 
+	if (mdcache_param.xattr_cache_size == 0)
+		goto passthrough;
+
+	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+
+	if (mdc_xattrs_valid(entry) && entry->xattrs.complete) {
+		status = mdc_xattrs_list(entry, len, cookie, eof, names);
+		PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+		(void) atomic_inc_uint64_t(&cache_stp->xattr_hit);
+		return status;
+	}
+
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+
+	(void) atomic_inc_uint64_t(&cache_stp->xattr_miss);
+
+	status = mdc_xattrs_revalidate(entry);
+	if (!FSAL_IS_ERROR(status) && entry->xattrs.complete) {
+		status = mdc_xattrs_list(entry, len, cookie, eof, names);
+		PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+		return status;
+	}
+
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	if (status.major == ERR_FSAL_STALE) {
+		mdcache_kill_entry(entry);
+		return status;
+	}
+
+passthrough:
 	subcall(
-		status = handle->sub_handle->obj_ops->listxattrs(
-			handle->sub_handle, len, cookie, verf, eof, names)
+		status = entry->sub_handle->obj_ops->listxattrs(
+			entry->sub_handle, len, cookie, verf, eof, names)
 	       );
 
 	return status;
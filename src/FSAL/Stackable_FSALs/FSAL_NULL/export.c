@@ -266,6 +266,29 @@ static fsal_status_t get_quota(struct fsal_export *exp_hdl,
 	return result;
 }
 
+/* get_quotas
+ * same lower mount restriction applies
+ */
+
+static fsal_status_t get_quotas(struct fsal_export *exp_hdl,
+				const char *filepath, int quota_type,
+				uint32_t count, const int *quota_ids,
+				fsal_quota_t *pquotas,
+				fsal_status_t *pstatuses)
+{
+	struct nullfs_fsal_export *exp =
+		container_of(exp_hdl, struct nullfs_fsal_export, export);
+
+	op_ctx->fsal_export = exp->export.sub_export;
+	fsal_status_t result =
+		exp->export.sub_export->exp_ops.get_quotas(
+			exp->export.sub_export, filepath,
+			quota_type, count, quota_ids, pquotas, pstatuses);
+	op_ctx->fsal_export = &exp->export;
+
+	return result;
+}
+
 /* set_quota
  * same lower mount restriction applies
  */
@@ -408,6 +431,7 @@ void nullfs_export_ops_init(struct export_ops *ops)
 	ops->fs_supported_attrs = fs_supported_attrs;
 	ops->fs_umask = fs_umask;
 	ops->get_quota = get_quota;
+	ops->get_quotas = get_quotas;
 	ops->set_quota = set_quota;
 	ops->alloc_state = nullfs_alloc_state;
 	ops->free_state = nullfs_free_state;
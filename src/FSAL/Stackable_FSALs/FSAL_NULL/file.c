@@ -389,3 +389,65 @@ fsal_status_t nullfs_fallocate(struct fsal_obj_handle *obj_hdl,
 	op_ctx->fsal_export = &export->export;
 	return status;
 }
+
+fsal_status_t nullfs_copy(struct fsal_obj_handle *dst_hdl,
+			  struct state_t *dst_state, uint64_t dst_offset,
+			  struct fsal_obj_handle *src_hdl,
+			  struct state_t *src_state, uint64_t src_offset,
+			  uint64_t count, uint64_t *copied)
+{
+	struct nullfs_fsal_obj_handle *dst =
+		container_of(dst_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+	struct nullfs_fsal_obj_handle *src =
+		container_of(src_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+	fsal_status_t status;
+
+	if (dst->sub_handle->fsal != src->sub_handle->fsal)
+		return fsalstat(ERR_FSAL_XDEV, 0);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	status = dst->sub_handle->obj_ops->copy(dst->sub_handle, dst_state,
+						dst_offset, src->sub_handle,
+						src_state, src_offset, count,
+						copied);
+	op_ctx->fsal_export = &export->export;
+	return status;
+}
+
+fsal_status_t nullfs_clone2(struct fsal_obj_handle *dst_hdl,
+			    struct state_t *dst_state, uint64_t dst_offset,
+			    struct fsal_obj_handle *src_hdl,
+			    struct state_t *src_state, uint64_t src_offset,
+			    uint64_t count)
+{
+	struct nullfs_fsal_obj_handle *dst =
+		container_of(dst_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+	struct nullfs_fsal_obj_handle *src =
+		container_of(src_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+	fsal_status_t status;
+
+	if (dst->sub_handle->fsal != src->sub_handle->fsal)
+		return fsalstat(ERR_FSAL_XDEV, 0);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	status = dst->sub_handle->obj_ops->clone2(dst->sub_handle, dst_state,
+						  dst_offset, src->sub_handle,
+						  src_state, src_offset,
+						  count);
+	op_ctx->fsal_export = &export->export;
+	return status;
+}
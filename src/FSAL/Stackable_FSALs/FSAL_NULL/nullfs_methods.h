@@ -163,6 +163,16 @@ fsal_status_t nullfs_close2(struct fsal_obj_handle *obj_hdl,
 fsal_status_t nullfs_fallocate(struct fsal_obj_handle *obj_hdl,
 			       struct state_t *state, uint64_t offset,
 			       uint64_t length, bool allocate);
+fsal_status_t nullfs_copy(struct fsal_obj_handle *dst_hdl,
+			  struct state_t *dst_state, uint64_t dst_offset,
+			  struct fsal_obj_handle *src_hdl,
+			  struct state_t *src_state, uint64_t src_offset,
+			  uint64_t count, uint64_t *copied);
+fsal_status_t nullfs_clone2(struct fsal_obj_handle *dst_hdl,
+			    struct state_t *dst_state, uint64_t dst_offset,
+			    struct fsal_obj_handle *src_hdl,
+			    struct state_t *src_state, uint64_t src_offset,
+			    uint64_t count);
 
 /* extended attributes management */
 fsal_status_t nullfs_list_ext_attrs(struct fsal_obj_handle *obj_hdl,
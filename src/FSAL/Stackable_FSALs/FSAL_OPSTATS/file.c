@@ -0,0 +1,521 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) Panasas Inc., 2011
+ * Author: Jim Lieb jlieb@panasas.com
+ *
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* file.c
+ * File I/O methods for OPSTATS module
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include "fsal.h"
+#include "FSAL/access_check.h"
+#include "fsal_convert.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include "FSAL/fsal_commonlib.h"
+#include "opstat_methods.h"
+
+/**
+ * @brief Callback arg for OPSTATS async callbacks
+ *
+ * OPSTATS needs to know what its object is related to the sub-FSAL's object.
+ * This wraps the given callback arg with OPSTATS specific info
+ */
+struct opstat_async_arg {
+	struct fsal_obj_handle *obj_hdl;	/**< OPSTATS's handle */
+	fsal_async_cb cb;			/**< Wrapped callback */
+	void *cb_arg;				/**< Wrapped callback data */
+	struct opstat_fsal_export *export;	/**< Export counted against */
+	enum opstat_op op;			/**< Operation counted */
+	bool timed;				/**< The call is being timed */
+	struct timespec start;			/**< Time the call started */
+};
+
+/**
+ * @brief Callback for OPSTATS async calls
+ *
+ * Count the call, unstack, and call up.  The time counted ends when the
+ * sub-FSAL completes the I/O, whether or not that is in another thread.
+ *
+ * @param[in] obj		Object being acted on
+ * @param[in] ret		Return status of call
+ * @param[in] obj_data		Data for call
+ * @param[in] caller_data	Data for caller
+ */
+void opstat_async_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+		     void *obj_data, void *caller_data)
+{
+	struct fsal_export *save_exp = op_ctx->fsal_export;
+	struct opstat_async_arg *arg = caller_data;
+
+	if (arg->timed)
+		opstat_record(arg->export, arg->op, &arg->start, ret);
+
+	op_ctx->fsal_export = save_exp->super_export;
+	arg->cb(arg->obj_hdl, ret, obj_data, arg->cb_arg);
+	op_ctx->fsal_export = save_exp;
+
+	gsh_free(arg);
+}
+
+/* opstat_close
+ * Close the file if it is still open.
+ * Yes, we ignor lock status.  Closing a file in POSIX
+ * releases all locks but that is state and cache inode's problem.
+ */
+
+fsal_status_t opstat_close(struct fsal_obj_handle *obj_hdl)
+{
+	struct opstat_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct opstat_fsal_obj_handle,
+			     obj_handle);
+
+	struct opstat_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct opstat_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->close(handle->sub_handle);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t opstat_open2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   fsal_openflags_t openflags,
+			   enum fsal_create_mode createmode,
+			   const char *name,
+			   struct attrlist *attrs_in,
+			   fsal_verifier_t verifier,
+			   struct fsal_obj_handle **new_obj,
+			   struct attrlist *attrs_out,
+			   bool *caller_perm_check)
+{
+	struct opstat_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct opstat_fsal_obj_handle,
+			     obj_handle);
+	struct opstat_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct opstat_fsal_export,
+			     export);
+	struct timespec start;
+	bool timed;
+	struct fsal_obj_handle *sub_handle = NULL;
+
+	/* calling subfsal method */
+	timed = opstat_start(&start);
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->open2(handle->sub_handle, state,
+						  openflags, createmode, name,
+						  attrs_in, verifier,
+						  &sub_handle, attrs_out,
+						  caller_perm_check);
+	op_ctx->fsal_export = &export->export;
+
+	if (timed)
+		opstat_record(export, OPSTAT_OPEN2, &start, status);
+
+	if (sub_handle) {
+		/* wrap the subfsal handle in a opstat handle. */
+		return opstat_alloc_and_check_handle(export, sub_handle,
+						     obj_hdl->fs, new_obj,
+						     status);
+	}
+
+	return status;
+}
+
+bool opstat_check_verifier(struct fsal_obj_handle *obj_hdl,
+			   fsal_verifier_t verifier)
+{
+	struct opstat_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct opstat_fsal_obj_handle,
+			     obj_handle);
+
+	struct opstat_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct opstat_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	bool result =
+		handle->sub_handle->obj_ops->check_verifier(handle->sub_handle,
+							   verifier);
+	op_ctx->fsal_export = &export->export;
+
+	return result;
+}
+
+fsal_openflags_t opstat_status2(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state)
+{
+	struct opstat_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct opstat_fsal_obj_handle,
+			     obj_handle);
+
+	struct opstat_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct opstat_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_openflags_t result =
+		handle->sub_handle->obj_ops->status2(handle->sub_handle,
+						    state);
+	op_ctx->fsal_export = &export->export;
+
+	return result;
+}
+
+fsal_status_t opstat_reopen2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state,
+			     fsal_openflags_t openflags)
+{
+	struct opstat_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct opstat_fsal_obj_handle,
+			     obj_handle);
+
+	struct opstat_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct opstat_fsal_export,
+			     export);
+	struct timespec start;
+	bool timed;
+
+	/* calling subfsal method */
+	timed = opstat_start(&start);
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->reopen2(handle->sub_handle,
+						    state, openflags);
+	op_ctx->fsal_export = &export->export;
+
+	if (timed)
+		opstat_record(export, OPSTAT_REOPEN2, &start, status);
+
+	return status;
+}
+
+void opstat_read2(struct fsal_obj_handle *obj_hdl,
+		  bool bypass,
+		  fsal_async_cb done_cb,
+		  struct fsal_io_arg *read_arg,
+		  void *caller_arg)
+{
+	struct opstat_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct opstat_fsal_obj_handle,
+			     obj_handle);
+	struct opstat_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct opstat_fsal_export,
+			     export);
+	struct opstat_async_arg *arg;
+
+	/* Set up async callback */
+	arg = gsh_calloc(1, sizeof(*arg));
+	arg->obj_hdl = obj_hdl;
+	arg->cb = done_cb;
+	arg->cb_arg = caller_arg;
+	arg->export = export;
+	arg->op = OPSTAT_READ2;
+	arg->timed = opstat_start(&arg->start);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	handle->sub_handle->obj_ops->read2(handle->sub_handle, bypass,
+					  opstat_async_cb, read_arg, arg);
+	op_ctx->fsal_export = &export->export;
+}
+
+void opstat_write2(struct fsal_obj_handle *obj_hdl,
+		   bool bypass,
+		   fsal_async_cb done_cb,
+		   struct fsal_io_arg *write_arg,
+		   void *caller_arg)
+{
+	struct opstat_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct opstat_fsal_obj_handle,
+			     obj_handle);
+
+	struct opstat_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct opstat_fsal_export,
+			     export);
+	struct opstat_async_arg *arg;
+
+	/* Set up async callback */
+	arg = gsh_calloc(1, sizeof(*arg));
+	arg->obj_hdl = obj_hdl;
+	arg->cb = done_cb;
+	arg->cb_arg = caller_arg;
+	arg->export = export;
+	arg->op = OPSTAT_WRITE2;
+	arg->timed = opstat_start(&arg->start);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	handle->sub_handle->obj_ops->write2(handle->sub_handle, bypass,
+					   opstat_async_cb, write_arg, arg);
+	op_ctx->fsal_export = &export->export;
+}
+
+fsal_status_t opstat_seek2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   struct io_info *info)
+{
+	struct opstat_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct opstat_fsal_obj_handle,
+			     obj_handle);
+
+	struct opstat_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct opstat_fsal_export,
+			     export);
+	struct timespec start;
+	bool timed;
+
+	/* calling subfsal method */
+	timed = opstat_start(&start);
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->seek2(handle->sub_handle, state,
+						  info);
+	op_ctx->fsal_export = &export->export;
+
+	if (timed)
+		opstat_record(export, OPSTAT_SEEK2, &start, status);
+
+	return status;
+}
+
+fsal_status_t opstat_io_advise2(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state,
+				struct io_hints *hints)
+{
+	struct opstat_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct opstat_fsal_obj_handle,
+			     obj_handle);
+
+	struct opstat_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct opstat_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->io_advise2(handle->sub_handle,
+						       state, hints);
+	op_ctx->fsal_export = &export->export;
+
+	return status;
+}
+
+fsal_status_t opstat_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
+			     size_t len)
+{
+	struct opstat_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct opstat_fsal_obj_handle,
+			     obj_handle);
+
+	struct opstat_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct opstat_fsal_export,
+			     export);
+	struct timespec start;
+	bool timed;
+
+	/* calling subfsal method */
+	timed = opstat_start(&start);
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->commit2(handle->sub_handle, offset,
+						    len);
+	op_ctx->fsal_export = &export->export;
+
+	if (timed)
+		opstat_record(export, OPSTAT_COMMIT2, &start, status);
+
+	return status;
+}
+
+fsal_status_t opstat_lock_op2(struct fsal_obj_handle *obj_hdl,
+			      struct state_t *state,
+			      void *p_owner,
+			      fsal_lock_op_t lock_op,
+			      fsal_lock_param_t *req_lock,
+			      fsal_lock_param_t *conflicting_lock)
+{
+	struct opstat_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct opstat_fsal_obj_handle,
+			     obj_handle);
+
+	struct opstat_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct opstat_fsal_export,
+			     export);
+	struct timespec start;
+	bool timed;
+
+	/* calling subfsal method */
+	timed = opstat_start(&start);
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->lock_op2(handle->sub_handle, state,
+						     p_owner, lock_op, req_lock,
+						     conflicting_lock);
+	op_ctx->fsal_export = &export->export;
+
+	if (timed)
+		opstat_record(export, OPSTAT_LOCK_OP2, &start, status);
+
+	return status;
+}
+
+fsal_status_t opstat_close2(struct fsal_obj_handle *obj_hdl,
+			    struct state_t *state)
+{
+	struct opstat_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct opstat_fsal_obj_handle,
+			     obj_handle);
+
+	struct opstat_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct opstat_fsal_export,
+			     export);
+	struct timespec start;
+	bool timed;
+
+	/* calling subfsal method */
+	timed = opstat_start(&start);
+	op_ctx->fsal_export = export->export.sub_export;
+	fsal_status_t status =
+		handle->sub_handle->obj_ops->close2(handle->sub_handle, state);
+	op_ctx->fsal_export = &export->export;
+
+	if (timed)
+		opstat_record(export, OPSTAT_CLOSE2, &start, status);
+
+	return status;
+}
+
+fsal_status_t opstat_fallocate(struct fsal_obj_handle *obj_hdl,
+			       struct state_t *state, uint64_t offset,
+			       uint64_t length, bool allocate)
+{
+	struct opstat_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct opstat_fsal_obj_handle,
+			     obj_handle);
+
+	struct opstat_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct opstat_fsal_export,
+			     export);
+	struct timespec start;
+	bool timed;
+	fsal_status_t status;
+
+	/* calling subfsal method */
+	timed = opstat_start(&start);
+	op_ctx->fsal_export = export->export.sub_export;
+	status = handle->sub_handle->obj_ops->fallocate(handle->sub_handle,
+							state, offset, length,
+							allocate);
+	op_ctx->fsal_export = &export->export;
+
+	if (timed)
+		opstat_record(export, OPSTAT_FALLOCATE, &start, status);
+	return status;
+}
+
+fsal_status_t opstat_copy(struct fsal_obj_handle *dst_hdl,
+			  struct state_t *dst_state, uint64_t dst_offset,
+			  struct fsal_obj_handle *src_hdl,
+			  struct state_t *src_state, uint64_t src_offset,
+			  uint64_t count, uint64_t *copied)
+{
+	struct opstat_fsal_obj_handle *dst =
+		container_of(dst_hdl, struct opstat_fsal_obj_handle,
+			     obj_handle);
+	struct opstat_fsal_obj_handle *src =
+		container_of(src_hdl, struct opstat_fsal_obj_handle,
+			     obj_handle);
+
+	struct opstat_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct opstat_fsal_export,
+			     export);
+	struct timespec start;
+	bool timed;
+	fsal_status_t status;
+
+	if (dst->sub_handle->fsal != src->sub_handle->fsal)
+		return fsalstat(ERR_FSAL_XDEV, 0);
+
+	/* calling subfsal method */
+	timed = opstat_start(&start);
+	op_ctx->fsal_export = export->export.sub_export;
+	status = dst->sub_handle->obj_ops->copy(dst->sub_handle, dst_state,
+						dst_offset, src->sub_handle,
+						src_state, src_offset, count,
+						copied);
+	op_ctx->fsal_export = &export->export;
+
+	if (timed)
+		opstat_record(export, OPSTAT_COPY, &start, status);
+	return status;
+}
+
+fsal_status_t opstat_clone2(struct fsal_obj_handle *dst_hdl,
+			    struct state_t *dst_state, uint64_t dst_offset,
+			    struct fsal_obj_handle *src_hdl,
+			    struct state_t *src_state, uint64_t src_offset,
+			    uint64_t count)
+{
+	struct opstat_fsal_obj_handle *dst =
+		container_of(dst_hdl, struct opstat_fsal_obj_handle,
+			     obj_handle);
+	struct opstat_fsal_obj_handle *src =
+		container_of(src_hdl, struct opstat_fsal_obj_handle,
+			     obj_handle);
+
+	struct opstat_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct opstat_fsal_export,
+			     export);
+	struct timespec start;
+	bool timed;
+	fsal_status_t status;
+
+	if (dst->sub_handle->fsal != src->sub_handle->fsal)
+		return fsalstat(ERR_FSAL_XDEV, 0);
+
+	/* calling subfsal method */
+	timed = opstat_start(&start);
+	op_ctx->fsal_export = export->export.sub_export;
+	status = dst->sub_handle->obj_ops->clone2(dst->sub_handle, dst_state,
+						  dst_offset, src->sub_handle,
+						  src_state, src_offset,
+						  count);
+	op_ctx->fsal_export = &export->export;
+
+	if (timed)
+		opstat_record(export, OPSTAT_CLONE2, &start, status);
+	return status;
+}
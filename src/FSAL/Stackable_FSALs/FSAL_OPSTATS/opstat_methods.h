@@ -0,0 +1,308 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) Panasas Inc., 2011
+ * Author: Jim Lieb jlieb@panasas.com
+ *
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published
+ *   by the Free Software Foundation; either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+ *   the GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * @brief OPSTAT methods for handles
+ */
+
+/* OPSTAT methods for handles
+ */
+
+#ifndef OPSTAT_METHODS_H
+#define OPSTAT_METHODS_H
+
+#include "common_utils.h"
+#include "nfs_core.h"
+#include "latency_hist.h"
+
+struct opstat_fsal_module {
+	struct fsal_module module;
+	struct fsal_obj_ops handle_ops;
+};
+
+extern struct opstat_fsal_module OPSTAT;
+
+struct opstat_fsal_obj_handle;
+
+/**
+ * Structure used to store data for read_dirents callback.
+ *
+ * Before executing the upper level callback (it might be another
+ * stackable fsal or the inode cache), the context has to be restored.
+ */
+struct opstat_readdir_state {
+	fsal_readdir_cb cb; /*< Callback to the upper layer. */
+	struct opstat_fsal_export *exp; /*< Export of the current opstatfsal. */
+	void *dir_state; /*< State to be sent to the next callback. */
+	bool timed; /*< The readdir is being timed. */
+	nsecs_elapsed_t cb_time; /*< Time spent in the upper layer. */
+};
+
+extern struct fsal_up_vector fsal_up_top;
+void opstat_handle_ops_init(struct fsal_obj_ops *ops);
+
+/**
+ * @brief Operations of the sub-FSAL that are counted
+ */
+enum opstat_op {
+	OPSTAT_LOOKUP,
+	OPSTAT_READDIR,
+	OPSTAT_MKDIR,
+	OPSTAT_MKNODE,
+	OPSTAT_SYMLINK,
+	OPSTAT_READLINK,
+	OPSTAT_GETATTRS,
+	OPSTAT_SETATTR2,
+	OPSTAT_LINK,
+	OPSTAT_RENAME,
+	OPSTAT_UNLINK,
+	OPSTAT_OPEN2,
+	OPSTAT_REOPEN2,
+	OPSTAT_READ2,
+	OPSTAT_WRITE2,
+	OPSTAT_SEEK2,
+	OPSTAT_COMMIT2,
+	OPSTAT_LOCK_OP2,
+	OPSTAT_CLOSE2,
+	OPSTAT_FALLOCATE,
+	OPSTAT_LIST_EXT_ATTRS,
+	OPSTAT_GETEXTATTR,
+	OPSTAT_SETEXTATTR,
+	OPSTAT_REMOVE_EXTATTR,
+	OPSTAT_LOOKUP_PATH,
+	OPSTAT_CREATE_HANDLE,
+	OPSTAT_COPY,
+	OPSTAT_CLONE2,
+	OPSTAT_NUM_OPS
+};
+
+/**
+ * @brief Counters of one operation
+ *
+ * Updated atomically, without a lock.
+ */
+struct opstat_counter {
+	uint64_t calls;
+	uint64_t errors;
+	uint64_t latency;		/*< Total nanoseconds */
+	struct lat_hist *hist;		/*< Allocated on the first call */
+};
+
+/*
+ * OPSTAT internal export
+ */
+struct opstat_fsal_export {
+	struct fsal_export export;
+	struct opstat_counter ops[OPSTAT_NUM_OPS];
+};
+
+void opstat_count(struct opstat_fsal_export *export, enum opstat_op op,
+		  nsecs_elapsed_t latency, fsal_status_t status);
+bool opstat_extract_stats(struct fsal_export *exp_hdl, void *iter);
+void opstat_reset_stats(struct fsal_export *exp_hdl);
+void opstat_free_stats(struct opstat_fsal_export *export);
+
+/**
+ * @brief Start timing a call to the sub-FSAL
+ *
+ * Counting follows FSAL stats, so this is one test of a global
+ * while they are disabled.
+ *
+ * @param[out] start	Time the call starts
+ *
+ * @return true if the call is to be counted.
+ */
+static inline bool opstat_start(struct timespec *start)
+{
+	if (likely(!nfs_param.core_param.enable_FSALSTATS))
+		return false;
+
+	now(start);
+	return true;
+}
+
+static inline nsecs_elapsed_t opstat_elapsed(const struct timespec *start)
+{
+	struct timespec end;
+
+	now(&end);
+	return timespec_diff(start, &end);
+}
+
+/**
+ * @brief Count a call timed from @a start
+ */
+static inline void opstat_record(struct opstat_fsal_export *export,
+				 enum opstat_op op,
+				 const struct timespec *start,
+				 fsal_status_t status)
+{
+	opstat_count(export, op, opstat_elapsed(start), status);
+}
+
+fsal_status_t opstat_lookup_path(struct fsal_export *exp_hdl,
+				 const char *path,
+				 struct fsal_obj_handle **handle,
+				 struct attrlist *attrs_out);
+
+fsal_status_t opstat_create_handle(struct fsal_export *exp_hdl,
+				   struct gsh_buffdesc *hdl_desc,
+				   struct fsal_obj_handle **handle,
+				   struct attrlist *attrs_out);
+
+fsal_status_t opstat_alloc_and_check_handle(
+		struct opstat_fsal_export *export,
+		struct fsal_obj_handle *sub_handle,
+		struct fsal_filesystem *fs,
+		struct fsal_obj_handle **new_handle,
+		fsal_status_t subfsal_status);
+
+/*
+ * OPSTAT internal object handle
+ *
+ * It contains a pointer to the fsal_obj_handle used by the subfsal.
+ *
+ * AF_UNIX sockets are strange ducks.  I personally cannot see why they
+ * are here except for the ability of a client to see such an animal with
+ * an 'ls' or get rid of one with an 'rm'.  You can't open them in the
+ * usual file way so open_by_handle_at leads to a deadend.  To work around
+ * this, we save the args that were used to mknod or lookup the socket.
+ */
+
+struct opstat_fsal_obj_handle {
+	struct fsal_obj_handle obj_handle; /*< Handle containing opstat data.*/
+	struct fsal_obj_handle *sub_handle; /*< Handle of the sub fsal.*/
+	int32_t refcnt;		/*< Reference count.  This is signed to make
+				   mistakes easy to see. */
+};
+
+int opstat_fsal_open(struct opstat_fsal_obj_handle *, int, fsal_errors_t *);
+int opstat_fsal_readlink(struct opstat_fsal_obj_handle *, fsal_errors_t *);
+
+static inline bool opstat_unopenable_type(object_file_type_t type)
+{
+	if ((type == SOCKET_FILE) || (type == CHARACTER_FILE)
+	    || (type == BLOCK_FILE)) {
+		return true;
+	} else {
+		return false;
+	}
+}
+
+/* I/O management */
+fsal_status_t opstat_close(struct fsal_obj_handle *obj_hdl);
+
+/* Multi-FD */
+fsal_status_t opstat_open2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   fsal_openflags_t openflags,
+			   enum fsal_create_mode createmode,
+			   const char *name,
+			   struct attrlist *attrs_in,
+			   fsal_verifier_t verifier,
+			   struct fsal_obj_handle **new_obj,
+			   struct attrlist *attrs_out,
+			   bool *caller_perm_check);
+bool opstat_check_verifier(struct fsal_obj_handle *obj_hdl,
+			   fsal_verifier_t verifier);
+fsal_openflags_t opstat_status2(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state);
+fsal_status_t opstat_reopen2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state,
+			     fsal_openflags_t openflags);
+void opstat_read2(struct fsal_obj_handle *obj_hdl,
+		  bool bypass,
+		  fsal_async_cb done_cb,
+		  struct fsal_io_arg *read_arg,
+		  void *caller_arg);
+void opstat_write2(struct fsal_obj_handle *obj_hdl,
+		   bool bypass,
+		   fsal_async_cb done_cb,
+		   struct fsal_io_arg *write_arg,
+		   void *caller_arg);
+fsal_status_t opstat_seek2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   struct io_info *info);
+fsal_status_t opstat_io_advise2(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state,
+				struct io_hints *hints);
+fsal_status_t opstat_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
+			     size_t len);
+fsal_status_t opstat_lock_op2(struct fsal_obj_handle *obj_hdl,
+			      struct state_t *state,
+			      void *p_owner,
+			      fsal_lock_op_t lock_op,
+			      fsal_lock_param_t *req_lock,
+			      fsal_lock_param_t *conflicting_lock);
+fsal_status_t opstat_close2(struct fsal_obj_handle *obj_hdl,
+			    struct state_t *state);
+fsal_status_t opstat_fallocate(struct fsal_obj_handle *obj_hdl,
+			       struct state_t *state, uint64_t offset,
+			       uint64_t length, bool allocate);
+fsal_status_t opstat_copy(struct fsal_obj_handle *dst_hdl,
+			  struct state_t *dst_state, uint64_t dst_offset,
+			  struct fsal_obj_handle *src_hdl,
+			  struct state_t *src_state, uint64_t src_offset,
+			  uint64_t count, uint64_t *copied);
+fsal_status_t opstat_clone2(struct fsal_obj_handle *dst_hdl,
+			    struct state_t *dst_state, uint64_t dst_offset,
+			    struct fsal_obj_handle *src_hdl,
+			    struct state_t *src_state, uint64_t src_offset,
+			    uint64_t count);
+
+/* extended attributes management */
+fsal_status_t opstat_list_ext_attrs(struct fsal_obj_handle *obj_hdl,
+				    unsigned int cookie,
+				    fsal_xattrent_t *xattrs_tab,
+				    unsigned int xattrs_tabsize,
+				    unsigned int *p_nb_returned,
+				    int *end_of_list);
+fsal_status_t opstat_getextattr_id_by_name(struct fsal_obj_handle *obj_hdl,
+					   const char *xattr_name,
+					   unsigned int *pxattr_id);
+fsal_status_t opstat_getextattr_value_by_name(struct fsal_obj_handle *obj_hdl,
+					      const char *xattr_name,
+					      void *buffer_addr,
+					      size_t buffer_size,
+					      size_t *p_output_size);
+fsal_status_t opstat_getextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
+					    unsigned int xattr_id,
+					    void *buffer_addr,
+					    size_t buffer_size,
+					    size_t *p_output_size);
+fsal_status_t opstat_setextattr_value(struct fsal_obj_handle *obj_hdl,
+				      const char *xattr_name,
+				      void *buffer_addr,
+				      size_t buffer_size,
+				      int create);
+fsal_status_t opstat_setextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
+					    unsigned int xattr_id,
+					    void *buffer_addr,
+					    size_t buffer_size);
+fsal_status_t opstat_remove_extattr_by_id(struct fsal_obj_handle *obj_hdl,
+					  unsigned int xattr_id);
+fsal_status_t opstat_remove_extattr_by_name(struct fsal_obj_handle *obj_hdl,
+					    const char *xattr_name);
+
+#endif			/* OPSTAT_METHODS_H */
@@ -0,0 +1,171 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * @file  stats.c
+ * @brief OPSTATS counters and their DBus reply
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+#include "abstract_atomic.h"
+#include "FSAL/fsal_commonlib.h"
+#include "opstat_methods.h"
+
+static const char *const opstat_op_names[OPSTAT_NUM_OPS] = {
+	[OPSTAT_LOOKUP] = "lookup",
+	[OPSTAT_READDIR] = "readdir",
+	[OPSTAT_MKDIR] = "mkdir",
+	[OPSTAT_MKNODE] = "mknode",
+	[OPSTAT_SYMLINK] = "symlink",
+	[OPSTAT_READLINK] = "readlink",
+	[OPSTAT_GETATTRS] = "getattrs",
+	[OPSTAT_SETATTR2] = "setattr2",
+	[OPSTAT_LINK] = "link",
+	[OPSTAT_RENAME] = "rename",
+	[OPSTAT_UNLINK] = "unlink",
+	[OPSTAT_OPEN2] = "open2",
+	[OPSTAT_REOPEN2] = "reopen2",
+	[OPSTAT_READ2] = "read2",
+	[OPSTAT_WRITE2] = "write2",
+	[OPSTAT_SEEK2] = "seek2",
+	[OPSTAT_COMMIT2] = "commit2",
+	[OPSTAT_LOCK_OP2] = "lock_op2",
+	[OPSTAT_CLOSE2] = "close2",
+	[OPSTAT_FALLOCATE] = "fallocate",
+	[OPSTAT_LIST_EXT_ATTRS] = "list_ext_attrs",
+	[OPSTAT_GETEXTATTR] = "getextattr",
+	[OPSTAT_SETEXTATTR] = "setextattr",
+	[OPSTAT_REMOVE_EXTATTR] = "remove_extattr",
+	[OPSTAT_LOOKUP_PATH] = "lookup_path",
+	[OPSTAT_CREATE_HANDLE] = "create_handle",
+	[OPSTAT_COPY] = "copy",
+	[OPSTAT_CLONE2] = "clone2",
+};
+
+/**
+ * @brief Count one call to the sub-FSAL
+ *
+ * @param[in] export	Our export
+ * @param[in] op	Operation called
+ * @param[in] latency	Time the sub-FSAL took
+ * @param[in] status	What it returned
+ */
+void opstat_count(struct opstat_fsal_export *export, enum opstat_op op,
+		  nsecs_elapsed_t latency, fsal_status_t status)
+{
+	struct opstat_counter *ctr = &export->ops[op];
+
+	(void)atomic_inc_uint64_t(&ctr->calls);
+	if (FSAL_IS_ERROR(status))
+		(void)atomic_inc_uint64_t(&ctr->errors);
+	(void)atomic_add_uint64_t(&ctr->latency, latency);
+	lat_hist_record(lat_hist_get(&ctr->hist), latency);
+}
+
+/**
+ * @brief Append the counters of an export to a DBus reply
+ *
+ * @param[in] exp_hdl	Our export
+ * @param[in] iter	DBus iterator, or NULL to ask if we keep counters
+ *
+ * @return true, OPSTATS always has counters.
+ */
+bool opstat_extract_stats(struct fsal_export *exp_hdl, void *iter)
+{
+#ifdef USE_DBUS
+	struct opstat_fsal_export *export =
+		container_of(exp_hdl, struct opstat_fsal_export, export);
+	DBusMessageIter *iterp = iter;
+	DBusMessageIter array_iter, op_iter;
+	const char *name = exp_hdl->fsal->name;
+	uint64_t val;
+	int op;
+
+	if (iter == NULL)
+		return true;
+
+	dbus_message_iter_append_basic(iterp, DBUS_TYPE_STRING, &name);
+	dbus_message_iter_open_container(iterp, DBUS_TYPE_ARRAY,
+					 "(sttt(ttttta(tt)))", &array_iter);
+	for (op = 0; op < OPSTAT_NUM_OPS; op++) {
+		struct opstat_counter *ctr = &export->ops[op];
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &op_iter);
+		dbus_message_iter_append_basic(&op_iter, DBUS_TYPE_STRING,
+					       &opstat_op_names[op]);
+		val = atomic_fetch_uint64_t(&ctr->calls);
+		dbus_message_iter_append_basic(&op_iter, DBUS_TYPE_UINT64,
+					       &val);
+		val = atomic_fetch_uint64_t(&ctr->errors);
+		dbus_message_iter_append_basic(&op_iter, DBUS_TYPE_UINT64,
+					       &val);
+		val = atomic_fetch_uint64_t(&ctr->latency);
+		dbus_message_iter_append_basic(&op_iter, DBUS_TYPE_UINT64,
+					       &val);
+		dbus_append_lat_hist(&op_iter, atomic_fetch_voidptr(
+						(void **)&ctr->hist));
+		dbus_message_iter_close_container(&array_iter, &op_iter);
+	}
+	dbus_message_iter_close_container(iterp, &array_iter);
+#endif
+	return true;
+}
+
+/**
+ * @brief Zero the counters of an export
+ *
+ * @param[in] exp_hdl	Our export
+ */
+void opstat_reset_stats(struct fsal_export *exp_hdl)
+{
+	struct opstat_fsal_export *export =
+		container_of(exp_hdl, struct opstat_fsal_export, export);
+	int op;
+
+	for (op = 0; op < OPSTAT_NUM_OPS; op++) {
+		struct opstat_counter *ctr = &export->ops[op];
+
+		atomic_store_uint64_t(&ctr->calls, 0);
+		atomic_store_uint64_t(&ctr->errors, 0);
+		atomic_store_uint64_t(&ctr->latency, 0);
+		lat_hist_reset(atomic_fetch_voidptr((void **)&ctr->hist));
+	}
+}
+
+/**
+ * @brief Free the histograms of an export being released
+ *
+ * @param[in] export	Our export
+ */
+void opstat_free_stats(struct opstat_fsal_export *export)
+{
+	int op;
+
+	for (op = 0; op < OPSTAT_NUM_OPS; op++)
+		gsh_free(export->ops[op].hist);
+}
@@ -16,6 +16,7 @@
 #include "FSAL/access_check.h"
 #include <stdbool.h>
 #include <unistd.h>
+#include <string.h>
 #include <sys/syscall.h>
 #include <grp.h>
 #include <sys/types.h>
@@ -420,127 +421,37 @@ static void fsal_print_access_by_acl(int naces, int ace_number,
 }
 
 /**
- * @brief Check access using v4 ACL list
+ * @brief Walk the ACEs of an ACL for an access check
  *
- * @param[in] creds
- * @param[in] v4mask
- * @param[in] allowed
- * @param[in] denied
- * @param[in] p_object_attributes
+ * The part of fsal_check_access_acl() whose result is cached.
  *
- * @return ERR_FSAL_NO_ERROR, ERR_FSAL_ACCESS, or ERR_FSAL_NO_ACE
+ * @param[in]  creds          Caller
+ * @param[in]  v4mask         Access asked for
+ * @param[in]  missing_access What privileges didn't already grant
+ * @param[out] allowed        Access allowed, or NULL
+ * @param[out] denied         Access denied, or NULL
+ * @param[in]  pacl           The ACL
+ * @param[in]  is_dir         The object is a directory
+ * @param[in]  is_owner       The caller owns the object
+ * @param[in]  is_group       The caller is in the object's group
+ * @param[in]  is_root        The caller is root
+ *
+ * @return ERR_FSAL_NO_ERROR, ERR_FSAL_ACCESS, ERR_FSAL_PERM or
+ *         ERR_FSAL_NO_ACE
  */
 
-static fsal_status_t fsal_check_access_acl(struct user_cred *creds,
-					   fsal_aceperm_t v4mask,
-					   fsal_accessflags_t *allowed,
-					   fsal_accessflags_t *denied,
-					   struct attrlist *p_object_attributes)
+static fsal_status_t fsal_check_access_aces(struct user_cred *creds,
+					    fsal_aceperm_t v4mask,
+					    fsal_aceperm_t missing_access,
+					    fsal_accessflags_t *allowed,
+					    fsal_accessflags_t *denied,
+					    fsal_acl_t *pacl, bool is_dir,
+					    bool is_owner, bool is_group,
+					    bool is_root)
 {
-	fsal_aceperm_t missing_access;
 	fsal_aceperm_t tperm;
-	uid_t uid;
-	gid_t gid;
-	fsal_acl_t *pacl = NULL;
 	fsal_ace_t *pace = NULL;
 	int ace_number = 0;
-	bool is_dir = false;
-	bool is_owner = false;
-	bool is_group = false;
-	bool is_root = false;
-
-	if (allowed != NULL)
-		*allowed = 0;
-
-	if (denied != NULL)
-		*denied = 0;
-
-	if (!p_object_attributes->acl) {
-		/* Means that FSAL_ACE4_REQ_FLAG was set, but no ACLs */
-		LogFullDebug(COMPONENT_NFS_V4_ACL,
-			     "Allow ACE required, but no ACLs");
-		return fsalstat(ERR_FSAL_NO_ACE, 0);
-	}
-
-	/* unsatisfied flags */
-	missing_access = v4mask & ~FSAL_ACE4_PERM_CONTINUE;
-	if (!missing_access) {
-		LogFullDebug(COMPONENT_NFS_V4_ACL, "Nothing was requested");
-		return fsalstat(ERR_FSAL_NO_ERROR, 0);
-	}
-
-	/* Get file ownership information. */
-	uid = p_object_attributes->owner;
-	gid = p_object_attributes->group;
-	pacl = p_object_attributes->acl;
-	is_dir = (p_object_attributes->type == DIRECTORY);
-	is_root = op_ctx->fsal_export->exp_ops.is_superuser(
-						op_ctx->fsal_export, creds);
-
-	if (is_root) {
-		if (is_dir) {
-			if (allowed != NULL)
-				*allowed = v4mask;
-
-			/* On a directory, allow root anything. */
-			LogFullDebug(COMPONENT_NFS_V4_ACL,
-				     "Met root privileges on directory");
-			return fsalstat(ERR_FSAL_NO_ERROR, 0);
-		}
-
-		/* Otherwise, allow root anything but execute. */
-		missing_access &= FSAL_ACE_PERM_EXECUTE;
-
-		if (allowed != NULL)
-			*allowed = v4mask & ~FSAL_ACE_PERM_EXECUTE;
-
-		if (!missing_access) {
-			LogFullDebug(COMPONENT_NFS_V4_ACL,
-				     "Met root privileges");
-			return fsalstat(ERR_FSAL_NO_ERROR, 0);
-		}
-	}
-
-	LogFullDebug(COMPONENT_NFS_V4_ACL,
-		     "file acl=%p, file uid=%u, file gid=%u, ", pacl, uid, gid);
-
-	if (isFullDebug(COMPONENT_NFS_V4_ACL)) {
-		char str[LOG_BUFF_LEN] = "\0";
-		struct display_buffer dspbuf = { sizeof(str), str, str };
-
-		(void)display_fsal_v4mask(&dspbuf, v4mask,
-					  p_object_attributes->type ==
-					  DIRECTORY);
-
-		LogFullDebug(COMPONENT_NFS_V4_ACL,
-			     "user uid=%u, user gid= %u, v4mask=%s",
-			     creds->caller_uid, creds->caller_gid, str);
-	}
-
-	is_owner = fsal_check_ace_owner(uid, creds);
-	is_group = fsal_check_ace_group(gid, creds);
-
-	/* Always grant READ_ACL, WRITE_ACL and READ_ATTR, WRITE_ATTR
-	 * to the file owner. */
-	if (is_owner) {
-		if (allowed != NULL)
-			*allowed |=
-			    v4mask & (FSAL_ACE_PERM_WRITE_ACL |
-				      FSAL_ACE_PERM_READ_ACL |
-				      FSAL_ACE_PERM_WRITE_ATTR |
-				      FSAL_ACE_PERM_READ_ATTR);
-
-		missing_access &=
-		    ~(FSAL_ACE_PERM_WRITE_ACL | FSAL_ACE_PERM_READ_ACL);
-		missing_access &=
-		    ~(FSAL_ACE_PERM_WRITE_ATTR | FSAL_ACE_PERM_READ_ATTR);
-		if (!missing_access) {
-			LogFullDebug(COMPONENT_NFS_V4_ACL,
-				     "Met owner privileges");
-			return fsalstat(ERR_FSAL_NO_ERROR, 0);
-		}
-	}
-	/** @todo Even if user is admin, audit/alarm checks should be done. */
 
 	for (pace = pacl->aces; pace < pacl->aces + pacl->naces; pace++) {
 		ace_number += 1;
@@ -676,6 +587,258 @@ static fsal_status_t fsal_check_access_acl(struct user_cred *creds,
 	}
 }
 
+/**
+ * @brief Slots of the per-thread access check cache
+ */
+
+#define FSAL_ACL_CACHE_SLOTS 128
+
+/** @{ Bits of fsal_acl_cache_entry::flags */
+#define FSAL_ACL_CACHE_DIR	0x01
+#define FSAL_ACL_CACHE_OWNER	0x02
+#define FSAL_ACL_CACHE_GROUP	0x04
+#define FSAL_ACL_CACHE_ROOT	0x08
+#define FSAL_ACL_CACHE_ALLOWED	0x10	/*< allowed was asked for */
+#define FSAL_ACL_CACHE_DENIED	0x20	/*< denied was asked for */
+/** @} */
+
+/**
+ * @brief The result of walking an ACL for a caller
+ *
+ * The ACL's id, the caller's UID, the groups of the ACL the caller is
+ * in and the flags are all the walk depends on, so that the same key
+ * always gives the same result.
+ */
+
+struct fsal_acl_cache_entry {
+	uint64_t acl_id;	/*< fsal_acl_t::id, 0 while unused */
+	uint64_t groups;	/*< Bit i set if in fsal_acl_t::gids[i] */
+	uid_t uid;
+	fsal_aceperm_t v4mask;
+	uint32_t flags;
+	fsal_errors_t major;
+	fsal_accessflags_t allowed;
+	fsal_accessflags_t denied;
+};
+
+/**
+ * @brief Recent access check results of this thread
+ *
+ * Direct mapped, a colliding result simply replaces the older one.
+ */
+
+static __thread struct fsal_acl_cache_entry
+	fsal_acl_cache[FSAL_ACL_CACHE_SLOTS];
+
+/**
+ * @brief Find which groups of an ACL a caller is in
+ *
+ * @param[in]  pacl   The ACL
+ * @param[in]  creds  The caller
+ * @param[out] groups Bit i set if the caller is in pacl->gids[i]
+ *
+ * @return false if checks on this ACL can't be cached.
+ */
+
+static bool fsal_acl_cache_groups(fsal_acl_t *pacl, struct user_cred *creds,
+				  uint64_t *groups)
+{
+	uint32_t i;
+
+	if (pacl->id == 0)
+		return false;
+
+	*groups = 0;
+	for (i = 0; i < pacl->ngids; i++)
+		if (fsal_check_ace_group(pacl->gids[i], creds))
+			*groups |= 1ULL << i;
+
+	return true;
+}
+
+static inline struct fsal_acl_cache_entry *
+fsal_acl_cache_slot(uint64_t acl_id, uid_t uid, fsal_aceperm_t v4mask,
+		    uint64_t groups, uint32_t flags)
+{
+	uint64_t h = acl_id * 0x9E3779B97F4A7C15ULL;
+
+	h ^= (uint64_t) uid * 0xFF51AFD7ED558CCDULL;
+	h ^= groups * 0xC4CEB9FE1A85EC53ULL;
+	h ^= ((uint64_t) v4mask << 8) ^ flags;
+
+	return &fsal_acl_cache[(h >> 32) % FSAL_ACL_CACHE_SLOTS];
+}
+
+/**
+ * @brief Check access using v4 ACL list
+ *
+ * The result of walking the ACEs is kept in fsal_acl_cache, and found
+ * there again by later checks of the same caller on the same ACL.
+ *
+ * @param[in] creds
+ * @param[in] v4mask
+ * @param[in] allowed
+ * @param[in] denied
+ * @param[in] p_object_attributes
+ *
+ * @return ERR_FSAL_NO_ERROR, ERR_FSAL_ACCESS, or ERR_FSAL_NO_ACE
+ */
+
+static fsal_status_t fsal_check_access_acl(struct user_cred *creds,
+					   fsal_aceperm_t v4mask,
+					   fsal_accessflags_t *allowed,
+					   fsal_accessflags_t *denied,
+					   struct attrlist *p_object_attributes)
+{
+	fsal_aceperm_t missing_access;
+	uid_t uid;
+	gid_t gid;
+	fsal_acl_t *pacl = NULL;
+	bool is_dir = false;
+	bool is_owner = false;
+	bool is_group = false;
+	bool is_root = false;
+	struct fsal_acl_cache_entry *slot = NULL;
+	fsal_status_t status;
+	uint64_t groups;
+	uint32_t flags = 0;
+	bool cached;
+
+	if (allowed != NULL)
+		*allowed = 0;
+
+	if (denied != NULL)
+		*denied = 0;
+
+	if (!p_object_attributes->acl) {
+		/* Means that FSAL_ACE4_REQ_FLAG was set, but no ACLs */
+		LogFullDebug(COMPONENT_NFS_V4_ACL,
+			     "Allow ACE required, but no ACLs");
+		return fsalstat(ERR_FSAL_NO_ACE, 0);
+	}
+
+	/* unsatisfied flags */
+	missing_access = v4mask & ~FSAL_ACE4_PERM_CONTINUE;
+	if (!missing_access) {
+		LogFullDebug(COMPONENT_NFS_V4_ACL, "Nothing was requested");
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	/* Get file ownership information. */
+	uid = p_object_attributes->owner;
+	gid = p_object_attributes->group;
+	pacl = p_object_attributes->acl;
+	is_dir = (p_object_attributes->type == DIRECTORY);
+	is_root = op_ctx->fsal_export->exp_ops.is_superuser(
+						op_ctx->fsal_export, creds);
+
+	if (is_root) {
+		if (is_dir) {
+			if (allowed != NULL)
+				*allowed = v4mask;
+
+			/* On a directory, allow root anything. */
+			LogFullDebug(COMPONENT_NFS_V4_ACL,
+				     "Met root privileges on directory");
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+		}
+
+		/* Otherwise, allow root anything but execute. */
+		missing_access &= FSAL_ACE_PERM_EXECUTE;
+
+		if (allowed != NULL)
+			*allowed = v4mask & ~FSAL_ACE_PERM_EXECUTE;
+
+		if (!missing_access) {
+			LogFullDebug(COMPONENT_NFS_V4_ACL,
+				     "Met root privileges");
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+		}
+	}
+
+	LogFullDebug(COMPONENT_NFS_V4_ACL,
+		     "file acl=%p, file uid=%u, file gid=%u, ", pacl, uid, gid);
+
+	if (isFullDebug(COMPONENT_NFS_V4_ACL)) {
+		char str[LOG_BUFF_LEN] = "\0";
+		struct display_buffer dspbuf = { sizeof(str), str, str };
+
+		(void)display_fsal_v4mask(&dspbuf, v4mask,
+					  p_object_attributes->type ==
+					  DIRECTORY);
+
+		LogFullDebug(COMPONENT_NFS_V4_ACL,
+			     "user uid=%u, user gid= %u, v4mask=%s",
+			     creds->caller_uid, creds->caller_gid, str);
+	}
+
+	is_owner = fsal_check_ace_owner(uid, creds);
+	is_group = fsal_check_ace_group(gid, creds);
+
+	/* Always grant READ_ACL, WRITE_ACL and READ_ATTR, WRITE_ATTR
+	 * to the file owner. */
+	if (is_owner) {
+		if (allowed != NULL)
+			*allowed |=
+			    v4mask & (FSAL_ACE_PERM_WRITE_ACL |
+				      FSAL_ACE_PERM_READ_ACL |
+				      FSAL_ACE_PERM_WRITE_ATTR |
+				      FSAL_ACE_PERM_READ_ATTR);
+
+		missing_access &=
+		    ~(FSAL_ACE_PERM_WRITE_ACL | FSAL_ACE_PERM_READ_ACL);
+		missing_access &=
+		    ~(FSAL_ACE_PERM_WRITE_ATTR | FSAL_ACE_PERM_READ_ATTR);
+		if (!missing_access) {
+			LogFullDebug(COMPONENT_NFS_V4_ACL,
+				     "Met owner privileges");
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+		}
+	}
+	/** @todo Even if user is admin, audit/alarm checks should be done. */
+
+	/* Debug logs tell how the decision was made, don't skip that */
+	cached = !isDebug(COMPONENT_NFS_V4_ACL) &&
+		 fsal_acl_cache_groups(pacl, creds, &groups);
+	if (cached) {
+		flags = (is_dir ? FSAL_ACL_CACHE_DIR : 0) |
+			(is_owner ? FSAL_ACL_CACHE_OWNER : 0) |
+			(is_group ? FSAL_ACL_CACHE_GROUP : 0) |
+			(is_root ? FSAL_ACL_CACHE_ROOT : 0) |
+			(allowed != NULL ? FSAL_ACL_CACHE_ALLOWED : 0) |
+			(denied != NULL ? FSAL_ACL_CACHE_DENIED : 0);
+		slot = fsal_acl_cache_slot(pacl->id, creds->caller_uid,
+					   v4mask, groups, flags);
+		if (slot->acl_id == pacl->id &&
+		    slot->uid == creds->caller_uid &&
+		    slot->v4mask == v4mask && slot->groups == groups &&
+		    slot->flags == flags) {
+			if (allowed != NULL)
+				*allowed = slot->allowed;
+			if (denied != NULL)
+				*denied = slot->denied;
+			return fsalstat(slot->major, 0);
+		}
+	}
+
+	status = fsal_check_access_aces(creds, v4mask, missing_access,
+					allowed, denied, pacl, is_dir,
+					is_owner, is_group, is_root);
+
+	if (cached) {
+		slot->acl_id = pacl->id;
+		slot->uid = creds->caller_uid;
+		slot->v4mask = v4mask;
+		slot->groups = groups;
+		slot->flags = flags;
+		slot->major = status.major;
+		slot->allowed = allowed != NULL ? *allowed : 0;
+		slot->denied = denied != NULL ? *denied : 0;
+	}
+
+	return status;
+}
+
 /**
  * @brief Check access using mode bits only
  *
@@ -863,12 +1026,96 @@ gid_t ganesha_gid;
 int ganesha_ngroups;
 gid_t *ganesha_groups;
 
+/** Most groups whose list a thread remembers */
+#define THREAD_CREDS_GROUPS 32
+
+/**
+ * Credentials the thread is known to run with, so that switching to
+ * the same ones again costs no system call.  Each part is only known
+ * once a switch to it succeeded, and is forgotten while switching.
+ */
+static __thread struct {
+	bool uid_known;
+	bool gid_known;
+	bool groups_known;
+	uid_t uid;
+	gid_t gid;
+	size_t ngroups;
+	gid_t groups[THREAD_CREDS_GROUPS];
+} thread_creds;
+
+/**
+ * @brief Switch the thread's supplementary groups
+ *
+ * @return 0 on success, an errno otherwise.
+ */
+static int thread_creds_set_groups(size_t ngroups, const gid_t *groups)
+{
+	if (thread_creds.groups_known && thread_creds.ngroups == ngroups &&
+	    (ngroups == 0 || memcmp(thread_creds.groups, groups,
+				    ngroups * sizeof(gid_t)) == 0))
+		return 0;
+
+	thread_creds.groups_known = false;
+	if (set_threadgroups(ngroups, groups) != 0)
+		return errno;
+
+	if (ngroups <= THREAD_CREDS_GROUPS) {
+		if (ngroups != 0)
+			memcpy(thread_creds.groups, groups,
+			       ngroups * sizeof(gid_t));
+		thread_creds.ngroups = ngroups;
+		thread_creds.groups_known = true;
+	}
+	return 0;
+}
+
+/**
+ * @brief Switch the thread's effective gid
+ */
+static void thread_creds_set_gid(gid_t gid)
+{
+	if (thread_creds.gid_known && thread_creds.gid == gid)
+		return;
+
+	thread_creds.gid_known = false;
+	if (setgroup(gid) == 0) {
+		thread_creds.gid = gid;
+		thread_creds.gid_known = true;
+	}
+}
+
+/**
+ * @brief Switch the thread's effective uid
+ */
+static void thread_creds_set_uid(uid_t uid)
+{
+	if (thread_creds.uid_known && thread_creds.uid == uid)
+		return;
+
+	thread_creds.uid_known = false;
+	if (setuser(uid) == 0) {
+		thread_creds.uid = uid;
+		thread_creds.uid_known = true;
+	}
+}
+
+/**
+ * @brief Run the thread with a caller's credentials
+ *
+ * Only the parts that differ from what the thread already runs with
+ * are switched, so a thread serving a caller with the same groups or
+ * gid as Ganesha, or serving Ganesha's own uid, saves those calls.
+ *
+ * @param[in] creds  Caller's credentials
+ */
 void fsal_set_credentials(const struct user_cred *creds)
 {
-	if (set_threadgroups(creds->caller_glen, creds->caller_garray) != 0)
+	if (thread_creds_set_groups(creds->caller_glen,
+				    creds->caller_garray) != 0)
 		LogFatal(COMPONENT_FSAL, "Could not set Context credentials");
-	setgroup(creds->caller_gid);
-	setuser(creds->caller_uid);
+	thread_creds_set_gid(creds->caller_gid);
+	thread_creds_set_uid(creds->caller_uid);
 }
 
 bool fsal_set_credentials_only_one_user(const struct user_cred *creds)
@@ -916,11 +1163,14 @@ void fsal_save_ganesha_credentials(void)
 	LogInfo(COMPONENT_FSAL, "%s", buffer);
 }
 
+/**
+ * @brief Run the thread with Ganesha's credentials again
+ */
 void fsal_restore_ganesha_credentials(void)
 {
-	setuser(ganesha_uid);
-	setgroup(ganesha_gid);
-	if (set_threadgroups(ganesha_ngroups, ganesha_groups) != 0)
+	thread_creds_set_uid(ganesha_uid);
+	thread_creds_set_gid(ganesha_gid);
+	if (thread_creds_set_groups(ganesha_ngroups, ganesha_groups) != 0)
 		LogFatal(COMPONENT_FSAL, "Could not set Ganesha credentials");
 }
 
@@ -541,6 +541,106 @@ nfsstat4 FSAL_encode_flex_file_layout(XDR *xdrs,
 	return nfs_status;
 }
 
+/**
+ * @brief Encode an owner or group of a flex files data server
+ *
+ * Loosely coupled data servers take AUTH_SYS numeric ids.
+ *
+ * @param[out] xdrs  XDR stream
+ * @param[in]  id    The id
+ *
+ * @return NFS status codes.
+ */
+static nfsstat4 FSAL_encode_ff_id(XDR *xdrs, const uint32_t id)
+{
+	char buf[sizeof("4294967295")];
+	utf8string name;
+
+	name.utf8string_len = snprintf(buf, sizeof(buf), "%" PRIu32, id);
+	name.utf8string_val = buf;
+
+	if (!xdr_fattr4_owner(xdrs, &name)) {
+		LogMajor(COMPONENT_PNFS, "Failed encoding ffds id %" PRIu32,
+			 id);
+		return NFS4ERR_SERVERFAULT;
+	}
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Convenience function to encode a flex files loc_body
+ *
+ * Unlike FSAL_encode_flex_file_layout, the handles are used as they
+ * are, so they may be ordinary NFS handles of a data server that is
+ * not a Ganesha pNFS DS.  Each mirror holds a single data server, and
+ * the data servers are loosely coupled: the stateid is anonymous.
+ *
+ * @param[out] xdrs         XDR stream
+ * @param[in]  stripe_unit  Stripe unit of the layout
+ * @param[in]  num_mirrors  Number of mirrors
+ * @param[in]  mirrors      The data server of each mirror
+ * @param[in]  flags        ffl_flags of the layout
+ * @param[in]  stats_collect_hint Seconds between LAYOUTSTATS
+ *
+ * @return NFS status codes.
+ */
+nfsstat4 FSAL_encode_ff_layout(XDR *xdrs, const uint64_t stripe_unit,
+			       const uint32_t num_mirrors,
+			       const fsal_ff_ds_member_t *mirrors,
+			       const ff_flags4 flags,
+			       const uint32_t stats_collect_hint)
+{
+	const uint32_t one = 1;
+	stateid4 anon_stateid;
+	nfsstat4 nfs_status;
+	uint32_t i;
+
+	memset(&anon_stateid, 0, sizeof(anon_stateid));
+
+	if (!xdr_length4(xdrs, (uint64_t *) &stripe_unit) ||
+	    !xdr_uint32_t(xdrs, (uint32_t *) &num_mirrors)) {
+		LogMajor(COMPONENT_PNFS, "Failed encoding ff_layout4.");
+		return NFS4ERR_SERVERFAULT;
+	}
+
+	for (i = 0; i < num_mirrors; i++) {
+		const fsal_ff_ds_member_t *ds = &mirrors[i];
+		u_int fh_len = ds->fh.len;
+		char *fh_val = ds->fh.addr;
+
+		/* ffm_data_servers<1>, then the ff_data_server4 */
+		if (!xdr_uint32_t(xdrs, (uint32_t *) &one) ||
+		    !xdr_fsal_deviceid(xdrs,
+				       (struct pnfs_deviceid *)&ds->deviceid) ||
+		    !xdr_uint32_t(xdrs, (uint32_t *) &ds->efficiency) ||
+		    !xdr_stateid4(xdrs, &anon_stateid) ||
+		    !xdr_uint32_t(xdrs, (uint32_t *) &one) ||
+		    !xdr_bytes(xdrs, &fh_val, &fh_len, NFS4_FHSIZE)) {
+			LogMajor(COMPONENT_PNFS,
+				 "Failed encoding ff_data_server4 %" PRIu32,
+				 i);
+			return NFS4ERR_SERVERFAULT;
+		}
+
+		nfs_status = FSAL_encode_ff_id(xdrs, ds->uid);
+		if (nfs_status != NFS4_OK)
+			return nfs_status;
+
+		nfs_status = FSAL_encode_ff_id(xdrs, ds->gid);
+		if (nfs_status != NFS4_OK)
+			return nfs_status;
+	}
+
+	if (!xdr_ff_flags(xdrs, (ff_flags4 *) &flags) ||
+	    !xdr_uint32_t(xdrs, (uint32_t *) &stats_collect_hint)) {
+		LogMajor(COMPONENT_PNFS, "Failed encoding ffl_flags.");
+		return NFS4ERR_SERVERFAULT;
+	}
+
+	return NFS4_OK;
+}
+
 /**
  * @brief Convenience function to encode ff_device_addr4
  *
@@ -43,6 +43,7 @@
 #include <misc/queue.h> /* avoid conflicts with sys/queue.h */
 #ifdef LINUX
 #include <sys/sysmacros.h> /* for major(3), minor(3) */
+#include <poll.h>
 #endif
 #include <libgen.h>		/* used for 'dirname' */
 #include <pthread.h>
@@ -385,6 +386,73 @@ const char *msg_fsal_err(fsal_errors_t fsal_err)
 	return "Unknown FSAL error";
 }
 
+/**
+ * @brief Deliver one entry of a per-entry readdir as a batch
+ *
+ * @param[in] name       The name of the entry
+ * @param[in] obj        The entry, ref'd
+ * @param[in] attrs      The requested attributes
+ * @param[in] dir_state  A struct fsal_readdir_batch_state
+ * @param[in] cookie     FSAL generated cookie
+ *
+ * @returns fsal_dir_result of the batch callback
+ */
+enum fsal_dir_result fsal_readdir_batch_one(const char *name,
+					    struct fsal_obj_handle *obj,
+					    struct attrlist *attrs,
+					    void *dir_state,
+					    fsal_cookie_t cookie)
+{
+	struct fsal_readdir_batch_state *state = dir_state;
+	struct fsal_readdir_entry entry = {
+		.name = name,
+		.obj = obj,
+		.attrs = attrs,
+		.cookie = cookie,
+	};
+	unsigned int consumed = 0;
+
+	return state->cb(&entry, 1, &consumed, state->dir_state);
+}
+
+/**
+ * @brief Deliver a readdir batch to a per-entry callback
+ *
+ * This is the body of a fsal_readdir_batch_cb for callers that handle
+ * one entry at a time.
+ *
+ * @param[in]  cb         Per-entry callback
+ * @param[in]  entries    The entries
+ * @param[in]  count      Number of entries
+ * @param[out] consumed   Number of entries cb accepted
+ * @param[in]  dir_state  Passed to cb
+ *
+ * @returns fsal_dir_result of the last entry handled
+ */
+enum fsal_dir_result fsal_readdir_entries(fsal_readdir_cb cb,
+					  struct fsal_readdir_entry *entries,
+					  unsigned int count,
+					  unsigned int *consumed,
+					  void *dir_state)
+{
+	enum fsal_dir_result cb_result = DIR_CONTINUE;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		cb_result = cb(entries[i].name, entries[i].obj,
+			       entries[i].attrs, dir_state, entries[i].cookie);
+		if (cb_result >= DIR_TERMINATE)
+			break;
+		(*consumed)++;
+	}
+
+	/* cb released the entries it was given, release the rest */
+	for (i++; i < count; i++)
+		entries[i].obj->obj_ops->put_ref(entries[i].obj);
+
+	return cb_result;
+}
+
 const char *fsal_dir_result_str(enum fsal_dir_result result)
 {
 	switch (result) {
@@ -673,6 +741,14 @@ struct glist_head posix_file_systems = {
 struct avltree avl_fsid;
 struct avltree avl_dev;
 
+/** Visible file systems by mount point, a later mount hides an earlier one */
+static struct avltree avl_path;
+
+#ifdef LINUX
+/** Polled for changes of the mount table, -1 until first populated */
+static int mountinfo_fd = -1;
+#endif
+
 static inline int
 fsal_fs_cmpf_fsid(const struct avltree_node *lhs,
 		  const struct avltree_node *rhs)
@@ -761,6 +837,50 @@ avltree_inline_dev_lookup(const struct avltree_node *key)
 		return NULL;
 }
 
+static inline int
+fsal_fs_cmpf_path(const struct avltree_node *lhs,
+		  const struct avltree_node *rhs)
+{
+	struct fsal_filesystem *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct fsal_filesystem, avl_path);
+	rk = avltree_container_of(rhs, struct fsal_filesystem, avl_path);
+
+	return strcmp(lk->path, rk->path);
+}
+
+/**
+ * @brief Find the file system mounted on a path
+ *
+ * @param[in] path  Mount point, need not be NUL terminated
+ * @param[in] len   Length of path
+ *
+ * @return The file system, NULL if none is mounted there.
+ */
+static struct fsal_filesystem *lookup_path_locked(const char *path,
+						  size_t len)
+{
+	struct fsal_filesystem key;
+	struct avltree_node *node;
+	char buf[MAXPATHLEN];
+
+	if (len >= sizeof(buf))
+		return NULL;
+
+	memcpy(buf, path, len);
+	buf[len] = '\0';
+	key.path = buf;
+
+	node = avltree_inline_lookup(&key.avl_path, &avl_path,
+				     fsal_fs_cmpf_path);
+
+	if (node != NULL)
+		return avltree_container_of(node, struct fsal_filesystem,
+					    avl_path);
+	else
+		return NULL;
+}
+
 void remove_fs(struct fsal_filesystem *fs)
 {
 	if (fs->in_fsid_avl)
@@ -769,6 +889,9 @@ void remove_fs(struct fsal_filesystem *fs)
 	if (fs->in_dev_avl)
 		avltree_remove(&fs->avl_dev, &avl_dev);
 
+	if (fs->in_path_avl)
+		avltree_remove(&fs->avl_path, &avl_path);
+
 	glist_del(&fs->siblings);
 	glist_del(&fs->filesystems);
 }
@@ -1066,14 +1189,6 @@ static void posix_create_file_system(struct mntent *mnt)
 	struct fsal_filesystem *fs;
 	struct avltree_node *node;
 
-	if (strncasecmp(mnt->mnt_type, "nfs", 3) == 0) {
-		LogDebug(COMPONENT_FSAL,
-			 "Ignoring %s because type %s",
-			 mnt->mnt_dir,
-			 mnt->mnt_type);
-		return;
-	}
-
 	fs = gsh_calloc(1, sizeof(*fs));
 
 	fs->path = gsh_strdup(mnt->mnt_dir);
@@ -1159,6 +1274,22 @@ static void posix_create_file_system(struct mntent *mnt)
 
 	fs->in_dev_avl = true;
 
+	node = avltree_insert(&fs->avl_path, &avl_path);
+
+	if (node != NULL) {
+		/* Mounted over an earlier file system, which is hidden */
+		struct fsal_filesystem *fs1;
+
+		fs1 = avltree_container_of(node,
+					   struct fsal_filesystem,
+					   avl_path);
+		avltree_remove(&fs1->avl_path, &avl_path);
+		fs1->in_path_avl = false;
+		avltree_insert(&fs->avl_path, &avl_path);
+	}
+
+	fs->in_path_avl = true;
+
 	glist_add_tail(&posix_file_systems, &fs->filesystems);
 	glist_init(&fs->children);
 
@@ -1171,11 +1302,59 @@ static void posix_create_file_system(struct mntent *mnt)
 		fs->fsid.major, fs->fsid.minor);
 }
 
-static void posix_find_parent(struct fsal_filesystem *this)
+/**
+ * @brief Check whether a mount is the file system already mounted there
+ *
+ * A refresh only has to examine the mounts that are new.
+ *
+ * @param[in] mnt  The mount
+ *
+ * @return true if the mount is known.
+ */
+static bool posix_mount_known(struct mntent *mnt)
 {
-	struct glist_head *glist;
 	struct fsal_filesystem *fs;
-	int plen = 0;
+
+	fs = lookup_path_locked(mnt->mnt_dir, strlen(mnt->mnt_dir));
+
+	return fs != NULL &&
+	       strcmp(fs->device, mnt->mnt_fsname) == 0 &&
+	       strcmp(fs->type, mnt->mnt_type) == 0;
+}
+
+/**
+ * @brief Check whether the mount table changed since the last populate
+ *
+ * The kernel flags /proc/self/mountinfo with POLLPRI when a mount is
+ * added or removed, polling clears the flag.  Without it every
+ * refresh reads the table.
+ *
+ * @return true if the table must be read again.
+ */
+static bool posix_mounts_changed(void)
+{
+#ifdef LINUX
+	struct pollfd pfd;
+
+	if (mountinfo_fd < 0)
+		return true;
+
+	pfd.fd = mountinfo_fd;
+	pfd.events = POLLPRI;
+	pfd.revents = 0;
+
+	if (poll(&pfd, 1, 0) < 0)
+		return true;
+
+	return (pfd.revents & (POLLPRI | POLLERR)) != 0;
+#else
+	return true;
+#endif
+}
+
+static void posix_find_parent(struct fsal_filesystem *this)
+{
+	size_t len = this->pathlen;
 
 	/* Check if it already has parent */
 	if (this->parent != NULL)
@@ -1185,31 +1364,18 @@ static void posix_find_parent(struct fsal_filesystem *this)
 	if (this->pathlen == 1 && this->path[0] == '/')
 		return;
 
-	glist_for_each(glist, &posix_file_systems) {
-		fs = glist_entry(glist, struct fsal_filesystem, filesystems);
-
-		/* If this path is longer than this path, then it
-		 * can't be a parent, or if it's shorter than the
-		 * current match;
-		 */
-		if (fs->pathlen >= this->pathlen ||
-		    fs->pathlen < plen)
-			continue;
-
-		/* Check for sub-string match */
-		if (strncmp(fs->path, this->path, fs->pathlen) != 0)
-			continue;
-
-		/* Differentiate between /fs1 and /fs10 for parent of
-		 * /fs10/fs2, however, if fs->path is "/", we need to
-		 * special case.
-		 */
-		if (fs->pathlen != 1 &&
-		    this->path[fs->pathlen] != '/')
-			continue;
+	/* The parent is the file system mounted on the longest leading
+	 * directory of the path, look them up from the deepest up.
+	 */
+	while (len > 1 && this->parent == NULL) {
+		do {
+			len--;
+		} while (len > 0 && this->path[len] != '/');
 
-		this->parent = fs;
-		plen = fs->pathlen;
+		if (len == 0 && this->path[0] == '/')
+			this->parent = lookup_path_locked("/", 1);
+		else if (len > 0)
+			this->parent = lookup_path_locked(this->path, len);
 	}
 
 	if (this->parent == NULL) {
@@ -1262,11 +1428,22 @@ int populate_posix_file_systems(bool force)
 		LogDebug(COMPONENT_FSAL, "Initializing posix file systems");
 		avltree_init(&avl_fsid, fsal_fs_cmpf_fsid, 0);
 		avltree_init(&avl_dev, fsal_fs_cmpf_dev, 0);
+		avltree_init(&avl_path, fsal_fs_cmpf_path, 0);
 	} else if (!force) {
 		LogDebug(COMPONENT_FSAL, "File systems are initialized");
 		goto out;
+	} else if (!posix_mounts_changed()) {
+		LogDebug(COMPONENT_FSAL, "Mount table has not changed");
+		goto out;
 	}
 
+#ifdef LINUX
+	if (mountinfo_fd < 0) {
+		/* Changes from now on will be seen by the next refresh */
+		mountinfo_fd = open("/proc/self/mountinfo", O_RDONLY);
+	}
+#endif
+
 	/* start looking for the mount point */
 	fp = setmntent(MOUNTED, "r");
 
@@ -1286,6 +1463,18 @@ int populate_posix_file_systems(bool force)
 		if (mnt->mnt_dir == NULL)
 			continue;
 
+		/* Don't stat what is ignored anyway, or already known */
+		if (strncasecmp(mnt->mnt_type, "nfs", 3) == 0) {
+			LogDebug(COMPONENT_FSAL,
+				 "Ignoring %s because type %s",
+				 mnt->mnt_dir,
+				 mnt->mnt_type);
+			continue;
+		}
+
+		if (posix_mount_known(mnt))
+			continue;
+
 		if (stat(mnt->mnt_dir, &st) < 0 || !S_ISDIR(st.st_mode)) {
 			continue;
 		}
@@ -1405,6 +1594,13 @@ void release_posix_file_systems(void)
 		release_posix_file_system(fs);
 	}
 
+#ifdef LINUX
+	if (mountinfo_fd >= 0) {
+		close(mountinfo_fd);
+		mountinfo_fd = -1;
+	}
+#endif
+
 	PTHREAD_RWLOCK_unlock(&fs_lock);
 }
 
@@ -1576,8 +1772,7 @@ int claim_posix_filesystems(const char *path,
 			    struct fsal_filesystem **root_fs)
 {
 	int retval = 0;
-	struct fsal_filesystem *fs, *root = NULL;
-	struct glist_head *glist;
+	struct fsal_filesystem *root;
 	struct stat statbuf;
 	struct fsal_dev__ dev;
 
@@ -1591,14 +1786,8 @@ int claim_posix_filesystems(const char *path,
 	}
 	dev = posix2fsal_devt(statbuf.st_dev);
 
-	/* Scan POSIX file systems to find export root fs */
-	glist_for_each(glist, &posix_file_systems) {
-		fs = glist_entry(glist, struct fsal_filesystem, filesystems);
-		if (fs->dev.major == dev.major && fs->dev.minor == dev.minor) {
-			root = fs;
-			break;
-		}
-	}
+	/* Find export root fs */
+	root = lookup_dev_locked(&dev);
 
 	/* Check if we found a filesystem */
 	if (root == NULL) {
@@ -2247,7 +2436,8 @@ void update_share_counters(struct fsal_share *share,
 		((int)(new_openflags & FSAL_O_DENY_WRITE_MAND) != 0) -
 		((int)(old_openflags & FSAL_O_DENY_WRITE_MAND) != 0);
 
-	share->share_access_read += access_read_inc;
+	(void) atomic_add_uint32_t(&share->share_access_read,
+				   access_read_inc);
 	share->share_access_write += access_write_inc;
 	share->share_deny_read += deny_read_inc;
 	share->share_deny_write += deny_write_inc;
@@ -2262,6 +2452,57 @@ void update_share_counters(struct fsal_share *share,
 		     share->share_deny_write_mand);
 }
 
+/**
+ * @brief Update the share counters for a read only, deny none open
+ *
+ * Opening to only read and deny nothing, or closing such an open, only
+ * changes share_access_read and can only conflict with share_deny_read,
+ * which is always changed with the write lock held.  Such updates are
+ * done here with the read lock, so that many clients opening a shared
+ * read only file do not serialize on the object or wait for its I/O.
+ *
+ * @param[in]  obj_hdl       File the share belongs to
+ * @param[in]  share         Share to update
+ * @param[in]  old_openflags Previous access/deny mode
+ * @param[in]  new_openflags Current access/deny mode
+ * @param[out] status        Result, if true is returned
+ *
+ * @retval true if the share was handled here.
+ * @retval false if the caller must check and update it with the write lock.
+ */
+
+bool update_share_counters_shared(struct fsal_obj_handle *obj_hdl,
+				  struct fsal_share *share,
+				  fsal_openflags_t old_openflags,
+				  fsal_openflags_t new_openflags,
+				  fsal_status_t *status)
+{
+	fsal_openflags_t mask = FSAL_O_RDWR | FSAL_O_DENY_READ |
+				FSAL_O_DENY_WRITE | FSAL_O_DENY_WRITE_MAND;
+	fsal_openflags_t old_mode = old_openflags & mask;
+	fsal_openflags_t new_mode = new_openflags & mask;
+
+	if (!(old_mode == FSAL_O_CLOSED && new_mode == FSAL_O_READ) &&
+	    !(old_mode == FSAL_O_READ && new_mode == FSAL_O_CLOSED))
+		return false;
+
+	PTHREAD_RWLOCK_rdlock(&obj_hdl->obj_lock);
+
+	if (new_mode == FSAL_O_READ) {
+		*status = check_share_conflict(share, new_openflags, false);
+
+		if (!FSAL_IS_ERROR(*status))
+			(void) atomic_inc_uint32_t(&share->share_access_read);
+	} else {
+		(void) atomic_sub_uint32_t(&share->share_access_read, 1);
+		*status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return true;
+}
+
 /**
  * @brief Check for share conflict
  *
@@ -2378,7 +2619,8 @@ fsal_status_t merge_share(struct fsal_share *orig_share,
 	}
 
 	/* Now that we are ok, merge the share counters in the original */
-	orig_share->share_access_read += dupe_share->share_access_read;
+	(void) atomic_add_uint32_t(&orig_share->share_access_read,
+				   dupe_share->share_access_read);
 	orig_share->share_access_write += dupe_share->share_access_write;
 	orig_share->share_deny_read += dupe_share->share_deny_read;
 	orig_share->share_deny_write += dupe_share->share_deny_write;
@@ -532,6 +532,27 @@ static fsal_status_t get_quota(struct fsal_export *exp_hdl,
 	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
 }
 
+/* get_quotas
+ * default case is one get_quota per id
+ */
+
+static fsal_status_t get_quotas(struct fsal_export *exp_hdl,
+				const char *filepath, int quota_type,
+				uint32_t count, const int *quota_ids,
+				fsal_quota_t *pquotas,
+				fsal_status_t *pstatuses)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+		pstatuses[i] = exp_hdl->exp_ops.get_quota(exp_hdl, filepath,
+							  quota_type,
+							  quota_ids[i],
+							  &pquotas[i]);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
 /* set_quota
  * default case not supported
  */
@@ -629,7 +650,7 @@ static struct state_t *alloc_state(struct fsal_export *exp_hdl,
 				   enum state_type state_type,
 				   struct state_t *related_state)
 {
-	return init_state(gsh_calloc(1, sizeof(struct state_t)),
+	return init_state(gsh_calloc(1, sizeof_state(state_type)),
 			  exp_hdl, state_type, related_state);
 }
 
@@ -660,6 +681,25 @@ bool is_superuser(struct fsal_export *exp_hdl, const struct user_cred *creds)
 	return (creds->caller_uid == 0);
 }
 
+/**
+ * @brief No per export statistics
+ *
+ * @param[in] exp_hdl               Export to report on
+ * @param[in] iter                  opaque pointer to DBusMessageIter, or NULL
+ *
+ * @returns false.
+ */
+
+static bool export_extract_stats(struct fsal_export *exp_hdl, void *iter)
+{
+	return false;
+}
+
+static void export_reset_stats(struct fsal_export *exp_hdl)
+{
+	/* Nothing to reset */
+}
+
 /* Default fsal export method vector.
  * copied to allocated vector at register time
  */
@@ -687,6 +727,7 @@ struct export_ops def_export_ops = {
 	.fs_umask = fs_umask,
 	.check_quota = check_quota,
 	.get_quota = get_quota,
+	.get_quotas = get_quotas,
 	.set_quota = set_quota,
 	.getdevicelist = getdevicelist,
 	.fs_layouttypes = fs_layouttypes,
@@ -697,6 +738,8 @@ struct export_ops def_export_ops = {
 	.alloc_state = alloc_state,
 	.free_state = free_state,
 	.is_superuser = is_superuser,
+	.extract_stats = export_extract_stats,
+	.reset_stats = export_reset_stats,
 };
 
 /* fsal_obj_handle common methods
@@ -1239,6 +1282,39 @@ static nfsstat4 layoutcommit(struct fsal_obj_handle *obj_hdl,
 	return NFS4ERR_NOTSUPP;
 }
 
+/**
+ * @brief Ignore I/O statistics for a layout
+ *
+ * @param[in] obj_hdl  The object the layout is for
+ * @param[in] req_ctx  Request context
+ * @param[in] lou_body Layout type-specific statistics
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return NFS4_OK, the statistics are only advice.
+ */
+static nfsstat4 layoutstats(struct fsal_obj_handle *obj_hdl,
+			    struct req_op_context *req_ctx, XDR *lou_body,
+			    const struct fsal_layoutstats_arg *arg)
+{
+	return NFS4_OK;
+}
+
+/**
+ * @brief Ignore an error met doing I/O through a layout
+ *
+ * @param[in] obj_hdl  The object the layout is for
+ * @param[in] req_ctx  Request context
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return NFS4_OK
+ */
+static nfsstat4 layouterror(struct fsal_obj_handle *obj_hdl,
+			    struct req_op_context *req_ctx,
+			    const struct fsal_layouterror_arg *arg)
+{
+	return NFS4_OK;
+}
+
 /* open2
  * default case not supported
  */
@@ -1360,16 +1436,15 @@ static fsal_status_t seek2(struct fsal_obj_handle *obj_hdl,
 }
 
 /* io io_advise2
- * default case not supported
+ * default case passes the hints to io_advise, which ignores them
+ * unless the FSAL has one of its own
  */
 
 static fsal_status_t io_advise2(struct fsal_obj_handle *obj_hdl,
 				struct state_t *fd,
 				struct io_hints *hints)
 {
-	hints->hints = 0;
-
-	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	return obj_hdl->obj_ops->io_advise(obj_hdl, hints);
 }
 
 /* commit2
@@ -1451,6 +1526,50 @@ static bool is_referral(struct fsal_obj_handle *obj_hdl,
 	return false;
 }
 
+/* read_dirents_batch
+ * default case delivers the entries of readdir one at a time
+ */
+static fsal_status_t read_dirents_batch(struct fsal_obj_handle *dir_hdl,
+					fsal_cookie_t *whence, void *dir_state,
+					fsal_readdir_batch_cb cb,
+					attrmask_t attrmask, bool *eof)
+{
+	struct fsal_readdir_batch_state state = {
+		.cb = cb,
+		.dir_state = dir_state,
+	};
+
+	return dir_hdl->obj_ops->readdir(dir_hdl, whence, &state,
+					 fsal_readdir_batch_one, attrmask,
+					 eof);
+}
+
+/* copy
+ * default case not supported, fsal_copy falls back to read2 and write2
+ */
+static fsal_status_t file_copy(struct fsal_obj_handle *dst_hdl,
+			       struct state_t *dst_state, uint64_t dst_offset,
+			       struct fsal_obj_handle *src_hdl,
+			       struct state_t *src_state, uint64_t src_offset,
+			       uint64_t count, uint64_t *copied)
+{
+	return fsalstat(ERR_FSAL_NOTSUPP, 0);
+}
+
+/* clone2
+ * default case not supported
+ */
+static fsal_status_t file_clone2(struct fsal_obj_handle *dst_hdl,
+				 struct state_t *dst_state,
+				 uint64_t dst_offset,
+				 struct fsal_obj_handle *src_hdl,
+				 struct state_t *src_state,
+				 uint64_t src_offset,
+				 uint64_t count)
+{
+	return fsalstat(ERR_FSAL_NOTSUPP, 0);
+}
+
 /* Default fsal handle object method vector.
  * copied to allocated vector at register time
  */
@@ -1491,6 +1610,8 @@ struct fsal_obj_ops def_handle_ops = {
 	.layoutget = layoutget,
 	.layoutreturn = layoutreturn,
 	.layoutcommit = layoutcommit,
+	.layoutstats = layoutstats,
+	.layouterror = layouterror,
 	.getxattrs = getxattrs,
 	.setxattrs = setxattrs,
 	.removexattrs = removexattrs,
@@ -1509,6 +1630,9 @@ struct fsal_obj_ops def_handle_ops = {
 	.setattr2 = setattr2,
 	.close2 = close2,
 	.is_referral = is_referral,
+	.readdir_batch = read_dirents_batch,
+	.copy = file_copy,
+	.clone2 = file_clone2,
 };
 
 /* fsal_pnfs_ds common methods */
@@ -49,6 +49,7 @@
 #include "sal_data.h"
 #include "sal_functions.h"
 #include "FSAL/fsal_commonlib.h"
+#include "gsh_iobuf.h"
 
 /**
  * This is a global counter of files opened.
@@ -62,6 +63,8 @@
 
 size_t open_fd_count;
 
+uint32_t fsal_obj_handle_epoch;
+
 static bool fsal_not_in_group_list(gid_t gid)
 {
 	const struct user_cred *creds = op_ctx->creds;
@@ -417,6 +420,12 @@ fsal_status_t open2_by_name(struct fsal_obj_handle *in_obj,
 		     "Created entry %p FSAL %s for %s",
 		     *obj, (*obj)->fsal->name, name);
 
+	/* An unchecked create may have opened an existing entry, telling
+	 * of it again does no harm.
+	 */
+	if (createmode != FSAL_NO_CREATE)
+		state_dir_notify(in_obj, NOTIFY4_ADD_ENTRY, name, NULL);
+
 	if (!caller_perm_check)
 		return status;
 
@@ -636,6 +645,8 @@ fsal_status_t fsal_link(struct fsal_obj_handle *obj,
 	/* Rather than performing a lookup first, just try to make the
 	   link and return the FSAL's error if it fails. */
 	status = obj->obj_ops->link(obj, dest_dir, name);
+	if (!FSAL_IS_ERROR(status))
+		state_dir_notify(dest_dir, NOTIFY4_ADD_ENTRY, name, NULL);
 	return status;
 }
 
@@ -834,11 +845,15 @@ fsal_status_t fsal_create(struct fsal_obj_handle *parent,
 	case DIRECTORY:
 		status = parent->obj_ops->mkdir(parent, name, attrs,
 					       obj, attrs_out);
+		if (FSAL_IS_SUCCESS(status))
+			state_dir_notify(parent, NOTIFY4_ADD_ENTRY, name, NULL);
 		break;
 
 	case SYMBOLIC_LINK:
 		status = parent->obj_ops->symlink(parent, name, link_content,
 						 attrs, obj, attrs_out);
+		if (FSAL_IS_SUCCESS(status))
+			state_dir_notify(parent, NOTIFY4_ADD_ENTRY, name, NULL);
 		break;
 
 	case SOCKET_FILE:
@@ -847,6 +862,8 @@ fsal_status_t fsal_create(struct fsal_obj_handle *parent,
 	case CHARACTER_FILE:
 		status = parent->obj_ops->mknode(parent, name, type,
 						attrs, obj, attrs_out);
+		if (FSAL_IS_SUCCESS(status))
+			state_dir_notify(parent, NOTIFY4_ADD_ENTRY, name, NULL);
 		break;
 
 	case NO_FILE_TYPE:
@@ -1066,11 +1083,37 @@ out:
 	return retval;
 }
 
+/* Open coded rather than fsal_readdir_entries() so populate_dirent is
+ * called directly.
+ */
+static enum fsal_dir_result
+populate_dirents(struct fsal_readdir_entry *entries, unsigned int count,
+		 unsigned int *consumed, void *dir_state)
+{
+	enum fsal_dir_result retval = DIR_CONTINUE;
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		retval = populate_dirent(entries[i].name, entries[i].obj,
+					 entries[i].attrs, dir_state,
+					 entries[i].cookie);
+		if (retval >= DIR_TERMINATE)
+			break;
+		(*consumed)++;
+	}
+
+	/* Put the refs on the entries we did not get to */
+	for (i++; i < count; i++)
+		entries[i].obj->obj_ops->put_ref(entries[i].obj);
+
+	return retval;
+}
+
 /**
  * @brief Reads a directory
  *
  * This function iterates over the directory entries  and invokes a supplied
- * callback function for each one.
+ * callback function for each one.  The FSAL hands them over in batches.
  *
  * @param[in]  directory The directory to be read
  * @param[in]  cookie    Starting cookie for the readdir operation
@@ -1155,11 +1198,11 @@ fsal_status_t fsal_readdir(struct fsal_obj_handle *directory,
 	state.cb_nfound = nbfound;
 	state.attrmask = attrmask;
 
-	fsal_status = directory->obj_ops->readdir(directory, &cookie,
-						 (void *)&state,
-						 populate_dirent,
-						 attrmask,
-						 eod_met);
+	fsal_status = directory->obj_ops->readdir_batch(directory, &cookie,
+						       (void *)&state,
+						       populate_dirents,
+						       attrmask,
+						       eod_met);
 
 	return fsal_status;
 }
@@ -1229,6 +1272,8 @@ fsal_remove(struct fsal_obj_handle *parent, const char *name)
 		goto out;
 	}
 
+	state_dir_notify(parent, NOTIFY4_REMOVE_ENTRY, name, NULL);
+
 out:
 
 	to_remove_obj->obj_ops->put_ref(to_remove_obj);
@@ -1308,6 +1353,14 @@ fsal_status_t fsal_rename(struct fsal_obj_handle *dir_src,
 		goto out;
 	}
 
+	if (dir_src == dir_dest) {
+		state_dir_notify(dir_src, NOTIFY4_RENAME_ENTRY, oldname,
+				 newname);
+	} else {
+		state_dir_notify(dir_src, NOTIFY4_REMOVE_ENTRY, oldname, NULL);
+		state_dir_notify(dir_dest, NOTIFY4_ADD_ENTRY, newname, NULL);
+	}
+
 out:
 	if (lookup_src) {
 		/* Note that even with a junction, this object is in the same
@@ -1525,6 +1578,113 @@ fsal_status_t fsal_verify2(struct fsal_obj_handle *obj,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+/** Most data fsal_copy moves through a buffer at a time */
+#define FSAL_COPY_BUFSIZE (1024 * 1024)
+
+/**
+ * @brief Record the result of a read2 or write2 done for fsal_copy
+ *
+ * @param[in] obj		Object being acted on
+ * @param[in] ret		Return status of call
+ * @param[in] io_data		I/O arguments
+ * @param[in] caller_data	Status to set
+ */
+static void fsal_copy_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			 void *io_data, void *caller_data)
+{
+	*(fsal_status_t *) caller_data = ret;
+}
+
+/**
+ * @brief Copy data from one file into another
+ *
+ * The FSAL copy method is tried first.  When it can't copy between the
+ * two files, the data is read into a buffer with read2 and written out
+ * with write2.  This must not be called with op_ctx->async_io set.
+ *
+ * @param[in]  dst        File to copy into
+ * @param[in]  dst_state  state_t to write with (or NULL)
+ * @param[in]  dst_offset Offset to write at
+ * @param[in]  src        File to copy from
+ * @param[in]  src_state  state_t to read with (or NULL)
+ * @param[in]  src_offset Offset to read from
+ * @param[in]  count      Bytes to copy
+ * @param[out] copied     Bytes copied, less than count if the source
+ *                        ended or an error stopped the copy
+ *
+ * @return FSAL status, success if anything at all was copied.
+ */
+
+fsal_status_t fsal_copy(struct fsal_obj_handle *dst,
+			struct state_t *dst_state, uint64_t dst_offset,
+			struct fsal_obj_handle *src,
+			struct state_t *src_state, uint64_t src_offset,
+			uint64_t count, uint64_t *copied)
+{
+	fsal_status_t status;
+	struct fsal_io_arg *io_arg;
+	size_t bufsize;
+
+	*copied = 0;
+
+	if (count == 0)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	status = dst->obj_ops->copy(dst, dst_state, dst_offset, src, src_state,
+				    src_offset, count, copied);
+
+	if (status.major != ERR_FSAL_NOTSUPP && status.major != ERR_FSAL_XDEV)
+		return status;
+
+	LogFullDebug(COMPONENT_FSAL,
+		     "Copying %" PRIu64 " bytes through read2 and write2",
+		     count);
+
+	bufsize = MIN(count, FSAL_COPY_BUFSIZE);
+	io_arg = gsh_calloc(1, sizeof(*io_arg) + sizeof(struct iovec));
+	io_arg->extent.fd = -1;
+	io_arg->iov_count = 1;
+	io_arg->iov[0].iov_base = iobuf_alloc(bufsize);
+
+	status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	while (*copied < count) {
+		io_arg->state = src_state;
+		io_arg->offset = src_offset + *copied;
+		io_arg->iov[0].iov_len = MIN(count - *copied, bufsize);
+		io_arg->io_amount = 0;
+		io_arg->end_of_file = false;
+
+		src->obj_ops->read2(src, false, fsal_copy_cb, io_arg, &status);
+
+		if (FSAL_IS_ERROR(status) || io_arg->io_amount == 0)
+			break;
+
+		io_arg->state = dst_state;
+		io_arg->offset = dst_offset + *copied;
+		io_arg->iov[0].iov_len = io_arg->io_amount;
+		io_arg->io_amount = 0;
+		io_arg->fsal_stable = false;
+
+		dst->obj_ops->write2(dst, false, fsal_copy_cb, io_arg,
+				     &status);
+
+		if (FSAL_IS_ERROR(status) || io_arg->io_amount == 0)
+			break;
+
+		*copied += io_arg->io_amount;
+	}
+
+	iobuf_free(io_arg->iov[0].iov_base);
+	gsh_free(io_arg);
+
+	/* What was copied before an error stands, the caller asks again */
+	if (*copied != 0)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	return status;
+}
+
 /**
  * @brief Fetch optional attributes
  *
@@ -360,6 +360,68 @@ fsal_status_t up_async_layoutrecall(struct fridgethr *fr,
 	return fsalstat(posix2fsal_error(rc), rc);
 }
 
+/* Layoutrecall of a filesystem */
+
+struct layoutrecall_fsid_args {
+	const struct fsal_up_vector *vec;
+	layouttype4 layout_type;
+	bool changed;
+	layoutiomode4 io_mode;
+	bool all;
+	fsal_fsid_t fsid;
+	void (*cb)(void *, state_status_t);
+	void *cb_arg;
+};
+
+static void queue_layoutrecall_fsid(struct fridgethr_context *ctx)
+{
+	struct layoutrecall_fsid_args *args = ctx->arg;
+	state_status_t status;
+
+	status = args->vec->up_fsal_export->up_ops->layoutrecall_fsid(
+						args->vec,
+						args->layout_type,
+						args->changed,
+						args->io_mode,
+						args->all ? NULL : &args->fsid);
+
+	if (args->cb)
+		args->cb(args->cb_arg, status);
+
+	gsh_free(args);
+}
+
+fsal_status_t up_async_layoutrecall_fsid(struct fridgethr *fr,
+					 const struct fsal_up_vector *vec,
+					 layouttype4 layout_type, bool changed,
+					 layoutiomode4 io_mode,
+					 const fsal_fsid_t *fsid,
+					 void (*cb)(void *, state_status_t),
+					 void *cb_arg)
+{
+	struct layoutrecall_fsid_args *args = NULL;
+	int rc = 0;
+
+	args = gsh_malloc(sizeof(struct layoutrecall_fsid_args));
+
+	args->vec = vec;
+	args->cb = cb;
+	args->cb_arg = cb_arg;
+	args->layout_type = layout_type;
+	args->changed = changed;
+	args->io_mode = io_mode;
+	args->all = fsid == NULL;
+	if (fsid)
+		args->fsid = *fsid;
+
+	rc = fridgethr_submit(fr, queue_layoutrecall_fsid, args);
+
+	if (rc != 0)
+		gsh_free(args);
+
+	return fsalstat(posix2fsal_error(rc), rc);
+}
+
 /* Notify Device */
 
 struct notify_device_args {
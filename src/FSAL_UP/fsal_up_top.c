@@ -354,6 +354,30 @@ static state_status_t create_file_recall(struct fsal_obj_handle *obj,
 
 static void layoutrecall_one_call(void *arg);
 
+/**
+ * @brief How long to wait before a CB_LAYOUTRECALL answered with DELAY
+ *
+ * Back off in plateaus.
+ *
+ * @param[in] attempts Times we've recalled
+ *
+ * @return Delay before recalling again.
+ */
+
+static nsecs_elapsed_t layoutrecall_backoff(uint32_t attempts)
+{
+	if (attempts < 5)
+		return 0;
+	else if (attempts < 10)
+		return 1 * NS_PER_MSEC;
+	else if (attempts < 20)
+		return 10 * NS_PER_MSEC;
+	else if (attempts < 30)
+		return 100 * NS_PER_MSEC;
+	else
+		return 1 * NS_PER_SEC;
+}
+
 /**
  * @brief Data used to handle the response to CB_LAYOUTRECALL
  */
@@ -566,28 +590,18 @@ static void layoutrec_completion(rpc_call_t *call)
 		goto out;
 	} else if (call->cbt.v_u.v4.res.status == NFS4ERR_DELAY) {
 		struct timespec current;
-		nsecs_elapsed_t delay;
 
 		now(&current);
 		if (timespec_diff(&cb_data->first_recall, &current) >
 		    (nfs_param.nfsv4_param.lease_lifetime * NS_PER_SEC)) {
 			goto revoke;
 		}
-		if (cb_data->attempts < 5)
-			delay = 0;
-		else if (cb_data->attempts < 10)
-			delay = 1 * NS_PER_MSEC;
-		else if (cb_data->attempts < 20)
-			delay = 10 * NS_PER_MSEC;
-		else if (cb_data->attempts < 30)
-			delay = 100 * NS_PER_MSEC;
-		else
-			delay = 1 * NS_PER_SEC;
 
 		/* We don't free the argument here, because we'll be
 		   re-using that to make the queued call. */
 		nfs41_release_single(call);
-		delayed_submit(layoutrecall_one_call, cb_data, delay);
+		delayed_submit(layoutrecall_one_call, cb_data,
+			       layoutrecall_backoff(cb_data->attempts));
 		goto out;
 	}
 
@@ -767,28 +781,18 @@ static void layoutrecall_one_call(void *arg)
 		root_op_context.req_ctx.ctx_export = export;
 		root_op_context.req_ctx.fsal_export = export->fsal_export;
 
-		code = nfs_rpc_cb_single(cb_data->client, &cb_data->arg,
-					  &state->state_refer,
-					  layoutrec_completion,
-					  cb_data);
+		/* The recall waits in the client's callback queue for
+		 * up to a lease period for a back channel, and is
+		 * batched with other callbacks to the same client.
+		 */
+		code = nfs_rpc_cb_queue(cb_data->client, &cb_data->arg,
+					&state->state_refer,
+					layoutrec_completion,
+					cb_data);
 
 		if (code != 0) {
-			/**
-			 * @todo On failure to submit a callback, we
-			 * ought to give the client at least one lease
-			 * period to establish a back channel before
-			 * we start revoking state.  We don't have the
-			 * infrasturcture to properly handle layout
-			 * revocation, however.  Once we get the
-			 * capability to revoke layouts we should
-			 * queue requests on the clientid, obey the
-			 * retransmission rule, and provide a callback
-			 * to dispose of a call and revoke state after
-			 * some number of lease periods.
-			 *
-			 * At present we just assume the client has
-			 * gone completely out to lunch and fake a
-			 * return.
+			/* We just assume the client has gone completely
+			 * out to lunch and fake a return.
 			 */
 
 			/**
@@ -843,6 +847,232 @@ static void layoutrecall_one_call(void *arg)
 	}
 }
 
+/**
+ * @brief Data used to handle the response to a bulk CB_LAYOUTRECALL
+ */
+
+struct layoutrecall_fsid_cb_data {
+	nfs_cb_argop4 arg;	/*< So we don't free */
+	uint64_t recall_id;	/*< From state_layout_recall_begin */
+	nfs_client_id_t *client;	/*< The client we're calling, with a
+					   reference */
+	fsal_fsid_t fsid;	/*< Filesystem recalled */
+	bool all;		/*< Recall of all filesystems */
+	layouttype4 type;	/*< Type of layout recalled */
+	struct timespec first_recall;	/*< Time of first recall */
+	uint32_t attempts;	/*< Number of times we've recalled */
+};
+
+static void layoutrecall_fsid_one_call(void *arg);
+
+/**
+ * @brief Finish a bulk recall the client did not answer with a return
+ *
+ * The layouts the client still holds on the filesystem are returned
+ * for it.  Nothing is left to do if a LAYOUTRETURN already ended the
+ * recall.
+ *
+ * @param[in] cb_data      The recall, freed
+ * @param[in] circumstance Why the layouts are returned
+ */
+
+static void layoutrecall_fsid_finish(struct layoutrecall_fsid_cb_data *cb_data,
+				     enum fsal_layoutreturn_circumstance
+								circumstance)
+{
+	struct root_op_context root_op_context;
+
+	if (state_layout_recall_end(cb_data->recall_id)) {
+		/* Initialize req_ctx */
+		init_root_op_context(&root_op_context, NULL, NULL,
+				     0, 0, UNKNOWN_REQUEST);
+		root_op_context.req_ctx.clientid =
+			&cb_data->client->cid_clientid;
+
+		state_return_owner_layouts(&cb_data->client->cid_owner,
+					   cb_data->all ? NULL : &cb_data->fsid,
+					   cb_data->type, circumstance);
+
+		release_root_op_context();
+	}
+
+	dec_client_id_ref(cb_data->client);
+	gsh_free(cb_data);
+}
+
+/**
+ * @brief Revoke what a bulk recall left
+ *
+ * Queued in delayed_exec, on a send error so that we don't call
+ * into the FSAL's layoutreturn function while its layoutrecall
+ * function may be holding locks, and a lease period after the client
+ * acknowledged a recall it never followed with a return.
+ *
+ * @param[in] arg The recall
+ */
+
+static void layoutrecall_fsid_revoke(void *arg)
+{
+	layoutrecall_fsid_finish(arg, circumstance_revoke);
+}
+
+/**
+ * @brief Complete a bulk CB_LAYOUTRECALL
+ *
+ * An acknowledged recall waits for the client's LAYOUTRETURN.  For
+ * NOMATCHINGLAYOUT we act as if the client returned everything the
+ * recall asked for; DELAY is handled as for a recall of one file, and
+ * other errors revoke the layouts.
+ *
+ * @param[in] call The RPC call being completed
+ */
+
+static void layoutrec_fsid_completion(rpc_call_t *call)
+{
+	struct layoutrecall_fsid_cb_data *cb_data = call->call_arg;
+	nfsstat4 status = call->cbt.v_u.v4.res.status;
+	bool aborted = call->states & NFS_CB_CALL_ABORTED;
+	struct timespec current;
+
+	LogFullDebug(COMPONENT_NFS_CB, "status %d cb_data %p",
+		     status, cb_data);
+
+	/* There is nothing allocated in the argument */
+	nfs41_release_single(call);
+
+	if (aborted) {
+		layoutrecall_fsid_finish(cb_data, circumstance_revoke);
+	} else if (status == NFS4_OK) {
+		delayed_submit(layoutrecall_fsid_revoke, cb_data,
+			       nfs_param.nfsv4_param.lease_lifetime *
+			       NS_PER_SEC);
+	} else if (status == NFS4ERR_NOMATCHING_LAYOUT) {
+		layoutrecall_fsid_finish(cb_data, circumstance_client);
+	} else if (status == NFS4ERR_DELAY) {
+		now(&current);
+		if (timespec_diff(&cb_data->first_recall, &current) >
+		    (nfs_param.nfsv4_param.lease_lifetime * NS_PER_SEC)) {
+			layoutrecall_fsid_finish(cb_data, circumstance_revoke);
+			return;
+		}
+
+		delayed_submit(layoutrecall_fsid_one_call, cb_data,
+			       layoutrecall_backoff(cb_data->attempts));
+	} else {
+		layoutrecall_fsid_finish(cb_data, circumstance_revoke);
+	}
+}
+
+/**
+ * @brief Send one bulk layoutrecall to one client
+ *
+ * @param[in] arg Structure holding all arguments, so we can queue
+ *                this function in delayed_exec for retry on NFS4ERR_DELAY.
+ */
+
+static void layoutrecall_fsid_one_call(void *arg)
+{
+	struct layoutrecall_fsid_cb_data *cb_data = arg;
+	int code;
+
+	if (cb_data->attempts == 0)
+		now(&cb_data->first_recall);
+
+	/* Counted before queueing, as the completion may run at once */
+	++cb_data->attempts;
+
+	code = nfs_rpc_cb_queue(cb_data->client, &cb_data->arg, NULL,
+				layoutrec_fsid_completion, cb_data);
+
+	if (code != 0) {
+		/* We just assume the client has gone completely out
+		 * to lunch and fake a return.
+		 */
+		delayed_submit(layoutrecall_fsid_revoke, cb_data, 0);
+	}
+}
+
+/**
+ * @brief Recall the layouts on a filesystem, one callback per client
+ *
+ * The per-filesystem index of layout states gives the clients to call
+ * back.  A client that is already being recalled from is not called
+ * again.
+ *
+ * @param[in] vec          Up ops vector
+ * @param[in] layout_type  The type of layout to recall
+ * @param[in] changed      Whether the layout has changed and the
+ *                         client ought to finish writes through MDS
+ * @param[in] io_mode      Iomode of the layouts to recall
+ * @param[in] fsid         Filesystem, NULL for all of them
+ *
+ * @retval STATE_SUCCESS if scheduled.
+ * @retval STATE_NOT_FOUND if no matching layouts exist.
+ */
+
+static state_status_t layoutrecall_fsid(const struct fsal_up_vector *vec,
+					layouttype4 layout_type, bool changed,
+					layoutiomode4 io_mode,
+					const fsal_fsid_t *fsid)
+{
+	nfs_client_id_t **clients;
+	uint32_t count, i;
+
+	count = state_layout_clients(fsid, layout_type, &clients);
+
+	if (count == 0) {
+		gsh_free(clients);
+		return STATE_NOT_FOUND;
+	}
+
+	for (i = 0; i < count; i++) {
+		struct layoutrecall_fsid_cb_data *cb_data;
+		CB_LAYOUTRECALL4args *cb_layoutrec;
+		uint64_t id;
+
+		id = state_layout_recall_begin(clients[i], fsid, layout_type);
+
+		if (id == 0) {
+			/* Already recalled, the client has yet to return */
+			dec_client_id_ref(clients[i]);
+			continue;
+		}
+
+		cb_data = gsh_calloc(1, sizeof(*cb_data));
+
+		cb_data->arg.argop = NFS4_OP_CB_LAYOUTRECALL;
+		cb_layoutrec = &cb_data->arg.nfs_cb_argop4_u.opcblayoutrecall;
+
+		cb_layoutrec->clora_type = layout_type;
+		cb_layoutrec->clora_iomode = io_mode;
+		cb_layoutrec->clora_changed = changed;
+
+		if (fsid != NULL) {
+			cb_layoutrec->clora_recall.lor_recalltype =
+							LAYOUTRECALL4_FSID;
+			cb_layoutrec->clora_recall.layoutrecall4_u
+					.lor_fsid.major = fsid->major;
+			cb_layoutrec->clora_recall.layoutrecall4_u
+					.lor_fsid.minor = fsid->minor;
+			cb_data->fsid = *fsid;
+		} else {
+			cb_layoutrec->clora_recall.lor_recalltype =
+							LAYOUTRECALL4_ALL;
+			cb_data->all = true;
+		}
+
+		cb_data->recall_id = id;
+		cb_data->client = clients[i];
+		cb_data->type = layout_type;
+
+		layoutrecall_fsid_one_call(cb_data);
+	}
+
+	gsh_free(clients);
+
+	return STATE_SUCCESS;
+}
+
 /**
  * @brief Data for CB_NOTIFY and CB_NOTIFY_DEVICEID response handler
  */
@@ -962,6 +1192,303 @@ state_status_t notify_device(notify_deviceid_type4 notify_type,
 	return STATE_SUCCESS;
 }
 
+/**
+ * @brief Data for CB_NOTIFY of directory changes
+ */
+
+struct dir_notify_cb {
+	nfs_client_id_t *dnc_clid;	/*< Client holding the delegation */
+	stateid4 dnc_stateid;		/*< The delegation */
+	nfs_fh4 dnc_fh;			/*< The directory */
+	struct notify4 dnc_notify[2];	/*< Remove then add of a rename */
+};
+
+static void free_dir_notify_cb(struct dir_notify_cb *dnc)
+{
+	int i;
+
+	for (i = 0; i < 2; i++)
+		gsh_free(dnc->dnc_notify[i].notify_vals.notifylist4_val);
+	nfs4_freeFH(&dnc->dnc_fh);
+	dec_client_id_ref(dnc->dnc_clid);
+	gsh_free(dnc);
+}
+
+/**
+ * @brief Handle CB_NOTIFY response
+ *
+ * A client that could not be told of a change must not go on trusting
+ * its cache of the directory, so the delegation is recalled.
+ *
+ * @param[in] call  The RPC call being completed
+ */
+
+static void dir_notify_completion(rpc_call_t *call)
+{
+	struct dir_notify_cb *dnc = call->call_arg;
+	struct req_op_context *save_ctx = op_ctx, req_ctx = {0};
+	struct fsal_obj_handle *obj = NULL;
+	struct gsh_export *export = NULL;
+	struct state_t *state;
+
+	LogFullDebug(COMPONENT_NFS_CB, "status %d arg %p",
+		     call->cbt.v_u.v4.res.status, call->call_arg);
+
+	if (!(call->states & NFS_CB_CALL_ABORTED) &&
+	    call->call_req.cc_error.re_status == RPC_SUCCESS &&
+	    call->cbt.v_u.v4.res.status == NFS4_OK)
+		goto out;
+
+	state = nfs4_State_Get_Pointer(dnc->dnc_stateid.other);
+	if (state == NULL)
+		goto out;
+
+	op_ctx = &req_ctx;
+
+	if (get_state_obj_export_owner_refs(state, &obj, &export, NULL) &&
+	    obj != NULL) {
+		op_ctx->ctx_export = export;
+		op_ctx->fsal_export = export->fsal_export;
+
+		LogDebug(COMPONENT_NFS_CB,
+			 "CB_NOTIFY failed, recalling directory delegation");
+
+		PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
+		if (delegrecall_state(obj, state))
+			obj->state_hdl->dir.dir_last_recall = time(NULL);
+		PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
+
+		obj->obj_ops->put_ref(obj);
+		put_gsh_export(export);
+	}
+
+	dec_state_t_ref(state);
+	op_ctx = save_ctx;
+
+out:
+	if (dnc->dnc_clid->cid_minorversion != 0)
+		nfs41_release_single(call);
+	free_dir_notify_cb(dnc);
+}
+
+/**
+ * @brief Encode one change for CB_NOTIFY
+ *
+ * Entries carry neither attributes nor cookies: none were asked for
+ * when the delegation was granted.
+ *
+ * @param[out] notify   Change to fill
+ * @param[in]  type     Type of the change
+ * @param[in]  name     Entry added or removed, old name of a rename
+ * @param[in]  new_name New name of a rename
+ *
+ * @return true on success.
+ */
+
+static bool dir_notify_encode(struct notify4 *notify, notify_type4 type,
+			      const char *name, const char *new_name)
+{
+	notify_remove4 nrm = {
+		.nrm_old_entry.ne_file.utf8string_val = (char *)name,
+		.nrm_old_entry.ne_file.utf8string_len = strlen(name),
+	};
+	notify_add4 nad = {
+		.nad_new_entry.ne_file.utf8string_val = (char *)name,
+		.nad_new_entry.ne_file.utf8string_len = strlen(name),
+		.nad_last_entry = false,
+	};
+	notify_rename4 nrn;
+	u_int len;
+	XDR xdr;
+	bool ok;
+
+	if (type == NOTIFY4_RENAME_ENTRY) {
+		nrn.nrn_old_entry = nrm;
+		nrn.nrn_new_entry = nad;
+		nrn.nrn_new_entry.nad_new_entry.ne_file.utf8string_val =
+			(char *)new_name;
+		nrn.nrn_new_entry.nad_new_entry.ne_file.utf8string_len =
+			strlen(new_name);
+	}
+
+	/* Names with their lengths, empty fattr4s, arrays and flags */
+	len = 2 * BYTES_PER_XDR_UNIT + RNDUP(strlen(name)) +
+	      (new_name != NULL ? RNDUP(strlen(new_name)) : 0) +
+	      16 * BYTES_PER_XDR_UNIT;
+
+	notify->notify_mask.bitmap4_len = 1;
+	notify->notify_mask.map[0] = 1 << type;
+	notify->notify_vals.notifylist4_val = gsh_malloc(len);
+
+	xdrmem_create(&xdr, notify->notify_vals.notifylist4_val, len,
+		      XDR_ENCODE);
+
+	switch (type) {
+	case NOTIFY4_REMOVE_ENTRY:
+		ok = xdr_notify_remove4(&xdr, &nrm);
+		break;
+	case NOTIFY4_ADD_ENTRY:
+		ok = xdr_notify_add4(&xdr, &nad);
+		break;
+	case NOTIFY4_RENAME_ENTRY:
+		ok = xdr_notify_rename4(&xdr, &nrn);
+		break;
+	default:
+		ok = false;
+	}
+
+	notify->notify_vals.notifylist4_len = xdr_getpos(&xdr);
+	xdr_destroy(&xdr);
+
+	return ok;
+}
+
+/**
+ * @brief Send a CB_NOTIFY of a directory change to one delegation
+ *
+ * A rename is sent as a remove then an add when the delegation was
+ * not granted rename notifications.
+ *
+ * @note The state_lock MUST be held
+ *
+ * @param[in] dir      Directory that changed
+ * @param[in] state    Delegation on the directory
+ * @param[in] type     Type of the change
+ * @param[in] name     Entry added or removed, old name of a rename
+ * @param[in] new_name New name of a rename, else NULL
+ *
+ * @return 0 if the notification was queued, else -1.
+ */
+
+int dir_notify_send(struct fsal_obj_handle *dir, struct state_t *state,
+		    notify_type4 type, const char *name, const char *new_name)
+{
+	struct dir_notify_cb *dnc;
+	struct gsh_export *export;
+	state_owner_t *owner;
+	nfs_cb_argop4 argop;
+	CB_NOTIFY4args *args = &argop.nfs_cb_argop4_u.opcbnotify;
+	u_int changes = 1;
+	bool ok;
+
+	if (!get_state_obj_export_owner_refs(state, NULL, &export, &owner))
+		return -1;
+
+	dnc = gsh_calloc(1, sizeof(*dnc));
+	dnc->dnc_clid = owner->so_owner.so_nfs4_owner.so_clientrec;
+	inc_client_id_ref(dnc->dnc_clid);
+	dec_state_owner_ref(owner);
+	COPY_STATEID(&dnc->dnc_stateid, state);
+
+	ok = nfs4_FSALToFhandle(true, &dnc->dnc_fh, dir, export);
+	put_gsh_export(export);
+
+	if (ok && type == NOTIFY4_RENAME_ENTRY &&
+	    !(state->state_data.deleg.sd_notify &
+	      (1 << NOTIFY4_RENAME_ENTRY))) {
+		ok = dir_notify_encode(&dnc->dnc_notify[0],
+				       NOTIFY4_REMOVE_ENTRY, name, NULL) &&
+		     dir_notify_encode(&dnc->dnc_notify[1],
+				       NOTIFY4_ADD_ENTRY, new_name, NULL);
+		changes = 2;
+	} else if (ok) {
+		ok = dir_notify_encode(&dnc->dnc_notify[0], type, name,
+				       new_name);
+	}
+
+	if (!ok) {
+		LogDebug(COMPONENT_FSAL_UP, "Could not build CB_NOTIFY");
+		free_dir_notify_cb(dnc);
+		return -1;
+	}
+
+	argop.argop = NFS4_OP_CB_NOTIFY;
+	args->cna_stateid = dnc->dnc_stateid;
+	args->cna_fh = dnc->dnc_fh;
+	args->cna_changes.cna_changes_len = changes;
+	args->cna_changes.cna_changes_val = dnc->dnc_notify;
+
+	return nfs_rpc_cb_queue(dnc->dnc_clid, &argop, &state->state_refer,
+				dir_notify_completion, dnc);
+}
+
+/**
+ * @brief Data for CB_NOTIFY_LOCK
+ */
+
+struct notify_lock_cb {
+	nfs_client_id_t *nlc_clid;	/*< Client of the lock owner */
+	nfs_fh4 nlc_fh;			/*< The file */
+	char nlc_owner[];		/*< Copy of the owner name */
+};
+
+/**
+ * @brief Handle CB_NOTIFY_LOCK response
+ *
+ * Nothing to do either way, the clients still poll.
+ *
+ * @param[in] call  The RPC call being completed
+ */
+
+static void notify_lock_completion(rpc_call_t *call)
+{
+	struct notify_lock_cb *nlc = call->call_arg;
+
+	LogFullDebug(COMPONENT_NFS_CB, "status %d arg %p",
+		     call->cbt.v_u.v4.res.status, call->call_arg);
+
+	nfs41_release_single(call);
+	nfs4_freeFH(&nlc->nlc_fh);
+	dec_client_id_ref(nlc->nlc_clid);
+	gsh_free(nlc);
+}
+
+/**
+ * @brief Tell a lock owner that a lock it was denied may be free
+ *
+ * @param[in] obj    File
+ * @param[in] owner  NFSv4.1 lock owner
+ * @param[in] export Export the lock was asked on
+ *
+ * @return 0 if the notification was queued, else -1.
+ */
+
+int notify_lock_send(struct fsal_obj_handle *obj, state_owner_t *owner,
+		     struct gsh_export *export)
+{
+	nfs_client_id_t *clid = owner->so_owner.so_nfs4_owner.so_clientrec;
+	struct notify_lock_cb *nlc;
+	nfs_cb_argop4 argop;
+	CB_NOTIFY_LOCK4args *args = &argop.nfs_cb_argop4_u.opcbnotify_lock;
+
+	if (clid->cid_confirmed != CONFIRMED_CLIENT_ID ||
+	    get_cb_chan_down(clid))
+		return -1;
+
+	nlc = gsh_malloc(sizeof(*nlc) + owner->so_owner_len);
+
+	if (!nfs4_FSALToFhandle(true, &nlc->nlc_fh, obj, export)) {
+		gsh_free(nlc);
+		return -1;
+	}
+
+	nlc->nlc_clid = clid;
+	inc_client_id_ref(clid);
+	memcpy(nlc->nlc_owner, owner->so_owner_val, owner->so_owner_len);
+
+	argop.argop = NFS4_OP_CB_NOTIFY_LOCK;
+	args->cnla_fh = nlc->nlc_fh;
+	args->cnla_lock_owner.clientid = clid->cid_clientid;
+	args->cnla_lock_owner.owner.owner_len = owner->so_owner_len;
+	args->cnla_lock_owner.owner.owner_val = nlc->nlc_owner;
+
+	LogFullDebug(COMPONENT_NFS_CB, "CB_NOTIFY_LOCK for client %" PRIx64,
+		     clid->cid_clientid);
+
+	return nfs_rpc_cb_queue(clid, &argop, NULL, notify_lock_completion,
+				nlc);
+}
+
 /**
  * @brief Check if the delegation needs to be revoked.
  *
@@ -1278,11 +1805,11 @@ void delegrecall_one(struct fsal_obj_handle *obj,
 		goto out;
 	}
 
-	ret = nfs_rpc_cb_single(p_cargs->drc_clid, &argop, &state->state_refer,
-				delegrecall_completion_func, p_cargs);
+	ret = nfs_rpc_cb_queue(p_cargs->drc_clid, &argop, &state->state_refer,
+			       delegrecall_completion_func, p_cargs);
 	if (ret == 0)
 		return;
-	LogDebug(COMPONENT_FSAL_UP, "nfs_rpc_cb_single returned %d", ret);
+	LogDebug(COMPONENT_FSAL_UP, "nfs_rpc_cb_queue returned %d", ret);
 
 out:
 	inc_failed_recalls(p_cargs->drc_clid->gsh_client);
@@ -1486,93 +2013,127 @@ static int schedule_delegrevoke_check(struct delegrecall_context *ctx,
 	return rc;
 }
 
-state_status_t delegrecall_impl(struct fsal_obj_handle *obj)
+/**
+ * @brief Start the recall of one delegation
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in] obj   File or directory being delegated
+ * @param[in] state The delegation
+ *
+ * @return true if the delegation is now being recalled.
+ */
+bool delegrecall_state(struct fsal_obj_handle *obj, struct state_t *state)
 {
-	struct glist_head *glist, *glist_n;
-	state_status_t rc = 0;
-	uint32_t *deleg_state = NULL;
-	struct state_t *state;
+	uint32_t *deleg_state;
 	state_owner_t *owner;
 	struct delegrecall_context *drc_ctx;
 	struct req_op_context *save_ctx = op_ctx, req_ctx = {0};
 
-	LogDebug(COMPONENT_FSAL_UP,
-		 "FSAL_UP_DELEG: obj %p type %u",
-		 obj, obj->type);
+	if (isDebug(COMPONENT_NFS_CB)) {
+		char str[LOG_BUFF_LEN] = "\0";
+		struct display_buffer dspbuf = {sizeof(str), str, str};
 
-	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
-	glist_for_each_safe(glist, glist_n,
-			    &obj->state_hdl->file.list_of_states) {
-		state = glist_entry(glist, struct state_t, state_list);
+		display_stateid(&dspbuf, state);
+		LogDebug(COMPONENT_NFS_CB, "Delegation for %s", str);
+	}
 
-		if (state->state_type != STATE_TYPE_DELEG)
-			continue;
+	deleg_state = &state->state_data.deleg.sd_state;
+	if (*deleg_state != DELEG_GRANTED) {
+		LogDebug(COMPONENT_FSAL_UP,
+			 "Delegation already being recalled, NOOP");
+		return false;
+	}
+	*deleg_state = DELEG_RECALL_WIP;
 
-		if (isDebug(COMPONENT_NFS_CB)) {
-			char str[LOG_BUFF_LEN] = "\0";
-			struct display_buffer dspbuf = {sizeof(str), str, str};
+	drc_ctx = gsh_malloc(sizeof(struct delegrecall_context));
 
-			display_stateid(&dspbuf, state);
-			LogDebug(COMPONENT_NFS_CB, "Delegation for %s", str);
-		}
+	/* Get references on the owner and the the export. The
+	 * export reference we will hold while we perform the recall.
+	 * The owner reference will be used to get access to the
+	 * clientid and reserve the lease.
+	 */
+	if (!get_state_obj_export_owner_refs(state, NULL,
+					     &drc_ctx->drc_exp,
+					     &owner)) {
+		LogDebug(COMPONENT_FSAL_UP,
+			 "Something is going stale, no need to recall delegation");
+		gsh_free(drc_ctx);
+		return false;
+	}
 
-		deleg_state = &state->state_data.deleg.sd_state;
-		if (*deleg_state != DELEG_GRANTED) {
-			LogDebug(COMPONENT_FSAL_UP,
-				 "Delegation already being recalled, NOOP");
-			continue;
-		}
-		*deleg_state = DELEG_RECALL_WIP;
+	/* op_ctx may be used by state_del_locked and others */
+	op_ctx = &req_ctx;
+	op_ctx->ctx_export = drc_ctx->drc_exp;
+	op_ctx->fsal_export = drc_ctx->drc_exp->fsal_export;
+
+	drc_ctx->drc_clid = owner->so_owner.so_nfs4_owner.so_clientrec;
+	COPY_STATEID(&drc_ctx->drc_stateid, state);
+	inc_client_id_ref(drc_ctx->drc_clid);
+	dec_state_owner_ref(owner);
+
+	/* Prevent client's lease expiring until we complete
+	 * this recall/revoke operation. If the client's lease
+	 * has already expired, let the reaper thread handling
+	 * expired clients revoke this delegation, and we just
+	 * skip it here.  A courtesy client won't answer the recall
+	 * either, and is expired for it rather than brought back.
+	 */
+	PTHREAD_MUTEX_lock(&drc_ctx->drc_clid->cid_mutex);
+	if (expire_courtesy_lease(drc_ctx->drc_clid) ||
+	    !reserve_lease(drc_ctx->drc_clid)) {
+		PTHREAD_MUTEX_unlock(&drc_ctx->drc_clid->cid_mutex);
+		put_gsh_export(drc_ctx->drc_exp);
+		dec_client_id_ref(drc_ctx->drc_clid);
+		gsh_free(drc_ctx);
+		op_ctx = save_ctx;
+		return true;
+	}
+	PTHREAD_MUTEX_unlock(&drc_ctx->drc_clid->cid_mutex);
 
-		drc_ctx = gsh_malloc(sizeof(struct delegrecall_context));
+	delegrecall_one(obj, state, drc_ctx);
 
-		/* Get references on the owner and the the export. The
-		 * export reference we will hold while we perform the recall.
-		 * The owner reference will be used to get access to the
-		 * clientid and reserve the lease.
-		 */
-		if (!get_state_obj_export_owner_refs(state, NULL,
-						     &drc_ctx->drc_exp,
-						     &owner)) {
-			LogDebug(COMPONENT_FSAL_UP,
-				 "Something is going stale, no need to recall delegation");
-			gsh_free(drc_ctx);
-			continue;
-		}
+	op_ctx = save_ctx;
+	return true;
+}
+
+state_status_t delegrecall_impl(struct fsal_obj_handle *obj)
+{
+	struct glist_head *glist, *glist_n, *list;
+	state_status_t rc = 0;
+	struct state_t *state;
+	bool recalled = false;
 
-		/* op_ctx may be used by state_del_locked and others */
-		op_ctx = &req_ctx;
-		op_ctx->ctx_export = drc_ctx->drc_exp;
-		op_ctx->fsal_export = drc_ctx->drc_exp->fsal_export;
+	LogDebug(COMPONENT_FSAL_UP,
+		 "FSAL_UP_DELEG: obj %p type %u",
+		 obj, obj->type);
 
-		drc_ctx->drc_clid = owner->so_owner.so_nfs4_owner.so_clientrec;
-		COPY_STATEID(&drc_ctx->drc_stateid, state);
-		inc_client_id_ref(drc_ctx->drc_clid);
-		dec_state_owner_ref(owner);
+	if (obj->type == DIRECTORY)
+		list = &obj->state_hdl->dir.list_of_states;
+	else
+		list = &obj->state_hdl->file.list_of_states;
 
-		obj->state_hdl->file.fdeleg_stats.fds_last_recall = time(NULL);
+	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
+	glist_for_each_safe(glist, glist_n, list) {
+		state = glist_entry(glist, struct state_t, state_list);
 
-		/* Prevent client's lease expiring until we complete
-		 * this recall/revoke operation. If the client's lease
-		 * has already expired, let the reaper thread handling
-		 * expired clients revoke this delegation, and we just
-		 * skip it here.
-		 */
-		PTHREAD_MUTEX_lock(&drc_ctx->drc_clid->cid_mutex);
-		if (!reserve_lease(drc_ctx->drc_clid)) {
-			PTHREAD_MUTEX_unlock(&drc_ctx->drc_clid->cid_mutex);
-			put_gsh_export(drc_ctx->drc_exp);
-			dec_client_id_ref(drc_ctx->drc_clid);
-			gsh_free(drc_ctx);
+		if (state->state_type != STATE_TYPE_DELEG)
 			continue;
-		}
-		PTHREAD_MUTEX_unlock(&drc_ctx->drc_clid->cid_mutex);
 
-		delegrecall_one(obj, state, drc_ctx);
+		if (delegrecall_state(obj, state))
+			recalled = true;
 	}
+
+	/* Feed the delegation policy */
+	if (recalled && obj->type == DIRECTORY) {
+		obj->state_hdl->dir.dir_last_recall = time(NULL);
+	} else if (recalled) {
+		obj->state_hdl->file.fdeleg_stats.fds_last_recall = time(NULL);
+		deleg_heuristics_conflict(obj->state_hdl);
+	}
+
 	PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
 
-	op_ctx = save_ctx;
 	return rc;
 }
 
@@ -1662,6 +2223,7 @@ struct fsal_up_vector fsal_up_top = {
 	.invalidate = invalidate,
 	.update = update,
 	.layoutrecall = layoutrecall,
+	.layoutrecall_fsid = layoutrecall_fsid,
 	.notify_device = notify_device,
 	.delegrecall = delegrecall,
 	.invalidate_close = invalidate_close
@@ -46,6 +46,12 @@
 #include <netinet/tcp.h>
 #include <poll.h>
 #include <arpa/inet.h>		/* For inet_ntop() */
+#include <sched.h>
+#include <unistd.h>
+#include <sys/param.h>
+#ifdef LINUX
+#include <sys/epoll.h>
+#endif
 #include "hashtable.h"
 #include "log.h"
 #include "abstract_mem.h"
@@ -58,7 +64,12 @@
 #include "nfs_req_queue.h"
 #include "client_mgr.h"
 #include "server_stats.h"
+#include "gsh_iobuf.h"
 #include "9p.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#include "server_stats_private.h"
+#endif
 #include <stdbool.h>
 
 #define P_FAMILY AF_INET6
@@ -67,8 +78,15 @@ static struct fridgethr *worker_fridge;
 
 static struct nfs_req_st nfs_req_st;	/*< Shared request queues */
 
+/** Set on 9P/TCP event loop threads, which must never run a request
+ *  inline: it would hold up every connection of the loop. */
+static __thread bool _9p_tcp_in_loop;
+
 static const char *req_q_s[N_REQ_QUEUES] = {
 	"REQ_Q_LOW_LATENCY",
+	"REQ_Q_SMALL_IO",
+	"REQ_Q_BULK_IO",
+	"REQ_Q_CALLBACK",
 };
 
 /* static */
@@ -78,22 +96,66 @@ uint32_t _9p_outstanding_reqs_est(void)
 	static uint32_t nreqs;
 	struct req_q_pair *qpair;
 	uint32_t treqs;
+	uint32_t sx;
 	int ix;
 
 	if ((atomic_inc_uint32_t(&ctr) % 10) != 0)
 		return atomic_fetch_uint32_t(&nreqs);
 
 	treqs = 0;
-	for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
-		qpair = &(nfs_req_st.reqs.nfs_request_q.qset[ix]);
-		treqs += atomic_fetch_uint32_t(&qpair->producer.size);
-		treqs += atomic_fetch_uint32_t(&qpair->consumer.size);
+	for (sx = 0; sx < nfs_req_st.reqs.n_shards; ++sx) {
+		struct req_q_set *nfs_request_q =
+			&nfs_req_st.reqs.shard[sx].nfs_request_q;
+
+		for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+			qpair = &(nfs_request_q->qset[ix]);
+			treqs += atomic_fetch_uint32_t(&qpair->producer.size);
+			treqs += atomic_fetch_uint32_t(&qpair->consumer.size);
+		}
 	}
 
 	atomic_store_uint32_t(&nreqs, treqs);
 	return treqs;
 }
 
+/**
+ * @brief Pick the request queue shard local to the calling thread
+ *
+ * @return Index of the shard for the CPU we are running on.
+ */
+static inline uint32_t _9p_local_shard(void)
+{
+	int cpu;
+
+	if (nfs_req_st.reqs.n_shards == 1)
+		return 0;
+
+	cpu = sched_getcpu();
+	if (unlikely(cpu < 0))
+		return atomic_inc_uint32_t(&nfs_req_st.reqs.ctr) %
+			nfs_req_st.reqs.n_shards;
+
+	return (uint32_t) cpu % nfs_req_st.reqs.n_shards;
+}
+
+/**
+ * @brief Account for a request leaving a queue
+ *
+ * Called with the consumer lock held.
+ *
+ * @param[in] q       Consumer queue
+ * @param[in] reqdata Request being dequeued
+ */
+static inline void _9p_account_dequeue(struct req_q *q,
+				       request_data_t *reqdata)
+{
+	struct timespec ts;
+
+	now(&ts);
+	++(q->total);
+	q->wait_ns += timespec_diff(&reqdata->time_queued, &ts);
+}
+
 static inline request_data_t *_9p_consume_req(struct req_q_pair *qpair)
 {
 	request_data_t *reqdata = NULL;
@@ -105,6 +167,7 @@ static inline request_data_t *_9p_consume_req(struct req_q_pair *qpair)
 				      req_q);
 		glist_del(&reqdata->req_q);
 		--(qpair->consumer.size);
+		_9p_account_dequeue(&qpair->consumer, reqdata);
 		pthread_spin_unlock(&qpair->consumer.sp);
 		goto out;
 	} else {
@@ -131,6 +194,7 @@ static inline request_data_t *_9p_consume_req(struct req_q_pair *qpair)
 					      request_data_t, req_q);
 			glist_del(&reqdata->req_q);
 			--(qpair->consumer.size);
+			_9p_account_dequeue(&qpair->consumer, reqdata);
 			pthread_spin_unlock(&qpair->consumer.sp);
 			if (s)
 				LogFullDebug(COMPONENT_DISPATCH,
@@ -151,21 +215,36 @@ static inline request_data_t *_9p_consume_req(struct req_q_pair *qpair)
 	return reqdata;
 }
 
-static request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
+/**
+ * @brief Take a request from one shard
+ *
+ * @param[in] shard Shard to look at
+ *
+ * @return A request, or NULL if the shard is empty.
+ */
+static request_data_t *_9p_dequeue_shard(struct req_q_shard *shard)
 {
-	request_data_t *reqdata = NULL;
-	struct req_q_set *nfs_request_q = &nfs_req_st.reqs.nfs_request_q;
+	struct req_q_set *nfs_request_q = &shard->nfs_request_q;
 	struct req_q_pair *qpair;
-	uint32_t ix, slot;
-	struct timespec timeout;
+	struct req_q_sched *sched = &nfs_req_st.reqs.sched;
+	request_data_t *reqdata = NULL;
+	uint32_t ix, first;
 
-	/* XXX: the following stands in for a more robust/flexible
-	 * weighting function */
+	/* The weighted schedule picks the class to try first, then we
+	 * fall back to the other classes in priority order.
+	 */
+	first = sched->slot[atomic_inc_uint32_t(&nfs_req_st.reqs.ctr) %
+			    sched->len];
+	qpair = &(nfs_request_q->qset[first]);
+	reqdata = _9p_consume_req(qpair);
+	if (reqdata)
+		return reqdata;
 
- retry_deq:
-	slot = atomic_inc_uint32_t(&nfs_req_st.reqs.ctr) % N_REQ_QUEUES;
 	for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
-		qpair = &(nfs_request_q->qset[slot]);
+		if (ix == first)
+			continue;
+
+		qpair = &(nfs_request_q->qset[ix]);
 
 		LogFullDebug(COMPONENT_DISPATCH,
 			     "dequeue_req try qpair %s %p:%p", qpair->s,
@@ -173,14 +252,49 @@ static request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
 
 		/* anything? */
 		reqdata = _9p_consume_req(qpair);
-		if (reqdata) {
+		if (reqdata)
 			break;
-		}
+	}			/* for */
 
-		++slot;
-		slot = slot % N_REQ_QUEUES;
+	return reqdata;
+}
 
-	}			/* for */
+static request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
+{
+	request_data_t *reqdata = NULL;
+	struct req_q_shard *home;
+	uint32_t ix, local;
+	struct timespec timeout;
+
+	/* A worker parks on its home shard, so that sleepers are spread
+	 * across the shards and an enqueue only touches the local
+	 * wait list in the common case.  A worker pinned to a NUMA
+	 * node parks on the shard of the CPU it runs on, so that it
+	 * is woken for requests of its own node.
+	 */
+	if (nfs_param.core_param.numa_policy == NUMA_POLICY_LOCAL)
+		home = &nfs_req_st.reqs.shard[_9p_local_shard()];
+	else
+		home = &nfs_req_st.reqs.shard[worker->worker_index %
+					      nfs_req_st.reqs.n_shards];
+
+ retry_deq:
+	/* Dequeue-local first, then steal from the other shards */
+	local = _9p_local_shard();
+	for (ix = 0; ix < nfs_req_st.reqs.n_shards; ++ix) {
+		reqdata = _9p_dequeue_shard(
+			&nfs_req_st.reqs.shard[(local + ix) %
+					       nfs_req_st.reqs.n_shards]);
+		if (reqdata) {
+			if (ix != 0)
+				LogFullDebug(COMPONENT_DISPATCH,
+					     "worker %u stole req from shard %u",
+					     worker->worker_index,
+					     (local + ix) %
+						nfs_req_st.reqs.n_shards);
+			break;
+		}
+	}
 
 	/* wait */
 	if (!reqdata) {
@@ -193,10 +307,10 @@ static request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
 		wqe->flags = Wqe_LFlag_WaitSync;
 		wqe->waiters = 1;
 		/* XXX functionalize */
-		pthread_spin_lock(&nfs_req_st.reqs.sp);
-		glist_add_tail(&nfs_req_st.reqs.wait_list, &wqe->waitq);
-		++(nfs_req_st.reqs.waiters);
-		pthread_spin_unlock(&nfs_req_st.reqs.sp);
+		pthread_spin_lock(&home->sp);
+		glist_add_tail(&home->wait_list, &wqe->waitq);
+		++(home->waiters);
+		pthread_spin_unlock(&home->sp);
 		while (!(wqe->flags & Wqe_LFlag_SyncDone)) {
 			timeout.tv_sec = time(NULL) + 5;
 			timeout.tv_nsec = 0;
@@ -205,25 +319,25 @@ static request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
 			if (fridgethr_you_should_break(ctx)) {
 				/* We are returning;
 				 * so take us out of the waitq */
-				pthread_spin_lock(&nfs_req_st.reqs.sp);
+				pthread_spin_lock(&home->sp);
 				if (wqe->waitq.next != NULL
 				    || wqe->waitq.prev != NULL) {
 					/* Element is still in wqitq,
 					 * remove it */
 					glist_del(&wqe->waitq);
-					--(nfs_req_st.reqs.waiters);
+					--(home->waiters);
 					--(wqe->waiters);
 					wqe->flags &=
 					    ~(Wqe_LFlag_WaitSync |
 					      Wqe_LFlag_SyncDone);
 				}
-				pthread_spin_unlock(&nfs_req_st.reqs.sp);
+				pthread_spin_unlock(&home->sp);
 				PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
 				return NULL;
 			}
 		}
 
-		/* XXX wqe was removed from nfs_req_st.waitq
+		/* XXX wqe was removed from the shard waitq
 		 * (by signalling thread) */
 		wqe->flags &= ~(Wqe_LFlag_WaitSync | Wqe_LFlag_SyncDone);
 		PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
@@ -248,11 +362,107 @@ static request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
 	return reqdata;
 }
 
+/**
+ * @brief Wake one idle worker, preferring the given shard
+ *
+ * @param[in] local Shard the request was queued on
+ *
+ * @return true if a worker was woken.
+ */
+static bool _9p_wake_worker(uint32_t local)
+{
+	struct req_q_shard *shard;
+	wait_q_entry_t *wqe;
+	uint32_t ix;
+
+	for (ix = 0; ix < nfs_req_st.reqs.n_shards; ++ix) {
+		shard = &nfs_req_st.reqs.shard[(local + ix) %
+					       nfs_req_st.reqs.n_shards];
+
+		/* unlocked peek, the spinlock is only taken when there
+		 * is somebody to wake up
+		 */
+		if (!atomic_fetch_uint32_t(&shard->waiters))
+			continue;
+
+		/* SPIN LOCKED */
+		pthread_spin_lock(&shard->sp);
+		if (!shard->waiters) {
+			/* ! SPIN LOCKED */
+			pthread_spin_unlock(&shard->sp);
+			continue;
+		}
+
+		wqe = glist_first_entry(&shard->wait_list,
+					wait_q_entry_t, waitq);
+
+		LogFullDebug(COMPONENT_DISPATCH,
+			     "shard %u waiters %u signal wqe %p",
+			     (local + ix) % nfs_req_st.reqs.n_shards,
+			     shard->waiters, wqe);
+
+		/* release 1 waiter */
+		glist_del(&wqe->waitq);
+		--(shard->waiters);
+		--(wqe->waiters);
+		/* ! SPIN LOCKED */
+		pthread_spin_unlock(&shard->sp);
+		PTHREAD_MUTEX_lock(&wqe->lwe.mtx);
+		/* XXX reliable handoff */
+		wqe->flags |= Wqe_LFlag_SyncDone;
+		if (wqe->flags & Wqe_LFlag_WaitSync)
+			pthread_cond_signal(&wqe->lwe.cv);
+		PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Choose the queue class for a 9P request
+ *
+ * Reads and writes are split on their byte count, everything else is
+ * metadata and goes to the low latency class.  So does a message too
+ * short to hold the fields read here, the interpreter rejects it.
+ *
+ * @param[in] req9p 9P request
+ *
+ * @return The queue class.
+ */
+static enum req_q_e _9p_classify_req(struct _9p_request_data *req9p)
+{
+	/* size[4], counting itself */
+	u32 msglen = *(u32 *) req9p->_9pmsg;
+	char *msgdata = req9p->_9pmsg + _9P_HDR_SIZE;
+	/* type[1] tag[2] fid[4] offset[8] count[4] */
+	u32 count_off = _9P_TYPE_SIZE + _9P_TAG_SIZE + sizeof(u32) +
+			sizeof(u64);
+	u32 count;
+
+	if (msglen < _9P_HDR_SIZE + _9P_TYPE_SIZE)
+		return REQ_Q_LOW_LATENCY;
+
+	switch (*(u8 *) msgdata) {
+	case _9P_TREAD:
+	case _9P_TWRITE:
+		if (msglen < _9P_HDR_SIZE + count_off + sizeof(u32))
+			return REQ_Q_LOW_LATENCY;
+		count = *(u32 *) (msgdata + count_off);
+		if (count >= nfs_param.core_param.req_queue.bulk_size)
+			return REQ_Q_BULK_IO;
+		return REQ_Q_SMALL_IO;
+	default:
+		return REQ_Q_LOW_LATENCY;
+	}
+}
+
 static void nfs_rpc_enqueue_req(request_data_t *reqdata)
 {
 	struct req_q_set *nfs_request_q;
 	struct req_q_pair *qpair;
 	struct req_q *q;
+	uint32_t local;
 
 #if defined(HAVE_BLKIN)
 	BLKIN_TIMESTAMP(
@@ -261,13 +471,14 @@ static void nfs_rpc_enqueue_req(request_data_t *reqdata)
 		"enqueue-enter");
 #endif
 
-	nfs_request_q = &nfs_req_st.reqs.nfs_request_q;
+	/* enqueue-local */
+	local = _9p_local_shard();
+	nfs_request_q = &nfs_req_st.reqs.shard[local].nfs_request_q;
 
 	switch (reqdata->rtype) {
 	case _9P_REQUEST:
-		/* XXX identify high-latency requests and allocate
-		 * to the high-latency queue, as above */
-		qpair = &(nfs_request_q->qset[REQ_Q_LOW_LATENCY]);
+		qpair = &(nfs_request_q->qset[
+				_9p_classify_req(&reqdata->r_u._9p)]);
 		break;
 	case NFS_REQUEST:
 	case NFS_CALL:
@@ -283,6 +494,7 @@ static void nfs_rpc_enqueue_req(request_data_t *reqdata)
 	pthread_spin_lock(&q->sp);
 	glist_add_tail(&q->q, &reqdata->req_q);
 	++(q->size);
+	++(q->total);
 	pthread_spin_unlock(&q->sp);
 
 #if defined(HAVE_BLKIN)
@@ -300,43 +512,14 @@ static void nfs_rpc_enqueue_req(request_data_t *reqdata)
 		"enqueue-exit");
 #endif
 	LogDebug(COMPONENT_DISPATCH,
-		 "enqueued req, q %p (%s %p:%p) size is %d (enq %"
+		 "enqueued req, shard %u q %p (%s %p:%p) size is %d (enq %"
 		 PRIu64 " deq %" PRIu64 ")",
-		 q, qpair->s, &qpair->producer, &qpair->consumer, q->size,
+		 local, q, qpair->s, &qpair->producer, &qpair->consumer,
+		 q->size,
 		 nfs_health_.enqueued_reqs, nfs_health_.dequeued_reqs);
 
 	/* potentially wakeup some thread */
-
-	/* global waitq */
-	{
-		wait_q_entry_t *wqe;
-
-		/* SPIN LOCKED */
-		pthread_spin_lock(&nfs_req_st.reqs.sp);
-		if (nfs_req_st.reqs.waiters) {
-			wqe = glist_first_entry(&nfs_req_st.reqs.wait_list,
-						wait_q_entry_t, waitq);
-
-			LogFullDebug(COMPONENT_DISPATCH,
-				     "nfs_req_st.reqs.waiters %u signal wqe %p (for q %p)",
-				     nfs_req_st.reqs.waiters, wqe, q);
-
-			/* release 1 waiter */
-			glist_del(&wqe->waitq);
-			--(nfs_req_st.reqs.waiters);
-			--(wqe->waiters);
-			/* ! SPIN LOCKED */
-			pthread_spin_unlock(&nfs_req_st.reqs.sp);
-			PTHREAD_MUTEX_lock(&wqe->lwe.mtx);
-			/* XXX reliable handoff */
-			wqe->flags |= Wqe_LFlag_SyncDone;
-			if (wqe->flags & Wqe_LFlag_WaitSync)
-				pthread_cond_signal(&wqe->lwe.cv);
-			PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
-		} else
-			/* ! SPIN LOCKED */
-			pthread_spin_unlock(&nfs_req_st.reqs.sp);
-	}
+	(void) _9p_wake_worker(local);
 
  out:
 	return;
@@ -379,12 +562,63 @@ static void _9p_execute(request_data_t *reqdata)
 static void _9p_free_reqdata(struct _9p_request_data *req9p)
 {
 	if (req9p->pconn->trans_type == _9P_TCP)
-		gsh_free(req9p->_9pmsg);
+		iobuf_free(req9p->_9pmsg);
 
 	/* decrease connection refcount */
 	(void) atomic_dec_uint32_t(&req9p->pconn->refcount);
 }
 
+/**
+ * @brief Run a 9p request and release it
+ *
+ * @param[in] reqdata 9p request
+ */
+static void _9p_run_req(request_data_t *reqdata)
+{
+	_9p_execute(reqdata);
+	_9p_free_reqdata(&reqdata->r_u._9p);
+
+	/* Free the req by releasing the entry */
+	LogFullDebug(COMPONENT_DISPATCH,
+		     "Invalidating processed entry");
+
+	pool_free(nfs_request_pool, reqdata);
+	(void) atomic_inc_uint64_t(&nfs_health_.dequeued_reqs);
+}
+
+/**
+ * @brief Decide whether to run a request on the thread that read it
+ *
+ * Running it there saves handing it to a worker and back, which is
+ * most of the latency of a small request.  It only pays when the
+ * workers are keeping up, and when the request won't hold up the
+ * connection: large transfers and TFLUSH, which waits for other
+ * requests, are always queued.
+ *
+ * @param[in] reqdata 9p request
+ *
+ * @return true if the request should be run inline.
+ */
+static bool _9p_run_inline(request_data_t *reqdata)
+{
+	struct _9p_request_data *req9p = &reqdata->r_u._9p;
+	uint32_t depth;
+
+	if (req9p->pconn->trans_type == _9P_TCP)
+		depth = _9p_param._9p_tcp_inline_depth;
+	else
+		depth = _9p_param._9p_rdma_inline_depth;
+
+	if (depth == 0 || _9p_tcp_in_loop)
+		return false;
+
+	if (*(u8 *) (req9p->_9pmsg + _9P_HDR_SIZE) == _9P_TFLUSH ||
+	    _9p_classify_req(req9p) == REQ_Q_BULK_IO)
+		return false;
+
+	return _9p_outstanding_reqs_est() <= depth;
+}
+
 static uint32_t worker_indexer;
 
 /**
@@ -442,8 +676,7 @@ static void worker_run(struct fridgethr_context *ctx)
 
 		switch (reqdata->rtype) {
 		case _9P_REQUEST:
-			_9p_execute(reqdata);
-			_9p_free_reqdata(&reqdata->r_u._9p);
+			_9p_run_req(reqdata);
 			break;
 
 		case UNKNOWN_REQUEST:
@@ -452,42 +685,291 @@ static void worker_run(struct fridgethr_context *ctx)
 		default:
 			LogCrit(COMPONENT_DISPATCH,
 				"Unexpected unknown request");
+			pool_free(nfs_request_pool, reqdata);
+			(void) atomic_inc_uint64_t(
+					&nfs_health_.dequeued_reqs);
 			break;
 		}
+	}
+}
 
-		/* Free the req by releasing the entry */
-		LogFullDebug(COMPONENT_DISPATCH,
-			     "Invalidating processed entry");
+/*
+ * Adaptive sizing of the worker pool, see Worker_Adaptive.
+ *
+ * Each interval the controller looks at how long the requests dequeued
+ * since its last look waited on average and at how many workers are
+ * parked.  Waits above grow_wait, or no parked worker while requests
+ * are queued, grow the pool by a quarter.  Over half the workers
+ * parked with short waits for WORKER_ADAPT_CALM intervals in a row
+ * shrinks it by an eighth.  The parameters start from the
+ * configuration and can be changed over DBus.
+ */
+#define WORKER_ADAPT_CALM 3
+
+static struct {
+	pthread_mutex_t mtx;	/*< Protects the whole structure */
+	bool enable;		/*< Whether the pool is resized */
+	uint32_t min;		/*< Fewest workers */
+	uint32_t max;		/*< Most workers */
+	uint32_t grow_wait;	/*< Average wait, microseconds, to grow */
+	uint32_t interval;	/*< Seconds between two looks */
+	uint32_t target;	/*< Workers asked of the fridge */
+	uint32_t calm;		/*< Consecutive intervals of idleness */
+	uint64_t dequeued;	/*< Requests dequeued at the last look */
+	uint64_t wait_ns;	/*< Their total wait */
+	uint64_t avg_wait_ns;	/*< Average wait over the last interval */
+	uint32_t busy;		/*< Workers not parked at the last look */
+	uint64_t grows;		/*< Decisions to grow */
+	uint64_t shrinks;	/*< Decisions to shrink */
+} worker_adapt = { .mtx = PTHREAD_MUTEX_INITIALIZER };
+
+static struct fridgethr *worker_adapt_fridge;
+
+/**
+ * @brief Sum the request queues up
+ *
+ * @param[out] dequeued Requests ever dequeued
+ * @param[out] wait_ns  Their total wait
+ * @param[out] depth    Requests queued now
+ * @param[out] parked   Workers parked now
+ */
+static void _9p_queue_totals(uint64_t *dequeued, uint64_t *wait_ns,
+			     uint32_t *depth, uint32_t *parked)
+{
+	struct req_q_shard *shard;
+	struct req_q_pair *qpair;
+	uint32_t sx;
+	int ix;
+
+	*dequeued = *wait_ns = 0;
+	*depth = *parked = 0;
+	for (sx = 0; sx < nfs_req_st.reqs.n_shards; ++sx) {
+		shard = &nfs_req_st.reqs.shard[sx];
+		*parked += atomic_fetch_uint32_t(&shard->waiters);
+		for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+			qpair = &shard->nfs_request_q.qset[ix];
+			*depth += atomic_fetch_uint32_t(&qpair->producer.size);
+			*depth += atomic_fetch_uint32_t(&qpair->consumer.size);
+			*dequeued +=
+			    atomic_fetch_uint64_t(&qpair->consumer.total);
+			*wait_ns +=
+			    atomic_fetch_uint64_t(&qpair->consumer.wait_ns);
+		}
+	}
+}
+
+/**
+ * @brief Bring the worker pool to a new size
+ *
+ * Extra workers exit once done with their request, or when they wake
+ * up parked.
+ *
+ * @param[in] target Workers wanted
+ */
+static void _9p_worker_resize(uint32_t target)
+{
+	int rc;
+
+	fridgethr_set_max(worker_fridge, target);
+
+	while (fridgethr_nthreads(worker_fridge) < target) {
+		rc = fridgethr_submit(worker_fridge, worker_run, NULL);
+		if (rc != 0) {
+			LogMajor(COMPONENT_DISPATCH,
+				 "Unable to start a worker: %d", rc);
+			return;
+		}
+	}
+
+	nfs_rpc_queue_awaken(&nfs_req_st);
+}
+
+/**
+ * @brief Look at the load and resize the worker pool
+ *
+ * @param[in] ctx Fridge thread context
+ */
+static void worker_adapt_run(struct fridgethr_context *ctx)
+{
+	uint64_t dequeued, wait_ns, avg_ns, grow_ns;
+	uint32_t depth, parked, nthreads, from, target;
+
+	SetNameFunction("9p_adapt");
+
+	_9p_queue_totals(&dequeued, &wait_ns, &depth, &parked);
+	nthreads = fridgethr_nthreads(worker_fridge);
+
+	PTHREAD_MUTEX_lock(&worker_adapt.mtx);
+
+	avg_ns = dequeued > worker_adapt.dequeued
+		? (wait_ns - worker_adapt.wait_ns) /
+		  (dequeued - worker_adapt.dequeued)
+		: 0;
+	worker_adapt.dequeued = dequeued;
+	worker_adapt.wait_ns = wait_ns;
+	worker_adapt.avg_wait_ns = avg_ns;
+	worker_adapt.busy = nthreads > parked ? nthreads - parked : 0;
+	fridgethr_setwait(ctx, worker_adapt.interval);
+
+	from = target = worker_adapt.target;
+	if (!worker_adapt.enable) {
+		PTHREAD_MUTEX_unlock(&worker_adapt.mtx);
+		return;
+	}
+
+	grow_ns = (uint64_t) worker_adapt.grow_wait * NS_PER_USEC;
+	if (avg_ns > grow_ns || (parked == 0 && depth > 0)) {
+		worker_adapt.calm = 0;
+		target = from + MAX(1, from / 4);
+	} else if (avg_ns < grow_ns / 4 && parked * 2 > nthreads) {
+		if (++worker_adapt.calm >= WORKER_ADAPT_CALM) {
+			worker_adapt.calm = 0;
+			target = from - MAX(1, from / 8);
+		}
+	} else {
+		worker_adapt.calm = 0;
+	}
+
+	/* The bounds may have been changed over DBus */
+	target = MIN(MAX(target, worker_adapt.min), worker_adapt.max);
+	if (target > from)
+		worker_adapt.grows++;
+	else if (target < from)
+		worker_adapt.shrinks++;
+	worker_adapt.target = target;
+
+	PTHREAD_MUTEX_unlock(&worker_adapt.mtx);
+
+	if (target == from)
+		return;
+
+	LogDebug(COMPONENT_DISPATCH,
+		 "Workers %" PRIu32 " -> %" PRIu32 ", average wait %" PRIu64
+		 " ns, %" PRIu32 " parked, %" PRIu32 " queued",
+		 from, target, avg_ns, parked, depth);
 
-		pool_free(nfs_request_pool, reqdata);
-		(void) atomic_inc_uint64_t(&nfs_health_.dequeued_reqs);
+	_9p_worker_resize(target);
+}
+
+/**
+ * @brief Change the adaptive worker pool's parameters
+ *
+ * @param[in]  enable    Whether the pool is resized
+ * @param[in]  min       Fewest workers
+ * @param[in]  max       Most workers
+ * @param[in]  grow_wait Average wait, microseconds, to grow
+ * @param[in]  interval  Seconds between two looks
+ * @param[out] errormsg  Why the parameters were refused
+ *
+ * @return true if they were taken.
+ */
+bool _9p_worker_adapt_set(bool enable, uint32_t min, uint32_t max,
+			  uint32_t grow_wait, uint32_t interval,
+			  char **errormsg)
+{
+	if (min == 0 || min > max) {
+		*errormsg = "Need 0 < min <= max";
+		return false;
+	}
+	if (grow_wait == 0) {
+		*errormsg = "Grow wait must not be 0";
+		return false;
 	}
+	if (interval == 0 || interval > 60) {
+		*errormsg = "Interval must be 1 to 60 seconds";
+		return false;
+	}
+
+	PTHREAD_MUTEX_lock(&worker_adapt.mtx);
+	worker_adapt.enable = enable;
+	worker_adapt.min = min;
+	worker_adapt.max = max;
+	worker_adapt.grow_wait = grow_wait;
+	worker_adapt.interval = interval;
+	worker_adapt.calm = 0;
+	PTHREAD_MUTEX_unlock(&worker_adapt.mtx);
+
+	/* Bounds are applied at the next look */
+	if (worker_adapt_fridge != NULL)
+		fridgethr_wake(worker_adapt_fridge);
+
+	LogEvent(COMPONENT_DISPATCH,
+		 "Adaptive workers %s, %" PRIu32 " to %" PRIu32
+		 ", grow above %" PRIu32 " us, every %" PRIu32 " s",
+		 enable ? "enabled" : "disabled", min, max, grow_wait,
+		 interval);
+	return true;
 }
 
 int _9p_worker_init(void)
 {
 	struct fridgethr_params frp;
+	struct req_q_shard *shard;
 	struct req_q_pair *qpair;
+	uint32_t weights[N_REQ_QUEUES] = {
+		[REQ_Q_LOW_LATENCY] =
+			nfs_param.core_param.req_queue.weight_latency,
+		[REQ_Q_SMALL_IO] =
+			nfs_param.core_param.req_queue.weight_small_io,
+		[REQ_Q_BULK_IO] =
+			nfs_param.core_param.req_queue.weight_bulk_io,
+		[REQ_Q_CALLBACK] =
+			nfs_param.core_param.req_queue.weight_callback,
+	};
+	struct nfs_core_param *core = &nfs_param.core_param;
+	uint32_t nb_worker = core->nb_worker;
+	uint32_t n_shards;
+	uint32_t sx;
 	int ix;
 	int rc = 0;
 
+	worker_adapt.enable = core->worker_adapt.enable;
+	worker_adapt.min = core->worker_adapt.min;
+	worker_adapt.max = MAX(core->worker_adapt.max, worker_adapt.min);
+	worker_adapt.grow_wait = core->worker_adapt.grow_wait;
+	worker_adapt.interval = core->worker_adapt.interval;
+	if (worker_adapt.enable)
+		nb_worker = MIN(MAX(nb_worker, worker_adapt.min),
+				worker_adapt.max);
+	worker_adapt.target = nb_worker;
+
 	/* Init request queue before workers */
-	pthread_spin_init(&nfs_req_st.reqs.sp, PTHREAD_PROCESS_PRIVATE);
+	n_shards = nfs_param.core_param.req_queue_shards;
+	if (n_shards == 0) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+		n_shards = ncpu > 0 ? (uint32_t) ncpu : 1;
+	}
+	/* no point having shards nobody sleeps on */
+	if (n_shards > nb_worker)
+		n_shards = nb_worker;
+
+	nfs_req_st.reqs.n_shards = n_shards;
+	nfs_req_st.reqs.shard = gsh_calloc(n_shards, sizeof(*shard));
 	nfs_req_st.reqs.size = 0;
-	for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
-		qpair = &(nfs_req_st.reqs.nfs_request_q.qset[ix]);
-		qpair->s = req_q_s[ix];
-		nfs_rpc_q_init(&qpair->producer);
-		nfs_rpc_q_init(&qpair->consumer);
+	nfs_rpc_q_sched_init(&nfs_req_st.reqs.sched, weights);
+
+	for (sx = 0; sx < n_shards; ++sx) {
+		shard = &nfs_req_st.reqs.shard[sx];
+		for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+			qpair = &(shard->nfs_request_q.qset[ix]);
+			qpair->s = req_q_s[ix];
+			nfs_rpc_q_init(&qpair->producer);
+			nfs_rpc_q_init(&qpair->consumer);
+		}
+
+		/* waitq */
+		pthread_spin_init(&shard->sp, PTHREAD_PROCESS_PRIVATE);
+		glist_init(&shard->wait_list);
+		shard->waiters = 0;
 	}
 
-	/* waitq */
-	glist_init(&nfs_req_st.reqs.wait_list);
-	nfs_req_st.reqs.waiters = 0;
+	LogInfo(COMPONENT_DISPATCH,
+		"9P request queues use %u shard(s)", n_shards);
 
 	memset(&frp, 0, sizeof(struct fridgethr_params));
-	frp.thr_max = nfs_param.core_param.nb_worker;
-	frp.thr_min = nfs_param.core_param.nb_worker;
+	frp.thr_max = nb_worker;
+	frp.thr_min = nb_worker;
 	frp.flavor = fridgethr_flavor_looper;
 	frp.thread_initialize = worker_thread_initializer;
 	frp.thread_finalize = worker_thread_finalizer;
@@ -506,6 +988,30 @@ int _9p_worker_init(void)
 	if (rc != 0) {
 		LogMajor(COMPONENT_DISPATCH,
 			 "Unable to populate worker fridge: %d", rc);
+		return rc;
+	}
+
+	/* The controller runs even while disabled, for the stats and so
+	 * that it can be enabled over DBus.
+	 */
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = worker_adapt.interval;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&worker_adapt_fridge, "9P_adapt", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_DISPATCH,
+			 "Unable to initialize worker controller fridge: %d",
+			 rc);
+		return rc;
+	}
+
+	rc = fridgethr_submit(worker_adapt_fridge, worker_adapt_run, NULL);
+	if (rc != 0) {
+		LogMajor(COMPONENT_DISPATCH,
+			 "Unable to start worker controller: %d", rc);
 	}
 
 	return rc;
@@ -513,9 +1019,23 @@ int _9p_worker_init(void)
 
 int _9p_worker_shutdown(void)
 {
-	int rc = fridgethr_sync_command(worker_fridge,
-					fridgethr_comm_stop,
-					120);
+	int rc;
+
+	/* Stop resizing before stopping the workers */
+	if (worker_adapt_fridge != NULL) {
+		rc = fridgethr_sync_command(worker_adapt_fridge,
+					    fridgethr_comm_stop, 120);
+		if (rc != 0) {
+			LogMajor(COMPONENT_DISPATCH,
+				 "Failed shutting down worker controller: %d",
+				 rc);
+			fridgethr_cancel(worker_adapt_fridge);
+		}
+	}
+
+	rc = fridgethr_sync_command(worker_fridge,
+				    fridgethr_comm_stop,
+				    120);
 
 	if (rc == ETIMEDOUT) {
 		LogMajor(COMPONENT_DISPATCH,
@@ -528,6 +1048,129 @@ int _9p_worker_shutdown(void)
 	return rc;
 }
 
+#ifdef USE_DBUS
+/**
+ * @brief Report per class queue depth and wait time
+ *
+ * @param[in,out] iter Reply iterator
+ */
+void _9p_dbus_req_queues(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter, struct_iter;
+	struct req_q_pair *qpair;
+	struct timespec timestamp;
+	uint64_t enq, deq, wait_ns, avg_ns;
+	uint32_t depth;
+	uint32_t sx;
+	int ix;
+	char *name;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 REQ_QUEUES_REPLY_ARRAY_TYPE,
+					 &array_iter);
+	for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+		depth = 0;
+		enq = deq = wait_ns = 0;
+		for (sx = 0; sx < nfs_req_st.reqs.n_shards; ++sx) {
+			qpair = &nfs_req_st.reqs.shard[sx]
+					.nfs_request_q.qset[ix];
+			depth += atomic_fetch_uint32_t(&qpair->producer.size);
+			depth += atomic_fetch_uint32_t(&qpair->consumer.size);
+			enq += atomic_fetch_uint64_t(&qpair->producer.total);
+			deq += atomic_fetch_uint64_t(&qpair->consumer.total);
+			wait_ns +=
+			    atomic_fetch_uint64_t(&qpair->consumer.wait_ns);
+		}
+		avg_ns = deq ? wait_ns / deq : 0;
+		name = (char *) req_q_s[ix];
+
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_STRING, &name);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT32, &depth);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &enq);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &deq);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &avg_ns);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+
+/**
+ * @brief Report the adaptive worker pool
+ *
+ * struct worker_pool {
+ *	bool enable;
+ *	uint32_t min, max;
+ *	uint32_t grow_wait;	(microseconds)
+ *	uint32_t interval;	(seconds)
+ *	uint32_t target;	(workers asked for)
+ *	uint32_t threads;	(workers running)
+ *	uint32_t busy;		(workers not parked at the last look)
+ *	uint64_t avg_wait_ns;	(over the last interval)
+ *	uint64_t grows, shrinks;
+ * }
+ *
+ * @param[in,out] iter Reply iterator
+ */
+void _9p_dbus_worker_pool(DBusMessageIter *iter)
+{
+	DBusMessageIter struct_iter;
+	struct timespec timestamp;
+	dbus_bool_t enable;
+	uint32_t min, max, grow_wait, interval, target, threads, busy;
+	uint64_t avg_wait_ns, grows, shrinks;
+
+	threads = fridgethr_nthreads(worker_fridge);
+
+	PTHREAD_MUTEX_lock(&worker_adapt.mtx);
+	enable = worker_adapt.enable;
+	min = worker_adapt.min;
+	max = worker_adapt.max;
+	grow_wait = worker_adapt.grow_wait;
+	interval = worker_adapt.interval;
+	target = worker_adapt.target;
+	busy = worker_adapt.busy;
+	avg_wait_ns = worker_adapt.avg_wait_ns;
+	grows = worker_adapt.grows;
+	shrinks = worker_adapt.shrinks;
+	PTHREAD_MUTEX_unlock(&worker_adapt.mtx);
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_BOOLEAN,
+				       &enable);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32, &min);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32, &max);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &grow_wait);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &interval);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &target);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &threads);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32, &busy);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &avg_wait_ns);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &grows);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &shrinks);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+#endif
+
 void DispatchWork9P(request_data_t *req)
 {
 	switch (req->rtype) {
@@ -560,15 +1203,162 @@ void DispatchWork9P(request_data_t *req)
 	/* increase connection refcount */
 	(void) atomic_inc_uint32_t(&req->r_u._9p.pconn->refcount);
 
+	if (_9p_run_inline(req)) {
+		LogFullDebug(COMPONENT_DISPATCH,
+			     "Running 9P request %p inline", req);
+		_9p_run_req(req);
+		return;
+	}
+
 	/* new-style dispatch */
 	nfs_rpc_enqueue_req(req);
 }
 
+/**
+ * @brief Set up a new 9P/TCP connection
+ *
+ * @param[out] pconn     The connection
+ * @param[in]  tcp_sock  Its socket
+ * @param[out] strcaller Printable peer address, INET6_ADDRSTRLEN long
+ *
+ * @return 0 on success, -1 if the peer is unknown.
+ */
+
+static int _9p_tcp_conn_init(struct _9p_conn *pconn, long int tcp_sock,
+			     char *strcaller)
+{
+	socklen_t addrpeerlen;
+	unsigned int i;
+	int rc;
+
+	/* Init the struct _9p_conn structure */
+	memset(pconn, 0, sizeof(*pconn));
+	PTHREAD_MUTEX_init(&pconn->sock_lock, NULL);
+	_9p_fid_table_init(pconn);
+	pconn->trans_type = _9P_TCP;
+	pconn->trans_data.sockfd = tcp_sock;
+	for (i = 0; i < FLUSH_BUCKETS; i++) {
+		PTHREAD_MUTEX_init(&pconn->flush_buckets[i].lock, NULL);
+		glist_init(&pconn->flush_buckets[i].list);
+	}
+	atomic_store_uint32_t(&pconn->refcount, 0);
+
+	/* Set initial msize.
+	 * Client may request a lower value during TVERSION */
+	pconn->msize = _9p_param._9p_tcp_msize;
+
+	if (gettimeofday(&pconn->birth, NULL) == -1)
+		LogFatal(COMPONENT_9P, "Cannot get connection's time of birth");
+
+	addrpeerlen = sizeof(pconn->addrpeer);
+	rc = getpeername(tcp_sock, (struct sockaddr *)&pconn->addrpeer,
+			 &addrpeerlen);
+	if (rc == -1) {
+		LogMajor(COMPONENT_9P,
+			 "Cannot get peername to tcp socket for 9p, error %d (%s)",
+			 errno, strerror(errno));
+		strlcpy(strcaller, "(unresolved)", INET6_ADDRSTRLEN);
+		return -1;
+	}
+
+	switch (pconn->addrpeer.ss_family) {
+	case AF_INET:
+		inet_ntop(pconn->addrpeer.ss_family,
+			  &((struct sockaddr_in *)&pconn->addrpeer)->sin_addr,
+			  strcaller, INET6_ADDRSTRLEN);
+		break;
+	case AF_INET6:
+		inet_ntop(pconn->addrpeer.ss_family,
+			  &((struct sockaddr_in6 *)&pconn->addrpeer)->sin6_addr,
+			  strcaller, INET6_ADDRSTRLEN);
+		break;
+	default:
+		snprintf(strcaller, INET6_ADDRSTRLEN, "BAD ADDRESS");
+		break;
+	}
+
+	LogEvent(COMPONENT_9P, "9p socket #%ld is connected to %s",
+		 tcp_sock, strcaller);
+
+	pconn->client = get_gsh_client(&pconn->addrpeer, false);
+	return 0;
+}
+
+/**
+ * @brief Release what a 9P/TCP connection holds
+ *
+ * The socket is already closed and no request refers to the
+ * connection anymore.
+ *
+ * @param[in] pconn The connection
+ */
+
+static void _9p_tcp_conn_fini(struct _9p_conn *pconn)
+{
+	_9p_cleanup_fids(pconn);
+
+	if (pconn->client != NULL)
+		put_gsh_client(pconn->client);
+}
+
+/**
+ * @brief Get a buffer for a message read from a 9P/TCP connection
+ *
+ * Buffers used to be msize long whatever the message.  With a large
+ * msize only the messages that need it get a large buffer, the others
+ * keep the room they always had.  Buffers are recycled, since they are
+ * freed by whichever worker ran the request.
+ *
+ * @param[in] pconn  The connection
+ * @param[in] msglen Length of the message, at most msize
+ *
+ * @return The buffer, to be released with iobuf_free.
+ */
+
+static char *_9p_tcp_msg_alloc(struct _9p_conn *pconn, uint32_t msglen)
+{
+	return iobuf_alloc(MIN(pconn->msize, MAX(msglen, _9P_TCP_MIN_BUF)));
+}
+
+/**
+ * @brief Hand a message read from a 9P/TCP connection to a worker
+ *
+ * @param[in] pconn  The connection
+ * @param[in] _9pmsg The message, now owned by the request
+ * @param[in] msglen Its length
+ */
+
+static void _9p_tcp_dispatch(struct _9p_conn *pconn, char *_9pmsg,
+			     uint32_t msglen)
+{
+	request_data_t *req;
+	int tag;
+
+	server_stats_transport_done(pconn->client, msglen, 1, 0, 0, 0, 0);
+
+	(void) atomic_inc_uint64_t(&nfs_health_.enqueued_reqs);
+	req = pool_alloc(nfs_request_pool);
+
+	req->rtype = _9P_REQUEST;
+	req->r_u._9p._9pmsg = _9pmsg;
+	req->r_u._9p.pconn = pconn;
+
+	/* Add this request to the request list,
+	 * should it be flushed later. */
+	tag = *(u16 *) (_9pmsg + _9P_HDR_SIZE + _9P_TYPE_SIZE);
+	_9p_AddFlushHook(&req->r_u._9p, tag, pconn->sequence++);
+	LogFullDebug(COMPONENT_9P, "Request tag is %d\n", tag);
+
+	/* Message was OK push it */
+	DispatchWork9P(req);
+}
+
 /**
  * _9p_socket_thread: 9p socket manager.
  *
  * This function is the main loop for the 9p socket manager.
- * One such thread exists per connection.
+ * One such thread exists per connection, when _9P_TCP_Event_Loops
+ * is 0.
  *
  * @param Arg the socket number cast as a void * in pthread_create
  *
@@ -584,15 +1374,10 @@ void *_9p_socket_thread(void *Arg)
 	int fdcount = 1;
 	static char my_name[MAXNAMLEN + 1];
 	char strcaller[INET6_ADDRSTRLEN];
-	request_data_t *req = NULL;
-	int tag;
-	unsigned long sequence = 0;
-	unsigned int i = 0;
 	char *_9pmsg = NULL;
 	uint32_t msglen;
 
 	struct _9p_conn _9p_conn;
-	socklen_t addrpeerlen;
 
 	int readlen = 0;
 	int total_readlen = 0;
@@ -600,59 +1385,13 @@ void *_9p_socket_thread(void *Arg)
 	snprintf(my_name, MAXNAMLEN, "9p_sock_mgr#fd=%ld", tcp_sock);
 	SetNameFunction(my_name);
 
-	/* Init the struct _9p_conn structure */
-	memset(&_9p_conn, 0, sizeof(_9p_conn));
-	PTHREAD_MUTEX_init(&_9p_conn.sock_lock, NULL);
-	_9p_conn.trans_type = _9P_TCP;
-	_9p_conn.trans_data.sockfd = tcp_sock;
-	for (i = 0; i < FLUSH_BUCKETS; i++) {
-		PTHREAD_MUTEX_init(&_9p_conn.flush_buckets[i].lock, NULL);
-		glist_init(&_9p_conn.flush_buckets[i].list);
-	}
-	atomic_store_uint32_t(&_9p_conn.refcount, 0);
+	/* Run near the NIC queue the connection's packets arrive on */
+	rc = gsh_numa_socket_node(tcp_sock);
+	if (rc >= 0)
+		gsh_numa_bind(rc);
 
-	/* Init the fids pointers array */
-	memset(&_9p_conn.fids, 0, _9P_FID_PER_CONN * sizeof(struct _9p_fid *));
-
-	/* Set initial msize.
-	 * Client may request a lower value during TVERSION */
-	_9p_conn.msize = _9p_param._9p_tcp_msize;
-
-	if (gettimeofday(&_9p_conn.birth, NULL) == -1)
-		LogFatal(COMPONENT_9P, "Cannot get connection's time of birth");
-
-	addrpeerlen = sizeof(_9p_conn.addrpeer);
-	rc = getpeername(tcp_sock, (struct sockaddr *)&_9p_conn.addrpeer,
-			 &addrpeerlen);
-	if (rc == -1) {
-		LogMajor(COMPONENT_9P,
-			 "Cannot get peername to tcp socket for 9p, error %d (%s)",
-			 errno, strerror(errno));
-		/* XXX */
-		strncpy(strcaller, "(unresolved)", INET6_ADDRSTRLEN);
-		strcaller[12] = '\0';
+	if (_9p_tcp_conn_init(&_9p_conn, tcp_sock, strcaller) != 0)
 		goto end;
-	} else {
-		switch (_9p_conn.addrpeer.ss_family) {
-		case AF_INET:
-			inet_ntop(_9p_conn.addrpeer.ss_family,
-				  &((struct sockaddr_in *)&_9p_conn.addrpeer)->
-				  sin_addr, strcaller, INET6_ADDRSTRLEN);
-			break;
-		case AF_INET6:
-			inet_ntop(_9p_conn.addrpeer.ss_family,
-				  &((struct sockaddr_in6 *)&_9p_conn.addrpeer)->
-				  sin6_addr, strcaller, INET6_ADDRSTRLEN);
-			break;
-		default:
-			snprintf(strcaller, INET6_ADDRSTRLEN, "BAD ADDRESS");
-			break;
-		}
-
-		LogEvent(COMPONENT_9P, "9p socket #%ld is connected to %s",
-			 tcp_sock, strcaller);
-	}
-	_9p_conn.client = get_gsh_client(&_9p_conn.addrpeer, false);
 
 	/* Set up the structure used by poll */
 	memset((char *)fds, 0, sizeof(struct pollfd));
@@ -692,17 +1431,13 @@ void *_9p_socket_thread(void *Arg)
 		if (!(fds[0].revents & (POLLIN | POLLRDNORM)))
 			continue;
 
-		/* Prepare to read the message */
-		_9pmsg = gsh_malloc(_9p_conn.msize);
-
 		/* An incoming 9P request: the msg has a 4 bytes header
 		   showing the size of the msg including the header */
-		readlen = recv(fds[0].fd, _9pmsg,
+		readlen = recv(fds[0].fd, &msglen,
 			       _9P_HDR_SIZE, MSG_WAITALL);
 		if (readlen != _9P_HDR_SIZE)
 			goto badmsg;
 
-		msglen = *(uint32_t *) _9pmsg;
 		if (msglen > _9p_conn.msize) {
 			LogCrit(COMPONENT_9P,
 				"Message size too big! got %u, max = %u",
@@ -710,6 +1445,10 @@ void *_9p_socket_thread(void *Arg)
 			goto end;
 		}
 
+		/* Prepare to read the message */
+		_9pmsg = _9p_tcp_msg_alloc(&_9p_conn, msglen);
+		memcpy(_9pmsg, &msglen, _9P_HDR_SIZE);
+
 		LogFullDebug(COMPONENT_9P,
 			     "Received 9P/TCP message of size %u from client %s on socket %lu",
 			     msglen, strcaller, tcp_sock);
@@ -730,29 +1469,8 @@ void *_9p_socket_thread(void *Arg)
 				goto badmsg;
 		}	/* while */
 
-		server_stats_transport_done(_9p_conn.client,
-					    total_readlen, 1, 0,
-					    0, 0, 0);
-
 		/* Message is good. */
-		(void) atomic_inc_uint64_t(&nfs_health_.enqueued_reqs);
-		req = pool_alloc(nfs_request_pool);
-
-		req->rtype = _9P_REQUEST;
-		req->r_u._9p._9pmsg = _9pmsg;
-		req->r_u._9p.pconn = &_9p_conn;
-
-		/* Add this request to the request list,
-		 * should it be flushed later. */
-		tag = *(u16 *) (_9pmsg + _9P_HDR_SIZE +
-				_9P_TYPE_SIZE);
-		_9p_AddFlushHook(&req->r_u._9p, tag,
-				 sequence++);
-		LogFullDebug(COMPONENT_9P,
-			     "Request tag is %d\n", tag);
-
-		/* Message was OK push it */
-		DispatchWork9P(req);
+		_9p_tcp_dispatch(&_9p_conn, _9pmsg, total_readlen);
 
 		/* Not our buffer anymore */
 		_9pmsg = NULL;
@@ -789,21 +1507,330 @@ end:
 	/* Free buffer if we encountered an error
 	 * before we could give it to a worker */
 	if (_9pmsg)
-		gsh_free(_9pmsg);
+		iobuf_free(_9pmsg);
 
 	while (atomic_fetch_uint32_t(&_9p_conn.refcount)) {
 		LogEvent(COMPONENT_9P, "Waiting for workers to release pconn");
 		sleep(1);
 	}
 
-	_9p_cleanup_fids(&_9p_conn);
-
-	if (_9p_conn.client != NULL)
-		put_gsh_client(_9p_conn.client);
+	_9p_tcp_conn_fini(&_9p_conn);
 
 	pthread_exit(NULL);
 }				/* _9p_socket_thread */
 
+#ifdef LINUX
+/**
+ * @defgroup _9p_tcp_loops 9P/TCP event loops
+ *
+ * Instead of a thread per connection, a few threads each wait on an
+ * epoll set of connections.  Sockets stay blocking for the workers
+ * sending replies, loops read with MSG_DONTWAIT and keep the state
+ * of a partially received message in its struct _9p_tcp_sock.  The
+ * header is read aside so that idle connections hold no buffer, the
+ * body lands straight in the buffer handed to the request.
+ *
+ * A closed connection is shut down and parked on its loop's closing
+ * list until the requests still running on it are done.  Only then
+ * is the descriptor closed, so that it can't be reused by a new
+ * connection while a worker still sends on it.
+ *
+ * @{
+ */
+
+/** Events handled per epoll_wait */
+#define _9P_TCP_LOOP_EVENTS 64
+
+/** Messages read from one connection before looking at others */
+#define _9P_TCP_LOOP_BATCH 16
+
+/**
+ * @brief A connection handled by an event loop
+ */
+
+struct _9p_tcp_sock {
+	struct _9p_conn conn;
+	struct glist_head closing;	/*< On the loop's closing list */
+	char strcaller[INET6_ADDRSTRLEN];
+	uint32_t hdr;		/*< Header of the message being read */
+	char *msg;		/*< Message being read, NULL with the header */
+	uint32_t msglen;	/*< Length of the message being read */
+	uint32_t readlen;	/*< Bytes of it read so far */
+};
+
+struct _9p_tcp_loop {
+	int epfd;
+	pthread_t thrid;
+	struct glist_head closing;	/*< Only touched by the loop */
+};
+
+static struct _9p_tcp_loop *_9p_tcp_loops;
+static uint32_t _9p_tcp_next_loop;
+
+/**
+ * @brief Read what a connection has to offer
+ *
+ * @param[in] ts The connection
+ *
+ * @return false if the connection must be closed.
+ */
+
+static bool _9p_tcp_sock_read(struct _9p_tcp_sock *ts)
+{
+	long int tcp_sock = ts->conn.trans_data.sockfd;
+	int msgs = 0;
+	ssize_t readlen;
+	char *buf;
+	uint32_t want;
+
+	while (msgs < _9P_TCP_LOOP_BATCH) {
+		if (ts->msg == NULL) {
+			buf = (char *)&ts->hdr;
+			want = _9P_HDR_SIZE;
+		} else {
+			buf = ts->msg;
+			want = ts->msglen;
+		}
+
+		readlen = recv(tcp_sock, buf + ts->readlen, want - ts->readlen,
+			       MSG_DONTWAIT);
+		if (readlen < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return true;
+			LogEvent(COMPONENT_9P,
+				 "Read error client %s on socket %lu errno=%d, total read = %u",
+				 ts->strcaller, tcp_sock, errno, ts->readlen);
+			return false;
+		}
+		if (readlen == 0) {
+			if (ts->readlen != 0 || ts->msg != NULL)
+				LogEvent(COMPONENT_9P,
+					 "Premature end for Client %s on socket %lu, total read = %u",
+					 ts->strcaller, tcp_sock, ts->readlen);
+			else
+				LogEvent(COMPONENT_9P,
+					 "Client %s on socket %lu has shut down and closed",
+					 ts->strcaller, tcp_sock);
+			return false;
+		}
+
+		ts->readlen += readlen;
+		if (ts->readlen < want)
+			continue;
+
+		if (ts->msg == NULL) {
+			/* The header is the size of the msg including it */
+			ts->msglen = ts->hdr;
+			if (ts->msglen > ts->conn.msize ||
+			    ts->msglen < _9P_HDR_SIZE + _9P_TYPE_SIZE +
+					 _9P_TAG_SIZE) {
+				LogCrit(COMPONENT_9P,
+					"Bad message size! got %u, max = %u",
+					ts->msglen, ts->conn.msize);
+				return false;
+			}
+
+			LogFullDebug(COMPONENT_9P,
+				     "Received 9P/TCP message of size %u from client %s on socket %lu",
+				     ts->msglen, ts->strcaller, tcp_sock);
+
+			ts->msg = _9p_tcp_msg_alloc(&ts->conn, ts->msglen);
+			memcpy(ts->msg, &ts->hdr, _9P_HDR_SIZE);
+			continue;
+		}
+
+		/* Message is good, it is not our buffer anymore */
+		_9p_tcp_dispatch(&ts->conn, ts->msg, ts->msglen);
+		ts->msg = NULL;
+		ts->readlen = 0;
+		msgs++;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Stop reading a connection
+ *
+ * @param[in] loop Its loop
+ * @param[in] ts   The connection
+ */
+
+static void _9p_tcp_sock_close(struct _9p_tcp_loop *loop,
+			       struct _9p_tcp_sock *ts)
+{
+	long int tcp_sock = ts->conn.trans_data.sockfd;
+
+	LogEvent(COMPONENT_9P, "Closing connection on socket %lu", tcp_sock);
+
+	(void) epoll_ctl(loop->epfd, EPOLL_CTL_DEL, tcp_sock, NULL);
+	(void) shutdown(tcp_sock, SHUT_RDWR);
+
+	/* Free buffer if we encountered an error
+	 * before we could give it to a worker */
+	if (ts->msg != NULL) {
+		iobuf_free(ts->msg);
+		ts->msg = NULL;
+	}
+
+	glist_add_tail(&loop->closing, &ts->closing);
+}
+
+/**
+ * @brief Free the closed connections no request refers to anymore
+ *
+ * @param[in] loop The loop
+ */
+
+static void _9p_tcp_loop_reap(struct _9p_tcp_loop *loop)
+{
+	struct glist_head *glist, *glistn;
+	struct _9p_tcp_sock *ts;
+
+	glist_for_each_safe(glist, glistn, &loop->closing) {
+		ts = glist_entry(glist, struct _9p_tcp_sock, closing);
+		if (atomic_fetch_uint32_t(&ts->conn.refcount) != 0)
+			continue;
+
+		glist_del(&ts->closing);
+		close(ts->conn.trans_data.sockfd);
+		_9p_tcp_conn_fini(&ts->conn);
+		gsh_free(ts);
+	}
+}
+
+/**
+ * @brief Main loop of a 9P/TCP event loop thread
+ *
+ * @param[in] arg The struct _9p_tcp_loop
+ *
+ * @return NULL, never.
+ */
+
+static void *_9p_tcp_loop_thread(void *arg)
+{
+	struct _9p_tcp_loop *loop = arg;
+	struct epoll_event events[_9P_TCP_LOOP_EVENTS];
+	struct _9p_tcp_sock *ts;
+	bool closed;
+	int n, i;
+
+	SetNameFunction("9p_loop");
+	_9p_tcp_in_loop = true;
+
+	for (;;) {
+		/* Look again at closed connections every second */
+		n = epoll_wait(loop->epfd, events, _9P_TCP_LOOP_EVENTS,
+			       glist_empty(&loop->closing) ? -1 : 1000);
+		if (n < 0 && errno != EINTR)
+			LogCrit(COMPONENT_9P,
+				"Got error %d (%s) while waiting on 9p sockets",
+				errno, strerror(errno));
+
+		for (i = 0; i < n; i++) {
+			ts = events[i].data.ptr;
+			closed = false;
+
+			/* Read first, a peer may send and close at once */
+			if (events[i].events & EPOLLIN)
+				closed = !_9p_tcp_sock_read(ts);
+
+			if (!closed &&
+			    events[i].events & (EPOLLERR | EPOLLHUP)) {
+				LogEvent(COMPONENT_9P,
+					 "Client %s on socket %lu has shut down and closed",
+					 ts->strcaller,
+					 ts->conn.trans_data.sockfd);
+				closed = true;
+			}
+
+			if (closed)
+				_9p_tcp_sock_close(loop, ts);
+		}
+
+		_9p_tcp_loop_reap(loop);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Start the 9P/TCP event loops
+ *
+ * @param[in] attr_thr Attributes of the loop threads
+ */
+
+static void _9p_tcp_loops_init(pthread_attr_t *attr_thr)
+{
+	uint32_t nloops = _9p_param._9p_tcp_event_loops;
+	struct _9p_tcp_loop *loop;
+	int rc;
+
+	_9p_tcp_loops = gsh_calloc(nloops, sizeof(struct _9p_tcp_loop));
+
+	for (loop = _9p_tcp_loops; loop < _9p_tcp_loops + nloops; loop++) {
+		glist_init(&loop->closing);
+		loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+		if (loop->epfd < 0)
+			LogFatal(COMPONENT_9P_DISPATCH,
+				 "Could not create 9p epoll set, error = %d (%s)",
+				 errno, strerror(errno));
+
+		rc = pthread_create(&loop->thrid, attr_thr,
+				    _9p_tcp_loop_thread, loop);
+		if (rc != 0)
+			LogFatal(COMPONENT_THREAD,
+				 "Could not create 9p event loop thread, error = %d (%s)",
+				 rc, strerror(rc));
+	}
+
+	LogEvent(COMPONENT_9P_DISPATCH, "%" PRIu32 " 9P event loops started",
+		 nloops);
+}
+
+/**
+ * @brief Give a new connection to an event loop
+ *
+ * @param[in] tcp_sock The connection's socket
+ */
+
+static void _9p_tcp_loops_add(long int tcp_sock)
+{
+	struct _9p_tcp_loop *loop;
+	struct _9p_tcp_sock *ts;
+	struct epoll_event ev;
+
+	loop = &_9p_tcp_loops[_9p_tcp_next_loop++ %
+			      _9p_param._9p_tcp_event_loops];
+
+	ts = gsh_calloc(1, sizeof(struct _9p_tcp_sock));
+	if (_9p_tcp_conn_init(&ts->conn, tcp_sock, ts->strcaller) != 0)
+		goto err;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLRDHUP;
+	ev.data.ptr = ts;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, tcp_sock, &ev) != 0) {
+		LogCrit(COMPONENT_9P_DISPATCH,
+			"Could not watch 9p socket %ld, error = %d (%s)",
+			tcp_sock, errno, strerror(errno));
+		goto err;
+	}
+
+	return;
+
+err:
+	LogEvent(COMPONENT_9P, "Closing connection on socket %lu", tcp_sock);
+	close(tcp_sock);
+	_9p_tcp_conn_fini(&ts->conn);
+	gsh_free(ts);
+}
+
+/** @} */
+#endif /* LINUX */
+
 /**
  * _9p_create_socket_V4 : create the socket and bind for 9P using
  * the available V4 interfaces on the host. This is not the default
@@ -1044,6 +2071,11 @@ void *_9p_dispatcher_thread(void *Arg)
 		LogDebug(COMPONENT_9P_DISPATCH,
 			 "can't set pthread's join state");
 
+#ifdef LINUX
+	if (_9p_param._9p_tcp_event_loops > 0)
+		_9p_tcp_loops_init(&attr_thr);
+#endif
+
 	LogEvent(COMPONENT_9P_DISPATCH, "9P dispatcher started");
 
 	while (true) {
@@ -1055,6 +2087,13 @@ void *_9p_dispatcher_thread(void *Arg)
 			continue;
 		}
 
+#ifdef LINUX
+		if (_9p_param._9p_tcp_event_loops > 0) {
+			_9p_tcp_loops_add(newsock);
+			continue;
+		}
+#endif
+
 		/* Starting the thread dedicated to signal handling */
 		rc = pthread_create(&tcp_thrid, &attr_thr,
 				    _9p_socket_thread, (void *)newsock);
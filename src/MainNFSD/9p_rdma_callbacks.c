@@ -200,13 +200,15 @@ void _9p_rdma_callback_recv(msk_trans_t *trans, msk_data_t *data, void *arg)
 	(void) atomic_inc_uint64_t(&nfs_health_.enqueued_reqs);
 	req = pool_alloc(nfs_request_pool);
 
+	/* The dispatcher reads the message type to classify it */
+	_9pmsg = data->data;
+
 	req->rtype = _9P_REQUEST;
 	req->r_u._9p._9pmsg = _9pmsg;
 	req->r_u._9p.pconn = _9p_rdma_priv_of(trans)->pconn;
 	req->r_u._9p.data = data;
 
 	/* Add this request to the request list, should it be flushed later. */
-	_9pmsg = data->data;
 	tag = *(u16 *) (_9pmsg + _9P_HDR_SIZE + _9P_TYPE_SIZE);
 	_9p_AddFlushHook(&req->r_u._9p, tag, req->r_u._9p.pconn->sequence++);
 
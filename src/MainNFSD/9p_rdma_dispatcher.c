@@ -59,6 +59,10 @@
 
 #include <mooshika.h>
 
+/** Registered buffers start on a page, so with an msize that is a
+ *  multiple of it every message buffer does. */
+#define _9P_RDMA_BUF_ALIGN 4096
+
 static void *_9p_rdma_cleanup_conn_thread(void *arg)
 {
 	msk_trans_t *trans = arg;
@@ -168,10 +172,7 @@ void *_9p_rdma_thread(void *Arg)
 	p_9p_conn->client =
 		get_gsh_client(&p_9p_conn->addrpeer, false);
 
-	/* Init the fids pointers array */
-	memset(&p_9p_conn->fids,
-	       0,
-	       _9P_FID_PER_CONN * sizeof(struct _9p_fid *));
+	_9p_fid_table_init(p_9p_conn);
 
 	/* Set initial msize.
 	 * Client may request a lower value during TVERSION */
@@ -223,8 +224,9 @@ static void _9p_rdma_setup_pernic(msk_trans_t *trans, uint8_t *outrdmabuf)
 
 	/* register input buffers */
 	/* Alloc rdmabuf */
-	pernic->rdmabuf = gsh_malloc(_9p_param._9p_rdma_inpool_size *
-				     _9p_param._9p_rdma_msize);
+	pernic->rdmabuf = gsh_malloc_aligned(_9P_RDMA_BUF_ALIGN,
+					     _9p_param._9p_rdma_inpool_size *
+					     _9p_param._9p_rdma_msize);
 
 	/* Register rdmabuf */
 	pernic->inmr = msk_reg_mr(trans, pernic->rdmabuf,
@@ -277,8 +279,9 @@ static void _9p_rdma_setup_global(uint8_t **poutrdmabuf, msk_data_t **pwdata,
 	msk_data_t *wdata;
 	struct _9p_outqueue *outqueue;
 
-	outrdmabuf = gsh_malloc(_9p_param._9p_rdma_outpool_size
-				* _9p_param._9p_rdma_msize);
+	outrdmabuf = gsh_malloc_aligned(_9P_RDMA_BUF_ALIGN,
+					_9p_param._9p_rdma_outpool_size
+					* _9p_param._9p_rdma_msize);
 
 	*poutrdmabuf = outrdmabuf;
 
@@ -43,9 +43,12 @@
 #include "pnfs_utils.h"
 #include "fsal.h"
 #include "netgroup_cache.h"
+#include "nfs_proto_functions.h"
+#include "nfs_creds.h"
 #ifdef USE_DBUS
 #include "gsh_dbus.h"
 #include "mdcache.h"
+#include "gsh_stats_shm.h"
 #endif
 
 /**
@@ -112,6 +115,87 @@ static struct gsh_dbus_method method_get_grace = {
 		 END_ARG_LIST}
 };
 
+/**
+ * @brief Dbus method get reclaim progress of the grace period
+ *
+ * @param[in]  args  dbus args
+ * @param[out] reply dbus reply message with grace period progress
+ */
+static bool admin_dbus_get_grace_progress(DBusMessageIter *args,
+					  DBusMessage *reply,
+					  DBusError *error)
+{
+	char *errormsg = "get grace progress success";
+	bool success = true;
+	DBusMessageIter iter;
+	struct grace_progress progress;
+	dbus_bool_t ingrace;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (args != NULL) {
+		errormsg = "Get grace progress takes no arguments.";
+		success = false;
+		LogWarn(COMPONENT_DBUS, "%s", errormsg);
+		goto out;
+	}
+
+	nfs_get_grace_progress(&progress);
+	ingrace = progress.in_grace;
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_BOOLEAN, &ingrace);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32,
+				       &progress.elapsed);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32,
+				       &progress.grace_period);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32,
+				       &progress.min_grace_period);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32,
+				       &progress.expected);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32,
+				       &progress.started);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32,
+				       &progress.completed);
+
+ out:
+	dbus_status_reply(&iter, success, errormsg);
+	return success;
+}
+
+static struct gsh_dbus_method method_get_grace_progress = {
+	.name = "get_grace_progress",
+	.method = admin_dbus_get_grace_progress,
+	.args = {
+		 {.name = "isgrace",
+		  .type = "b",
+		  .direction = "out",
+		 },
+		 {.name = "elapsed",
+		  .type = "u",
+		  .direction = "out",
+		 },
+		 {.name = "grace_period",
+		  .type = "u",
+		  .direction = "out",
+		 },
+		 {.name = "min_grace_period",
+		  .type = "u",
+		  .direction = "out",
+		 },
+		 {.name = "expected",
+		  .type = "u",
+		  .direction = "out",
+		 },
+		 {.name = "started",
+		  .type = "u",
+		  .direction = "out",
+		 },
+		 {.name = "completed",
+		  .type = "u",
+		  .direction = "out",
+		 },
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
 /**
  * @brief Dbus method start grace period
  *
@@ -238,6 +322,7 @@ static bool admin_dbus_purge_gids(DBusMessageIter *args,
 	}
 
 	uid2grp_clear_cache();
+	nfs_creds_cache_flush();
 
  out:
 	dbus_status_reply(&iter, success, errormsg);
@@ -309,6 +394,7 @@ static bool admin_dbus_purge_idmapper_cache(DBusMessageIter *args,
 		goto out;
 	}
 	idmapper_clear_cache();
+	nfs_creds_cache_flush();
  out:
 	dbus_status_reply(&iter, success, errormsg);
 	return success;
@@ -362,6 +448,7 @@ static struct gsh_dbus_method *admin_methods[] = {
 	&method_shutdown,
 	&method_grace_period,
 	&method_get_grace,
+	&method_get_grace_progress,
 	&method_purge_gids,
 	&method_purge_netgroups,
 	&method_init_fds_limit,
@@ -473,6 +560,12 @@ static void do_shutdown(void)
 	}
 #endif
 
+	LogEvent(COMPONENT_MAIN, "Stopping copy threads");
+	nfs4_copy_pkgshutdown();
+
+	LogEvent(COMPONENT_MAIN, "Stopping PUTFH resolution threads");
+	nfs4_putfh_pkgshutdown();
+
 	rc = general_fridge_shutdown();
 	if (rc != 0) {
 		LogMajor(COMPONENT_THREAD,
@@ -482,6 +575,9 @@ static void do_shutdown(void)
 		LogEvent(COMPONENT_THREAD, "General fridge shut down.");
 	}
 
+	stats_shm_shutdown();
+	rquota_cache_shutdown();
+
 	rc = reaper_shutdown();
 	if (rc != 0) {
 		LogMajor(COMPONENT_THREAD,
@@ -491,6 +587,8 @@ static void do_shutdown(void)
 		LogEvent(COMPONENT_THREAD, "Reaper thread shut down.");
 	}
 
+	mdcache_snapshot_save();
+
 	LogEvent(COMPONENT_MAIN, "Removing all exports.");
 	remove_all_exports();
 
@@ -0,0 +1,366 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs_capture.c
+ * @brief Capture of the requests served, see nfs_capture.h
+ *
+ * A request is recorded by the thread that sent its reply, from the
+ * decoded arguments and the result still at hand.  Records go through
+ * the per-thread rings of the async log facility, so the serving
+ * thread only pays for building the record; when its ring is full the
+ * record is dropped and counted rather than waited for.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include "log.h"
+#include "city.h"
+#include "common_utils.h"
+#include "nfs_core.h"
+#include "nfs_proto_functions.h"
+#include "export_mgr.h"
+#include "nfs_capture.h"
+
+#define CAPTURE_MAX_REC \
+	(sizeof(struct nfs_capture_req) + \
+	 NFS_CAPTURE_MAX_OPS * sizeof(struct nfs_capture_op))
+
+bool nfs_capture_on;
+
+static struct log_async *capture_async;
+
+static __thread uint32_t capture_tid;
+static __thread uint64_t capture_dropped;
+
+static inline uint64_t capture_hash(const char *buf, u_int len)
+{
+	return len == 0 ? 0 : CityHash64(buf, len);
+}
+
+/**
+ * @brief Start capturing requests if Capture_File is set
+ */
+void nfs_capture_start(void)
+{
+	struct nfs_capture_file rec = {
+		.hdr.len = sizeof(rec),
+		.hdr.type = NFS_CAPTURE_REC_FILE,
+		.magic = NFS_CAPTURE_MAGIC,
+		.version = NFS_CAPTURE_VERSION,
+	};
+	struct timespec ts;
+
+	if (nfs_param.core_param.capture_file == NULL)
+		return;
+
+	capture_async = log_async_create(nfs_param.core_param.capture_file,
+					 nfs_param.core_param.capture_ring_size,
+					 LOG_ASYNC_DROP);
+	if (capture_async == NULL) {
+		LogCrit(COMPONENT_DISPATCH,
+			"Could not capture requests to %s",
+			nfs_param.core_param.capture_file);
+		return;
+	}
+
+	now(&ts);
+	rec.ns = timespec_to_nsecs(&ts);
+
+	/* Nothing is queued yet, so this can't be dropped */
+	(void) log_async_record(capture_async, &rec, sizeof(rec));
+
+	nfs_capture_on = true;
+
+	LogEvent(COMPONENT_DISPATCH, "Capturing requests to %s",
+		 nfs_param.core_param.capture_file);
+}
+
+#ifdef _USE_NFS3
+/**
+ * @brief Record an NFSv3 procedure
+ */
+static void capture_nfs3(request_data_t *reqdata, int rc,
+			 struct nfs_capture_op *op)
+{
+	nfs_arg_t *arg = &reqdata->r_u.req.arg_nfs;
+	nfs_res_t *res = reqdata->r_u.req.res_nfs;
+	nfs_fh3 *fh = (nfs_fh3 *) arg;
+	post_op_fh3 *obj = NULL;
+
+	if (op->op == NFSPROC3_NULL)
+		return;
+
+	/* The arguments always begin with the handle */
+	op->fh_hash = capture_hash(fh->data.data_val, fh->data.data_len);
+
+	switch (op->op) {
+	case NFSPROC3_READ:
+		op->offset = arg->arg_read3.offset;
+		op->length = arg->arg_read3.count;
+		break;
+	case NFSPROC3_WRITE:
+		op->offset = arg->arg_write3.offset;
+		op->length = arg->arg_write3.count;
+		break;
+	case NFSPROC3_COMMIT:
+		op->offset = arg->arg_commit3.offset;
+		op->length = arg->arg_commit3.count;
+		break;
+	}
+
+	if (rc == NFS_REQ_DROP)
+		return;
+
+	op->status = res->res_getattr3.status;
+	if (op->status != NFS3_OK)
+		return;
+
+	switch (op->op) {
+	case NFSPROC3_LOOKUP:
+		fh = &res->res_lookup3.LOOKUP3res_u.resok.object;
+		op->obj_hash = capture_hash(fh->data.data_val,
+					    fh->data.data_len);
+		return;
+	case NFSPROC3_CREATE:
+		obj = &res->res_create3.CREATE3res_u.resok.obj;
+		break;
+	case NFSPROC3_MKDIR:
+		obj = &res->res_mkdir3.MKDIR3res_u.resok.obj;
+		break;
+	case NFSPROC3_SYMLINK:
+		obj = &res->res_symlink3.SYMLINK3res_u.resok.obj;
+		break;
+	case NFSPROC3_MKNOD:
+		obj = &res->res_mknod3.MKNOD3res_u.resok.obj;
+		break;
+	default:
+		return;
+	}
+
+	if (obj->handle_follows) {
+		fh = &obj->post_op_fh3_u.handle;
+		op->obj_hash = capture_hash(fh->data.data_val,
+					    fh->data.data_len);
+	}
+}
+#endif /* _USE_NFS3 */
+
+/**
+ * @brief Record the operations of an NFSv4 COMPOUND
+ *
+ * The handle of an operation is the one PUTFH set, or GETFH returned,
+ * last.  A GETFH right after a LOOKUP, OPEN or CREATE also tells what
+ * that operation found.
+ *
+ * @return Number of operations recorded.
+ */
+static uint16_t capture_nfs4(request_data_t *reqdata, int rc,
+			     struct nfs_capture_req *rec,
+			     struct nfs_capture_op *ops)
+{
+	COMPOUND4args *args = &reqdata->r_u.req.arg_nfs.arg_compound4;
+	COMPOUND4res *res = &reqdata->r_u.req.res_nfs->res_compound4;
+	uint64_t cur = 0, saved = 0;
+	u_int nops = args->argarray.argarray_len;
+	u_int nres = rc == NFS_REQ_DROP ? 0 : res->resarray.resarray_len;
+	u_int i;
+
+	rec->minorversion = args->minorversion;
+	if (nops > NFS_CAPTURE_MAX_OPS) {
+		nops = NFS_CAPTURE_MAX_OPS;
+		rec->flags |= NFS_CAPTURE_TRUNCATED;
+	}
+
+	for (i = 0; i < nops; i++) {
+		nfs_argop4 *arg = &args->argarray.argarray_val[i];
+		nfs_resop4 *resop = i < nres ? &res->resarray.resarray_val[i]
+					     : NULL;
+		struct nfs_capture_op *op = &ops[i];
+		nfs_fh4 *fh;
+
+		op->op = arg->argop;
+		op->status = resop != NULL
+			? (int32_t) resop->nfs_resop4_u.opaccess.status : -1;
+
+		switch (arg->argop) {
+		case NFS4_OP_PUTFH:
+			fh = &arg->nfs_argop4_u.opputfh.object;
+			cur = capture_hash(fh->nfs_fh4_val, fh->nfs_fh4_len);
+			break;
+		case NFS4_OP_PUTROOTFH:
+		case NFS4_OP_PUTPUBFH:
+		case NFS4_OP_LOOKUP:
+		case NFS4_OP_LOOKUPP:
+		case NFS4_OP_OPEN:
+		case NFS4_OP_CREATE:
+			op->fh_hash = cur;
+			cur = 0;
+			continue;
+		case NFS4_OP_SAVEFH:
+			saved = cur;
+			break;
+		case NFS4_OP_RESTOREFH:
+			cur = saved;
+			break;
+		case NFS4_OP_GETFH:
+			if (op->status != NFS4_OK)
+				break;
+			fh = &resop->nfs_resop4_u.opgetfh.GETFH4res_u.resok4
+								.object;
+			cur = capture_hash(fh->nfs_fh4_val, fh->nfs_fh4_len);
+			if (i > 0 &&
+			    (ops[i - 1].op == NFS4_OP_LOOKUP ||
+			     ops[i - 1].op == NFS4_OP_LOOKUPP ||
+			     ops[i - 1].op == NFS4_OP_OPEN ||
+			     ops[i - 1].op == NFS4_OP_CREATE))
+				ops[i - 1].obj_hash = cur;
+			break;
+		case NFS4_OP_READ:
+			op->offset = arg->nfs_argop4_u.opread.offset;
+			op->length = arg->nfs_argop4_u.opread.count;
+			break;
+		case NFS4_OP_WRITE:
+			op->offset = arg->nfs_argop4_u.opwrite.offset;
+			op->length = arg->nfs_argop4_u.opwrite.data.data_len;
+			break;
+		case NFS4_OP_COMMIT:
+			op->offset = arg->nfs_argop4_u.opcommit.offset;
+			op->length = arg->nfs_argop4_u.opcommit.count;
+			break;
+		case NFS4_OP_LOCK:
+			op->offset = arg->nfs_argop4_u.oplock.offset;
+			op->length = arg->nfs_argop4_u.oplock.length;
+			break;
+		case NFS4_OP_LOCKU:
+			op->offset = arg->nfs_argop4_u.oplocku.offset;
+			op->length = arg->nfs_argop4_u.oplocku.length;
+			break;
+		}
+
+		op->fh_hash = cur;
+	}
+
+	if (rc != NFS_REQ_DROP)
+		rec->status = res->status;
+
+	return nops;
+}
+
+/**
+ * @brief Record a request whose reply was sent or dropped
+ *
+ * Call with op_ctx still set up and the arguments and result still
+ * around, only when nfs_capture_on.
+ *
+ * @param[in] reqdata  The request
+ * @param[in] rc       NFS_REQ_OK or NFS_REQ_DROP
+ */
+void nfs_capture_request(request_data_t *reqdata, int rc)
+{
+	char buf[CAPTURE_MAX_REC];
+	struct nfs_capture_req *rec = (struct nfs_capture_req *)buf;
+	struct nfs_capture_op *ops = (struct nfs_capture_op *)(rec + 1);
+	struct svc_req *req = &reqdata->r_u.req.svc;
+	sockaddr_t *addr = op_ctx->caller_addr;
+	struct timespec ts;
+	uint16_t nops = 1;
+
+	if (unlikely(capture_tid == 0))
+		capture_tid = syscall(SYS_gettid);
+
+	if (unlikely(capture_dropped != 0)) {
+		struct nfs_capture_drop drop = {
+			.hdr.len = sizeof(drop),
+			.hdr.type = NFS_CAPTURE_REC_DROP,
+			.tid = capture_tid,
+			.count = capture_dropped,
+		};
+
+		if (log_async_record(capture_async, &drop, sizeof(drop)) != 0) {
+			/* Still full, this one goes too */
+			capture_dropped++;
+			return;
+		}
+		capture_dropped = 0;
+	}
+
+	now(&ts);
+
+	memset(buf, 0, sizeof(struct nfs_capture_req) +
+		       sizeof(struct nfs_capture_op));
+	rec->hdr.type = NFS_CAPTURE_REC_REQ;
+	rec->ns = timespec_to_nsecs(&nfs_ServerBootTime) + op_ctx->start_time;
+	rec->latency = timespec_diff(&nfs_ServerBootTime, &ts) -
+		       op_ctx->start_time;
+	rec->queue_wait = op_ctx->queue_wait;
+	rec->xid = req->rq_msg.rm_xid;
+	rec->prog = req->rq_msg.cb_prog;
+	rec->vers = req->rq_msg.cb_vers;
+	rec->proc = req->rq_msg.cb_proc;
+	rec->export_id = op_ctx->ctx_export != NULL
+		? op_ctx->ctx_export->export_id : UINT16_MAX;
+	if (rc == NFS_REQ_DROP)
+		rec->flags |= NFS_CAPTURE_DROPPED;
+
+	if (addr != NULL && addr->ss_family == AF_INET) {
+		struct sockaddr_in *sin = (struct sockaddr_in *)addr;
+
+		rec->family = AF_INET;
+		rec->port = ntohs(sin->sin_port);
+		memcpy(rec->addr, &sin->sin_addr, sizeof(sin->sin_addr));
+	} else if (addr != NULL && addr->ss_family == AF_INET6) {
+		struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)addr;
+
+		rec->family = AF_INET6;
+		rec->port = ntohs(sin6->sin6_port);
+		memcpy(rec->addr, &sin6->sin6_addr, sizeof(sin6->sin6_addr));
+	}
+
+	ops[0].op = rec->proc;
+
+	if (rec->prog == nfs_param.core_param.program[P_NFS]) {
+		if (rec->vers == NFS_V4 && rec->proc == NFSPROC4_COMPOUND) {
+			memset(ops + 1, 0, (NFS_CAPTURE_MAX_OPS - 1) *
+					   sizeof(struct nfs_capture_op));
+			nops = capture_nfs4(reqdata, rc, rec, ops);
+		}
+#ifdef _USE_NFS3
+		else if (rec->vers == NFS_V3) {
+			capture_nfs3(reqdata, rc, ops);
+			rec->status = ops[0].status;
+		}
+#endif /* _USE_NFS3 */
+	}
+
+	rec->nops = nops;
+	rec->hdr.len = sizeof(struct nfs_capture_req) +
+		       nops * sizeof(struct nfs_capture_op);
+
+	if (log_async_record(capture_async, rec, rec->hdr.len) != 0)
+		capture_dropped++;
+}
@@ -73,6 +73,9 @@
 #include "mdcache.h"
 #include "common_utils.h"
 #include "nfs_init.h"
+#include "gsh_iobuf.h"
+#include "gsh_stats_shm.h"
+#include "nfs_capture.h"
 
 /**
  * @brief init_complete used to indicate if ganesha is during
@@ -315,6 +318,8 @@ void nfs_print_param_config(void)
 	printf("\tNFS_Program = %u ;\n", nfs_param.core_param.program[P_NFS]);
 	printf("\tMNT_Program = %u ;\n", nfs_param.core_param.program[P_NFS]);
 	printf("\tNb_Worker = %u ;\n", nfs_param.core_param.nb_worker);
+	printf("\tReq_Queue_Shards = %u ;\n",
+	       nfs_param.core_param.req_queue_shards);
 	printf("\tDRC_TCP_Npart = %u ;\n", nfs_param.core_param.drc.tcp.npart);
 	printf("\tDRC_TCP_Size = %u ;\n", nfs_param.core_param.drc.tcp.size);
 	printf("\tDRC_TCP_Cachesz = %u ;\n",
@@ -390,6 +395,18 @@ int nfs_set_param_from_conf(config_file_t parse_tree,
 		return -1;
 	}
 
+	/* Requiring TLS that can't be started would refuse every client */
+#ifdef USE_RPC_TLS
+	if (nfs_param.core_param.tls.required &&
+	    !nfs_param.core_param.tls.enable)
+		LogFatal(COMPONENT_INIT,
+			 "RPC_TLS_Required is set but Enable_RPC_TLS is not");
+#else
+	if (nfs_param.core_param.tls.required)
+		LogFatal(COMPONENT_INIT,
+			 "RPC_TLS_Required is set, built without USE_RPC_TLS");
+#endif
+
 	/* Worker paramters: ip/name hash table and expiration for each entry */
 	(void) load_config_from_parse(parse_tree,
 				      &nfs_ip_name,
@@ -596,6 +613,15 @@ static void nfs_Start_threads(void)
 	}
 	LogEvent(COMPONENT_THREAD, "reaper thread was started successfully");
 
+	/* Start publishing the stats, if configured */
+	stats_shm_start();
+
+	/* Start capturing the requests, if configured */
+	nfs_capture_start();
+
+	/* Start the RQUOTA quota cache */
+	rquota_cache_start();
+
 	/* Starting the general fridge */
 	rc = general_fridge_init();
 	if (rc != 0) {
@@ -641,9 +667,15 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 
 	nfs41_session_pool =
 	    pool_basic_init("NFSv4.1 session pool", sizeof(nfs41_session_t));
+	pool_set_mem_tag(nfs41_session_pool, MEM_TAG_SESSION);
 
 	nfs_request_pool =
 	    pool_basic_init("Request pool", sizeof(request_data_t));
+	pool_set_mem_tag(nfs_request_pool, MEM_TAG_REQUEST);
+
+	nfs4_Compound_pkginit();
+
+	iobuf_pkginit();
 
 	/* If rpcsec_gss is used, set the path to the keytab */
 #ifdef _HAVE_GSSAPI
@@ -702,7 +734,20 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 #ifdef HAVE_KRB5
 	}			/*  if( nfs_param.krb5_param.active_krb5 ) */
 #endif				/* HAVE_KRB5 */
+
+	if (gss_crypto_pkginit() != 0)
+		LogFatal(COMPONENT_INIT,
+			 "Could not start the GSS crypto threads");
 #endif				/* _HAVE_GSSAPI */
+#ifdef USE_RPC_TLS
+	if (nfs_rpc_tls_pkginit() != 0)
+		LogFatal(COMPONENT_INIT,
+			 "Could not set up RPC-over-TLS");
+#else
+	if (nfs_param.core_param.tls.enable)
+		LogWarn(COMPONENT_INIT,
+			"Enable_RPC_TLS is ignored, built without USE_RPC_TLS");
+#endif
 	/* Init the NFSv4 Clientid cache */
 	LogDebug(COMPONENT_INIT, "Now building NFSv4 clientid cache");
 	if (nfs_Init_client_id() !=
@@ -805,6 +850,12 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 
 	/* callback dispatch */
 	nfs_rpc_cb_pkginit();
+
+	/* asynchronous COPY */
+	nfs4_copy_pkginit();
+
+	/* asynchronous PUTFH handle resolution */
+	nfs4_putfh_pkginit();
 #ifdef _USE_CB_SIMULATOR
 	nfs_rpc_cbsim_pkginit();
 #endif				/*  _USE_CB_SIMULATOR */
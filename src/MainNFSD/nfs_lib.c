@@ -42,6 +42,7 @@
 #include "nfs_init.h"
 #include "nfs_exports.h"
 #include "pnfs_utils.h"
+#include "gsh_partition.h"
 #include "conf_url.h"
 #include "sal_functions.h"
 
@@ -220,6 +221,13 @@ int nfs_libmain(const char *ganesha_conf,
 		goto fatal_die;
 	}
 
+	/* Load the partitions exports may be put in */
+	if (ReadPartitions(nfs_config_struct, &err_type) < 0) {
+		LogCrit(COMPONENT_INIT,
+			"Error while parsing partition entries");
+		goto fatal_die;
+	}
+
 	/* Load Data Server entries from parsed file
 	 * returns the number of DS entries.
 	 */
@@ -43,6 +43,7 @@
 #include "nfs_init.h"
 #include "nfs_exports.h"
 #include "pnfs_utils.h"
+#include "gsh_partition.h"
 #include "config_parsing.h"
 #include "conf_url.h"
 #include "sal_functions.h"
@@ -87,13 +88,14 @@ char *nfs_host_name = "localhost";
 
 /* command line syntax */
 
-static const char options[] = "v@L:N:f:p:FRTE:Ch";
+static const char options[] = "v@L:N:f:c:p:FRTE:Ch";
 static const char usage[] =
 	"Usage: %s [-hd][-L <logfile>][-N <dbg_lvl>][-f <config_file>]\n"
 	"\t[-v]                display version information\n"
 	"\t[-L <logfile>]      set the default logfile for the daemon\n"
 	"\t[-N <dbg_lvl>]      set the verbosity level\n"
 	"\t[-f <config_file>]  set the config file to be used\n"
+	"\t[-c <cache_file>]   keep a compiled cache of the config file\n"
 	"\t[-p <pid_file>]     set the pid file\n"
 	"\t[-F]                the program stays in foreground\n"
 	"\t[-R]                daemon will manage RPCSEC_GSS (default is no RPCSEC_GSS)\n"
@@ -142,6 +144,7 @@ int main(int argc, char *argv[])
 	int rc;
 	int pidfile;
 	char *log_path = NULL;
+	char *config_cache_file = NULL;
 	char *exec_name = "nfs-ganesha";
 	int debug_level = -1;
 	int detach_flag = true;
@@ -211,6 +214,11 @@ int main(int argc, char *argv[])
 			nfs_config_path = main_strdup("config_path", optarg);
 			break;
 
+		case 'c':
+			/* compiled config cache */
+			config_cache_file = main_strdup("config_cache", optarg);
+			break;
+
 		case 'p':
 			/* PID file */
 			nfs_pidfile_path = main_strdup("pidfile_path", optarg);
@@ -419,9 +427,11 @@ int main(int argc, char *argv[])
 		LogWarn(COMPONENT_INIT,
 			"No configuration file named.");
 		nfs_config_struct = NULL;
-	} else
+	} else {
+		config_SetCache(nfs_config_path, config_cache_file);
 		nfs_config_struct =
 			config_ParseFile(nfs_config_path, &err_type);
+	}
 
 	if (!config_error_no_error(&err_type)) {
 		char *errstr = err_type_str(&err_type);
@@ -470,6 +480,13 @@ int main(int argc, char *argv[])
 			"Failed to initialize server packages");
 		goto fatal_die;
 	}
+	/* Load the partitions exports may be put in */
+	if (ReadPartitions(nfs_config_struct, &err_type) < 0) {
+		LogCrit(COMPONENT_INIT,
+			"Error while parsing partition entries");
+		goto fatal_die;
+	}
+
 	/* Load Data Server entries from parsed file
 	 * returns the number of DS entries.
 	 */
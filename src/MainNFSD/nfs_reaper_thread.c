@@ -34,6 +34,7 @@
 #include "nfs_core.h"
 #include "log.h"
 #include "fridgethr.h"
+#include "nfs_dupreq.h"
 
 #define REAPER_DELAY 10
 
@@ -41,94 +42,84 @@ unsigned int reaper_delay = REAPER_DELAY;
 
 static struct fridgethr *reaper_fridge;
 
-static int reap_hash_table(hash_table_t *ht_reap)
+/**
+ * @brief Expire the clientids whose lease ran out
+ *
+ * Only the clientids the lease wheel says are due are looked at, renewed
+ * ones and courtesy clients keeping their state go back on the wheel.
+ *
+ * @return Number of clientids checked.
+ */
+static int reap_expired_leases(void)
 {
-	struct rbt_head *head_rbt;
-	struct hash_data *addr = NULL;
-	uint32_t i;
-	struct rbt_node *pn;
 	nfs_client_id_t *client_id;
 	nfs_client_record_t *client_rec;
 	int count = 0;
 
-	/* For each bucket of the requested hashtable */
-	for (i = 0; i < ht_reap->parameter.index_size; i++) {
-		head_rbt = &ht_reap->partitions[i].rbt;
-
-restart:
-		/* acquire mutex */
-		PTHREAD_RWLOCK_wrlock(&ht_reap->partitions[i].lock);
-
-		/* go through all entries in the red-black-tree */
-		RBT_LOOP(head_rbt, pn) {
-			char str[LOG_BUFF_LEN] = "\0";
-			struct display_buffer dspbuf = {sizeof(str), str, str};
-			bool str_valid = false;
-
-			addr = RBT_OPAQ(pn);
-			client_id = addr->val.addr;
-
-			count++;
-
-			PTHREAD_MUTEX_lock(&client_id->cid_mutex);
+	while ((client_id = lease_wheel_next_due()) != NULL) {
+		char str[LOG_BUFF_LEN] = "\0";
+		struct display_buffer dspbuf = {sizeof(str), str, str};
+		bool str_valid = false;
 
-			if (valid_lease(client_id)) {
-				PTHREAD_MUTEX_unlock(&client_id->cid_mutex);
-				RBT_INCREMENT(pn);
-				continue;
-			}
+		count++;
 
-			if (isDebug(COMPONENT_CLIENTID)) {
-				display_client_id_rec(&dspbuf, client_id);
-				LogFullDebug(COMPONENT_CLIENTID,
-					     "Expire index %d %s", i, str);
-				str_valid = true;
-			}
+		PTHREAD_MUTEX_lock(&client_id->cid_mutex);
 
-			/* Get the client record */
-			client_rec = client_id->cid_client_record;
+		if (client_id->cid_confirmed == EXPIRED_CLIENT_ID) {
+			/* Already gone, just drop the wheel's reference */
+			PTHREAD_MUTEX_unlock(&client_id->cid_mutex);
+			dec_client_id_ref(client_id);
+			continue;
+		}
 
-			/* get a ref to client_id as we might drop the
-			 * last reference with expiring.
-			 */
-			inc_client_id_ref(client_id);
+		if (valid_lease(client_id) || keep_courtesy_lease(client_id)) {
+			lease_wheel_queue(client_id);
+			PTHREAD_MUTEX_unlock(&client_id->cid_mutex);
+			dec_client_id_ref(client_id);
+			continue;
+		}
 
-			/* if record is STALE, the linkage to client_record is
-			 * removed already. Acquire a ref on client record
-			 * before we drop the mutex on clientid
-			 */
-			if (client_rec != NULL)
-				inc_client_record_ref(client_rec);
+		if (isDebug(COMPONENT_CLIENTID)) {
+			display_client_id_rec(&dspbuf, client_id);
+			LogFullDebug(COMPONENT_CLIENTID, "Expire %s", str);
+			str_valid = true;
+		}
 
-			PTHREAD_MUTEX_unlock(&client_id->cid_mutex);
-			PTHREAD_RWLOCK_unlock(&ht_reap->partitions[i].lock);
+		/* Get the client record */
+		client_rec = client_id->cid_client_record;
 
-			if (client_rec != NULL)
-				PTHREAD_MUTEX_lock(&client_rec->cr_mutex);
+		/* if record is STALE, the linkage to client_record is
+		 * removed already. Acquire a ref on client record
+		 * before we drop the mutex on clientid
+		 */
+		if (client_rec != NULL)
+			inc_client_record_ref(client_rec);
 
-			nfs_client_id_expire(client_id, false);
+		PTHREAD_MUTEX_unlock(&client_id->cid_mutex);
 
-			if (client_rec != NULL) {
-				PTHREAD_MUTEX_unlock(&client_rec->cr_mutex);
-				dec_client_record_ref(client_rec);
-			}
+		if (client_rec != NULL)
+			PTHREAD_MUTEX_lock(&client_rec->cr_mutex);
 
-			if (isFullDebug(COMPONENT_CLIENTID)) {
-				if (!str_valid)
-					display_printf(&dspbuf, "clientid %p",
-						       client_id);
+		nfs_client_id_expire(client_id, false);
 
-				LogFullDebug(COMPONENT_CLIENTID,
-					     "Reaper done, expired {%s}", str);
-			}
+		if (client_rec != NULL) {
+			PTHREAD_MUTEX_unlock(&client_rec->cr_mutex);
+			dec_client_record_ref(client_rec);
+		}
 
-			/* drop our reference to the client_id */
-			dec_client_id_ref(client_id);
+		if (isFullDebug(COMPONENT_CLIENTID)) {
+			if (!str_valid)
+				display_printf(&dspbuf, "clientid %p",
+					       client_id);
 
-			goto restart;
+			LogFullDebug(COMPONENT_CLIENTID,
+				     "Reaper done, expired {%s}", str);
 		}
-		PTHREAD_RWLOCK_unlock(&ht_reap->partitions[i].lock);
+
+		/* drop the reference the wheel handed us */
+		dec_client_id_ref(client_id);
 	}
+
 	return count;
 }
 
@@ -139,54 +130,63 @@ static int reap_expired_open_owners(void)
 	time_t texpire;
 	state_owner_t *owner;
 	struct state_nfs4_owner_t *nfs4_owner;
-
-	PTHREAD_MUTEX_lock(&cached_open_owners_lock);
-
-	/* Walk the list of cached NFS 4 open owners. Because we hold
-	 * the mutex while walking this list, it is impossible for another
-	 * thread to get a primary reference to these owners while we
-	 * process, and thus prevent them from expiring.
-	 */
-	while (true) {
-		owner = glist_first_entry(&cached_open_owners, state_owner_t,
+	struct state_list_shard *shard;
+	int i;
+
+	for (i = 0; i < STATE_LIST_SHARDS; i++) {
+		shard = &cached_open_owners[i];
+		PTHREAD_MUTEX_lock(&shard->sls_mutex);
+
+		/* Walk this shard of the cached NFS 4 open owners.
+		 * Because we hold the mutex while walking this list, it is
+		 * impossible for another thread to get a primary reference
+		 * to these owners while we process, and thus prevent them
+		 * from expiring.
+		 */
+		while (true) {
+			owner = glist_first_entry(&shard->sls_list,
+				state_owner_t,
 				so_owner.so_nfs4_owner.so_cache_entry);
 
-		if (owner == NULL)
-			break;
-
-		nfs4_owner = &owner->so_owner.so_nfs4_owner;
-		texpire = atomic_fetch_time_t(&nfs4_owner->so_cache_expire);
-		if (texpire > tnow) {
-			/* This owner has not yet expired. */
-			if (isFullDebug(COMPONENT_STATE)) {
-				char str[LOG_BUFF_LEN] = "\0";
-				struct display_buffer dspbuf = {
-						sizeof(str), str, str};
-
-				display_owner(&dspbuf, owner);
-
-				LogFullDebug(COMPONENT_STATE,
-					     "Did not release CLOSE_PENDING %d seconds left for {%s}",
-					     (int) (texpire - tnow),
-					     str);
+			if (owner == NULL)
+				break;
+
+			nfs4_owner = &owner->so_owner.so_nfs4_owner;
+			texpire = atomic_fetch_time_t(
+					&nfs4_owner->so_cache_expire);
+			if (texpire > tnow) {
+				/* This owner has not yet expired. */
+				if (isFullDebug(COMPONENT_STATE)) {
+					char str[LOG_BUFF_LEN] = "\0";
+					struct display_buffer dspbuf = {
+							sizeof(str), str, str};
+
+					display_owner(&dspbuf, owner);
+
+					LogFullDebug(COMPONENT_STATE,
+						     "Did not release CLOSE_PENDING %d seconds left for {%s}",
+						     (int) (texpire - tnow),
+						     str);
+				}
+
+				/* Because entries are not moved on a shard,
+				 * and they are added when they first become
+				 * eligible, each shard is in order of
+				 * expiration time, and thus once we hit one
+				 * that is not expired yet, the rest of the
+				 * shard is also not expired.
+				 */
+				break;
 			}
 
-			/* Because entries are not moved on this list, and
-			 * they are added when they first become eligible,
-			 * the entries are in order of expiration time, and
-			 * thus once we hit one that is not expired yet, the
-			 * rest are also not expired.
-			 */
-			break;
+			/* This cached owner has expired, uncache it. */
+			uncache_nfs4_owner(nfs4_owner);
+			count++;
 		}
 
-		/* This cached owner has expired, uncache it. */
-		uncache_nfs4_owner(nfs4_owner);
-		count++;
+		PTHREAD_MUTEX_unlock(&shard->sls_mutex);
 	}
 
-	PTHREAD_MUTEX_unlock(&cached_open_owners_lock);
-
 	return count;
 }
 
@@ -228,11 +228,17 @@ static void reaper_run(struct fridgethr_context *ctx)
 #endif
 	}
 
-	rst->count =
-	    (reap_hash_table(ht_confirmed_client_id) +
-	     reap_hash_table(ht_unconfirmed_client_id));
+	rst->count = reap_expired_leases();
 
 	rst->count += reap_expired_open_owners();
+
+	nfs41_session_update_slot_target();
+
+	nfs4_referral_refresh();
+
+	nfs_dupreq_shrink_idle();
+
+	nfs_dupreq_adapt();
 }
 
 int reaper_init(void)
@@ -58,8 +58,22 @@
 #endif /* _HAVE_GSSAPI */
 #include "sal_data.h"
 #include "sal_functions.h"
+#include "fridgethr.h"
+#include "delayed_exec.h"
 #include <misc/timespec.h>
 
+/** Most operations sent in one batched CB_COMPOUND */
+#define CB_BATCH_MAX 16
+
+/** Threads sending batched callbacks to different clients at once */
+#define CB_DISPATCH_THREADS 16
+
+/** Back off while every back channel slot of a client is busy */
+#define CB_SLOT_RETRY (100 * NS_PER_MSEC)
+
+/** Back off while a client has no usable back channel */
+#define CB_CHAN_RETRY NS_PER_SEC
+
 const struct __netid_nc_table netid_nc_table[9] = {
 	{
 	"-", _NC_ERR, 0}, {
@@ -75,6 +89,9 @@ const struct __netid_nc_table netid_nc_table[9] = {
 /* retry timeout default to the moon and back */
 static const struct timespec tout = { 3, 0 };
 
+/** Threads sending queued callbacks, one client at a time each */
+static struct fridgethr *cb_dispatch_fridge;
+
 /**
  * @brief Initialize the callback credential cache
  *
@@ -115,6 +132,19 @@ static inline void nfs_rpc_cb_init_ccache(const char *ccache)
  */
 void nfs_rpc_cb_pkginit(void)
 {
+	struct fridgethr_params frp;
+	int rc;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = CB_DISPATCH_THREADS;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&cb_dispatch_fridge, "cb_dispatch", &frp);
+	if (rc != 0)
+		LogCrit(COMPONENT_INIT,
+			"Unable to initialize callback dispatch fridge: %d",
+			rc);
+
 #ifdef _HAVE_GSSAPI
 	/* ccache */
 	nfs_rpc_cb_init_ccache(nfs_param.krb5_param.ccache_dir);
@@ -131,7 +161,21 @@ void nfs_rpc_cb_pkginit(void)
  */
 void nfs_rpc_cb_pkgshutdown(void)
 {
-	/* return */
+	int rc;
+
+	if (cb_dispatch_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(cb_dispatch_fridge, fridgethr_comm_stop,
+				    120);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_NFS_CB,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(cb_dispatch_fridge);
+	}
+
+	fridgethr_destroy(cb_dispatch_fridge);
+	cb_dispatch_fridge = NULL;
 }
 
 /**
@@ -679,23 +723,65 @@ static enum clnt_stat rpc_cb_null(rpc_call_channel_t *chan, bool locked)
 	return stat;
 }
 
+
 /**
- * @brief Create a channel for an NFSv4.1 session
+ * @brief Remember the security a back channel was set up with
  *
- * This function creates a channel on an NFSv4.1 session, using the
- * given security parameters.  If a channel already exists, it is
- * removed and replaced.
+ * So that it can be set up again on another connection of the session.
  *
- * @param[in,out] session       The session on which to create the
- *                              back channel
- * @param[in]     num_sec_parms Length of sec_parms list
- * @param[in]     sec_parms     Allowable security parameters
+ * @param[in,out] session The session
+ * @param[in]     parms   Security parameters that worked
+ */
+static void cb_sec_parms_save(nfs41_session_t *session,
+			      callback_sec_parms4 *parms)
+{
+	struct authunix_parms *sys =
+		&parms->callback_sec_parms4_u.cbsp_sys_cred;
+	struct authunix_parms *saved =
+		&session->cb_sec_parms.callback_sec_parms4_u.cbsp_sys_cred;
+
+	if (parms == &session->cb_sec_parms)
+		return;
+
+	nfs41_session_free_cb_sec(session);
+
+	session->cb_sec_parms.cb_secflavor = parms->cb_secflavor;
+	if (parms->cb_secflavor == AUTH_SYS) {
+		*saved = *sys;
+		saved->aup_machname = gsh_strdup(sys->aup_machname);
+		saved->aup_gids = gsh_malloc(sys->aup_len * sizeof(gid_t));
+		memcpy(saved->aup_gids, sys->aup_gids,
+		       sys->aup_len * sizeof(gid_t));
+	}
+	session->cb_sec_saved = true;
+}
+
+/**
+ * @brief Release the security parameters saved by cb_sec_parms_save
  *
- * @return 0 or POSIX error code.
+ * @param[in,out] session The session
  */
+void nfs41_session_free_cb_sec(nfs41_session_t *session)
+{
+	struct authunix_parms *saved =
+		&session->cb_sec_parms.callback_sec_parms4_u.cbsp_sys_cred;
 
-int nfs_rpc_create_chan_v41(SVCXPRT *xprt, nfs41_session_t *session,
-			    int num_sec_parms, callback_sec_parms4 *sec_parms)
+	if (!session->cb_sec_saved)
+		return;
+
+	if (session->cb_sec_parms.cb_secflavor == AUTH_SYS) {
+		gsh_free(saved->aup_machname);
+		gsh_free(saved->aup_gids);
+	}
+	session->cb_sec_saved = false;
+}
+
+/**
+ * @brief Create a session's back channel, with the channel mutex held
+ */
+static int _nfs_rpc_create_chan_v41(SVCXPRT *xprt, nfs41_session_t *session,
+				    int num_sec_parms,
+				    callback_sec_parms4 *sec_parms)
 {
 	rpc_call_channel_t *chan = &session->cb_chan;
 	char *err;
@@ -703,8 +789,6 @@ int nfs_rpc_create_chan_v41(SVCXPRT *xprt, nfs41_session_t *session,
 	int code = 0;
 	bool authed = false;
 
-	PTHREAD_MUTEX_lock(&chan->mtx);
-
 	if (chan->clnt) {
 		/* Something better later. */
 		code = EEXIST;
@@ -785,14 +869,16 @@ int nfs_rpc_create_chan_v41(SVCXPRT *xprt, nfs41_session_t *session,
 		goto out;
 	}
 
-	if (rpc_cb_null(chan, true) != RPC_SUCCESS)
+	if (rpc_cb_null(chan, true) != RPC_SUCCESS) {
 #ifdef EBADFD
 		code = EBADFD;
 #else				/* !EBADFD */
 		code = EBADF;
 #endif				/* !EBADFD */
-	else
+	} else {
+		cb_sec_parms_save(session, &sec_parms[i]);
 		atomic_set_uint32_t_bits(&session->flags, session_bc_up);
+	}
 
  out:
 	if (code != 0) {
@@ -802,6 +888,74 @@ int nfs_rpc_create_chan_v41(SVCXPRT *xprt, nfs41_session_t *session,
 			_nfs_rpc_destroy_chan(chan);
 	}
 
+	return code;
+}
+
+/**
+ * @brief Create a channel for an NFSv4.1 session
+ *
+ * This function creates a channel on an NFSv4.1 session, using the
+ * given security parameters.  If a channel already exists, it is
+ * removed and replaced.
+ *
+ * @param[in,out] session       The session on which to create the
+ *                              back channel
+ * @param[in]     num_sec_parms Length of sec_parms list
+ * @param[in]     sec_parms     Allowable security parameters
+ *
+ * @return 0 or POSIX error code.
+ */
+int nfs_rpc_create_chan_v41(SVCXPRT *xprt, nfs41_session_t *session,
+			    int num_sec_parms, callback_sec_parms4 *sec_parms)
+{
+	int code;
+
+	PTHREAD_MUTEX_lock(&session->cb_chan.mtx);
+	code = _nfs_rpc_create_chan_v41(xprt, session, num_sec_parms,
+					sec_parms);
+	PTHREAD_MUTEX_unlock(&session->cb_chan.mtx);
+
+	return code;
+}
+
+/**
+ * @brief Move a session's back channel to another connection
+ *
+ * Called when the client binds a connection for the back channel.  A
+ * back channel that still works is kept, one that went down is set up
+ * again on the new connection with the security it had, so callbacks
+ * survive the loss of one connection of a trunked session.
+ *
+ * @param[in]     xprt    Connection the client bound
+ * @param[in,out] session The session
+ *
+ * @return 0 if the session has a working back channel, or POSIX
+ *         error code.
+ */
+int nfs_rpc_rebind_chan_v41(SVCXPRT *xprt, nfs41_session_t *session)
+{
+	rpc_call_channel_t *chan = &session->cb_chan;
+	int code = 0;
+
+	PTHREAD_MUTEX_lock(&chan->mtx);
+
+	if (atomic_fetch_uint32_t(&session->flags) & session_bc_up)
+		goto out;
+
+	if (!session->cb_sec_saved) {
+		/* No back channel was ever set up, nothing to go by */
+		code = ENOTCONN;
+		goto out;
+	}
+
+	_nfs_rpc_destroy_chan(chan);
+	code = _nfs_rpc_create_chan_v41(xprt, session, 1,
+					&session->cb_sec_parms);
+	if (code == 0)
+		LogDebug(COMPONENT_NFS_CB,
+			 "Back channel moved to fd %d", xprt->xp_fd);
+
+ out:
 	PTHREAD_MUTEX_unlock(&chan->mtx);
 
 	return code;
@@ -1096,11 +1250,14 @@ static void release_v41(rpc_call_t *call)
 		&argarray_val[0].nfs_cb_argop4_u.opcbsequence;
 	referring_call_list4 *call_lists =
 		sequence->csa_referring_call_lists.csarcl_val;
+	u_int i;
 
 	if (call_lists == NULL)
 		return;
 
-	gsh_free(call_lists->rcl_referring_calls.rcl_referring_calls_val);
+	for (i = 0; i < sequence->csa_referring_call_lists.csarcl_len; i++)
+		gsh_free(call_lists[i].rcl_referring_calls
+			 .rcl_referring_calls_val);
 	gsh_free(call_lists);
 }
 
@@ -1283,6 +1440,10 @@ restart:
 
 void nfs41_release_single(rpc_call_t *call)
 {
+	/* The batch owns the slot and session, see cb_batch_completion */
+	if (call->states & NFS_CB_CALL_BATCHED)
+		return;
+
 	release_cb_slot(call->chan->source.session,
 			call->cbt.v_u.v4.args.argarray.argarray_val[0]
 			.nfs_cb_argop4_u.opcbsequence.csa_slotid, true);
@@ -1412,3 +1573,665 @@ int nfs_rpc_cb_single(nfs_client_id_t *clientid, nfs_cb_argop4 *op,
 		return nfs_rpc_v40_single(clientid, op, completion, c_arg);
 	return nfs_rpc_v41_single(clientid, op, refer, completion, c_arg);
 }
+
+/**
+ * @brief A callback operation waiting in a client's queue
+ */
+
+struct cb_queued_op {
+	struct glist_head cqo_list;	/*< Link in cid_cb_queue or a batch */
+	nfs_cb_argop4 cqo_op;		/*< The operation */
+	struct state_refer cqo_refer;	/*< Referring call, if any */
+	bool cqo_has_refer;
+	void (*cqo_completion)(rpc_call_t *);
+	void *cqo_arg;
+	time_t cqo_deadline;	/*< Give up if not sent by then */
+};
+
+/**
+ * @brief Operations sent together in one CB_COMPOUND
+ */
+
+struct cb_batch {
+	nfs_client_id_t *cbb_clientid;	/*< Referenced */
+	struct glist_head cbb_ops;	/*< In the order they were sent */
+};
+
+static void cb_dispatch_submit(nfs_client_id_t *clientid);
+
+/**
+ * @brief Hand one operation of a batch its result
+ *
+ * The completion gets a call that looks like the single call the
+ * operation used to be sent in: CB_SEQUENCE (for v4.1) followed by
+ * the operation, with the operation's status as the compound status.
+ * It is marked NFS_CB_CALL_BATCHED so that nfs41_release_single
+ * leaves the slot and session to the batch.
+ *
+ * @param[in] carrier The batched call, NULL if it never went out
+ * @param[in] qop     The operation, freed here
+ * @param[in] minor   Client minor version
+ * @param[in] status  Status to report
+ * @param[in] states  Call states to report
+ */
+
+static void cb_complete_one(rpc_call_t *carrier, struct cb_queued_op *qop,
+			    uint32_t minor, nfsstat4 status, uint32_t states)
+{
+	rpc_call_t view;
+	nfs_cb_argop4 args[2];
+	u_int n = 0;
+
+	memset(&view, 0, sizeof(view));
+	memset(args, 0, sizeof(args));
+
+	if (carrier != NULL) {
+		view.chan = carrier->chan;
+		view.call_req.cc_error = carrier->call_req.cc_error;
+	} else {
+		view.call_req.cc_error.re_status = RPC_CANTSEND;
+	}
+
+	if (minor > 0) {
+		args[n].argop = NFS4_OP_CB_SEQUENCE;
+		if (carrier != NULL) {
+			args[n].nfs_cb_argop4_u.opcbsequence =
+				carrier->cbt.v_u.v4.args.argarray
+				.argarray_val[0].nfs_cb_argop4_u.opcbsequence;
+			args[n].nfs_cb_argop4_u.opcbsequence
+				.csa_referring_call_lists.csarcl_len = 0;
+			args[n].nfs_cb_argop4_u.opcbsequence
+				.csa_referring_call_lists.csarcl_val = NULL;
+		}
+		n++;
+	}
+	args[n++] = qop->cqo_op;
+
+	view.states = states | NFS_CB_CALL_BATCHED;
+	view.call_arg = qop->cqo_arg;
+	view.cbt.v_u.v4.args.minorversion = minor;
+	view.cbt.v_u.v4.args.argarray.argarray_val = args;
+	view.cbt.v_u.v4.args.argarray.argarray_len = n;
+	view.cbt.v_u.v4.res.status = status;
+
+	qop->cqo_completion(&view);
+
+	gsh_free(qop);
+}
+
+/**
+ * @brief Put operations back at the head of a client's queue
+ *
+ * @param[in] clientid The client, cid_mutex held
+ * @param[in] ops      Operations, in order, emptied
+ */
+
+static void cb_queue_return(nfs_client_id_t *clientid, struct glist_head *ops)
+{
+	glist_splice_tail(ops, &clientid->cid_cb_queue);
+	glist_splice_tail(&clientid->cid_cb_queue, ops);
+}
+
+/**
+ * @brief Decide whether to (re)start a client's dispatcher
+ *
+ * A dispatcher that is running keeps going.  One that is parked
+ * waiting for a slot or a connection is restarted, and a new one is
+ * started (with a client reference) if there is none.
+ *
+ * @param[in] clientid The client, cid_mutex held
+ *
+ * @return true if the caller must call cb_dispatch_submit.
+ */
+
+static bool cb_dispatch_kick_locked(nfs_client_id_t *clientid)
+{
+	if (glist_empty(&clientid->cid_cb_queue))
+		return false;
+
+	if (!clientid->cid_cb_dispatching) {
+		clientid->cid_cb_dispatching = true;
+		inc_client_id_ref(clientid);
+		return true;
+	}
+
+	if (clientid->cid_cb_stalled) {
+		clientid->cid_cb_stalled = false;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Handle the reply to a batched CB_COMPOUND
+ *
+ * The client stops at the first operation that fails, so every
+ * operation before it succeeded and the failing one gets the
+ * compound status.  Operations after it were never looked at and go
+ * back to the head of the queue.  If the call itself failed, or
+ * CB_SEQUENCE did, every operation gets that failure.
+ *
+ * @param[in] call The batched call
+ */
+
+static void cb_batch_completion(rpc_call_t *call)
+{
+	struct cb_batch *batch = call->call_arg;
+	nfs_client_id_t *clientid = batch->cbb_clientid;
+	const uint32_t minor = clientid->cid_minorversion;
+	const u_int off = minor > 0 ? 1 : 0;
+	u_int len = call->cbt.v_u.v4.res.resarray.resarray_len;
+	nfsstat4 status = call->cbt.v_u.v4.res.status;
+	bool failed = (call->states & NFS_CB_CALL_ABORTED) ||
+		      call->call_req.cc_error.re_status != RPC_SUCCESS ||
+		      len <= off;
+	struct glist_head requeue, *glist, *glistn;
+	u_int idx = off;
+	bool kick;
+
+	LogFullDebug(COMPONENT_NFS_CB,
+		     "batch %p client %" PRIx64 " status %d results %u",
+		     batch, clientid->cid_clientid, status, len);
+
+	glist_init(&requeue);
+
+	glist_for_each_safe(glist, glistn, &batch->cbb_ops) {
+		struct cb_queued_op *qop =
+			glist_entry(glist, struct cb_queued_op, cqo_list);
+
+		glist_del(&qop->cqo_list);
+
+		if (failed || idx == len - 1)
+			cb_complete_one(call, qop, minor, status,
+					call->states);
+		else if (idx < len - 1)
+			cb_complete_one(call, qop, minor, NFS4_OK,
+					call->states);
+		else
+			glist_add_tail(&requeue, &qop->cqo_list);
+
+		idx++;
+	}
+
+	if (minor > 0)
+		nfs41_release_single(call);
+
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	cb_queue_return(clientid, &requeue);
+	kick = cb_dispatch_kick_locked(clientid);
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+	if (kick)
+		cb_dispatch_submit(clientid);
+
+	dec_client_id_ref(clientid);
+	gsh_free(batch);
+}
+
+/**
+ * @brief Build CB_SEQUENCE for a batch
+ *
+ * Referring calls of all the operations are merged, one list per
+ * referring session.
+ *
+ * @param[in]  session      Session the batch goes out on
+ * @param[in]  batch        The batch
+ * @param[in]  count        Operations in the batch
+ * @param[in]  slot         Back channel slot reserved
+ * @param[in]  highest_slot Highest back channel slot in use
+ * @param[out] sequenceop   The CB_SEQUENCE operation
+ */
+
+static void cb_batch_sequence(nfs41_session_t *session,
+			      struct cb_batch *batch, u_int count,
+			      slotid4 slot, slotid4 highest_slot,
+			      nfs_cb_argop4 *sequenceop)
+{
+	CB_SEQUENCE4args *sequence = &sequenceop->nfs_cb_argop4_u.opcbsequence;
+	referring_call_list4 *lists = NULL;
+	struct glist_head *glist;
+	u_int nlists = 0, i;
+
+	memset(sequenceop, 0, sizeof(*sequenceop));
+	sequenceop->argop = NFS4_OP_CB_SEQUENCE;
+
+	memcpy(sequence->csa_sessionid, session->session_id,
+	       NFS4_SESSIONID_SIZE);
+	sequence->csa_sequenceid = session->bc_slots[slot].sequence;
+	sequence->csa_slotid = slot;
+	sequence->csa_highest_slotid = highest_slot;
+	sequence->csa_cachethis = false;
+
+	glist_for_each(glist, &batch->cbb_ops) {
+		struct cb_queued_op *qop =
+			glist_entry(glist, struct cb_queued_op, cqo_list);
+		referring_call_list4 *list = NULL;
+		referring_call4 *ref_call;
+
+		if (!qop->cqo_has_refer)
+			continue;
+
+		if (lists == NULL)
+			lists = gsh_calloc(count, sizeof(*lists));
+
+		for (i = 0; i < nlists; i++) {
+			if (memcmp(lists[i].rcl_sessionid,
+				   qop->cqo_refer.session,
+				   NFS4_SESSIONID_SIZE) == 0) {
+				list = &lists[i];
+				break;
+			}
+		}
+
+		if (list == NULL) {
+			list = &lists[nlists++];
+			memcpy(list->rcl_sessionid, qop->cqo_refer.session,
+			       NFS4_SESSIONID_SIZE);
+			list->rcl_referring_calls.rcl_referring_calls_val =
+				gsh_calloc(count, sizeof(referring_call4));
+		}
+
+		ref_call = &list->rcl_referring_calls.rcl_referring_calls_val[
+			list->rcl_referring_calls.rcl_referring_calls_len++];
+		ref_call->rc_sequenceid = qop->cqo_refer.sequence;
+		ref_call->rc_slotid = qop->cqo_refer.slot;
+	}
+
+	sequence->csa_referring_call_lists.csarcl_len = nlists;
+	sequence->csa_referring_call_lists.csarcl_val = lists;
+}
+
+/**
+ * @brief Send a batch on one of a v4.1 client's back channels
+ *
+ * Operations the session's back channel cannot take in one compound
+ * are moved to @c rest.
+ *
+ * @param[in]  batch The batch
+ * @param[out] rest  Operations left over
+ *
+ * @retval 0 if the batch was sent.
+ * @retval EAGAIN if every slot is busy.
+ * @retval ENOTCONN if there is no back channel.
+ */
+
+static int cb_send_v41_batch(struct cb_batch *batch, struct glist_head *rest)
+{
+	nfs_client_id_t *clientid = batch->cbb_clientid;
+	struct glist_head *glist, *gop;
+	int ret = ENOTCONN;
+
+restart:
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	glist_for_each(glist, &clientid->cid_cb.v41.cb_session_list) {
+		nfs41_session_t *scur, *session;
+		slotid4 slot = 0;
+		slotid4 highest_slot = 0;
+		nfs_cb_argop4 sequenceop;
+		rpc_call_t *call;
+		u_int max_ops, count = 0;
+
+		scur = glist_entry(glist, nfs41_session_t, session_link);
+
+		if (!(atomic_fetch_uint32_t(&scur->flags) & session_bc_up))
+			continue;
+
+		if (!find_cb_slot(scur, false, &slot, &highest_slot)) {
+			ret = EAGAIN;
+			continue;
+		}
+
+		if (!nfs41_Session_Get_Pointer(scur->session_id, &session)) {
+			release_cb_slot(scur, slot, false);
+			continue;
+		}
+
+		assert(session == scur);
+
+		PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+		max_ops = session->back_channel_attrs.ca_maxoperations;
+		max_ops = max_ops > 1 ? max_ops - 1 : 1;
+
+		glist_for_each(gop, &batch->cbb_ops) {
+			if (count == max_ops) {
+				glist_split(&batch->cbb_ops, rest, gop);
+				break;
+			}
+			count++;
+		}
+
+		cb_batch_sequence(session, batch, count, slot, highest_slot,
+				  &sequenceop);
+
+		call = alloc_rpc_call();
+		call->chan = &session->cb_chan;
+		cb_compound_init_v4(&call->cbt, count + 1,
+				    clientid->cid_minorversion, 0, NULL, 0);
+		cb_compound_add_op(&call->cbt, &sequenceop);
+		glist_for_each(gop, &batch->cbb_ops) {
+			struct cb_queued_op *qop =
+				glist_entry(gop, struct cb_queued_op,
+					    cqo_list);
+
+			cb_compound_add_op(&call->cbt, &qop->cqo_op);
+		}
+
+		call->call_hook = cb_batch_completion;
+		call->call_arg = batch;
+
+		ret = nfs_rpc_call(call, NFS_RPC_CALL_NONE);
+		if (ret == 0)
+			return 0;
+
+		LogDebug(COMPONENT_NFS_CB, "nfs_rpc_call failed: %d", ret);
+		atomic_clear_uint32_t_bits(&session->flags, session_bc_up);
+
+		release_v41(call);
+		free_rpc_call(call);
+
+		release_cb_slot(session, slot, false);
+		dec_session_ref(session);
+
+		/* Whatever was split off goes back in the batch */
+		glist_splice_tail(&batch->cbb_ops, rest);
+		ret = ENOTCONN;
+		goto restart;
+	}
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+	return ret;
+}
+
+/**
+ * @brief Send a batch on a v4.0 client's back channel
+ *
+ * @param[in] batch The batch
+ *
+ * @retval 0 if the batch was sent.
+ * @retval ENOTCONN if there is no back channel.
+ */
+
+static int cb_send_v40_batch(struct cb_batch *batch)
+{
+	nfs_client_id_t *clientid = batch->cbb_clientid;
+	struct glist_head *glist;
+	rpc_call_channel_t *chan;
+	rpc_call_t *call;
+	u_int count;
+
+	if (get_cb_chan_down(clientid))
+		return ENOTCONN;
+
+	chan = nfs_rpc_get_chan(clientid, NFS_RPC_FLAG_NONE);
+	if (!chan || !chan->clnt || !chan->auth) {
+		LogDebug(COMPONENT_NFS_CB, "nfs_rpc_get_chan failed");
+		set_cb_chan_down(clientid, true);
+		return ENOTCONN;
+	}
+
+	count = glist_length(&batch->cbb_ops);
+
+	call = alloc_rpc_call();
+	call->chan = chan;
+	cb_compound_init_v4(&call->cbt, count, 0,
+			    clientid->cid_cb.v40.cb_callback_ident, NULL, 0);
+	glist_for_each(glist, &batch->cbb_ops) {
+		struct cb_queued_op *qop =
+			glist_entry(glist, struct cb_queued_op, cqo_list);
+
+		cb_compound_add_op(&call->cbt, &qop->cqo_op);
+	}
+
+	call->call_hook = cb_batch_completion;
+	call->call_arg = batch;
+
+	if (nfs_rpc_call(call, NFS_RPC_CALL_NONE) == 0)
+		return 0;
+
+	free_rpc_call(call);
+	return ENOTCONN;
+}
+
+/**
+ * @brief Restart a parked dispatcher after its back off
+ *
+ * @param[in] arg The client, referenced for us
+ */
+
+static void cb_dispatch_retry(void *arg)
+{
+	nfs_client_id_t *clientid = arg;
+	bool kick;
+
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	kick = clientid->cid_cb_stalled;
+	clientid->cid_cb_stalled = false;
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+	if (kick)
+		cb_dispatch_submit(clientid);
+
+	dec_client_id_ref(clientid);
+}
+
+/**
+ * @brief Park a dispatcher until a slot or connection may be available
+ *
+ * The dispatcher keeps its client reference; cb_dispatch_retry, or a
+ * batch completing, picks it back up.
+ *
+ * @param[in] clientid The client, cid_mutex held
+ * @param[in] delay    How long to back off
+ */
+
+static void cb_dispatch_park_locked(nfs_client_id_t *clientid,
+				    nsecs_elapsed_t delay)
+{
+	clientid->cid_cb_stalled = true;
+
+	inc_client_id_ref(clientid);
+	if (delayed_submit(cb_dispatch_retry, clientid, delay) != 0) {
+		LogCrit(COMPONENT_NFS_CB,
+			"Unable to schedule callback retry for client %"
+			PRIx64, clientid->cid_clientid);
+		dec_client_id_ref(clientid);
+	}
+}
+
+/**
+ * @brief Send everything queued for one client
+ *
+ * Operations are sent in batches, as many as the back channel will
+ * take at a time, and without waiting for replies so long as there
+ * are back channel slots.  Operations still not sent by their
+ * deadline are completed as aborted.
+ *
+ * @param[in] clientid The client, its dispatcher reference is ours
+ */
+
+static void cb_dispatch_client(nfs_client_id_t *clientid)
+{
+	struct glist_head expired, rest, *glist, *glistn;
+	struct cb_batch *batch;
+	time_t now;
+	u_int count;
+	int rc;
+
+	glist_init(&expired);
+	glist_init(&rest);
+
+	for (;;) {
+		batch = gsh_malloc(sizeof(*batch));
+		batch->cbb_clientid = clientid;
+		glist_init(&batch->cbb_ops);
+		count = 0;
+		now = time(NULL);
+
+		PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+
+		glist_for_each_safe(glist, glistn, &clientid->cid_cb_queue) {
+			struct cb_queued_op *qop =
+				glist_entry(glist, struct cb_queued_op,
+					    cqo_list);
+
+			glist_del(&qop->cqo_list);
+			if (qop->cqo_deadline < now)
+				glist_add_tail(&expired, &qop->cqo_list);
+			else if (count < CB_BATCH_MAX) {
+				glist_add_tail(&batch->cbb_ops,
+					       &qop->cqo_list);
+				count++;
+			} else {
+				glist_add_tail(&rest, &qop->cqo_list);
+			}
+		}
+
+		glist_splice_tail(&clientid->cid_cb_queue, &rest);
+
+		if (count == 0)
+			clientid->cid_cb_dispatching = false;
+
+		PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+		glist_for_each_safe(glist, glistn, &expired) {
+			struct cb_queued_op *qop =
+				glist_entry(glist, struct cb_queued_op,
+					    cqo_list);
+
+			glist_del(&qop->cqo_list);
+			LogEvent(COMPONENT_NFS_CB,
+				 "Callback %d to client %" PRIx64
+				 " not sent before its deadline",
+				 qop->cqo_op.argop, clientid->cid_clientid);
+			cb_complete_one(NULL, qop, clientid->cid_minorversion,
+					NFS4ERR_DELAY, NFS_CB_CALL_ABORTED);
+		}
+
+		if (count == 0) {
+			gsh_free(batch);
+			break;
+		}
+
+		inc_client_id_ref(clientid);
+
+		if (clientid->cid_minorversion == 0)
+			rc = cb_send_v40_batch(batch);
+		else
+			rc = cb_send_v41_batch(batch, &rest);
+
+		if (rc == 0) {
+			/* The completion now owns the batch */
+			PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+			cb_queue_return(clientid, &rest);
+			PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+			continue;
+		}
+
+		dec_client_id_ref(clientid);
+
+		LogDebug(COMPONENT_NFS_CB,
+			 "Client %" PRIx64 " %s, %u callbacks wait",
+			 clientid->cid_clientid,
+			 rc == EAGAIN ? "has no free slot" : "has no channel",
+			 count);
+
+		PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+		cb_queue_return(clientid, &batch->cbb_ops);
+		cb_dispatch_park_locked(clientid, rc == EAGAIN ? CB_SLOT_RETRY
+							       : CB_CHAN_RETRY);
+		PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+		gsh_free(batch);
+		return;
+	}
+
+	dec_client_id_ref(clientid);
+}
+
+/**
+ * @brief Fridge wrapper for cb_dispatch_client
+ *
+ * @param[in] ctx Thread context, the client is the argument
+ */
+
+static void cb_dispatch_run(struct fridgethr_context *ctx)
+{
+	cb_dispatch_client(ctx->arg);
+}
+
+/**
+ * @brief Run a client's dispatcher on the dispatch fridge
+ *
+ * The dispatcher is never run in the caller's thread, since callers
+ * hold state locks that completions may need.
+ *
+ * @param[in] clientid The client, its dispatcher reference is handed on
+ */
+
+static void cb_dispatch_submit(nfs_client_id_t *clientid)
+{
+	int rc = fridgethr_submit(cb_dispatch_fridge, cb_dispatch_run,
+				  clientid);
+
+	if (rc == 0)
+		return;
+
+	LogMajor(COMPONENT_NFS_CB, "Unable to dispatch callbacks: %d", rc);
+
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	cb_dispatch_park_locked(clientid, CB_CHAN_RETRY);
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+}
+
+/**
+ * @brief Queue a callback operation for a client
+ *
+ * Unlike nfs_rpc_cb_single, this never waits for a back channel slot
+ * or connection.  Each client has a queue drained by a dispatcher on
+ * its own thread, so that recalls to many clients go out in parallel;
+ * operations queued for the same client are sent together in one
+ * CB_COMPOUND, and further batches are pipelined on free back channel
+ * slots.  An operation that could not be sent within a lease period is
+ * completed with NFS_CB_CALL_ABORTED set.
+ *
+ * The completion is called once per operation, with a call laid out
+ * as nfs_rpc_cb_single would have sent it; it must not keep the call.
+ *
+ * @param[in] clientid       Client record
+ * @param[in] op             The operation, copied
+ * @param[in] refer          Referral tracking info (or NULL), copied
+ * @param[in] completion     Completion function for this operation
+ * @param[in] c_arg          Argument provided to completion hook
+ *
+ * @return 0, the completion reports any failure.
+ */
+
+int nfs_rpc_cb_queue(nfs_client_id_t *clientid, nfs_cb_argop4 *op,
+		     struct state_refer *refer,
+		     void (*completion)(rpc_call_t *),
+		     void *c_arg)
+{
+	struct cb_queued_op *qop = gsh_calloc(1, sizeof(*qop));
+	bool kick;
+
+	qop->cqo_op = *op;
+	if (refer != NULL) {
+		qop->cqo_refer = *refer;
+		qop->cqo_has_refer = true;
+	}
+	qop->cqo_completion = completion;
+	qop->cqo_arg = c_arg;
+	qop->cqo_deadline = time(NULL) + nfs_param.nfsv4_param.lease_lifetime;
+
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	glist_add_tail(&clientid->cid_cb_queue, &qop->cqo_list);
+	kick = cb_dispatch_kick_locked(clientid);
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+	if (kick)
+		cb_dispatch_submit(clientid);
+
+	return 0;
+}
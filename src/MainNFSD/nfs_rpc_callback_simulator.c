@@ -132,9 +132,34 @@ static struct gsh_dbus_method cbsim_get_client_ids = {
 		 }
 };
 
+/**
+ * @brief Append a session id to the reply
+ *
+ * @param pdata  Entry of ht_session_id
+ * @param arg    The array iterator
+ */
+
+static void nfs_rpc_cbsim_append_session_id(struct hash_data *pdata,
+					    void *arg)
+{
+	DBusMessageIter *sub_iter = arg;
+	nfs41_session_t *session_data = pdata->val.addr;
+	char session_id[2 * NFS4_SESSIONID_SIZE];	/* guaranteed to fit */
+	char *session_str = session_id;
+
+	/* format */
+	b64_ntop((unsigned char *)session_data->session_id,
+		 NFS4_SESSIONID_SIZE, session_id, (2 * NFS4_SESSIONID_SIZE));
+	dbus_message_iter_append_basic(sub_iter, DBUS_TYPE_STRING,
+				       &session_str);
+}
+
 /**
  * @brief Return a timestamped list of session ids.
  *
+ * ht_session_id is an open addressing table, so it is only walked
+ * through hashtable_for_each().
+ *
  * @param args    (not used)
  * @param reply   the message reply
  */
@@ -143,13 +168,6 @@ static bool nfs_rpc_cbsim_get_session_ids(DBusMessageIter *args,
 					  DBusMessage *reply,
 					  DBusError *error)
 {
-	uint32_t i;
-	hash_table_t *ht = ht_session_id;
-	struct rbt_head *head_rbt;
-	struct hash_data *pdata = NULL;
-	struct rbt_node *pn;
-	char session_id[2 * NFS4_SESSIONID_SIZE];	/* guaranteed to fit */
-	nfs41_session_t *session_data;
 	DBusMessageIter iter, sub_iter;
 	struct timespec ts;
 
@@ -160,28 +178,8 @@ static bool nfs_rpc_cbsim_get_session_ids(DBusMessageIter *args,
 
 	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
 					 DBUS_TYPE_UINT64_AS_STRING, &sub_iter);
-	/* For each bucket of the hashtable */
-	for (i = 0; i < ht->parameter.index_size; i++) {
-		head_rbt = &(ht->partitions[i].rbt);
-
-		/* acquire mutex */
-		PTHREAD_RWLOCK_wrlock(&(ht->partitions[i].lock));
-
-		/* go through all entries in the red-black-tree */
-		RBT_LOOP(head_rbt, pn) {
-			pdata = RBT_OPAQ(pn);
-			session_data = pdata->val.addr;
-			/* format */
-			b64_ntop((unsigned char *)session_data->session_id,
-				 NFS4_SESSIONID_SIZE, session_id,
-				 (2 * NFS4_SESSIONID_SIZE));
-			dbus_message_iter_append_basic(&sub_iter,
-						       DBUS_TYPE_STRING,
-						       &session_id);
-			RBT_INCREMENT(pn);
-		}
-		PTHREAD_RWLOCK_unlock(&(ht->partitions[i].lock));
-	}
+	hashtable_for_each(ht_session_id, nfs_rpc_cbsim_append_session_id,
+			   &sub_iter);
 	dbus_message_iter_close_container(&iter, &sub_iter);
 	return true;
 }
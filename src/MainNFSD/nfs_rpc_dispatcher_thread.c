@@ -44,7 +44,11 @@
 #endif
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <arpa/inet.h>
 #include <assert.h>
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
 #include "hashtable.h"
 #include "log.h"
 #include "gsh_rpc.h"
@@ -60,10 +64,15 @@
 #include "nfs_proto_functions.h"
 #include "nfs_dupreq.h"
 #include "nfs_file_handle.h"
+#include "mem_acct.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
 
 #define NFS_pcp nfs_param.core_param
 #define NFS_options NFS_pcp.core_options
 #define NFS_program NFS_pcp.program
+#define NFS_listeners NFS_pcp.rpc.listeners
 
 /**
  * TI-RPC event channels.  Each channel is a thread servicing an event
@@ -147,6 +156,14 @@ int tcp_socket[P_COUNT];
 SVCXPRT *udp_xprt[P_COUNT];
 SVCXPRT *tcp_xprt[P_COUNT];
 
+/* Sockets and channels of the NFS listeners past the first, which is
+ * udp_socket[P_NFS] and tcp_socket[P_NFS] on UDP_UREG_CHAN and
+ * TCP_UREG_CHAN.  Only the first one is registered with rpcbind.
+ */
+static int udp_listener[RPC_LISTENERS_MAX];
+static int tcp_listener[RPC_LISTENERS_MAX];
+static struct rpc_evchan listener_evchan[RPC_LISTENERS_MAX];
+
 /* Flag to indicate if V6 interfaces on the host are enabled */
 bool v6disabled;
 bool vsock;
@@ -237,6 +254,7 @@ static inline bool nfs_protocol_enabled(protos p)
 static void close_rpc_fd(void)
 {
 	protos p;
+	uint32_t i;
 
 	for (p = P_NFS; p < P_COUNT; p++) {
 		if (udp_socket[p] != -1)
@@ -244,6 +262,12 @@ static void close_rpc_fd(void)
 		if (tcp_socket[p] != -1)
 			close(tcp_socket[p]);
 	}
+	for (i = 1; i < NFS_listeners; i++) {
+		if (udp_listener[i] > 0)
+			close(udp_listener[i]);
+		if (tcp_listener[i] > 0)
+			close(tcp_listener[i]);
+	}
 	/* no need for special tcp_xprt[P_NFS_VSOCK] treatment */
 }
 
@@ -357,62 +381,123 @@ const svc_xprt_fun_t tcp_dispatch[] = {
 	NULL,
 };
 
-void Create_udp(protos prot)
+static SVCXPRT *create_udp_xprt(protos prot, int fd, uint32_t chan_id)
 {
-	udp_xprt[prot] =
-	    svc_dg_create(udp_socket[prot],
-			  nfs_param.core_param.rpc.max_send_buffer_size,
-			  nfs_param.core_param.rpc.max_recv_buffer_size);
-	if (udp_xprt[prot] == NULL)
+	SVCXPRT *xprt;
+
+	xprt = svc_dg_create(fd,
+			     nfs_param.core_param.rpc.max_send_buffer_size,
+			     nfs_param.core_param.rpc.max_recv_buffer_size);
+	if (xprt == NULL)
 		LogFatal(COMPONENT_DISPATCH, "Cannot allocate %s/UDP SVCXPRT",
 			 tags[prot]);
 
-	udp_xprt[prot]->xp_dispatch.rendezvous_cb = udp_dispatch[prot];
+	xprt->xp_dispatch.rendezvous_cb = udp_dispatch[prot];
 
 	/* Hook xp_free_user_data (finalize/free private data) */
-	(void)SVC_CONTROL(udp_xprt[prot], SVCSET_XP_FREE_USER_DATA,
+	(void)SVC_CONTROL(xprt, SVCSET_XP_FREE_USER_DATA,
 			  nfs_rpc_free_user_data);
 
-	(void)svc_rqst_evchan_reg(rpc_evchan[UDP_UREG_CHAN].chan_id,
-				  udp_xprt[prot], SVC_RQST_FLAG_XPRT_UREG);
+	(void)svc_rqst_evchan_reg(chan_id, xprt, SVC_RQST_FLAG_XPRT_UREG);
+	return xprt;
 }
 
-void Create_tcp(protos prot)
+static SVCXPRT *create_tcp_xprt(protos prot, int fd, uint32_t chan_id)
 {
-	tcp_xprt[prot] =
-		svc_vc_ncreatef(tcp_socket[prot],
-				nfs_param.core_param.rpc.max_send_buffer_size,
-				nfs_param.core_param.rpc.max_recv_buffer_size,
-				SVC_CREATE_FLAG_CLOSE | SVC_CREATE_FLAG_LISTEN);
-	if (tcp_xprt[prot] == NULL)
+	SVCXPRT *xprt;
+
+	xprt = svc_vc_ncreatef(fd,
+			       nfs_param.core_param.rpc.max_send_buffer_size,
+			       nfs_param.core_param.rpc.max_recv_buffer_size,
+			       SVC_CREATE_FLAG_CLOSE | SVC_CREATE_FLAG_LISTEN);
+	if (xprt == NULL)
 		LogFatal(COMPONENT_DISPATCH, "Cannot allocate %s/TCP SVCXPRT",
 			 tags[prot]);
 
-	tcp_xprt[prot]->xp_dispatch.rendezvous_cb = tcp_dispatch[prot];
+	xprt->xp_dispatch.rendezvous_cb = tcp_dispatch[prot];
 
 	/* Hook xp_free_user_data (finalize/free private data) */
-	(void)SVC_CONTROL(tcp_xprt[prot], SVCSET_XP_FREE_USER_DATA,
+	(void)SVC_CONTROL(xprt, SVCSET_XP_FREE_USER_DATA,
 			  nfs_rpc_free_user_data);
 
-	(void)svc_rqst_evchan_reg(rpc_evchan[TCP_UREG_CHAN].chan_id,
-				  tcp_xprt[prot], SVC_RQST_FLAG_XPRT_UREG);
+	(void)svc_rqst_evchan_reg(chan_id, xprt, SVC_RQST_FLAG_XPRT_UREG);
+	return xprt;
+}
+
+void Create_udp(protos prot)
+{
+	udp_xprt[prot] = create_udp_xprt(prot, udp_socket[prot],
+					 rpc_evchan[UDP_UREG_CHAN].chan_id);
+}
+
+void Create_tcp(protos prot)
+{
+	tcp_xprt[prot] = create_tcp_xprt(prot, tcp_socket[prot],
+					 rpc_evchan[TCP_UREG_CHAN].chan_id);
+}
+
+/**
+ * @brief Create the SVCXPRTs of the extra NFS listeners
+ *
+ * They share UDP and TCP dispatch with the first listener and need no
+ * svc_reg() of their own, the dispatch does not go through the
+ * callout table.
+ */
+static void Create_listeners(void)
+{
+	uint32_t i;
+
+	for (i = 1; i < NFS_listeners; i++) {
+		(void)create_udp_xprt(P_NFS, udp_listener[i],
+				      listener_evchan[i].chan_id);
+		(void)create_tcp_xprt(P_NFS, tcp_listener[i],
+				      listener_evchan[i].chan_id);
+	}
 }
 
 #ifdef _USE_NFS_RDMA
+static char rdma_node[INET6_ADDRSTRLEN];
+static char rdma_port[sizeof("65535")];
+
+/* node, port, depths, backlog and credits come from NFS_CORE_PARAM */
 struct rpc_rdma_attr rpc_rdma_xa = {
 	.statistics_prefix = NULL,
-	.node = "::",
-	.port = "20049",
-	.sq_depth = 32,			/* default was 50 */
+	.node = rdma_node,
+	.port = rdma_port,
 	.max_send_sge = 32,		/* minimum 2 */
-	.rq_depth = 32,			/* default was 50 */
 	.max_recv_sge = 31,		/* minimum 1 */
-	.backlog = 10,			/* minimum 2 */
-	.credits = 30,			/* default 10 */
 	.destroy_on_disconnect = true,
 	.use_srq = false,
 };
 
+/**
+ * @brief Set the RPC/RDMA listener attributes from the configuration
+ *
+ * The listener binds to Bind_Addr, like the sockets.  Each credit is
+ * a receive posted ahead and a reply in flight, so the queues are
+ * sized from the credits, with room for two more work requests.
+ */
+static void rdma_setup_attr(void)
+{
+	sockaddr_t *addr = (sockaddr_t *)&nfs_param.core_param.bind_addr;
+	const void *src;
+
+	if (addr->ss_family == AF_INET6)
+		src = &((struct sockaddr_in6 *)addr)->sin6_addr;
+	else
+		src = &((struct sockaddr_in *)addr)->sin_addr;
+	if (inet_ntop(addr->ss_family, src, rdma_node,
+		      sizeof(rdma_node)) == NULL)
+		strcpy(rdma_node, "::");
+	(void)snprintf(rdma_port, sizeof(rdma_port), "%" PRIu16,
+		       nfs_param.core_param.port[P_NFS_RDMA]);
+
+	rpc_rdma_xa.credits = nfs_param.core_param.rdma.credits;
+	rpc_rdma_xa.sq_depth = rpc_rdma_xa.credits + 2;
+	rpc_rdma_xa.rq_depth = rpc_rdma_xa.credits + 2;
+	rpc_rdma_xa.backlog = nfs_param.core_param.rdma.backlog;
+}
+
 static enum xprt_stat nfs_rpc_dispatch_RDMA(SVCXPRT *xprt)
 {
 	LogFullDebug(COMPONENT_DISPATCH,
@@ -424,6 +509,8 @@ static enum xprt_stat nfs_rpc_dispatch_RDMA(SVCXPRT *xprt)
 
 void Create_RDMA(protos prot)
 {
+	rdma_setup_attr();
+
 	/* This has elements of both UDP and TCP setup */
 	tcp_xprt[prot] =
 		svc_rdma_create(&rpc_rdma_xa,
@@ -441,6 +528,10 @@ void Create_RDMA(protos prot)
 
 	(void)svc_rqst_evchan_reg(rpc_evchan[RDMA_UREG_CHAN].chan_id,
 				  tcp_xprt[prot], SVC_RQST_FLAG_XPRT_UREG);
+
+	LogInfo(COMPONENT_DISPATCH,
+		"%s listening on [%s]:%s with %u credits",
+		tags[prot], rdma_node, rdma_port, rpc_rdma_xa.credits);
 }
 #endif
 
@@ -457,6 +548,7 @@ void Create_SVCXPRTs(void)
 			Create_udp(p);
 			Create_tcp(p);
 		}
+	Create_listeners();
 #ifdef RPC_VSOCK
 	if (vsock)
 		Create_tcp(P_NFS_VSOCK);
@@ -710,14 +802,14 @@ void Bind_sockets(void)
  *	  udp and tcp sockets
  *
  */
-static int alloc_socket_setopts(int p)
+static int socket_setopts(protos p, int udp_fd, int tcp_fd)
 {
 	int one = 1;
 	const struct nfs_core_param *nfs_cp = &nfs_param.core_param;
 
 	/* Use SO_REUSEADDR in order to avoid wait
 	 * the 2MSL timeout */
-	if (setsockopt(udp_socket[p],
+	if (setsockopt(udp_fd,
 		       SOL_SOCKET, SO_REUSEADDR,
 		       &one, sizeof(one))) {
 		LogWarn(COMPONENT_DISPATCH,
@@ -727,7 +819,7 @@ static int alloc_socket_setopts(int p)
 		return -1;
 	}
 
-	if (setsockopt(tcp_socket[p],
+	if (setsockopt(tcp_fd,
 		       SOL_SOCKET, SO_REUSEADDR,
 		       &one, sizeof(one))) {
 		LogWarn(COMPONENT_DISPATCH,
@@ -737,8 +829,23 @@ static int alloc_socket_setopts(int p)
 		return -1;
 	}
 
+#ifdef SO_REUSEPORT
+	/* Let the NFS listeners share the port */
+	if (p == P_NFS && NFS_listeners > 1 &&
+	    (setsockopt(udp_fd, SOL_SOCKET, SO_REUSEPORT,
+			&one, sizeof(one)) ||
+	     setsockopt(tcp_fd, SOL_SOCKET, SO_REUSEPORT,
+			&one, sizeof(one)))) {
+		LogWarn(COMPONENT_DISPATCH,
+			"Bad socket option reuseport for %s, error %d(%s)",
+			tags[p], errno, strerror(errno));
+
+		return -1;
+	}
+#endif
+
 	if (nfs_cp->enable_tcp_keepalive) {
-		if (setsockopt(tcp_socket[p],
+		if (setsockopt(tcp_fd,
 			       SOL_SOCKET, SO_KEEPALIVE,
 			       &one, sizeof(one))) {
 			LogWarn(COMPONENT_DISPATCH,
@@ -749,7 +856,7 @@ static int alloc_socket_setopts(int p)
 		}
 
 		if (nfs_cp->tcp_keepcnt) {
-			if (setsockopt(tcp_socket[p], IPPROTO_TCP, TCP_KEEPCNT,
+			if (setsockopt(tcp_fd, IPPROTO_TCP, TCP_KEEPCNT,
 				       &nfs_cp->tcp_keepcnt,
 				       sizeof(nfs_cp->tcp_keepcnt))) {
 				LogWarn(COMPONENT_DISPATCH,
@@ -761,7 +868,7 @@ static int alloc_socket_setopts(int p)
 		}
 
 		if (nfs_cp->tcp_keepidle) {
-			if (setsockopt(tcp_socket[p], IPPROTO_TCP, TCP_KEEPIDLE,
+			if (setsockopt(tcp_fd, IPPROTO_TCP, TCP_KEEPIDLE,
 				       &nfs_cp->tcp_keepidle,
 				       sizeof(nfs_cp->tcp_keepidle))) {
 				LogWarn(COMPONENT_DISPATCH,
@@ -773,7 +880,7 @@ static int alloc_socket_setopts(int p)
 		}
 
 		if (nfs_cp->tcp_keepintvl) {
-			if (setsockopt(tcp_socket[p], IPPROTO_TCP,
+			if (setsockopt(tcp_fd, IPPROTO_TCP,
 				       TCP_KEEPINTVL, &nfs_cp->tcp_keepintvl,
 				       sizeof(nfs_cp->tcp_keepintvl))) {
 				LogWarn(COMPONENT_DISPATCH,
@@ -787,7 +894,7 @@ static int alloc_socket_setopts(int p)
 
 	/* We prefer using non-blocking socket
 	 * in the specific case */
-	if (fcntl(udp_socket[p], F_SETFL, FNDELAY) == -1) {
+	if (fcntl(udp_fd, F_SETFL, FNDELAY) == -1) {
 		LogWarn(COMPONENT_DISPATCH,
 			"Cannot set udp socket for %s as non blocking, error %d(%s)",
 			tags[p], errno, strerror(errno));
@@ -798,6 +905,96 @@ static int alloc_socket_setopts(int p)
 	return 0;
 }
 
+static int alloc_socket_setopts(protos p)
+{
+	return socket_setopts(p, udp_socket[p], tcp_socket[p]);
+}
+
+/**
+ * @brief Spread a reuseport group over its sockets by receiving CPU
+ *
+ * Without a program, the kernel picks the socket by a hash of the
+ * addresses.  This one returns the CPU that took the packet modulo the
+ * number of listeners, so what the NIC steers to a CPU with RSS is
+ * always handed to the same listener.  The index of a socket in the
+ * group is the order it was bound in.
+ *
+ * @param[in] fd  Any socket of the group
+ * @param[in] n   Sockets in the group
+ */
+static void reuseport_steer_cpu(int fd, uint32_t n)
+{
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+	struct sock_filter code[] = {
+		{ BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU },
+		{ BPF_ALU | BPF_MOD | BPF_K, 0, 0, n },
+		{ BPF_RET | BPF_A, 0, 0, 0 },
+	};
+	struct sock_fprog prog = {
+		.len = sizeof(code) / sizeof(code[0]),
+		.filter = code,
+	};
+
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+		       &prog, sizeof(prog)))
+		LogInfo(COMPONENT_DISPATCH,
+			"Cannot steer listeners by CPU, error %d(%s), the kernel will hash",
+			errno, strerror(errno));
+#endif
+}
+
+/**
+ * @brief Allocate and bind the NFS listeners past the first
+ *
+ * They take the family, address and options of the first one, which
+ * must be bound already.
+ */
+static void Bind_listeners(void)
+{
+	proto_data *pdatap = &pdata[P_NFS];
+	int family = v6disabled ? AF_INET : AF_INET6;
+	uint32_t i;
+
+	if (NFS_listeners <= 1)
+		return;
+
+#ifdef SO_REUSEPORT
+	for (i = 1; i < NFS_listeners; i++) {
+		udp_listener[i] = socket(family, SOCK_DGRAM, IPPROTO_UDP);
+		tcp_listener[i] = socket(family, SOCK_STREAM, IPPROTO_TCP);
+		if (udp_listener[i] == -1 || tcp_listener[i] == -1)
+			LogFatal(COMPONENT_DISPATCH,
+				 "Cannot allocate %s listener %u, error %d(%s)",
+				 tags[P_NFS], i, errno, strerror(errno));
+
+		if (socket_setopts(P_NFS, udp_listener[i], tcp_listener[i]))
+			LogFatal(COMPONENT_DISPATCH,
+				 "Error setting socket option for %s listener %u",
+				 tags[P_NFS], i);
+
+		if (bind(udp_listener[i],
+			 (struct sockaddr *)pdatap->bindaddr_udp6.addr.buf,
+			 (socklen_t) pdatap->si_udp6.si_alen) == -1 ||
+		    bind(tcp_listener[i],
+			 (struct sockaddr *)pdatap->bindaddr_tcp6.addr.buf,
+			 (socklen_t) pdatap->si_tcp6.si_alen) == -1)
+			LogFatal(COMPONENT_DISPATCH,
+				 "Cannot bind %s listener %u, error %d(%s)",
+				 tags[P_NFS], i, errno, strerror(errno));
+	}
+
+	reuseport_steer_cpu(udp_socket[P_NFS], NFS_listeners);
+	reuseport_steer_cpu(tcp_socket[P_NFS], NFS_listeners);
+
+	LogInfo(COMPONENT_DISPATCH, "%u %s listeners on each of UDP and TCP",
+		NFS_listeners, tags[P_NFS]);
+#else
+	LogWarn(COMPONENT_DISPATCH,
+		"No SO_REUSEPORT, RPC_Listeners = %u ignored", NFS_listeners);
+	NFS_listeners = 1;
+#endif
+}
+
 /**
  * @brief Allocate the tcp and udp sockets for the nfs daemon
  * using V4 interfaces
@@ -1084,10 +1281,11 @@ void nfs_Init_svc(void)
 	svc_params.flags = SVC_INIT_EPOLL;	/* use EPOLL event mgmt */
 	svc_params.flags |= SVC_INIT_NOREG_XPRTS; /* don't call xprt_register */
 	svc_params.max_connections = nfs_param.core_param.rpc.max_connections;
-	svc_params.max_events = 1024;	/* length of epoll event queue */
+	svc_params.max_events = /* length of epoll event queue */
+		nfs_param.core_param.rpc.max_events;
 	svc_params.ioq_send_max =
 	    nfs_param.core_param.rpc.max_send_buffer_size;
-	svc_params.channels = N_EVENT_CHAN;
+	svc_params.channels = N_EVENT_CHAN + NFS_listeners - 1;
 	svc_params.idle_timeout = nfs_param.core_param.rpc.idle_timeout_s;
 	svc_params.ioq_thrd_max = /* max ioq worker threads */
 		nfs_param.core_param.rpc.ioq_thrd_max;
@@ -1115,6 +1313,16 @@ void nfs_Init_svc(void)
 		/* XXX bail?? */
 	}
 
+	for (ix = 1; ix < NFS_listeners; ++ix) {
+		code = svc_rqst_new_evchan(&listener_evchan[ix].chan_id,
+					   NULL /* u_data */,
+					   SVC_RQST_FLAG_NONE);
+		if (code)
+			LogFatal(COMPONENT_DISPATCH,
+				 "Cannot create TI-RPC event channel for listener %d (%d)",
+				 ix, code);
+	}
+
 	/* Get the netconfig entries from /etc/netconfig */
 	netconfig_udpv4 = (struct netconfig *)getnetconfigent("udp");
 	if (netconfig_udpv4 == NULL)
@@ -1157,6 +1365,7 @@ void nfs_Init_svc(void)
 	if ((NFS_options & CORE_OPTION_ALL_NFS_VERS) != 0) {
 		/* Bind the tcp and udp sockets */
 		Bind_sockets();
+		Bind_listeners();
 
 		/* Unregister from portmapper/rpcbind */
 		unregister_rpc();
@@ -1222,6 +1431,258 @@ void nfs_Init_svc(void)
 
 }
 
+/**
+ * Admission control
+ *
+ * Past Admission_High_Requests requests in progress, or
+ * Admission_High_Bytes of request and buffer memory, the thread
+ * receiving on a TCP connection with at least its share of the
+ * requests in progress waits before decoding the next one.  That
+ * connection isn't read meanwhile, so TCP flow control holds its
+ * client back, while connections with less than their share go on.
+ * All are read again once below the low watermarks.
+ *
+ * The wait is bounded by NFS_ADMISSION_MAX_WAIT: the next record may be
+ * the reply to a back channel call that a request in progress waits
+ * for.
+ */
+
+/** Longest a receive is held back, seconds */
+#define NFS_ADMISSION_MAX_WAIT 5
+
+/** State of a TCP connection, in xp_u1 */
+struct nfs_xprt_admission {
+	uint32_t inflight;	/*< Requests in progress, atomic */
+	uint32_t tls;		/*< Records go through kernel TLS, atomic */
+};
+
+static struct {
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	uint32_t inflight;	/*< Requests in progress, atomic */
+	uint32_t busy_xprts;	/*< Connections with some, atomic */
+	uint32_t waiting;	/*< Receives held back now */
+	uint32_t closed;	/*< Over the high watermarks, atomic */
+	uint64_t closings;	/*< Times the high watermarks were crossed */
+	uint64_t held;		/*< Receives held back */
+} admission = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static inline bool nfs_admission_enabled(void)
+{
+	return NFS_pcp.admission_high_requests != 0 ||
+	       NFS_pcp.admission_high_bytes != 0;
+}
+
+static inline uint64_t nfs_admission_bytes(void)
+{
+	return mem_acct_bytes(MEM_TAG_REQUEST) + mem_acct_bytes(MEM_TAG_BUFFER);
+}
+
+static inline uint64_t nfs_admission_low(uint64_t low, uint64_t high)
+{
+	return low != 0 && low < high ? low : high / 4 * 3;
+}
+
+/**
+ * @brief Close or reopen admission by the watermarks
+ *
+ * Called with admission.mtx held.
+ */
+static void nfs_admission_update(void)
+{
+	uint64_t high_r = NFS_pcp.admission_high_requests;
+	uint64_t high_b = NFS_pcp.admission_high_bytes;
+	uint64_t inflight = atomic_fetch_uint32_t(&admission.inflight);
+	uint64_t bytes = high_b != 0 ? nfs_admission_bytes() : 0;
+
+	if (!admission.closed) {
+		if ((high_r == 0 || inflight < high_r) &&
+		    (high_b == 0 || bytes < high_b))
+			return;
+
+		atomic_store_uint32_t(&admission.closed, true);
+		admission.closings++;
+		LogEvent(COMPONENT_DISPATCH,
+			 "Holding back busy connections, %" PRIu64
+			 " requests and %" PRIu64 " bytes in progress",
+			 inflight, bytes);
+		return;
+	}
+
+	if ((high_r != 0 &&
+	     inflight > nfs_admission_low(NFS_pcp.admission_low_requests,
+					   high_r)) ||
+	    (high_b != 0 &&
+	     bytes > nfs_admission_low(NFS_pcp.admission_low_bytes, high_b)))
+		return;
+
+	atomic_store_uint32_t(&admission.closed, false);
+	pthread_cond_broadcast(&admission.cond);
+	LogEvent(COMPONENT_DISPATCH,
+		 "Reading all connections again, %" PRIu64
+		 " requests and %" PRIu64 " bytes in progress",
+		 inflight, bytes);
+}
+
+/**
+ * @brief Whether a connection has at least its share of the requests
+ *
+ * @param[in] xa  Admission state of the connection
+ */
+static inline bool nfs_admission_over_share(struct nfs_xprt_admission *xa)
+{
+	uint64_t mine = atomic_fetch_uint32_t(&xa->inflight);
+	uint64_t busy = atomic_fetch_uint32_t(&admission.busy_xprts);
+
+	return mine != 0 &&
+	       mine * busy >= atomic_fetch_uint32_t(&admission.inflight);
+}
+
+/**
+ * @brief Wait for a connection to be admitted to receive a request
+ *
+ * @param[in] xprt  Connection about to decode a request
+ */
+static void nfs_admission_wait(SVCXPRT *xprt)
+{
+	struct nfs_xprt_admission *xa = xprt->xp_u1;
+	struct timespec deadline;
+	bool counted = false;
+
+	if (xa == NULL || !nfs_admission_enabled())
+		return;
+
+	if (!atomic_fetch_uint32_t(&admission.closed)) {
+		uint64_t high_r = NFS_pcp.admission_high_requests;
+		uint64_t high_b = NFS_pcp.admission_high_bytes;
+
+		if ((high_r == 0 ||
+		     atomic_fetch_uint32_t(&admission.inflight) < high_r) &&
+		    (high_b == 0 || nfs_admission_bytes() < high_b))
+			return;
+	}
+
+	PTHREAD_MUTEX_lock(&admission.mtx);
+
+	nfs_admission_update();
+
+	if (admission.closed && nfs_admission_over_share(xa)) {
+		now(&deadline);
+		deadline.tv_sec += NFS_ADMISSION_MAX_WAIT;
+		while (admission.closed && nfs_admission_over_share(xa)) {
+			if (!counted) {
+				admission.held++;
+				counted = true;
+			}
+			admission.waiting++;
+			if (pthread_cond_timedwait(&admission.cond,
+						   &admission.mtx,
+						   &deadline) == ETIMEDOUT) {
+				admission.waiting--;
+				break;
+			}
+			admission.waiting--;
+			nfs_admission_update();
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&admission.mtx);
+}
+
+/**
+ * @brief Account for a request coming in
+ *
+ * @param[in] xprt  Its transport
+ */
+static inline void nfs_admission_start(SVCXPRT *xprt)
+{
+	struct nfs_xprt_admission *xa = xprt->xp_u1;
+
+	(void) atomic_inc_uint32_t(&admission.inflight);
+	if (xa != NULL && atomic_inc_uint32_t(&xa->inflight) == 1)
+		(void) atomic_inc_uint32_t(&admission.busy_xprts);
+}
+
+/**
+ * @brief Account for a request done, and wake receives held back
+ *
+ * @param[in] xprt  Its transport
+ */
+static inline void nfs_admission_done(SVCXPRT *xprt)
+{
+	struct nfs_xprt_admission *xa = xprt->xp_u1;
+
+	if (xa != NULL && atomic_dec_uint32_t(&xa->inflight) == 0)
+		(void) atomic_dec_uint32_t(&admission.busy_xprts);
+	(void) atomic_dec_uint32_t(&admission.inflight);
+
+	if (!atomic_fetch_uint32_t(&admission.closed))
+		return;
+
+	PTHREAD_MUTEX_lock(&admission.mtx);
+	nfs_admission_update();
+	if (admission.waiting != 0)
+		pthread_cond_broadcast(&admission.cond);
+	PTHREAD_MUTEX_unlock(&admission.mtx);
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report the admission state
+ *
+ * struct admission {
+ *	bool closed;		(busy connections are held back)
+ *	uint32_t inflight;	(requests in progress)
+ *	uint64_t bytes;		(request and buffer memory)
+ *	uint32_t busy;		(TCP connections with requests in progress)
+ *	uint32_t waiting;	(receives held back now)
+ *	uint64_t closings;	(times the high watermarks were crossed)
+ *	uint64_t held;		(receives held back)
+ * }
+ *
+ * @param iter   [IN] iterator in reply stream to fill
+ */
+void nfs_admission_dbus_append(DBusMessageIter *iter)
+{
+	DBusMessageIter struct_iter;
+	struct timespec timestamp;
+	dbus_bool_t closed;
+	uint32_t inflight, busy, waiting;
+	uint64_t bytes, closings, held;
+
+	PTHREAD_MUTEX_lock(&admission.mtx);
+	closed = admission.closed;
+	waiting = admission.waiting;
+	closings = admission.closings;
+	held = admission.held;
+	PTHREAD_MUTEX_unlock(&admission.mtx);
+	inflight = atomic_fetch_uint32_t(&admission.inflight);
+	busy = atomic_fetch_uint32_t(&admission.busy_xprts);
+	bytes = nfs_admission_bytes();
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_BOOLEAN,
+				       &closed);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &inflight);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &bytes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32, &busy);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &waiting);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &closings);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &held);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+#endif				/* USE_DBUS */
+
 /**
  * @brief Rendezvous callout.  This routine will be called by TI-RPC
  *        after newxprt has been accepted.
@@ -1236,6 +1697,7 @@ void nfs_Init_svc(void)
  */
 static enum xprt_stat nfs_rpc_tcp_user_data(SVCXPRT *newxprt)
 {
+	newxprt->xp_u1 = gsh_calloc(1, sizeof(struct nfs_xprt_admission));
 	return SVC_STAT(newxprt->xp_parent);
 }
 
@@ -1250,9 +1712,38 @@ static enum xprt_stat nfs_rpc_free_user_data(SVCXPRT *xprt)
 		nfs_dupreq_put_drc(xprt->xp_u2, DRC_FLAG_RELEASE);
 		xprt->xp_u2 = NULL;
 	}
+	gsh_free(xprt->xp_u1);
+	xprt->xp_u1 = NULL;
 	return XPRT_DESTROYED;
 }
 
+/**
+ * @brief Mark a TCP connection as using RPC-over-TLS
+ *
+ * @param[in] xprt Transport whose TLS handshake completed
+ */
+void nfs_rpc_xprt_set_tls(SVCXPRT *xprt)
+{
+	struct nfs_xprt_admission *xa = xprt->xp_u1;
+
+	if (xa != NULL)
+		atomic_store_uint32_t(&xa->tls, 1);
+}
+
+/**
+ * @brief Whether a connection uses RPC-over-TLS
+ *
+ * @param[in] xprt Transport
+ *
+ * @return true once nfs_rpc_xprt_set_tls() was called on it
+ */
+bool nfs_rpc_xprt_tls(SVCXPRT *xprt)
+{
+	struct nfs_xprt_admission *xa = xprt->xp_u1;
+
+	return xa != NULL && atomic_fetch_uint32_t(&xa->tls) != 0;
+}
+
 
 /**
  * @brief Allocate a new request
@@ -1266,6 +1757,7 @@ static inline request_data_t *alloc_nfs_request(SVCXPRT *xprt, XDR *xdrs)
 	request_data_t *reqdata = pool_alloc(nfs_request_pool);
 
 	(void) atomic_inc_uint64_t(&nfs_health_.enqueued_reqs);
+	nfs_admission_start(xprt);
 
 	/* set the request as NFS already-read */
 	reqdata->rtype = NFS_REQUEST;
@@ -1298,6 +1790,7 @@ int free_nfs_request(request_data_t *reqdata)
 		if (reqdata->r_u.req.svc.rq_auth)
 			SVCAUTH_RELEASE(&(reqdata->r_u.req.svc));
 		XDR_DESTROY(reqdata->r_u.req.svc.rq_xdrs);
+		nfs_admission_done(xprt);
 		break;
 	default:
 		break;
@@ -1327,7 +1820,11 @@ static enum xprt_stat nfs_rpc_decode_request(SVCXPRT *xprt, XDR *xdrs)
 		 "%p fd %d context %p",
 		 xprt, xprt->xp_fd, xdrs);
 
+	/* Hold a busy connection back while over the watermarks */
+	nfs_admission_wait(xprt);
+
 	reqdata = alloc_nfs_request(xprt, xdrs);
+	now(&reqdata->time_queued);
 #if HAVE_BLKIN
 	blkin_init_new_trace(&reqdata->r_u.req.svc.bl_trace, "nfs-ganesha",
 			&xprt->blkin.endp);
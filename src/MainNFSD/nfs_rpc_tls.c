@@ -0,0 +1,258 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs_rpc_tls.c
+ * @brief RPC-over-TLS with kernel TLS
+ *
+ * A client starts TLS (RFC 9289) with a NULL call carrying AUTH_TLS.
+ * The reply carries the "STARTTLS" verifier, then the TLS 1.3
+ * handshake runs with OpenSSL on the receiving thread, blocking, while
+ * libntirpc does not read the connection.  Once done, OpenSSL has
+ * handed the keys to the kernel, which encrypts and decrypts the
+ * records from then on, so libntirpc goes on reading and writing plain
+ * RPC records on the same socket.
+ *
+ * The kernel cannot hand non application data records to a plain
+ * read, so a client sending one after the handshake, such as a
+ * KeyUpdate, has its connection closed.  Session tickets are not
+ * issued for the same reason.
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include "log.h"
+#include "nfs_core.h"
+#include "nfs_init.h"
+
+/** Longest a handshake may take, seconds */
+#define NFS_RPC_TLS_HANDSHAKE_TIMEOUT 10
+
+/** ALPN of RPC-over-TLS, RFC 9289 */
+static const unsigned char rpc_tls_alpn[] = "\x06sunrpc";
+
+static SSL_CTX *rpc_tls_ctx;
+
+/**
+ * @brief Log and clear the OpenSSL error queue
+ *
+ * @param[in] what  What failed
+ */
+static void rpc_tls_log_errors(const char *what)
+{
+	unsigned long err;
+	char buf[256];
+
+	while ((err = ERR_get_error()) != 0) {
+		ERR_error_string_n(err, buf, sizeof(buf));
+		LogWarn(COMPONENT_DISPATCH, "%s: %s", what, buf);
+	}
+}
+
+/**
+ * @brief Pick the sunrpc protocol in the client's ALPN list
+ */
+static int rpc_tls_alpn_select(SSL *ssl, const unsigned char **out,
+			       unsigned char *outlen, const unsigned char *in,
+			       unsigned int inlen, void *arg)
+{
+	unsigned char *sel;
+
+	if (SSL_select_next_proto(&sel, outlen, rpc_tls_alpn,
+				  sizeof(rpc_tls_alpn) - 1, in, inlen)
+	    != OPENSSL_NPN_NEGOTIATED)
+		return SSL_TLSEXT_ERR_ALERT_FATAL;
+
+	*out = sel;
+	return SSL_TLSEXT_ERR_OK;
+}
+
+/**
+ * @brief Build the TLS context
+ *
+ * Does nothing unless Enable_RPC_TLS is set.
+ *
+ * @return 0 on success, -1 when the context could not be built.
+ */
+int nfs_rpc_tls_pkginit(void)
+{
+	struct nfs_core_param *p = &nfs_param.core_param;
+	SSL_CTX *ctx;
+
+	if (!p->tls.enable)
+		return 0;
+
+	if (p->tls.cert_file == NULL || p->tls.key_file == NULL) {
+		LogCrit(COMPONENT_INIT,
+			"Enable_RPC_TLS needs RPC_TLS_Cert_File and RPC_TLS_Key_File");
+		return -1;
+	}
+
+	ctx = SSL_CTX_new(TLS_server_method());
+	if (ctx == NULL)
+		goto err;
+
+	/* RFC 9289 asks for TLS 1.3, and kernel TLS needs the keys of a
+	 * session that never changes once set up.
+	 */
+	if (!SSL_CTX_set_min_proto_version(ctx, TLS1_3_VERSION))
+		goto err;
+	SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+	if (!SSL_CTX_set_num_tickets(ctx, 0))
+		goto err;
+	SSL_CTX_set_alpn_select_cb(ctx, rpc_tls_alpn_select, NULL);
+
+	if (SSL_CTX_use_certificate_chain_file(ctx, p->tls.cert_file) != 1 ||
+	    SSL_CTX_use_PrivateKey_file(ctx, p->tls.key_file,
+					SSL_FILETYPE_PEM) != 1 ||
+	    SSL_CTX_check_private_key(ctx) != 1)
+		goto err;
+
+	if (p->tls.ca_file != NULL) {
+		if (SSL_CTX_load_verify_locations(ctx, p->tls.ca_file, NULL)
+		    != 1)
+			goto err;
+		SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER |
+				   SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL);
+	}
+
+	rpc_tls_ctx = ctx;
+	LogEvent(COMPONENT_INIT, "RPC-over-TLS enabled");
+	return 0;
+
+err:
+	rpc_tls_log_errors("Could not build the RPC-over-TLS context");
+	SSL_CTX_free(ctx);
+	return -1;
+}
+
+/**
+ * @brief Set a socket's receive and send timeouts
+ */
+static void rpc_tls_set_timeouts(int fd, const struct timeval *tv)
+{
+	(void)setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, tv, sizeof(*tv));
+	(void)setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, tv, sizeof(*tv));
+}
+
+/**
+ * @brief Run the TLS handshake and move the connection to kernel TLS
+ *
+ * @param[in] fd  Socket of the connection
+ *
+ * @return true if both directions now go through kernel TLS.
+ */
+static bool rpc_tls_handshake(int fd)
+{
+	struct timeval tv = { .tv_sec = NFS_RPC_TLS_HANDSHAKE_TIMEOUT };
+	struct timeval none = { 0 };
+	bool ok = false;
+	SSL *ssl;
+	int flags;
+
+	flags = fcntl(fd, F_GETFL);
+	if (flags < 0)
+		return false;
+
+	ssl = SSL_new(rpc_tls_ctx);
+	if (ssl == NULL) {
+		rpc_tls_log_errors("SSL_new");
+		return false;
+	}
+
+	/* libntirpc's sockets are non blocking, the handshake is easier
+	 * done blocking, with a bound.
+	 */
+	(void)fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+	rpc_tls_set_timeouts(fd, &tv);
+
+	if (SSL_set_fd(ssl, fd) != 1 || SSL_accept(ssl) != 1) {
+		rpc_tls_log_errors("RPC-over-TLS handshake failed");
+	} else if (!BIO_get_ktls_send(SSL_get_wbio(ssl)) ||
+		   !BIO_get_ktls_recv(SSL_get_rbio(ssl))) {
+		LogWarn(COMPONENT_DISPATCH,
+			"RPC-over-TLS needs kernel TLS in both directions, is the tls module loaded?");
+	} else {
+		ok = true;
+	}
+
+	rpc_tls_set_timeouts(fd, &none);
+	(void)fcntl(fd, F_SETFL, flags);
+
+	/* The socket BIO does not close the fd, and no close_notify is
+	 * sent: the session lives on in the kernel.
+	 */
+	SSL_free(ssl);
+	return ok;
+}
+
+/**
+ * @brief Handle a NULL call with AUTH_TLS
+ *
+ * Replies with the STARTTLS verifier and runs the handshake.  A
+ * connection whose handshake fails is shut down, since the client
+ * and the server no longer agree on what it carries.
+ *
+ * @param[in] reqdata  The NULL call
+ *
+ * @return Status of the transport.
+ */
+enum xprt_stat nfs_rpc_tls_start(request_data_t *reqdata)
+{
+	struct svc_req *req = &reqdata->r_u.req.svc;
+	SVCXPRT *xprt = req->rq_xprt;
+	enum xprt_stat xprt_rc;
+
+	if (rpc_tls_ctx == NULL || req->rq_msg.cb_proc != NULLPROC ||
+	    xprt->xp_type != XPRT_TCP || nfs_rpc_xprt_tls(xprt)) {
+		LogDebug(COMPONENT_DISPATCH,
+			 "Refusing AUTH_TLS on fd %d", xprt->xp_fd);
+		return svcerr_auth(req, AUTH_BADCRED);
+	}
+
+	(void)_svcauth_none(req);
+	req->rq_msg.RPCM_ack.ar_verf.oa_flavor = AUTH_NONE;
+	req->rq_msg.RPCM_ack.ar_verf.oa_base = "STARTTLS";
+	req->rq_msg.RPCM_ack.ar_verf.oa_length = 8;
+	req->rq_msg.RPCM_ack.ar_results.where = NULL;
+	req->rq_msg.RPCM_ack.ar_results.proc = (xdrproc_t) xdr_void;
+
+	xprt_rc = svc_sendreply(req);
+	if (xprt_rc >= XPRT_DIED)
+		return xprt_rc;
+
+	if (!rpc_tls_handshake(xprt->xp_fd)) {
+		(void)shutdown(xprt->xp_fd, SHUT_RDWR);
+		return SVC_STAT(xprt);
+	}
+
+	nfs_rpc_xprt_set_tls(xprt);
+	LogDebug(COMPONENT_DISPATCH,
+		 "fd %d now uses RPC-over-TLS", xprt->xp_fd);
+	return SVC_STAT(xprt);
+}
@@ -59,7 +59,11 @@
 #include "client_mgr.h"
 #include "export_mgr.h"
 #include "server_stats.h"
+#include "gsh_throttle.h"
+#include "gsh_partition.h"
 #include "uid2grp.h"
+#include "nfs_capture.h"
+#include "fridgethr.h"
 
 #ifdef USE_LTTNG
 #include "gsh_lttng/nfs_rpc.h"
@@ -660,13 +664,463 @@ const nfs_function_desc_t rquota2_func_desc[] = {
 				       .dispatch_behaviour = NEEDS_CRED}
 };
 
+#ifdef _USE_NFS3
 /**
- * @brief Main RPC dispatcher routine
+ * @brief Bytes an NFSv3 request moves, for throttling
+ *
+ * @param[in] reqdata  The request
+ *
+ * @return The READ or WRITE count, 0 for other procedures
+ */
+static uint64_t nfs3_throttle_bytes(request_data_t *reqdata)
+{
+	nfs_arg_t *arg_nfs = &reqdata->r_u.req.arg_nfs;
+
+	switch (reqdata->r_u.req.svc.rq_msg.cb_proc) {
+	case NFSPROC3_READ:
+		return arg_nfs->arg_read3.count;
+	case NFSPROC3_WRITE:
+		return arg_nfs->arg_write3.count;
+	default:
+		return 0;
+	}
+}
+#endif /* _USE_NFS3 */
+
+#ifdef _HAVE_GSSAPI
+/**
+ * @brief The service level of an RPCSEC_GSS request
+ *
+ * @param[in] req  The request
+ *
+ * @return The service level, 0 for other flavors.
+ */
+static rpc_gss_svc_t nfs_rpc_gss_svc(struct svc_req *req)
+{
+	struct rpc_gss_cred *gc;
+
+	if (req->rq_msg.RPCM_ack.ar_verf.oa_flavor != RPCSEC_GSS)
+		return 0;
+
+	gc = (struct rpc_gss_cred *)req->rq_msg.rq_cred_body;
+	return gc->gc_svc;
+}
+
+/**
+ * @brief Whether to time the crypto of a request
+ */
+static inline bool nfs_rpc_gss_timed(struct svc_req *req)
+{
+	return nfs_param.core_param.enable_NFSSTATS &&
+	       req->rq_msg.RPCM_ack.ar_verf.oa_flavor == RPCSEC_GSS;
+}
+#endif /* _HAVE_GSSAPI */
+
+/**
+ * @brief Send the reply of a processed request
+ *
+ * @param[in] reqdata	NFS request
+ * @param[in] rc	NFS_REQ_OK or NFS_REQ_DROP
+ */
+static void nfs_rpc_send_reply(request_data_t *reqdata, int rc)
+{
+	const nfs_function_desc_t *reqdesc = reqdata->r_u.req.funcdesc;
+	nfs_res_t *res_nfs = reqdata->r_u.req.res_nfs;
+	SVCXPRT *xprt = reqdata->r_u.req.svc.rq_xprt;
+	enum xprt_stat xprt_rc;
+#ifdef _HAVE_GSSAPI
+	struct timespec wrap_start, wrap_end;
+#endif
+
+/* NFSv4 stats are handled in nfs4_compound()
+ */
+	if (reqdata->r_u.req.svc.rq_msg.cb_prog != NFS_program[P_NFS]
+	    || reqdata->r_u.req.svc.rq_msg.cb_vers != NFS_V4)
+		server_stats_nfs_done(reqdata, rc, false);
+
+	/* If request is dropped, no return to the client */
+	if (rc == NFS_REQ_DROP) {
+		/* The request was dropped */
+		LogDebug(COMPONENT_DISPATCH,
+			 "Drop request rpc_xid=%" PRIu32
+			 ", program %" PRIu32
+			 ", version %" PRIu32
+			 ", function %" PRIu32,
+			 reqdata->r_u.req.svc.rq_msg.rm_xid,
+			 reqdata->r_u.req.svc.rq_msg.cb_prog,
+			 reqdata->r_u.req.svc.rq_msg.cb_vers,
+			 reqdata->r_u.req.svc.rq_msg.cb_proc);
+
+		/* If the request is not normally cached, then the entry
+		 * will be removed later.  We only remove a reply that is
+		 * normally cached that has been dropped.
+		 */
+		if (nfs_dupreq_delete(&reqdata->r_u.req.svc)
+		    != DUPREQ_SUCCESS) {
+			LogCrit(COMPONENT_DISPATCH,
+				"Attempt to delete duplicate request failed on line %d",
+				__LINE__);
+		}
+		return;
+	} else {
+		LogFullDebug(COMPONENT_DISPATCH,
+			     "Before svc_sendreply on socket %d", xprt->xp_fd);
+
+		reqdata->r_u.req.svc.rq_msg.RPCM_ack.ar_results.where = res_nfs;
+		reqdata->r_u.req.svc.rq_msg.RPCM_ack.ar_results.proc =
+					reqdesc->xdr_encode_func;
+#ifdef _HAVE_GSSAPI
+		if (nfs_rpc_gss_timed(&reqdata->r_u.req.svc))
+			now(&wrap_start);
+#endif
+		xprt_rc = svc_sendreply(&reqdata->r_u.req.svc);
+#ifdef _HAVE_GSSAPI
+		if (nfs_rpc_gss_timed(&reqdata->r_u.req.svc)) {
+			now(&wrap_end);
+			gss_stats_wrap(nfs_rpc_gss_svc(&reqdata->r_u.req.svc),
+				       timespec_diff(&wrap_start, &wrap_end));
+		}
+#endif
+		if (xprt_rc >= XPRT_DIED) {
+			LogDebug(COMPONENT_DISPATCH,
+				 "NFS DISPATCHER: FAILURE: Error while calling svc_sendreply on a new request. rpcxid=%"
+				 PRIu32
+				 " socket=%d function:%s client:%s program:%"
+				 PRIu32
+				 " nfs version:%" PRIu32
+				 " proc:%" PRIu32
+				 " errno: %d",
+				 reqdata->r_u.req.svc.rq_msg.rm_xid,
+				 xprt->xp_fd,
+				 reqdesc->funcname,
+				 op_ctx->client != NULL
+					? op_ctx->client->hostaddr_str
+					: "<unknown client>",
+				 reqdata->r_u.req.svc.rq_msg.cb_prog,
+				 reqdata->r_u.req.svc.rq_msg.cb_vers,
+				 reqdata->r_u.req.svc.rq_msg.cb_proc,
+				 errno);
+			SVC_DESTROY(xprt);
+			return;
+		}
+
+		LogFullDebug(COMPONENT_DISPATCH,
+			     "After svc_sendreply on socket %d", xprt->xp_fd);
+
+	}			/* rc == NFS_REQ_DROP */
+
+	/* Finish any request not already deleted */
+	(void) nfs_dupreq_finish(&reqdata->r_u.req.svc, res_nfs);
+}
+
+/**
+ * @brief The time since boot, to time the stages of a request
+ */
+static inline nsecs_elapsed_t nfs_rpc_stamp(void)
+{
+	struct timespec ts;
+
+	now(&ts);
+	return timespec_diff(&nfs_ServerBootTime, &ts);
+}
+
+/* Rate limiting and sampling of the slow request log */
+static pthread_mutex_t slow_req_mtx = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t slow_req_seen;		/*< Slow requests, for sampling */
+static time_t slow_req_second;		/*< Second being rate limited */
+static uint32_t slow_req_logged;	/*< Logged in that second */
+static uint64_t slow_req_skipped;	/*< Left out since the last logged */
+
+/**
+ * @brief Whether to time the stages of requests
+ */
+static inline bool nfs_rpc_stages_timed(void)
+{
+	return nfs_param.core_param.enable_STAGE_HIST ||
+	       nfs_param.core_param.slow_request_threshold != 0;
+}
+
+/**
+ * @brief Pick the slow requests that are logged
+ *
+ * One in Slow_Request_Sample, and no more than Slow_Request_Log_Rate a
+ * second.
+ *
+ * @param[out] skipped	Slow requests left out since the last logged
+ *
+ * @return true if this one is logged.
+ */
+static bool nfs_rpc_slow_pick(uint64_t *skipped)
+{
+	time_t second = time(NULL);
+	bool pick;
+
+	PTHREAD_MUTEX_lock(&slow_req_mtx);
+	if (second != slow_req_second) {
+		slow_req_second = second;
+		slow_req_logged = 0;
+	}
+	pick = slow_req_seen++ % nfs_param.core_param.slow_request_sample == 0
+	       && slow_req_logged < nfs_param.core_param.slow_request_log_rate;
+	if (pick) {
+		slow_req_logged++;
+		*skipped = slow_req_skipped;
+		slow_req_skipped = 0;
+	} else {
+		slow_req_skipped++;
+	}
+	PTHREAD_MUTEX_unlock(&slow_req_mtx);
+
+	return pick;
+}
+
+/**
+ * @brief Log a request slower than Slow_Request_Threshold
+ *
+ * @param[in] reqdata	NFS request
+ * @param[in] stage	Time it spent in each stage
+ * @param[in] total	Time from its receipt to the end of its reply
+ */
+static void nfs_rpc_log_slow(request_data_t *reqdata,
+			     const nsecs_elapsed_t *stage,
+			     nsecs_elapsed_t total)
+{
+	struct svc_req *req = &reqdata->r_u.req.svc;
+	nfs_arg_t *arg_nfs = &reqdata->r_u.req.arg_nfs;
+	char str[LOG_BUFF_LEN];
+	struct display_buffer dspbuf = {sizeof(str), str, str};
+	uint64_t skipped = 0;
+	uint32_t i;
+
+	if (!isLevel(COMPONENT_SLOW_REQ, NIV_WARN) ||
+	    !nfs_rpc_slow_pick(&skipped))
+		return;
+
+	(void) display_printf(&dspbuf, "%s xid=%" PRIu32 " client=%s export=%d",
+			      reqdata->r_u.req.funcdesc->funcname,
+			      req->rq_msg.rm_xid,
+			      op_ctx->client != NULL
+					? op_ctx->client->hostaddr_str
+					: "<unknown client>",
+			      op_ctx->ctx_export != NULL
+					? op_ctx->ctx_export->export_id : -1);
+
+	if (req->rq_msg.cb_prog == NFS_program[P_NFS] &&
+	    req->rq_msg.cb_vers == NFS_V4 &&
+	    req->rq_msg.cb_proc == NFSPROC4_COMPOUND) {
+		COMPOUND4args *args = &arg_nfs->arg_compound4;
+		nfs_fh4 *fh = NULL;
+
+		(void) display_cat(&dspbuf, " ops=");
+		for (i = 0; i < args->argarray.argarray_len; i++) {
+			nfs_argop4 *op = &args->argarray.argarray_val[i];
+
+			(void) display_printf(&dspbuf, "%s%s", i ? "," : "",
+					      nfs4_op_name(op->argop));
+			if (fh == NULL && op->argop == NFS4_OP_PUTFH)
+				fh = &op->nfs_argop4_u.opputfh.object;
+		}
+		if (fh != NULL) {
+			(void) display_cat(&dspbuf, " handle=");
+			(void) display_opaque_bytes(&dspbuf, fh->nfs_fh4_val,
+						    fh->nfs_fh4_len);
+		}
+	}
+#ifdef _USE_NFS3
+	else if (req->rq_msg.cb_prog == NFS_program[P_NFS] &&
+		 req->rq_msg.cb_vers == NFS_V3 &&
+		 req->rq_msg.cb_proc != NFSPROC3_NULL) {
+		/* The arguments always begin with the handle */
+		nfs_fh3 *fh = (nfs_fh3 *) arg_nfs;
+
+		(void) display_cat(&dspbuf, " handle=");
+		(void) display_opaque_bytes(&dspbuf, fh->data.data_val,
+					    fh->data.data_len);
+	}
+#endif /* _USE_NFS3 */
+
+	(void) display_printf(&dspbuf,
+			      " total=%" PRIu64 "us decode=%" PRIu64
+			      "us queue=%" PRIu64 "us execute=%" PRIu64
+			      "us fsal=%" PRIu64 "us reply=%" PRIu64 "us",
+			      total / NS_PER_USEC,
+			      stage[REQ_STAGE_DECODE] / NS_PER_USEC,
+			      stage[REQ_STAGE_QUEUE] / NS_PER_USEC,
+			      stage[REQ_STAGE_EXECUTE] / NS_PER_USEC,
+			      stage[REQ_STAGE_FSAL] / NS_PER_USEC,
+			      stage[REQ_STAGE_REPLY] / NS_PER_USEC);
+
+	if (op_ctx->fsal_ncalls != 0) {
+		(void) display_cat(&dspbuf, " fsal_calls=");
+		for (i = 0; i < op_ctx->fsal_ncalls && i < REQ_FSAL_CALLS; i++)
+			(void) display_printf(&dspbuf, "%s%s:%" PRIu64 "us",
+					      i ? "," : "",
+					      op_ctx->fsal_calls[i].func,
+					      op_ctx->fsal_calls[i].duration
+						/ NS_PER_USEC);
+		if (op_ctx->fsal_ncalls > REQ_FSAL_CALLS)
+			(void) display_printf(&dspbuf, ",%" PRIu32 " more",
+					      op_ctx->fsal_ncalls -
+					      REQ_FSAL_CALLS);
+	}
+
+	if (skipped != 0)
+		(void) display_printf(&dspbuf,
+				      " (%" PRIu64 " slow requests not logged)",
+				      skipped);
+
+	LogWarn(COMPONENT_SLOW_REQ, "%s", str);
+}
+
+/**
+ * @brief Account for the stages of a request that was replied to
+ *
+ * @param[in] reqdata		NFS request
+ * @param[in] reply_start	When its reply started
+ */
+static void nfs_rpc_stages_done(request_data_t *reqdata,
+				nsecs_elapsed_t reply_start)
+{
+	nsecs_elapsed_t stage[REQ_STAGE_COUNT];
+	nsecs_elapsed_t exec = reply_start - reqdata->exec_time;
+	nsecs_elapsed_t total;
+	uint32_t threshold = nfs_param.core_param.slow_request_threshold;
+
+	stage[REQ_STAGE_DECODE] = reqdata->decoded_time -
+		timespec_diff(&nfs_ServerBootTime, &reqdata->time_queued);
+	stage[REQ_STAGE_QUEUE] = reqdata->exec_time - reqdata->decoded_time;
+	stage[REQ_STAGE_FSAL] = op_ctx->fsal_time < exec
+		? op_ctx->fsal_time : exec;
+	stage[REQ_STAGE_EXECUTE] = exec - stage[REQ_STAGE_FSAL];
+	stage[REQ_STAGE_REPLY] = nfs_rpc_stamp() - reply_start;
+
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, stages, reqdata,
+		   reqdata->r_u.req.svc.rq_msg.rm_xid,
+		   stage[REQ_STAGE_DECODE], stage[REQ_STAGE_QUEUE],
+		   stage[REQ_STAGE_EXECUTE], stage[REQ_STAGE_FSAL],
+		   stage[REQ_STAGE_REPLY]);
+#endif
+
+	server_stats_stages_done(reqdata, stage);
+
+	total = stage[REQ_STAGE_DECODE] + stage[REQ_STAGE_QUEUE] + exec +
+		stage[REQ_STAGE_REPLY];
+	if (threshold != 0 && total >= threshold * NS_PER_MSEC)
+		nfs_rpc_log_slow(reqdata, stage, total);
+}
+
+/**
+ * @brief Reply to a processed request and account for it
+ *
+ * @param[in] reqdata	NFS request
+ * @param[in] rc	NFS_REQ_OK or NFS_REQ_DROP
+ */
+static void nfs_rpc_reply(request_data_t *reqdata, int rc)
+{
+	nsecs_elapsed_t reply_start = 0;
+
+	/* Requests that failed before executing have no stages */
+	if (reqdata->exec_time != 0)
+		reply_start = nfs_rpc_stamp();
+
+	nfs_rpc_send_reply(reqdata, rc);
+
+	if (reply_start != 0)
+		nfs_rpc_stages_done(reqdata, reply_start);
+	if (unlikely(nfs_capture_on))
+		nfs_capture_request(reqdata, rc);
+}
+
+/**
+ * @brief Free the arguments and the context of a request
+ *
+ * @param[in] reqdata	NFS request
+ */
+static void nfs_rpc_release_request(request_data_t *reqdata)
+{
+	const nfs_function_desc_t *reqdesc = reqdata->r_u.req.funcdesc;
+	nfs_arg_t *arg_nfs = &reqdata->r_u.req.arg_nfs;
+
+	/* Free the allocated resources once the work is done */
+	/* Free the arguments */
+	if ((reqdata->r_u.req.svc.rq_msg.cb_vers == 2)
+	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 3)
+	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 4)) {
+		if (!xdr_free(reqdesc->xdr_decode_func, arg_nfs)) {
+			LogCrit(COMPONENT_DISPATCH,
+				"%s FAILURE: Bad xdr_free for %s",
+				__func__,
+				reqdesc->funcname);
+		}
+	}
+
+	/* Finalize the request. */
+	if (reqdata->r_u.req.res_nfs)
+		nfs_dupreq_rele(&reqdata->r_u.req.svc, reqdesc);
+
+	SetClientIP(NULL);
+	nfs_partition_exit();
+	if (op_ctx->client != NULL) {
+		put_gsh_client(op_ctx->client);
+		op_ctx->client = NULL;
+	}
+	if (op_ctx->ctx_export != NULL) {
+		put_gsh_export(op_ctx->ctx_export);
+		op_ctx->ctx_export = NULL;
+	}
+	clean_credentials();
+	op_ctx = NULL;
+
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, end, reqdata);
+#endif
+}
+
+/**
+ * @brief Whether a request is not worth executing any more
+ *
+ * A request whose connection is gone can't be answered.  One waiting
+ * longer than Max_Request_Age has likely been given up on by a client
+ * that will retransmit it, or already has; NFSv4 clients don't on the
+ * same connection, so those are kept whatever their age.
+ *
+ * @param[in] reqdata	NFS request, not yet decoded
+ *
+ * @return true to drop the request without a reply.
+ */
+static bool nfs_rpc_request_stale(request_data_t *reqdata)
+{
+	struct svc_req *req = &reqdata->r_u.req.svc;
+	uint32_t max_age = nfs_param.core_param.max_request_age;
+	struct timespec ts;
+
+	if (SVC_STAT(req->rq_xprt) >= XPRT_DIED) {
+		server_stats_req_dropped(REQ_DROP_XPRT);
+		return true;
+	}
+
+	if (max_age == 0 ||
+	    (req->rq_msg.cb_prog == NFS_program[P_NFS] &&
+	     req->rq_msg.cb_vers == NFS_V4))
+		return false;
+
+	now(&ts);
+	if (timespec_diff(&reqdata->time_queued, &ts) <
+	    max_age * NS_PER_MSEC)
+		return false;
+
+	server_stats_req_dropped(REQ_DROP_AGE);
+	return true;
+}
+
+/**
+ * @brief Decode, run and reply to an authenticated request
  *
  * @param[in,out] reqdata	NFS request
  *
  */
-static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
+static enum xprt_stat nfs_rpc_execute_request(request_data_t *reqdata)
 {
 	const char *client_ip = "<unknown client>";
 	const char *progname = "unknown";
@@ -675,72 +1129,30 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 	SVCXPRT *xprt = reqdata->r_u.req.svc.rq_xprt;
 	XDR *xdrs = reqdata->r_u.req.svc.rq_xdrs;
 	nfs_res_t *res_nfs;
-	struct export_perms export_perms;
-	struct user_cred user_credentials;
-	struct req_op_context req_ctx;
+	struct export_perms *export_perms = &reqdata->r_u.req.export_perms;
+	struct req_op_context *req_ctx = &reqdata->r_u.req.req_ctx;
 	dupreq_status_t dpq_status;
 	struct timespec timer_start;
 	enum auth_stat auth_rc;
 	enum xprt_stat xprt_rc;
 	int port;
 	int rc = NFS_REQ_OK;
+	bool decoded;
 #ifdef _USE_NFS3
 	int exportid = -1;
 #endif /* _USE_NFS3 */
-	bool no_dispatch = false;
-
-#ifdef USE_LTTNG
-	tracepoint(nfs_rpc, start, reqdata);
-#endif
-
-#if defined(HAVE_BLKIN)
-	BLKIN_TIMESTAMP(
-		&reqdata->r_u.req.svc.bl_trace,
-		&reqdata->r_u.req.svc.rq_xprt->blkin.endp,
-		"nfs_rpc_process_request-start");
-#endif
-
-	LogFullDebug(COMPONENT_DISPATCH,
-		     "About to authenticate Prog=%" PRIu32
-		     ", vers=%" PRIu32
-		     ", proc=%" PRIu32
-		     ", xid=%" PRIu32
-		     ", SVCXPRT=%p, fd=%d",
-		     reqdata->r_u.req.svc.rq_msg.cb_prog,
-		     reqdata->r_u.req.svc.rq_msg.cb_vers,
-		     reqdata->r_u.req.svc.rq_msg.cb_proc,
-		     reqdata->r_u.req.svc.rq_msg.rm_xid,
-		     xprt, xprt->xp_fd);
-
-	/* If authentication is AUTH_NONE or AUTH_UNIX, then the value of
-	 * no_dispatch remains false and the request proceeds normally.
-	 *
-	 * If authentication is RPCSEC_GSS, no_dispatch may have value true,
-	 * this means that gc->gc_proc != RPCSEC_GSS_DATA and that the message
-	 * is in fact an internal negotiation message from RPCSEC_GSS using
-	 * GSSAPI. It should not be processed by the worker and SVC_STAT
-	 * should be returned to the dispatcher.
-	 */
-	auth_rc = svc_auth_authenticate(&reqdata->r_u.req.svc, &no_dispatch);
-	if (auth_rc != AUTH_OK) {
-		LogInfo(COMPONENT_DISPATCH,
-			"Could not authenticate request... rejecting with AUTH_STAT=%s",
-			auth_stat2str(auth_rc));
-		return svcerr_auth(&reqdata->r_u.req.svc, auth_rc);
 #ifdef _HAVE_GSSAPI
-	} else if (reqdata->r_u.req.svc.rq_msg.RPCM_ack.ar_verf.oa_flavor
-		   == RPCSEC_GSS) {
-		struct rpc_gss_cred *gc = (struct rpc_gss_cred *)
-			reqdata->r_u.req.svc.rq_msg.rq_cred_body;
-
-		LogFullDebug(COMPONENT_DISPATCH,
-			     "RPCSEC_GSS no_dispatch=%d gc->gc_proc=(%"
-			     PRIu32 ") %s",
-			     no_dispatch, gc->gc_proc,
-			     str_gc_proc(gc->gc_proc));
-		if (no_dispatch)
-			return SVC_STAT(xprt);
+	struct timespec unwrap_start, unwrap_end;
 #endif
+
+	/* Don't spend the unwrap on a request that is to be dropped */
+	if (nfs_rpc_request_stale(reqdata)) {
+		LogDebug(COMPONENT_DISPATCH,
+			 "Dropping stale request xid=%" PRIu32
+			 " on SVCXPRT %p fd %d",
+			 reqdata->r_u.req.svc.rq_msg.rm_xid,
+			 xprt, xprt->xp_fd);
+		return SVC_STAT(xprt);
 	}
 
 	/*
@@ -755,7 +1167,23 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 	reqdata->r_u.req.svc.rq_msg.rm_xdr.proc = reqdesc->xdr_decode_func;
 	xdrs->x_public = &reqdata->r_u.req.lookahead;
 
-	if (!SVCAUTH_CHECKSUM(&reqdata->r_u.req.svc)) {
+#ifdef _HAVE_GSSAPI
+	if (nfs_rpc_gss_timed(&reqdata->r_u.req.svc))
+		now(&unwrap_start);
+#endif
+	decoded = SVCAUTH_CHECKSUM(&reqdata->r_u.req.svc);
+#ifdef _HAVE_GSSAPI
+	if (nfs_rpc_gss_timed(&reqdata->r_u.req.svc)) {
+		now(&unwrap_end);
+		gss_stats_unwrap(nfs_rpc_gss_svc(&reqdata->r_u.req.svc),
+				 timespec_diff(&unwrap_start, &unwrap_end));
+	}
+#endif
+
+	if (decoded && nfs_rpc_stages_timed())
+		reqdata->decoded_time = nfs_rpc_stamp();
+
+	if (!decoded) {
 		LogInfo(COMPONENT_DISPATCH,
 			"SVCAUTH_CHECKSUM failed for Program %" PRIu32
 			", Version %" PRIu32
@@ -779,14 +1207,34 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 
 	/* set up the request context
 	 */
-	memset(&export_perms, 0, sizeof(export_perms));
-	memset(&req_ctx, 0, sizeof(req_ctx));
-	op_ctx = &req_ctx;
-	op_ctx->creds = &user_credentials;
+	memset(export_perms, 0, sizeof(*export_perms));
+	memset(req_ctx, 0, sizeof(*req_ctx));
+	op_ctx = req_ctx;
+	op_ctx->creds = &reqdata->r_u.req.user_credentials;
 	op_ctx->caller_addr = (sockaddr_t *)svc_getrpccaller(xprt);
 	op_ctx->nfs_vers = reqdata->r_u.req.svc.rq_msg.cb_vers;
 	op_ctx->req_type = reqdata->rtype;
-	op_ctx->export_perms = &export_perms;
+	op_ctx->export_perms = export_perms;
+	op_ctx->time_fsal = reqdata->decoded_time != 0;
+	if (op_ctx->time_fsal &&
+	    nfs_param.core_param.slow_request_threshold != 0)
+		op_ctx->fsal_calls = reqdata->fsal_calls;
+	if (nfs_param.core_param.enable_TOP_TRACKING) {
+		/* NFSv4 operations set it as they go */
+		op_ctx->top_fh = &reqdata->top_fh;
+		reqdata->top_fh.len = 0;
+#ifdef _USE_NFS3
+		if (reqdata->r_u.req.svc.rq_msg.cb_prog == NFS_program[P_NFS] &&
+		    op_ctx->nfs_vers == NFS_V3 &&
+		    reqdata->r_u.req.svc.rq_msg.cb_proc != NFSPROC3_NULL) {
+			/* The arguments always begin with the handle */
+			nfs_fh3 *fh = (nfs_fh3 *) arg_nfs;
+
+			server_topk_key(&reqdata->top_fh, fh->data.data_val,
+					fh->data.data_len);
+		}
+#endif /* _USE_NFS3 */
+	}
 
 	/* Set up initial export permissions that don't allow anything. */
 	export_check_access();
@@ -868,10 +1316,8 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 				     "Before svc_sendreply on socket %d (dup req)",
 				     xprt->xp_fd);
 
-			reqdata->r_u.req.svc.rq_msg.RPCM_ack.ar_results.where =
-						res_nfs;
-			reqdata->r_u.req.svc.rq_msg.RPCM_ack.ar_results.proc =
-						reqdesc->xdr_encode_func;
+			nfs_dupreq_reply_results(&reqdata->r_u.req.svc,
+						 reqdesc);
 			xprt_rc = svc_sendreply(&reqdata->r_u.req.svc);
 			if (xprt_rc >= XPRT_DIED) {
 				LogDebug(COMPONENT_DISPATCH,
@@ -900,6 +1346,7 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 				     "DUP: Request xid=%" PRIu32
 				     " is already being processed; the active thread will reply",
 				     reqdata->r_u.req.svc.rq_msg.rm_xid);
+			server_stats_req_dropped(REQ_DROP_DUPLICATE);
 			/* Free the arguments */
 			/* Ignore the request, send no error */
 			break;
@@ -1098,7 +1545,7 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 
 		export_check_access();
 
-		if ((export_perms.options & EXPORT_OPTION_ACCESS_MASK) == 0) {
+		if ((export_perms->options & EXPORT_OPTION_ACCESS_MASK) == 0) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"Client %s is not allowed to access Export_Id %d %s, vers=%"
 				PRIu32 ", proc=%" PRIu32,
@@ -1112,7 +1559,7 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 			goto auth_failure;
 		}
 
-		if ((EXPORT_OPTION_NFSV3 & export_perms.options) == 0) {
+		if ((EXPORT_OPTION_NFSV3 & export_perms->options) == 0) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"%s Version %" PRIu32
 				" not allowed on Export_Id %d %s for client %s",
@@ -1128,9 +1575,10 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 
 		/* Check transport type */
 		if (((xprt_type == XPRT_UDP)
-		     && ((export_perms.options & EXPORT_OPTION_UDP) == 0))
+		     && ((export_perms->options & EXPORT_OPTION_UDP) == 0))
 		    || ((xprt_type == XPRT_TCP)
-			&& ((export_perms.options & EXPORT_OPTION_TCP) == 0))) {
+			&& ((export_perms->options &
+			     EXPORT_OPTION_TCP) == 0))) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"%s Version %" PRIu32
 				" over %s not allowed on Export_Id %d %s for client %s",
@@ -1164,7 +1612,7 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 		/* Check if client is using a privileged port,
 		 * but only for NFS protocol */
 		if ((reqdata->r_u.req.svc.rq_msg.cb_prog == NFS_program[P_NFS])
-		 && (export_perms.options & EXPORT_OPTION_PRIVILEGED_PORT)
+		 && (export_perms->options & EXPORT_OPTION_PRIVILEGED_PORT)
 		 && (port >= IPPORT_RESERVED)) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"Non-reserved Port %d is not allowed on Export_Id %d %s for client %s",
@@ -1183,7 +1631,7 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 	 */
 	if (op_ctx->ctx_export != NULL
 	    && (reqdesc->dispatch_behaviour & MAKES_IO)
-	    && !(export_perms.options & EXPORT_OPTION_RW_ACCESS)) {
+	    && !(export_perms->options & EXPORT_OPTION_RW_ACCESS)) {
 		/* Request of type MDONLY_RO were rejected at the
 		 * nfs_rpc_dispatcher level.
 		 * This is done by replying EDQUOT
@@ -1215,7 +1663,7 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 		}
 	} else if (op_ctx->ctx_export != NULL
 		   && (reqdesc->dispatch_behaviour & MAKES_WRITE)
-		   && (export_perms.options
+		   && (export_perms->options
 		       & (EXPORT_OPTION_WRITE_ACCESS
 			| EXPORT_OPTION_MD_WRITE_ACCESS)) == 0) {
 		if (reqdata->r_u.req.svc.rq_msg.cb_prog == NFS_program[P_NFS])
@@ -1242,7 +1690,7 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 			rc = NFS_REQ_DROP;
 		}
 	} else if (op_ctx->ctx_export != NULL
-		   && (export_perms.options
+		   && (export_perms->options
 		       & (EXPORT_OPTION_READ_ACCESS
 			 | EXPORT_OPTION_MD_READ_ACCESS)) == 0) {
 		LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
@@ -1259,7 +1707,7 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 		if (reqdesc->dispatch_behaviour & NEEDS_CRED) {
 			/* If we don't have an export, don't squash */
 			if (op_ctx->fsal_export == NULL) {
-				export_perms.options &=
+				export_perms->options &=
 					~EXPORT_OPTION_SQUASH_TYPES;
 			}
 
@@ -1273,6 +1721,28 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 			}
 		}
 
+#ifdef _USE_NFS3
+		if (op_ctx->ctx_export != NULL &&
+		    reqdata->r_u.req.svc.rq_msg.cb_prog == NFS_program[P_NFS] &&
+		    reqdata->r_u.req.svc.rq_msg.cb_vers == NFS_V3 &&
+		    nfs_throttle(nfs3_throttle_bytes(reqdata)) != 0) {
+			/* Over budget, have the client come back later */
+			res_nfs->res_getattr3.status = NFS3ERR_JUKEBOX;
+			rc = NFS_REQ_OK;
+			goto req_error;
+		}
+
+		if (op_ctx->ctx_export != NULL &&
+		    reqdata->r_u.req.svc.rq_msg.cb_prog == NFS_program[P_NFS] &&
+		    reqdata->r_u.req.svc.rq_msg.cb_vers == NFS_V3 &&
+		    nfs_partition_enter(false) != 0) {
+			/* Partition full, don't tie up this thread too */
+			res_nfs->res_getattr3.status = NFS3ERR_JUKEBOX;
+			rc = NFS_REQ_OK;
+			goto req_error;
+		}
+#endif /* _USE_NFS3 */
+
 		/* processing
 		 * At this point, op_ctx->ctx_export has one of the following
 		 * conditions:
@@ -1299,6 +1769,12 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 
  null_op:
 
+		/* FSAL calls made before executing count as queued */
+		if (op_ctx->time_fsal) {
+			reqdata->exec_time = nfs_rpc_stamp();
+			op_ctx->fsal_time = 0;
+		}
+
 #ifdef USE_LTTNG
 		tracepoint(nfs_rpc, op_start, reqdata,
 			   reqdesc->funcname,
@@ -1345,73 +1821,16 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
  req_error:
 #endif /* _USE_NFS3 */
 
-/* NFSv4 stats are handled in nfs4_compound()
- */
-	if (reqdata->r_u.req.svc.rq_msg.cb_prog != NFS_program[P_NFS]
-	    || reqdata->r_u.req.svc.rq_msg.cb_vers != NFS_V4)
-		server_stats_nfs_done(reqdata, rc, false);
-
-	/* If request is dropped, no return to the client */
-	if (rc == NFS_REQ_DROP) {
-		/* The request was dropped */
-		LogDebug(COMPONENT_DISPATCH,
-			 "Drop request rpc_xid=%" PRIu32
-			 ", program %" PRIu32
-			 ", version %" PRIu32
-			 ", function %" PRIu32,
-			 reqdata->r_u.req.svc.rq_msg.rm_xid,
-			 reqdata->r_u.req.svc.rq_msg.cb_prog,
-			 reqdata->r_u.req.svc.rq_msg.cb_vers,
-			 reqdata->r_u.req.svc.rq_msg.cb_proc);
-
-		/* If the request is not normally cached, then the entry
-		 * will be removed later.  We only remove a reply that is
-		 * normally cached that has been dropped.
+	if (rc == NFS_REQ_ASYNC_WAIT) {
+		/* The request was suspended, whoever resumes it owns op_ctx
+		 * now and replies through nfs_rpc_complete_async_request().
 		 */
-		if (nfs_dupreq_delete(&reqdata->r_u.req.svc)
-		    != DUPREQ_SUCCESS) {
-			LogCrit(COMPONENT_DISPATCH,
-				"Attempt to delete duplicate request failed on line %d",
-				__LINE__);
-		}
-		goto freeargs;
-	} else {
-		LogFullDebug(COMPONENT_DISPATCH,
-			     "Before svc_sendreply on socket %d", xprt->xp_fd);
-
-		reqdata->r_u.req.svc.rq_msg.RPCM_ack.ar_results.where = res_nfs;
-		reqdata->r_u.req.svc.rq_msg.RPCM_ack.ar_results.proc =
-					reqdesc->xdr_encode_func;
-		xprt_rc = svc_sendreply(&reqdata->r_u.req.svc);
-		if (xprt_rc >= XPRT_DIED) {
-			LogDebug(COMPONENT_DISPATCH,
-				 "NFS DISPATCHER: FAILURE: Error while calling svc_sendreply on a new request. rpcxid=%"
-				 PRIu32
-				 " socket=%d function:%s client:%s program:%"
-				 PRIu32
-				 " nfs version:%" PRIu32
-				 " proc:%" PRIu32
-				 " errno: %d",
-				 reqdata->r_u.req.svc.rq_msg.rm_xid,
-				 xprt->xp_fd,
-				 reqdesc->funcname,
-				 client_ip,
-				 reqdata->r_u.req.svc.rq_msg.cb_prog,
-				 reqdata->r_u.req.svc.rq_msg.cb_vers,
-				 reqdata->r_u.req.svc.rq_msg.cb_proc,
-				 errno);
-			SVC_DESTROY(xprt);
-			goto freeargs;
-		}
-
-		LogFullDebug(COMPONENT_DISPATCH,
-			     "After svc_sendreply on socket %d", xprt->xp_fd);
-
-	}			/* rc == NFS_REQ_DROP */
+		SetClientIP(NULL);
+		op_ctx = NULL;
+		return SVC_STAT(xprt);
+	}
 
-	/* Finish any request not already deleted */
-	if (dpq_status == DUPREQ_SUCCESS)
-		dpq_status = nfs_dupreq_finish(&reqdata->r_u.req.svc, res_nfs);
+	nfs_rpc_reply(reqdata, rc);
 	goto freeargs;
 
  auth_failure:
@@ -1424,39 +1843,236 @@ static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
 	}
 
  freeargs:
-	/* Free the allocated resources once the work is done */
-	/* Free the arguments */
-	if ((reqdata->r_u.req.svc.rq_msg.cb_vers == 2)
-	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 3)
-	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 4)) {
-		if (!xdr_free(reqdesc->xdr_decode_func, arg_nfs)) {
-			LogCrit(COMPONENT_DISPATCH,
-				"%s FAILURE: Bad xdr_free for %s",
-				__func__,
-				reqdesc->funcname);
-		}
-	}
+	nfs_rpc_release_request(reqdata);
+	return SVC_STAT(xprt);
+}
 
-	/* Finalize the request. */
-	if (res_nfs)
-		nfs_dupreq_rele(&reqdata->r_u.req.svc, reqdesc);
+#ifdef _HAVE_GSSAPI
+/**
+ * @brief Threads that unwrap and run protected bulk requests
+ */
+static struct fridgethr *gss_crypto_fridge;
 
-	SetClientIP(NULL);
-	if (op_ctx->client != NULL) {
-		put_gsh_client(op_ctx->client);
-		op_ctx->client = NULL;
+/**
+ * @brief A request waiting for a crypto thread
+ */
+struct gss_crypto_job {
+	request_data_t *reqdata;
+	struct timespec queued;
+};
+
+/**
+ * @brief Whether a request may carry a bulk payload
+ *
+ * The arguments are still wrapped, so this goes by procedure: NFSv3
+ * READ and WRITE and every NFSv4 COMPOUND.
+ */
+static bool nfs_rpc_may_be_bulk(struct svc_req *req)
+{
+	if (req->rq_msg.cb_prog != NFS_program[P_NFS])
+		return false;
+
+	if (req->rq_msg.cb_vers == NFS_V4)
+		return req->rq_msg.cb_proc == NFSPROC4_COMPOUND;
+
+	return req->rq_msg.cb_vers == NFS_V3 &&
+	       (req->rq_msg.cb_proc == NFSPROC3_READ ||
+		req->rq_msg.cb_proc == NFSPROC3_WRITE);
+}
+
+static void gss_crypto_run(struct fridgethr_context *ctx)
+{
+	struct gss_crypto_job *job = ctx->arg;
+	request_data_t *reqdata = job->reqdata;
+	struct timespec start;
+
+	now(&start);
+	gss_stats_offload(nfs_rpc_gss_svc(&reqdata->r_u.req.svc),
+			  timespec_diff(&job->queued, &start));
+	gsh_free(job);
+
+	(void) nfs_rpc_execute_request(reqdata);
+
+	/* Drop the reference taken by gss_crypto_offload() */
+	free_nfs_request(reqdata);
+}
+
+/**
+ * @brief Hand a protected bulk request to a crypto thread
+ *
+ * Unwrapping a krb5i or krb5p READ or WRITE, then wrapping its reply,
+ * would otherwise hold the thread that received it for as long as the
+ * crypto takes.  The crypto thread runs the rest of the request.
+ *
+ * @param[in] reqdata	NFS request, authenticated
+ *
+ * @return true if a crypto thread owns the request now.
+ */
+static bool gss_crypto_offload(request_data_t *reqdata)
+{
+	struct svc_req *req = &reqdata->r_u.req.svc;
+	struct gss_crypto_job *job;
+	rpc_gss_svc_t svc;
+
+	if (gss_crypto_fridge == NULL)
+		return false;
+
+	svc = nfs_rpc_gss_svc(req);
+	if ((svc != RPCSEC_GSS_SVC_INTEGRITY &&
+	     svc != RPCSEC_GSS_SVC_PRIVACY) || !nfs_rpc_may_be_bulk(req))
+		return false;
+
+	job = gsh_malloc(sizeof(*job));
+	job->reqdata = reqdata;
+	now(&job->queued);
+
+	/* The crypto thread holds the request until it has replied */
+	(void) atomic_inc_uint32_t(&req->rq_refcnt);
+
+	if (fridgethr_submit(gss_crypto_fridge, gss_crypto_run, job) != 0) {
+		(void) atomic_dec_uint32_t(&req->rq_refcnt);
+		gsh_free(job);
+		return false;
 	}
-	if (op_ctx->ctx_export != NULL) {
-		put_gsh_export(op_ctx->ctx_export);
-		op_ctx->ctx_export = NULL;
+
+	return true;
+}
+
+/**
+ * @brief Start the crypto threads
+ *
+ * @return 0 on success, or if there are to be none.
+ */
+int gss_crypto_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (!nfs_param.krb5_param.active_krb5 ||
+	    nfs_param.krb5_param.crypto_threads == 0)
+		return 0;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = nfs_param.krb5_param.crypto_threads;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&gss_crypto_fridge, "gss_crypto", &frp);
+	if (rc != 0) {
+		LogCrit(COMPONENT_DISPATCH,
+			"Unable to initialize GSS crypto fridge: %d", rc);
+		gss_crypto_fridge = NULL;
 	}
-	clean_credentials();
-	op_ctx = NULL;
+
+	return rc;
+}
+#endif /* _HAVE_GSSAPI */
+
+/**
+ * @brief Main RPC dispatcher routine
+ *
+ * @param[in,out] reqdata	NFS request
+ *
+ */
+static enum xprt_stat nfs_rpc_process_request(request_data_t *reqdata)
+{
+	SVCXPRT *xprt = reqdata->r_u.req.svc.rq_xprt;
+	enum auth_stat auth_rc;
+	bool no_dispatch = false;
 
 #ifdef USE_LTTNG
-	tracepoint(nfs_rpc, end, reqdata);
+	tracepoint(nfs_rpc, start, reqdata);
 #endif
-	return SVC_STAT(xprt);
+
+#if defined(HAVE_BLKIN)
+	BLKIN_TIMESTAMP(
+		&reqdata->r_u.req.svc.bl_trace,
+		&reqdata->r_u.req.svc.rq_xprt->blkin.endp,
+		"nfs_rpc_process_request-start");
+#endif
+
+	LogFullDebug(COMPONENT_DISPATCH,
+		     "About to authenticate Prog=%" PRIu32
+		     ", vers=%" PRIu32
+		     ", proc=%" PRIu32
+		     ", xid=%" PRIu32
+		     ", SVCXPRT=%p, fd=%d",
+		     reqdata->r_u.req.svc.rq_msg.cb_prog,
+		     reqdata->r_u.req.svc.rq_msg.cb_vers,
+		     reqdata->r_u.req.svc.rq_msg.cb_proc,
+		     reqdata->r_u.req.svc.rq_msg.rm_xid,
+		     xprt, xprt->xp_fd);
+
+#ifdef USE_RPC_TLS
+	if (reqdata->r_u.req.svc.rq_msg.cb_cred.oa_flavor == AUTH_TLS)
+		return nfs_rpc_tls_start(reqdata);
+
+	if (nfs_param.core_param.tls.required &&
+	    reqdata->r_u.req.svc.rq_msg.cb_proc != NULLPROC &&
+	    !nfs_rpc_xprt_tls(xprt)) {
+		LogInfo(COMPONENT_DISPATCH,
+			"Rejecting request without TLS on fd %d", xprt->xp_fd);
+		return svcerr_auth(&reqdata->r_u.req.svc, AUTH_TOOWEAK);
+	}
+#endif
+
+	/* If authentication is AUTH_NONE or AUTH_UNIX, then the value of
+	 * no_dispatch remains false and the request proceeds normally.
+	 *
+	 * If authentication is RPCSEC_GSS, no_dispatch may have value true,
+	 * this means that gc->gc_proc != RPCSEC_GSS_DATA and that the message
+	 * is in fact an internal negotiation message from RPCSEC_GSS using
+	 * GSSAPI. It should not be processed by the worker and SVC_STAT
+	 * should be returned to the dispatcher.
+	 */
+	auth_rc = svc_auth_authenticate(&reqdata->r_u.req.svc, &no_dispatch);
+	if (auth_rc != AUTH_OK) {
+		LogInfo(COMPONENT_DISPATCH,
+			"Could not authenticate request... rejecting with AUTH_STAT=%s",
+			auth_stat2str(auth_rc));
+		return svcerr_auth(&reqdata->r_u.req.svc, auth_rc);
+#ifdef _HAVE_GSSAPI
+	} else if (reqdata->r_u.req.svc.rq_msg.RPCM_ack.ar_verf.oa_flavor
+		   == RPCSEC_GSS) {
+		struct rpc_gss_cred *gc = (struct rpc_gss_cred *)
+			reqdata->r_u.req.svc.rq_msg.rq_cred_body;
+
+		LogFullDebug(COMPONENT_DISPATCH,
+			     "RPCSEC_GSS no_dispatch=%d gc->gc_proc=(%"
+			     PRIu32 ") %s",
+			     no_dispatch, gc->gc_proc,
+			     str_gc_proc(gc->gc_proc));
+		if (no_dispatch)
+			return SVC_STAT(xprt);
+#endif
+	}
+
+#ifdef _HAVE_GSSAPI
+	if (gss_crypto_offload(reqdata))
+		return SVC_STAT(xprt);
+#endif
+
+	return nfs_rpc_execute_request(reqdata);
+}
+
+/**
+ * @brief Finish a request suspended by NFS_REQ_ASYNC_WAIT
+ *
+ * Called by whoever resumed the request once its result is complete;
+ * sends the reply, releases the request context and drops the reference
+ * taken when the request was suspended.
+ *
+ * @param[in] reqdata	Suspended request
+ * @param[in] rc	NFS_REQ_OK or NFS_REQ_DROP
+ */
+void nfs_rpc_complete_async_request(request_data_t *reqdata, int rc)
+{
+	op_ctx = &reqdata->r_u.req.req_ctx;
+	if (op_ctx->client != NULL)
+		SetClientIP(op_ctx->client->hostaddr_str);
+
+	nfs_rpc_reply(reqdata, rc);
+	nfs_rpc_release_request(reqdata);
+	free_nfs_request(reqdata);
 }
 
 /**
@@ -78,11 +78,6 @@ int _9p_attach(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		 (u32) *msgtag, *fid, *afid, (int) *uname_len, uname_str,
 		 (int) *aname_len, aname_str, *n_uname);
 
-	if (*fid >= _9P_FID_PER_CONN) {
-		err = ERANGE;
-		goto errout;
-	}
-
 	/*
 	 * Find the export for the aname (using as well Path or Tag)
 	 *
@@ -157,7 +152,6 @@ int _9p_attach(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	get_gsh_export_ref(pfid->fid_export);
 
 	pfid->fid = *fid;
-	req9p->pconn->fids[*fid] = pfid;
 
 	/* Is user name provided as a string or as an uid ? */
 	if (*n_uname != _9P_NONUNAME) {
@@ -234,6 +228,9 @@ int _9p_attach(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	pfid->qid.path = pfid->pentry->fileid;
 	pfid->xattr = NULL;
 
+	/* keep info on new fid */
+	_9p_fid_insert(req9p->pconn, pfid);
+
 	/* Build the reply */
 	_9p_setinitptr(cursor, preply, _9P_RATTACH);
 	_9p_setptr(cursor, msgtag, u16);
@@ -32,6 +32,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
 
 #include "nfs_core.h"
 #include "9p.h"
@@ -41,6 +43,7 @@
 #include "nfs_dupreq.h"
 #include "nfs_file_handle.h"
 #include "server_stats.h"
+#include "gsh_iobuf.h"
 
 /* opcode to function array */
 const struct _9p_function_desc _9pfuncdesc[] = {
@@ -123,17 +126,123 @@ static ssize_t tcp_conn_send(struct _9p_conn *conn, const void *buf, size_t len,
 	return ret;
 }
 
+/**
+ * @brief Send a reply whose data is still in a file
+ *
+ * The header goes out from @a buf, the data follows from @a fd with
+ * sendfile, both under the socket lock so replies don't interleave.
+ * Should the file shrink under us, the reply is padded with zeroes to
+ * keep the stream framed.
+ *
+ * @return Bytes sent, or -1.
+ */
+static ssize_t tcp_conn_send_extent(struct _9p_conn *conn, const void *buf,
+				    size_t len, int fd, uint64_t offset,
+				    size_t datalen)
+{
+	static const char zeroes[4096];
+	off_t off = offset;
+	size_t left = datalen;
+	ssize_t ret;
+
+	PTHREAD_MUTEX_lock(&conn->sock_lock);
+
+	ret = send(conn->trans_data.sockfd, buf, len, MSG_MORE);
+	if (ret != (ssize_t) len) {
+		ret = -1;
+		goto out;
+	}
+
+	while (left > 0) {
+		ret = sendfile(conn->trans_data.sockfd, fd, &off, left);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret == 0) {
+			/* Truncated since the read */
+			ret = send(conn->trans_data.sockfd, zeroes,
+				   MIN(left, sizeof(zeroes)), 0);
+		}
+		if (ret <= 0) {
+			ret = -1;
+			goto out;
+		}
+		left -= ret;
+	}
+
+	ret = len + datalen;
+
+ out:
+	PTHREAD_MUTEX_unlock(&conn->sock_lock);
+
+	if (ret < 0)
+		server_stats_transport_done(conn->client,
+					    0, 0, 0,
+					    0, 0, 1);
+	else
+		server_stats_transport_done(conn->client,
+					    0, 0, 0,
+					    ret, 1, 0);
+	return ret;
+}
+
+/**
+ * @brief Size of the buffer a 9P/TCP reply needs
+ *
+ * Only RREAD and RREADDIR grow with what the client asked for, and
+ * TREAD and TREADDIR both carry their count after tag, fid and offset.
+ * Other replies get _9P_TCP_MIN_BUF, so that a large msize doesn't
+ * cost a large buffer per request.
+ *
+ * @param[in] req9p The request
+ *
+ * @return Bytes the reply may use, at most msize.
+ */
+static u32 _9p_tcp_reply_size(struct _9p_request_data *req9p)
+{
+	char *cursor = req9p->_9pmsg + _9P_HDR_SIZE;
+	u8 msgtype = *(u8 *) cursor;
+	u32 size = _9P_TCP_MIN_BUF;
+	u32 count;
+
+	if (msgtype == _9P_TREAD || msgtype == _9P_TREADDIR) {
+		cursor += _9P_TYPE_SIZE + _9P_TAG_SIZE + sizeof(u32) +
+			  sizeof(u64);
+		count = *(u32 *) cursor;
+		if (count < req9p->pconn->msize)
+			size = MAX(size, count + _9P_ROOM_RREAD);
+		else
+			size = req9p->pconn->msize;
+	}
+
+	return MIN(size, req9p->pconn->msize);
+}
+
 void _9p_tcp_process_request(struct _9p_request_data *req9p)
 {
 	u32 outdatalen = 0;
 	int rc = 0;
-	char replydata[_9P_MSG_SIZE];
+	char *replydata;
+
+	/* Replies can be up to the negotiated msize, which is too much
+	 * for the stack.  Take a recycled buffer instead, only as large
+	 * as this reply can be.
+	 */
+	outdatalen = _9p_tcp_reply_size(req9p);
+	replydata = iobuf_alloc(outdatalen);
 
 	rc = _9p_process_buffer(req9p, replydata, &outdatalen);
 	if (rc != 1) {
 		LogMajor(COMPONENT_9P,
 			 "Could not process 9P buffer on socket #%lu",
 			 req9p->pconn->trans_data.sockfd);
+	} else if (req9p->zc_len != 0) {
+		if (tcp_conn_send_extent(req9p->pconn, replydata,
+					 outdatalen - req9p->zc_len,
+					 req9p->zc_fd, req9p->zc_offset,
+					 req9p->zc_len) != outdatalen)
+			LogMajor(COMPONENT_9P,
+				 "Could not send 9P/TCP reply correctly on socket #%lu",
+				 req9p->pconn->trans_data.sockfd);
 	} else {
 		if (tcp_conn_send(req9p->pconn, replydata, outdatalen, 0) !=
 		    outdatalen)
@@ -141,6 +250,11 @@ void _9p_tcp_process_request(struct _9p_request_data *req9p)
 				 "Could not send 9P/TCP reply correctly on socket #%lu",
 				 req9p->pconn->trans_data.sockfd);
 	}
+	if (req9p->zc_len != 0) {
+		close(req9p->zc_fd);
+		req9p->zc_len = 0;
+	}
+	iobuf_free(replydata);
 	_9p_DiscardFlushHook(req9p);
 }				/* _9p_process_request */
 
@@ -170,11 +284,13 @@ int _9p_process_buffer(struct _9p_request_data *req9p, char *replydata,
 	LogFullDebug(COMPONENT_9P, "9P msg: length=%u type (%u|%s)", msglen,
 		     (u32) msgtype, _9pfuncdesc[msgtype].funcname);
 
-	/* Temporarily set outlen to maximum message size. This value will be
-	 * used inside the protocol functions for additional bound checking,
-	 * and then replaced by the actual message size, (see _9p_checkbound())
+	/* Temporarily set outlen to maximum message size, or to the room
+	 * the caller gave if less. This value will be used inside the
+	 * protocol functions for additional bound checking, and then
+	 * replaced by the actual message size, (see _9p_checkbound())
 	 */
-	*poutlen = req9p->pconn->msize;
+	if (*poutlen == 0 || *poutlen > req9p->pconn->msize)
+		*poutlen = req9p->pconn->msize;
 
 	/* Call the 9P service function */
 	rc = _9pfuncdesc[msgtype].service_function(req9p, poutlen, replydata);
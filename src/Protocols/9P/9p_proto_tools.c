@@ -37,6 +37,7 @@
 #include <pthread.h>
 #include <sys/types.h>
 #include <pwd.h>
+#include <sys/param.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include "nfs_core.h"
@@ -413,9 +414,177 @@ int _9p_tools_clunk(struct _9p_fid *pfid)
 	return 0;
 }
 
+/**
+ * @brief Home slot of a fid
+ *
+ * Fids are mostly small and handed out in sequence, multiplying by an
+ * odd constant spreads them without ever mapping two of a run of
+ * size fids to the same slot.
+ */
+static inline u32 _9p_fid_hash(u32 fid, u32 size)
+{
+	return (fid * 2654435761U) & (size - 1);
+}
+
+/**
+ * @brief Slot holding a fid, or the free one it would go in
+ *
+ * The table is never more than half full so the probe always ends.
+ */
+static u32 _9p_fid_probe(struct _9p_fid_table *table, u32 fid)
+{
+	u32 i = _9p_fid_hash(fid, table->size);
+
+	while (table->slots[i].pfid != NULL && table->slots[i].fid != fid)
+		i = (i + 1) & (table->size - 1);
+
+	return i;
+}
+
+/**
+ * @brief Move a fid table to a new number of slots
+ *
+ * Called with the table's lock held for writing.
+ */
+static void _9p_fid_resize(struct _9p_fid_table *table, u32 size)
+{
+	struct _9p_fid_slot *old = table->slots;
+	u32 old_size = table->size;
+	u32 i;
+
+	table->slots = gsh_calloc(size, sizeof(*table->slots));
+	table->size = size;
+
+	for (i = 0; i < old_size; i++) {
+		if (old[i].pfid != NULL)
+			table->slots[_9p_fid_probe(table, old[i].fid)] = old[i];
+	}
+
+	gsh_free(old);
+}
+
+/**
+ * @brief Set up a connection's empty fid table
+ *
+ * @param[in] conn The connection
+ */
+void _9p_fid_table_init(struct _9p_conn *conn)
+{
+	PTHREAD_RWLOCK_init(&conn->fids.lock, NULL);
+	conn->fids.slots = NULL;
+	conn->fids.size = 0;
+	conn->fids.count = 0;
+}
+
+/**
+ * @brief Find the fid a connection knows by a number
+ *
+ * @param[in] conn The connection
+ * @param[in] fid  Number the client gave the fid
+ *
+ * @return The fid, or NULL if the client has none by that number.
+ */
+struct _9p_fid *_9p_fid_lookup(struct _9p_conn *conn, u32 fid)
+{
+	struct _9p_fid_table *table = &conn->fids;
+	struct _9p_fid *pfid = NULL;
+
+	PTHREAD_RWLOCK_rdlock(&table->lock);
+
+	if (table->size != 0)
+		pfid = table->slots[_9p_fid_probe(table, fid)].pfid;
+
+	PTHREAD_RWLOCK_unlock(&table->lock);
+
+	return pfid;
+}
+
+/**
+ * @brief Give a connection a fid
+ *
+ * A fid already known by the same number is replaced, as a client
+ * reusing a number it did not clunk is its own problem.
+ *
+ * @param[in] conn The connection
+ * @param[in] pfid The fid, known by pfid->fid
+ */
+void _9p_fid_insert(struct _9p_conn *conn, struct _9p_fid *pfid)
+{
+	struct _9p_fid_table *table = &conn->fids;
+	u32 i;
+
+	PTHREAD_RWLOCK_wrlock(&table->lock);
+
+	if (2 * (table->count + 1) > table->size)
+		_9p_fid_resize(table, MAX(_9P_FID_TABLE_MIN, 2 * table->size));
+
+	i = _9p_fid_probe(table, pfid->fid);
+	if (table->slots[i].pfid == NULL)
+		table->count++;
+	table->slots[i].fid = pfid->fid;
+	table->slots[i].pfid = pfid;
+
+	PTHREAD_RWLOCK_unlock(&table->lock);
+}
+
+/**
+ * @brief Forget a connection's fid
+ *
+ * The fid itself is left to the caller.  The fids after it in its run
+ * of slots are shifted back, so lookups need no tombstones, and the
+ * table shrinks once it is mostly empty.
+ *
+ * @param[in] conn The connection
+ * @param[in] fid  Number the client gave the fid
+ */
+void _9p_fid_remove(struct _9p_conn *conn, u32 fid)
+{
+	struct _9p_fid_table *table = &conn->fids;
+	u32 i, j, home, mask;
+
+	PTHREAD_RWLOCK_wrlock(&table->lock);
+
+	if (table->size == 0)
+		goto out;
+
+	i = _9p_fid_probe(table, fid);
+	if (table->slots[i].pfid == NULL)
+		goto out;
+
+	table->slots[i].pfid = NULL;
+	table->count--;
+
+	mask = table->size - 1;
+	for (j = (i + 1) & mask; table->slots[j].pfid != NULL;
+	     j = (j + 1) & mask) {
+		home = _9p_fid_hash(table->slots[j].fid, table->size);
+
+		/* Leave it if its home is still reached before the hole */
+		if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+			continue;
+
+		table->slots[i] = table->slots[j];
+		table->slots[j].pfid = NULL;
+		i = j;
+	}
+
+	if (table->count == 0) {
+		gsh_free(table->slots);
+		table->slots = NULL;
+		table->size = 0;
+	} else if (table->size > _9P_FID_TABLE_MIN &&
+		   8 * table->count < table->size) {
+		_9p_fid_resize(table, table->size / 2);
+	}
+
+out:
+	PTHREAD_RWLOCK_unlock(&table->lock);
+}
+
 void _9p_cleanup_fids(struct _9p_conn *conn)
 {
-	int i;
+	struct _9p_fid_table *table = &conn->fids;
+	u32 i;
 
 	/* Allocate op_ctx, is should always be NULL here
 	 * Note we only need it if there is a non-null fid,
@@ -423,15 +592,20 @@ void _9p_cleanup_fids(struct _9p_conn *conn)
 	 */
 	op_ctx = gsh_calloc(1, sizeof(struct req_op_context));
 
-	for (i = 0; i < _9P_FID_PER_CONN; i++) {
-		if (conn->fids[i]) {
-			_9p_init_opctx(conn->fids[i], NULL);
-			_9p_tools_clunk(conn->fids[i]);
+	for (i = 0; i < table->size; i++) {
+		if (table->slots[i].pfid) {
+			_9p_init_opctx(table->slots[i].pfid, NULL);
+			_9p_tools_clunk(table->slots[i].pfid);
 			_9p_release_opctx();
-			conn->fids[i] = NULL;	/* poison the entry */
 		}
 	}
 
 	gsh_free(op_ctx);
 	op_ctx = NULL;
+
+	gsh_free(table->slots);
+	table->slots = NULL;
+	table->size = 0;
+	table->count = 0;
+	PTHREAD_RWLOCK_destroy(&table->lock);
 }
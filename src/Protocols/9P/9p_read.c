@@ -37,6 +37,7 @@
 #include <string.h>
 #include <pthread.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include "nfs_core.h"
 #include "log.h"
 #include "fsal.h"
@@ -102,10 +103,7 @@ int _9p_read(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	LogDebug(COMPONENT_9P, "TREAD: tag=%u fid=%u offset=%llu count=%u",
 		 (u32) *msgtag, *fid, (unsigned long long)*offset, *count);
 
-	if (*fid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	pfid = req9p->pconn->fids[*fid];
+	pfid = _9p_fid_lookup(req9p->pconn, *fid);
 
 	/* Make sure the requested amount of data respects negotiated msize */
 	if (*count + _9P_ROOM_RREAD > req9p->pconn->msize)
@@ -151,6 +149,11 @@ int _9p_read(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		read_arg->info = NULL;
 		read_arg->state = pfid->state;
 		read_arg->offset = *offset;
+		read_arg->extent.want =
+			_9p_param._9p_tcp_zero_copy_read &&
+			req9p->pconn->trans_type == _9P_TCP &&
+			*count >= _9P_ZERO_COPY_MIN;
+		read_arg->extent.fd = -1;
 		read_arg->iov_count = 1;
 		read_arg->iov[0].iov_len = *count;
 		read_arg->iov[0].iov_base = databuffer;
@@ -163,12 +166,24 @@ int _9p_read(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		pfid->pentry->obj_ops->read2(pfid->pentry, true, _9p_read_cb,
 					    read_arg, &read_data);
 
-		if (FSAL_IS_ERROR(read_data.ret))
+		if (FSAL_IS_ERROR(read_data.ret)) {
+			if (read_arg->extent.fd >= 0)
+				close(read_arg->extent.fd);
 			return _9p_rerror(req9p, msgtag,
 					  _9p_tools_errno(read_data.ret),
 					  plenout, preply);
+		}
 
 		outcount = (u32) read_arg->io_amount;
+
+		/* The data stays in the file, the transport sends it
+		 * right behind the reply header.
+		 */
+		if (read_arg->extent.fd >= 0) {
+			req9p->zc_fd = read_arg->extent.fd;
+			req9p->zc_offset = read_arg->extent.offset;
+			req9p->zc_len = read_arg->extent.length;
+		}
 	}
 	_9p_setfilledbuffer(cursor, outcount);
 
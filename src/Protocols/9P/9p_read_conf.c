@@ -51,6 +51,14 @@ static struct config_item _9p_params[] = {
 	CONF_ITEM_UI16("_9P_RDMA_Outpool_Size", 1, UINT16_MAX,
 		       _9P_RDMA_OUTPOOL_SIZE,
 		       _9p_param, _9p_rdma_outpool_size),
+	CONF_ITEM_BOOL("_9P_TCP_Zero_Copy_Read", false,
+		       _9p_param, _9p_tcp_zero_copy_read),
+	CONF_ITEM_UI32("_9P_TCP_Inline_Depth", 0, UINT32_MAX, 0,
+		       _9p_param, _9p_tcp_inline_depth),
+	CONF_ITEM_UI32("_9P_RDMA_Inline_Depth", 0, UINT32_MAX, 0,
+		       _9p_param, _9p_rdma_inline_depth),
+	CONF_ITEM_UI32("_9P_TCP_Event_Loops", 0, 1024, _9P_TCP_EVENT_LOOPS,
+		       _9p_param, _9p_tcp_event_loops),
 	CONFIG_EOL
 };
 
@@ -74,10 +74,7 @@ int _9p_renameat(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		 (u32) *msgtag, *oldfid, *oldname_len, oldname_str, *newfid,
 		 *newname_len, newname_str);
 
-	if (*oldfid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	poldfid = req9p->pconn->fids[*oldfid];
+	poldfid = _9p_fid_lookup(req9p->pconn, *oldfid);
 
 	/* Check that it is a valid fid */
 	if (poldfid == NULL || poldfid->pentry == NULL) {
@@ -87,10 +84,7 @@ int _9p_renameat(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 
 	_9p_init_opctx(poldfid, req9p);
 
-	if (*newfid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	pnewfid = req9p->pconn->fids[*newfid];
+	pnewfid = _9p_fid_lookup(req9p->pconn, *newfid);
 
 	/* Check that it is a valid fid */
 	if (pnewfid == NULL || pnewfid->pentry == NULL) {
@@ -72,10 +72,7 @@ int _9p_statfs(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 
 	LogDebug(COMPONENT_9P, "TSTATFS: tag=%u fid=%u", (u32) *msgtag, *fid);
 
-	if (*fid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	pfid = req9p->pconn->fids[*fid];
+	pfid = _9p_fid_lookup(req9p->pconn, *fid);
 	if (pfid == NULL)
 		return _9p_rerror(req9p, msgtag, EINVAL, plenout, preply);
 	_9p_init_opctx(pfid, req9p);
@@ -71,13 +71,7 @@ int _9p_walk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	LogDebug(COMPONENT_9P, "TWALK: tag=%u fid=%u newfid=%u nwname=%u",
 		 (u32) *msgtag, *fid, *newfid, *nwname);
 
-	if (*fid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	if (*newfid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	pfid = req9p->pconn->fids[*fid];
+	pfid = _9p_fid_lookup(req9p->pconn, *fid);
 	/* Check that it is a valid fid */
 	if (pfid == NULL || pfid->pentry == NULL) {
 		LogDebug(COMPONENT_9P, "request on invalid fid=%u", *fid);
@@ -200,7 +194,7 @@ int _9p_walk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	pnewfid->state->state_refcount = 1;
 
 	/* keep info on new fid */
-	req9p->pconn->fids[*newfid] = pnewfid;
+	_9p_fid_insert(req9p->pconn, pnewfid);
 
 	/* As much qid as requested fid */
 	nwqid = nwname;
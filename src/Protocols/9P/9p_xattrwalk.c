@@ -87,13 +87,7 @@ int _9p_xattrwalk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 			 "TXATTRWALK (component): tag=%u fid=%u attrfid=%u name=%.*s",
 			 (u32) *msgtag, *fid, *attrfid, *name_len, name_str);
 
-	if (*fid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	if (*attrfid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	pfid = req9p->pconn->fids[*fid];
+	pfid = _9p_fid_lookup(req9p->pconn, *fid);
 	/* Check that it is a valid fid */
 	if (pfid == NULL || pfid->pentry == NULL) {
 		LogDebug(COMPONENT_9P, "request on invalid fid=%u", *fid);
@@ -116,6 +110,7 @@ int _9p_xattrwalk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	 * Don't copy the state_t pointer.
 	 */
 	memcpy((char *)pxattrfid, (char *)pfid, sizeof(struct _9p_fid));
+	pxattrfid->fid = *attrfid;
 	pxattrfid->state = NULL;
 
 	snprintf(name, sizeof(name), "%.*s", *name_len, name_str);
@@ -234,7 +229,7 @@ int _9p_xattrwalk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	pxattrfid->xattr->xattr_size = attrsize;
 	pxattrfid->xattr->xattr_write = _9P_XATTR_READ_ONLY;
 
-	req9p->pconn->fids[*attrfid] = pxattrfid;
+	_9p_fid_insert(req9p->pconn, pxattrfid);
 
 	/* Increments refcount as we're manually making a new copy */
 	pfid->pentry->obj_ops->get_ref(pfid->pentry);
@@ -72,6 +72,8 @@ struct nfs3_readdirplus_cb_data {
 				   the array. */
 	nfsstat3 error;		/*< Set to a value other than NFS_OK if the
 				   callback function finds a fatal error. */
+	struct gsh_arena *arena;	/*< Holds the entries, their names
+					   and handles */
 };
 
 static
@@ -256,7 +258,9 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		fsal_cookie = 0;
 
 	/* Allocate space for entries */
-	tracker.entries = gsh_calloc(estimated_num_entries, sizeof(entryplus3));
+	tracker.entries = arena_create(estimated_num_entries *
+				       sizeof(entryplus3));
+	tracker.arena = arena_of(tracker.entries);
 
 	if (begin_cookie == 0) {
 		/* Fill in "." */
@@ -329,6 +333,8 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 	if ((num_entries == 0) && (begin_cookie > 1)) {
 		res->res_readdirplus3.status = NFS3_OK;
+		free_entryplus3s(tracker.entries);
+		tracker.entries = NULL;
 		resok->reply.entries = NULL;
 		resok->reply.eof = TRUE;
 	} else {
@@ -388,7 +394,7 @@ void nfs3_readdirplus_free(nfs_res_t *resp)
  *
  * This function is a callback passed to fsal_readdir.  It
  * fills in a pre-allocated array of entryplys3 structures and allocates
- * space for the name and attributes.  This space must be freed.
+ * space for the name and handle from the arena of the array.
  *
  * @param opaque [in] Pointer to a struct nfs3_readdirplus_cb_data that is
  *                    gives the location of the array and other
@@ -412,6 +418,7 @@ fsal_errors_t nfs3_readdirplus_callback(void *opaque,
 	/* Length of the current filename */
 	size_t namelen = strlen(cb_parms->name);
 	entryplus3 *ep3 = tracker->entries + tracker->count;
+	struct arena_mark mark;
 
 	if (tracker->count == tracker->total_entries) {
 		cb_parms->in_result = false;
@@ -436,7 +443,8 @@ fsal_errors_t nfs3_readdirplus_callback(void *opaque,
 		cb_parms->name, cookie);
 
 	ep3->fileid = obj->fileid;
-	ep3->name = gsh_strdup(cb_parms->name);
+	arena_get_mark(tracker->arena, &mark);
+	ep3->name = arena_strndup(tracker->arena, cb_parms->name, namelen);
 	ep3->cookie = cookie;
 
 	/* Account for file name + length + cookie */
@@ -444,17 +452,22 @@ fsal_errors_t nfs3_readdirplus_callback(void *opaque,
 							BYTES_PER_XDR_UNIT;
 
 	if (cb_parms->attr_allowed) {
+		nfs_fh3 *fh3 = &ep3->name_handle.post_op_fh3_u.handle;
+
 		ep3->name_handle.handle_follows = TRUE;
 
-		if (!nfs3_FSALToFhandle(true,
-					&ep3->name_handle.post_op_fh3_u.handle,
-					obj,
+		fh3->data.data_val = arena_reserve(tracker->arena,
+						   NFS3_FHSIZE);
+		if (!nfs3_FSALToFhandle(false, fh3, obj,
 					op_ctx->ctx_export)) {
 			tracker->error = NFS3ERR_SERVERFAULT;
-			gsh_free(ep3->name);
+			arena_rewind(tracker->arena, &mark);
+			ep3->name = NULL;
+			fh3->data.data_val = NULL;
 			cb_parms->in_result = false;
 			return ERR_FSAL_NO_ERROR;
 		}
+		arena_commit(tracker->arena, fh3->data.data_len);
 
 		/* Account for filehande + length + follows + nextentry */
 		tracker->mem_left -=
@@ -490,20 +503,14 @@ fsal_errors_t nfs3_readdirplus_callback(void *opaque,
 /**
  * @brief Clean up memory allocated to serve NFSv3 READDIRPLUS
  *
- * This function traverses the list of entries, freeing all names
- * allocated in the callback function, then frees the list itself.
+ * The entries, their names and handles all come from the arena the
+ * array was made with, so this frees them all at once.
  *
  * @param entryplus3s [in] Pointer to first obj
  */
 
 static void free_entryplus3s(entryplus3 *entryplus3s)
 {
-	entryplus3 *entry = NULL;
-
-	for (entry = entryplus3s; entry != NULL; entry = entry->nextentry) {
-		gsh_free(entry->name);
-		gsh_free(entry->name_handle.post_op_fh3_u.handle.data.data_val);
-	}
-
-	gsh_free(entryplus3s);
+	if (entryplus3s != NULL)
+		arena_destroy(arena_of(entryplus3s));
 }
@@ -50,6 +50,7 @@
 struct nfs3_write_data {
 	nfs_res_t *res;		/**< Results for write */
 	int rc;			/**< Return code */
+	pre_op_attr pre_attr;	/**< Cached attributes before the write */
 };
 
 /**
@@ -90,7 +91,7 @@ static void nfs3_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 		data->rc = NFS_REQ_OK;
 	} else {
 		/* Build Weak Cache Coherency data */
-		nfs_SetWccData(NULL, obj, &resok->file_wcc);
+		nfs_SetWccData(&data->pre_attr, obj, &resok->file_wcc);
 
 		/* Set the written size */
 		resok->count = write_arg->io_amount;
@@ -137,9 +138,6 @@ out:
 int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 {
 	struct fsal_obj_handle *obj;
-	pre_op_attr pre_attr = {
-		.attributes_follow = false
-	};
 	fsal_status_t fsal_status = {0, 0};
 	size_t size = 0;
 	uint64_t MaxWrite =
@@ -152,6 +150,7 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 					       sizeof(struct iovec));
 
 	write_data.rc = NFS_REQ_OK;
+	write_data.pre_attr.attributes_follow = false;
 
 	write_arg->offset = arg->arg_write3.offset;
 	size = arg->arg_write3.count;
@@ -201,7 +200,9 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		return write_data.rc;
 	}
 
-	nfs_SetPreOpAttr(obj, &pre_attr);
+	/* Before attributes are only worth it when they cost no fetch */
+	if (nfs_param.core_param.cached_pre_op_attrs)
+		nfs_SetPreOpAttr(obj, &write_data.pre_attr);
 
 	fsal_status =
 	    obj->obj_ops->test_access(obj, FSAL_WRITE_ACCESS, NULL, NULL, true);
@@ -42,6 +42,9 @@
 #include "server_stats.h"
 #include "export_mgr.h"
 #include "nfs_creds.h"
+#include "gsh_throttle.h"
+#include "gsh_partition.h"
+#include "nfs_init.h"
 
 #ifdef USE_LTTNG
 #include "gsh_lttng/nfs_rpc.h"
@@ -381,10 +384,10 @@ static const struct nfs4_op_desc optabv4[] = {
 		.exp_perm_flags = 0},
 	[NFS4_OP_GET_DIR_DELEGATION] = {
 		.name = "OP_GET_DIR_DELEGATION",
-		.funct = nfs4_op_illegal,
-		.free_res = nfs4_op_illegal_Free,
+		.funct = nfs4_op_get_dir_delegation,
+		.free_res = nfs4_op_get_dir_delegation_Free,
 		.resp_size = sizeof(GET_DIR_DELEGATION4res),
-		.exp_perm_flags = 0	/* tbd */},
+		.exp_perm_flags = EXPORT_OPTION_MD_READ_ACCESS},
 	[NFS4_OP_GETDEVICEINFO] = {
 		.name = "OP_GETDEVICEINFO",
 		.funct = nfs4_op_getdeviceinfo,
@@ -467,8 +470,8 @@ static const struct nfs4_op_desc optabv4[] = {
 		.exp_perm_flags = 0},
 	[NFS4_OP_COPY] = {
 		.name = "OP_COPY",
-		.funct = nfs4_op_notsupp,
-		.free_res = nfs4_op_notsupp_Free,
+		.funct = nfs4_op_copy,
+		.free_res = nfs4_op_copy_Free,
 		.resp_size = sizeof(COPY4res),
 		.exp_perm_flags = 0},
 	[NFS4_OP_COPY_NOTIFY] = {
@@ -503,14 +506,14 @@ static const struct nfs4_op_desc optabv4[] = {
 		.exp_perm_flags = 0},
 	[NFS4_OP_OFFLOAD_CANCEL] = {
 		.name = "OP_OFFLOAD_CANCEL",
-		.funct = nfs4_op_notsupp,
-		.free_res = nfs4_op_notsupp_Free,
-		.resp_size = sizeof(OFFLOAD_ABORT4res),
+		.funct = nfs4_op_offload_cancel,
+		.free_res = nfs4_op_offload_cancel_Free,
+		.resp_size = sizeof(OFFLOAD_CANCEL4res),
 		.exp_perm_flags = 0},
 	[NFS4_OP_OFFLOAD_STATUS] = {
 		.name = "OP_OFFLOAD_STATUS",
-		.funct = nfs4_op_notsupp,
-		.free_res = nfs4_op_notsupp_Free,
+		.funct = nfs4_op_offload_status,
+		.free_res = nfs4_op_offload_status_Free,
 		.resp_size = sizeof(OFFLOAD_STATUS4res),
 		.exp_perm_flags = 0},
 	[NFS4_OP_READ_PLUS] = {
@@ -533,9 +536,9 @@ static const struct nfs4_op_desc optabv4[] = {
 		.exp_perm_flags = 0},
 	[NFS4_OP_CLONE] = {
 		.name = "OP_CLONE",
-		.funct = nfs4_op_notsupp,
-		.free_res = nfs4_op_notsupp_Free,
-		.resp_size = sizeof(ILLEGAL4res),
+		.funct = nfs4_op_clone,
+		.free_res = nfs4_op_clone_Free,
+		.resp_size = sizeof(CLONE4res),
 		.exp_perm_flags = 0},
 
 	/* NFSv4.3 */
@@ -565,32 +568,813 @@ static const struct nfs4_op_desc optabv4[] = {
 		.exp_perm_flags = 0},
 };
 
-/** Define the last valid NFS v4 op for each minor version.
+/** Define the last valid NFS v4 op for each minor version.
+ *
+ */
+nfs_opnum4 LastOpcode[] = {
+	NFS4_OP_RELEASE_LOCKOWNER,
+	NFS4_OP_RECLAIM_COMPLETE,
+	NFS4_OP_REMOVEXATTR
+};
+
+/** Result arrays of COMPOUNDs up to this many ops come from a pool */
+#define NFS4_RESARRAY_POOLED 8
+
+/** Pool of compound_data_t */
+static pool_t *compound_data_pool;
+/** Pool of NFS4_RESARRAY_POOLED long result arrays */
+static pool_t *nfs4_resarray_pool;
+
+/**
+ * @brief Set up the COMPOUND pools
+ */
+void nfs4_Compound_pkginit(void)
+{
+	compound_data_pool =
+	    pool_basic_init("compound_data_t pool", sizeof(compound_data_t));
+	nfs4_resarray_pool =
+	    pool_basic_init("nfs_resop4 pool",
+			    NFS4_RESARRAY_POOLED * sizeof(struct nfs_resop4));
+	pool_set_mem_tag(compound_data_pool, MEM_TAG_REQUEST);
+	pool_set_mem_tag(nfs4_resarray_pool, MEM_TAG_REQUEST);
+}
+
+/**
+ * @brief Free the result array of a COMPOUND
+ *
+ * @param[in,out] res The COMPOUND result
+ */
+static void nfs4_Compound_FreeResarray(nfs_res_t *res)
+{
+	if (res->res_compound4_extended.res_pooled)
+		pool_free(nfs4_resarray_pool,
+			  res->res_compound4.resarray.resarray_val);
+	else
+		gsh_free(res->res_compound4.resarray.resarray_val);
+
+	res->res_compound4.resarray.resarray_val = NULL;
+	res->res_compound4_extended.res_pooled = false;
+}
+
+void copy_tag(utf8str_cs *dest, utf8str_cs *src)
+{
+	/* Keeping the same tag as in the arguments */
+	dest->utf8string_len = src->utf8string_len;
+
+	if (dest->utf8string_len > 0) {
+
+		dest->utf8string_val = gsh_malloc(dest->utf8string_len + 1);
+
+		memcpy(dest->utf8string_val,
+		       src->utf8string_val,
+		       dest->utf8string_len);
+
+		dest->utf8string_val[dest->utf8string_len] = '\0';
+	} else {
+		dest->utf8string_val = NULL;
+	}
+}
+
+/**
+ * @brief Bytes an NFSv4 operation moves, for throttling
+ *
+ * @param[in] op  The operation
+ *
+ * @return The READ count or WRITE length, 0 for other operations
+ */
+static uint64_t nfs4_throttle_bytes(nfs_argop4 *op)
+{
+	switch (op->argop) {
+	case NFS4_OP_READ:
+		return op->nfs_argop4_u.opread.count;
+	case NFS4_OP_WRITE:
+		return op->nfs_argop4_u.opwrite.data.data_len;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * @brief What grace means for an op
+ */
+enum nfs4_grace_class {
+	NFS4_GRACE_NONE,	/*< Not in grace, or grace has no bearing */
+	NFS4_GRACE_RECLAIM,	/*< A reclaim during grace */
+	NFS4_GRACE_REFUSED,	/*< An OPEN or LOCK grace refuses */
+};
+
+/**
+ * @brief Tell the reclaims and the refused ops apart during grace
+ *
+ * Non reclaim OPENs and LOCKs, and LOCKTs, are refused outright during
+ * grace unless the FSAL manages grace itself, so they can be refused
+ * before they wait for anything.
+ *
+ * @param[in] op  The op, its current filehandle set
+ *
+ * @return The op's class.
+ */
+static enum nfs4_grace_class nfs4_op_grace_class(nfs_argop4 *op)
+{
+	bool reclaim;
+
+	switch (op->argop) {
+	case NFS4_OP_OPEN:
+		switch (op->nfs_argop4_u.opopen.claim.claim) {
+		case CLAIM_PREVIOUS:
+			reclaim = true;
+			break;
+		case CLAIM_NULL:
+		case CLAIM_FH:
+			reclaim = false;
+			break;
+		default:
+			return NFS4_GRACE_NONE;
+		}
+		break;
+	case NFS4_OP_LOCK:
+		reclaim = op->nfs_argop4_u.oplock.reclaim;
+		break;
+	case NFS4_OP_LOCKT:
+		reclaim = false;
+		break;
+	default:
+		return NFS4_GRACE_NONE;
+	}
+
+	if (!nfs_in_grace() ||
+	    op_ctx->fsal_export->exp_ops.fs_supports(op_ctx->fsal_export,
+						     fso_grace_method))
+		return NFS4_GRACE_NONE;
+
+	return reclaim ? NFS4_GRACE_RECLAIM : NFS4_GRACE_REFUSED;
+}
+
+/**
+ * @brief Whether a reclaiming COMPOUND goes ahead of other requests
+ *
+ * At most Reclaim_Priority_Per_Client COMPOUNDs of an NFSv4.1 client do
+ * at once, so that one client's reclaims do not hold up the others'.
+ *
+ * @param[in,out] data  The compound request's data
+ *
+ * @return true if its reclaims go first.
+ */
+static bool nfs4_reclaim_prio(compound_data_t *data)
+{
+	uint32_t max = nfs_param.nfsv4_param.reclaim_priority_per_client;
+	nfs_client_id_t *clientid;
+
+	if (data->reclaim_prio)
+		return true;
+
+	if (max == 0)
+		return false;
+
+	/* NFSv4.0 reclaims name their client op by op, they are not paced */
+	if (data->session == NULL)
+		return true;
+
+	clientid = data->session->clientid_record;
+
+	if (atomic_inc_int32_t(&clientid->cid_reclaim_prio) > (int32_t) max) {
+		(void) atomic_dec_int32_t(&clientid->cid_reclaim_prio);
+		return false;
+	}
+
+	data->reclaim_prio = true;
+	return true;
+}
+
+/**
+ * @brief Charge a COMPOUND against its throttles and partition
+ *
+ * Done once, at the first op that works on an export.  The ops before
+ * it need no filehandle and change nothing on the export, so turning
+ * the COMPOUND away there with NFS4ERR_DELAY does not make the client
+ * run any of its ops twice.  The whole COMPOUND is charged, and holds
+ * its partition slot until it is done or suspends, even if it crosses
+ * into another export.
+ *
+ * @param[in,out] data     The compound request's data
+ * @param[in]     reclaim  The op is a reclaim during grace
+ * @param[out]    reason   Why the COMPOUND was turned away
+ *
+ * @return NFS4_OK or NFS4ERR_DELAY.
+ */
+static nfsstat4 nfs4_compound_admit(compound_data_t *data, bool reclaim,
+				    const char **reason)
+{
+	uint64_t bytes = 0;
+	uint32_t i;
+
+	for (i = data->oppos; i < data->argarray_len; i++)
+		bytes += nfs4_throttle_bytes(&data->argarray[i]);
+
+	if (nfs_throttle(bytes) != 0) {
+		*reason = "Over throttle budget";
+		return NFS4ERR_DELAY;
+	}
+
+	if (nfs_partition_enter(reclaim && nfs4_reclaim_prio(data)) != 0) {
+		*reason = "Partition full";
+		return NFS4ERR_DELAY;
+	}
+
+	data->admitted = true;
+	return NFS4_OK;
+}
+
+/**
+ * @brief Outcome of processing one op of a COMPOUND
+ */
+enum nfs4_op_result {
+	NFS4_OP_NEXT,		/*< Go on with the next op */
+	NFS4_OP_STOP,		/*< The COMPOUND is done */
+	NFS4_OP_SUSPEND,	/*< The op suspended the COMPOUND */
+};
+
+/* nfs4_op_async_suspend()/nfs4_op_async_done() handshake, whichever of
+ * the op and its callback finishes second goes on with the COMPOUND.
+ */
+#define NFS4_ASYNC_DONE		0x01	/*< The callback has run */
+#define NFS4_ASYNC_SUSPENDED	0x02	/*< The op returned, suspending */
+
+/**
+ * @brief Account for the result of the current op of a COMPOUND
+ *
+ * @param[in,out] data    The compound request's data
+ * @param[in]     status  Status the op completed with
+ *
+ * @retval NFS4_OP_NEXT to go on with the next op.
+ * @retval NFS4_OP_STOP if the COMPOUND is done.
+ */
+static enum nfs4_op_result nfs4_complete_one_op(compound_data_t *data,
+						nfsstat4 status)
+{
+	const uint32_t i = data->oppos;
+	nfs_resop4 *resarray = data->res->res_compound4.resarray.resarray_val;
+
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, v4op_end, i, data->argarray[i].argop,
+		   data->opname, nfsstat4_to_str(status));
+#endif
+
+	data->status = status;
+
+	LogCompoundFH(data);
+
+	/* All the operation, like NFS4_OP_ACCESS, have a first replied
+	 * field called .status
+	 */
+	resarray[i].nfs_resop4_u.opaccess.status = status;
+
+	server_stats_nfsv4_op_done(data->opcode, data->op_start_time, status);
+	if (op_ctx->time_fsal)
+		server_stats_nfsv4_op_stages(data->opcode, data->op_start_time,
+					     op_ctx->fsal_time -
+					     data->op_fsal_time);
+
+	/* Tally the response size */
+	if (status != NFS4_OK &&
+	    (optabv4[data->opcode].resp_size != VARIABLE_RESP_SIZE ||
+	     data->op_resp_size == VARIABLE_RESP_SIZE)) {
+		/* If the op failed and has a static response size, or
+		 * it has a variable size that hasn't been set, use the
+		 * sizeof nfsstat4 instead.
+		 */
+		data->op_resp_size = sizeof(nfsstat4);
+	}
+
+	data->resp_size += sizeof(nfs_opnum4) + data->op_resp_size;
+
+	LogDebug(COMPONENT_NFS_V4,
+		 "Status of %s in position %d = %s, op response size is %"
+		 PRIu32" total response size is %"PRIu32,
+		 data->opname, i, nfsstat4_to_str(status),
+		 data->op_resp_size, data->resp_size);
+
+	if (status != NFS4_OK) {
+		/* An error occurred, we do not manage the other requests
+		 * in the COMPOUND, this may be a regular behavior
+		 */
+		data->res->res_compound4.resarray.resarray_len = i + 1;
+		return NFS4_OP_STOP;
+	}
+
+	/* NFS_V4.1 specific stuff */
+	if (data->use_slot_cached_result) {
+		/* Replay cache, only true for SEQUENCE or
+		 * CREATE_SESSION w/o SEQUENCE. Since will only be set
+		 * in those cases, no need to check operation or
+		 * anything.
+		 */
+
+		/* Free the reply allocated above */
+		nfs4_Compound_FreeResarray(data->res);
+
+		/* Copy the reply from the cache */
+		data->res->res_compound4_extended = *data->cached_result;
+		data->status = ((COMPOUND4res *) data->cached_result)->status;
+		LogFullDebug(COMPONENT_SESSIONS,
+			     "Use session replay cache %p result %s",
+			     data->cached_result,
+			     nfsstat4_to_str(data->status));
+		return NFS4_OP_STOP;
+	}
+
+	return NFS4_OP_NEXT;
+}
+
+/**
+ * @brief Check and run the current op of a COMPOUND
+ *
+ * @param[in,out] data  The compound request's data
+ *
+ * @retval NFS4_OP_NEXT to go on with the next op.
+ * @retval NFS4_OP_STOP if the COMPOUND is done.
+ * @retval NFS4_OP_SUSPEND if the op suspended the COMPOUND, in which case
+ *         @a data belongs to whoever resumes it.
+ */
+static enum nfs4_op_result nfs4_process_one_op(compound_data_t *data)
+{
+	const uint32_t i = data->oppos;
+	nfs_resop4 *resarray = data->res->res_compound4.resarray.resarray_val;
+	nfs_opnum4 opcode;
+	struct timespec ts;
+	int perm_flags;
+	int status;
+	enum nfs4_grace_class grace;
+	const char *bad_op_state_reason = "";
+	log_components_t alt_component = COMPONENT_NFS_V4;
+
+	data->op_resp_size = sizeof(nfsstat4);
+	opcode = data->argarray[i].argop;
+
+	/* Handle opcode overflow */
+	if (opcode > LastOpcode[data->minorversion])
+		opcode = 0;
+
+	data->opcode = opcode;
+	data->opname = optabv4[opcode].name;
+
+	LogDebug(COMPONENT_NFS_V4, "Request %d: opcode %d is %s", i,
+		 data->argarray[i].argop, data->opname);
+
+	/* Verify BIND_CONN_TO_SESSION is not used in a compound
+	 * with length > 1. This check is NOT redundant with the
+	 * checks above.
+	 */
+	if (i > 0 &&
+	    data->argarray[i].argop == NFS4_OP_BIND_CONN_TO_SESSION) {
+		status = NFS4ERR_NOT_ONLY_OP;
+		bad_op_state_reason =
+				"BIND_CONN_TO_SESSION past position 1";
+		goto bad_op_state;
+	}
+
+	/* OP_SEQUENCE is always the first operation of the request */
+	if (i > 0 && data->argarray[i].argop == NFS4_OP_SEQUENCE) {
+		status = NFS4ERR_SEQUENCE_POS;
+		bad_op_state_reason =
+				"SEQUENCE past position 1";
+		goto bad_op_state;
+	}
+
+	/* If a DESTROY_SESSION not the only operation, and it matches
+	 * the session specified in the SEQUENCE op (since the compound
+	 * has more than one op, we already know it MUST start with
+	 * SEQUENCE), then it MUST be the final op in the compound.
+	 */
+	if (i > 0 && data->argarray[i].argop == NFS4_OP_DESTROY_SESSION) {
+		bool session_compare;
+		bool bad_pos;
+
+		session_compare = memcmp(
+		    data->argarray[0].nfs_argop4_u.opsequence.sa_sessionid,
+		    data->argarray[i]
+			.nfs_argop4_u.opdestroy_session.dsa_sessionid,
+		    NFS4_SESSIONID_SIZE) == 0;
+
+		bad_pos = session_compare && i != (data->argarray_len - 1);
+
+		LogAtLevel(COMPONENT_SESSIONS,
+			   bad_pos ? NIV_INFO : NIV_DEBUG,
+			   "DESTROY_SESSION in position %u out of 0-%"
+			   PRIi32 " %s is %s",
+			   i, data->argarray_len - 1, session_compare
+				? "same session as SEQUENCE"
+				: "different session from SEQUENCE",
+			   bad_pos ? "not last op in compound" : "opk");
+
+		if (bad_pos) {
+			status = NFS4ERR_NOT_ONLY_OP;
+			bad_op_state_reason =
+			    "DESTROY_SESSION not last op in compound";
+			goto bad_op_state;
+		}
+	}
+
+	/* time each op */
+	now(&ts);
+	data->op_start_time = timespec_diff(&nfs_ServerBootTime, &ts);
+	data->op_fsal_time = op_ctx->fsal_time;
+	if (op_ctx->top_fh != NULL)
+		server_topk_key(op_ctx->top_fh, data->currentFH.nfs_fh4_val,
+				data->currentFH.nfs_fh4_len);
+
+	if (data->minorversion > 0 && data->session != NULL &&
+	    data->session->fore_channel_attrs.ca_maxoperations == i) {
+		status = NFS4ERR_TOO_MANY_OPS;
+		bad_op_state_reason = "Too many operations";
+		goto bad_op_state;
+	}
+
+	perm_flags =
+	    optabv4[opcode].exp_perm_flags & EXPORT_OPTION_ACCESS_MASK;
+
+	if (perm_flags != 0) {
+		status = nfs4_Is_Fh_Empty(&data->currentFH);
+		if (status != NFS4_OK) {
+			bad_op_state_reason = "Empty or NULL handle";
+			goto bad_op_state;
+		}
+
+		/* Operation uses a CurrentFH, so we can check export
+		 * perms. Perms should even be set reasonably for pseudo
+		 * file system.
+		 */
+		LogMidDebugAlt(COMPONENT_NFS_V4, COMPONENT_EXPORT,
+			       "Check export perms export = %08x req = %08x",
+			       op_ctx->export_perms->options &
+					EXPORT_OPTION_ACCESS_MASK,
+			       perm_flags);
+		if ((op_ctx->export_perms->options &
+		     perm_flags) != perm_flags) {
+			/* Export doesn't allow requested
+			 * access for this client.
+			 */
+			if ((perm_flags & EXPORT_OPTION_MODIFY_ACCESS)
+			    != 0)
+				status = NFS4ERR_ROFS;
+			else
+				status = NFS4ERR_ACCESS;
+
+			bad_op_state_reason =
+					"Export permission failure";
+			alt_component = COMPONENT_EXPORT;
+			goto bad_op_state;
+		}
+
+		grace = nfs4_op_grace_class(&data->argarray[i]);
+
+		if (grace == NFS4_GRACE_REFUSED) {
+			/* Don't let it wait for what reclaims need */
+			status = NFS4ERR_GRACE;
+			bad_op_state_reason = "Not a reclaim during grace";
+			goto bad_op_state;
+		}
+
+		if (!data->admitted) {
+			bool reclaim = grace == NFS4_GRACE_RECLAIM;
+
+			status = nfs4_compound_admit(data, reclaim,
+						     &bad_op_state_reason);
+			if (status != NFS4_OK)
+				goto bad_op_state;
+		}
+	}
+
+	/* Set up the minimum/default response size and check if there
+	 * is room for it.
+	*/
+	data->op_resp_size = optabv4[opcode].resp_size;
+
+	status = check_resp_room(data, data->op_resp_size);
+
+	if (status != NFS4_OK) {
+		bad_op_state_reason = "op response size";
+
+ bad_op_state:
+		/* Tally the response size */
+		data->resp_size += sizeof(nfs_opnum4) + sizeof(nfsstat4);
+
+		LogDebugAlt(COMPONENT_NFS_V4, alt_component,
+			    "Status of %s in position %d due to %s is %s, op response size = %"
+			    PRIu32" total response size = %"PRIu32,
+			    data->opname, i, bad_op_state_reason,
+			    nfsstat4_to_str(status),
+			    data->op_resp_size, data->resp_size);
+
+		/* All the operation, like NFS4_OP_ACCESS, have
+		 * a first replied field called .status
+		 */
+		resarray[i].nfs_resop4_u.opaccess.status = status;
+		resarray[i].resop = data->argarray[i].argop;
+
+		/* Do not manage the other requests in the COMPOUND. */
+		data->res->res_compound4.resarray.resarray_len = i + 1;
+		data->status = status;
+		return NFS4_OP_STOP;
+	}
+
+	/***************************************************************
+	 * Make the actual op call                                     *
+	 **************************************************************/
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, v4op_start, i, data->argarray[i].argop,
+		   data->opname);
+#endif
+
+	/* Clean handshake for ops calling nfs4_op_async_suspend() */
+	data->async_flags = 0;
+
+	status = (optabv4[opcode].funct) (&data->argarray[i], data,
+					  &resarray[i]);
+
+	if (status == NFS4_OP_ASYNC_WAIT)
+		return NFS4_OP_SUSPEND;
+
+	return nfs4_complete_one_op(data, status);
+}
+
+/**
+ * @brief Finish a COMPOUND once its last op has been processed
+ *
+ * @param[in,out] data  The compound request's data, freed here
+ *
+ * @retval NFS_REQ_OK
+ */
+static int complete_nfs4_compound(compound_data_t *data)
+{
+	nfs_res_t *res = data->res;
+	nfsstat4 status = data->status;
+
+	server_stats_compound_done(data->argarray_len, status);
+
+	/* Complete the reply, in particular, tell where you stopped if
+	 * unsuccessful COMPOUND
+	 */
+	res->res_compound4.status = status;
+
+	/* Manage session's DRC: keep NFS4.1 replay for later use, but don't
+	 * save a replayed result again.
+	 */
+	if (data->sa_cachethis) {
+		/* Pointer has been set by nfs4_op_sequence and points to slot
+		 * to cache result in.
+		 */
+		LogFullDebug(COMPONENT_SESSIONS,
+			     "Save result in session replay cache %p sizeof nfs_res_t=%d",
+			     data->cached_result, (int)sizeof(nfs_res_t));
+
+		/* Indicate to nfs4_Compound_Free that this reply is cached. */
+		res->res_compound4_extended.res_cached = true;
+
+		/* Save the result in the cache (copy out of the result array
+		 * into the slot cache (which is pointed to by
+		 * data->cached_result).
+		 */
+		*data->cached_result = res->res_compound4_extended;
+	} else if (data->minorversion > 0 && !data->use_slot_cached_result &&
+		   data->argarray[0].argop == NFS4_OP_SEQUENCE &&
+		   data->cached_result != NULL) {
+		/* We need to cache an "uncached" response. The length is
+		 * 1 if only one op processed, otherwise 2.  It goes in the
+		 * slot's own array, so nothing is allocated for it.
+		 */
+		nfs41_session_slot_t *slot =
+			container_of(data->cached_result, nfs41_session_slot_t,
+				     cached_result);
+		struct COMPOUND4res *c_res =
+			&data->cached_result->res_compound4;
+		u_int resarray_len =
+			res->res_compound4.resarray.resarray_len == 1 ? 1 : 2;
+		struct nfs_resop4 *res0;
+
+		c_res->resarray.resarray_len = resarray_len;
+		c_res->resarray.resarray_val = slot->uncached_res;
+		copy_tag(&c_res->tag, &res->res_compound4.tag);
+		res0 = c_res->resarray.resarray_val;
+
+		/* Copy the sequence result. */
+		*res0 = res->res_compound4.resarray.resarray_val[0];
+		c_res->status = res0->nfs_resop4_u.opillegal.status;
+
+		if (resarray_len == 2) {
+			struct nfs_resop4 *res1 = res0 + 1;
+
+			/* Shallow copy response since we will override any
+			 * resok or any negative response that might have
+			 * allocated data->
+			 */
+			*res1 = res->res_compound4.resarray.resarray_val[1];
+
+			/* Override NFS4_OK and NFS4ERR_DENIED. We MUST override
+			 * NFS4_OK since we aren't caching a full response and
+			 * we MUST override NFS4ERR_DENIED because LOCK and
+			 * LOCKT allocate data that we did not deep copy.
+			 *
+			 * If any new operations are added with dynamically
+			 * allocated data associated with a non-NFS4_OK
+			 * status are added in some future minor version, they
+			 * will likely need special handling here also.
+			 *
+			 * Note that we COULD get fancy and if we had a 2 op
+			 * compound that had an NFS4_OK status and no dynamic
+			 * data was allocated then go ahead and cache the
+			 * full response since it wouldn't take any more
+			 * memory. However, that would add a lot more special
+			 * handling here.
+			 */
+			if (res1->nfs_resop4_u.opillegal.status == NFS4_OK ||
+			    res1->nfs_resop4_u.opillegal.status ==
+							NFS4ERR_DENIED) {
+				res1->nfs_resop4_u.opillegal.status =
+						NFS4ERR_RETRY_UNCACHED_REP;
+			}
+
+			c_res->status = res1->nfs_resop4_u.opillegal.status;
+		}
+
+		/* Indicate that this reply is cached in slot cache. */
+		data->cached_result->res_cached = true;
+	}
+
+	/* If we have reserved a lease, update it and release it */
+	if (data->preserved_clientid != NULL) {
+		/* Update and release lease */
+		update_lease(data->preserved_clientid);
+	}
+
+	if (status != NFS4_OK)
+		LogDebug(COMPONENT_NFS_V4, "End status = %s lastindex = %d",
+			 nfsstat4_to_str(status), data->oppos);
+
+	compound_data_Free(data);
+	pool_free(compound_data_pool, data);
+
+	/* release current active export in op_ctx. */
+	if (op_ctx->ctx_export) {
+		put_gsh_export(op_ctx->ctx_export);
+		op_ctx->ctx_export = NULL;
+		op_ctx->fsal_export = NULL;
+	}
+
+	return NFS_REQ_OK;
+}
+
+/**
+ * @brief Run the ops of a COMPOUND from its current position
  *
+ * @param[in,out] data  The compound request's data
+ *
+ * @retval NFS_REQ_OK if the COMPOUND is done.
+ * @retval NFS_REQ_ASYNC_WAIT if an op suspended it.
  */
-nfs_opnum4 LastOpcode[] = {
-	NFS4_OP_RELEASE_LOCKOWNER,
-	NFS4_OP_RECLAIM_COMPLETE,
-	NFS4_OP_REMOVEXATTR
-};
+static int nfs4_compound_run(compound_data_t *data)
+{
+	while (data->oppos < data->argarray_len) {
+		switch (nfs4_process_one_op(data)) {
+		case NFS4_OP_NEXT:
+			data->oppos++;
+			continue;
+		case NFS4_OP_STOP:
+			break;
+		case NFS4_OP_SUSPEND:
+			return NFS_REQ_ASYNC_WAIT;
+		}
+		break;
+	}
 
-void copy_tag(utf8str_cs *dest, utf8str_cs *src)
+	return complete_nfs4_compound(data);
+}
+
+/**
+ * @brief The v4.1 slot a COMPOUND holds locked, if any
+ */
+static inline nfs41_session_slot_t *nfs4_compound_slot(compound_data_t *data)
 {
-	/* Keeping the same tag as in the arguments */
-	dest->utf8string_len = src->utf8string_len;
+	if (data->session == NULL || data->slot == UINT32_MAX)
+		return NULL;
 
-	if (dest->utf8string_len > 0) {
+	return data->session->fc_slots[data->slot];
+}
 
-		dest->utf8string_val = gsh_malloc(dest->utf8string_len + 1);
+/**
+ * @brief Resume a COMPOUND whose async op has completed
+ *
+ * Runs the rest of the COMPOUND on the calling thread and replies.
+ *
+ * @param[in,out] data  The compound request's data
+ */
+static void nfs4_compound_resume(compound_data_t *data)
+{
+	request_data_t *reqdata =
+		container_of(data->req, request_data_t, r_u.req.svc);
+	struct req_op_context *saved_ctx = op_ctx;
+	nfs41_session_slot_t *slot = nfs4_compound_slot(data);
+	int rc = NFS_REQ_OK;
 
-		memcpy(dest->utf8string_val,
-		       src->utf8string_val,
-		       dest->utf8string_len);
+	op_ctx = &reqdata->r_u.req.req_ctx;
 
-		dest->utf8string_val[dest->utf8string_len] = '\0';
+	LogFullDebug(COMPONENT_NFS_V4, "Resuming %s in position %" PRIu32,
+		     data->opname, data->oppos);
+
+	if (slot != NULL) {
+		/* Take the slot back for this thread */
+		PTHREAD_MUTEX_lock(&slot->lock);
+		slot->suspended = false;
+	}
+
+	if (nfs4_complete_one_op(data, data->async_status) == NFS4_OP_NEXT) {
+		data->oppos++;
+		rc = nfs4_compound_run(data);
 	} else {
-		dest->utf8string_val = NULL;
+		rc = complete_nfs4_compound(data);
+	}
+
+	if (rc != NFS_REQ_ASYNC_WAIT)
+		nfs_rpc_complete_async_request(reqdata, rc);
+
+	op_ctx = saved_ctx;
+}
+
+/**
+ * @brief Check whether an op must suspend its COMPOUND
+ *
+ * An op that started an FSAL call whose callback will call
+ * nfs4_op_async_done() calls this once the FSAL call returns.  If the
+ * callback already ran, the op carries on as usual.  Otherwise the op must
+ * return NFS4_OP_ASYNC_WAIT at once without touching @a data again, and
+ * the worker goes back to the pool; the callback resumes the COMPOUND.
+ *
+ * A mutex must be unlocked by the thread that locked it, so the v4.1 slot
+ * lock is dropped while suspended and retaken by the resuming thread;
+ * SEQUENCE on a suspended slot gets NFS4ERR_DELAY meanwhile.  The
+ * partition slot is given back for good, the rest of the COMPOUND
+ * having been admitted already.
+ *
+ * @param[in,out] data  The compound request's data
+ *
+ * @return true if the op must return NFS4_OP_ASYNC_WAIT.
+ */
+bool nfs4_op_async_suspend(compound_data_t *data)
+{
+	nfs41_session_slot_t *slot;
+	uint32_t flags;
+
+	/* Most FSALs call back before returning */
+	if (atomic_fetch_uint32_t(&data->async_flags) & NFS4_ASYNC_DONE)
+		return false;
+
+	slot = nfs4_compound_slot(data);
+
+	/* Hold the request for whoever resumes it */
+	(void) atomic_inc_uint32_t(&data->req->rq_refcnt);
+
+	if (slot != NULL) {
+		slot->suspended = true;
+		PTHREAD_MUTEX_unlock(&slot->lock);
 	}
+
+	/* Don't keep others out of the partition while parked */
+	nfs_partition_exit();
+
+	flags = atomic_postset_uint32_t_bits(&data->async_flags,
+					     NFS4_ASYNC_SUSPENDED);
+	if (!(flags & NFS4_ASYNC_DONE))
+		return true;
+
+	/* The callback ran already, go on synchronously */
+	if (slot != NULL) {
+		PTHREAD_MUTEX_lock(&slot->lock);
+		slot->suspended = false;
+	}
+
+	(void) atomic_dec_uint32_t(&data->req->rq_refcnt);
+	return false;
+}
+
+/**
+ * @brief Report the completion of an async op
+ *
+ * Called from the callback of the FSAL call, once the op's result is
+ * filled in.  If the op suspended the COMPOUND it is resumed here.
+ *
+ * @param[in,out] data    The compound request's data
+ * @param[in]     status  Status of the op
+ */
+void nfs4_op_async_done(compound_data_t *data, nfsstat4 status)
+{
+	uint32_t flags;
+
+	data->async_status = status;
+
+	flags = atomic_postset_uint32_t_bits(&data->async_flags,
+					     NFS4_ASYNC_DONE);
+	if (flags & NFS4_ASYNC_SUSPENDED)
+		nfs4_compound_resume(data);
 }
 
 /**
@@ -612,24 +1396,18 @@ void copy_tag(utf8str_cs *dest, utf8str_cs *src)
  *
  * @retval NFS_REQ_OKAY if a result is sent.
  * @retval NFS_REQ_DROP if we pretend we never saw the request.
+ * @retval NFS_REQ_ASYNC_WAIT if an op suspended the COMPOUND, the reply
+ *         is sent when it is resumed.
  */
 
 int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 {
-	unsigned int i = 0;
 	int status = NFS4_OK;
-	compound_data_t data;
-	nfs_opnum4 opcode;
+	compound_data_t *data;
 	const uint32_t compound4_minor = arg->arg_compound4.minorversion;
 	const uint32_t argarray_len = arg->arg_compound4.argarray.argarray_len;
 	/* Array of op arguments */
 	nfs_argop4 * const argarray = arg->arg_compound4.argarray.argarray_val;
-	nfs_resop4 *resarray;
-	nsecs_elapsed_t op_start_time;
-	struct timespec ts;
-	int perm_flags;
-	const char *bad_op_state_reason = "";
-	log_components_t alt_component = COMPONENT_NFS_V4;
 
 	if (compound4_minor > 2) {
 		LogCrit(COMPONENT_NFS_V4, "Bad Minor Version %d",
@@ -649,8 +1427,10 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		return NFS_REQ_OK;
 	}
 
-	/* Initialisation of the compound request internal's data */
-	memset(&data, 0, sizeof(data));
+	/* Initialisation of the compound request internal's data, it
+	 * outlives this call if an op suspends the COMPOUND.
+	 */
+	data = pool_alloc(compound_data_pool);
 	op_ctx->nfs_minorvers = compound4_minor;
 
 	/* Keeping the same tag as in the arguments */
@@ -660,7 +1440,7 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		/* Check if the tag is a valid utf8 string */
 		status =
 		    nfs4_utf8string2dynamic(&(res->res_compound4.tag),
-					    UTF8_SCAN_ALL, &data.tagname);
+					    UTF8_SCAN_ALL, &data->tagname);
 		if (status != 0) {
 			char str[LOG_BUFF_LEN];
 			struct display_buffer dspbuf = {sizeof(str), str, str};
@@ -679,18 +1459,19 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 			status = NFS4ERR_INVAL;
 			res->res_compound4.status = status;
 			res->res_compound4.resarray.resarray_len = 0;
-			compound_data_Free(&data);
+			compound_data_Free(data);
+			pool_free(compound_data_pool, data);
 			return NFS_REQ_OK;
 		}
 	} else {
 		/* No tag */
-		data.tagname = gsh_strdup("NO TAG");
+		data->tagname = gsh_strdup("NO TAG");
 	}
 
 	/* Managing the operation list */
 	LogDebug(COMPONENT_NFS_V4,
 		 "COMPOUND: There are %d operations, res = %p, tag = %s",
-		 argarray_len, res, data.tagname);
+		 argarray_len, res, data->tagname);
 
 	/* Check for empty COMPOUND request */
 	if (argarray_len == 0) {
@@ -699,7 +1480,8 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 		res->res_compound4.status = NFS4_OK;
 		res->res_compound4.resarray.resarray_len = 0;
-		compound_data_Free(&data);
+		compound_data_Free(data);
+		pool_free(compound_data_pool, data);
 		return NFS_REQ_OK;
 	}
 
@@ -711,20 +1493,25 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 		res->res_compound4.status = NFS4ERR_RESOURCE;
 		res->res_compound4.resarray.resarray_len = 0;
-		compound_data_Free(&data);
+		compound_data_Free(data);
+		pool_free(compound_data_pool, data);
 		return NFS_REQ_OK;
 	}
 
 	/* Minor version related stuff */
-	data.minorversion = compound4_minor;
-	data.req = req;
+	data->minorversion = compound4_minor;
+	data->req = req;
+	data->argarray = argarray;
+	data->argarray_len = argarray_len;
+	data->res = res;
 
 	/* Initialize response size with size of compound response size. */
-	data.resp_size = sizeof(COMPOUND4res) - sizeof(nfs_resop4 *);
+	data->resp_size = sizeof(COMPOUND4res) - sizeof(nfs_resop4 *);
 
 	/* Building the client credential field */
-	if (nfs_rpc_req2client_cred(req, &(data.credential)) == -1) {
-		compound_data_Free(&data);
+	if (nfs_rpc_req2client_cred(req, &(data->credential)) == -1) {
+		compound_data_Free(data);
+		pool_free(compound_data_pool, data);
 		return NFS_REQ_DROP;	/* Malformed credential */
 	}
 
@@ -733,11 +1520,16 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	    arg->arg_compound4.tag.utf8string_len;
 
 	/* Allocating the reply nfs_resop4 */
-	res->res_compound4.resarray.resarray_val =
-		gsh_calloc(argarray_len, sizeof(struct nfs_resop4));
+	if (argarray_len <= NFS4_RESARRAY_POOLED) {
+		res->res_compound4.resarray.resarray_val =
+			pool_alloc(nfs4_resarray_pool);
+		res->res_compound4_extended.res_pooled = true;
+	} else {
+		res->res_compound4.resarray.resarray_val =
+			gsh_calloc(argarray_len, sizeof(struct nfs_resop4));
+	}
 
 	res->res_compound4.resarray.resarray_len = argarray_len;
-	resarray = res->res_compound4.resarray.resarray_val;
 
 	/* Manage errors NFS4ERR_OP_NOT_IN_SESSION and NFS4ERR_NOT_ONLY_OP.
 	 * These checks apply only to 4.1 */
@@ -755,7 +1547,8 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 			status = NFS4ERR_OP_NOT_IN_SESSION;
 			res->res_compound4.status = status;
 			res->res_compound4.resarray.resarray_len = 0;
-			compound_data_Free(&data);
+			compound_data_Free(data);
+			pool_free(compound_data_pool, data);
 			return NFS_REQ_OK;
 		}
 
@@ -781,348 +1574,30 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 				status = NFS4ERR_NOT_ONLY_OP;
 				res->res_compound4.status = status;
 				res->res_compound4.resarray.resarray_len = 0;
-				compound_data_Free(&data);
+				compound_data_Free(data);
+				pool_free(compound_data_pool, data);
 				return NFS_REQ_OK;
 			}
 		}
 	}
 
-	for (i = 0; i < argarray_len; i++) {
-		/* Used to check if OP_SEQUENCE is the first operation */
-		data.oppos = i;
-		data.op_resp_size = sizeof(nfsstat4);
-		opcode = argarray[i].argop;
-
-		/* Handle opcode overflow */
-		if (opcode > LastOpcode[compound4_minor])
-			opcode = 0;
-
-		data.opname = optabv4[opcode].name;
-
-		LogDebug(COMPONENT_NFS_V4, "Request %d: opcode %d is %s", i,
-			 argarray[i].argop, data.opname);
-
-		/* Verify BIND_CONN_TO_SESSION is not used in a compound
-		 * with length > 1. This check is NOT redundant with the
-		 * checks above.
-		 */
-		if (i > 0 &&
-		    argarray[i].argop == NFS4_OP_BIND_CONN_TO_SESSION) {
-			status = NFS4ERR_NOT_ONLY_OP;
-			bad_op_state_reason =
-					"BIND_CONN_TO_SESSION past position 1";
-			goto bad_op_state;
-		}
-
-		/* OP_SEQUENCE is always the first operation of the request */
-		if (i > 0 && argarray[i].argop == NFS4_OP_SEQUENCE) {
-			status = NFS4ERR_SEQUENCE_POS;
-			bad_op_state_reason =
-					"SEQUENCE past position 1";
-			goto bad_op_state;
-		}
-
-		/* If a DESTROY_SESSION not the only operation, and it matches
-		 * the session specified in the SEQUENCE op (since the compound
-		 * has more than one op, we already know it MUST start with
-		 * SEQUENCE), then it MUST be the final op in the compound.
-		 */
-		if (i > 0 && argarray[i].argop == NFS4_OP_DESTROY_SESSION) {
-			bool session_compare;
-			bool bad_pos;
-
-			session_compare = memcmp(
-			    argarray[0].nfs_argop4_u.opsequence.sa_sessionid,
-			    argarray[i]
-				.nfs_argop4_u.opdestroy_session.dsa_sessionid,
-			    NFS4_SESSIONID_SIZE) == 0;
-
-			bad_pos = session_compare && i != (argarray_len - 1);
-
-			LogAtLevel(COMPONENT_SESSIONS,
-				   bad_pos ? NIV_INFO : NIV_DEBUG,
-				   "DESTROY_SESSION in position %u out of 0-%"
-				   PRIi32 " %s is %s",
-				   i, argarray_len - 1, session_compare
-					? "same session as SEQUENCE"
-					: "different session from SEQUENCE",
-				   bad_pos ? "not last op in compound" : "opk");
-
-			if (bad_pos) {
-				status = NFS4ERR_NOT_ONLY_OP;
-				bad_op_state_reason =
-				    "DESTROY_SESSION not last op in compound";
-				goto bad_op_state;
-			}
-		}
-
-		/* time each op */
-		now(&ts);
-		op_start_time = timespec_diff(&nfs_ServerBootTime, &ts);
-
-		if (compound4_minor > 0 && data.session != NULL &&
-		    data.session->fore_channel_attrs.ca_maxoperations == i) {
-			status = NFS4ERR_TOO_MANY_OPS;
-			bad_op_state_reason = "Too many operations";
-			goto bad_op_state;
-		}
-
-		perm_flags =
-		    optabv4[opcode].exp_perm_flags & EXPORT_OPTION_ACCESS_MASK;
-
-		if (perm_flags != 0) {
-			status = nfs4_Is_Fh_Empty(&data.currentFH);
-			if (status != NFS4_OK) {
-				bad_op_state_reason = "Empty or NULL handle";
-				goto bad_op_state;
-			}
-
-			/* Operation uses a CurrentFH, so we can check export
-			 * perms. Perms should even be set reasonably for pseudo
-			 * file system.
-			 */
-			LogMidDebugAlt(COMPONENT_NFS_V4, COMPONENT_EXPORT,
-				       "Check export perms export = %08x req = %08x",
-				       op_ctx->export_perms->options &
-						EXPORT_OPTION_ACCESS_MASK,
-				       perm_flags);
-			if ((op_ctx->export_perms->options &
-			     perm_flags) != perm_flags) {
-				/* Export doesn't allow requested
-				 * access for this client.
-				 */
-				if ((perm_flags & EXPORT_OPTION_MODIFY_ACCESS)
-				    != 0)
-					status = NFS4ERR_ROFS;
-				else
-					status = NFS4ERR_ACCESS;
-
-				bad_op_state_reason =
-						"Export permission failure";
-				alt_component = COMPONENT_EXPORT;
-				goto bad_op_state;
-			}
-		}
-
-		/* Set up the minimum/default response size and check if there
-		 * is room for it.
-		*/
-		data.op_resp_size = optabv4[opcode].resp_size;
-
-		status = check_resp_room(&data, data.op_resp_size);
-
-		if (status != NFS4_OK) {
-			bad_op_state_reason = "op response size";
-
- bad_op_state:
-			/* Tally the response size */
-			data.resp_size += sizeof(nfs_opnum4) + sizeof(nfsstat4);
-
-			LogDebugAlt(COMPONENT_NFS_V4, alt_component,
-				    "Status of %s in position %d due to %s is %s, op response size = %"
-				    PRIu32" total response size = %"PRIu32,
-				    data.opname, i, bad_op_state_reason,
-				    nfsstat4_to_str(status),
-				    data.op_resp_size, data.resp_size);
-
-			/* All the operation, like NFS4_OP_ACCESS, have
-			 * a first replied field called .status
-			 */
-			resarray[i].nfs_resop4_u.opaccess.status = status;
-			resarray[i].resop = argarray[i].argop;
-
-			/* Do not manage the other requests in the COMPOUND. */
-			res->res_compound4.resarray.resarray_len = i + 1;
-			break;
-		}
-
-		/***************************************************************
-		 * Make the actual op call                                     *
-		 **************************************************************/
-#ifdef USE_LTTNG
-		tracepoint(nfs_rpc, v4op_start, i, argarray[i].argop,
-			   data.opname);
-#endif
-
-		status = (optabv4[opcode].funct) (&argarray[i],
-						  &data,
-						  &resarray[i]);
-
-#ifdef USE_LTTNG
-		tracepoint(nfs_rpc, v4op_end, i, argarray[i].argop,
-			   data.opname, nfsstat4_to_str(status));
-#endif
-
-		LogCompoundFH(&data);
-
-		/* All the operation, like NFS4_OP_ACESS, have a first replyied
-		 * field called .status
-		 */
-		resarray[i].nfs_resop4_u.opaccess.status = status;
-
-		server_stats_nfsv4_op_done(opcode, op_start_time, status);
-
-		/* Tally the response size */
-		if (status != NFS4_OK &&
-		    (optabv4[opcode].resp_size != VARIABLE_RESP_SIZE ||
-		     data.op_resp_size == VARIABLE_RESP_SIZE)) {
-			/* If the op failed and has a static response size, or
-			 * it has a variable size that hasn't been set, use the
-			 * sizeof nfsstat4 instead.
-			 */
-			data.op_resp_size = sizeof(nfsstat4);
-		}
-
-		data.resp_size += sizeof(nfs_opnum4) + data.op_resp_size;
-
-		LogDebug(COMPONENT_NFS_V4,
-			 "Status of %s in position %d = %s, op response size is %"
-			 PRIu32" total response size is %"PRIu32,
-			 data.opname, i, nfsstat4_to_str(status),
-			 data.op_resp_size, data.resp_size);
-
-		if (status != NFS4_OK) {
-			/* An error occured, we do not manage the other requests
-			 * in the COMPOUND, this may be a regular behavior
-			 */
-			res->res_compound4.resarray.resarray_len = i + 1;
-			break;
-		}
-
-		/* NFS_V4.1 specific stuff */
-		if (data.use_slot_cached_result) {
-			/* Replay cache, only true for SEQUENCE or
-			 * CREATE_SESSION w/o SEQUENCE. Since will only be set
-			 * in those cases, no need to check operation or
-			 * anything.
-			 */
-
-			/* Free the reply allocated above */
-			gsh_free(res->res_compound4.resarray.resarray_val);
-
-			/* Copy the reply from the cache */
-			res->res_compound4_extended = *data.cached_result;
-			status = ((COMPOUND4res *) data.cached_result)->status;
-			LogFullDebug(COMPONENT_SESSIONS,
-				     "Use session replay cache %p result %s",
-				     data.cached_result,
-				     nfsstat4_to_str(status));
-			break;	/* Exit the for loop */
-		}
-	}			/* for */
-
-	server_stats_compound_done(argarray_len, status);
-
-	/* Complete the reply, in particular, tell where you stopped if
-	 * unsuccessfull COMPOUD
-	 */
-	res->res_compound4.status = status;
-
-	/* Manage session's DRC: keep NFS4.1 replay for later use, but don't
-	 * save a replayed result again.
-	 */
-	if (data.sa_cachethis) {
-		/* Pointer has been set by nfs4_op_sequence and points to slot
-		 * to cache result in.
-		 */
-		LogFullDebug(COMPONENT_SESSIONS,
-			     "Save result in session replay cache %p sizeof nfs_res_t=%d",
-			     data.cached_result, (int)sizeof(nfs_res_t));
-
-		/* Indicate to nfs4_Compound_Free that this reply is cached. */
-		res->res_compound4_extended.res_cached = true;
-
-		/* Save the result in the cache (copy out of the result array
-		 * into the slot cache (which is pointed to by
-		 * data.cached_result).
-		 */
-		*data.cached_result = res->res_compound4_extended;
-	} else if (compound4_minor > 0 && !data.use_slot_cached_result &&
-		   argarray[0].argop == NFS4_OP_SEQUENCE &&
-		   data.cached_result != NULL) {
-		/* We need to cache an "uncached" response. The length is
-		 * 1 if only one op processed, otherwise 2. */
-		struct COMPOUND4res *c_res = &data.cached_result->res_compound4;
-		u_int resarray_len =
-			res->res_compound4.resarray.resarray_len == 1 ? 1 : 2;
-		struct nfs_resop4 *res0;
-
-		c_res->resarray.resarray_len = resarray_len;
-		c_res->resarray.resarray_val =
-			gsh_calloc(resarray_len, sizeof(struct nfs_resop4));
-		copy_tag(&c_res->tag, &res->res_compound4.tag);
-		res0 = c_res->resarray.resarray_val;
-
-		/* Copy the sequence result. */
-		*res0 = res->res_compound4.resarray.resarray_val[0];
-		c_res->status = res0->nfs_resop4_u.opillegal.status;
-
-		if (resarray_len == 2) {
-			struct nfs_resop4 *res1 = res0 + 1;
-
-			/* Shallow copy response since we will override any
-			 * resok or any negative response that might have
-			 * allocated data.
-			 */
-			*res1 = res->res_compound4.resarray.resarray_val[1];
-
-			/* Override NFS4_OK and NFS4ERR_DENIED. We MUST override
-			 * NFS4_OK since we aren't caching a full response and
-			 * we MUST override NFS4ERR_DENIED because LOCK and
-			 * LOCKT allocate data that we did not deep copy.
-			 *
-			 * If any new operations are added with dynamically
-			 * allocated data associated with a non-NFS4_OK
-			 * status are added in some future minor version, they
-			 * will likely need special handling here also.
-			 *
-			 * Note that we COULD get fancy and if we had a 2 op
-			 * compound that had an NFS4_OK status and no dynamic
-			 * data was allocated then go ahead and cache the
-			 * full response since it wouldn't take any more
-			 * memory. However, that would add a lot more special
-			 * handling here.
-			 */
-			if (res1->nfs_resop4_u.opillegal.status == NFS4_OK ||
-			    res1->nfs_resop4_u.opillegal.status ==
-							NFS4ERR_DENIED) {
-				res1->nfs_resop4_u.opillegal.status =
-						NFS4ERR_RETRY_UNCACHED_REP;
-			}
-
-			c_res->status = res1->nfs_resop4_u.opillegal.status;
-		}
-
-		/* Indicate that this reply is cached in slot cache. */
-		data.cached_result->res_cached = true;
-	}
-
-	/* If we have reserved a lease, update it and release it */
-	if (data.preserved_clientid != NULL) {
-		/* Update and release lease */
-		PTHREAD_MUTEX_lock(&data.preserved_clientid->cid_mutex);
-
-		update_lease(data.preserved_clientid);
-
-		PTHREAD_MUTEX_unlock(&data.preserved_clientid->cid_mutex);
-	}
-
-	if (status != NFS4_OK)
-		LogDebug(COMPONENT_NFS_V4, "End status = %s lastindex = %d",
-			 nfsstat4_to_str(status), i);
-
-	compound_data_Free(&data);
-
-	/* release current active export in op_ctx. */
-	if (op_ctx->ctx_export) {
-		put_gsh_export(op_ctx->ctx_export);
-		op_ctx->ctx_export = NULL;
-		op_ctx->fsal_export = NULL;
-	}
-
-	return NFS_REQ_OK;
+	return nfs4_compound_run(data);
 }				/* nfs4_Compound */
 
+/**
+ * @brief The name of an NFSv4 operation
+ *
+ * @param[in] op  Operation number, from any minor version
+ *
+ * @return Its name, OP_ILLEGAL if it is none.
+ */
+const char *nfs4_op_name(nfs_opnum4 op)
+{
+	if (op > LastOpcode[NFS4_MINOR_VERS_2])
+		op = 0;
+	return optabv4[op].name;
+}
+
 /**
  *
  * @brief Free the result for one NFS4_OP
@@ -1181,8 +1656,7 @@ void nfs4_Compound_Free(nfs_res_t *res)
 		}
 	}
 
-	gsh_free(res->res_compound4.resarray.resarray_val);
-	res->res_compound4.resarray.resarray_val = NULL;
+	nfs4_Compound_FreeResarray(res);
 
 	gsh_free(res->res_compound4.tag.utf8string_val);
 	res->res_compound4.tag.utf8string_val = NULL;
@@ -1201,15 +1675,22 @@ void compound_data_Free(compound_data_t *data)
 	/* Release refcounted cache entries */
 	set_current_entry(data, NULL);
 	set_saved_entry(data, NULL);
+	nfs4_stateid_cache_release(data);
 
 	gsh_free(data->tagname);
 
+	if (data->reclaim_prio) {
+		(void) atomic_dec_int32_t(
+			&data->session->clientid_record->cid_reclaim_prio);
+		data->reclaim_prio = false;
+	}
+
 	if (data->session) {
 		if (data->slot != UINT32_MAX) {
 			nfs41_session_slot_t *slot;
 
 			/* Release the slot if in use */
-			slot = &data->session->fc_slots[data->slot];
+			slot = data->session->fc_slots[data->slot];
 			PTHREAD_MUTEX_unlock(&slot->lock);
 		}
 
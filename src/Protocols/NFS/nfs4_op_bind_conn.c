@@ -80,10 +80,7 @@ int nfs4_op_bind_conn(struct nfs_argop4 *op, compound_data_t *data,
 		 "BIND_CONN_TO_SESSION session=%p", session);
 
 	/* Check if lease is expired and reserve it */
-	PTHREAD_MUTEX_lock(&session->clientid_record->cid_mutex);
-
-	if (!reserve_lease(session->clientid_record)) {
-		PTHREAD_MUTEX_unlock(&session->clientid_record->cid_mutex);
+	if (!reserve_lease_fast(session->clientid_record)) {
 
 		dec_session_ref(session);
 		res_BIND_CONN_TO_SESSION4->bctsr_status = NFS4ERR_EXPIRED;
@@ -96,8 +93,6 @@ int nfs4_op_bind_conn(struct nfs_argop4 *op, compound_data_t *data,
 
 	data->preserved_clientid = session->clientid_record;
 
-	PTHREAD_MUTEX_unlock(&session->clientid_record->cid_mutex);
-
 	/* By default, no DRC replay */
 	data->use_slot_cached_result = false;
 
@@ -112,18 +107,24 @@ int nfs4_op_bind_conn(struct nfs_argop4 *op, compound_data_t *data,
 	       arg_BIND_CONN_TO_SESSION4->bctsa_sessid,
 	       sizeof(resok_BIND_CONN_TO_SESSION4->bctsr_sessid));
 
+	/* A connection bound for the back channel takes it over only if
+	 * the one in use went down, so a trunked session keeps calling
+	 * back on one connection.
+	 */
 	switch (arg_BIND_CONN_TO_SESSION4->bctsa_dir) {
 	case CDFC4_FORE:
 		resok_BIND_CONN_TO_SESSION4->bctsr_dir = CDFS4_FORE;
 		break;
 	case CDFC4_BACK:
+		(void) nfs_rpc_rebind_chan_v41(data->req->rq_xprt, session);
 		resok_BIND_CONN_TO_SESSION4->bctsr_dir = CDFS4_BACK;
 		break;
 	case CDFC4_FORE_OR_BOTH:
-		resok_BIND_CONN_TO_SESSION4->bctsr_dir = CDFS4_BOTH;
-		break;
 	case CDFC4_BACK_OR_BOTH:
-		resok_BIND_CONN_TO_SESSION4->bctsr_dir = CDFS4_BOTH;
+		if (nfs_rpc_rebind_chan_v41(data->req->rq_xprt, session) == 0)
+			resok_BIND_CONN_TO_SESSION4->bctsr_dir = CDFS4_BOTH;
+		else
+			resok_BIND_CONN_TO_SESSION4->bctsr_dir = CDFS4_FORE;
 		break;
 	}
 
@@ -0,0 +1,978 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs4_op_copy.c
+ * @brief Routines used for managing the NFS4 COMPOUND functions.
+ *
+ * Routines used for managing the NFS4 COMPOUND functions COPY,
+ * OFFLOAD_STATUS, OFFLOAD_CANCEL and CLONE.
+ *
+ * Only copies within this server are done.  Small copies are done
+ * before COPY replies.  Larger ones are handed to copy threads: COPY
+ * replies at once with a callback stateid, the client may follow the
+ * copy with OFFLOAD_STATUS or stop it with OFFLOAD_CANCEL, and is told
+ * of the result with CB_OFFLOAD.  CLONE has the FSAL share the blocks
+ * of the source, and is done before replying.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "fsal.h"
+#include "nfs_core.h"
+#include "sal_functions.h"
+#include "nfs_proto_functions.h"
+#include "nfs_proto_tools.h"
+#include "nfs_convert.h"
+#include "nfs_file_handle.h"
+#include "nfs_rpc_callback.h"
+#include "fridgethr.h"
+#include "export_mgr.h"
+
+/** Bytes an asynchronous copy does between looks for a cancel */
+#define NFS4_COPY_CHUNK (4 * 1024 * 1024)
+
+/** An asynchronous copy */
+struct nfs4_copy {
+	struct glist_head list;		/*< Entry in nfs4_copies */
+	stateid4 stateid;		/*< Callback stateid given the client */
+	nfs_client_id_t *clientid;	/*< Client that asked for the copy */
+	struct gsh_export *export;
+	struct export_perms export_perms;
+	struct user_cred creds;		/*< Caller's, garray is ours */
+	struct fsal_obj_handle *dst_obj;
+	struct state_t *dst_state;
+	uint64_t dst_offset;
+	struct fsal_obj_handle *src_obj;
+	struct state_t *src_state;
+	uint64_t src_offset;
+	uint64_t count;
+	uint64_t copied;		/*< Bytes copied so far, atomic */
+	bool cancelled;			/*< OFFLOAD_CANCEL was received */
+	bool done;			/*< The copy has ended */
+	nfsstat4 status;		/*< How it ended */
+};
+
+static struct fridgethr *nfs4_copy_fridge;
+static pthread_mutex_t nfs4_copies_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head nfs4_copies = GLIST_HEAD_INIT(nfs4_copies);
+
+/**
+ * @brief Drop the references of a copy and free it
+ *
+ * @param[in] copy	Copy, already off nfs4_copies
+ */
+static void nfs4_copy_free(struct nfs4_copy *copy)
+{
+	if (copy->dst_state != NULL)
+		dec_state_t_ref(copy->dst_state);
+	if (copy->src_state != NULL)
+		dec_state_t_ref(copy->src_state);
+	copy->dst_obj->obj_ops->put_ref(copy->dst_obj);
+	copy->src_obj->obj_ops->put_ref(copy->src_obj);
+	put_gsh_export(copy->export);
+	dec_client_id_ref(copy->clientid);
+	gsh_free(copy->creds.caller_garray);
+	gsh_free(copy);
+}
+
+/**
+ * @brief Take a copy off nfs4_copies and free it
+ *
+ * @param[in] copy	Copy
+ */
+static void nfs4_copy_remove(struct nfs4_copy *copy)
+{
+	PTHREAD_MUTEX_lock(&nfs4_copies_mtx);
+	glist_del(&copy->list);
+	PTHREAD_MUTEX_unlock(&nfs4_copies_mtx);
+
+	nfs4_copy_free(copy);
+}
+
+/**
+ * @brief Find a copy of the client from its callback stateid
+ *
+ * Called with nfs4_copies_mtx held.
+ *
+ * @param[in] clientid	Client asking
+ * @param[in] stateid	Callback stateid it was given
+ *
+ * @return The copy, or NULL.
+ */
+static struct nfs4_copy *nfs4_copy_lookup(nfs_client_id_t *clientid,
+					  stateid4 *stateid)
+{
+	struct glist_head *glist;
+
+	glist_for_each(glist, &nfs4_copies) {
+		struct nfs4_copy *copy =
+			glist_entry(glist, struct nfs4_copy, list);
+
+		if (copy->clientid == clientid &&
+		    memcmp(copy->stateid.other, stateid->other,
+			   OTHERSIZE) == 0)
+			return copy;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Free the copy once its CB_OFFLOAD has been answered
+ *
+ * @param[in] call	The callback
+ */
+static void nfs4_copy_cb_completion(rpc_call_t *call)
+{
+	struct nfs4_copy *copy = call->call_arg;
+	CB_OFFLOAD4args *opcboffload =
+		&call->cbt.v_u.v4.args.argarray.argarray_val[1]
+			.nfs_cb_argop4_u.opcboffload;
+
+	LogDebug(COMPONENT_NFS_CB, "%p %s", call,
+		 !(call->states & NFS_CB_CALL_ABORTED) ? "Success" : "Failed");
+
+	nfs4_freeFH(&opcboffload->coa_fh);
+	nfs41_release_single(call);
+
+	nfs4_copy_remove(copy);
+}
+
+/**
+ * @brief Tell the client an asynchronous copy has ended
+ *
+ * @param[in] copy	Copy, freed once the callback is done
+ */
+static void nfs4_copy_send_offload(struct nfs4_copy *copy)
+{
+	nfs_cb_argop4 argop;
+	CB_OFFLOAD4args *opcboffload = &argop.nfs_cb_argop4_u.opcboffload;
+	offload_info4 *info = &opcboffload->coa_offload_info;
+	write_response4 *resok = &info->offload_info4_u.coa_resok4;
+	struct gsh_buffdesc verf_desc;
+	int ret;
+
+	memset(&argop, 0, sizeof(argop));
+	argop.argop = NFS4_OP_CB_OFFLOAD;
+	opcboffload->coa_stateid = copy->stateid;
+	info->coa_status = copy->status;
+
+	if (copy->status == NFS4_OK) {
+		resok->wr_ids = 0;
+		resok->wr_count = copy->copied;
+		resok->wr_committed = UNSTABLE4;
+		verf_desc.addr = resok->wr_writeverf;
+		verf_desc.len = sizeof(verifier4);
+		op_ctx->fsal_export->exp_ops.get_write_verifier(
+					op_ctx->fsal_export, &verf_desc);
+	} else {
+		info->offload_info4_u.coa_bytes_copied = copy->copied;
+	}
+
+	if (!nfs4_FSALToFhandle(true, &opcboffload->coa_fh, copy->dst_obj,
+				copy->export)) {
+		LogCrit(COMPONENT_NFS_V4,
+			"nfs4_FSALToFhandle failed, can not send CB_OFFLOAD");
+		nfs4_copy_remove(copy);
+		return;
+	}
+
+	ret = nfs_rpc_cb_queue(copy->clientid, &argop, NULL,
+			       nfs4_copy_cb_completion, copy);
+	if (ret == 0)
+		return;
+
+	LogDebug(COMPONENT_NFS_CB, "nfs_rpc_cb_queue returned %d", ret);
+	nfs4_freeFH(&opcboffload->coa_fh);
+	nfs4_copy_remove(copy);
+}
+
+/**
+ * @brief Run an asynchronous copy
+ *
+ * The copy is done a chunk at a time, so that a cancel or a shutdown is
+ * noticed, and so that OFFLOAD_STATUS sees it progress.
+ *
+ * @param[in] ctx	Thread context, arg is the copy
+ */
+static void nfs4_copy_run(struct fridgethr_context *ctx)
+{
+	struct nfs4_copy *copy = ctx->arg;
+	struct req_op_context req_ctx = {0};
+	struct req_op_context *saved_ctx = op_ctx;
+	fsal_status_t fsal_status = {0, 0};
+	uint64_t copied = 0;
+	uint64_t chunk;
+	nfsstat4 status = NFS4_OK;
+	bool cancelled = false;
+
+	req_ctx.creds = &copy->creds;
+	req_ctx.ctx_export = copy->export;
+	req_ctx.fsal_export = copy->export->fsal_export;
+	req_ctx.export_perms = &copy->export_perms;
+	req_ctx.nfs_vers = NFS_V4;
+	req_ctx.nfs_minorvers = 2;
+	req_ctx.req_type = NFS_REQUEST;
+	op_ctx = &req_ctx;
+
+	while (copied < copy->count) {
+		PTHREAD_MUTEX_lock(&nfs4_copies_mtx);
+		cancelled = copy->cancelled || fridgethr_you_should_break(ctx);
+		PTHREAD_MUTEX_unlock(&nfs4_copies_mtx);
+
+		if (cancelled)
+			break;
+
+		chunk = MIN(copy->count - copied, NFS4_COPY_CHUNK);
+
+		fsal_status = fsal_copy(copy->dst_obj, copy->dst_state,
+					copy->dst_offset + copied,
+					copy->src_obj, copy->src_state,
+					copy->src_offset + copied,
+					chunk, &chunk);
+
+		if (FSAL_IS_ERROR(fsal_status)) {
+			status = nfs4_Errno_status(fsal_status);
+			break;
+		}
+
+		copied += chunk;
+		atomic_store_uint64_t(&copy->copied, copied);
+
+		if (chunk == 0) {
+			/* The source ended */
+			break;
+		}
+	}
+
+	PTHREAD_MUTEX_lock(&nfs4_copies_mtx);
+	copy->status = status;
+	copy->done = true;
+	cancelled = cancelled || copy->cancelled;
+	PTHREAD_MUTEX_unlock(&nfs4_copies_mtx);
+
+	LogDebug(COMPONENT_NFS_V4,
+		 "Copy of %" PRIu64 " bytes ended after %" PRIu64
+		 " status %s%s", copy->count, copied, nfsstat4_to_str(status),
+		 cancelled ? " (cancelled)" : "");
+
+	/* A cancelled copy is forgotten without a callback */
+	if (cancelled)
+		nfs4_copy_remove(copy);
+	else
+		nfs4_copy_send_offload(copy);
+
+	op_ctx = saved_ctx;
+}
+
+/**
+ * @brief Check a stateid of COPY and get the open state to use
+ *
+ * As READ and WRITE: an open or lock stateid gives its open state, and
+ * a delegation stateid or an anonymous one gives none.
+ *
+ * @param[in]  data	Compound request's data
+ * @param[in]  stateid	Stateid to check
+ * @param[in]  obj	File it is used on
+ * @param[in]  write	This is the destination
+ * @param[out] state	Open state with a reference, or NULL
+ *
+ * @return NFS4_OK or an error.
+ */
+static nfsstat4 copy_check_stateid(compound_data_t *data, stateid4 *stateid,
+				   struct fsal_obj_handle *obj, bool write,
+				   state_t **state)
+{
+	state_t *state_found = NULL;
+	state_t *state_open = NULL;
+	struct state_deleg *sdeleg;
+	nfsstat4 status;
+
+	*state = NULL;
+
+	status = nfs4_Check_Stateid(stateid, obj, &state_found, data,
+				    STATEID_SPECIAL_ANY, 0, false, "COPY");
+	if (status != NFS4_OK)
+		return status;
+
+	if (state_found == NULL) {
+		/* Anonymous stateid, check for a conflicting delegation */
+		if (state_deleg_conflict(obj, write))
+			return NFS4ERR_DELAY;
+		return NFS4_OK;
+	}
+
+	switch (state_found->state_type) {
+	case STATE_TYPE_SHARE:
+		if (!state_owner_confirmed(state_found)) {
+			status = NFS4ERR_BAD_STATEID;
+			goto out;
+		}
+		state_open = state_found;
+		inc_state_t_ref(state_open);
+		break;
+
+	case STATE_TYPE_LOCK:
+		state_open = state_found->state_data.lock.openstate;
+		inc_state_t_ref(state_open);
+		break;
+
+	case STATE_TYPE_DELEG:
+		sdeleg = &state_found->state_data.deleg;
+		if (!(sdeleg->sd_type &
+		      (write ? OPEN_DELEGATE_WRITE : OPEN_DELEGATE_READ))) {
+			/* Invalid delegation for this operation. */
+			LogDebug(COMPONENT_STATE,
+				"Delegation type:%d state:%d",
+				sdeleg->sd_type,
+				sdeleg->sd_state);
+			status = NFS4ERR_BAD_STATEID;
+		}
+		goto out;
+
+	default:
+		LogDebug(COMPONENT_NFS_V4_LOCK,
+			 "COPY with invalid stateid of type %d",
+			 (int)state_found->state_type);
+		status = NFS4ERR_BAD_STATEID;
+		goto out;
+	}
+
+	/* The destination must be open for writing, and as with READ the
+	 * source only must not deny reading.
+	 */
+	if (write ? (state_open->state_data.share.share_access &
+		     OPEN4_SHARE_ACCESS_WRITE) == 0
+		  : (state_open->state_data.share.share_deny &
+		     OPEN4_SHARE_DENY_READ) != 0) {
+		status = NFS4ERR_OPENMODE;
+
+		if (isDebug(COMPONENT_NFS_V4_LOCK)) {
+			char str[LOG_BUFF_LEN] = "\0";
+			struct display_buffer dspbuf = {sizeof(str), str, str};
+
+			display_stateid(&dspbuf, state_found);
+			LogDebug(COMPONENT_NFS_V4_LOCK,
+				 "COPY %s doesn't have %s", str,
+				 write ? "OPEN4_SHARE_ACCESS_WRITE"
+				       : "OPEN4_SHARE_ACCESS_READ");
+		}
+
+		dec_state_t_ref(state_open);
+		goto out;
+	}
+
+	*state = state_open;
+
+ out:
+
+	dec_state_t_ref(state_found);
+	return status;
+}
+
+/**
+ * @brief Hand a copy to a copy thread
+ *
+ * The copy takes references on the objects, and once queued it owns
+ * the state references it was given.
+ *
+ * @param[in]  data	Compound request's data
+ * @param[in]  copy	The copy, with its objects, states and range set
+ * @param[out] stateid	Callback stateid for the client
+ *
+ * @return true if it was queued, false to do it here.
+ */
+static bool copy_start_async(compound_data_t *data, struct nfs4_copy *copy,
+			     stateid4 *stateid)
+{
+	nfs_client_id_t *clientid = data->session->clientid_record;
+	int rc;
+
+	copy->clientid = clientid;
+	inc_client_id_ref(clientid);
+	copy->export = op_ctx->ctx_export;
+	get_gsh_export_ref(copy->export);
+	copy->export_perms = *op_ctx->export_perms;
+	copy->creds = *op_ctx->creds;
+	if (copy->creds.caller_glen != 0)
+		copy->creds.caller_garray =
+			gsh_memdup(op_ctx->creds->caller_garray,
+				   copy->creds.caller_glen * sizeof(gid_t));
+	else
+		copy->creds.caller_garray = NULL;
+
+	copy->dst_obj->obj_ops->get_ref(copy->dst_obj);
+	copy->src_obj->obj_ops->get_ref(copy->src_obj);
+
+	copy->stateid.seqid = 1;
+	nfs4_BuildStateId_Other(clientid, copy->stateid.other);
+	*stateid = copy->stateid;
+
+	PTHREAD_MUTEX_lock(&nfs4_copies_mtx);
+	glist_add_tail(&nfs4_copies, &copy->list);
+	PTHREAD_MUTEX_unlock(&nfs4_copies_mtx);
+
+	rc = fridgethr_submit(nfs4_copy_fridge, nfs4_copy_run, copy);
+	if (rc == 0)
+		return true;
+
+	LogDebug(COMPONENT_NFS_V4,
+		 "Could not queue copy, error %d, copying now", rc);
+
+	PTHREAD_MUTEX_lock(&nfs4_copies_mtx);
+	glist_del(&copy->list);
+	PTHREAD_MUTEX_unlock(&nfs4_copies_mtx);
+
+	copy->dst_obj->obj_ops->put_ref(copy->dst_obj);
+	copy->src_obj->obj_ops->put_ref(copy->src_obj);
+	dec_client_id_ref(clientid);
+	put_gsh_export(copy->export);
+	gsh_free(copy->creds.caller_garray);
+
+	return false;
+}
+
+/**
+ * @brief The NFS4_OP_COPY operation
+ *
+ * This functions handles the NFS4_OP_COPY operation in NFSv4.2. This
+ * function can be called only from nfs4_Compound.  The saved filehandle
+ * is the source, the current one the destination.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC 7862
+ */
+int nfs4_op_copy(struct nfs_argop4 *op, compound_data_t *data,
+		 struct nfs_resop4 *resp)
+{
+	COPY4args * const arg_COPY4 = &op->nfs_argop4_u.opcopy;
+	COPY4res * const res_COPY4 = &resp->nfs_resop4_u.opcopy;
+	COPY4resok *resok = &res_COPY4->COPY4res_u.cr_resok4;
+	struct fsal_obj_handle *src, *dst;
+	state_t *src_state = NULL, *dst_state = NULL;
+	struct nfs4_copy *copy;
+	struct attrlist attrs;
+	struct gsh_buffdesc verf_desc;
+	fsal_status_t fsal_status;
+	uint64_t count = arg_COPY4->ca_count;
+	uint64_t copied = 0;
+	uint64_t size;
+	uint64_t sync_max = nfs_param.nfsv4_param.copy_sync_max;
+	uint64_t MaxOffsetWrite =
+		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxOffsetWrite);
+	bool synchronous;
+
+	resp->resop = NFS4_OP_COPY;
+	res_COPY4->cr_status = NFS4_OK;
+
+	if (data->minorversion < 2) {
+		res_COPY4->cr_status = NFS4ERR_NOTSUPP;
+		return res_COPY4->cr_status;
+	}
+
+	/* Only copies within this server */
+	if (arg_COPY4->ca_source_server.ca_source_server_len != 0) {
+		res_COPY4->cr_status = NFS4ERR_NOTSUPP;
+		return res_COPY4->cr_status;
+	}
+
+	res_COPY4->cr_status = nfs4_sanity_check_FH(data, REGULAR_FILE, false);
+	if (res_COPY4->cr_status != NFS4_OK)
+		return res_COPY4->cr_status;
+
+	res_COPY4->cr_status = nfs4_sanity_check_saved_FH(data, REGULAR_FILE,
+							 false);
+	if (res_COPY4->cr_status != NFS4_OK)
+		return res_COPY4->cr_status;
+
+	/* Both files must be in the export, the copy goes through its
+	 * FSAL.
+	 */
+	if (data->saved_export != op_ctx->ctx_export) {
+		res_COPY4->cr_status = NFS4ERR_XDEV;
+		return res_COPY4->cr_status;
+	}
+
+	src = data->saved_obj;
+	dst = data->current_obj;
+
+	res_COPY4->cr_status = copy_check_stateid(data,
+						  &arg_COPY4->ca_src_stateid,
+						  src, false, &src_state);
+	if (res_COPY4->cr_status != NFS4_OK)
+		goto out;
+
+	res_COPY4->cr_status = copy_check_stateid(data,
+						  &arg_COPY4->ca_dst_stateid,
+						  dst, true, &dst_state);
+	if (res_COPY4->cr_status != NFS4_OK)
+		goto out;
+
+	fsal_status = src->obj_ops->test_access(src, FSAL_READ_ACCESS,
+						NULL, NULL, true);
+	if (FSAL_IS_ERROR(fsal_status)) {
+		res_COPY4->cr_status = nfs4_Errno_status(fsal_status);
+		goto out;
+	}
+
+	fsal_status = dst->obj_ops->test_access(dst, FSAL_WRITE_ACCESS,
+						NULL, NULL, true);
+	if (FSAL_IS_ERROR(fsal_status)) {
+		res_COPY4->cr_status = nfs4_Errno_status(fsal_status);
+		goto out;
+	}
+
+	/* The range must be within the source, a count of 0 copies to its
+	 * end.
+	 */
+	fsal_prepare_attrs(&attrs, ATTR_SIZE);
+	fsal_status = src->obj_ops->getattrs(src, &attrs);
+	size = attrs.filesize;
+	fsal_release_attrs(&attrs);
+
+	if (FSAL_IS_ERROR(fsal_status)) {
+		res_COPY4->cr_status = nfs4_Errno_status(fsal_status);
+		goto out;
+	}
+
+	if (arg_COPY4->ca_src_offset > size ||
+	    (count != 0 && count > size - arg_COPY4->ca_src_offset)) {
+		res_COPY4->cr_status = NFS4ERR_INVAL;
+		goto out;
+	}
+
+	if (count == 0)
+		count = size - arg_COPY4->ca_src_offset;
+
+	if (arg_COPY4->ca_dst_offset > UINT64_MAX - count ||
+	    arg_COPY4->ca_dst_offset + count > MaxOffsetWrite) {
+		LogEvent(COMPONENT_NFS_V4,
+			 "A client tried to violate max file size %"
+			 PRIu64 " for exportid #%hu",
+			 MaxOffsetWrite, op_ctx->ctx_export->export_id);
+		res_COPY4->cr_status = NFS4ERR_FBIG;
+		goto out;
+	}
+
+	LogFullDebug(COMPONENT_NFS_V4,
+		     "src offset = %" PRIu64 " dst offset = %" PRIu64
+		     " count = %" PRIu64 " synchronous = %d",
+		     arg_COPY4->ca_src_offset, arg_COPY4->ca_dst_offset,
+		     count, arg_COPY4->ca_synchronous);
+
+	memset(resok, 0, sizeof(*resok));
+
+	synchronous = arg_COPY4->ca_synchronous || count <= sync_max ||
+		      nfs4_copy_fridge == NULL || data->session == NULL ||
+		      nfs_rpc_get_chan(data->session->clientid_record,
+				       0) == NULL;
+
+	if (!synchronous) {
+		copy = gsh_calloc(1, sizeof(*copy));
+		copy->dst_obj = dst;
+		copy->dst_state = dst_state;
+		copy->dst_offset = arg_COPY4->ca_dst_offset;
+		copy->src_obj = src;
+		copy->src_state = src_state;
+		copy->src_offset = arg_COPY4->ca_src_offset;
+		copy->count = count;
+
+		if (copy_start_async(data, copy,
+				     &resok->cr_response.wr_callback_id)) {
+			resok->cr_response.wr_ids = 1;
+			goto reply;
+		}
+
+		gsh_free(copy);
+		synchronous = true;
+	}
+
+	/* Do no more here than a worker should be held for, the client
+	 * carries on from where the copy stopped.
+	 */
+	if (!arg_COPY4->ca_synchronous && count > sync_max && sync_max != 0)
+		count = sync_max;
+
+	fsal_status = fsal_copy(dst, dst_state, arg_COPY4->ca_dst_offset,
+				src, src_state, arg_COPY4->ca_src_offset,
+				count, &copied);
+	if (FSAL_IS_ERROR(fsal_status)) {
+		res_COPY4->cr_status = nfs4_Errno_status(fsal_status);
+		goto out;
+	}
+
+	resok->cr_response.wr_ids = 0;
+	resok->cr_response.wr_count = copied;
+
+ reply:
+
+	resok->cr_response.wr_committed = UNSTABLE4;
+	verf_desc.addr = resok->cr_response.wr_writeverf;
+	verf_desc.len = sizeof(verifier4);
+	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
+							&verf_desc);
+	resok->cr_requirements.cr_consecutive = true;
+	resok->cr_requirements.cr_synchronous = synchronous;
+
+	if (!synchronous) {
+		/* The copy holds the state refs */
+		return res_COPY4->cr_status;
+	}
+
+ out:
+
+	if (src_state != NULL)
+		dec_state_t_ref(src_state);
+	if (dst_state != NULL)
+		dec_state_t_ref(dst_state);
+
+	return res_COPY4->cr_status;
+}
+
+/**
+ * @brief Free memory allocated for COPY result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_copy_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_CLONE operation
+ *
+ * This functions handles the NFS4_OP_CLONE operation in NFSv4.2. This
+ * function can be called only from nfs4_Compound.  The saved filehandle
+ * is the source, the current one the destination.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC 7862
+ */
+int nfs4_op_clone(struct nfs_argop4 *op, compound_data_t *data,
+		  struct nfs_resop4 *resp)
+{
+	CLONE4args * const arg_CLONE4 = &op->nfs_argop4_u.opclone;
+	CLONE4res * const res_CLONE4 = &resp->nfs_resop4_u.opclone;
+	struct fsal_obj_handle *src, *dst;
+	state_t *src_state = NULL, *dst_state = NULL;
+	struct attrlist attrs;
+	fsal_status_t fsal_status;
+	uint64_t count = arg_CLONE4->cl_count;
+	uint64_t size, length;
+	uint64_t MaxOffsetWrite =
+		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxOffsetWrite);
+
+	resp->resop = NFS4_OP_CLONE;
+	res_CLONE4->cl_status = NFS4_OK;
+
+	if (data->minorversion < 2) {
+		res_CLONE4->cl_status = NFS4ERR_NOTSUPP;
+		return res_CLONE4->cl_status;
+	}
+
+	res_CLONE4->cl_status = nfs4_sanity_check_FH(data, REGULAR_FILE, false);
+	if (res_CLONE4->cl_status != NFS4_OK)
+		return res_CLONE4->cl_status;
+
+	res_CLONE4->cl_status = nfs4_sanity_check_saved_FH(data, REGULAR_FILE,
+							  false);
+	if (res_CLONE4->cl_status != NFS4_OK)
+		return res_CLONE4->cl_status;
+
+	if (data->saved_export != op_ctx->ctx_export) {
+		res_CLONE4->cl_status = NFS4ERR_XDEV;
+		return res_CLONE4->cl_status;
+	}
+
+	if (!op_ctx->fsal_export->exp_ops.fs_supports(op_ctx->fsal_export,
+						      fso_clone)) {
+		res_CLONE4->cl_status = NFS4ERR_NOTSUPP;
+		return res_CLONE4->cl_status;
+	}
+
+	src = data->saved_obj;
+	dst = data->current_obj;
+
+	res_CLONE4->cl_status = copy_check_stateid(data,
+						   &arg_CLONE4->cl_src_stateid,
+						   src, false, &src_state);
+	if (res_CLONE4->cl_status != NFS4_OK)
+		goto out;
+
+	res_CLONE4->cl_status = copy_check_stateid(data,
+						   &arg_CLONE4->cl_dst_stateid,
+						   dst, true, &dst_state);
+	if (res_CLONE4->cl_status != NFS4_OK)
+		goto out;
+
+	fsal_status = src->obj_ops->test_access(src, FSAL_READ_ACCESS,
+						NULL, NULL, true);
+	if (FSAL_IS_ERROR(fsal_status)) {
+		res_CLONE4->cl_status = nfs4_Errno_status(fsal_status);
+		goto out;
+	}
+
+	fsal_status = dst->obj_ops->test_access(dst, FSAL_WRITE_ACCESS,
+						NULL, NULL, true);
+	if (FSAL_IS_ERROR(fsal_status)) {
+		res_CLONE4->cl_status = nfs4_Errno_status(fsal_status);
+		goto out;
+	}
+
+	/* The range must be within the source */
+	fsal_prepare_attrs(&attrs, ATTR_SIZE);
+	fsal_status = src->obj_ops->getattrs(src, &attrs);
+	size = attrs.filesize;
+	fsal_release_attrs(&attrs);
+
+	if (FSAL_IS_ERROR(fsal_status)) {
+		res_CLONE4->cl_status = nfs4_Errno_status(fsal_status);
+		goto out;
+	}
+
+	if (arg_CLONE4->cl_src_offset > size ||
+	    count > size - arg_CLONE4->cl_src_offset) {
+		res_CLONE4->cl_status = NFS4ERR_INVAL;
+		goto out;
+	}
+
+	length = count != 0 ? count : size - arg_CLONE4->cl_src_offset;
+
+	if (arg_CLONE4->cl_dst_offset > UINT64_MAX - length ||
+	    arg_CLONE4->cl_dst_offset + length > MaxOffsetWrite) {
+		LogEvent(COMPONENT_NFS_V4,
+			 "A client tried to violate max file size %"
+			 PRIu64 " for exportid #%hu",
+			 MaxOffsetWrite, op_ctx->ctx_export->export_id);
+		res_CLONE4->cl_status = NFS4ERR_FBIG;
+		goto out;
+	}
+
+	LogFullDebug(COMPONENT_NFS_V4,
+		     "src offset = %" PRIu64 " dst offset = %" PRIu64
+		     " count = %" PRIu64,
+		     arg_CLONE4->cl_src_offset, arg_CLONE4->cl_dst_offset,
+		     count);
+
+	fsal_status = dst->obj_ops->clone2(dst, dst_state,
+					   arg_CLONE4->cl_dst_offset,
+					   src, src_state,
+					   arg_CLONE4->cl_src_offset, count);
+	if (FSAL_IS_ERROR(fsal_status))
+		res_CLONE4->cl_status = nfs4_Errno_status(fsal_status);
+
+ out:
+
+	if (src_state != NULL)
+		dec_state_t_ref(src_state);
+	if (dst_state != NULL)
+		dec_state_t_ref(dst_state);
+
+	return res_CLONE4->cl_status;
+}
+
+/**
+ * @brief Free memory allocated for CLONE result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_clone_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_OFFLOAD_STATUS operation
+ *
+ * This functions handles the NFS4_OP_OFFLOAD_STATUS operation in
+ * NFSv4.2. This function can be called only from nfs4_Compound.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC 7862
+ */
+int nfs4_op_offload_status(struct nfs_argop4 *op, compound_data_t *data,
+			   struct nfs_resop4 *resp)
+{
+	OFFLOAD_STATUS4args * const arg_STATUS4 =
+		&op->nfs_argop4_u.opoffload_status;
+	OFFLOAD_STATUS4res * const res_STATUS4 =
+		&resp->nfs_resop4_u.opoffload_status;
+	OFFLOAD_STATUS4resok *resok =
+		&res_STATUS4->OFFLOAD_STATUS4res_u.osr_resok4;
+	struct nfs4_copy *copy;
+
+	resp->resop = NFS4_OP_OFFLOAD_STATUS;
+
+	if (data->minorversion < 2 || data->session == NULL) {
+		res_STATUS4->osr_status = NFS4ERR_NOTSUPP;
+		return res_STATUS4->osr_status;
+	}
+
+	PTHREAD_MUTEX_lock(&nfs4_copies_mtx);
+
+	copy = nfs4_copy_lookup(data->session->clientid_record,
+				&arg_STATUS4->osa_stateid);
+	if (copy == NULL) {
+		res_STATUS4->osr_status = NFS4ERR_BAD_STATEID;
+	} else {
+		res_STATUS4->osr_status = NFS4_OK;
+		resok->osr_count = atomic_fetch_uint64_t(&copy->copied);
+		resok->osr_complete_len = copy->done ? 1 : 0;
+		resok->osr_complete = copy->status;
+	}
+
+	PTHREAD_MUTEX_unlock(&nfs4_copies_mtx);
+
+	return res_STATUS4->osr_status;
+}
+
+/**
+ * @brief Free memory allocated for OFFLOAD_STATUS result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_offload_status_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_OFFLOAD_CANCEL operation
+ *
+ * This functions handles the NFS4_OP_OFFLOAD_CANCEL operation in
+ * NFSv4.2. This function can be called only from nfs4_Compound.  The
+ * copy stops at its next chunk, and no CB_OFFLOAD is sent for it.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC 7862
+ */
+int nfs4_op_offload_cancel(struct nfs_argop4 *op, compound_data_t *data,
+			   struct nfs_resop4 *resp)
+{
+	OFFLOAD_CANCEL4args * const arg_CANCEL4 =
+		&op->nfs_argop4_u.opoffload_cancel;
+	OFFLOAD_CANCEL4res * const res_CANCEL4 =
+		&resp->nfs_resop4_u.opoffload_cancel;
+	struct nfs4_copy *copy;
+
+	resp->resop = NFS4_OP_OFFLOAD_CANCEL;
+
+	if (data->minorversion < 2 || data->session == NULL) {
+		res_CANCEL4->ocr_status = NFS4ERR_NOTSUPP;
+		return res_CANCEL4->ocr_status;
+	}
+
+	PTHREAD_MUTEX_lock(&nfs4_copies_mtx);
+
+	copy = nfs4_copy_lookup(data->session->clientid_record,
+				&arg_CANCEL4->oca_stateid);
+	if (copy == NULL) {
+		res_CANCEL4->ocr_status = NFS4ERR_BAD_STATEID;
+	} else {
+		res_CANCEL4->ocr_status = NFS4_OK;
+		copy->cancelled = true;
+	}
+
+	PTHREAD_MUTEX_unlock(&nfs4_copies_mtx);
+
+	return res_CANCEL4->ocr_status;
+}
+
+/**
+ * @brief Free memory allocated for OFFLOAD_CANCEL result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_offload_cancel_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief Start the copy threads
+ */
+void nfs4_copy_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (nfs_param.nfsv4_param.copy_threads == 0) {
+		/* Every copy is done before COPY replies */
+		return;
+	}
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = nfs_param.nfsv4_param.copy_threads;
+	frp.thr_min = 0;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&nfs4_copy_fridge, "NFS4_COPY_fridge", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_INIT,
+			 "Unable to initialize copy fridge, error code %d.",
+			 rc);
+		nfs4_copy_fridge = NULL;
+	}
+}
+
+/**
+ * @brief Stop the copy threads
+ *
+ * Copies still running stop at their next chunk, without a callback.
+ */
+void nfs4_copy_pkgshutdown(void)
+{
+	int rc;
+
+	if (nfs4_copy_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(nfs4_copy_fridge, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_THREAD,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(nfs4_copy_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Failed shutting down copy threads: %d", rc);
+	}
+
+	fridgethr_destroy(nfs4_copy_fridge);
+	nfs4_copy_fridge = NULL;
+}
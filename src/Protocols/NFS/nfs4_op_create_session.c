@@ -105,7 +105,7 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 	struct display_buffer dspbuf_clientid4 = {
 		sizeof(str_clientid4), str_clientid4, str_clientid4};
 	/* Return code from clientid calls */
-	int i, rc = 0;
+	int rc = 0;
 	/* Component for logging */
 	log_components_t component = COMPONENT_CLIENTID;
 	/* Abbreviated alias for arguments */
@@ -354,12 +354,12 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 	PTHREAD_RWLOCK_init(&nfs41_session->conn_lock, NULL);
 	nfs41_session->nb_slots = MIN(nfs_param.nfsv4_param.nb_slots,
 			nfs41_session->fore_channel_attrs.ca_maxrequests);
+	nfs41_session->highest_slot = nfs41_session->nb_slots - 1;
+	PTHREAD_MUTEX_init(&nfs41_session->slot_lock, NULL);
 	nfs41_session->fc_slots = gsh_calloc(nfs41_session->nb_slots,
-					     sizeof(nfs41_session_slot_t));
+					     sizeof(nfs41_session_slot_t *));
 	nfs41_session->bc_slots = gsh_calloc(nfs41_session->nb_slots,
 					     sizeof(nfs41_cb_session_slot_t));
-	for (i = 0; i < nfs41_session->nb_slots; i++)
-		PTHREAD_MUTEX_init(&nfs41_session->fc_slots[i].lock, NULL);
 
 	/* Take reference to clientid record on behalf the session. */
 	inc_client_id_ref(found);
@@ -518,7 +518,7 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 	conf->cid_create_session_sequence++;
 
 	/* Bump the lease timer */
-	conf->cid_last_renew = time(NULL);
+	atomic_store_time_t(&conf->cid_last_renew, time(NULL));
 
 	if (isFullDebug(component)) {
 		char str[LOG_BUFF_LEN] = "\0";
@@ -0,0 +1,222 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file    nfs4_op_get_dir_delegation.c
+ * @brief   The NFS4_OP_GET_DIR_DELEGATION operation
+ *
+ * A directory delegation lets a client cache the entries of a
+ * directory.  Adds, removes and renames the client asked to be told of
+ * are sent as CB_NOTIFY, any other change recalls the delegation, see
+ * state_dir_notify().
+ */
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "log.h"
+#include "gsh_rpc.h"
+#include "nfs4.h"
+#include "nfs_core.h"
+#include "nfs_exports.h"
+#include "sal_functions.h"
+#include "nfs_proto_functions.h"
+#include "nfs_proto_tools.h"
+
+/**
+ * @brief Check whether a client already holds a delegation
+ *
+ * @note The state_lock MUST be held
+ *
+ * @param[in] ostate Directory state
+ * @param[in] owner  Client owner
+ *
+ * @return true if it does.
+ */
+static bool dir_deleg_held(struct state_hdl *ostate, state_owner_t *owner)
+{
+	struct glist_head *glist;
+	struct state_t *state;
+
+	glist_for_each(glist, &ostate->dir.list_of_states) {
+		state = glist_entry(glist, struct state_t, state_list);
+		if (state->state_type == STATE_TYPE_DELEG &&
+		    state->state_owner == owner)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Build the cookie verifier of a directory
+ *
+ * Same as READDIR's, so a client can go on with the cookies it has.
+ *
+ * @param[in]  obj        Directory
+ * @param[out] cookieverf Verifier
+ *
+ * @return NFS4_OK or errors.
+ */
+static nfsstat4 dir_deleg_cookieverf(struct fsal_obj_handle *obj,
+				     verifier4 cookieverf)
+{
+	fsal_status_t fsal_status;
+	struct attrlist attrs;
+	time_t change_time;
+
+	memset(cookieverf, 0, NFS4_VERIFIER_SIZE);
+	if (!op_ctx_export_has_option(EXPORT_OPTION_USE_COOKIE_VERIFIER))
+		return NFS4_OK;
+
+	fsal_prepare_attrs(&attrs, ATTR_CHGTIME);
+	fsal_status = obj->obj_ops->getattrs(obj, &attrs);
+	if (FSAL_IS_ERROR(fsal_status))
+		return nfs4_Errno_status(fsal_status);
+
+	change_time = timespec_to_nsecs(&attrs.chgtime);
+	memcpy(cookieverf, &change_time, sizeof(change_time));
+	fsal_release_attrs(&attrs);
+
+	return NFS4_OK;
+}
+
+/**
+ *
+ * @brief The NFS4_OP_GET_DIR_DELEGATION operation.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC5661, p. 373
+ *
+ * @see nfs4_Compound
+ */
+
+int nfs4_op_get_dir_delegation(struct nfs_argop4 *op, compound_data_t *data,
+			       struct nfs_resop4 *resp)
+{
+	GET_DIR_DELEGATION4args * const arg =
+	    &op->nfs_argop4_u.opget_dir_delegation;
+	GET_DIR_DELEGATION4res * const res =
+	    &resp->nfs_resop4_u.opget_dir_delegation;
+	GET_DIR_DELEGATION4res_non_fatal *nonfatal =
+	    &res->GET_DIR_DELEGATION4res_u.gddr_res_non_fatal4;
+	GET_DIR_DELEGATION4resok *resok =
+	    &nonfatal->GET_DIR_DELEGATION4res_non_fatal_u.gddrnf_resok4;
+	struct fsal_obj_handle *obj = data->current_obj;
+	nfs_client_id_t *client;
+	state_owner_t *owner;
+	struct state_hdl *ostate;
+	union state_data state_data;
+	struct state_refer refer;
+	state_t *state = NULL;
+	state_status_t state_status;
+	uint32_t notify = 0;
+
+	resp->resop = NFS4_OP_GET_DIR_DELEGATION;
+
+	res->gddr_status = nfs4_sanity_check_FH(data, DIRECTORY, false);
+	if (res->gddr_status != NFS4_OK)
+		return res->gddr_status;
+
+	res->gddr_status = dir_deleg_cookieverf(obj, resok->gddr_cookieverf);
+	if (res->gddr_status != NFS4_OK)
+		return res->gddr_status;
+
+	client = data->session->clientid_record;
+	owner = &client->cid_owner;
+	ostate = obj->state_hdl;
+
+	if (arg->gdda_notification_types.bitmap4_len > 0)
+		notify = arg->gdda_notification_types.map[0] &
+			 DIR_DELEG_NOTIFY_SUPPORTED;
+
+	memcpy(refer.session, data->session->session_id, sizeof(sessionid4));
+	refer.sequence = data->sequence;
+	refer.slot = data->slot;
+
+	if (!nfs_param.nfsv4_param.allow_dir_delegations ||
+	    !(op_ctx->export_perms->options & EXPORT_OPTION_READ_DELEG) ||
+	    ostate == NULL)
+		goto unavail;
+
+	PTHREAD_RWLOCK_wrlock(&ostate->state_lock);
+
+	if (dir_deleg_held(ostate, owner) ||
+	    !should_we_grant_dir_deleg(ostate, client)) {
+		PTHREAD_RWLOCK_unlock(&ostate->state_lock);
+		goto unavail;
+	}
+
+	init_new_deleg_state(&state_data, OPEN_DELEGATE_READ, client);
+	state_data.deleg.sd_notify = notify;
+
+	state_status = state_add_impl(obj, STATE_TYPE_DELEG, &state_data,
+				      owner, &state, &refer);
+	if (state_status != STATE_SUCCESS) {
+		PTHREAD_RWLOCK_unlock(&ostate->state_lock);
+		LogDebug(COMPONENT_NFS_V4_LOCK,
+			 "Could not add directory delegation: %s",
+			 state_err_str(state_status));
+		goto unavail;
+	}
+	state->state_seqid++;
+	COPY_STATEID(&resok->gddr_stateid, state);
+
+	PTHREAD_RWLOCK_unlock(&ostate->state_lock);
+
+	inc_grants(client->gsh_client);
+	client->curr_deleg_grants++;
+	dec_state_t_ref(state);
+
+	/* Neither child nor directory attributes are notified */
+	resok->gddr_notification.bitmap4_len = 1;
+	resok->gddr_notification.map[0] = notify;
+	resok->gddr_child_attributes.bitmap4_len = 0;
+	resok->gddr_dir_attributes.bitmap4_len = 0;
+
+	LogDebug(COMPONENT_NFS_V4_LOCK,
+		 "Directory delegation granted, notifications %" PRIx32,
+		 notify);
+
+	nonfatal->gddrnf_status = GDD4_OK;
+	return res->gddr_status;
+
+unavail:
+	/* We never tell when one becomes available */
+	nonfatal->gddrnf_status = GDD4_UNAVAIL;
+	nonfatal->GET_DIR_DELEGATION4res_non_fatal_u.gddrnf_signal = false;
+	return res->gddr_status;
+}
+
+/**
+ * @brief Free memory allocated for GET_DIR_DELEGATION result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+void nfs4_op_get_dir_delegation_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
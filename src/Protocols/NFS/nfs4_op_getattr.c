@@ -110,8 +110,17 @@ int nfs4_op_getattr(struct nfs_argop4 *op, compound_data_t *data,
 			obj_attributes,
 			&arg_GETATTR4->attr_request);
 
-	current_obj_is_referral = data->current_obj->obj_ops->is_referral(
-					data->current_obj, &attrs, false);
+	if (data->current_referral != NULL) {
+		/* Dynamic referral, see Dynamic_Referrals */
+		nfs4_fs_locations_release(attrs.fs_locations);
+		nfs4_fs_locations_get_ref(data->current_referral);
+		attrs.fs_locations = data->current_referral;
+		current_obj_is_referral = true;
+	} else {
+		current_obj_is_referral =
+			data->current_obj->obj_ops->is_referral(
+				data->current_obj, &attrs, false);
+	}
 
 	/*
 	 * If it is a referral point, return the FATTR4_RDATTR_ERROR if
@@ -81,6 +81,11 @@ int nfs4_op_getfh(struct nfs_argop4 *op, compound_data_t *data,
 	if (res_GETFH->status != NFS4_OK)
 		goto out;
 
+	if (data->current_referral != NULL) {
+		res_GETFH->status = NFS4ERR_MOVED;
+		goto out;
+	}
+
 	fsal_prepare_attrs(&attrs,
 			   op_ctx->fsal_export->exp_ops.fs_supported_attrs(
 					op_ctx->fsal_export));
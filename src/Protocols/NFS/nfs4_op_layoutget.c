@@ -203,6 +203,7 @@ static nfsstat4 acquire_layout_state(compound_data_t *data,
 		}
 
 		glist_init(&(*layout_state)->state_data.layout.state_segments);
+		state_layout_index(*layout_state, data->current_obj);
 	} else {
 		/* A state eixsts but is of an invalid type. */
 		nfs_status = NFS4ERR_BAD_STATEID;
@@ -270,6 +271,8 @@ static nfsstat4 one_segment(struct fsal_obj_handle *obj,
 	nfsstat4 nfs_status = 0;
 	/* Return from state calls */
 	state_status_t state_status = 0;
+	/* The loc_body encoded, kept with the segment */
+	struct gsh_buffdesc body;
 	/* Size of a loc_body buffer */
 	size_t loc_body_size = MIN(
 	    op_ctx->fsal_export->exp_ops.fs_loc_body_size(op_ctx->fsal_export),
@@ -311,10 +314,14 @@ static nfsstat4 one_segment(struct fsal_obj_handle *obj,
 	current->lo_length = res->segment.length;
 	current->lo_iomode = res->segment.io_mode;
 
+	body.addr = current->lo_content.loc_body.loc_body_val;
+	body.len = current->lo_content.loc_body.loc_body_len;
+
 	state_status = state_add_segment(layout_state,
 					 &res->segment,
 					 res->fsal_seg_data,
-					 res->return_on_close);
+					 res->return_on_close,
+					 &body);
 
 	if (state_status != STATE_SUCCESS) {
 		nfs_status = nfs4_Errno_state(state_status);
@@ -410,6 +417,15 @@ int nfs4_op_layoutget(struct nfs_argop4 *op, compound_data_t *data,
 	if (nfs_status != NFS4_OK)
 		goto out;
 
+	/* The client must first return what a recall of the whole
+	 * filesystem asked for.
+	 */
+	if (state_layout_recalling(data->session->clientid_record,
+				   &data->current_obj->fsid)) {
+		nfs_status = NFS4ERR_RECALLCONFLICT;
+		goto out;
+	}
+
 	/*
 	 * Blank out argument structures and get the filehandle.
 	 */
@@ -437,7 +453,21 @@ int nfs4_op_layoutget(struct nfs_argop4 *op, compound_data_t *data,
 	 */
 	res.signal_available = false;
 
-	do {
+	/* A range the client already holds is answered with the layout
+	 * it was granted.
+	 */
+	PTHREAD_RWLOCK_rdlock(&data->current_obj->state_hdl->state_lock);
+	if (state_layout_cached(layout_state, arg_LAYOUTGET4->loga_iomode,
+				arg_LAYOUTGET4->loga_offset, arg.minlength,
+				arg.maxcount, layouts)) {
+		resp_size += LAYOUYSEGMENT_BASE_SIZE +
+			     layouts[0].lo_content.loc_body.loc_body_len;
+		numlayouts = 1;
+		res.last_segment = true;
+	}
+	PTHREAD_RWLOCK_unlock(&data->current_obj->state_hdl->state_lock);
+
+	while (!res.last_segment) {
 		u_int blen;
 
 		/* Since the FSAL writes to tis structure with every
@@ -469,7 +499,7 @@ int nfs4_op_layoutget(struct nfs_argop4 *op, compound_data_t *data,
 			nfs_status = NFS4ERR_SERVERFAULT;
 			goto out;
 		}
-	} while (!res.last_segment);
+	}
 
 	/* Now check response size. */
 	nfs_status = check_resp_room(data, resp_size);
@@ -537,6 +567,18 @@ void nfs4_op_layoutget_Free(nfs_resop4 *res)
 
 }				/* nfs41_op_layoutget_Free */
 
+/**
+ * @brief The NFS4_OP_LAYOUTERROR operation
+ *
+ * Hand the error a client met doing I/O through a layout to the FSAL,
+ * which may steer later layouts away from the data server.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC7862
+ */
 int nfs4_op_layouterror(struct nfs_argop4 *op, compound_data_t *data,
 		      struct nfs_resop4 *resp)
 {
@@ -548,8 +590,14 @@ int nfs4_op_layouterror(struct nfs_argop4 *op, compound_data_t *data,
 					&resp->nfs_resop4_u.oplayouterror;
 	/* NFSv4.2 status code */
 	nfsstat4 nfs_status = 0;
+	/* State indicated by client */
+	state_t *layout_state = NULL;
+	/* Input arguments of FSAL_layouterror */
+	struct fsal_layouterror_arg arg;
 
-	LogEvent(COMPONENT_PNFS,
+	resp->resop = NFS4_OP_LAYOUTERROR;
+
+	LogDebug(COMPONENT_PNFS,
 		 "LAYOUTERROR OP %d status %d offset: %" PRIu64
 		 " length: %" PRIu64,
 		 arg_LAYOUTERROR4->lea_errors.de_opnum,
@@ -557,7 +605,45 @@ int nfs4_op_layouterror(struct nfs_argop4 *op, compound_data_t *data,
 		 arg_LAYOUTERROR4->lea_offset,
 		 arg_LAYOUTERROR4->lea_length);
 
-	/** @todo: what else do we want to do with this error ???  */
+	nfs_status = nfs4_sanity_check_FH(data, REGULAR_FILE, false);
+
+	if (nfs_status != NFS4_OK)
+		goto out;
+
+	nfs_status = nfs4_Check_Stateid(&arg_LAYOUTERROR4->lea_stateid,
+					data->current_obj,
+					&layout_state, data,
+					STATEID_SPECIAL_CURRENT,
+					0,
+					false,
+					"LAYOUTERROR");
+
+	if (nfs_status != NFS4_OK)
+		goto out;
+
+	if (layout_state->state_type != STATE_TYPE_LAYOUT) {
+		nfs_status = NFS4ERR_BAD_STATEID;
+		goto out;
+	}
+
+	memset(&arg, 0, sizeof(arg));
+	arg.type = layout_state->state_data.layout.state_layout_type;
+	arg.offset = arg_LAYOUTERROR4->lea_offset;
+	arg.length = arg_LAYOUTERROR4->lea_length;
+	memcpy(&arg.deviceid, arg_LAYOUTERROR4->lea_errors.de_deviceid,
+	       sizeof(arg.deviceid));
+	arg.status = arg_LAYOUTERROR4->lea_errors.de_status;
+	arg.opnum = arg_LAYOUTERROR4->lea_errors.de_opnum;
+
+	nfs_status = data->current_obj->obj_ops->layouterror(
+						data->current_obj,
+						op_ctx,
+						&arg);
+
+ out:
+
+	if (layout_state != NULL)
+		dec_state_t_ref(layout_state);
 
 	res_LAYOUTERROR4->ler_status = nfs_status;
 
@@ -568,6 +654,18 @@ void nfs4_op_layouterror_Free(nfs_resop4 *res)
 {
 }
 
+/**
+ * @brief The NFS4_OP_LAYOUTSTATS operation
+ *
+ * Hand what a client saw doing I/O through a layout to the FSAL, which
+ * may weigh its data servers by it.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC7862
+ */
 int nfs4_op_layoutstats(struct nfs_argop4 *op, compound_data_t *data,
 		      struct nfs_resop4 *resp)
 {
@@ -579,21 +677,80 @@ int nfs4_op_layoutstats(struct nfs_argop4 *op, compound_data_t *data,
 					&resp->nfs_resop4_u.oplayoutstats;
 	/* NFSv4.2 status code */
 	nfsstat4 nfs_status = 0;
+	/* State indicated by client */
+	state_t *layout_state = NULL;
+	/* Input arguments of FSAL_layoutstats */
+	struct fsal_layoutstats_arg arg;
+	/* XDR stream holding the lou_body opaque */
+	XDR lou_body;
 
-	LogEvent(COMPONENT_PNFS,
-		 "LAYOUTSTATS offset %" PRIu64 " length %" PRIu64,
-		 arg_LAYOUTSTATS4->lsa_offset,
-		 arg_LAYOUTSTATS4->lsa_length);
+	resp->resop = NFS4_OP_LAYOUTSTATS;
 
-	LogEvent(COMPONENT_PNFS,
-		 "LAYOUTSTATS read count %u bytes %" PRIu64
+	LogDebug(COMPONENT_PNFS,
+		 "LAYOUTSTATS offset %" PRIu64 " length %" PRIu64
+		 " read count %u bytes %" PRIu64
 		 " write count %u bytes %" PRIu64,
+		 arg_LAYOUTSTATS4->lsa_offset,
+		 arg_LAYOUTSTATS4->lsa_length,
 		 arg_LAYOUTSTATS4->lsa_read.ii_count,
 		 arg_LAYOUTSTATS4->lsa_read.ii_bytes,
 		 arg_LAYOUTSTATS4->lsa_write.ii_count,
 		 arg_LAYOUTSTATS4->lsa_write.ii_bytes);
 
-	/** @todo: what else do we want to do with the stats ???  */
+	nfs_status = nfs4_sanity_check_FH(data, REGULAR_FILE, false);
+
+	if (nfs_status != NFS4_OK) {
+		res_LAYOUTSTATS4->lsr_status = nfs_status;
+		return res_LAYOUTSTATS4->lsr_status;
+	}
+
+	xdrmem_create(&lou_body,
+		      arg_LAYOUTSTATS4->lsa_layoutupdate.lou_body.lou_body_val,
+		      arg_LAYOUTSTATS4->lsa_layoutupdate.lou_body.lou_body_len,
+		      XDR_DECODE);
+
+	nfs_status = nfs4_Check_Stateid(&arg_LAYOUTSTATS4->lsa_stateid,
+					data->current_obj,
+					&layout_state, data,
+					STATEID_SPECIAL_CURRENT,
+					0,
+					false,
+					"LAYOUTSTATS");
+
+	if (nfs_status != NFS4_OK)
+		goto out;
+
+	if (layout_state->state_type != STATE_TYPE_LAYOUT) {
+		nfs_status = NFS4ERR_BAD_STATEID;
+		goto out;
+	}
+
+	memset(&arg, 0, sizeof(arg));
+	arg.type = layout_state->state_data.layout.state_layout_type;
+	arg.offset = arg_LAYOUTSTATS4->lsa_offset;
+	arg.length = arg_LAYOUTSTATS4->lsa_length;
+	arg.read_count = arg_LAYOUTSTATS4->lsa_read.ii_count;
+	arg.read_bytes = arg_LAYOUTSTATS4->lsa_read.ii_bytes;
+	arg.write_count = arg_LAYOUTSTATS4->lsa_write.ii_count;
+	arg.write_bytes = arg_LAYOUTSTATS4->lsa_write.ii_bytes;
+
+	if (arg_LAYOUTSTATS4->lsa_layoutupdate.lou_type != arg.type) {
+		nfs_status = NFS4ERR_INVAL;
+		goto out;
+	}
+
+	nfs_status = data->current_obj->obj_ops->layoutstats(
+						data->current_obj,
+						op_ctx,
+						&lou_body,
+						&arg);
+
+ out:
+
+	if (layout_state != NULL)
+		dec_state_t_ref(layout_state);
+
+	xdr_destroy(&lou_body);
 
 	res_LAYOUTSTATS4->lsr_status = nfs_status;
 
@@ -277,6 +277,19 @@ int nfs4_op_layoutreturn(struct nfs_argop4 *op, compound_data_t *data,
 				continue;
 			}
 
+			if (return_fsid &&
+			    (obj->fsid.major != fsid.major ||
+			     obj->fsid.minor != fsid.minor)) {
+				/* On another filesystem, the state holds
+				 * the file so this is not the last ref.
+				 */
+				obj->obj_ops->put_ref(obj);
+				obj = NULL;
+				put_gsh_export(export);
+				export = NULL;
+				continue;
+			}
+
 			/* Set up the root op context for this state */
 			root_op_context.req_ctx.clientid =
 			    &clientid_owner->so_owner.so_nfs4_owner.so_clientid;
@@ -293,21 +306,6 @@ int nfs4_op_layoutreturn(struct nfs_argop4 *op, compound_data_t *data,
 			PTHREAD_MUTEX_unlock(&clientid_owner->so_mutex);
 			so_mutex_locked = false;
 
-			if (return_fsid) {
-				if (!memcmp(&fsid, &data->current_obj->fsid,
-					    sizeof(fsid))) {
-					obj->obj_ops->put_ref(obj);
-					put_gsh_export(export);
-					dec_state_t_ref(layout_state);
-
-					/* Since we had to drop so_mutex, the
-					 * list may have changed under us, we
-					 * MUST start over.
-					 */
-					goto again;
-				}
-			}
-
 			PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
 
 			res_LAYOUTRETURN4->lorr_status = nfs4_return_one_state(
@@ -340,6 +338,11 @@ int nfs4_op_layoutreturn(struct nfs_argop4 *op, compound_data_t *data,
 		if (so_mutex_locked)
 			PTHREAD_MUTEX_unlock(&clientid_owner->so_mutex);
 
+		if (res_LAYOUTRETURN4->lorr_status == NFS4_OK)
+			state_layout_recall_returned(
+				data->session->clientid_record,
+				return_fsid ? &fsid : NULL);
+
 		/* Poison the current stateid */
 		data->current_stateid_valid = false;
 		lorr_stateid->lrs_present = 0;
@@ -610,6 +613,13 @@ nfsstat4 nfs4_return_one_state(struct fsal_obj_handle *obj,
 				g->sls_segment =
 				    pnfs_segment_difference(&spec_segment,
 							    &g->sls_segment);
+
+				/* Granted for the whole, not handed out
+				 * again for what is left.
+				 */
+				gsh_free(g->sls_body.addr);
+				g->sls_body.addr = NULL;
+				g->sls_body.len = 0;
 			}
 		}
 
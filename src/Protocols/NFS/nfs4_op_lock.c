@@ -630,6 +630,12 @@ int nfs4_op_lock(struct nfs_argop4 *op, compound_data_t *data,
 						conflict_owner,
 						&conflict_desc,
 						data);
+
+			/* Tell a waiting client when it is worth retrying */
+			if (blocking == STATE_NFSV4_BLOCKING &&
+			    data->minorversion > 0)
+				state_lock_notify_add(obj, lock_owner,
+						      &lock_desc);
 		} else {
 			res_LOCK4->status = nfs4_Errno_state(state_status);
 		}
@@ -41,6 +41,36 @@
 #include "nfs_proto_tools.h"
 #include "nfs_convert.h"
 #include "export_mgr.h"
+#include "sal_functions.h"
+
+/**
+ * @brief Refer a client crossing into an export elsewhere, if need be
+ *
+ * See Dynamic_Referrals.  Clients that hold state here, or may be about
+ * to reclaim it, stay.
+ *
+ * @param[in,out] data Compound request's data, currentFH the export root
+ */
+static void lookup_junction_referral(compound_data_t *data)
+{
+	nfs_client_id_t *client;
+	bool has_state;
+
+	if (!nfs_param.nfsv4_param.dynamic_referrals || nfs_in_grace())
+		return;
+
+	if (data->session != NULL) {
+		client = data->session->clientid_record;
+		PTHREAD_MUTEX_lock(&client->cid_mutex);
+		has_state = client_id_has_state(client);
+		PTHREAD_MUTEX_unlock(&client->cid_mutex);
+		if (has_state)
+			return;
+	}
+
+	data->current_referral =
+		nfs4_referral_locations(op_ctx->ctx_export->pseudopath);
+}
 
 /**
  * @brief NFS4_OP_LOOKUP
@@ -71,6 +101,8 @@ int nfs4_op_lookup(struct nfs_argop4 *op, compound_data_t *data,
 	struct fsal_obj_handle *file_obj = NULL;
 	/* Status code from fsal */
 	fsal_status_t status = {0, 0};
+	/* Whether the lookup crossed into another export */
+	bool junction = false;
 
 	resp->resop = NFS4_OP_LOOKUP;
 	res_LOOKUP4->status = NFS4_OK;
@@ -204,6 +236,7 @@ int nfs4_op_lookup(struct nfs_argop4 *op, compound_data_t *data,
 
 			file_obj->obj_ops->put_ref(file_obj);
 			file_obj = obj;
+			junction = true;
 		} else {
 			PTHREAD_RWLOCK_unlock(&file_obj->state_hdl->state_lock);
 		}
@@ -219,6 +252,9 @@ int nfs4_op_lookup(struct nfs_argop4 *op, compound_data_t *data,
 	/* Keep the pointer within the compound data */
 	set_current_entry(data, file_obj);
 
+	if (junction)
+		lookup_junction_referral(data);
+
 	/* Put our ref */
 	file_obj->obj_ops->put_ref(file_obj);
 	file_obj = NULL;
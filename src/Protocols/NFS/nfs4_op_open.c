@@ -555,6 +555,12 @@ static void do_delegation(OPEN4args *arg_OPEN4, OPEN4res *res_OPEN4,
 		return;
 	}
 
+	/* Every open feeds the delegation policy, wanted or not */
+	if (nfs_param.nfsv4_param.allow_delegations &&
+	    data->current_obj->type == REGULAR_FILE)
+		deleg_heuristics_open(ostate, clientid,
+				      arg_OPEN4->share_access);
+
 	/* This will be updated later if we actually delegate */
 	if (clientid->cid_minorversion == 0)
 		resok->delegation.delegation_type = OPEN_DELEGATE_NONE;
@@ -697,6 +703,34 @@ static void open4_ex_create_args(OPEN4args *arg,
  *
  */
 
+/**
+ * @brief Status of a failed open of a file
+ *
+ * An open denied by the share reservations of courtesy clients is told
+ * to retry, by when the clients and their opens are gone.
+ *
+ * @note The state_lock of file_obj MUST be held
+ *
+ * @param[in] status    Status of the open
+ * @param[in] file_obj  File, NULL if it did not exist
+ * @param[in] arg       OPEN arguments
+ *
+ * @return NFSv4 status.
+ */
+static nfsstat4 open4_ex_status(fsal_status_t status,
+				struct fsal_obj_handle *file_obj,
+				OPEN4args *arg)
+{
+	if (status.major == ERR_FSAL_SHARE_DENIED && file_obj != NULL &&
+	    state_share_courtesy_conflict(file_obj->state_hdl,
+					  arg->share_access &
+						OPEN4_SHARE_ACCESS_BOTH,
+					  arg->share_deny))
+		return NFS4ERR_DELAY;
+
+	return nfs4_Errno_status(status);
+}
+
 static void open4_ex(OPEN4args *arg,
 		     compound_data_t *data,
 		     OPEN4res *res_OPEN4,
@@ -969,7 +1003,8 @@ static void open4_ex(OPEN4args *arg,
 				    NULL);
 
 		if (FSAL_IS_ERROR(status)) {
-			res_OPEN4->status = nfs4_Errno_status(status);
+			res_OPEN4->status = open4_ex_status(status, file_obj,
+							    arg);
 			goto out;
 		}
 	} else if (createmode >= FSAL_EXCLUSIVE) {
@@ -1000,7 +1035,8 @@ static void open4_ex(OPEN4args *arg,
 				      false);
 
 		if (FSAL_IS_ERROR(status)) {
-			res_OPEN4->status = nfs4_Errno_status(status);
+			res_OPEN4->status = open4_ex_status(status, file_obj,
+							    arg);
 			goto out;
 		}
 
@@ -1385,6 +1421,11 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
 
 	res_OPEN4->OPEN4res_u.resok4.rflags |= OPEN4_RESULT_LOCKTYPE_POSIX;
 
+	/* Blocking locks denied are followed by CB_NOTIFY_LOCK */
+	if (data->minorversion > 0)
+		res_OPEN4->OPEN4res_u.resok4.rflags |=
+						OPEN4_RESULT_MAY_NOTIFY_LOCK;
+
 	LogFullDebug(COMPONENT_STATE, "NFS4 OPEN returning NFS4_OK");
 
 	/* regular exit */
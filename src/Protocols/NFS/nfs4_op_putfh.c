@@ -45,6 +45,498 @@
 #include "fsal_convert.h"
 #include "nfs_file_handle.h"
 #include "pnfs_utils.h"
+#include "fridgethr.h"
+#include "city.h"
+
+/**
+ * @brief A handle resolved by a recent PUTFH
+ *
+ * Each worker thread keeps the objects its last PUTFHs resolved, with
+ * a reference on them and on their export, keyed on the wire handle
+ * and the export it was found in.  A slot is only used while
+ * fsal_obj_epoch() has not moved since its object was looked up; a
+ * stale slot is looked up again and refreshed on its next use.
+ *
+ * The caches are listed so that removing an export releases what they
+ * hold of it, and a thread's cache is released as the thread exits.
+ * Each has a mutex for that, which is otherwise only its thread's.
+ */
+
+struct putfh_slot {
+	struct gsh_export *export;	/*< Export, NULL if slot is empty */
+	struct fsal_obj_handle *obj;	/*< Object, ref held */
+	uint32_t epoch;			/*< Epoch sampled before the lookup */
+	uint32_t used;			/*< When last used */
+	uint32_t fh_len;
+	char fh[NFS4_FHSIZE];
+};
+
+struct putfh_cache {
+	struct glist_head list;		/*< In putfh_caches */
+	pthread_mutex_t mtx;		/*< Protects the slots */
+	uint32_t size;
+	uint32_t clock;
+	struct putfh_slot slots[];
+};
+
+static __thread struct putfh_cache *putfh_cache;
+
+static GLIST_HEAD(putfh_caches);
+static pthread_mutex_t putfh_caches_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t putfh_key;
+static pthread_once_t putfh_key_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Release what a slot holds
+ *
+ * The object must be released in its own export.
+ *
+ * @param[in] slot  The slot
+ */
+static void putfh_slot_release(struct putfh_slot *slot)
+{
+	struct gsh_export *saved_export = op_ctx->ctx_export;
+	struct fsal_export *saved_fsal_export = op_ctx->fsal_export;
+
+	if (slot->export == NULL)
+		return;
+
+	op_ctx->ctx_export = slot->export;
+	op_ctx->fsal_export = slot->export->fsal_export;
+
+	slot->obj->obj_ops->put_ref(slot->obj);
+
+	op_ctx->ctx_export = saved_export;
+	op_ctx->fsal_export = saved_fsal_export;
+
+	put_gsh_export(slot->export);
+	slot->export = NULL;
+	slot->obj = NULL;
+}
+
+/**
+ * @brief Release a thread's cache as it exits
+ *
+ * @param[in] arg  The cache
+ */
+static void putfh_cache_destroy(void *arg)
+{
+	struct putfh_cache *cache = arg;
+	struct req_op_context *saved_ctx = op_ctx;
+	struct req_op_context req_ctx = {0};
+	uint32_t i;
+
+	PTHREAD_MUTEX_lock(&putfh_caches_mtx);
+	glist_del(&cache->list);
+	PTHREAD_MUTEX_unlock(&putfh_caches_mtx);
+
+	/* Objects are put in their export, which needs an op context */
+	op_ctx = &req_ctx;
+	for (i = 0; i < cache->size; i++)
+		putfh_slot_release(&cache->slots[i]);
+	op_ctx = saved_ctx;
+
+	PTHREAD_MUTEX_destroy(&cache->mtx);
+	gsh_free(cache);
+}
+
+static void putfh_key_init(void)
+{
+	(void) pthread_key_create(&putfh_key, putfh_cache_destroy);
+}
+
+/**
+ * @brief Release what every thread's cache holds of an export
+ *
+ * Called as the export is removed, so no worker keeps it or its
+ * objects past that.
+ *
+ * @param[in] export  The export
+ */
+void nfs4_putfh_flush_export(struct gsh_export *export)
+{
+	struct glist_head *glist;
+	struct putfh_cache *cache;
+	uint32_t i;
+
+	PTHREAD_MUTEX_lock(&putfh_caches_mtx);
+	glist_for_each(glist, &putfh_caches) {
+		cache = glist_entry(glist, struct putfh_cache, list);
+
+		PTHREAD_MUTEX_lock(&cache->mtx);
+		for (i = 0; i < cache->size; i++)
+			if (cache->slots[i].export == export)
+				putfh_slot_release(&cache->slots[i]);
+		PTHREAD_MUTEX_unlock(&cache->mtx);
+	}
+	PTHREAD_MUTEX_unlock(&putfh_caches_mtx);
+}
+
+/**
+ * @brief Find a handle in the thread's cache
+ *
+ * On a miss the least recently used slot is emptied and given the
+ * handle, putfh_cache_fill() completes it once the lookup succeeded.
+ * The handle must be keyed before the lookup, wire_to_host may
+ * rewrite it in place.  A slot is returned with the cache locked.
+ *
+ * @param[in] export  Export the handle is in
+ * @param[in] fh      Wire handle
+ * @param[in] epoch   Current epoch
+ *
+ * @return The slot, holding the object on a hit, NULL if the cache
+ *         is disabled.
+ */
+static struct putfh_slot *putfh_cache_find(struct gsh_export *export,
+					   nfs_fh4 *fh, uint32_t epoch)
+{
+	struct putfh_slot *victim = NULL;
+	uint32_t size, i;
+
+	if (putfh_cache == NULL) {
+		size = nfs_param.nfsv4_param.putfh_cache_size;
+		if (size == 0)
+			return NULL;
+
+		(void) pthread_once(&putfh_key_once, putfh_key_init);
+
+		putfh_cache = gsh_calloc(1, sizeof(struct putfh_cache) +
+					    size * sizeof(struct putfh_slot));
+		putfh_cache->size = size;
+		PTHREAD_MUTEX_init(&putfh_cache->mtx, NULL);
+		(void) pthread_setspecific(putfh_key, putfh_cache);
+
+		PTHREAD_MUTEX_lock(&putfh_caches_mtx);
+		glist_add(&putfh_caches, &putfh_cache->list);
+		PTHREAD_MUTEX_unlock(&putfh_caches_mtx);
+	}
+
+	PTHREAD_MUTEX_lock(&putfh_cache->mtx);
+
+	putfh_cache->clock++;
+
+	for (i = 0; i < putfh_cache->size; i++) {
+		struct putfh_slot *slot = &putfh_cache->slots[i];
+
+		if (slot->export != NULL && !export_ready(slot->export))
+			putfh_slot_release(slot);
+
+		if (slot->export == export &&
+		    slot->fh_len == fh->nfs_fh4_len &&
+		    memcmp(slot->fh, fh->nfs_fh4_val, fh->nfs_fh4_len) == 0) {
+			slot->used = putfh_cache->clock;
+			if (slot->epoch != epoch) {
+				/* Stale, look it up again */
+				putfh_slot_release(slot);
+			}
+			return slot;
+		}
+
+		if (victim == NULL || (victim->export != NULL &&
+		    (slot->export == NULL || slot->used < victim->used)))
+			victim = slot;
+	}
+
+	putfh_slot_release(victim);
+	victim->used = putfh_cache->clock;
+	victim->fh_len = fh->nfs_fh4_len;
+	memcpy(victim->fh, fh->nfs_fh4_val, fh->nfs_fh4_len);
+
+	return victim;
+}
+
+/**
+ * @brief Complete a slot with the object its handle resolved to
+ *
+ * @param[in] slot    Slot from putfh_cache_find()
+ * @param[in] export  Export the handle is in
+ * @param[in] obj     Object, the caller's ref passes to the slot
+ * @param[in] epoch   Epoch sampled before the lookup
+ */
+static void putfh_cache_fill(struct putfh_slot *slot,
+			     struct gsh_export *export,
+			     struct fsal_obj_handle *obj, uint32_t epoch)
+{
+	PTHREAD_MUTEX_lock(&putfh_cache->mtx);
+	get_gsh_export_ref(export);
+	slot->export = export;
+	slot->obj = obj;
+	slot->epoch = epoch;
+	PTHREAD_MUTEX_unlock(&putfh_cache->mtx);
+}
+
+/**
+ * @brief Asynchronous resolution of handles
+ *
+ * With PUTFH_Resolve_Threads set, a PUTFH whose handle is not in the
+ * thread's cache hands the lookup to a pool and suspends its COMPOUND,
+ * so a worker is not held while a cold handle is opened.  PUTFHs of a
+ * handle already being resolved join that resolution instead of
+ * starting another, which is what a reconnect storm mostly is.
+ */
+
+#define PUTFH_RESOLVE_BUCKETS 64
+
+/** A COMPOUND waiting on a resolution */
+struct putfh_waiter {
+	struct glist_head list;
+	compound_data_t *data;
+	struct req_op_context *ctx;	/*< Its op context */
+	nfsstat4 status;
+};
+
+/** A handle being resolved */
+struct putfh_resolve {
+	struct glist_head list;		/*< In its bucket */
+	struct putfh_bucket *bucket;
+	struct gsh_export *export;
+	struct glist_head waiters;
+	struct putfh_waiter owner;	/*< The COMPOUND that started it */
+	uint32_t fh_len;
+	char fh[NFS4_FHSIZE];
+};
+
+static struct putfh_bucket {
+	pthread_mutex_t mtx;
+	struct glist_head resolving;
+} putfh_buckets[PUTFH_RESOLVE_BUCKETS];
+
+static struct fridgethr *putfh_fridge;
+
+/**
+ * @brief Resume a COMPOUND that joined a resolution
+ *
+ * @param[in] ctx  Thread context, the waiter as argument
+ */
+static void putfh_resume_run(struct fridgethr_context *ctx)
+{
+	struct putfh_waiter *waiter = ctx->arg;
+
+	nfs4_op_async_done(waiter->data, waiter->status);
+	gsh_free(waiter);
+}
+
+/**
+ * @brief Resolve a handle and resume the COMPOUNDs waiting on it
+ *
+ * The lookup is made in the op context of the COMPOUND that started
+ * it, which stays suspended until the very end.  The joiners are
+ * resumed by the pool so none waits for the others to finish.
+ *
+ * @param[in] res  The resolution, freed here
+ */
+static void putfh_resolve_complete(struct putfh_resolve *res)
+{
+	struct req_op_context *saved_ctx = op_ctx;
+	struct file_handle_v4 *v4_handle = (struct file_handle_v4 *)res->fh;
+	struct fsal_export *export = res->export->fsal_export;
+	struct fsal_obj_handle *new_hdl = NULL;
+	struct gsh_buffdesc fh_desc;
+	fsal_status_t fsal_status;
+	struct putfh_waiter *waiter;
+	struct glist_head *glist, *glistn;
+	compound_data_t *owner;
+	nfsstat4 status = NFS4_OK;
+
+	op_ctx = res->owner.ctx;
+
+	fh_desc.len = v4_handle->fs_len;
+	fh_desc.addr = &v4_handle->fsopaque;
+
+	fsal_status = export->exp_ops.wire_to_host(export,
+						   FSAL_DIGEST_NFSV4,
+						   &fh_desc,
+						   v4_handle->fhflags1);
+	if (FSAL_IS_ERROR(fsal_status)) {
+		LogFullDebug(COMPONENT_FILEHANDLE,
+			     "wire_to_host failed %s",
+			     msg_fsal_err(fsal_status.major));
+	} else {
+		fsal_status = export->exp_ops.create_handle(export, &fh_desc,
+							    &new_hdl, NULL);
+		if (FSAL_IS_ERROR(fsal_status))
+			LogDebug(COMPONENT_FILEHANDLE,
+				 "could not get create_handle object error %s",
+				 msg_fsal_err(fsal_status.major));
+	}
+
+	if (FSAL_IS_ERROR(fsal_status))
+		status = nfs4_Errno_status(fsal_status);
+
+	/* No one joins from now on */
+	PTHREAD_MUTEX_lock(&res->bucket->mtx);
+	glist_del(&res->list);
+	PTHREAD_MUTEX_unlock(&res->bucket->mtx);
+
+	glist_for_each(glist, &res->waiters) {
+		waiter = glist_entry(glist, struct putfh_waiter, list);
+		waiter->status = status;
+		if (new_hdl != NULL) {
+			op_ctx = waiter->ctx;
+			set_current_entry(waiter->data, new_hdl);
+		}
+	}
+
+	op_ctx = res->owner.ctx;
+	if (new_hdl != NULL)
+		new_hdl->obj_ops->put_ref(new_hdl);
+	op_ctx = saved_ctx;
+
+	glist_for_each_safe(glist, glistn, &res->waiters) {
+		waiter = glist_entry(glist, struct putfh_waiter, list);
+		if (waiter == &res->owner)
+			continue;
+		glist_del(&waiter->list);
+		if (fridgethr_submit(putfh_fridge, putfh_resume_run,
+				     waiter) != 0) {
+			nfs4_op_async_done(waiter->data, waiter->status);
+			gsh_free(waiter);
+		}
+	}
+
+	owner = res->owner.data;
+	gsh_free(res);
+
+	nfs4_op_async_done(owner, status);
+}
+
+/**
+ * @brief Resolution thread body
+ *
+ * @param[in] ctx  Thread context, the resolution as argument
+ */
+static void putfh_resolve_run(struct fridgethr_context *ctx)
+{
+	putfh_resolve_complete(ctx->arg);
+}
+
+/**
+ * @brief Resolve the current handle in the pool
+ *
+ * @param[in,out] data    The compound request's data
+ * @param[in]     export  Export the handle is in
+ *
+ * @return NFS4_OP_ASYNC_WAIT if the COMPOUND suspended, else the status
+ *         of the resolution.
+ */
+static int putfh_resolve_async(compound_data_t *data,
+			       struct gsh_export *export)
+{
+	nfs_fh4 *fh = &data->currentFH;
+	struct putfh_bucket *bucket;
+	struct putfh_resolve *res;
+	struct putfh_waiter *waiter;
+	struct glist_head *glist;
+
+	bucket = &putfh_buckets[CityHash64(fh->nfs_fh4_val, fh->nfs_fh4_len)
+				% PUTFH_RESOLVE_BUCKETS];
+
+	PTHREAD_MUTEX_lock(&bucket->mtx);
+
+	glist_for_each(glist, &bucket->resolving) {
+		res = glist_entry(glist, struct putfh_resolve, list);
+
+		if (res->export != export || res->fh_len != fh->nfs_fh4_len ||
+		    memcmp(res->fh, fh->nfs_fh4_val, fh->nfs_fh4_len) != 0)
+			continue;
+
+		waiter = gsh_malloc(sizeof(*waiter));
+		waiter->data = data;
+		waiter->ctx = op_ctx;
+		glist_add_tail(&res->waiters, &waiter->list);
+
+		PTHREAD_MUTEX_unlock(&bucket->mtx);
+
+		LogFullDebug(COMPONENT_FILEHANDLE,
+			     "Joined resolution of the handle");
+		goto suspend;
+	}
+
+	res = gsh_malloc(sizeof(*res));
+	res->bucket = bucket;
+	res->export = export;
+	res->fh_len = fh->nfs_fh4_len;
+	memcpy(res->fh, fh->nfs_fh4_val, fh->nfs_fh4_len);
+	res->owner.data = data;
+	res->owner.ctx = op_ctx;
+	glist_init(&res->waiters);
+	glist_add_tail(&res->waiters, &res->owner.list);
+	glist_add_tail(&bucket->resolving, &res->list);
+
+	PTHREAD_MUTEX_unlock(&bucket->mtx);
+
+	if (fridgethr_submit(putfh_fridge, putfh_resolve_run, res) != 0) {
+		/* Resolve it here, the COMPOUND does not suspend */
+		putfh_resolve_complete(res);
+	}
+
+ suspend:
+	if (nfs4_op_async_suspend(data))
+		return NFS4_OP_ASYNC_WAIT;
+
+	return data->async_status;
+}
+
+/**
+ * @brief Start the handle resolution threads
+ */
+void nfs4_putfh_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int rc, i;
+
+	if (nfs_param.nfsv4_param.putfh_resolve_threads == 0) {
+		/* Every PUTFH resolves its handle itself */
+		return;
+	}
+
+	for (i = 0; i < PUTFH_RESOLVE_BUCKETS; i++) {
+		PTHREAD_MUTEX_init(&putfh_buckets[i].mtx, NULL);
+		glist_init(&putfh_buckets[i].resolving);
+	}
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = nfs_param.nfsv4_param.putfh_resolve_threads;
+	frp.thr_min = 0;
+	frp.thread_delay = 60;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&putfh_fridge, "NFS4_PUTFH_fridge", &frp);
+	if (rc != 0) {
+		LogMajor(COMPONENT_INIT,
+			 "Unable to initialize PUTFH fridge, error code %d.",
+			 rc);
+		putfh_fridge = NULL;
+	}
+}
+
+/**
+ * @brief Stop the handle resolution threads
+ *
+ * Called once the workers are stopped, so no PUTFH suspends anymore.
+ */
+void nfs4_putfh_pkgshutdown(void)
+{
+	int rc;
+
+	if (putfh_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(putfh_fridge, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_THREAD,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(putfh_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Failed shutting down PUTFH threads: %d", rc);
+	}
+
+	fridgethr_destroy(putfh_fridge);
+	putfh_fridge = NULL;
+}
 
 static int nfs4_ds_putfh(compound_data_t *data)
 {
@@ -138,6 +630,8 @@ static int nfs4_mds_putfh(compound_data_t *data)
 	struct gsh_buffdesc fh_desc;
 	struct fsal_obj_handle *new_hdl;
 	fsal_status_t fsal_status = { 0, 0 };
+	struct putfh_slot *slot;
+	uint32_t epoch;
 	bool changed = true;
 
 	LogFullDebug(COMPONENT_FILEHANDLE,
@@ -193,6 +687,23 @@ static int nfs4_mds_putfh(compound_data_t *data)
 		}
 	}
 
+	/* Sample the epoch before anything is looked up */
+	epoch = fsal_obj_epoch();
+	slot = putfh_cache_find(exporting, &data->currentFH, epoch);
+	if (slot != NULL) {
+		struct fsal_obj_handle *obj = slot->obj;
+
+		/* A hit takes its own ref before the slot can go */
+		if (obj != NULL)
+			set_current_entry(data, obj);
+		PTHREAD_MUTEX_unlock(&putfh_cache->mtx);
+		if (obj != NULL)
+			return NFS4_OK;
+	}
+
+	if (putfh_fridge != NULL)
+		return putfh_resolve_async(data, exporting);
+
 	fh_desc.len = v4_handle->fs_len;
 	fh_desc.addr = &v4_handle->fsopaque;
 
@@ -220,8 +731,13 @@ static int nfs4_mds_putfh(compound_data_t *data)
 	/* Set the current entry using the ref from get */
 	set_current_entry(data, new_hdl);
 
-	/* Put our ref */
-	new_hdl->obj_ops->put_ref(new_hdl);
+	if (slot != NULL) {
+		/* The cache keeps our ref */
+		putfh_cache_fill(slot, exporting, new_hdl, epoch);
+	} else {
+		/* Put our ref */
+		new_hdl->obj_ops->put_ref(new_hdl);
+	}
 
 	LogFullDebug(COMPONENT_FILEHANDLE,
 		     "File handle is of type %s(%d)",
@@ -253,6 +769,7 @@ int nfs4_op_putfh(struct nfs_argop4 *op, compound_data_t *data,
 	PUTFH4args * const arg_PUTFH4 = &op->nfs_argop4_u.opputfh;
 	/* Convenience alias for resopnse */
 	PUTFH4res * const res_PUTFH4 = &resp->nfs_resop4_u.opputfh;
+	int status;
 
 	resp->resop = NFS4_OP_PUTFH;
 
@@ -276,10 +793,15 @@ int nfs4_op_putfh(struct nfs_argop4 *op, compound_data_t *data,
 	 * cache_inode to populate the metadata cache.
 	 */
 	if (nfs4_Is_Fh_DSHandle(&data->currentFH))
-		res_PUTFH4->status = nfs4_ds_putfh(data);
+		status = nfs4_ds_putfh(data);
 	else
-		res_PUTFH4->status = nfs4_mds_putfh(data);
+		status = nfs4_mds_putfh(data);
+
+	/* Once suspended the result is no longer ours */
+	if (status == NFS4_OP_ASYNC_WAIT)
+		return status;
 
+	res_PUTFH4->status = status;
 	return res_PUTFH4->status;
 }				/* nfs4_op_putfh */
 
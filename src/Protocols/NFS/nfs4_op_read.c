@@ -47,10 +47,13 @@
 #include "fsal_pnfs.h"
 #include "server_stats.h"
 #include "export_mgr.h"
+#include "gsh_iobuf.h"
 
 struct nfs4_read_data {
 	READ4res *res_READ4;		/**< Results for read */
 	state_owner_t *owner;		/**< Owner of state */
+	compound_data_t *data;		/**< COMPOUND to resume, if it may
+					     suspend */
 };
 
 /**
@@ -66,6 +69,8 @@ static void nfs4_read_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 {
 	struct nfs4_read_data *data = caller_data;
 	struct fsal_io_arg *read_arg = read_data;
+	compound_data_t *compound;
+	nfsstat4 status;
 	int i;
 
 	/* Fixup FSAL_SHARE_DENIED status */
@@ -77,7 +82,7 @@ static void nfs4_read_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 
 	if (FSAL_IS_ERROR(ret)) {
 		for (i = 0; i < read_arg->iov_count; ++i) {
-			gsh_free(read_arg->iov[i].iov_base);
+			iobuf_free(read_arg->iov[i].iov_base);
 		}
 		data->res_READ4->READ4res_u.resok4.data.data_val = NULL;
 		goto done;
@@ -132,6 +137,14 @@ done:
 
 	if (read_arg->state)
 		dec_state_t_ref(read_arg->state);
+
+	/* The arguments went with the call, the status stays in the result */
+	compound = data->data;
+	status = data->res_READ4->status;
+	gsh_free(data);
+
+	if (compound != NULL)
+		nfs4_op_async_done(compound, status);
 }
 
 /**
@@ -172,7 +185,7 @@ static int op_dsread(struct nfs_argop4 *op, compound_data_t *data,
 
 	/* Construct the FSAL file handle */
 
-	buffer = gsh_malloc_aligned(4096, arg_READ4->count);
+	buffer = iobuf_alloc(arg_READ4->count);
 
 	res_READ4->READ4res_u.resok4.data.data_val = buffer;
 
@@ -187,7 +200,7 @@ static int op_dsread(struct nfs_argop4 *op, compound_data_t *data,
 				&eof);
 
 	if (nfs_status != NFS4_OK) {
-		gsh_free(buffer);
+		iobuf_free(buffer);
 		res_READ4->READ4res_u.resok4.data.data_val = NULL;
 	}
 
@@ -243,7 +256,7 @@ static int op_dsread_plus(struct nfs_argop4 *op, compound_data_t *data,
 
 	/* Construct the FSAL file handle */
 
-	buffer = gsh_malloc_aligned(4096, arg_READ4->count);
+	buffer = iobuf_alloc(arg_READ4->count);
 
 	nfs_status = data->current_ds->dsh_ops.read_plus(
 				data->current_ds,
@@ -257,7 +270,7 @@ static int op_dsread_plus(struct nfs_argop4 *op, compound_data_t *data,
 
 	res_RPLUS->rpr_status = nfs_status;
 	if (nfs_status != NFS4_OK) {
-		gsh_free(buffer);
+		iobuf_free(buffer);
 		return res_RPLUS->rpr_status;
 	}
 
@@ -275,6 +288,9 @@ static int op_dsread_plus(struct nfs_argop4 *op, compound_data_t *data,
 					info->io_content.data.d_data.data_len;
 		contentp->data.d_data.data_val =
 					info->io_content.data.d_data.data_val;
+	} else {
+		/* Nothing refers to the buffer in a hole reply */
+		iobuf_free(buffer);
 	}
 	return res_RPLUS->rpr_status;
 }
@@ -300,9 +316,8 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 	uint64_t MaxOffsetRead =
 			atomic_fetch_uint64_t(
 				&op_ctx->ctx_export->MaxOffsetRead);
-	struct nfs4_read_data read_data;
-	struct fsal_io_arg *read_arg = alloca(sizeof(*read_arg) +
-						sizeof(struct iovec));
+	struct nfs4_read_data *read_data;
+	struct fsal_io_arg *read_arg;
 	uint32_t resp_size;
 
 	/* Say we are managing NFS4_OP_READ */
@@ -541,7 +556,7 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 	}
 
 	/* Some work is to be done */
-	bufferdata = gsh_malloc_aligned(4096, size);
+	bufferdata = iobuf_alloc(size);
 
 	if (!anonymous_started && data->minorversion == 0) {
 		owner = get_state_owner_ref(state_found);
@@ -551,21 +566,45 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 		}
 	}
 
-	/* Set up args */
+	/* Set up args, they live until the callback as the FSAL may complete
+	 * the read after read2 returned.
+	 */
+	read_data = gsh_malloc(sizeof(*read_data) + sizeof(*read_arg) +
+			       sizeof(struct iovec));
+	read_arg = (struct fsal_io_arg *) (read_data + 1);
+
 	read_arg->info = info;
 	read_arg->state = state_found;
 	read_arg->offset = offset;
+	read_arg->extent.want = false;
+	read_arg->extent.fd = -1;
 	read_arg->iov_count = 1;
 	read_arg->iov[0].iov_len = size;
 	read_arg->iov[0].iov_base = bufferdata;
 	read_arg->io_amount = 0;
 	read_arg->end_of_file = false;
 
-	read_data.res_READ4 = res_READ4;
-	read_data.owner = owner;
+	read_data->res_READ4 = res_READ4;
+	read_data->owner = owner;
+	/* READ_PLUS post-processes the result itself so it never suspends */
+	read_data->data = io == FSAL_IO_READ ? data : NULL;
 
 	/* Do the actual read */
-	obj->obj_ops->read2(obj, bypass, nfs4_read_cb, read_arg, &read_data);
+	op_ctx->async_io = read_data->data != NULL;
+	obj->obj_ops->read2(obj, bypass, nfs4_read_cb, read_arg, read_data);
+	op_ctx->async_io = false;
+
+	/* A callback from another thread only cleared its own copy */
+	if (owner != NULL)
+		op_ctx->clientid = NULL;
+
+	if (state_open != NULL)
+		dec_state_t_ref(state_open);
+
+	if (io == FSAL_IO_READ && nfs4_op_async_suspend(data))
+		return NFS4_OP_ASYNC_WAIT;
+
+	return res_READ4->status;
 
  out:
 	if (state_open != NULL)
@@ -612,7 +651,7 @@ void nfs4_op_read_Free(nfs_resop4 *res)
 
 	if (resp->status == NFS4_OK)
 		if (resp->READ4res_u.resok4.data.data_val != NULL)
-			gsh_free(resp->READ4res_u.resok4.data.data_val);
+			iobuf_free(resp->READ4res_u.resok4.data.data_val);
 }
 
 /**
@@ -640,6 +679,31 @@ int nfs4_op_read_plus(struct nfs_argop4 *op, compound_data_t *data,
 
 	resp->resop = NFS4_OP_READ_PLUS;
 
+	memset(&info, 0, sizeof(info));
+
+	if (!nfs4_Is_Fh_DSHandle(&data->currentFH) &&
+	    op_ctx->fsal_export != NULL &&
+	    !op_ctx->fsal_export->exp_ops.fs_supports(op_ctx->fsal_export,
+						      fso_read_plus)) {
+		/* The FSAL knows nothing of holes, all we have is data */
+		nfs4_read(op, data, &res, FSAL_IO_READ_PLUS, NULL);
+
+		res_RPLUS->rpr_status = res_READ4->status;
+		if (res_RPLUS->rpr_status != NFS4_OK)
+			return res_RPLUS->rpr_status;
+
+		contentp->what = NFS4_CONTENT_DATA;
+		res_RPLUS->rpr_resok4.rpr_contents_count = 1;
+		res_RPLUS->rpr_resok4.rpr_eof =
+				res_READ4->READ4res_u.resok4.eof;
+		contentp->data.d_offset = op->nfs_argop4_u.opread.offset;
+		contentp->data.d_data.data_len =
+				res_READ4->READ4res_u.resok4.data.data_len;
+		contentp->data.d_data.data_val =
+				res_READ4->READ4res_u.resok4.data.data_val;
+		return res_RPLUS->rpr_status;
+	}
+
 	nfs4_read(op, data, &res, FSAL_IO_READ_PLUS, &info);
 
 	res_RPLUS->rpr_status = res_READ4->status;
@@ -661,6 +725,9 @@ int nfs4_op_read_plus(struct nfs_argop4 *op, compound_data_t *data,
 					info.io_content.data.d_data.data_len;
 		contentp->data.d_data.data_val =
 					info.io_content.data.d_data.data_val;
+	} else {
+		/* Nothing refers to the buffer in a hole reply */
+		iobuf_free(res_READ4->READ4res_u.resok4.data.data_val);
 	}
 	return res_RPLUS->rpr_status;
 }
@@ -672,7 +739,7 @@ void nfs4_op_read_plus_Free(nfs_resop4 *res)
 
 	if (resp->rpr_status == NFS4_OK && conp->what == NFS4_CONTENT_DATA)
 		if (conp->data.d_data.data_val != NULL)
-			gsh_free(conp->data.d_data.data_val);
+			iobuf_free(conp->data.d_data.data_val);
 }
 
 /**
@@ -728,18 +795,22 @@ int nfs4_op_io_advise(struct nfs_argop4 *op, compound_data_t *data,
 	if (res_IO_ADVISE->iaa_status != NFS4_OK)
 		goto done;
 
-	if (state_found && obj) {
-		hints.hints = arg_IO_ADVISE->iaa_hints.map[0];
+	if (obj) {
+		hints.hints = arg_IO_ADVISE->iaa_hints.bitmap4_len > 0
+				? arg_IO_ADVISE->iaa_hints.map[0] : 0;
 		hints.offset = arg_IO_ADVISE->iaa_offset;
 		hints.count = arg_IO_ADVISE->iaa_count;
 
-		fsal_status = obj->obj_ops->io_advise(obj, &hints);
+		/* hints comes back with the ones the FSAL acted on */
+		fsal_status = obj->obj_ops->io_advise2(obj, state_found,
+						       &hints);
 		if (FSAL_IS_ERROR(fsal_status)) {
 			res_IO_ADVISE->iaa_status = NFS4ERR_NOTSUPP;
 			goto done;
 		}
 		/* save hints to use with other operations */
-		state_found->state_data.io_advise = hints.hints;
+		if (state_found != NULL)
+			state_found->state_data.io_advise = hints.hints;
 
 		res_IO_ADVISE->iaa_status = NFS4_OK;
 		res_IO_ADVISE->iaa_hints.bitmap4_len = 1;
@@ -57,6 +57,8 @@ struct nfs4_readdir_cb_data {
 				   nfs_fh4s. */
 	struct export_perms save_export_perms;	/*< Saved export perms. */
 	struct gsh_export *saved_gsh_export;	/*< Saved export */
+	struct gsh_arena *arena;	/*< Holds the entries, their names
+					   and attributes */
 };
 
 static void restore_data(struct nfs4_readdir_cb_data *tracker)
@@ -87,7 +89,7 @@ static void restore_data(struct nfs4_readdir_cb_data *tracker)
  *
  * This function is a callback passed to fsal_readdir.  It
  * fills in a pre-allocated array of entry4 structures and allocates
- * space for the name and attributes.  This space must be freed.
+ * space for the name and attributes from the arena of the array.
  *
  * @param[in,out] opaque A struct nfs4_readdir_cb_data that stores the
  *                       location of the array and other bookeeping
@@ -119,6 +121,7 @@ fsal_errors_t nfs4_readdir_callback(void *opaque,
 	fsal_status_t fsal_status;
 	fsal_accessflags_t access_mask_attr = 0;
 	size_t initial_mem_left = tracker->mem_left;
+	struct arena_mark mark;
 
 	/* Cleanup after problem with junction processing. */
 	if (cb_state == CB_PROBLEM) {
@@ -130,6 +133,8 @@ fsal_errors_t nfs4_readdir_callback(void *opaque,
 	if (tracker->total_entries == tracker->count)
 		goto not_inresult;
 
+	arena_get_mark(tracker->arena, &mark);
+
 	/* Test if this is a junction.
 	 *
 	 * NOTE: If there is a junction within a file system (perhaps setting
@@ -285,6 +290,7 @@ not_junction:
 	args.mounted_on_fileid = mounted_on_fileid;
 	args.fileid = obj->fileid;
 	args.fsid = obj->fsid;
+	args.arena = tracker->arena;
 
 	/* Now process the entry */
 	memset(val_fh, 0, NFS4_FHSIZE);
@@ -316,7 +322,8 @@ not_junction:
 
 	tracker->mem_left -= RNDUP(namelen);
 	tracker_entry->name.utf8string_len = namelen;
-	tracker_entry->name.utf8string_val = gsh_strdup(cb_parms->name);
+	tracker_entry->name.utf8string_val =
+		arena_strndup(tracker->arena, cb_parms->name, namelen);
 
 	/* If we carried an error from above, now that we have
 	 * the name set up, go ahead and try and put error in
@@ -382,8 +389,11 @@ not_junction:
 		LogDebug(COMPONENT_NFS_READDIR,
 			 "Skipping because of %s",
 			 nfsstat4_to_str(rdattr_error));
-		/* Discard the attributes we had retrieved. */
-		nfs4_Fattr_Free(&tracker_entry->attrs);
+		/* Discard the attributes we had retrieved, the arena
+		 * keeps their memory until the reply is freed.
+		 */
+		tracker_entry->attrs.attr_vals.attrlist4_val = NULL;
+		tracker_entry->attrs.attr_vals.attrlist4_len = 0;
 	}
 
  skip:
@@ -432,12 +442,12 @@ not_junction:
  failure:
 
 	tracker->mem_left = initial_mem_left;
-	nfs4_Fattr_Free(&tracker_entry->attrs);
 
-	if (tracker_entry->name.utf8string_val != NULL) {
-		gsh_free(tracker_entry->name.utf8string_val);
-		tracker_entry->name.utf8string_val = NULL;
-	}
+	/* Give back the name and attributes of the entry */
+	arena_rewind(tracker->arena, &mark);
+	tracker_entry->attrs.attr_vals.attrlist4_val = NULL;
+	tracker_entry->attrs.attr_vals.attrlist4_len = 0;
+	tracker_entry->name.utf8string_val = NULL;
 
  not_inresult:
 
@@ -457,23 +467,16 @@ not_junction:
 /**
  * @brief Free a list of entry4s
  *
- * This function frees a list of entry4s and all dependent strctures.
+ * The entries, their names and attributes all come from the arena the
+ * array was made with, so this frees them all at once.
  *
  * @param[in,out] entries The entries to be freed
  */
 
 static void free_entries(entry4 *entries)
 {
-	entry4 *entry = NULL;
-
-	for (entry = entries; entry != NULL; entry = entry->nextentry) {
-		if (entry->attrs.attr_vals.attrlist4_val != NULL)
-			gsh_free(entry->attrs.attr_vals.attrlist4_val);
-
-		if (entry->name.utf8string_val != NULL)
-			gsh_free(entry->name.utf8string_val);
-	}
-	gsh_free(entries);
+	if (entries != NULL)
+		arena_destroy(arena_of(entries));
 }
 
 /**
@@ -634,8 +637,9 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 	}
 
 	/* Prepare to read the entries */
-	entries = gsh_calloc(estimated_num_entries, sizeof(entry4));
+	entries = arena_create(estimated_num_entries * sizeof(entry4));
 	tracker.entries = entries;
+	tracker.arena = arena_of(entries);
 	tracker.mem_left = maxcount - READDIR_RESP_BASE_SIZE;
 	tracker.count = 0;
 	tracker.error = NFS4_OK;
@@ -702,7 +706,7 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 		 */
 		res_READDIR4->READDIR4res_u.resok4.reply.entries = entries;
 	} else {
-		gsh_free(entries);
+		free_entries(entries);
 		entries = NULL;
 		res_READDIR4->READDIR4res_u.resok4.reply.entries = NULL;
 	}
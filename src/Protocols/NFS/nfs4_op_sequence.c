@@ -58,6 +58,7 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 
 	nfs41_session_t *session;
 	nfs41_session_slot_t *slot;
+	uint32_t target;
 
 	resp->resop = NFS4_OP_SEQUENCE;
 	res_SEQUENCE4->sr_status = NFS4_OK;
@@ -81,10 +82,7 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 	LogDebug(COMPONENT_SESSIONS, "SEQUENCE session=%p", session);
 
 	/* Check if lease is expired and reserve it */
-	PTHREAD_MUTEX_lock(&session->clientid_record->cid_mutex);
-
-	if (!reserve_lease(session->clientid_record)) {
-		PTHREAD_MUTEX_unlock(&session->clientid_record->cid_mutex);
+	if (!reserve_lease_fast(session->clientid_record)) {
 
 		dec_session_ref(session);
 		res_SEQUENCE4->sr_status = NFS4ERR_EXPIRED;
@@ -96,12 +94,10 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 
 	data->preserved_clientid = session->clientid_record;
 
-	PTHREAD_MUTEX_unlock(&session->clientid_record->cid_mutex);
-
 	slotid = arg_SEQUENCE4->sa_slotid;
 
-	/* Check is slot is compliant with ca_maxrequests */
-	if (slotid >= session->fore_channel_attrs.ca_maxrequests) {
+	/* Check the slot is within the slots currently offered */
+	if (slotid > atomic_fetch_uint32_t(&session->highest_slot)) {
 		dec_session_ref(session);
 		res_SEQUENCE4->sr_status = NFS4ERR_BADSLOT;
 		LogDebugAlt(COMPONENT_SESSIONS, COMPONENT_CLIENTID,
@@ -112,11 +108,23 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 
 	/* By default, no DRC replay */
 	data->use_slot_cached_result = false;
-	slot = &session->fc_slots[slotid];
+	slot = nfs41_session_get_slot(session, slotid);
 
 	/* Serialize use of this slot. */
 	PTHREAD_MUTEX_lock(&slot->lock);
 
+	if (slot->suspended) {
+		/* The slot's COMPOUND is still waiting on an async op */
+		PTHREAD_MUTEX_unlock(&slot->lock);
+
+		dec_session_ref(session);
+		res_SEQUENCE4->sr_status = NFS4ERR_DELAY;
+		LogDebugAlt(COMPONENT_SESSIONS, COMPONENT_CLIENTID,
+			    "SEQUENCE returning status %s",
+			    nfsstat4_to_str(res_SEQUENCE4->sr_status));
+		return res_SEQUENCE4->sr_status;
+	}
+
 	if (slot->sequence + 1 != arg_SEQUENCE4->sa_sequenceid) {
 		/* This sequence is NOT the next sequence */
 		if (slot->sequence == arg_SEQUENCE4->sa_sequenceid) {
@@ -180,10 +188,12 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 	slot->sequence += 1;
 
 	/* If the slot cache was in use, free it. */
-	if (slot->cached_result.res_cached) {
-		slot->cached_result.res_cached = false;
-		nfs4_Compound_Free((nfs_res_t *) &slot->cached_result);
-	}
+	nfs41_Session_Slot_Release(slot);
+
+	/* Follow the server's load with the slots offered */
+	target = nfs41_session_slot_target(session);
+	nfs41_session_adjust_slots(session, arg_SEQUENCE4->sa_highest_slotid,
+				   target);
 
 	/* Set up the response */
 	memcpy(res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_sessionid,
@@ -191,9 +201,9 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_sequenceid = slot->sequence;
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_slotid = slotid;
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_highest_slotid =
-	    session->nb_slots - 1;
+	    atomic_fetch_uint32_t(&session->highest_slot);
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_target_highest_slotid =
-	    session->fore_channel_attrs.ca_maxrequests - 1;
+	    target - 1;
 
 	res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_status_flags = 0;
 
@@ -202,6 +212,15 @@ int nfs4_op_sequence(struct nfs_argop4 *op, compound_data_t *data,
 		    SEQ4_STATUS_CB_PATH_DOWN;
 	}
 
+	/* Ask the client to bind another connection for the back channel
+	 * when the one it had went down.
+	 */
+	if (session->cb_sec_saved &&
+	    !(atomic_fetch_uint32_t(&session->flags) & session_bc_up)) {
+		res_SEQUENCE4->SEQUENCE4res_u.sr_resok4.sr_status_flags |=
+		    SEQ4_STATUS_CB_PATH_DOWN_SESSION;
+	}
+
 	/* Remember if we are caching result and set position to cache. */
 	data->sa_cachethis = arg_SEQUENCE4->sa_cachethis;
 	data->cached_result = &slot->cached_result;
@@ -46,6 +46,8 @@
 struct nfs4_write_data {
 	WRITE4res *res_WRITE4;		/**< Results for write */
 	state_owner_t *owner;		/**< Owner of state */
+	compound_data_t *data;		/**< COMPOUND to resume, if it may
+					     suspend */
 };
 
 /**
@@ -62,6 +64,8 @@ static void nfs4_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
 	struct nfs4_write_data *data = caller_data;
 	struct fsal_io_arg *write_arg = write_data;
 	struct gsh_buffdesc verf_desc;
+	compound_data_t *compound;
+	nfsstat4 status;
 
 	/* Fixup ERR_FSAL_SHARE_DENIED status */
 	if (ret.major == ERR_FSAL_SHARE_DENIED)
@@ -98,6 +102,14 @@ done:
 
 	if (write_arg->state)
 		dec_state_t_ref(write_arg->state);
+
+	/* The arguments went with the call, the status stays in the result */
+	compound = data->data;
+	status = data->res_WRITE4->status;
+	gsh_free(data);
+
+	if (compound != NULL)
+		nfs4_op_async_done(compound, status);
 }
 
 /**
@@ -222,9 +234,8 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxWrite);
 	uint64_t MaxOffsetWrite =
 		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxOffsetWrite);
-	struct nfs4_write_data write_data;
-	struct fsal_io_arg *write_arg = alloca(sizeof(*write_arg) +
-						sizeof(struct iovec));
+	struct nfs4_write_data *write_data;
+	struct fsal_io_arg *write_arg;
 
 	/* Lock are not supported */
 	resp->resop = NFS4_OP_WRITE;
@@ -438,7 +449,13 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 		}
 	}
 
-	/* Set up args */
+	/* Set up args, they live until the callback as the FSAL may complete
+	 * the write after write2 returned.
+	 */
+	write_data = gsh_malloc(sizeof(*write_data) + sizeof(*write_arg) +
+				sizeof(struct iovec));
+	write_arg = (struct fsal_io_arg *) (write_data + 1);
+
 	write_arg->info = info;
 	write_arg->state = state_found;
 	write_arg->offset = offset;
@@ -452,11 +469,26 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 		write_arg->fsal_stable = true;
 
 
-	write_data.res_WRITE4 = res_WRITE4;
-	write_data.owner = owner;
+	write_data->res_WRITE4 = res_WRITE4;
+	write_data->owner = owner;
+	write_data->data = data;
 
 	/* Do the actual write */
-	obj->obj_ops->write2(obj, false, nfs4_write_cb, write_arg, &write_data);
+	op_ctx->async_io = true;
+	obj->obj_ops->write2(obj, false, nfs4_write_cb, write_arg, write_data);
+	op_ctx->async_io = false;
+
+	/* A callback from another thread only cleared its own copy */
+	if (owner != NULL)
+		op_ctx->clientid = NULL;
+
+	if (state_open != NULL)
+		dec_state_t_ref(state_open);
+
+	if (nfs4_op_async_suspend(data))
+		return NFS4_OP_ASYNC_WAIT;
+
+	return res_WRITE4->status;
 
  out:
 
@@ -444,31 +444,140 @@ bool pseudo_mount_export(struct gsh_export *export)
 }
 
 /**
- * @brief Build a pseudo fs from an exportlist
+ * @brief An export waiting to be mounted and its nesting depth
+ */
+
+struct pseudo_mount {
+	struct gsh_export *export;
+	int depth;
+};
+
+/**
+ * @brief Count the exports an export's pseudo path is nested under
  *
- * foreach through the exports to create pseudofs entries.
+ * The root export is not counted, so exports mounted directly on the
+ * pseudo root are at depth 0.
  *
- * @return status as errno (0 == SUCCESS).
+ * @param export [IN] export in question
+ *
+ * @return the nesting depth.
  */
 
-void create_pseudofs(void)
+int pseudo_mount_depth(struct gsh_export *export)
+{
+	struct gsh_export *parent;
+	char *path = gsh_strdup(export->pseudopath);
+	char *slash;
+	int depth = 0;
+
+	while ((slash = strrchr(path, '/')) != NULL && slash != path) {
+		*slash = '\0';
+
+		parent = get_gsh_export_by_pseudo(path, false);
+		if (parent == NULL)
+			break;
+
+		if (parent->pseudopath[1] == '\0') {
+			put_gsh_export(parent);
+			break;
+		}
+
+		depth++;
+		path[strlen(parent->pseudopath)] = '\0';
+		put_gsh_export(parent);
+	}
+
+	gsh_free(path);
+	return depth;
+}
+
+static int pseudo_mount_cmpf(const void *a, const void *b)
+{
+	const struct pseudo_mount *lk = a, *rk = b;
+
+	if (lk->depth != rk->depth)
+		return lk->depth < rk->depth ? -1 : 1;
+
+	return 0;
+}
+
+static void pseudo_mount_cb(struct gsh_export *export, void *state)
 {
 	struct root_op_context root_op_context;
-	struct gsh_export *export;
+	struct timespec start, end;
 
 	/* Initialize a root context */
 	init_root_op_context(&root_op_context, NULL, NULL,
 			     NFS_V4, 0, NFS_REQUEST);
 
+	now(&start);
+	if (!pseudo_mount_export(export))
+		LogFatal(COMPONENT_EXPORT,
+			 "Could not complete creating PseudoFS");
+	now(&end);
+
+	release_root_op_context();
+
+	LogInfo(COMPONENT_EXPORT,
+		"Export %d mounted on %s in %" PRIu64 " ms",
+		export->export_id, export->pseudopath,
+		timespec_diff(&start, &end) / NS_PER_MSEC);
+}
+
+/**
+ * @brief Build a pseudo fs from an exportlist
+ *
+ * foreach through the exports to create pseudofs entries.  Exports are
+ * mounted in parallel, a wave per nesting depth, so an export is only
+ * mounted once every export its pseudo path is nested under is.
+ *
+ * @return status as errno (0 == SUCCESS).
+ */
+
+void create_pseudofs(void)
+{
+	struct pseudo_mount *work = NULL;
+	struct gsh_export **wave;
+	struct gsh_export *export;
+	struct timespec start, end;
+	uint32_t count = 0, size = 0;
+	uint32_t i, j;
+
+	now(&start);
+
 	while (true) {
 		export = export_take_mount_work();
 		if (export == NULL)
 			break;
-		if (!pseudo_mount_export(export))
-			LogFatal(COMPONENT_EXPORT,
-				 "Could not complete creating PseudoFS");
+
+		if (count == size) {
+			size = size ? size * 2 : 64;
+			work = gsh_realloc(work, size * sizeof(*work));
+		}
+
+		work[count].export = export;
+		work[count].depth = pseudo_mount_depth(export);
+		count++;
 	}
-	release_root_op_context();
+
+	qsort(work, count, sizeof(*work), pseudo_mount_cmpf);
+
+	wave = gsh_calloc(count ? count : 1, sizeof(*wave));
+
+	for (i = 0; i < count; i = j) {
+		for (j = i; j < count && work[j].depth == work[i].depth; j++)
+			wave[j - i] = work[j].export;
+
+		foreach_gsh_export_parallel(wave, j - i, pseudo_mount_cb, NULL);
+	}
+
+	gsh_free(wave);
+	gsh_free(work);
+
+	now(&end);
+	LogEvent(COMPONENT_EXPORT,
+		 "Mounted %u exports in the PseudoFS in %" PRIu64 " ms",
+		 count, timespec_diff(&start, &end) / NS_PER_MSEC);
 }
 
 /**
@@ -105,6 +105,9 @@ void nfs_SetPostOpAttr(struct fsal_obj_handle *obj,
  * This function Converts FSAL Attributes to NFSv3 PreOp Attributes
  * structure.
  *
+ * With Cached_Pre_Op_Attrs, only attributes the cache holds are used,
+ * and none follow if it would have to fetch them.
+ *
  * @param[in]  obj   FSAL object
  * @param[out] attr  NFSv3 PreOp structure attributes.
  */
@@ -116,9 +119,12 @@ void nfs_SetPreOpAttr(struct fsal_obj_handle *obj, pre_op_attr *attr)
 
 	fsal_prepare_attrs(&attrs, ATTR_SIZE | ATTR_CTIME | ATTR_MTIME);
 
+	if (nfs_param.core_param.cached_pre_op_attrs)
+		attrs.request_mask |= ATTR_CACHED_ONLY;
+
 	status = obj->obj_ops->getattrs(obj, &attrs);
 
-	if (FSAL_IS_ERROR(status))
+	if (FSAL_IS_ERROR(status) || attrs.valid_mask == ATTR_RDATTR_ERR)
 		attr->attributes_follow = false;
 	else {
 		attr->pre_op_attr_u.attributes.size =
@@ -407,36 +413,42 @@ static fattr_xdr_result decode_supported_attrs(XDR *xdr,
  * FATTR4_TYPE
  */
 
-static fattr_xdr_result encode_type(XDR *xdr, struct xdr_attrs_args *args)
+/**
+ * @brief Map an FSAL object type to its NFSv4 type
+ *
+ * @param[in] type  FSAL object type
+ *
+ * @return The nfs_ftype4, 0 for a type NFSv4 has no name for.
+ */
+static inline uint32_t nfs4_ftype(object_file_type_t type)
 {
-	uint32_t file_type;
-
-	switch (args->attrs->type) {
+	switch (type) {
 	case REGULAR_FILE:
 	case EXTENDED_ATTR:
-		file_type = NF4REG;	/* Regular file */
-		break;
+		return NF4REG;	/* Regular file */
 	case DIRECTORY:
-		file_type = NF4DIR;	/* Directory */
-		break;
+		return NF4DIR;	/* Directory */
 	case BLOCK_FILE:
-		file_type = NF4BLK;	/* Special File - block device */
-		break;
+		return NF4BLK;	/* Special File - block device */
 	case CHARACTER_FILE:
-		file_type = NF4CHR;	/* Special File - character device */
-		break;
+		return NF4CHR;	/* Special File - character device */
 	case SYMBOLIC_LINK:
-		file_type = NF4LNK;	/* Symbolic Link */
-		break;
+		return NF4LNK;	/* Symbolic Link */
 	case SOCKET_FILE:
-		file_type = NF4SOCK;	/* Special File - socket */
-		break;
+		return NF4SOCK;	/* Special File - socket */
 	case FIFO_FILE:
-		file_type = NF4FIFO;	/* Special File - fifo */
-		break;
+		return NF4FIFO;	/* Special File - fifo */
 	default:		/* includes NO_FILE_TYPE & FS_JUNCTION: */
+		return 0;
+	}
+}
+
+static fattr_xdr_result encode_type(XDR *xdr, struct xdr_attrs_args *args)
+{
+	uint32_t file_type = nfs4_ftype(args->attrs->type);
+
+	if (file_type == 0)
 		return FATTR_XDR_FAILED;	/* silently skip bogus? */
-	}			/* switch( pattr->type ) */
 	if (!xdr_u_int32_t(xdr, &file_type))
 		return FATTR_XDR_FAILED;
 	return FATTR_XDR_SUCCESS;
@@ -626,18 +638,23 @@ static fattr_xdr_result decode_namedattrsupport(XDR *xdr,
  * FATTR4_FSID
  */
 
-static fattr_xdr_result encode_fsid(XDR *xdr, struct xdr_attrs_args *args)
+static inline void nfs4_fsid(struct xdr_attrs_args *args, fsid4 *fsid)
 {
-	fsid4 fsid = {0, 0};
-
 	if (args->data != NULL &&
 	    op_ctx_export_has_option_set(EXPORT_OPTION_FSID_SET)) {
-		fsid.major = op_ctx->ctx_export->filesystem_id.major;
-		fsid.minor = op_ctx->ctx_export->filesystem_id.minor;
+		fsid->major = op_ctx->ctx_export->filesystem_id.major;
+		fsid->minor = op_ctx->ctx_export->filesystem_id.minor;
 	} else {
-		fsid.major = args->fsid.major;
-		fsid.minor = args->fsid.minor;
+		fsid->major = args->fsid.major;
+		fsid->minor = args->fsid.minor;
 	}
+}
+
+static fattr_xdr_result encode_fsid(XDR *xdr, struct xdr_attrs_args *args)
+{
+	fsid4 fsid = {0, 0};
+
+	nfs4_fsid(args, &fsid);
 	LogDebug(COMPONENT_NFS_V4,
 		 "fsid.major = %"PRIu64", fsid.minor = %"PRIu64,
 		 fsid.major, fsid.minor);
@@ -3603,10 +3620,204 @@ int nfs4_Fattr_Fill_Error(compound_data_t *data, fattr4 *Fattr,
 	return nfs4_FSALattr_To_Fattr(args, &restricted_attrmask, Fattr);
 }
 
+/**
+ * @brief Size of an attribute the plan encodes with straight stores
+ *
+ * These are the fixed size attributes whose value is taken straight
+ * from the arguments, which covers what ls -l asks for apart from
+ * owner and owner_group.
+ *
+ * @param[in] attr  Attribute number
+ *
+ * @return Encoded size in bytes, 0 if it goes through fattr4tab.
+ */
+static inline uint32_t fattr4_fixed_size(int attr)
+{
+	switch (attr) {
+	case FATTR4_TYPE:
+	case FATTR4_MODE:
+	case FATTR4_NUMLINKS:
+	case FATTR4_RDATTR_ERROR:
+		return BYTES_PER_XDR_UNIT;
+	case FATTR4_CHANGE:
+	case FATTR4_SIZE:
+	case FATTR4_FILEID:
+	case FATTR4_RAWDEV:
+	case FATTR4_SPACE_USED:
+	case FATTR4_MOUNTED_ON_FILEID:
+		return 2 * BYTES_PER_XDR_UNIT;
+	case FATTR4_TIME_ACCESS:
+	case FATTR4_TIME_METADATA:
+	case FATTR4_TIME_MODIFY:
+		return 3 * BYTES_PER_XDR_UNIT;
+	case FATTR4_FSID:
+		return 4 * BYTES_PER_XDR_UNIT;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * @brief Compile a requested attrmask into an encode plan
+ *
+ * @param[out] plan          The plan
+ * @param[in]  Bitmap        Requested attributes
+ * @param[in]  max_attr_idx  Highest attribute of the minor version
+ */
+static void nfs4_Fattr_Plan_Compile(struct fattr4_plan *plan,
+				    struct bitmap4 *Bitmap, int max_attr_idx)
+{
+	int attr, run = -1;
+	uint32_t size;
+
+	memset(plan, 0, sizeof(*plan));
+	plan->request.bitmap4_len = MIN(Bitmap->bitmap4_len, BITMAP4_MAPLEN);
+	memcpy(plan->request.map, Bitmap->map,
+	       plan->request.bitmap4_len * sizeof(uint32_t));
+
+	for (attr = next_attr_from_bitmap(Bitmap, -1);
+	     attr != -1 && attr <= max_attr_idx;
+	     attr = next_attr_from_bitmap(Bitmap, attr)) {
+		size = fattr4_fixed_size(attr);
+		if (size == 0) {
+			run = -1;
+		} else {
+			if (run == -1)
+				run = plan->nattrs;
+			plan->run_cnt[run]++;
+			plan->run_len[run] += size;
+		}
+		plan->attrs[plan->nattrs++] = attr;
+	}
+
+	plan->valid = true;
+}
+
+/**
+ * @brief Find the plan for a requested attrmask
+ *
+ * The plan of a COMPOUND is kept in its compound data and only
+ * compiled again when an operation asks for a different attrmask.
+ *
+ * @param[in]  args    XDR attribute arguments
+ * @param[in]  Bitmap  Requested attributes
+ * @param[out] local   Plan to use when there is no compound
+ *
+ * @return The plan.
+ */
+static const struct fattr4_plan *nfs4_Fattr_Plan(struct xdr_attrs_args *args,
+						 struct bitmap4 *Bitmap,
+						 struct fattr4_plan *local)
+{
+	struct fattr4_plan *plan = local;
+	u_int len = MIN(Bitmap->bitmap4_len, BITMAP4_MAPLEN);
+
+	if (args->data != NULL) {
+		plan = &args->data->fattr_plan;
+		if (plan->valid && plan->request.bitmap4_len == len &&
+		    memcmp(plan->request.map, Bitmap->map,
+			   len * sizeof(uint32_t)) == 0)
+			return plan;
+	}
+
+	nfs4_Fattr_Plan_Compile(plan, Bitmap, nfs4_max_attr_index(args->data));
+	return plan;
+}
+
+static inline int32_t *fattr4_put_u64(int32_t *buf, uint64_t val)
+{
+	IXDR_PUT_U_INT32(buf, (uint32_t) (val >> 32));
+	IXDR_PUT_U_INT32(buf, (uint32_t) val);
+	return buf;
+}
+
+static inline int32_t *fattr4_put_time(int32_t *buf, struct timespec *ts)
+{
+	buf = fattr4_put_u64(buf, ts->tv_sec);
+	IXDR_PUT_U_INT32(buf, (uint32_t) ts->tv_nsec);
+	return buf;
+}
+
+/**
+ * @brief Encode a run of fixed size attributes
+ *
+ * @param[in] buf    Space reserved for the run
+ * @param[in] attrs  Attributes of the run
+ * @param[in] count  Number of attributes
+ * @param[in] args   XDR attribute arguments
+ *
+ * @return true if successful.
+ */
+static bool fattr4_encode_fixed(int32_t *buf, const uint8_t *attrs, int count,
+				struct xdr_attrs_args *args)
+{
+	struct attrlist *attrs_in = args->attrs;
+	fsid4 fsid;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		switch (attrs[i]) {
+		case FATTR4_TYPE:
+			if (nfs4_ftype(attrs_in->type) == 0)
+				return false;
+			IXDR_PUT_U_INT32(buf, nfs4_ftype(attrs_in->type));
+			break;
+		case FATTR4_CHANGE:
+			buf = fattr4_put_u64(buf, attrs_in->change);
+			break;
+		case FATTR4_SIZE:
+			buf = fattr4_put_u64(buf, attrs_in->filesize);
+			break;
+		case FATTR4_FSID:
+			nfs4_fsid(args, &fsid);
+			buf = fattr4_put_u64(buf, fsid.major);
+			buf = fattr4_put_u64(buf, fsid.minor);
+			break;
+		case FATTR4_RDATTR_ERROR:
+			IXDR_PUT_U_INT32(buf, args->rdattr_error);
+			break;
+		case FATTR4_FILEID:
+			buf = fattr4_put_u64(buf, args->fileid);
+			break;
+		case FATTR4_MODE:
+			IXDR_PUT_U_INT32(buf, fsal2unix_mode(attrs_in->mode));
+			break;
+		case FATTR4_NUMLINKS:
+			IXDR_PUT_U_INT32(buf, attrs_in->numlinks);
+			break;
+		case FATTR4_RAWDEV:
+			IXDR_PUT_U_INT32(buf, attrs_in->rawdev.major);
+			IXDR_PUT_U_INT32(buf, attrs_in->rawdev.minor);
+			break;
+		case FATTR4_SPACE_USED:
+			buf = fattr4_put_u64(buf, attrs_in->spaceused);
+			break;
+		case FATTR4_TIME_ACCESS:
+			buf = fattr4_put_time(buf, &attrs_in->atime);
+			break;
+		case FATTR4_TIME_METADATA:
+			buf = fattr4_put_time(buf, &attrs_in->ctime);
+			break;
+		case FATTR4_TIME_MODIFY:
+			buf = fattr4_put_time(buf, &attrs_in->mtime);
+			break;
+		case FATTR4_MOUNTED_ON_FILEID:
+			buf = fattr4_put_u64(buf, args->mounted_on_fileid);
+			break;
+		default:
+			return false;
+		}
+	}
+
+	return true;
+}
+
 /**
  * @brief Converts FSAL Attributes to NFSv4 Fattr buffer.
  *
- * Converts FSAL Attributes to NFSv4 Fattr buffer.
+ * Converts FSAL Attributes to NFSv4 Fattr buffer.  The requested
+ * attributes are compiled into a plan once per COMPOUND, see
+ * nfs4_Fattr_Plan().
  *
  * @param[in]  args    XDR attribute arguments
  * @param[in]  Bitmap  Bitmap of attributes being requested
@@ -3623,12 +3834,15 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 			   fattr4 *Fattr)
 {
 	int attribute_to_set = 0;
-	int max_attr_idx;
 	u_int LastOffset;
 	fsal_dynamicfsinfo_t dynamicinfo;
 	XDR attr_body;
 	fattr_xdr_result xdr_res;
 	uint32_t attrvals_buflen;
+	struct fattr4_plan local_plan;
+	const struct fattr4_plan *plan;
+	int32_t *buf;
+	int i, j;
 
 	/* basic init */
 	memset(Fattr, 0, sizeof(*Fattr));
@@ -3649,11 +3863,13 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 	if (attrvals_buflen > nfs_param.core_param.rpc.max_send_buffer_size)
 		attrvals_buflen = nfs_param.core_param.rpc.max_send_buffer_size;
 
-	Fattr->attr_vals.attrlist4_val = gsh_malloc(attrvals_buflen);
+	if (args->arena != NULL)
+		Fattr->attr_vals.attrlist4_val =
+			arena_reserve(args->arena, attrvals_buflen);
+	else
+		Fattr->attr_vals.attrlist4_val = gsh_malloc(attrvals_buflen);
 
-	max_attr_idx = nfs4_max_attr_index(args->data);
-	LogFullDebug(COMPONENT_NFS_V4, "Maximum allowed attr index = %d",
-		 max_attr_idx);
+	plan = nfs4_Fattr_Plan(args, Bitmap, &local_plan);
 
 	LastOffset = 0;
 	memset(&attr_body, 0, sizeof(attr_body));
@@ -3663,12 +3879,31 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 	if (args->dynamicinfo == NULL)
 		args->dynamicinfo = &dynamicinfo;
 
-	for (attribute_to_set = next_attr_from_bitmap(Bitmap, -1);
-	     attribute_to_set != -1;
-	     attribute_to_set =
-	     next_attr_from_bitmap(Bitmap, attribute_to_set)) {
-		if (attribute_to_set > max_attr_idx)
-			break;	/* skip out of bounds */
+	for (i = 0; i < plan->nattrs; i++) {
+		attribute_to_set = plan->attrs[i];
+
+		if (plan->run_cnt[i] != 0) {
+			/* Fall back to fattr4tab if the run doesn't fit */
+			buf = xdr_inline_encode(&attr_body, plan->run_len[i]);
+		} else {
+			buf = NULL;
+		}
+
+		if (buf != NULL) {
+			if (!fattr4_encode_fixed(buf, &plan->attrs[i],
+						 plan->run_cnt[i], args)) {
+				LogEvent(COMPONENT_NFS_V4,
+					 "Encode FAILED for attr %d, name = %s",
+					 attribute_to_set,
+					 fattr4tab[attribute_to_set].name);
+				goto err;
+			}
+			for (j = 0; j < plan->run_cnt[i]; j++)
+				set_attribute_in_bitmap(&Fattr->attrmask,
+							plan->attrs[i + j]);
+			i += plan->run_cnt[i] - 1;
+			continue;
+		}
 
 		xdr_res = fattr4tab[attribute_to_set].encode(&attr_body, args);
 		if (xdr_res == FATTR_XDR_SUCCESS) {
@@ -3701,14 +3936,24 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 
 	if (LastOffset == 0) {	/* no supported attrs so we can free */
 		assert(Fattr->attrmask.bitmap4_len == 0);
-		gsh_free(Fattr->attr_vals.attrlist4_val);
+		if (args->arena == NULL)
+			gsh_free(Fattr->attr_vals.attrlist4_val);
 		Fattr->attr_vals.attrlist4_val = NULL;
+	} else if (args->arena != NULL) {
+		/* Only keep what was used of the room reserved */
+		arena_commit(args->arena, LastOffset);
 	}
 	Fattr->attr_vals.attrlist4_len = LastOffset;
 	return 0;
 
  err:
-	nfs4_Fattr_Free(Fattr);
+	if (args->arena != NULL) {
+		/* Nothing was committed, just drop the room */
+		Fattr->attr_vals.attrlist4_val = NULL;
+		Fattr->attr_vals.attrlist4_len = 0;
+	} else {
+		nfs4_Fattr_Free(Fattr);
+	}
 	return -1;
 }
 
@@ -4436,6 +4681,27 @@ int nfs4_Fattr_To_FSAL_attr(struct attrlist *FSAL_attr, fattr4 *Fattr,
 	return Fattr4_To_FSAL_attr(FSAL_attr, Fattr, NULL, NULL, data);
 }
 
+/**
+ * @brief Convert NFSv4 attributes to FSAL ones and the filehandle
+ *
+ * As nfs4_Fattr_To_FSAL_attr, also decoding FATTR4_FILEHANDLE.
+ *
+ * @param[out]    FSAL_attr Converted attributes
+ * @param[in]     Fattr     NFSv4 attributes
+ * @param[in,out] hdl4      nfs_fh4_val points to NFS4_FHSIZE bytes,
+ *                          nfs_fh4_len is left alone when the
+ *                          filehandle isn't in Fattr
+ * @param[in]     data      NFSv4 compound request's data
+ *
+ * @return NFS4_OK if successful, NFS4ERR codes if not.
+ */
+int nfs4_Fattr_To_FSAL_attr_fh(struct attrlist *FSAL_attr, fattr4 *Fattr,
+			       nfs_fh4 *hdl4, compound_data_t *data)
+{
+	memset(FSAL_attr, 0, sizeof(struct attrlist));
+	return Fattr4_To_FSAL_attr(FSAL_attr, Fattr, hdl4, NULL, data);
+}
+
 /**
  *
  * nfs4_Fattr_To_fsinfo: Decode filesystem info out of NFSv4 attributes.
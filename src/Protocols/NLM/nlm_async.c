@@ -34,6 +34,7 @@
 #include "sal_functions.h"
 #include "nlm_util.h"
 #include "nlm_async.h"
+#include "gsh_list.h"
 
 pthread_mutex_t nlm_async_resp_mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t nlm_async_resp_cond = PTHREAD_COND_INITIALIZER;
@@ -111,6 +112,277 @@ static void *resp_key;
 static const int MAX_ASYNC_RETRY = 2;
 static const struct timespec tout = { 0, 0 }; /* one-shot */
 
+/**
+ * @brief A cached callback handle to a client
+ *
+ * NLM clients come and go with their locks, so the handles used for
+ * the asynchronous responses and GRANTED callbacks are kept here,
+ * keyed by caller name, transport and local address, and outlive
+ * them.  After a reboot thousands of clients reclaim at once and each
+ * would otherwise pay for a portmapper query and a new connection on
+ * every response.
+ *
+ * A host whose handle could not be set up is remembered for
+ * NLM_ASYNC_NEGATIVE_TIME seconds, during which sends to it fail
+ * right away instead of holding a thread on the portmapper and
+ * resolver timeouts.  Handles unused for NLM_ASYNC_IDLE_TIME seconds
+ * are closed the next time their bucket is searched.
+ */
+
+struct nlm_async_clnt {
+	struct glist_head node;		/*< Bucket list */
+	char *caller_name;
+	xprt_type_t client_type;
+	struct sockaddr_storage server_addr;
+	pthread_mutex_t lock;		/*< Serializes use of clnt */
+	CLIENT *clnt;
+	AUTH *auth;
+	time_t last_used;
+	time_t failed;			/*< Last set up failure, 0 if none */
+	int32_t users;			/*< Protected by the bucket lock */
+};
+
+#define NLM_ASYNC_BUCKETS 127
+#define NLM_ASYNC_NEGATIVE_TIME 30
+#define NLM_ASYNC_IDLE_TIME 600
+
+static struct nlm_async_bucket {
+	pthread_mutex_t lock;
+	struct glist_head list;
+} nlm_async_clnts[NLM_ASYNC_BUCKETS];
+
+static pthread_once_t nlm_async_once = PTHREAD_ONCE_INIT;
+
+static void nlm_async_clnts_init(void)
+{
+	int i;
+
+	for (i = 0; i < NLM_ASYNC_BUCKETS; i++) {
+		PTHREAD_MUTEX_init(&nlm_async_clnts[i].lock, NULL);
+		glist_init(&nlm_async_clnts[i].list);
+	}
+}
+
+static void nlm_async_clnt_free(struct nlm_async_clnt *ac)
+{
+	LogFullDebug(COMPONENT_NLM, "Closing NLM async handle to %s",
+		     ac->caller_name);
+
+	if (ac->clnt != NULL)
+		CLNT_DESTROY(ac->clnt);
+	PTHREAD_MUTEX_destroy(&ac->lock);
+	gsh_free(ac->caller_name);
+	gsh_free(ac);
+}
+
+static struct nlm_async_bucket *nlm_async_bucket(const char *caller_name,
+						 xprt_type_t client_type)
+{
+	uint32_t hash = client_type;
+	const unsigned char *c;
+
+	for (c = (const unsigned char *)caller_name; *c != '\0'; c++)
+		hash = hash * 31 + *c;
+
+	return &nlm_async_clnts[hash % NLM_ASYNC_BUCKETS];
+}
+
+/**
+ * @brief Find or create the cached handle entry for a client
+ *
+ * The entry is returned with a user reference, drop it with
+ * nlm_async_clnt_put().
+ *
+ * @param[in] host The NLM client to send to
+ *
+ * @return The entry.
+ */
+
+static struct nlm_async_clnt *nlm_async_clnt_get(state_nlm_client_t *host)
+{
+	char *caller_name = host->slc_nsm_client->ssc_nlm_caller_name;
+	struct nlm_async_bucket *bucket;
+	struct nlm_async_clnt *ac, *found = NULL;
+	struct glist_head *glist, *glistn;
+	time_t now = time(NULL);
+
+	pthread_once(&nlm_async_once, nlm_async_clnts_init);
+
+	bucket = nlm_async_bucket(caller_name, host->slc_client_type);
+
+	PTHREAD_MUTEX_lock(&bucket->lock);
+
+	glist_for_each_safe(glist, glistn, &bucket->list) {
+		ac = glist_entry(glist, struct nlm_async_clnt, node);
+
+		if (found == NULL &&
+		    ac->client_type == host->slc_client_type &&
+		    memcmp(&ac->server_addr, &host->slc_server_addr,
+			   sizeof(ac->server_addr)) == 0 &&
+		    strcmp(ac->caller_name, caller_name) == 0) {
+			found = ac;
+			continue;
+		}
+
+		if (ac->users == 0 &&
+		    now - ac->last_used > NLM_ASYNC_IDLE_TIME) {
+			glist_del(&ac->node);
+			nlm_async_clnt_free(ac);
+		}
+	}
+
+	if (found == NULL) {
+		found = gsh_calloc(1, sizeof(*found));
+		found->caller_name = gsh_strdup(caller_name);
+		found->client_type = host->slc_client_type;
+		memcpy(&found->server_addr, &host->slc_server_addr,
+		       sizeof(found->server_addr));
+		PTHREAD_MUTEX_init(&found->lock, NULL);
+		glist_add_tail(&bucket->list, &found->node);
+	}
+
+	found->users++;
+	found->last_used = now;
+
+	PTHREAD_MUTEX_unlock(&bucket->lock);
+
+	return found;
+}
+
+static void nlm_async_clnt_put(struct nlm_async_clnt *ac)
+{
+	struct nlm_async_bucket *bucket;
+
+	bucket = nlm_async_bucket(ac->caller_name, ac->client_type);
+
+	PTHREAD_MUTEX_lock(&bucket->lock);
+	ac->users--;
+	ac->last_used = time(NULL);
+	PTHREAD_MUTEX_unlock(&bucket->lock);
+}
+
+/**
+ * @brief Set up the callback handle of a cached entry
+ *
+ * Called with ac->lock held.
+ *
+ * @param[in] ac The entry
+ *
+ * @retval 0 on success.
+ * @retval RPC_UNKNOWNADDR if resolving the name failed in a way worth
+ *         retrying.
+ * @retval -1 on other failures.
+ */
+
+static int nlm_async_clnt_create(struct nlm_async_clnt *ac)
+{
+	char *caller_name = ac->caller_name;
+	const char *client_type_str = xprt_type_to_str(ac->client_type);
+	int retval;
+
+	LogFullDebug(COMPONENT_NLM, "clnt_ncreate %s", caller_name);
+
+	if (ac->client_type == XPRT_TCP) {
+		int fd;
+		struct sockaddr_in6 server_addr;
+		struct netbuf *buf, local_buf;
+		struct addrinfo *result;
+		struct addrinfo hints;
+		char port_str[20];
+
+		fd = socket(PF_INET6, SOCK_STREAM, IPPROTO_TCP);
+		if (fd < 0)
+			return -1;
+
+		memcpy(&server_addr, &ac->server_addr,
+		       sizeof(struct sockaddr_in6));
+		server_addr.sin6_port = 0;
+
+		if (bind(fd, (struct sockaddr *)&server_addr,
+			 sizeof(server_addr)) == -1) {
+			LogMajor(COMPONENT_NLM, "Cannot bind");
+			close(fd);
+			return -1;
+		}
+
+		buf = rpcb_find_mapped_addr((char *) client_type_str,
+					    NLMPROG, NLM4_VERS,
+					    caller_name);
+		/* handle error here, for example,
+		 * client side blocking rpc call
+		 */
+		if (buf == NULL) {
+			LogMajor(COMPONENT_NLM,
+				 "Cannot create NLM async %s connection to client %s",
+				 client_type_str, caller_name);
+			close(fd);
+			return -1;
+		}
+
+		memset(&hints, 0, sizeof(struct addrinfo));
+		hints.ai_family = AF_INET6;	/* only INET6 */
+		hints.ai_socktype = SOCK_STREAM; /* TCP */
+		hints.ai_protocol = 0;	/* Any protocol */
+		hints.ai_canonname = NULL;
+		hints.ai_addr = NULL;
+		hints.ai_next = NULL;
+
+		/* convert port to string format */
+		sprintf(port_str, "%d",
+			htons(((struct sockaddr_in *)buf->buf)->sin_port));
+
+		/* buf with inet is only needed for the port */
+		gsh_free(buf->buf);
+		gsh_free(buf);
+
+		/* get the IPv4 mapped IPv6 address */
+		retval = getaddrinfo(caller_name, port_str, &hints, &result);
+
+		/* retry for spurious EAI_NONAME errors */
+		if (retval == EAI_NONAME || retval == EAI_AGAIN) {
+			LogEvent(COMPONENT_NLM,
+				 "failed to resolve %s to an address: %s",
+				 caller_name, gai_strerror(retval));
+			close(fd);
+			return RPC_UNKNOWNADDR;
+		} else if (retval != 0) {
+			LogMajor(COMPONENT_NLM,
+				 "failed to resolve %s to an address: %s",
+				 caller_name, gai_strerror(retval));
+			close(fd);
+			return -1;
+		}
+
+		/* setup the netbuf with in6 address */
+		local_buf.buf = result->ai_addr;
+		local_buf.len = local_buf.maxlen = result->ai_addrlen;
+
+		ac->clnt = clnt_vc_ncreate(fd, &local_buf, NLMPROG,
+					   NLM4_VERS, 0, 0);
+		freeaddrinfo(result);
+	} else {
+		ac->clnt = clnt_ncreate(caller_name, NLMPROG, NLM4_VERS,
+					(char *) client_type_str);
+	}
+
+	if (CLNT_FAILURE(ac->clnt)) {
+		char *err = rpc_sperror(&ac->clnt->cl_error, "failed");
+
+		LogMajor(COMPONENT_NLM,
+			 "Create NLM async %s connection to client %s %s",
+			 client_type_str, caller_name, err);
+		gsh_free(err);
+		CLNT_DESTROY(ac->clnt);
+		ac->clnt = NULL;
+		return -1;
+	}
+
+	/* split auth (for authnone, idempotent) */
+	ac->auth = authnone_ncreate();
+
+	return 0;
+}
+
 /* Client routine  to send the asynchrnous response,
  * key is used to wait for a response
  */
@@ -120,131 +392,34 @@ int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 	char *t;
 	struct timeval start, now;
 	struct timespec timeout;
-	int retval, retry;
-	char *caller_name = host->slc_nsm_client->ssc_nlm_caller_name;
-	const char *client_type_str = xprt_type_to_str(host->slc_client_type);
+	int retval = -1, retry;
+	struct nlm_async_clnt *ac = nlm_async_clnt_get(host);
+
+	PTHREAD_MUTEX_lock(&ac->lock);
+
+	if (ac->clnt == NULL && ac->failed != 0 &&
+	    time(NULL) - ac->failed < NLM_ASYNC_NEGATIVE_TIME) {
+		LogDebug(COMPONENT_NLM,
+			 "Client %s was unreachable %ld seconds ago, not sending NLM async procedure %d",
+			 ac->caller_name, (long)(time(NULL) - ac->failed),
+			 proc);
+		PTHREAD_MUTEX_unlock(&ac->lock);
+		nlm_async_clnt_put(ac);
+		return -1;
+	}
 
 	for (retry = 0; retry < MAX_ASYNC_RETRY; retry++) {
-		if (host->slc_callback_clnt == NULL) {
-			LogFullDebug(COMPONENT_NLM,
-				     "clnt_ncreate %s",
-				     caller_name);
-
-			if (host->slc_client_type == XPRT_TCP) {
-				int fd;
-				struct sockaddr_in6 server_addr;
-				struct netbuf *buf, local_buf;
-				struct addrinfo *result;
-				struct addrinfo hints;
-				char port_str[20];
-
-				fd = socket(PF_INET6, SOCK_STREAM, IPPROTO_TCP);
-				if (fd < 0)
-					return -1;
-
-				memcpy(&server_addr,
-				       &(host->slc_server_addr),
-				       sizeof(struct sockaddr_in6));
-				server_addr.sin6_port = 0;
-
-				if (bind(fd,
-					 (struct sockaddr *)&server_addr,
-					  sizeof(server_addr)) == -1) {
-					LogMajor(COMPONENT_NLM, "Cannot bind");
-					close(fd);
-					return -1;
-				}
-
-				buf = rpcb_find_mapped_addr(
-						(char *) client_type_str,
-						NLMPROG, NLM4_VERS,
-						caller_name);
-				/* handle error here, for example,
-				 * client side blocking rpc call
-				 */
-				if (buf == NULL) {
-					LogMajor(COMPONENT_NLM,
-						 "Cannot create NLM async %s connection to client %s",
-						 client_type_str, caller_name);
-					close(fd);
-					return -1;
-				}
-
-				memset(&hints, 0, sizeof(struct addrinfo));
-				hints.ai_family = AF_INET6;	/* only INET6 */
-				hints.ai_socktype = SOCK_STREAM; /* TCP */
-				hints.ai_protocol = 0;	/* Any protocol */
-				hints.ai_canonname = NULL;
-				hints.ai_addr = NULL;
-				hints.ai_next = NULL;
-
-				/* convert port to string format */
-				sprintf(port_str, "%d",
-					htons(((struct sockaddr_in *)
-						buf->buf)->sin_port));
-
-				/* buf with inet is only needed for the port */
-				gsh_free(buf->buf);
-				gsh_free(buf);
-
-				/* get the IPv4 mapped IPv6 address */
-				retval = getaddrinfo(caller_name,
-						     port_str,
-						     &hints,
-						     &result);
-
-				/* retry for spurious EAI_NONAME errors */
-				if (retval == EAI_NONAME ||
-				    retval == EAI_AGAIN) {
-					LogEvent(COMPONENT_NLM,
-						 "failed to resolve %s to an address: %s",
-						 caller_name,
-						 gai_strerror(retval));
-					/* getaddrinfo() failed, retry */
-					retval = RPC_UNKNOWNADDR;
-					usleep(1000);
-					continue;
-				} else if (retval != 0) {
-					LogMajor(COMPONENT_NLM,
-						 "failed to resolve %s to an address: %s",
-						 caller_name,
-						 gai_strerror(retval));
-					return -1;
-				}
-
-				/* setup the netbuf with in6 address */
-				local_buf.buf = result->ai_addr;
-				local_buf.len = local_buf.maxlen =
-				    result->ai_addrlen;
-
-				host->slc_callback_clnt =
-				    clnt_vc_ncreate(fd, &local_buf, NLMPROG,
-						    NLM4_VERS, 0, 0);
-				freeaddrinfo(result);
-			} else {
-
-				host->slc_callback_clnt =
-				    clnt_ncreate(caller_name, NLMPROG,
-						 NLM4_VERS,
-						 (char *) client_type_str);
-			}
+		if (ac->clnt == NULL) {
+			retval = nlm_async_clnt_create(ac);
 
-			if (CLNT_FAILURE(host->slc_callback_clnt)) {
-				char *err = rpc_sperror(
-					&host->slc_callback_clnt->cl_error,
-					"failed");
-
-				LogMajor(COMPONENT_NLM,
-					 "Create NLM async %s connection to client %s %s",
-					 client_type_str, caller_name, err);
-				gsh_free(err);
-				CLNT_DESTROY(host->slc_callback_clnt);
-				host->slc_callback_clnt = NULL;
-				return -1;
+			if (retval == RPC_UNKNOWNADDR) {
+				/* getaddrinfo() failed, retry */
+				usleep(1000);
+				continue;
 			}
 
-			/* split auth (for authnone, idempotent) */
-			host->slc_callback_auth = authnone_ncreate();
+			if (retval != 0)
+				break;
 		}
 
 		PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
@@ -254,8 +429,7 @@ int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 		LogFullDebug(COMPONENT_NLM, "About to make clnt_call");
 
 		cc = gsh_malloc(sizeof(*cc));
-		clnt_req_fill(cc, host->slc_callback_clnt,
-			      host->slc_callback_auth, proc,
+		clnt_req_fill(cc, ac->clnt, ac->auth, proc,
 			      (xdrproc_t) nlm_reply_proc[proc], inarg,
 			      (xdrproc_t) xdr_void, NULL);
 		retval = clnt_req_setup(cc, tout);
@@ -279,20 +453,29 @@ int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 		gsh_free(t);
 
 		clnt_req_release(cc);
-		CLNT_DESTROY(host->slc_callback_clnt);
-		host->slc_callback_clnt = NULL;
+		CLNT_DESTROY(ac->clnt);
+		ac->clnt = NULL;
 	}
 
-	if (retry == MAX_ASYNC_RETRY) {
-		LogMajor(COMPONENT_NLM,
-			 "NLM async Client exceeded retry count %d",
-			 MAX_ASYNC_RETRY);
+	if (retval != RPC_SUCCESS) {
+		ac->failed = time(NULL);
+		PTHREAD_MUTEX_unlock(&ac->lock);
+		nlm_async_clnt_put(ac);
+
+		if (retry == MAX_ASYNC_RETRY)
+			LogMajor(COMPONENT_NLM,
+				 "NLM async Client exceeded retry count %d",
+				 MAX_ASYNC_RETRY);
 		PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
 		resp_key = NULL;
 		PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
 		return retval;
 	}
 
+	ac->failed = 0;
+	PTHREAD_MUTEX_unlock(&ac->lock);
+	nlm_async_clnt_put(ac);
+
 	PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
 
 	if (resp_key != NULL) {
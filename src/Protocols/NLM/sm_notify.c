@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <rpc/types.h>
 #include <rpc/nettype.h>
 #include <sys/socket.h>
@@ -12,8 +13,13 @@
 
 #define STR_SIZE 100
 
-#define USAGE "usage: %s [-p <port>] -l <local address> " \
-	"-m <monitor host> -r <remote address> -s <state>\n"
+#define USAGE "usage: %s [-p <port>] [-w <window>] -l <local address> " \
+	"-m <monitor host> {-r <remote address> ... | -f <file>} " \
+	"-s <state>\n"
+
+/* Notifications in flight at once by default */
+#define DEFAULT_WINDOW 32
+#define MAX_WINDOW 1024
 
 #define ERR_MSG1 "%s address too long\n"
 
@@ -56,24 +62,141 @@ nsm_notify_1(notify *argp, CLIENT *clnt)
 	return (void *)&clnt_res;
 }
 
-int main(int argc, char **argv)
+/* What every notification shares, set up by main() */
+static int port;
+static struct sockaddr_in local_addr;
+static notify arg;
+
+static char **remotes;
+static int nremotes;
+static int next_remote;
+static int failures;
+static pthread_mutex_t remotes_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void add_remote(const char *remote)
+{
+	if (strlen(remote) >= STR_SIZE) {
+		fprintf(stderr, ERR_MSG1, "remote address");
+		exit(1);
+	}
+
+	remotes = gsh_realloc(remotes, (nremotes + 1) * sizeof(*remotes));
+	remotes[nremotes++] = gsh_strdup(remote);
+}
+
+/* Read remote addresses from a file, one per line */
+static void read_remotes(const char *path)
+{
+	char line[STR_SIZE + 2];
+	FILE *f = fopen(path, "r");
+
+	if (f == NULL) {
+		fprintf(stderr, "cannot open %s. errno=%d\n", path, errno);
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		line[strcspn(line, " \t\r\n")] = '\0';
+		if (line[0] != '\0' && line[0] != '#')
+			add_remote(line);
+	}
+
+	fclose(f);
+}
+
+/* Send SM_NOTIFY to one remote host, each call has its own socket */
+static int notify_remote(const char *remote_addr_s)
 {
-	int c;
-	int port = 0;
-	int state = 0, sflag = 0;
-	char mon_client[STR_SIZE], mflag = 0;
-	char remote_addr_s[STR_SIZE], rflag = 0;
-	char local_addr_s[STR_SIZE], lflag = 0;
-	notify arg;
 	CLIENT *clnt;
 	struct netbuf *buf;
-	char port_str[20];
+	int fd, one = 1;
+
+	/* create a udp socket */
+	fd = socket(PF_INET, SOCK_DGRAM|SOCK_NONBLOCK, IPPROTO_UDP);
+	if (fd < 0) {
+		fprintf(stderr, "socket call failed. errno=%d\n", errno);
+		return -1;
+	}
+
+	/* with a fixed port the workers all bind to it */
+	if (port != 0 &&
+	    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+		fprintf(stderr, "setsockopt call failed. errno=%d\n", errno);
+		close(fd);
+		return -1;
+	}
+
+	if (bind(fd, (struct sockaddr *)&local_addr,
+			sizeof(struct sockaddr)) < 0) {
+		fprintf(stderr, "bind call failed. errno=%d\n", errno);
+		close(fd);
+		return -1;
+	}
+
+	/* find the port for SM service of the remote server */
+	buf = rpcb_find_mapped_addr(
+				"udp",
+				SM_PROG, SM_VERS,
+				(char *)remote_addr_s);
+
+	/* handle error here, for example,
+	 * client side blocking rpc call
+	 */
+	if (buf == NULL) {
+		fprintf(stderr, "cannot find SM service of %s\n",
+			remote_addr_s);
+		close(fd);
+		return -1;
+	}
+
+	clnt = clnt_dg_ncreate(fd, buf, SM_PROG,
+			SM_VERS, 0, 0);
+
+	nsm_notify_1(&arg, clnt);
+
+	/* free resources */
+	gsh_free(buf->buf);
+	gsh_free(buf);
+	CLNT_DESTROY(clnt);
+
+	close(fd);
+
+	return 0;
+}
+
+/* Worker of the notification window, takes remotes until none is left */
+static void *notify_thread(void *unused)
+{
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&remotes_mutex);
+		i = next_remote++;
+		pthread_mutex_unlock(&remotes_mutex);
+
+		if (i >= nremotes)
+			break;
+
+		if (notify_remote(remotes[i]) != 0) {
+			pthread_mutex_lock(&remotes_mutex);
+			failures++;
+			pthread_mutex_unlock(&remotes_mutex);
+		}
+	}
 
-	struct sockaddr_in local_addr;
+	return NULL;
+}
 
-	int fd;
+int main(int argc, char **argv)
+{
+	int c, i;
+	int state = 0, sflag = 0;
+	int window = DEFAULT_WINDOW;
+	char mon_client[STR_SIZE], mflag = 0;
+	char local_addr_s[STR_SIZE], lflag = 0;
+	pthread_t *threads;
 
-	while ((c = getopt(argc, argv, "p:r:m:l:s:")) != EOF)
+	while ((c = getopt(argc, argv, "p:r:f:m:l:s:w:")) != EOF)
 		switch (c) {
 		case 'p':
 			port = atoi(optarg);
@@ -91,12 +214,10 @@ int main(int argc, char **argv)
 			mflag = 1;
 			break;
 		case 'r':
-			if (strlen(optarg) >= STR_SIZE) {
-				fprintf(stderr, ERR_MSG1, "remote address");
-				exit(1);
-			}
-			strcpy(remote_addr_s, optarg);
-			rflag = 1;
+			add_remote(optarg);
+			break;
+		case 'f':
+			read_remotes(optarg);
 			break;
 		case 'l':
 			if (strlen(optarg) >= STR_SIZE) {
@@ -106,6 +227,14 @@ int main(int argc, char **argv)
 			strcpy(local_addr_s, optarg);
 			lflag = 1;
 			break;
+		case 'w':
+			window = atoi(optarg);
+			if (window < 1 || window > MAX_WINDOW) {
+				fprintf(stderr, "window must be 1 to %d\n",
+					MAX_WINDOW);
+				exit(1);
+			}
+			break;
 		case '?':
 		default:
 			fprintf(stderr, USAGE, argv[0]);
@@ -113,63 +242,56 @@ int main(int argc, char **argv)
 			break;
 	}
 
-	if ((sflag + lflag + mflag + rflag) != 4) {
+	if ((sflag + lflag + mflag) != 3 || nremotes == 0) {
 		fprintf(stderr, USAGE, argv[0]);
 		exit(1);
 	}
 
-
-	/* create a udp socket */
-	fd = socket(PF_INET, SOCK_DGRAM|SOCK_NONBLOCK, IPPROTO_UDP);
-	if (fd < 0) {
-		fprintf(stderr, "socket call failed. errno=%d\n", errno);
-		exit(1);
-	}
-
 	/* set up the sockaddr for local endpoint */
 	memset(&local_addr, 0, sizeof(struct sockaddr_in));
 	local_addr.sin_family = PF_INET;
 	local_addr.sin_port = htons(port);
 	local_addr.sin_addr.s_addr = inet_addr(local_addr_s);
 
-	if (bind(fd, (struct sockaddr *)&local_addr,
-			sizeof(struct sockaddr)) < 0) {
-		fprintf(stderr, "bind call failed. errno=%d\n", errno);
-		exit(1);
-	}
-
-	/* find the port for SM service of the remote server */
-	buf = rpcb_find_mapped_addr(
-				"udp",
-				SM_PROG, SM_VERS,
-				remote_addr_s);
+	arg.my_name = mon_client;
+	arg.state = state;
 
-	/* handle error here, for example,
-	 * client side blocking rpc call
+	/* A single remote is notified inline, as it always was.  With
+	 * many, a window of threads keeps that many notifications in
+	 * flight so that an unreachable client only holds up its own
+	 * worker for the call timeout.
 	 */
-	if (buf == NULL) {
-		close(fd);
-		exit(1);
-	}
+	if (window > nremotes)
+		window = nremotes;
 
-	/* convert port to string format */
-	sprintf(port_str, "%d",
-		htons(((struct sockaddr_in *)
-		buf->buf)->sin_port));
+	if (window == 1) {
+		notify_thread(NULL);
+	} else {
+		threads = gsh_calloc(window, sizeof(*threads));
 
-	clnt = clnt_dg_ncreate(fd, buf, SM_PROG,
-			SM_VERS, 0, 0);
+		for (i = 0; i < window; i++) {
+			if (pthread_create(&threads[i], NULL,
+					   notify_thread, NULL) != 0) {
+				fprintf(stderr,
+					"pthread_create failed. errno=%d\n",
+					errno);
+				break;
+			}
+		}
 
-	arg.my_name = mon_client;
-	arg.state = state;
-	nsm_notify_1(&arg, clnt);
+		/* no worker could be started, do the work here */
+		if (i == 0)
+			notify_thread(NULL);
 
-	/* free resources */
-	gsh_free(buf->buf);
-	gsh_free(buf);
-	CLNT_DESTROY(clnt);
+		while (i > 0)
+			pthread_join(threads[--i], NULL);
 
-	close(fd);
+		gsh_free(threads);
+	}
 
-	return 0;
+	for (i = 0; i < nremotes; i++)
+		gsh_free(remotes[i]);
+	gsh_free(remotes);
+
+	return failures == 0 ? 0 : 1;
 }
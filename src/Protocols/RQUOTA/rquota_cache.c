@@ -0,0 +1,505 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+/**
+ * @file rquota_cache.c
+ * @brief Cache of the quotas served by RQUOTA
+ *
+ * quota(1) on login nodes asks for the quotas of their users every
+ * few seconds, and each GETQUOTA used to be a quotactl or a scan in
+ * the FSAL.  Answers are kept here for Rquota_Cache_Time seconds,
+ * keyed by export, path, quota type and id.
+ *
+ * A background thread refreshes the entries that were asked for since
+ * they were fetched, before they expire, so a steadily polled quota is
+ * always answered from the cache.  It groups them by export, path and
+ * type and hands each group to the FSAL get_quotas method, which lets
+ * filesystems that report quotas in bulk do one pass for all the ids.
+ * Entries nobody asked for in a while are dropped.
+ *
+ * Every RQUOTA caller is served with the same credentials, so an
+ * answer cached for one is an answer any other would have got.  Only
+ * successes and ERR_FSAL_NO_QUOTA are cached.
+ */
+
+#include "config.h"
+#include <string.h>
+#include <pthread.h>
+#include <os/quota.h>		/* For USRQUOTA */
+#include "log.h"
+#include "gsh_list.h"
+#include "fsal.h"
+#include "nfs_core.h"
+#include "nfs_exports.h"
+#include "export_mgr.h"
+#include "fridgethr.h"
+#include "nfs_proto_functions.h"
+
+/** Hash buckets of the cache */
+#define RQUOTA_CACHE_BUCKETS 1021
+
+/** Cap on the number of entries, beyond that answers are not cached */
+#define RQUOTA_CACHE_MAX 65536
+
+/** Entries unused for this many cache times are dropped */
+#define RQUOTA_CACHE_IDLE 6
+
+struct rquota_cache_entry {
+	struct glist_head node;		/*< Bucket list */
+	uint16_t export_id;
+	int quota_type;
+	int quota_id;
+	fsal_status_t status;		/*< What the FSAL returned */
+	fsal_quota_t quota;
+	time_t fetched;			/*< When quota was got from the FSAL */
+	time_t used;			/*< Last time it was asked for */
+	char path[];
+};
+
+static struct rquota_cache_bucket {
+	pthread_mutex_t lock;
+	struct glist_head list;
+} rquota_cache[RQUOTA_CACHE_BUCKETS];
+
+static int32_t rquota_cache_count;
+static struct fridgethr *rquota_cache_fridge;
+
+/** An entry to refresh, copied out of the cache */
+struct rquota_refresh {
+	uint16_t export_id;
+	int quota_type;
+	int quota_id;
+	const char *path;
+};
+
+static struct rquota_cache_bucket *rquota_cache_bucket(uint16_t export_id,
+						       int quota_type,
+						       int quota_id)
+{
+	uint32_t hash = ((uint32_t)quota_id * 2654435761U) ^
+			(export_id << 2) ^ quota_type;
+
+	return &rquota_cache[hash % RQUOTA_CACHE_BUCKETS];
+}
+
+/* Called with the bucket lock held */
+static struct rquota_cache_entry *
+rquota_cache_find(struct rquota_cache_bucket *bucket, uint16_t export_id,
+		  const char *path, int quota_type, int quota_id)
+{
+	struct glist_head *glist;
+	struct rquota_cache_entry *entry;
+
+	glist_for_each(glist, &bucket->list) {
+		entry = glist_entry(glist, struct rquota_cache_entry, node);
+
+		if (entry->quota_id == quota_id &&
+		    entry->export_id == export_id &&
+		    entry->quota_type == quota_type &&
+		    strcmp(entry->path, path) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+static bool rquota_cacheable(fsal_status_t status)
+{
+	return status.major == ERR_FSAL_NO_ERROR ||
+	       status.major == ERR_FSAL_NO_QUOTA;
+}
+
+/**
+ * @brief Store what the FSAL said about a quota
+ *
+ * @param[in] export_id  Export the quota was asked on
+ * @param[in] path       Path within the export
+ * @param[in] quota_type USRQUOTA or GRPQUOTA
+ * @param[in] quota_id   Id of the quota
+ * @param[in] status     Status from the FSAL
+ * @param[in] quota      The quota, if status is a success
+ * @param[in] create     Whether to add an entry that is not cached
+ */
+
+static void rquota_cache_store(uint16_t export_id, const char *path,
+			       int quota_type, int quota_id,
+			       fsal_status_t status, const fsal_quota_t *quota,
+			       bool create)
+{
+	struct rquota_cache_bucket *bucket;
+	struct rquota_cache_entry *entry;
+	time_t now = time(NULL);
+	size_t len;
+
+	bucket = rquota_cache_bucket(export_id, quota_type, quota_id);
+
+	PTHREAD_MUTEX_lock(&bucket->lock);
+
+	entry = rquota_cache_find(bucket, export_id, path, quota_type,
+				  quota_id);
+
+	if (entry != NULL && !rquota_cacheable(status)) {
+		/* Let the next request find out for itself */
+		glist_del(&entry->node);
+		gsh_free(entry);
+		(void) atomic_dec_int32_t(&rquota_cache_count);
+		goto out;
+	}
+
+	if (entry == NULL) {
+		if (!create || !rquota_cacheable(status) ||
+		    atomic_fetch_int32_t(&rquota_cache_count) >=
+		    RQUOTA_CACHE_MAX)
+			goto out;
+
+		len = strlen(path) + 1;
+		entry = gsh_malloc(sizeof(*entry) + len);
+		entry->export_id = export_id;
+		entry->quota_type = quota_type;
+		entry->quota_id = quota_id;
+		entry->used = now;
+		memcpy(entry->path, path, len);
+		glist_add_tail(&bucket->list, &entry->node);
+		(void) atomic_inc_int32_t(&rquota_cache_count);
+	}
+
+	entry->status = status;
+	if (FSAL_IS_ERROR(status))
+		memset(&entry->quota, 0, sizeof(entry->quota));
+	else
+		entry->quota = *quota;
+	entry->fetched = now;
+
+ out:
+	PTHREAD_MUTEX_unlock(&bucket->lock);
+}
+
+/**
+ * @brief Get a quota, from the cache if it is fresh enough
+ *
+ * @param[in]  exp        Export the quota is asked on
+ * @param[in]  path       Path within the export
+ * @param[in]  quota_type USRQUOTA or GRPQUOTA
+ * @param[in]  quota_id   Id of the quota
+ * @param[out] quota      The quota
+ *
+ * @return FSAL status, as get_quota would.
+ */
+
+fsal_status_t rquota_cache_get(struct gsh_export *exp, const char *path,
+			       int quota_type, int quota_id,
+			       fsal_quota_t *quota)
+{
+	uint32_t ttl = nfs_param.core_param.rquota_cache_time;
+	struct rquota_cache_bucket *bucket;
+	struct rquota_cache_entry *entry;
+	fsal_status_t status;
+	time_t now;
+
+	if (ttl == 0)
+		goto fetch;
+
+	now = time(NULL);
+	bucket = rquota_cache_bucket(exp->export_id, quota_type, quota_id);
+
+	PTHREAD_MUTEX_lock(&bucket->lock);
+
+	entry = rquota_cache_find(bucket, exp->export_id, path, quota_type,
+				  quota_id);
+
+	if (entry != NULL) {
+		entry->used = now;
+		if (now - entry->fetched < ttl) {
+			status = entry->status;
+			*quota = entry->quota;
+			PTHREAD_MUTEX_unlock(&bucket->lock);
+
+			LogFullDebug(COMPONENT_NFSPROTO,
+				     "Quota of %d type %d on %s from cache",
+				     quota_id, quota_type, path);
+			return status;
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&bucket->lock);
+
+ fetch:
+	status = exp->fsal_export->exp_ops.get_quota(exp->fsal_export, path,
+						      quota_type, quota_id,
+						      quota);
+
+	if (ttl != 0)
+		rquota_cache_store(exp->export_id, path, quota_type, quota_id,
+				   status, quota, true);
+
+	return status;
+}
+
+/**
+ * @brief Drop a cached quota
+ *
+ * Called when a quota is set, so that the next GETQUOTA sees the new
+ * limits.
+ *
+ * @param[in] exp        Export the quota was set on
+ * @param[in] path       Path within the export
+ * @param[in] quota_type USRQUOTA or GRPQUOTA
+ * @param[in] quota_id   Id of the quota
+ */
+
+void rquota_cache_forget(struct gsh_export *exp, const char *path,
+			 int quota_type, int quota_id)
+{
+	struct rquota_cache_bucket *bucket;
+	struct rquota_cache_entry *entry;
+
+	if (nfs_param.core_param.rquota_cache_time == 0)
+		return;
+
+	bucket = rquota_cache_bucket(exp->export_id, quota_type, quota_id);
+
+	PTHREAD_MUTEX_lock(&bucket->lock);
+
+	entry = rquota_cache_find(bucket, exp->export_id, path, quota_type,
+				  quota_id);
+	if (entry != NULL) {
+		glist_del(&entry->node);
+		gsh_free(entry);
+		(void) atomic_dec_int32_t(&rquota_cache_count);
+	}
+
+	PTHREAD_MUTEX_unlock(&bucket->lock);
+}
+
+static int rquota_refresh_cmp(const void *a, const void *b)
+{
+	const struct rquota_refresh *ra = a, *rb = b;
+	int rc;
+
+	if (ra->export_id != rb->export_id)
+		return ra->export_id < rb->export_id ? -1 : 1;
+
+	rc = strcmp(ra->path, rb->path);
+	if (rc != 0)
+		return rc;
+
+	return ra->quota_type - rb->quota_type;
+}
+
+/**
+ * @brief Refresh a run of entries of one export, path and type
+ *
+ * @param[in] refresh The entries
+ * @param[in] count   How many there are
+ */
+
+static void rquota_refresh_group(struct rquota_refresh *refresh,
+				 uint32_t count)
+{
+	struct root_op_context root_op_context;
+	struct gsh_export *exp;
+	fsal_quota_t *quotas;
+	fsal_status_t *statuses, status;
+	int *ids;
+	uint32_t i;
+
+	exp = get_gsh_export(refresh->export_id);
+	if (exp == NULL)
+		return;
+
+	ids = gsh_malloc(count * sizeof(*ids));
+	quotas = gsh_calloc(count, sizeof(*quotas));
+	statuses = gsh_malloc(count * sizeof(*statuses));
+
+	for (i = 0; i < count; i++)
+		ids[i] = refresh[i].quota_id;
+
+	init_root_op_context(&root_op_context, exp, exp->fsal_export,
+			     0, 0, UNKNOWN_REQUEST);
+
+	status = exp->fsal_export->exp_ops.get_quotas(exp->fsal_export,
+						       refresh->path,
+						       refresh->quota_type,
+						       count, ids, quotas,
+						       statuses);
+
+	release_root_op_context();
+
+	if (FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_NFSPROTO,
+			 "Refreshing %" PRIu32 " quotas on %s failed: %s",
+			 count, refresh->path, msg_fsal_err(status.major));
+	} else {
+		for (i = 0; i < count; i++)
+			rquota_cache_store(refresh->export_id, refresh->path,
+					   refresh->quota_type, ids[i],
+					   statuses[i], &quotas[i], false);
+	}
+
+	put_gsh_export(exp);
+	gsh_free(ids);
+	gsh_free(quotas);
+	gsh_free(statuses);
+}
+
+/**
+ * @brief Refresh the cached quotas that are still asked for
+ *
+ * @param[in] ctx Fridge context
+ */
+
+static void rquota_cache_run(struct fridgethr_context *ctx)
+{
+	uint32_t ttl = nfs_param.core_param.rquota_cache_time;
+	struct rquota_refresh *refresh = NULL;
+	uint32_t nrefresh = 0, size = 0, i, first;
+	struct glist_head *glist, *glistn;
+	struct rquota_cache_entry *entry;
+	time_t now = time(NULL);
+	int b;
+
+	SetNameFunction("rquota_cache");
+
+	for (b = 0; b < RQUOTA_CACHE_BUCKETS; b++) {
+		struct rquota_cache_bucket *bucket = &rquota_cache[b];
+
+		PTHREAD_MUTEX_lock(&bucket->lock);
+
+		glist_for_each_safe(glist, glistn, &bucket->list) {
+			entry = glist_entry(glist, struct rquota_cache_entry,
+					    node);
+
+			if (now - entry->used > RQUOTA_CACHE_IDLE * ttl) {
+				glist_del(&entry->node);
+				gsh_free(entry);
+				(void) atomic_dec_int32_t(&rquota_cache_count);
+				continue;
+			}
+
+			/* Refresh what was asked for since it was fetched,
+			 * once it is past half its life.
+			 */
+			if (entry->used <= entry->fetched ||
+			    2 * (now - entry->fetched) < ttl)
+				continue;
+
+			if (nrefresh == size) {
+				size = size == 0 ? 64 : size * 2;
+				refresh = gsh_realloc(refresh,
+						      size * sizeof(*refresh));
+			}
+
+			refresh[nrefresh].export_id = entry->export_id;
+			refresh[nrefresh].quota_type = entry->quota_type;
+			refresh[nrefresh].quota_id = entry->quota_id;
+			refresh[nrefresh].path = gsh_strdup(entry->path);
+			nrefresh++;
+		}
+
+		PTHREAD_MUTEX_unlock(&bucket->lock);
+	}
+
+	if (nrefresh == 0)
+		return;
+
+	qsort(refresh, nrefresh, sizeof(*refresh), rquota_refresh_cmp);
+
+	for (first = 0, i = 1; i <= nrefresh; i++) {
+		if (i < nrefresh &&
+		    rquota_refresh_cmp(&refresh[first], &refresh[i]) == 0)
+			continue;
+
+		rquota_refresh_group(&refresh[first], i - first);
+		first = i;
+	}
+
+	LogFullDebug(COMPONENT_NFSPROTO, "Refreshed %" PRIu32 " quotas",
+		     nrefresh);
+
+	for (i = 0; i < nrefresh; i++)
+		gsh_free((char *)refresh[i].path);
+	gsh_free(refresh);
+}
+
+/**
+ * @brief Start the quota cache
+ *
+ * Nothing is started if RQUOTA is disabled or Rquota_Cache_Time is 0.
+ */
+
+void rquota_cache_start(void)
+{
+	uint32_t ttl = nfs_param.core_param.rquota_cache_time;
+	struct fridgethr_params frp;
+	int rc, i;
+
+	for (i = 0; i < RQUOTA_CACHE_BUCKETS; i++) {
+		PTHREAD_MUTEX_init(&rquota_cache[i].lock, NULL);
+		glist_init(&rquota_cache[i].list);
+	}
+
+	if (!nfs_param.core_param.enable_RQUOTA || ttl == 0) {
+		nfs_param.core_param.rquota_cache_time = 0;
+		return;
+	}
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = ttl / 2 > 0 ? ttl / 2 : 1;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&rquota_cache_fridge, "rquota_cache", &frp);
+	if (rc == 0)
+		rc = fridgethr_submit(rquota_cache_fridge, rquota_cache_run,
+				      NULL);
+	if (rc != 0) {
+		/* Without a thread to drop them, do not cache at all */
+		LogCrit(COMPONENT_INIT,
+			"Unable to start quota cache thread: %d", rc);
+		nfs_param.core_param.rquota_cache_time = 0;
+	}
+}
+
+/**
+ * @brief Stop refreshing the quota cache
+ */
+
+void rquota_cache_shutdown(void)
+{
+	int rc;
+
+	if (rquota_cache_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(rquota_cache_fridge, fridgethr_comm_stop,
+				    120);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_THREAD,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(rquota_cache_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Failed shutting down quota cache thread: %d", rc);
+	}
+	fridgethr_destroy(rquota_cache_fridge);
+	rquota_cache_fridge = NULL;
+}
@@ -110,10 +110,8 @@ int rquota_getquota(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		goto out;
 	}
 
-	fsal_status =
-	    exp->fsal_export->exp_ops.get_quota(exp->fsal_export,
-					     quota_path, quota_type,
-					     quota_id, &fsal_quota);
+	fsal_status = rquota_cache_get(exp, quota_path, quota_type, quota_id,
+				       &fsal_quota);
 	if (FSAL_IS_ERROR(fsal_status)) {
 		if (fsal_status.major == ERR_FSAL_NO_QUOTA)
 			qres->status = Q_NOQUOTA;
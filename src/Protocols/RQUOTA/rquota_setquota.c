@@ -150,6 +150,7 @@ static int do_rquota_setquota(char *quota_path, int quota_type,
 						       quota_id,
 						       &fsal_quota_in,
 						       &fsal_quota_out);
+	rquota_cache_forget(exp, qpath, quota_type, quota_id);
 	if (FSAL_IS_ERROR(fsal_status)) {
 		if (fsal_status.major == ERR_FSAL_NO_QUOTA)
 			qres->status = Q_NOQUOTA;
@@ -48,6 +48,9 @@
 
 #include "nfs_core.h"
 #include "log.h"
+#include "abstract_atomic.h"
+
+struct gss_svc_stats gss_svc_stats[RPCSEC_GSS_SVC_PRIVACY + 1];
 
 /**
  * @brief Convert GSSAPI status to a string
@@ -101,3 +104,79 @@ const char *str_gc_proc(rpc_gss_proc_t gc_proc)
 
 	return "unknown";
 }
+
+const char *str_gc_svc(rpc_gss_svc_t gc_svc)
+{
+	switch (gc_svc) {
+	case RPCSEC_GSS_SVC_NONE:
+		return "krb5";
+	case RPCSEC_GSS_SVC_INTEGRITY:
+		return "krb5i";
+	case RPCSEC_GSS_SVC_PRIVACY:
+		return "krb5p";
+	}
+
+	return "unknown";
+}
+
+static inline struct gss_svc_stats *gss_stats_of(rpc_gss_svc_t svc)
+{
+	if (svc < RPCSEC_GSS_SVC_NONE || svc > RPCSEC_GSS_SVC_PRIVACY)
+		return NULL;
+
+	return &gss_svc_stats[svc];
+}
+
+/**
+ * @brief Account the unwrap of a request's arguments
+ *
+ * @param[in] svc  Service level of the request
+ * @param[in] ns   Time taken
+ */
+
+void gss_stats_unwrap(rpc_gss_svc_t svc, uint64_t ns)
+{
+	struct gss_svc_stats *st = gss_stats_of(svc);
+
+	if (st == NULL)
+		return;
+
+	(void) atomic_inc_uint64_t(&st->requests);
+	(void) atomic_add_uint64_t(&st->unwrap_ns, ns);
+}
+
+/**
+ * @brief Account the wrap of a reply
+ *
+ * @param[in] svc  Service level of the request
+ * @param[in] ns   Time taken
+ */
+
+void gss_stats_wrap(rpc_gss_svc_t svc, uint64_t ns)
+{
+	struct gss_svc_stats *st = gss_stats_of(svc);
+
+	if (st == NULL)
+		return;
+
+	(void) atomic_inc_uint64_t(&st->replies);
+	(void) atomic_add_uint64_t(&st->wrap_ns, ns);
+}
+
+/**
+ * @brief Account a request run by a crypto thread
+ *
+ * @param[in] svc       Service level of the request
+ * @param[in] queue_ns  Time it waited for the thread
+ */
+
+void gss_stats_offload(rpc_gss_svc_t svc, uint64_t queue_ns)
+{
+	struct gss_svc_stats *st = gss_stats_of(svc);
+
+	if (st == NULL)
+		return;
+
+	(void) atomic_inc_uint64_t(&st->offloaded);
+	(void) atomic_add_uint64_t(&st->queue_ns, queue_ns);
+}
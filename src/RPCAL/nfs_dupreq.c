@@ -49,6 +49,10 @@
 #include "abstract_mem.h"
 #include "gsh_intrinsic.h"
 #include "gsh_wait_queue.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#include "server_stats_private.h"
+#endif
 
 #define DUPREQ_NOCACHE   0x02
 #define DUPREQ_MAX_RETRIES 5
@@ -117,110 +121,245 @@ struct drc_st {
 static struct drc_st *drc_st;
 
 /**
- * @brief Comparison function for duplicate request entries.
+ * @brief Hash a request on its xid and checksum
  *
- * @param[in] lhs An integer
- * @param[in] rhs Another integer
+ * @param[in] xid    RPC transaction id
+ * @param[in] cksum  TI-RPC checksum of the request, may be 0
  *
- * @return -1 if the left-hand is smaller than the right, 0 if they
- * are equal, and 1 if the left-hand is larger.
+ * @return The hash.  The partition comes from the whole value, the
+ *	   home bucket from the high half and the tag from the low half.
  */
-static inline int uint32_cmpf(uint32_t lhs, uint32_t rhs)
+static inline uint64_t dupreq_hash(uint32_t xid, uint64_t cksum)
 {
-	if (lhs < rhs)
-		return -1;
+	uint64_t h = (cksum ^ xid) * 0x9e3779b97f4a7c15ULL;
 
-	if (lhs == rhs)
-		return 0;
+	return h ^ (h >> 29);
+}
 
-	return 1;
+/**
+ * @brief Get the hash index partition for a hash
+ *
+ * @param[in] drc  The DRC
+ * @param[in] h    Hash from dupreq_hash()
+ *
+ * @return The partition.
+ */
+static inline struct drc_part *drc_part_of(drc_t *drc, uint64_t h)
+{
+	return &drc->part[h % drc->npart];
 }
 
 /**
- * @brief Comparison function for duplicate request entries.
+ * @brief Check whether a cached entry is the same request as a new one
  *
- * @param[in] lhs An integer
- * @param[in] rhs Another integer
+ * @param[in] drc  The DRC
+ * @param[in] dv   Cached entry
+ * @param[in] dk   New entry
  *
- * @return -1 if the left-hand is smaller than the right, 0 if they
- * are equal, and 1 if the left-hand is larger.
+ * @return true if they match.
  */
-static inline int uint64_cmpf(uint64_t lhs, uint64_t rhs)
+static inline bool dupreq_match(drc_t *drc, dupreq_entry_t *dv,
+				dupreq_entry_t *dk)
 {
-	if (lhs < rhs)
-		return -1;
+	if (dv->hin.tcp.rq_xid != dk->hin.tcp.rq_xid || dv->hk != dk->hk)
+		return false;
 
-	if (lhs == rhs)
-		return 0;
+	/* The shared DRC has requests from all clients */
+	if (drc->type == DRC_UDP_V234)
+		return sockaddr_cmpf(&dv->hin.addr, &dk->hin.addr, false) == 0;
 
-	return 1;
+	return true;
 }
 
 /**
- * @brief Comparison function for entries in a shared DRC
+ * @brief Look up a request in a hash index partition
  *
- * @param[in] lhs  Left-hand-side
- * @param[in] rhs  Right-hand-side
+ * @param[in] drc  The DRC
+ * @param[in] dp   The partition, locked
+ * @param[in] dk   Key entry for the request
+ * @param[in] h    Hash of the request
  *
- * @return -1,0,1.
+ * @return The cached entry, or NULL.
  */
-static inline int dupreq_shared_cmpf(const struct opr_rbtree_node *lhs,
-				     const struct opr_rbtree_node *rhs)
+static dupreq_entry_t *drc_hash_lookup(drc_t *drc, struct drc_part *dp,
+				       dupreq_entry_t *dk, uint64_t h)
 {
-	dupreq_entry_t *lk, *rk;
-
-	lk = opr_containerof(lhs, dupreq_entry_t, rbt_k);
-	rk = opr_containerof(rhs, dupreq_entry_t, rbt_k);
-
-	switch (sockaddr_cmpf(&lk->hin.addr, &rk->hin.addr, false)) {
-	case -1:
-		return -1;
-	case 0:
-		switch (uint32_cmpf(lk->hin.tcp.rq_xid, rk->hin.tcp.rq_xid)) {
-		case -1:
-			return -1;
-		case 0:
-			return uint64_cmpf(lk->hk, rk->hk);
-		default:
+	uint32_t ix = (h >> 32) & dp->mask;
+	uint32_t tag = (uint32_t) h;
+	struct drc_bucket *b;
+	uint32_t probes, way;
+
+	for (probes = 0; probes <= dp->mask; probes++) {
+		b = &dp->buckets[ix];
+
+		for (way = 0; way < DRC_BUCKET_WAYS; way++) {
+			if (b->dv[way] != NULL && b->tag[way] == tag &&
+			    dupreq_match(drc, b->dv[way], dk))
+				return b->dv[way];
+		}
+
+		/* Nothing that hashed here or earlier went on past */
+		if (b->overflow == 0)
 			break;
-		}		/* xid */
-		break;
-	default:
-		break;
-	}			/* addr+port */
 
-	return 1;
+		ix = (ix + 1) & dp->mask;
+	}
+
+	return NULL;
 }
 
 /**
- * @brief Comparison function for entries in a per-connection (TCP) DRC
+ * @brief Insert a request in a hash index partition
  *
- * @param[in] lhs  Left-hand-side
- * @param[in] rhs  Right-hand-side
+ * @param[in] dp   The partition, locked
+ * @param[in] dk   The new entry
+ * @param[in] h    Hash of the request
  *
- * @return -1,0,1.
+ * @return false if the partition is full.
  */
-static inline int dupreq_tcp_cmpf(const struct opr_rbtree_node *lhs,
-				  const struct opr_rbtree_node *rhs)
+static bool drc_hash_insert(struct drc_part *dp, dupreq_entry_t *dk,
+			    uint64_t h)
 {
-	dupreq_entry_t *lk, *rk;
+	uint32_t home = (h >> 32) & dp->mask;
+	uint32_t ix = home;
+	struct drc_bucket *b;
+	uint32_t probes, way;
 
-	LogDebug(COMPONENT_DUPREQ, "%s", __func__);
+	for (probes = 0; probes <= dp->mask; probes++) {
+		b = &dp->buckets[ix];
 
-	lk = opr_containerof(lhs, dupreq_entry_t, rbt_k);
-	rk = opr_containerof(rhs, dupreq_entry_t, rbt_k);
+		for (way = 0; way < DRC_BUCKET_WAYS; way++) {
+			if (b->dv[way] == NULL)
+				goto found;
+		}
 
-	if (lk->hin.tcp.rq_xid < rk->hin.tcp.rq_xid)
-		return -1;
+		ix = (ix + 1) & dp->mask;
+	}
 
-	if (lk->hin.tcp.rq_xid == rk->hin.tcp.rq_xid) {
-		LogDebug(COMPONENT_DUPREQ,
-			 "xids eq %" PRIu32 ", ck1 %" PRIu64 " ck2 %" PRIu64,
-			 lk->hin.tcp.rq_xid, lk->hk, rk->hk);
-		return uint64_cmpf(lk->hk, rk->hk);
+	return false;
+
+ found:
+	b->tag[way] = (uint32_t) h;
+	b->dv[way] = dk;
+
+	/* Every full bucket we walked past now leads on to this one */
+	for (; home != ix; home = (home + 1) & dp->mask)
+		dp->buckets[home].overflow++;
+
+	return true;
+}
+
+/**
+ * @brief Remove an entry from a hash index partition
+ *
+ * @param[in] dp   The partition, locked
+ * @param[in] dv   The entry
+ * @param[in] h    Hash of the entry
+ */
+static void drc_hash_remove(struct drc_part *dp, dupreq_entry_t *dv,
+			    uint64_t h)
+{
+	uint32_t home = (h >> 32) & dp->mask;
+	uint32_t ix = home;
+	struct drc_bucket *b;
+	uint32_t probes, way;
+
+	for (probes = 0; probes <= dp->mask; probes++) {
+		b = &dp->buckets[ix];
+
+		for (way = 0; way < DRC_BUCKET_WAYS; way++) {
+			if (b->dv[way] == dv)
+				goto found;
+		}
+
+		if (b->overflow == 0)
+			break;
+
+		ix = (ix + 1) & dp->mask;
+	}
+
+	LogCrit(COMPONENT_DUPREQ, "BUG: dupreq entry %p not in DRC", dv);
+	return;
+
+ found:
+	b->dv[way] = NULL;
+
+	for (; home != ix; home = (home + 1) & dp->mask)
+		dp->buckets[home].overflow--;
+}
+
+/**
+ * @brief Bytes of the buckets of a DRC's hash index
+ *
+ * @param[in] drc  The DRC
+ */
+static inline size_t drc_hash_bytes(drc_t *drc)
+{
+	return drc->npart * (drc->part[0].mask + 1) *
+	       sizeof(struct drc_bucket);
+}
+
+/**
+ * @brief Allocate the empty buckets of a DRC's hash index
+ *
+ * @param[in] drc  The DRC, with its partitions set up
+ */
+static void drc_hash_alloc(drc_t *drc)
+{
+	size_t size = (drc->part[0].mask + 1) * sizeof(struct drc_bucket);
+	int ix;
+
+	for (ix = 0; ix < drc->npart; ++ix) {
+		drc->part[ix].buckets = gsh_malloc_aligned(GSH_CACHE_LINE_SIZE,
+							   size);
+		memset(drc->part[ix].buckets, 0, size);
+	}
+}
+
+/**
+ * @brief Allocate the hash index of a DRC
+ *
+ * The index has room for a quarter more than drc->maxsize entries, so
+ * that probes stay short at the high water mark and the cache can go
+ * somewhat over maxsize before the retire logic catches up.
+ *
+ * @param[in] drc  The DRC, with maxsize and npart set
+ */
+static void drc_hash_init(drc_t *drc)
+{
+	uint32_t slots = (drc->maxsize + drc->maxsize / 4) / drc->npart + 1;
+	uint32_t nbuckets = 1;
+	struct drc_part *dp;
+	int ix;
+
+	while (nbuckets * DRC_BUCKET_WAYS < slots)
+		nbuckets <<= 1;
+
+	drc->part = gsh_calloc(drc->npart, sizeof(struct drc_part));
+
+	for (ix = 0; ix < drc->npart; ++ix) {
+		dp = &drc->part[ix];
+		PTHREAD_MUTEX_init(&dp->mtx, NULL);
+		dp->mask = nbuckets - 1;
 	}
 
-	return 1;
+	drc_hash_alloc(drc);
+}
+
+/**
+ * @brief Free the hash index of a DRC
+ *
+ * @param[in] drc  The DRC
+ */
+static void drc_hash_free(drc_t *drc)
+{
+	int ix;
+
+	for (ix = 0; ix < drc->npart; ++ix) {
+		PTHREAD_MUTEX_destroy(&drc->part[ix].mtx);
+		gsh_free(drc->part[ix].buckets);
+	}
+	gsh_free(drc->part);
 }
 
 /**
@@ -249,36 +388,30 @@ static inline int drc_recycle_cmpf(const struct opr_rbtree_node *lhs,
 static inline void init_shared_drc(void)
 {
 	drc_t *drc = &drc_st->udp_drc;
-	int ix, code __attribute__ ((unused)) = 0;
 
 	drc->type = DRC_UDP_V234;
 	drc->refcnt = 0;
 	drc->retwnd = 0;
 	drc->d_u.tcp.recycle_time = 0;
 	drc->maxsize = nfs_param.core_param.drc.udp.size;
-	drc->cachesz = nfs_param.core_param.drc.udp.cachesz;
 	drc->npart = nfs_param.core_param.drc.udp.npart;
 	drc->hiwat = nfs_param.core_param.drc.udp.hiwat;
+	drc->enc_bytes = 0;
+	drc->enc_max = drc->maxsize * DRC_ENCODED_BYTES_PER_ENTRY;
+	drc->hits = 0;
+	drc->misses = 0;
+	drc->retrans_s = 0;
+	drc->pass_hits = 0;
+	drc->pass_misses = 0;
+	drc->pass_depth = 0;
 
 	gsh_mutex_init(&drc->mtx, NULL);
 
 	/* init dict */
-	code =
-	    rbtx_init(&drc->xt, dupreq_shared_cmpf, drc->npart,
-		      RBT_X_FLAG_ALLOC | RBT_X_FLAG_CACHE_WT);
-	assert(!code);
+	drc_hash_init(drc);
 
 	/* completed requests */
 	TAILQ_INIT(&drc->dupreq_q);
-
-	/* init closed-form "cache" partition */
-	for (ix = 0; ix < drc->npart; ++ix) {
-		struct rbtree_x_part *xp = &(drc->xt.tree[ix]);
-
-		drc->xt.cachesz = drc->cachesz;
-		xp->cache =
-		    gsh_calloc(drc->cachesz, sizeof(struct opr_rbtree_node *));
-	}
 }
 
 /**
@@ -295,6 +428,10 @@ void dupreq2_pkginit(void)
 
 	tcp_drc_pool = pool_basic_init("TCP DRC Pool", sizeof(drc_t));
 
+	pool_set_mem_tag(dupreq_pool, MEM_TAG_DRC);
+	pool_set_mem_tag(nfs_res_pool, MEM_TAG_DRC);
+	pool_set_mem_tag(tcp_drc_pool, MEM_TAG_DRC);
+
 	drc_st = gsh_calloc(1, sizeof(struct drc_st));
 
 	/* init shared statics */
@@ -361,33 +498,33 @@ static inline enum drc_type get_drc_type(struct svc_req *req)
  * @brief Allocate a duplicate request cache
  *
  * @param[in] dtype   Style DRC to allocate (e.g., TCP, by enum drc_type)
- * @param[in] maxsz   Upper bound on requests to cache
- * @param[in] cachesz Number of entries in the closed hash partition
- * @param[in] flags   DRC flags
  *
  * @return the drc, if successfully allocated, else NULL.
  */
 static inline drc_t *alloc_tcp_drc(enum drc_type dtype)
 {
 	drc_t *drc = pool_alloc(tcp_drc_pool);
-	int ix, code __attribute__ ((unused)) = 0;
 
 	drc->type = dtype;	/* DRC_TCP_V3 or DRC_TCP_V4 */
 	drc->refcnt = 0;
 	drc->retwnd = 0;
 	drc->d_u.tcp.recycle_time = 0;
 	drc->maxsize = nfs_param.core_param.drc.tcp.size;
-	drc->cachesz = nfs_param.core_param.drc.tcp.cachesz;
 	drc->npart = nfs_param.core_param.drc.tcp.npart;
 	drc->hiwat = nfs_param.core_param.drc.tcp.hiwat;
+	drc->enc_bytes = 0;
+	drc->enc_max = drc->maxsize * DRC_ENCODED_BYTES_PER_ENTRY;
+	drc->hits = 0;
+	drc->misses = 0;
+	drc->retrans_s = 0;
+	drc->pass_hits = 0;
+	drc->pass_misses = 0;
+	drc->pass_depth = 0;
 
 	PTHREAD_MUTEX_init(&drc->mtx, NULL);
 
 	/* init dict */
-	code =
-	    rbtx_init(&drc->xt, dupreq_tcp_cmpf, drc->npart,
-		      RBT_X_FLAG_ALLOC | RBT_X_FLAG_CACHE_WT);
-	assert(!code);
+	drc_hash_init(drc);
 
 	/* completed requests */
 	TAILQ_INIT(&drc->dupreq_q);
@@ -395,15 +532,6 @@ static inline drc_t *alloc_tcp_drc(enum drc_type dtype)
 	/* recycling DRC */
 	TAILQ_INIT_ENTRY(drc, d_u.tcp.recycle_q);
 
-	/* init "cache" partition */
-	for (ix = 0; ix < drc->npart; ++ix) {
-		struct rbtree_x_part *xp = &(drc->xt.tree[ix]);
-
-		drc->xt.cachesz = drc->cachesz;
-		xp->cache =
-		    gsh_calloc(drc->cachesz, sizeof(struct opr_rbtree_node *));
-	}
-
 	return drc;
 }
 
@@ -416,12 +544,7 @@ static inline drc_t *alloc_tcp_drc(enum drc_type dtype)
  */
 static inline void free_tcp_drc(drc_t *drc)
 {
-	int ix;
-
-	for (ix = 0; ix < drc->npart; ++ix) {
-		if (drc->xt.tree[ix].cache)
-			gsh_free(drc->xt.tree[ix].cache);
-	}
+	drc_hash_free(drc);
 	PTHREAD_MUTEX_destroy(&drc->mtx);
 	LogFullDebug(COMPONENT_DUPREQ, "free TCP drc %p", drc);
 	pool_free(tcp_drc_pool, drc);
@@ -655,6 +778,14 @@ retry:
 		break;
 	}
 
+	/* Only TCP gets here, the UDP DRC is never shrunk */
+	drc->d_u.tcp.last_use = time(NULL);
+	if (unlikely(drc->flags & DRC_FLAG_SHRUNK)) {
+		drc_hash_alloc(drc);
+		drc->flags &= ~DRC_FLAG_SHRUNK;
+		LogFullDebug(COMPONENT_DUPREQ, "regrow idle drc %p", drc);
+	}
+
 	/* call path ref */
 	(void)nfs_dupreq_ref_drc(drc);
 	PTHREAD_MUTEX_unlock(&drc->mtx);
@@ -701,7 +832,7 @@ void nfs_dupreq_put_drc(drc_t *drc, uint32_t flags)
 			break;
 
 		/* note t's lock order wrt drc->mtx is the opposite of
-		 * drc->xt[*].lock. Drop and reacquire locks in correct
+		 * drc->part[*].mtx. Drop and reacquire locks in correct
 		 * order.
 		 */
 		PTHREAD_MUTEX_unlock(&drc->mtx);
@@ -843,6 +974,7 @@ static inline void nfs_dupreq_free_dupreq(dupreq_entry_t *dv)
 		func->free_function(dv->res);
 		free_nfs_res(dv->res);
 	}
+	gsh_free(dv->enc.buf);
 	PTHREAD_MUTEX_destroy(&dv->mtx);
 	pool_free(dupreq_pool, dv);
 }
@@ -917,6 +1049,34 @@ static inline void dupreq_entry_put(dupreq_entry_t *dv)
 			--((drc)->retwnd);	\
 	} while (0)
 
+/**
+ * @brief Count a retransmission answered from the DRC
+ *
+ * How many requests were cached since the one asked for again is how
+ * deep the DRC has to be to answer it.  The delay is smoothed like a
+ * TCP round trip time, by an eighth of each new one.
+ *
+ * @param[in] drc      The DRC, locked
+ * @param[in] seq      drc->misses when the entry was cached
+ * @param[in] replied  When it was replied to
+ */
+static inline void drc_count_hit(drc_t *drc, uint64_t seq, time_t replied)
+{
+	uint64_t depth = drc->misses - seq;
+	int64_t delay = time(NULL) - replied;
+
+	if (delay < 0)
+		delay = 0;
+	if (drc->hits++ == 0)
+		drc->retrans_s = delay;
+	else
+		drc->retrans_s += (delay - (int64_t) drc->retrans_s) / 8;
+
+	drc->pass_hits++;
+	if (depth > drc->pass_depth)
+		drc->pass_depth = MIN(depth, UINT32_MAX);
+}
+
 /**
  * @brief retire request predicate.
  *
@@ -944,6 +1104,89 @@ static inline bool drc_should_retire(drc_t *drc)
 	return false;
 }
 
+/**
+ * @brief Keep the encoded reply of a retransmitted request
+ *
+ * Done once, on the first retransmit of a completed request, so that
+ * a retransmit storm encodes each reply at most twice.  The bytes are
+ * charged to the DRC; a reply that is too large or does not fit the
+ * DRC's budget is simply encoded again on each retransmit.
+ *
+ * The reply is encoded with no lock held, the caller's ref keeping
+ * dv and its result.  It is kept only if dv is still in the DRC, so
+ * that retiring dv gives back what was charged.
+ *
+ * @param[in] drc  The DRC
+ * @param[in] dp   The partition of dv, unlocked
+ * @param[in] dv   The entry, referenced and unlocked, enc.tried set
+ * @param[in] h    The hash of dv
+ */
+static void nfs_dupreq_encode(drc_t *drc, struct drc_part *dp,
+			      dupreq_entry_t *dv, uint64_t h)
+{
+	const nfs_function_desc_t *func = nfs_dupreq_func(dv);
+	u_int max = nfs_param.core_param.drc.encoded_max;
+	XDR xdrs;
+	char *buf;
+	u_int len;
+	bool ok;
+
+	if (func == NULL || dv->res == NULL)
+		return;
+
+	buf = gsh_malloc(max);
+	xdrmem_create(&xdrs, buf, max, XDR_ENCODE);
+	ok = func->xdr_encode_func(&xdrs, dv->res);
+	len = xdr_getpos(&xdrs);
+	xdr_destroy(&xdrs);
+
+	if (!ok) {
+		gsh_free(buf);
+		return;
+	}
+	buf = gsh_realloc(buf, len);
+
+	PTHREAD_MUTEX_lock(&dp->mtx);
+	PTHREAD_MUTEX_lock(&dv->mtx);
+	ok = dv->enc.buf == NULL && drc_hash_lookup(drc, dp, dv, h) == dv;
+	if (ok) {
+		PTHREAD_MUTEX_lock(&drc->mtx);
+		ok = drc->enc_bytes + len <= drc->enc_max;
+		if (ok) {
+			drc->enc_bytes += len;
+			dv->enc.buf = buf;
+			dv->enc.len = len;
+		}
+		PTHREAD_MUTEX_unlock(&drc->mtx);
+	}
+	PTHREAD_MUTEX_unlock(&dv->mtx);
+	PTHREAD_MUTEX_unlock(&dp->mtx);
+
+	if (!ok) {
+		LogFullDebug(COMPONENT_DUPREQ,
+			     "not keeping encoded reply of dv=%p on DRC=%p",
+			     dv, drc);
+		gsh_free(buf);
+	}
+}
+
+/**
+ * @brief XDR routine that sends an encoded reply as is
+ *
+ * @param[in] xdrs  The reply stream
+ * @param[in] enc   The encoded reply
+ *
+ * @return true if successful.
+ */
+static bool xdr_dupreq_encoded(XDR *xdrs, struct dupreq_encoded *enc)
+{
+	if (xdrs->x_op != XDR_ENCODE)
+		return true;
+
+	/* Already a multiple of 4 bytes, so nothing is padded */
+	return xdr_opaque(xdrs, enc->buf, enc->len);
+}
+
 static inline bool nfs_dupreq_v4_cacheable(nfs_request_t *reqnfs)
 {
 	COMPOUND4args *arg_c4 = (COMPOUND4args *)&reqnfs->arg_nfs;
@@ -982,6 +1225,9 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *reqnfs,
 	dupreq_entry_t *dv = NULL, *dk = NULL;
 	drc_t *drc;
 	dupreq_status_t status = DUPREQ_SUCCESS;
+	uint64_t seq = 0;
+	time_t replied = 0;
+	bool encode = false;
 
 	if (!(reqnfs->funcdesc->dispatch_behaviour & CAN_BE_DUP))
 		goto no_cache;
@@ -1034,15 +1280,14 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *reqnfs,
 	dk->timestamp = time(NULL);
 
 	{
-		struct opr_rbtree_node *nv;
-		struct rbtree_x_part *t =
-		    rbtx_partition_of_scalar(&drc->xt, dk->hk);
-		PTHREAD_MUTEX_lock(&t->mtx);	/* partition lock */
-		nv = rbtree_x_cached_lookup(&drc->xt, t, &dk->rbt_k, dk->hk);
-		if (nv) {
+		uint64_t h = dupreq_hash(dk->hin.tcp.rq_xid, dk->hk);
+		struct drc_part *dp = drc_part_of(drc, h);
+
+		PTHREAD_MUTEX_lock(&dp->mtx);	/* partition lock */
+		dv = drc_hash_lookup(drc, dp, dk, h);
+		if (dv) {
 			/* cached request */
 			nfs_dupreq_free_dupreq(dk);
-			dv = opr_containerof(nv, dupreq_entry_t, rbt_k);
 			PTHREAD_MUTEX_lock(&dv->mtx);
 			if (unlikely(dv->state == DUPREQ_START)) {
 				status = DUPREQ_BEING_PROCESSED;
@@ -1052,13 +1297,22 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *reqnfs,
 				req->rq_u1 = dv;
 				reqnfs->res_nfs = req->rq_u2 = dv->res;
 				status = DUPREQ_EXISTS;
+				seq = dv->seq;
+				replied = dv->timestamp;
 				dupreq_entry_get(dv);
+				if (nfs_param.core_param.drc.encoded &&
+				    !dv->enc.tried) {
+					/* Ours to encode, below */
+					dv->enc.tried = true;
+					encode = true;
+				}
 			}
 			PTHREAD_MUTEX_unlock(&dv->mtx);
 
 			if (status == DUPREQ_EXISTS) {
 				PTHREAD_MUTEX_lock(&drc->mtx);
 				drc_inc_retwnd(drc);
+				drc_count_hit(drc, seq, replied);
 				PTHREAD_MUTEX_unlock(&drc->mtx);
 			}
 
@@ -1067,16 +1321,21 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *reqnfs,
 				 " cksum %" PRIu64 " state=%s",
 				 dv, dv->hin.tcp.rq_xid, dv->hk,
 				 dupreq_state_table[dv->state]);
+		} else if (unlikely(!drc_hash_insert(dp, dk, h))) {
+			/* index is full, run the request uncached */
+			PTHREAD_MUTEX_unlock(&dp->mtx);
+			LogDebug(COMPONENT_DUPREQ,
+				 "DRC=%p full, not caching xid=%" PRIu32,
+				 drc, dk->hin.tcp.rq_xid);
+			nfs_dupreq_put_drc(drc, DRC_FLAG_NONE);
+			nfs_dupreq_free_dupreq(dk);
+			goto no_cache;
 		} else {
 			/* new request */
 			req->rq_u1 = dk;
 			dk->res = alloc_nfs_res();
 			reqnfs->res_nfs = req->rq_u2 = dk->res;
 
-			/* cache--can exceed drc->maxsize */
-			(void)rbtree_x_cached_insert(&drc->xt, t,
-						&dk->rbt_k, dk->hk);
-
 			/* dupreq ref count starts with 2; one for the caller
 			 * and another for staying in the hash table.
 			 */
@@ -1086,6 +1345,8 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *reqnfs,
 			PTHREAD_MUTEX_lock(&drc->mtx);
 			TAILQ_INSERT_TAIL(&drc->dupreq_q, dk, fifo_q);
 			++(drc->size);
+			dk->seq = drc->misses++;
+			drc->pass_misses++;
 			PTHREAD_MUTEX_unlock(&drc->mtx);
 
 			LogFullDebug(COMPONENT_DUPREQ,
@@ -1096,7 +1357,10 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *reqnfs,
 				     dupreq_status_table[status],
 				     dk->refcnt, drc->size);
 		}
-		PTHREAD_MUTEX_unlock(&t->mtx);
+		PTHREAD_MUTEX_unlock(&dp->mtx);
+
+		if (encode)
+			nfs_dupreq_encode(drc, dp, dv, h);
 	}
 
 	return status;
@@ -1137,7 +1401,7 @@ dupreq_status_t nfs_dupreq_finish(struct svc_req *req, nfs_res_t *res_nfs)
 {
 	dupreq_entry_t *ov = NULL, *dv = (dupreq_entry_t *)req->rq_u1;
 	dupreq_status_t status = DUPREQ_SUCCESS;
-	struct rbtree_x_part *t;
+	struct drc_part *dp;
 	drc_t *drc = NULL;
 	int16_t cnt = 0;
 
@@ -1171,15 +1435,16 @@ dq_again:
 		ov = TAILQ_FIRST(&drc->dupreq_q);
 		if (likely(ov)) {
 			/* remove dict entry */
-			t = rbtx_partition_of_scalar(&drc->xt, ov->hk);
-			uint64_t ov_hk = ov->hk;
+			uint64_t ov_h = dupreq_hash(ov->hin.tcp.rq_xid, ov->hk);
+
+			dp = drc_part_of(drc, ov_h);
 
 			/* Need to acquire partition lock, but the lock
 			 * order is partition lock followed by drc lock.
 			 * Drop drc lock and reacquire it!
 			 */
 			PTHREAD_MUTEX_unlock(&drc->mtx);
-			PTHREAD_MUTEX_lock(&t->mtx);	/* partition lock */
+			PTHREAD_MUTEX_lock(&dp->mtx);	/* partition lock */
 			PTHREAD_MUTEX_lock(&drc->mtx);
 
 			/* Since we dropped drc lock and reacquired it,
@@ -1188,24 +1453,26 @@ dq_again:
 			 */
 			ov = TAILQ_FIRST(&drc->dupreq_q);
 
-			/* Make sure that we are removing the entry we
-			 * expected (imperfect, but harmless).
+			/* Make sure the head still hashes to the partition
+			 * we locked; any such entry will do.
 			 */
-			if (ov == NULL || ov->hk != ov_hk) {
-				PTHREAD_MUTEX_unlock(&t->mtx);
+			if (ov == NULL ||
+			    dupreq_hash(ov->hin.tcp.rq_xid, ov->hk) != ov_h) {
+				PTHREAD_MUTEX_unlock(&dp->mtx);
 				goto unlock;
 			}
 
 			/* remove q entry */
 			TAILQ_REMOVE(&drc->dupreq_q, ov, fifo_q);
 			--(drc->size);
+			drc->enc_bytes -= ov->enc.len;
 			/* release dv's ref */
 			nfs_dupreq_put_drc(drc, DRC_FLAG_LOCKED);
 			/* drc->mtx gets unlocked in the above call! */
 
-			rbtree_x_cached_remove(&drc->xt, t, &ov->rbt_k, ov->hk);
+			drc_hash_remove(dp, ov, ov_h);
 
-			PTHREAD_MUTEX_unlock(&t->mtx);
+			PTHREAD_MUTEX_unlock(&dp->mtx);
 
 			LogDebug(COMPONENT_DUPREQ,
 				 "retiring ov=%p xid=%" PRIu32
@@ -1253,7 +1520,8 @@ dupreq_status_t nfs_dupreq_delete(struct svc_req *req)
 {
 	dupreq_entry_t *dv = (dupreq_entry_t *)req->rq_u1;
 	dupreq_status_t status = DUPREQ_SUCCESS;
-	struct rbtree_x_part *t;
+	struct drc_part *dp;
+	uint64_t h;
 	drc_t *drc;
 
 	/* do nothing if req is marked no-cache */
@@ -1273,16 +1541,18 @@ dupreq_status_t nfs_dupreq_delete(struct svc_req *req)
 		     dv->refcnt);
 
 	/* XXX dv holds a ref on drc */
-	t = rbtx_partition_of_scalar(&drc->xt, dv->hk);
+	h = dupreq_hash(dv->hin.tcp.rq_xid, dv->hk);
+	dp = drc_part_of(drc, h);
 
-	PTHREAD_MUTEX_lock(&t->mtx);
-	rbtree_x_cached_remove(&drc->xt, t, &dv->rbt_k, dv->hk);
-	PTHREAD_MUTEX_unlock(&t->mtx);
+	PTHREAD_MUTEX_lock(&dp->mtx);
+	drc_hash_remove(dp, dv, h);
+	PTHREAD_MUTEX_unlock(&dp->mtx);
 
 	PTHREAD_MUTEX_lock(&drc->mtx);
 
 	TAILQ_REMOVE(&drc->dupreq_q, dv, fifo_q);
 	--(drc->size);
+	drc->enc_bytes -= dv->enc.len;
 
 	/* release dv's ref on drc and unlock */
 	nfs_dupreq_put_drc(drc, DRC_FLAG_LOCKED);
@@ -1331,6 +1601,342 @@ void nfs_dupreq_rele(struct svc_req *req, const nfs_function_desc_t *func)
 		SVCAUTH_RELEASE(req);
 }
 
+/**
+ * @brief Set up the reply to a retransmitted request
+ *
+ * The encoded reply is sent if nfs_dupreq_start() kept one, otherwise
+ * the cached result is encoded again.
+ *
+ * @param[in] req  The svc_req structure, a DUPREQ_EXISTS hit
+ * @param[in] func The function descriptor for this request type
+ */
+void nfs_dupreq_reply_results(struct svc_req *req,
+			      const nfs_function_desc_t *func)
+{
+	dupreq_entry_t *dv = (dupreq_entry_t *) req->rq_u1;
+	bool encoded = false;
+
+	if (dv != (void *)DUPREQ_NOCACHE) {
+		/* Set once, then kept until dv is freed */
+		PTHREAD_MUTEX_lock(&dv->mtx);
+		encoded = dv->enc.buf != NULL;
+		PTHREAD_MUTEX_unlock(&dv->mtx);
+	}
+
+	if (encoded) {
+		req->rq_msg.RPCM_ack.ar_results.where = &dv->enc;
+		req->rq_msg.RPCM_ack.ar_results.proc =
+					(xdrproc_t) xdr_dupreq_encoded;
+		return;
+	}
+
+	req->rq_msg.RPCM_ack.ar_results.where = req->rq_u2;
+	req->rq_msg.RPCM_ack.ar_results.proc = func->xdr_encode_func;
+}
+
+/**
+ * @brief Bytes held by a TCP DRC
+ *
+ * The DRC, its hash index, and its entries with their encoded
+ * replies.  What the results point to is not counted.
+ *
+ * @param[in] drc  The DRC, locked
+ */
+static uint64_t drc_bytes(drc_t *drc)
+{
+	uint64_t bytes = sizeof(*drc) + drc->npart * sizeof(struct drc_part);
+
+	if (!(drc->flags & DRC_FLAG_SHRUNK))
+		bytes += drc_hash_bytes(drc);
+
+	return bytes + drc->enc_bytes +
+	       drc->size * (sizeof(dupreq_entry_t) + sizeof(nfs_res_t));
+}
+
+/**
+ * @brief Take the cached replies and hash index from an idle TCP DRC
+ *
+ * Nothing is done while a request is between nfs_dupreq_get_drc() and
+ * nfs_dupreq_finish(): all the references must be the connection's
+ * and the completed entries'.  Without a request in the call path,
+ * nothing looks at the buckets, so they can go without the partition
+ * locks.  nfs_dupreq_get_drc() brings them back.
+ *
+ * @param[in]  drc      The DRC, locked
+ * @param[out] retired  Where to put the entries, still holding their
+ *		        hash index reference
+ *
+ * @return true if the DRC was shrunk.
+ */
+static bool drc_shrink(drc_t *drc, struct drc_tailq *retired)
+{
+	uint32_t xprt_ref = (drc->flags & DRC_FLAG_RECYCLE) ? 0 : 1;
+	dupreq_entry_t *dv;
+	int ix;
+
+	if (drc->flags & DRC_FLAG_SHRUNK ||
+	    drc->refcnt != drc->size + xprt_ref)
+		return false;
+
+	/* An entry only goes from DUPREQ_START to DUPREQ_COMPLETE, and
+	 * a completed one is only retired under drc->mtx, so the state
+	 * can be read unlocked.
+	 */
+	TAILQ_FOREACH(dv, &drc->dupreq_q, fifo_q)
+		if (dv->state != DUPREQ_COMPLETE)
+			return false;
+
+	while ((dv = TAILQ_FIRST(&drc->dupreq_q)) != NULL) {
+		TAILQ_REMOVE(&drc->dupreq_q, dv, fifo_q);
+		TAILQ_INSERT_TAIL(retired, dv, fifo_q);
+	}
+	drc->refcnt = xprt_ref;
+	drc->size = 0;
+	drc->enc_bytes = 0;
+	drc->retwnd = 0;
+
+	for (ix = 0; ix < drc->npart; ++ix) {
+		gsh_free(drc->part[ix].buckets);
+		drc->part[ix].buckets = NULL;
+	}
+	drc->flags |= DRC_FLAG_SHRUNK;
+
+	return true;
+}
+
+/**
+ * @brief Shrink the TCP DRCs that have been idle for a while
+ *
+ * Run from the reaper.  An idle connection keeps its DRC for as long
+ * as it stays up, with up to DRC_TCP_Hiwat cached replies and the
+ * whole hash index.  Past DRC_TCP_Idle_Shrink_S, no retransmission is
+ * expected on it any more, so they are freed.
+ */
+void nfs_dupreq_shrink_idle(void)
+{
+	time_t idle = nfs_param.core_param.drc.tcp.idle_shrink_s;
+	time_t now = time(NULL);
+	struct drc_tailq retired;
+	struct opr_rbtree_node *node;
+	struct rbtree_x_part *t;
+	dupreq_entry_t *dv;
+	drc_t *drc;
+	uint32_t shrunk = 0;
+	int ix;
+
+	if (idle == 0)
+		return;
+
+	TAILQ_INIT(&retired);
+
+	DRC_ST_LOCK();
+	for (ix = 0; ix < drc_st->tcp_drc_recycle_t.npart; ++ix) {
+		t = &drc_st->tcp_drc_recycle_t.tree[ix];
+		for (node = opr_rbtree_first(&t->t); node != NULL;
+		     node = opr_rbtree_next(node)) {
+			drc = opr_containerof(node, drc_t, d_u.tcp.recycle_k);
+			PTHREAD_MUTEX_lock(&drc->mtx);
+			if (now - drc->d_u.tcp.last_use >= idle &&
+			    drc_shrink(drc, &retired))
+				shrunk++;
+			PTHREAD_MUTEX_unlock(&drc->mtx);
+		}
+	}
+	DRC_ST_UNLOCK();
+
+	/* The entries no longer need their DRC */
+	while ((dv = TAILQ_FIRST(&retired)) != NULL) {
+		TAILQ_REMOVE(&retired, dv, fifo_q);
+		dupreq_entry_put(dv);
+	}
+
+	if (shrunk > 0)
+		LogDebug(COMPONENT_DUPREQ, "shrunk %" PRIu32 " idle TCP DRCs",
+			 shrunk);
+}
+
+/**
+ * @brief Halve or grow the TCP DRCs for one adaptive pass
+ *
+ * @param[in]     grow  Grow the DRCs that answered a retransmission, else
+ *			halve the ones that answered none
+ * @param[in,out] used  Bytes of replies the DRCs may keep
+ *
+ * @return How many DRCs were resized.
+ */
+static uint32_t drc_adapt_pass(bool grow, uint64_t *used)
+{
+	uint64_t budget = nfs_param.core_param.drc.tcp.adaptive_budget;
+	uint64_t entry = sizeof(dupreq_entry_t) + sizeof(nfs_res_t);
+	uint32_t floor = nfs_param.core_param.drc.tcp.hiwat_min;
+	struct opr_rbtree_node *node;
+	struct rbtree_x_part *t;
+	uint32_t resized = 0;
+	uint64_t want;
+	drc_t *drc;
+	int ix;
+
+	for (ix = 0; ix < drc_st->tcp_drc_recycle_t.npart; ++ix) {
+		t = &drc_st->tcp_drc_recycle_t.tree[ix];
+		for (node = opr_rbtree_first(&t->t); node != NULL;
+		     node = opr_rbtree_next(node)) {
+			drc = opr_containerof(node, drc_t, d_u.tcp.recycle_k);
+			PTHREAD_MUTEX_lock(&drc->mtx);
+			if (!grow) {
+				/* Went through all its replies for nothing */
+				want = MAX(drc->hiwat / 2,
+					   MIN(floor, drc->maxsize));
+				if (drc->pass_hits == 0 &&
+				    drc->pass_misses >= drc->hiwat &&
+				    want < drc->hiwat) {
+					drc->hiwat = want;
+					resized++;
+				}
+				if (!(drc->flags & DRC_FLAG_SHRUNK))
+					*used += drc->hiwat * entry;
+			} else {
+				want = MIN(2 * (uint64_t) drc->pass_depth,
+					   drc->maxsize);
+				if (drc->pass_hits > 0 && want > drc->hiwat &&
+				    *used + (want - drc->hiwat) * entry <=
+				    budget) {
+					*used += (want - drc->hiwat) * entry;
+					drc->hiwat = want;
+					resized++;
+				}
+				drc->pass_hits = 0;
+				drc->pass_misses = 0;
+				drc->pass_depth = 0;
+			}
+			PTHREAD_MUTEX_unlock(&drc->mtx);
+		}
+	}
+
+	return resized;
+}
+
+/**
+ * @brief Size the TCP DRCs by what their connections retransmit
+ *
+ * Run from the reaper when DRC_TCP_Adaptive_Budget is set.  Most
+ * connections never retransmit, and keep DRC_TCP_Hiwat replies for
+ * nothing, while a lossy one can retransmit a reply already retired.
+ * A DRC that went through as many requests as it keeps without
+ * answering a retransmission is halved, down to DRC_TCP_Hiwat_Min.
+ * The room this makes goes to those that answered one: they grow to
+ * twice the deepest one asked for, up to DRC_TCP_Size, while all the
+ * replies fit the budget.  Shrinking first lets a busy server give
+ * the budget to where it is used.  What a DRC learns is kept when its
+ * connection comes back and the DRC is recycled.
+ */
+void nfs_dupreq_adapt(void)
+{
+	uint64_t used = 0;
+	uint32_t halved, grown;
+
+	if (nfs_param.core_param.drc.tcp.adaptive_budget == 0)
+		return;
+
+	DRC_ST_LOCK();
+	halved = drc_adapt_pass(false, &used);
+	grown = drc_adapt_pass(true, &used);
+	DRC_ST_UNLOCK();
+
+	if (halved > 0 || grown > 0)
+		LogDebug(COMPONENT_DUPREQ,
+			 "halved %" PRIu32 " and grew %" PRIu32
+			 " TCP DRCs, %" PRIu64 " bytes of replies",
+			 halved, grown, used);
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report the DRC memory of each connection from an address
+ *
+ * A timestamp, then for each TCP DRC of the address, live or waiting
+ * to be recycled, its port, seconds since its last request, whether it
+ * is shrunk, its cached replies and its bytes, the retransmissions it
+ * answered, the requests it cached, the replies it keeps, and the
+ * smoothed seconds from a reply to its retransmission.
+ *
+ * @param[in] addr  Client address, the port is ignored
+ * @param[in] iter  Iterator in reply stream to fill
+ */
+void nfs_dupreq_dbus_conns(sockaddr_t *addr, DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter, conn_iter;
+	struct timespec timestamp;
+	struct opr_rbtree_node *node;
+	struct rbtree_x_part *t;
+	time_t secs = time(NULL);
+	dbus_bool_t shrunk;
+	uint16_t port;
+	uint32_t idle, size, hiwat, retrans_s;
+	uint64_t bytes, hits, misses;
+	drc_t *drc;
+	int ix;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(qubutttuu)",
+					 &array_iter);
+	DRC_ST_LOCK();
+	for (ix = 0; ix < drc_st->tcp_drc_recycle_t.npart; ++ix) {
+		t = &drc_st->tcp_drc_recycle_t.tree[ix];
+		for (node = opr_rbtree_first(&t->t); node != NULL;
+		     node = opr_rbtree_next(node)) {
+			drc = opr_containerof(node, drc_t, d_u.tcp.recycle_k);
+			if (!cmp_sockaddr(&drc->d_u.tcp.addr, addr, true))
+				continue;
+
+			PTHREAD_MUTEX_lock(&drc->mtx);
+			port = get_port(&drc->d_u.tcp.addr);
+			idle = secs - drc->d_u.tcp.last_use;
+			shrunk = (drc->flags & DRC_FLAG_SHRUNK) != 0;
+			size = drc->size;
+			bytes = drc_bytes(drc);
+			hits = drc->hits;
+			misses = drc->misses;
+			hiwat = drc->hiwat;
+			retrans_s = drc->retrans_s;
+			PTHREAD_MUTEX_unlock(&drc->mtx);
+
+			dbus_message_iter_open_container(&array_iter,
+							 DBUS_TYPE_STRUCT,
+							 NULL, &conn_iter);
+			dbus_message_iter_append_basic(&conn_iter,
+						       DBUS_TYPE_UINT16, &port);
+			dbus_message_iter_append_basic(&conn_iter,
+						       DBUS_TYPE_UINT32, &idle);
+			dbus_message_iter_append_basic(&conn_iter,
+						       DBUS_TYPE_BOOLEAN,
+						       &shrunk);
+			dbus_message_iter_append_basic(&conn_iter,
+						       DBUS_TYPE_UINT32, &size);
+			dbus_message_iter_append_basic(&conn_iter,
+						       DBUS_TYPE_UINT64,
+						       &bytes);
+			dbus_message_iter_append_basic(&conn_iter,
+						       DBUS_TYPE_UINT64, &hits);
+			dbus_message_iter_append_basic(&conn_iter,
+						       DBUS_TYPE_UINT64,
+						       &misses);
+			dbus_message_iter_append_basic(&conn_iter,
+						       DBUS_TYPE_UINT32,
+						       &hiwat);
+			dbus_message_iter_append_basic(&conn_iter,
+						       DBUS_TYPE_UINT32,
+						       &retrans_s);
+			dbus_message_iter_close_container(&array_iter,
+							  &conn_iter);
+		}
+	}
+	DRC_ST_UNLOCK();
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+#endif				/* USE_DBUS */
+
 /**
  * @brief Shutdown the dupreq2 package.
  */
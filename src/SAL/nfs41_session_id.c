@@ -38,6 +38,7 @@
 #include "nfs_core.h"
 #include "nfs_proto_functions.h"
 #include "sal_functions.h"
+#include "nfs_rpc_callback.h"
 #ifdef USE_LTTNG
 #include "gsh_lttng/nfs4.h"
 #endif
@@ -59,6 +60,14 @@ hash_table_t *ht_session_id;
 
 uint64_t global_sequence;
 
+/**
+ * @brief Percentage of a session's slots offered to the client
+ *
+ * Lowered by the reaper while the host is short of memory.
+ */
+
+static uint32_t slot_memory_pct = 100;
+
 /**
  * @brief Display a session ID
  *
@@ -193,7 +202,7 @@ static hash_parameter_t session_id_param = {
 	.compare_key = compare_session_id,
 	.key_to_str = display_session_id_key,
 	.val_to_str = display_session_id_val,
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_OPEN,
 };
 
 /**
@@ -265,23 +274,26 @@ int32_t _dec_session_ref(nfs41_session_t *session, const char *func, int line)
 		/* Destroy this session's mutexes and condition variable */
 
 		for (i = 0; i < session->nb_slots; i++) {
-			nfs41_session_slot_t *slot;
+			nfs41_session_slot_t *slot = session->fc_slots[i];
+
+			if (slot == NULL)
+				continue;
 
-			slot = &session->fc_slots[i];
 			PTHREAD_MUTEX_destroy(&slot->lock);
-			if (slot->cached_result.res_cached) {
-				slot->cached_result.res_cached = false;
-				nfs4_Compound_Free((nfs_res_t *)
-						   &slot->cached_result);
-			}
+			nfs41_Session_Slot_Release(slot);
+			gsh_free(slot);
 		}
 
+		PTHREAD_MUTEX_destroy(&session->slot_lock);
+
 		PTHREAD_COND_destroy(&session->cb_cond);
 		PTHREAD_MUTEX_destroy(&session->cb_mutex);
 
-		/* Destroy the session's back channel (if any) */
-		if (session->flags & session_bc_up)
-			nfs_rpc_destroy_chan(&session->cb_chan);
+		/* Destroy the session's back channel (if any), which may
+		 * still hold a client after going down.
+		 */
+		nfs_rpc_destroy_chan(&session->cb_chan);
+		nfs41_session_free_cb_sec(session);
 
 		/* Free the slot tables */
 		gsh_free(session->fc_slots);
@@ -429,6 +441,41 @@ void nfs41_Session_PrintAll(void)
 	hashtable_log(COMPONENT_SESSIONS, ht_session_id);
 }
 
+/**
+ * @brief Drop a slot's cached reply
+ *
+ * A full reply (sa_cachethis) is the reply that was sent, handed over
+ * to the slot.  Otherwise only SEQUENCE and its successor's status
+ * are kept, in the slot's own uncached_res array.
+ *
+ * @param[in] slot The slot, locked or being destroyed
+ */
+
+void nfs41_Session_Slot_Release(nfs41_session_slot_t *slot)
+{
+	COMPOUND4res *c_res = &slot->cached_result.res_compound4;
+	u_int i;
+
+	if (!slot->cached_result.res_cached)
+		return;
+
+	slot->cached_result.res_cached = false;
+
+	if (c_res->resarray.resarray_val != slot->uncached_res) {
+		nfs4_Compound_Free((nfs_res_t *) &slot->cached_result);
+		return;
+	}
+
+	for (i = 0; i < c_res->resarray.resarray_len; i++)
+		nfs4_Compound_FreeOne(&slot->uncached_res[i]);
+
+	c_res->resarray.resarray_val = NULL;
+	c_res->resarray.resarray_len = 0;
+
+	gsh_free(c_res->tag.utf8string_val);
+	c_res->tag.utf8string_val = NULL;
+}
+
 bool check_session_conn(nfs41_session_t *session,
 			compound_data_t *data,
 			bool can_associate)
@@ -505,4 +552,246 @@ retry:
 	return true;
 }
 
+/**
+ * @brief Get a forechannel slot, allocating it on first use
+ *
+ * Slots are never freed before the session is, so the pointer stays
+ * good for as long as the caller holds a session reference.
+ *
+ * @param[in] session The session
+ * @param[in] slotid  The slot, less than session->nb_slots
+ *
+ * @return The slot.
+ */
+
+nfs41_session_slot_t *nfs41_session_get_slot(nfs41_session_t *session,
+					     slotid4 slotid)
+{
+	nfs41_session_slot_t *slot;
+
+	slot = atomic_fetch_voidptr((void **)&session->fc_slots[slotid]);
+	if (slot != NULL)
+		return slot;
+
+	PTHREAD_MUTEX_lock(&session->slot_lock);
+
+	slot = session->fc_slots[slotid];
+	if (slot == NULL) {
+		slot = gsh_calloc(1, sizeof(*slot));
+		PTHREAD_MUTEX_init(&slot->lock, NULL);
+		atomic_store_voidptr((void **)&session->fc_slots[slotid],
+				     slot);
+	}
+
+	PTHREAD_MUTEX_unlock(&session->slot_lock);
+
+	return slot;
+}
+
+/**
+ * @brief Number of slots the server would like a session to use
+ *
+ * All of them when the server is idle, half as many while the
+ * request queue is more than twice the number of workers, and a
+ * quarter as many while memory is short.
+ *
+ * @param[in] session The session
+ *
+ * @return The target number of slots, at least one.
+ */
+
+uint32_t nfs41_session_slot_target(nfs41_session_t *session)
+{
+	uint32_t pct = atomic_fetch_uint32_t(&slot_memory_pct);
+	uint64_t depth = nfs_health_.enqueued_reqs - nfs_health_.dequeued_reqs;
+	uint32_t target;
+
+	if (depth > 2 * (uint64_t) nfs_param.core_param.nb_worker)
+		pct /= 2;
+
+	target = (uint64_t) session->nb_slots * pct / 100;
+
+	return target > 0 ? target : 1;
+}
+
+/**
+ * @brief Grow or shrink the slots a session offers
+ *
+ * Growing just raises highest_slot; the slots are allocated as the
+ * client uses them.  Shrinking waits until the client has stopped
+ * using the slots above the target (its sa_highest_slotid), and then
+ * drops their cached replies and resets their sequence so that a
+ * regrown slot starts over at seqid 1.  A slot still in use stops the
+ * shrink there; the next SEQUENCE will try again.
+ *
+ * @param[in] session        The session
+ * @param[in] client_highest The client's sa_highest_slotid
+ * @param[in] target         Target number of slots
+ */
+
+void nfs41_session_adjust_slots(nfs41_session_t *session,
+				slotid4 client_highest, uint32_t target)
+{
+	uint32_t highest = atomic_fetch_uint32_t(&session->highest_slot);
+	uint32_t floor;
+
+	if (target > session->nb_slots)
+		target = session->nb_slots;
+
+	if (target - 1 == highest ||
+	    (target - 1 < highest && client_highest >= highest))
+		return;
+
+	PTHREAD_MUTEX_lock(&session->slot_lock);
+
+	highest = session->highest_slot;
+
+	if (target - 1 > highest) {
+		LogDebug(COMPONENT_SESSIONS,
+			 "Session %p growing to %" PRIu32 " slots",
+			 session, target);
+		atomic_store_uint32_t(&session->highest_slot, target - 1);
+		goto out;
+	}
+
+	floor = MAX(target - 1, client_highest);
+
+	while (highest > floor) {
+		nfs41_session_slot_t *slot = session->fc_slots[highest];
+
+		if (slot != NULL) {
+			if (pthread_mutex_trylock(&slot->lock) != 0)
+				break;
+
+			if (slot->suspended) {
+				PTHREAD_MUTEX_unlock(&slot->lock);
+				break;
+			}
+
+			nfs41_Session_Slot_Release(slot);
+			slot->sequence = 0;
+			PTHREAD_MUTEX_unlock(&slot->lock);
+		}
+
+		highest--;
+	}
+
+	if (highest != session->highest_slot) {
+		LogDebug(COMPONENT_SESSIONS,
+			 "Session %p shrinking to %" PRIu32 " slots",
+			 session, highest + 1);
+		atomic_store_uint32_t(&session->highest_slot, highest);
+	}
+
+out:
+	PTHREAD_MUTEX_unlock(&session->slot_lock);
+}
+
+/**
+ * @brief Completion for CB_RECALL_SLOT
+ *
+ * @param[in] call The finished call
+ */
+
+static void recall_slot_completion(rpc_call_t *call)
+{
+	LogFullDebug(COMPONENT_NFS_CB, "CB_RECALL_SLOT status %d",
+		     call->cbt.v_u.v4.res.status);
+
+	nfs41_release_single(call);
+}
+
+/**
+ * @brief Ask a client with too many slots to give some back
+ *
+ * @param[in] clientid The client
+ * @param[in] state    Unused
+ *
+ * @return true.
+ */
+
+static bool recall_slot_client_callback(nfs_client_id_t *clientid,
+					void *state)
+{
+	struct glist_head *glist;
+	nfs41_session_t *session;
+	nfs_cb_argop4 op;
+	uint32_t target = 0;
+	uint32_t slots = 0;
+
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+
+	glist_for_each(glist, &clientid->cid_cb.v41.cb_session_list) {
+		session = glist_entry(glist, nfs41_session_t, session_link);
+
+		slots = MAX(slots,
+			    atomic_fetch_uint32_t(&session->highest_slot) + 1);
+		target = MAX(target, nfs41_session_slot_target(session));
+	}
+
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+	if (slots <= target)
+		return true;
+
+	LogDebug(COMPONENT_SESSIONS,
+		 "Recalling slots of client %" PRIx64 " down to %" PRIu32,
+		 clientid->cid_clientid, target);
+
+	memset(&op, 0, sizeof(op));
+	op.argop = NFS4_OP_CB_RECALL_SLOT;
+	op.nfs_cb_argop4_u.opcbrecall_slot.rsa_target_highest_slotid =
+		target - 1;
+
+	(void) nfs_rpc_cb_single(clientid, &op, NULL,
+				 recall_slot_completion, NULL);
+
+	return true;
+}
+
+/**
+ * @brief Check memory and recall session slots when it is short
+ *
+ * Called periodically by the reaper.  Memory is short when less than
+ * a tenth of it is available; clients are then sent CB_RECALL_SLOT
+ * rather than waiting for their next SEQUENCE to see the lower
+ * target.
+ */
+
+void nfs41_session_update_slot_target(void)
+{
+	FILE *fp = fopen("/proc/meminfo", "r");
+	char line[128];
+	uint64_t total = 0, avail = 0, val;
+	uint32_t pct;
+
+	if (fp == NULL)
+		return;
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "MemTotal: %" SCNu64, &val) == 1)
+			total = val;
+		else if (sscanf(line, "MemAvailable: %" SCNu64, &val) == 1)
+			avail = val;
+	}
+
+	fclose(fp);
+
+	if (total == 0)
+		return;
+
+	pct = avail < total / 10 ? 25 : 100;
+
+	if (atomic_fetch_uint32_t(&slot_memory_pct) != pct) {
+		LogEvent(COMPONENT_SESSIONS,
+			 "Memory %s, offering %" PRIu32 "%% of session slots",
+			 pct < 100 ? "short" : "recovered", pct);
+		atomic_store_uint32_t(&slot_memory_pct, pct);
+	}
+
+	if (pct < 100)
+		nfs41_foreach_client_callback(recall_slot_client_callback,
+					      NULL);
+}
+
 /** @} */
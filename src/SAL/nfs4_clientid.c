@@ -573,6 +573,7 @@ nfs_client_id_t *create_client_id(clientid4 clientid,
 	/* need to init the list_head */
 	glist_init(&client_rec->cid_openowners);
 	glist_init(&client_rec->cid_lockowners);
+	glist_init(&client_rec->cid_cb_queue);
 
 	/* set up the content of the clientid_owner */
 	owner->so_type = STATE_CLIENTID_OWNER_NFSV4;
@@ -636,6 +637,10 @@ clientid_status_t nfs_client_id_insert(nfs_client_id_t *clientid)
 	/* Take a reference to the unconfirmed clientid for the hash table. */
 	(void)inc_client_id_ref(clientid);
 
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	lease_wheel_queue(clientid);
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
 	if (isFullDebug(COMPONENT_CLIENTID) &&
 	    isFullDebug(COMPONENT_HASHTABLE)) {
 		LogFullDebug(COMPONENT_CLIENTID,
@@ -683,6 +688,8 @@ int remove_confirmed_client_id(nfs_client_id_t *clientid)
 	/* Set this up so this client id record will be freed. */
 	clientid->cid_confirmed = EXPIRED_CLIENT_ID;
 
+	lease_wheel_remove(clientid);
+
 	/* Release hash table reference to the unconfirmed record */
 	(void)dec_client_id_ref(clientid);
 
@@ -727,6 +734,8 @@ int remove_unconfirmed_client_id(nfs_client_id_t *clientid)
 	/* Set this up so this client id record will be freed. */
 	clientid->cid_confirmed = EXPIRED_CLIENT_ID;
 
+	lease_wheel_remove(clientid);
+
 	/* Release hash table reference to the unconfirmed record */
 	(void)dec_client_id_ref(clientid);
 
@@ -906,6 +915,8 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 		LogDebug(COMPONENT_CLIENTID, "Expiring {%s}", str);
 	}
 
+	end_courtesy_lease(clientid);
+
 	if ((clientid->cid_confirmed == CONFIRMED_CLIENT_ID) ||
 	    (clientid->cid_confirmed == STALE_CLIENT_ID))
 		ht_expire = ht_confirmed_client_id;
@@ -1126,6 +1137,10 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 			atomic_dec_int32_t(&reclaim_completes);
 	}
 
+	/* Nor is it still one of the clients reclaiming */
+	if (clientid->cid_allow_reclaim)
+		atomic_dec_int32_t(&reclaim_starts);
+
 	if (clientid->cid_recov_tag != NULL && !make_stale) {
 		nfs4_rm_clid(clientid);
 		gsh_free(clientid->cid_recov_tag);
@@ -1141,8 +1156,10 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 	}
 
 	/* Release the hash table reference to the clientid. */
-	if (!make_stale)
+	if (!make_stale) {
+		lease_wheel_remove(clientid);
 		(void)dec_client_id_ref(clientid);
+	}
 
 	if (isFullDebug(COMPONENT_CLIENTID)) {
 		if (!str_valid)
@@ -1260,6 +1277,24 @@ clientid_status_t nfs_client_id_get_confirmed(clientid4 clientid,
 	return nfs_client_id_get(ht_confirmed_client_id, clientid, client_rec);
 }
 
+static void client_id_count_cb(struct hash_data *addr, void *arg)
+{
+	(*(uint64_t *)arg)++;
+}
+
+/**
+ * @brief Count the confirmed client ids
+ *
+ * @return The count, which may already be off by the time it is used.
+ */
+uint64_t nfs_client_id_count_confirmed(void)
+{
+	uint64_t count = 0;
+
+	hashtable_for_each(ht_confirmed_client_id, client_id_count_cb, &count);
+	return count;
+}
+
 static hash_parameter_t cid_confirmed_hash_param = {
 	.index_size = PRIME_STATE,
 	.hash_func_key = client_id_value_hash_func,
@@ -1336,6 +1371,9 @@ int nfs_Init_client_id(void)
 
 	client_id_pool =
 	    pool_basic_init("NFS4 Client ID Pool", sizeof(nfs_client_id_t));
+	pool_set_mem_tag(client_id_pool, MEM_TAG_STATE);
+
+	lease_wheel_init();
 
 	return CLIENT_ID_SUCCESS;
 }
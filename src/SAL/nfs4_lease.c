@@ -40,6 +40,188 @@
 #include "nfs4.h"
 #include "sal_functions.h"
 
+/**
+ * @brief Number of one second slots in the lease wheel
+ *
+ * Must be a power of 2 greater than the longest Lease_Lifetime, so that a
+ * lease never expires further out than one turn of the wheel.
+ */
+#define LEASE_WHEEL_SLOTS 256
+
+/**
+ * @brief Clientids hashed by the second their lease is next due
+ *
+ * Every hashed clientid sits in the slot for cid_lease_expire, and the
+ * wheel holds a reference to it.  The reaper only visits the slots for
+ * the seconds that passed since its last run, instead of every clientid.
+ * A clientid may be visited before its lease is really over (it renewed
+ * without moving), the reaper just queues it again.
+ */
+static struct lease_wheel {
+	pthread_mutex_t mutex;
+	/** Last second whose slot was moved to due */
+	time_t time;
+	/** Clientids taken off the wheel, to be checked by the reaper */
+	struct glist_head due;
+	struct glist_head slots[LEASE_WHEEL_SLOTS];
+} lease_wheel;
+
+/** Clients keeping their state with their lease run out, atomic */
+static uint32_t courtesy_clients;
+
+static inline struct glist_head *lease_wheel_slot(time_t when)
+{
+	return &lease_wheel.slots[when & (LEASE_WHEEL_SLOTS - 1)];
+}
+
+/**
+ * @brief Put a clientid in the slot for a time, with the mutex held
+ */
+static void lease_wheel_insert(nfs_client_id_t *clientid, time_t when)
+{
+	time_t now = time(NULL);
+
+	if (when > now + LEASE_WHEEL_SLOTS - 1)
+		when = now + LEASE_WHEEL_SLOTS - 1;
+
+	clientid->cid_lease_expire = when;
+
+	if (when <= lease_wheel.time)
+		glist_add_tail(&lease_wheel.due, &clientid->cid_lease_list);
+	else
+		glist_add_tail(lease_wheel_slot(when),
+			       &clientid->cid_lease_list);
+}
+
+/**
+ * @brief Initialize the lease wheel
+ */
+void lease_wheel_init(void)
+{
+	int i;
+
+	PTHREAD_MUTEX_init(&lease_wheel.mutex, NULL);
+	lease_wheel.time = time(NULL);
+	glist_init(&lease_wheel.due);
+
+	for (i = 0; i < LEASE_WHEEL_SLOTS; i++)
+		glist_init(&lease_wheel.slots[i]);
+}
+
+/**
+ * @brief Queue a clientid for the time its lease runs out
+ *
+ * The wheel takes a reference if the clientid was not on it yet.  The
+ * lease fields may be read while they change, the reaper checks the lease
+ * again when the clientid comes due.
+ *
+ * @param[in] clientid Clientid to queue
+ */
+void lease_wheel_queue(nfs_client_id_t *clientid)
+{
+	time_t expire;
+
+	if (clientid->cid_confirmed == EXPIRED_CLIENT_ID)
+		return;
+
+	if (clientid->cid_courtesy_conflict)
+		expire = time(NULL);
+	else if (clientid->cid_courtesy != 0)
+		expire = clientid->cid_courtesy +
+			 nfs_param.nfsv4_param.courtesy_max_time;
+	else if (atomic_fetch_int32_t(&clientid->cid_lease_reservations) != 0)
+		expire = time(NULL) + nfs_param.nfsv4_param.lease_lifetime;
+	else
+		expire = atomic_fetch_time_t(&clientid->cid_last_renew) +
+			 nfs_param.nfsv4_param.lease_lifetime;
+
+	/* Nothing to move, renewals within a second land in one slot */
+	if (atomic_fetch_time_t(&clientid->cid_lease_expire) == expire &&
+	    !glist_null(&clientid->cid_lease_list))
+		return;
+
+	PTHREAD_MUTEX_lock(&lease_wheel.mutex);
+
+	if (glist_null(&clientid->cid_lease_list))
+		inc_client_id_ref(clientid);
+	else
+		glist_del(&clientid->cid_lease_list);
+
+	lease_wheel_insert(clientid, expire);
+
+	PTHREAD_MUTEX_unlock(&lease_wheel.mutex);
+}
+
+/**
+ * @brief Take a clientid off the lease wheel
+ *
+ * Drops the wheel's reference, so the caller must hold one of its own.
+ *
+ * @param[in] clientid Clientid that is going away
+ */
+void lease_wheel_remove(nfs_client_id_t *clientid)
+{
+	bool queued;
+
+	PTHREAD_MUTEX_lock(&lease_wheel.mutex);
+
+	queued = !glist_null(&clientid->cid_lease_list);
+	glist_del(&clientid->cid_lease_list);
+
+	PTHREAD_MUTEX_unlock(&lease_wheel.mutex);
+
+	if (queued)
+		(void)dec_client_id_ref(clientid);
+}
+
+/**
+ * @brief Get the next clientid whose lease is due
+ *
+ * The wheel's reference is handed to the caller, who must check the lease
+ * and either expire the clientid or queue it again before releasing it.
+ *
+ * @return A clientid or NULL when none is due.
+ */
+nfs_client_id_t *lease_wheel_next_due(void)
+{
+	nfs_client_id_t *clientid;
+	time_t now = time(NULL);
+
+	PTHREAD_MUTEX_lock(&lease_wheel.mutex);
+
+	while (true) {
+		clientid = glist_first_entry(&lease_wheel.due,
+					     nfs_client_id_t,
+					     cid_lease_list);
+
+		if (clientid == NULL) {
+			if (lease_wheel.time >= now)
+				break;
+
+			/* After a long stall, one turn covers every slot */
+			if (now - lease_wheel.time > LEASE_WHEEL_SLOTS)
+				lease_wheel.time = now - LEASE_WHEEL_SLOTS;
+
+			lease_wheel.time++;
+			glist_splice_tail(&lease_wheel.due,
+					  lease_wheel_slot(lease_wheel.time));
+			continue;
+		}
+
+		glist_del(&clientid->cid_lease_list);
+
+		if (clientid->cid_lease_expire <= now)
+			break;
+
+		/* Shares the slot with a later turn of the wheel */
+		lease_wheel_insert(clientid, clientid->cid_lease_expire);
+	}
+
+	PTHREAD_MUTEX_unlock(&lease_wheel.mutex);
+
+	return clientid;
+}
+
 /**
  * @brief Return the lifetime of a valid lease
  *
@@ -51,17 +233,19 @@ static unsigned int _valid_lease(nfs_client_id_t *clientid)
 {
 	time_t t;
 
+	time_t last_renew;
+
 	if (clientid->cid_confirmed == EXPIRED_CLIENT_ID)
 		return 0;
 
-	if (clientid->cid_lease_reservations != 0)
+	if (atomic_fetch_int32_t(&clientid->cid_lease_reservations) != 0)
 		return nfs_param.nfsv4_param.lease_lifetime;
 
 	t = time(NULL);
+	last_renew = atomic_fetch_time_t(&clientid->cid_last_renew);
 
-	if (clientid->cid_last_renew + nfs_param.nfsv4_param.lease_lifetime > t)
-		return (clientid->cid_last_renew +
-			nfs_param.nfsv4_param.lease_lifetime) - t;
+	if (last_renew + nfs_param.nfsv4_param.lease_lifetime > t)
+		return (last_renew + nfs_param.nfsv4_param.lease_lifetime) - t;
 
 	return 0;
 }
@@ -112,8 +296,20 @@ int reserve_lease(nfs_client_id_t *clientid)
 
 	valid = _valid_lease(clientid);
 
+	if (valid == 0 && clientid->cid_courtesy != 0 &&
+	    !clientid->cid_courtesy_conflict &&
+	    clientid->cid_confirmed == CONFIRMED_CLIENT_ID) {
+		/* A courtesy client back, its state is still all there */
+		LogDebug(COMPONENT_CLIENTID,
+			 "Courtesy clientid %" PRIx64 " is back",
+			 clientid->cid_clientid);
+		end_courtesy_lease(clientid);
+		atomic_store_time_t(&clientid->cid_last_renew, time(NULL));
+		valid = nfs_param.nfsv4_param.lease_lifetime;
+	}
+
 	if (valid != 0)
-		clientid->cid_lease_reservations++;
+		(void)atomic_inc_int32_t(&clientid->cid_lease_reservations);
 
 	if (isFullDebug(COMPONENT_CLIENTID)) {
 		char str[LOG_BUFF_LEN] = "\0";
@@ -128,6 +324,45 @@ int reserve_lease(nfs_client_id_t *clientid)
 	return valid != 0;
 }
 
+/**
+ * @brief Reserve a lease without taking cid_mutex if it is well clear of
+ *        expiry
+ *
+ * The reservation is taken first, which keeps the reaper off the lease, so
+ * a lease found with more than a quarter of its lifetime left cannot be
+ * in the middle of expiring.  Anything closer to expiry, or an expired
+ * clientid, is settled by reserve_lease() under cid_mutex.
+ *
+ * The caller must NOT hold cid_mutex.
+ *
+ * @param[in] clientid Client record to check lease for
+ *
+ * @return true if the lease is valid and reserved.
+ */
+bool reserve_lease_fast(nfs_client_id_t *clientid)
+{
+	time_t last_renew;
+	int valid;
+
+	(void)atomic_inc_int32_t(&clientid->cid_lease_reservations);
+
+	last_renew = atomic_fetch_time_t(&clientid->cid_last_renew);
+
+	if (clientid->cid_confirmed != EXPIRED_CLIENT_ID &&
+	    last_renew + nfs_param.nfsv4_param.lease_lifetime -
+	    nfs_param.nfsv4_param.lease_lifetime / 4 > time(NULL))
+		return true;
+
+	/* Near expiry or being reaped, do it the careful way */
+	(void)atomic_dec_int32_t(&clientid->cid_lease_reservations);
+
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	valid = reserve_lease(clientid);
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+	return valid != 0;
+}
+
 /**
  * @brief Release a lease reservation and update lease.
  *
@@ -135,6 +370,8 @@ int reserve_lease(nfs_client_id_t *clientid)
  * function releases the lease reservation. Before releasing the last
  * reservation, cid_last_renew will be updated.
  *
+ * This does not need cid_mutex, callers may or may not hold it.
+ *
  * @param[in] clientid Clientid record to update
  *
  * @return 1 if lease is valid, 0 if not.
@@ -142,11 +379,13 @@ int reserve_lease(nfs_client_id_t *clientid)
  */
 void update_lease(nfs_client_id_t *clientid)
 {
-	clientid->cid_lease_reservations--;
+	/* Renew lease before the last reservation can be released, so the
+	 * reaper never sees no reservation with the old renewal time.
+	 */
+	atomic_store_time_t(&clientid->cid_last_renew, time(NULL));
 
-	/* Renew lease when last reservation is released */
-	if (clientid->cid_lease_reservations == 0)
-		clientid->cid_last_renew = time(NULL);
+	if (atomic_dec_int32_t(&clientid->cid_lease_reservations) == 0)
+		lease_wheel_queue(clientid);
 
 	if (isFullDebug(COMPONENT_CLIENTID)) {
 		char str[LOG_BUFF_LEN] = "\0";
@@ -157,4 +396,121 @@ void update_lease(nfs_client_id_t *clientid)
 	}
 }
 
+/**
+ * @brief Decide whether a clientid whose lease ran out keeps its state
+ *
+ * With Courteous_Server, a clientid with state becomes a courtesy
+ * client rather than expiring, as long as there are fewer than
+ * Max_Courtesy_Clients.  It stays one until another client conflicts
+ * with its state or Courtesy_Max_Time passes, or until it comes back
+ * and reserves its lease again.
+ *
+ * The caller must hold cid_mutex.
+ *
+ * @param[in] clientid Clientid whose lease is not valid
+ *
+ * @return true if the clientid is to be kept, false to expire it.
+ */
+bool keep_courtesy_lease(nfs_client_id_t *clientid)
+{
+	if (clientid->cid_courtesy != 0)
+		return !clientid->cid_courtesy_conflict &&
+		       time(NULL) < clientid->cid_courtesy +
+				    nfs_param.nfsv4_param.courtesy_max_time;
+
+	if (!nfs_param.nfsv4_param.courteous_server ||
+	    clientid->cid_confirmed != CONFIRMED_CLIENT_ID ||
+	    !client_id_has_state(clientid))
+		return false;
+
+	if (atomic_inc_uint32_t(&courtesy_clients) >
+	    nfs_param.nfsv4_param.max_courtesy_clients) {
+		(void)atomic_dec_uint32_t(&courtesy_clients);
+		return false;
+	}
+
+	clientid->cid_courtesy = time(NULL);
+
+	LogDebug(COMPONENT_CLIENTID,
+		 "Clientid %" PRIx64 " keeps its state as a courtesy client",
+		 clientid->cid_clientid);
+
+	return true;
+}
+
+/**
+ * @brief Have a courtesy client expired, another client conflicting
+ *
+ * The state can't go right here, since whoever conflicts with it holds
+ * locks its removal needs.  The reaper is woken to expire the clientid
+ * instead, and the conflicting request should be retried.
+ *
+ * The caller must hold cid_mutex.
+ *
+ * @param[in] clientid Clientid holding the conflicting state
+ *
+ * @return true if the clientid is a courtesy client, now on its way out.
+ */
+bool expire_courtesy_lease(nfs_client_id_t *clientid)
+{
+	if (clientid->cid_courtesy == 0)
+		return false;
+
+	if (!clientid->cid_courtesy_conflict) {
+		LogDebug(COMPONENT_CLIENTID,
+			 "Conflict with courtesy clientid %" PRIx64
+			 ", expiring it", clientid->cid_clientid);
+		clientid->cid_courtesy_conflict = true;
+		lease_wheel_queue(clientid);
+		reaper_wake();
+	}
+
+	return true;
+}
+
+/**
+ * @brief Stop counting a clientid as a courtesy client
+ *
+ * The caller must hold cid_mutex.
+ *
+ * @param[in] clientid Clientid that is back or expiring
+ */
+void end_courtesy_lease(nfs_client_id_t *clientid)
+{
+	if (clientid->cid_courtesy == 0)
+		return;
+
+	clientid->cid_courtesy = 0;
+	(void)atomic_dec_uint32_t(&courtesy_clients);
+}
+
+/**
+ * @brief Have the courtesy client of an owner expired, if it is one
+ *
+ * @param[in] owner Owner of state another client conflicts with
+ *
+ * @return true if the owner's client is a courtesy client, on its way
+ *         out, so that the conflicting request should be retried.
+ */
+bool state_owner_courtesy_conflict(state_owner_t *owner)
+{
+	nfs_client_id_t *clientid;
+	bool courtesy;
+
+	if (owner->so_type != STATE_OPEN_OWNER_NFSV4 &&
+	    owner->so_type != STATE_LOCK_OWNER_NFSV4 &&
+	    owner->so_type != STATE_CLIENTID_OWNER_NFSV4)
+		return false;
+
+	clientid = owner->so_owner.so_nfs4_owner.so_clientrec;
+	if (clientid == NULL)
+		return false;
+
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	courtesy = expire_courtesy_lease(clientid);
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+	return courtesy;
+}
+
 /** @} */
@@ -349,7 +349,7 @@ static hash_parameter_t nfs4_owner_param = {
 	.compare_key = compare_nfs4_owner_key,
 	.key_to_str = display_nfs4_owner_key,
 	.val_to_str = display_nfs4_owner_val,
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_OPEN,
 };
 
 /**
@@ -67,6 +67,7 @@ static uint32_t	grace_status;
 
 static struct nfs4_recovery_backend *recovery_backend;
 int32_t reclaim_completes; /* atomic */
+int32_t reclaim_starts; /* atomic, clients from clid_list seen this grace */
 
 static void nfs4_recovery_load_clids(nfs_grace_start_t *gsp);
 static void nfs_release_nlm_state(char *release_ip);
@@ -105,6 +106,7 @@ void nfs4_cleanup_clid_entries(void)
 	}
 	assert(clid_count == 0);
 	atomic_store_int32_t(&reclaim_completes, 0);
+	atomic_store_int32_t(&reclaim_starts, 0);
 }
 
 /*
@@ -411,10 +413,91 @@ int nfs_recovery_get_nodeid(char **pnodeid)
 	return rc;
 }
 
+/**
+ * @brief Tell the other nodes of the cluster how loaded this one is
+ *
+ * Singleton servers have nobody to tell.
+ *
+ * @param[in] load Confirmed clients of this node
+ */
+void nfs_recovery_publish_load(uint64_t load)
+{
+	if (recovery_backend->publish_load)
+		recovery_backend->publish_load(load);
+}
+
+/**
+ * @brief Find the least loaded other node of the cluster
+ *
+ * Caller must free the returned server with gsh_free.
+ *
+ * @param[out] pload   Its load
+ * @param[out] pserver Server clients are referred to for it
+ *
+ * @return 0 on success, -ENOTSUP if the backend keeps no load view,
+ *         other negative POSIX error codes if no peer was found.
+ */
+int nfs_recovery_least_loaded_peer(uint64_t *pload, char **pserver)
+{
+	if (!recovery_backend->least_loaded_peer)
+		return -ENOTSUP;
+	return recovery_backend->least_loaded_peer(pload, pserver);
+}
+
+/**
+ * @brief Seconds the early lift must wait, see Min_Grace_Period
+ */
+static uint32_t nfs_min_grace_period(void)
+{
+	if (nfs_param.nfsv4_param.min_grace_period != 0)
+		return nfs_param.nfsv4_param.min_grace_period;
+	return nfs_param.nfsv4_param.lease_lifetime;
+}
+
+/**
+ * @brief Seconds since the grace period started
+ *
+ * Caller must hold grace_mutex.
+ */
+static uint32_t nfs_grace_elapsed(void)
+{
+	struct timespec now;
+	int ret = clock_gettime(CLOCK_MONOTONIC, &now);
+
+	if (ret != 0) {
+		LogCrit(COMPONENT_MAIN, "Failed to get timestamp");
+		assert(0);
+	}
+
+	if (gsh_time_cmp(&now, &current_grace) <= 0)
+		return 0;
+	return now.tv_sec - current_grace.tv_sec;
+}
+
+/**
+ * @brief Report how far reclaim has got in the current grace period
+ *
+ * @param[out] progress Reclaim counters and timing
+ */
+void nfs_get_grace_progress(struct grace_progress *progress)
+{
+	PTHREAD_MUTEX_lock(&grace_mutex);
+	progress->in_grace = nfs_in_grace();
+	progress->elapsed = progress->in_grace ? nfs_grace_elapsed() : 0;
+	progress->grace_period = nfs_param.nfsv4_param.grace_period;
+	progress->min_grace_period = nfs_min_grace_period();
+	progress->expected = clid_count;
+	progress->started = atomic_fetch_int32_t(&reclaim_starts);
+	progress->completed = atomic_fetch_int32_t(&reclaim_completes);
+	PTHREAD_MUTEX_unlock(&grace_mutex);
+}
+
 void nfs_try_lift_grace(void)
 {
 	bool in_grace = true;
 	int32_t rc_count = 0;
+	int32_t rs_count;
+	uint32_t elapsed;
 	uint32_t cur, old, pro;
 
 	/* Already lifted? Just return */
@@ -430,21 +513,31 @@ void nfs_try_lift_grace(void)
 	if (!nfs_param.core_param.enable_NLM)
 		in_grace = (rc_count != clid_count);
 
-	/* Otherwise, wait for the timeout */
-	if (in_grace) {
-		struct timespec timeout, now;
-		int ret = clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = nfs_grace_elapsed();
 
-		if (ret != 0) {
-			LogCrit(COMPONENT_MAIN, "Failed to get timestamp");
-			assert(0);
+	/*
+	 * Clients in the recovery db that are still alive come back within
+	 * a lease period or so. Once that has passed, and every client that
+	 * did come back has sent RECLAIM_COMPLETE, the rest are taken to be
+	 * dead and there is nothing left to wait for.
+	 */
+	if (in_grace && !nfs_param.core_param.enable_NLM &&
+	    elapsed >= nfs_min_grace_period()) {
+		rs_count = atomic_fetch_int32_t(&reclaim_starts);
+		if (rc_count == rs_count) {
+			LogEvent(COMPONENT_STATE,
+				 "All %d reclaiming clients done after %"PRIu32
+				 "s, %d of %d recovery clients never returned",
+				 rc_count, elapsed, clid_count - rs_count,
+				 clid_count);
+			in_grace = false;
 		}
-
-		timeout = current_grace;
-		timeout.tv_sec += nfs_param.nfsv4_param.grace_period;
-		in_grace = gsh_time_cmp(&timeout, &now) > 0;
 	}
 
+	/* Otherwise, wait for the timeout */
+	if (in_grace)
+		in_grace = elapsed < nfs_param.nfsv4_param.grace_period;
+
 	/*
 	 * Ok, we're basically ready to lift. Ensure there are no outstanding
 	 * references to the current status of the grace period. If there are,
@@ -604,6 +697,8 @@ void  nfs4_chk_clid_impl(nfs_client_id_t *clientid, clid_entry_t **clid_ent_arg)
 					     "Allowed to reclaim ClientId %s",
 					     str);
 			}
+			if (!clientid->cid_allow_reclaim)
+				atomic_inc_int32_t(&reclaim_starts);
 			clientid->cid_allow_reclaim = true;
 			*clid_ent_arg = clid_ent;
 			return;
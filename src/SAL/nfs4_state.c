@@ -139,7 +139,8 @@ state_status_t _state_add_impl(struct fsal_obj_handle *obj,
 			pnew_state->stateid_other);
 
 	/* Set the type and data for this state */
-	memcpy(&(pnew_state->state_data), state_data, sizeof(*state_data));
+	memcpy(&(pnew_state->state_data), state_data,
+	       state_data_size(state_type));
 	pnew_state->state_type = state_type;
 	pnew_state->state_seqid = 0;	/* will be incremented to 1 later */
 	pnew_state->state_refcount = 2; /* sentinel plus returned ref */
@@ -202,7 +203,16 @@ state_status_t _state_add_impl(struct fsal_obj_handle *obj,
 
 	/* Add state to list for file */
 	PTHREAD_MUTEX_lock(&pnew_state->state_mutex);
-	glist_add_tail(&ostate->file.list_of_states, &pnew_state->state_list);
+	if (obj->type == DIRECTORY) {
+		glist_add_tail(&ostate->dir.list_of_states,
+			       &pnew_state->state_list);
+		if (state_type == STATE_TYPE_DELEG)
+			(void)atomic_inc_uint32_t(
+				&ostate->dir.dir_delegations);
+	} else {
+		glist_add_tail(&ostate->file.list_of_states,
+			       &pnew_state->state_list);
+	}
 	/* Get ref for this state entry */
 	obj->obj_ops->get_ref(obj);
 	PTHREAD_MUTEX_unlock(&pnew_state->state_mutex);
@@ -233,7 +243,8 @@ state_status_t _state_add_impl(struct fsal_obj_handle *obj,
 #endif
 
 	if (pnew_state->state_type == STATE_TYPE_DELEG &&
-	    pnew_state->state_data.deleg.sd_type == OPEN_DELEGATE_WRITE)
+	    pnew_state->state_data.deleg.sd_type == OPEN_DELEGATE_WRITE &&
+	    obj->type == REGULAR_FILE)
 		ostate->file.write_delegated = true;
 
 	/* Copy the result */
@@ -350,6 +361,10 @@ void _state_del_locked(state_t *state, const char *func, int line)
 	if (str_valid)
 		LogFullDebug(COMPONENT_STATE, "Deleting %s", str);
 
+	/* Out of the filesystem index while the state has its owner */
+	if (state->state_type == STATE_TYPE_LAYOUT)
+		state_layout_unindex(state);
+
 	/* Protect extraction of all the referenced objects, we don't
 	 * actually need to test them or take references because we assure
 	 * that there is exactly one state_del_locked call that proceeds
@@ -429,12 +444,17 @@ void _state_del_locked(state_t *state, const char *func, int line)
 			/* Retain the reference held by the state, and track
 			 * when this owner was last closed.
 			 */
-			PTHREAD_MUTEX_lock(&cached_open_owners_lock);
+			struct state_list_shard *shard;
+
+			shard = state_list_shard(cached_open_owners,
+						 nfs4_owner);
+
+			PTHREAD_MUTEX_lock(&shard->sls_mutex);
 
 			atomic_store_time_t(&nfs4_owner->so_cache_expire,
 					    nfs_param.nfsv4_param.lease_lifetime
 						+ time(NULL));
-			glist_add_tail(&cached_open_owners,
+			glist_add_tail(&shard->sls_list,
 				       &nfs4_owner->so_cache_entry);
 
 			if (isFullDebug(COMPONENT_STATE)) {
@@ -449,7 +469,7 @@ void _state_del_locked(state_t *state, const char *func, int line)
 					     str);
 			}
 
-			PTHREAD_MUTEX_unlock(&cached_open_owners_lock);
+			PTHREAD_MUTEX_unlock(&shard->sls_mutex);
 
 			PTHREAD_MUTEX_unlock(&owner->so_mutex);
 		} else {
@@ -469,8 +489,11 @@ void _state_del_locked(state_t *state, const char *func, int line)
 		glist_del(&state->state_data.lock.state_sharelist);
 
 	/* Reset write delegated if this is a write delegation */
-	if (state->state_type == STATE_TYPE_DELEG &&
-	    state->state_data.deleg.sd_type == OPEN_DELEGATE_WRITE)
+	if (state->state_type == STATE_TYPE_DELEG && obj->type == DIRECTORY)
+		(void) atomic_dec_uint32_t(
+				&obj->state_hdl->dir.dir_delegations);
+	else if (state->state_type == STATE_TYPE_DELEG &&
+		 state->state_data.deleg.sd_type == OPEN_DELEGATE_WRITE)
 		obj->state_hdl->file.write_delegated = false;
 
 	/* Remove from list of states for a particular export.
@@ -713,6 +736,7 @@ void release_openstate(state_owner_t *owner)
 	int errcnt = 0;
 	bool ok;
 	struct state_nfs4_owner_t *nfs4_owner = &owner->so_owner.so_nfs4_owner;
+	struct state_list_shard *shard;
 
 	if (isFullDebug(COMPONENT_STATE)) {
 		char str[LOG_BUFF_LEN] = "\0";
@@ -733,12 +757,14 @@ void release_openstate(state_owner_t *owner)
 
 		if (atomic_fetch_time_t(&nfs4_owner->so_cache_expire) != 0) {
 			/* This owner has no state, it is a cached open owner.
-			 * Take cached_open_owners_lock and verify.
+			 * Take its cached_open_owners shard mutex and verify.
 			 *
 			 * We have to check every iteration since the state
 			 * list may have become empty and we are now cached.
 			 */
-			PTHREAD_MUTEX_lock(&cached_open_owners_lock);
+			shard = state_list_shard(cached_open_owners,
+						 nfs4_owner);
+			PTHREAD_MUTEX_lock(&shard->sls_mutex);
 
 			if (atomic_fetch_time_t(&nfs4_owner->so_cache_expire)
 			    != 0) {
@@ -758,11 +784,11 @@ void release_openstate(state_owner_t *owner)
 				 */
 				PTHREAD_MUTEX_unlock(&owner->so_mutex);
 				uncache_nfs4_owner(nfs4_owner);
-				PTHREAD_MUTEX_unlock(&cached_open_owners_lock);
+				PTHREAD_MUTEX_unlock(&shard->sls_mutex);
 				return;
 			}
 
-			PTHREAD_MUTEX_unlock(&cached_open_owners_lock);
+			PTHREAD_MUTEX_unlock(&shard->sls_mutex);
 
 			/* We should be done, but will fall through anyway
 			 * to remove any remote possibility of a race with
@@ -68,6 +68,11 @@
 hash_table_t *ht_state_id;
 hash_table_t *ht_state_obj;
 
+/**
+ * @brief Bumped each time a stateid leaves ht_state_id
+ */
+static uint64_t state_id_gen;
+
 /**
  * @brief All-zeroes stateid4.other
  */
@@ -319,7 +324,7 @@ static hash_parameter_t state_id_param = {
 	.compare_key = compare_state_id,
 	.key_to_str = display_state_id_key,
 	.val_to_str = display_state_id_val,
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_OPEN,
 	.ht_log_component = COMPONENT_STATE,
 	.ht_name = "State ID Table"
 };
@@ -431,7 +436,7 @@ static hash_parameter_t state_obj_param = {
 	.compare_key = compare_state_obj,
 	.key_to_str = display_state_id_val,
 	.val_to_str = display_state_id_val,
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_OPEN,
 	.ht_log_component = COMPONENT_STATE,
 	.ht_name = "State Obj Table"
 };
@@ -561,8 +566,10 @@ state_status_t nfs4_State_Set(state_t *state)
 
 	/* If stateid is a LOCK or SHARE state, we also index by entry/owner */
 	if (state->state_type != STATE_TYPE_LOCK &&
-	    state->state_type != STATE_TYPE_SHARE)
+	    state->state_type != STATE_TYPE_SHARE) {
+		state_count_add(state->state_type);
 		return STATE_SUCCESS;
+	}
 
 	buffkey.addr = state;
 	buffkey.len = sizeof(state_t);
@@ -577,6 +584,7 @@ state_status_t nfs4_State_Set(state_t *state)
 
 	switch (err) {
 	case HASHTABLE_SUCCESS:
+		state_count_add(state->state_type);
 		return STATE_SUCCESS;
 
 	case HASHTABLE_ERROR_KEY_ALREADY_EXISTS: /* buggy client? */
@@ -655,6 +663,86 @@ struct state_t *nfs4_State_Get_Pointer(char *other)
 	return state;
 }
 
+/**
+ * @brief Get the state from a stateid a COMPOUND may have resolved before
+ *
+ * A COMPOUND keeps the last few stateids it resolved, so that ops
+ * using the same stateid do not each go to ht_state_id.  An entry is
+ * trusted only while no stateid has been deleted since it was made.
+ *
+ * @param[in]     other  stateid4.other
+ * @param[in,out] data   Compound data
+ *
+ * @returns The found state_t, referenced, or NULL if not found.
+ */
+static struct state_t *nfs4_State_Get_Cached(char *other,
+					     compound_data_t *data)
+{
+	uint64_t gen = atomic_fetch_uint64_t(&state_id_gen);
+	struct nfs4_stateid_cache *ent = NULL;
+	struct state_t *state;
+	int i;
+
+	for (i = 0; i < NFS4_STATEID_CACHE_SIZE; i++) {
+		ent = &data->stateid_cache[i];
+
+		if (ent->state == NULL ||
+		    memcmp(ent->stateid.other, other, OTHERSIZE) != 0)
+			continue;
+
+		if (ent->gen == gen) {
+			inc_state_t_ref(ent->state);
+			return ent->state;
+		}
+
+		/* A stateid was deleted since, this may be it */
+		dec_state_t_ref(ent->state);
+		ent->state = NULL;
+		break;
+	}
+
+	state = nfs4_State_Get_Pointer(other);
+
+	if (state == NULL)
+		return NULL;
+
+	if (i == NFS4_STATEID_CACHE_SIZE) {
+		ent = &data->stateid_cache[data->stateid_cache_next];
+		data->stateid_cache_next = (data->stateid_cache_next + 1) %
+					   NFS4_STATEID_CACHE_SIZE;
+
+		if (ent->state != NULL)
+			dec_state_t_ref(ent->state);
+	}
+
+	memcpy(ent->stateid.other, other, OTHERSIZE);
+	ent->gen = gen;
+	ent->state = state;
+	inc_state_t_ref(state);
+
+	return state;
+}
+
+/**
+ * @brief Release the stateids a COMPOUND has resolved
+ *
+ * @param[in,out] data   Compound data
+ */
+void nfs4_stateid_cache_release(compound_data_t *data)
+{
+	int i;
+
+	for (i = 0; i < NFS4_STATEID_CACHE_SIZE; i++) {
+		if (data->stateid_cache[i].state == NULL)
+			continue;
+
+		dec_state_t_ref(data->stateid_cache[i].state);
+		data->stateid_cache[i].state = NULL;
+	}
+
+	data->stateid_cache_next = 0;
+}
+
 /**
  * @brief Get the state from the stateid by entry/owner
  *
@@ -722,6 +810,9 @@ bool nfs4_State_Del(state_t *state)
 	buffkey.addr = state->stateid_other;
 	buffkey.len = OTHERSIZE;
 
+	/* Stop COMPOUNDs trusting the stateids they resolved */
+	(void) atomic_inc_uint64_t(&state_id_gen);
+
 	err = HashTable_Del(ht_state_id, &buffkey, &old_key, &old_value);
 
 	if (err == HASHTABLE_ERROR_NO_SUCH_KEY) {
@@ -742,6 +833,8 @@ bool nfs4_State_Del(state_t *state)
 
 	assert(state == old_value.addr);
 
+	state_count_sub(state->state_type);
+
 	/* If stateid is a LOCK or SHARE state, we had also indexed by
 	 * entry/owner
 	 */
@@ -910,7 +1003,7 @@ nfsstat4 nfs4_Check_Stateid(stateid4 *stateid, struct fsal_obj_handle *fsal_obj,
 	}
 
 	/* Try to get the related state */
-	state2 = nfs4_State_Get_Pointer(stateid->other);
+	state2 = nfs4_State_Get_Cached(stateid->other, data);
 
 	/* We also need a reference to the state_obj and state_owner.
 	 * If we can't get them, we will check below for lease invalidity.
@@ -286,6 +286,8 @@ void dec_nlm_state_ref(state_t *state)
 	if (str_valid)
 		LogFullDebug(COMPONENT_STATE, "Try to remove {%s}", str);
 
+	state_count_sub(state->state_type);
+
 	buffkey.addr = state;
 	buffkey.len = sizeof(*state);
 
@@ -508,6 +510,8 @@ int get_nlm_state(enum state_type state_type,
 		return NLM4_DENIED_NOLOCKS;
 	}
 
+	state_count_add(state->state_type);
+
 	get_gsh_export_ref(state->state_export);
 
 	inc_state_owner_ref(state->state_owner);
@@ -24,6 +24,7 @@
 
 #define RADOS_KEY_MAX_LEN	NAME_MAX
 #define RADOS_VAL_MAX_LEN	PATH_MAX
+#define DEFAULT_RADOS_LOAD_OID	"load"
 
 extern rados_t		rados_recov_cluster;
 extern rados_ioctx_t	rados_recov_io_ctx;
@@ -43,6 +44,10 @@ struct rados_kv_parameter {
 	char *grace_oid;
 	/** rados_cluster node_id */
 	char *nodeid;
+	/** rados_cluster load view OID */
+	char *load_oid;
+	/** Server peers refer clients to, defaults to node_id */
+	char *referral_server;
 };
 extern struct rados_kv_parameter rados_kv_param;
 
@@ -52,6 +57,9 @@ struct pop_args {
 	add_rfh_entry_hook add_rfh_entry;
 	bool old;
 	bool takeover;
+	/** Updates spooled by the callback, committed per page */
+	rados_write_op_t old_op;
+	rados_write_op_t recov_op;
 };
 typedef void (*pop_clid_entry_t)(char *, char *, struct pop_args *);
 
@@ -60,6 +68,7 @@ int rados_kv_connect(rados_ioctx_t *io_ctx, const char *userid,
 void rados_kv_shutdown(void);
 int rados_kv_put(char *key, char *val, char *object);
 int rados_kv_get(char *key, char *val, char *object);
+int rados_kv_del(char *key, char *object);
 void rados_kv_add_clid(nfs_client_id_t *clientid);
 void rados_kv_rm_clid(nfs_client_id_t *clientid);
 void rados_kv_add_revoke_fh(nfs_client_id_t *delr_clid, nfs_fh4 *delr_handle);
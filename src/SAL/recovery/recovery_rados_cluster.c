@@ -226,9 +226,8 @@ struct rados_cluster_kv_pairs {
  */
 #define RADOS_KV_STARTING_SLOTS		1024
 
-static void rados_set_client_cb(struct rbt_node *pn, void *arg)
+static void rados_set_client_cb(struct hash_data *addr, void *arg)
 {
-	struct hash_data *addr = RBT_OPAQ(pn);
 	nfs_client_id_t *clientid = addr->val.addr;
 	struct rados_cluster_kv_pairs *kvp = arg;
 	char ckey[RADOS_KEY_MAX_LEN];
@@ -325,6 +324,119 @@ static void rados_cluster_maybe_start_grace(void)
 	nfs_start_grace(&gsp);
 }
 
+/*
+ * The load view is the omap of load_oid, one key per nodeid, valued
+ *
+ * "<load> <time> <server>"
+ *
+ * load being the node's count of confirmed clients, time when it was
+ * published and server where peers refer clients to it.  Nodes that
+ * stopped publishing are skipped once their entry is stale.
+ */
+#define RADOS_LOAD_MAX_NODES		1024
+
+static void rados_cluster_publish_load(uint64_t load)
+{
+	int ret;
+	rados_write_op_t wop;
+	char val[RADOS_VAL_MAX_LEN];
+	const char *keys[1] = { nodeid };
+	const char *vals[1] = { val };
+	size_t lens[1];
+	const char *server = rados_kv_param.referral_server ?
+			     rados_kv_param.referral_server : nodeid;
+
+	lens[0] = snprintf(val, sizeof(val), "%" PRIu64 " %ld %s",
+			   load, (long)time(NULL), server);
+
+	wop = rados_create_write_op();
+	rados_write_op_create(wop, LIBRADOS_CREATE_IDEMPOTENT, NULL);
+	rados_write_op_omap_set(wop, keys, vals, lens, 1);
+	ret = rados_write_op_operate(wop, rados_recov_io_ctx,
+				     rados_kv_param.load_oid, NULL, 0);
+	rados_release_write_op(wop);
+	if (ret < 0)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to publish load of %s: %d", nodeid, ret);
+}
+
+static int rados_cluster_least_loaded_peer(uint64_t *pload, char **pserver)
+{
+	int ret;
+	rados_read_op_t rop;
+	rados_omap_iter_t iter;
+	unsigned char more = '\0';
+	char *key_out = NULL;
+	char *val_out = NULL;
+	size_t len_out = 0;
+	char val[RADOS_VAL_MAX_LEN];
+	char *best = NULL;
+	uint64_t best_load = 0, load;
+	long when;
+	int off;
+	time_t oldest = time(NULL) -
+			3 * nfs_param.nfsv4_param.lease_lifetime;
+
+	rop = rados_create_read_op();
+	rados_read_op_omap_get_vals2(rop, "", "", RADOS_LOAD_MAX_NODES,
+				     &iter, &more, NULL);
+	ret = rados_read_op_operate(rop, rados_recov_io_ctx,
+				    rados_kv_param.load_oid, 0);
+	if (ret < 0) {
+		rados_release_read_op(rop);
+		return ret;
+	}
+
+	for (;;) {
+		rados_omap_get_next(iter, &key_out, &val_out, &len_out);
+		if (key_out == NULL || val_out == NULL)
+			break;
+		if (strcmp(key_out, nodeid) == 0 || len_out >= sizeof(val))
+			continue;
+
+		/* Values are not NUL terminated */
+		memcpy(val, val_out, len_out);
+		val[len_out] = '\0';
+
+		off = 0;
+		if (sscanf(val, "%" SCNu64 " %ld %n", &load, &when, &off) < 2
+		    || off == 0 || val[off] == '\0' || when < oldest)
+			continue;
+
+		if (best == NULL || load < best_load) {
+			gsh_free(best);
+			best = gsh_strdup(val + off);
+			best_load = load;
+		}
+	}
+	rados_omap_get_end(iter);
+	rados_release_read_op(rop);
+
+	if (best == NULL)
+		return -ENOENT;
+
+	*pload = best_load;
+	*pserver = best;
+	return 0;
+}
+
+/* Leave the load view, so peers stop referring clients here */
+static void rados_cluster_unpublish_load(void)
+{
+	int ret;
+	rados_write_op_t wop;
+	const char *keys[1] = { nodeid };
+
+	wop = rados_create_write_op();
+	rados_write_op_omap_rm_keys(wop, keys, 1);
+	ret = rados_write_op_operate(wop, rados_recov_io_ctx,
+				     rados_kv_param.load_oid, NULL, 0);
+	rados_release_write_op(wop);
+	if (ret < 0 && ret != -ENOENT)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to remove load of %s: %d", nodeid, ret);
+}
+
 static void rados_cluster_shutdown(void)
 {
 	int		ret;
@@ -348,6 +460,9 @@ static void rados_cluster_shutdown(void)
 		LogEvent(COMPONENT_CLIENTID,
 			 "Failed to unwatch grace db: %d", ret);
 
+	if (nfs_param.nfsv4_param.dynamic_referrals)
+		rados_cluster_unpublish_load();
+
 	rados_kv_shutdown();
 	gsh_free(nodeid);
 	nodeid = NULL;
@@ -409,6 +524,8 @@ struct nfs4_recovery_backend rados_cluster_backend = {
 	.grace_enforcing = rados_cluster_grace_enforcing,
 	.is_member = rados_cluster_is_member,
 	.get_nodeid = rados_cluster_get_nodeid,
+	.publish_load = rados_cluster_publish_load,
+	.least_loaded_peer = rados_cluster_least_loaded_peer,
 };
 
 void rados_cluster_backend_init(struct nfs4_recovery_backend **backend)
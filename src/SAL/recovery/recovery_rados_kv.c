@@ -37,6 +37,10 @@ static struct config_item rados_kv_params[] = {
 		       rados_kv_parameter, grace_oid),
 	CONF_ITEM_STR("nodeid", 1, NI_MAXHOST, NULL, rados_kv_parameter,
 			nodeid),
+	CONF_ITEM_STR("load_oid", 1, NI_MAXHOST, DEFAULT_RADOS_LOAD_OID,
+		       rados_kv_parameter, load_oid),
+	CONF_ITEM_STR("referral_server", 1, NI_MAXHOST, NULL,
+		       rados_kv_parameter, referral_server),
 	CONFIG_EOL
 };
 
@@ -136,29 +140,165 @@ void rados_kv_create_val(nfs_client_id_t *clientid, char *val)
 	LogDebug(COMPONENT_CLIENTID, "Created client name [%s]", val);
 }
 
-int rados_kv_put(char *key, char *val, char *object)
+/**
+ * @brief A group of omap updates committed as one write op
+ *
+ * Updates to the same object are group committed: the first caller to
+ * find no open batch for its object becomes the batch leader.  While an
+ * earlier batch for that object is in flight, later callers append
+ * their set or remove to the open batch.  When the earlier batch
+ * completes, the leader sends everything collected in one round trip.
+ * Every caller still waits for its own update to be durable, so a
+ * caller waits for at most the round trip ahead of it plus its own.
+ */
+struct rados_kv_batch {
+	struct glist_head node;		/*< On rados_kv_batches */
+	char object[NI_MAXHOST + 6];	/*< Object the batch updates */
+	rados_write_op_t write_op;	/*< Accumulated omap updates */
+	uint32_t count;			/*< Updates in write_op */
+	uint32_t refs;			/*< Callers waiting on the batch */
+	bool sent;			/*< Leader has sent write_op */
+	bool done;			/*< write_op has completed */
+	int ret;			/*< Result of write_op */
+};
+
+#define RADOS_KV_BATCH_MAX	512	/* updates per write op */
+
+static GLIST_HEAD(rados_kv_batches);
+static pthread_mutex_t rados_kv_batch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rados_kv_batch_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * @brief Find the last batch for an object, or NULL
+ *
+ * @note rados_kv_batch_lock must be held.
+ */
+static struct rados_kv_batch *rados_kv_batch_last(const char *object)
 {
-	int ret;
-	char *keys[1];
-	char *vals[1];
+	struct glist_head *glist;
+	struct rados_kv_batch *batch, *last = NULL;
+
+	glist_for_each(glist, &rados_kv_batches) {
+		batch = glist_entry(glist, struct rados_kv_batch, node);
+		if (strcmp(batch->object, object) == 0)
+			last = batch;
+	}
+
+	return last;
+}
+
+/**
+ * @brief Check whether a batch is the oldest one for its object
+ *
+ * Batches for one object are sent in order, one at a time.
+ *
+ * @note rados_kv_batch_lock must be held.
+ */
+static bool rados_kv_batch_first(struct rados_kv_batch *batch)
+{
+	struct glist_head *glist;
+	struct rados_kv_batch *first;
+
+	glist_for_each(glist, &rados_kv_batches) {
+		first = glist_entry(glist, struct rados_kv_batch, node);
+		if (strcmp(first->object, batch->object) == 0)
+			return first == batch;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Add an omap set or remove to a batch and wait for its commit
+ *
+ * @param[in] key    Key to update
+ * @param[in] val    Value to set, NULL to remove the key
+ * @param[in] object Object holding the omap
+ *
+ * @return Result of the write op that carried the update.
+ */
+static int rados_kv_batch_write(char *key, char *val, const char *object)
+{
+	struct rados_kv_batch *batch;
+	char *keys[1] = { key };
+	char *vals[1] = { val };
 	size_t lens[1];
-	rados_write_op_t write_op;
+	bool leader = false;
+	int ret;
 
-	keys[0] = key;
-	vals[0] = val;
-	lens[0] = strlen(val);
-	write_op = rados_create_write_op();
+	PTHREAD_MUTEX_lock(&rados_kv_batch_lock);
 
-	rados_write_op_omap_set(write_op, (const char * const*)keys,
-					  (const char * const*)vals, lens, 1);
-	ret = rados_write_op_operate(write_op, rados_recov_io_ctx, object,
-				     NULL, 0);
+	batch = rados_kv_batch_last(object);
+	if (batch == NULL || batch->sent ||
+	    batch->count >= RADOS_KV_BATCH_MAX) {
+		batch = gsh_calloc(1, sizeof(*batch));
+		strlcpy(batch->object, object, sizeof(batch->object));
+		batch->write_op = rados_create_write_op();
+		glist_add_tail(&rados_kv_batches, &batch->node);
+		leader = true;
+	}
+
+	/* The write op encodes keys and values as they are added */
+	if (val != NULL) {
+		lens[0] = strlen(val);
+		rados_write_op_omap_set(batch->write_op,
+					(const char * const*)keys,
+					(const char * const*)vals, lens, 1);
+	} else {
+		rados_write_op_omap_rm_keys(batch->write_op,
+					    (const char * const*)keys, 1);
+	}
+	batch->count++;
+	batch->refs++;
+
+	if (leader) {
+		/* Collect updates while the batch ahead of us is in flight */
+		while (!rados_kv_batch_first(batch))
+			pthread_cond_wait(&rados_kv_batch_cond,
+					  &rados_kv_batch_lock);
+
+		batch->sent = true;
+		PTHREAD_MUTEX_unlock(&rados_kv_batch_lock);
+
+		LogFullDebug(COMPONENT_CLIENTID,
+			     "Committing %"PRIu32" updates to %s",
+			     batch->count, batch->object);
+		ret = rados_write_op_operate(batch->write_op,
+					     rados_recov_io_ctx,
+					     batch->object, NULL, 0);
+
+		PTHREAD_MUTEX_lock(&rados_kv_batch_lock);
+		batch->ret = ret;
+		batch->done = true;
+		glist_del(&batch->node);
+		pthread_cond_broadcast(&rados_kv_batch_cond);
+	} else {
+		while (!batch->done)
+			pthread_cond_wait(&rados_kv_batch_cond,
+					  &rados_kv_batch_lock);
+	}
+
+	ret = batch->ret;
+	if (--batch->refs == 0) {
+		rados_release_write_op(batch->write_op);
+		gsh_free(batch);
+	}
+
+	PTHREAD_MUTEX_unlock(&rados_kv_batch_lock);
+
+	return ret;
+}
+
+int rados_kv_put(char *key, char *val, char *object)
+{
+	int ret;
+
+	ret = rados_kv_batch_write(key, val, object);
 	if (ret < 0) {
 		LogEvent(COMPONENT_CLIENTID,
 			 "Failed to put kv ret=%d, key=%s, val=%s",
 			 ret, key, val);
 	}
-	rados_release_write_op(write_op);
 
 	return ret;
 }
@@ -203,69 +343,203 @@ out:
 	return ret;
 }
 
-static int rados_kv_del(char *key, char *object)
+int rados_kv_del(char *key, char *object)
 {
 	int ret;
-	char *keys[1];
-	rados_write_op_t write_op;
-
-	keys[0] = key;
-	write_op = rados_create_write_op();
 
-	rados_write_op_omap_rm_keys(write_op, (const char * const*)keys, 1);
-	ret = rados_write_op_operate(write_op, rados_recov_io_ctx, object,
-				     NULL, 0);
+	ret = rados_kv_batch_write(key, NULL, object);
 	if (ret < 0) {
 		LogEvent(COMPONENT_CLIENTID,
 			 "Failed to del kv ret=%d, key=%s",
 			 ret, key);
 	}
-	rados_release_write_op(write_op);
 
 	return ret;
 }
 
-int rados_kv_traverse(pop_clid_entry_t callback, struct pop_args *args,
-			const char *object)
+/**
+ * @brief Spool an omap set or remove onto a write op
+ *
+ * @param[in,out] write_op Write op, created on first use
+ * @param[in]     key      Key to update
+ * @param[in]     val      Value to set, NULL to remove the key
+ */
+static void rados_kv_spool(rados_write_op_t *write_op, char *key, char *val)
+{
+	char *keys[1] = { key };
+	char *vals[1] = { val };
+	size_t lens[1];
+
+	if (*write_op == NULL)
+		*write_op = rados_create_write_op();
+
+	if (val != NULL) {
+		lens[0] = strlen(val);
+		rados_write_op_omap_set(*write_op, (const char * const*)keys,
+					(const char * const*)vals, lens, 1);
+	} else {
+		rados_write_op_omap_rm_keys(*write_op,
+					    (const char * const*)keys, 1);
+	}
+}
+
+/**
+ * @brief Commit and release a spooled write op, if any
+ */
+static void rados_kv_commit_spool(rados_write_op_t *write_op,
+				  const char *object)
 {
 	int ret;
-	char *key_out = NULL;
-	char *val_out = NULL;
-	size_t val_len_out = 0;
-	bool pmore = false;
-	char *start = "";
-	rados_omap_iter_t iter_vals;
-	rados_read_op_t read_op;
 
-again:
-	read_op = rados_create_read_op();
-	rados_read_op_omap_get_vals2(read_op, start, "", MAX_ITEMS, &iter_vals,
-				     (unsigned char *)&pmore, NULL);
-	ret = rados_read_op_operate(read_op, rados_recov_io_ctx, object, 0);
+	if (*write_op == NULL)
+		return;
+
+	ret = rados_write_op_operate(*write_op, rados_recov_io_ctx, object,
+				     NULL, 0);
 	if (ret < 0) {
 		LogEvent(COMPONENT_CLIENTID,
-			 "Failed to lst kv ret=%d", ret);
-		goto out;
+			 "Failed to commit updates to %s ret=%d",
+			 object, ret);
 	}
+	rados_release_write_op(*write_op);
+	*write_op = NULL;
+}
 
-	while (true) {
-		rados_omap_get_next(iter_vals, &key_out, &val_out,
-				    &val_len_out);
-		if (val_len_out == 0 && key_out == NULL && val_out == NULL)
-			break;
-		start = key_out;
-		callback(key_out, val_out, args);
+/**
+ * @brief One paged omap listing within a traverse
+ *
+ * Keys are clientids in decimal (see rados_kv_create_key), so the key
+ * space splits into one stream per leading digit.  Each stream pages
+ * independently, which keeps RADOS_KV_STREAMS reads in flight instead
+ * of one.
+ */
+struct rados_kv_stream {
+	char prefix[2];			/*< Leading digit of the stream */
+	char *start;			/*< Last key seen, NULL at start */
+	rados_read_op_t read_op;
+	rados_completion_t comp;
+	rados_omap_iter_t iter_vals;
+	unsigned char more;		/*< Keys remain after this page */
+	int rval;			/*< Result of the omap listing */
+};
+
+#define RADOS_KV_STREAMS	10
+
+static int rados_kv_stream_read(struct rados_kv_stream *stream,
+				const char *object)
+{
+	int ret;
+
+	stream->read_op = rados_create_read_op();
+	rados_read_op_omap_get_vals2(stream->read_op,
+				     stream->start ? stream->start : "",
+				     stream->prefix, MAX_ITEMS,
+				     &stream->iter_vals, &stream->more,
+				     &stream->rval);
+
+	ret = rados_aio_create_completion(NULL, NULL, NULL, &stream->comp);
+	if (ret < 0)
+		goto err;
+
+	ret = rados_aio_read_op_operate(stream->read_op, rados_recov_io_ctx,
+					stream->comp, object, 0);
+	if (ret < 0) {
+		rados_aio_release(stream->comp);
+		goto err;
 	}
-	rados_omap_get_end(iter_vals);
 
-	/* more items, next round */
-	if (pmore) {
-		rados_release_read_op(read_op);
-		goto again;
+	return 0;
+
+err:
+	rados_release_read_op(stream->read_op);
+	stream->read_op = NULL;
+	return ret;
+}
+
+/**
+ * @brief Hand every key/value of an object to a callback
+ *
+ * All streams are started at once.  Pages are then processed in turn,
+ * on the calling thread, and each stream's next page is requested as
+ * soon as its current page has been consumed.  Updates the callback
+ * spools in @a args are committed once per page.
+ */
+int rados_kv_traverse(pop_clid_entry_t callback, struct pop_args *args,
+			const char *object)
+{
+	struct rados_kv_stream streams[RADOS_KV_STREAMS] = { { { 0 } } };
+	struct rados_kv_stream *stream;
+	char *key_out = NULL;
+	char *val_out = NULL;
+	size_t val_len_out = 0;
+	int active = 0;
+	int ret = 0, rc;
+	int i;
+
+	for (i = 0; i < RADOS_KV_STREAMS; i++) {
+		stream = &streams[i];
+		stream->prefix[0] = '0' + i;
+		rc = rados_kv_stream_read(stream, object);
+		if (rc < 0) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to lst kv ret=%d", rc);
+			ret = rc;
+			continue;
+		}
+		active++;
+	}
+
+	while (active > 0) {
+		for (i = 0; i < RADOS_KV_STREAMS; i++) {
+			stream = &streams[i];
+			if (stream->read_op == NULL)
+				continue;
+
+			rados_aio_wait_for_complete(stream->comp);
+			rc = rados_aio_get_return_value(stream->comp);
+			rados_aio_release(stream->comp);
+			if (rc == 0)
+				rc = stream->rval;
+			if (rc < 0) {
+				LogEvent(COMPONENT_CLIENTID,
+					 "Failed to lst kv ret=%d", rc);
+				ret = rc;
+				stream->more = false;
+				goto next;
+			}
+
+			while (true) {
+				rados_omap_get_next(stream->iter_vals,
+						    &key_out, &val_out,
+						    &val_len_out);
+				if (val_len_out == 0 && key_out == NULL &&
+				    val_out == NULL)
+					break;
+				gsh_free(stream->start);
+				stream->start = gsh_strdup(key_out);
+				callback(key_out, val_out, args);
+			}
+			rados_omap_get_end(stream->iter_vals);
+
+			rados_kv_commit_spool(&args->old_op,
+					      rados_recov_old_oid);
+			rados_kv_commit_spool(&args->recov_op,
+					      rados_recov_oid);
+next:
+			rados_release_read_op(stream->read_op);
+			stream->read_op = NULL;
+
+			/* more items, next round */
+			if (stream->more &&
+			    rados_kv_stream_read(stream, object) == 0)
+				continue;
+
+			gsh_free(stream->start);
+			stream->start = NULL;
+			active--;
+		}
 	}
 
-out:
-	rados_release_read_op(read_op);
 	return ret;
 }
 
@@ -459,7 +733,6 @@ void rados_kv_rm_clid(nfs_client_id_t *clientid)
 
 void rados_kv_pop_clid_entry(char *key, char *val, struct pop_args *pop_args)
 {
-	int ret;
 	char *dupval;
 	char *cl_name, *rfh_names, *rfh_name;
 	clid_entry_t *clid_ent;
@@ -483,24 +756,15 @@ void rados_kv_pop_clid_entry(char *key, char *val, struct pop_args *pop_args)
 	}
 	gsh_free(dupval);
 
-	if (!old) {
-		ret = rados_kv_put(key, val, rados_recov_old_oid);
-		if (ret < 0) {
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to move %s", key);
-		}
-	}
+	/* Moves and removals are committed by rados_kv_traverse per page */
+	if (!old)
+		rados_kv_spool(&pop_args->old_op, key, val);
 
 	if (!takeover) {
-		if (old) {
-			ret = rados_kv_del(key, rados_recov_old_oid);
-		} else {
-			ret = rados_kv_del(key, rados_recov_oid);
-		}
-		if (ret < 0) {
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to del %s", key);
-		}
+		if (old)
+			rados_kv_spool(&pop_args->old_op, key, NULL);
+		else
+			rados_kv_spool(&pop_args->recov_op, key, NULL);
 	}
 }
 
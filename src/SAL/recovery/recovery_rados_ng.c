@@ -27,7 +27,8 @@
  *
  * When lifting the grace period, synchronously commit the transaction
  * to the kvstore. After that point, all client creation and removal is done
- * synchronously to the kvstore.
+ * synchronously to the kvstore, group committed with any concurrent updates
+ * (see rados_kv_put).
  *
  * This allows for better resilience when the server crashes during the grace
  * period. No changes are made to the backing store until the grace period
@@ -47,12 +48,9 @@ static pthread_mutex_t grace_op_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static int rados_ng_put(char *key, char *val, char *object)
 {
-	int ret;
 	char *keys[1];
 	char *vals[1];
 	size_t lens[1];
-	rados_write_op_t write_op = NULL;
-	bool in_grace;
 
 	keys[0] = key;
 	vals[0] = val;
@@ -60,55 +58,34 @@ static int rados_ng_put(char *key, char *val, char *object)
 
 	/* When there is an active grace_op, spool up the changes to it */
 	PTHREAD_MUTEX_lock(&grace_op_lock);
-	in_grace = grace_op;
-	write_op = grace_op;
-	if (!write_op)
-		write_op = rados_create_write_op();
-	rados_write_op_omap_set(write_op, (const char * const*)keys,
-					  (const char * const*)vals, lens, 1);
-	PTHREAD_MUTEX_unlock(&grace_op_lock);
-	if (in_grace)
+	if (grace_op) {
+		rados_write_op_omap_set(grace_op, (const char * const*)keys,
+					(const char * const*)vals, lens, 1);
+		PTHREAD_MUTEX_unlock(&grace_op_lock);
 		return 0;
-
-	ret = rados_write_op_operate(write_op, rados_recov_io_ctx, object,
-				     NULL, 0);
-	if (ret < 0) {
-		LogEvent(COMPONENT_CLIENTID,
-			 "Failed to put kv ret=%d, key=%s, val=%s",
-			 ret, key, val);
 	}
-	rados_release_write_op(write_op);
+	PTHREAD_MUTEX_unlock(&grace_op_lock);
 
-	return ret;
+	/* Otherwise group commit it with other concurrent updates */
+	return rados_kv_put(key, val, object);
 }
 
 static int rados_ng_del(char *key, char *object)
 {
-	int ret;
 	char *keys[1];
-	rados_write_op_t write_op;
-	bool in_grace;
 
 	keys[0] = key;
 
 	PTHREAD_MUTEX_lock(&grace_op_lock);
-	in_grace = grace_op;
-	write_op = in_grace ? grace_op : rados_create_write_op();
-	rados_write_op_omap_rm_keys(write_op, (const char * const*)keys, 1);
-	PTHREAD_MUTEX_unlock(&grace_op_lock);
-
-	if (in_grace)
+	if (grace_op) {
+		rados_write_op_omap_rm_keys(grace_op,
+					    (const char * const*)keys, 1);
+		PTHREAD_MUTEX_unlock(&grace_op_lock);
 		return 0;
-
-	ret = rados_write_op_operate(write_op, rados_recov_io_ctx, object,
-				     NULL, 0);
-	if (ret < 0) {
-		LogEvent(COMPONENT_CLIENTID, "Failed to del kv ret=%d, key=%s",
-			 ret, key);
 	}
-	rados_release_write_op(write_op);
+	PTHREAD_MUTEX_unlock(&grace_op_lock);
 
-	return ret;
+	return rados_kv_del(key, object);
 }
 
 static int rados_ng_init(void)
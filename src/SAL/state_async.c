@@ -157,6 +157,7 @@ state_status_t state_async_init(void)
 	memset(&frp, 0, sizeof(struct fridgethr_params));
 	frp.thr_max = 1;
 	frp.deferment = fridgethr_defer_queue;
+	frp.ring_size = 1024;
 
 	rc = fridgethr_init(&state_async_fridge, "State_Async", &frp);
 
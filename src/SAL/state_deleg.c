@@ -72,6 +72,7 @@ void init_new_deleg_state(union state_data *deleg_state,
 
 	deleg_state->deleg.sd_type = deleg_type;
 	deleg_state->deleg.sd_state = DELEG_GRANTED;
+	deleg_state->deleg.sd_notify = 0;
 
 	clfile_entry->cfd_rs_time = 0;
 	clfile_entry->cfd_r_time = 0;
@@ -163,6 +164,12 @@ state_status_t release_lease_lock(struct fsal_obj_handle *obj, state_t *state)
 	if (owner == NULL)
 		return STATE_ESTALE;
 
+	/* Directory delegations are SAL's own, the FSAL has no lease */
+	if (obj->type != REGULAR_FILE) {
+		dec_state_owner_ref(owner);
+		return STATE_SUCCESS;
+	}
+
 	status = do_lease_op(obj, state, owner, FSAL_DELEG_NONE);
 	if (status != STATE_SUCCESS)
 		LogMajor(COMPONENT_STATE, "Unable to unlock FSAL, error=%s",
@@ -223,13 +230,27 @@ void deleg_heuristics_recall(struct fsal_obj_handle *obj,
 	struct file_deleg_stats *statistics =
 		&obj->state_hdl->file.fdeleg_stats;
 
-	statistics->fds_curr_delegations--;
-	statistics->fds_recall_count++;
-
 	/* Update delegation stats for client. */
 	dec_grants(client->gsh_client);
 	client->curr_deleg_grants--;
 
+	/* How long the client took to give back a recalled delegation */
+	if (deleg->state_data.deleg.sd_clfile_stats.cfd_r_time != 0) {
+		time_t latency = time(NULL) -
+			deleg->state_data.deleg.sd_clfile_stats.cfd_r_time;
+
+		(void) atomic_add_uint64_t(&client->cid_recall_time, latency);
+		(void) atomic_inc_uint32_t(&client->cid_recall_returns);
+		add_recall_latency(client->gsh_client, latency);
+	}
+
+	/* A directory keeps no per file stats */
+	if (obj->type != REGULAR_FILE)
+		return;
+
+	statistics->fds_curr_delegations--;
+	statistics->fds_recall_count++;
+
 	/* Update delegation stats for file. */
 	statistics->fds_avg_hold = advance_avg(statistics->fds_avg_hold,
 					   time(NULL)
@@ -266,6 +287,196 @@ bool init_deleg_heuristics(struct fsal_obj_handle *obj)
 	statistics->fds_avg_hold = 0;
 	statistics->fds_num_opens = 0;
 	statistics->fds_first_open = 0;
+	statistics->fds_win_start = 0;
+	memset(statistics->fds_win_conflicts, 0,
+	       sizeof(statistics->fds_win_conflicts));
+	memset(statistics->fds_openers, 0, sizeof(statistics->fds_openers));
+
+	return true;
+}
+
+/* How far back the delegation policy looks at a file's sharing */
+#define DELEG_HISTORY_WINDOW 60
+
+/* Conflicts within the window after which a file is not delegated */
+#define DELEG_CONFLICT_LIMIT 2
+
+/**
+ * @brief Move a file's conflict window up to now
+ *
+ * @param[in,out] statistics File delegation stats
+ * @param[in]     now        Current time
+ */
+static void deleg_window_roll(struct file_deleg_stats *statistics, time_t now)
+{
+	time_t windows = (now - statistics->fds_win_start) /
+			 DELEG_HISTORY_WINDOW;
+
+	if (windows <= 0)
+		return;
+
+	statistics->fds_win_conflicts[1] =
+		windows == 1 ? statistics->fds_win_conflicts[0] : 0;
+	statistics->fds_win_conflicts[0] = 0;
+	statistics->fds_win_start = windows > 1 ? now :
+		statistics->fds_win_start + DELEG_HISTORY_WINDOW;
+}
+
+/**
+ * @brief Estimate the conflicts on a file over the last window
+ *
+ * The previous window is weighted by how much of it still overlaps the
+ * sliding window ending now.
+ *
+ * @param[in,out] statistics File delegation stats
+ * @param[in]     now        Current time
+ *
+ * @return Estimated number of conflicts.
+ */
+static uint32_t deleg_window_conflicts(struct file_deleg_stats *statistics,
+				       time_t now)
+{
+	time_t into;
+
+	deleg_window_roll(statistics, now);
+
+	into = now - statistics->fds_win_start;
+
+	return statistics->fds_win_conflicts[0] +
+	       statistics->fds_win_conflicts[1] *
+	       (DELEG_HISTORY_WINDOW - into) / DELEG_HISTORY_WINDOW;
+}
+
+/**
+ * @brief Record an open of a file for the delegation policy
+ *
+ * Keeps the most recent distinct clients to open the file.
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in] ostate       File state
+ * @param[in] client       Client opening the file
+ * @param[in] share_access Access it opened with
+ */
+void deleg_heuristics_open(struct state_hdl *ostate, nfs_client_id_t *client,
+			   uint32_t share_access)
+{
+	struct deleg_opener *openers = ostate->file.fdeleg_stats.fds_openers;
+	struct deleg_opener *slot = &openers[0];
+	time_t now = time(NULL);
+	int i;
+
+	for (i = 0; i < DELEG_OPENERS; i++) {
+		if (openers[i].do_clientid == client->cid_clientid) {
+			slot = &openers[i];
+			break;
+		}
+		if (openers[i].do_last_open < slot->do_last_open)
+			slot = &openers[i];
+	}
+
+	if (slot->do_clientid != client->cid_clientid ||
+	    now - slot->do_last_open > DELEG_HISTORY_WINDOW)
+		slot->do_write = false;
+
+	slot->do_clientid = client->cid_clientid;
+	slot->do_last_open = now;
+	if (share_access & OPEN4_SHARE_ACCESS_WRITE)
+		slot->do_write = true;
+}
+
+/**
+ * @brief Record a conflict with a file's delegations
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in] ostate File state
+ */
+void deleg_heuristics_conflict(struct state_hdl *ostate)
+{
+	struct file_deleg_stats *statistics = &ostate->file.fdeleg_stats;
+
+	deleg_window_roll(statistics, time(NULL));
+	statistics->fds_win_conflicts[0]++;
+}
+
+/**
+ * @brief Check whether a client is slow to return recalled delegations
+ *
+ * @param[in] client Client that would own the delegation
+ *
+ * @return true if it takes more than half a lease on average.
+ */
+static bool deleg_client_is_slow(nfs_client_id_t *client)
+{
+	uint32_t lease_lifetime = nfs_param.nfsv4_param.lease_lifetime;
+	uint32_t returns;
+
+	returns = atomic_fetch_uint32_t(&client->cid_recall_returns);
+	if (returns != 0 &&
+	    atomic_fetch_uint64_t(&client->cid_recall_time) / returns >
+	    lease_lifetime / 2) {
+		LogFullDebug(COMPONENT_STATE,
+			     "Client is slow to return delegations, not delegating");
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Decide whether a delegation is likely to pay off
+ *
+ * A delegation only pays off if it is not recalled soon.  It is not
+ * granted on a file that keeps seeing conflicts, nor when other
+ * clients have recently opened the file in a way the delegation would
+ * conflict with, nor to a client that is slow to return recalled
+ * delegations.
+ *
+ * @param[in]  ostate File state
+ * @param[in]  client Client that would own the delegation
+ * @param[in]  write  Whether this would be a write delegation
+ * @param[out] why    Why not, when returning false
+ *
+ * @return true if the delegation should be granted.
+ */
+static bool deleg_policy_allows(struct state_hdl *ostate,
+				nfs_client_id_t *client, bool write,
+				why_no_delegation4 *why)
+{
+	struct file_deleg_stats *statistics = &ostate->file.fdeleg_stats;
+	time_t now = time(NULL);
+	int i;
+
+	if (deleg_window_conflicts(statistics, now) >= DELEG_CONFLICT_LIMIT) {
+		LogFullDebug(COMPONENT_STATE,
+			     "File keeps seeing conflicts, not delegating");
+		*why = WND4_CONTENTION;
+		return false;
+	}
+
+	for (i = 0; i < DELEG_OPENERS; i++) {
+		struct deleg_opener *opener = &statistics->fds_openers[i];
+
+		if (opener->do_clientid == client->cid_clientid ||
+		    opener->do_last_open == 0 ||
+		    now - opener->do_last_open > DELEG_HISTORY_WINDOW)
+			continue;
+
+		if (write || opener->do_write) {
+			LogFullDebug(COMPONENT_STATE,
+				     "File is shared with client %" PRIx64
+				     ", not delegating",
+				     opener->do_clientid);
+			*why = WND4_CONTENTION;
+			return false;
+		}
+	}
+
+	if (deleg_client_is_slow(client)) {
+		*why = WND4_RESOURCE;
+		return false;
+	}
 
 	return true;
 }
@@ -298,6 +509,8 @@ bool should_we_grant_deleg(struct state_hdl *ostate, nfs_client_id_t *client,
 	struct file_deleg_stats *file_stats = &ostate->file.fdeleg_stats;
 	/* specific client, all files stats */
 	open_claim_type4 claim = args->claim.claim;
+	/* nothing on an immutable export conflicts with reading it */
+	bool immutable_read;
 
 	LogDebug(COMPONENT_STATE, "Checking if we should grant delegation.");
 
@@ -346,12 +559,15 @@ bool should_we_grant_deleg(struct state_hdl *ostate, nfs_client_id_t *client,
 		}
 	}
 
+	immutable_read = !(args->share_access & OPEN4_SHARE_ACCESS_WRITE) &&
+			 op_ctx_export_has_option(EXPORT_OPTION_IMMUTABLE);
+
 	/* If there is a recent recall on this file, the client that made
 	 * the conflicting open may retry the open later. Don't give out
 	 * delegation to avoid starving the client's open that caused
 	 * the recall.
 	 */
-	if (file_stats->fds_last_recall != 0 &&
+	if (!immutable_read && file_stats->fds_last_recall != 0 &&
 	    time(NULL) - file_stats->fds_last_recall < RECALL2DELEG_TIME) {
 		resok->delegation.open_delegation4_u.od_whynone.ond_why =
 								WND4_CONTENTION;
@@ -365,10 +581,136 @@ bool should_we_grant_deleg(struct state_hdl *ostate, nfs_client_id_t *client,
 		return false;
 	}
 
+	if (!immutable_read &&
+	    !deleg_policy_allows(ostate, client,
+				args->share_access & OPEN4_SHARE_ACCESS_WRITE,
+				&resok->delegation.open_delegation4_u
+				.od_whynone.ond_why)) {
+		inc_recalls_avoided(client->gsh_client);
+		return false;
+	}
+
 	LogDebug(COMPONENT_STATE, "Let's delegate!!");
 	return true;
 }
 
+/**
+ * @brief Decide if a directory delegation should be granted
+ *
+ * There is no FSAL lease on a directory: the delegation holds as long
+ * as the directory only changes through this server, which notifies
+ * or recalls it, see state_dir_notify().
+ *
+ * @note The state_lock MUST be held for read
+ *
+ * @param[in] ostate Directory state
+ * @param[in] client Client that would own the delegation
+ *
+ * @return true if the delegation should be granted.
+ */
+bool should_we_grant_dir_deleg(struct state_hdl *ostate,
+			       nfs_client_id_t *client)
+{
+	/* Another client is changing the directory, let it */
+	if (ostate->dir.dir_last_recall != 0 &&
+	    time(NULL) - ostate->dir.dir_last_recall < RECALL2DELEG_TIME)
+		return false;
+
+	/* Notifications and recalls need the back channel */
+	if (get_cb_chan_down(client))
+		return false;
+
+	if (client->num_revokes > 2 || deleg_client_is_slow(client))
+		return false;
+
+	return true;
+}
+
+/**
+ * @brief Check whether a delegation is held by the client of op_ctx
+ *
+ * @param[in] state Delegation state
+ *
+ * @return true if the caller owns the delegation.
+ */
+static bool deleg_is_callers(struct state_t *state)
+{
+	state_owner_t *owner;
+	bool mine;
+
+	if (op_ctx->clientid == NULL)
+		return false;
+
+	owner = get_state_owner_ref(state);
+	if (owner == NULL)
+		return false;
+
+	mine = owner->so_owner.so_nfs4_owner.so_clientrec->cid_clientid ==
+	       *op_ctx->clientid;
+	dec_state_owner_ref(owner);
+
+	return mine;
+}
+
+/**
+ * @brief Tell the holders of directory delegations about a change
+ *
+ * Called once an entry of dir was added, removed or renamed, by any
+ * protocol.  A delegation that was granted notifications of the change
+ * gets a CB_NOTIFY, others are recalled.  The client making the change
+ * already knows of it.
+ *
+ * @param[in] dir      Directory that changed
+ * @param[in] type     NOTIFY4_ADD_ENTRY, NOTIFY4_REMOVE_ENTRY or
+ *                     NOTIFY4_RENAME_ENTRY
+ * @param[in] name     Entry added or removed, old name of a rename
+ * @param[in] new_name New name of a rename, else NULL
+ */
+void state_dir_notify(struct fsal_obj_handle *dir, notify_type4 type,
+		      const char *name, const char *new_name)
+{
+	struct state_hdl *ostate = dir->state_hdl;
+	struct glist_head *glist, *glistn;
+	struct state_t *state;
+	uint32_t need = 1 << type;
+	uint32_t notify;
+	bool recalled = false;
+
+	if (dir->type != DIRECTORY || ostate == NULL ||
+	    atomic_fetch_uint32_t(&ostate->dir.dir_delegations) == 0)
+		return;
+
+	PTHREAD_RWLOCK_wrlock(&ostate->state_lock);
+
+	glist_for_each_safe(glist, glistn, &ostate->dir.list_of_states) {
+		state = glist_entry(glist, struct state_t, state_list);
+
+		if (state->state_type != STATE_TYPE_DELEG ||
+		    state->state_data.deleg.sd_state != DELEG_GRANTED ||
+		    deleg_is_callers(state))
+			continue;
+
+		/* A rename may also be told as a remove and an add */
+		notify = state->state_data.deleg.sd_notify;
+		if (type == NOTIFY4_RENAME_ENTRY &&
+		    (notify & (1 << NOTIFY4_REMOVE_ENTRY)) &&
+		    (notify & (1 << NOTIFY4_ADD_ENTRY)))
+			notify |= need;
+
+		if ((notify & need) &&
+		    dir_notify_send(dir, state, type, name, new_name) == 0)
+			continue;
+
+		if (delegrecall_state(dir, state))
+			recalled = true;
+	}
+
+	if (recalled)
+		ostate->dir.dir_last_recall = time(NULL);
+
+	PTHREAD_RWLOCK_unlock(&ostate->state_lock);
+}
+
 /**
  * @brief Form the ACE mask for the delegated file.
  *
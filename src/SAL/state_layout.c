@@ -46,6 +46,13 @@
 #include "sal_functions.h"
 #include "nfs_core.h"
 #include "nfs_proto_tools.h"
+#include "pnfs_utils.h"
+
+/** Filesystems with layouts, and the bulk recalls outstanding on them */
+static struct glist_head layout_fsids = GLIST_HEAD_INIT(layout_fsids);
+static struct glist_head layout_recalls = GLIST_HEAD_INIT(layout_recalls);
+static pthread_mutex_t layout_fsid_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t layout_recall_id;
 
 /**
  * @brief Add a segment to an existing layout state
@@ -60,12 +67,15 @@
  * @param[in] segment         Layout segment itself granted by the FSAL
  * @param[in] fsal_data       Pointer to FSAL-specific data for this segment.
  * @param[in] return_on_close True for automatic return on last close
+ * @param[in] body            loc_body granted, copied to be handed out
+ *                            again by state_layout_cached.  May be NULL.
  *
  * @return STATE_SUCCESS on completion, other values of state_status_t
  *         on failure.
  */
 state_status_t state_add_segment(state_t *state, struct pnfs_segment *segment,
-				 void *fsal_data, bool return_on_close)
+				 void *fsal_data, bool return_on_close,
+				 const struct gsh_buffdesc *body)
 {
 	/* Pointer to the new segment being added to the state */
 	state_layout_segment_t *new_segment = NULL;
@@ -88,6 +98,12 @@ state_status_t state_add_segment(state_t *state, struct pnfs_segment *segment,
 	new_segment->sls_state = state;
 	new_segment->sls_segment = *segment;
 
+	if (body != NULL && body->len != 0) {
+		new_segment->sls_body.addr = gsh_malloc(body->len);
+		memcpy(new_segment->sls_body.addr, body->addr, body->len);
+		new_segment->sls_body.len = body->len;
+	}
+
 	glist_add_tail(&state->state_data.layout.state_segments,
 		       &new_segment->sls_state_segments);
 
@@ -112,10 +128,355 @@ state_status_t state_add_segment(state_t *state, struct pnfs_segment *segment,
 state_status_t state_delete_segment(state_layout_segment_t *segment)
 {
 	glist_del(&segment->sls_state_segments);
+	gsh_free(segment->sls_body.addr);
 	gsh_free(segment);
 	return STATE_SUCCESS;
 }
 
+/**
+ * @brief Find a granted segment to answer a LAYOUTGET again
+ *
+ * A client asking for a range it already holds a layout on (after a
+ * LAYOUTERROR, or just forgetting) is handed the layout it holds, the
+ * FSAL does not compute it again and no duplicate segment is added.
+ * A read/write layout answers a read request.
+ *
+ * @note state_lock must be held.
+ *
+ * @param[in]  state     The layout state
+ * @param[in]  io_mode   Iomode requested
+ * @param[in]  offset    Offset requested
+ * @param[in]  minlength Least length the client accepts
+ * @param[in]  maxcount  Room for the loc_body
+ * @param[out] layout    Filled in with a copy of the layout
+ *
+ * @return true if a segment covered the request.
+ */
+bool state_layout_cached(state_t *state, layoutiomode4 io_mode,
+			 offset4 offset, length4 minlength, count4 maxcount,
+			 layout4 *layout)
+{
+	struct glist_head *glist;
+
+	glist_for_each(glist, &state->state_data.layout.state_segments) {
+		state_layout_segment_t *g =
+			glist_entry(glist, state_layout_segment_t,
+				    sls_state_segments);
+		struct pnfs_segment want = {
+			.io_mode = g->sls_segment.io_mode,
+			.offset = offset,
+			.length = minlength != 0 ? minlength : 1
+		};
+
+		if (g->sls_body.len == 0 || g->sls_body.len > maxcount)
+			continue;
+
+		if (g->sls_segment.io_mode != io_mode &&
+		    !(g->sls_segment.io_mode == LAYOUTIOMODE4_RW &&
+		      io_mode == LAYOUTIOMODE4_READ))
+			continue;
+
+		if (!pnfs_segment_contains(&g->sls_segment, &want))
+			continue;
+
+		layout->lo_offset = g->sls_segment.offset;
+		layout->lo_length = g->sls_segment.length;
+		layout->lo_iomode = g->sls_segment.io_mode;
+		layout->lo_content.loc_type =
+			state->state_data.layout.state_layout_type;
+		layout->lo_content.loc_body.loc_body_val =
+			gsh_malloc(g->sls_body.len);
+		memcpy(layout->lo_content.loc_body.loc_body_val,
+		       g->sls_body.addr, g->sls_body.len);
+		layout->lo_content.loc_body.loc_body_len = g->sls_body.len;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Index a layout state by the filesystem of its file
+ *
+ * @note state_lock must be held for write.
+ *
+ * @param[in] state The new layout state
+ * @param[in] obj   Its file
+ */
+void state_layout_index(state_t *state, struct fsal_obj_handle *obj)
+{
+	struct state_layout *layout = &state->state_data.layout;
+	struct state_layout_fsid *lf = NULL;
+	struct glist_head *glist;
+
+	PTHREAD_MUTEX_lock(&layout_fsid_mutex);
+
+	glist_for_each(glist, &layout_fsids) {
+		lf = glist_entry(glist, struct state_layout_fsid, slf_list);
+		if (lf->slf_fsid.major == obj->fsid.major &&
+		    lf->slf_fsid.minor == obj->fsid.minor)
+			break;
+		lf = NULL;
+	}
+
+	if (lf == NULL) {
+		lf = gsh_malloc(sizeof(*lf));
+		lf->slf_fsid = obj->fsid;
+		glist_init(&lf->slf_states);
+		glist_add_tail(&layout_fsids, &lf->slf_list);
+	}
+
+	glist_add_tail(&lf->slf_states, &layout->state_fsid_list);
+	layout->state_fsid = lf;
+
+	PTHREAD_MUTEX_unlock(&layout_fsid_mutex);
+}
+
+/**
+ * @brief Take a layout state being deleted out of the index
+ *
+ * @param[in] state The layout state
+ */
+void state_layout_unindex(state_t *state)
+{
+	struct state_layout *layout = &state->state_data.layout;
+	struct state_layout_fsid *lf;
+
+	PTHREAD_MUTEX_lock(&layout_fsid_mutex);
+
+	lf = layout->state_fsid;
+	if (lf != NULL) {
+		glist_del(&layout->state_fsid_list);
+		layout->state_fsid = NULL;
+
+		if (glist_empty(&lf->slf_states)) {
+			glist_del(&lf->slf_list);
+			gsh_free(lf);
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&layout_fsid_mutex);
+}
+
+/**
+ * @brief Find the clients holding layouts on a filesystem
+ *
+ * @param[in]  fsid    Filesystem, NULL for all of them
+ * @param[in]  type    Layout type
+ * @param[out] clients Each client once, with a reference, to be freed
+ *
+ * @return Number of clients.
+ */
+uint32_t state_layout_clients(const fsal_fsid_t *fsid, layouttype4 type,
+			      nfs_client_id_t ***clients)
+{
+	struct glist_head *glist, *sglist;
+	uint32_t count = 0, size = 0, i;
+
+	*clients = NULL;
+
+	PTHREAD_MUTEX_lock(&layout_fsid_mutex);
+
+	glist_for_each(glist, &layout_fsids) {
+		struct state_layout_fsid *lf =
+			glist_entry(glist, struct state_layout_fsid, slf_list);
+
+		if (fsid != NULL &&
+		    (lf->slf_fsid.major != fsid->major ||
+		     lf->slf_fsid.minor != fsid->minor))
+			continue;
+
+		glist_for_each(sglist, &lf->slf_states) {
+			state_t *state = glist_entry(sglist, state_t,
+					state_data.layout.state_fsid_list);
+			nfs_client_id_t *client;
+
+			/* Indexed states are not yet deleted, so have
+			 * their owner.
+			 */
+			if (state->state_data.layout.state_layout_type != type)
+				continue;
+
+			client = state->state_owner
+				->so_owner.so_nfs4_owner.so_clientrec;
+
+			for (i = 0; i < count; i++)
+				if ((*clients)[i] == client)
+					break;
+
+			if (i < count)
+				continue;
+
+			if (count == size) {
+				size = size ? size * 2 : 16;
+				*clients = gsh_realloc(*clients, size *
+						       sizeof(**clients));
+			}
+
+			inc_client_id_ref(client);
+			(*clients)[count++] = client;
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&layout_fsid_mutex);
+
+	return count;
+}
+
+/**
+ * @brief Record a bulk recall sent to a client
+ *
+ * @param[in] client Client recalled from
+ * @param[in] fsid   Filesystem, NULL for all of them
+ * @param[in] type   Layout type
+ *
+ * @return An id for state_layout_recall_end, 0 if such a recall is
+ *         already outstanding.
+ */
+uint64_t state_layout_recall_begin(nfs_client_id_t *client,
+				   const fsal_fsid_t *fsid, layouttype4 type)
+{
+	struct state_layout_recall_fsid *recall;
+	struct glist_head *glist;
+	uint64_t id = 0;
+
+	PTHREAD_MUTEX_lock(&layout_fsid_mutex);
+
+	glist_for_each(glist, &layout_recalls) {
+		recall = glist_entry(glist, struct state_layout_recall_fsid,
+				     lrf_list);
+		if (recall->lrf_client == client &&
+		    recall->lrf_type == type &&
+		    (recall->lrf_all ||
+		     (fsid != NULL &&
+		      recall->lrf_fsid.major == fsid->major &&
+		      recall->lrf_fsid.minor == fsid->minor)))
+			goto out;
+	}
+
+	recall = gsh_calloc(1, sizeof(*recall));
+	recall->lrf_id = ++layout_recall_id;
+	recall->lrf_client = client;
+	recall->lrf_all = fsid == NULL;
+	if (fsid != NULL)
+		recall->lrf_fsid = *fsid;
+	recall->lrf_type = type;
+	glist_add_tail(&layout_recalls, &recall->lrf_list);
+	id = recall->lrf_id;
+
+ out:
+	PTHREAD_MUTEX_unlock(&layout_fsid_mutex);
+
+	return id;
+}
+
+/**
+ * @brief End a bulk recall that has not been answered by a return
+ *
+ * @param[in] id Id from state_layout_recall_begin
+ *
+ * @return true if the recall was still outstanding.
+ */
+bool state_layout_recall_end(uint64_t id)
+{
+	struct glist_head *glist;
+
+	PTHREAD_MUTEX_lock(&layout_fsid_mutex);
+
+	glist_for_each(glist, &layout_recalls) {
+		struct state_layout_recall_fsid *recall =
+			glist_entry(glist, struct state_layout_recall_fsid,
+				    lrf_list);
+
+		if (recall->lrf_id == id) {
+			glist_del(&recall->lrf_list);
+			PTHREAD_MUTEX_unlock(&layout_fsid_mutex);
+			gsh_free(recall);
+			return true;
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&layout_fsid_mutex);
+
+	return false;
+}
+
+/**
+ * @brief A client returned the layouts of a filesystem, or all of them
+ *
+ * The bulk recalls the return satisfies are done with.
+ *
+ * @param[in] client Client returning
+ * @param[in] fsid   Filesystem, NULL for a return of all layouts
+ */
+void state_layout_recall_returned(nfs_client_id_t *client,
+				  const fsal_fsid_t *fsid)
+{
+	struct glist_head *glist, *glistn;
+
+	PTHREAD_MUTEX_lock(&layout_fsid_mutex);
+
+	glist_for_each_safe(glist, glistn, &layout_recalls) {
+		struct state_layout_recall_fsid *recall =
+			glist_entry(glist, struct state_layout_recall_fsid,
+				    lrf_list);
+
+		if (recall->lrf_client != client)
+			continue;
+
+		if (fsid != NULL &&
+		    (recall->lrf_all ||
+		     recall->lrf_fsid.major != fsid->major ||
+		     recall->lrf_fsid.minor != fsid->minor))
+			continue;
+
+		glist_del(&recall->lrf_list);
+		gsh_free(recall);
+	}
+
+	PTHREAD_MUTEX_unlock(&layout_fsid_mutex);
+}
+
+/**
+ * @brief Check whether a LAYOUTGET conflicts with a bulk recall
+ *
+ * Only the client recalled from is held off, and only on the
+ * filesystem recalled.
+ *
+ * @param[in] client Client asking for a layout
+ * @param[in] fsid   Filesystem of the file
+ *
+ * @return true if the client must return its layouts first.
+ */
+bool state_layout_recalling(nfs_client_id_t *client, const fsal_fsid_t *fsid)
+{
+	struct glist_head *glist;
+	bool recalling = false;
+
+	if (glist_empty(&layout_recalls))
+		return false;
+
+	PTHREAD_MUTEX_lock(&layout_fsid_mutex);
+
+	glist_for_each(glist, &layout_recalls) {
+		struct state_layout_recall_fsid *recall =
+			glist_entry(glist, struct state_layout_recall_fsid,
+				    lrf_list);
+
+		if (recall->lrf_client == client &&
+		    (recall->lrf_all ||
+		     (recall->lrf_fsid.major == fsid->major &&
+		      recall->lrf_fsid.minor == fsid->minor))) {
+			recalling = true;
+			break;
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&layout_fsid_mutex);
+
+	return recalling;
+}
+
 /**
  * @brief Find pre-existing layouts
  *
@@ -158,11 +519,17 @@ state_status_t state_lookup_layout_state(struct fsal_obj_handle *obj,
 }
 
 /**
- * @brief Revoke layouts belonging to the client owner.
+ * @brief Return layouts belonging to the client owner.
  *
- * @param[in,out] client owner
+ * @param[in,out] client_owner Client owner
+ * @param[in]     fsid         Only layouts on this filesystem, NULL for all
+ * @param[in]     type         Only layouts of this type, 0 for all
+ * @param[in]     circumstance Why they are returned
  */
-void revoke_owner_layouts(state_owner_t *client_owner)
+void state_return_owner_layouts(state_owner_t *client_owner,
+				const fsal_fsid_t *fsid, layouttype4 type,
+				enum fsal_layoutreturn_circumstance
+								circumstance)
 {
 	state_t *state, *first;
 	struct fsal_obj_handle *obj;
@@ -210,6 +577,10 @@ void revoke_owner_layouts(state_owner_t *client_owner)
 		if (state->state_type != STATE_TYPE_LAYOUT)
 			continue;
 
+		if (type != 0 &&
+		    state->state_data.layout.state_layout_type != type)
+			continue;
+
 		if (!get_state_obj_export_owner_refs(state, &obj,
 						     &export, NULL)) {
 			LogDebug(COMPONENT_STATE,
@@ -217,6 +588,17 @@ void revoke_owner_layouts(state_owner_t *client_owner)
 			continue;
 		}
 
+		if (fsid != NULL &&
+		    (obj->fsid.major != fsid->major ||
+		     obj->fsid.minor != fsid->minor)) {
+			/* The state holds the file, this is not the last
+			 * reference.
+			 */
+			obj->obj_ops->put_ref(obj);
+			put_gsh_export(export);
+			continue;
+		}
+
 		inc_state_t_ref(state);
 
 		/* Set up the op_context with the proper export */
@@ -230,7 +612,7 @@ void revoke_owner_layouts(state_owner_t *client_owner)
 
 		(void) nfs4_return_one_state(obj,
 					     LAYOUTRETURN4_FILE,
-					     circumstance_revoke,
+					     circumstance,
 					     state,
 					     entire,
 					     0,
@@ -240,7 +622,7 @@ void revoke_owner_layouts(state_owner_t *client_owner)
 		if (!deleted) {
 			errcnt++;
 			LogCrit(COMPONENT_PNFS,
-				"Layout state not destroyed during lease expiry.");
+				"Layout state not destroyed on return.");
 		}
 
 		PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
@@ -281,4 +663,14 @@ void revoke_owner_layouts(state_owner_t *client_owner)
 		op_ctx->fsal_export = op_ctx->ctx_export->fsal_export;
 }
 
+/**
+ * @brief Revoke layouts belonging to the client owner.
+ *
+ * @param[in,out] client owner
+ */
+void revoke_owner_layouts(state_owner_t *client_owner)
+{
+	state_return_owner_layouts(client_owner, NULL, 0, circumstance_revoke);
+}
+
 /** @} */
@@ -73,13 +73,9 @@
 
 #ifdef DEBUG_SAL
 /**
- * @brief All locks.
+ * @brief All locks, sharded by lock entry.
  */
-static struct glist_head state_all_locks = GLIST_HEAD_INIT(state_all_locks);
-/**
- * @brief All locks mutex
- */
-pthread_mutex_t all_locks_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct state_list_shard state_all_locks[STATE_LIST_SHARDS];
 #endif
 
 /**
@@ -130,7 +126,7 @@ static hash_parameter_t cookie_param = {
 	.compare_key = compare_lock_cookie_key,
 	.key_to_str = display_lock_cookie_key,
 	.val_to_str = display_lock_cookie_val,
-	.flags = HT_FLAG_NONE,
+	.flags = HT_FLAG_OPEN,
 };
 
 static hash_table_t *ht_lock_cookies;
@@ -153,8 +149,15 @@ state_status_t state_lock_init(void)
 
 	status = state_async_init();
 
+	state_list_shards_init(cached_open_owners);
+#ifdef DEBUG_SAL
+	state_list_shards_init(state_owners_all);
+	state_list_shards_init(state_all_locks);
+#endif
+
 	state_owner_pool =
 		pool_basic_init("NFSv4 state owners", sizeof(state_owner_t));
+	pool_set_mem_tag(state_owner_pool, MEM_TAG_STATE);
 
 	return status;
 }
@@ -529,20 +532,25 @@ void dump_all_locks(const char *label)
 {
 #ifdef DEBUG_SAL
 	struct glist_head *glist;
+	struct state_list_shard *shard;
+	bool empty = true;
+	int i;
+
+	for (i = 0; i < STATE_LIST_SHARDS; i++) {
+		shard = &state_all_locks[i];
+		PTHREAD_MUTEX_lock(&shard->sls_mutex);
+
+		glist_for_each(glist, &shard->sls_list) {
+			LogEntry(label, glist_entry(glist, state_lock_entry_t,
+						    sle_all_locks));
+			empty = false;
+		}
 
-	PTHREAD_MUTEX_lock(&all_locks_mutex);
-
-	if (glist_empty(&state_all_locks)) {
-		LogFullDebug(COMPONENT_STATE, "All Locks are freed");
-		PTHREAD_MUTEX_unlock(&all_locks_mutex);
-		return;
+		PTHREAD_MUTEX_unlock(&shard->sls_mutex);
 	}
 
-	glist_for_each(glist, &state_all_locks)
-	    LogEntry(label,
-		     glist_entry(glist, state_lock_entry_t, sle_all_locks));
-
-	PTHREAD_MUTEX_unlock(&all_locks_mutex);
+	if (empty)
+		LogFullDebug(COMPONENT_STATE, "All Locks are freed");
 #else
 	return;
 #endif
@@ -575,6 +583,9 @@ static state_lock_entry_t *create_state_lock_entry(struct fsal_obj_handle *obj,
 						   fsal_lock_param_t *lock)
 {
 	state_lock_entry_t *new_entry;
+#ifdef DEBUG_SAL
+	struct state_list_shard *shard;
+#endif
 
 	new_entry = gsh_calloc(1, sizeof(*new_entry));
 
@@ -636,11 +647,12 @@ static state_lock_entry_t *create_state_lock_entry(struct fsal_obj_handle *obj,
 	PTHREAD_MUTEX_unlock(&owner->so_mutex);
 
 #ifdef DEBUG_SAL
-	PTHREAD_MUTEX_lock(&all_locks_mutex);
+	shard = state_list_shard(state_all_locks, new_entry);
+	PTHREAD_MUTEX_lock(&shard->sls_mutex);
 
-	glist_add_tail(&state_all_locks, &new_entry->sle_all_locks);
+	glist_add_tail(&shard->sls_list, &new_entry->sle_all_locks);
 
-	PTHREAD_MUTEX_unlock(&all_locks_mutex);
+	PTHREAD_MUTEX_unlock(&shard->sls_mutex);
 #endif
 
 	return new_entry;
@@ -684,6 +696,9 @@ static inline void lock_entry_inc_ref(state_lock_entry_t *lock_entry)
 static void lock_entry_dec_ref(state_lock_entry_t *lock_entry)
 {
 	int32_t refcount = atomic_dec_int32_t(&lock_entry->sle_ref_count);
+#ifdef DEBUG_SAL
+	struct state_list_shard *shard;
+#endif
 
 	LogEntryRefCount(refcount != 0
 			 ? "Decrement refcount"
@@ -700,9 +715,10 @@ static void lock_entry_dec_ref(state_lock_entry_t *lock_entry)
 			gsh_free(lock_entry->sle_block_data);
 		}
 #ifdef DEBUG_SAL
-		PTHREAD_MUTEX_lock(&all_locks_mutex);
+		shard = state_list_shard(state_all_locks, lock_entry);
+		PTHREAD_MUTEX_lock(&shard->sls_mutex);
 		glist_del(&lock_entry->sle_all_locks);
-		PTHREAD_MUTEX_unlock(&all_locks_mutex);
+		PTHREAD_MUTEX_unlock(&shard->sls_mutex);
 #endif
 
 		lock_entry->sle_obj->obj_ops->put_ref(lock_entry->sle_obj);
@@ -712,6 +728,271 @@ static void lock_entry_dec_ref(state_lock_entry_t *lock_entry)
 	}
 }
 
+/******************************************************************************
+ *
+ * Interval tree indexing a file's lock list by range
+ *
+ * Every entry on file.lock_list is also a node in file.lock_tree, a treap
+ * keyed on (lock_start, entry address) with a priority derived from the
+ * entry address.  Each node carries the highest lock end in its subtree so
+ * a range query only descends into subtrees that can reach the range.  The
+ * list is kept for the walkers that visit every lock.
+ *
+ * The tree is protected by the state_lock, like the list.
+ *
+ ******************************************************************************/
+
+/**
+ * @brief Number of query results held without allocating
+ */
+#define LOCK_HITS_INLINE 16
+
+/**
+ * @brief Lock entries overlapping a queried range, in lock_start order
+ */
+struct lock_hits {
+	state_lock_entry_t **entries;
+	size_t count;
+	size_t size;
+	state_lock_entry_t *inline_entries[LOCK_HITS_INLINE];
+};
+
+static inline uint32_t lock_tree_prio(state_lock_entry_t *entry)
+{
+	uint64_t key = (uintptr_t) entry >> 4;
+
+	return (uint32_t) ((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+static inline bool lock_tree_before(state_lock_entry_t *entry1,
+				    state_lock_entry_t *entry2)
+{
+	if (entry1->sle_lock.lock_start != entry2->sle_lock.lock_start)
+		return entry1->sle_lock.lock_start <
+		       entry2->sle_lock.lock_start;
+
+	return (uintptr_t) entry1 < (uintptr_t) entry2;
+}
+
+static inline void lock_tree_update(state_lock_entry_t *node)
+{
+	uint64_t max_end = lock_end(&node->sle_lock);
+
+	if (node->sle_left != NULL && node->sle_left->sle_max_end > max_end)
+		max_end = node->sle_left->sle_max_end;
+
+	if (node->sle_right != NULL && node->sle_right->sle_max_end > max_end)
+		max_end = node->sle_right->sle_max_end;
+
+	node->sle_max_end = max_end;
+}
+
+/**
+ * @brief Split a subtree into the nodes before and after an entry
+ */
+static void lock_tree_split(state_lock_entry_t *node,
+			    state_lock_entry_t *entry,
+			    state_lock_entry_t **left,
+			    state_lock_entry_t **right)
+{
+	if (node == NULL) {
+		*left = NULL;
+		*right = NULL;
+		return;
+	}
+
+	if (lock_tree_before(node, entry)) {
+		lock_tree_split(node->sle_right, entry, &node->sle_right,
+				right);
+		*left = node;
+	} else {
+		lock_tree_split(node->sle_left, entry, left, &node->sle_left);
+		*right = node;
+	}
+
+	lock_tree_update(node);
+}
+
+/**
+ * @brief Join two subtrees where every node of left sorts before right
+ */
+static state_lock_entry_t *lock_tree_join(state_lock_entry_t *left,
+					  state_lock_entry_t *right)
+{
+	if (left == NULL)
+		return right;
+
+	if (right == NULL)
+		return left;
+
+	if (lock_tree_prio(left) > lock_tree_prio(right)) {
+		left->sle_right = lock_tree_join(left->sle_right, right);
+		lock_tree_update(left);
+		return left;
+	}
+
+	right->sle_left = lock_tree_join(left, right->sle_left);
+	lock_tree_update(right);
+	return right;
+}
+
+static state_lock_entry_t *lock_tree_insert_at(state_lock_entry_t *node,
+					       state_lock_entry_t *entry)
+{
+	if (node == NULL)
+		return entry;
+
+	if (lock_tree_prio(entry) > lock_tree_prio(node)) {
+		lock_tree_split(node, entry, &entry->sle_left,
+				&entry->sle_right);
+		lock_tree_update(entry);
+		return entry;
+	}
+
+	if (lock_tree_before(entry, node))
+		node->sle_left = lock_tree_insert_at(node->sle_left, entry);
+	else
+		node->sle_right = lock_tree_insert_at(node->sle_right, entry);
+
+	lock_tree_update(node);
+	return node;
+}
+
+static state_lock_entry_t *lock_tree_remove_at(state_lock_entry_t *node,
+					       state_lock_entry_t *entry)
+{
+	if (node == NULL)
+		return NULL;
+
+	if (node == entry)
+		return lock_tree_join(node->sle_left, node->sle_right);
+
+	if (lock_tree_before(entry, node))
+		node->sle_left = lock_tree_remove_at(node->sle_left, entry);
+	else
+		node->sle_right = lock_tree_remove_at(node->sle_right, entry);
+
+	lock_tree_update(node);
+	return node;
+}
+
+/**
+ * @brief Index a lock entry by its range
+ *
+ * The entry's range must not change while it is in the tree.
+ *
+ * @param[in,out] ostate File state
+ * @param[in,out] entry  Entry that is on ostate's lock list
+ */
+static void lock_tree_insert(struct state_hdl *ostate,
+			     state_lock_entry_t *entry)
+{
+	entry->sle_left = NULL;
+	entry->sle_right = NULL;
+	entry->sle_max_end = lock_end(&entry->sle_lock);
+	entry->sle_in_tree = true;
+	ostate->file.lock_tree = lock_tree_insert_at(ostate->file.lock_tree,
+						     entry);
+}
+
+/**
+ * @brief Drop a lock entry from the range index
+ *
+ * @param[in,out] ostate File state
+ * @param[in,out] entry  Entry to drop, a no-op if it is not indexed
+ */
+static void lock_tree_remove(struct state_hdl *ostate,
+			     state_lock_entry_t *entry)
+{
+	if (!entry->sle_in_tree)
+		return;
+
+	ostate->file.lock_tree = lock_tree_remove_at(ostate->file.lock_tree,
+						     entry);
+	entry->sle_left = NULL;
+	entry->sle_right = NULL;
+	entry->sle_in_tree = false;
+}
+
+static void lock_hits_add(struct lock_hits *hits, state_lock_entry_t *entry)
+{
+	if (hits->count == hits->size) {
+		hits->size *= 2;
+
+		if (hits->entries == hits->inline_entries) {
+			hits->entries = gsh_malloc(hits->size *
+						   sizeof(*hits->entries));
+			memcpy(hits->entries, hits->inline_entries,
+			       sizeof(hits->inline_entries));
+		} else {
+			hits->entries = gsh_realloc(hits->entries,
+						    hits->size *
+						    sizeof(*hits->entries));
+		}
+	}
+
+	hits->entries[hits->count++] = entry;
+}
+
+static void lock_tree_collect(state_lock_entry_t *node, uint64_t start,
+			      uint64_t end, struct lock_hits *hits)
+{
+	while (node != NULL && node->sle_max_end >= start) {
+		lock_tree_collect(node->sle_left, start, end, hits);
+
+		/* Everything further right starts after the range */
+		if (node->sle_lock.lock_start > end)
+			return;
+
+		if (lock_end(&node->sle_lock) >= start)
+			lock_hits_add(hits, node);
+
+		node = node->sle_right;
+	}
+}
+
+/**
+ * @brief Find the lock entries that overlap a range
+ *
+ * Blocked and cancelled entries are returned too, callers filter them as
+ * they would walking the lock list.  The result holds no references, it
+ * is only valid while the state_lock is held and must be released with
+ * lock_hits_release().
+ *
+ * @param[in]  ostate File state to search
+ * @param[in]  start  First byte of the range
+ * @param[in]  end    Last byte of the range
+ * @param[out] hits   Overlapping entries
+ */
+static void lock_tree_find(struct state_hdl *ostate, uint64_t start,
+			   uint64_t end, struct lock_hits *hits)
+{
+	hits->entries = hits->inline_entries;
+	hits->count = 0;
+	hits->size = LOCK_HITS_INLINE;
+
+	lock_tree_collect(ostate->file.lock_tree, start, end, hits);
+}
+
+static inline void lock_hits_release(struct lock_hits *hits)
+{
+	if (hits->entries != hits->inline_entries)
+		gsh_free(hits->entries);
+}
+
+/**
+ * @brief Add an entry to the file's lock list and range index
+ *
+ * @param[in,out] ostate File state
+ * @param[in,out] entry  Entry to add
+ */
+static inline void lock_list_add(struct state_hdl *ostate,
+				 state_lock_entry_t *entry)
+{
+	glist_add_tail(&ostate->file.lock_list, &entry->sle_list);
+	lock_tree_insert(ostate, entry);
+}
+
 /**
  * @brief Remove an entry from the lock lists
  *
@@ -766,6 +1047,8 @@ static void remove_from_locklist(state_lock_entry_t *lock_entry)
 	}
 
 	lock_entry->sle_owner = NULL;
+	lock_tree_remove(lock_entry->sle_obj->state_hdl, lock_entry);
+	glist_del(&lock_entry->sle_waiter_list);
 	glist_del(&lock_entry->sle_list);
 	lock_entry_dec_ref(lock_entry);
 }
@@ -785,12 +1068,15 @@ static state_lock_entry_t *get_overlapping_entry(struct state_hdl *ostate,
 						 state_owner_t *owner,
 						 fsal_lock_param_t *lock)
 {
-	struct glist_head *glist;
+	struct lock_hits hits;
 	state_lock_entry_t *found_entry = NULL;
 	uint64_t found_entry_end, range_end = lock_end(lock);
+	size_t i;
 
-	glist_for_each(glist, &ostate->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	lock_tree_find(ostate, lock->lock_start, range_end, &hits);
+
+	for (i = 0; i < hits.count; i++) {
+		found_entry = hits.entries[i];
 
 		LogEntry("Checking", found_entry);
 
@@ -813,11 +1099,13 @@ static state_lock_entry_t *get_overlapping_entry(struct state_hdl *ostate,
 			    && different_owners(found_entry->sle_owner, owner)
 			    ) {
 				/* found a conflicting lock, return it */
+				lock_hits_release(&hits);
 				return found_entry;
 			}
 		}
 	}
 
+	lock_hits_release(&hits);
 	return NULL;
 }
 
@@ -840,13 +1128,29 @@ static void merge_lock_entry(struct state_hdl *ostate,
 	state_lock_entry_t *check_entry_right;
 	uint64_t check_entry_end;
 	uint64_t lock_entry_end;
-	struct glist_head *glist;
-	struct glist_head *glistn;
+	uint64_t range_start, range_end;
+	struct lock_hits hits;
+	bool indexed = lock_entry->sle_in_tree;
+	size_t i;
 
 	/* lock_entry might be STATE_NON_BLOCKING or STATE_GRANTING */
 
-	glist_for_each_safe(glist, glistn, &ostate->file.lock_list) {
-		check_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	/* lock_entry may grow below, take it out of the index meanwhile */
+	lock_tree_remove(ostate, lock_entry);
+
+	/* Touching locks merge too, so look one byte beyond each end */
+	range_start = lock_entry->sle_lock.lock_start;
+	if (range_start != 0)
+		range_start--;
+
+	range_end = lock_end(&lock_entry->sle_lock);
+	if (range_end != UINT64_MAX)
+		range_end++;
+
+	lock_tree_find(ostate, range_start, range_end, &hits);
+
+	for (i = 0; i < hits.count; i++) {
+		check_entry = hits.entries[i];
 
 		/* Skip entry being merged - it could be in the list */
 		if (check_entry == lock_entry)
@@ -887,14 +1191,13 @@ static void merge_lock_entry(struct state_hdl *ostate,
 				/* Need to split old lock */
 				check_entry_right =
 				    state_lock_entry_t_dup(check_entry);
-				glist_add_tail(&ostate->file.lock_list,
-					       &(check_entry_right->sle_list));
 			} else {
 				/* No split, just shrink, make the logic below
 				 * work on original lock
 				 */
 				check_entry_right = check_entry;
 			}
+			lock_tree_remove(ostate, check_entry);
 			if (lock_entry_end < check_entry_end) {
 				/* Need to shrink old lock from beginning
 				 * (right lock if split)
@@ -919,6 +1222,9 @@ static void merge_lock_entry(struct state_hdl *ostate,
 				    check_entry->sle_lock.lock_start;
 				LogEntry("Merge shrunk left", check_entry);
 			}
+			lock_tree_insert(ostate, check_entry);
+			if (check_entry_right != check_entry)
+				lock_list_add(ostate, check_entry_right);
 			/* Done splitting/shrinking old lock */
 			continue;
 		}
@@ -945,6 +1251,11 @@ static void merge_lock_entry(struct state_hdl *ostate,
 		LogEntry("Merging removing", check_entry);
 		remove_from_locklist(check_entry);
 	}
+
+	lock_hits_release(&hits);
+
+	if (indexed)
+		lock_tree_insert(ostate, lock_entry);
 }
 
 /**
@@ -1060,7 +1371,7 @@ static state_status_t subtract_lock_from_entry(state_lock_entry_t *found_entry,
  * @param[in]     state   Associated lock state
  * @param[in]     lock    Lock to remove
  * @param[out]    removed True if an entry was removed
- * @param[in,out] list    List of locks to modify
+ * @param[in,out] ostate  File state whose lock list is modified
  *
  * @return State status.
  */
@@ -1069,21 +1380,26 @@ static state_status_t subtract_lock_from_list(state_owner_t *owner,
 					      int32_t state,
 					      fsal_lock_param_t *lock,
 					      bool *removed,
-					      struct glist_head *list)
+					      struct state_hdl *ostate)
 {
 	state_lock_entry_t *found_entry;
 	struct glist_head split_lock_list, remove_list;
 	struct glist_head *glist, *glistn;
+	struct glist_head *list = &ostate->file.lock_list;
+	struct lock_hits hits;
 	state_status_t status = STATE_SUCCESS;
 	bool removed_one = false;
+	size_t i;
 
 	*removed = false;
 
 	glist_init(&split_lock_list);
 	glist_init(&remove_list);
 
-	glist_for_each_safe(glist, glistn, list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	lock_tree_find(ostate, lock->lock_start, lock_end(lock), &hits);
+
+	for (i = 0; i < hits.count; i++) {
+		found_entry = hits.entries[i];
 
 		if (owner != NULL
 		    && different_owners(found_entry->sle_owner, owner))
@@ -1111,6 +1427,9 @@ static state_status_t subtract_lock_from_list(state_owner_t *owner,
 					     &removed_one);
 		*removed |= removed_one;
 
+		if (removed_one)
+			lock_tree_remove(ostate, found_entry);
+
 		if (status != STATE_SUCCESS) {
 			/* We ran out of memory while splitting,
 			 * deal with it outside loop
@@ -1119,6 +1438,8 @@ static state_status_t subtract_lock_from_list(state_owner_t *owner,
 		}
 	}
 
+	lock_hits_release(&hits);
+
 	if (status != STATE_SUCCESS) {
 		/* We ran out of memory while splitting. split_lock_list
 		 * has been freed. For each entry on the remove_list, put
@@ -1129,14 +1450,19 @@ static state_status_t subtract_lock_from_list(state_owner_t *owner,
 			found_entry =
 			    glist_entry(glist, state_lock_entry_t, sle_list);
 			glist_del(&found_entry->sle_list);
-			glist_add_tail(list, &(found_entry->sle_list));
+			lock_list_add(ostate, found_entry);
 		}
 	} else {
 		/* free the enttries on the remove_list */
 		free_list(&remove_list);
 
 		/* now add the split lock list */
-		glist_add_list_tail(list, &split_lock_list);
+		glist_for_each_safe(glist, glistn, &split_lock_list) {
+			found_entry =
+			    glist_entry(glist, state_lock_entry_t, sle_list);
+			glist_del(&found_entry->sle_list);
+			lock_list_add(ostate, found_entry);
+		}
 	}
 
 	LogFullDebug(COMPONENT_STATE,
@@ -1152,7 +1478,7 @@ static state_status_t subtract_lock_from_list(state_owner_t *owner,
  *
  ******************************************************************************/
 
-static void grant_blocked_locks(struct state_hdl *);
+static void grant_blocked_locks(struct state_hdl *, fsal_lock_param_t *);
 
 /**
  * @brief Display lock cookie in hash table
@@ -1660,6 +1986,7 @@ void grant_blocked_lock_immediate(struct state_hdl *ostate,
 
 	/* Mark lock as granted */
 	lock_entry->sle_blocked = STATE_NON_BLOCKING;
+	glist_del(&lock_entry->sle_waiter_list);
 
 	/* Merge any touching or overlapping locks into this one. */
 	LogEntry("Granted immediate, merging locks for", lock_entry);
@@ -1668,7 +1995,7 @@ void grant_blocked_lock_immediate(struct state_hdl *ostate,
 	LogEntry("Immediate Granted entry", lock_entry);
 
 	/* A lock downgrade could unblock blocked locks */
-	grant_blocked_locks(ostate);
+	grant_blocked_locks(ostate, &lock_entry->sle_lock);
 }
 
 /**
@@ -1699,6 +2026,7 @@ void state_complete_grant(state_cookie_entry_t *cookie_entry)
 	if (lock_entry->sle_blocked == STATE_GRANTING) {
 		/* Mark lock as granted */
 		lock_entry->sle_blocked = STATE_NON_BLOCKING;
+		glist_del(&lock_entry->sle_waiter_list);
 
 		/* Merge any touching or overlapping locks into this one. */
 		LogEntry("Granted, merging locks for", lock_entry);
@@ -1707,7 +2035,7 @@ void state_complete_grant(state_cookie_entry_t *cookie_entry)
 		LogEntry("Granted entry", lock_entry);
 
 		/* A lock downgrade could unblock blocked locks */
-		grant_blocked_locks(obj->state_hdl);
+		grant_blocked_locks(obj->state_hdl, &lock_entry->sle_lock);
 	}
 
 	/* Free cookie and unblock lock.
@@ -1811,34 +2139,176 @@ void process_blocked_lock_upcall(state_block_data_t *block_data)
 }
 
 /**
- * @brief Attempt to grant all blocked locks on a file
+ * @brief Most lock owners waiting for CB_NOTIFY_LOCK on one file
+ */
+#define STATE_LOCK_NOTIFY_MAX 64
+
+/**
+ * @brief Forget a lock owner waiting for CB_NOTIFY_LOCK
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in] obj File
+ * @param[in] sln Waiter to forget
+ */
+static void lock_notify_free(struct fsal_obj_handle *obj,
+			     struct state_lock_notify *sln)
+{
+	glist_del(&sln->sln_list);
+	dec_state_owner_ref(sln->sln_owner);
+	put_gsh_export(sln->sln_export);
+	gsh_free(sln);
+
+	/* The list no longer pins the file */
+	if (glist_empty(&obj->state_hdl->file.lock_notify))
+		obj->obj_ops->put_ref(obj);
+}
+
+/**
+ * @brief Remember an NFSv4.1 lock owner that was denied a lock
+ *
+ * The owner is sent a CB_NOTIFY_LOCK once a lock overlapping the range
+ * it asked for is released, so it retries then rather than on its next
+ * poll.  A client that does not retry within a lease is forgotten.
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in] obj   File
+ * @param[in] owner Lock owner that was denied
+ * @param[in] lock  Lock it asked for
+ */
+void state_lock_notify_add(struct fsal_obj_handle *obj, state_owner_t *owner,
+			   fsal_lock_param_t *lock)
+{
+	struct glist_head *list = &obj->state_hdl->file.lock_notify;
+	struct glist_head *glist, *glistn;
+	struct state_lock_notify *sln;
+	time_t now = time(NULL);
+	int count = 0;
+
+	if (owner->so_type != STATE_LOCK_OWNER_NFSV4 ||
+	    owner->so_owner.so_nfs4_owner.so_clientrec->cid_minorversion == 0)
+		return;
+
+	glist_for_each_safe(glist, glistn, list) {
+		sln = glist_entry(glist, struct state_lock_notify, sln_list);
+
+		if (sln->sln_expire < now) {
+			lock_notify_free(obj, sln);
+			continue;
+		}
+
+		if (sln->sln_owner == owner) {
+			/* The client is polling, keep the widest range */
+			sln->sln_start = MIN(sln->sln_start, lock->lock_start);
+			sln->sln_end = MAX(sln->sln_end, lock_end(lock));
+			sln->sln_expire = now +
+				nfs_param.nfsv4_param.lease_lifetime;
+			return;
+		}
+
+		count++;
+	}
+
+	/* Past this, clients just poll */
+	if (count >= STATE_LOCK_NOTIFY_MAX)
+		return;
+
+	if (glist_empty(list))
+		obj->obj_ops->get_ref(obj);
+
+	sln = gsh_malloc(sizeof(*sln));
+	inc_state_owner_ref(owner);
+	sln->sln_owner = owner;
+	get_gsh_export_ref(op_ctx->ctx_export);
+	sln->sln_export = op_ctx->ctx_export;
+	sln->sln_start = lock->lock_start;
+	sln->sln_end = lock_end(lock);
+	sln->sln_expire = now + nfs_param.nfsv4_param.lease_lifetime;
+	glist_add_tail(list, &sln->sln_list);
+
+	LogLock(COMPONENT_STATE, NIV_FULL_DEBUG, "Will notify", obj, owner,
+		lock);
+}
+
+/**
+ * @brief Tell lock owners waiting on a released range to retry
+ *
+ * @note The state_lock MUST be held for write
  *
  * @param[in] ostate File state
+ * @param[in] lock   Range that was released
  */
+static void notify_lock_waiters(struct state_hdl *ostate,
+				fsal_lock_param_t *lock)
+{
+	struct fsal_obj_handle *obj = ostate->file.obj;
+	struct glist_head *glist, *glistn;
+	struct state_lock_notify *sln;
+	uint64_t range_end = lock_end(lock);
+	time_t now = time(NULL);
+
+	glist_for_each_safe(glist, glistn, &ostate->file.lock_notify) {
+		sln = glist_entry(glist, struct state_lock_notify, sln_list);
+
+		if (sln->sln_expire >= now &&
+		    (sln->sln_end < lock->lock_start ||
+		     sln->sln_start > range_end))
+			continue;
 
-static void grant_blocked_locks(struct state_hdl *ostate)
+		if (sln->sln_expire >= now)
+			(void)notify_lock_send(obj, sln->sln_owner,
+					       sln->sln_export);
+
+		lock_notify_free(obj, sln);
+	}
+}
+
+/**
+ * @brief Attempt to grant the blocked locks waiting on a range of a file
+ *
+ * Called when locks in the range are released or downgraded, only the
+ * waiters overlapping it can have become grantable.
+ *
+ * @param[in] ostate File state
+ * @param[in] lock   Range that was released
+ */
+static void grant_blocked_locks(struct state_hdl *ostate,
+				fsal_lock_param_t *lock)
 {
 	state_lock_entry_t *found_entry;
 	struct glist_head *glist, *glistn;
 	struct fsal_export *export = op_ctx->ctx_export->fsal_export;
+	uint64_t range_end = lock_end(lock);
 
 	if (!ostate)
 		return;
 
+	/* Whether or not the FSAL grants blocked locks, NFSv4.1 clients
+	 * told of the release retry on their own.
+	 */
+	notify_lock_waiters(ostate, lock);
+
 	/* If FSAL supports async blocking locks,
 	 * allow it to grant blocked locks.
 	 */
 	if (export->exp_ops.fs_supports(export, fso_lock_support_async_block))
 		return;
 
-	glist_for_each_safe(glist, glistn, &ostate->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	glist_for_each_safe(glist, glistn, &ostate->file.lock_waiters) {
+		found_entry = glist_entry(glist, state_lock_entry_t,
+					  sle_waiter_list);
 
 		if (found_entry->sle_blocked != STATE_NLM_BLOCKING
 		    && found_entry->sle_blocked != STATE_NFSV4_BLOCKING)
 			continue;
 
-		/* Found a blocked entry for this file,
+		/* Waiters outside the released range are still blocked */
+		if (lock_end(&found_entry->sle_lock) < lock->lock_start
+		    || found_entry->sle_lock.lock_start > range_end)
+			continue;
+
+		/* Found a blocked entry for this range,
 		 * see if we can place the lock.
 		 */
 		if (get_overlapping_entry(ostate, found_entry->sle_owner,
@@ -1963,8 +2433,9 @@ void cancel_blocked_locks_range(struct state_hdl *ostate,
 	state_lock_entry_t *found_entry = NULL;
 	uint64_t found_entry_end, range_end = lock_end(lock);
 
-	glist_for_each_safe(glist, glistn, &ostate->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	glist_for_each_safe(glist, glistn, &ostate->file.lock_waiters) {
+		found_entry = glist_entry(glist, state_lock_entry_t,
+					  sle_waiter_list);
 
 		/* Skip locks not owned by owner */
 		if (owner != NULL
@@ -2006,6 +2477,7 @@ state_status_t state_release_grant(state_cookie_entry_t *cookie_entry)
 {
 	state_lock_entry_t *lock_entry;
 	struct fsal_obj_handle *obj;
+	fsal_lock_param_t lock;
 	state_status_t status = STATE_SUCCESS;
 
 	lock_entry = cookie_entry->sce_lock_entry;
@@ -2013,6 +2485,9 @@ state_status_t state_release_grant(state_cookie_entry_t *cookie_entry)
 
 	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
 
+	/* The entry may be freed below, keep its range for the waiters */
+	lock = lock_entry->sle_lock;
+
 	/* We need to make sure lock is only "granted" once...
 	 * It's (remotely) possible that due to latency, we might end up
 	 * processing two GRANTED_RSP calls at the same time.
@@ -2052,7 +2527,7 @@ state_status_t state_release_grant(state_cookie_entry_t *cookie_entry)
 	free_cookie(cookie_entry, true);
 
 	/* Check to see if we can grant any blocked locks. */
-	grant_blocked_locks(obj->state_hdl);
+	grant_blocked_locks(obj->state_hdl, &lock);
 
 	PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
 
@@ -2231,6 +2706,34 @@ void copy_conflict(state_lock_entry_t *found_entry, state_owner_t **holder,
 		*conflict = found_entry->sle_lock;
 }
 
+/**
+ * @brief Status of a lock request conflicting with a lock
+ *
+ * An NFSv4 request conflicting with a courtesy client's lock is told
+ * to retry, by when the client and its locks are gone.  NLM has nothing
+ * like NFS4ERR_DELAY, its requests are denied or blocked as usual.
+ *
+ * @param[in]     owner     Lock owner of the request
+ * @param[in]     courtesy  The lock is a courtesy client's
+ * @param[in,out] holder    Owner holding the lock, released if retrying
+ *
+ * @return STATE_FSAL_DELAY or STATE_LOCK_CONFLICT.
+ */
+static state_status_t state_lock_courtesy_conflict(state_owner_t *owner,
+						   bool courtesy,
+						   state_owner_t **holder)
+{
+	if (!courtesy || owner->so_type != STATE_LOCK_OWNER_NFSV4)
+		return STATE_LOCK_CONFLICT;
+
+	if (holder != NULL && *holder != NULL) {
+		dec_state_owner_ref(*holder);
+		*holder = NULL;
+	}
+
+	return STATE_FSAL_DELAY;
+}
+
 /******************************************************************************
  *
  * Primary lock interface functions
@@ -2273,7 +2776,10 @@ state_status_t state_test(struct fsal_obj_handle *obj,
 		/* found a conflicting lock, return it */
 		LogEntry("Found conflict", found_entry);
 		copy_conflict(found_entry, holder, conflict);
-		status = STATE_LOCK_CONFLICT;
+		status = state_lock_courtesy_conflict(
+			owner,
+			state_owner_courtesy_conflict(found_entry->sle_owner),
+			holder);
 	} else {
 		/* Prepare to make call to FSAL for this lock */
 		status = do_lock_op(obj, state, FSAL_OP_LOCKT, owner,
@@ -2304,6 +2810,39 @@ state_status_t state_test(struct fsal_obj_handle *obj,
 	return status;
 }
 
+/**
+ * @brief Find a lock an owner holds or is waiting for on a file
+ *
+ * @note The state_lock MUST be held
+ *
+ * @param[in] owner Lock owner
+ * @param[in] obj   File to look for
+ *
+ * @return The first such lock entry or NULL.
+ */
+static state_lock_entry_t *owner_lock_on_file(state_owner_t *owner,
+					      struct fsal_obj_handle *obj)
+{
+	state_lock_entry_t *found_entry;
+	struct glist_head *glist;
+
+	PTHREAD_MUTEX_lock(&owner->so_mutex);
+
+	glist_for_each(glist, &owner->so_lock_list) {
+		found_entry = glist_entry(glist, state_lock_entry_t,
+					  sle_owner_locks);
+
+		if (found_entry->sle_obj == obj) {
+			PTHREAD_MUTEX_unlock(&owner->so_mutex);
+			return found_entry;
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&owner->so_mutex);
+
+	return NULL;
+}
+
 /**
  * @brief Attempt to acquire a lock
  *
@@ -2329,15 +2868,39 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 			  state_owner_t **holder,
 			  fsal_lock_param_t *conflict)
 {
-	bool allow = true, overlap = false;
-	struct glist_head *glist;
+	bool allow = true, overlap = false, courtesy = false;
 	state_lock_entry_t *found_entry;
 	uint64_t found_entry_end;
 	uint64_t range_end = lock_end(lock);
 	struct fsal_export *fsal_export = op_ctx->fsal_export;
 	fsal_lock_op_t lock_op;
 	state_status_t status = 0;
+	struct lock_hits hits;
 	bool async;
+	size_t i;
+
+	/* Need to reject lock request if this lock owner already has
+	 * a lock on this file via a different export.
+	 */
+	found_entry = owner_lock_on_file(owner, obj);
+
+	if (found_entry != NULL
+	    && found_entry->sle_export != op_ctx->ctx_export) {
+		LogEvent(COMPONENT_STATE,
+			 "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
+			 found_entry->sle_export->export_id,
+			 op_ctx_export_path(found_entry->sle_export),
+			 op_ctx->ctx_export->export_id,
+			 op_ctx_export_path(op_ctx->ctx_export));
+
+		LogEntry("Found lock entry belonging to another export",
+			 found_entry);
+
+		status = STATE_INVALID_ARGUMENT;
+		return status;
+	}
+
+	lock_tree_find(obj->state_hdl, lock->lock_start, range_end, &hits);
 
 	if (blocking != STATE_NON_BLOCKING) {
 		/* First search for a blocked request. Client can ignore the
@@ -2345,33 +2908,12 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		 * and again. So if we have a mapping blocked request return
 		 * that
 		 */
-		glist_for_each(glist, &obj->state_hdl->file.lock_list) {
-			found_entry =
-			    glist_entry(glist, state_lock_entry_t, sle_list);
+		for (i = 0; i < hits.count; i++) {
+			found_entry = hits.entries[i];
 
 			if (different_owners(found_entry->sle_owner, owner))
 				continue;
 
-			/* Need to reject lock request if this lock owner
-			 * already has a lock on this file via a different
-			 * export.
-			 */
-			if (found_entry->sle_export != op_ctx->ctx_export) {
-				LogEvent(COMPONENT_STATE,
-					 "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
-					 found_entry->sle_export->export_id,
-					 op_ctx_export_path(
-						found_entry->sle_export),
-					 op_ctx->ctx_export->export_id,
-					 op_ctx_export_path(
-							op_ctx->ctx_export));
-				LogEntry(
-					"Found lock entry belonging to another export",
-					found_entry);
-				status = STATE_INVALID_ARGUMENT;
-				return status;
-			}
-
 			if (found_entry->sle_blocked != blocking)
 				continue;
 
@@ -2383,31 +2925,14 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 			 * polling.
 			 */
 			LogEntry("Found blocked", found_entry);
+			lock_hits_release(&hits);
 			status = STATE_LOCK_BLOCKED;
 			return status;
 		}
 	}
 
-	glist_for_each(glist, &obj->state_hdl->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
-		/* Need to reject lock request if this lock owner already has
-		 * a lock on this file via a different export.
-		 */
-		if (found_entry->sle_export != op_ctx->ctx_export
-		    && !different_owners(found_entry->sle_owner, owner)) {
-			LogEvent(COMPONENT_STATE,
-				 "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
-				 found_entry->sle_export->export_id,
-				 op_ctx_export_path(found_entry->sle_export),
-				 op_ctx->ctx_export->export_id,
-				 op_ctx_export_path(op_ctx->ctx_export));
-
-			LogEntry("Found lock entry belonging to another export",
-				 found_entry);
-
-			status = STATE_INVALID_ARGUMENT;
-			return status;
-		}
+	for (i = 0; i < hits.count; i++) {
+		found_entry = hits.entries[i];
 
 		/* Don't skip blocked locks for fairness */
 		found_entry_end = lock_end(&found_entry->sle_lock);
@@ -2430,6 +2955,8 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 				LogList("Locks", obj,
 					&obj->state_hdl->file.lock_list);
 				copy_conflict(found_entry, holder, conflict);
+				courtesy = state_owner_courtesy_conflict(
+						found_entry->sle_owner);
 				allow = false;
 				overlap = true;
 				break;
@@ -2467,6 +2994,7 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 
 				LogEntry("Found existing", found_entry);
 
+				lock_hits_release(&hits);
 				status = STATE_SUCCESS;
 				return status;
 			}
@@ -2479,6 +3007,8 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		}
 	}
 
+	lock_hits_release(&hits);
+
 	/* Decide how to proceed */
 	if (blocking == STATE_NLM_BLOCKING) {
 		/* do_lock_op will handle FSAL_OP_LOCKB for those FSALs that
@@ -2494,9 +3024,10 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		lock_op = FSAL_OP_LOCK;
 	} else {
 		/* Can't do async blocking lock in FSAL and have a conflict.
-		 * Return it.
+		 * Return it, or have an NFSv4 client retry once the courtesy
+		 * client holding the lock is gone.
 		 */
-		status = STATE_LOCK_CONFLICT;
+		status = state_lock_courtesy_conflict(owner, courtesy, holder);
 		return status;
 	}
 
@@ -2597,11 +3128,10 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		/* Insert entry into lock list */
 		LogEntry("New lock", found_entry);
 
-		glist_add_tail(&obj->state_hdl->file.lock_list,
-			       &found_entry->sle_list);
+		lock_list_add(obj->state_hdl, found_entry);
 
 		/* A lock downgrade could unblock blocked locks */
-		grant_blocked_locks(obj->state_hdl);
+		grant_blocked_locks(obj->state_hdl, &found_entry->sle_lock);
 	} else if (status == STATE_LOCK_CONFLICT) {
 		LogEntry("Conflict in FSAL for", found_entry);
 
@@ -2630,8 +3160,9 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		/* Insert entry into lock list */
 		LogEntry("FSAL block for", found_entry);
 
-		glist_add_tail(&obj->state_hdl->file.lock_list,
-			       &found_entry->sle_list);
+		lock_list_add(obj->state_hdl, found_entry);
+		glist_add_tail(&obj->state_hdl->file.lock_waiters,
+			       &found_entry->sle_waiter_list);
 
 		PTHREAD_MUTEX_lock(&blocked_locks_mutex);
 
@@ -2702,8 +3233,7 @@ state_status_t state_unlock(struct fsal_obj_handle *obj,
 
 	/* Release the lock from cache inode lock list for entry */
 	status = subtract_lock_from_list(owner, state_applies, nsm_state, lock,
-					 &removed,
-					 &obj->state_hdl->file.lock_list);
+					 &removed, obj->state_hdl);
 
 	/* If the lock list has become zero; decrement the pin ref count pt
 	 * placed. Do this here just in case subtract_lock_from_list has made
@@ -2751,7 +3281,7 @@ state_status_t state_unlock(struct fsal_obj_handle *obj,
 		empty =
 		    LogList("Lock List", obj, &obj->state_hdl->file.lock_list);
 
-	grant_blocked_locks(obj->state_hdl);
+	grant_blocked_locks(obj->state_hdl, lock);
 
 
 	if (isFullDebug(COMPONENT_STATE) && isFullDebug(COMPONENT_MEMLEAKS)
@@ -2796,8 +3326,9 @@ state_status_t state_cancel(struct fsal_obj_handle *obj,
 		goto out_unlock;
 	}
 
-	glist_for_each(glist, &obj->state_hdl->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	glist_for_each(glist, &obj->state_hdl->file.lock_waiters) {
+		found_entry = glist_entry(glist, state_lock_entry_t,
+					  sle_waiter_list);
 
 		if (different_owners(found_entry->sle_owner, owner))
 			continue;
@@ -2813,7 +3344,7 @@ state_status_t state_cancel(struct fsal_obj_handle *obj,
 		cancel_blocked_lock(obj, found_entry);
 
 		/* Check to see if we can grant any blocked locks. */
-		grant_blocked_locks(obj->state_hdl);
+		grant_blocked_locks(obj->state_hdl, lock);
 
 		break;
 	}
@@ -3345,6 +3876,10 @@ void state_export_unlock_all(void)
 /**
  * @brief Poll any blocked locks of type STATE_BLOCK_POLL
  *
+ * Waiters are retried as soon as a lock overlapping them is released
+ * through Ganesha, see grant_blocked_locks().  This only catches the
+ * conflicts held outside Ganesha, which only the FSAL can see go away.
+ *
  * @param[in] ctx Fridge Thread Context
  *
  */
@@ -49,18 +49,33 @@
 #include "fsal.h"
 #include "nfs_core.h"
 #include "sal_functions.h"
+#ifdef USE_DBUS
+#include "server_stats_private.h"
+#endif
 
-struct glist_head cached_open_owners = GLIST_HEAD_INIT(cached_open_owners);
-
-pthread_mutex_t cached_open_owners_lock = PTHREAD_MUTEX_INITIALIZER;
+struct state_list_shard cached_open_owners[STATE_LIST_SHARDS];
 
 pool_t *state_owner_pool;	/*< Pool for NFSv4 files's open owner */
 
 #ifdef DEBUG_SAL
-struct glist_head state_owners_all = GLIST_HEAD_INIT(state_owners_all);
-pthread_mutex_t all_state_owners_mutex = PTHREAD_MUTEX_INITIALIZER;
+struct state_list_shard state_owners_all[STATE_LIST_SHARDS];
 #endif
 
+/**
+ * @brief Initialize the shards of a list
+ *
+ * @param[in,out] shards Shards to initialize
+ */
+void state_list_shards_init(struct state_list_shard *shards)
+{
+	int i;
+
+	for (i = 0; i < STATE_LIST_SHARDS; i++) {
+		PTHREAD_MUTEX_init(&shards[i].sls_mutex, NULL);
+		glist_init(&shards[i].sls_list);
+	}
+}
+
 /* Error conversion routines */
 /**
  * @brief Get a string from an error code
@@ -811,6 +826,9 @@ void free_state_owner(state_owner_t *owner)
 {
 	char str[LOG_BUFF_LEN] = "\0";
 	struct display_buffer dspbuf = {sizeof(str), str, str};
+#ifdef DEBUG_SAL
+	struct state_list_shard *shard;
+#endif
 
 	switch (owner->so_type) {
 #ifdef _USE_NLM
@@ -837,16 +855,18 @@ void free_state_owner(state_owner_t *owner)
 		return;
 	}
 
-	gsh_free(owner->so_owner_val);
+	if (owner->so_owner_val != owner->so_owner_inline)
+		gsh_free(owner->so_owner_val);
 
 	PTHREAD_MUTEX_destroy(&owner->so_mutex);
 
 #ifdef DEBUG_SAL
-	PTHREAD_MUTEX_lock(&all_state_owners_mutex);
+	shard = state_list_shard(state_owners_all, owner);
+	PTHREAD_MUTEX_lock(&shard->sls_mutex);
 
 	glist_del(&owner->so_all_owners);
 
-	PTHREAD_MUTEX_unlock(&all_state_owners_mutex);
+	PTHREAD_MUTEX_unlock(&shard->sls_mutex);
 #endif
 
 	pool_free(state_owner_pool, owner);
@@ -970,7 +990,8 @@ void dec_state_owner_ref(state_owner_t *owner)
 
 /** @brief Remove an NFS 4 open owner from the cached owners list.
  *
- * The caller MUST hold the cached_open_owners_lock, also must NOT hold
+ * The caller MUST hold the owner's cached_open_owners shard mutex, also
+ * must NOT hold
  * so_mutex as the so_mutex may get destroyed after this call.
  *
  * If this owner is being revived, the refcount should have already been
@@ -1013,12 +1034,14 @@ static inline
 void refresh_nfs4_open_owner(struct state_nfs4_owner_t *nfs4_owner)
 {
 	time_t cache_expire;
+	struct state_list_shard *shard;
 
 	/* Since this owner is active, reset cache_expire. */
 	cache_expire = atomic_fetch_time_t(&nfs4_owner->so_cache_expire);
 
 	if (cache_expire != 0) {
-		PTHREAD_MUTEX_lock(&cached_open_owners_lock);
+		shard = state_list_shard(cached_open_owners, nfs4_owner);
+		PTHREAD_MUTEX_lock(&shard->sls_mutex);
 
 		/* Check again while holding the mutex. */
 
@@ -1027,7 +1050,7 @@ void refresh_nfs4_open_owner(struct state_nfs4_owner_t *nfs4_owner)
 			uncache_nfs4_owner(nfs4_owner);
 		}
 
-		PTHREAD_MUTEX_unlock(&cached_open_owners_lock);
+		PTHREAD_MUTEX_unlock(&shard->sls_mutex);
 	}
 }
 
@@ -1054,6 +1077,9 @@ state_owner_t *get_state_owner(care_t care, state_owner_t *key,
 	struct gsh_buffdesc buffval;
 	hash_table_t *ht_owner;
 	int32_t refcount;
+#ifdef DEBUG_SAL
+	struct state_list_shard *shard;
+#endif
 
 	if (isnew != NULL)
 		*isnew = false;
@@ -1151,11 +1177,12 @@ not_found:
 	PTHREAD_MUTEX_init(&owner->so_mutex, NULL);
 
 #ifdef DEBUG_SAL
-	PTHREAD_MUTEX_lock(&all_state_owners_mutex);
+	shard = state_list_shard(state_owners_all, owner);
+	PTHREAD_MUTEX_lock(&shard->sls_mutex);
 
-	glist_add_tail(&state_owners_all, &owner->so_all_owners);
+	glist_add_tail(&shard->sls_list, &owner->so_all_owners);
 
-	PTHREAD_MUTEX_unlock(&all_state_owners_mutex);
+	PTHREAD_MUTEX_unlock(&shard->sls_mutex);
 #endif
 
 	/* Do any owner type specific initialization */
@@ -1163,9 +1190,15 @@ not_found:
 		init_owner(owner);
 
 
-	if (key->so_owner_len != 0) {
+	if (key->so_owner_len > OWNER_INLINE_LEN) {
 		owner->so_owner_val = gsh_malloc(key->so_owner_len);
 
+		memcpy(owner->so_owner_val,
+		       key->so_owner_val,
+		       key->so_owner_len);
+	} else if (key->so_owner_len != 0) {
+		owner->so_owner_val = owner->so_owner_inline;
+
 		memcpy(owner->so_owner_val,
 		       key->so_owner_val,
 		       key->so_owner_len);
@@ -1323,20 +1356,27 @@ void state_wipe_file(struct fsal_obj_handle *obj)
 #ifdef DEBUG_SAL
 void dump_all_owners(void)
 {
+	char str[LOG_BUFF_LEN] = "\0";
+	struct display_buffer dspbuf = {sizeof(str), str, str};
+	struct glist_head *glist;
+	struct state_list_shard *shard;
+	bool empty = true;
+	int i;
+
 	if (!isFullDebug(COMPONENT_STATE))
 		return;
 
-	PTHREAD_MUTEX_lock(&all_state_owners_mutex);
+	for (i = 0; i < STATE_LIST_SHARDS; i++) {
+		shard = &state_owners_all[i];
+		PTHREAD_MUTEX_lock(&shard->sls_mutex);
 
-	if (!glist_empty(&state_owners_all)) {
-		char str[LOG_BUFF_LEN] = "\0";
-		struct display_buffer dspbuf = {sizeof(str), str, str};
-		struct glist_head *glist;
-
-		LogFullDebug(COMPONENT_STATE,
-			     " ---------------------- State Owner List ----------------------");
+		if (empty && !glist_empty(&shard->sls_list)) {
+			LogFullDebug(COMPONENT_STATE,
+				     " ---------------------- State Owner List ----------------------");
+			empty = false;
+		}
 
-		glist_for_each(glist, &state_owners_all) {
+		glist_for_each(glist, &shard->sls_list) {
 			display_reset_buffer(&dspbuf);
 			display_owner(&dspbuf, glist_entry(glist,
 							   state_owner_t,
@@ -1344,14 +1384,78 @@ void dump_all_owners(void)
 			LogFullDebug(COMPONENT_STATE, "{%s}", str);
 		}
 
+		PTHREAD_MUTEX_unlock(&shard->sls_mutex);
+	}
+
+	if (!empty)
 		LogFullDebug(COMPONENT_STATE, " ----------------------");
-	} else
+	else
 		LogFullDebug(COMPONENT_STATE, "All state owners released");
-
-	PTHREAD_MUTEX_unlock(&all_state_owners_mutex);
 }
 #endif
 
+/** Live NFSv4 and NLM states of each type */
+uint64_t state_counts[STATE_TYPE_COUNT];
+
+#ifdef USE_DBUS
+/**
+ * @brief Report the live states of each type and what they take
+ *
+ * array of struct state_count {
+ *	char *type;
+ *	uint64_t count;
+ *	uint32_t size;		(bytes of each state_t)
+ *	uint64_t bytes;		(bytes of all of them)
+ * }
+ *
+ * The bytes are those of the state_t, sized for its type; what the
+ * FSAL keeps with it, like an open file descriptor, is not included.
+ *
+ * @param iter   [IN] iterator in reply stream to fill
+ */
+void state_dbus_counts(DBusMessageIter *iter)
+{
+	static const char * const names[STATE_TYPE_COUNT] = {
+		[STATE_TYPE_SHARE] = "open",
+		[STATE_TYPE_DELEG] = "delegation",
+		[STATE_TYPE_LOCK] = "lock",
+		[STATE_TYPE_LAYOUT] = "layout",
+		[STATE_TYPE_NLM_LOCK] = "nlm_lock",
+		[STATE_TYPE_NLM_SHARE] = "nlm_share",
+	};
+	DBusMessageIter array_iter, struct_iter;
+	struct timespec timestamp;
+	enum state_type type;
+	uint64_t count, bytes;
+	uint32_t size;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 "(stut)", &array_iter);
+	for (type = STATE_TYPE_SHARE; type <= STATE_TYPE_NLM_SHARE; type++) {
+		count = atomic_fetch_uint64_t(&state_counts[type]);
+		size = sizeof_state(type);
+		bytes = count * size;
+
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &names[type]);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &count);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &size);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &bytes);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+#endif				/* USE_DBUS */
+
 /**
  * @brief Release all the state belonging to an export.
  *
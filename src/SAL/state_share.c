@@ -391,4 +391,42 @@ void state_export_unshare_all(void)
 }
 #endif /* _USE_NLM */
 
+/**
+ * @brief Expire courtesy clients holding opens a new open conflicts with
+ *
+ * @note The state_lock MUST be held
+ *
+ * @param[in] ostate       File state
+ * @param[in] share_access Access of the new open
+ * @param[in] share_deny   Deny of the new open
+ *
+ * @return true if a courtesy client conflicts, the open is worth
+ *         retrying once it is gone.
+ */
+bool state_share_courtesy_conflict(struct state_hdl *ostate,
+				   unsigned int share_access,
+				   unsigned int share_deny)
+{
+	struct glist_head *glist;
+	state_t *state;
+	bool courtesy = false;
+
+	glist_for_each(glist, &ostate->file.list_of_states) {
+		state = glist_entry(glist, state_t, state_list);
+
+		if (state->state_type != STATE_TYPE_SHARE ||
+		    state->state_owner == NULL)
+			continue;
+
+		if (!(state->state_data.share.share_access & share_deny) &&
+		    !(state->state_data.share.share_deny & share_access))
+			continue;
+
+		if (state_owner_courtesy_conflict(state->state_owner))
+			courtesy = true;
+	}
+
+	return courtesy;
+}
+
 /** @} */
@@ -118,6 +118,14 @@ else (NOT CEPH_FS)
 	  set(USE_FSAL_CEPH_RECLAIM_RESET ON)
   endif(NOT CEPH_FS_RECLAIM_RESET)
 
+  check_library_exists(cephfs ceph_ll_nonblocking_readv_writev ${CEPHFS_LIBRARY_DIR} CEPH_FS_NONBLOCKING_IO)
+  if(NOT CEPH_FS_NONBLOCKING_IO)
+	  message("Cannot find ceph_ll_nonblocking_readv_writev. FSAL_CEPH I/O will block the worker threads.")
+	  set(USE_FSAL_CEPH_LL_NONBLOCKING_IO OFF)
+  else(NOT CEPH_FS_NONBLOCKING_IO)
+	  set(USE_FSAL_CEPH_LL_NONBLOCKING_IO ON)
+  endif(NOT CEPH_FS_NONBLOCKING_IO)
+
   set(CMAKE_REQUIRED_INCLUDES ${CEPHFS_INCLUDE_DIR})
   check_symbol_exists(CEPH_STATX_INO "cephfs/libcephfs.h" CEPH_FS_CEPH_STATX)
   if(NOT CEPH_FS_CEPH_STATX)
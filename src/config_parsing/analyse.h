@@ -74,6 +74,10 @@ struct config_node {
 struct file_list {
 	struct file_list *next;
 	char *pathname;
+	bool url;		/* fetched with %url */
+	bool hashed;		/* hash and size are of its content */
+	uint64_t hash;
+	uint64_t size;
 };
 
 /*
@@ -123,8 +127,19 @@ char *save_token(char *token, bool esc, struct parser_state *st);
 int ganesha_yyparse(struct parser_state *st);
 int ganeshun_yy_init_parser(char *srcfile,
 			   struct parser_state *st);
+int ganeshun_yy_init_parser_buf(char *srcbuf,
+				struct parser_state *st);
 void ganeshun_yy_cleanup_parser(struct parser_state *st);
 
+/**
+ * Compiled config cache, conf_cache.c
+ */
+
+bool config_cache_hash(FILE *f, uint64_t *hash, uint64_t *size);
+struct config_root *config_cache_load(const char *cache_path,
+				      const char *file_path);
+void config_cache_save(const char *cache_path, struct config_root *root);
+
 /**
  * Error reporting
  */
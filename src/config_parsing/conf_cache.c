@@ -0,0 +1,670 @@
+/* ----------------------------------------------------------------------------
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file conf_cache.c
+ * @brief Compiled form of a parse tree
+ *
+ * A parse tree that was built without errors is written out in a flat
+ * binary form: the files it came from, each with a hash and size of
+ * its content, its nodes in pre-order and its token table.  When the
+ * same configuration file is parsed again, the cache is mapped, its
+ * checksum verified, and every source, %url ones included, hashed
+ * again.  If they all still match, the tree is rebuilt from the cache
+ * without running the scanner or parser.  Otherwise the caller parses
+ * the text and writes the cache anew.
+ *
+ * The cache is only an image of this build's parse tree; it holds no
+ * byte order or version independence and is simply not used by a
+ * build that does not recognize it.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "config_parsing.h"
+#include "analyse.h"
+#include "abstract_mem.h"
+#include "conf_yacc.h"
+#include "conf_url.h"
+#include "city.h"
+#include "log.h"
+
+#define CONF_CACHE_MAGIC 0x47534843464743ULL
+#define CONF_CACHE_VERSION 1
+
+/** No string or file */
+#define CONF_CACHE_NONE UINT32_MAX
+
+/** Deepest nesting of blocks a cache may hold */
+#define CONF_CACHE_MAX_DEPTH 64
+
+/** Chunk sources are hashed in */
+#define CONF_CACHE_CHUNK (64 * 1024)
+
+struct conf_cache_hdr {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t nfiles;
+	uint32_t nnodes;	/*< Not counting the root */
+	uint32_t nroot;		/*< Nodes at the top level */
+	uint32_t ntokens;
+	uint32_t src;		/*< String of the file parsed */
+	uint32_t conf_dir;	/*< String of the directory of includes */
+	uint32_t pad;
+	uint64_t strings_len;
+	uint64_t checksum;	/*< Of all that follows the header */
+};
+
+#define CONF_CACHE_FILE_URL 1
+
+struct conf_cache_file {
+	uint64_t hash;
+	uint64_t size;
+	uint32_t path;		/*< String of its pathname */
+	uint32_t flags;
+};
+
+struct conf_cache_node {
+	uint32_t name;		/*< Token of the name, or a term's value */
+	uint32_t op_code;	/*< Token of a term's operator */
+	uint32_t file;		/*< Index of the file it is in */
+	int32_t linenumber;
+	uint32_t nsub;		/*< Sub nodes, which follow it */
+	uint8_t type;
+	uint8_t term_type;
+	uint16_t pad;
+};
+
+/**
+ * @brief Hash the whole content of a stream
+ *
+ * The stream is rewound after, so the scanner can read it.
+ *
+ * @param[in]  f     Stream, at its start
+ * @param[out] hash  Hash of its content
+ * @param[out] size  Its length
+ *
+ * @retval true if it could be read to the end.
+ */
+bool config_cache_hash(FILE *f, uint64_t *hash, uint64_t *size)
+{
+	char *buf = gsh_malloc(CONF_CACHE_CHUNK);
+	uint64_t h = 0, len = 0;
+	size_t n;
+	bool ok;
+
+	while ((n = fread(buf, 1, CONF_CACHE_CHUNK, f)) > 0) {
+		h = CityHash64WithSeed(buf, n, h);
+		len += n;
+	}
+	ok = !ferror(f);
+	gsh_free(buf);
+	rewind(f);
+
+	*hash = h;
+	*size = len;
+	return ok;
+}
+
+/**
+ * @brief Check that a source still has the content the cache was of
+ */
+static bool cache_source_valid(const char *path,
+			       const struct conf_cache_file *cf)
+{
+	uint64_t hash, size;
+	char *fbuf = NULL;
+	FILE *f = NULL;
+	bool ok;
+
+	if (cf->flags & CONF_CACHE_FILE_URL) {
+		(void) config_url_fetch(path, &f, &fbuf);
+	} else {
+		f = fopen(path, "r");
+	}
+	if (f == NULL)
+		return false;
+
+	ok = config_cache_hash(f, &hash, &size);
+
+	if (cf->flags & CONF_CACHE_FILE_URL)
+		config_url_release(f, fbuf);
+	else
+		fclose(f);
+
+	return ok && hash == cf->hash && size == cf->size;
+}
+
+/*
+ * Loading
+ */
+
+struct cache_load {
+	const struct conf_cache_node *nodes;
+	uint32_t nnodes;
+	uint32_t next;		/*< Node to be loaded next */
+	char **tokens;
+	uint32_t ntokens;
+	char **files;
+	uint32_t nfiles;
+};
+
+static bool cache_child_ok(enum node_type parent, enum node_type child)
+{
+	if (parent == TYPE_STMT)
+		return child == TYPE_TERM;
+	return child == TYPE_BLOCK || child == TYPE_STMT;
+}
+
+/**
+ * @brief Rebuild the sub nodes of a node from the cache
+ *
+ * Each node is linked to its parent before its own sub nodes are
+ * loaded, so a tree given up half way is still freed whole.  Blocks
+ * are put on all_blocks after their sub blocks, as the parser does.
+ */
+static bool cache_load_sub_nodes(struct cache_load *cl,
+				 struct config_node *parent,
+				 uint32_t nsub, int depth)
+{
+	const struct conf_cache_node *cn;
+	struct config_node *node;
+	uint32_t i;
+
+	if (depth > CONF_CACHE_MAX_DEPTH)
+		return false;
+
+	for (i = 0; i < nsub; i++) {
+		if (cl->next >= cl->nnodes)
+			return false;
+		cn = &cl->nodes[cl->next++];
+
+		if (cn->type < TYPE_BLOCK || cn->type > TYPE_TERM ||
+		    !cache_child_ok(parent->type, cn->type) ||
+		    cn->name >= cl->ntokens ||
+		    (cn->file != CONF_CACHE_NONE && cn->file >= cl->nfiles))
+			return false;
+
+		node = gsh_calloc(1, sizeof(struct config_node));
+		glist_init(&node->node);
+		glist_init(&node->blocks);
+		node->filename = cn->file == CONF_CACHE_NONE
+					? NULL : cl->files[cn->file];
+		node->linenumber = cn->linenumber;
+		node->type = cn->type;
+		glist_add_tail(&parent->u.nterm.sub_nodes, &node->node);
+
+		if (cn->type == TYPE_TERM) {
+			if (cn->nsub != 0 ||
+			    cn->term_type < TERM_TOKEN ||
+			    cn->term_type > TERM_NETGROUP ||
+			    (cn->op_code != CONF_CACHE_NONE &&
+			     cn->op_code >= cl->ntokens))
+				return false;
+			node->u.term.type = cn->term_type;
+			node->u.term.varvalue = cl->tokens[cn->name];
+			if (cn->op_code != CONF_CACHE_NONE)
+				node->u.term.op_code = cl->tokens[cn->op_code];
+			continue;
+		}
+
+		node->u.nterm.name = cl->tokens[cn->name];
+		glist_init(&node->u.nterm.sub_nodes);
+		if (cn->type == TYPE_BLOCK)
+			node->u.nterm.parent = parent;
+		if (!cache_load_sub_nodes(cl, node, cn->nsub, depth + 1))
+			return false;
+		if (cn->type == TYPE_BLOCK)
+			glist_add_tail(&all_blocks, &node->blocks);
+	}
+	return true;
+}
+
+static bool cache_str_ok(const struct conf_cache_hdr *hdr, uint32_t off)
+{
+	return off < hdr->strings_len;
+}
+
+/**
+ * @brief Rebuild a parse tree from its cache
+ *
+ * all_blocks must be empty; it is left with the blocks of the tree.
+ *
+ * @param[in] cache_path  The cache file
+ * @param[in] file_path   The configuration file being parsed
+ *
+ * @return The tree, or NULL if the cache is missing, not valid, of
+ *         another file, or its sources have changed since.
+ */
+struct config_root *config_cache_load(const char *cache_path,
+				      const char *file_path)
+{
+	const struct conf_cache_hdr *hdr;
+	const struct conf_cache_file *cfiles;
+	const uint32_t *ctokens;
+	const char *strings;
+	struct config_root *root = NULL;
+	struct file_list *flist, **ftail;
+	struct token_tab *tok, **ttail;
+	struct cache_load cl;
+	struct stat st;
+	uint64_t body;
+	char *map;
+	uint32_t i;
+	int fd;
+
+	fd = open(cache_path, O_RDONLY);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			LogWarn(COMPONENT_CONFIG,
+				"Could not open config cache %s: %s",
+				cache_path, strerror(errno));
+		return NULL;
+	}
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*hdr)) {
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	hdr = (const struct conf_cache_hdr *)map;
+	body = (uint64_t)hdr->nfiles * sizeof(*cfiles) +
+	       (uint64_t)hdr->nnodes * sizeof(struct conf_cache_node) +
+	       (uint64_t)hdr->ntokens * sizeof(*ctokens) +
+	       hdr->strings_len;
+
+	if (hdr->magic != CONF_CACHE_MAGIC ||
+	    hdr->version != CONF_CACHE_VERSION ||
+	    sizeof(*hdr) + body != (uint64_t)st.st_size ||
+	    hdr->strings_len == 0 ||
+	    CityHash64(map + sizeof(*hdr), body) != hdr->checksum) {
+		LogWarn(COMPONENT_CONFIG,
+			"Config cache %s is not valid, ignored", cache_path);
+		goto out;
+	}
+
+	cfiles = (const struct conf_cache_file *)(map + sizeof(*hdr));
+	cl.nodes = (const struct conf_cache_node *)(cfiles + hdr->nfiles);
+	ctokens = (const uint32_t *)(cl.nodes + hdr->nnodes);
+	strings = (const char *)(ctokens + hdr->ntokens);
+
+	/* With the last string terminated, none may run off the end */
+	if (strings[hdr->strings_len - 1] != '\0' ||
+	    !cache_str_ok(hdr, hdr->src) || !cache_str_ok(hdr, hdr->conf_dir))
+		goto out;
+
+	if (strcmp(strings + hdr->src, file_path) != 0) {
+		LogDebug(COMPONENT_CONFIG,
+			 "Config cache %s is of %s, not %s",
+			 cache_path, strings + hdr->src, file_path);
+		goto out;
+	}
+
+	for (i = 0; i < hdr->nfiles; i++) {
+		if (!cache_str_ok(hdr, cfiles[i].path))
+			goto out;
+		if (!cache_source_valid(strings + cfiles[i].path,
+					&cfiles[i])) {
+			LogInfo(COMPONENT_CONFIG,
+				"%s changed since config cache %s was written",
+				strings + cfiles[i].path, cache_path);
+			goto out;
+		}
+	}
+	for (i = 0; i < hdr->ntokens; i++) {
+		if (!cache_str_ok(hdr, ctokens[i]))
+			goto out;
+	}
+
+	root = gsh_calloc(1, sizeof(struct config_root));
+	glist_init(&root->root.node);
+	glist_init(&root->root.u.nterm.sub_nodes);
+	root->root.type = TYPE_ROOT;
+	root->root.filename = gsh_strdup(file_path);
+	root->conf_dir = gsh_strdup(strings + hdr->conf_dir);
+
+	cl.nnodes = hdr->nnodes;
+	cl.next = 0;
+	cl.nfiles = hdr->nfiles;
+	cl.ntokens = hdr->ntokens;
+	cl.files = gsh_calloc(hdr->nfiles + 1, sizeof(char *));
+	cl.tokens = gsh_calloc(hdr->ntokens + 1, sizeof(char *));
+
+	/* Lists are rebuilt in the order they were written */
+	ftail = &root->files;
+	for (i = 0; i < hdr->nfiles; i++) {
+		flist = gsh_calloc(1, sizeof(struct file_list));
+		flist->pathname = gsh_strdup(strings + cfiles[i].path);
+		flist->url = (cfiles[i].flags & CONF_CACHE_FILE_URL) != 0;
+		flist->hash = cfiles[i].hash;
+		flist->size = cfiles[i].size;
+		flist->hashed = true;
+		*ftail = flist;
+		ftail = &flist->next;
+		cl.files[i] = flist->pathname;
+	}
+	ttail = &root->tokens;
+	for (i = 0; i < hdr->ntokens; i++) {
+		const char *s = strings + ctokens[i];
+		size_t len = strlen(s);
+
+		tok = gsh_calloc(1, sizeof(struct token_tab) + len + 1);
+		memcpy(tok->token, s, len);
+		*ttail = tok;
+		ttail = &tok->next;
+		cl.tokens[i] = tok->token;
+	}
+
+	if (!cache_load_sub_nodes(&cl, &root->root, hdr->nroot, 0) ||
+	    cl.next != cl.nnodes) {
+		LogWarn(COMPONENT_CONFIG,
+			"Config cache %s has a malformed tree, ignored",
+			cache_path);
+		free_parse_tree(root);
+		glist_init(&all_blocks);
+		root = NULL;
+	}
+	gsh_free(cl.files);
+	gsh_free(cl.tokens);
+
+	if (root != NULL)
+		LogEvent(COMPONENT_CONFIG,
+			 "Loaded %s from config cache %s, %u nodes",
+			 file_path, cache_path, cl.nnodes);
+out:
+	munmap(map, st.st_size);
+	return root;
+}
+
+/*
+ * Saving
+ */
+
+struct token_idx {
+	const char *token;
+	uint32_t idx;
+};
+
+struct cache_save {
+	struct conf_cache_node *nodes;
+	uint32_t next;
+	struct token_idx *tokens;
+	uint32_t ntokens;
+	struct file_list **files;
+	uint32_t nfiles;
+};
+
+static int token_idx_cmp(const void *a, const void *b)
+{
+	const char *ta = ((const struct token_idx *)a)->token;
+	const char *tb = ((const struct token_idx *)b)->token;
+
+	return ta < tb ? -1 : ta > tb ? 1 : 0;
+}
+
+/**
+ * @brief Index of a token in the token table
+ *
+ * Every name and value of the tree points into the token table, so
+ * the pointer itself is looked up.
+ */
+static uint32_t cache_token(struct cache_save *cs, const char *token)
+{
+	struct token_idx key = { .token = token }, *found;
+
+	if (token == NULL)
+		return CONF_CACHE_NONE;
+	found = bsearch(&key, cs->tokens, cs->ntokens,
+			sizeof(struct token_idx), token_idx_cmp);
+	return found == NULL ? CONF_CACHE_NONE : found->idx;
+}
+
+static uint32_t cache_file(struct cache_save *cs, const char *filename)
+{
+	uint32_t i;
+
+	if (filename == NULL)
+		return CONF_CACHE_NONE;
+	for (i = 0; i < cs->nfiles; i++) {
+		if (cs->files[i]->pathname == filename ||
+		    strcmp(cs->files[i]->pathname, filename) == 0)
+			return i;
+	}
+	return CONF_CACHE_NONE;
+}
+
+static uint32_t cache_count_nodes(struct config_node *node)
+{
+	struct config_node *sub;
+	struct glist_head *ns;
+	uint32_t count = 0;
+
+	if (node->type == TYPE_TERM)
+		return 0;
+	glist_for_each(ns, &node->u.nterm.sub_nodes) {
+		sub = glist_entry(ns, struct config_node, node);
+		count += 1 + cache_count_nodes(sub);
+	}
+	return count;
+}
+
+/**
+ * @brief Append a string to the string table
+ *
+ * @return Its offset.
+ */
+static uint32_t cache_str(char *strings, size_t *len, const char *s)
+{
+	uint32_t off = *len;
+
+	strcpy(strings + off, s);
+	*len += strlen(s) + 1;
+	return off;
+}
+
+static bool cache_save_sub_nodes(struct cache_save *cs,
+				 struct config_node *parent)
+{
+	struct config_node *node;
+	struct conf_cache_node *cn;
+	struct glist_head *ns;
+
+	glist_for_each(ns, &parent->u.nterm.sub_nodes) {
+		node = glist_entry(ns, struct config_node, node);
+		cn = &cs->nodes[cs->next++];
+		cn->type = node->type;
+		cn->file = cache_file(cs, node->filename);
+		cn->linenumber = node->linenumber;
+		cn->op_code = CONF_CACHE_NONE;
+		if (node->type == TYPE_TERM) {
+			cn->term_type = node->u.term.type;
+			cn->name = cache_token(cs, node->u.term.varvalue);
+			if (node->u.term.op_code != NULL) {
+				cn->op_code = cache_token(cs,
+							  node->u.term.op_code);
+				if (cn->op_code == CONF_CACHE_NONE)
+					return false;
+			}
+		} else {
+			cn->name = cache_token(cs, node->u.nterm.name);
+			cn->nsub = glist_length(&node->u.nterm.sub_nodes);
+		}
+		if (cn->name == CONF_CACHE_NONE)
+			return false;
+		if (node->type != TYPE_TERM &&
+		    !cache_save_sub_nodes(cs, node))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Write the cache of a parse tree
+ *
+ * The tree must have been parsed without errors.  It is written to a
+ * temporary file renamed over the cache, so a reader sees either the
+ * old cache or the new one.
+ *
+ * @param[in] cache_path  The cache file
+ * @param[in] root        The tree
+ */
+void config_cache_save(const char *cache_path, struct config_root *root)
+{
+	struct conf_cache_hdr *hdr;
+	struct conf_cache_file *cfiles;
+	uint32_t *ctokens;
+	char *strings, *buf = NULL, *tmp = NULL;
+	struct cache_save cs;
+	struct file_list *fp;
+	struct token_tab *tok;
+	uint64_t strings_len = 0;
+	uint32_t nnodes, i;
+	size_t body, len;
+	ssize_t n = 0;
+	int fd;
+
+	memset(&cs, 0, sizeof(cs));
+
+	for (fp = root->files; fp != NULL; fp = fp->next) {
+		if (!fp->hashed) {
+			LogInfo(COMPONENT_CONFIG,
+				"%s could not be hashed, config cache %s not written",
+				fp->pathname, cache_path);
+			return;
+		}
+		strings_len += strlen(fp->pathname) + 1;
+		cs.nfiles++;
+	}
+	for (tok = root->tokens; tok != NULL; tok = tok->next) {
+		strings_len += strlen(tok->token) + 1;
+		cs.ntokens++;
+	}
+	strings_len += strlen(root->root.filename) + 1;
+	strings_len += strlen(root->conf_dir) + 1;
+	if (strings_len >= CONF_CACHE_NONE)
+		return;
+
+	nnodes = cache_count_nodes(&root->root);
+
+	body = cs.nfiles * sizeof(*cfiles) +
+	       (size_t)nnodes * sizeof(struct conf_cache_node) +
+	       cs.ntokens * sizeof(*ctokens) + strings_len;
+	buf = gsh_calloc(1, sizeof(*hdr) + body);
+
+	hdr = (struct conf_cache_hdr *)buf;
+	cfiles = (struct conf_cache_file *)(buf + sizeof(*hdr));
+	cs.nodes = (struct conf_cache_node *)(cfiles + cs.nfiles);
+	ctokens = (uint32_t *)(cs.nodes + nnodes);
+	strings = (char *)(ctokens + cs.ntokens);
+
+	hdr->magic = CONF_CACHE_MAGIC;
+	hdr->version = CONF_CACHE_VERSION;
+	hdr->nfiles = cs.nfiles;
+	hdr->nnodes = nnodes;
+	hdr->nroot = glist_length(&root->root.u.nterm.sub_nodes);
+	hdr->ntokens = cs.ntokens;
+	hdr->strings_len = strings_len;
+
+	len = 0;
+	hdr->src = cache_str(strings, &len, root->root.filename);
+	hdr->conf_dir = cache_str(strings, &len, root->conf_dir);
+
+	cs.files = gsh_calloc(cs.nfiles + 1, sizeof(struct file_list *));
+	for (fp = root->files, i = 0; fp != NULL; fp = fp->next, i++) {
+		cs.files[i] = fp;
+		cfiles[i].hash = fp->hash;
+		cfiles[i].size = fp->size;
+		cfiles[i].path = cache_str(strings, &len, fp->pathname);
+		cfiles[i].flags = fp->url ? CONF_CACHE_FILE_URL : 0;
+	}
+
+	cs.tokens = gsh_calloc(cs.ntokens + 1, sizeof(struct token_idx));
+	for (tok = root->tokens, i = 0; tok != NULL; tok = tok->next, i++) {
+		cs.tokens[i].token = tok->token;
+		cs.tokens[i].idx = i;
+		ctokens[i] = cache_str(strings, &len, tok->token);
+	}
+	qsort(cs.tokens, cs.ntokens, sizeof(struct token_idx), token_idx_cmp);
+
+	if (!cache_save_sub_nodes(&cs, &root->root)) {
+		LogWarn(COMPONENT_CONFIG,
+			"Parse tree has a string not in its token table, config cache %s not written",
+			cache_path);
+		goto out;
+	}
+
+	hdr->checksum = CityHash64(buf + sizeof(*hdr), body);
+
+	tmp = gsh_malloc(strlen(cache_path) + 24);
+	sprintf(tmp, "%s.%d.tmp", cache_path, (int)getpid());
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		LogWarn(COMPONENT_CONFIG,
+			"Could not create config cache %s: %s",
+			tmp, strerror(errno));
+		goto out;
+	}
+	len = 0;
+	while (len < sizeof(*hdr) + body) {
+		n = write(fd, buf + len, sizeof(*hdr) + body - len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			break;
+		len += n;
+	}
+	/* A torn cache fails its checksum, it need not be synced */
+	if (close(fd) != 0)
+		n = -1;
+	if (n < 0) {
+		LogWarn(COMPONENT_CONFIG,
+			"Could not write config cache %s: %s",
+			tmp, strerror(errno));
+		unlink(tmp);
+		goto out;
+	}
+	if (rename(tmp, cache_path) != 0) {
+		LogWarn(COMPONENT_CONFIG,
+			"Could not rename %s to %s: %s",
+			tmp, cache_path, strerror(errno));
+		unlink(tmp);
+		goto out;
+	}
+	LogInfo(COMPONENT_CONFIG,
+		"Wrote config cache %s of %s, %u nodes",
+		cache_path, root->root.filename, nnodes);
+out:
+	gsh_free(tmp);
+	gsh_free(cs.files);
+	gsh_free(cs.tokens);
+	gsh_free(buf);
+}
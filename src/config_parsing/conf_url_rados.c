@@ -23,8 +23,14 @@
 #include "conf_url_rados.h"
 #include <stdio.h>
 #include <stdbool.h>
+#include <errno.h>
 #include <regex.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
 #include "log.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
 #include "sal_functions.h"
 
 #ifdef RADOS_URLS
@@ -38,6 +44,8 @@ static struct rados_url_parameter {
 	char *ceph_conf;
 	/** Userid (?) */
 	char *userid;
+	/** Watch fetched objects and reload when notified */
+	bool watch_url;
 } rados_url_param;
 
 static struct config_item rados_url_params[] = {
@@ -45,9 +53,168 @@ static struct config_item rados_url_params[] = {
 		       rados_url_parameter, ceph_conf),
 	CONF_ITEM_STR("userid", 1, MAXPATHLEN, NULL,
 		       rados_url_parameter, userid),
+	CONF_ITEM_BOOL("watch_url", false,
+		       rados_url_parameter, watch_url),
 	CONFIG_EOL
 };
 
+/**
+ * @brief A watch on a config object
+ *
+ * Every object fetched is watched once, on an ioctx of its own that
+ * lives as long as the watch.  A notify on it reloads the
+ * configuration the way SIGHUP does.  Watches are kept until shutdown;
+ * one of an object no longer included only costs a spurious reload.
+ */
+struct rados_url_watch {
+	struct glist_head list;
+	char *url;		/*< (<pool>/)object, as fetched */
+	char *oid;
+	rados_ioctx_t io_ctx;
+	uint64_t cookie;
+	int32_t broken;		/*< The watch was lost, set it up again */
+};
+
+static struct glist_head url_watches = GLIST_HEAD_INIT(url_watches);
+static pthread_mutex_t url_watch_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Ask the signal manager thread for a config reload
+ *
+ * Pending SIGHUPs merge, so a burst of notifies is one reload.
+ */
+static void rados_url_reload(void)
+{
+	if (kill(getpid(), SIGHUP) != 0)
+		LogEvent(COMPONENT_CONFIG,
+			 "Could not signal config reload: %s",
+			 strerror(errno));
+}
+
+static void rados_url_watchcb(void *arg, uint64_t notify_id, uint64_t handle,
+			      uint64_t notifier_id, void *data,
+			      size_t data_len)
+{
+	struct rados_url_watch *w = arg;
+	int ret;
+
+	/* ACK it first, so the notifier doesn't wait on our reload */
+	ret = rados_notify_ack(w->io_ctx, w->oid, notify_id, w->cookie,
+			       NULL, 0);
+	if (ret < 0)
+		LogEvent(COMPONENT_CONFIG,
+			 "rados_notify_ack of %s failed: %d", w->url, ret);
+
+	LogEvent(COMPONENT_CONFIG,
+		 "Config object %s was updated, reloading", w->url);
+	rados_url_reload();
+}
+
+static void rados_url_watcherrcb(void *arg, uint64_t cookie, int err)
+{
+	struct rados_url_watch *w = arg;
+
+	LogEvent(COMPONENT_CONFIG,
+		 "Watch on config object %s lost: %d, reloading",
+		 w->url, err);
+
+	/* Notifies may have been missed; the reload fetches the object
+	 * again, and that sets the watch up again.
+	 */
+	atomic_store_int32_t(&w->broken, true);
+	rados_url_reload();
+}
+
+/**
+ * @brief Watch a config object once it has been fetched
+ */
+static void rados_url_watch(const char *url, const char *pool_name,
+			    const char *object_name)
+{
+	struct rados_url_watch *w = NULL;
+	struct glist_head *glh;
+	bool new_watch = false;
+	int ret;
+
+	PTHREAD_MUTEX_lock(&url_watch_mtx);
+
+	glist_for_each(glh, &url_watches) {
+		w = glist_entry(glh, struct rados_url_watch, list);
+		if (strcmp(w->url, url) == 0)
+			break;
+		w = NULL;
+	}
+
+	if (w != NULL && !atomic_fetch_int32_t(&w->broken))
+		goto out;
+
+	if (w == NULL) {
+		w = gsh_calloc(1, sizeof(*w));
+		w->url = gsh_strdup(url);
+		w->oid = gsh_strdup(object_name);
+		ret = rados_ioctx_create(cluster, pool_name, &w->io_ctx);
+		if (ret < 0) {
+			LogEvent(COMPONENT_CONFIG,
+				 "%s: Failed to create ioctx to watch %s: %d",
+				 __func__, url, ret);
+			goto free_out;
+		}
+		new_watch = true;
+	} else {
+		(void) rados_unwatch2(w->io_ctx, w->cookie);
+	}
+
+	/* Same timeout as the watch on the grace DB */
+	ret = rados_watch3(w->io_ctx, w->oid, &w->cookie, rados_url_watchcb,
+			   rados_url_watcherrcb, 30, w);
+	if (ret < 0) {
+		LogEvent(COMPONENT_CONFIG,
+			 "%s: Failed to watch config object %s: %d",
+			 __func__, url, ret);
+		if (new_watch) {
+			rados_ioctx_destroy(w->io_ctx);
+			goto free_out;
+		}
+		goto out;
+	}
+	atomic_store_int32_t(&w->broken, false);
+
+	if (new_watch)
+		glist_add_tail(&url_watches, &w->list);
+	LogInfo(COMPONENT_CONFIG, "Watching config object %s", url);
+	goto out;
+
+free_out:
+	gsh_free(w->url);
+	gsh_free(w->oid);
+	gsh_free(w);
+out:
+	PTHREAD_MUTEX_unlock(&url_watch_mtx);
+}
+
+static void rados_url_unwatch_all(void)
+{
+	struct rados_url_watch *w;
+	struct glist_head *glh, *gln;
+
+	PTHREAD_MUTEX_lock(&url_watch_mtx);
+
+	glist_for_each_safe(glh, gln, &url_watches) {
+		w = glist_entry(glh, struct rados_url_watch, list);
+		glist_del(&w->list);
+		(void) rados_unwatch2(w->io_ctx, w->cookie);
+		rados_ioctx_destroy(w->io_ctx);
+		gsh_free(w->url);
+		gsh_free(w->oid);
+		gsh_free(w);
+	}
+
+	PTHREAD_MUTEX_unlock(&url_watch_mtx);
+
+	/* No callback may be running once the cluster is shut down */
+	(void) rados_watch_flush(cluster);
+}
+
 static void *rados_url_param_init(void *link_mem, void *self_struct)
 {
 	if (self_struct == NULL)
@@ -174,6 +341,7 @@ static void cu_rados_url_init(void)
 static void cu_rados_url_shutdown(void)
 {
 	if (initialized) {
+		rados_url_unwatch_all();
 		rados_shutdown(cluster);
 		regfree(&url_regex);
 		initialized = false;
@@ -293,6 +461,9 @@ static int cu_rados_url_fetch(const char *url, FILE **f, char **fbuf)
 		/* return--caller will release */
 		*f = stream;
 		*fbuf = streambuf;
+
+		if (rados_url_param.watch_url)
+			rados_url_watch(x0, pool_name, object_name);
 	}
 
 err:
@@ -38,13 +38,13 @@
 #include "log.h"
 #include "fsal_convert.h"
 
-/* config_ParseFile:
- * Reads the content of a configuration file and
- * stores it in a memory structure.
+/* config_parse:
+ * Reads the content of a configuration file, or of a string
+ * if is_buf, and stores it in a memory structure.
  */
 
-config_file_t config_ParseFile(char *file_path,
-			       struct config_error_type *err_type)
+static config_file_t config_parse(char *src, bool is_buf,
+				  struct config_error_type *err_type)
 {
 	struct parser_state st;
 	struct config_root *root;
@@ -53,7 +53,10 @@ config_file_t config_ParseFile(char *file_path,
 	glist_init(&all_blocks);
 	memset(&st, 0, sizeof(struct parser_state));
 	st.err_type = err_type;
-	rc = ganeshun_yy_init_parser(file_path, &st);
+	if (is_buf)
+		rc = ganeshun_yy_init_parser_buf(src, &st);
+	else
+		rc = ganeshun_yy_init_parser(src, &st);
 	if (rc) {
 		return NULL;
 	}
@@ -71,6 +74,47 @@ config_file_t config_ParseFile(char *file_path,
 	return (config_file_t)root;
 }
 
+/* Compiled cache of the parse tree of cache_config_path */
+static char *cache_config_path;
+static char *cache_path;
+
+void config_SetCache(const char *config_path, const char *cache_file)
+{
+	gsh_free(cache_config_path);
+	gsh_free(cache_path);
+	cache_config_path = NULL;
+	cache_path = NULL;
+	if (config_path == NULL || cache_file == NULL)
+		return;
+	cache_config_path = gsh_strdup(config_path);
+	cache_path = gsh_strdup(cache_file);
+}
+
+config_file_t config_ParseFile(char *file_path,
+			       struct config_error_type *err_type)
+{
+	struct config_root *root;
+	bool cached = cache_path != NULL &&
+		      strcmp(file_path, cache_config_path) == 0;
+
+	if (cached) {
+		glist_init(&all_blocks);
+		root = config_cache_load(cache_path, file_path);
+		if (root != NULL)
+			return (config_file_t)root;
+	}
+	root = (struct config_root *)config_parse(file_path, false, err_type);
+	if (cached && root != NULL && config_error_no_error(err_type))
+		config_cache_save(cache_path, root);
+	return (config_file_t)root;
+}
+
+config_file_t config_ParseString(char *buf,
+				 struct config_error_type *err_type)
+{
+	return config_parse(buf, true, err_type);
+}
+
 /**
  *  Return the first node in the global config block list with
  *  name == block_name
@@ -1814,6 +1858,130 @@ out:
 	return rc;
 }
 
+#define CONFIG_HASH_PRIME 0x100000001b3ULL
+
+static uint64_t hash_config_str(uint64_t hash, const char *str)
+{
+	const unsigned char *cp = (const unsigned char *)str;
+
+	if (cp != NULL) {
+		for (; *cp != '\0'; cp++) {
+			hash ^= *cp;
+			hash *= CONFIG_HASH_PRIME;
+		}
+	}
+
+	/* Hash the terminator too so "ab" "c" is not "a" "bc" */
+	hash *= CONFIG_HASH_PRIME;
+	return hash;
+}
+
+static uint64_t hash_config_node(uint64_t hash, struct config_node *node)
+{
+	struct glist_head *ns;
+
+	hash ^= node->type;
+	hash *= CONFIG_HASH_PRIME;
+
+	if (node->type == TYPE_TERM) {
+		hash ^= node->u.term.type;
+		hash *= CONFIG_HASH_PRIME;
+		hash = hash_config_str(hash, node->u.term.op_code);
+		return hash_config_str(hash, node->u.term.varvalue);
+	}
+
+	hash = hash_config_str(hash, node->u.nterm.name);
+	glist_for_each(ns, &node->u.nterm.sub_nodes) {
+		hash = hash_config_node(hash,
+					glist_entry(ns, struct config_node,
+						    node));
+	}
+
+	/* Close the block or statement */
+	hash ^= node->type;
+	hash *= CONFIG_HASH_PRIME;
+	return hash;
+}
+
+/**
+ * @brief Hash a parse tree node and everything under it
+ *
+ * Names and values are hashed (FNV-1a), where they came from is not,
+ * so a block hashes the same wherever it is in the file.
+ *
+ * @param tree_node [IN] A CONFIG_BLOCK node in the parse tree
+ *
+ * @return The hash, never 0.
+ */
+
+uint64_t config_node_hash(void *tree_node)
+{
+	uint64_t hash;
+
+	hash = hash_config_node(0xcbf29ce484222325ULL,
+				(struct config_node *)tree_node);
+	return hash != 0 ? hash : 1;
+}
+
+/**
+ * @brief Hash all the top level blocks of a given name
+ *
+ * @param config  [IN] root of parse tree
+ * @param blkname [IN] block name
+ *
+ * @return The hash, 0 if there is no such block.
+ */
+
+uint64_t config_block_hash(config_file_t config, const char *blkname)
+{
+	struct config_root *tree = (struct config_root *)config;
+	struct config_node *node;
+	struct glist_head *ns;
+	uint64_t hash = 0;
+
+	if (tree == NULL)
+		return 0;
+
+	glist_for_each(ns, &tree->root.u.nterm.sub_nodes) {
+		node = glist_entry(ns, struct config_node, node);
+		if (node->type == TYPE_BLOCK &&
+		    strcasecmp(blkname, node->u.nterm.name) == 0)
+			hash = hash * CONFIG_HASH_PRIME +
+			       config_node_hash(node);
+	}
+	return hash;
+}
+
+/**
+ * @brief Return the value of a parameter of a block
+ *
+ * @param tree_node [IN] A CONFIG_BLOCK node in the parse tree
+ * @param name      [IN] Parameter name, case insensitive
+ *
+ * @return The first value of the parameter, NULL if it is not set.
+ */
+
+const char *config_block_value(void *tree_node, const char *name)
+{
+	struct config_node *node = (struct config_node *)tree_node;
+	struct config_node *sub_node, *term_node;
+	struct glist_head *ns;
+
+	if (node == NULL || node->type != TYPE_BLOCK)
+		return NULL;
+
+	glist_for_each(ns, &node->u.nterm.sub_nodes) {
+		sub_node = glist_entry(ns, struct config_node, node);
+		if (sub_node->type != TYPE_STMT ||
+		    strcasecmp(name, sub_node->u.nterm.name) != 0)
+			continue;
+		term_node = glist_first_entry(&sub_node->u.nterm.sub_nodes,
+					      struct config_node, node);
+		return term_node != NULL ? term_node->u.term.varvalue : NULL;
+	}
+	return NULL;
+}
+
 /**
  * @brief Fill configuration structure from a parse tree node
  *
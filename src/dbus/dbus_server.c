@@ -47,6 +47,7 @@
 #include <os/memstream.h>
 #include "dbus_priv.h"
 #include "nfs_init.h"
+#include "latency_hist.h"
 
 /**
  *
@@ -516,6 +517,52 @@ void dbus_append_timestamp(DBusMessageIter *iterp, struct timespec *timestamp)
 	dbus_message_iter_close_container(iterp, &ts_iter);
 }
 
+/**
+ * @brief Append a latency histogram
+ *
+ * The histogram goes out as a (ttttta(tt)) struct: the count, the
+ * 50th, 90th, 99th and 99.9th percentiles in nanoseconds, then the
+ * non-empty buckets as (lower bound in ns, count) pairs.
+ *
+ * @param[in] iterp  Iterator in reply stream to fill
+ * @param[in] hist   Histogram, NULL if nothing was recorded
+ */
+void dbus_append_lat_hist(DBusMessageIter *iterp, struct lat_hist *hist)
+{
+	uint64_t buckets[LAT_HIST_BUCKETS];
+	uint64_t total, val;
+	DBusMessageIter struct_iter, array_iter, bucket_iter;
+	static const uint32_t quantiles[] = {500, 900, 990, 999};
+	uint32_t i;
+
+	total = lat_hist_merge(hist, buckets);
+
+	dbus_message_iter_open_container(iterp, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &total);
+	for (i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++) {
+		val = lat_hist_quantile(buckets, total, quantiles[i]);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &val);
+	}
+	dbus_message_iter_open_container(&struct_iter, DBUS_TYPE_ARRAY,
+					 "(tt)", &array_iter);
+	for (i = 0; i < LAT_HIST_BUCKETS; i++) {
+		if (buckets[i] == 0)
+			continue;
+		val = lat_hist_bucket_low(i);
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &bucket_iter);
+		dbus_message_iter_append_basic(&bucket_iter, DBUS_TYPE_UINT64,
+					       &val);
+		dbus_message_iter_append_basic(&bucket_iter, DBUS_TYPE_UINT64,
+					       &buckets[i]);
+		dbus_message_iter_close_container(&array_iter, &bucket_iter);
+	}
+	dbus_message_iter_close_container(&struct_iter, &array_iter);
+	dbus_message_iter_close_container(iterp, &struct_iter);
+}
+
 static DBusHandlerResult dbus_message_entrypoint(DBusConnection *conn,
 						 DBusMessage *msg,
 						 void *user_data)
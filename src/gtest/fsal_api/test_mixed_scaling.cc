@@ -0,0 +1,405 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (C) 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Mixed lookup/getattr/readdir/write workload swept over thread counts,
+ * through MDCACHE and bypassing it.  The FSAL is whatever the export
+ * given by --config and --export uses, FSAL_MEM or FSAL_VFS for
+ * instance.  --mix sets the op ratios (e.g. lookup=50,getattr=30,
+ * readdir=10,write=10), --threads the largest thread count of the
+ * sweep, --ops the ops each thread runs and --json where to write the
+ * results.
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/exception.hpp>
+#include <boost/program_options.hpp>
+
+extern "C" {
+/* Manually forward this, as 9P is not C++ safe */
+void admin_halt(void);
+/* Ganesha headers */
+#include "export_mgr.h"
+#include "nfs_exports.h"
+#include "sal_data.h"
+#include "fsal.h"
+#include "common_utils.h"
+/* For MDCACHE bypass.  Use with care */
+#include "../FSAL/Stackable_FSALs/FSAL_MDCACHE/mdcache_debug.h"
+}
+
+#include "gtest.hh"
+#include "gtest_bench.hh"
+
+#define TEST_ROOT "mixed_scaling"
+#define TEST_DIR "test_dir"
+#define READDIR_COUNT 64
+#define WRITE_SIZE 4096
+#define WRITE_SPAN (1024 * 1024)
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+  char* event_list = nullptr;
+  char* profile_out = nullptr;
+  int file_count = 10000;
+  std::string mix;
+
+  static enum fsal_dir_result
+  populate_dirent(const char *name,
+                struct fsal_obj_handle *obj,
+                struct attrlist *attrs,
+                void *dir_state,
+                fsal_cookie_t cookie)
+  {
+    obj->obj_ops->put_ref(obj);
+    return DIR_CONTINUE;
+  }
+
+  static void write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+                       void *write_data, void *caller_data)
+  {
+    *(bool *) caller_data = ret.major == ERR_FSAL_NO_ERROR;
+  }
+
+  class MixedScalingTest : public gtest::GaneshaFSALBaseTest {
+  protected:
+
+    virtual void SetUp() {
+      fsal_status_t status;
+      struct attrlist attrs_out;
+      unsigned max_threads = gtest::bench_config.threads.back();
+      char fname[NAMELEN];
+
+      gtest::GaneshaFSALBaseTest::SetUp();
+
+      status = fsal_create(test_root, TEST_DIR, DIRECTORY, &attrs, NULL,
+                           &test_dir, &attrs_out);
+      ASSERT_EQ(status.major, 0);
+      ASSERT_NE(test_dir, nullptr);
+      fsal_release_attrs(&attrs_out);
+
+      create_and_prime_many(READDIR_COUNT, NULL, test_dir);
+
+      objs.resize(file_count);
+      create_and_prime_many(file_count, objs.data());
+
+      /* One file to write per thread */
+      files.resize(max_threads);
+      for (unsigned t = 0; t < max_threads; t++) {
+        bool caller_perm_check = false;
+
+        sprintf(fname, "w-%08x", t);
+        status = test_root->obj_ops->open2(test_root, NULL, FSAL_O_RDWR,
+                                           FSAL_UNCHECKED, fname, NULL, NULL,
+                                           &files[t], NULL,
+                                           &caller_perm_check);
+        ASSERT_EQ(status.major, 0);
+      }
+
+      ctxs.resize(max_threads);
+      buffer.assign(WRITE_SIZE, 'a');
+    }
+
+    virtual void TearDown() {
+      fsal_status_t status;
+      char fname[NAMELEN];
+
+      for (unsigned t = 0; t < files.size(); t++) {
+        status = files[t]->obj_ops->close(files[t]);
+        EXPECT_EQ(status.major, 0);
+        files[t]->obj_ops->put_ref(files[t]);
+
+        sprintf(fname, "w-%08x", t);
+        status = fsal_remove(test_root, fname);
+        EXPECT_EQ(status.major, 0);
+      }
+
+      remove_many(file_count, objs.data());
+      remove_many(READDIR_COUNT, NULL, test_dir);
+
+      status = test_root->obj_ops->unlink(test_root, test_dir, TEST_DIR);
+      EXPECT_EQ(status.major, 0);
+      test_dir->obj_ops->put_ref(test_dir);
+      test_dir = NULL;
+
+      gtest::GaneshaFSALBaseTest::TearDown();
+    }
+
+    /* The ops on the given objects, MDCACHE ones or their sub handles */
+    std::vector<gtest::BenchOp> mixed_ops(struct fsal_obj_handle *root,
+                                          struct fsal_obj_handle *dir,
+                                          std::vector<fsal_obj_handle *> &obj,
+                                          std::vector<fsal_obj_handle *> &file)
+    {
+      std::vector<gtest::BenchOp> ops = {
+        {"lookup", 50, [=](unsigned t, std::mt19937 &rng) {
+          struct fsal_obj_handle *found;
+          fsal_status_t status;
+          char fname[NAMELEN];
+
+          sprintf(fname, "f-%08x", (int) (rng() % file_count));
+          status = root->obj_ops->lookup(root, fname, &found, NULL);
+          if (FSAL_IS_ERROR(status))
+            return false;
+          found->obj_ops->put_ref(found);
+          return true;
+        }},
+        {"getattr", 30, [&](unsigned t, std::mt19937 &rng) {
+          struct fsal_obj_handle *o = obj[rng() % obj.size()];
+          struct attrlist outattrs;
+          fsal_status_t status;
+
+          fsal_prepare_attrs(&outattrs, ATTRS_POSIX);
+          status = o->obj_ops->getattrs(o, &outattrs);
+          fsal_release_attrs(&outattrs);
+          return !FSAL_IS_ERROR(status);
+        }},
+        {"readdir", 10, [=](unsigned t, std::mt19937 &rng) {
+          fsal_status_t status;
+          uint64_t whence = 0;
+          bool eod = false;
+
+          status = dir->obj_ops->readdir(dir, &whence, NULL,
+                                         populate_dirent, 0, &eod);
+          return !FSAL_IS_ERROR(status);
+        }},
+        {"write", 10, [&](unsigned t, std::mt19937 &rng) {
+          struct fsal_io_arg *write_arg;
+          bool ok = false;
+
+          write_arg = (struct fsal_io_arg *) alloca(
+                          sizeof(struct fsal_io_arg) + sizeof(struct iovec));
+          memset(write_arg, 0, sizeof(struct fsal_io_arg));
+          write_arg->offset = (rng() % (WRITE_SPAN / WRITE_SIZE)) *
+                              WRITE_SIZE;
+          write_arg->iov_count = 1;
+          write_arg->iov[0].iov_len = WRITE_SIZE;
+          write_arg->iov[0].iov_base = buffer.data();
+          write_arg->fsal_stable = false;
+
+          file[t]->obj_ops->write2(file[t], true, write_cb, write_arg, &ok);
+          return ok;
+        }},
+      };
+
+      EXPECT_TRUE(gtest::bench_parse_mix(mix, ops)) << "bad mix " << mix;
+      return ops;
+    }
+
+    /* Each thread has its own op context, ganesha keeps it in tls */
+    void thread_init(unsigned t, struct fsal_export *fsal_export) {
+      ctxs[t] = req_ctx;
+      ctxs[t].fsal_export = fsal_export;
+      op_ctx = &ctxs[t];
+    }
+
+    struct fsal_obj_handle *test_dir = nullptr;
+    std::vector<fsal_obj_handle *> objs;
+    std::vector<fsal_obj_handle *> files;
+    std::vector<struct req_op_context> ctxs;
+    std::vector<char> buffer;
+  };
+
+} /* namespace */
+
+TEST_F(MixedScalingTest, MIXED)
+{
+  auto ops = mixed_ops(test_root, test_dir, objs, files);
+
+  enableEvents(event_list);
+  if (profile_out)
+    ProfilerStart(profile_out);
+
+  gtest::bench_run("mixed", ops, [&](unsigned t) {
+    thread_init(t, a_export->fsal_export);
+  });
+
+  if (profile_out)
+    ProfilerStop();
+  disableEvents(event_list);
+}
+
+TEST_F(MixedScalingTest, MIXED_BYPASS)
+{
+  std::vector<fsal_obj_handle *> sub_objs, sub_files;
+
+  for (auto o : objs)
+    sub_objs.push_back(mdcdb_get_sub_handle(o));
+  for (auto f : files)
+    sub_files.push_back(mdcdb_get_sub_handle(f));
+
+  auto ops = mixed_ops(mdcdb_get_sub_handle(test_root),
+                       mdcdb_get_sub_handle(test_dir), sub_objs, sub_files);
+
+  enableEvents(event_list);
+  if (profile_out)
+    ProfilerStart(profile_out);
+
+  gtest::bench_run("mixed_bypass", ops, [&](unsigned t) {
+    thread_init(t, a_export->fsal_export->sub_export);
+  });
+
+  if (profile_out)
+    ProfilerStop();
+  disableEvents(event_list);
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+
+  using namespace std;
+  using namespace std::literals;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+	"LTTng session name")
+
+      ("event-list", po::value<string>(),
+	"LTTng event list, comma separated")
+
+      ("profile", po::value<string>(),
+	"Enable profiling and set output file.")
+
+      ("threads", po::value<unsigned>(),
+	"largest thread count, the sweep doubles up to it (default 8)")
+
+      ("ops", po::value<uint64_t>(),
+	"ops each thread runs (default 100000)")
+
+      ("files", po::value<int>(),
+	"files looked up and getattr'ed (default 10000)")
+
+      ("mix", po::value<string>(),
+	"op weights, e.g. lookup=50,getattr=30,readdir=10,write=10")
+
+      ("json", po::value<string>(),
+	"write the results as JSON to this file")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("event-list");
+    if (vm_iter != vm.end()) {
+      event_list = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("profile");
+    if (vm_iter != vm.end()) {
+      profile_out = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("threads");
+    gtest::bench_config.threads = gtest::bench_sweep(
+      vm_iter != vm.end() ? std::max(vm_iter->second.as<unsigned>(), 1U) : 8);
+    vm_iter = vm.find("ops");
+    if (vm_iter != vm.end()) {
+      gtest::bench_config.ops_per_thread = vm_iter->second.as<uint64_t>();
+    }
+    vm_iter = vm.find("files");
+    if (vm_iter != vm.end()) {
+      file_count = std::max(vm_iter->second.as<int>(), 1);
+    }
+    vm_iter = vm.find("mix");
+    if (vm_iter != vm.end()) {
+      mix = vm_iter->second.as<std::string>();
+    }
+    vm_iter = vm.find("json");
+    if (vm_iter != vm.end()) {
+      gtest::bench_config.json_path = vm_iter->second.as<std::string>();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+					session_name, TEST_ROOT, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+
+    gtest::bench_write_json();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
@@ -148,6 +148,8 @@ TEST_F(Read2EmptyLatencyTest, SIMPLE)
   read_arg->info = NULL;
   read_arg->state = NULL;
   read_arg->offset = OFFSET;
+  read_arg->extent.want = false;
+  read_arg->extent.fd = -1;
   read_arg->iov_count = 1;
   read_arg->iov[0].iov_len = bytes;
   read_arg->iov[0].iov_base = r_databuffer;
@@ -197,6 +199,8 @@ TEST_F(Read2EmptyLatencyTest, SIMPLE_BYPASS)
   read_arg->info = NULL;
   read_arg->state = NULL;
   read_arg->offset = OFFSET;
+  read_arg->extent.want = false;
+  read_arg->extent.fd = -1;
   read_arg->iov_count = 1;
   read_arg->iov[0].iov_len = bytes;
   read_arg->iov[0].iov_base = r_databuffer;
@@ -239,6 +243,8 @@ TEST_F(Read2EmptyLatencyTest, LARGE_DATA_READ)
   read_arg->info = NULL;
   read_arg->state = NULL;
   read_arg->offset = OFFSET;
+  read_arg->extent.want = false;
+  read_arg->extent.fd = -1;
   read_arg->iov_count = 1;
   read_arg->iov[0].iov_len = bytes;
   read_arg->iov[0].iov_base = r_databuffer;
@@ -285,6 +291,8 @@ TEST_F(Read2EmptyLatencyTest, LOOP)
   read_arg->info = NULL;
   read_arg->state = NULL;
   read_arg->offset = OFFSET;
+  read_arg->extent.want = false;
+  read_arg->extent.fd = -1;
   read_arg->iov_count = 1;
   read_arg->iov[0].iov_len = bytes;
   read_arg->iov[0].iov_base = r_databuffer;
@@ -341,6 +349,8 @@ TEST_F(Read2EmptyLatencyTest, LOOP_BYPASS)
   read_arg->info = NULL;
   read_arg->state = NULL;
   read_arg->offset = OFFSET;
+  read_arg->extent.want = false;
+  read_arg->extent.fd = -1;
   read_arg->iov_count = 1;
   read_arg->iov[0].iov_len = bytes;
   read_arg->iov[0].iov_base = r_databuffer;
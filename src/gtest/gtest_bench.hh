@@ -0,0 +1,347 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (C) 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Multi-threaded benchmark harness
+ *
+ * A benchmark is a set of weighted ops.  For each thread count of the
+ * sweep, every thread runs ops_per_thread ops picked at random by
+ * weight, timing each one.  After each run, the throughput and the
+ * latency percentiles of every op are printed to stderr, and the
+ * results are kept for bench_write_json().
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef GTEST_GTEST_BENCH_HH
+#define GTEST_GTEST_BENCH_HH
+
+namespace gtest {
+
+  /* One op of a benchmark, fn returns false on failure */
+  struct BenchOp {
+    std::string name;
+    unsigned weight;
+    std::function<bool(unsigned thread, std::mt19937 &rng)> fn;
+  };
+
+  struct BenchConfig {
+    std::vector<unsigned> threads = {1};
+    uint64_t ops_per_thread = 100000;
+    std::string json_path;
+  };
+
+  BenchConfig bench_config;
+
+  struct BenchOpResult {
+    std::string name;
+    uint64_t ops = 0;
+    uint64_t errors = 0;
+    uint64_t mean = 0;
+    uint64_t p50 = 0;
+    uint64_t p90 = 0;
+    uint64_t p99 = 0;
+    uint64_t p999 = 0;
+    uint64_t max = 0;
+  };
+
+  struct BenchResult {
+    std::string name;
+    unsigned threads;
+    uint64_t elapsed;		/* ns */
+    uint64_t ops;
+    std::vector<BenchOpResult> op;
+  };
+
+  std::vector<BenchResult> bench_results;
+
+  /* Sweep of powers of two up to max, then max itself */
+  static inline std::vector<unsigned> bench_sweep(unsigned max)
+  {
+    std::vector<unsigned> sweep;
+
+    for (unsigned n = 1; n < max; n *= 2)
+      sweep.push_back(n);
+    sweep.push_back(max);
+    return sweep;
+  }
+
+  /* Weights from "name=weight,name=weight", names not listed get 0 */
+  static inline bool bench_parse_mix(const std::string &mix,
+				     std::vector<BenchOp> &ops)
+  {
+    std::stringstream ss(mix);
+    std::string item;
+
+    if (mix.empty())
+      return true;
+
+    for (auto &op : ops)
+      op.weight = 0;
+
+    while (std::getline(ss, item, ',')) {
+      size_t eq = item.find('=');
+      bool found = false;
+
+      if (eq == std::string::npos)
+	return false;
+
+      for (auto &op : ops) {
+	if (op.name == item.substr(0, eq)) {
+	  op.weight = std::stoul(item.substr(eq + 1));
+	  found = true;
+	}
+      }
+
+      if (!found)
+	return false;
+    }
+
+    return true;
+  }
+
+  static inline uint64_t bench_now(void)
+  {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  }
+
+  static inline uint64_t bench_percentile(const std::vector<uint64_t> &sorted,
+					  double pct)
+  {
+    if (sorted.empty())
+      return 0;
+    return sorted[std::min(sorted.size() - 1,
+			   (size_t) (sorted.size() * pct / 100.0))];
+  }
+
+  /*
+   * Run a benchmark at one thread count
+   *
+   * thread_init is called by each thread before the start, to set up
+   * its op context.
+   */
+  static inline BenchResult
+  bench_run_one(const std::string &name, const std::vector<BenchOp> &ops,
+		unsigned nthreads,
+		std::function<void(unsigned thread)> thread_init)
+  {
+    /* samples[thread][op] */
+    std::vector<std::vector<std::vector<uint64_t>>> samples(nthreads);
+    std::vector<std::vector<uint64_t>> errors(nthreads);
+    std::vector<std::thread> threads;
+    std::mutex mtx;
+    std::condition_variable cond;
+    unsigned ready = 0;
+    bool go = false;
+    unsigned total_weight = 0;
+    uint64_t start, end;
+    BenchResult res;
+
+    for (auto &op : ops)
+      total_weight += op.weight;
+
+    for (unsigned t = 0; t < nthreads; t++) {
+      samples[t].resize(ops.size());
+      errors[t].resize(ops.size());
+      threads.emplace_back([&, t]() {
+	std::mt19937 rng(t + 1);
+	std::uniform_int_distribution<unsigned> pick(0, total_weight - 1);
+
+	for (auto &s : samples[t])
+	  s.reserve(bench_config.ops_per_thread);
+
+	if (thread_init)
+	  thread_init(t);
+
+	{
+	  std::unique_lock<std::mutex> lock(mtx);
+	  ready++;
+	  cond.notify_all();
+	  cond.wait(lock, [&] { return go; });
+	}
+
+	for (uint64_t i = 0; i < bench_config.ops_per_thread; i++) {
+	  unsigned w = pick(rng);
+	  size_t o = 0;
+	  uint64_t s_time;
+	  bool ok;
+
+	  while (w >= ops[o].weight) {
+	    w -= ops[o].weight;
+	    o++;
+	  }
+
+	  s_time = bench_now();
+	  ok = ops[o].fn(t, rng);
+	  samples[t][o].push_back(bench_now() - s_time);
+	  if (!ok)
+	    errors[t][o]++;
+	}
+      });
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      cond.wait(lock, [&] { return ready == nthreads; });
+      start = bench_now();
+      go = true;
+      cond.notify_all();
+    }
+
+    for (auto &th : threads)
+      th.join();
+
+    end = bench_now();
+
+    res.name = name;
+    res.threads = nthreads;
+    res.elapsed = end - start;
+    res.ops = nthreads * bench_config.ops_per_thread;
+
+    for (size_t o = 0; o < ops.size(); o++) {
+      std::vector<uint64_t> all;
+      BenchOpResult r;
+      uint64_t sum = 0;
+
+      for (unsigned t = 0; t < nthreads; t++) {
+	all.insert(all.end(), samples[t][o].begin(), samples[t][o].end());
+	r.errors += errors[t][o];
+      }
+
+      if (all.empty())
+	continue;
+
+      std::sort(all.begin(), all.end());
+      for (auto v : all)
+	sum += v;
+
+      r.name = ops[o].name;
+      r.ops = all.size();
+      r.mean = sum / all.size();
+      r.p50 = bench_percentile(all, 50);
+      r.p90 = bench_percentile(all, 90);
+      r.p99 = bench_percentile(all, 99);
+      r.p999 = bench_percentile(all, 99.9);
+      r.max = all.back();
+      res.op.push_back(r);
+    }
+
+    fprintf(stderr, "%s threads=%u ops=%" PRIu64 " %.0f ops/s\n",
+	    name.c_str(), nthreads, res.ops,
+	    res.ops * 1e9 / std::max<uint64_t>(res.elapsed, 1));
+    for (auto &r : res.op)
+      fprintf(stderr,
+	      "  %-10s ops=%" PRIu64 " errors=%" PRIu64 " mean=%" PRIu64
+	      " p50=%" PRIu64 " p90=%" PRIu64 " p99=%" PRIu64
+	      " p99.9=%" PRIu64 " max=%" PRIu64 " ns\n",
+	      r.name.c_str(), r.ops, r.errors, r.mean, r.p50, r.p90, r.p99,
+	      r.p999, r.max);
+
+    return res;
+  }
+
+  /* Run a benchmark at every thread count of the sweep */
+  static inline std::vector<BenchResult>
+  bench_run(const std::string &name, const std::vector<BenchOp> &ops,
+	    std::function<void(unsigned thread)> thread_init = nullptr)
+  {
+    std::vector<BenchResult> results;
+    unsigned total_weight = 0;
+
+    for (auto &op : ops)
+      total_weight += op.weight;
+
+    if (total_weight == 0) {
+      fprintf(stderr, "%s: no op to run\n", name.c_str());
+      return results;
+    }
+
+    for (auto n : bench_config.threads) {
+      results.push_back(bench_run_one(name, ops, n, thread_init));
+      bench_results.push_back(results.back());
+    }
+
+    return results;
+  }
+
+  /* Write every result so far to bench_config.json_path, if set */
+  static inline void bench_write_json(void)
+  {
+    FILE *fp;
+    bool first = true;
+
+    if (bench_config.json_path.empty())
+      return;
+
+    fp = fopen(bench_config.json_path.c_str(), "w");
+    if (fp == NULL) {
+      perror(bench_config.json_path.c_str());
+      return;
+    }
+
+    fprintf(fp, "[\n");
+    for (auto &res : bench_results) {
+      bool first_op = true;
+
+      fprintf(fp, "%s  {\"name\": \"%s\", \"threads\": %u, "
+	      "\"elapsed_ns\": %" PRIu64 ", \"ops\": %" PRIu64
+	      ", \"ops_per_sec\": %.1f, \"op\": [",
+	      first ? "" : ",\n", res.name.c_str(), res.threads,
+	      res.elapsed, res.ops,
+	      res.ops * 1e9 / std::max<uint64_t>(res.elapsed, 1));
+      for (auto &r : res.op) {
+	fprintf(fp, "%s\n    {\"name\": \"%s\", \"ops\": %" PRIu64
+		", \"errors\": %" PRIu64 ", \"mean_ns\": %" PRIu64
+		", \"p50_ns\": %" PRIu64 ", \"p90_ns\": %" PRIu64
+		", \"p99_ns\": %" PRIu64 ", \"p999_ns\": %" PRIu64
+		", \"max_ns\": %" PRIu64 "}",
+		first_op ? "" : ",", r.name.c_str(), r.ops, r.errors,
+		r.mean, r.p50, r.p90, r.p99, r.p999, r.max);
+	first_op = false;
+      }
+      fprintf(fp, "]}");
+      first = false;
+    }
+    fprintf(fp, "\n]\n");
+
+    fclose(fp);
+  }
+} // namespace gtest
+
+#endif /* GTEST_GTEST_BENCH_HH */
@@ -0,0 +1,860 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (C) 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * NFSv4 COMPOUNDs run through nfs4_Compound() by many threads, swept
+ * over thread counts.  Each thread is its own v4.0 client: it forges an
+ * AUTH_SYS request from 127.0.0.1, gets a clientid by SETCLIENTID and
+ * SETCLIENTID_CONFIRM, and keeps an open file for READ, WRITE and LOCK,
+ * so the protocol, SAL and MDCACHE layers are measured without the
+ * network and the RPC layer.
+ *
+ * The requests are never queued, so nothing that suspends a COMPOUND
+ * can be set: an FSAL that completes I/O asynchronously, or
+ * PUTFH_Resolve_Threads.  v4.1 is not covered, EXCHANGE_ID and
+ * CREATE_SESSION bind the session to the transport of the request.
+ *
+ * --mix sets the op ratios of the MIXED test (e.g. getattr=40,lookup=30,
+ * readdir=5,open_close=5,read=10,write=5,lock=5), --threads the largest
+ * thread count of the sweep, --ops the ops each thread runs and --json
+ * where to write the results.
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/exception.hpp>
+#include <boost/program_options.hpp>
+
+#include "gtest_nfs4.hh"
+#include "gtest_bench.hh"
+
+extern "C" {
+#include "sal_functions.h"
+#include "nfs_proto_tools.h"
+}
+
+#define TEST_ROOT "nfs4_compound_scaling"
+#define TEST_DIR "test_dir"
+#define READDIR_COUNT 64
+#define IO_SIZE 4096
+#define IO_SPAN (1024 * 1024)
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+  char* event_list = nullptr;
+  char* profile_out = nullptr;
+  int file_count = 10000;
+  std::string mix;
+
+  /* Tells the clients of one fixture from those of the previous ones */
+  unsigned instance;
+
+  /* One forged v4.0 client per thread */
+  struct Nfs4Client {
+    nfs_request_t req;
+    SVCXPRT xprt;
+    struct authunix_parms aup;
+    sockaddr_t addr;
+    char id[NAMELEN * 2];
+    char open_owner[NAMELEN];
+    char lock_owner[NAMELEN];
+    clientid4 clientid;
+    seqid4 open_seqid;
+    seqid4 lock_seqid;
+    stateid4 open_stateid;	/* of the thread's I/O file */
+    stateid4 lock_stateid;
+    bool have_lock_owner;
+  };
+
+  /*
+   * Whether an error still bumps the seqid of the owner, RFC 7530
+   * section 9.1.7
+   */
+  static bool seqid_consumed(nfsstat4 status)
+  {
+    switch (status) {
+    case NFS4ERR_STALE_CLIENTID:
+    case NFS4ERR_STALE_STATEID:
+    case NFS4ERR_BAD_STATEID:
+    case NFS4ERR_BAD_SEQID:
+    case NFS4ERR_BADXDR:
+    case NFS4ERR_RESOURCE:
+    case NFS4ERR_NOFILEHANDLE:
+    case NFS4ERR_MOVED:
+      return false;
+    default:
+      return true;
+    }
+  }
+
+  static void set_name(component4 *comp, char *name)
+  {
+    comp->utf8string_len = strlen(name);
+    comp->utf8string_val = name;
+  }
+
+  class Nfs4CompoundScalingTest : public gtest::GaneshaFSALBaseTest {
+  protected:
+
+    virtual void SetUp() {
+      fsal_status_t status;
+      struct attrlist attrs_out;
+      unsigned max_threads = gtest::bench_config.threads.back();
+      char fname[NAMELEN];
+
+      gtest::GaneshaFSALBaseTest::SetUp();
+
+      status = fsal_create(test_root, TEST_DIR, DIRECTORY, &attrs, NULL,
+                           &test_dir, &attrs_out);
+      ASSERT_EQ(status.major, 0);
+      ASSERT_NE(test_dir, nullptr);
+      fsal_release_attrs(&attrs_out);
+
+      create_and_prime_many(READDIR_COUNT, NULL, test_dir);
+
+      objs.resize(file_count);
+      create_and_prime_many(file_count, objs.data());
+
+      /* Per thread, a file kept open and a file opened and closed */
+      for (unsigned t = 0; t < max_threads; t++) {
+        struct fsal_obj_handle *obj;
+
+        sprintf(fname, "w-%08x", t);
+        status = fsal_create(test_root, fname, REGULAR_FILE, &attrs, NULL,
+                             &obj, NULL);
+        ASSERT_EQ(status.major, 0);
+        io_files.push_back(obj);
+
+        sprintf(fname, "o-%08x", t);
+        status = fsal_create(test_root, fname, REGULAR_FILE, &attrs, NULL,
+                             &obj, NULL);
+        ASSERT_EQ(status.major, 0);
+        open_files.push_back(obj);
+      }
+
+      root_fh = make_fh(test_root);
+      dir_fh = make_fh(test_dir);
+      for (auto o : objs)
+        obj_fh.push_back(make_fh(o));
+      for (auto o : io_files)
+        io_fh.push_back(make_fh(o));
+      for (auto o : open_files)
+        open_fh.push_back(make_fh(o));
+
+      /* The attributes a Linux client asks for in GETATTR and READDIR */
+      memset(&attr_request, 0, sizeof(attr_request));
+      for (int attr : {FATTR4_TYPE, FATTR4_CHANGE, FATTR4_SIZE, FATTR4_FSID,
+                       FATTR4_FILEID, FATTR4_MODE, FATTR4_NUMLINKS,
+                       FATTR4_OWNER, FATTR4_OWNER_GROUP, FATTR4_RAWDEV,
+                       FATTR4_SPACE_USED, FATTR4_TIME_ACCESS,
+                       FATTR4_TIME_METADATA, FATTR4_TIME_MODIFY,
+                       FATTR4_MOUNTED_ON_FILEID})
+        set_attribute_in_bitmap(&attr_request, attr);
+
+      buffer.assign(IO_SIZE, 'a');
+      clients.assign(max_threads, nullptr);
+      instance++;
+
+      /* OPEN and LOCK get NFS4ERR_GRACE until the grace period ends */
+      while (nfs_in_grace())
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+
+    virtual void TearDown() {
+      fsal_status_t status;
+      char fname[NAMELEN];
+
+      for (unsigned t = 0; t < clients.size(); t++) {
+        if (clients[t] != nullptr)
+          client_fini(t);
+      }
+      op_ctx = &req_ctx;
+
+      gsh_free(root_fh.nfs_fh4_val);
+      gsh_free(dir_fh.nfs_fh4_val);
+      for (auto &fh : obj_fh)
+        gsh_free(fh.nfs_fh4_val);
+      for (auto &fh : io_fh)
+        gsh_free(fh.nfs_fh4_val);
+      for (auto &fh : open_fh)
+        gsh_free(fh.nfs_fh4_val);
+
+      for (unsigned t = 0; t < io_files.size(); t++) {
+        io_files[t]->obj_ops->put_ref(io_files[t]);
+        sprintf(fname, "w-%08x", t);
+        status = fsal_remove(test_root, fname);
+        EXPECT_EQ(status.major, 0);
+      }
+
+      for (unsigned t = 0; t < open_files.size(); t++) {
+        open_files[t]->obj_ops->put_ref(open_files[t]);
+        sprintf(fname, "o-%08x", t);
+        status = fsal_remove(test_root, fname);
+        EXPECT_EQ(status.major, 0);
+      }
+
+      remove_many(file_count, objs.data());
+      remove_many(READDIR_COUNT, NULL, test_dir);
+
+      status = test_root->obj_ops->unlink(test_root, test_dir, TEST_DIR);
+      EXPECT_EQ(status.major, 0);
+      test_dir->obj_ops->put_ref(test_dir);
+      test_dir = NULL;
+
+      gtest::GaneshaFSALBaseTest::TearDown();
+    }
+
+    nfs_fh4 make_fh(struct fsal_obj_handle *obj) {
+      nfs_fh4 fh;
+      bool fhres;
+
+      memset(&fh, 0, sizeof(fh));
+      fhres = nfs4_FSALToFhandle(true, &fh, obj, a_export);
+      EXPECT_EQ(fhres, true);
+      return fh;
+    }
+
+    /*
+     * Run a COMPOUND as the given client, the caller frees res with
+     * nfs4_Compound_Free().  Like the worker, no export is kept from
+     * one request to the next.
+     */
+    bool compound(Nfs4Client *c, nfs_argop4 *argops, u_int len,
+                  nfs_res_t *res) {
+      nfs_arg_t arg;
+      int rc;
+
+      memset(&arg, 0, sizeof(arg));
+      memset(res, 0, sizeof(*res));
+      arg.arg_compound4.minorversion = 0;
+      arg.arg_compound4.argarray.argarray_len = len;
+      arg.arg_compound4.argarray.argarray_val = argops;
+
+      op_ctx = &c->req.req_ctx;
+      rc = nfs4_Compound(&arg, &c->req.svc, res);
+
+      if (rc == NFS_REQ_ASYNC_WAIT) {
+        /* There is no request to resume and reply to */
+        fprintf(stderr, "COMPOUND suspended, giving up\n");
+        abort();
+      }
+
+      if (op_ctx->ctx_export != NULL) {
+        put_gsh_export(op_ctx->ctx_export);
+        op_ctx->ctx_export = NULL;
+        op_ctx->fsal_export = NULL;
+      }
+
+      return rc == NFS_REQ_OK;
+    }
+
+    static void set_putfh(nfs_argop4 *op, nfs_fh4 &fh) {
+      op->argop = NFS4_OP_PUTFH;
+      op->nfs_argop4_u.opputfh.object = fh;
+    }
+
+    /* The result of the op at pos, NULL if it was not run */
+    static nfs_resop4 *result(nfs_res_t *res, u_int pos) {
+      if (pos >= res->res_compound4.resarray.resarray_len)
+        return NULL;
+      return &res->res_compound4.resarray.resarray_val[pos];
+    }
+
+    bool setclientid(Nfs4Client *c, unsigned t) {
+      nfs_argop4 argops[1];
+      nfs_res_t res;
+      SETCLIENTID4args *sc = &argops[0].nfs_argop4_u.opsetclientid;
+      SETCLIENTID_CONFIRM4args *scc =
+                              &argops[0].nfs_argop4_u.opsetclientid_confirm;
+      verifier4 confirm;
+      bool ok;
+
+      memset(argops, 0, sizeof(argops));
+      argops[0].argop = NFS4_OP_SETCLIENTID;
+      memcpy(sc->client.verifier, &instance, sizeof(instance));
+      sc->client.id.id_len = strlen(c->id);
+      sc->client.id.id_val = c->id;
+      sc->callback.cb_program = 0x40000000;
+      sc->callback.cb_location.r_netid = (char *) "tcp";
+      sc->callback.cb_location.r_addr = (char *) "127.0.0.1.0.0";
+      sc->callback_ident = t;
+
+      ok = compound(c, argops, 1, &res) &&
+           res.res_compound4.status == NFS4_OK;
+      if (ok) {
+        SETCLIENTID4resok *resok =
+          &result(&res, 0)->nfs_resop4_u.opsetclientid.SETCLIENTID4res_u
+                                                                  .resok4;
+
+        c->clientid = resok->clientid;
+        memcpy(confirm, resok->setclientid_confirm, sizeof(confirm));
+      }
+      nfs4_Compound_Free(&res);
+      if (!ok)
+        return false;
+
+      memset(argops, 0, sizeof(argops));
+      argops[0].argop = NFS4_OP_SETCLIENTID_CONFIRM;
+      scc->clientid = c->clientid;
+      memcpy(scc->setclientid_confirm, confirm, sizeof(confirm));
+
+      ok = compound(c, argops, 1, &res) &&
+           res.res_compound4.status == NFS4_OK;
+      nfs4_Compound_Free(&res);
+      return ok;
+    }
+
+    /* OPEN a file of test_root, and OPEN_CONFIRM it if asked to */
+    bool open_file(Nfs4Client *c, char *name, nfs_fh4 &fh, stateid4 *stateid) {
+      nfs_argop4 argops[2];
+      nfs_res_t res;
+      nfs_resop4 *r;
+      OPEN4args *oa = &argops[1].nfs_argop4_u.opopen;
+      OPEN_CONFIRM4args *oca = &argops[1].nfs_argop4_u.opopen_confirm;
+      bool ok, confirm = false;
+
+      memset(argops, 0, sizeof(argops));
+      set_putfh(&argops[0], root_fh);
+      argops[1].argop = NFS4_OP_OPEN;
+      oa->seqid = c->open_seqid;
+      oa->share_access = OPEN4_SHARE_ACCESS_BOTH;
+      oa->share_deny = OPEN4_SHARE_DENY_NONE;
+      oa->owner.clientid = c->clientid;
+      oa->owner.owner.owner_len = strlen(c->open_owner);
+      oa->owner.owner.owner_val = c->open_owner;
+      oa->openhow.opentype = OPEN4_NOCREATE;
+      oa->claim.claim = CLAIM_NULL;
+      set_name(&oa->claim.open_claim4_u.file, name);
+
+      ok = compound(c, argops, 2, &res);
+      r = result(&res, 1);
+      if (r != NULL && seqid_consumed(r->nfs_resop4_u.opopen.status))
+        c->open_seqid++;
+      ok = ok && res.res_compound4.status == NFS4_OK;
+      if (ok) {
+        OPEN4resok *resok = &r->nfs_resop4_u.opopen.OPEN4res_u.resok4;
+
+        *stateid = resok->stateid;
+        confirm = (resok->rflags & OPEN4_RESULT_CONFIRM) != 0;
+      }
+      nfs4_Compound_Free(&res);
+      if (!ok || !confirm)
+        return ok;
+
+      memset(argops, 0, sizeof(argops));
+      set_putfh(&argops[0], fh);
+      argops[1].argop = NFS4_OP_OPEN_CONFIRM;
+      oca->open_stateid = *stateid;
+      oca->seqid = c->open_seqid;
+
+      ok = compound(c, argops, 2, &res);
+      r = result(&res, 1);
+      if (r != NULL &&
+          seqid_consumed(r->nfs_resop4_u.opopen_confirm.status))
+        c->open_seqid++;
+      ok = ok && res.res_compound4.status == NFS4_OK;
+      if (ok)
+        *stateid =
+          r->nfs_resop4_u.opopen_confirm.OPEN_CONFIRM4res_u.resok4
+                                                          .open_stateid;
+      nfs4_Compound_Free(&res);
+      return ok;
+    }
+
+    bool close_file(Nfs4Client *c, nfs_fh4 &fh, stateid4 *stateid) {
+      nfs_argop4 argops[2];
+      nfs_res_t res;
+      nfs_resop4 *r;
+      bool ok;
+
+      memset(argops, 0, sizeof(argops));
+      set_putfh(&argops[0], fh);
+      argops[1].argop = NFS4_OP_CLOSE;
+      argops[1].nfs_argop4_u.opclose.seqid = c->open_seqid;
+      argops[1].nfs_argop4_u.opclose.open_stateid = *stateid;
+
+      ok = compound(c, argops, 2, &res);
+      r = result(&res, 1);
+      if (r != NULL && seqid_consumed(r->nfs_resop4_u.opclose.status))
+        c->open_seqid++;
+      ok = ok && res.res_compound4.status == NFS4_OK;
+      nfs4_Compound_Free(&res);
+      return ok;
+    }
+
+    /* LOCK then LOCKU a range of the thread's I/O file */
+    bool lock_unlock(Nfs4Client *c, unsigned t, offset4 offset) {
+      nfs_argop4 argops[2];
+      nfs_res_t res;
+      nfs_resop4 *r;
+      LOCK4args *la = &argops[1].nfs_argop4_u.oplock;
+      LOCKU4args *lua = &argops[1].nfs_argop4_u.oplocku;
+      bool ok;
+
+      memset(argops, 0, sizeof(argops));
+      set_putfh(&argops[0], io_fh[t]);
+      argops[1].argop = NFS4_OP_LOCK;
+      la->locktype = WRITE_LT;
+      la->offset = offset;
+      la->length = IO_SIZE;
+      if (!c->have_lock_owner) {
+        open_to_lock_owner4 *otlo = &la->locker.locker4_u.open_owner;
+
+        la->locker.new_lock_owner = true;
+        otlo->open_seqid = c->open_seqid;
+        otlo->open_stateid = c->open_stateid;
+        otlo->lock_seqid = c->lock_seqid;
+        otlo->lock_owner.clientid = c->clientid;
+        otlo->lock_owner.owner.owner_len = strlen(c->lock_owner);
+        otlo->lock_owner.owner.owner_val = c->lock_owner;
+      } else {
+        la->locker.new_lock_owner = false;
+        la->locker.locker4_u.lock_owner.lock_stateid = c->lock_stateid;
+        la->locker.locker4_u.lock_owner.lock_seqid = c->lock_seqid;
+      }
+
+      ok = compound(c, argops, 2, &res);
+      r = result(&res, 1);
+      if (r != NULL && seqid_consumed(r->nfs_resop4_u.oplock.status)) {
+        if (c->have_lock_owner)
+          c->lock_seqid++;
+        else
+          c->open_seqid++;
+      }
+      ok = ok && res.res_compound4.status == NFS4_OK;
+      if (ok) {
+        c->lock_stateid =
+          r->nfs_resop4_u.oplock.LOCK4res_u.resok4.lock_stateid;
+        if (!c->have_lock_owner) {
+          c->have_lock_owner = true;
+          c->lock_seqid++;
+        }
+      }
+      nfs4_Compound_Free(&res);
+      if (!ok)
+        return false;
+
+      memset(argops, 0, sizeof(argops));
+      set_putfh(&argops[0], io_fh[t]);
+      argops[1].argop = NFS4_OP_LOCKU;
+      lua->locktype = WRITE_LT;
+      lua->seqid = c->lock_seqid;
+      lua->lock_stateid = c->lock_stateid;
+      lua->offset = offset;
+      lua->length = IO_SIZE;
+
+      ok = compound(c, argops, 2, &res);
+      r = result(&res, 1);
+      if (r != NULL && seqid_consumed(r->nfs_resop4_u.oplocku.status))
+        c->lock_seqid++;
+      ok = ok && res.res_compound4.status == NFS4_OK;
+      if (ok)
+        c->lock_stateid = r->nfs_resop4_u.oplocku.LOCKU4res_u.lock_stateid;
+      nfs4_Compound_Free(&res);
+      return ok;
+    }
+
+    /* Forge the thread's client on first use, and get its state */
+    void client_init(unsigned t) {
+      struct sockaddr_in *sin;
+      Nfs4Client *c;
+      char fname[NAMELEN];
+
+      if (clients[t] != nullptr)
+        return;
+
+      c = (Nfs4Client *) gsh_calloc(1, sizeof(Nfs4Client));
+
+      sin = (struct sockaddr_in *) &c->addr;
+      sin->sin_family = AF_INET;
+      sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+      c->xprt.xp_type = XPRT_TCP;
+      c->req.svc.rq_xprt = &c->xprt;
+
+      c->aup.aup_machname = (char *) "gtest";
+      c->aup.aup_uid = attrs.owner;
+      c->aup.aup_gid = attrs.group;
+      c->req.svc.rq_msg.cb_cred.oa_flavor = AUTH_UNIX;
+      memcpy(c->req.svc.rq_msg.rq_cred_body, &c->aup, sizeof(c->aup));
+
+      c->req.req_ctx.creds = &c->req.user_credentials;
+      c->req.req_ctx.caller_addr = &c->addr;
+      c->req.req_ctx.nfs_vers = NFS_V4;
+      c->req.req_ctx.export_perms = &c->req.export_perms;
+      c->req.req_ctx.client = get_gsh_client(&c->addr, false);
+
+      snprintf(c->id, sizeof(c->id), "gtest-compound-%u-%u", instance, t);
+      snprintf(c->open_owner, sizeof(c->open_owner), "open-%u", t);
+      snprintf(c->lock_owner, sizeof(c->lock_owner), "lock-%u", t);
+
+      clients[t] = c;
+
+      sprintf(fname, "w-%08x", t);
+      EXPECT_TRUE(setclientid(c, t));
+      EXPECT_TRUE(open_file(c, fname, io_fh[t], &c->open_stateid));
+    }
+
+    void client_fini(unsigned t) {
+      Nfs4Client *c = clients[t];
+
+      EXPECT_TRUE(close_file(c, io_fh[t], &c->open_stateid));
+      put_gsh_client(c->req.req_ctx.client);
+      gsh_free(c);
+      clients[t] = nullptr;
+    }
+
+    std::vector<gtest::BenchOp> compound_ops(void) {
+      std::vector<gtest::BenchOp> ops = {
+        {"getattr", 40, [&](unsigned t, std::mt19937 &rng) {
+          nfs_argop4 argops[2];
+          nfs_res_t res;
+          bool ok;
+
+          memset(argops, 0, sizeof(argops));
+          set_putfh(&argops[0], obj_fh[rng() % obj_fh.size()]);
+          argops[1].argop = NFS4_OP_GETATTR;
+          argops[1].nfs_argop4_u.opgetattr.attr_request = attr_request;
+
+          ok = compound(clients[t], argops, 2, &res) &&
+               res.res_compound4.status == NFS4_OK;
+          nfs4_Compound_Free(&res);
+          return ok;
+        }},
+        {"lookup", 30, [&](unsigned t, std::mt19937 &rng) {
+          nfs_argop4 argops[4];
+          nfs_res_t res;
+          char fname[NAMELEN];
+          bool ok;
+
+          sprintf(fname, "f-%08x", (int) (rng() % file_count));
+          memset(argops, 0, sizeof(argops));
+          set_putfh(&argops[0], root_fh);
+          argops[1].argop = NFS4_OP_LOOKUP;
+          set_name(&argops[1].nfs_argop4_u.oplookup.objname, fname);
+          argops[2].argop = NFS4_OP_GETFH;
+          argops[3].argop = NFS4_OP_GETATTR;
+          argops[3].nfs_argop4_u.opgetattr.attr_request = attr_request;
+
+          ok = compound(clients[t], argops, 4, &res) &&
+               res.res_compound4.status == NFS4_OK;
+          nfs4_Compound_Free(&res);
+          return ok;
+        }},
+        {"readdir", 5, [&](unsigned t, std::mt19937 &rng) {
+          nfs_argop4 argops[2];
+          nfs_res_t res;
+          READDIR4args *ra = &argops[1].nfs_argop4_u.opreaddir;
+          bool ok;
+
+          memset(argops, 0, sizeof(argops));
+          set_putfh(&argops[0], dir_fh);
+          argops[1].argop = NFS4_OP_READDIR;
+          ra->dircount = 16384;
+          ra->maxcount = 32768;
+          ra->attr_request = attr_request;
+
+          ok = compound(clients[t], argops, 2, &res) &&
+               res.res_compound4.status == NFS4_OK;
+          nfs4_Compound_Free(&res);
+          return ok;
+        }},
+        {"open_close", 5, [&](unsigned t, std::mt19937 &rng) {
+          Nfs4Client *c = clients[t];
+          char fname[NAMELEN];
+          stateid4 stateid;
+
+          sprintf(fname, "o-%08x", t);
+          if (!open_file(c, fname, open_fh[t], &stateid))
+            return false;
+          return close_file(c, open_fh[t], &stateid);
+        }},
+        {"read", 10, [&](unsigned t, std::mt19937 &rng) {
+          nfs_argop4 argops[2];
+          nfs_res_t res;
+          READ4args *ra = &argops[1].nfs_argop4_u.opread;
+          bool ok;
+
+          memset(argops, 0, sizeof(argops));
+          set_putfh(&argops[0], io_fh[t]);
+          argops[1].argop = NFS4_OP_READ;
+          ra->stateid = clients[t]->open_stateid;
+          ra->offset = (rng() % (IO_SPAN / IO_SIZE)) * IO_SIZE;
+          ra->count = IO_SIZE;
+
+          ok = compound(clients[t], argops, 2, &res) &&
+               res.res_compound4.status == NFS4_OK;
+          nfs4_Compound_Free(&res);
+          return ok;
+        }},
+        {"write", 5, [&](unsigned t, std::mt19937 &rng) {
+          nfs_argop4 argops[2];
+          nfs_res_t res;
+          WRITE4args *wa = &argops[1].nfs_argop4_u.opwrite;
+          bool ok;
+
+          memset(argops, 0, sizeof(argops));
+          set_putfh(&argops[0], io_fh[t]);
+          argops[1].argop = NFS4_OP_WRITE;
+          wa->stateid = clients[t]->open_stateid;
+          wa->offset = (rng() % (IO_SPAN / IO_SIZE)) * IO_SIZE;
+          wa->stable = UNSTABLE4;
+          wa->data.data_len = IO_SIZE;
+          wa->data.data_val = buffer.data();
+
+          ok = compound(clients[t], argops, 2, &res) &&
+               res.res_compound4.status == NFS4_OK;
+          nfs4_Compound_Free(&res);
+          return ok;
+        }},
+        {"lock", 5, [&](unsigned t, std::mt19937 &rng) {
+          return lock_unlock(clients[t], t,
+                             (rng() % (IO_SPAN / IO_SIZE)) * IO_SIZE);
+        }},
+      };
+
+      return ops;
+    }
+
+    /* Run the op given alone, or the mix if none is */
+    void run(const std::string &name, const char *only = nullptr) {
+      auto ops = compound_ops();
+
+      ASSERT_EQ(nfs_param.nfsv4_param.putfh_resolve_threads, 0U)
+        << "COMPOUNDs can't suspend here, set PUTFH_Resolve_Threads = 0";
+
+      if (only != nullptr) {
+        for (auto &op : ops)
+          op.weight = op.name == only ? 1 : 0;
+      } else {
+        EXPECT_TRUE(gtest::bench_parse_mix(mix, ops)) << "bad mix " << mix;
+      }
+
+      enableEvents(event_list);
+      if (profile_out)
+        ProfilerStart(profile_out);
+
+      gtest::bench_run(name, ops, [&](unsigned t) {
+        client_init(t);
+      });
+
+      if (profile_out)
+        ProfilerStop();
+      disableEvents(event_list);
+    }
+
+    struct fsal_obj_handle *test_dir = nullptr;
+    std::vector<fsal_obj_handle *> objs;
+    std::vector<fsal_obj_handle *> io_files;
+    std::vector<fsal_obj_handle *> open_files;
+    nfs_fh4 root_fh = {0, nullptr};
+    nfs_fh4 dir_fh = {0, nullptr};
+    std::vector<nfs_fh4> obj_fh;
+    std::vector<nfs_fh4> io_fh;
+    std::vector<nfs_fh4> open_fh;
+    struct bitmap4 attr_request;
+    std::vector<char> buffer;
+    std::vector<Nfs4Client *> clients;
+  };
+
+} /* namespace */
+
+TEST_F(Nfs4CompoundScalingTest, GETATTR)
+{
+  run("nfs4_getattr", "getattr");
+}
+
+TEST_F(Nfs4CompoundScalingTest, LOOKUP)
+{
+  run("nfs4_lookup", "lookup");
+}
+
+TEST_F(Nfs4CompoundScalingTest, READDIR)
+{
+  run("nfs4_readdir", "readdir");
+}
+
+TEST_F(Nfs4CompoundScalingTest, OPEN_CLOSE)
+{
+  run("nfs4_open_close", "open_close");
+}
+
+TEST_F(Nfs4CompoundScalingTest, READ)
+{
+  run("nfs4_read", "read");
+}
+
+TEST_F(Nfs4CompoundScalingTest, WRITE)
+{
+  run("nfs4_write", "write");
+}
+
+TEST_F(Nfs4CompoundScalingTest, LOCK)
+{
+  run("nfs4_lock", "lock");
+}
+
+TEST_F(Nfs4CompoundScalingTest, MIXED)
+{
+  run("nfs4_mixed");
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+
+  using namespace std;
+  using namespace std::literals;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+	"LTTng session name")
+
+      ("event-list", po::value<string>(),
+	"LTTng event list, comma separated")
+
+      ("profile", po::value<string>(),
+	"Enable profiling and set output file.")
+
+      ("threads", po::value<unsigned>(),
+	"largest thread count, the sweep doubles up to it (default 8)")
+
+      ("ops", po::value<uint64_t>(),
+	"ops each thread runs (default 100000)")
+
+      ("files", po::value<int>(),
+	"files looked up and getattr'ed (default 10000)")
+
+      ("mix", po::value<string>(),
+	"op weights of MIXED, e.g. getattr=40,lookup=30,readdir=5,"
+	"open_close=5,read=10,write=5,lock=5")
+
+      ("json", po::value<string>(),
+	"write the results as JSON to this file")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("event-list");
+    if (vm_iter != vm.end()) {
+      event_list = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("profile");
+    if (vm_iter != vm.end()) {
+      profile_out = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("threads");
+    gtest::bench_config.threads = gtest::bench_sweep(
+      vm_iter != vm.end() ? std::max(vm_iter->second.as<unsigned>(), 1U) : 8);
+    vm_iter = vm.find("ops");
+    if (vm_iter != vm.end()) {
+      gtest::bench_config.ops_per_thread = vm_iter->second.as<uint64_t>();
+    }
+    vm_iter = vm.find("files");
+    if (vm_iter != vm.end()) {
+      file_count = std::max(vm_iter->second.as<int>(), 1);
+    }
+    vm_iter = vm.find("mix");
+    if (vm_iter != vm.end()) {
+      mix = vm_iter->second.as<std::string>();
+    }
+    vm_iter = vm.find("json");
+    if (vm_iter != vm.end()) {
+      gtest::bench_config.json_path = vm_iter->second.as<std::string>();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+					session_name, TEST_ROOT, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+
+    gtest::bench_write_json();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
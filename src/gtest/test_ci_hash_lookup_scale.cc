@@ -0,0 +1,249 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (C) 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Handle lookup scaling.  Every lookup goes through
+ * exp_ops.create_handle(), so it is a hit in the MDCACHE handle hash,
+ * and the same set of handles is looked up from 1, 2, 4 ... threads.
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/exception.hpp>
+#include <boost/program_options.hpp>
+
+extern "C" {
+/* Manually forward this, as 9P is not C++ safe */
+void admin_halt(void);
+/* Ganesha headers */
+#include "export_mgr.h"
+#include "nfs_exports.h"
+#include "sal_data.h"
+#include "fsal.h"
+#include "common_utils.h"
+}
+
+#include "gtest.hh"
+
+#define TEST_ROOT "ci_hash_lookup_scale"
+#define FILE_COUNT 10000
+#define LOOP_COUNT 1000000
+#define HANDLE_SIZE 128
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+  int max_threads = 16;
+
+  struct host_handle {
+    char buf[HANDLE_SIZE];
+    size_t len;
+  };
+
+  class CIHashLookupScaleTest : public gtest::GaneshaFSALBaseTest {
+  protected:
+
+    virtual void SetUp() {
+      fsal_status_t status;
+      struct gsh_buffdesc fh_desc;
+
+      gtest::GaneshaFSALBaseTest::SetUp();
+
+      create_and_prime_many(FILE_COUNT, objs);
+
+      for (int i = 0; i < FILE_COUNT; ++i) {
+	fh_desc.addr = handles[i].buf;
+	fh_desc.len = HANDLE_SIZE;
+
+	status = objs[i]->obj_ops->handle_to_wire(objs[i],
+						  FSAL_DIGEST_NFSV4,
+						  &fh_desc);
+	ASSERT_EQ(status.major, 0);
+
+	status = op_ctx->fsal_export->exp_ops.wire_to_host(
+		op_ctx->fsal_export, FSAL_DIGEST_NFSV4, &fh_desc, 0);
+	ASSERT_EQ(status.major, 0);
+
+	handles[i].len = fh_desc.len;
+      }
+    }
+
+    virtual void TearDown() {
+      remove_many(FILE_COUNT, objs);
+
+      gtest::GaneshaFSALBaseTest::TearDown();
+    }
+
+    void lookup_loop(int thread_ix, int nthreads) {
+      struct req_op_context ctx = req_ctx;
+      struct fsal_export *exp = req_ctx.fsal_export;
+      struct gsh_buffdesc fh_desc;
+      struct fsal_obj_handle *obj;
+      fsal_status_t status;
+
+      /* op_ctx is per thread */
+      op_ctx = &ctx;
+
+      for (int i = thread_ix; i < LOOP_COUNT; i += nthreads) {
+	struct host_handle *h = &handles[i % FILE_COUNT];
+
+	fh_desc.addr = h->buf;
+	fh_desc.len = h->len;
+
+	status = exp->exp_ops.create_handle(exp, &fh_desc, &obj, NULL);
+	ASSERT_EQ(status.major, 0);
+	obj->obj_ops->put_ref(obj);
+      }
+    }
+
+    struct fsal_obj_handle *objs[FILE_COUNT];
+    struct host_handle handles[FILE_COUNT];
+  };
+
+} /* namespace */
+
+TEST_F(CIHashLookupScaleTest, SCALE)
+{
+  struct timespec s_time, e_time;
+  uint64_t base = 0;
+
+  for (int nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+    std::vector<std::thread> threads;
+    uint64_t elapsed;
+
+    now(&s_time);
+
+    for (int t = 0; t < nthreads; ++t)
+      threads.emplace_back(&CIHashLookupScaleTest::lookup_loop, this,
+			   t, nthreads);
+    for (auto& th : threads)
+      th.join();
+
+    now(&e_time);
+
+    elapsed = timespec_diff(&s_time, &e_time);
+    if (base == 0)
+      base = elapsed;
+
+    fprintf(stderr,
+	    "%2d threads: %" PRIu64 " ns per lookup, %.0f lookups/s,"
+	    " speedup %.2f\n",
+	    nthreads, elapsed / LOOP_COUNT,
+	    LOOP_COUNT * 1e9 / elapsed, (double) base / elapsed);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+
+  using namespace std;
+  using namespace std::literals;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+	"LTTng session name")
+
+      ("threads", po::value<int>(),
+	"largest number of lookup threads (default 16)")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("threads");
+    if (vm_iter != vm.end()) {
+      max_threads = vm_iter->second.as<int>();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+					session_name, TEST_ROOT, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
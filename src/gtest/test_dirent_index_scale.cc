@@ -0,0 +1,243 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (C) 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Dirent index scaling in a large directory.  A full readdir of the
+ * directory inserts every dirent into the MDCACHE name and cookie
+ * trees, then every name is looked up from the dirent cache, then the
+ * directory is read again from cache.
+ *
+ * Run with CacheInode { Dir_Chunk_Max, Chunks_HWMark and Entries_HWMark }
+ * large enough to hold the whole directory, or the lookups go to the
+ * FSAL.
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/exception.hpp>
+#include <boost/program_options.hpp>
+
+extern "C" {
+/* Manually forward this, as 9P is not C++ safe */
+void admin_halt(void);
+/* Ganesha headers */
+#include "export_mgr.h"
+#include "nfs_exports.h"
+#include "sal_data.h"
+#include "fsal.h"
+#include "common_utils.h"
+}
+
+#include "gtest.hh"
+
+#define TEST_ROOT "dirent_index_scale"
+#define DIRENT_COUNT 1000000
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+  int dirent_count = DIRENT_COUNT;
+
+  class DirentIndexScaleTest : public gtest::GaneshaFSALBaseTest {
+  protected:
+
+    virtual void SetUp() {
+      fsal_status_t status;
+      struct attrlist attrs_out;
+      struct fsal_obj_handle *obj;
+      char fname[NAMELEN];
+
+      gtest::GaneshaFSALBaseTest::SetUp();
+
+      for (int i = 0; i < dirent_count; ++i) {
+	fsal_prepare_attrs(&attrs_out, 0);
+	sprintf(fname, "f-%08x", i);
+
+	status = fsal_create(test_root, fname, REGULAR_FILE, &attrs, NULL,
+			     &obj, &attrs_out);
+	ASSERT_EQ(status.major, 0);
+
+	fsal_release_attrs(&attrs_out);
+	obj->obj_ops->put_ref(obj);
+      }
+    }
+
+    virtual void TearDown() {
+      remove_many(dirent_count);
+
+      gtest::GaneshaFSALBaseTest::TearDown();
+    }
+
+    uint64_t read_all(void) {
+      struct timespec s_time, e_time;
+      fsal_status_t status;
+      unsigned int num_entries = 0;
+      bool eod_met = false;
+      uint32_t tracker;
+
+      now(&s_time);
+
+      status = fsal_readdir(test_root, 0, &num_entries, &eod_met, 0,
+			    readdir_callback, &tracker);
+
+      now(&e_time);
+
+      EXPECT_EQ(status.major, 0);
+      EXPECT_TRUE(eod_met);
+      EXPECT_EQ(num_entries, (unsigned int) dirent_count);
+
+      return timespec_diff(&s_time, &e_time);
+    }
+
+    uint64_t lookup_all(void) {
+      struct timespec s_time, e_time;
+      struct fsal_obj_handle *obj;
+      fsal_status_t status;
+      char fname[NAMELEN];
+
+      now(&s_time);
+
+      for (int i = 0; i < dirent_count; ++i) {
+	sprintf(fname, "f-%08x", i);
+
+	status = test_root->obj_ops->lookup(test_root, fname, &obj, NULL);
+	EXPECT_EQ(status.major, 0);
+	obj->obj_ops->put_ref(obj);
+      }
+
+      now(&e_time);
+
+      return timespec_diff(&s_time, &e_time);
+    }
+
+    void report(const char *what, uint64_t elapsed) {
+      fprintf(stderr,
+	      "%s: %d dirents, %" PRIu64 " ns per dirent, %.0f dirents/s\n",
+	      what, dirent_count, elapsed / dirent_count,
+	      dirent_count * 1e9 / elapsed);
+    }
+  };
+
+} /* namespace */
+
+TEST_F(DirentIndexScaleTest, SCALE)
+{
+  report("insert (readdir from FSAL)", read_all());
+  report("lookup (dirent cache)", lookup_all());
+  report("readdir (dirent cache)", read_all());
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  char* session_name = NULL;
+
+  using namespace std;
+  using namespace std::literals;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+       "path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+       "log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+       "id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+       "ganesha debug level")
+
+      ("session", po::value<string>(),
+	"LTTng session name")
+
+      ("count", po::value<int>(),
+	"number of entries in the directory (default 1000000)")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("session");
+    if (vm_iter != vm.end()) {
+      session_name = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("count");
+    if (vm_iter != vm.end()) {
+      dirent_count = vm_iter->second.as<int>();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    gtest::env = new gtest::Environment(ganesha_conf, lpath, dlevel,
+					session_name, TEST_ROOT, export_id);
+    ::testing::AddGlobalTestEnvironment(gtest::env);
+
+    code  = RUN_ALL_TESTS();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
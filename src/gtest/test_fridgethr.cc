@@ -0,0 +1,137 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include "gtest/gtest.h"
+
+extern "C" {
+
+#include "nfs_core.h"
+#include "fridgethr.h"
+#include "abstract_atomic.h"
+
+/* gperf headers */
+#include <gperftools/profiler.h>
+
+  struct fr_test_job {
+    struct timespec submitted;
+    uint64_t *latency;
+    uint64_t *done;
+  };
+
+  void
+  fr_test_run(struct fridgethr_context *ctx)
+  {
+    struct fr_test_job *job = (struct fr_test_job *)ctx->arg;
+    struct timespec ran;
+
+    now(&ran);
+    (void)atomic_add_uint64_t(job->latency,
+			      timespec_diff(&job->submitted, &ran));
+    (void)atomic_inc_uint64_t(job->done);
+  }
+
+} /* extern "C" */
+
+namespace {
+
+  char* profile_out = nullptr; //"/tmp/profile.out";
+
+  static constexpr uint32_t num_jobs = 200000;
+
+  class FridgethrLatency : public ::testing::TestWithParam<uint32_t> {
+
+  protected:
+    struct fridgethr *fr;
+    struct fr_test_job *jobs;
+    uint64_t latency;
+    uint64_t done;
+
+    virtual void SetUp() {
+      struct fridgethr_params frp = {};
+
+      frp.thr_max = 4;
+      frp.thr_min = 0;
+      frp.flavor = fridgethr_flavor_worker;
+      frp.deferment = fridgethr_defer_queue;
+      frp.ring_size = GetParam();
+
+      ASSERT_EQ(fridgethr_init(&fr, "test", &frp), 0);
+
+      jobs = new fr_test_job[num_jobs];
+      latency = 0;
+      done = 0;
+      for (uint32_t ix = 0; ix < num_jobs; ++ix) {
+	jobs[ix].latency = &latency;
+	jobs[ix].done = &done;
+      }
+    }
+
+    virtual void TearDown() {
+      EXPECT_EQ(fridgethr_sync_command(fr, fridgethr_comm_stop, 10), 0);
+      fridgethr_destroy(fr);
+      delete[] jobs;
+    }
+
+  };
+
+} /* namespace */
+
+TEST_P(FridgethrLatency, SUBMIT)
+{
+  struct timespec s_time, e_time;
+
+  if (profile_out)
+    ProfilerStart(profile_out);
+
+  now(&s_time);
+
+  for (uint32_t ix = 0; ix < num_jobs; ++ix) {
+    now(&jobs[ix].submitted);
+    ASSERT_EQ(fridgethr_submit(fr, fr_test_run, &jobs[ix]), 0);
+  }
+
+  while (atomic_fetch_uint64_t(&done) < num_jobs)
+    sched_yield();
+
+  now(&e_time);
+
+  if (profile_out)
+    ProfilerStop();
+
+  uint64_t dt = timespec_diff(&s_time, &e_time);
+  uint64_t jobs_s = num_jobs / (double(dt) / 1000000000);
+
+  fprintf(stderr, "%s: total run time: %" PRIu64 " (%" PRIu32 " jobs %"
+	  PRIu64 " jobs/s, %" PRIu64 " ns submit to run)\n",
+	  GetParam() ? "ring" : "classic", dt, num_jobs, jobs_s,
+	  latency / num_jobs);
+}
+
+INSTANTIATE_TEST_CASE_P(Queues, FridgethrLatency,
+			::testing::Values(0U, 1024U));
+
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,174 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include "gtest/gtest.h"
+
+extern "C" {
+
+#include "nfs_core.h"
+#include "hashtable.h"
+
+/* gperf headers */
+#include <gperftools/profiler.h>
+
+  uint32_t
+  ht_test_hash_key(struct hash_param *p, struct gsh_buffdesc *key)
+  {
+    return *(uint64_t *)key->addr % p->index_size;
+  }
+
+  uint64_t
+  ht_test_hash_rbt(struct hash_param *p, struct gsh_buffdesc *key)
+  {
+    uint64_t h = *(uint64_t *)key->addr;
+
+    /* murmur3 finalizer */
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  int
+  ht_test_compare(struct gsh_buffdesc *lhs, struct gsh_buffdesc *rhs)
+  {
+    return *(uint64_t *)lhs->addr != *(uint64_t *)rhs->addr;
+  }
+
+  int
+  ht_test_free(struct gsh_buffdesc key, struct gsh_buffdesc val)
+  {
+    return 1;
+  }
+
+} /* extern "C" */
+
+namespace {
+
+  char* profile_out = nullptr; //"/tmp/profile.out";
+
+  static constexpr uint32_t item_wsize = 1000000;
+  static constexpr uint32_t num_calls = 1000000;
+
+  class HashtableLatency : public ::testing::TestWithParam<uint32_t> {
+
+  protected:
+    struct hash_table *ht;
+    uint64_t *keys;
+
+    bool set(uint64_t *key) {
+      struct gsh_buffdesc k = { key, sizeof(*key) };
+      struct gsh_buffdesc v = { key, sizeof(*key) };
+
+      return HashTable_Set(ht, &k, &v) == HASHTABLE_SUCCESS;
+    }
+
+    bool get(uint64_t *key) {
+      struct gsh_buffdesc k = { key, sizeof(*key) };
+      struct gsh_buffdesc v;
+
+      return HashTable_Get(ht, &k, &v) == HASHTABLE_SUCCESS &&
+	*(uint64_t *)v.addr == *key;
+    }
+
+    bool del(uint64_t *key) {
+      struct gsh_buffdesc k = { key, sizeof(*key) };
+
+      return HashTable_Del(ht, &k, NULL, NULL) == HASHTABLE_SUCCESS;
+    }
+
+    virtual void SetUp() {
+      struct hash_param param = {};
+
+      param.flags = GetParam();
+      param.index_size = 17;
+      param.hash_func_key = ht_test_hash_key;
+      param.hash_func_rbt = ht_test_hash_rbt;
+      param.compare_key = ht_test_compare;
+      param.ht_name = (char *)"test";
+      param.ht_log_component = COMPONENT_HASHTABLE;
+
+      ht = hashtable_init(&param);
+      ASSERT_NE(ht, nullptr);
+
+      /* room for the window plus every key inserted by the run */
+      keys = new uint64_t[item_wsize + num_calls];
+      for (uint32_t ix = 0; ix < item_wsize + num_calls; ++ix)
+	keys[ix] = ix;
+
+      /* fill window */
+      for (uint32_t ix = 0; ix < item_wsize; ++ix)
+	ASSERT_TRUE(set(&keys[ix]));
+    }
+
+    virtual void TearDown() {
+      for (uint32_t ix = num_calls; ix < item_wsize + num_calls; ++ix)
+	EXPECT_TRUE(del(&keys[ix]));
+      EXPECT_EQ(hashtable_destroy(ht, ht_test_free), HASHTABLE_SUCCESS);
+      delete[] keys;
+    }
+
+  };
+
+} /* namespace */
+
+TEST_P(HashtableLatency, CHURN)
+{
+  struct timespec s_time, e_time;
+
+  if (profile_out)
+    ProfilerStart(profile_out);
+
+  now(&s_time);
+
+  for (uint32_t call_ctr = 0; call_ctr < num_calls; ++call_ctr) {
+    /* look up a live key, delete the oldest, insert a new one */
+    ASSERT_TRUE(get(&keys[call_ctr + item_wsize / 2]));
+    ASSERT_TRUE(del(&keys[call_ctr]));
+    ASSERT_TRUE(set(&keys[call_ctr + item_wsize]));
+  }
+
+  now(&e_time);
+
+  if (profile_out)
+    ProfilerStop();
+
+  EXPECT_FALSE(get(&keys[0]));
+
+  uint64_t dt = timespec_diff(&s_time, &e_time);
+  uint64_t reqs_s = num_calls / (double(dt) / 1000000000);
+
+  fprintf(stderr, "%s: total run time: %" PRIu64 " (%" PRIu32 " reqs %"
+	  PRIu64 " reqs/s)\n",
+	  GetParam() & HT_FLAG_OPEN ? "open" : "rbt", dt, num_calls,
+	  reqs_s);
+}
+
+INSTANTIATE_TEST_CASE_P(Backends, HashtableLatency,
+			::testing::Values(HT_FLAG_CACHE, HT_FLAG_OPEN));
+
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,105 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include "gtest/gtest.h"
+
+extern "C" {
+/* Ganesha headers */
+#include "export_mgr.h"
+#include "nfs_proto_functions.h"
+}
+
+namespace {
+
+  struct gsh_export *add_export(uint16_t export_id, const char *pseudopath)
+  {
+    struct gsh_export *exp = alloc_export();
+
+    exp->export_id = export_id;
+    exp->fullpath = gsh_strdup(pseudopath);
+    exp->pseudopath = gsh_strdup(pseudopath);
+    EXPECT_TRUE(insert_gsh_export(exp));
+
+    return exp;
+  }
+
+  void del_export(struct gsh_export *exp)
+  {
+    remove_gsh_export(exp->export_id);
+    put_gsh_export(exp);
+  }
+
+  class PseudoMountDepth : public ::testing::Test {
+  protected:
+    static void SetUpTestCase() {
+      export_pkginit();
+    }
+
+    virtual void SetUp() {
+      root = add_export(1, "/");
+    }
+
+    virtual void TearDown() {
+      del_export(root);
+    }
+
+    struct gsh_export *root;
+  };
+
+} /* namespace */
+
+TEST_F(PseudoMountDepth, ON_ROOT)
+{
+  struct gsh_export *a = add_export(2, "/a");
+
+  EXPECT_EQ(pseudo_mount_depth(root), 0);
+  EXPECT_EQ(pseudo_mount_depth(a), 0);
+
+  del_export(a);
+}
+
+TEST_F(PseudoMountDepth, NESTED)
+{
+  struct gsh_export *a = add_export(2, "/a");
+  struct gsh_export *ab = add_export(3, "/a/b");
+  struct gsh_export *abcd = add_export(4, "/a/b/c/d");
+  struct gsh_export *abx = add_export(5, "/a/bx");
+
+  EXPECT_EQ(pseudo_mount_depth(a), 0);
+  EXPECT_EQ(pseudo_mount_depth(ab), 1);
+  /* /a/b/c is not an export, so it does not count */
+  EXPECT_EQ(pseudo_mount_depth(abcd), 2);
+  /* /a/b is not a path prefix of /a/bx */
+  EXPECT_EQ(pseudo_mount_depth(abx), 1);
+
+  del_export(abx);
+  del_export(abcd);
+  del_export(ab);
+  del_export(a);
+}
+
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,414 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (C) 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * XDR encode and decode of the hottest NFSv4.1 COMPOUNDs, in memory:
+ * SEQUENCE+PUTFH+READ arguments and replies, SEQUENCE+PUTFH+GETATTR
+ * replies and SEQUENCE+PUTFH+READDIR replies.  Each op encodes one into
+ * a buffer of its thread, or decodes the buffer encoded beforehand and
+ * frees the result, so the XDR routines are measured alone.
+ *
+ * --threads sets the largest thread count of the sweep, --ops the ops
+ * each thread runs, --entries the entries of a READDIR reply and --json
+ * where to write the results.
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <vector>
+#include <random>
+#include "gtest/gtest.h"
+#include <boost/program_options.hpp>
+
+extern "C" {
+#include "nfsv41.h"
+}
+
+#include "gtest_bench.hh"
+
+#define XDR_BENCH_BUFSIZE (1024 * 1024)
+#define XDR_BENCH_READSIZE 4096
+
+namespace {
+
+  int entry_count = 64;
+
+  char fh[64];
+  char read_data[XDR_BENCH_READSIZE];
+  char attr_vals[88];
+  sessionid4 sessionid = "xdr-bench-sess";
+
+  /* What is encoded, and decoded back, by every op */
+  struct Compounds {
+    nfs_argop4 read_argops[3];
+    nfs_resop4 read_resops[3];
+    nfs_resop4 getattr_resops[3];
+    nfs_resop4 readdir_resops[3];
+    std::vector<entry4> entries;
+    std::vector<std::string> names;
+    COMPOUND4args read_args;
+    COMPOUND4res read_res;
+    COMPOUND4res getattr_res;
+    COMPOUND4res readdir_res;
+  };
+
+  /* The encoded form of each COMPOUND, to decode */
+  struct Encoded {
+    std::vector<char> read_args;
+    std::vector<char> read_res;
+    std::vector<char> getattr_res;
+    std::vector<char> readdir_res;
+  };
+
+  Compounds compounds;
+  Encoded encoded;
+  std::vector<std::vector<char>> buffers;
+
+  void set_fattr(fattr4 *attrs)
+  {
+    attrs->attrmask.bitmap4_len = 2;
+    attrs->attrmask.map[0] = 0x0010011a;
+    attrs->attrmask.map[1] = 0x00b0a23a;
+    attrs->attr_vals.attrlist4_len = sizeof(attr_vals);
+    attrs->attr_vals.attrlist4_val = attr_vals;
+  }
+
+  void set_sequence(nfs_argop4 *argop, nfs_resop4 *resop)
+  {
+    argop->argop = NFS4_OP_SEQUENCE;
+    memcpy(argop->nfs_argop4_u.opsequence.sa_sessionid, sessionid,
+	   NFS4_SESSIONID_SIZE);
+    argop->nfs_argop4_u.opsequence.sa_sequenceid = 17;
+    argop->nfs_argop4_u.opsequence.sa_slotid = 3;
+    argop->nfs_argop4_u.opsequence.sa_highest_slotid = 63;
+    argop->nfs_argop4_u.opsequence.sa_cachethis = false;
+
+    SEQUENCE4resok *resok =
+      &resop->nfs_resop4_u.opsequence.SEQUENCE4res_u.sr_resok4;
+
+    resop->resop = NFS4_OP_SEQUENCE;
+    resop->nfs_resop4_u.opsequence.sr_status = NFS4_OK;
+    memcpy(resok->sr_sessionid, sessionid, NFS4_SESSIONID_SIZE);
+    resok->sr_sequenceid = 17;
+    resok->sr_slotid = 3;
+    resok->sr_highest_slotid = 63;
+    resok->sr_target_highest_slotid = 63;
+    resok->sr_status_flags = 0;
+  }
+
+  void set_putfh(nfs_argop4 *argop, nfs_resop4 *resop)
+  {
+    if (argop != nullptr) {
+      argop->argop = NFS4_OP_PUTFH;
+      argop->nfs_argop4_u.opputfh.object.nfs_fh4_len = sizeof(fh);
+      argop->nfs_argop4_u.opputfh.object.nfs_fh4_val = fh;
+    }
+    resop->resop = NFS4_OP_PUTFH;
+    resop->nfs_resop4_u.opputfh.status = NFS4_OK;
+  }
+
+  void build_compounds(void)
+  {
+    Compounds &c = compounds;
+    READ4resok *read_ok;
+    READDIR4resok *readdir_ok;
+
+    memset(fh, 0x5a, sizeof(fh));
+    memset(read_data, 0xa5, sizeof(read_data));
+    memset(attr_vals, 0x3c, sizeof(attr_vals));
+
+    set_sequence(&c.read_argops[0], &c.read_resops[0]);
+    set_sequence(&c.read_argops[0], &c.getattr_resops[0]);
+    set_sequence(&c.read_argops[0], &c.readdir_resops[0]);
+    set_putfh(&c.read_argops[1], &c.read_resops[1]);
+    set_putfh(nullptr, &c.getattr_resops[1]);
+    set_putfh(nullptr, &c.readdir_resops[1]);
+
+    c.read_argops[2].argop = NFS4_OP_READ;
+    c.read_argops[2].nfs_argop4_u.opread.stateid.seqid = 1;
+    memset(c.read_argops[2].nfs_argop4_u.opread.stateid.other, 7, 12);
+    c.read_argops[2].nfs_argop4_u.opread.offset = 1 << 20;
+    c.read_argops[2].nfs_argop4_u.opread.count = XDR_BENCH_READSIZE;
+
+    c.read_resops[2].resop = NFS4_OP_READ;
+    c.read_resops[2].nfs_resop4_u.opread.status = NFS4_OK;
+    read_ok = &c.read_resops[2].nfs_resop4_u.opread.READ4res_u.resok4;
+    read_ok->eof = false;
+    read_ok->data.data_len = XDR_BENCH_READSIZE;
+    read_ok->data.data_val = read_data;
+
+    c.getattr_resops[2].resop = NFS4_OP_GETATTR;
+    c.getattr_resops[2].nfs_resop4_u.opgetattr.status = NFS4_OK;
+    set_fattr(&c.getattr_resops[2].nfs_resop4_u.opgetattr.GETATTR4res_u
+	      .resok4.obj_attributes);
+
+    c.entries.resize(entry_count);
+    c.names.resize(entry_count);
+    for (int i = 0; i < entry_count; i++) {
+      char name[NAME_MAX];
+
+      sprintf(name, "file-%08x.dat", i);
+      c.names[i] = name;
+      c.entries[i].cookie = i + 3;
+      c.entries[i].name.utf8string_len = c.names[i].size();
+      c.entries[i].name.utf8string_val = (char *) c.names[i].c_str();
+      set_fattr(&c.entries[i].attrs);
+      c.entries[i].nextentry =
+	i + 1 < entry_count ? &c.entries[i + 1] : nullptr;
+    }
+
+    c.readdir_resops[2].resop = NFS4_OP_READDIR;
+    c.readdir_resops[2].nfs_resop4_u.opreaddir.status = NFS4_OK;
+    readdir_ok = &c.readdir_resops[2].nfs_resop4_u.opreaddir.READDIR4res_u
+      .resok4;
+    memset(readdir_ok->cookieverf, 0, NFS4_VERIFIER_SIZE);
+    readdir_ok->reply.entries = entry_count ? &c.entries[0] : nullptr;
+    readdir_ok->reply.eof = true;
+
+    c.read_args.tag.utf8string_len = 0;
+    c.read_args.tag.utf8string_val = nullptr;
+    c.read_args.minorversion = 1;
+    c.read_args.argarray.argarray_len = 3;
+    c.read_args.argarray.argarray_val = c.read_argops;
+
+    COMPOUND4res *res[] = {&c.read_res, &c.getattr_res, &c.readdir_res};
+    nfs_resop4 *resops[] = {c.read_resops, c.getattr_resops,
+			    c.readdir_resops};
+
+    for (int i = 0; i < 3; i++) {
+      res[i]->status = NFS4_OK;
+      res[i]->tag.utf8string_len = 0;
+      res[i]->tag.utf8string_val = nullptr;
+      res[i]->resarray.resarray_len = 3;
+      res[i]->resarray.resarray_val = resops[i];
+    }
+  }
+
+  /* Encode into buf, returns the bytes encoded or 0 */
+  u_int encode(xdrproc_t proc, void *obj, char *buf)
+  {
+    XDR xdrs;
+    u_int len = 0;
+
+    xdrmem_create(&xdrs, buf, XDR_BENCH_BUFSIZE, XDR_ENCODE);
+    if (proc(&xdrs, obj))
+      len = XDR_GETPOS(&xdrs);
+    XDR_DESTROY(&xdrs);
+    return len;
+  }
+
+  template <typename T>
+  bool decode(xdrproc_t proc, std::vector<char> &buf)
+  {
+    XDR xdrs;
+    T obj;
+    bool ok;
+
+    memset(&obj, 0, sizeof(obj));
+    xdrmem_create(&xdrs, buf.data(), buf.size(), XDR_DECODE);
+    ok = proc(&xdrs, &obj);
+    XDR_DESTROY(&xdrs);
+    xdr_free(proc, &obj);
+    return ok;
+  }
+
+  std::vector<char> encode_once(xdrproc_t proc, void *obj)
+  {
+    std::vector<char> buf(XDR_BENCH_BUFSIZE);
+
+    buf.resize(encode(proc, obj, buf.data()));
+    return buf;
+  }
+
+  char *thread_buf(unsigned thread)
+  {
+    return buffers[thread].data();
+  }
+
+  class XDRBench : public ::testing::Test {
+  protected:
+
+    virtual void SetUp() {
+      unsigned max_threads = 1;
+
+      build_compounds();
+
+      encoded.read_args = encode_once((xdrproc_t) xdr_COMPOUND4args,
+				      &compounds.read_args);
+      encoded.read_res = encode_once((xdrproc_t) xdr_COMPOUND4res,
+				     &compounds.read_res);
+      encoded.getattr_res = encode_once((xdrproc_t) xdr_COMPOUND4res,
+					&compounds.getattr_res);
+      encoded.readdir_res = encode_once((xdrproc_t) xdr_COMPOUND4res,
+					&compounds.readdir_res);
+
+      for (auto n : gtest::bench_config.threads)
+	max_threads = std::max(max_threads, n);
+      buffers.assign(max_threads, std::vector<char>(XDR_BENCH_BUFSIZE));
+    }
+
+    void run(const std::string &name, xdrproc_t proc, void *obj,
+	     std::vector<char> &enc, bool is_args) {
+      std::vector<gtest::BenchOp> ops = {
+	{"encode", 1,
+	 [proc, obj](unsigned thread, std::mt19937 &rng) {
+	   return encode(proc, obj, thread_buf(thread)) != 0;
+	 }},
+	{"decode", 1,
+	 [proc, &enc, is_args](unsigned thread, std::mt19937 &rng) {
+	   if (is_args)
+	     return decode<COMPOUND4args>(proc, enc);
+	   return decode<COMPOUND4res>(proc, enc);
+	 }},
+      };
+
+      ASSERT_NE(enc.size(), 0U);
+      fprintf(stderr, "%s: %zu bytes\n", name.c_str(), enc.size());
+      gtest::bench_run(name, ops);
+    }
+  };
+
+} /* namespace */
+
+TEST_F(XDRBench, SEQUENCE_PUTFH_READ_ARGS)
+{
+  run("SEQUENCE_PUTFH_READ_ARGS", (xdrproc_t) xdr_COMPOUND4args,
+      &compounds.read_args, encoded.read_args, true);
+}
+
+TEST_F(XDRBench, SEQUENCE_PUTFH_READ_RES)
+{
+  run("SEQUENCE_PUTFH_READ_RES", (xdrproc_t) xdr_COMPOUND4res,
+      &compounds.read_res, encoded.read_res, false);
+}
+
+TEST_F(XDRBench, SEQUENCE_PUTFH_GETATTR_RES)
+{
+  run("SEQUENCE_PUTFH_GETATTR_RES", (xdrproc_t) xdr_COMPOUND4res,
+      &compounds.getattr_res, encoded.getattr_res, false);
+}
+
+TEST_F(XDRBench, SEQUENCE_PUTFH_READDIR_RES)
+{
+  run("SEQUENCE_PUTFH_READDIR_RES", (xdrproc_t) xdr_COMPOUND4res,
+      &compounds.readdir_res, encoded.readdir_res, false);
+}
+
+/* A decoded COMPOUND must encode back to the same bytes */
+TEST_F(XDRBench, ROUND_TRIP)
+{
+  std::vector<char> *encs[] = {&encoded.getattr_res, &encoded.readdir_res,
+			       &encoded.read_res};
+
+  for (auto enc : encs) {
+    XDR xdrs;
+    COMPOUND4res res;
+
+    memset(&res, 0, sizeof(res));
+    xdrmem_create(&xdrs, enc->data(), enc->size(), XDR_DECODE);
+    ASSERT_TRUE(xdr_COMPOUND4res(&xdrs, &res));
+    XDR_DESTROY(&xdrs);
+
+    std::vector<char> again = encode_once((xdrproc_t) xdr_COMPOUND4res,
+					  &res);
+    EXPECT_EQ(again, *enc);
+    xdr_free((xdrproc_t) xdr_COMPOUND4res, &res);
+  }
+
+  XDR xdrs;
+  COMPOUND4args args;
+
+  memset(&args, 0, sizeof(args));
+  xdrmem_create(&xdrs, encoded.read_args.data(), encoded.read_args.size(),
+		XDR_DECODE);
+  ASSERT_TRUE(xdr_COMPOUND4args(&xdrs, &args));
+  XDR_DESTROY(&xdrs);
+  EXPECT_EQ(encode_once((xdrproc_t) xdr_COMPOUND4args, &args),
+	    encoded.read_args);
+  xdr_free((xdrproc_t) xdr_COMPOUND4args, &args);
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+
+  using namespace std;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("threads", po::value<unsigned>(),
+	"largest thread count, the sweep doubles up to it (default 1)")
+
+      ("ops", po::value<uint64_t>(),
+	"ops each thread runs (default 100000)")
+
+      ("entries", po::value<int>(),
+	"entries of a READDIR reply (default 64)")
+
+      ("json", po::value<string>(),
+	"write the results as JSON to this file")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::command_line_parser parser{argc, argv};
+    parser.options(opts).allow_unregistered();
+    po::store(parser.run(), vm);
+    po::notify(vm);
+
+    vm_iter = vm.find("threads");
+    gtest::bench_config.threads = gtest::bench_sweep(
+      vm_iter != vm.end() ? std::max(vm_iter->second.as<unsigned>(), 1U) : 1);
+    vm_iter = vm.find("ops");
+    if (vm_iter != vm.end()) {
+      gtest::bench_config.ops_per_thread = vm_iter->second.as<uint64_t>();
+    }
+    vm_iter = vm.find("entries");
+    if (vm_iter != vm.end()) {
+      entry_count = std::max(vm_iter->second.as<int>(), 0);
+    }
+    vm_iter = vm.find("json");
+    if (vm_iter != vm.end()) {
+      gtest::bench_config.json_path = vm_iter->second.as<std::string>();
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+    code = RUN_ALL_TESTS();
+
+    gtest::bench_write_json();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
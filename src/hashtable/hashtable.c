@@ -39,6 +39,14 @@
  * determines which of the partitions (each containing a tree and each
  * separately locked), and a hash which acts as the key within an
  * individual Red-Black Tree.
+ *
+ * With HT_FLAG_OPEN, each partition is instead an open addressing
+ * table with linear probing, which holds large tables without deep
+ * trees.  A table that gets three quarters full is doubled, and its
+ * entries moved to the new table a few slots at each set or delete.
+ * Until the old table is empty, lookups search both.  Readers still
+ * take the partition lock, as callers rely on the latch to take
+ * references safely.
  */
 
 #include "config.h"
@@ -267,6 +275,318 @@ compute(struct hash_table *ht, const struct gsh_buffdesc *key,
 	return HASHTABLE_SUCCESS;
 }
 
+/** Slots an open addressing partition starts with */
+#define HT_OPEN_MIN_SLOTS 16
+
+/** Slots of a table being drained moved at each set or delete.  The
+ *  new table is twice the size, so the old one is empty well before
+ *  the new one fills up.
+ */
+#define HT_OPEN_DRAIN_STEP 8
+
+/** Marks an entry moved or deleted from a table being drained, so
+ *  probes for the entries after it go on.
+ */
+#define HT_OPEN_TOMBSTONE ((struct hash_data *)1)
+
+/**
+ * @brief First slot to probe for a hash
+ *
+ * The hashes of some tables are weak in their low bits, so they are
+ * mixed with a multiplication and the top bits are used.
+ *
+ * @param[in] hash   The hash of the key
+ * @param[in] nslots Size of the table, a power of 2
+ *
+ * @return The slot index.
+ */
+static inline uint32_t
+open_home(uint64_t hash, uint32_t nslots)
+{
+	return (hash * 0x9e3779b97f4a7c15ULL) >> (64 - __builtin_ctz(nslots));
+}
+
+/**
+ * @brief Find a key in one open addressing table
+ *
+ * @param[in] ht     The hash table
+ * @param[in] slots  The table, may be NULL
+ * @param[in] nslots Its size
+ * @param[in] key    The key to look up
+ * @param[in] hash   Its hash
+ *
+ * @return The slot index, or -1 if not found.
+ */
+static int64_t
+open_find(struct hash_table *ht, struct hash_slot *slots, uint32_t nslots,
+	  const struct gsh_buffdesc *key, uint64_t hash)
+{
+	uint32_t mask = nslots - 1;
+	uint32_t i;
+
+	if (slots == NULL)
+		return -1;
+
+	for (i = open_home(hash, nslots); slots[i].data != NULL;
+	     i = (i + 1) & mask) {
+		if (slots[i].data != HT_OPEN_TOMBSTONE &&
+		    slots[i].hash == hash &&
+		    ht->parameter.compare_key((struct gsh_buffdesc *)key,
+					      &slots[i].data->key) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+/**
+ * @brief Locate a key within an open addressing partition
+ *
+ * @param[in]  ht      The hashtable to be used
+ * @param[in]  key     The key to look up
+ * @param[in]  index   Index of the partition
+ * @param[in]  hash    Hash of the key
+ * @param[out] data    On success, the entry found, NULL otherwise
+ *
+ * @retval HASHTABLE_SUCCESS if successful
+ * @retval HASHTABLE_NO_SUCH_KEY if key was not found
+ */
+static hash_error_t
+open_locate(struct hash_table *ht, const struct gsh_buffdesc *key,
+	    uint32_t index, uint64_t hash, struct hash_data **data)
+{
+	struct hash_partition *partition = &ht->partitions[index];
+	int64_t i;
+
+	i = open_find(ht, partition->slots, partition->nslots, key, hash);
+	if (i >= 0) {
+		*data = partition->slots[i].data;
+		return HASHTABLE_SUCCESS;
+	}
+
+	i = open_find(ht, partition->old_slots, partition->old_nslots, key,
+		      hash);
+	if (i >= 0) {
+		*data = partition->old_slots[i].data;
+		return HASHTABLE_SUCCESS;
+	}
+
+	*data = NULL;
+	return HASHTABLE_ERROR_NO_SUCH_KEY;
+}
+
+/**
+ * @brief Put an entry in the first free slot of its probe sequence
+ *
+ * @param[in] slots  The table, which must have a free slot
+ * @param[in] nslots Its size
+ * @param[in] hash   Hash of the key
+ * @param[in] data   The entry
+ */
+static void
+open_place(struct hash_slot *slots, uint32_t nslots, uint64_t hash,
+	   struct hash_data *data)
+{
+	uint32_t mask = nslots - 1;
+	uint32_t i;
+
+	for (i = open_home(hash, nslots); slots[i].data != NULL;
+	     i = (i + 1) & mask)
+		;
+
+	slots[i].hash = hash;
+	slots[i].data = data;
+}
+
+/**
+ * @brief Empty a slot of the current table of a partition
+ *
+ * Entries after it in the probe sequence are shifted back, so the
+ * current table never holds tombstones.
+ *
+ * @param[in] partition The partition
+ * @param[in] i         The slot
+ */
+static void
+open_clear(struct hash_partition *partition, uint32_t i)
+{
+	struct hash_slot *slots = partition->slots;
+	uint32_t mask = partition->nslots - 1;
+	uint32_t j = i;
+	uint32_t home;
+
+	for (;;) {
+		j = (j + 1) & mask;
+		if (slots[j].data == NULL)
+			break;
+
+		/* Leave the entry if its home is cyclically in (i, j] */
+		home = open_home(slots[j].hash, partition->nslots);
+		if (i <= j ? (i < home && home <= j)
+			   : (i < home || home <= j))
+			continue;
+
+		slots[i] = slots[j];
+		i = j;
+	}
+
+	slots[i].data = NULL;
+}
+
+/**
+ * @brief Move a few entries of the table being drained
+ *
+ * @param[in] partition The partition, write locked
+ * @param[in] steps     Slots of the old table to move
+ */
+static void
+open_drain(struct hash_partition *partition, uint32_t steps)
+{
+	struct hash_slot *slot;
+
+	while (partition->old_slots != NULL && steps-- > 0) {
+		slot = &partition->old_slots[partition->drained++];
+		if (slot->data != NULL && slot->data != HT_OPEN_TOMBSTONE) {
+			open_place(partition->slots, partition->nslots,
+				   slot->hash, slot->data);
+			slot->data = HT_OPEN_TOMBSTONE;
+		}
+
+		if (partition->drained == partition->old_nslots) {
+			gsh_free(partition->old_slots);
+			partition->old_slots = NULL;
+			partition->old_nslots = 0;
+			partition->drained = 0;
+		}
+	}
+}
+
+/**
+ * @brief Make room for one more entry in an open addressing partition
+ *
+ * @param[in] partition The partition, write locked
+ */
+static void
+open_reserve(struct hash_partition *partition)
+{
+	if ((partition->count + 1) * 4 <= (size_t) partition->nslots * 3)
+		return;
+
+	/* Not reached with a drain still going, but just in case */
+	open_drain(partition, UINT32_MAX);
+
+	partition->old_slots = partition->slots;
+	partition->old_nslots = partition->nslots;
+	partition->drained = 0;
+	partition->nslots *= 2;
+	partition->slots = gsh_calloc(partition->nslots,
+				      sizeof(struct hash_slot));
+}
+
+/**
+ * @brief Take an entry out of an open addressing partition
+ *
+ * @param[in] partition The partition, write locked
+ * @param[in] hash      Hash of the key
+ * @param[in] data      The entry
+ */
+static void
+open_unlink(struct hash_partition *partition, uint64_t hash,
+	    struct hash_data *data)
+{
+	uint32_t mask = partition->nslots - 1;
+	uint32_t i;
+
+	for (i = open_home(hash, partition->nslots);
+	     partition->slots[i].data != NULL; i = (i + 1) & mask) {
+		if (partition->slots[i].data == data) {
+			open_clear(partition, i);
+			return;
+		}
+	}
+
+	/* The latch said it was here */
+	assert(partition->old_slots != NULL);
+
+	mask = partition->old_nslots - 1;
+	for (i = open_home(hash, partition->old_nslots);
+	     partition->old_slots[i].data != NULL; i = (i + 1) & mask) {
+		if (partition->old_slots[i].data == data) {
+			partition->old_slots[i].data = HT_OPEN_TOMBSTONE;
+			return;
+		}
+	}
+
+	assert(false);
+}
+
+/**
+ * @brief Call a function on each entry of an open addressing partition
+ *
+ * @param[in] partition The partition, locked
+ * @param[in] callback  Function to call
+ * @param[in] arg       Its argument
+ */
+static void
+open_for_each(struct hash_partition *partition,
+	      ht_for_each_cb_t callback, void *arg)
+{
+	uint32_t i;
+
+	for (i = 0; i < partition->nslots; i++) {
+		if (partition->slots[i].data != NULL)
+			callback(partition->slots[i].data, arg);
+	}
+
+	for (i = partition->drained; i < partition->old_nslots; i++) {
+		if (partition->old_slots[i].data != NULL &&
+		    partition->old_slots[i].data != HT_OPEN_TOMBSTONE)
+			callback(partition->old_slots[i].data, arg);
+	}
+}
+
+/**
+ * @brief Remove and free all entries of an open addressing partition
+ *
+ * @param[in] ht        The hash table
+ * @param[in] partition The partition, write locked
+ * @param[in] free_func The function with which to free each entry
+ *
+ * @return false if free_func failed.
+ */
+static bool
+open_delall(struct hash_table *ht, struct hash_partition *partition,
+	    int (*free_func)(struct gsh_buffdesc, struct gsh_buffdesc))
+{
+	struct hash_data *data;
+	struct gsh_buffdesc key;
+	struct gsh_buffdesc val;
+	uint32_t i = 0;
+
+	open_drain(partition, UINT32_MAX);
+
+	/* Removing an entry may shift the next one into its slot */
+	while (i < partition->nslots) {
+		data = partition->slots[i].data;
+		if (data == NULL) {
+			i++;
+			continue;
+		}
+
+		key = data->key;
+		val = data->val;
+
+		open_clear(partition, i);
+		pool_free(ht->data_pool, data);
+		--partition->count;
+
+		if (free_func(key, val) == 0)
+			return false;
+	}
+
+	return true;
+}
+
 /* The following are the hash table primitives implementing the
    actual functionality. */
 
@@ -316,6 +636,10 @@ hashtable_init(struct hash_param *hparam)
 			(sizeof(struct hash_partition) *
 			 hparam->index_size));
 
+	/* Open addressing finds entries without the cache */
+	if (hparam->flags & HT_FLAG_OPEN)
+		hparam->flags &= ~HT_FLAG_CACHE;
+
 	/* Fixup entry size */
 	if (hparam->flags & HT_FLAG_CACHE) {
 		if (!hparam->cache_entry_count)
@@ -339,10 +663,17 @@ hashtable_init(struct hash_param *hparam)
 		if (hparam->flags & HT_FLAG_CACHE)
 			partition->cache = gsh_calloc(1, cache_page_size(ht));
 
+		if (hparam->flags & HT_FLAG_OPEN) {
+			partition->nslots = HT_OPEN_MIN_SLOTS;
+			partition->slots = gsh_calloc(HT_OPEN_MIN_SLOTS,
+						      sizeof(struct hash_slot));
+		}
+
 		completed++;
 	}
 
-	ht->node_pool = pool_basic_init(NULL, sizeof(rbt_node_t));
+	if (!(hparam->flags & HT_FLAG_OPEN))
+		ht->node_pool = pool_basic_init(NULL, sizeof(rbt_node_t));
 	ht->data_pool = pool_basic_init(NULL, sizeof(struct hash_data));
 
 	pthread_rwlockattr_destroy(&rwlockattr);
@@ -353,6 +684,7 @@ hashtable_init(struct hash_param *hparam)
 	while (completed != 0) {
 		if (hparam->flags & HT_FLAG_CACHE)
 			gsh_free(ht->partitions[completed - 1].cache);
+		gsh_free(ht->partitions[completed - 1].slots);
 
 		PTHREAD_RWLOCK_destroy(&(ht->partitions[completed - 1].lock));
 		completed--;
@@ -398,9 +730,13 @@ hashtable_destroy(struct hash_table *ht,
 			ht->partitions[index].cache = NULL;
 		}
 
+		gsh_free(ht->partitions[index].slots);
+		gsh_free(ht->partitions[index].old_slots);
+
 		PTHREAD_RWLOCK_destroy(&(ht->partitions[index].lock));
 	}
-	pool_destroy(ht->node_pool);
+	if (ht->node_pool)
+		pool_destroy(ht->node_pool);
 	pool_destroy(ht->data_pool);
 	gsh_free(ht);
 
@@ -497,11 +833,16 @@ hashtable_getlatch(struct hash_table *ht,
 	else
 		PTHREAD_RWLOCK_rdlock(&(ht->partitions[index].lock));
 
-	rc = key_locate(ht, key, index, rbt_hash, &locator);
+	if (ht->parameter.flags & HT_FLAG_OPEN) {
+		rc = open_locate(ht, key, index, rbt_hash, &data);
+	} else {
+		rc = key_locate(ht, key, index, rbt_hash, &locator);
+		if (rc == HASHTABLE_SUCCESS)
+			data = RBT_OPAQ(locator);
+	}
 
 	if (rc == HASHTABLE_SUCCESS) {
 		/* Key was found */
-		data = RBT_OPAQ(locator);
 		if (val) {
 			val->addr = data->val.addr;
 			val->len = data->val.len;
@@ -528,6 +869,7 @@ hashtable_getlatch(struct hash_table *ht,
 		latch->index = index;
 		latch->rbt_hash = rbt_hash;
 		latch->locator = locator;
+		latch->data = data;
 	} else {
 		PTHREAD_RWLOCK_unlock(&ht->partitions[index].lock);
 	}
@@ -631,13 +973,13 @@ hashtable_setlatched(struct hash_table *ht,
 	}
 
 	/* In the case of collision */
-	if (latch->locator) {
+	if (latch->data) {
 		if (!overwrite) {
 			rc = HASHTABLE_ERROR_KEY_ALREADY_EXISTS;
 			goto out;
 		}
 
-		descriptors = RBT_OPAQ(latch->locator);
+		descriptors = latch->data;
 
 		if (isDebug(COMPONENT_HASHTABLE)
 		    && isFullDebug(ht->parameter.ht_log_component)) {
@@ -680,15 +1022,27 @@ hashtable_setlatched(struct hash_table *ht,
 	/* We have no collision, so go about creating and inserting a new
 	   node. */
 
-	RBT_FIND(&ht->partitions[latch->index].rbt, locator, latch->rbt_hash);
+	descriptors = pool_alloc(ht->data_pool);
 
-	mutator = pool_alloc(ht->node_pool);
+	if (ht->parameter.flags & HT_FLAG_OPEN) {
+		struct hash_partition *partition =
+			&ht->partitions[latch->index];
 
-	descriptors = pool_alloc(ht->data_pool);
+		open_reserve(partition);
+		open_place(partition->slots, partition->nslots,
+			   latch->rbt_hash, descriptors);
+		open_drain(partition, HT_OPEN_DRAIN_STEP);
+	} else {
+		RBT_FIND(&ht->partitions[latch->index].rbt, locator,
+			 latch->rbt_hash);
 
-	RBT_OPAQ(mutator) = descriptors;
-	RBT_VALUE(mutator) = latch->rbt_hash;
-	RBT_INSERT(&ht->partitions[latch->index].rbt, mutator, locator);
+		mutator = pool_alloc(ht->node_pool);
+
+		RBT_OPAQ(mutator) = descriptors;
+		RBT_VALUE(mutator) = latch->rbt_hash;
+		RBT_INSERT(&ht->partitions[latch->index].rbt, mutator,
+			   locator);
+	}
 
 	descriptors->key.addr = key->addr;
 	descriptors->key.len = key->len;
@@ -743,7 +1097,7 @@ void hashtable_deletelatched(struct hash_table *ht,
 	/* Its partition */
 	struct hash_partition *partition = &ht->partitions[latch->index];
 
-	data = RBT_OPAQ(latch->locator);
+	data = latch->data;
 
 	if (isDebug(COMPONENT_HASHTABLE)
 	    && isFullDebug(ht->parameter.ht_log_component)) {
@@ -800,9 +1154,14 @@ void hashtable_deletelatched(struct hash_table *ht,
 	}
 
 	/* Now remove the entry */
-	RBT_UNLINK(&partition->rbt, latch->locator);
+	if (ht->parameter.flags & HT_FLAG_OPEN) {
+		open_unlink(partition, latch->rbt_hash, data);
+		open_drain(partition, HT_OPEN_DRAIN_STEP);
+	} else {
+		RBT_UNLINK(&partition->rbt, latch->locator);
+		pool_free(ht->node_pool, latch->locator);
+	}
 	pool_free(ht->data_pool, data);
-	pool_free(ht->node_pool, latch->locator);
 	--ht->partitions[latch->index].count;
 
 	/* Some callers re-use the latch to insert a record after this call,
@@ -810,6 +1169,7 @@ void hashtable_deletelatched(struct hash_table *ht,
 	 * invalid latch->locator
 	 */
 	latch->locator = NULL;
+	latch->data = NULL;
 }
 
 /**
@@ -840,6 +1200,15 @@ hashtable_delall(struct hash_table *ht,
 
 		PTHREAD_RWLOCK_wrlock(&ht->partitions[index].lock);
 
+		if (ht->parameter.flags & HT_FLAG_OPEN) {
+			if (!open_delall(ht, &ht->partitions[index],
+					 free_func)) {
+				PTHREAD_RWLOCK_unlock(
+						&ht->partitions[index].lock);
+				return HASHTABLE_ERROR_DELALL_FAIL;
+			}
+		}
+
 		/* Continue until there are no more entries in the red-black
 		   tree */
 		while ((cursor = RBT_LEFTMOST(root)) != NULL) {
@@ -921,13 +1290,37 @@ hashtable_log(log_components_t component, struct hash_table *ht)
 	LogFullDebug(component, "The hash contains %zd entries", nb_entries);
 
 	for (i = 0; i < ht->parameter.index_size; i++) {
-		root = &ht->partitions[i].rbt;
+		struct hash_partition *partition = &ht->partitions[i];
+		uint32_t slot = 0;
+
+		root = &partition->rbt;
 		LogFullDebug(component,
 			     "The partition in position %" PRIu32
-			     "contains: %u entries", i, root->rbt_num_node);
-		PTHREAD_RWLOCK_rdlock(&ht->partitions[i].lock);
-		RBT_LOOP(root, it) {
-			data = it->rbt_opaq;
+			     "contains: %zu entries", i, partition->count);
+		PTHREAD_RWLOCK_rdlock(&partition->lock);
+		if (ht->parameter.flags & HT_FLAG_OPEN)
+			it = NULL;
+		else
+			it = RBT_LEFTMOST(root);
+		for (;;) {
+			if (!(ht->parameter.flags & HT_FLAG_OPEN)) {
+				if (it == NULL)
+					break;
+				data = it->rbt_opaq;
+				RBT_INCREMENT(it);
+			} else if (slot < partition->nslots) {
+				data = partition->slots[slot++].data;
+				if (data == NULL)
+					continue;
+			} else if (slot < partition->nslots +
+					  partition->old_nslots) {
+				data = partition->old_slots[
+					slot++ - partition->nslots].data;
+				if (data == NULL || data == HT_OPEN_TOMBSTONE)
+					continue;
+			} else {
+				break;
+			}
 
 			ht->parameter.key_to_str(&(data->key), dispkey);
 			ht->parameter.val_to_str(&(data->val), dispval);
@@ -943,9 +1336,8 @@ hashtable_log(log_components_t component, struct hash_table *ht)
 			LogFullDebug(component,
 				     "%s => %s; index=%" PRIu32 " rbt_hash=%"
 				     PRIu64, dispkey, dispval, index, rbt_hash);
-			RBT_INCREMENT(it);
 		}
-		PTHREAD_RWLOCK_unlock(&ht->partitions[i].lock);
+		PTHREAD_RWLOCK_unlock(&partition->lock);
 	}
 }
 
@@ -1062,9 +1454,13 @@ void hashtable_for_each(hash_table_t *ht, ht_for_each_cb_t callback, void *arg)
 	for (i = 0; i < ht->parameter.index_size; i++) {
 		head_rbt = &ht->partitions[i].rbt;
 		PTHREAD_RWLOCK_rdlock(&ht->partitions[i].lock);
-		RBT_LOOP(head_rbt, pn) {
-			callback(pn, arg);
-			RBT_INCREMENT(pn);
+		if (ht->parameter.flags & HT_FLAG_OPEN) {
+			open_for_each(&ht->partitions[i], callback, arg);
+		} else {
+			RBT_LOOP(head_rbt, pn) {
+				callback(RBT_OPAQ(pn), arg);
+				RBT_INCREMENT(pn);
+			}
 		}
 		PTHREAD_RWLOCK_unlock(&ht->partitions[i].lock);
 	}
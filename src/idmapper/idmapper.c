@@ -52,10 +52,36 @@
 #include "common_utils.h"
 #include "gsh_rpc.h"
 #include "nfs_core.h"
+#include "fridgethr.h"
 #include "idmapper.h"
 
 static struct gsh_buffdesc owner_domain;
 
+/**
+ * @brief Threads refreshing expired cache entries
+ */
+
+static struct fridgethr *idmapper_fridge;
+
+/**
+ * @brief Most threads refreshing expired cache entries at once
+ */
+
+#define IDMAPPER_REFRESH_THREADS 4
+
+/**
+ * @brief An expired cache entry to look up again
+ */
+
+struct idmapper_refresh {
+	bool group;		/*< A group, rather than a user */
+	bool by_name;		/*< The entry maps name to an ID */
+	uint32_t id;		/*< ID of an ID entry */
+	struct gsh_buffdesc name;	/*< Name of a name entry */
+};
+
+static void idmapper_refresh_job(struct fridgethr_context *ctx);
+
 /**
  * @brief Initialize the ID Mapper
  *
@@ -87,9 +113,185 @@ bool idmapper_init(void)
 	}
 
 	idmapper_cache_init();
+
+	if (idmapper_fridge == NULL) {
+		struct fridgethr_params frp;
+		int rc;
+
+		memset(&frp, 0, sizeof(struct fridgethr_params));
+		frp.thr_max = IDMAPPER_REFRESH_THREADS;
+		frp.deferment = fridgethr_defer_queue;
+
+		rc = fridgethr_init(&idmapper_fridge, "idmapper", &frp);
+		if (rc != 0) {
+			/* Expired entries will be looked up inline */
+			LogWarn(COMPONENT_IDMAPPER,
+				"Unable to initialize idmapper refresh fridge: %d",
+				rc);
+			idmapper_fridge = NULL;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Queue an expired cache entry to be looked up again
+ *
+ * @param[in] group True for a group, false for a user
+ * @param[in] name  Name of a name entry, NULL for an ID entry
+ * @param[in] id    ID of an ID entry
+ *
+ * @retval true if the entry will be refreshed in the background.
+ * @retval false if the caller must look it up itself.
+ */
+
+static bool idmapper_refresh(bool group, const struct gsh_buffdesc *name,
+			     uint32_t id)
+{
+	struct idmapper_refresh *req;
+	size_t len = name != NULL ? name->len : 0;
+	int rc;
+
+	if (idmapper_fridge == NULL)
+		return false;
+
+	req = gsh_malloc(sizeof(struct idmapper_refresh) + len);
+	req->group = group;
+	req->by_name = name != NULL;
+	req->id = id;
+	req->name.addr = (char *)req + sizeof(struct idmapper_refresh);
+	req->name.len = len;
+	if (len != 0)
+		memcpy(req->name.addr, name->addr, len);
+
+	rc = fridgethr_submit(idmapper_fridge, idmapper_refresh_job, req);
+	if (rc != 0) {
+		LogDebug(COMPONENT_IDMAPPER,
+			 "Unable to queue idmapper refresh: %d", rc);
+		gsh_free(req);
+		return false;
+	}
+
 	return true;
 }
 
+/**
+ * @brief Size of a buffer for the name of a UID or GID
+ *
+ * @param[in] group True if this is a GID, false for a UID
+ */
+
+static size_t id2name_size(bool group)
+{
+	long size;
+
+	if (!nfs_param.nfsv4_param.use_getpwnam)
+		return NFS4_MAX_DOMAIN_LEN + 2;
+
+	if (group)
+		size = sysconf(_SC_GETGR_R_SIZE_MAX);
+	else
+		size = sysconf(_SC_GETPW_R_SIZE_MAX);
+	if (size == -1)
+		size = PWENT_BEST_GUESS_LEN;
+
+	return size + owner_domain.len + 2;
+}
+
+/**
+ * @brief Look up the name of a UID or GID and cache it
+ *
+ * A lookup that fails is cached as a negative entry naming the ID
+ * numerically or as nobody.
+ *
+ * @param[in]     id    UID or GID
+ * @param[in]     group True if this is a GID, false for a UID
+ * @param[in,out] name  Buffer of id2name_size() bytes for the name
+ */
+
+static void id2name(uint32_t id, bool group, struct gsh_buffdesc *name)
+{
+	int rc;
+	bool looked_up = false;
+	char *namebuff = name->addr;
+
+	if (nfs_param.nfsv4_param.use_getpwnam) {
+		char *cursor;
+		bool nulled;
+		size_t len = id2name_size(group) - owner_domain.len - 2;
+
+		if (group) {
+			struct group g;
+			struct group *gres;
+
+			rc = getgrgid_r(id, &g, namebuff, len, &gres);
+			nulled = (gres == NULL);
+		} else {
+			struct passwd p;
+			struct passwd *pres;
+
+			rc = getpwuid_r(id, &p, namebuff, len, &pres);
+			nulled = (pres == NULL);
+		}
+
+		if ((rc == 0) && !nulled) {
+			name->len = strlen(namebuff);
+			cursor = namebuff + name->len;
+			*(cursor++) = '@';
+			++name->len;
+			memcpy(cursor, owner_domain.addr, owner_domain.len);
+			name->len += owner_domain.len;
+			looked_up = true;
+		} else {
+			LogInfo(COMPONENT_IDMAPPER,
+				"%s failed with code %d.",
+				(group ? "getgrgid_r" : "getpwuid_r"), rc);
+		}
+	} else {
+#ifdef USE_NFSIDMAP
+		if (group) {
+			rc = nfs4_gid_to_name(id, owner_domain.addr, namebuff,
+					      NFS4_MAX_DOMAIN_LEN + 1);
+		} else {
+			rc = nfs4_uid_to_name(id, owner_domain.addr, namebuff,
+					      NFS4_MAX_DOMAIN_LEN + 1);
+		}
+		if (rc == 0) {
+			name->len = strlen(namebuff);
+			looked_up = true;
+		} else {
+			LogInfo(COMPONENT_IDMAPPER,
+				"%s failed with code %d.",
+				(group ? "nfs4_gid_to_name" :
+				"nfs4_uid_to_name"), rc);
+		}
+#else				/* USE_NFSIDMAP */
+		looked_up = false;
+#endif				/* !USE_NFSIDMAP */
+	}
+
+	if (!looked_up) {
+		if (nfs_param.nfsv4_param.allow_numeric_owners) {
+			LogInfo(COMPONENT_IDMAPPER,
+				"Lookup for %d failed, using numeric %s",
+				id, (group ? "group" : "owner"));
+			/* 2**32 is 10 digits long in decimal */
+			sprintf(namebuff, "%"PRIu32, id);
+			name->len = strlen(namebuff);
+		} else {
+			LogInfo(COMPONENT_IDMAPPER,
+				"Lookup for %d failed, using nobody.", id);
+			memcpy(namebuff, "nobody", 6);
+			name->len = 6;
+		}
+	}
+
+	/* Add to the cache, a name that resolved maps back to the id. */
+	idmapper_add_id(group, id, name, !looked_up);
+	if (looked_up)
+		idmapper_add_name(group, name, id, NULL, false);
+}
+
 /**
  * @brief Encode a UID or GID as a string
  *
@@ -103,13 +305,14 @@ bool idmapper_init(void)
 
 static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 {
-	const struct gsh_buffdesc *found;
+	struct gsh_buffdesc name;
 	uint32_t not_a_size_t;
-	bool success = false;
+	enum idmapper_status status;
+	size_t size;
+	bool negative;
 
 	if (nfs_param.nfsv4_param.only_numeric_owners) {
 		/* 2**32 is 10 digits long in decimal */
-		struct gsh_buffdesc name;
 		char namebuf[11];
 
 		name.addr = namebuf;
@@ -120,146 +323,21 @@ static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
 					&not_a_size_t, UINT32_MAX);
 	}
 
-	PTHREAD_RWLOCK_rdlock(group ? &idmapper_group_lock :
-			      &idmapper_user_lock);
-	if (group)
-		success = idmapper_lookup_by_gid(id, &found);
-	else
-		success = idmapper_lookup_by_uid(id, &found, NULL);
-
-	if (likely(success)) {
-		not_a_size_t = found->len;
-
-		/* Fully qualified owners are always stored in the
-		   hash table, no matter what our lookup method. */
-		success =
-		    inline_xdr_bytes(xdrs, (char **)&found->addr, &not_a_size_t,
-				     UINT32_MAX);
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		return success;
-	} else {
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		int rc;
-		int size;
-		bool looked_up = false;
-		char *namebuff = NULL;
-		struct gsh_buffdesc new_name;
-
-		if (nfs_param.nfsv4_param.use_getpwnam) {
-			if (group)
-				size = sysconf(_SC_GETGR_R_SIZE_MAX);
-			else
-				size = sysconf(_SC_GETPW_R_SIZE_MAX);
-			if (size == -1)
-				size = PWENT_BEST_GUESS_LEN;
-			new_name.len = size;
-			size += owner_domain.len + 2;
-		} else {
-			size = NFS4_MAX_DOMAIN_LEN + 2;
-		}
-
-		namebuff = alloca(size);
-
-		new_name.addr = namebuff;
-
-		if (nfs_param.nfsv4_param.use_getpwnam) {
-			char *cursor;
-			bool nulled;
-
-			if (group) {
-				struct group g;
-				struct group *gres;
-
-				rc = getgrgid_r(id, &g, namebuff, new_name.len,
-						&gres);
-				nulled = (gres == NULL);
-			} else {
-				struct passwd p;
-				struct passwd *pres;
+	size = id2name_size(group);
+	name.addr = alloca(size);
 
-				rc = getpwuid_r(id, &p, namebuff, new_name.len,
-						&pres);
-				nulled = (pres == NULL);
-			}
+	status = idmapper_lookup_id(group, id, &name, size, &negative);
 
-			if ((rc == 0) && !nulled) {
-				new_name.len = strlen(namebuff);
-				cursor = namebuff + new_name.len;
-				*(cursor++) = '@';
-				++new_name.len;
-				memcpy(cursor, owner_domain.addr,
-				       owner_domain.len);
-				new_name.len += owner_domain.len;
-				looked_up = true;
-			} else {
-				LogInfo(COMPONENT_IDMAPPER,
-					"%s failed with code %d.",
-					(group ? "getgrgid_r" : "getpwuid_r"),
-					rc);
-			}
-		} else {
-#ifdef USE_NFSIDMAP
-			if (group) {
-				rc = nfs4_gid_to_name(id, owner_domain.addr,
-						      namebuff,
-						      NFS4_MAX_DOMAIN_LEN + 1);
-			} else {
-				rc = nfs4_uid_to_name(id, owner_domain.addr,
-						      namebuff,
-						      NFS4_MAX_DOMAIN_LEN + 1);
-			}
-			if (rc == 0) {
-				new_name.len = strlen(namebuff);
-				looked_up = true;
-			} else {
-				LogInfo(COMPONENT_IDMAPPER,
-					"%s failed with code %d.",
-					(group ? "nfs4_gid_to_name" :
-					"nfs4_uid_to_name"), rc);
-			}
-#else				/* USE_NFSIDMAP */
-			looked_up = false;
-#endif				/* !USE_NFSIDMAP */
-		}
+	/* An expired name is served while it is looked up again */
+	if (status == IDMAPPER_REFRESH && idmapper_refresh(group, NULL, id))
+		status = IDMAPPER_STALE;
 
-		if (!looked_up) {
-			if (nfs_param.nfsv4_param.allow_numeric_owners) {
-				LogInfo(COMPONENT_IDMAPPER,
-					"Lookup for %d failed, using numeric %s",
-					id, (group ? "group" : "owner"));
-				/* 2**32 is 10 digits long in decimal */
-				sprintf(namebuff, "%"PRIu32, id);
-				new_name.len = strlen(namebuff);
-			} else {
-				LogInfo(COMPONENT_IDMAPPER,
-					"Lookup for %d failed, using nobody.",
-					id);
-				memcpy(new_name.addr, "nobody", 6);
-				new_name.len = 6;
-			}
-		}
+	if (status == IDMAPPER_MISS || status == IDMAPPER_REFRESH)
+		id2name(id, group, &name);
 
-		/* Add to the cache and encode the result. */
-		PTHREAD_RWLOCK_wrlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		if (group)
-			success = idmapper_add_group(&new_name, id);
-		else
-			success = idmapper_add_user(&new_name, id, NULL, false);
-
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		if (unlikely(!success)) {
-			LogMajor(COMPONENT_IDMAPPER, "%s failed.",
-				 group ? "idmapper_add_group" :
-				 "idmaper_add_user");
-		}
-		not_a_size_t = new_name.len;
-		return inline_xdr_bytes(xdrs, (char **)&new_name.addr,
-					&not_a_size_t, UINT32_MAX);
-	}
+	not_a_size_t = name.len;
+	return inline_xdr_bytes(xdrs, (char **)&name.addr, &not_a_size_t,
+				UINT32_MAX);
 }
 
 /**
@@ -303,10 +381,15 @@ bool xdr_encode_nfs4_group(XDR *xdrs, gid_t gid)
  * @return true on success, false on just phoning it in.
  */
 
+static inline bool is_nobody(const char *name, size_t len)
+{
+	return (len == 6) && (!memcmp(name, "nobody", 6));
+}
+
 static bool atless2id(char *name, size_t len, uint32_t *id,
 		      const uint32_t anon)
 {
-	if ((len == 6) && (!memcmp(name, "nobody", 6))) {
+	if (is_nobody(name, len)) {
 		*id = anon;
 		return true;
 	} else if (nfs_param.nfsv4_param.allow_numeric_owners) {
@@ -506,6 +589,78 @@ static bool idmapname2id(char *name, size_t len, uint32_t *id,
 #endif				/* USE_NFSIDMAP */
 }
 
+/**
+ * @brief Look up the ID of a name and cache it
+ *
+ * A name that can't be mapped is cached as a negative entry, which
+ * maps to the anonymous ID of whichever export looks it up.
+ *
+ * @param[in]  name  The name of the user
+ * @param[out] id    The resulting id
+ * @param[in]  group True if this is a group name
+ * @param[in]  anon  ID to return if look up fails
+ *
+ * @return true if successful, false otherwise
+ */
+
+static bool name2id_lookup(const struct gsh_buffdesc *name, uint32_t *id,
+			   bool group, const uint32_t anon)
+{
+	gid_t gid;
+	bool got_gid = false;
+	/* Something we can mutate and count on as terminated */
+	char *namebuff = alloca(name->len + 1);
+	char *at;
+	bool looked_up = false;
+	bool nobody = false;
+
+	memcpy(namebuff, name->addr, name->len);
+	*(namebuff + name->len) = '\0';
+	at = memchr(namebuff, '@', name->len);
+
+	if (at == NULL) {
+		if (pwentname2id
+		    (namebuff, name->len, id, anon, group, &gid,
+		     &got_gid, NULL))
+			looked_up = true;
+		else if (is_nobody(namebuff, name->len))
+			nobody = true;
+		else if (atless2id(namebuff, name->len, id, anon))
+			looked_up = true;
+		else {
+			/* Nothing replaces an expired entry, let the next
+			 * caller try again.
+			 */
+			idmapper_refresh_failed(group, name);
+			return false;
+		}
+	} else if (nfs_param.nfsv4_param.use_getpwnam) {
+		looked_up =
+		    pwentname2id(namebuff, name->len, id, anon, group,
+				 &gid, &got_gid, at);
+	} else {
+		looked_up =
+		    idmapname2id(namebuff, name->len, id, anon, group,
+				 &gid, &got_gid, at);
+	}
+
+	if (!looked_up) {
+		if (!nobody)
+			LogInfo(COMPONENT_IDMAPPER,
+				"All lookups failed for %s, using anonymous.",
+				namebuff);
+		*id = anon;
+	}
+
+	/* Add to the cache, an id that resolved maps back to the name. */
+	idmapper_add_name(group, name, *id, got_gid ? &gid : NULL,
+			  !looked_up);
+	if (looked_up)
+		idmapper_add_id(group, *id, name, false);
+
+	return true;
+}
+
 /**
  * @brief Convert a name to an ID
  *
@@ -520,75 +675,47 @@ static bool idmapname2id(char *name, size_t len, uint32_t *id,
 static bool name2id(const struct gsh_buffdesc *name, uint32_t *id, bool group,
 		    const uint32_t anon)
 {
-	bool success;
+	enum idmapper_status status;
+	bool negative;
 
-	PTHREAD_RWLOCK_rdlock(group ? &idmapper_group_lock :
-			      &idmapper_user_lock);
-	if (group)
-		success = idmapper_lookup_by_gname(name, id);
-	else
-		success = idmapper_lookup_by_uname(name, id, NULL, false);
-	PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-			      &idmapper_user_lock);
+	status = idmapper_lookup_name(group, name, id, NULL, NULL, &negative);
 
-	if (success)
-		return true;
-	else {
-		gid_t gid;
-		bool got_gid = false;
-		/* Something we can mutate and count on as terminated */
-		char *namebuff = alloca(name->len + 1);
-		char *at;
-		bool looked_up = false;
-
-		memcpy(namebuff, name->addr, name->len);
-		*(namebuff + name->len) = '\0';
-		at = memchr(namebuff, '@', name->len);
-
-		if (at == NULL) {
-			if (pwentname2id
-			    (namebuff, name->len, id, anon, group, &gid,
-			     &got_gid, NULL))
-				looked_up = true;
-			else if (atless2id(namebuff, name->len, id, anon))
-				looked_up = true;
-			else
-				return false;
-		} else if (nfs_param.nfsv4_param.use_getpwnam) {
-			looked_up =
-			    pwentname2id(namebuff, name->len, id, anon, group,
-					 &gid, &got_gid, at);
-		} else {
-			looked_up =
-			    idmapname2id(namebuff, name->len, id, anon, group,
-					 &gid, &got_gid, at);
-		}
+	/* An expired id is served while it is looked up again */
+	if (status == IDMAPPER_REFRESH && idmapper_refresh(group, name, 0))
+		status = IDMAPPER_STALE;
 
-		if (!looked_up) {
-			LogInfo(COMPONENT_IDMAPPER,
-				"All lookups failed for %s, using anonymous.",
-				namebuff);
-			*id = anon;
-		}
+	if (status == IDMAPPER_MISS || status == IDMAPPER_REFRESH)
+		return name2id_lookup(name, id, group, anon);
 
-		PTHREAD_RWLOCK_wrlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		if (group)
-			success = idmapper_add_group(name, *id);
-		else
-			success =
-			    idmapper_add_user(name, *id, got_gid ? &gid : NULL,
-					      false);
+	if (negative)
+		*id = anon;
 
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
+	return true;
+}
 
-		if (!success)
-			LogMajor(COMPONENT_IDMAPPER, "%s(%s %u) failed",
-				 (group ? "gidmap_add" : "uidmap_add"),
-				 namebuff, *id);
-		return true;
+/**
+ * @brief Look up an expired cache entry again
+ *
+ * @param[in] ctx Thread context, holding the entry to refresh
+ */
+
+static void idmapper_refresh_job(struct fridgethr_context *ctx)
+{
+	struct idmapper_refresh *req = ctx->arg;
+
+	if (req->by_name) {
+		uint32_t id;
+
+		/* The anonymous id is only a placeholder in the cache */
+		(void) name2id_lookup(&req->name, &id, req->group, 0);
+	} else {
+		struct gsh_buffdesc name;
+
+		name.addr = alloca(id2name_size(req->group));
+		id2name(req->id, req->group, &name);
 	}
+
+	gsh_free(req);
 }
 
 /**
@@ -648,7 +775,8 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 #ifdef USE_NFSIDMAP
 	uid_t gss_uid = -1;
 	gid_t gss_gid = -1;
-	const gid_t *gss_gidres = NULL;
+	bool got_gid = false;
+	bool negative;
 	int rc;
 	bool success;
 	struct gsh_buffdesc princbuff = {
@@ -661,18 +789,13 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 		return false;
 
 #ifdef USE_NFSIDMAP
-	PTHREAD_RWLOCK_rdlock(&idmapper_user_lock);
-	success =
-	    idmapper_lookup_by_uname(&princbuff, &gss_uid, &gss_gidres, true);
-
 	/* We do need uid and gid. If gid is not in the cache, treat it as a
-	 * failure.
+	 * failure.  The credentials of the request are needed to map a
+	 * principal, so an expired one is looked up again inline.
 	 */
-	if (success && gss_gidres != NULL)
-		gss_gid = *gss_gidres;
-	else
-		success = false;
-	PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
+	success = idmapper_lookup_name(false, &princbuff, &gss_uid, &gss_gid,
+				       &got_gid, &negative) == IDMAPPER_HIT &&
+		  got_gid && !negative;
 	if (unlikely(!success)) {
 		if ((princbuff.len >= 4)
 		    && (!memcmp(princbuff.addr, "nfs/", 4)
@@ -770,16 +893,8 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
  principal_found:
 #endif
 
-		PTHREAD_RWLOCK_wrlock(&idmapper_user_lock);
-		success =
-		    idmapper_add_user(&princbuff, gss_uid, &gss_gid, true);
-		PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
-
-		if (!success) {
-			LogMajor(COMPONENT_IDMAPPER,
-				 "idmapper_add_user(%s, %d, %d) failed",
-				 principal, gss_uid, gss_gid);
-		}
+		idmapper_add_name(false, &princbuff, gss_uid, &gss_gid,
+				  false);
 	}
 
 	*uid = gss_uid;
@@ -44,98 +44,131 @@
 #include "idmapper.h"
 #include "nfs_core.h"
 #include "abstract_atomic.h"
+#include "city.h"
 
 /**
- * @brief User entry in the IDMapper cache
+ * @brief Entry in one of the IDMapper caches
+ *
+ * The same structure maps a user or group name to an ID, or an ID
+ * back to a name, depending on the cache it lives in.
  */
 
-struct cache_user {
-	struct gsh_buffdesc uname;	/*< Username */
-	uid_t uid;		/*< Corresponding UID */
-	gid_t gid;		/*< Corresponding GID */
+struct cache_entry {
+	struct avltree_node node_k;	/*< Node in the shard's tree */
+	struct gsh_buffdesc name;	/*< User or group name */
+	uint32_t id;		/*< Corresponding UID or GID */
+	gid_t gid;		/*< GID of a user looked up by name */
 	bool gid_set;		/*< if the GID has been set */
-	struct avltree_node uname_node;	/*< Node in the name tree */
-	struct avltree_node uid_node;	/*< Node in the UID tree */
-	bool in_uidtree;		/* true iff this is in uid_tree */
+	bool negative;		/*< The lookup failed, held for the
+				    negative cache expiration */
+	uint32_t refreshing;	/*< Callers that found it expired */
 	time_t epoch;
 };
 
-#define user_expired(user) (time(NULL) - (user)->epoch > \
-		nfs_param.core_param.manage_gids_expiration)
+/**
+ * @brief Number of shards of each cache, should be prime.
+ */
+
+#define IDMAPPER_SHARDS 17
 
 /**
- * @brief Group entry in the IDMapper cache
+ * @brief Number of front cache slots in an ID shard, should be prime.
  */
 
-struct cache_group {
-	struct gsh_buffdesc gname;	/*< Group name */
-	gid_t gid;		/*< Group ID */
-	struct avltree_node gname_node;	/*< Node in the name tree */
-	struct avltree_node gid_node;	/*< Node in the GID tree */
-	time_t epoch;
+#define id_cache_size 61
+
+/**
+ * @brief One shard of a cache
+ *
+ * The front cache is only used by the ID caches.  If the lock is held
+ * for read, it must be accessed atomically.  (For a write, normal
+ * fetch/store is sufficient since others are kept out.)
+ */
+
+struct cache_shard {
+	pthread_rwlock_t lock;	/*< Protects the tree and front cache */
+	struct avltree t;	/*< Entries, by name or by ID */
+	struct avltree_node *cache[id_cache_size];
 };
 
-#define group_expired(group) (time(NULL) - (group)->epoch > \
-		nfs_param.core_param.manage_gids_expiration)
+struct cache_map {
+	bool by_name;		/*< Keyed by name, rather than by ID */
+	struct cache_shard shards[IDMAPPER_SHARDS];
+};
 
 /**
- * @brief Number of entires in the UID cache, should be prime.
+ * @brief Slots of each per-thread ID cache
  */
 
-#define id_cache_size 1009
+#define IDMAPPER_TCACHE_SLOTS 64
 
 /**
- * @brief UID cache, may only be accessed with idmapper_user_lock
- * held.  If idmapper_user_lock is held for read, it must be accessed
- * atomically.  (For a write, normal fetch/store is sufficient since
- * others are kept out.)
+ * @brief Longest name kept in a per-thread ID cache
  */
 
-static struct avltree_node *uid_cache[id_cache_size];
+#define IDMAPPER_TCACHE_NAME 64
 
 /**
- * @brief GID cache, may only be accessed with idmapper_group_lock
- * held.  If idmapper_group_lock is held for read, it must be accessed
- * atomically.  (For a write, normal fetch/store is sufficient since
- * others are kept out.)
+ * @brief A name cached by a thread
  */
 
-static struct avltree_node *gid_cache[id_cache_size];
+struct tcache_slot {
+	uint32_t id;
+	bool valid;
+	bool negative;
+	uint8_t len;
+	time_t expire;		/*< Past this, ask the shared cache */
+	char name[IDMAPPER_TCACHE_NAME];
+};
 
 /**
- * @brief Lock that protects the idmapper user cache
+ * @brief Per-thread, direct mapped, front of an ID cache
+ *
+ * Encoding OWNER and OWNER_GROUP of each entry of a READDIR would take
+ * a shard lock twice per entry.  Each thread keeps the names it got
+ * instead, valid as long as the global generation hasn't moved.
  */
 
-pthread_rwlock_t idmapper_user_lock = PTHREAD_RWLOCK_INITIALIZER;
+struct tcache {
+	uint64_t generation;	/*< idmapper_generation the slots match */
+	struct tcache_slot slot[IDMAPPER_TCACHE_SLOTS];
+};
 
 /**
- * @brief Lock that protects the idmapper group cache
+ * @brief Bumped whenever an ID stops mapping to the name it had
+ *
+ * Adding an ID that wasn't cached doesn't bump it, the per-thread
+ * caches only hold IDs that were found.
  */
 
-pthread_rwlock_t idmapper_group_lock = PTHREAD_RWLOCK_INITIALIZER;
+static uint64_t idmapper_generation;
+
+static __thread struct tcache uid_tcache;
+static __thread struct tcache gid_tcache;
 
 /**
- * @brief Tree of users, by name
+ * @brief Users by name, so a user can be found by name
  */
 
-static struct avltree uname_tree;
+static struct cache_map uname_map = { .by_name = true };
 
 /**
- * @brief Tree of users, by ID
+ * @brief Users by ID
  */
 
-static struct avltree uid_tree;
+static struct cache_map uid_map;
 
 /**
- * @brief Tree of groups, by name
+ * @brief Groups by name
  */
-static struct avltree gname_tree;
+
+static struct cache_map gname_map = { .by_name = true };
 
 /**
- * @brief Tree of groups, by ID
+ * @brief Groups by ID
  */
 
-static struct avltree gid_tree;
+static struct cache_map gid_map;
 
 /**
  * @brief Compare two buffers
@@ -169,7 +202,7 @@ static inline int buffdesc_comparator(const struct gsh_buffdesc *buffa,
 }
 
 /**
- * @brief Comparison for user names
+ * @brief Comparison for names
  *
  * @param[in] node1 A node
  * @param[in] nodea Another node
@@ -179,21 +212,19 @@ static inline int buffdesc_comparator(const struct gsh_buffdesc *buffa,
  * @retval 1 if node1 is greater than nodea
  */
 
-static int uname_comparator(const struct avltree_node *node1,
-			    const struct avltree_node *nodea)
+static int name_comparator(const struct avltree_node *node1,
+			   const struct avltree_node *nodea)
 {
-	struct cache_user *user1 =
-	    avltree_container_of(node1, struct cache_user,
-				 uname_node);
-	struct cache_user *usera =
-	    avltree_container_of(nodea, struct cache_user,
-				 uname_node);
-
-	return buffdesc_comparator(&user1->uname, &usera->uname);
+	struct cache_entry *entry1 =
+	    avltree_container_of(node1, struct cache_entry, node_k);
+	struct cache_entry *entrya =
+	    avltree_container_of(nodea, struct cache_entry, node_k);
+
+	return buffdesc_comparator(&entry1->name, &entrya->name);
 }
 
 /**
- * @brief Comparison for UIDs
+ * @brief Comparison for IDs
  *
  * @param[in] node1 A node
  * @param[in] nodea Another node
@@ -203,75 +234,96 @@ static int uname_comparator(const struct avltree_node *node1,
  * @retval 1 if node1 is greater than nodea
  */
 
-static int uid_comparator(const struct avltree_node *node1,
-			  const struct avltree_node *nodea)
+static int id_comparator(const struct avltree_node *node1,
+			 const struct avltree_node *nodea)
 {
-	struct cache_user *user1 =
-	    avltree_container_of(node1, struct cache_user,
-				 uid_node);
-	struct cache_user *usera =
-	    avltree_container_of(nodea, struct cache_user,
-				 uid_node);
-
-	if (user1->uid < usera->uid)
+	struct cache_entry *entry1 =
+	    avltree_container_of(node1, struct cache_entry, node_k);
+	struct cache_entry *entrya =
+	    avltree_container_of(nodea, struct cache_entry, node_k);
+
+	if (entry1->id < entrya->id)
 		return -1;
-	else if (user1->uid > usera->uid)
+	else if (entry1->id > entrya->id)
 		return 1;
 	else
 		return 0;
 }
 
-/**
- * @brief Comparison for group names
- *
- * @param[in] node1 A node
- * @param[in] nodea Another node
- *
- * @retval -1 if node1 is less than nodea
- * @retval 0 if node1 and nodea are equal
- * @retval 1 if node1 is greater than nodea
- */
+static inline struct cache_shard *name_shard(struct cache_map *map,
+					     const struct gsh_buffdesc *name)
+{
+	return &map->shards[CityHash64(name->addr, name->len) %
+			    IDMAPPER_SHARDS];
+}
+
+static inline struct cache_shard *id_shard(struct cache_map *map,
+					   uint32_t id)
+{
+	return &map->shards[id % IDMAPPER_SHARDS];
+}
 
-static inline int gname_comparator(const struct avltree_node *node1,
-				   const struct avltree_node *nodea)
+static inline void **id_cache_slot(struct cache_shard *shard, uint32_t id)
 {
-	struct cache_group *group1 =
-	    avltree_container_of(node1, struct cache_group,
-				 gname_node);
-	struct cache_group *groupa =
-	    avltree_container_of(nodea, struct cache_group,
-				 gname_node);
-
-	return buffdesc_comparator(&group1->gname, &groupa->gname);
+	return (void **)&shard->cache[(id / IDMAPPER_SHARDS) % id_cache_size];
 }
 
 /**
- * @brief Comparison for GIDs
+ * @brief Check whether an entry may still be served
  *
- * @param[in] node1 A node
- * @param[in] nodea Another node
+ * An expired entry is handed out for refresh to the first caller to
+ * find it, later callers are told it is stale and may keep serving it
+ * until the refresh replaces it.
  *
- * @retval -1 if node1 is less than nodea
- * @retval 0 if node1 and nodea are equal
- * @retval 1 if node1 is greater than nodea
+ * @note The caller must hold the shard lock.
  */
 
-static int gid_comparator(const struct avltree_node *node1,
-			  const struct avltree_node *nodea)
+static enum idmapper_status cache_entry_status(struct cache_entry *entry)
 {
-	struct cache_group *group1 =
-	    avltree_container_of(node1, struct cache_group,
-				 gid_node);
-	struct cache_group *groupa =
-	    avltree_container_of(nodea, struct cache_group,
-				 gid_node);
-
-	if (group1->gid < groupa->gid)
-		return -1;
-	else if (group1->gid > groupa->gid)
-		return 1;
-	else
-		return 0;
+	time_t expiration = entry->negative ?
+		nfs_param.core_param.negative_cache_expiration :
+		nfs_param.core_param.manage_gids_expiration;
+
+	if (time(NULL) - entry->epoch <= expiration)
+		return IDMAPPER_HIT;
+
+	if (atomic_inc_uint32_t(&entry->refreshing) == 1)
+		return IDMAPPER_REFRESH;
+
+	return IDMAPPER_STALE;
+}
+
+static struct cache_entry *cache_entry_alloc(const struct gsh_buffdesc *name,
+					     uint32_t id, bool negative)
+{
+	struct cache_entry *new;
+
+	new = gsh_malloc(sizeof(struct cache_entry) + name->len);
+	new->epoch = time(NULL);
+	new->name.addr = (char *)new + sizeof(struct cache_entry);
+	new->name.len = name->len;
+	new->id = id;
+	memcpy(new->name.addr, name->addr, name->len);
+	new->gid = -1;
+	new->gid_set = false;
+	new->negative = negative;
+	new->refreshing = 0;
+
+	return new;
+}
+
+static void cache_shard_init(struct cache_map *map)
+{
+	int i;
+
+	for (i = 0; i < IDMAPPER_SHARDS; i++) {
+		struct cache_shard *shard = &map->shards[i];
+
+		PTHREAD_RWLOCK_init(&shard->lock, NULL);
+		avltree_init(&shard->t, map->by_name ? name_comparator :
+						       id_comparator, 0);
+		memset(shard->cache, 0, sizeof(shard->cache));
+	}
 }
 
 /**
@@ -280,444 +332,400 @@ static int gid_comparator(const struct avltree_node *node1,
 
 void idmapper_cache_init(void)
 {
-	avltree_init(&uname_tree, uname_comparator, 0);
-	avltree_init(&uid_tree, uid_comparator, 0);
-	memset(uid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
-
-	avltree_init(&gname_tree, gname_comparator, 0);
-	avltree_init(&gid_tree, gid_comparator, 0);
-	memset(gid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
+	cache_shard_init(&uname_map);
+	cache_shard_init(&uid_map);
+	cache_shard_init(&gname_map);
+	cache_shard_init(&gid_map);
 }
 
 /**
- * @brief Add a user entry to the cache
- *
- * @note The caller must hold idmapper_user_lock for write.
+ * @brief Drop the entry mapping an ID, if it maps it to name
  *
- * @param[in] name The user name
- * @param[in] uid  The user ID
- * @param[in] gid  Optional.  Set to NULL if no gid is known.
- * @param[in] gss_princ true when name is gss principal.
- *                      The uid to name map is not added for gss principals.
- *
- * @retval true on success.
- * @retval false if our reach exceeds our grasp.
+ * Used when a name is found to have changed ID, so the reverse
+ * mapping does not outlive it.
  */
 
-bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
-		       const gid_t *gid, bool gss_princ)
+static void cache_forget_id(struct cache_map *map, uint32_t id,
+			    const struct gsh_buffdesc *name)
 {
-	struct avltree_node *found_name;
-	struct avltree_node *found_id;
-	struct cache_user *old;
-	struct cache_user *new;
-
-	new = gsh_malloc(sizeof(struct cache_user) + name->len);
-	new->epoch = time(NULL);
-	new->uname.addr = (char *)new + sizeof(struct cache_user);
-	new->uname.len = name->len;
-	new->uid = uid;
-	memcpy(new->uname.addr, name->addr, name->len);
-	if (gid) {
-		new->gid = *gid;
-		new->gid_set = true;
-	} else {
-		new->gid = -1;
-		new->gid_set = false;
+	struct cache_shard *shard = id_shard(map, id);
+	struct cache_entry prototype = {
+		.id = id
+	};
+	struct avltree_node *node;
+	struct cache_entry *old = NULL;
+	void **cache_slot = id_cache_slot(shard, id);
+
+	PTHREAD_RWLOCK_wrlock(&shard->lock);
+	node = avltree_lookup(&prototype.node_k, &shard->t);
+	if (node != NULL) {
+		old = avltree_container_of(node, struct cache_entry, node_k);
+		if (old->negative ||
+		    buffdesc_comparator(&old->name, name) != 0) {
+			old = NULL;
+		} else {
+			if (*cache_slot == node)
+				*cache_slot = NULL;
+			avltree_remove(node, &shard->t);
+		}
 	}
-	new->in_uidtree = (gss_princ) ? false : true;
+	PTHREAD_RWLOCK_unlock(&shard->lock);
 
-	/*
-	 * There are 3 cases why we find an existing cache entry.
-	 *
-	 * Case 1:
-	 * The threads that lookup by-name or by-id use the read lock.
-	 * If they don't find an entry, then they release the read lock,
-	 * acquire the write lock and then add the entry. So it is
-	 * possible that multiple threads may fail to find an entry at
-	 * one point and they all try to add. In this case, we will be
-	 * trying to insert same name,id mapping.
-	 *
-	 * Case 2:
-	 * It is also possible that name got a different id or an id got
-	 * a different name causing us to find an existing entry when we
-	 * are trying to add an entry. This case calls for removing the
-	 * stale entry and update with this new entry.
-	 *
-	 * Case 3:
-	 * The username to id mapping could be from plain nfs idmapping
-	 * in which case we will not have a valid gid. If this is for a
-	 * kerberos principal mapping, we will have uid and gid but we
-	 * will not have "uid to name" cache entry (the reverse
-	 * mapping). This case requires us to combine the old entry and
-	 * the new entry!
-	 *
-	 * Note that the 3rd case happens if and only if IDMAPD_DOMAIN
-	 * and LOCAL_REALMS are set to the same value!
-	 */
-	found_name = avltree_insert(&new->uname_node, &uname_tree);
-	if (unlikely(found_name)) {
-		old = avltree_container_of(found_name, struct cache_user,
-					   uname_node);
-		/* Combine old into new if uid's match */
-		if (old->uid == new->uid) {
-			if (!new->gid_set && old->gid_set) {
-				new->gid = old->gid;
-				new->gid_set = true;
-			}
-			if (!new->in_uidtree && old->in_uidtree)
-				new->in_uidtree = true;
-		}
+	if (old != NULL)
+		(void) atomic_inc_uint64_t(&idmapper_generation);
+	gsh_free(old);
+}
 
-		/* Remove the old and insert the new */
-		avltree_remove(found_name, &uname_tree);
-		if (old->in_uidtree) {
-			uid_cache[old->uid % id_cache_size] = NULL;
-			avltree_remove(&old->uid_node, &uid_tree);
-		}
-		gsh_free(old);
-		found_name = avltree_insert(&new->uname_node, &uname_tree);
-		assert(found_name == NULL);
-	}
+/**
+ * @brief Drop the entry mapping a name, if it maps it to id
+ *
+ * Used when an ID is found to have changed name.
+ */
 
-	if (!new->in_uidtree) /* all done */
-		return true;
-
-	found_id = avltree_insert(&new->uid_node, &uid_tree);
-	if (unlikely(found_id)) {
-		old = avltree_container_of(found_id, struct cache_user,
-					   uid_node);
-		uid_cache[old->uid % id_cache_size] = NULL;
-		avltree_remove(found_id, &uid_tree);
-		avltree_remove(&old->uname_node, &uname_tree);
-		gsh_free(old);
-		found_id = avltree_insert(&new->uid_node, &uid_tree);
-		assert(found_id == NULL);
+static void cache_forget_name(struct cache_map *map,
+			      const struct gsh_buffdesc *name, uint32_t id)
+{
+	struct cache_shard *shard = name_shard(map, name);
+	struct cache_entry prototype = {
+		.name = *name
+	};
+	struct avltree_node *node;
+	struct cache_entry *old = NULL;
+
+	PTHREAD_RWLOCK_wrlock(&shard->lock);
+	node = avltree_lookup(&prototype.node_k, &shard->t);
+	if (node != NULL) {
+		old = avltree_container_of(node, struct cache_entry, node_k);
+		if (old->negative || old->id != id)
+			old = NULL;
+		else
+			avltree_remove(node, &shard->t);
 	}
-	uid_cache[uid % id_cache_size] = &new->uid_node;
+	PTHREAD_RWLOCK_unlock(&shard->lock);
 
-	return true;
+	gsh_free(old);
 }
 
 /**
- * @brief Add a group entry to the cache
- *
- * @note The caller must hold idmapper_group_lock for write.
+ * @brief Add a name to ID entry to the cache
  *
- * @param[in] name The user name
- * @param[in] gid  The group id
- *
- * @retval true on success.
- * @retval false if our reach exceeds our grasp.
+ * @param[in] group    true for a group name, false for a user name
+ * @param[in] name     The user or group name
+ * @param[in] id       The user or group ID
+ * @param[in] gid      Optional.  Set to NULL if no gid is known.
+ * @param[in] negative The lookup failed, id is only a placeholder
  */
 
-bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid)
+void idmapper_add_name(bool group, const struct gsh_buffdesc *name,
+		       uint32_t id, const gid_t *gid, bool negative)
 {
-	struct avltree_node *found_name;
-	struct avltree_node *found_id;
-	struct cache_group *tmp;
-	struct cache_group *new;
+	struct cache_map *map = group ? &gname_map : &uname_map;
+	struct cache_shard *shard = name_shard(map, name);
+	struct avltree_node *found;
+	struct cache_entry *old = NULL;
+	struct cache_entry *new;
 
-	new = gsh_malloc(sizeof(struct cache_group) + name->len);
-	new->epoch = time(NULL);
-	new->gname.addr = (char *)new + sizeof(struct cache_group);
-	new->gname.len = name->len;
-	new->gid = gid;
-	memcpy(new->gname.addr, name->addr, name->len);
+	new = cache_entry_alloc(name, id, negative);
+	if (gid) {
+		new->gid = *gid;
+		new->gid_set = true;
+	}
+
+	PTHREAD_RWLOCK_wrlock(&shard->lock);
 
 	/*
-	 * The threads that lookup by-name or by-id use the read lock. If
-	 * they don't find an entry, then they release the read lock,
-	 * acquire the write lock and then add the entry. So it is
-	 * possible that multiple threads may fail to find an entry at
-	 * one point and they all try to add. In this case, we will be
-	 * trying to insert same name,id mapping. It is also possible
-	 * that name got a different id or an id got a different name
-	 * causing us to find an existing entry when we are trying to
-	 * add an entry!
+	 * Several threads may miss the same name and all add it, or the
+	 * name may have got a different id.  Either way the new entry
+	 * replaces the old one.
 	 *
-	 * If we find an existing entry, we remove it from both the name
-	 * and the id AVL trees, and then add the new entry.
+	 * A name may also be added by plain nfs idmapping without a gid,
+	 * after a kerberos principal mapping (which has one) was added
+	 * for it, when IDMAPD_DOMAIN and LOCAL_REALMS are set to the
+	 * same value.  Keep the gid in that case.
 	 */
-	found_name = avltree_insert(&new->gname_node, &gname_tree);
-	if (unlikely(found_name)) {
-		tmp = avltree_container_of(found_name, struct cache_group,
-					   gname_node);
-		avltree_remove(found_name, &gname_tree);
-		avltree_remove(&tmp->gid_node, &gid_tree);
-		gid_cache[tmp->gid % id_cache_size] = NULL;
-		gsh_free(tmp);
-		found_name = avltree_insert(&new->gname_node, &gname_tree);
-		assert(found_name == NULL);
-	}
+	found = avltree_insert(&new->node_k, &shard->t);
+	if (unlikely(found)) {
+		old = avltree_container_of(found, struct cache_entry, node_k);
+		if (!negative && !old->negative && old->id == new->id) {
+			if (!new->gid_set && old->gid_set) {
+				new->gid = old->gid;
+				new->gid_set = true;
+			}
+		}
 
-	found_id = avltree_insert(&new->gid_node, &gid_tree);
-	if (unlikely(found_id)) {
-		tmp = avltree_container_of(found_id, struct cache_group,
-					   gid_node);
-
-		gid_cache[tmp->gid % id_cache_size] = NULL;
-		avltree_remove(found_id, &gid_tree);
-		avltree_remove(&tmp->gname_node, &gname_tree);
-		gsh_free(tmp);
-		found_id = avltree_insert(&new->gid_node, &gid_tree);
-		assert(found_id == NULL);
+		avltree_remove(found, &shard->t);
+		found = avltree_insert(&new->node_k, &shard->t);
+		assert(found == NULL);
 	}
-	gid_cache[gid % id_cache_size] = &new->gid_node;
 
-	return true;
+	PTHREAD_RWLOCK_unlock(&shard->lock);
+
+	if (old == NULL)
+		return;
+
+	if (!old->negative && (negative || old->id != id))
+		cache_forget_id(group ? &gid_map : &uid_map, old->id,
+				&old->name);
+	gsh_free(old);
 }
 
 /**
- * @brief Look up a user by name
- *
- * @note The caller must hold idmapper_user_lock for read.
+ * @brief Add an ID to name entry to the cache
  *
- * @param[in]  name The user name to look up.
- * @param[out] uid  The user ID found.  May be NULL if the caller
- *                  isn't interested in the UID.  (This seems
- *                  unlikely.)
- * @param[out] gid  The GID for the user, or NULL if there is
- *                  none. The caller may specify NULL if it isn't
- *                  interested.
- *
- * @retval true on success.
- * @retval false if we need to try, try again.
+ * @param[in] group    true for a GID, false for a UID
+ * @param[in] id       The user or group ID
+ * @param[in] name     The user or group name
+ * @param[in] negative The lookup failed, name is only a placeholder
  */
 
-bool idmapper_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
-			      const gid_t **gid, bool gss_princ)
+void idmapper_add_id(bool group, uint32_t id, const struct gsh_buffdesc *name,
+		     bool negative)
 {
-	struct cache_user prototype = {
-		.uname = *name
-	};
-	struct avltree_node *found_node = avltree_lookup(&prototype.uname_node,
-							 &uname_tree);
-	struct cache_user *found_user;
-	void **cache_slot;
-
-	if (unlikely(!found_node))
-		return false;
-
-	found_user =
-	    avltree_container_of(found_node, struct cache_user, uname_node);
-	if (!gss_princ) {
-		/* I assume that if someone likes this user enough to look it
-		   up by name, they'll like it enough to look it up by ID
-		   later.
-
-		   If the name is gss principal it does not have entry
-		   in uid tree */
-
-		cache_slot = (void **)
-			&uid_cache[found_user->uid % id_cache_size];
-		atomic_store_voidptr(cache_slot, &found_user->uid_node);
+	struct cache_map *map = group ? &gid_map : &uid_map;
+	struct cache_shard *shard = id_shard(map, id);
+	struct avltree_node *found;
+	struct cache_entry *old = NULL;
+	struct cache_entry *new;
+
+	new = cache_entry_alloc(name, id, negative);
+
+	PTHREAD_RWLOCK_wrlock(&shard->lock);
+
+	found = avltree_insert(&new->node_k, &shard->t);
+	if (unlikely(found)) {
+		old = avltree_container_of(found, struct cache_entry, node_k);
+		avltree_remove(found, &shard->t);
+		found = avltree_insert(&new->node_k, &shard->t);
+		assert(found == NULL);
 	}
+	*id_cache_slot(shard, id) = &new->node_k;
 
-	if (likely(uid))
-		*uid = found_user->uid;
+	PTHREAD_RWLOCK_unlock(&shard->lock);
 
-	if (unlikely(gid))
-		*gid = (found_user->gid_set ? &found_user->gid : NULL);
+	if (old == NULL)
+		return;
 
-	return user_expired(found_user) ? false : true;
+	(void) atomic_inc_uint64_t(&idmapper_generation);
+
+	if (!old->negative &&
+	    (negative || buffdesc_comparator(&old->name, name) != 0))
+		cache_forget_name(group ? &gname_map : &uname_map,
+				  &old->name, id);
+	gsh_free(old);
 }
 
 /**
- * @brief Look up a user by ID
- *
- * @note The caller must hold idmapper_user_lock for read.
+ * @brief Look up a user or group by name
  *
- * @param[in]  uid  The user ID to look up.
- * @param[out] name The user name to look up. (May be NULL if the user
- *                  doesn't care about the name.)
- * @param[out] gid  The GID for the user, or NULL if there is
- *                  none. The caller may specify NULL if it isn't
- *                  interested.
+ * @param[in]  group    true for a group name, false for a user name
+ * @param[in]  name     The name to look up.
+ * @param[out] id       The ID found.
+ * @param[out] gid      The GID for the user, if got_gid is set.  May be
+ *                      NULL if the caller isn't interested.
+ * @param[out] got_gid  Whether there is a GID for the user.
+ * @param[out] negative The lookup failed when the entry was added.
  *
- * @retval true on success.
- * @retval false if we weren't so successful.
+ * @return Whether and how the entry may be used.
  */
 
-bool idmapper_lookup_by_uid(const uid_t uid, const struct gsh_buffdesc **name,
-			    const gid_t **gid)
+enum idmapper_status idmapper_lookup_name(bool group,
+					  const struct gsh_buffdesc *name,
+					  uint32_t *id, gid_t *gid,
+					  bool *got_gid, bool *negative)
 {
-	struct cache_user prototype = {
-		.uid = uid
+	struct cache_map *map = group ? &gname_map : &uname_map;
+	struct cache_shard *shard = name_shard(map, name);
+	struct cache_entry prototype = {
+		.name = *name
 	};
-	void **cache_slot = (void **)&uid_cache[uid % id_cache_size];
-	struct avltree_node *found_node = atomic_fetch_voidptr(cache_slot);
-	struct cache_user *found_user;
-	bool found = false;
+	struct avltree_node *found_node;
+	struct cache_entry *found;
+	enum idmapper_status status;
 
-	if (likely(found_node)) {
-		found_user = avltree_container_of(found_node,
-						  struct cache_user,
-						  uid_node);
-		if (found_user->uid == uid)
-			found = true;
+	PTHREAD_RWLOCK_rdlock(&shard->lock);
+
+	found_node = avltree_lookup(&prototype.node_k, &shard->t);
+	if (unlikely(!found_node)) {
+		PTHREAD_RWLOCK_unlock(&shard->lock);
+		return IDMAPPER_MISS;
 	}
 
-	if (unlikely(!found)) {
-		found_node = avltree_lookup(&prototype.uid_node, &uid_tree);
-		if (unlikely(!found_node))
-			return false;
+	found = avltree_container_of(found_node, struct cache_entry, node_k);
 
-		atomic_store_voidptr(cache_slot, found_node);
-		found_user = avltree_container_of(found_node,
-						  struct cache_user,
-						  uid_node);
+	*id = found->id;
+	*negative = found->negative;
+	if (gid) {
+		*gid = found->gid;
+		*got_gid = found->gid_set;
 	}
+	status = cache_entry_status(found);
 
-	if (likely(name))
-		*name = &found_user->uname;
-
-	if (gid)
-		*gid = (found_user->gid_set ? &found_user->gid : NULL);
+	PTHREAD_RWLOCK_unlock(&shard->lock);
 
-	return user_expired(found_user) ? false : true;
+	return status;
 }
 
 /**
- * @brief Lookup a group by name
+ * @brief Let an expired name entry be refreshed again
  *
- * @note The caller must hold idmapper_group_lock for read.
+ * Called when looking the name up again failed without replacing the
+ * entry, so that the next caller to find it gets IDMAPPER_REFRESH
+ * rather than IDMAPPER_STALE.
  *
- * @param[in]  name The user name to look up.
- * @param[out] gid  The group ID found.  May be NULL if the caller
- *                  isn't interested in the GID.  (This seems
- *                  unlikely, since you can't get anything else from
- *                  this function.)
- *
- * @retval true on success.
- * @retval false if we need to try, try again.
+ * @param[in] group  true for a group name, false for a user name
+ * @param[in] name   The name that failed
  */
 
-bool idmapper_lookup_by_gname(const struct gsh_buffdesc *name, uid_t *gid)
+void idmapper_refresh_failed(bool group, const struct gsh_buffdesc *name)
 {
-	struct cache_group prototype = {
-		.gname = *name
+	struct cache_map *map = group ? &gname_map : &uname_map;
+	struct cache_shard *shard = name_shard(map, name);
+	struct cache_entry prototype = {
+		.name = *name
 	};
-	struct avltree_node *found_node = avltree_lookup(&prototype.gname_node,
-							 &gname_tree);
-	struct cache_group *found_group;
-	void **cache_slot;
-
-	if (unlikely(!found_node))
-		return false;
+	struct avltree_node *found_node;
+	struct cache_entry *found;
 
-	found_group =
-	    avltree_container_of(found_node, struct cache_group, gname_node);
+	PTHREAD_RWLOCK_rdlock(&shard->lock);
 
-	/* I assume that if someone likes this group enough to look it
-	   up by name, they'll like it enough to look it up by ID
-	   later. */
-
-	cache_slot = (void **)&gid_cache[found_group->gid % id_cache_size];
-	atomic_store_voidptr(cache_slot, &found_group->gid_node);
-
-	if (likely(gid))
-		*gid = found_group->gid;
-	else
-		LogDebug(COMPONENT_IDMAPPER, "Caller is being weird.");
+	found_node = avltree_lookup(&prototype.node_k, &shard->t);
+	if (found_node != NULL) {
+		found = avltree_container_of(found_node, struct cache_entry,
+					     node_k);
+		atomic_store_uint32_t(&found->refreshing, 0);
+	}
 
-	return group_expired(found_group) ? false : true;
+	PTHREAD_RWLOCK_unlock(&shard->lock);
 }
 
 /**
- * @brief Look up a group by ID
+ * @brief Look up a user or group by ID
  *
- * @note The caller must hold idmapper_group_lock for read.
+ * @param[in]     group    true for a GID, false for a UID
+ * @param[in]     id       The ID to look up.
+ * @param[in,out] name     Buffer the name found is copied to
+ * @param[in]     size     Size of the buffer
+ * @param[out]    negative The lookup failed when the entry was added.
  *
- * @param[in]  gid  The group ID to look up.
- * @param[out] name The user name to look up. (May be NULL if the user
- *                  doesn't care about the name, which would be weird.)
+ * Current entries are also kept in the calling thread's cache, and
+ * served from there without a lock until they expire or some ID
+ * changes name.
  *
- * @retval true on success.
- * @retval false if we're most unfortunate.
+ * @return Whether and how the entry may be used.  A name too long for
+ *         the buffer is a miss.
  */
 
-bool idmapper_lookup_by_gid(const gid_t gid, const struct gsh_buffdesc **name)
+enum idmapper_status idmapper_lookup_id(bool group, uint32_t id,
+					struct gsh_buffdesc *name,
+					size_t size, bool *negative)
 {
-	struct cache_group prototype = {
-		.gid = gid
+	struct cache_map *map = group ? &gid_map : &uid_map;
+	struct cache_shard *shard = id_shard(map, id);
+	struct cache_entry prototype = {
+		.id = id
 	};
-	void **cache_slot = (void **)&gid_cache[gid % id_cache_size];
-	struct avltree_node *found_node = atomic_fetch_voidptr(cache_slot);
-	struct cache_group *found_group;
-	bool found = false;
+	void **cache_slot = id_cache_slot(shard, id);
+	struct avltree_node *found_node;
+	struct cache_entry *found = NULL;
+	enum idmapper_status status = IDMAPPER_MISS;
+	struct tcache *tc = group ? &gid_tcache : &uid_tcache;
+	struct tcache_slot *ts = &tc->slot[id % IDMAPPER_TCACHE_SLOTS];
+	uint64_t generation = atomic_fetch_uint64_t(&idmapper_generation);
+
+	if (unlikely(tc->generation != generation)) {
+		memset(tc->slot, 0, sizeof(tc->slot));
+		tc->generation = generation;
+	} else if (ts->valid && ts->id == id && ts->len <= size &&
+		   time(NULL) <= ts->expire) {
+		memcpy(name->addr, ts->name, ts->len);
+		name->len = ts->len;
+		*negative = ts->negative;
+		return IDMAPPER_HIT;
+	}
 
+	PTHREAD_RWLOCK_rdlock(&shard->lock);
+
+	found_node = atomic_fetch_voidptr(cache_slot);
 	if (likely(found_node)) {
-		found_group = avltree_container_of(found_node,
-						   struct cache_group,
-						   gid_node);
-		if (found_group->gid == gid)
-			found = true;
+		found = avltree_container_of(found_node, struct cache_entry,
+					     node_k);
+		if (found->id != id)
+			found = NULL;
 	}
 
 	if (unlikely(!found)) {
-		found_node = avltree_lookup(&prototype.gid_node, &gid_tree);
+		found_node = avltree_lookup(&prototype.node_k, &shard->t);
 		if (unlikely(!found_node))
-			return false;
+			goto out;
 
 		atomic_store_voidptr(cache_slot, found_node);
-		found_group = avltree_container_of(found_node,
-						   struct cache_group,
-						   gid_node);
+		found = avltree_container_of(found_node, struct cache_entry,
+					     node_k);
 	}
 
-	if (likely(name))
-		*name = &found_group->gname;
-	else
-		LogDebug(COMPONENT_IDMAPPER, "Caller is being weird.");
+	if (found->name.len > size)
+		goto out;
 
-	return group_expired(found_group) ? false : true;
-}
+	memcpy(name->addr, found->name.addr, found->name.len);
+	name->len = found->name.len;
+	*negative = found->negative;
+	status = cache_entry_status(found);
 
-/**
- * @brief Wipe out the idmapper cache
- */
+	/* Only a current entry may be served without the lock, a stale
+	 * one must go on being looked up until it is refreshed.
+	 */
+	if (status == IDMAPPER_HIT && found->name.len <= sizeof(ts->name)) {
+		ts->id = id;
+		ts->valid = true;
+		ts->negative = found->negative;
+		ts->len = found->name.len;
+		ts->expire = found->epoch + (found->negative ?
+			nfs_param.core_param.negative_cache_expiration :
+			nfs_param.core_param.manage_gids_expiration);
+		memcpy(ts->name, found->name.addr, found->name.len);
+	}
 
-void idmapper_clear_cache(void)
-{
-	struct avltree_node *node;
+ out:
+	PTHREAD_RWLOCK_unlock(&shard->lock);
 
-	PTHREAD_RWLOCK_wrlock(&idmapper_user_lock);
-	PTHREAD_RWLOCK_wrlock(&idmapper_group_lock);
+	return status;
+}
 
-	memset(uid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
-	memset(gid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
+static void cache_map_clear(struct cache_map *map)
+{
+	struct avltree_node *node;
+	int i;
 
-	for (node = avltree_first(&uname_tree);
-	     node != NULL;
-	     node = avltree_first(&uname_tree)) {
-		struct cache_user *user;
+	for (i = 0; i < IDMAPPER_SHARDS; i++) {
+		struct cache_shard *shard = &map->shards[i];
 
-		user = avltree_container_of(node,
-					    struct cache_user, uname_node);
-		avltree_remove(&user->uname_node, &uname_tree);
-		avltree_remove(&user->uid_node, &uid_tree);
-		gsh_free(user);
-	}
+		PTHREAD_RWLOCK_wrlock(&shard->lock);
 
-	assert(avltree_first(&uid_tree) == NULL);
+		memset(shard->cache, 0, sizeof(shard->cache));
 
-	for (node = avltree_first(&gname_tree);
-	     node != NULL;
-	     node = avltree_first(&gname_tree)) {
-		struct cache_group *group;
+		for (node = avltree_first(&shard->t);
+		     node != NULL;
+		     node = avltree_first(&shard->t)) {
+			avltree_remove(node, &shard->t);
+			gsh_free(avltree_container_of(node, struct cache_entry,
+						      node_k));
+		}
 
-		group = avltree_container_of(node,
-					     struct cache_group, gname_node);
-		avltree_remove(&group->gname_node, &gname_tree);
-		avltree_remove(&group->gid_node, &gid_tree);
-		gsh_free(group);
+		PTHREAD_RWLOCK_unlock(&shard->lock);
 	}
+}
 
-	assert(avltree_first(&gid_tree) == NULL);
+/**
+ * @brief Wipe out the idmapper cache
+ */
 
-	PTHREAD_RWLOCK_unlock(&idmapper_group_lock);
-	PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
+void idmapper_clear_cache(void)
+{
+	cache_map_clear(&uname_map);
+	cache_map_clear(&uid_map);
+	cache_map_clear(&gname_map);
+	cache_map_clear(&gid_map);
+	(void) atomic_inc_uint64_t(&idmapper_generation);
 }
 
 /** @} */
@@ -51,7 +51,8 @@
 
 #define _9P_LOCK_CLIENT_LEN 64
 
-#define _9P_FID_PER_CONN        1024
+/* Slots a connection's fid table starts with once it holds a fid */
+#define _9P_FID_TABLE_MIN        16
 
 /* _9P_MSG_SIZE: maximum message size for 9P/TCP */
 #define _9P_MSG_SIZE 70000
@@ -330,6 +331,24 @@ struct _9p_fid {
 	struct _9p_xattr_desc *xattr;
 };
 
+/**
+ * @brief Table of the fids a connection holds, keyed by fid
+ *
+ * Open addressed with linear probing, so a lookup is a hash and a few
+ * adjacent slots.  The table is only allocated with the first fid, and
+ * doubles or halves so that it stays between 1/8 and 1/2 full: its
+ * size follows the fids in use and any u32 can be a fid.
+ */
+struct _9p_fid_table {
+	pthread_rwlock_t lock;
+	struct _9p_fid_slot {
+		u32 fid;
+		struct _9p_fid *pfid;	/*< NULL for a free slot */
+	} *slots;
+	u32 size;		/*< Slots, 0 or a power of 2 */
+	u32 count;		/*< Slots in use */
+};
+
 enum _9p_trans_type {
 	_9P_TCP,
 	_9P_RDMA
@@ -374,7 +393,7 @@ struct _9p_conn {
 	struct gsh_client *client;
 	struct timeval birth;	/* This is useful if same sockfd is
 				   reused on socket's close/open */
-	struct _9p_fid *fids[_9P_FID_PER_CONN];
+	struct _9p_fid_table fids;
 	struct _9p_flush_bucket flush_buckets[FLUSH_BUCKETS];
 	unsigned long sequence;
 	pthread_mutex_t sock_lock;
@@ -412,6 +431,10 @@ struct _9p_request_data {
 	msk_data_t *data;
 #endif
 	struct _9p_flush_hook flush_hook;
+	/* Reply data left in a file, sent after the reply header */
+	int zc_fd;
+	uint64_t zc_offset;
+	u32 zc_len;		/* 0 when the reply is all in the buffer */
 };
 
 typedef int (*_9p_function_t) (struct _9p_request_data *req9p,
@@ -628,6 +651,26 @@ do {                                                   \
  */
 #define _9P_RDMA_BACKLOG 10
 
+/**
+ * @brief Smallest buffer for a 9P/TCP message or reply
+ *
+ * Replies other than RREAD and RREADDIR, and all messages but TWRITE,
+ * are short: with a larger msize only those get bigger buffers.
+ */
+#define _9P_TCP_MIN_BUF 65536
+
+/**
+ * @brief Default value for _9p_tcp_event_loops
+ */
+#define _9P_TCP_EVENT_LOOPS 4
+
+/**
+ * @brief Smallest TREAD sent zero copy
+ *
+ * Below this, copying is cheaper than the extra system calls.
+ */
+#define _9P_ZERO_COPY_MIN 16384
+
 
 /**
  * @brief 9p configuration
@@ -657,6 +700,21 @@ struct _9p_param {
 	    Defaults to _9P_RDMA_OUTPOOL_SIZE,
 	    settable by _9P_RDMA_OutPool_Size */
 	uint16_t _9p_rdma_outpool_size;
+	/** Send TREAD replies on TCP straight from the file when the
+	    FSAL allows it.  Defaults to false,
+	    settable by _9P_TCP_Zero_Copy_Read */
+	bool _9p_tcp_zero_copy_read;
+	/** Run a TCP request on the thread that read it when no more
+	    than this many requests are queued.  Defaults to 0 (never),
+	    settable by _9P_TCP_Inline_Depth */
+	uint32_t _9p_tcp_inline_depth;
+	/** Same for RDMA.  Defaults to 0 (never),
+	    settable by _9P_RDMA_Inline_Depth */
+	uint32_t _9p_rdma_inline_depth;
+	/** Threads waiting on the TCP connections with epoll, 0 for a
+	    thread per connection.  Defaults to _9P_TCP_EVENT_LOOPS,
+	    settable by _9P_TCP_Event_Loops */
+	uint32_t _9p_tcp_event_loops;
 
 };
 
@@ -724,6 +782,10 @@ int _9p_tools_get_req_context_by_name(int uname_len, char *uname_str,
 int _9p_tools_errno(fsal_status_t fsal_status);
 void _9p_openflags2FSAL(u32 *inflags, fsal_openflags_t *outflags);
 int _9p_tools_clunk(struct _9p_fid *pfid);
+void _9p_fid_table_init(struct _9p_conn *conn);
+struct _9p_fid *_9p_fid_lookup(struct _9p_conn *conn, u32 fid);
+void _9p_fid_insert(struct _9p_conn *conn, struct _9p_fid *pfid);
+void _9p_fid_remove(struct _9p_conn *conn, u32 fid);
 void _9p_cleanup_fids(struct _9p_conn *conn);
 
 static inline unsigned int _9p_openflags_to_share_access(u32 *inflags)
@@ -172,6 +172,12 @@ void update_share_counters(struct fsal_share *share,
 			   fsal_openflags_t old_openflags,
 			   fsal_openflags_t new_openflags);
 
+bool update_share_counters_shared(struct fsal_obj_handle *obj_hdl,
+				  struct fsal_share *share,
+				  fsal_openflags_t old_openflags,
+				  fsal_openflags_t new_openflags,
+				  fsal_status_t *status);
+
 fsal_status_t check_share_conflict(struct fsal_share *share,
 				   fsal_openflags_t openflags,
 				   bool bypass);
@@ -29,11 +29,11 @@
  * @brief  Abstract memory shims to allow swapping out allocators
  *
  * This file's purpose is to allow us to easily replace the memory
- * allocator used by Ganesha.  Further, it provides a pool abstraction
- * that may be implemented in terms of the normal allocator that may
- * be expanded at a later date.  These are intended to be thin
- * wrappers, but conditionally compiled trace information could be
- * added.
+ * allocator used by Ganesha.  Further, it provides a pool of fixed
+ * size objects, implemented in support/pool.c, that recycles objects
+ * through per-thread caches.  The general allocator functions are
+ * intended to be thin wrappers, but conditionally compiled trace
+ * information could be added.
  */
 
 #ifndef ABSTRACT_MEM_H
@@ -43,6 +43,7 @@
 #include <string.h>
 #include <assert.h>
 #include "log.h"
+#include "mem_acct.h"
 
 /**
  * @page GeneralAllocator General Allocator Shim
@@ -315,6 +316,84 @@ gsh_free_size(void *p, size_t n __attribute__ ((unused)))
 	free(p);
 }
 
+/**
+ * @brief Allocate memory charged to a subsystem
+ *
+ * Like gsh_malloc, and counted against @a tag as described in
+ * mem_acct.h.  The block must be freed with gsh_free_tag and the
+ * same size.
+ *
+ * @param[in] tag      Subsystem to charge
+ * @param[in] n        Number of bytes to allocate
+ * @param[in] file     Calling source file
+ * @param[in] line     Calling source line
+ * @param[in] function Calling source function
+ *
+ * @return Pointer to a block of memory.
+ */
+static inline void *
+gsh_malloc_tag__(enum mem_tag tag, size_t n,
+		 const char *file, int line, const char *function)
+{
+	mem_acct_charge(tag, n, 1);
+	return gsh_malloc__(n, file, line, function);
+}
+
+#define gsh_malloc_tag(tag, n) \
+	gsh_malloc_tag__(tag, n, __FILE__, __LINE__, __func__)
+
+/**
+ * @brief Allocate zeroed memory charged to a subsystem
+ *
+ * Like gsh_calloc, and counted against @a tag.  The block must be
+ * freed with gsh_free_tag and a size of @a n times @a s.
+ *
+ * @param[in] tag      Subsystem to charge
+ * @param[in] n        Number of objects in block
+ * @param[in] s        Size of object
+ * @param[in] file     Calling source file
+ * @param[in] line     Calling source line
+ * @param[in] function Calling source function
+ *
+ * @return Pointer to a block of zeroed memory.
+ */
+static inline void *
+gsh_calloc_tag__(enum mem_tag tag, size_t n, size_t s,
+		 const char *file, int line, const char *function)
+{
+	mem_acct_charge(tag, n * s, 1);
+	return gsh_calloc__(n, s, file, line, function);
+}
+
+#define gsh_calloc_tag(tag, n, s) \
+	gsh_calloc_tag__(tag, n, s, __FILE__, __LINE__, __func__)
+
+/**
+ * @brief Free memory charged to a subsystem
+ *
+ * @param[in] tag  Subsystem it was charged to
+ * @param[in] p    Block of memory to free, may be NULL
+ * @param[in] n    Size it was allocated with
+ */
+static inline void
+gsh_free_tag(enum mem_tag tag, void *p, size_t n)
+{
+	if (p != NULL)
+		mem_acct_charge(tag, -(int64_t)n, -1);
+	free(p);
+}
+
+/**
+ * @page PoolAllocator Pool Allocator
+ *
+ * Objects of one size are kept in a pool.  Freed objects go to a
+ * per-thread magazine, and to a depot per NUMA node when the thread
+ * has more than it can use, so the common case of alloc and free
+ * touches no lock and no memory shared with other threads.  Only
+ * when a depot is full are objects given back to the general
+ * allocator.
+ */
+
 /**
  * @brief Type representing a pool
  *
@@ -323,29 +402,37 @@ gsh_free_size(void *p, size_t n __attribute__ ((unused)))
  * stored or passed to pool functions.  The pointer should never be
  * referenced.  No assumptions about the size of the pointed-to type
  * should be made.
- *
- * This allows for flexible growth in the future.
  */
 
-typedef struct pool {
-	char *name; /*< The name of the pool */
-	size_t object_size; /*< The size of the objects created */
-} pool_t;
+typedef struct pool pool_t;
 
 /**
- * @brief Create a basic object pool
+ * @brief Construct or destroy an object of a pool
+ *
+ * @param[in] object The object
+ */
+typedef void (*pool_object_fn)(void *object);
+
+/**
+ * @brief Create an object pool
  *
  * This function creates a new object pool, given a name, object size,
  * constructor and destructor.
  *
- * This particular implementation throws the name away, but other
- * implementations that do tracking or keep counts of allocated or
- * de-allocated objects will likely wish to use it in log messages.
+ * Without a constructor, every object pool_alloc() returns is zeroed.
+ * With one, an object is constructed only when the pool first gets it
+ * from the general allocator, and comes back from pool_alloc() the way
+ * it was given to pool_free().  Callers must then free objects in
+ * their constructed state, which saves zeroing and initializing them
+ * each time.  The destructor is called when the pool gives an object
+ * back to the general allocator.
  *
  * This initializer function is expected to abort if it fails.
  *
- * @param[in] name             The name of this pool
+ * @param[in] name             The name of this pool, for stats
  * @param[in] object_size      The size of objects to allocate
+ * @param[in] constructor      Called on new objects, may be NULL
+ * @param[in] destructor       Called on objects released, may be NULL
  * @param[in] file             Calling source file
  * @param[in] line             Calling source line
  * @param[in] function         Calling source function
@@ -357,25 +444,29 @@ typedef struct pool {
  *         pool_destroy.
  */
 
-static inline pool_t *
-pool_basic_init__(const char *name, size_t object_size,
-		  const char *file, int line, const char *function)
-{
-	pool_t *pool = (pool_t *) gsh_malloc__(sizeof(pool_t), file, line,
-					function);
+pool_t *pool_init__(const char *name, size_t object_size,
+		    pool_object_fn constructor, pool_object_fn destructor,
+		    const char *file, int line, const char *function);
 
-	pool->object_size = object_size;
+#define pool_init(name, object_size, constructor, destructor) \
+	pool_init__(name, object_size, constructor, destructor, \
+		    __FILE__, __LINE__, __func__)
 
-	if (name)
-		pool->name = gsh_strdup__(name, file, line, function);
-	else
-		pool->name = NULL;
-
-	return pool;
-}
+/**
+ * @brief Create a basic object pool
+ *
+ * A pool handing out zeroed objects, with no constructor or
+ * destructor.
+ *
+ * @param[in] name             The name of this pool
+ * @param[in] object_size      The size of objects to allocate
+ *
+ * @return A pointer to the pool object.
+ */
 
 #define pool_basic_init(name, object_size) \
-	pool_basic_init__(name, object_size, __FILE__, __LINE__, __func__)
+	pool_init__(name, object_size, NULL, NULL, \
+		    __FILE__, __LINE__, __func__)
 
 /**
  * @brief Destroy a memory pool
@@ -386,21 +477,28 @@ pool_basic_init__(const char *name, size_t object_size,
  * @param[in] pool The pool to be destroyed.
  */
 
-static inline void
-pool_destroy(pool_t *pool)
-{
-	gsh_free(pool->name);
-	gsh_free(pool);
-}
+void pool_destroy(pool_t *pool);
+
+/**
+ * @brief Charge the objects of a pool to a subsystem
+ *
+ * Objects the pool takes from the general allocator are counted
+ * against @a tag, as described in mem_acct.h, until they are given
+ * back.  Must be called before the first pool_alloc.
+ *
+ * @param[in] pool The pool
+ * @param[in] tag  Subsystem to charge
+ */
+
+void pool_set_mem_tag(pool_t *pool, enum mem_tag tag);
 
 /**
  * @brief Allocate an object from a pool
  *
  * This function allocates a single object from the pool and returns a
- * pointer to it.  If a constructor was specified at pool creation, it
- * is called on that pointer.  This function must be thread safe.  If
- * the underlying pool abstraction requires a lock, this function must
- * take and release it.
+ * pointer to it.  If a constructor was specified at pool creation, the
+ * object is in its constructed state, otherwise it is zeroed.  This
+ * function is thread safe.
  *
  * This function returns void pointers.  Programmers who wish for more
  * type safety can easily create static inline wrappers (alloc_client
@@ -417,11 +515,8 @@ pool_destroy(pool_t *pool)
  * @return A pointer to the allocated pool item.
  */
 
-static inline void *
-pool_alloc__(pool_t *pool, const char *file, int line, const char *function)
-{
-	return gsh_calloc__(1, pool->object_size, file, line, function);
-}
+void *pool_alloc__(pool_t *pool, const char *file, int line,
+		   const char *function);
 
 #define pool_alloc(pool) \
 	pool_alloc__(pool, __FILE__, __LINE__, __func__)
@@ -429,23 +524,19 @@ pool_alloc__(pool_t *pool, const char *file, int line, const char *function)
 /**
  * @brief Return an entry to a pool
  *
- * This function returns a single object to the pool.  If a destructor
- * was defined at pool creation time, it is called before the object
- * is freed.  This function must be thread-safe.  If the underlying
- * pool abstract requires a lock, this function must take and release
- * it.
+ * This function returns a single object to the pool.  The object is
+ * kept for reuse, and only given to the destructor, if any, when the
+ * pool has more idle objects than it keeps.  This function is
+ * thread-safe.
  *
  * @param[in] pool   Pool to which to return the object
- * @param[in] object Object to return.  This is a void pointer.
- *                   Programmers wishing more type safety could create
- *                   a static inline wrapper taking an object of a
- *                   specific type (and omitting the pool parameter.)
+ * @param[in] object Object to return, may be NULL.  This is a void
+ *                   pointer.  Programmers wishing more type safety
+ *                   could create a static inline wrapper taking an
+ *                   object of a specific type (and omitting the pool
+ *                   parameter.)
  */
 
-static inline void
-pool_free(pool_t *pool, void *object)
-{
-	gsh_free(object);
-}
+void pool_free(pool_t *pool, void *object);
 
 #endif /* ABSTRACT_MEM_H */
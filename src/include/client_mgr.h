@@ -44,6 +44,20 @@
 
 #include "avltree.h"
 #include "gsh_types.h"
+#include "gsh_throttle.h"
+#include "fsal_types.h"
+
+/** Number of export access decisions a gsh_client remembers */
+#define CLIENT_MATCH_CACHE_SIZE 8
+
+/**
+ * @brief A remembered export access decision, see export_check_access
+ */
+struct client_match_cache {
+	uint64_t cm_gen;	/*< clients_gen of the export */
+	uint64_t cm_opt_gen;	/*< Generation of EXPORT_DEFAULTS */
+	struct export_perms cm_perms;	/*< Resolved permissions */
+};
 
 struct gsh_client {
 	struct avltree_node node_k;
@@ -52,6 +66,9 @@ struct gsh_client {
 	int64_t refcnt;
 	nsecs_elapsed_t last_update;
 	char *hostaddr_str;
+	struct gsh_throttle throttle;
+	/** Access decisions by export_id, protected by lock */
+	struct client_match_cache cm_cache[CLIENT_MATCH_CACHE_SIZE];
 	unsigned char addrbuf[];
 };
 
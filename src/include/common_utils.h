@@ -82,6 +82,30 @@ extern int portable_clock_gettime(struct timespec *ts);
 #define SCANDIR_CONST
 #endif
 
+#ifdef ENABLE_LOCK_PROFILE
+#include "lock_prof.h"
+
+/**
+ * @brief Give a lock call site its lock_prof_site
+ *
+ * @param[in] _kind  enum lock_prof_kind
+ * @param[in] _name  Lock expression
+ */
+#define LOCK_PROF_SITE(_kind, _name)					\
+	static struct lock_prof_site lp_site = {			\
+		.file = __FILE__,					\
+		.name = _name,						\
+		.line = __LINE__,					\
+		.kind = _kind						\
+	}
+#define LOCK_PROF_LOCK(_func, _lock) lock_prof_lock(_lock, &lp_site)
+#define LOCK_PROF_RELEASE(_lock) lock_prof_release(_lock)
+#else
+#define LOCK_PROF_SITE(_kind, _name) do { } while (0)
+#define LOCK_PROF_LOCK(_func, _lock) _func(_lock)
+#define LOCK_PROF_RELEASE(_lock) do { } while (0)
+#endif
+
 /**
  * @brief Logging rwlock initialization
  *
@@ -140,8 +164,9 @@ extern int portable_clock_gettime(struct timespec *ts);
 #define PTHREAD_RWLOCK_wrlock(_lock)					\
 	do {								\
 		int rc;							\
+		LOCK_PROF_SITE(LOCK_PROF_WRLOCK, #_lock);		\
 									\
-		rc = pthread_rwlock_wrlock(_lock);			\
+		rc = LOCK_PROF_LOCK(pthread_rwlock_wrlock, _lock);	\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Got write lock on %p (%s) "	\
@@ -165,8 +190,9 @@ extern int portable_clock_gettime(struct timespec *ts);
 #define PTHREAD_RWLOCK_rdlock(_lock)					\
 	do {								\
 		int rc;							\
+		LOCK_PROF_SITE(LOCK_PROF_RDLOCK, #_lock);		\
 									\
-		rc = pthread_rwlock_rdlock(_lock);			\
+		rc = LOCK_PROF_LOCK(pthread_rwlock_rdlock, _lock);	\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Got read lock on %p (%s) "	\
@@ -191,6 +217,7 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
+		LOCK_PROF_RELEASE(_lock);				\
 		rc = pthread_rwlock_unlock(_lock);			\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
@@ -215,8 +242,9 @@ extern int portable_clock_gettime(struct timespec *ts);
 #define PTHREAD_MUTEX_lock(_mtx)					\
 	do {								\
 		int rc;							\
+		LOCK_PROF_SITE(LOCK_PROF_MUTEX, #_mtx);			\
 									\
-		rc = pthread_mutex_lock(_mtx);				\
+		rc = LOCK_PROF_LOCK(pthread_mutex_lock, _mtx);		\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Acquired mutex %p (%s) at %s:%d",	\
@@ -241,6 +269,7 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
+		LOCK_PROF_RELEASE(_mtx);				\
 		rc = pthread_mutex_unlock(_mtx);			\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
@@ -25,11 +25,13 @@
 #cmakedefine USE_CAPS 1
 #cmakedefine USE_BLKID 1
 #cmakedefine PROXY_HANDLE_MAPPING 1
+#cmakedefine HAVE_SQLITE3 1
 #cmakedefine _USE_9P 1
 #cmakedefine _USE_9P_RDMA 1
 #cmakedefine _USE_NFS_RDMA 1
 #cmakedefine _USE_NFS3 1
 #cmakedefine _USE_NLM 1
+#cmakedefine USE_RPC_TLS 1
 #cmakedefine DEBUG_SAL 1
 #cmakedefine _VALGRIND_MEMCHECK 1
 #cmakedefine _NO_TCP_REGISTER 1
@@ -48,7 +50,7 @@
 #cmakedefine ENABLE_VFS_DEBUG_ACL 1
 #cmakedefine ENABLE_RFC_ACL 1
 #cmakedefine USE_GLUSTER_XREADDIRPLUS 1
-#cmakedefine USE_GLUSTER_UPCALL_REGISTER 1
+#cmakedefine USE_GLUSTER_COPY_FILE_RANGE 1
 #cmakedefine USE_FSAL_CEPH_MKNOD 1
 #cmakedefine USE_FSAL_CEPH_SETLK 1
 #cmakedefine USE_FSAL_CEPH_LL_LOOKUP_ROOT 1
@@ -58,8 +60,11 @@
 #cmakedefine USE_CEPH_LL_FALLOCATE 1
 #cmakedefine USE_FSAL_CEPH_ABORT_CONN 1
 #cmakedefine USE_FSAL_CEPH_RECLAIM_RESET 1
+#cmakedefine USE_FSAL_CEPH_LL_NONBLOCKING_IO 1
 #cmakedefine USE_FSAL_RGW_MOUNT2 1
 #cmakedefine ENABLE_LOCKTRACE 1
+#cmakedefine ENABLE_LOCK_PROFILE 1
+#cmakedefine ENABLE_MEM_ACCOUNTING 1
 #cmakedefine SANITIZE_ADDRESS 1
 #cmakedefine DEBUG_MDCACHE 1
 #cmakedefine USE_RADOS_RECOV 1
@@ -816,6 +816,32 @@ static inline bool is_prime(int v)
 config_file_t config_ParseFile(char *file_path,
 			       struct config_error_type *err_type);
 
+/**
+ * @brief Keep a compiled cache of a configuration file's parse tree
+ *
+ * config_ParseFile of config_path then rebuilds the tree from
+ * cache_file while the content of config_path and of everything it
+ * includes is unchanged, and writes it whenever the text parses
+ * without errors.  Other files are always parsed.
+ *
+ * @param config_path [IN] configuration file, NULL for no cache
+ * @param cache_file  [IN] where its cache is kept
+ */
+void config_SetCache(const char *config_path, const char *cache_file);
+
+/**
+ * @brief Parse configuration held in a string into a parse tree.
+ *
+ * Include files are found relative to the current directory.
+ *
+ * @param buf      [IN]  NUL terminated configuration text
+ * @param err_type [OUT] Error type. Check this for success.
+ *
+ * @return pointer to parse tree.  Must be freed if != NULL
+ */
+config_file_t config_ParseString(char *buf,
+				 struct config_error_type *err_type);
+
 /**
  *  Return the first node in the global config block list with
  *  name == block_name
@@ -845,6 +871,13 @@ int find_config_nodes(config_file_t config, char *expr,
 		     struct config_node_list **node_list,
 		      struct config_error_type *err_type);
 
+/* hash a block of the parse tree, or all top level blocks of a name */
+uint64_t config_node_hash(void *tree_node);
+uint64_t config_block_hash(config_file_t config, const char *blkname);
+
+/* value of a parameter of a block */
+const char *config_block_value(void *tree_node, const char *name);
+
 /* fill configuration structure from parse tree */
 int load_config_from_node(void *tree_node,
 			  struct config_block *conf_blk,
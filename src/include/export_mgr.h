@@ -40,6 +40,8 @@
 #include "avltree.h"
 #include "abstract_atomic.h"
 #include "fsal.h"
+#include "gsh_throttle.h"
+#include "gsh_partition.h"
 
 #ifndef EXPORT_MGR_H
 #define EXPORT_MGR_H
@@ -61,6 +63,14 @@ struct gsh_export {
 	struct glist_head exp_list;
 	/** gsh_exports are kept in an AVL tree by export_id */
 	struct avltree_node node_k;
+	/** Exports sharing this fullpath, and the path index node holding
+	    them.  Protected by export_by_id.lock */
+	struct glist_head exp_path_list;
+	struct export_path_node *exp_path_node;
+	/** Exports sharing this pseudopath, and the pseudo path index node
+	    holding them.  Protected by export_by_id.lock */
+	struct glist_head exp_pseudo_list;
+	struct export_path_node *exp_pseudo_node;
 	/** List of NFS v4 state belonging to this export */
 	struct glist_head exp_state_list;
 	/** List of locks belonging to this export */
@@ -79,6 +89,12 @@ struct gsh_export {
 	struct fsal_obj_handle *exp_root_obj;
 	/** CFG Allowed clients - update protected by lock */
 	struct glist_head clients;
+	/** Network clients compiled for lookup, rebuilt with clients.
+	    Protected by lock */
+	struct client_trie *client_trie;
+	/** Server wide unique version of clients, 0 until compiled.
+	    Protected by lock */
+	uint64_t clients_gen;
 	/** Entry for the junction of this export.  Protected by lock */
 	struct fsal_obj_handle *exp_junction_obj;
 	/** The export this export sits on. Protected by lock */
@@ -107,6 +123,22 @@ struct gsh_export {
 	uint64_t MaxOffsetWrite;
 	/** CFG: Maximum Offset allowed for read - atomic changeable option */
 	uint64_t MaxOffsetRead;
+	/** CFG: Operations per second - atomic changeable option */
+	uint64_t max_iops;
+	/** CFG: Bytes per second - atomic changeable option */
+	uint64_t max_bandwidth;
+	/** Request throttle, limits set here override max_iops and
+	 *  max_bandwidth
+	 */
+	struct gsh_throttle throttle;
+	/** CFG: Percent of Entries_HWMark kept for this export - atomic
+	 *  changeable option
+	 */
+	uint32_t cache_share;
+	/** CFG: Name of the isolation partition - changeable option */
+	char *partition_name;
+	/** Isolation partition, NULL for none - atomic changeable option */
+	struct gsh_partition *partition;
 	/** CFG: Filesystem ID for overriding fsid from FSAL - ????? */
 	fsal_fsid_t filesystem_id;
 	/** References to this export */
@@ -121,6 +153,12 @@ struct gsh_export {
 	uint32_t options;
 	/** CFG: Export non-permission options set - atomic changeable option */
 	uint32_t options_set;
+	/** Hash of the EXPORT block this export was last loaded from in
+	    the config file, 0 once added or updated over DBus */
+	uint64_t config_hash;
+	/** Config file load that last found this export, 0 if it was
+	    never in the config file */
+	uint64_t config_gen;
 	/** CFG: Export_Id for this export - static option */
 	uint16_t export_id;
 
@@ -170,6 +208,10 @@ struct gsh_export *get_gsh_export_by_pseudo_locked(char *path,
 struct gsh_export *get_gsh_export_by_tag(char *tag);
 bool mount_gsh_export(struct gsh_export *exp);
 void remove_gsh_export(uint16_t export_id);
+void foreach_gsh_export_parallel(struct gsh_export **exports, uint32_t count,
+				 void (*cb)(struct gsh_export *exp,
+					    void *state),
+				 void *state);
 bool foreach_gsh_export(bool(*cb) (struct gsh_export *exp, void *state),
 			bool wrlock, void *state);
 
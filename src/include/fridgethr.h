@@ -46,6 +46,7 @@
 #include <stdbool.h>
 #include "gsh_list.h"
 #include "gsh_wait_queue.h"
+#include "gsh_intrinsic.h"
 
 struct fridgethr;
 
@@ -179,6 +180,15 @@ struct fridgethr_params {
 	void (*wake_threads)(void *);
 	/* Argument for wake_threads */
 	void *wake_threads_arg;
+	/**
+	 * If non-zero, a worker fridge hands jobs to its threads
+	 * through a lock-free ring of this many slots (rounded up to a
+	 * power of 2), without taking the fridge mutex.  Threads
+	 * waiting for work spin on the ring for a while, then sleep on
+	 * a futex.  When the ring is full, jobs are deferred as usual.
+	 * Only used on Linux.
+	 */
+	uint32_t ring_size;
 };
 
 /**
@@ -191,6 +201,35 @@ struct fridgethr_work {
 	void *arg; /*< Functions argument */
 };
 
+/**
+ * @brief One slot of a fridge ring
+ */
+struct fridgethr_cell {
+	uint64_t seq;		/*< Position this slot is ready for */
+	void (*func)(struct fridgethr_context *); /*< Job */
+	void *arg;		/*< Its argument */
+};
+
+/**
+ * @brief Bounded multi-producer multi-consumer job ring
+ *
+ * Each slot carries the position it can next be used at, so
+ * producers and consumers only contend on their own cursor.
+ */
+struct fridgethr_ring {
+	uint64_t head;		/*< Next position to fill */
+	GSH_CACHE_PAD(0);
+	uint64_t tail;		/*< Next position to take */
+	GSH_CACHE_PAD(1);
+	uint32_t waiters;	/*< Threads spinning or sleeping on the
+				    ring */
+	uint32_t sleepers;	/*< Those of them sleeping on the futex */
+	uint32_t futex;		/*< Bumped to wake sleepers */
+	GSH_CACHE_PAD(2);
+	uint64_t mask;		/*< Number of slots - 1 */
+	struct fridgethr_cell cell[];
+};
+
 /**
  * @brief Commands a caller can issue
  */
@@ -223,6 +262,8 @@ struct fridgethr {
 	pthread_cond_t *cb_cv;	/*< Condition variable, signalled on
 				   completion */
 	bool transitioning; /*< Changing state */
+	uint32_t numa_next; /*< NUMA node for the next thread started */
+	struct fridgethr_ring *ring; /*< Job ring, if ring_size was set */
 	union {
 		struct glist_head work_q; /*< Work queued */
 		struct {
@@ -261,6 +302,8 @@ int fridgethr_populate(struct fridgethr *, void (*)(struct fridgethr_context *),
 
 void fridgethr_setwait(struct fridgethr_context *ctx, time_t thread_delay);
 time_t fridgethr_getwait(struct fridgethr_context *ctx);
+void fridgethr_set_max(struct fridgethr *fr, uint32_t thr_max);
+uint32_t fridgethr_nthreads(struct fridgethr *fr);
 
 void fridgethr_cancel(struct fridgethr *fr);
 
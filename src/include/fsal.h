@@ -107,6 +107,32 @@ struct root_op_context {
 
 extern size_t open_fd_count;
 
+/**
+ * @brief Counter of objects made unreachable by their handle
+ *
+ * Layers above the FSALs that keep references to objects looked up
+ * by handle, to skip doing it again, must sample fsal_obj_epoch()
+ * before the lookup and only use the reference while the epoch has
+ * not moved since.
+ */
+extern uint32_t fsal_obj_handle_epoch;
+
+static inline uint32_t fsal_obj_epoch(void)
+{
+	return atomic_fetch_uint32_t(&fsal_obj_handle_epoch);
+}
+
+/**
+ * @brief Note that an object can no longer be found by its handle
+ *
+ * To be called once the object has been made unreachable, so that a
+ * lookup racing with it is caught by the epoch sampled before it.
+ */
+static inline void fsal_obj_invalidate(void)
+{
+	(void) atomic_inc_uint32_t(&fsal_obj_handle_epoch);
+}
+
 static inline void init_root_op_context(struct root_op_context *ctx,
 					struct gsh_export *exp,
 					struct fsal_export *fsal_exp,
@@ -146,6 +172,30 @@ static inline void release_root_op_context(void)
 	op_ctx = ctx->old_op_ctx;
 }
 
+/**
+ * @brief Keep the caller's context for a done_cb from another thread
+ *
+ * An FSAL whose read2 or write2 returns before calling done_cb fills
+ * this in when it starts the I/O and sets op_ctx to it around done_cb.
+ * It keeps the fsal_export and ctx_export the I/O was started with,
+ * which the layers above have put back by the time it completes, and
+ * leaves the caller's context to the caller, who goes on using it
+ * until it suspends.
+ *
+ * @param[out] ctx	Copy of op_ctx
+ */
+static inline void fsal_async_ctx_save(struct req_op_context *ctx)
+{
+	*ctx = *op_ctx;
+	ctx->async_io = false;
+	ctx->partition = NULL;
+	/* The caller's FSAL timing stays with the caller */
+	ctx->time_fsal = false;
+	ctx->in_fsal = false;
+	ctx->fsal_calls = NULL;
+	ctx->fsal_ncalls = 0;
+}
+
 /******************************************************
  *                Structure used to define a fsal
  ******************************************************/
@@ -434,6 +484,11 @@ fsal_status_t fsal_commit(struct fsal_obj_handle *obj, off_t offset,
 }
 fsal_status_t fsal_verify2(struct fsal_obj_handle *obj,
 			   fsal_verifier_t verifier);
+fsal_status_t fsal_copy(struct fsal_obj_handle *dst,
+			struct state_t *dst_state, uint64_t dst_offset,
+			struct fsal_obj_handle *src,
+			struct state_t *src_state, uint64_t src_offset,
+			uint64_t count, uint64_t *copied);
 
 /**
  * @brief Pepare an attrlist for fetching attributes.
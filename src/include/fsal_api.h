@@ -52,6 +52,7 @@
 */
 struct gsh_client;
 struct gsh_export;
+struct gsh_partition;
 struct fsal_up_vector;		/* From fsal_up.h */
 struct state_t;
 
@@ -319,7 +320,7 @@ struct state_t;
  * rules), increment the minor version
  */
 
-#define FSAL_MINOR_VERSION 0
+#define FSAL_MINOR_VERSION 6
 
 /* Forward references for object methods */
 
@@ -393,6 +394,17 @@ struct io_hints {
  *          module does not know and the code will still do the right thing.
  */
 
+struct topk_key;
+
+/** How many FSAL calls of a request the slow request log shows */
+#define REQ_FSAL_CALLS 16
+
+/** A call MDCACHE made to the FSAL below it */
+struct fsal_call_rec {
+	const char *func;	/*< MDCACHE function that made it */
+	nsecs_elapsed_t duration;
+};
+
 struct req_op_context {
 	struct user_cred *creds;	/*< resolved user creds from request */
 	struct user_cred original_creds;	/*< Saved creds */
@@ -415,6 +427,21 @@ struct req_op_context {
 	void *fsal_private;		/*< private for FSAL use */
 	struct fsal_module *fsal_module;	/*< current fsal module */
 	struct fsal_pnfs_ds *fsal_pnfs_ds;	/*< current pNFS DS */
+	bool async_io;		/*< read2/write2 may call back after returning,
+				    from another thread, see
+				    fsal_async_ctx_save() */
+	bool time_fsal;		/*< time the calls MDCACHE makes to the
+				    FSAL below it, see fsal_time */
+	bool in_fsal;		/*< one of those calls is being timed */
+	nsecs_elapsed_t fsal_time;	/*< time spent in those calls */
+	struct fsal_call_rec *fsal_calls;	/*< where to keep them, for the
+						    slow request log, or NULL */
+	uint32_t fsal_ncalls;	/*< how many were made, may be more than
+				    fit in fsal_calls */
+	struct topk_key *top_fh;	/*< handle operated on, for top
+					    tracking, or NULL */
+	struct gsh_partition *partition;	/*< partition a slot is held
+						    in, or NULL */
 	/* add new context members here */
 };
 
@@ -1027,6 +1054,31 @@ struct export_ops {
 				    int quota_id,
 				    fsal_quota_t *quota,
 				    fsal_quota_t *resquota);
+
+/**
+ * @brief Get the quotas of several ids at once
+ *
+ * Filesystems that can report many quota records in one pass should
+ * implement this; the default calls get_quota for each id in turn.
+ * The caller looks at @a statuses for each id, the returned status is
+ * only an error if the request as a whole could not be attempted.
+ *
+ * @param[in]  exp_hdl    The export to interrogate
+ * @param[in]  filepath   The path within the export to check
+ * @param[in]  quota_type Whether we are checking inodes or blocks
+ * @param[in]  count      Number of ids
+ * @param[in]  quota_ids  Ids to get the quotas of
+ * @param[out] quotas     The quotas, one per id
+ * @param[out] statuses   Status of each id
+ *
+ * @return FSAL types.
+ */
+	 fsal_status_t (*get_quotas)(struct fsal_export *exp_hdl,
+				     const char *filepath, int quota_type,
+				     uint32_t count,
+				     const int *quota_ids,
+				     fsal_quota_t *quotas,
+				     fsal_status_t *statuses);
 /**@}*/
 
 /**@{*/
@@ -1172,6 +1224,29 @@ struct export_ops {
 
 	bool (*is_superuser)(struct fsal_export *exp_hdl,
 			     const struct user_cred *creds);
+
+/**
+ * @brief Report the statistics kept for an export
+ *
+ * Most FSALs keep none.  A stackable FSAL that counts operations per
+ * export appends its name and counters to @a iter.  Called with a NULL
+ * @a iter to ask whether there is anything to report.
+ *
+ * @param[in] exp_hdl               Export to report on
+ * @param[in] iter                  opaque pointer to DBusMessageIter, or NULL
+ *
+ * @returns true if the export keeps statistics.
+ */
+
+	bool (*extract_stats)(struct fsal_export *exp_hdl, void *iter);
+
+/**
+ * @brief Reset the statistics kept for an export
+ *
+ * @param[in] exp_hdl               Export to reset
+ */
+
+	void (*reset_stats)(struct fsal_export *exp_hdl);
 };
 
 /**
@@ -1275,6 +1350,74 @@ typedef enum fsal_dir_result (*fsal_readdir_cb)(
 				struct attrlist *attrs,
 				void *dir_state, fsal_cookie_t cookie);
 
+/**
+ * @brief One directory entry of a readdir batch
+ */
+struct fsal_readdir_entry {
+	const char *name;		/*< The name of the entry */
+	struct fsal_obj_handle *obj;	/*< The entry, ref'd */
+	struct attrlist *attrs;		/*< The requested attributes */
+	fsal_cookie_t cookie;		/*< FSAL generated cookie */
+};
+
+/**
+ * @brief Callback to provide readdir caller with directory entries in batches
+ *
+ * The entries are handled in order, as if each had been passed to a
+ * fsal_readdir_cb, stopping at the first one that would have returned
+ * DIR_TERMINATE.  The callback releases the reference on every object
+ * in the batch, including those it did not get to.
+ *
+ * @param[in]  entries    The entries
+ * @param[in]  count      Number of entries, at least 1
+ * @param[out] consumed   Number of entries added to the caller's result
+ * @param[in]  dir_state  Opaque pointer to be passed to callback
+ *
+ * @returns fsal_dir_result of the last entry handled
+ */
+typedef enum fsal_dir_result (*fsal_readdir_batch_cb)(
+				struct fsal_readdir_entry *entries,
+				unsigned int count, unsigned int *consumed,
+				void *dir_state);
+
+/**
+ * @brief State to deliver entries of a per-entry readdir as batches of one
+ *
+ * Pass fsal_readdir_batch_one() as the fsal_readdir_cb and this as its
+ * dir_state.
+ */
+struct fsal_readdir_batch_state {
+	fsal_readdir_batch_cb cb;
+	void *dir_state;
+};
+
+enum fsal_dir_result fsal_readdir_batch_one(const char *name,
+					    struct fsal_obj_handle *obj,
+					    struct attrlist *attrs,
+					    void *dir_state,
+					    fsal_cookie_t cookie);
+enum fsal_dir_result fsal_readdir_entries(fsal_readdir_cb cb,
+					  struct fsal_readdir_entry *entries,
+					  unsigned int count,
+					  unsigned int *consumed,
+					  void *dir_state);
+
+/**
+ * @brief File backed read data
+ *
+ * A caller that can send straight from a file descriptor sets @c want
+ * before calling read2.  An FSAL that supports it may then leave iov[]
+ * untouched and instead return a descriptor for the data in @c fd,
+ * which the caller owns and must close once the data is sent.  FSALs
+ * that don't support it just fill iov[] and leave @c fd as -1.
+ */
+struct fsal_io_extent {
+	bool want;		/**< Caller accepts an extent */
+	int fd;			/**< Descriptor to send from, or -1 */
+	uint64_t offset;	/**< Offset of the data in @c fd */
+	size_t length;		/**< Bytes of data */
+};
+
 /**
  * @brief Argument for read2/write2 and their callbacks
  *
@@ -1288,6 +1431,7 @@ struct fsal_io_arg {
 	};
 	struct state_t *state;	/**< State to use for read (or NULL) */
 	uint64_t offset;	/**< Offset into file to read */
+	struct fsal_io_extent extent;	/**< Zero copy read reply */
 	int iov_count;		/**< Number of vectors in iov */
 	struct iovec iov[];	/**< Vector of buffers to fill */
 };
@@ -2086,6 +2230,42 @@ struct fsal_obj_ops {
 				 const struct fsal_layoutcommit_arg *arg,
 				 struct fsal_layoutcommit_res *res);
 
+/**
+ * @brief Take I/O statistics for a layout
+ *
+ * This function is called by LAYOUTSTATS with what a client saw doing
+ * I/O through a layout of the object, for the FSAL to weigh its data
+ * servers by.
+ *
+ * @param[in] obj_hdl  The object the layout is for
+ * @param[in] req_ctx  Request context
+ * @param[in] lou_body An XDR stream containing the layout type-specific
+ *                     portion of the statistics
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return Valid error codes in RFC 7862, p. 79.
+ */
+	 nfsstat4(*layoutstats)(struct fsal_obj_handle *obj_hdl,
+				struct req_op_context *req_ctx,
+				XDR *lou_body,
+				const struct fsal_layoutstats_arg *arg);
+
+/**
+ * @brief Take an error met doing I/O through a layout
+ *
+ * This function is called by LAYOUTERROR once a client has failed to
+ * do I/O to a data server of a layout of the object.
+ *
+ * @param[in] obj_hdl  The object the layout is for
+ * @param[in] req_ctx  Request context
+ * @param[in] arg      Input arguments of the function
+ *
+ * @return Valid error codes in RFC 7862, p. 78.
+ */
+	 nfsstat4(*layouterror)(struct fsal_obj_handle *obj_hdl,
+				struct req_op_context *req_ctx,
+				const struct fsal_layouterror_arg *arg);
+
 /**
  * @brief Get Extended Attribute
  *
@@ -2492,6 +2672,92 @@ struct fsal_obj_ops {
 			     struct attrlist *attrs,
 			     bool cache_attrs);
 
+/**
+ * @brief Read a directory in batches
+ *
+ * Like readdir, but hands the callback several entries at a time.
+ * The default delivers the entries of readdir one at a time; FSALs
+ * with their own dirent cache, such as MDCACHE, deliver them as they
+ * walk the cache.
+ *
+ * @param[in]  dir_hdl   Directory to read
+ * @param[in]  whence    Point at which to start reading.  NULL to
+ *                       start at beginning.
+ * @param[in]  dir_state Opaque pointer to be passed to callback
+ * @param[in]  cb        Callback to receive entries
+ * @param[in]  attrmask  Indicate which attributes the caller is interested in
+ * @param[out] eof       true if the last entry was reached
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*readdir_batch)(struct fsal_obj_handle *dir_hdl,
+					fsal_cookie_t *whence,
+					void *dir_state,
+					fsal_readdir_batch_cb cb,
+					attrmask_t attrmask,
+					bool *eof);
+
+/**
+ * @brief Copy data from one file into another
+ *
+ * Copy a range of a file of the same FSAL into this one without the
+ * data passing through the caller.  Copying less than asked is not an
+ * error, the caller asks again for the rest; nothing copied means the
+ * source ended.  An FSAL that cannot copy between these two files
+ * returns ERR_FSAL_NOTSUPP or ERR_FSAL_XDEV, and fsal_copy() then
+ * copies with read2 and write2.
+ *
+ * As with write2, the data need not be stable when this returns.
+ *
+ * @param[in]  dst_hdl    File to copy into
+ * @param[in]  dst_state  state_t to write with (or NULL)
+ * @param[in]  dst_offset Offset to write at
+ * @param[in]  src_hdl    File to copy from
+ * @param[in]  src_state  state_t to read with (or NULL)
+ * @param[in]  src_offset Offset to read from
+ * @param[in]  count      Bytes to copy
+ * @param[out] copied     Bytes copied
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*copy)(struct fsal_obj_handle *dst_hdl,
+			       struct state_t *dst_state,
+			       uint64_t dst_offset,
+			       struct fsal_obj_handle *src_hdl,
+			       struct state_t *src_state,
+			       uint64_t src_offset,
+			       uint64_t count,
+			       uint64_t *copied);
+
+/**
+ * @brief Share the blocks of a range of one file with another
+ *
+ * The range of the destination is made to share the storage of the
+ * range of the source, as a reflink does, rather than having the data
+ * copied.  Unlike copy, this is all or nothing: an FSAL (or filesystem)
+ * that cannot do it returns ERR_FSAL_NOTSUPP and the caller does not
+ * fall back to copying.  The filesystem may require the offsets, and a
+ * count that does not reach the end of the source, to be aligned to
+ * its block size, and returns ERR_FSAL_INVAL if they are not.
+ *
+ * @param[in] dst_hdl    File to clone into
+ * @param[in] dst_state  state_t to write with (or NULL)
+ * @param[in] dst_offset Offset to clone at
+ * @param[in] src_hdl    File to clone from
+ * @param[in] src_state  state_t to read with (or NULL)
+ * @param[in] src_offset Offset to clone from
+ * @param[in] count      Bytes to clone, 0 for up to the end of the source
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*clone2)(struct fsal_obj_handle *dst_hdl,
+				 struct state_t *dst_state,
+				 uint64_t dst_offset,
+				 struct fsal_obj_handle *src_hdl,
+				 struct state_t *src_state,
+				 uint64_t src_offset,
+				 uint64_t count);
+
 /**@{*/
 
 /**
@@ -2867,11 +3133,13 @@ struct fsal_filesystem {
 
 	struct avltree_node avl_fsid;	/*< AVL indexed by fsid */
 	struct avltree_node avl_dev;	/*< AVL indexed by dev */
+	struct avltree_node avl_path;	/*< AVL indexed by path */
 	struct fsal_fsid__ fsid;	/*< file system id */
 	fsal_dev_t dev;			/*< device filesystem is on */
 	enum fsid_type fsid_type;	/*< type of fsid present */
 	bool in_fsid_avl;		/*< true if inserted in fsid avl */
 	bool in_dev_avl;		/*< true if inserted in dev avl */
+	bool in_path_avl;		/*< true if inserted in path avl */
 	bool exported;			/*< true if explicitly exported */
 };
 
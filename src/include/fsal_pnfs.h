@@ -333,5 +333,40 @@ struct fsal_getdevicelist_res {
 	bool eof;
 };
 
+/**
+ * Input parameters to FSAL_layoutstats
+ */
+
+struct fsal_layoutstats_arg {
+	/** The type of the layout the statistics are for */
+	layouttype4 type;
+	/** The range the statistics cover */
+	uint64_t offset;
+	uint64_t length;
+	/** Reads and bytes read through the layout in the period */
+	uint32_t read_count;
+	uint64_t read_bytes;
+	/** Writes and bytes written through the layout in the period */
+	uint32_t write_count;
+	uint64_t write_bytes;
+};
+
+/**
+ * Input parameters to FSAL_layouterror
+ */
+
+struct fsal_layouterror_arg {
+	/** The type of the layout the error was met through */
+	layouttype4 type;
+	/** The range of the I/O that failed */
+	uint64_t offset;
+	uint64_t length;
+	/** The device the error was returned by */
+	struct pnfs_deviceid deviceid;
+	/** The error, and the operation that returned it */
+	nfsstat4 status;
+	nfs_opnum4 opnum;
+};
+
 #endif				/* !FSAL_PNFS_H */
 /** @} */
@@ -103,6 +103,14 @@ struct export_perms {
 	uint32_t options;
 	/** Permission Options that have been set */
 	uint32_t set;
+	/** Operations per second allowed each client, 0 for unlimited.
+	 *  Settable with Max_IOPS in a CLIENT block.
+	 */
+	uint64_t max_iops;
+	/** Bytes per second allowed each client, 0 for unlimited.
+	 *  Settable with Max_Bandwidth in a CLIENT block.
+	 */
+	uint64_t max_bandwidth;
 };
 
 /* Define bit values for cred_flags */
@@ -209,11 +217,24 @@ typedef struct fsal_ace__ {
 	} who;
 } fsal_ace_t;
 
+/** Most distinct groups an ACL may name and still have its access
+ *  checks cached, see fsal_acl_t::gids. */
+#define FSAL_ACL_MAX_GIDS 64
+
 typedef struct fsal_acl__ {
 	uint32_t naces;
 	fsal_ace_t *aces;
 	pthread_rwlock_t lock;
 	uint32_t ref;
+	/** Unique among all ACLs ever made by nfs4_acl_new_entry, 0 for
+	    others, whose access checks are never cached. */
+	uint64_t id;
+	/** Distinct GIDs of the group ACEs: with the caller's UID and
+	    which of these it is in, all that an access check depends on.
+	    More than FSAL_ACL_MAX_GIDS and ngids is 0, gids NULL and
+	    checks aren't cached. */
+	gid_t *gids;
+	uint32_t ngids;
 } fsal_acl_t;
 
 typedef struct fsal_acl_data__ {
@@ -406,6 +427,9 @@ typedef uint64_t attrmask_t;
 #define ATTR_CHGTIME 0x0000000000040000LL
 /* This bit indicates that an error occured during getting object attributes */
 #define ATTR_RDATTR_ERR 0x8000000000000000LL
+/* Request only: a caching FSAL returns what it holds, or ATTR_RDATTR_ERR
+ * rather than fetch */
+#define ATTR_CACHED_ONLY 0x4000000000000000LL
 /* Generation number */
 #define ATTR_GENERATION 0x0000000000080000LL
 /* Change attribute */
@@ -668,6 +692,8 @@ typedef enum enum_fsal_fsinfo_options {
 	fso_compute_readdir_cookie,
 	fso_whence_is_name,
 	fso_readdir_plus,
+	fso_clone,
+	fso_read_plus,
 } fsal_fsinfo_options_t;
 
 /* The largest maxread and maxwrite value */
@@ -714,6 +740,8 @@ typedef struct fsal_staticfsinfo_t {
 	bool compute_readdir_cookie;
 	bool whence_is_name;
 	bool readdir_plus;	/*< FSAL supports readdir_plus */
+	bool clone;		/*< FSAL may support clone2 */
+	bool read_plus;		/*< read2 reports holes in read_arg->info */
 } fsal_staticfsinfo_t;
 
 /**
@@ -919,9 +947,13 @@ struct fsal_fd {
  * There is a separate count of mandatory deny write flags so that they can be
  * enforced against all writes (non-mandatory deny write is only enforced
  * against indicated operations).
+ *
+ * The counters are changed with the object lock held for write, except
+ * share_access_read, which read only deny none opens and their closes
+ * change atomically with the lock held for read.
  */
 struct fsal_share {
-	unsigned int share_access_read;
+	uint32_t share_access_read;
 	unsigned int share_access_write;
 	unsigned int share_deny_read;
 	unsigned int share_deny_write;
@@ -113,6 +113,7 @@ static const uint32_t FSAL_UP_INVALIDATE_DIR_CHUNKS = 0x10;
 static const uint32_t FSAL_UP_INVALIDATE_CLOSE = 0x100;
 static const uint32_t FSAL_UP_INVALIDATE_FS_LOCATIONS = 0x200;
 static const uint32_t FSAL_UP_INVALIDATE_SEC_LABEL = 0x400;
+static const uint32_t FSAL_UP_INVALIDATE_XATTRS = 0x800;
 #define FSAL_UP_INVALIDATE_CACHE ( \
 	FSAL_UP_INVALIDATE_ATTRS | \
 	FSAL_UP_INVALIDATE_ACL | \
@@ -120,7 +121,8 @@ static const uint32_t FSAL_UP_INVALIDATE_SEC_LABEL = 0x400;
 	FSAL_UP_INVALIDATE_DIR_POPULATED | \
 	FSAL_UP_INVALIDATE_DIR_CHUNKS | \
 	FSAL_UP_INVALIDATE_FS_LOCATIONS | \
-	FSAL_UP_INVALIDATE_SEC_LABEL)
+	FSAL_UP_INVALIDATE_SEC_LABEL | \
+	FSAL_UP_INVALIDATE_XATTRS)
 
 /**
  * @brief Possible upcall functions
@@ -229,6 +231,27 @@ struct fsal_up_vector {
 				       void *cookie,
 				       struct layoutrecall_spec *spec);
 
+	/** Perform a layoutrecall on a whole filesystem
+	 *
+	 * Each client holding layouts on the filesystem gets a single
+	 * CB_LAYOUTRECALL of type FSID (or ALL), however many files it
+	 * has layouts on.
+	 *
+	 * @param[in] vec	   Up ops vector
+	 * @param[in] layout_type  The type of layout to recall
+	 * @param[in] changed      Whether the layout has changed and the
+	 *                         client ought to finish writes through MDS
+	 * @param[in] io_mode      Iomode of the layouts to recall
+	 * @param[in] fsid         Filesystem to recall, NULL to recall the
+	 *                         layouts on all of them
+	 *
+	 */
+	state_status_t (*layoutrecall_fsid)(const struct fsal_up_vector *vec,
+					    layouttype4 layout_type,
+					    bool changed,
+					    layoutiomode4 io_mode,
+					    const fsal_fsid_t *fsid);
+
 	/** Remove or change a deviceid
 	 *
 	 * @param[in] notify_type  Change or remove
@@ -307,6 +330,13 @@ fsal_status_t up_async_layoutrecall(struct fridgethr *fr,
 				    struct layoutrecall_spec *spec,
 				    void (*cb)(void *, state_status_t),
 				    void *cb_arg);
+fsal_status_t up_async_layoutrecall_fsid(struct fridgethr *fr,
+					 const struct fsal_up_vector *vec,
+					 layouttype4 layout_type, bool changed,
+					 layoutiomode4 io_mode,
+					 const fsal_fsid_t *fsid,
+					 void (*cb)(void *, state_status_t),
+					 void *cb_arg);
 fsal_status_t up_async_notify_device(struct fridgethr *fr,
 				     const struct fsal_up_vector *vec,
 				     notify_deviceid_type4 notify_type,
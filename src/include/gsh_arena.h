@@ -0,0 +1,180 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_arena.h
+ * @brief Bump allocator for the memory of one reply
+ *
+ * A reply such as READDIR is made of many small pieces, names and
+ * encoded attributes, that are all thrown away together when the reply
+ * is freed.  An arena hands them out of a few large chunks and gives
+ * the chunks back in one go, instead of a malloc/free pair per piece.
+ *
+ * The arena is made together with the first allocation of the reply,
+ * the array its other pieces hang off, and is found again from that
+ * with arena_of().  The reply may outlive the request that built it,
+ * in the DRC or a session slot, so the arena belongs to the reply and
+ * is destroyed by the reply's free function.
+ *
+ * Memory handed out by an arena must never be passed to gsh_free().
+ */
+
+#ifndef GSH_ARENA_H
+#define GSH_ARENA_H
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/param.h>
+#include "gsh_intrinsic.h"
+#include "abstract_mem.h"
+
+/** Usual size of a chunk, bigger allocations get a chunk of their own */
+#define ARENA_CHUNK_SIZE 16384
+
+/** Alignment of every allocation */
+#define ARENA_ALIGN 8
+
+struct arena_chunk {
+	struct arena_chunk *next;	/*< Chunk filled before this one */
+	size_t size;			/*< Bytes of data */
+};
+
+struct gsh_arena {
+	struct arena_chunk *chunks;	/*< Chunk being filled, then the
+					    older ones */
+	char *next;			/*< Next free byte of chunks */
+	size_t left;			/*< Free bytes from next */
+};
+
+/**
+ * @brief A place in an arena to rewind to
+ */
+struct arena_mark {
+	struct arena_chunk *chunk;
+	char *next;
+	size_t left;
+};
+
+void *arena_create(size_t size);
+void arena_grow(struct gsh_arena *arena, size_t size);
+void arena_rewind(struct gsh_arena *arena, const struct arena_mark *mark);
+void arena_destroy(struct gsh_arena *arena);
+
+/** Room taken by the arena itself in its first chunk */
+#define ARENA_HDR_SIZE roundup(sizeof(struct gsh_arena), ARENA_ALIGN)
+
+/**
+ * @brief Find the arena from its first allocation
+ *
+ * @param[in] first  What arena_create() returned
+ *
+ * @return The arena.
+ */
+static inline struct gsh_arena *arena_of(void *first)
+{
+	return (struct gsh_arena *)((char *)first - ARENA_HDR_SIZE);
+}
+
+/**
+ * @brief Get room for up to size bytes without taking it
+ *
+ * For buffers whose final length is only known once they are filled,
+ * the caller then takes what it used with arena_commit().  Nothing
+ * else may be allocated from the arena in between.
+ *
+ * @param[in] arena  The arena
+ * @param[in] size   Most bytes the caller will use
+ *
+ * @return The room.
+ */
+static inline void *arena_reserve(struct gsh_arena *arena, size_t size)
+{
+	if (unlikely(size > arena->left))
+		arena_grow(arena, size);
+
+	return arena->next;
+}
+
+/**
+ * @brief Take the first size bytes of the room arena_reserve() gave
+ *
+ * @param[in] arena  The arena
+ * @param[in] size   Bytes used, no more than were reserved
+ */
+static inline void arena_commit(struct gsh_arena *arena, size_t size)
+{
+	size = MIN(roundup(size, ARENA_ALIGN), arena->left);
+	arena->next += size;
+	arena->left -= size;
+}
+
+/**
+ * @brief Allocate from an arena
+ *
+ * @param[in] arena  The arena
+ * @param[in] size   Bytes wanted
+ *
+ * @return The memory, never NULL.
+ */
+static inline void *arena_alloc(struct gsh_arena *arena, size_t size)
+{
+	void *p = arena_reserve(arena, size);
+
+	arena_commit(arena, size);
+	return p;
+}
+
+/**
+ * @brief Copy a string into an arena
+ *
+ * @param[in] arena  The arena
+ * @param[in] str    The string
+ * @param[in] len    Its length, as from strlen()
+ *
+ * @return The copy, NUL terminated.
+ */
+static inline char *arena_strndup(struct gsh_arena *arena, const char *str,
+				  size_t len)
+{
+	char *p = arena_alloc(arena, len + 1);
+
+	memcpy(p, str, len);
+	p[len] = '\0';
+	return p;
+}
+
+/**
+ * @brief Remember where an arena is
+ *
+ * @param[in]  arena  The arena
+ * @param[out] mark   Where to rewind to
+ */
+static inline void arena_get_mark(struct gsh_arena *arena,
+				  struct arena_mark *mark)
+{
+	mark->chunk = arena->chunks;
+	mark->next = arena->next;
+	mark->left = arena->left;
+}
+
+#endif				/* GSH_ARENA_H */
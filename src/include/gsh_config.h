@@ -48,6 +48,8 @@
 
 #include "nfs4.h"
 #include "gsh_rpc.h"
+#include "gsh_numa.h"
+#include "gsh_hugepage.h"
 
 /**
  * @brief An enumeration of protocols in the NFS family
@@ -79,11 +81,26 @@ typedef enum protos {
  */
 #define RQUOTA_PORT 875
 
+/**
+ * @brief Default seconds quotas are cached for RQUOTA.
+ */
+#define RQUOTA_CACHE_TIME 10
+
 /**
  * @brief Default value for core_param.nb_worker
  */
 #define NB_WORKER_THREAD_DEFAULT 256
 
+/**
+ * @brief Default value for core_param.drc.encoded_max
+ */
+#define DRC_ENCODED_MAX 8192
+
+/**
+ * @brief Encoded reply bytes a DRC may hold per entry of its size
+ */
+#define DRC_ENCODED_BYTES_PER_ENTRY 512
+
 /**
  * @brief Default value for core_param.drc.tcp.npart
  */
@@ -97,7 +114,7 @@ typedef enum protos {
 /**
  * @brief Default value for core_param.drc.tcp.cachesz
  */
-#define DRC_TCP_CACHESZ 127	/* make prime */
+#define DRC_TCP_CACHESZ 127	/* unused */
 
 /**
  * @brief Default value for core_param.drc.tcp.hiwat
@@ -114,6 +131,16 @@ typedef enum protos {
  */
 #define DRC_TCP_RECYCLE_EXPIRE_S 600	/* 10m */
 
+/**
+ * @brief Default value for core_param.drc.tcp.idle_shrink_s
+ */
+#define DRC_TCP_IDLE_SHRINK_S 120	/* 2m */
+
+/**
+ * @brief Default value for core_param.drc.tcp.hiwat_min
+ */
+#define DRC_TCP_HIWAT_MIN 8
+
 /**
  * @brief Default value for core_param.drc.tcp.checkstum
  */
@@ -132,7 +159,7 @@ typedef enum protos {
 /**
  * @brief Default value for core_param.drc.udp.cachesz
  */
-#define DRC_UDP_CACHESZ 599	/* make prime */
+#define DRC_UDP_CACHESZ 599	/* unused */
 
 /**
  * @brief Default value for core_param.drc.udp.hiwat
@@ -154,6 +181,26 @@ typedef enum protos {
  */
 #define NFS_DEFAULT_RECV_BUFFER_SIZE 1048576
 
+/**
+ * Maximum value for core_param.rpc.listeners
+ */
+#define RPC_LISTENERS_MAX 64
+
+/**
+ * Default value for core_param.port[P_NFS_RDMA]
+ */
+#define NFS_RDMA_PORT 20049
+
+/**
+ * Default value for core_param.rdma.credits
+ */
+#define NFS_RDMA_CREDITS 30
+
+/**
+ * Default value for core_param.rdma.backlog
+ */
+#define NFS_RDMA_BACKLOG 10
+
 /**
  * @brief Turn off all protocols
  */
@@ -216,6 +263,61 @@ typedef struct nfs_core_param {
 	/** Number of worker threads.  Set to NB_WORKER_DEFAULT by
 	    default and changed with the Nb_Worker option. */
 	uint32_t nb_worker;
+	/** Number of request queue shards.  Decoders enqueue on the
+	    shard of the CPU they run on, workers dequeue locally and
+	    steal from the other shards when idle.  0 means one shard
+	    per online CPU.  Defaults to 1 and settable with
+	    Req_Queue_Shards. */
+	uint32_t req_queue_shards;
+	/** Request queue class scheduling. */
+	struct {
+		/** Relative share of dequeues for metadata and lease
+		    requests.  Settable with Req_Queue_Weight_Latency. */
+		uint32_t weight_latency;
+		/** Relative share of dequeues for small I/O.  Settable
+		    with Req_Queue_Weight_Small_IO. */
+		uint32_t weight_small_io;
+		/** Relative share of dequeues for bulk I/O.  Settable
+		    with Req_Queue_Weight_Bulk_IO. */
+		uint32_t weight_bulk_io;
+		/** Relative share of dequeues for callbacks.  Settable
+		    with Req_Queue_Weight_Callback. */
+		uint32_t weight_callback;
+		/** READ/WRITE of at least this many bytes are queued as
+		    bulk I/O.  Settable with Req_Queue_Bulk_Size. */
+		uint32_t bulk_size;
+	} req_queue;
+	/** Adaptive sizing of the worker pool, which then starts with
+	    Nb_Worker threads, clamped to the bounds. */
+	struct {
+		/** Whether the pool is resized at all.  Settable with
+		    Worker_Adaptive. */
+		bool enable;
+		/** Fewest workers.  Settable with Worker_Min. */
+		uint32_t min;
+		/** Most workers.  Settable with Worker_Max. */
+		uint32_t max;
+		/** Average queue wait, in microseconds, above which the
+		    pool grows.  Settable with Worker_Grow_Wait. */
+		uint32_t grow_wait;
+		/** Seconds between two decisions.  Settable with
+		    Worker_Adapt_Interval. */
+		uint32_t interval;
+	} worker_adapt;
+	/** Most memory, in bytes, the I/O buffer pool keeps around
+	    for reuse.  0 disables recycling.  Settable with
+	    IO_Buffer_Pool_Size. */
+	uint64_t iobuf_pool_size;
+	/** How new I/O buffers are backed by huge pages.  Defaults
+	    to HUGE_PAGES_NONE, settable with IO_Buffer_Huge_Pages. */
+	enum huge_pages iobuf_huge_pages;
+	/** Bytes of huge pages I/O buffers are carved from.
+	    Settable with IO_Buffer_Huge_Size. */
+	uint64_t iobuf_huge_size;
+	/** Whether worker and connection threads are pinned to NUMA
+	    nodes.  Defaults to NUMA_POLICY_NONE, settable with
+	    NUMA_Policy. */
+	enum numa_policy numa_policy;
 	/** For NFSv3, whether to drop rather than reply to requests
 	    yielding I/O errors.  True by default and settable with
 	    Drop_IO_Errors.  As this generally results in client
@@ -238,6 +340,14 @@ typedef struct nfs_core_param {
 		/** Whether to disable the DRC entirely.  Defaults to
 		    false, settable by DRC_Disabled. */
 		bool disabled;
+		/** Whether to keep the encoded reply of a request once
+		    it has been retransmitted, so further retransmits
+		    are sent without encoding.  Defaults to false,
+		    settable by DRC_Encoded_Replies. */
+		bool encoded;
+		/** Largest reply kept encoded, in bytes.  Defaults to
+		    DRC_ENCODED_MAX, settable by DRC_Encoded_Reply_Max. */
+		uint32_t encoded_max;
 		/* Parameters controlling TCP specific DRC behavior. */
 		struct {
 			/** Number of partitions in the tree for the
@@ -271,6 +381,21 @@ typedef struct nfs_core_param {
 			    DRC_TCP_RECYCLE_EXPIRE_S and settable by
 			    DRC_TCP_Recycle_Expire_S. */
 			uint32_t recycle_expire_s;
+			/** How long (in seconds) a DRC may go
+			    without a request before its cached
+			    replies and index are freed, 0 for never.
+			    Defaults to DRC_TCP_IDLE_SHRINK_S and
+			    settable by DRC_TCP_Idle_Shrink_S. */
+			uint32_t idle_shrink_s;
+			/** Bytes of cached replies all the TCP DRCs
+			    may grow to when sized by what they see
+			    retransmitted, 0 to keep them at hiwat.
+			    Settable by DRC_TCP_Adaptive_Budget. */
+			uint64_t adaptive_budget;
+			/** Fewest replies an adaptive DRC keeps.
+			    Defaults to DRC_TCP_HIWAT_MIN and settable
+			    by DRC_TCP_Hiwat_Min. */
+			uint32_t hiwat_min;
 			/** Whether to use a checksum to match
 			    requests as well as the XID.  Defaults to
 			    DRC_TCP_CHECKSUM and settable by
@@ -323,6 +448,14 @@ typedef struct nfs_core_param {
 		/** TIRPC ioq max simultaneous io threads.  Defaults to
 		    200 and settable by RPC_Ioq_ThrdMax. */
 		uint32_t ioq_thrd_max;
+		/** SO_REUSEPORT listeners per NFS socket, each on an
+		    event channel of its own.  Defaults to 1 and settable
+		    by RPC_Listeners. */
+		uint32_t listeners;
+		/** Readiness events each event channel takes from the
+		    kernel per wakeup.  Defaults to 1024 and settable by
+		    RPC_Max_Events. */
+		uint32_t max_events;
 		struct {
 			/** Partitions in GSS ctx cache table (default 13). */
 			uint32_t ctx_hash_partitions;
@@ -336,6 +469,37 @@ typedef struct nfs_core_param {
 			uint32_t max_gc;
 		} gss;
 	} rpc;
+	/** Parameters of the RPC/RDMA listener. */
+	struct {
+		/** Requests a client may have outstanding on a
+		    connection, the send and receive queues get two
+		    more.  Defaults to NFS_RDMA_CREDITS and settable
+		    by NFS_RDMA_Credits. */
+		uint32_t credits;
+		/** Connections waiting to be accepted.  Defaults to
+		    NFS_RDMA_BACKLOG and settable by
+		    NFS_RDMA_Backlog. */
+		uint32_t backlog;
+	} rdma;
+	/** RPC-over-TLS (RFC 9289), with USE_RPC_TLS */
+	struct {
+		/** Whether clients may start TLS on a TCP connection.
+		    Settable with Enable_RPC_TLS. */
+		bool enable;
+		/** Whether only the NULL procedure is served without TLS.
+		    Settable with RPC_TLS_Required. */
+		bool required;
+		/** PEM certificate chain of the server.  Settable with
+		    RPC_TLS_Cert_File. */
+		char *cert_file;
+		/** PEM private key of the server.  Settable with
+		    RPC_TLS_Key_File. */
+		char *key_file;
+		/** PEM certificates trusted to sign client certificates,
+		    NULL not to ask clients for one.  Settable with
+		    RPC_TLS_CA_File. */
+		char *ca_file;
+	} tls;
 	/** Polling interval for blocked lock polling thread. */
 	time_t blocked_lock_poller_interval;
 	/** Protocols to support.  Should probably be renamed.
@@ -362,6 +526,23 @@ typedef struct nfs_core_param {
 	bool enable_FASTSTATS;
 	/** Whether to collect FSAL stats.  Defaults to false. */
 	bool enable_FSALSTATS;
+	/** Whether to keep per operation latency histograms.  Defaults
+	    to false. */
+	bool enable_LATENCY_HIST;
+	/** Whether to keep per operation histograms of the time requests
+	    spend decoding, queued, executing, in the FSAL and replying.
+	    Defaults to false. */
+	bool enable_STAGE_HIST;
+	/** Whether to track the handles and clients with the most
+	    operations and bytes, see server_topk.h.  Defaults to
+	    false. */
+	bool enable_TOP_TRACKING;
+	/** Whether to track the users with the most operations, bytes
+	    and time, see server_topk.h.  Defaults to false. */
+	bool enable_USER_TRACKING;
+	/** Whether each thread counts NFS stats in its own copy, added
+	    up when they are read.  Defaults to false. */
+	bool enable_PERTHREAD_STATS;
 	/** Whether tcp sockets should use SO_KEEPALIVE */
 	bool enable_tcp_keepalive;
 	/** Maximum number of TCP probes before dropping the connection */
@@ -375,10 +556,22 @@ typedef struct nfs_core_param {
 	    VMware NFSv3 client has a max limit of 56 byte file handles!
 	    Defaults to false. */
 	bool short_file_handle;
+	/** NFSv3 pre-op attributes only come from cached attributes, and
+	    are left out when they are not cached.  WRITE only reports
+	    them in this mode.  Defaults to false, settable with
+	    Cached_Pre_Op_Attrs. */
+	bool cached_pre_op_attrs;
 	/** How long the server will trust information it got by
 	    calling getgroups() when "Manage_Gids = TRUE" is
 	    used in a export entry. */
 	time_t manage_gids_expiration;
+	/** How long the server will remember that a user or group could
+	    not be mapped before looking it up again. */
+	time_t negative_cache_expiration;
+	/** Number of threads used to initialize export roots and mount
+	    the pseudo fs at startup.  Defaults to 16 and settable with
+	    Export_Init_Threads. */
+	uint32_t export_init_threads;
 	/** Path to the directory containing server specific
 	    modules.  In particular, this is where FSALs live. */
 	char *ganesha_modules_loc;
@@ -394,6 +587,63 @@ typedef struct nfs_core_param {
 	    ganesha instance. If this is set, dbus name will be
 	    <prefix>.org.ganesha.nfsd */
 	char *dbus_name_prefix;
+	/** How far over its Max_IOPS or Max_Bandwidth, in ms of budget,
+	    a request still goes ahead; the client is told to retry one
+	    further over.  Settable with Throttle_Max_Delay. */
+	uint32_t throttle_max_delay;
+	/** File the stats are published in, see gsh_stats_shm.h.  Settable
+	    with Stats_Shm_File, NULL to publish nothing. */
+	char *stats_shm_file;
+	/** Seconds between updates of the published stats.  Settable with
+	    Stats_Shm_Interval. */
+	uint32_t stats_shm_interval;
+	/** Port serving the published stats to Prometheus, 0 for none.
+	    Settable with Stats_HTTP_Port. */
+	uint16_t stats_http_port;
+	/** Seconds an RQUOTA reply is served from the quota cache, 0 to
+	    ask the FSAL every time.  Settable with Rquota_Cache_Time. */
+	uint32_t rquota_cache_time;
+	/** File the requests are captured in, see nfs_capture.h.
+	    Settable with Capture_File, NULL to capture nothing. */
+	char *capture_file;
+	/** Bytes of capture each thread can queue before dropping.
+	    Settable with Capture_Ring_Size. */
+	uint32_t capture_ring_size;
+	/** Milliseconds past which a request is logged as slow, 0 to log
+	    none.  Settable with Slow_Request_Threshold. */
+	uint32_t slow_request_threshold;
+	/** Most slow requests logged a second.  Settable with
+	    Slow_Request_Log_Rate. */
+	uint32_t slow_request_log_rate;
+	/** Log one in this many slow requests.  Settable with
+	    Slow_Request_Sample. */
+	uint32_t slow_request_sample;
+	/** Milliseconds past which a request not yet executed is dropped
+	    for its client to retransmit, 0 to drop none.  NFSv4 requests
+	    are not dropped for their age.  Settable with
+	    Max_Request_Age. */
+	uint32_t max_request_age;
+	/** Requests in progress from which connections holding more
+	    than their share stop being read, 0 for no limit.  Settable
+	    with Admission_High_Requests. */
+	uint32_t admission_high_requests;
+	/** Requests in progress below which they are read again, 0 for
+	    3/4 of the high watermark.  Settable with
+	    Admission_Low_Requests. */
+	uint32_t admission_low_requests;
+	/** Bytes of requests and I/O buffers from which connections
+	    stop being read, 0 for no limit.  Only counted with
+	    ENABLE_MEM_ACCOUNTING.  Settable with Admission_High_Bytes. */
+	uint64_t admission_high_bytes;
+	/** Bytes below which they are read again, 0 for 3/4 of the high
+	    watermark.  Settable with Admission_Low_Bytes. */
+	uint64_t admission_low_bytes;
+	/** Seconds each top tracking summary counts.  Settable with
+	    Top_Tracking_Interval. */
+	uint32_t top_tracking_interval;
+	/** Keys each top tracking summary keeps.  Settable with
+	    Top_Tracking_Entries. */
+	uint32_t top_tracking_entries;
 } nfs_core_parameter_t;
 
 /** @} */
@@ -455,6 +705,15 @@ typedef struct nfs_version4_parameter {
 	/** The NFS grace period.  Defaults to
 	    GRACE_PERIOD_DEFAULT and is settable with Grace_Period. */
 	uint32_t grace_period;
+	/** Least time the grace period lasts before it may be lifted
+	    with clients from the recovery database still missing.
+	    Defaults to 0, meaning Lease_Lifetime, and is settable
+	    with Min_Grace_Period. */
+	uint32_t min_grace_period;
+	/** COMPOUNDs of one client whose reclaims wait for a partition
+	    slot ahead of other requests during grace.  Defaults to 16
+	    and is settable with Reclaim_Priority_Per_Client. */
+	uint32_t reclaim_priority_per_client;
 	/** Domain to use if we aren't using the nfsidmap.  Defaults
 	    to DOMAINNAME_DEFAULT and is set with DomainName. */
 	char *domainname;
@@ -478,6 +737,26 @@ typedef struct nfs_version4_parameter {
 	/** Whether to allow delegations. Defaults to false and settable
 	    with Delegations */
 	bool allow_delegations;
+	/** Whether to grant directory delegations. Defaults to false and
+	    settable with Directory_Delegations */
+	bool allow_dir_delegations;
+	/** Whether to refer clients crossing into an export to the least
+	    loaded cluster node.  Defaults to false and settable with
+	    Dynamic_Referrals */
+	bool dynamic_referrals;
+	/** Clients this node must have over the least loaded one before
+	    it refers any.  Settable with Referral_Load_Slack */
+	uint32_t referral_load_slack;
+	/** Whether clients whose lease ran out keep their state until it
+	    conflicts.  Defaults to false and settable with
+	    Courteous_Server */
+	bool courteous_server;
+	/** Seconds a client whose lease ran out keeps its state at most.
+	    Settable with Courtesy_Max_Time */
+	uint32_t courtesy_max_time;
+	/** Most clients keeping state with their lease run out.  Settable
+	    with Max_Courtesy_Clients */
+	uint32_t max_courtesy_clients;
 	/** Delay after which server will retry a recall in case of failures */
 	uint32_t deleg_recall_retry_delay;
 	/** Whether this a pNFS MDS server. Defaults to false */
@@ -490,6 +769,14 @@ typedef struct nfs_version4_parameter {
 	unsigned int minor_versions;
 	/** Number of allowed slots in the 4.1 slot table */
 	uint32_t nb_slots;
+	/** Largest COPY done before replying */
+	uint64_t copy_sync_max;
+	/** Threads doing asynchronous COPY, 0 for none */
+	uint32_t copy_threads;
+	/** Handles each worker remembers the PUTFH of, 0 for none */
+	uint32_t putfh_cache_size;
+	/** Threads resolving PUTFH handles, 0 for none */
+	uint32_t putfh_resolve_threads;
 } nfs_version4_parameter_t;
 
 /** @} */
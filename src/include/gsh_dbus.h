@@ -123,6 +123,13 @@
 	.direction = "in"	\
 }
 
+#define CONFIG_ARG		\
+{				\
+	.name = "config",	\
+	.type = "s",		\
+	.direction = "in"	\
+}
+
 #define FSAL_ARG		\
 {				\
 	.name = "fsal",		\
@@ -223,6 +230,8 @@ void *gsh_dbus_thread(void *arg);
 
 /* callout method */
 void dbus_append_timestamp(DBusMessageIter *iterp, struct timespec *ts);
+struct lat_hist;
+void dbus_append_lat_hist(DBusMessageIter *iterp, struct lat_hist *hist);
 void dbus_status_reply(DBusMessageIter *iter, bool success, char *errormsg);
 int32_t gsh_dbus_register_path(const char *name,
 			       struct gsh_dbus_interface **interfaces);
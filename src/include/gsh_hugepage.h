@@ -0,0 +1,72 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_hugepage.h
+ * @brief Regions of memory on 2 MiB pages
+ *
+ * A region is mapped once, either from the hugetlbfs pool or as
+ * anonymous memory the kernel is asked to back with transparent huge
+ * pages, and carved from the front.  What is carved is never given
+ * back, so it suits objects that are recycled rather than freed, like
+ * I/O buffers.  A region that can't be mapped the way asked falls back
+ * to the next weaker way, and at worst is empty so that every carve
+ * fails and the caller allocates as usual.
+ */
+
+#ifndef GSH_HUGEPAGE_H
+#define GSH_HUGEPAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/** Size of the huge pages used */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/**
+ * @brief How a region is backed
+ */
+enum huge_pages {
+	HUGE_PAGES_NONE,	/*< Not mapped, carving fails */
+	HUGE_PAGES_THP,		/*< Transparent huge pages */
+	HUGE_PAGES_HUGETLB	/*< Reserved hugetlbfs pages */
+};
+
+struct huge_region {
+	pthread_mutex_t mtx;
+	const char *name;
+	char *base;
+	size_t size;
+	size_t used;		/*< Bytes carved, protected by mtx */
+	enum huge_pages backing;
+};
+
+void huge_region_init(struct huge_region *region, const char *name,
+		      enum huge_pages want, size_t size);
+void *huge_region_carve(struct huge_region *region, size_t size);
+uint64_t huge_region_backed(struct huge_region *region);
+const char *huge_pages_str(enum huge_pages backing);
+
+#endif				/* GSH_HUGEPAGE_H */
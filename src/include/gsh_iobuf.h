@@ -0,0 +1,83 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_iobuf.h
+ * @brief Recycled I/O data buffers
+ *
+ * READ style replies need a large, page aligned buffer for every
+ * call.  Rather than going to malloc for each of them, buffers are
+ * kept in power of two size classes, with a small per-thread cache
+ * in front of a global free list per class.  The amount of idle
+ * memory kept around is bounded by IO_Buffer_Pool_Size.
+ *
+ * With IO_Buffer_Huge_Pages, new buffers are first carved from a
+ * region of IO_Buffer_Huge_Size bytes on 2 MiB pages.  Those are never
+ * given back to the system, only recycled, and are not counted against
+ * IO_Buffer_Pool_Size.
+ *
+ * Buffers handed out by iobuf_alloc() must be released with
+ * iobuf_free(), never with gsh_free().
+ */
+
+#ifndef GSH_IOBUF_H
+#define GSH_IOBUF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Alignment of every buffer handed out */
+#define IOBUF_ALIGN 4096
+
+/** Smallest size class, as a power of two */
+#define IOBUF_MIN_SHIFT 12
+
+/** Largest size class, as a power of two.  Bigger requests still
+ *  work, they are just not recycled.
+ */
+#define IOBUF_MAX_SHIFT 24
+
+#define IOBUF_NCLASSES (IOBUF_MAX_SHIFT - IOBUF_MIN_SHIFT + 1)
+
+/** Buffers kept per class in each thread */
+#define IOBUF_TCACHE_DEPTH 4
+
+/**
+ * @brief Pool counters, for stats reporting
+ */
+struct iobuf_stats {
+	uint64_t allocs;	/*< Total allocations */
+	uint64_t reused;	/*< Allocations satisfied from the pool */
+	uint64_t idle_bytes;	/*< Memory currently sitting in the pool */
+	uint64_t huge_size;	/*< Bytes of the huge page region */
+	uint64_t huge_used;	/*< Of those, carved into buffers */
+	uint64_t huge_backed;	/*< Of those, actually on huge pages */
+	const char *huge_pages;	/*< How the region is backed */
+};
+
+void iobuf_pkginit(void);
+void *iobuf_alloc(size_t size);
+void iobuf_free(void *buf);
+void iobuf_get_stats(struct iobuf_stats *stats);
+
+#endif				/* GSH_IOBUF_H */
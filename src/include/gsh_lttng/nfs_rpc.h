@@ -152,6 +152,46 @@ TRACEPOINT_LOGLEVEL(
 	v4op_end,
 	TRACE_INFO)
 
+/**
+ * @brief Trace the stages of a request, once it is replied to
+ *
+ * Only with Enable_Stage_Histograms, times are in nsecs
+ *
+ * @param req     - the address of the request
+ * @param xid     - its RPC xid
+ * @param decode  - receipt to arguments decoded
+ * @param queue   - decoded to executing
+ * @param execute - execution, less the time in the FSAL
+ * @param fsal    - calls from MDCACHE to the FSAL
+ * @param reply   - encoding and sending the reply
+ */
+
+TRACEPOINT_EVENT(
+	nfs_rpc,
+	stages,
+	TP_ARGS(request_data_t *, req,
+		uint32_t, xid,
+		uint64_t, decode,
+		uint64_t, queue,
+		uint64_t, execute,
+		uint64_t, fsal,
+		uint64_t, reply),
+	TP_FIELDS(
+		ctf_integer_hex(request_data_t *, req, req)
+		ctf_integer(uint32_t, xid, xid)
+		ctf_integer(uint64_t, decode, decode)
+		ctf_integer(uint64_t, queue, queue)
+		ctf_integer(uint64_t, execute, execute)
+		ctf_integer(uint64_t, fsal, fsal)
+		ctf_integer(uint64_t, reply, reply)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	nfs_rpc,
+	stages,
+	TRACE_INFO)
+
 #endif /* GANESHA_LTTNG_NFS_RPC_H */
 
 #undef TRACEPOINT_INCLUDE
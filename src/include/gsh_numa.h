@@ -0,0 +1,58 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_numa.h
+ * @brief NUMA topology and thread placement
+ *
+ * The topology is read from sysfs once, on first use.  Without it,
+ * everything is node 0 and nothing is ever pinned.
+ *
+ * The caches that keep per-node state (object pool depots, I/O
+ * buffers) always use the node of the calling CPU.  Pinning threads
+ * to nodes is up to NUMA_Policy.
+ */
+
+#ifndef GSH_NUMA_H
+#define GSH_NUMA_H
+
+#include <stdint.h>
+
+/** Most NUMA nodes told apart, higher ones are folded onto these */
+#define GSH_NUMA_MAX_NODES 64
+
+/**
+ * @brief Values of NUMA_Policy
+ */
+enum numa_policy {
+	NUMA_POLICY_NONE,	/*< Let the scheduler place threads */
+	NUMA_POLICY_LOCAL	/*< Pin threads to nodes */
+};
+
+uint32_t gsh_numa_nodes(void);
+uint32_t gsh_numa_local_node(void);
+int gsh_numa_socket_node(int fd);
+void gsh_numa_bind(uint32_t node);
+void gsh_numa_bind_next(uint32_t *next);
+
+#endif				/* GSH_NUMA_H */
@@ -0,0 +1,86 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_partition.h
+ * @brief Isolation partitions of exports
+ *
+ * A PARTITION block names a budget of requests that may run at once
+ * and of requests that may wait for one of those to finish.  Exports
+ * are put in a partition with Partition = name; their requests hold a
+ * slot of it while they run.  A request finding the partition full
+ * waits at most Max_Wait in its queue, and one finding the queue full
+ * too, or still waiting after that, is answered with NFS3ERR_JUKEBOX or
+ * NFS4ERR_DELAY.  A backend that stops answering thus only ties up the
+ * threads its own partition is allowed, the other exports go on.
+ * During grace, reclaims waiting for a slot are given one before any
+ * other request.
+ *
+ * Exports in no partition are not limited.  Partitions are read at
+ * start up and live as long as the server.
+ */
+
+#ifndef GSH_PARTITION_H
+#define GSH_PARTITION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "gsh_list.h"
+#include "config_parsing.h"
+
+struct gsh_partition {
+	struct glist_head node;
+	/** CFG: Name exports refer to */
+	char *name;
+	/** CFG: Requests that may run at once */
+	uint32_t max_workers;
+	/** CFG: Requests that may wait for a slot */
+	uint32_t max_queue;
+	/** CFG: Longest a request waits for a slot, in ms */
+	uint32_t max_wait;
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	/** Requests holding a slot, protected by mtx */
+	uint32_t active;
+	/** Requests waiting for one, protected by mtx */
+	uint32_t queued;
+	/** Of those, reclaims that go first, protected by mtx */
+	uint32_t queued_reclaim;
+	/** Most requests that held a slot at once */
+	uint32_t peak;
+	/** Requests that got a slot */
+	uint64_t admitted;
+	/** Requests that had to wait */
+	uint64_t waited;
+	/** Requests sent back to the client to retry */
+	uint64_t deferred;
+};
+
+int ReadPartitions(config_file_t in_config,
+		   struct config_error_type *err_type);
+struct gsh_partition *partition_lookup(const char *name);
+int nfs_partition_enter(bool reclaim);
+void nfs_partition_exit(void);
+
+#endif				/* GSH_PARTITION_H */
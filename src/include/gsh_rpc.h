@@ -130,12 +130,38 @@ typedef struct nfs_krb5_param {
 	    Kerberos support is compiled in) and settable with
 	    Active_krb5 */
 	bool active_krb5;
+	/** Number of threads that verify, decrypt and run integrity
+	    and privacy protected requests that may carry bulk data.
+	    0 keeps them on the thread that received them.  Defaults
+	    to 8 and settable with Crypto_Threads. */
+	uint32_t crypto_threads;
 } nfs_krb5_parameter_t;
 /** @} */
 /** @} */
 
+/**
+ * @brief Time spent on RPCSEC_GSS DATA requests of a service level
+ *
+ * Unwrap is verifying or decrypting and decoding the arguments, wrap
+ * is encoding, signing or encrypting and sending the reply.
+ */
+struct gss_svc_stats {
+	uint64_t requests;	/*< Requests unwrapped */
+	uint64_t replies;	/*< Replies wrapped */
+	uint64_t offloaded;	/*< Requests handed to a crypto thread */
+	uint64_t unwrap_ns;	/*< Total unwrap time */
+	uint64_t wrap_ns;	/*< Total wrap time */
+	uint64_t queue_ns;	/*< Total wait for a crypto thread */
+};
+
+extern struct gss_svc_stats gss_svc_stats[RPCSEC_GSS_SVC_PRIVACY + 1];
+
 void log_sperror_gss(char *, OM_uint32, OM_uint32);
 const char *str_gc_proc(rpc_gss_proc_t);
+const char *str_gc_svc(rpc_gss_svc_t);
+void gss_stats_unwrap(rpc_gss_svc_t svc, uint64_t ns);
+void gss_stats_wrap(rpc_gss_svc_t svc, uint64_t ns);
+void gss_stats_offload(rpc_gss_svc_t svc, uint64_t queue_ns);
 #endif /* _HAVE_GSSAPI */
 
 bool copy_xprt_addr(sockaddr_t *, SVCXPRT *);
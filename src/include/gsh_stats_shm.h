@@ -0,0 +1,147 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_stats_shm.h
+ * @brief Layout of the stats published in shared memory
+ *
+ * When Stats_Shm_File is set, a background thread copies the server,
+ * export and client counters into that file every Stats_Shm_Interval
+ * seconds.  Monitoring tools mmap the file read-only and never talk
+ * to the server, so scraping costs the serving threads nothing.
+ *
+ * The file starts with a struct gsh_stats_shm_hdr followed by
+ * nentries struct gsh_stats_shm_entry.  The first entry holds the
+ * server totals, then come the exports and the clients.  Only the
+ * file grows, and size tells how much of it is meaningful; a reader
+ * whose mapping is shorter than size must map it again.
+ *
+ * Updates are guarded by seq, a sequence lock.  A reader copies what
+ * it needs between two loads of seq and retries if the value was odd
+ * or changed.  This header only depends on stdint.h so that external
+ * readers can include it.
+ */
+
+#ifndef GSH_STATS_SHM_H
+#define GSH_STATS_SHM_H
+
+#include <stdint.h>
+
+#define GSH_STATS_SHM_MAGIC 0x47534853	/* "GSHS" */
+#define GSH_STATS_SHM_VERSION 1
+
+#define GSH_STATS_SHM_NAME_LEN 64
+#define GSH_STATS_SHM_OP_NAME_LEN 24
+
+/** NFSv3 procedures, NULL to COMMIT */
+#define GSH_STATS_SHM_V3_OPS 22
+/** NFSv4 operations, room for all minor versions */
+#define GSH_STATS_SHM_V4_OPS 80
+
+enum gsh_stats_shm_kind {
+	GSH_STATS_SHM_SERVER = 1,
+	GSH_STATS_SHM_EXPORT = 2,
+	GSH_STATS_SHM_CLIENT = 3
+};
+
+enum gsh_stats_shm_proto {
+	GSH_STATS_SHM_NFSV3,
+	GSH_STATS_SHM_NFSV40,
+	GSH_STATS_SHM_NFSV41,
+	GSH_STATS_SHM_NFSV42,
+	GSH_STATS_SHM_PROTOS
+};
+
+/**
+ * @brief Counters of a class of requests
+ *
+ * Latencies are sums in nanoseconds, divide by ops for an average.
+ */
+
+struct gsh_stats_shm_ops {
+	uint64_t ops;
+	uint64_t errors;
+	uint64_t latency;
+	uint64_t queue_latency;
+};
+
+/**
+ * @brief Counters of READ or WRITE
+ */
+
+struct gsh_stats_shm_io {
+	struct gsh_stats_shm_ops cmd;
+	uint64_t requested;	/*< Bytes asked for */
+	uint64_t transferred;	/*< Bytes actually moved */
+};
+
+/**
+ * @brief Counters of one protocol version
+ *
+ * For NFSv3 ops are calls, for NFSv4 they are COMPOUNDs.
+ */
+
+struct gsh_stats_shm_proto_stats {
+	struct gsh_stats_shm_ops ops;
+	struct gsh_stats_shm_io read;
+	struct gsh_stats_shm_io write;
+};
+
+/**
+ * @brief Server, export or client counters
+ */
+
+struct gsh_stats_shm_entry {
+	uint32_t kind;		/*< enum gsh_stats_shm_kind */
+	uint32_t id;		/*< Export id, 0 otherwise */
+	char name[GSH_STATS_SHM_NAME_LEN];	/*< Export path or client
+						    address */
+	struct gsh_stats_shm_proto_stats proto[GSH_STATS_SHM_PROTOS];
+};
+
+/**
+ * @brief Server wide count of an operation
+ */
+
+struct gsh_stats_shm_op {
+	char name[GSH_STATS_SHM_OP_NAME_LEN];	/*< Empty if unused */
+	uint64_t count;
+};
+
+struct gsh_stats_shm_hdr {
+	uint32_t magic;		/*< GSH_STATS_SHM_MAGIC */
+	uint32_t version;	/*< GSH_STATS_SHM_VERSION */
+	uint32_t seq;		/*< Odd while an update is in progress */
+	uint32_t nentries;	/*< Entries following the header */
+	uint64_t size;		/*< Bytes of the file in use */
+	uint64_t timestamp;	/*< Time of the last update, ns since
+				    the epoch */
+	struct gsh_stats_shm_op v3_ops[GSH_STATS_SHM_V3_OPS];
+	struct gsh_stats_shm_op v4_ops[GSH_STATS_SHM_V4_OPS];
+	struct gsh_stats_shm_entry entry[];
+};
+
+void stats_shm_start(void);
+void stats_shm_shutdown(void);
+
+#endif /* GSH_STATS_SHM_H */
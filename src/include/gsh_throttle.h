@@ -0,0 +1,93 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_throttle.h
+ * @brief Per-client and per-export request throttling
+ *
+ * Each export carries a pair of token buckets, one counting operations
+ * and one counting bytes read or written.  Each client carries a pair
+ * for the limits set on it over DBus, and a pair for each export whose
+ * client entries limit it, since those limits differ from one export
+ * to the next.  The buckets are kept as a theoretical arrival time
+ * (GCRA): a request costing c against a rate r pushes the time out by
+ * c/r seconds, and is within budget while that time is no more than
+ * THROTTLE_BURST_NS ahead of now.  Nothing waits: a request up to
+ * Throttle_Max_Delay over budget goes ahead at once, still charged so
+ * the rate holds over time, and one further over is not charged and is
+ * answered with NFS3ERR_JUKEBOX or NFS4ERR_DELAY so the client retries
+ * later; a request is never dropped.
+ */
+
+#ifndef GSH_THROTTLE_H
+#define GSH_THROTTLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "gsh_list.h"
+
+/** A full second of budget may be spent at once */
+#define THROTTLE_BURST_NS 1000000000ULL
+
+/** Theoretical arrival times of a pair of buckets */
+struct throttle_tat {
+	uint64_t ops;
+	uint64_t bytes;
+};
+
+/** A client's buckets for the limits of one export */
+struct throttle_bucket {
+	struct glist_head node;	/*< On the client's buckets */
+	uint16_t export_id;
+	struct throttle_tat tat;
+};
+
+struct gsh_throttle {
+	pthread_mutex_t mtx;
+	/** Operations per second, 0 for unlimited */
+	uint64_t iops;
+	/** Bytes per second, 0 for unlimited */
+	uint64_t bandwidth;
+	/** Limits were set over DBus and override the configuration */
+	uint32_t overridden;
+	/** Theoretical arrival times, protected by mtx */
+	struct throttle_tat tat;
+	/** A client's struct throttle_bucket per export, protected by mtx */
+	struct glist_head buckets;
+	/** Requests let through over budget */
+	uint64_t delayed;
+	/** Requests sent back to the client to retry */
+	uint64_t deferred;
+	/** Total time those let through were over budget by, in ns */
+	uint64_t delay_ns;
+};
+
+void throttle_init(struct gsh_throttle *throttle);
+void throttle_destroy(struct gsh_throttle *throttle);
+void throttle_set(struct gsh_throttle *throttle, uint64_t iops,
+		  uint64_t bandwidth, bool overridden);
+void throttle_clear(struct gsh_throttle *throttle);
+int nfs_throttle(uint64_t bytes);
+
+#endif				/* GSH_THROTTLE_H */
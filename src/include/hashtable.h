@@ -77,6 +77,10 @@ typedef int (*val_display_function_t)(struct gsh_buffdesc *, char *);
 #define HT_FLAG_NONE 0x0000	/*< Null hash table flags */
 #define HT_FLAG_CACHE 0x0001	/*< Indicates that caching should be
 				   enabled */
+#define HT_FLAG_OPEN 0x0002	/*< Keep each partition in an open
+				   addressing table that grows as
+				   needed, rather than a red-black
+				   tree.  The cache is not used. */
 
 /**
  * @brief Hash parameters
@@ -144,11 +148,28 @@ typedef struct hash_stat {
  * a hash table.
  */
 
+/**
+ * @brief A slot of an open addressing partition
+ */
+
+struct hash_slot {
+	uint64_t hash; /*< Saved hash of the key */
+	struct hash_data *data; /*< The entry, NULL if the slot is free */
+};
+
 struct hash_partition {
 	size_t count; /*< Numer of entries in this partition */
 	struct rbt_head rbt; /*< The red-black tree */
 	pthread_rwlock_t lock; /*< Lock for this partition */
 	struct rbt_node **cache; /*< Expected entry cache */
+	struct hash_slot *slots; /*< Open addressing table, a power of 2
+				     of nslots */
+	uint32_t nslots;
+	uint32_t old_nslots;
+	struct hash_slot *old_slots; /*< Smaller table being moved into
+					 slots, a few slots at each
+					 change */
+	uint32_t drained; /*< Slots of old_slots moved so far */
 };
 
 /**
@@ -176,6 +197,7 @@ typedef struct hash_table {
 
 struct hash_latch {
 	struct rbt_node *locator; /*< Saved location in the tree */
+	struct hash_data *data; /*< Saved entry found, NULL if none */
 	uint64_t rbt_hash; /*< Saved red-black hash */
 	uint32_t index;	/*< Saved partition index */
 };
@@ -344,7 +366,7 @@ hash_error_t hashtable_getref(struct hash_table *, struct gsh_buffdesc *,
 			      struct gsh_buffdesc *,
 			      void (*)(struct gsh_buffdesc *));
 
-typedef void (*ht_for_each_cb_t)(struct rbt_node *pn, void *arg);
+typedef void (*ht_for_each_cb_t)(struct hash_data *data, void *arg);
 void hashtable_for_each(struct hash_table *ht, ht_for_each_cb_t callback,
 				void *arg);
 /** @} */
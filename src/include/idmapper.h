@@ -54,19 +54,26 @@
  * @{
  */
 
-extern pthread_rwlock_t idmapper_user_lock;
-extern pthread_rwlock_t idmapper_group_lock;
+/**
+ * @brief Result of a lookup in the idmapper cache
+ */
+enum idmapper_status {
+	IDMAPPER_MISS,		/*< Not cached, look it up */
+	IDMAPPER_HIT,		/*< Cached and current */
+	IDMAPPER_REFRESH,	/*< Expired, the caller should refresh it
+				    and may serve it meanwhile */
+	IDMAPPER_STALE,		/*< Expired and already being refreshed */
+};
 
 void idmapper_cache_init(void);
-bool idmapper_add_user(const struct gsh_buffdesc *, uid_t, const gid_t *,
-		       bool);
-bool idmapper_add_group(const struct gsh_buffdesc *, gid_t);
-bool idmapper_lookup_by_uname(const struct gsh_buffdesc *, uid_t *,
-			      const gid_t **, bool);
-bool idmapper_lookup_by_uid(const uid_t, const struct gsh_buffdesc **,
-			    const gid_t **);
-bool idmapper_lookup_by_gname(const struct gsh_buffdesc *, uid_t *);
-bool idmapper_lookup_by_gid(const gid_t, const struct gsh_buffdesc **);
+void idmapper_add_name(bool, const struct gsh_buffdesc *, uint32_t,
+		       const gid_t *, bool);
+void idmapper_add_id(bool, uint32_t, const struct gsh_buffdesc *, bool);
+enum idmapper_status idmapper_lookup_name(bool, const struct gsh_buffdesc *,
+					  uint32_t *, gid_t *, bool *, bool *);
+enum idmapper_status idmapper_lookup_id(bool, uint32_t, struct gsh_buffdesc *,
+					size_t, bool *);
+void idmapper_refresh_failed(bool, const struct gsh_buffdesc *);
 /** @} */
 
 bool idmapper_init(void);
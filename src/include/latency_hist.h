@@ -0,0 +1,115 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file latency_hist.h
+ * @brief Log-linear latency histograms
+ *
+ * Each power of two range of nanoseconds is split into
+ * LAT_HIST_SUB linear buckets, so a bucket is never wider than
+ * 1/LAT_HIST_SUB of its value.  Recording is one atomic increment
+ * in a shard picked by the calling thread, so threads rarely share a
+ * cache line.  Readers merge the shards.
+ */
+
+#ifndef LATENCY_HIST_H
+#define LATENCY_HIST_H
+
+#include <stdint.h>
+#include "abstract_atomic.h"
+#include "gsh_intrinsic.h"
+
+/** Linear buckets per power of two, as a power of two */
+#define LAT_HIST_SUB_BITS 3
+#define LAT_HIST_SUB (1 << LAT_HIST_SUB_BITS)
+
+/** Latencies of 2^LAT_HIST_MAX_SHIFT ns (about 68 s) and up all land
+ *  in the last bucket.
+ */
+#define LAT_HIST_MAX_SHIFT 36
+
+#define LAT_HIST_BUCKETS \
+	((LAT_HIST_MAX_SHIFT - LAT_HIST_SUB_BITS + 2) * LAT_HIST_SUB)
+
+/** Shards per histogram */
+#define LAT_HIST_SHARDS 8
+
+struct lat_hist_shard {
+	uint64_t bucket[LAT_HIST_BUCKETS];
+	GSH_CACHE_PAD(0);
+};
+
+struct lat_hist {
+	struct lat_hist_shard shard[LAT_HIST_SHARDS];
+};
+
+extern __thread int lat_hist_shard_ix;
+
+int lat_hist_pick_shard(void);
+
+/**
+ * @brief Find the bucket for a latency
+ *
+ * @param[in] ns  Latency in nanoseconds
+ *
+ * @return Bucket index
+ */
+static inline uint32_t lat_hist_bucket(uint64_t ns)
+{
+	uint32_t msb;
+
+	if (ns < LAT_HIST_SUB)
+		return ns;
+
+	msb = 63 - __builtin_clzll(ns);
+	if (msb > LAT_HIST_MAX_SHIFT)
+		return LAT_HIST_BUCKETS - 1;
+
+	return (msb - LAT_HIST_SUB_BITS + 1) * LAT_HIST_SUB +
+	       ((ns >> (msb - LAT_HIST_SUB_BITS)) & (LAT_HIST_SUB - 1));
+}
+
+/**
+ * @brief Record one latency
+ *
+ * @param[in] hist  Histogram
+ * @param[in] ns    Latency in nanoseconds
+ */
+static inline void lat_hist_record(struct lat_hist *hist, uint64_t ns)
+{
+	int ix = lat_hist_shard_ix;
+
+	if (unlikely(ix < 0))
+		ix = lat_hist_pick_shard();
+
+	(void)atomic_inc_uint64_t(&hist->shard[ix].bucket[lat_hist_bucket(ns)]);
+}
+
+struct lat_hist *lat_hist_get(struct lat_hist **histp);
+uint64_t lat_hist_bucket_low(uint32_t ix);
+uint64_t lat_hist_merge(struct lat_hist *hist, uint64_t *buckets);
+uint64_t lat_hist_quantile(const uint64_t *buckets, uint64_t total,
+			   uint32_t permille);
+void lat_hist_reset(struct lat_hist *hist);
+
+#endif				/* LATENCY_HIST_H */
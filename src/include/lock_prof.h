@@ -0,0 +1,155 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file lock_prof.h
+ * @brief Lock contention profiler
+ *
+ * With ENABLE_LOCK_PROFILE, the PTHREAD_MUTEX_lock,
+ * PTHREAD_RWLOCK_rdlock and PTHREAD_RWLOCK_wrlock macros of
+ * common_utils.h each keep a static struct lock_prof_site, so a lock
+ * class is the place a lock is taken.  Once enabled with
+ * "EnableStats locks", each site counts:
+ *
+ * - the acquisitions that had to wait, and how long they waited.  An
+ *   acquisition first tries the lock, only one that fails reads the
+ *   clock;
+ * - one in LOCK_PROF_SAMPLE acquisitions of each thread, and how long
+ *   they held the lock until the PTHREAD_*_unlock that released it.
+ *   Hold time includes waits on a condition variable of the lock.
+ *
+ * Sites are only touched, and so only share a cache line between
+ * threads, on those two paths.  GetLockProfile reports the sites that
+ * waited the most.
+ */
+
+#ifndef LOCK_PROF_H
+#define LOCK_PROF_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "gsh_intrinsic.h"
+
+/** Acquisitions of a thread per hold time sample, as a power of two */
+#define LOCK_PROF_SAMPLE_BITS 6
+#define LOCK_PROF_SAMPLE (1 << LOCK_PROF_SAMPLE_BITS)
+
+/** Power of two buckets of wait and hold histograms, the last takes
+ *  2^(LOCK_PROF_BUCKETS - 1) ns (about 1 s) and up.
+ */
+#define LOCK_PROF_BUCKETS 31
+
+/** Sampled locks a thread can hold at once */
+#define LOCK_PROF_HELD 8
+
+enum lock_prof_kind {
+	LOCK_PROF_MUTEX,
+	LOCK_PROF_RDLOCK,
+	LOCK_PROF_WRLOCK
+};
+
+struct lock_prof_site {
+	const char *file;
+	const char *name;	/*< Lock expression */
+	uint32_t line;
+	uint32_t kind;		/*< enum lock_prof_kind */
+	struct lock_prof_site *next;	/*< In lock_prof_sites, or NULL */
+	uint32_t registered;
+	uint64_t contended;	/*< Acquisitions that waited */
+	uint64_t wait_ns;
+	uint64_t max_wait_ns;
+	uint64_t sampled;	/*< Acquisitions whose hold was timed */
+	uint64_t hold_ns;
+	uint64_t max_hold_ns;
+	uint64_t wait_hist[LOCK_PROF_BUCKETS];
+	uint64_t hold_hist[LOCK_PROF_BUCKETS];
+};
+
+extern bool lock_prof_enabled;
+extern __thread uint32_t lock_prof_countdown;
+extern __thread uint32_t lock_prof_nheld;
+
+int lock_prof_acquire(void *lock, struct lock_prof_site *site, int rc);
+void lock_prof_release_held(void *lock);
+void lock_prof_reset(void);
+
+/**
+ * @brief Try a lock, for lock_prof_acquire to wait on
+ */
+static inline int lock_prof_try(void *lock, uint32_t kind)
+{
+	switch (kind) {
+	case LOCK_PROF_MUTEX:
+		return pthread_mutex_trylock(lock);
+	case LOCK_PROF_RDLOCK:
+		return pthread_rwlock_tryrdlock(lock);
+	default:
+		return pthread_rwlock_trywrlock(lock);
+	}
+}
+
+/**
+ * @brief Take a lock through a profiled site
+ *
+ * Takes the lock the way the site's kind says.
+ *
+ * @param[in] lock  pthread_mutex_t or pthread_rwlock_t
+ * @param[in] site  Call site
+ *
+ * @return What the pthread call returned.
+ */
+static inline int lock_prof_lock(void *lock, struct lock_prof_site *site)
+{
+	int rc;
+
+	if (likely(!lock_prof_enabled)) {
+		switch (site->kind) {
+		case LOCK_PROF_MUTEX:
+			return pthread_mutex_lock(lock);
+		case LOCK_PROF_RDLOCK:
+			return pthread_rwlock_rdlock(lock);
+		default:
+			return pthread_rwlock_wrlock(lock);
+		}
+	}
+
+	rc = lock_prof_try(lock, site->kind);
+	if (likely(rc == 0) && likely(--lock_prof_countdown != 0))
+		return 0;
+
+	return lock_prof_acquire(lock, site, rc);
+}
+
+/**
+ * @brief Note the release of a lock
+ *
+ * @param[in] lock  Lock about to be unlocked
+ */
+static inline void lock_prof_release(void *lock)
+{
+	if (unlikely(lock_prof_nheld != 0))
+		lock_prof_release_held(lock);
+}
+
+#endif				/* LOCK_PROF_H */
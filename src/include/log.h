@@ -108,6 +108,7 @@ typedef enum log_components {
 	COMPONENT_FSAL_UP,
 	COMPONENT_DBUS,
 	COMPONENT_NFS_MSK,
+	COMPONENT_SLOW_REQ,
 	COMPONENT_COUNT
 } log_components_t;
 
@@ -200,6 +201,53 @@ int set_log_destination(const char *name, char *dest);
 int set_log_level(const char *name, log_levels_t max_level);
 void set_const_log_str(void);
 
+/**
+ * @brief What an async log facility does when a thread's ring is full
+ */
+enum log_async_full {
+	LOG_ASYNC_DROP,		/*< Drop the message and count it */
+	LOG_ASYNC_BLOCK		/*< Wait for the writer to make room */
+};
+
+struct log_async;
+
+int log_to_async(log_header_t headers, void *priv,
+		 log_levels_t level,
+		 struct display_buffer *buffer, char *compstr,
+		 char *message);
+struct log_async *log_async_create(const char *path, uint32_t ring_size,
+				   enum log_async_full full);
+void log_async_destroy(struct log_async *async);
+void log_async_set_path(struct log_async *async, const char *path);
+const char *log_async_path(struct log_async *async);
+int log_async_record(struct log_async *async, const void *rec, uint32_t len);
+
+/** Most arguments a traced message can have */
+#define LOG_TRACE_MAX_ARGS 16
+
+/**
+ * @brief A debug message call site, as known to the binary trace
+ *
+ * Each LogDebug(), LogMidDebug() and LogFullDebug() has one.  The
+ * format is parsed once, on first use, into the argument types.
+ */
+struct log_trace_site {
+	const char *format;	/*< Format the site was registered with */
+	uint32_t id;		/*< 0 until registered */
+	uint32_t gen;		/*< Trace file the site is described in */
+	uint8_t nargs;		/*< UINT8_MAX if the format can't be traced */
+	uint8_t types[LOG_TRACE_MAX_ARGS];
+};
+
+extern log_levels_t trace_log_level[COMPONENT_COUNT];
+
+void log_trace(struct log_trace_site *site, log_components_t component,
+	       const char *file, int line, const char *function,
+	       log_levels_t level, const char *format, ...)
+	__attribute__ ((format(printf, 7, 8)));
+int log_trace_setup(const char *file, uint32_t ring_size,
+		    enum log_async_full full, const log_levels_t *levels);
+
 struct log_component_info {
 	const char *comp_name;	/* component name */
 	const char *comp_str;	/* shorter, more useful name */
@@ -290,6 +338,18 @@ extern struct log_component_info LogComponents[COMPONENT_COUNT];
 						 NIV_INFO, format, ## args); \
 	} while (0)
 
+/**
+ * @brief Record a debug message in the binary trace
+ *
+ * Only the arguments are saved, formatting is left to the decoder.
+ */
+#define LogTraceLevel(component, level, format, args...) \
+	do { \
+		static struct log_trace_site trace_site; \
+		log_trace(&trace_site, component, __FILE__, __LINE__, \
+			  __func__, level, format, ## args); \
+	} while (0)
+
 #define LogDebug(component, format, args...) \
 	do { \
 		if (unlikely(component_log_level[component] \
@@ -298,6 +358,9 @@ extern struct log_component_info LogComponents[COMPONENT_COUNT];
 						 __LINE__, \
 						  __func__, \
 						 NIV_DEBUG, format, ## args); \
+		else if (unlikely(trace_log_level[component] \
+			 >= NIV_DEBUG)) \
+			LogTraceLevel(component, NIV_DEBUG, format, ## args); \
 	} while (0)
 
 #define LogMidDebug(component, format, args...) \
@@ -309,6 +372,10 @@ extern struct log_component_info LogComponents[COMPONENT_COUNT];
 						  __func__, \
 						 NIV_MID_DEBUG, \
 						 format, ## args); \
+		else if (unlikely(trace_log_level[component] \
+			 >= NIV_MID_DEBUG)) \
+			LogTraceLevel(component, NIV_MID_DEBUG, \
+				      format, ## args); \
 	} while (0)
 
 #define LogFullDebug(component, format, args...) \
@@ -320,6 +387,10 @@ extern struct log_component_info LogComponents[COMPONENT_COUNT];
 						  __func__, \
 						 NIV_FULL_DEBUG, \
 						 format, ## args); \
+		else if (unlikely(trace_log_level[component] \
+			 >= NIV_FULL_DEBUG)) \
+			LogTraceLevel(component, NIV_FULL_DEBUG, \
+				      format, ## args); \
 	} while (0)
 
 #define \
@@ -35,6 +35,8 @@
 #include "fsal_types.h"
 #include "fsal_up.h"
 
+struct gsh_export;
+
 /* Create an MDCACHE instance at the top of a stack */
 fsal_status_t
 mdcache_fsal_create_export(struct fsal_module *fsal_hdl, void *parse_node,
@@ -51,6 +53,19 @@ fsal_status_t mdcache_pkginit(void);
 int mdcache_set_param_from_conf(config_file_t parse_tree,
 				struct config_error_type *err_type);
 
+/* Save the cache snapshot, if one is configured */
+void mdcache_snapshot_save(void);
+
+/* Warm the cache with a subtree of an export, in the background */
+bool mdcache_warm_start(uint16_t export_id, const char *path,
+			uint32_t depth, uint32_t rate, bool symlinks,
+			char **errormsg);
+bool mdcache_warm_cancel(void);
+
+/* Drop what is cached of an export */
+uint64_t mdcache_export_invalidate(struct gsh_export *export);
+
 bool mdcache_lru_fds_available(void);
+size_t mdcache_lru_fds_excess(void);
 void init_fds_limit(void);
 #endif /* MDCACHE_H */
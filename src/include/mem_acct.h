@@ -0,0 +1,113 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file mem_acct.h
+ * @brief Memory accounting per subsystem
+ *
+ * With ENABLE_MEM_ACCOUNTING, the allocators that hold most of the
+ * memory of a busy server charge what they take from the general
+ * allocator to a subsystem: pools by the tag given with
+ * pool_set_mem_tag(), other objects through gsh_malloc_tag(),
+ * gsh_calloc_tag() and gsh_free_tag().  Bytes are the sizes asked
+ * for, without the allocator's own overhead, so the sum stays below
+ * the RSS.
+ *
+ * Each thread keeps its charges in deltas of its own and adds them to
+ * the totals once they pass MEM_ACCT_FLUSH bytes either way, and when
+ * it exits.  A total is then off by at most MEM_ACCT_FLUSH per thread.
+ *
+ * Without ENABLE_MEM_ACCOUNTING nothing is counted and every total is
+ * 0.
+ */
+
+#ifndef MEM_ACCT_H
+#define MEM_ACCT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gsh_intrinsic.h"
+
+enum mem_tag {
+	MEM_TAG_MDCACHE,	/*< Entries, dirent chunks and dirents */
+	MEM_TAG_STATE,		/*< State owners and client ids */
+	MEM_TAG_DRC,		/*< Duplicate request cache */
+	MEM_TAG_SESSION,	/*< NFSv4.1 sessions */
+	MEM_TAG_REQUEST,	/*< Requests and compounds in flight */
+	MEM_TAG_BUFFER,		/*< I/O buffers */
+	MEM_TAGS,
+	MEM_TAG_NONE = MEM_TAGS	/*< Not counted */
+};
+
+/** Bytes a thread's delta may reach before it is flushed */
+#define MEM_ACCT_FLUSH (256 * 1024)
+
+#ifdef ENABLE_MEM_ACCOUNTING
+
+struct mem_acct_delta {
+	int64_t bytes;
+	int64_t objects;
+};
+
+extern __thread struct mem_acct_delta mem_acct_deltas[MEM_TAGS];
+extern __thread bool mem_acct_registered;
+
+void mem_acct_flush(enum mem_tag tag);
+
+/**
+ * @brief Charge or credit a subsystem
+ *
+ * @param[in] tag      Subsystem, MEM_TAG_NONE is ignored
+ * @param[in] bytes    Bytes taken, negative for bytes given back
+ * @param[in] objects  Objects taken, negative for objects given back
+ */
+static inline void mem_acct_charge(enum mem_tag tag, int64_t bytes,
+				   int64_t objects)
+{
+	struct mem_acct_delta *delta;
+
+	if (tag >= MEM_TAGS)
+		return;
+
+	delta = &mem_acct_deltas[tag];
+	delta->bytes += bytes;
+	delta->objects += objects;
+	if (unlikely(!mem_acct_registered) ||
+	    unlikely(delta->bytes > MEM_ACCT_FLUSH ||
+		     delta->bytes < -MEM_ACCT_FLUSH))
+		mem_acct_flush(tag);
+}
+
+#else				/* ENABLE_MEM_ACCOUNTING */
+
+static inline void mem_acct_charge(enum mem_tag tag, int64_t bytes,
+				   int64_t objects)
+{
+}
+
+#endif				/* ENABLE_MEM_ACCOUNTING */
+
+uint64_t mem_acct_bytes(enum mem_tag tag);
+uint64_t mem_acct_bytes_except(enum mem_tag tag);
+
+#endif				/* MEM_ACCT_H */
@@ -25,5 +25,5 @@
 #define NETGROUP_CACHE_H
 void ng_cache_init(void);
 void ng_clear_cache(void);
-bool ng_innetgr(const char *group, const char *host);
+bool ng_innetgr(const char *group, const char *host, bool *timedout);
 #endif
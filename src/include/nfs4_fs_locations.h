@@ -35,4 +35,7 @@ fsal_fs_locations_t *nfs4_fs_locations_new(const char *fs_root,
 					   const char *rootpath,
 					   const unsigned int count);
 
+void nfs4_referral_refresh(void);
+fsal_fs_locations_t *nfs4_referral_locations(const char *pseudopath);
+
 #endif
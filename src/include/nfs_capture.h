@@ -0,0 +1,122 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs_capture.h
+ * @brief Layout of the request capture
+ *
+ * When Capture_File is set, every request the server replies to is
+ * recorded in that file once its reply is sent: when it started, how
+ * long it took, who sent it, what it was and how it ended.  Handles
+ * are only kept as a hash, names and data not at all, so a capture
+ * says what a workload did to which objects without what they hold.
+ * tools/ganesha_replay.py replays a capture against a test server.
+ *
+ * The file is a sequence of records, each starting with a struct
+ * nfs_capture_rec_hdr, in the byte order of the server.  The first
+ * record is a struct nfs_capture_file.  A request is a struct
+ * nfs_capture_req followed by nops struct nfs_capture_op: one per
+ * NFSv4 operation, one for the procedure of any other request.
+ * Records of different threads are not in time order.  This header
+ * only depends on stdint.h and stdbool.h so that external readers can
+ * include it.
+ */
+
+#ifndef NFS_CAPTURE_H
+#define NFS_CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define NFS_CAPTURE_MAGIC 0x47435054	/* "GCPT" */
+#define NFS_CAPTURE_VERSION 1
+
+/** Most NFSv4 operations recorded for a COMPOUND */
+#define NFS_CAPTURE_MAX_OPS 32
+
+enum nfs_capture_rec_type {
+	NFS_CAPTURE_REC_FILE = 1,	/*< Starts the file */
+	NFS_CAPTURE_REC_REQ,		/*< One request */
+	NFS_CAPTURE_REC_DROP		/*< Requests a thread dropped */
+};
+
+/* nfs_capture_req flags */
+#define NFS_CAPTURE_DROPPED 0x0001	/*< No reply was sent */
+#define NFS_CAPTURE_TRUNCATED 0x0002	/*< More ops than recorded */
+
+struct nfs_capture_rec_hdr {
+	uint32_t len;		/*< Whole record */
+	uint32_t type;
+};
+
+struct nfs_capture_file {
+	struct nfs_capture_rec_hdr hdr;
+	uint32_t magic;		/*< NFS_CAPTURE_MAGIC */
+	uint32_t version;	/*< NFS_CAPTURE_VERSION */
+	uint64_t ns;		/*< Capture start, ns since the epoch */
+};
+
+struct nfs_capture_req {
+	struct nfs_capture_rec_hdr hdr;
+	uint64_t ns;		/*< Processing start, ns since the epoch */
+	uint64_t latency;	/*< ns from processing start to reply */
+	uint64_t queue_wait;	/*< ns queued before processing */
+	uint32_t xid;
+	uint32_t prog;
+	uint16_t vers;
+	uint16_t proc;
+	int32_t status;		/*< NFS status, of the COMPOUND for v4 */
+	uint16_t export_id;	/*< UINT16_MAX if none */
+	uint16_t flags;
+	uint16_t family;	/*< Client address family */
+	uint16_t port;		/*< Client port, host byte order */
+	uint8_t addr[16];	/*< Client address, network byte order */
+	uint16_t minorversion;
+	uint16_t nops;
+	uint32_t reserved;
+};
+
+struct nfs_capture_op {
+	uint32_t op;		/*< NFSv4 operation or the procedure */
+	int32_t status;
+	uint64_t fh_hash;	/*< Handle operated on, 0 if not known */
+	uint64_t obj_hash;	/*< Handle looked up or created, or 0 */
+	uint64_t offset;	/*< Of READ, WRITE, COMMIT and locks */
+	uint64_t length;
+};
+
+struct nfs_capture_drop {
+	struct nfs_capture_rec_hdr hdr;
+	uint32_t tid;
+	uint32_t reserved;
+	uint64_t count;
+};
+
+struct request_data;
+
+extern bool nfs_capture_on;
+
+void nfs_capture_start(void);
+void nfs_capture_request(struct request_data *reqdata, int rc);
+
+#endif /* NFS_CAPTURE_H */
@@ -41,6 +41,7 @@
 #include "sal_data.h"
 #include "gsh_config.h"
 #include "gsh_wait_queue.h"
+#include "server_topk.h"
 
 #ifdef _USE_9P
 #include "9p.h"
@@ -112,6 +113,18 @@ typedef struct request_data {
 	struct glist_head req_q;	/* chaining of pending requests */
 	struct timespec time_queued;	/*< The time at which a request was
 					 *  added to the worker thread queue.
+					 *  For NFS, the time it was received.
+					 */
+	nsecs_elapsed_t decoded_time;	/*< When its arguments were decoded,
+					 *  0 if its stages are not timed.
+					 */
+	nsecs_elapsed_t exec_time;	/*< When it started executing */
+	struct fsal_call_rec fsal_calls[REQ_FSAL_CALLS];
+					/*< Its first FSAL calls, when slow
+					 *  requests are logged.
+					 */
+	struct topk_key top_fh;		/*< Handle of its operation, when
+					 *  top tracking.
 					 */
 	request_type_t rtype;
 } request_data_t;
@@ -150,6 +163,9 @@ int _9p_process_buffer(struct _9p_request_data *req9p, char *replydata,
 
 int _9p_worker_init(void);
 int _9p_worker_shutdown(void);
+bool _9p_worker_adapt_set(bool enable, uint32_t min, uint32_t max,
+			  uint32_t grow_wait, uint32_t interval,
+			  char **errormsg);
 void DispatchWork9P(request_data_t *req);
 #endif
 
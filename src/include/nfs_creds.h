@@ -48,6 +48,7 @@ void clean_credentials(void);
 void squash_setattr(struct attrlist *attr);
 
 nfsstat4 nfs_req_creds(struct svc_req *req);
+void nfs_creds_cache_flush(void);
 
 nfsstat4 nfs4_export_check_access(struct svc_req *req);
 
@@ -55,21 +55,62 @@ enum drc_type {
 #define DRC_FLAG_LOCKED 0x0010
 #define DRC_FLAG_RECYCLE 0x0020
 #define DRC_FLAG_RELEASE 0x0040
+#define DRC_FLAG_SHRUNK 0x0080	/*< Hash index freed while idle */
+
+/**
+ * @brief Slots in a DRC hash bucket
+ *
+ * Five tags, the overflow count and five pointers make a bucket
+ * exactly 64 bytes, so a probe touches one cache line per bucket.
+ */
+#define DRC_BUCKET_WAYS 5
+
+struct dupreq_entry;
+
+struct drc_bucket {
+	/** Low bits of the hash of each slot's entry */
+	uint32_t tag[DRC_BUCKET_WAYS];
+	/** Entries that probed past this bucket because it was full */
+	uint32_t overflow;
+	struct dupreq_entry *dv[DRC_BUCKET_WAYS];
+};
+
+/**
+ * @brief A partition of a DRC's open-addressing hash index
+ *
+ * Entries hash on (xid, checksum) to a home bucket and go in the
+ * first bucket from there with a free slot.  A lookup can stop at the
+ * first bucket with no overflow, so no tombstones are needed.
+ */
+struct drc_part {
+	pthread_mutex_t mtx;
+	uint32_t mask;		/*< buckets - 1 */
+	struct drc_bucket *buckets;
+};
 
 typedef struct drc {
 	enum drc_type type;
-	struct rbtree_x xt;
+	struct drc_part *part;
 	/* Define the tail queue */
 	TAILQ_HEAD(drc_tailq, dupreq_entry) dupreq_q;
 	pthread_mutex_t mtx;
 	uint32_t npart;
-	uint32_t cachesz;
 	uint32_t size;
 	uint32_t maxsize;
 	uint32_t hiwat;
 	uint32_t flags;
 	uint32_t refcnt; /* call path refs */
 	uint32_t retwnd;
+	uint32_t enc_bytes; /* encoded reply bytes held, protected by mtx */
+	uint32_t enc_max;
+	/* What the cache answered and missed, protected by mtx */
+	uint64_t hits;		/*< retransmissions answered */
+	uint64_t misses;	/*< requests cached */
+	uint32_t retrans_s;	/*< smoothed seconds from reply to retransmit */
+	/* Since the last nfs_dupreq_adapt(), protected by mtx */
+	uint32_t pass_hits;
+	uint32_t pass_misses;
+	uint32_t pass_depth;	/*< most requests since one answered again */
 	union {
 		struct {
 			sockaddr_t addr;
@@ -77,6 +118,7 @@ typedef struct drc {
 
 			TAILQ_ENTRY(drc) recycle_q; /* XXX drc */
 			time_t recycle_time;
+			time_t last_use; /* last request, protected by mtx */
 			uint64_t hk; /* hash key */
 		} tcp;
 	} d_u;
@@ -89,7 +131,6 @@ typedef enum dupreq_state {
 } dupreq_state_t;
 
 struct dupreq_entry {
-	struct opr_rbtree_node rbt_k;
 	/* Define the tail queue */
 	TAILQ_ENTRY(dupreq_entry) fifo_q;
 	pthread_mutex_t mtx;
@@ -108,7 +149,15 @@ struct dupreq_entry {
 	dupreq_state_t state;
 	uint32_t refcnt;
 	nfs_res_t *res;
+	/* Encoded reply, made on the first retransmit, protected by mtx;
+	 * buf and len are set under the DRC's mtx as well */
+	struct dupreq_encoded {
+		char *buf;
+		u_int len;
+		bool tried;
+	} enc;
 	time_t timestamp;
+	uint64_t seq;		/*< drc->misses when cached */
 };
 
 typedef struct dupreq_entry dupreq_entry_t;
@@ -145,5 +194,8 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *,
 dupreq_status_t nfs_dupreq_finish(struct svc_req *, nfs_res_t *);
 dupreq_status_t nfs_dupreq_delete(struct svc_req *);
 void nfs_dupreq_rele(struct svc_req *, const nfs_function_desc_t *);
+void nfs_dupreq_reply_results(struct svc_req *, const nfs_function_desc_t *);
+void nfs_dupreq_shrink_idle(void);
+void nfs_dupreq_adapt(void);
 
 #endif /* NFS_DUPREQ_H */
@@ -101,6 +101,9 @@ typedef struct exportlist_client_entry__ {
 /* Constants for export options masks */
 #define EXPORT_OPTION_FSID_SET 0x00000001 /* Set if Filesystem_id is set */
 #define EXPORT_OPTION_USE_COOKIE_VERIFIER 0x00000002 /* Use cookie verifier */
+/** Nothing is changed behind the export's back, so its cache never
+    expires and read delegations are given without heuristics. */
+#define EXPORT_OPTION_IMMUTABLE 0x00000004
 /** Controls whether a directory's dirent cache is trusted for
     negative results. */
 #define EXPORT_OPTION_TRUST_READIR_NEGATIVE_CACHE 0x00000008
@@ -111,6 +111,8 @@ static inline void nfs_check_malloc(void)
 /* in nfs_rpc_dispatcher_thread.c */
 
 int free_nfs_request(request_data_t *);
+void nfs_rpc_xprt_set_tls(SVCXPRT *xprt);
+bool nfs_rpc_xprt_tls(SVCXPRT *xprt);
 
 /* in nfs_worker_thread.c */
 
@@ -118,5 +120,21 @@ enum xprt_stat nfs_rpc_valid_NFS(struct svc_req *);
 enum xprt_stat nfs_rpc_valid_NLM(struct svc_req *);
 enum xprt_stat nfs_rpc_valid_MNT(struct svc_req *);
 enum xprt_stat nfs_rpc_valid_RQUOTA(struct svc_req *);
+void nfs_rpc_complete_async_request(request_data_t *reqdata, int rc);
+#ifdef _HAVE_GSSAPI
+int gss_crypto_pkginit(void);
+#endif
+
+/* in nfs_rpc_tls.c */
+
+#ifdef USE_RPC_TLS
+/** Flavor of the NULL call starting TLS, RFC 9289 */
+#ifndef AUTH_TLS
+#define AUTH_TLS 7
+#endif
+
+int nfs_rpc_tls_pkginit(void);
+enum xprt_stat nfs_rpc_tls_start(request_data_t *reqdata);
+#endif
 
 #endif				/* !NFS_INIT_H */
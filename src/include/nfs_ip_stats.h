@@ -13,6 +13,7 @@
 #define IP_NAME_INSERT_MALLOC_ERROR 1
 #define IP_NAME_NOT_FOUND           2
 #define IP_NAME_NETDB_ERROR         3
+#define IP_NAME_TIMEOUT             4
 
 #define IP_NAME_PREALLOC_SIZE      200
 
@@ -25,6 +26,9 @@ typedef struct nfs_ip_name__ {
 int nfs_ip_name_get(sockaddr_t *ipaddr, char *hostname, size_t size);
 int nfs_ip_name_add(sockaddr_t *ipaddr, char *hostname, size_t size);
 int nfs_ip_name_remove(sockaddr_t *ipaddr);
+int nfs_ip_name_resolve(sockaddr_t *ipaddr, char *hostname, size_t size);
+bool nfs_ip_name_deadline(struct timespec *deadline);
+bool nfs_ip_name_allow_on_timeout(void);
 
 int display_ip_name_key(struct gsh_buffdesc *pbuff, char *str);
 int display_ip_name_val(struct gsh_buffdesc *pbuff, char *str);
@@ -37,6 +37,7 @@
 #define NFS_PROTO_DATA_H
 
 #include "fsal_api.h"
+#include "nfs4_fs_locations.h"
 #include "rquota.h"
 
 /*
@@ -103,6 +104,7 @@ typedef union nfs_arg__ {
 struct COMPOUND4res_extended {
 	COMPOUND4res res_compound4;
 	bool res_cached;
+	bool res_pooled;	/*< resarray came from the resarray pool */
 };
 
 typedef union nfs_res__ {
@@ -194,6 +196,11 @@ typedef struct nfs_request {
 	nfs_arg_t arg_nfs;
 	nfs_res_t *res_nfs;
 	const nfs_function_desc_t *funcdesc;
+	/* Kept with the request rather than on the worker's stack so that
+	   a suspended request can be resumed on another thread */
+	struct req_op_context req_ctx;
+	struct export_perms export_perms;
+	struct user_cred user_credentials;
 } nfs_request_t;
 
 enum rpc_chan_type {
@@ -289,6 +296,42 @@ typedef struct nfs_client_cred__ {
  * This structure contains the necessary stuff for keeping the state
  * of a V4 compound request.
  */
+/**
+ * @brief A compiled FATTR4 encode plan
+ *
+ * The list of attributes an attrmask asks for, so that encoding the
+ * attributes of each READDIR entry does not walk the bitmap again.
+ * Consecutive fixed size attributes form a run that is encoded with
+ * one buffer reservation and straight stores; the others go through
+ * fattr4tab.
+ */
+struct fattr4_plan {
+	struct bitmap4 request;	/*< Attrmask the plan was compiled from */
+	bool valid;		/*< The plan has been compiled */
+	uint8_t nattrs;		/*< Number of attributes to encode */
+	uint8_t attrs[BITMAP4_MAPLEN * 32];	/*< Attributes, in order */
+	uint8_t run_cnt[BITMAP4_MAPLEN * 32];	/*< Attributes in the run
+						    starting here, 0 if none
+						    starts here */
+	uint16_t run_len[BITMAP4_MAPLEN * 32];	/*< Bytes of that run */
+};
+
+/** Stateids a COMPOUND keeps resolved */
+#define NFS4_STATEID_CACHE_SIZE 4
+
+/**
+ * @brief A stateid a COMPOUND has resolved to its state
+ *
+ * The entry holds a reference on the state until the COMPOUND is
+ * freed, and is only trusted while no stateid has been deleted since
+ * it was resolved.
+ */
+struct nfs4_stateid_cache {
+	stateid4 stateid;	/*< The stateid, only other is compared */
+	struct state_t *state;	/*< Its state, NULL if the entry is free */
+	uint64_t gen;		/*< Stateid generation it was resolved at */
+};
+
 typedef struct compound_data {
 	nfs_fh4 currentFH;	/*< Current filehandle */
 	nfs_fh4 savedFH;	/*< Saved filehandle */
@@ -302,6 +345,8 @@ typedef struct compound_data {
 	struct fsal_ds_handle *current_ds;	/*< current ds handle */
 	struct fsal_ds_handle *saved_ds;	/*< Saved DS handle */
 	object_file_type_t current_filetype;    /*< File type of current obj */
+	fsal_fs_locations_t *current_referral;	/*< Dynamic referral of
+						    currentFH, if any */
 	object_file_type_t saved_filetype;	/*< File type of saved entry */
 	struct gsh_export *saved_export; /*< Export entry related to the
 					     savedFH */
@@ -330,6 +375,23 @@ typedef struct compound_data {
 				   (if applicable) */
 	uint32_t resp_size;	/*< Running total response size. */
 	uint32_t op_resp_size;	/*< Current op's response size. */
+	struct fattr4_plan fattr_plan;	/*< Last compiled FATTR4 plan */
+	/* What nfs4_Compound needs to carry on after an op suspended */
+	nfs_argop4 *argarray;	/*< Op arguments */
+	nfs_res_t *res;		/*< COMPOUND result */
+	uint32_t argarray_len;	/*< Number of ops */
+	nfs_opnum4 opcode;	/*< Opcode of the current op */
+	nsecs_elapsed_t op_start_time;	/*< When the current op started */
+	nsecs_elapsed_t op_fsal_time;	/*< op_ctx->fsal_time then */
+	nfsstat4 status;	/*< Status of the last op processed */
+	uint32_t async_flags;	/*< NFS4_ASYNC_* handshake of the current op */
+	nfsstat4 async_status;	/*< Status the async op completed with */
+	struct nfs4_stateid_cache stateid_cache[NFS4_STATEID_CACHE_SIZE];
+	/*< Stateids resolved by this COMPOUND */
+	uint32_t stateid_cache_next;	/*< Entry of stateid_cache to reuse
+					    next */
+	bool reclaim_prio;	/*< Counted in the client's cid_reclaim_prio */
+	bool admitted;		/*< Charged to its throttles and partition */
 } compound_data_t;
 
 #define VARIABLE_RESP_SIZE (0)
@@ -359,6 +421,12 @@ static inline void set_current_entry(compound_data_t *data,
 		data->current_ds = NULL;
 	}
 
+	/* A referral only holds for the object it was made on */
+	if (data->current_referral) {
+		nfs4_fs_locations_release(data->current_referral);
+		data->current_referral = NULL;
+	}
+
 	if (data->current_obj) {
 		/* Release ref on old object */
 		data->current_obj->obj_ops->put_ref(data->current_obj);
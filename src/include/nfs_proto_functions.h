@@ -281,6 +281,9 @@ int nfs4_op_free_stateid(struct nfs_argop4 *, compound_data_t *,
 int nfs4_op_getdeviceinfo(struct nfs_argop4 *, compound_data_t *,
 			  struct nfs_resop4 *);
 
+int nfs4_op_get_dir_delegation(struct nfs_argop4 *, compound_data_t *,
+			       struct nfs_resop4 *);
+
 int nfs4_op_destroy_clientid(struct nfs_argop4 *, compound_data_t *,
 			     struct nfs_resop4 *);
 
@@ -331,6 +334,33 @@ int nfs4_op_deallocate(struct nfs_argop4 *, compound_data_t *,
 
 void nfs4_op_deallocate_Free(nfs_resop4 *resp);
 
+int nfs4_op_copy(struct nfs_argop4 *, compound_data_t *,
+		      struct nfs_resop4 *);
+
+void nfs4_op_copy_Free(nfs_resop4 *resp);
+
+int nfs4_op_clone(struct nfs_argop4 *, compound_data_t *,
+		      struct nfs_resop4 *);
+
+void nfs4_op_clone_Free(nfs_resop4 *resp);
+
+int nfs4_op_offload_status(struct nfs_argop4 *, compound_data_t *,
+		      struct nfs_resop4 *);
+
+void nfs4_op_offload_status_Free(nfs_resop4 *resp);
+
+int nfs4_op_offload_cancel(struct nfs_argop4 *, compound_data_t *,
+		      struct nfs_resop4 *);
+
+void nfs4_op_offload_cancel_Free(nfs_resop4 *resp);
+
+void nfs4_copy_pkginit(void);
+void nfs4_copy_pkgshutdown(void);
+
+void nfs4_putfh_pkginit(void);
+void nfs4_putfh_pkgshutdown(void);
+void nfs4_putfh_flush_export(struct gsh_export *export);
+
 int nfs4_op_seek(struct nfs_argop4 *, compound_data_t *,
 		      struct nfs_resop4 *);
 
@@ -378,6 +408,8 @@ void nfs4_op_removexattr_Free(nfs_resop4 *resp);
 
 #define NFS_REQ_OK   0
 #define NFS_REQ_DROP 1
+/** The request was suspended, nfs_rpc_complete_async_request() replies */
+#define NFS_REQ_ASYNC_WAIT 2
 
 /* Free functions */
 void mnt1_Mnt_Free(nfs_res_t *);
@@ -407,6 +439,15 @@ void rquota_getactivequota_Free(nfs_res_t *);
 void rquota_setquota_Free(nfs_res_t *);
 void rquota_setactivequota_Free(nfs_res_t *);
 
+/* Quota cache, in rquota_cache.c */
+fsal_status_t rquota_cache_get(struct gsh_export *exp, const char *path,
+			       int quota_type, int quota_id,
+			       fsal_quota_t *quota);
+void rquota_cache_forget(struct gsh_export *exp, const char *path,
+			 int quota_type, int quota_id);
+void rquota_cache_start(void);
+void rquota_cache_shutdown(void);
+
 void nfs_null_free(nfs_res_t *);
 
 void nfs3_getattr_free(nfs_res_t *);
@@ -431,6 +472,8 @@ void nfs3_pathconf_free(nfs_res_t *);
 void nfs3_commit_free(nfs_res_t *);
 void nfs3_read_free(nfs_res_t *);
 
+void nfs4_Compound_pkginit(void);
+const char *nfs4_op_name(nfs_opnum4 op);
 void nfs4_Compound_FreeOne(nfs_resop4 *);
 void nfs4_Compound_Free(nfs_res_t *);
 void nfs4_Compound_CopyResOne(nfs_resop4 *, nfs_resop4 *);
@@ -494,6 +537,7 @@ void nfs4_op_create_session_Free(nfs_resop4 *);
 void nfs4_op_getdevicelist_Free(nfs_resop4 *);
 void nfs4_op_getdeviceinfo_Free(nfs_resop4 *);
 void nfs4_op_free_stateid_Free(nfs_resop4 *);
+void nfs4_op_get_dir_delegation_Free(nfs_resop4 *);
 void nfs4_op_destroy_session_Free(nfs_resop4 *);
 void nfs4_op_lock_Free(nfs_resop4 *);
 void nfs4_op_lockt_Free(nfs_resop4 *);
@@ -508,8 +552,15 @@ void nfs4_op_reclaim_complete_Free(nfs_resop4 *);
 
 void compound_data_Free(compound_data_t *);
 
+/** An op returns this once nfs4_op_async_suspend() told it to suspend */
+#define NFS4_OP_ASYNC_WAIT (-1)
+
+bool nfs4_op_async_suspend(compound_data_t *data);
+void nfs4_op_async_done(compound_data_t *data, nfsstat4 status);
+
 /* Pseudo FS functions */
 bool pseudo_mount_export(struct gsh_export *exp);
+int pseudo_mount_depth(struct gsh_export *exp);
 void create_pseudofs(void);
 void pseudo_unmount_export(struct gsh_export *exp);
 
@@ -43,6 +43,7 @@
 #include "nfs_file_handle.h"
 #include "sal_data.h"
 #include "fsal.h"
+#include "gsh_arena.h"
 
 /* Hard and soft limit for nfsv4 quotas */
 #define NFS_V4_MAX_QUOTA_SOFT 4294967296LL	/*  4 GB */
@@ -85,6 +86,9 @@ struct xdr_attrs_args {
 	compound_data_t *data;
 	bool statfscalled;
 	fsal_dynamicfsinfo_t *dynamicinfo;
+	struct gsh_arena *arena;	/*< If set, the encoded attributes are
+					   allocated from it and must not be
+					   freed with nfs4_Fattr_Free. */
 };
 
 typedef struct fattr4_dent {
@@ -289,6 +293,9 @@ bool nfs3_Sattr_To_FSALattr(struct attrlist *, sattr3 *);
 
 int nfs4_Fattr_To_FSAL_attr(struct attrlist *, fattr4 *, compound_data_t *);
 
+int nfs4_Fattr_To_FSAL_attr_fh(struct attrlist *, fattr4 *, nfs_fh4 *,
+			       compound_data_t *);
+
 int nfs4_Fattr_To_fsinfo(fsal_dynamicfsinfo_t *, fattr4 *);
 
 int nfs4_Fattr_Fill_Error(compound_data_t *, fattr4 *, nfsstat4,
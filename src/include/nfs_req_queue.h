@@ -45,6 +45,8 @@ struct req_q {
 	uint32_t size;
 	uint32_t max;
 	uint32_t waiters;
+	uint64_t total;		/* requests that went through this queue */
+	uint64_t wait_ns;	/* consumer only, total time spent queued */
 };
 
 struct req_q_pair {
@@ -58,21 +60,60 @@ struct req_q_pair {
 
 enum req_q_e {
 	REQ_Q_LOW_LATENCY,	/*< GETATTR, RENEW, etc */
+	REQ_Q_SMALL_IO,		/*< READ/WRITE below the bulk threshold */
+	REQ_Q_BULK_IO,		/*< Large READ/WRITE */
+	REQ_Q_CALLBACK,		/*< Back channel work */
 	N_REQ_QUEUES
 };
 
+/**
+ * @brief Longest weighted dequeue schedule
+ *
+ * The sum of the class weights is clamped to this.
+ */
+#define REQ_Q_SCHED_MAX 64
+
 struct req_q_set {
 	struct req_q_pair qset[N_REQ_QUEUES];
 };
 
+/**
+ * @brief Weighted round robin schedule shared by all shards
+ *
+ * Each slot names the class a dequeue starts with.  Slots are spread
+ * so that each class gets its weight's share of the slots without
+ * bunching, and a dequeue falls through to the other classes in
+ * priority order when its class is empty, so the schedule is work
+ * conserving.
+ */
+struct req_q_sched {
+	uint32_t len;
+	uint8_t slot[REQ_Q_SCHED_MAX];
+};
+
+/**
+ * @brief One shard of the request queues
+ *
+ * Each shard carries its own queue set and its own list of idle
+ * workers, so that decoders and workers running on different CPUs
+ * do not bounce the same spinlocks.  Idle workers steal from other
+ * shards before going to sleep.
+ */
+struct req_q_shard {
+	struct req_q_set nfs_request_q;
+	pthread_spinlock_t sp;	/* protects wait_list */
+	struct glist_head wait_list;
+	uint32_t waiters;
+	GSH_CACHE_PAD(0);
+};
+
 struct nfs_req_st {
 	struct {
 		uint32_t ctr;
-		struct req_q_set nfs_request_q;
+		uint32_t n_shards;
+		struct req_q_shard *shard;
+		struct req_q_sched sched;
 		uint64_t size;
-		pthread_spinlock_t sp;
-		struct glist_head wait_list;
-		uint32_t waiters;
 	} reqs;
 	GSH_CACHE_PAD(1);
 };
@@ -83,22 +124,71 @@ static inline void nfs_rpc_q_init(struct req_q *q)
 	pthread_spin_init(&q->sp, PTHREAD_PROCESS_PRIVATE);
 	q->size = 0;
 	q->waiters = 0;
+	q->total = 0;
+	q->wait_ns = 0;
+}
+
+/**
+ * @brief Build a smooth weighted round robin schedule
+ *
+ * @param[out] sched   Schedule to fill in
+ * @param[in]  weights One weight per class, 0 is treated as 1
+ */
+static inline void nfs_rpc_q_sched_init(struct req_q_sched *sched,
+					const uint32_t *weights)
+{
+	int32_t current[N_REQ_QUEUES] = { 0 };
+	uint32_t w[N_REQ_QUEUES];
+	uint32_t total = 0;
+	uint32_t ix, jx, best;
+
+	for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+		w[ix] = weights[ix] ? weights[ix] : 1;
+		total += w[ix];
+	}
+
+	/* scale down so the schedule fits */
+	while (total > REQ_Q_SCHED_MAX) {
+		total = 0;
+		for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+			w[ix] = (w[ix] + 1) / 2;
+			total += w[ix];
+		}
+	}
+
+	sched->len = total;
+	for (jx = 0; jx < total; ++jx) {
+		best = 0;
+		for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+			current[ix] += w[ix];
+			if (current[ix] > current[best])
+				best = ix;
+		}
+		current[best] -= total;
+		sched->slot[jx] = best;
+	}
 }
 
 static inline void nfs_rpc_queue_awaken(void *arg)
 {
 	struct nfs_req_st *st = arg;
+	struct req_q_shard *shard;
 	struct glist_head *g = NULL;
 	struct glist_head *n = NULL;
+	uint32_t ix;
 
-	pthread_spin_lock(&st->reqs.sp);
-	glist_for_each_safe(g, n, &st->reqs.wait_list) {
-		wait_q_entry_t *wqe = glist_entry(g, wait_q_entry_t, waitq);
+	for (ix = 0; ix < st->reqs.n_shards; ++ix) {
+		shard = &st->reqs.shard[ix];
+		pthread_spin_lock(&shard->sp);
+		glist_for_each_safe(g, n, &shard->wait_list) {
+			wait_q_entry_t *wqe =
+				glist_entry(g, wait_q_entry_t, waitq);
 
-		pthread_cond_signal(&wqe->lwe.cv);
-		pthread_cond_signal(&wqe->rwe.cv);
+			pthread_cond_signal(&wqe->lwe.cv);
+			pthread_cond_signal(&wqe->rwe.cv);
+		}
+		pthread_spin_unlock(&shard->sp);
 	}
-	pthread_spin_unlock(&st->reqs.sp);
 }
 
 #endif				/* NFS_REQ_QUEUE_H */
@@ -74,6 +74,8 @@ enum nfs_cb_call_states {
 	NFS_CB_CALL_DISPATCH,
 	NFS_CB_CALL_FINISHED,
 	NFS_CB_CALL_ABORTED,
+	NFS_CB_CALL_BATCHED = 4,	/*< One op of a batched CB_COMPOUND,
+					    see nfs_rpc_cb_queue */
 };
 
 rpc_call_t *alloc_rpc_call();
@@ -118,6 +120,8 @@ int nfs_rpc_create_chan_v40(nfs_client_id_t *pclientid, uint32_t flags);
 
 int nfs_rpc_create_chan_v41(SVCXPRT *xprt, nfs41_session_t *session,
 			    int num_sec_parms, callback_sec_parms4 *sec_parms);
+int nfs_rpc_rebind_chan_v41(SVCXPRT *xprt, nfs41_session_t *session);
+void nfs41_session_free_cb_sec(nfs41_session_t *session);
 
 #define NFS_RPC_CALL_NONE 0x0000
 
@@ -128,6 +132,10 @@ int nfs_rpc_cb_single(nfs_client_id_t *clientid, nfs_cb_argop4 *op,
 		       void (*completion)(rpc_call_t *),
 		       void *completion_arg);
 void nfs41_release_single(rpc_call_t *call);
+int nfs_rpc_cb_queue(nfs_client_id_t *clientid, nfs_cb_argop4 *op,
+		     struct state_refer *refer,
+		     void (*completion)(rpc_call_t *),
+		     void *completion_arg);
 enum clnt_stat nfs_test_cb_chan(nfs_client_id_t *);
 
 #endif /* !NFS_RPC_CALLBACK_H */
@@ -2605,11 +2605,26 @@ typedef struct {
 } seek_res4;
 
 typedef struct OFFLOAD_STATUS4resok {
-	length4         osr_bytes_copied;
-	count4          osr_count_complete;
+	length4         osr_count;
+	count4          osr_complete_len;	/* 0 or 1 */
 	nfsstat4        osr_complete;
 } OFFLOAD_STATUS4resok;
 
+struct netloc4 {
+	netloc_type4        nl_type;
+	union {
+		utf8str_cis nl_name;
+		utf8str_cis nl_url;
+		netaddr4    nl_addr;
+	};
+};
+typedef struct netloc4 netloc4;
+
+typedef struct {
+	bool_t          cr_consecutive;
+	bool_t          cr_synchronous;
+} copy_requirements4;
+
 struct COPY_NOTIFY4args {
 	stateid4 cna_stateid;
 	netloc_type4        cna_type;
@@ -2653,33 +2668,38 @@ struct COPY4args {
 	offset4         ca_src_offset;
 	offset4         ca_dst_offset;
 	length4         ca_count;
-	netloc_type4        ca_type;
-	union {
-		utf8str_cis ca_name;
-		utf8str_cis ca_url;
-		netaddr4    ca_addr;
-	};
+	bool_t          ca_consecutive;
+	bool_t          ca_synchronous;
+	struct {
+		u_int ca_source_server_len;
+		netloc4 *ca_source_server_val;
+	} ca_source_server;
 };
 typedef struct COPY4args COPY4args;
 
+typedef struct {
+	write_response4     cr_response;
+	copy_requirements4  cr_requirements;
+} COPY4resok;
+
 struct COPY4res {
 	nfsstat4 cr_status;
 	union {
-		write_response4 cr_resok4;
-		length4         cr_bytes_copied;
+		COPY4resok         cr_resok4;
+		copy_requirements4 cr_requirements;
 	} COPY4res_u;
 };
 typedef struct COPY4res COPY4res;
 
-struct OFFLOAD_ABORT4args {
-	stateid4        oaa_stateid;
+struct OFFLOAD_CANCEL4args {
+	stateid4        oca_stateid;
 };
-typedef struct OFFLOAD_ABORT4args OFFLOAD_ABORT4args;
+typedef struct OFFLOAD_CANCEL4args OFFLOAD_CANCEL4args;
 
-struct OFFLOAD_ABORT4res {
-	stateid4        oar_stateid;
+struct OFFLOAD_CANCEL4res {
+	nfsstat4        ocr_status;
 };
-typedef struct OFFLOAD_ABORT4res OFFLOAD_ABORT4res;
+typedef struct OFFLOAD_CANCEL4res OFFLOAD_CANCEL4res;
 
 struct OFFLOAD_STATUS4args {
 	stateid4        osa_stateid;
@@ -2694,6 +2714,20 @@ struct OFFLOAD_STATUS4res {
 };
 typedef struct OFFLOAD_STATUS4res OFFLOAD_STATUS4res;
 
+struct CLONE4args {
+	stateid4        cl_src_stateid;
+	stateid4        cl_dst_stateid;
+	offset4         cl_src_offset;
+	offset4         cl_dst_offset;
+	length4         cl_count;
+};
+typedef struct CLONE4args CLONE4args;
+
+struct CLONE4res {
+	nfsstat4        cl_status;
+};
+typedef struct CLONE4res CLONE4res;
+
 struct WRITE_SAME4args {
 	stateid4        wp_stateid;
 	stable_how4     wp_stable;
@@ -3213,7 +3247,7 @@ struct nfs_argop4 {
 		COPY_NOTIFY4args opoffload_notify;
 		OFFLOAD_REVOKE4args opcopy_revoke;
 		COPY4args opcopy;
-		OFFLOAD_ABORT4args opoffload_abort;
+		OFFLOAD_CANCEL4args opoffload_cancel;
 		OFFLOAD_STATUS4args opoffload_status;
 		WRITE_SAME4args opwrite_plus;
 		ALLOCATE4args opallocate;
@@ -3223,6 +3257,7 @@ struct nfs_argop4 {
 		IO_ADVISE4args opio_advise;
 		LAYOUTERROR4args oplayouterror;
 		LAYOUTSTATS4args oplayoutstats;
+		CLONE4args opclone;
 
 		/* NFSv4.3 */
 		GETXATTR4args opgetxattr;
@@ -3298,7 +3333,7 @@ struct nfs_resop4 {
 		COPY_NOTIFY4res opoffload_notify;
 		OFFLOAD_REVOKE4res opcopy_revoke;
 		COPY4res opcopy;
-		OFFLOAD_ABORT4res opoffload_abort;
+		OFFLOAD_CANCEL4res opoffload_cancel;
 		OFFLOAD_STATUS4res opoffload_status;
 		WRITE_SAME4res opwrite_plus;
 		ALLOCATE4res opallocate;
@@ -3308,6 +3343,7 @@ struct nfs_resop4 {
 		IO_ADVISE4res opio_advise;
 		LAYOUTERROR4res oplayouterror;
 		LAYOUTSTATS4res oplayoutstats;
+		CLONE4res opclone;
 
 		/* NFSv4.3 */
 		GETXATTR4res opgetxattr;
@@ -3654,6 +3690,28 @@ struct CB_NOTIFY_DEVICEID4res {
 };
 typedef struct CB_NOTIFY_DEVICEID4res CB_NOTIFY_DEVICEID4res;
 
+/* NFSv4.2 */
+struct offload_info4 {
+	nfsstat4 coa_status;
+	union {
+		write_response4 coa_resok4;
+		length4         coa_bytes_copied;
+	} offload_info4_u;
+};
+typedef struct offload_info4 offload_info4;
+
+struct CB_OFFLOAD4args {
+	nfs_fh4         coa_fh;
+	stateid4        coa_stateid;
+	offload_info4   coa_offload_info;
+};
+typedef struct CB_OFFLOAD4args CB_OFFLOAD4args;
+
+struct CB_OFFLOAD4res {
+	nfsstat4 cor_status;
+};
+typedef struct CB_OFFLOAD4res CB_OFFLOAD4res;
+
 /* Callback operations new to NFSv4.1 */
 
 enum nfs_cb_opnum4 {
@@ -3669,6 +3727,7 @@ enum nfs_cb_opnum4 {
 	NFS4_OP_CB_WANTS_CANCELLED = 12,
 	NFS4_OP_CB_NOTIFY_LOCK = 13,
 	NFS4_OP_CB_NOTIFY_DEVICEID = 14,
+	NFS4_OP_CB_OFFLOAD = 15,
 	NFS4_OP_CB_ILLEGAL = 10044,
 };
 typedef enum nfs_cb_opnum4 nfs_cb_opnum4;
@@ -3688,6 +3747,7 @@ struct nfs_cb_argop4 {
 		CB_WANTS_CANCELLED4args opcbwants_cancelled;
 		CB_NOTIFY_LOCK4args opcbnotify_lock;
 		CB_NOTIFY_DEVICEID4args opcbnotify_deviceid;
+		CB_OFFLOAD4args opcboffload;
 	} nfs_cb_argop4_u;
 };
 typedef struct nfs_cb_argop4 nfs_cb_argop4;
@@ -3707,6 +3767,7 @@ struct nfs_cb_resop4 {
 		CB_WANTS_CANCELLED4res opcbwants_cancelled;
 		CB_NOTIFY_LOCK4res opcbnotify_lock;
 		CB_NOTIFY_DEVICEID4res opcbnotify_deviceid;
+		CB_OFFLOAD4res opcboffload;
 		CB_ILLEGAL4res opcbillegal;
 	} nfs_cb_resop4_u;
 };
@@ -3756,6 +3817,45 @@ extern CB_COMPOUND4res *cb_compound_1_svc(CB_COMPOUND4args *,
 
 /* the xdr functions */
 
+/*
+ * The hottest structures have fast paths: when the stream has their
+ * fixed size run in one contiguous piece, xdr_inline_encode or
+ * xdr_inline_decode hands it over and the fields are stored directly,
+ * otherwise the per-field routines are used.  Either way the bytes on
+ * the wire are the same.
+ */
+
+static inline int32_t *xdr_fast_put_u64(int32_t *buf, uint64_t val)
+{
+	IXDR_PUT_U_INT32(buf, (uint32_t) (val >> 32));
+	IXDR_PUT_U_INT32(buf, (uint32_t) val);
+	return buf;
+}
+
+static inline int32_t *xdr_fast_get_u64(int32_t *buf, uint64_t *val)
+{
+	*val = (uint64_t) IXDR_GET_U_INT32(buf) << 32;
+	*val |= IXDR_GET_U_INT32(buf);
+	return buf;
+}
+
+/* Opaque data of @a len bytes, zero padded to a whole unit */
+static inline int32_t *xdr_fast_put_opaque(int32_t *buf, const void *data,
+					   u_int len)
+{
+	if (len % BYTES_PER_XDR_UNIT != 0)
+		buf[len / BYTES_PER_XDR_UNIT] = 0;
+	memcpy(buf, data, len);
+	return buf + RNDUP(len) / BYTES_PER_XDR_UNIT;
+}
+
+static inline int32_t *xdr_fast_get_opaque(int32_t *buf, void *data,
+					   u_int len)
+{
+	memcpy(data, buf, len);
+	return buf + RNDUP(len) / BYTES_PER_XDR_UNIT;
+}
+
 static inline bool xdr_nfs_ftype4(XDR *xdrs, nfs_ftype4 *objp)
 {
 	if (!inline_xdr_enum(xdrs, (enum_t *) objp))
@@ -4160,8 +4260,36 @@ static inline bool xdr_nfs_impl_id4(XDR *xdrs, nfs_impl_id4 *objp)
 	return true;
 }
 
+static inline int32_t *xdr_fast_put_stateid4(int32_t *buf, stateid4 *objp)
+{
+	IXDR_PUT_U_INT32(buf, objp->seqid);
+	return xdr_fast_put_opaque(buf, objp->other, 12);
+}
+
+static inline int32_t *xdr_fast_get_stateid4(int32_t *buf, stateid4 *objp)
+{
+	objp->seqid = IXDR_GET_U_INT32(buf);
+	return xdr_fast_get_opaque(buf, objp->other, 12);
+}
+
 static inline bool xdr_stateid4(XDR *xdrs, stateid4 *objp)
 {
+	int32_t *buf;
+
+	if (xdrs->x_op == XDR_ENCODE) {
+		buf = xdr_inline_encode(xdrs, 4 * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			(void) xdr_fast_put_stateid4(buf, objp);
+			return true;
+		}
+	} else if (xdrs->x_op == XDR_DECODE) {
+		buf = xdr_inline_decode(xdrs, 4 * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			(void) xdr_fast_get_stateid4(buf, objp);
+			return true;
+		}
+	}
+
 	if (!inline_xdr_u_int32_t(xdrs, &objp->seqid))
 		return false;
 	if (!xdr_opaque(xdrs, objp->other, 12))
@@ -4998,6 +5126,26 @@ static inline bool xdr_fattr4_change_policy(XDR *xdrs,
 
 static inline bool xdr_fattr4(XDR *xdrs, fattr4 *objp)
 {
+	u_int mapsize = objp->attrmask.bitmap4_len;
+	u_int len = objp->attr_vals.attrlist4_len;
+	int32_t *buf = NULL;
+	u_int i;
+
+	/* GETATTR and every READDIR entry encode one */
+	if (xdrs->x_op == XDR_ENCODE && mapsize <= BITMAP4_MAPLEN &&
+	    len <= XDR_BYTES_MAXLEN)
+		buf = xdr_inline_encode(xdrs, (mapsize + 2) * BYTES_PER_XDR_UNIT
+					+ RNDUP(len));
+	if (buf != NULL) {
+		IXDR_PUT_U_INT32(buf, mapsize);
+		for (i = 0; i < mapsize; i++)
+			IXDR_PUT_U_INT32(buf, objp->attrmask.map[i]);
+		IXDR_PUT_U_INT32(buf, len);
+		(void) xdr_fast_put_opaque(buf, objp->attr_vals.attrlist4_val,
+					   len);
+		return true;
+	}
+
 	if (!xdr_bitmap4(xdrs, &objp->attrmask))
 		return false;
 	if (!xdr_attrlist4(xdrs, &objp->attr_vals))
@@ -6308,6 +6456,26 @@ static inline bool xdr_PUTROOTFH4res(XDR *xdrs, PUTROOTFH4res *objp)
 
 static inline bool xdr_READ4args(XDR *xdrs, READ4args *objp)
 {
+	int32_t *buf;
+
+	if (xdrs->x_op == XDR_ENCODE) {
+		buf = xdr_inline_encode(xdrs, 7 * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			buf = xdr_fast_put_stateid4(buf, &objp->stateid);
+			buf = xdr_fast_put_u64(buf, objp->offset);
+			IXDR_PUT_U_INT32(buf, objp->count);
+			return true;
+		}
+	} else if (xdrs->x_op == XDR_DECODE) {
+		buf = xdr_inline_decode(xdrs, 7 * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			buf = xdr_fast_get_stateid4(buf, &objp->stateid);
+			buf = xdr_fast_get_u64(buf, &objp->offset);
+			objp->count = IXDR_GET_U_INT32(buf);
+			return true;
+		}
+	}
+
 	if (!xdr_stateid4(xdrs, &objp->stateid))
 		return false;
 	if (!xdr_offset4(xdrs, &objp->offset))
@@ -6373,8 +6541,53 @@ static inline bool xdr_entry4(XDR *xdrs, entry4 *objp)
 	return true;
 }
 
+/**
+ * @brief Encode the entries of a READDIR reply
+ *
+ * Walks the list instead of recursing through xdr_pointer once per
+ * entry.  The cookie and name of an entry go in one run.
+ */
+static inline bool xdr_dirlist4_encode(XDR *xdrs, dirlist4 *objp)
+{
+	bool_t more = true;
+	entry4 *entry;
+	int32_t *buf;
+	u_int len;
+
+	for (entry = objp->entries; entry != NULL; entry = entry->nextentry) {
+		len = entry->name.utf8string_len;
+		buf = NULL;
+		if (len <= XDR_STRING_MAXLEN)
+			buf = xdr_inline_encode(xdrs, 4 * BYTES_PER_XDR_UNIT
+						+ RNDUP(len));
+		if (buf != NULL) {
+			IXDR_PUT_U_INT32(buf, more);
+			buf = xdr_fast_put_u64(buf, entry->cookie);
+			IXDR_PUT_U_INT32(buf, len);
+			(void) xdr_fast_put_opaque(buf,
+						   entry->name.utf8string_val,
+						   len);
+		} else if (!inline_xdr_bool(xdrs, &more) ||
+			   !xdr_nfs_cookie4(xdrs, &entry->cookie) ||
+			   !xdr_component4(xdrs, &entry->name)) {
+			return false;
+		}
+		if (!xdr_fattr4(xdrs, &entry->attrs))
+			return false;
+	}
+
+	more = false;
+	if (!inline_xdr_bool(xdrs, &more))
+		return false;
+	if (!inline_xdr_bool(xdrs, &objp->eof))
+		return false;
+	return true;
+}
+
 static inline bool xdr_dirlist4(XDR *xdrs, dirlist4 *objp)
 {
+	if (xdrs->x_op == XDR_ENCODE)
+		return xdr_dirlist4_encode(xdrs, objp);
 	if (!xdr_pointer(xdrs,
 	    (void **)&objp->entries, sizeof(entry4),
 	    (xdrproc_t) xdr_entry4))
@@ -7549,6 +7762,32 @@ static inline bool xdr_SECINFO_NO_NAME4res(XDR *xdrs,
 
 static inline bool xdr_SEQUENCE4args(XDR *xdrs, SEQUENCE4args *objp)
 {
+	int32_t *buf;
+
+	if (xdrs->x_op == XDR_ENCODE) {
+		buf = xdr_inline_encode(xdrs, 8 * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			buf = xdr_fast_put_opaque(buf, objp->sa_sessionid,
+						  NFS4_SESSIONID_SIZE);
+			IXDR_PUT_U_INT32(buf, objp->sa_sequenceid);
+			IXDR_PUT_U_INT32(buf, objp->sa_slotid);
+			IXDR_PUT_U_INT32(buf, objp->sa_highest_slotid);
+			IXDR_PUT_U_INT32(buf, objp->sa_cachethis ? 1 : 0);
+			return true;
+		}
+	} else if (xdrs->x_op == XDR_DECODE) {
+		buf = xdr_inline_decode(xdrs, 8 * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			buf = xdr_fast_get_opaque(buf, objp->sa_sessionid,
+						  NFS4_SESSIONID_SIZE);
+			objp->sa_sequenceid = IXDR_GET_U_INT32(buf);
+			objp->sa_slotid = IXDR_GET_U_INT32(buf);
+			objp->sa_highest_slotid = IXDR_GET_U_INT32(buf);
+			objp->sa_cachethis = IXDR_GET_U_INT32(buf) != 0;
+			return true;
+		}
+	}
+
 	if (!xdr_sessionid4(xdrs, objp->sa_sessionid))
 		return false;
 	if (!xdr_sequenceid4(xdrs, &objp->sa_sequenceid))
@@ -7564,6 +7803,34 @@ static inline bool xdr_SEQUENCE4args(XDR *xdrs, SEQUENCE4args *objp)
 
 static inline bool xdr_SEQUENCE4resok(XDR *xdrs, SEQUENCE4resok *objp)
 {
+	int32_t *buf;
+
+	if (xdrs->x_op == XDR_ENCODE) {
+		buf = xdr_inline_encode(xdrs, 9 * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			buf = xdr_fast_put_opaque(buf, objp->sr_sessionid,
+						  NFS4_SESSIONID_SIZE);
+			IXDR_PUT_U_INT32(buf, objp->sr_sequenceid);
+			IXDR_PUT_U_INT32(buf, objp->sr_slotid);
+			IXDR_PUT_U_INT32(buf, objp->sr_highest_slotid);
+			IXDR_PUT_U_INT32(buf, objp->sr_target_highest_slotid);
+			IXDR_PUT_U_INT32(buf, objp->sr_status_flags);
+			return true;
+		}
+	} else if (xdrs->x_op == XDR_DECODE) {
+		buf = xdr_inline_decode(xdrs, 9 * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			buf = xdr_fast_get_opaque(buf, objp->sr_sessionid,
+						  NFS4_SESSIONID_SIZE);
+			objp->sr_sequenceid = IXDR_GET_U_INT32(buf);
+			objp->sr_slotid = IXDR_GET_U_INT32(buf);
+			objp->sr_highest_slotid = IXDR_GET_U_INT32(buf);
+			objp->sr_target_highest_slotid = IXDR_GET_U_INT32(buf);
+			objp->sr_status_flags = IXDR_GET_U_INT32(buf);
+			return true;
+		}
+	}
+
 	if (!xdr_sessionid4(xdrs, objp->sr_sessionid))
 		return false;
 	if (!xdr_sequenceid4(xdrs, &objp->sr_sequenceid))
@@ -7795,7 +8062,7 @@ static inline bool xdr_WRITE_SAME4args(XDR *xdrs, WRITE_SAME4args *objp)
 	return true;
 }
 
-static inline bool xdr_WRITE_SAME4resok(XDR *xdrs, write_response4 *objp)
+static inline bool xdr_write_response4(XDR *xdrs, write_response4 *objp)
 {
 	if (!xdr_count4(xdrs, &objp->wr_ids))
 		return false;
@@ -7875,7 +8142,7 @@ static inline bool xdr_WRITE_SAME4res(XDR *xdrs, WRITE_SAME4res *objp)
 		return false;
 	switch (objp->wpr_status) {
 	case NFS4_OK:
-		if (!xdr_WRITE_SAME4resok(xdrs, &objp->wpr_resok4))
+		if (!xdr_write_response4(xdrs, &objp->wpr_resok4))
 			return false;
 		break;
 	default:
@@ -8056,6 +8323,166 @@ static inline bool xdr_LAYOUTSTATS4res(XDR *xdrs, LAYOUTSTATS4res *objp)
 	return true;
 }
 
+static inline bool xdr_netloc4(XDR *xdrs, netloc4 *objp)
+{
+	if (!inline_xdr_enum(xdrs, (enum_t *)&objp->nl_type))
+		return false;
+	switch (objp->nl_type) {
+	case NL4_NAME:
+		if (!xdr_utf8str_cis(xdrs, &objp->nl_name))
+			return false;
+		break;
+	case NL4_URL:
+		if (!xdr_utf8str_cis(xdrs, &objp->nl_url))
+			return false;
+		break;
+	case NL4_NETADDR:
+		if (!xdr_netaddr4(xdrs, &objp->nl_addr))
+			return false;
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+static inline bool xdr_COPY4args(XDR *xdrs, COPY4args *objp)
+{
+	if (!xdr_stateid4(xdrs, &objp->ca_src_stateid))
+		return false;
+	if (!xdr_stateid4(xdrs, &objp->ca_dst_stateid))
+		return false;
+	if (!xdr_offset4(xdrs, &objp->ca_src_offset))
+		return false;
+	if (!xdr_offset4(xdrs, &objp->ca_dst_offset))
+		return false;
+	if (!xdr_length4(xdrs, &objp->ca_count))
+		return false;
+	if (!inline_xdr_bool(xdrs, &objp->ca_consecutive))
+		return false;
+	if (!inline_xdr_bool(xdrs, &objp->ca_synchronous))
+		return false;
+	if (!xdr_array(xdrs,
+		       (char **)&objp->ca_source_server.ca_source_server_val,
+		       &objp->ca_source_server.ca_source_server_len,
+		       XDR_ARRAY_MAXLEN,
+		       sizeof(netloc4), (xdrproc_t) xdr_netloc4))
+		return false;
+	return true;
+}
+
+static inline bool xdr_copy_requirements4(XDR *xdrs,
+					  copy_requirements4 *objp)
+{
+	if (!inline_xdr_bool(xdrs, &objp->cr_consecutive))
+		return false;
+	if (!inline_xdr_bool(xdrs, &objp->cr_synchronous))
+		return false;
+	return true;
+}
+
+static inline bool xdr_COPY4res(XDR *xdrs, COPY4res *objp)
+{
+	if (!xdr_nfsstat4(xdrs, &objp->cr_status))
+		return false;
+	switch (objp->cr_status) {
+	case NFS4_OK:
+		if (!xdr_write_response4(xdrs,
+				&objp->COPY4res_u.cr_resok4.cr_response))
+			return false;
+		if (!xdr_copy_requirements4(xdrs,
+				&objp->COPY4res_u.cr_resok4.cr_requirements))
+			return false;
+		break;
+	case NFS4ERR_OFFLOAD_NO_REQS:
+		if (!xdr_copy_requirements4(xdrs,
+				&objp->COPY4res_u.cr_requirements))
+			return false;
+		break;
+	default:
+		break;
+	}
+	return true;
+}
+
+static inline bool xdr_OFFLOAD_CANCEL4args(XDR *xdrs,
+					   OFFLOAD_CANCEL4args *objp)
+{
+	if (!xdr_stateid4(xdrs, &objp->oca_stateid))
+		return false;
+	return true;
+}
+
+static inline bool xdr_OFFLOAD_CANCEL4res(XDR *xdrs,
+					  OFFLOAD_CANCEL4res *objp)
+{
+	if (!xdr_nfsstat4(xdrs, &objp->ocr_status))
+		return false;
+	return true;
+}
+
+static inline bool xdr_CLONE4args(XDR *xdrs, CLONE4args *objp)
+{
+	if (!xdr_stateid4(xdrs, &objp->cl_src_stateid))
+		return false;
+	if (!xdr_stateid4(xdrs, &objp->cl_dst_stateid))
+		return false;
+	if (!xdr_offset4(xdrs, &objp->cl_src_offset))
+		return false;
+	if (!xdr_offset4(xdrs, &objp->cl_dst_offset))
+		return false;
+	if (!xdr_length4(xdrs, &objp->cl_count))
+		return false;
+	return true;
+}
+
+static inline bool xdr_CLONE4res(XDR *xdrs, CLONE4res *objp)
+{
+	if (!xdr_nfsstat4(xdrs, &objp->cl_status))
+		return false;
+	return true;
+}
+
+static inline bool xdr_OFFLOAD_STATUS4args(XDR *xdrs,
+					   OFFLOAD_STATUS4args *objp)
+{
+	if (!xdr_stateid4(xdrs, &objp->osa_stateid))
+		return false;
+	return true;
+}
+
+static inline bool xdr_OFFLOAD_STATUS4resok(XDR *xdrs,
+					    OFFLOAD_STATUS4resok *objp)
+{
+	if (!xdr_length4(xdrs, &objp->osr_count))
+		return false;
+	if (!xdr_count4(xdrs, &objp->osr_complete_len))
+		return false;
+	if (objp->osr_complete_len > 1)
+		return false;
+	if (objp->osr_complete_len == 1)
+		if (!xdr_nfsstat4(xdrs, &objp->osr_complete))
+			return false;
+	return true;
+}
+
+static inline bool xdr_OFFLOAD_STATUS4res(XDR *xdrs,
+					  OFFLOAD_STATUS4res *objp)
+{
+	if (!xdr_nfsstat4(xdrs, &objp->osr_status))
+		return false;
+	switch (objp->osr_status) {
+	case NFS4_OK:
+		if (!xdr_OFFLOAD_STATUS4resok(xdrs,
+				&objp->OFFLOAD_STATUS4res_u.osr_resok4))
+			return false;
+		break;
+	default:
+		break;
+	}
+	return true;
+}
+
 /* new operations for NFSv4.1 */
 
 static inline bool xdr_nfs_opnum4(XDR *xdrs, nfs_opnum4 *objp)
@@ -8384,12 +8811,28 @@ static inline bool xdr_nfs_argop4(XDR *xdrs, nfs_argop4 *objp)
 				&objp->nfs_argop4_u.oplayoutstats))
 			return false;
 		break;
-
 	case NFS4_OP_COPY:
-	case NFS4_OP_COPY_NOTIFY:
+		if (!xdr_COPY4args(xdrs, &objp->nfs_argop4_u.opcopy))
+			return false;
+		lkhd->flags |= NFS_LOOKAHEAD_WRITE;
+		break;
 	case NFS4_OP_OFFLOAD_CANCEL:
+		if (!xdr_OFFLOAD_CANCEL4args(xdrs,
+				&objp->nfs_argop4_u.opoffload_cancel))
+			return false;
+		break;
 	case NFS4_OP_OFFLOAD_STATUS:
+		if (!xdr_OFFLOAD_STATUS4args(xdrs,
+				&objp->nfs_argop4_u.opoffload_status))
+			return false;
+		break;
 	case NFS4_OP_CLONE:
+		if (!xdr_CLONE4args(xdrs, &objp->nfs_argop4_u.opclone))
+			return false;
+		lkhd->flags |= NFS_LOOKAHEAD_WRITE;
+		break;
+
+	case NFS4_OP_COPY_NOTIFY:
 		break;
 
 	/* NFSv4.3 */
@@ -8714,12 +9157,26 @@ static inline bool xdr_nfs_resop4(XDR *xdrs, nfs_resop4 *objp)
 					 &objp->nfs_resop4_u.oplayoutstats))
 			return false;
 		break;
-
 	case NFS4_OP_COPY:
-	case NFS4_OP_COPY_NOTIFY:
+		if (!xdr_COPY4res(xdrs, &objp->nfs_resop4_u.opcopy))
+			return false;
+		break;
 	case NFS4_OP_OFFLOAD_CANCEL:
+		if (!xdr_OFFLOAD_CANCEL4res(xdrs,
+				&objp->nfs_resop4_u.opoffload_cancel))
+			return false;
+		break;
 	case NFS4_OP_OFFLOAD_STATUS:
+		if (!xdr_OFFLOAD_STATUS4res(xdrs,
+				&objp->nfs_resop4_u.opoffload_status))
+			return false;
+		break;
 	case NFS4_OP_CLONE:
+		if (!xdr_CLONE4res(xdrs, &objp->nfs_resop4_u.opclone))
+			return false;
+		break;
+
+	case NFS4_OP_COPY_NOTIFY:
 
 	/* NFSv4.3 */
 	case NFS4_OP_GETXATTR:
@@ -9510,6 +9967,43 @@ static inline bool xdr_CB_NOTIFY_DEVICEID4res(XDR *xdrs,
 	return true;
 }
 
+static inline bool xdr_offload_info4(XDR *xdrs, offload_info4 *objp)
+{
+	if (!xdr_nfsstat4(xdrs, &objp->coa_status))
+		return false;
+	switch (objp->coa_status) {
+	case NFS4_OK:
+		if (!xdr_write_response4(xdrs,
+					 &objp->offload_info4_u.coa_resok4))
+			return false;
+		break;
+	default:
+		if (!xdr_length4(xdrs,
+				 &objp->offload_info4_u.coa_bytes_copied))
+			return false;
+		break;
+	}
+	return true;
+}
+
+static inline bool xdr_CB_OFFLOAD4args(XDR *xdrs, CB_OFFLOAD4args *objp)
+{
+	if (!xdr_nfs_fh4(xdrs, &objp->coa_fh))
+		return false;
+	if (!xdr_stateid4(xdrs, &objp->coa_stateid))
+		return false;
+	if (!xdr_offload_info4(xdrs, &objp->coa_offload_info))
+		return false;
+	return true;
+}
+
+static inline bool xdr_CB_OFFLOAD4res(XDR *xdrs, CB_OFFLOAD4res *objp)
+{
+	if (!xdr_nfsstat4(xdrs, &objp->cor_status))
+		return false;
+	return true;
+}
+
 /* Callback operations new to NFSv4.1 */
 
 static inline bool xdr_nfs_cb_opnum4(XDR *xdrs, nfs_cb_opnum4 *objp)
@@ -9584,6 +10078,11 @@ static inline bool xdr_nfs_cb_argop4(XDR *xdrs, nfs_cb_argop4 *objp)
 		    &objp->nfs_cb_argop4_u.opcbnotify_deviceid))
 			return false;
 		break;
+	case NFS4_OP_CB_OFFLOAD:
+		if (!xdr_CB_OFFLOAD4args(xdrs,
+		    &objp->nfs_cb_argop4_u.opcboffload))
+			return false;
+		break;
 	case NFS4_OP_CB_ILLEGAL:
 		break;
 	default:
@@ -9657,6 +10156,11 @@ static inline bool xdr_nfs_cb_resop4(XDR *xdrs, nfs_cb_resop4 *objp)
 		    &objp->nfs_cb_resop4_u.opcbnotify_deviceid))
 			return false;
 		break;
+	case NFS4_OP_CB_OFFLOAD:
+		if (!xdr_CB_OFFLOAD4res(xdrs,
+		    &objp->nfs_cb_resop4_u.opcboffload))
+			return false;
+		break;
 	case NFS4_OP_CB_ILLEGAL:
 		if (!xdr_CB_ILLEGAL4res(xdrs,
 		    &objp->nfs_cb_resop4_u.opcbillegal))
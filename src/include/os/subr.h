@@ -51,8 +51,8 @@ struct vfs_dirent {
 
 int vfs_readents(int fd, char *buf, unsigned int bcount, off_t *basepp);
 bool to_vfs_dirent(char *buf, int bpos, struct vfs_dirent *vd, off_t base);
-void setuser(uid_t uid);
-void setgroup(gid_t gid);
+int setuser(uid_t uid);
+int setgroup(gid_t gid);
 uid_t getuser(void);
 gid_t getgroup(void);
 int set_threadgroups(size_t size, const gid_t *list);
@@ -239,6 +239,24 @@ nfsstat4 FSAL_encode_flex_file_layout(XDR *xdrs,
 				 const ff_flags4 ffl_flags,
 				 const uint32_t ffl_stats_collect_hint);
 
+/**
+ * A data server of a flex files layout, for FSAL_encode_ff_layout.
+ */
+
+typedef struct fsal_ff_ds_member {
+	struct pnfs_deviceid deviceid;	/*< Device of the data server */
+	uint32_t efficiency;		/*< Higher is better */
+	struct gsh_buffdesc fh;		/*< NFS handle of the file on it */
+	uid_t uid;			/*< Credentials to use with it */
+	gid_t gid;
+} fsal_ff_ds_member_t;
+
+nfsstat4 FSAL_encode_ff_layout(XDR *xdrs, const uint64_t stripe_unit,
+			       const uint32_t num_mirrors,
+			       const fsal_ff_ds_member_t *mirrors,
+			       const ff_flags4 flags,
+			       const uint32_t stats_collect_hint);
+
 nfsstat4 FSAL_encode_ff_device_versions4(XDR *xdrs,
 				const u_int multipath_list4_len,
 				const u_int ffda_versions_len,
@@ -37,6 +37,7 @@
 #ifndef SAL_DATA_H
 #define SAL_DATA_H
 
+#include <stddef.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/param.h>
@@ -133,6 +134,11 @@ typedef struct nfs41_session_slot__ {
 	struct COMPOUND4res_extended cached_result;	/*< NFv41: pointer to
 							   cached RPC result in
 							   a session's slot */
+	nfs_resop4 uncached_res[2];	/*< Result array of cached_result when
+					    only SEQUENCE and the status of
+					    the op after it are kept */
+	bool suspended;		/*< The COMPOUND using the slot is suspended
+				    and has dropped the lock until resumed */
 } nfs41_session_slot_t;
 
 /**
@@ -158,7 +164,8 @@ enum {
 #define NFS41_MIN_REQUEST_SIZE 256
 #define NFS41_MIN_RESPONSE_SIZE 256
 #define NFS41_MIN_OPERATIONS 2
-#define NFS41_MAX_CONNECTIONS 16
+/** Enough for nconnect over several trunked addresses */
+#define NFS41_MAX_CONNECTIONS 64
 
 /**
  * @brief Structure representing an NFSv4.1 session
@@ -174,6 +181,11 @@ struct nfs41_session {
 
 	channel_attrs4 back_channel_attrs;	/*< Back-channel attributes */
 	struct rpc_call_channel cb_chan;	/*< Back channel */
+	callback_sec_parms4 cb_sec_parms;	/*< Security the back channel
+						   was set up with, to set it
+						   up again on another
+						   connection */
+	bool cb_sec_saved;	/*< cb_sec_parms is set */
 	pthread_mutex_t cb_mutex;	/*< Protects the cb slot table,
 					   when searching for a free slot */
 	pthread_cond_t cb_cond;	/*< Condition variable on which we
@@ -192,7 +204,14 @@ struct nfs41_session {
 	uint32_t flags;		/*< Flags pertaining to this session */
 	int32_t refcount;
 	uint32_t nb_slots;	/**< Number of slots in this session */
-	nfs41_session_slot_t *fc_slots;	/**< Forechannel slot table*/
+	uint32_t highest_slot;	/**< Highest slot the client may use now,
+				     between 0 and nb_slots - 1 */
+	pthread_mutex_t slot_lock;	/**< Protects allocating, growing and
+					     shrinking the forechannel
+					     slots */
+	nfs41_session_slot_t **fc_slots;	/**< Forechannel slot table,
+						     each slot allocated on
+						     first use */
 	nfs41_cb_session_slot_t *bc_slots;	/**< Backchannel slot table */
 };
 
@@ -329,6 +348,9 @@ struct state_deleg {
 	open_delegation_type4 sd_type;
 	enum deleg_state sd_state;
 	struct cf_deleg_stats sd_clfile_stats;  /* client specific */
+	uint32_t sd_notify;	/* directory delegation, notify_type4 bits
+				 * granted
+				 */
 };
 
 /**
@@ -342,6 +364,10 @@ struct state_layout {
 	uint32_t granting;	/*< Number of LAYOUTGETs in progress */
 	bool state_return_on_close;	/*< Whether this layout should be
 					   returned on last close. */
+	struct glist_head state_fsid_list;	/*< Entry in the layouts of
+						   the filesystem */
+	struct state_layout_fsid *state_fsid;	/*< Filesystem indexed on,
+						   NULL if not indexed */
 };
 
 /**
@@ -391,7 +417,6 @@ struct state_t {
 	state_owner_t *state_owner;	/**< State Owner related to state */
 	struct fsal_obj_handle *state_obj; /**< owning object */
 	struct fsal_export *state_exp;  /**< FSAL export */
-	union state_data state_data;
 	enum state_type state_type;
 	u_int32_t state_seqid;		/**< The NFSv4 Sequence id */
 	int32_t state_refcount;		/**< Refcount for state_t objects */
@@ -400,8 +425,61 @@ struct state_t {
 	struct state_refer state_refer;	/**< For NFSv4.1, track the
 					   call that created a
 					   state. */
+	/* Keep this last, a state is only allocated as far as the member
+	 * of its type, see sizeof_state().
+	 */
+	union state_data state_data;
 };
 
+/**
+ * @brief Bytes of state_data a state of the given type uses
+ *
+ * @param[in] state_type Type of the state
+ *
+ * @return Size of the union member for that type.
+ */
+
+static inline size_t state_data_size(enum state_type state_type)
+{
+	switch (state_type) {
+	case STATE_TYPE_SHARE:
+		return sizeof(struct state_share);
+	case STATE_TYPE_DELEG:
+		return sizeof(struct state_deleg);
+	case STATE_TYPE_LOCK:
+	case STATE_TYPE_NLM_LOCK:
+		return sizeof(struct state_lock);
+	case STATE_TYPE_LAYOUT:
+		return sizeof(struct state_layout);
+	case STATE_TYPE_NLM_SHARE:
+		return sizeof(struct state_nlm_share);
+	case STATE_TYPE_9P_FID:
+		return sizeof(struct state_9p_fid);
+	case STATE_TYPE_NONE:
+		break;
+	}
+
+	return sizeof(union state_data);
+}
+
+/**
+ * @brief Bytes to allocate for a state of the given type
+ *
+ * An open does not pay for the layout or NLM share data it never
+ * uses.  FSALs embedding a state_t in a larger structure must put it
+ * last to allocate it this way.
+ *
+ * @param[in] state_type Type of the state
+ *
+ * @return Size of a state_t of that type.
+ */
+
+static inline size_t sizeof_state(enum state_type state_type)
+{
+	return offsetof(struct state_t, state_data) +
+	       state_data_size(state_type);
+}
+
 /* Macros to compare and copy state_t to a struct stateid4 */
 #define SAME_STATEID(id4, state) \
 	((id4)->seqid == (state)->state_seqid && \
@@ -427,8 +505,33 @@ extern hash_table_t *ht_9p_owner;
 #endif
 extern hash_table_t *ht_nfs4_owner;
 
-extern struct glist_head cached_open_owners;
-extern pthread_mutex_t cached_open_owners_lock;
+/**
+ * @brief One shard of a server wide list, with its own mutex
+ *
+ * Objects are spread over the shards by address, so that threads adding
+ * and removing unrelated objects rarely take the same mutex.
+ */
+struct state_list_shard {
+	pthread_mutex_t sls_mutex;	/*< Protects sls_list */
+	struct glist_head sls_list;	/*< This shard's objects */
+};
+
+/** Shards per list. This must be prime. */
+#define STATE_LIST_SHARDS 17
+
+/**
+ * @brief Find the shard an object belongs in
+ *
+ * @param[in] shards Shards of the list
+ * @param[in] obj    Object being added, removed or checked
+ */
+static inline struct state_list_shard *
+state_list_shard(struct state_list_shard *shards, void *obj)
+{
+	return &shards[((uintptr_t) obj >> 4) % STATE_LIST_SHARDS];
+}
+
+extern struct state_list_shard cached_open_owners[STATE_LIST_SHARDS];
 
 /**
  * @brief A structure identifying the owner of an NFSv4 open or lock state
@@ -511,8 +614,6 @@ struct state_nlm_client_t {
 						     made */
 	int32_t slc_nlm_caller_name_len;	/*< Length of client name */
 	char *slc_nlm_caller_name;	/*< Client name */
-	CLIENT *slc_callback_clnt;	/*< Callback for blocking locks */
-	AUTH *slc_callback_auth;	/*< Authentication for callback */
 };
 
 /**
@@ -590,10 +691,19 @@ struct state_nfs4_owner_t {
 	time_t so_cache_expire; /* time cached OPEN owner will expire.  If
 				   non-zero, so_cache_entry is in
 				   cached_open_owners list.
-				   cached_open_owners_lock MUST be held
+				   The mutex of the owner's
+				   cached_open_owners shard MUST be held
 				   when accessing this field.*/
 };
 
+/**
+ * @brief Longest owner name kept in the owner itself
+ *
+ * The open and lock owners of the Linux client are 24 bytes or less.
+ */
+
+#define OWNER_INLINE_LEN 32
+
 /**
  * @brief General state owner
  *
@@ -611,6 +721,8 @@ struct state_owner_t {
 	int32_t so_refcount;	/*< Reference count for lifecyce management */
 	int so_owner_len;	/*< Length of owner name */
 	char *so_owner_val;	/*< Owner name */
+	/** Owner name if it fits, saves allocating it apart */
+	char so_owner_inline[OWNER_INLINE_LEN];
 	union {
 		state_nfs4_owner_t so_nfs4_owner; /*< All NFSv4 state owners */
 		state_nlm_owner_t so_nlm_owner;	/*< NLM lock and share
@@ -669,9 +781,11 @@ struct nfs_client_id_t {
 	clientid4 cid_clientid;	/*< The clientid */
 	verifier4 cid_verifier;	/*< Known verifier */
 	verifier4 cid_incoming_verifier; /*< Most recently supplied verifier */
-	time_t cid_last_renew;	/*< Time of last renewal */
+	time_t cid_last_renew;	/*< Time of last renewal, atomic */
 	nfs_clientid_confirm_state_t cid_confirmed; /*< Confirm/expire state */
 	bool cid_allow_reclaim;	/*< Can still reclaim state? */
+	int32_t cid_reclaim_prio;	/*< COMPOUNDs reclaiming with priority,
+					   atomic */
 	nfs_client_cred_t cid_credential;	/*< Client credential */
 	char *cid_recov_tag;	/*< Recovery tag */
 	nfs_client_record_t *cid_client_record;	/*< Record for managing
@@ -701,6 +815,11 @@ struct nfs_client_id_t {
 			struct glist_head cb_session_list;
 		} v41;		/*< v4.1 callback information */
 	} cid_cb;		/*< Version specific callback information */
+	struct glist_head cid_cb_queue;	/*< Callbacks waiting to be sent,
+					   protected by cid_mutex */
+	bool cid_cb_dispatching;	/*< A dispatcher owns cid_cb_queue */
+	bool cid_cb_stalled;	/*< The dispatcher is waiting for a back
+				   channel slot or connection */
 	time_t first_path_down_resp_time;  /* Time when the server first sent
 					       NFS4ERR_CB_PATH_DOWN */
 	unsigned int cid_nb_session;	/*< Number of sessions stored */
@@ -710,14 +829,29 @@ struct nfs_client_id_t {
 							  last CREATE_SESSION */
 	state_owner_t cid_owner;	/*< Owner for per-client state */
 	int32_t cid_refcount;	/*< Reference count for lifecycle */
-	int cid_lease_reservations;	/*< Counted lease reservations, to spare
-					   this clientid from the reaper */
+	int32_t cid_lease_reservations;	/*< Counted lease reservations, to
+					   spare this clientid from the
+					   reaper.  Atomic. */
+	struct glist_head cid_lease_list; /*< Node in the lease wheel,
+					     protected by its mutex */
+	time_t cid_lease_expire;	/*< When the reaper next looks at us */
+	time_t cid_courtesy;	/*< When the lease ran out with the state
+				   kept, 0 if the lease did not.  Protected
+				   by cid_mutex */
+	bool cid_courtesy_conflict;	/*< Another client conflicts with the
+					   kept state.  Protected by
+					   cid_mutex */
 	uint32_t cid_minorversion;
 	uint32_t cid_stateid_counter;
 
 	uint32_t curr_deleg_grants; /* current num of delegations owned by
 				       this client */
 	uint32_t num_revokes;       /* Num revokes for the client */
+	uint64_t cid_recall_time;   /* seconds this client took to return
+				       recalled delegations, in total.
+				       Atomic. */
+	uint32_t cid_recall_returns; /* recalled delegations returned.
+					Atomic. */
 	struct gsh_client *gsh_client; /* for client specific statistics. */
 };
 
@@ -838,7 +972,7 @@ struct state_lock_entry_t {
 	struct glist_head sle_client_locks;	/*< Locks on this client */
 	struct glist_head sle_state_locks;	/*< Locks on this state */
 #ifdef DEBUG_SAL
-	struct glist_head sle_all_locks; /*< Link on the global lock list */
+	struct glist_head sle_all_locks; /*< Link on the global lock shards */
 #endif				/* DEBUG_SAL */
 	struct glist_head sle_export_locks;	/*< Link on the export
 						   lock list */
@@ -851,6 +985,40 @@ struct state_lock_entry_t {
 	int32_t sle_ref_count;	/*< Reference count */
 	fsal_lock_param_t sle_lock;	/*< Lock description */
 	pthread_mutex_t sle_mutex;	/*< Mutex to protect the structure */
+	/* Node in the file's interval tree of sle_list entries.  Protected
+	   by state_lock. */
+	state_lock_entry_t *sle_left;
+	state_lock_entry_t *sle_right;
+	uint64_t sle_max_end;	/*< Highest lock end in this subtree */
+	bool sle_in_tree;	/*< Entry is indexed in lock_tree */
+	/** Node in the file's queue of blocked locks.  Protected by
+	    state_lock */
+	struct glist_head sle_waiter_list;
+};
+
+/**
+ * @brief An NFSv4.1 lock owner to tell when a denied range frees up
+ */
+
+struct state_lock_notify {
+	struct glist_head sln_list;	/*< Link on the file's lock_notify */
+	state_owner_t *sln_owner;	/*< Lock owner, holds a reference */
+	struct gsh_export *sln_export;	/*< Export, holds a reference */
+	uint64_t sln_start;		/*< First byte denied */
+	uint64_t sln_end;		/*< Last byte denied */
+	time_t sln_expire;		/*< Forgotten after this */
+};
+
+/**
+ * @brief Distinct clients that recently opened a file
+ */
+
+#define DELEG_OPENERS 4
+
+struct deleg_opener {
+	clientid4 do_clientid;		/* client that opened the file */
+	time_t do_last_open;		/* time of its last open */
+	bool do_write;			/* whether it opened for write */
 };
 
 /**
@@ -868,6 +1036,11 @@ struct file_deleg_stats {
 	uint32_t fds_num_opens;         /* total num of opens so far. */
 	time_t fds_first_open;          /* time that we started recording
 					   num_opens */
+	time_t fds_win_start;           /* start of the current conflict
+					   window */
+	uint32_t fds_win_conflicts[2];  /* conflicts in the current and
+					   previous window */
+	struct deleg_opener fds_openers[DELEG_OPENERS]; /* recent openers */
 };
 
 /**
@@ -884,6 +1057,15 @@ struct state_file {
 	struct glist_head layoutrecall_list;
 	/** Pointers for lock list. Protected by state_lock */
 	struct glist_head lock_list;
+	/** Interval tree indexing lock_list by range. Protected by
+	    state_lock */
+	state_lock_entry_t *lock_tree;
+	/** Blocked locks waiting on this file, oldest first. Protected by
+	    state_lock */
+	struct glist_head lock_waiters;
+	/** NFSv4.1 lock owners waiting for CB_NOTIFY_LOCK, see
+	    struct state_lock_notify. Protected by state_lock */
+	struct glist_head lock_notify;
 	/** Pointers for NLM share list. Protected by state_lock */
 	struct glist_head nlm_share_list;
 	/** true iff write delegated */
@@ -912,6 +1094,15 @@ struct state_dir {
 	    for which this entry is a root for. This field is used
 	    with the atomic inc/dec/fetch routines. */
 	int32_t exp_root_refcount;
+	/** NFSv4 states on this directory, its directory delegations.
+	    Protected by state_lock */
+	struct glist_head list_of_states;
+	/** Directory delegations in list_of_states, so that changing
+	    a directory nobody holds a delegation on is cheap. Atomic */
+	uint32_t dir_delegations;
+	/** When a directory delegation was last recalled. Protected by
+	    state_lock */
+	time_t dir_last_recall;
 };
 
 struct state_hdl {
@@ -934,8 +1125,43 @@ typedef struct state_layout_segment {
 	state_t *sls_state;	/*< Associated layout state */
 	struct pnfs_segment sls_segment;	/*< Segment descriptor */
 	void *sls_fsal_data;	/*< FSAL data */
+	struct gsh_buffdesc sls_body;	/*< loc_body as granted, handed out
+					   again to a LAYOUTGET the segment
+					   covers */
 } state_layout_segment_t;
 
+/**
+ * @brief The layout states on one filesystem
+ *
+ * Layouts are indexed by the FSID of their file, so that a recall of
+ * a whole filesystem finds the clients to call back without walking
+ * every file.
+ */
+
+struct state_layout_fsid {
+	struct glist_head slf_list;	/*< Entry in the list of filesystems */
+	fsal_fsid_t slf_fsid;	/*< The filesystem */
+	struct glist_head slf_states;	/*< Layout states on it */
+};
+
+/**
+ * @brief A CB_LAYOUTRECALL of a whole filesystem, or of all of them
+ *
+ * Outstanding until the client returns the layouts, or we revoke
+ * them.  LAYOUTGETs from the client for the filesystem conflict with
+ * it meanwhile.
+ */
+
+struct state_layout_recall_fsid {
+	struct glist_head lrf_list;	/*< Entry in the list of bulk recalls */
+	uint64_t lrf_id;	/*< Identifies the recall to its callback */
+	nfs_client_id_t *lrf_client;	/*< Client recalled from, held by
+					   the callback */
+	fsal_fsid_t lrf_fsid;	/*< Filesystem recalled */
+	bool lrf_all;		/*< Recall of all filesystems */
+	layouttype4 lrf_type;	/*< Type of layout recalled */
+};
+
 /**
  * @brief An entry in a list of states affected by a recall
  *
@@ -1085,7 +1311,7 @@ extern pool_t *state_owner_pool;	/*< Pool for NFSv4 files's open owner */
 
 #ifdef DEBUG_SAL
 extern struct glist_head state_v4_all;
-extern struct glist_head state_owners_all;
+extern struct state_list_shard state_owners_all[STATE_LIST_SHARDS];
 #endif
 
 #endif				/* SAL_DATA_H */
@@ -92,6 +92,28 @@ void state_release_export(struct gsh_export *exp);
 
 bool state_unlock_err_ok(state_status_t status);
 
+extern uint64_t state_counts[STATE_TYPE_COUNT];
+
+/**
+ * @brief Count a state made visible to clients
+ *
+ * @param[in] state_type Type of the state
+ */
+static inline void state_count_add(enum state_type state_type)
+{
+	(void) atomic_inc_uint64_t(&state_counts[state_type]);
+}
+
+/**
+ * @brief Stop counting a state no longer visible to clients
+ *
+ * @param[in] state_type Type of the state
+ */
+static inline void state_count_sub(enum state_type state_type)
+{
+	(void) atomic_dec_uint64_t(&state_counts[state_type]);
+}
+
 /**
  * @brief Initialize a state handle
  *
@@ -110,11 +132,14 @@ static inline void state_hdl_init(struct state_hdl *ostate,
 		glist_init(&ostate->file.list_of_states);
 		glist_init(&ostate->file.layoutrecall_list);
 		glist_init(&ostate->file.lock_list);
+		glist_init(&ostate->file.lock_waiters);
+		glist_init(&ostate->file.lock_notify);
 		glist_init(&ostate->file.nlm_share_list);
 		ostate->file.obj = obj;
 		break;
 	case DIRECTORY:
 		glist_init(&ostate->dir.export_roots);
+		glist_init(&ostate->dir.list_of_states);
 		break;
 	default:
 		break;
@@ -289,6 +314,8 @@ int remove_unconfirmed_client_id(nfs_client_id_t *clientid);
 clientid_status_t nfs_client_id_confirm(nfs_client_id_t *clientid,
 					log_components_t component);
 
+uint64_t nfs_client_id_count_confirmed(void);
+
 bool clientid_has_state(nfs_client_id_t *clientid);
 
 bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale);
@@ -386,6 +413,13 @@ int nfs41_Session_Get_Pointer(char sessionid[NFS4_SESSIONID_SIZE],
 int nfs41_Session_Del(char sessionid[NFS4_SESSIONID_SIZE]);
 void nfs41_Build_sessionid(clientid4 *clientid, char *sessionid);
 void nfs41_Session_PrintAll(void);
+void nfs41_Session_Slot_Release(nfs41_session_slot_t *slot);
+nfs41_session_slot_t *nfs41_session_get_slot(nfs41_session_t *session,
+					     slotid4 slotid);
+uint32_t nfs41_session_slot_target(nfs41_session_t *session);
+void nfs41_session_adjust_slots(nfs41_session_t *session,
+				slotid4 client_highest, uint32_t target);
+void nfs41_session_update_slot_target(void);
 
 bool check_session_conn(nfs41_session_t *session,
 			compound_data_t *data,
@@ -469,6 +503,7 @@ static inline void dec_state_t_ref(struct state_t *state)
 
 state_status_t nfs4_State_Set(state_t *state_data);
 struct state_t *nfs4_State_Get_Pointer(char *other);
+void nfs4_stateid_cache_release(compound_data_t *data);
 bool nfs4_State_Del(state_t *state);
 void nfs_State_PrintAll(void);
 
@@ -491,8 +526,17 @@ uint64_t state_id_rbt_hash_func(hash_parameter_t *hparam,
  ******************************************************************************/
 
 int reserve_lease(nfs_client_id_t *clientid);
+bool reserve_lease_fast(nfs_client_id_t *clientid);
 void update_lease(nfs_client_id_t *clientid);
 bool valid_lease(nfs_client_id_t *clientid);
+void lease_wheel_init(void);
+void lease_wheel_queue(nfs_client_id_t *clientid);
+void lease_wheel_remove(nfs_client_id_t *clientid);
+nfs_client_id_t *lease_wheel_next_due(void);
+bool keep_courtesy_lease(nfs_client_id_t *clientid);
+bool expire_courtesy_lease(nfs_client_id_t *clientid);
+void end_courtesy_lease(nfs_client_id_t *clientid);
+bool state_owner_courtesy_conflict(state_owner_t *owner);
 
 /******************************************************************************
  *
@@ -501,6 +545,7 @@ bool valid_lease(nfs_client_id_t *clientid);
  ******************************************************************************/
 
 void uncache_nfs4_owner(struct state_nfs4_owner_t *nfs4_owner);
+void state_list_shards_init(struct state_list_shard *shards);
 void free_nfs4_owner(state_owner_t *owner);
 int display_nfs4_owner(struct display_buffer *dspbuf, state_owner_t *owner);
 int display_nfs4_owner_val(struct gsh_buffdesc *buff, char *str);
@@ -685,6 +730,11 @@ state_status_t state_unlock(struct fsal_obj_handle *obj,
 state_status_t state_cancel(struct fsal_obj_handle *obj,
 			    state_owner_t *owner, fsal_lock_param_t *lock);
 
+void state_lock_notify_add(struct fsal_obj_handle *obj, state_owner_t *owner,
+			   fsal_lock_param_t *lock);
+int notify_lock_send(struct fsal_obj_handle *obj, state_owner_t *owner,
+		     struct gsh_export *export);
+
 state_status_t state_nlm_notify(state_nsm_client_t *nsmclient,
 				bool state_applies,
 				int32_t state);
@@ -898,10 +948,26 @@ void init_new_deleg_state(union state_data *deleg_state,
 void deleg_heuristics_recall(struct fsal_obj_handle *obj,
 			     state_owner_t *owner,
 			     struct state_t *deleg);
+void deleg_heuristics_open(struct state_hdl *ostate, nfs_client_id_t *client,
+			   uint32_t share_access);
+void deleg_heuristics_conflict(struct state_hdl *ostate);
 void get_deleg_perm(nfsace4 *permissions, open_delegation_type4 type);
 void update_delegation_stats(struct state_hdl *ostate,
 			     state_owner_t *owner);
 state_status_t delegrecall_impl(struct fsal_obj_handle *obj);
+bool delegrecall_state(struct fsal_obj_handle *obj, struct state_t *state);
+
+/** Changes a directory delegation can be notified of, notify_type4 bits */
+#define DIR_DELEG_NOTIFY_SUPPORTED ((1 << NOTIFY4_REMOVE_ENTRY) | \
+				    (1 << NOTIFY4_ADD_ENTRY) | \
+				    (1 << NOTIFY4_RENAME_ENTRY))
+
+bool should_we_grant_dir_deleg(struct state_hdl *ostate,
+			       nfs_client_id_t *client);
+void state_dir_notify(struct fsal_obj_handle *dir, notify_type4 type,
+		      const char *name, const char *new_name);
+int dir_notify_send(struct fsal_obj_handle *dir, struct state_t *state,
+		    notify_type4 type, const char *name, const char *new_name);
 nfsstat4 deleg_revoke(struct fsal_obj_handle *obj, struct state_t *deleg_state);
 void state_deleg_revoke(struct fsal_obj_handle *obj, state_t *state);
 bool state_deleg_conflict(struct fsal_obj_handle *obj, bool write);
@@ -913,12 +979,30 @@ bool state_deleg_conflict(struct fsal_obj_handle *obj, bool write);
  ******************************************************************************/
 
 state_status_t state_add_segment(state_t *state, struct pnfs_segment *segment,
-				 void *fsal_data, bool return_on_close);
+				 void *fsal_data, bool return_on_close,
+				 const struct gsh_buffdesc *body);
 
 state_status_t state_delete_segment(state_layout_segment_t *segment);
+bool state_layout_cached(state_t *state, layoutiomode4 io_mode,
+			 offset4 offset, length4 minlength, count4 maxcount,
+			 layout4 *layout);
 state_status_t state_lookup_layout_state(struct fsal_obj_handle *obj,
 					 state_owner_t *owner,
 					 layouttype4 type, state_t **state);
+void state_layout_index(state_t *state, struct fsal_obj_handle *obj);
+void state_layout_unindex(state_t *state);
+uint32_t state_layout_clients(const fsal_fsid_t *fsid, layouttype4 type,
+			      nfs_client_id_t ***clients);
+uint64_t state_layout_recall_begin(nfs_client_id_t *client,
+				   const fsal_fsid_t *fsid, layouttype4 type);
+bool state_layout_recall_end(uint64_t id);
+void state_layout_recall_returned(nfs_client_id_t *client,
+				  const fsal_fsid_t *fsid);
+bool state_layout_recalling(nfs_client_id_t *client, const fsal_fsid_t *fsid);
+void state_return_owner_layouts(state_owner_t *client_owner,
+				const fsal_fsid_t *fsid, layouttype4 type,
+				enum fsal_layoutreturn_circumstance
+								circumstance);
 void revoke_owner_layouts(state_owner_t *client_owner);
 
 
@@ -946,6 +1030,9 @@ state_status_t state_nlm_share(struct fsal_obj_handle *obj,
 
 void state_share_wipe(struct state_hdl *ostate);
 void state_export_unshare_all(void);
+bool state_share_courtesy_conflict(struct state_hdl *ostate,
+				   unsigned int share_access,
+				   unsigned int share_deny);
 
 /******************************************************************************
  *
@@ -983,6 +1070,20 @@ void blocked_lock_polling(struct fridgethr_context *ctx);
 
 /* Grace period handling */
 extern int32_t reclaim_completes; /* atomic */
+extern int32_t reclaim_starts; /* atomic */
+
+/** Reclaim progress of the current grace period */
+struct grace_progress {
+	bool in_grace;
+	uint32_t elapsed;		/*< Seconds since grace started */
+	uint32_t grace_period;		/*< Grace_Period */
+	uint32_t min_grace_period;	/*< Floor before an early lift */
+	uint32_t expected;		/*< Clients in the recovery db */
+	uint32_t started;		/*< Of those, clients that came back */
+	uint32_t completed;		/*< Of those, RECLAIM_COMPLETE sent */
+};
+
+void nfs_get_grace_progress(struct grace_progress *progress);
 void nfs_start_grace(nfs_grace_start_t *gsp);
 void nfs_end_grace(void);
 bool nfs_in_grace(void);
@@ -991,6 +1092,8 @@ void nfs_put_grace_status(void);
 void nfs_maybe_start_grace(void);
 bool nfs_grace_is_member(void);
 int nfs_recovery_get_nodeid(char **pnodeid);
+void nfs_recovery_publish_load(uint64_t load);
+int nfs_recovery_least_loaded_peer(uint64_t *pload, char **pserver);
 void nfs_try_lift_grace(void);
 void nfs_wait_for_grace_enforcement(void);
 void nfs_notify_grace_waiters(void);
@@ -1050,6 +1153,8 @@ struct nfs4_recovery_backend {
 	bool (*grace_enforcing)(void);
 	bool (*is_member)(void);
 	int (*get_nodeid)(char **pnodeid);
+	void (*publish_load)(uint64_t load);
+	int (*least_loaded_peer)(uint64_t *pload, char **pserver);
 };
 
 void fs_backend_init(struct nfs4_recovery_backend **);
@@ -52,6 +52,8 @@ enum state_type {
 	STATE_TYPE_9P_FID = 7,
 };
 
+#define STATE_TYPE_COUNT (STATE_TYPE_9P_FID + 1)
+
 
 #endif				/* SAL_SHARED_H */
 /** @} */
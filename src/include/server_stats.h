@@ -41,7 +41,26 @@
 
 #include <sys/types.h>
 
+/** Stages of an NFS request, timed with Enable_Stage_Histograms */
+enum req_stage {
+	REQ_STAGE_DECODE,	/*< From receipt to arguments decoded */
+	REQ_STAGE_QUEUE,	/*< From decoded to executing */
+	REQ_STAGE_EXECUTE,	/*< Execution, less the time in the FSAL */
+	REQ_STAGE_FSAL,		/*< Calls from MDCACHE to the FSAL */
+	REQ_STAGE_REPLY,	/*< Encoding and sending the reply */
+	REQ_STAGE_COUNT
+};
+
+/** Why a request was dropped before being executed */
+enum req_drop {
+	REQ_DROP_XPRT,		/*< Its connection went away */
+	REQ_DROP_DUPLICATE,	/*< A copy of it is in progress */
+	REQ_DROP_AGE,		/*< Older than Max_Request_Age */
+	REQ_DROP_COUNT
+};
+
 void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup);
+void server_stats_req_dropped(enum req_drop why);
 
 #ifdef _USE_9P
 void server_stats_9p_done(u8 msgtype, struct _9p_request_data *req9p);
@@ -52,6 +71,10 @@ void server_stats_io_done(size_t requested,
 void server_stats_compound_done(int num_ops, int status);
 void server_stats_nfsv4_op_done(int proto_op,
 				nsecs_elapsed_t start_time, int status);
+void server_stats_stages_done(request_data_t *reqdata,
+			      const nsecs_elapsed_t *stage);
+void server_stats_nfsv4_op_stages(int proto_op, nsecs_elapsed_t start_time,
+				  nsecs_elapsed_t fsal_time);
 void server_stats_transport_done(struct gsh_client *client,
 				uint64_t rx_bytes, uint64_t rx_pkt,
 				uint64_t rx_err, uint64_t tx_bytes,
@@ -63,6 +86,8 @@ void dec_grants(struct gsh_client *client);
 void inc_revokes(struct gsh_client *client);
 void inc_recalls(struct gsh_client *client);
 void inc_failed_recalls(struct gsh_client *client);
+void inc_recalls_avoided(struct gsh_client *client);
+void add_recall_latency(struct gsh_client *client, time_t latency);
 
 #endif				/* !SERVER_STATS_H */
 /** @} */
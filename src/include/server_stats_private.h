@@ -41,6 +41,7 @@
 #define SERVER_STATS_PRIVATE_H
 
 #include "sal_data.h"
+#include "server_topk.h"
 
 /**
  * @brief Server request statistics
@@ -58,6 +59,8 @@ struct rquota_stats;
 struct nfsv40_stats;
 struct nfsv41_stats;
 struct nfsv42_stats;
+struct lat_hists;
+struct gsh_throttle;
 struct deleg_stats;
 struct _9p_stats;
 
@@ -71,8 +74,13 @@ struct gsh_stats {
 	struct nfsv41_stats *nfsv42;
 	struct deleg_stats *deleg;
 	struct _9p_stats *_9p;
+	struct lat_hists *lat;
+	struct gsh_stats *slabs;	/*< STATS_SLABS per-thread copies */
 };
 
+/** Per-thread copies of each gsh_stats with Enable_Per_Thread_Stats */
+#define STATS_SLABS 16
+
 /**
  * @brief Server by client IP statistics
  *
@@ -191,6 +199,22 @@ struct export_stats {
 	.direction = "out"   \
 }
 
+/* Per export counters of a stackable FSAL, an array of
+ * OP_NAME, CALLS, ERRORS, TOTAL_LATENCY (ns) and a latency histogram
+ * in the LAT_HIST_REPLY layout
+ */
+#define FSAL_EXPORT_OPS_REPLY	\
+{				\
+	.name = "fsal_name",	\
+	.type = "s",		\
+	.direction = "out"	\
+},				\
+{				\
+	.name = "fsal_op_stats",	\
+	.type = "a(sttt(ttttta(tt)))",	\
+	.direction = "out"	\
+}
+
 #define STATS_STATUS_REPLY	\
 {	\
 	.name = "nfs_status",	\
@@ -231,11 +255,12 @@ struct export_stats {
 }
 
 /* number of delegations, number of sent recalls,
- * number of failed recalls, number of revokes */
+ * number of failed recalls, number of revokes, number of grants,
+ * number of recalls avoided, average seconds to return a recall */
 #define DELEG_REPLY		       \
 {				       \
 	.name = "delegation_stats",    \
-	.type = "(tttt)",	       \
+	.type = "(ttttttt)",	       \
 	.direction = "out"	       \
 }
 
@@ -249,6 +274,50 @@ struct export_stats {
 }						\
 
 
+/* per class name, depth, enqueued, dequeued, avg wait (ns) */
+#define REQ_QUEUES_REPLY_ARRAY_TYPE "(suttt)"
+#define REQ_QUEUES_REPLY			\
+{						\
+	.name = "req_queues",			\
+	.type = DBUS_TYPE_ARRAY_AS_STRING	\
+		REQ_QUEUES_REPLY_ARRAY_TYPE,	\
+	.direction = "out"			\
+}
+
+/* enable, min, max, grow wait (us), interval (s), target, threads, busy,
+ * avg wait (ns), grows, shrinks
+ */
+#define WORKER_POOL_REPLY		\
+{					\
+	.name = "worker_pool",		\
+	.type = "(buuuuuuuttt)",	\
+	.direction = "out"		\
+}
+
+/* per service name, unwrapped, avg unwrap (ns), wrapped, avg wrap (ns),
+ * offloaded, avg wait for a crypto thread (ns)
+ */
+#define GSS_STATS_REPLY_ARRAY_TYPE "(stttttt)"
+#define GSS_STATS_REPLY				\
+{						\
+	.name = "gss_stats",			\
+	.type = DBUS_TYPE_ARRAY_AS_STRING	\
+		GSS_STATS_REPLY_ARRAY_TYPE,	\
+	.direction = "out"			\
+}
+
+/* per pool name, object size, objects held, idle in depots, created,
+ * released, magazine exchanges
+ */
+#define POOL_STATS_REPLY_ARRAY_TYPE "(stttttt)"
+#define POOL_STATS_REPLY			\
+{						\
+	.name = "pool_stats",			\
+	.type = DBUS_TYPE_ARRAY_AS_STRING	\
+		POOL_STATS_REPLY_ARRAY_TYPE,	\
+	.direction = "out"			\
+}
+
 #define _9P_OP_ARG           \
 {                            \
 	.name = "_9p_opname",\
@@ -257,6 +326,242 @@ struct export_stats {
 }
 
 
+#define NFS_VERS_ARG        \
+{                           \
+	.name = "nfs_vers", \
+	.type = "s",        \
+	.direction = "in"   \
+}
+
+#define NFS_OP_ARG          \
+{                           \
+	.name = "nfs_op",   \
+	.type = "s",        \
+	.direction = "in"   \
+}
+
+#define LAT_HIST_REPLY      \
+{                           \
+	.name = "lat_hist", \
+	.type = "(ttttta(tt))", \
+	.direction = "out"  \
+}
+
+/* Stage name and histogram in the LAT_HIST_REPLY layout, per stage */
+#define STAGE_HIST_REPLY    \
+{                           \
+	.name = "stage_hists", \
+	.type = "a(s(ttttta(tt)))", \
+	.direction = "out"  \
+}
+
+#define THROTTLE_IOPS_ARG   \
+{                           \
+	.name = "iops",     \
+	.type = "t",        \
+	.direction = "in"   \
+}
+
+#define THROTTLE_BW_ARG         \
+{                               \
+	.name = "bandwidth",    \
+	.type = "t",            \
+	.direction = "in"       \
+}
+
+#define WORKER_ENABLE_ARG       \
+{                               \
+	.name = "enable",       \
+	.type = "b",            \
+	.direction = "in"       \
+}
+
+#define WORKER_MIN_ARG          \
+{                               \
+	.name = "min",          \
+	.type = "u",            \
+	.direction = "in"       \
+}
+
+#define WORKER_MAX_ARG          \
+{                               \
+	.name = "max",          \
+	.type = "u",            \
+	.direction = "in"       \
+}
+
+#define WORKER_GROW_WAIT_ARG    \
+{                               \
+	.name = "grow_wait",    \
+	.type = "u",            \
+	.direction = "in"       \
+}
+
+#define WORKER_INTERVAL_ARG     \
+{                               \
+	.name = "interval",     \
+	.type = "u",            \
+	.direction = "in"       \
+}
+
+/* "handles" or "clients" for GetTopK */
+#define TOPK_WHO_ARG        \
+{                           \
+	.name = "who",      \
+	.type = "s",        \
+	.direction = "in"   \
+}
+
+/* "ops" or "bytes" for GetTopK */
+#define TOPK_BY_ARG         \
+{                           \
+	.name = "by",       \
+	.type = "s",        \
+	.direction = "in"   \
+}
+
+#define TOPK_WINDOW_ARG     \
+{                           \
+	.name = "window",   \
+	.type = "u",        \
+	.direction = "in"   \
+}
+
+#define TOPK_COUNT_ARG      \
+{                           \
+	.name = "count",    \
+	.type = "u",        \
+	.direction = "in"   \
+}
+
+/* Seconds the window of GetTopK covered */
+#define TOPK_COVERED_REPLY  \
+{                           \
+	.name = "covered",  \
+	.type = "u",        \
+	.direction = "out"  \
+}
+
+/* Key, count, error, read, write and other parts of the count */
+#define TOPK_REPLY          \
+{                           \
+	.name = "top",      \
+	.type = "a(sttttt)", \
+	.direction = "out"  \
+}
+
+/* Most lock sites for GetLockProfile to report, 0 for all */
+#define LOCK_PROF_COUNT_ARG \
+{                           \
+	.name = "count",    \
+	.type = "u",        \
+	.direction = "in"   \
+}
+
+/* Acquisitions per hold time sample */
+#define LOCK_PROF_SAMPLE_REPLY \
+{                           \
+	.name = "sample",   \
+	.type = "u",        \
+	.direction = "out"  \
+}
+
+/* The counts of a lock_prof_site, per site */
+#define LOCK_PROF_REPLY     \
+{                           \
+	.name = "lock_sites", \
+	.type = "a(sssutttttta(tt)a(tt))", \
+	.direction = "out"  \
+}
+
+/* Most bytes a thread holds back from the totals, per subsystem */
+#define MEM_ACCT_FLUSH_REPLY \
+{                           \
+	.name = "flush",    \
+	.type = "u",        \
+	.direction = "out"  \
+}
+
+/* Name, bytes and objects of each subsystem */
+#define MEM_ACCT_REPLY      \
+{                           \
+	.name = "subsystems", \
+	.type = "a(stt)",   \
+	.direction = "out"  \
+}
+
+#define REQ_DROPS_REPLY     \
+{                           \
+	.name = "drops",    \
+	.type = "(ttt)",    \
+	.direction = "out"  \
+}
+
+#define ADMISSION_REPLY     \
+{                           \
+	.name = "admission", \
+	.type = "(butuutt)", \
+	.direction = "out"  \
+}
+
+/* Port, idle seconds, shrunk, cached replies and bytes of each
+ * connection's DRC
+ */
+#define CONN_MEM_REPLY      \
+{                           \
+	.name = "connections", \
+	.type = "a(qubutttuu)", \
+	.direction = "out"  \
+}
+
+#define THROTTLE_REPLY      \
+{                           \
+	.name = "throttle", \
+	.type = "(bttttt)", \
+	.direction = "out"  \
+}
+
+/* Export id, entries, entries kept from the reaper, hits and misses of
+ * each export's share of the cache
+ */
+#define CACHE_SHARES_REPLY  \
+{                           \
+	.name = "shares",   \
+	.type = "a(qtttt)", \
+	.direction = "out"  \
+}
+
+/* Name, max workers, max queue, active, queued, peak, admitted, waited
+ * and deferred requests of each partition
+ */
+#define PARTITIONS_REPLY    \
+{                           \
+	.name = "partitions", \
+	.type = "a(suuuuuttt)", \
+	.direction = "out"  \
+}
+
+/* Type, live states, bytes of each and bytes of all of them for each
+ * type of NFSv4 and NLM state
+ */
+#define STATE_COUNTS_REPLY  \
+{                           \
+	.name = "states",   \
+	.type = "a(stut)",  \
+	.direction = "out"  \
+}
+
+/* Huge page backing, allocations, reuses and idle bytes of the I/O
+ * buffer pool, then bytes of its huge page region, carved and on huge
+ * pages
+ */
+#define IOBUF_STATS_REPLY   \
+{                           \
+	.name = "iobufs",   \
+	.type = "(stttttt)", \
+	.direction = "out"  \
+}
+
 #define OP_STATS_REPLY      \
 {                           \
 	.name = "op_stats", \
@@ -264,6 +569,48 @@ struct export_stats {
 	.direction = "out"  \
 }
 
+/* Top of the subtree WarmCache reads, from the root of the export */
+#define WARM_PATH_ARG       \
+{                           \
+	.name = "path",     \
+	.type = "s",        \
+	.direction = "in"   \
+}
+
+/* Levels of directories WarmCache reads, 0 for all */
+#define WARM_DEPTH_ARG      \
+{                           \
+	.name = "depth",    \
+	.type = "u",        \
+	.direction = "in"   \
+}
+
+/* Entries WarmCache reads a second */
+#define WARM_RATE_ARG       \
+{                           \
+	.name = "rate",     \
+	.type = "u",        \
+	.direction = "in"   \
+}
+
+/* Whether WarmCache reads the targets of symlinks */
+#define WARM_SYMLINKS_ARG   \
+{                           \
+	.name = "symlinks", \
+	.type = "b",        \
+	.direction = "in"   \
+}
+
+/* State, export, path, directories, entries, symlinks, errors, queued
+ * directories and milliseconds of the last cache warm
+ */
+#define WARM_PROGRESS_REPLY \
+{                           \
+	.name = "progress", \
+	.type = "(sqstttttt)", \
+	.direction = "out"  \
+}
+
 
 void server_stats_summary(DBusMessageIter * iter, struct gsh_stats *st);
 void server_dbus_v3_iostats(struct nfsv3_stats *v3p, DBusMessageIter *iter);
@@ -280,10 +627,23 @@ void server_dbus_total_ops(struct export_stats *export_st,
 void global_dbus_total_ops(DBusMessageIter *iter);
 void server_dbus_fast_ops(DBusMessageIter *iter);
 void mdcache_dbus_show(DBusMessageIter *iter);
+void mdcache_dbus_shares(DBusMessageIter *iter);
+void mdcache_dbus_warm(DBusMessageIter *iter);
 void reset_server_stats(void);
 void reset_export_stats(void);
 void reset_client_stats(void);
 void reset_gsh_stats(struct gsh_stats *st);
+bool arg_lat_hist_op(DBusMessageIter *args, bool compound, int *nfs_vers,
+		     uint32_t *opcode, char **errormsg);
+void server_dbus_lat_hist(struct gsh_stats *st, int nfs_vers,
+			  uint32_t opcode, DBusMessageIter *iter);
+void server_dbus_stage_hists(int nfs_vers, uint32_t opcode,
+			     DBusMessageIter *iter);
+bool arg_throttle(DBusMessageIter *args, uint64_t *iops, uint64_t *bandwidth,
+		  char **errormsg);
+void server_dbus_throttle(struct gsh_throttle *throttle, uint64_t iops,
+			  uint64_t bandwidth, DBusMessageIter *iter);
+void server_dbus_req_drops(DBusMessageIter *iter);
 
 #ifdef _USE_9P
 void server_dbus_9p_iostats(struct _9p_stats *_9pp, DBusMessageIter *iter);
@@ -292,13 +652,36 @@ void server_dbus_9p_tcpstats(struct _9p_stats *_9pp, DBusMessageIter *iter);
 void server_dbus_9p_rdmastats(struct _9p_stats *_9pp, DBusMessageIter *iter);
 void server_dbus_9p_opstats(struct _9p_stats *_9pp, u8 opcode,
 			    DBusMessageIter *iter);
+void _9p_dbus_req_queues(DBusMessageIter *iter);
+void _9p_dbus_worker_pool(DBusMessageIter *iter);
+#endif
+#ifdef _HAVE_GSSAPI
+void server_dbus_gss_stats(DBusMessageIter *iter);
 #endif
+void pool_dbus_stats(DBusMessageIter *iter);
+void lock_prof_dbus_append(DBusMessageIter *iter, uint32_t count);
+void mem_acct_dbus_append(DBusMessageIter *iter);
+void nfs_admission_dbus_append(DBusMessageIter *iter);
+void partition_dbus_append(DBusMessageIter *iter);
+void state_dbus_counts(DBusMessageIter *iter);
+void iobuf_dbus_stats(DBusMessageIter *iter);
+void nfs_dupreq_dbus_conns(sockaddr_t *addr, DBusMessageIter *iter);
+void server_topk_dbus(enum topk_tracker tracker, uint32_t window,
+		      uint32_t count, DBusMessageIter *iter);
 
 extern struct glist_head fsal_list;
 
 #endif				/* USE_DBUS */
 
 void server_stats_free(struct gsh_stats *statsp);
+void server_stats_merge(struct gsh_stats *stats, pthread_rwlock_t *lock);
+
+struct gsh_stats_shm_hdr;
+struct gsh_stats_shm_entry;
+void server_stats_shm_server(struct gsh_stats_shm_hdr *hdr,
+			     struct gsh_stats_shm_entry *entry);
+void server_stats_shm_fill(struct gsh_stats *st, pthread_rwlock_t *lock,
+			   struct gsh_stats_shm_entry *entry);
 
 void server_stats_init(void);
 
@@ -0,0 +1,92 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file server_topk.h
+ * @brief Hottest handles, clients and users
+ *
+ * With Enable_Top_Tracking, server_stats counts the operations and
+ * bytes of each file handle and client in space-saving summaries of
+ * Top_Tracking_Entries keys.  With Enable_User_Tracking, it also
+ * counts the operations, bytes and time taken of each uid, as resolved
+ * from the request credentials and before any squashing, so the users
+ * behind one busy client can be told apart.
+ *
+ * A summary keeps a key's count exact while the key stays in it, and
+ * when a new key pushes out the smallest one it inherits its count as
+ * an error bound, so any key with more than 1 / Top_Tracking_Entries
+ * of the weight is never lost.
+ *
+ * Summaries are sharded by thread and start over every
+ * Top_Tracking_Interval seconds, the last TOPK_EPOCHS of them are
+ * kept.  GetTopK merges those covering the window asked for.
+ */
+
+#ifndef SERVER_TOPK_H
+#define SERVER_TOPK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Bytes of a key kept for display, longer handles are cut */
+#define TOPK_KEY_MAX 64
+
+/** Intervals kept */
+#define TOPK_EPOCHS 6
+
+enum topk_tracker {
+	TOPK_HANDLE_OPS,
+	TOPK_HANDLE_BYTES,
+	TOPK_CLIENT_OPS,
+	TOPK_CLIENT_BYTES,
+	TOPK_USER_OPS,
+	TOPK_USER_BYTES,
+	TOPK_USER_TIME,		/*< Nanoseconds operations took */
+	TOPK_TRACKERS
+};
+
+/** What an operation or its bytes are also counted as */
+enum topk_class {
+	TOPK_READ,
+	TOPK_WRITE,
+	TOPK_META,
+	TOPK_CLASSES
+};
+
+struct topk_key {
+	uint64_t hash;
+	uint32_t len;		/*< Of the whole key, 0 if there is none */
+	char key[TOPK_KEY_MAX];
+};
+
+void server_topk_key(struct topk_key *key, const char *buf, uint32_t len);
+void server_topk_record(enum topk_tracker tracker,
+			const struct topk_key *key, enum topk_class kind,
+			uint64_t weight);
+void server_topk_client(enum topk_class kind, uint64_t ops,
+			uint64_t bytes);
+void server_topk_user(enum topk_class kind, uint64_t ops, uint64_t bytes,
+		      uint64_t nsecs);
+void server_topk_reset(void);
+
+#endif				/* SERVER_TOPK_H */
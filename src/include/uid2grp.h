@@ -57,6 +57,7 @@ typedef struct group_data {
 	time_t epoch;
 	int nbgroups;
 	unsigned int refcount;
+	uint32_t prefetching;	/*< Callers that found it due for prefetch */
 	pthread_mutex_t lock;
 	gid_t *groups;
 } group_data_t;
@@ -64,6 +65,7 @@ typedef struct group_data {
 extern pthread_rwlock_t uid2grp_user_lock;
 
 void uid2grp_cache_init(void);
+void uid2grp_prefetch_init(void);
 
 void uid2grp_add_user(struct group_data *);
 bool uid2grp_lookup_by_uname(const struct gsh_buffdesc *, uid_t *,
@@ -0,0 +1,580 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file log_async.c
+ * @brief Asynchronous file log facility
+ *
+ * Every thread that logs gets its own ring of formatted messages, so
+ * logging is a copy into memory nobody else writes.  A writer thread
+ * drains all the rings and hands the batch to one writev().  When a
+ * ring is full the message is either dropped and counted or the
+ * thread waits for the writer, as configured.
+ *
+ * This code runs inside the logger, so it must never log, and it uses
+ * the bare pthread calls rather than the PTHREAD_* wrappers, which
+ * log.
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include "log.h"
+#include "gsh_list.h"
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "gsh_intrinsic.h"
+
+/** Rings a thread keeps handy, one per async facility it logs to */
+#define LOG_ASYNC_TCACHE 4
+
+/** Messages handed to one writev() */
+#define LOG_ASYNC_IOV 256
+
+/** How long the writer sleeps when there is nothing to write */
+#define LOG_ASYNC_POLL_MS 10
+
+/** Smallest ring, big enough for several of the longest messages */
+#define LOG_ASYNC_MIN_RING (8 * LOG_BUFF_LEN)
+
+/** Record header marking the unused end of a ring */
+#define LOG_REC_PAD UINT32_MAX
+
+#define LOG_REC_SIZE(len) \
+	((sizeof(uint32_t) + (len) + sizeof(uint32_t) - 1) & \
+	 ~(sizeof(uint32_t) - 1))
+
+/**
+ * @brief One thread's ring of messages
+ *
+ * The owning thread moves head, the writer moves tail.  Each message
+ * is a uint32_t length followed by the text, and never wraps: if it
+ * does not fit before the end, the end is skipped with a pad record.
+ */
+struct log_ring {
+	struct glist_head rings;	/*< On log_async->rings */
+	uint32_t refs;		/*< Owning thread and facility */
+	uint32_t size;		/*< Power of two */
+	uint64_t drain_tail;	/*< Writer's tail before it is published */
+	uint64_t head;
+	GSH_CACHE_PAD(0);
+	uint64_t tail;
+	GSH_CACHE_PAD(1);
+	char data[];
+};
+
+struct log_async {
+	struct glist_head asyncs;	/*< On log_asyncs */
+	struct glist_head rings;	/*< Rings of all threads */
+	pthread_mutex_t mtx;	/*< Protects rings, path and stop */
+	pthread_mutex_t drain_mtx;	/*< One drain at a time, owns iov */
+	pthread_cond_t wake;	/*< Wakes the writer */
+	pthread_t writer;
+	uint64_t id;		/*< Distinguishes facilities in caches */
+	char *path;
+	uint32_t ring_size;
+	enum log_async_full full;
+	bool stop;
+	uint64_t dropped;
+	uint64_t reported;	/*< Drops already noted in the file */
+	struct iovec iov[LOG_ASYNC_IOV + 1];
+	char drop_msg[80];
+	char drain_path[MAXPATHLEN];
+};
+
+struct log_ring_ref {
+	uint64_t id;
+	struct log_ring *ring;
+};
+
+static __thread struct log_ring_ref log_ring_cache[LOG_ASYNC_TCACHE];
+static __thread bool log_ring_registered;
+
+static pthread_once_t log_async_once = PTHREAD_ONCE_INIT;
+static pthread_key_t log_ring_key;
+static pthread_mutex_t log_asyncs_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head log_asyncs = GLIST_HEAD_INIT(log_asyncs);
+static uint64_t log_async_next_id;
+
+static const int log_async_mask = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+
+static void log_ring_put(struct log_ring *ring)
+{
+	if (atomic_dec_uint32_t(&ring->refs) == 0)
+		gsh_free(ring);
+}
+
+/**
+ * @brief Give up a thread's rings when it exits
+ *
+ * The writer frees each ring once it has drained it.
+ */
+static void log_ring_cache_destroy(void *arg)
+{
+	struct log_ring_ref *cache = arg;
+	int i;
+
+	for (i = 0; i < LOG_ASYNC_TCACHE; i++) {
+		if (cache[i].ring != NULL)
+			log_ring_put(cache[i].ring);
+		cache[i].ring = NULL;
+	}
+}
+
+static void log_async_flush_all(void);
+
+static void log_async_once_init(void)
+{
+	if (pthread_key_create(&log_ring_key, log_ring_cache_destroy) != 0)
+		fprintf(stderr, "Could not create async log ring key\n");
+
+	/* Write out what is queued when the server exits, including
+	 * the message of a LogFatal().
+	 */
+	atexit(log_async_flush_all);
+}
+
+/**
+ * @brief Find or make the calling thread's ring for a facility
+ */
+static struct log_ring *log_ring_get(struct log_async *async)
+{
+	struct log_ring *ring;
+	int i, slot = LOG_ASYNC_TCACHE - 1;
+
+	for (i = 0; i < LOG_ASYNC_TCACHE; i++) {
+		if (log_ring_cache[i].id == async->id &&
+		    log_ring_cache[i].ring != NULL)
+			return log_ring_cache[i].ring;
+		if (log_ring_cache[i].ring == NULL)
+			slot = MIN(slot, i);
+	}
+
+	if (unlikely(!log_ring_registered)) {
+		(void) pthread_setspecific(log_ring_key, log_ring_cache);
+		log_ring_registered = true;
+	}
+
+	/* Out of slots, the oldest ring goes to the writer to drain */
+	if (log_ring_cache[slot].ring != NULL) {
+		log_ring_put(log_ring_cache[0].ring);
+		memmove(&log_ring_cache[0], &log_ring_cache[1],
+			sizeof(log_ring_cache[0]) * (LOG_ASYNC_TCACHE - 1));
+	}
+
+	ring = gsh_calloc(1, sizeof(*ring) + async->ring_size);
+	ring->size = async->ring_size;
+	ring->refs = 2;
+
+	pthread_mutex_lock(&async->mtx);
+	glist_add_tail(&async->rings, &ring->rings);
+	pthread_mutex_unlock(&async->mtx);
+
+	log_ring_cache[slot].id = async->id;
+	log_ring_cache[slot].ring = ring;
+
+	return ring;
+}
+
+/**
+ * @brief Copy a message, and maybe a newline, into a ring
+ *
+ * @return false if the ring is full.
+ */
+static bool log_ring_push(struct log_async *async, struct log_ring *ring,
+			  const char *msg, uint32_t len, bool newline)
+{
+	uint64_t head = ring->head;
+	uint64_t tail = atomic_fetch_uint64_t(&ring->tail);
+	uint32_t off = head & (ring->size - 1);
+	uint32_t need = LOG_REC_SIZE(len + newline);
+	uint32_t pad = 0;
+
+	if (off + need > ring->size)
+		pad = ring->size - off;
+
+	if (ring->size - (head - tail) < pad + need)
+		return false;
+
+	if (pad != 0) {
+		*(uint32_t *)(ring->data + off) = LOG_REC_PAD;
+		off = 0;
+	}
+
+	*(uint32_t *)(ring->data + off) = len + newline;
+	memcpy(ring->data + off + sizeof(uint32_t), msg, len);
+	if (newline)
+		ring->data[off + sizeof(uint32_t) + len] = '\n';
+
+	atomic_store_uint64_t(&ring->head, head + pad + need);
+
+	/* Don't leave the writer asleep on a filling ring */
+	if (head + pad + need - tail > ring->size / 2)
+		pthread_cond_signal(&async->wake);
+
+	return true;
+}
+
+/**
+ * @brief Write out everything queued, up to LOG_ASYNC_IOV messages
+ *
+ * The batch is gathered under async->mtx, then written with it
+ * dropped so logging threads registering a ring or a path change
+ * don't wait on the file.  The messages stay put meanwhile, since a
+ * ring's tail only moves once they are written.  Rings whose thread
+ * has gone are freed once empty.
+ *
+ * @return Number of messages written.
+ */
+static uint32_t log_async_drain(struct log_async *async)
+{
+	struct glist_head *glist, *glistn;
+	struct log_ring *ring;
+	uint32_t iovcnt = 0, msgs, off, len;
+	uint64_t tail, head, dropped;
+	ssize_t want = 0, rc = 0;
+	int fd, err = 0;
+
+	pthread_mutex_lock(&async->drain_mtx);
+	pthread_mutex_lock(&async->mtx);
+
+	glist_for_each(glist, &async->rings) {
+		ring = glist_entry(glist, struct log_ring, rings);
+		tail = ring->tail;
+		head = atomic_fetch_uint64_t(&ring->head);
+
+		while (tail != head && iovcnt < LOG_ASYNC_IOV) {
+			off = tail & (ring->size - 1);
+			len = *(uint32_t *)(ring->data + off);
+			if (len == LOG_REC_PAD) {
+				tail += ring->size - off;
+				continue;
+			}
+			async->iov[iovcnt].iov_base =
+				ring->data + off + sizeof(uint32_t);
+			async->iov[iovcnt].iov_len = len;
+			want += len;
+			iovcnt++;
+			tail += LOG_REC_SIZE(len);
+		}
+		ring->drain_tail = tail;
+	}
+
+	msgs = iovcnt;
+
+	dropped = atomic_fetch_uint64_t(&async->dropped);
+	if (dropped != async->reported) {
+		len = snprintf(async->drop_msg, sizeof(async->drop_msg),
+			       "%" PRIu64
+			       " log messages dropped, log buffer full\n",
+			       dropped - async->reported);
+		async->iov[iovcnt].iov_base = async->drop_msg;
+		async->iov[iovcnt].iov_len = len;
+		want += len;
+		iovcnt++;
+		async->reported = dropped;
+	}
+
+	(void)snprintf(async->drain_path, sizeof(async->drain_path), "%s",
+		       async->path);
+
+	pthread_mutex_unlock(&async->mtx);
+
+	if (iovcnt != 0) {
+		fd = open(async->drain_path, O_WRONLY | O_APPEND | O_CREAT,
+			  log_async_mask);
+		if (fd != -1) {
+			rc = writev(fd, async->iov, iovcnt);
+			if (rc < 0)
+				err = errno;
+			else if (rc < want)
+				err = ENOSPC;
+			(void)close(fd);
+		} else {
+			err = errno;
+		}
+
+		if (err != 0)
+			fprintf(stderr,
+				"Error: couldn't complete write to the log file %s status=%d (%s), %u messages lost\n",
+				async->drain_path, err, strerror(err), msgs);
+	}
+
+	pthread_mutex_lock(&async->mtx);
+
+	glist_for_each_safe(glist, glistn, &async->rings) {
+		ring = glist_entry(glist, struct log_ring, rings);
+		atomic_store_uint64_t(&ring->tail, ring->drain_tail);
+
+		/* Only our reference left and nothing more can come */
+		if (atomic_fetch_uint32_t(&ring->refs) == 1 &&
+		    ring->drain_tail == atomic_fetch_uint64_t(&ring->head)) {
+			glist_del(&ring->rings);
+			log_ring_put(ring);
+		}
+	}
+
+	pthread_mutex_unlock(&async->mtx);
+	pthread_mutex_unlock(&async->drain_mtx);
+
+	return msgs;
+}
+
+static void *log_async_writer(void *arg)
+{
+	struct log_async *async = arg;
+	struct timespec ts;
+
+	for (;;) {
+		if (log_async_drain(async) != 0)
+			continue;
+
+		pthread_mutex_lock(&async->mtx);
+		if (async->stop) {
+			pthread_mutex_unlock(&async->mtx);
+			break;
+		}
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += LOG_ASYNC_POLL_MS * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+		(void)pthread_cond_timedwait(&async->wake, &async->mtx, &ts);
+		pthread_mutex_unlock(&async->mtx);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Write out every async facility, at exit
+ */
+static void log_async_flush_all(void)
+{
+	struct glist_head *glist;
+	struct log_async *async;
+
+	pthread_mutex_lock(&log_asyncs_mtx);
+	glist_for_each(glist, &log_asyncs) {
+		async = glist_entry(glist, struct log_async, asyncs);
+		while (log_async_drain(async) != 0)
+			;
+	}
+	pthread_mutex_unlock(&log_asyncs_mtx);
+}
+
+static int log_async_push(struct log_async *async, const char *msg,
+			  uint32_t len, bool newline)
+{
+	struct log_ring *ring = log_ring_get(async);
+	struct timespec ts = { .tv_sec = 0, .tv_nsec = 50000 };
+
+	/* Keep a record to half a ring, so it always fits eventually */
+	if (len > ring->size / 2 - 2 * sizeof(uint32_t))
+		len = ring->size / 2 - 2 * sizeof(uint32_t);
+
+	while (!log_ring_push(async, ring, msg, len, newline)) {
+		if (async->full == LOG_ASYNC_DROP)
+			return -ENOSPC;
+		pthread_cond_signal(&async->wake);
+		(void)nanosleep(&ts, NULL);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Log facility function for async files
+ *
+ * @param[in] private  struct log_async from log_async_create()
+ */
+int log_to_async(log_header_t headers, void *private,
+		 log_levels_t level,
+		 struct display_buffer *buffer, char *compstr,
+		 char *message)
+{
+	struct log_async *async = private;
+	int rc;
+
+	rc = log_async_push(async, buffer->b_start,
+			    display_buffer_len(buffer), true);
+	if (rc != 0)
+		(void) atomic_inc_uint64_t(&async->dropped);
+
+	return rc;
+}
+
+/**
+ * @brief Queue a binary record on an async file
+ *
+ * The record is written as is, and a dropped record is left to the
+ * caller to account for, so nothing but records reaches the file.
+ *
+ * @return 0, or -ENOSPC if the record was dropped.
+ */
+int log_async_record(struct log_async *async, const void *rec, uint32_t len)
+{
+	return log_async_push(async, rec, len, false);
+}
+
+/**
+ * @brief Set up an async file for create_log_facility()
+ *
+ * @param[in] path       Log file
+ * @param[in] ring_size  Bytes of ring per logging thread
+ * @param[in] full       What to do when a ring is full
+ *
+ * @return The private data for log_to_async(), NULL on failure.
+ */
+struct log_async *log_async_create(const char *path, uint32_t ring_size,
+				   enum log_async_full full)
+{
+	struct log_async *async;
+	char *dir;
+	int rc;
+
+	if (path == NULL || *path == '\0' || strlen(path) >= MAXPATHLEN) {
+		LogCrit(COMPONENT_LOG, "New log file path empty or too long");
+		return NULL;
+	}
+	dir = alloca(strlen(path) + 1);
+	strcpy(dir, path);
+	dir = dirname(dir);
+	if (access(dir, W_OK) != 0) {
+		rc = errno;
+		LogCrit(COMPONENT_LOG,
+			"Cannot create new log file (%s), because: %s",
+			path, strerror(rc));
+		return NULL;
+	}
+
+	(void)pthread_once(&log_async_once, log_async_once_init);
+
+	async = gsh_calloc(1, sizeof(*async));
+
+	async->ring_size = LOG_ASYNC_MIN_RING;
+	while (async->ring_size < ring_size)
+		async->ring_size <<= 1;
+	async->full = full;
+	async->path = gsh_strdup(path);
+	async->id = atomic_inc_uint64_t(&log_async_next_id);
+	glist_init(&async->rings);
+	pthread_mutex_init(&async->mtx, NULL);
+	pthread_mutex_init(&async->drain_mtx, NULL);
+	pthread_cond_init(&async->wake, NULL);
+
+	rc = pthread_create(&async->writer, NULL, log_async_writer, async);
+	if (rc != 0) {
+		LogCrit(COMPONENT_LOG,
+			"Could not start async log writer for %s: %s",
+			path, strerror(rc));
+		pthread_cond_destroy(&async->wake);
+		pthread_mutex_destroy(&async->drain_mtx);
+		pthread_mutex_destroy(&async->mtx);
+		gsh_free(async->path);
+		gsh_free(async);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&log_asyncs_mtx);
+	glist_add_tail(&log_asyncs, &async->asyncs);
+	pthread_mutex_unlock(&log_asyncs_mtx);
+
+	return async;
+}
+
+/**
+ * @brief Write out and free an async file
+ *
+ * The facility must already be unreachable, so no thread is in
+ * log_to_async() for it.
+ */
+void log_async_destroy(struct log_async *async)
+{
+	struct glist_head *glist, *glistn;
+	struct log_ring *ring;
+
+	pthread_mutex_lock(&log_asyncs_mtx);
+	glist_del(&async->asyncs);
+	pthread_mutex_unlock(&log_asyncs_mtx);
+
+	pthread_mutex_lock(&async->mtx);
+	async->stop = true;
+	pthread_cond_signal(&async->wake);
+	pthread_mutex_unlock(&async->mtx);
+
+	(void)pthread_join(async->writer, NULL);
+
+	/* Threads still holding a ring free it when they exit */
+	glist_for_each_safe(glist, glistn, &async->rings) {
+		ring = glist_entry(glist, struct log_ring, rings);
+		glist_del(&ring->rings);
+		log_ring_put(ring);
+	}
+
+	pthread_cond_destroy(&async->wake);
+	pthread_mutex_destroy(&async->drain_mtx);
+	pthread_mutex_destroy(&async->mtx);
+	gsh_free(async->path);
+	gsh_free(async);
+}
+
+/**
+ * @brief Point an async file somewhere else
+ *
+ * The caller has checked the directory is writable.
+ */
+void log_async_set_path(struct log_async *async, const char *path)
+{
+	char *new_path = gsh_strdup(path);
+	char *old_path;
+
+	pthread_mutex_lock(&async->mtx);
+	old_path = async->path;
+	async->path = new_path;
+	pthread_mutex_unlock(&async->mtx);
+
+	gsh_free(old_path);
+}
+
+/**
+ * @brief Current file of an async facility
+ *
+ * Only stable while the caller holds the logger lock.
+ */
+const char *log_async_path(struct log_async *async)
+{
+	return async->path;
+}
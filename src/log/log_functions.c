@@ -837,6 +837,8 @@ void release_log_facility(const char *name)
 	if (facility->lf_func == log_to_file &&
 	    facility->lf_private != NULL)
 		gsh_free(facility->lf_private);
+	else if (facility->lf_func == log_to_async)
+		log_async_destroy(facility->lf_private);
 	gsh_free(facility->lf_name);
 	gsh_free(facility);
 }
@@ -1018,7 +1020,8 @@ int set_log_destination(const char *name, char *dest)
 			 name);
 		return -ENOENT;
 	}
-	if (facility->lf_func == log_to_file) {
+	if (facility->lf_func == log_to_file ||
+	    facility->lf_func == log_to_async) {
 		char *logfile, *dir;
 
 		dir = alloca(strlen(dest) + 1);
@@ -1032,9 +1035,13 @@ int set_log_destination(const char *name, char *dest)
 				dest, strerror(errno));
 			return -errno;
 		}
-		logfile = gsh_strdup(dest);
-		gsh_free(facility->lf_private);
-		facility->lf_private = logfile;
+		if (facility->lf_func == log_to_async) {
+			log_async_set_path(facility->lf_private, dest);
+		} else {
+			logfile = gsh_strdup(dest);
+			gsh_free(facility->lf_private);
+			facility->lf_private = logfile;
+		}
 	} else if (facility->lf_func == log_to_stream) {
 		FILE *out;
 
@@ -1573,7 +1580,8 @@ static log_levels_t default_log_levels[] = {
 	[COMPONENT_9P_DISPATCH] = NIV_EVENT,
 	[COMPONENT_FSAL_UP] = NIV_EVENT,
 	[COMPONENT_DBUS] = NIV_EVENT,
-	[COMPONENT_NFS_MSK] = NIV_EVENT
+	[COMPONENT_NFS_MSK] = NIV_EVENT,
+	[COMPONENT_SLOW_REQ] = NIV_EVENT
 };
 
 log_levels_t *component_log_level = default_log_levels;
@@ -1689,7 +1697,10 @@ struct log_component_info LogComponents[COMPONENT_COUNT] = {
 		.comp_str = "DBUS",},
 	[COMPONENT_NFS_MSK] = {
 		.comp_name = "COMPONENT_NFS_MSK",
-		.comp_str = "NFS_MSK",}
+		.comp_str = "NFS_MSK",},
+	[COMPONENT_SLOW_REQ] = {
+		.comp_name = "COMPONENT_SLOW_REQ",
+		.comp_str = "SLOW_REQ",}
 };
 
 void DisplayLogComponentLevel(log_components_t component, const char *file,
@@ -1851,6 +1862,7 @@ HANDLE_PROP(9P_DISPATCH);
 HANDLE_PROP(FSAL_UP);
 HANDLE_PROP(DBUS);
 HANDLE_PROP(NFS_MSK);
+HANDLE_PROP(SLOW_REQ);
 
 static struct gsh_dbus_prop *log_props[] = {
 	LOG_PROPERTY_ITEM(ALL),
@@ -1890,6 +1902,7 @@ static struct gsh_dbus_prop *log_props[] = {
 	LOG_PROPERTY_ITEM(FSAL_UP),
 	LOG_PROPERTY_ITEM(DBUS),
 	LOG_PROPERTY_ITEM(NFS_MSK),
+	LOG_PROPERTY_ITEM(SLOW_REQ),
 	NULL
 };
 
@@ -1918,6 +1931,9 @@ struct facility_config {
 	log_header_t headers;
 	log_levels_t max_level;
 	void *lf_private;
+	bool async;
+	uint32_t async_ring_size;
+	enum log_async_full async_full;
 };
 
 /**
@@ -1930,6 +1946,17 @@ struct logger_config {
 	log_levels_t *comp_log_level;
 	log_levels_t default_level;
 	uint32_t rpc_debug_flags;
+	struct trace_config *trace;
+};
+
+/**
+ * @brief Binary trace parameters
+ */
+struct trace_config {
+	char *file;
+	uint32_t ring_size;
+	enum log_async_full full;
+	log_levels_t levels[COMPONENT_COUNT];
 };
 
 /**
@@ -2187,6 +2214,8 @@ static struct config_item component_levels[] = {
 			 COMPONENT_DBUS, int),
 	CONF_INDEX_TOKEN("NFS_MSK", NB_LOG_LEVEL, log_levels,
 			 COMPONENT_NFS_MSK, int),
+	CONF_INDEX_TOKEN("SLOW_REQ", NB_LOG_LEVEL, log_levels,
+			 COMPONENT_SLOW_REQ, int),
 	CONFIG_EOL
 };
 
@@ -2267,6 +2296,63 @@ static struct config_item_list enable_options[] = {
 	CONFIG_LIST_EOL
 };
 
+static struct config_item_list async_full_options[] = {
+	CONFIG_LIST_TOK("drop", LOG_ASYNC_DROP),
+	CONFIG_LIST_TOK("block", LOG_ASYNC_BLOCK),
+	CONFIG_LIST_EOL
+};
+
+/**
+ * @brief Binary trace parameters
+ *
+ * Only the components log_trace_setup() knows about are here.
+ */
+static struct config_item trace_params[] = {
+	CONF_ITEM_PATH("File", 1, MAXPATHLEN, NULL,
+		       trace_config, file),
+	CONF_ITEM_UI32("Ring_Size", 16384, 16777216, 1048576,
+		       trace_config, ring_size),
+	CONF_ITEM_TOKEN("Full", LOG_ASYNC_DROP, async_full_options,
+			trace_config, full),
+	CONF_ITEM_TOKEN("NFS4", NIV_NULL, log_levels,
+			trace_config, levels[COMPONENT_NFS_V4]),
+	CONF_ITEM_TOKEN("CACHE_INODE", NIV_NULL, log_levels,
+			trace_config, levels[COMPONENT_CACHE_INODE]),
+	CONF_ITEM_TOKEN("CACHE_INODE_LRU", NIV_NULL, log_levels,
+			trace_config, levels[COMPONENT_CACHE_INODE_LRU]),
+	CONF_ITEM_TOKEN("STATE", NIV_NULL, log_levels,
+			trace_config, levels[COMPONENT_STATE]),
+	CONFIG_EOL
+};
+
+static void *trace_init(void *link_mem, void *self_struct)
+{
+	struct trace_config *trace = self_struct;
+
+	assert(link_mem != NULL || self_struct != NULL);
+
+	if (link_mem == NULL)
+		return NULL;
+	if (self_struct == NULL)
+		return gsh_calloc(1, sizeof(struct trace_config));
+
+	if (trace->file != NULL)
+		gsh_free(trace->file);
+	gsh_free(trace);
+	return NULL;
+}
+
+static int trace_commit(void *node, void *link_mem, void *self_struct,
+			struct config_error_type *err_type)
+{
+	struct trace_config **tracep = link_mem;
+	struct logger_config *logger;
+
+	logger = container_of(tracep, struct logger_config, trace);
+	logger->trace = self_struct;
+	return 0;
+}
+
 static struct config_item facility_params[] = {
 	CONF_ITEM_STR("name", 1, 20, NULL,
 		      facility_config, facility_name),
@@ -2278,6 +2364,12 @@ static struct config_item facility_params[] = {
 			facility_config, headers),
 	CONF_ITEM_TOKEN("enable", FAC_IDLE, enable_options,
 			facility_config, state),
+	CONF_ITEM_BOOL("async", false,
+		       facility_config, async),
+	CONF_ITEM_UI32("async_ring_size", 16384, 16777216, 262144,
+		       facility_config, async_ring_size),
+	CONF_ITEM_TOKEN("async_full", LOG_ASYNC_DROP, async_full_options,
+			facility_config, async_full),
 	CONFIG_EOL
 };
 
@@ -2361,7 +2453,7 @@ static int facility_commit(void *node, void *link_mem, void *self_struct,
 			if (conf->headers == NB_LH_TYPES)
 				conf->headers = LH_COMPONENT;
 		} else {
-			conf->func = log_to_file;
+			conf->func = conf->async ? log_to_async : log_to_file;
 			conf->lf_private = conf->dest;
 			if (conf->headers == NB_LH_TYPES)
 				conf->headers = LH_ALL;
@@ -2421,6 +2513,10 @@ static void *log_conf_init(void *link_mem, void *self_struct)
 					  logger->logfields);
 			logger->logfields = NULL;
 		}
+		if (logger->trace != NULL) {
+			(void)trace_init(&logger->trace, logger->trace);
+			logger->trace = NULL;
+		}
 	}
 	return NULL;
 }
@@ -2445,11 +2541,24 @@ static int log_conf_commit(void *node, void *link_mem, void *self_struct,
 				 conf->facility_name);
 			goto done;
 		}
+		if (conf->func == log_to_async) {
+			conf->lf_private =
+				log_async_create(conf->dest,
+						 conf->async_ring_size,
+						 conf->async_full);
+			if (conf->lf_private == NULL) {
+				err_type->resource = true;
+				errcnt++;
+				goto done;
+			}
+		}
 		rc = create_log_facility(conf->facility_name,
 					 conf->func,
 					 conf->max_level,
 					 conf->headers,
 					 conf->lf_private);
+		if (rc != 0 && conf->func == log_to_async)
+			log_async_destroy(conf->lf_private);
 		if (rc != 0 && rc != -EEXIST) {
 			LogCrit(COMPONENT_CONFIG,
 				"Failed to create facility (%s), (%s)",
@@ -2548,6 +2657,17 @@ static int log_conf_commit(void *node, void *link_mem, void *self_struct,
 		}
 		ntirpc_pp.debug_flags = logger->rpc_debug_flags;
 		SetNTIRPCLogLevel(component_log_level[COMPONENT_TIRPC]);
+		if (logger->trace != NULL) {
+			struct trace_config *trace = logger->trace;
+
+			if (log_trace_setup(trace->file, trace->ring_size,
+					    trace->full, trace->levels) != 0) {
+				LogCrit(COMPONENT_CONFIG,
+					"Could not start the binary trace");
+				err_type->resource = true;
+				errcnt++;
+			}
+		}
 	} else {
 		if (logger->logfields != NULL) {
 			struct logfields *lf = logger->logfields;
@@ -2561,8 +2681,11 @@ static int log_conf_commit(void *node, void *link_mem, void *self_struct,
 		if (logger->comp_log_level != NULL)
 			gsh_free(logger->comp_log_level);
 	}
+	if (logger->trace != NULL)
+		(void)trace_init(&logger->trace, logger->trace);
 	logger->logfields = NULL;
 	logger->comp_log_level = NULL;
+	logger->trace = NULL;
 	return errcnt;
 }
 
@@ -2581,6 +2704,9 @@ static struct config_item logging_params[] = {
 	CONF_ITEM_BLOCK("Components", component_levels,
 			component_init, component_commit,
 			logger_config, comp_log_level),
+	CONF_ITEM_BLOCK("Trace", trace_params,
+			trace_init, trace_commit,
+			logger_config, trace),
 	CONFIG_EOL
 };
 
@@ -2644,6 +2770,11 @@ void gsh_backtrace(void)
 				  O_WRONLY | O_APPEND | O_CREAT, log_mask);
 			break;
 		}
+		if (facility->lf_func == log_to_async) {
+			fd = open(log_async_path(facility->lf_private),
+				  O_WRONLY | O_APPEND | O_CREAT, log_mask);
+			break;
+		}
 	}
 
 	if (fd != -1) {
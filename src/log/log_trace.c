@@ -0,0 +1,424 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file log_trace.c
+ * @brief Binary trace of debug messages
+ *
+ * A traced debug message is saved as its call site id and its raw
+ * arguments, and the printf formatting is done offline by
+ * tools/ganesha_trace.py.  The first time a site is hit in a trace
+ * file, its format, file, line and function are written out so the
+ * file can be decoded on its own.  Records go through the async log
+ * rings, so the caller only pays for the copy.
+ *
+ * Every record starts with a struct trace_rec_hdr, in the byte order
+ * of the server.
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "log.h"
+#include "abstract_atomic.h"
+#include "gsh_intrinsic.h"
+
+enum trace_rec_type {
+	TRACE_REC_SITE = 1,	/*< Describes a call site */
+	TRACE_REC_EVENT,	/*< One message */
+	TRACE_REC_DROP		/*< Messages a thread dropped */
+};
+
+enum trace_arg_type {
+	TRACE_ARG_INT = 1,	/*< int, 4 bytes */
+	TRACE_ARG_LONG,		/*< long long, pointers, 8 bytes */
+	TRACE_ARG_DOUBLE,	/*< double, 8 bytes */
+	TRACE_ARG_STR		/*< uint16_t length then the bytes */
+};
+
+#define TRACE_NO_ARGS UINT8_MAX
+
+/** Longest string argument kept */
+#define TRACE_MAX_STR 256
+
+/** Longest format, file or function name kept in a site record */
+#define TRACE_MAX_NAME 512
+
+#define TRACE_MAX_REC \
+	(sizeof(struct trace_event) + \
+	 LOG_TRACE_MAX_ARGS * (sizeof(uint16_t) + TRACE_MAX_STR))
+
+struct trace_rec_hdr {
+	uint32_t len;		/*< Whole record */
+	uint32_t type;
+};
+
+/* Followed by the types, then NUL terminated format, file, function
+ * and component name.
+ */
+struct trace_site_rec {
+	struct trace_rec_hdr hdr;
+	uint32_t id;
+	uint32_t line;
+	uint32_t nargs;
+};
+
+/* Followed by the arguments */
+struct trace_event {
+	struct trace_rec_hdr hdr;
+	uint32_t id;
+	uint32_t tid;
+	uint64_t ns;		/*< CLOCK_REALTIME */
+	uint16_t component;
+	uint16_t level;
+	uint32_t reserved;
+};
+
+struct trace_drop {
+	struct trace_rec_hdr hdr;
+	uint32_t tid;
+	uint32_t reserved;
+	uint64_t count;
+};
+
+log_levels_t trace_log_level[COMPONENT_COUNT];
+
+/** Components that can be traced */
+static const log_components_t trace_components[] = {
+	COMPONENT_NFS_V4,
+	COMPONENT_CACHE_INODE,
+	COMPONENT_CACHE_INODE_LRU,
+	COMPONENT_STATE,
+};
+
+#define TRACE_NCOMPONENTS \
+	(sizeof(trace_components) / sizeof(trace_components[0]))
+
+static struct log_async *trace_async;
+static pthread_mutex_t trace_mtx = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t trace_next_id;
+static uint32_t trace_gen = 1;
+
+static __thread uint32_t trace_tid;
+static __thread uint64_t trace_dropped;
+
+/**
+ * @brief Work out the argument types of a format
+ *
+ * @return Number of arguments, or TRACE_NO_ARGS if the format has a
+ *         conversion that can't be saved raw.
+ */
+static uint8_t trace_parse_format(const char *fmt, uint8_t *types)
+{
+	uint8_t nargs = 0;
+	int lng;
+
+	while ((fmt = strchr(fmt, '%')) != NULL) {
+		fmt++;
+		if (*fmt == '%') {
+			fmt++;
+			continue;
+		}
+
+		fmt += strspn(fmt, "-+ #0'I");
+
+		/* Width and precision */
+		while (*fmt == '*' || *fmt == '.' ||
+		       (*fmt >= '0' && *fmt <= '9')) {
+			if (*fmt == '*') {
+				if (nargs == LOG_TRACE_MAX_ARGS)
+					return TRACE_NO_ARGS;
+				types[nargs++] = TRACE_ARG_INT;
+			}
+			fmt++;
+		}
+
+		lng = 0;
+		while (strchr("hlqjzt", *fmt) != NULL && *fmt != '\0') {
+			if (*fmt != 'h')
+				lng = 1;
+			fmt++;
+		}
+
+		if (nargs == LOG_TRACE_MAX_ARGS)
+			return TRACE_NO_ARGS;
+
+		switch (*fmt) {
+		case 'd':
+		case 'i':
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			types[nargs++] = lng ? TRACE_ARG_LONG : TRACE_ARG_INT;
+			break;
+		case 'c':
+			types[nargs++] = TRACE_ARG_INT;
+			break;
+		case 'p':
+			types[nargs++] = TRACE_ARG_LONG;
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			types[nargs++] = TRACE_ARG_DOUBLE;
+			break;
+		case 's':
+			if (lng)
+				return TRACE_NO_ARGS;
+			types[nargs++] = TRACE_ARG_STR;
+			break;
+		default:
+			/* %n, %m, %L... */
+			return TRACE_NO_ARGS;
+		}
+		fmt++;
+	}
+
+	return nargs;
+}
+
+static void trace_push(const void *rec, uint32_t len, bool must)
+{
+	struct timespec ts = { .tv_sec = 0, .tv_nsec = 50000 };
+
+	while (log_async_record(trace_async, rec, len) != 0) {
+		if (!must) {
+			trace_dropped++;
+			return;
+		}
+		/* A site must be described or its events are lost */
+		(void)nanosleep(&ts, NULL);
+	}
+}
+
+/**
+ * @brief Describe a site in the current trace file
+ *
+ * Sites are registered once; when the trace moves to a new file they
+ * are described again the next time they are hit.
+ */
+static void trace_register(struct log_trace_site *site, const char *file,
+			   int line, const char *function,
+			   log_components_t component, const char *format)
+{
+	char buf[sizeof(struct trace_site_rec) + LOG_TRACE_MAX_ARGS +
+		 4 * TRACE_MAX_NAME];
+	struct trace_site_rec *rec = (struct trace_site_rec *)buf;
+	const char *strs[] = {
+		format, file, function, LogComponents[component].comp_str
+	};
+	uint32_t len, gen;
+	size_t slen;
+	int i;
+
+	pthread_mutex_lock(&trace_mtx);
+
+	gen = atomic_fetch_uint32_t(&trace_gen);
+	if (site->id != 0 && site->gen == gen) {
+		pthread_mutex_unlock(&trace_mtx);
+		return;
+	}
+
+	if (site->id == 0) {
+		site->format = format;
+		site->nargs = trace_parse_format(format, site->types);
+		site->id = ++trace_next_id;
+	}
+
+	rec->hdr.type = TRACE_REC_SITE;
+	rec->id = site->id;
+	rec->line = line;
+	rec->nargs = site->nargs;
+	len = sizeof(*rec);
+
+	if (site->nargs != TRACE_NO_ARGS) {
+		memcpy(buf + len, site->types, site->nargs);
+		len += site->nargs;
+	}
+
+	for (i = 0; i < 4; i++) {
+		slen = strnlen(strs[i], TRACE_MAX_NAME - 1);
+		memcpy(buf + len, strs[i], slen);
+		buf[len + slen] = '\0';
+		len += slen + 1;
+	}
+
+	rec->hdr.len = len;
+	trace_push(buf, len, true);
+
+	atomic_store_uint32_t(&site->gen, gen);
+	pthread_mutex_unlock(&trace_mtx);
+}
+
+/**
+ * @brief Record a debug message in the binary trace
+ *
+ * Use the LogDebug() family rather than calling this.
+ */
+void log_trace(struct log_trace_site *site, log_components_t component,
+	       const char *file, int line, const char *function,
+	       log_levels_t level, const char *format, ...)
+{
+	char buf[TRACE_MAX_REC];
+	struct trace_event *ev = (struct trace_event *)buf;
+	struct timespec ts;
+	uint32_t len = sizeof(*ev);
+	va_list args;
+	int i;
+
+	if (unlikely(atomic_fetch_uint32_t(&site->gen) !=
+		     atomic_fetch_uint32_t(&trace_gen)))
+		trace_register(site, file, line, function, component, format);
+
+	/* One site, one format, or we can't trust the types */
+	if (unlikely(site->format != format))
+		return;
+
+	if (unlikely(trace_tid == 0))
+		trace_tid = syscall(SYS_gettid);
+
+	if (unlikely(trace_dropped != 0)) {
+		struct trace_drop drop = {
+			.hdr.len = sizeof(drop),
+			.hdr.type = TRACE_REC_DROP,
+			.tid = trace_tid,
+			.count = trace_dropped,
+		};
+
+		trace_dropped = 0;
+		trace_push(&drop, sizeof(drop), false);
+		if (trace_dropped != 0) {
+			/* Still full, this one goes too */
+			trace_dropped = drop.count + 1;
+			return;
+		}
+	}
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	ev->hdr.type = TRACE_REC_EVENT;
+	ev->id = site->id;
+	ev->tid = trace_tid;
+	ev->ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	ev->component = component;
+	ev->level = level;
+	ev->reserved = 0;
+
+	va_start(args, format);
+	for (i = 0; site->nargs != TRACE_NO_ARGS && i < site->nargs; i++) {
+		switch (site->types[i]) {
+		case TRACE_ARG_INT: {
+			int32_t v = va_arg(args, int);
+
+			memcpy(buf + len, &v, sizeof(v));
+			len += sizeof(v);
+			break;
+		}
+		case TRACE_ARG_LONG: {
+			uint64_t v = va_arg(args, unsigned long long);
+
+			memcpy(buf + len, &v, sizeof(v));
+			len += sizeof(v);
+			break;
+		}
+		case TRACE_ARG_DOUBLE: {
+			double v = va_arg(args, double);
+
+			memcpy(buf + len, &v, sizeof(v));
+			len += sizeof(v);
+			break;
+		}
+		case TRACE_ARG_STR: {
+			const char *v = va_arg(args, const char *);
+			uint16_t slen;
+
+			if (v == NULL)
+				v = "(null)";
+			slen = strnlen(v, TRACE_MAX_STR);
+			memcpy(buf + len, &slen, sizeof(slen));
+			memcpy(buf + len + sizeof(slen), v, slen);
+			len += sizeof(slen) + slen;
+			break;
+		}
+		}
+	}
+	va_end(args);
+
+	ev->hdr.len = len;
+	trace_push(buf, len, false);
+}
+
+/**
+ * @brief Start, retarget or stop the binary trace
+ *
+ * The ring size and full policy are fixed by the first call that
+ * names a file.  Tracing is never torn down, since threads may be
+ * inside log_trace() at any time; without a file it is just turned
+ * off.
+ *
+ * @param[in] file       Trace file, NULL to stop tracing
+ * @param[in] ring_size  Bytes of ring per thread
+ * @param[in] full       What to do when a ring is full
+ * @param[in] levels     Trace level of each component
+ *
+ * @return 0 on success, -1 if the trace could not be started.
+ */
+int log_trace_setup(const char *file, uint32_t ring_size,
+		    enum log_async_full full, const log_levels_t *levels)
+{
+	size_t i;
+
+	for (i = 0; i < TRACE_NCOMPONENTS; i++)
+		trace_log_level[trace_components[i]] = NIV_NULL;
+
+	if (file == NULL)
+		return 0;
+
+	if (trace_async == NULL) {
+		trace_async = log_async_create(file, ring_size, full);
+		if (trace_async == NULL)
+			return -1;
+	} else if (strcmp(log_async_path(trace_async), file) != 0) {
+		/* Describe every site again in the new file */
+		pthread_mutex_lock(&trace_mtx);
+		log_async_set_path(trace_async, file);
+		(void) atomic_inc_uint32_t(&trace_gen);
+		pthread_mutex_unlock(&trace_mtx);
+	}
+
+	for (i = 0; i < TRACE_NCOMPONENTS; i++)
+		trace_log_level[trace_components[i]] =
+			levels[trace_components[i]];
+
+	return 0;
+}
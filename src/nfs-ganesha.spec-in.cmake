@@ -42,6 +42,12 @@ Requires: openSUSE-release
 @BCOND_NULLFS@ nullfs
 %global use_fsal_null %{on_off_switch nullfs}
 
+@BCOND_DATACACHE@ datacache
+%global use_fsal_datacache %{on_off_switch datacache}
+
+@BCOND_OPSTATS@ opstats
+%global use_fsal_opstats %{on_off_switch opstats}
+
 @BCOND_MEM@ mem
 %global use_fsal_mem %{on_off_switch mem}
 
@@ -299,6 +305,32 @@ This package contains a Stackable FSAL shared object to
 be used with NFS-Ganesha. This is mostly a template for future (more sophisticated) stackable FSALs
 %endif
 
+# DATACACHE
+%if %{with datacache}
+%package datacache
+Summary: The NFS-GANESHA DATACACHE Stackable FSAL
+Group: Applications/System
+Requires: nfs-ganesha = %{version}-%{release}
+
+%description datacache
+This package contains a Stackable FSAL shared object to
+be used with NFS-Ganesha. It caches file data in memory, and
+optionally in a local file, in front of remote backends
+%endif
+
+# OPSTATS
+%if %{with opstats}
+%package opstats
+Summary: The NFS-GANESHA OPSTATS Stackable FSAL
+Group: Applications/System
+Requires: nfs-ganesha = %{version}-%{release}
+
+%description opstats
+This package contains a Stackable FSAL shared object to
+be used with NFS-Ganesha. It counts and times every call made
+to the FSAL below it, per export
+%endif
+
 # MEM
 %if %{with mem}
 %package mem
@@ -478,6 +510,8 @@ Development headers and auxiliary files for developing with %{name}.
 cmake .	-DCMAKE_BUILD_TYPE=Debug			\
 	-DBUILD_CONFIG=rpmbuild				\
 	-DUSE_FSAL_NULL=%{use_fsal_null}		\
+	-DUSE_FSAL_DATACACHE=%{use_fsal_datacache}	\
+	-DUSE_FSAL_OPSTATS=%{use_fsal_opstats}		\
 	-DUSE_FSAL_MEM=%{use_fsal_mem}			\
 	-DUSE_FSAL_XFS=%{use_fsal_xfs}			\
 	-DUSE_FSAL_LUSTRE=%{use_fsal_lustre}			\
@@ -721,6 +755,22 @@ exit 0
 %{_libdir}/ganesha/libfsalnull*
 %endif
 
+%if %{with datacache}
+%files datacache
+%{_libdir}/ganesha/libfsaldatacache*
+%if %{with man_page}
+%{_mandir}/*/ganesha-datacache-config.8.gz
+%endif
+%endif
+
+%if %{with opstats}
+%files opstats
+%{_libdir}/ganesha/libfsalopstats*
+%if %{with man_page}
+%{_mandir}/*/ganesha-opstats-config.8.gz
+%endif
+%endif
+
 %if %{with mem}
 %files mem
 %{_libdir}/ganesha/libfsalmem*
@@ -838,6 +888,7 @@ exit 0
 %{_bindir}/get_clientids
 %{_bindir}/grace_period
 %{_bindir}/ganesha_stats
+%{_bindir}/ganesha_top
 %{_bindir}/sm_notify.ganesha
 %{_bindir}/ganesha_mgr
 %{_bindir}/ganesha_conf
@@ -207,7 +207,7 @@ gid_t getgroup(void)
 	return getegid();
 }
 
-void setuser(uid_t uid)
+int setuser(uid_t uid)
 {
 	int rc = setthreaduid(uid);
 
@@ -215,9 +215,10 @@ void setuser(uid_t uid)
 		LogCrit(COMPONENT_FSAL,
 			"Could not set user identity %s (%d)",
 			strerror(errno), errno);
+	return rc;
 }
 
-void setgroup(gid_t gid)
+int setgroup(gid_t gid)
 {
 	int rc = setthreadgid(gid);
 
@@ -225,6 +226,7 @@ void setgroup(gid_t gid)
 		LogCrit(COMPONENT_FSAL,
 			"Could not set group identity %s (%d)",
 			strerror(errno), errno);
+	return rc;
 }
 
 int set_threadgroups(size_t size, const gid_t *list)
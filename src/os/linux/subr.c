@@ -116,7 +116,7 @@ gid_t getgroup(void)
 	return getegid();
 }
 
-void setuser(uid_t uid)
+int setuser(uid_t uid)
 {
 	int rc = syscall(SYS_setresuid, -1, uid, -1);
 
@@ -124,9 +124,10 @@ void setuser(uid_t uid)
 		LogCrit(COMPONENT_FSAL,
 			"Could not set user identity %s (%d)",
 			strerror(errno), errno);
+	return rc;
 }
 
-void setgroup(gid_t gid)
+int setgroup(gid_t gid)
 {
 	int rc = syscall(SYS_setresgid, -1, gid, -1);
 
@@ -134,6 +135,7 @@ void setgroup(gid_t gid)
 		LogCrit(COMPONENT_FSAL,
 			"Could not set group identity %s (%d)",
 			strerror(errno), errno);
+	return rc;
 }
 
 int set_threadgroups(size_t size, const gid_t *list)
@@ -165,6 +165,16 @@ class ExportMgr():
 
         return True, "Done: "+msg
 
+    def ApplyExport(self, config):
+        apply_export_method = self.dbusobj.get_dbus_method("ApplyExport",
+                                                           self.dbus_interface)
+        try:
+           msg = apply_export_method(config)
+        except dbus.exceptions.DBusException as e:
+           return False, e
+
+        return True, "Done: "+msg
+
     def RemoveExport(self, exp_id):
         rm_export_method = self.dbusobj.get_dbus_method("RemoveExport",
                                                         self.dbus_interface)
@@ -183,6 +193,45 @@ class ExportMgr():
            return False, e, []
         return True, "Done", [id, fullpath, pseudopath, tag]
 
+    def WarmCache(self, exp_id, path, depth, rate, symlinks):
+        warm_cache_method = self.dbusobj.get_dbus_method("WarmCache",
+                                                         self.dbus_interface)
+        try:
+           reply = warm_cache_method(dbus.UInt16(int(exp_id)), path,
+                                     dbus.UInt32(int(depth)),
+                                     dbus.UInt32(int(rate)),
+                                     dbus.Boolean(symlinks))
+        except dbus.exceptions.DBusException as e:
+           return False, e
+        return reply[0], reply[1]
+
+    def WarmCacheProgress(self):
+        progress_method = self.dbusobj.get_dbus_method("WarmCacheProgress",
+                                                       self.dbus_interface)
+        try:
+           reply = progress_method()
+        except dbus.exceptions.DBusException as e:
+           return False, e, None
+        return reply[0], reply[1], reply[3]
+
+    def InvalidateCache(self, exp_id):
+        invalidate_method = self.dbusobj.get_dbus_method("InvalidateCache",
+                                                         self.dbus_interface)
+        try:
+           reply = invalidate_method(dbus.UInt16(int(exp_id)))
+        except dbus.exceptions.DBusException as e:
+           return False, e
+        return reply[0], reply[1]
+
+    def CancelWarmCache(self):
+        cancel_method = self.dbusobj.get_dbus_method("CancelWarmCache",
+                                                     self.dbus_interface)
+        try:
+           reply = cancel_method()
+        except dbus.exceptions.DBusException as e:
+           return False, e
+        return reply[0], reply[1]
+
     def ShowExports(self):
         show_export_method = self.dbusobj.get_dbus_method("ShowExports",
                                                           self.dbus_interface)
@@ -244,6 +293,18 @@ class AdminInterface():
         msg = reply[1]
         return status, msg
 
+    def get_grace_progress(self):
+        method = self.dbusobj.get_dbus_method("get_grace_progress",
+                                              self.dbus_interface)
+        try:
+           reply = method()
+        except dbus.exceptions.DBusException as e:
+           return False, e, None
+
+        status = reply[7]
+        msg = reply[8]
+        return status, msg, reply[0:7]
+
     def shutdown(self):
         shutdown_method = self.dbusobj.get_dbus_method("shutdown",
                                                        self.dbus_interface)
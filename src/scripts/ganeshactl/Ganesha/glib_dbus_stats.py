@@ -45,6 +45,32 @@ class RetrieveExportStats():
         stats_op = self.exportmgrobj.get_dbus_method("ShowCacheInode",
                                  self.dbus_exportstats_name)
         return InodeStats(stats_op())
+    def cache_share_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("ShowCacheShares",
+                                 self.dbus_exportstats_name)
+        return CacheShareStats(stats_op())
+    # request queue classes
+    def queue_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("GetReqQueueStats",
+                                 self.dbus_exportstats_name)
+        return QueueStats(stats_op())
+    # adaptive 9P worker pool
+    def worker_pool_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("GetWorkerPool",
+                                 self.dbus_exportstats_name)
+        return WorkerPoolStats(stats_op())
+    def partition_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("GetPartitions",
+                                 self.dbus_exportstats_name)
+        return PartitionStats(stats_op())
+    def state_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("GetStateCounts",
+                                 self.dbus_exportstats_name)
+        return StateStats(stats_op())
+    def iobuf_stats(self):
+        stats_op = self.exportmgrobj.get_dbus_method("GetIOBuffers",
+                                 self.dbus_exportstats_name)
+        return IOBufStats(stats_op())
     # list of all exports
     def export_stats(self):
         stats_op = self.exportmgrobj.get_dbus_method("ShowExports",
@@ -95,6 +121,54 @@ class RetrieveExportStats():
             stats_dict[export_id] = stats_op(int(export_id))
             return PNFSStats(stats_dict)
 
+    # latency histogram of one operation, for the server or an export
+    def lat_hist(self, op, export_id=None):
+        if export_id is None:
+            stats_op = self.exportmgrobj.get_dbus_method("GetGlobalLatencyHist",
+                                     self.dbus_exportstats_name)
+            return LatencyHist(stats_op(op[0], op[1]))
+        stats_op = self.exportmgrobj.get_dbus_method("GetLatencyHist",
+                                 self.dbus_exportstats_name)
+        return LatencyHist(stats_op(export_id, op[0], op[1]))
+
+    # stage histograms of one operation, or of NFSv4 COMPOUNDs
+    def stage_hist(self, op):
+        stats_op = self.exportmgrobj.get_dbus_method("GetStageHist",
+                                 self.dbus_exportstats_name)
+        return StageHist(stats_op(op[0], op[1]))
+
+    # hottest handles, clients or users by ops or bytes, or users by time,
+    # over the last window seconds
+    def topk(self, who, by, window, count):
+        stats_op = self.exportmgrobj.get_dbus_method("GetTopK",
+                                 self.dbus_exportstats_name)
+        return TopK(who, by, stats_op(who, by, dbus.UInt32(window),
+                                      dbus.UInt32(count)))
+
+    # lock sites that waited the most
+    def lock_prof(self, count):
+        stats_op = self.exportmgrobj.get_dbus_method("GetLockProfile",
+                                 self.dbus_exportstats_name)
+        return LockProfile(stats_op(dbus.UInt32(count)))
+
+    # memory of each subsystem
+    def mem_acct(self):
+        stats_op = self.exportmgrobj.get_dbus_method("GetMemoryAccounting",
+                                 self.dbus_exportstats_name)
+        return MemoryAccounting(stats_op())
+
+    # requests dropped before execution
+    def req_drops(self):
+        stats_op = self.exportmgrobj.get_dbus_method("GetRequestDrops",
+                                 self.dbus_exportstats_name)
+        return RequestDrops(stats_op())
+
+    # whether busy connections are held back
+    def admission(self):
+        stats_op = self.exportmgrobj.get_dbus_method("GetAdmission",
+                                 self.dbus_exportstats_name)
+        return Admission(stats_op())
+
     # Reset the statistics counters for all
     def reset_stats(self):
         stats_state = self.exportmgrobj.get_dbus_method("ResetStats",
@@ -149,6 +223,16 @@ class RetrieveClientStats():
         stats_op = self.clientmgrobj.get_dbus_method("ShowClients",
                           self.dbus_clientmgr_name)
         return Clients(stats_op())
+    # latency histogram of one operation for a single client ip
+    def lat_hist(self, ip, op):
+        stats_op = self.clientmgrobj.get_dbus_method("GetLatencyHist",
+                          self.dbus_clientstats_name)
+        return LatencyHist(stats_op(ip, op[0], op[1]))
+    # DRC memory of the connections of a single client ip
+    def connections(self, ip):
+        stats_op = self.clientmgrobj.get_dbus_method("GetConnections",
+                          self.dbus_clientstats_name)
+        return Connections(stats_op(ip))
 
 class Clients():
     def __init__(self, clients):
@@ -168,6 +252,24 @@ class Clients():
                        "\nNFSv4.2 stats available: " + str(client[7]) +
                        "\n9P stats available: " + str(client[8]) )
         return output
+class Connections():
+    def __init__(self, stats):
+        self.status = stats[1]
+        if stats[0]:
+            self.timestamp = (stats[2][0], stats[2][1])
+            self.conns = stats[3]
+    def __str__(self):
+        if self.status != "OK":
+            return ("GANESHA RESPONSE STATUS: " + self.status)
+        output = ("Timestamp: " + time.ctime(self.timestamp[0]) + str(self.timestamp[1]) + " nsecs\n" +
+                  " Port   Idle (s)  Shrunk  Cached replies     Bytes" +
+                  "       Hits     Misses  Hiwat  Retrans (s)\n")
+        for (port, idle, shrunk, size, nbytes, hits, misses, hiwat,
+             retrans) in self.conns:
+            output += (" %5d %10d  %6s %15d %9d %10d %10d %6d %12d\n" %
+                       (port, idle, bool(shrunk), size, nbytes, hits,
+                        misses, hiwat, retrans))
+        return output
 class DelegStats():
     def __init__(self, stats):
         self.status = stats[1]
@@ -177,6 +279,9 @@ class DelegStats():
             self.curr_recall = stats[3][1]
             self.fail_recall = stats[3][2]
             self.num_revokes = stats[3][3]
+            self.tot_grants = stats[3][4]
+            self.recalls_avoided = stats[3][5]
+            self.recall_latency = stats[3][6]
     def __str__(self):
         if self.status != "OK":
             return ("GANESHA RESPONSE STATUS: " + self.status)
@@ -186,7 +291,10 @@ class DelegStats():
                      "\nCurrent Delegations: " + str(self.curr_deleg) +
                      "\nCurrent Recalls: " + str(self.curr_recall) +
                      "\nCurrent Failed Recalls: " + str(self.fail_recall) +
-                     "\nCurrent Number of Revokes: " + str(self.num_revokes) )
+                     "\nCurrent Number of Revokes: " + str(self.num_revokes) +
+                     "\nTotal Grants: " + str(self.tot_grants) +
+                     "\nRecalls Avoided: " + str(self.recalls_avoided) +
+                     "\nAverage Recall Latency: " + str(self.recall_latency) + " secs" )
 
 class Export():
     def __init__(self, export):
@@ -249,6 +357,27 @@ class GlobalStats():
                 "\nTotal NFSv4.2 ops: " + str(self.nfsv42_total))
         return output
 
+class CacheShareStats():
+    def __init__(self, stats):
+        self.status = stats[1]
+        if stats[1] != "OK":
+            return
+        self.timestamp = (stats[2][0], stats[2][1])
+        self.shares = stats[3]
+    def __str__(self):
+        if self.status != "OK":
+            return "GANESHA RESPONSE STATUS: " + self.status
+        output = ("Timestamp: " + time.ctime(self.timestamp[0]) + str(self.timestamp[1]) + " nsecs\n")
+        output += ("%-10s %12s %12s %14s %14s %8s\n" %
+                   ("Export id", "Entries", "Kept", "Hits", "Misses",
+                    "Hit %"))
+        for (export_id, entries, kept, hits, misses) in self.shares:
+            lookups = hits + misses
+            ratio = 100.0 * hits / lookups if lookups else 0.0
+            output += ("%-10d %12d %12d %14d %14d %8.1f\n" %
+                       (export_id, entries, kept, hits, misses, ratio))
+        return output
+
 class InodeStats():
     def __init__(self, stats):
         self.status = stats[1]
@@ -261,6 +390,36 @@ class InodeStats():
         self.cache_conflict = stats[3][7]
         self.cache_add = stats[3][9]
         self.cache_mapping = stats[3][11]
+        self.lru_2q_hit = stats[3][13]
+        self.lru_2q_miss = stats[3][15]
+        self.lru_2q_ghost_hit = stats[3][17]
+        self.entry_bytes = stats[3][19]
+        self.chunk_bytes = stats[3][21]
+        self.dirent_bytes = stats[3][23]
+        self.xattr_bytes = stats[3][25]
+        self.memory_limit = stats[3][27]
+        self.attr_trusted = stats[3][29]
+        self.attr_refreshed = stats[3][31]
+        self.xattr_hit = stats[3][33]
+        self.xattr_miss = stats[3][35]
+        self.entry_size = stats[3][37]
+        self.dirent_size = stats[3][39]
+        self.key_inlined = stats[3][41]
+        self.key_allocated = stats[3][43]
+        self.key_allocated_bytes = stats[3][45]
+        self.key_prefixed = stats[3][47]
+        self.key_prefixes = stats[3][49]
+        (self.lookup_hit, self.lookup_miss, self.lookup_negative_hit,
+         self.attr_hit, self.attr_miss, self.attr_expired,
+         self.chunk_hit, self.chunk_fill, self.reap_alloc, self.reap_trim,
+         self.lru_demote, self.fd_reclaim, self.chunk_reap,
+         self.symlink_hit, self.symlink_miss,
+         self.parent_hit, self.parent_miss,
+         self.chunk_spill, self.chunk_restore) = stats[3][51::2]
+    def ratio(self, hits, misses):
+        if hits + misses == 0:
+            return "-"
+        return "%.1f%%" % (100.0 * hits / (hits + misses))
     def __str__(self):
         if self.status != "OK":
             return "No NFS activity, GANESHA RESPONSE STATUS: " + self.status
@@ -270,7 +429,320 @@ class InodeStats():
                  "\nInode Cache Misses: " + str(self.cache_miss) +
                  "\nInode Cache Conflicts:: " + str(self.cache_conflict) +
                  "\nInode Cache Adds: " + str(self.cache_add) +
-                 "\nInode Cache Mapping: " + str(self.cache_mapping) )
+                 "\nInode Cache Mapping: " + str(self.cache_mapping) +
+                 "\nInode LRU 2Q Hits: " + str(self.lru_2q_hit) +
+                 "\nInode LRU 2Q Misses: " + str(self.lru_2q_miss) +
+                 "\nInode LRU 2Q Ghost Hits: " + str(self.lru_2q_ghost_hit) +
+                 "\nEntry Memory (bytes): " + str(self.entry_bytes) +
+                 "\nChunk Memory (bytes): " + str(self.chunk_bytes) +
+                 "\nDirent Memory (bytes): " + str(self.dirent_bytes) +
+                 "\nXattr Memory (bytes): " + str(self.xattr_bytes) +
+                 "\nCache Memory Limit (bytes): " + str(self.memory_limit) +
+                 "\nAttributes Served Past Expiry: " + str(self.attr_trusted) +
+                 "\nAttributes Refreshed: " + str(self.attr_refreshed) +
+                 "\nXattr Cache Hits: " + str(self.xattr_hit) +
+                 "\nXattr Cache Misses: " + str(self.xattr_miss) +
+                 "\nEntry Size (bytes): " + str(self.entry_size) +
+                 "\nDirent Size (bytes): " + str(self.dirent_size) +
+                 "\nKeys Inlined: " + str(self.key_inlined) +
+                 "\nKeys Allocated: " + str(self.key_allocated) +
+                 "\nKey Memory Allocated (bytes): " + str(self.key_allocated_bytes) +
+                 "\nKeys Sharing A Prefix: " + str(self.key_prefixed) +
+                 "\nKey Prefixes Interned: " + str(self.key_prefixes) +
+                 "\nName Lookup Hits: " + str(self.lookup_hit) +
+                 "\nName Lookup Negative Hits: " + str(self.lookup_negative_hit) +
+                 "\nName Lookup Misses: " + str(self.lookup_miss) +
+                 "\nName Lookup Hit Rate: " +
+                 self.ratio(self.lookup_hit + self.lookup_negative_hit,
+                            self.lookup_miss) +
+                 "\nAttribute Hits: " + str(self.attr_hit) +
+                 "\nAttribute Misses: " + str(self.attr_miss) +
+                 "\nAttribute Misses From Expiry: " + str(self.attr_expired) +
+                 "\nAttribute Hit Rate: " +
+                 self.ratio(self.attr_hit, self.attr_miss) +
+                 "\nDirent Chunk Hits: " + str(self.chunk_hit) +
+                 "\nDirent Chunks Read From FSAL: " + str(self.chunk_fill) +
+                 "\nDirent Chunk Hit Rate: " +
+                 self.ratio(self.chunk_hit, self.chunk_fill) +
+                 "\nEntries Recycled For New Entries: " + str(self.reap_alloc) +
+                 "\nEntries Freed By LRU Thread: " + str(self.reap_trim) +
+                 "\nEntries Demoted To L2: " + str(self.lru_demote) +
+                 "\nFiles Closed On Demotion: " + str(self.fd_reclaim) +
+                 "\nChunks Recycled For New Chunks: " + str(self.chunk_reap) +
+                 "\nSymlink Hits: " + str(self.symlink_hit) +
+                 "\nSymlink Misses: " + str(self.symlink_miss) +
+                 "\nParent Lookups From Cache: " + str(self.parent_hit) +
+                 "\nParent Lookups From FSAL: " + str(self.parent_miss) +
+                 "\nChunks Saved To Chunk Store: " + str(self.chunk_spill) +
+                 "\nChunks Read From Chunk Store: " + str(self.chunk_restore) )
+
+class LatencyHist():
+    def __init__(self, stats):
+        self.success = stats[0]
+        self.status = stats[1]
+        if self.success:
+            self.timestamp = (stats[2][0], stats[2][1])
+            (self.total, self.p50, self.p90, self.p99, self.p999,
+             self.buckets) = stats[3]
+    def __str__(self):
+        if not self.success:
+            return "GANESHA RESPONSE STATUS: " + self.status
+        output = ""
+        if self.status != "OK":
+            output += self.status + "\n"
+        output += ("Timestamp: " + time.ctime(self.timestamp[0]) + str(self.timestamp[1]) + " nsecs" +
+                   "\nOperations: " + str(self.total) +
+                   "\np50: " + str(self.p50) + " ns" +
+                   "\np90: " + str(self.p90) + " ns" +
+                   "\np99: " + str(self.p99) + " ns" +
+                   "\np99.9: " + str(self.p999) + " ns\n" +
+                   "%16s %14s\n" % (">= ns", "Count"))
+        for (low, count) in self.buckets:
+            output += "%16d %14d\n" % (low, count)
+        return output
+
+class StageHist():
+    def __init__(self, stats):
+        self.success = stats[0]
+        self.status = stats[1]
+        if self.success:
+            self.timestamp = (stats[2][0], stats[2][1])
+            self.stages = stats[3]
+    def __str__(self):
+        if not self.success:
+            return "GANESHA RESPONSE STATUS: " + self.status
+        output = ""
+        if self.status != "OK":
+            output += self.status + "\n"
+        output += ("Timestamp: " + time.ctime(self.timestamp[0]) + str(self.timestamp[1]) + " nsecs\n" +
+                   "%-8s %12s %12s %12s %12s %12s\n" %
+                   ("Stage", "Count", "p50 ns", "p90 ns", "p99 ns", "p99.9 ns"))
+        for (name, (total, p50, p90, p99, p999, buckets)) in self.stages:
+            output += "%-8s %12d %12d %12d %12d %12d\n" % (name, total, p50, p90, p99, p999)
+        return output
+
+class TopK():
+    def __init__(self, who, by, stats):
+        self.who = who
+        self.by = by
+        self.success = stats[0]
+        self.status = stats[1]
+        if self.success:
+            self.timestamp = (stats[2][0], stats[2][1])
+            self.covered = stats[3]
+            self.top = stats[4]
+    def __str__(self):
+        if not self.success:
+            return "GANESHA RESPONSE STATUS: " + self.status
+        output = ""
+        if self.status != "OK":
+            output += self.status + "\n"
+        # time is counted in nanoseconds, shown in microseconds
+        scale = 1000 if self.by == "time" else 1
+        by = "Time us" if self.by == "time" else self.by.capitalize()
+        output += ("Timestamp: " + time.ctime(self.timestamp[0]) + str(self.timestamp[1]) + " nsecs\n" +
+                   "Top " + self.who + " by " + self.by + " over the last " +
+                   str(self.covered) + " seconds\n" +
+                   "%14s %14s %12s %12s %12s  %s\n" %
+                   (by, "Error", "Read", "Write", "Other",
+                    self.who.capitalize()[:-1]))
+        for (key, count, error, read, write, other) in self.top:
+            output += "%14d %14d %12d %12d %12d  %s\n" % (
+                count / scale, error / scale, read / scale, write / scale,
+                other / scale, key)
+        return output
+
+class LockProfile():
+    def __init__(self, stats):
+        self.success = stats[0]
+        self.status = stats[1]
+        if self.success:
+            self.timestamp = (stats[2][0], stats[2][1])
+            self.sample = stats[3]
+            self.sites = stats[4]
+    def __str__(self):
+        if not self.success:
+            return "GANESHA RESPONSE STATUS: " + self.status
+        output = ""
+        if self.status != "OK":
+            output += self.status + "\n"
+        output += ("Timestamp: " + time.ctime(self.timestamp[0]) + str(self.timestamp[1]) + " nsecs\n" +
+                   "Hold times of 1 in " + str(self.sample) + " acquisitions\n" +
+                   "%-40s %-7s %10s %12s %10s %10s %10s\n" %
+                   ("Site", "Kind", "Waits", "Wait ms", "Max us", "Avg hold", "Max hold"))
+        for (path, name, kind, line, waits, wait_ns, max_wait,
+             sampled, hold_ns, max_hold, wait_hist, hold_hist) in self.sites:
+            site = "%s:%d %s" % (path.split('/')[-1], line, name)
+            avg_hold = hold_ns / sampled if sampled else 0
+            output += "%-40s %-7s %10d %12.3f %10d %10d %10d\n" % (
+                site[:40], kind, waits, wait_ns / 1e6, max_wait / 1000,
+                avg_hold, max_hold)
+        output += "Hold times are in ns\n"
+        return output
+
+class MemoryAccounting():
+    def __init__(self, stats):
+        self.success = stats[0]
+        self.status = stats[1]
+        if self.success:
+            self.timestamp = (stats[2][0], stats[2][1])
+            self.flush = stats[3]
+            self.subsystems = stats[4]
+    def __str__(self):
+        if not self.success:
+            return "GANESHA RESPONSE STATUS: " + self.status
+        output = ("Timestamp: " + time.ctime(self.timestamp[0]) + str(self.timestamp[1]) + " nsecs\n" +
+                  "%-12s %16s %12s\n" % ("Subsystem", "Bytes", "Objects"))
+        total = 0
+        for (name, nbytes, objects) in self.subsystems:
+            output += "%-12s %16d %12d\n" % (name, nbytes, objects)
+            total += nbytes
+        output += "%-12s %16d\n" % ("total", total)
+        output += ("Each count may lag by up to " + str(self.flush) +
+                   " bytes per thread\n")
+        return output
+
+class RequestDrops():
+    def __init__(self, stats):
+        self.success = stats[0]
+        self.status = stats[1]
+        if self.success:
+            self.timestamp = (stats[2][0], stats[2][1])
+            (self.xprt, self.duplicate, self.age) = stats[3]
+    def __str__(self):
+        if not self.success:
+            return "GANESHA RESPONSE STATUS: " + self.status
+        return ("Timestamp: " + time.ctime(self.timestamp[0]) + str(self.timestamp[1]) + " nsecs\n" +
+                "Requests dropped before execution\n" +
+                "  connection closed:          " + str(self.xprt) + "\n" +
+                "  retransmission in progress: " + str(self.duplicate) + "\n" +
+                "  past Max_Request_Age:       " + str(self.age) + "\n")
+
+class Admission():
+    def __init__(self, stats):
+        self.success = stats[0]
+        self.status = stats[1]
+        if self.success:
+            self.timestamp = (stats[2][0], stats[2][1])
+            (self.closed, self.inflight, self.nbytes, self.busy,
+             self.waiting, self.closings, self.held) = stats[3]
+    def __str__(self):
+        if not self.success:
+            return "GANESHA RESPONSE STATUS: " + self.status
+        output = ("Timestamp: " + time.ctime(self.timestamp[0]) + str(self.timestamp[1]) + " nsecs\n" +
+                  "Status: " + self.status + "\n")
+        if self.closed:
+            output += "Busy connections held back\n"
+        else:
+            output += "All connections read\n"
+        output += ("Requests in progress:       " + str(self.inflight) + "\n" +
+                   "Request and buffer bytes:   " + str(self.nbytes) + "\n" +
+                   "Connections with requests:  " + str(self.busy) + "\n" +
+                   "Receives held back now:     " + str(self.waiting) + "\n" +
+                   "High watermarks crossed:    " + str(self.closings) + "\n" +
+                   "Receives held back:         " + str(self.held) + "\n")
+        return output
+
+class QueueStats():
+    def __init__(self, stats):
+        self.success = stats[0]
+        self.status = stats[1]
+        if self.success:
+            self.timestamp = (stats[2][0], stats[2][1])
+            self.queues = stats[3]
+    def __str__(self):
+        if not self.success:
+            return "GANESHA RESPONSE STATUS: " + self.status
+        output = ("Timestamp: " + time.ctime(self.timestamp[0]) + str(self.timestamp[1]) + " nsecs\n" +
+                  "%-20s %10s %14s %14s %14s\n" % ("Queue", "Depth", "Enqueued", "Dequeued", "Avg wait(ns)"))
+        for (name, depth, enq, deq, wait) in self.queues:
+            output += "%-20s %10d %14d %14d %14d\n" % (name, depth, enq, deq, wait)
+        return output
+
+class WorkerPoolStats():
+    def __init__(self, stats):
+        self.success = stats[0]
+        self.status = stats[1]
+        if self.success:
+            self.timestamp = (stats[2][0], stats[2][1])
+            self.pool = stats[3]
+    def __str__(self):
+        if not self.success:
+            return "GANESHA RESPONSE STATUS: " + self.status
+        (enable, wmin, wmax, grow_wait, interval, target, threads, busy,
+         wait, grows, shrinks) = self.pool
+        return ("Timestamp: " + time.ctime(self.timestamp[0]) + str(self.timestamp[1]) + " nsecs\n" +
+                "Adaptive:                 " + str(bool(enable)) + "\n" +
+                "Bounds:                   " + str(wmin) + " - " + str(wmax) + "\n" +
+                "Grow wait (us):           " + str(grow_wait) + "\n" +
+                "Interval (s):             " + str(interval) + "\n" +
+                "Target workers:           " + str(target) + "\n" +
+                "Running workers:          " + str(threads) + "\n" +
+                "Busy workers:             " + str(busy) + "\n" +
+                "Avg wait (ns):            " + str(wait) + "\n" +
+                "Grows:                    " + str(grows) + "\n" +
+                "Shrinks:                  " + str(shrinks) + "\n")
+
+class PartitionStats():
+    def __init__(self, stats):
+        self.success = stats[0]
+        self.status = stats[1]
+        if self.success:
+            self.timestamp = (stats[2][0], stats[2][1])
+            self.partitions = stats[3]
+    def __str__(self):
+        if not self.success:
+            return "GANESHA RESPONSE STATUS: " + self.status
+        output = ("Timestamp: " + time.ctime(self.timestamp[0]) + str(self.timestamp[1]) + " nsecs\n")
+        if not self.partitions:
+            return output + "No partitions configured\n"
+        output += ("%-20s %8s %8s %8s %8s %8s %12s %12s %12s\n" %
+                   ("Partition", "Workers", "Queue", "Active", "Queued",
+                    "Peak", "Admitted", "Waited", "Deferred"))
+        for (name, workers, queue, active, queued, peak, admitted, waited,
+             deferred) in self.partitions:
+            output += ("%-20s %8d %8d %8d %8d %8d %12d %12d %12d\n" %
+                       (name, workers, queue, active, queued, peak,
+                        admitted, waited, deferred))
+        return output
+
+class StateStats():
+    def __init__(self, stats):
+        self.success = stats[0]
+        self.status = stats[1]
+        if self.success:
+            self.timestamp = (stats[2][0], stats[2][1])
+            self.states = stats[3]
+    def __str__(self):
+        if not self.success:
+            return "GANESHA RESPONSE STATUS: " + self.status
+        output = ("Timestamp: " + time.ctime(self.timestamp[0]) + str(self.timestamp[1]) + " nsecs\n")
+        output += ("%-12s %12s %8s %14s\n" %
+                   ("State", "Count", "Size", "Bytes"))
+        for (name, count, size, total) in self.states:
+            output += ("%-12s %12d %8d %14d\n" %
+                       (name, count, size, total))
+        return output
+
+class IOBufStats():
+    def __init__(self, stats):
+        self.success = stats[0]
+        self.status = stats[1]
+        if self.success:
+            self.timestamp = (stats[2][0], stats[2][1])
+            self.iobufs = stats[3]
+    def __str__(self):
+        if not self.success:
+            return "GANESHA RESPONSE STATUS: " + self.status
+        (pages, allocs, reused, idle, size, used, backed) = self.iobufs
+        return ("Timestamp: " + time.ctime(self.timestamp[0]) + str(self.timestamp[1]) + " nsecs\n" +
+                "Allocations:              " + str(allocs) + "\n" +
+                "Reused:                   " + str(reused) + "\n" +
+                "Idle bytes:               " + str(idle) + "\n" +
+                "Huge region pages:        " + pages + "\n" +
+                "Huge region bytes:        " + str(size) + "\n" +
+                "Huge region carved:       " + str(used) + "\n" +
+                "On huge pages:            " + str(backed) + "\n")
 
 class FastStats():
     def __init__(self, stats):
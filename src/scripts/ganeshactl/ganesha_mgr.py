@@ -109,6 +109,11 @@ class ShowExports():
         status, msg = self.exportmgr.UpdateExport(conf_path, exp_expr)
         self.status_message(status, msg)
 
+    def applyexport(self, config):
+        print("Apply Export config")
+        status, msg = self.exportmgr.ApplyExport(config)
+        self.status_message(status, msg)
+
     def displayexport(self, exp_id):
         print("Display export with id %d" % int(exp_id))
         status, msg, reply = self.exportmgr.DisplayExport(exp_id)
@@ -121,6 +126,34 @@ class ShowExports():
         else:
            self.status_message(status, msg)
 
+    def warmcache(self, exp_id, path, depth, rate, symlinks):
+        print("Warm cache with %s of export %d" % (path, int(exp_id)))
+        status, msg = self.exportmgr.WarmCache(exp_id, path, depth, rate,
+                                               symlinks)
+        self.status_message(status, msg)
+
+    def warmcacheprogress(self):
+        status, msg, progress = self.exportmgr.WarmCacheProgress()
+        if not status:
+            self.status_message(status, msg)
+            return
+        (state, exp_id, path, dirs, entries, links, errors, queued,
+         elapsed) = progress
+        print("Cache warm of %s, export %d: %s after %.1fs"
+              % (path, exp_id, state, elapsed / 1000.0))
+        print("Directories: %d, waiting: %d, entries: %d, symlinks: %d,"
+              " errors: %d" % (dirs, queued, entries, links, errors))
+
+    def cancelwarmcache(self):
+        print("Cancel cache warm")
+        status, msg = self.exportmgr.CancelWarmCache()
+        self.status_message(status, msg)
+
+    def invalidatecache(self, exp_id):
+        print("Invalidate cache of export %d" % int(exp_id))
+        status, msg = self.exportmgr.InvalidateCache(exp_id)
+        self.status_message(status, msg)
+
     def proc_export(self, id, path, pseudo, tag):
         print("export %d: path = %s, pseudo = %s, tag = %s" % (id, path, pseudo, tag))
 
@@ -165,6 +198,19 @@ class ServerAdmin():
         status, msg = self.admin.grace(ipaddr)
         self.status_message(status, msg)
 
+    def grace_progress(self):
+        status, msg, progress = self.admin.get_grace_progress()
+        if not status:
+            self.status_message(status, msg)
+            return
+        (ingrace, elapsed, grace, floor, expected, started,
+         completed) = progress
+        print("In grace: %s" % bool(ingrace))
+        print("Elapsed: %us of %us (early lift after %us)"
+              % (elapsed, grace, floor))
+        print("Recovery clients: %u, returned: %u, reclaim complete: %u"
+              % (expected, started, completed))
+
     def purge_netgroups(self):
         print("Purging netgroups cache")
         status, msg = self.admin.purge_netgroups()
@@ -237,6 +283,19 @@ if __name__ == '__main__':
        "   display_export export_id: \n"                                     \
        "      Displays the export with the given ID\n\n"                     \
        "   show_exports: Displays all current exports\n\n"                   \
+       "   warm_cache export_id path [depth [rate [symlinks]]]:\n"           \
+       "      Reads the subtree at path, from the root of the export,\n"    \
+       "      into the cache in the background, depth levels of\n"          \
+       "      directories (0, the default, for all) at most rate\n"         \
+       "      entries a second (default 1000), reading symlink\n"           \
+       "      targets too if symlinks is yes\n"                             \
+       "      Example: \n"                                                   \
+       "      warm_cache 77 /datasets/v3 4 5000 yes\n\n"                     \
+       "   warm_cache_progress: Shows how far the last cache warm got\n\n"  \
+       "   cancel_warm_cache: Stops the running cache warm\n\n"             \
+       "   invalidate_cache export_id:\n"                                   \
+       "      Drops what is cached of the export, to publish what\n"        \
+       "      changed behind an Immutable export\n\n"                       \
        "   add_export conf expr:\n"                                          \
        "      Adds an export from the given config file that contains\n"     \
        "      the given expression\n"                                        \
@@ -248,11 +307,16 @@ if __name__ == '__main__':
        "      the given expression\n"                                        \
        "      Example: \n"                                                   \
        "      update_export /etc/ganesha/gpfs.conf \"EXPORT(Export_ID=77)\"\n\n"\
+       "   apply_export config:\n"                                          \
+       "      Adds or updates the exports in the given EXPORT blocks\n"     \
+       "      Example: \n"                                                   \
+       "      apply_export \"EXPORT { Export_Id = 77; ... }\"\n\n"          \
        "   shutdown: Shuts down the ganesha nfs server\n\n"                  \
        "   purge netgroups: Purges netgroups cache\n\n"                      \
        "   purge idmap: Purges idmapper cache\n\n"                      \
        "   purge gids: Purges gids cache\n\n"                      \
        "   grace ipaddr: Begins grace for the given IP\n\n"                  \
+       "   grace_progress: Shows reclaim progress of the grace period\n\n"  \
        "   get_log component: Gets the log level for the given component\n\n"\
        "   set_log component level: \n"                                      \
        "       Sets the given log level to the given component\n\n"          \
@@ -295,6 +359,12 @@ if __name__ == '__main__':
                  " Try \"ganesha_mgr.py help\" for more info")
            sys.exit(1)
         exportmgr.updateexport(sys.argv[2], sys.argv[3])
+    elif sys.argv[1] == "apply_export":
+        if len(sys.argv) < 3:
+           print("apply_export requires EXPORT config."\
+                 " Try \"ganesha_mgr.py help\" for more info")
+           sys.exit(1)
+        exportmgr.applyexport(sys.argv[2])
     elif sys.argv[1] == "display_export":
         if len(sys.argv) < 3:
            print("display_export requires an export ID."\
@@ -303,6 +373,25 @@ if __name__ == '__main__':
         exportmgr.displayexport(sys.argv[2])
     elif sys.argv[1] == "show_exports":
         exportmgr.showexports()
+    elif sys.argv[1] == "warm_cache":
+        if len(sys.argv) < 4:
+           print("warm_cache requires an export ID and a path."\
+                 " Try \"ganesha_mgr.py help\" for more info")
+           sys.exit(1)
+        depth = sys.argv[4] if len(sys.argv) > 4 else 0
+        rate = sys.argv[5] if len(sys.argv) > 5 else 1000
+        symlinks = len(sys.argv) > 6 and sys.argv[6] in ("yes", "true", "1")
+        exportmgr.warmcache(sys.argv[2], sys.argv[3], depth, rate, symlinks)
+    elif sys.argv[1] == "warm_cache_progress":
+        exportmgr.warmcacheprogress()
+    elif sys.argv[1] == "cancel_warm_cache":
+        exportmgr.cancelwarmcache()
+    elif sys.argv[1] == "invalidate_cache":
+        if len(sys.argv) < 3:
+           print("invalidate_cache requires an export ID."\
+                 " Try \"ganesha_mgr.py help\" for more info")
+           sys.exit(1)
+        exportmgr.invalidatecache(sys.argv[2])
 
     elif sys.argv[1] == "shutdown":
         ganesha.shutdown()
@@ -328,6 +417,9 @@ if __name__ == '__main__':
            sys.exit(1)
         ganesha.grace(sys.argv[2])
 
+    elif sys.argv[1] == "grace_progress":
+        ganesha.grace_progress()
+
     elif sys.argv[1] == "set_log":
         if len(sys.argv) < 4:
            print("set_log requires a component and a log level."\
@@ -17,14 +17,18 @@ def usage():
     message += "To display current status regarding stat counting use \n"
     message += "%s status \n" % (sys.argv[0])
     message += "To display stat counters use \n"
-    message += "%s [list_clients | deleg <ip address> | " % (sys.argv[0])
+    message += "%s [list_clients | deleg <ip address> | conns <ip address> | " % (sys.argv[0])
     message += "inode | iov3 [export id] | iov4 [export id] | export |"
     message += " total [export id] | fast | pnfs [export id] |"
-    message += " fsal <fsal name> ] \n"
+    message += " fsal <fsal name> | queues | workers |"
+    message += " latency <NFSv3 | NFSv4> <op> [export id | client ip] |"
+    message += " stages <NFSv3 | NFSv4> <op | COMPOUND> | locks [count] |"
+    message += " memory | drops | admission | partitions | shares | states |"
+    message += " iobufs ] \n"
     message += "To reset stat counters use \n"
     message += "%s reset \n" % (sys.argv[0])
     message += "To enable/disable stat counters use \n"
-    message += "%s [enable | disable] [all | nfs | fsal] " % (sys.argv[0])
+    message += "%s [enable | disable] [all | nfs | fsal | latency | stages | top | users | locks] " % (sys.argv[0])
     sys.exit(message)
 
 if len(sys.argv) < 2:
@@ -35,12 +39,14 @@ else:
 # check arguments
 commands = ('help', 'list_clients', 'deleg', 'global', 'inode', 'iov3', 'iov4',
 	    'export', 'total', 'fast', 'pnfs', 'fsal', 'reset', 'enable',
-	    'disable', 'pool')
+	    'disable', 'pool', 'queues', 'workers', 'latency', 'stages', 'locks',
+	    'memory', 'drops', 'admission', 'partitions', 'shares', 'states',
+	    'iobufs', 'conns')
 if command not in commands:
     print("Option \"%s\" is not correct." % (command))
     usage()
 # requires an IP address
-elif command in ('deleg'):
+elif command in ('deleg', 'conns'):
     if not len(sys.argv) == 3:
         print("Option \"%s\" must be followed by an ip address." % (command))
         usage()
@@ -63,11 +69,32 @@ elif command in ('fsal'):
     command_arg = sys.argv[2]
 elif command in ('enable', 'disable'):
     if not len(sys.argv) == 3:
-        print("Option \"%s\" must be followed by all/nfs/fsal." % (command))
+        print("Option \"%s\" must be followed by all/nfs/fsal/latency/stages/top/users/locks." % (command))
         usage()
     command_arg = sys.argv[2]
-    if command_arg not in ('all', 'nfs', 'fsal'):
-        print("Option \"%s\" must be followed by all/nfs/fsal." % (command))
+    if command_arg not in ('all', 'nfs', 'fsal', 'latency', 'stages', 'top', 'users', 'locks'):
+        print("Option \"%s\" must be followed by all/nfs/fsal/latency/stages/top/users/locks." % (command))
+        usage()
+# requires a version and an operation, optionally an export id or client ip
+elif command in ('latency'):
+    if len(sys.argv) not in (4, 5) or sys.argv[2] not in ('NFSv3', 'NFSv4'):
+        print("Option \"%s\" must be followed by NFSv3/NFSv4 and an operation." % (command))
+        usage()
+    command_arg = (sys.argv[2], sys.argv[3].upper())
+    latency_target = sys.argv[4] if len(sys.argv) == 5 else None
+# requires a version and an operation
+elif command in ('stages'):
+    if len(sys.argv) != 4 or sys.argv[2] not in ('NFSv3', 'NFSv4'):
+        print("Option \"%s\" must be followed by NFSv3/NFSv4 and an operation." % (command))
+        usage()
+    command_arg = (sys.argv[2], sys.argv[3].upper())
+# optionally accepts a site count
+elif command in ('locks'):
+    if (len(sys.argv) == 2):
+        command_arg = 20
+    elif (len(sys.argv) == 3) and sys.argv[2].isdigit():
+        command_arg = int(sys.argv[2])
+    else:
         usage()
 
 # retrieve and print(stats
@@ -81,10 +108,24 @@ elif command == "inode":
     print(exp_interface.inode_stats())
 elif command == "fast":
     print(exp_interface.fast_stats())
+elif command == "queues":
+    print(exp_interface.queue_stats())
+elif command == "workers":
+    print(exp_interface.worker_pool_stats())
+elif command == "partitions":
+    print(exp_interface.partition_stats())
+elif command == "shares":
+    print(exp_interface.cache_share_stats())
+elif command == "states":
+    print(exp_interface.state_stats())
+elif command == "iobufs":
+    print(exp_interface.iobuf_stats())
 elif command == "list_clients":
     print(cl_interface.list_clients())
 elif command == "deleg":
     print(cl_interface.deleg_stats(command_arg))
+elif command == "conns":
+    print(cl_interface.connections(command_arg))
 elif command == "iov3":
     print(exp_interface.v3io_stats(command_arg))
 elif command == "iov4":
@@ -101,5 +142,22 @@ elif command == "enable":
     print(exp_interface.enable_stats(command_arg))
 elif command == "disable":
     print(exp_interface.disable_stats(command_arg))
+elif command == "latency":
+    if latency_target is None:
+        print(exp_interface.lat_hist(command_arg))
+    elif latency_target.isdigit():
+        print(exp_interface.lat_hist(command_arg, int(latency_target)))
+    else:
+        print(cl_interface.lat_hist(latency_target, command_arg))
+elif command == "stages":
+    print(exp_interface.stage_hist(command_arg))
+elif command == "locks":
+    print(exp_interface.lock_prof(command_arg))
+elif command == "memory":
+    print(exp_interface.mem_acct())
+elif command == "drops":
+    print(exp_interface.req_drops())
+elif command == "admission":
+    print(exp_interface.admission())
 elif command == "status":
     print exp_interface.status_stats()
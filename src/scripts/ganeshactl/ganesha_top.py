@@ -0,0 +1,49 @@
+#!/usr/bin/python2
+#
+# Show the handles, clients or users with the most operations or bytes, or
+# users by the time their operations took, like top.
+# ./ganesha_top.py [handles | clients | users] [ops | bytes | time] [options]
+# eg. ./ganesha_top.py clients bytes -w 30 -n 10
+#
+# The server tracks handles and clients with Enable_Top_Tracking, or after
+# "ganesha_stats enable top", and users with Enable_User_Tracking, or after
+# "ganesha_stats enable users".
+#
+from __future__ import print_function
+import argparse
+import os
+import sys
+import time
+import Ganesha.glib_dbus_stats
+
+parser = argparse.ArgumentParser(
+    description="Show the hottest handles, clients or users of ganesha")
+parser.add_argument("who", nargs="?", default="handles",
+                    choices=("handles", "clients", "users"))
+parser.add_argument("by", nargs="?", default="ops",
+                    choices=("ops", "bytes", "time"))
+parser.add_argument("-w", "--window", type=int, default=60,
+                    help="seconds to look back (default 60)")
+parser.add_argument("-n", "--count", type=int, default=20,
+                    help="how many to show, 0 for all (default 20)")
+parser.add_argument("-i", "--interval", type=float, default=5,
+                    help="seconds between refreshes (default 5)")
+parser.add_argument("-1", "--once", action="store_true",
+                    help="show once and exit")
+args = parser.parse_args()
+
+exp_interface = Ganesha.glib_dbus_stats.RetrieveExportStats()
+try:
+    while True:
+        top = exp_interface.topk(args.who, args.by, args.window, args.count)
+        if args.once:
+            print(top)
+            break
+        if sys.stdout.isatty():
+            os.system("clear")
+        print(top)
+        if not top.success:
+            break
+        time.sleep(args.interval)
+except KeyboardInterrupt:
+    pass
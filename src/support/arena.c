@@ -0,0 +1,150 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file arena.c
+ * @brief Bump allocator for the memory of one reply
+ *
+ * The first chunk starts with the arena itself, followed by the first
+ * allocation, which is how arena_of() finds it.  Chunks are only
+ * given back all together by arena_destroy() or, for the ones made
+ * after a mark, by arena_rewind().
+ */
+
+#include "config.h"
+#include <assert.h>
+#include "gsh_arena.h"
+#include "mem_acct.h"
+
+/** Room taken by a chunk header in front of its data */
+#define ARENA_CHUNK_HDR_SIZE roundup(sizeof(struct arena_chunk), ARENA_ALIGN)
+
+/**
+ * @brief Allocate a chunk of at least size bytes of data
+ */
+static struct arena_chunk *arena_chunk_alloc(size_t size)
+{
+	struct arena_chunk *chunk;
+
+	size = MAX(size, ARENA_CHUNK_SIZE - ARENA_CHUNK_HDR_SIZE);
+	chunk = gsh_malloc(ARENA_CHUNK_HDR_SIZE + size);
+	chunk->next = NULL;
+	chunk->size = size;
+	mem_acct_charge(MEM_TAG_REQUEST, ARENA_CHUNK_HDR_SIZE + size, 1);
+
+	return chunk;
+}
+
+/**
+ * @brief Give a chunk back
+ */
+static void arena_chunk_free(struct arena_chunk *chunk)
+{
+	mem_acct_charge(MEM_TAG_REQUEST,
+			-(int64_t)(ARENA_CHUNK_HDR_SIZE + chunk->size), -1);
+	gsh_free(chunk);
+}
+
+/**
+ * @brief Make an arena along with its first allocation
+ *
+ * @param[in] size  Bytes of the first allocation, which is zeroed
+ *
+ * @return The first allocation, arena_of() gives the arena.
+ */
+void *arena_create(size_t size)
+{
+	struct arena_chunk *chunk;
+	struct gsh_arena *arena;
+	void *first;
+
+	size = roundup(size, ARENA_ALIGN);
+	chunk = arena_chunk_alloc(ARENA_HDR_SIZE + size);
+	arena = (struct gsh_arena *)((char *)chunk + ARENA_CHUNK_HDR_SIZE);
+	first = (char *)arena + ARENA_HDR_SIZE;
+
+	arena->chunks = chunk;
+	arena->next = (char *)first + size;
+	arena->left = chunk->size - ARENA_HDR_SIZE - size;
+	memset(first, 0, size);
+
+	assert(arena_of(first) == arena);
+	return first;
+}
+
+/**
+ * @brief Start a new chunk with room for at least size bytes
+ *
+ * What is left of the current chunk is not used any more.
+ *
+ * @param[in] arena  The arena
+ * @param[in] size   Bytes the caller is about to take
+ */
+void arena_grow(struct gsh_arena *arena, size_t size)
+{
+	struct arena_chunk *chunk = arena_chunk_alloc(size);
+
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+	arena->next = (char *)chunk + ARENA_CHUNK_HDR_SIZE;
+	arena->left = chunk->size;
+}
+
+/**
+ * @brief Give back everything allocated since a mark
+ *
+ * @param[in] arena  The arena
+ * @param[in] mark   From arena_get_mark()
+ */
+void arena_rewind(struct gsh_arena *arena, const struct arena_mark *mark)
+{
+	struct arena_chunk *chunk;
+
+	while (arena->chunks != mark->chunk) {
+		chunk = arena->chunks;
+		arena->chunks = chunk->next;
+		arena_chunk_free(chunk);
+	}
+
+	arena->next = mark->next;
+	arena->left = mark->left;
+}
+
+/**
+ * @brief Give back an arena and all that was allocated from it
+ *
+ * @param[in] arena  The arena, may be NULL
+ */
+void arena_destroy(struct gsh_arena *arena)
+{
+	struct arena_chunk *chunk, *next;
+
+	if (arena == NULL)
+		return;
+
+	/* The arena itself lives in the oldest chunk, freed last */
+	for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		arena_chunk_free(chunk);
+	}
+}
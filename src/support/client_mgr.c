@@ -227,6 +227,7 @@ struct gsh_client *get_gsh_client(sockaddr_t *client_ipaddr, bool lookup_only)
 		cl = avltree_container_of(node, struct gsh_client, node_k);
 	} else {
 		PTHREAD_RWLOCK_init(&cl->lock, NULL);
+		throttle_init(&cl->throttle);
 	}
 
  out:
@@ -332,6 +333,7 @@ int remove_gsh_client(sockaddr_t *client_ipaddr)
 	if (removed == 0) {
 		server_st = container_of(cl, struct server_stats, client);
 		server_stats_free(&server_st->st);
+		throttle_destroy(&cl->throttle);
 		if (cl->hostaddr_str != NULL)
 			gsh_free(cl->hostaddr_str);
 		gsh_free(server_st);
@@ -608,6 +610,11 @@ static struct gsh_client *lookup_client(DBusMessageIter *args, char **errormsg)
 		client = get_gsh_client(&sockaddr, true);
 		if (client == NULL)
 			*errormsg = "Client IP address not found";
+		else
+			server_stats_merge(&container_of(client,
+							 struct server_stats,
+							 client)->st,
+					   &client->lock);
 	}
 	return client;
 }
@@ -1003,12 +1010,210 @@ static struct gsh_dbus_method cltmgr_show_9p_op_stats = {
 #endif
 
 
+/**
+ * DBUS method to report a latency histogram for a client
+ *
+ */
+
+static bool get_client_lat_hist(DBusMessageIter *args,
+				DBusMessage *reply,
+				DBusError *error)
+{
+	struct gsh_client *client = NULL;
+	struct server_stats *server_st = NULL;
+	int nfs_vers;
+	uint32_t opcode;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	client = lookup_client(args, &errormsg);
+	if (client == NULL) {
+		success = false;
+	} else {
+		server_st = container_of(client, struct server_stats, client);
+		if (server_st->st.lat == NULL) {
+			success = false;
+			errormsg = "Client has no latency histograms";
+		}
+	}
+	dbus_message_iter_next(args);
+	if (success)
+		success = arg_lat_hist_op(args, false, &nfs_vers, &opcode,
+						  &errormsg);
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		server_dbus_lat_hist(&server_st->st, nfs_vers, opcode, &iter);
+
+	if (client != NULL)
+		put_gsh_client(client);
+	return true;
+}
+
+static struct gsh_dbus_method cltmgr_show_lat_hist = {
+	.name = "GetLatencyHist",
+	.method = get_client_lat_hist,
+	.args = {IPADDR_ARG,
+		 NFS_VERS_ARG,
+		 NFS_OP_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LAT_HIST_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report a client's request throttle
+ *
+ * Without a SetThrottle, the limits come from the CLIENT block the
+ * client matches on each export, so none are reported.
+ */
+
+static bool get_client_throttle(DBusMessageIter *args,
+				DBusMessage *reply,
+				DBusError *error)
+{
+	struct gsh_client *client = NULL;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	client = lookup_client(args, &errormsg);
+	dbus_status_reply(&iter, client != NULL, errormsg);
+	if (client == NULL)
+		return true;
+
+	server_dbus_throttle(&client->throttle, 0, 0, &iter);
+	put_gsh_client(client);
+	return true;
+}
+
+static struct gsh_dbus_method cltmgr_show_throttle = {
+	.name = "GetThrottle",
+	.method = get_client_throttle,
+	.args = {IPADDR_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 THROTTLE_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to override a client's throttle limits on all exports
+ *
+ */
+
+static bool set_client_throttle(DBusMessageIter *args,
+				DBusMessage *reply,
+				DBusError *error)
+{
+	struct gsh_client *client = NULL;
+	uint64_t iops, bandwidth;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	client = lookup_client(args, &errormsg);
+	if (client == NULL)
+		success = false;
+	dbus_message_iter_next(args);
+	if (success)
+		success = arg_throttle(args, &iops, &bandwidth, &errormsg);
+	if (success)
+		throttle_set(&client->throttle, iops, bandwidth, true);
+	dbus_status_reply(&iter, success, errormsg);
+
+	if (client != NULL)
+		put_gsh_client(client);
+	return true;
+}
+
+static struct gsh_dbus_method cltmgr_set_throttle = {
+	.name = "SetThrottle",
+	.method = set_client_throttle,
+	.args = {IPADDR_ARG,
+		 THROTTLE_IOPS_ARG,
+		 THROTTLE_BW_ARG,
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to put a client back on its configured throttle limits
+ *
+ */
+
+static bool clear_client_throttle(DBusMessageIter *args,
+				  DBusMessage *reply,
+				  DBusError *error)
+{
+	struct gsh_client *client = NULL;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	client = lookup_client(args, &errormsg);
+	if (client != NULL) {
+		throttle_clear(&client->throttle);
+		put_gsh_client(client);
+	}
+	dbus_status_reply(&iter, client != NULL, errormsg);
+	return true;
+}
+
+static struct gsh_dbus_method cltmgr_clear_throttle = {
+	.name = "ClearThrottle",
+	.method = clear_client_throttle,
+	.args = {IPADDR_ARG,
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report the DRC memory of a client's connections
+ *
+ */
+
+static bool get_client_connections(DBusMessageIter *args,
+				   DBusMessage *reply,
+				   DBusError *error)
+{
+	sockaddr_t sockaddr;
+	char *errormsg = "OK";
+	bool success;
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	success = arg_ipaddr(args, &sockaddr, &errormsg);
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		nfs_dupreq_dbus_conns(&sockaddr, &iter);
+	return true;
+}
+
+static struct gsh_dbus_method cltmgr_show_connections = {
+	.name = "GetConnections",
+	.method = get_client_connections,
+	.args = {IPADDR_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 CONN_MEM_REPLY,
+		 END_ARG_LIST}
+};
+
 static struct gsh_dbus_method *cltmgr_stats_methods[] = {
 	&cltmgr_show_v3_io,
 	&cltmgr_show_v40_io,
 	&cltmgr_show_v41_io,
 	&cltmgr_show_v41_layouts,
 	&cltmgr_show_delegations,
+	&cltmgr_show_lat_hist,
+	&cltmgr_show_throttle,
+	&cltmgr_set_throttle,
+	&cltmgr_clear_throttle,
+	&cltmgr_show_connections,
 #ifdef _USE_9P
 	&cltmgr_show_9p_io,
 	&cltmgr_show_9p_trans,
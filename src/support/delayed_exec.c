@@ -45,28 +45,41 @@
 #include "abstract_mem.h"
 #include "delayed_exec.h"
 #include "log.h"
-#include "avltree.h"
+#include "abstract_atomic.h"
 #include "misc/queue.h"
 #include "gsh_intrinsic.h"
 #include "common_utils.h"
 
 /**
- * @brief A list of tasks
+ * @brief Length of a wheel tick in nanoseconds
  */
+#define DELAYED_TICK NS_PER_MSEC
 
-LIST_HEAD(delayed_tasklist, delayed_task);
+/**
+ * @brief Bits of the tick count resolved by each wheel level
+ */
+#define DELAYED_WHEEL_BITS 8
+#define DELAYED_WHEEL_SLOTS (1 << DELAYED_WHEEL_BITS)
+#define DELAYED_WHEEL_MASK (DELAYED_WHEEL_SLOTS - 1)
 
 /**
- * @brief All tasks executing at a given time.
+ * @brief Wheel levels, covering 2^32 ticks (about 49 days)
+ *
+ * Tasks further out than that are parked in the last slot of the top
+ * level and placed again each time it cascades.
  */
+#define DELAYED_WHEEL_LEVELS 4
 
-struct delayed_multi {
-	struct timespec realtime;	/*< A wallclock time at which to
-					   perform the given task. */
-	struct delayed_tasklist list;	/*< The linked list of tasks to
-					   perform. */
-	struct avltree_node node;	/*< Our node in the tree */
-};
+/**
+ * @brief Number of wheels, each with its own lock and executor thread
+ */
+#define DELAYED_SHARDS 4
+
+/**
+ * @brief A list of tasks
+ */
+
+LIST_HEAD(delayed_tasklist, delayed_task);
 
 /**
  * @brief An individual delayed task
@@ -77,10 +90,32 @@ struct delayed_task {
 	void (*func)(void *);
 	/** Argument for delayed task */
 	void *arg;
-	/** Link in the task list. */
+	/** Tick at which to run, counted from delayed_base */
+	uint64_t expire;
+	/** Link in the slot or ready list. */
 	LIST_ENTRY(delayed_task) link;
 };
 
+/**
+ * @brief A hierarchical timer wheel
+ *
+ * Level 0 has one slot per tick.  Each slot of level n covers a whole
+ * turn of level n - 1 and is cascaded into the levels below when that
+ * turn begins, so insertion and removal are a list operation.
+ */
+
+struct delayed_wheel {
+	pthread_mutex_t mtx;	/*< Lock for this wheel */
+	pthread_cond_t cv;	/*< Signalled on earlier work or stop */
+	uint64_t tick;		/*< Next tick to expire */
+	uint64_t wake;		/*< Tick the executor sleeps until */
+	uint64_t count;		/*< Tasks in the slots */
+	struct delayed_tasklist ready;	/*< Tasks due now */
+	struct delayed_tasklist slot[DELAYED_WHEEL_LEVELS]
+				    [DELAYED_WHEEL_SLOTS];
+	GSH_CACHE_PAD(0);
+};
+
 /**
  * @brief A list of threads
  */
@@ -93,6 +128,7 @@ LIST_HEAD(delayed_threadlist, delayed_thread);
 
 struct delayed_thread {
 	pthread_t id;		/*< Thread id */
+	struct delayed_wheel *wheel;	/*< Wheel we serve */
 	 LIST_ENTRY(delayed_thread) link;	/*< Link in the thread list. */
 };
 
@@ -103,12 +139,16 @@ struct delayed_thread {
 
 /** list of all threads */
 static struct delayed_threadlist thread_list;
-/** Mutex for delayed execution */
+/** Mutex for the thread list */
 static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
-/** Condition variable for delayed execution */
+/** Condition variable for the last thread leaving */
 static pthread_cond_t cv = PTHREAD_COND_INITIALIZER;
-/** The timer tree */
-static struct avltree tree;
+/** The timer wheels */
+static struct delayed_wheel wheels[DELAYED_SHARDS];
+/** Wheel for the next submission */
+static uint32_t next_wheel;
+/** Wallclock time of tick 0 */
+static struct timespec delayed_base;
 
 /**
  * @brief Posssible states for the delayed executor
@@ -121,74 +161,156 @@ enum delayed_state {
 /** State for the executor */
 static enum delayed_state delayed_state;
 
-enum delayed_employment {
-	delayed_employed,	/*< Work is available, do it. */
-	delayed_on_break,	/*< Work is available, but wait for it */
-	delayed_unemployed	/*< No work is available, wait indefinitely */
-};
-
 /** @} */
 
-static int comparator(const struct avltree_node *a,
-		      const struct avltree_node *b)
+/**
+ * @brief Convert a wallclock time to wheel ticks
+ *
+ * @param[in] ts    The time
+ * @param[in] round Round up rather than down
+ *
+ * @return Ticks since delayed_base.
+ */
+
+static uint64_t delayed_ticks(const struct timespec *ts, bool round)
 {
-	struct delayed_multi *p =
-	    avltree_container_of(a, struct delayed_multi, node);
-	struct delayed_multi *q =
-	    avltree_container_of(b, struct delayed_multi, node);
+	nsecs_elapsed_t ns;
+
+	if (gsh_time_cmp(ts, &delayed_base) <= 0)
+		return 0;
 
-	return gsh_time_cmp(&p->realtime, &q->realtime);
+	ns = timespec_diff(&delayed_base, ts);
+	if (round)
+		ns += DELAYED_TICK - 1;
+
+	return ns / DELAYED_TICK;
 }
 
 /**
- * @brief Get a task to perform
+ * @brief Put a task in the slot for its expiry
+ *
+ * This function must be called with the wheel mutex held.
  *
- * This function must be called with the mutex held.
+ * @param[in] wheel The wheel
+ * @param[in] task  The task
+ */
+
+static void delayed_place(struct delayed_wheel *wheel,
+			  struct delayed_task *task)
+{
+	uint64_t expire = task->expire;
+	uint64_t delta;
+	int level;
+
+	if (expire < wheel->tick) {
+		LIST_INSERT_HEAD(&wheel->ready, task, link);
+		return;
+	}
+
+	delta = expire - wheel->tick;
+	for (level = 0; level < DELAYED_WHEEL_LEVELS - 1; level++) {
+		if (delta < 1ULL << ((level + 1) * DELAYED_WHEEL_BITS))
+			break;
+	}
+
+	if (delta >= 1ULL << (DELAYED_WHEEL_LEVELS * DELAYED_WHEEL_BITS))
+		expire = wheel->tick +
+		    (1ULL << (DELAYED_WHEEL_LEVELS * DELAYED_WHEEL_BITS)) - 1;
+
+	LIST_INSERT_HEAD(&wheel->slot[level]
+			 [(expire >> (level * DELAYED_WHEEL_BITS))
+			  & DELAYED_WHEEL_MASK],
+			 task, link);
+	++wheel->count;
+}
+
+/**
+ * @brief Empty a slot into the levels below it
  *
- * @param[out] when The time for which to wait, if there is one
- * @param[out] func The function to execute, if there is one
- * @param[out] arg  The argument to supply, if there is one
+ * The slot is the one the current tick falls in.
  *
- * @retval delayed_employed if there is a task to perform now.  Its
- *         argument and function are stored in @c arg and @c func.
- * @retval delayed_on_break if there is work but it is not to be
- *         performed yet.  The time at which it is to be performed is
- *         set in *when.
- * @retval delayed_unemployed if there is no work at all.  The caller
- *         should wait indefinitely to be signalled.
+ * @param[in] wheel The wheel
+ * @param[in] level Level of the slot
  */
 
-static enum delayed_employment delayed_get_work(struct timespec *when,
-						void (**func) (void *),
-						void **arg)
+static void delayed_cascade(struct delayed_wheel *wheel, int level)
 {
-	struct avltree_node *first = avltree_first(&tree);
-	struct delayed_multi *mul;
-	struct timespec current;
+	int index = (wheel->tick >> (level * DELAYED_WHEEL_BITS))
+	    & DELAYED_WHEEL_MASK;
+	struct delayed_tasklist *list = &wheel->slot[level][index];
 	struct delayed_task *task;
 
-	if (first == NULL)
-		return delayed_unemployed;
+	while ((task = LIST_FIRST(list)) != NULL) {
+		LIST_REMOVE(task, link);
+		--wheel->count;
+		delayed_place(wheel, task);
+	}
+}
+
+/**
+ * @brief Move every task due by a given tick to the ready list
+ *
+ * This function must be called with the wheel mutex held.
+ *
+ * @param[in] wheel The wheel
+ * @param[in] until The current tick
+ */
 
-	now(&current);
-	mul = avltree_container_of(first, struct delayed_multi, node);
+static void delayed_advance(struct delayed_wheel *wheel, uint64_t until)
+{
+	struct delayed_tasklist *list;
+	struct delayed_task *task;
+	int level;
+
+	while (wheel->tick <= until) {
+		if (wheel->count == 0) {
+			/* Nothing to cascade, just catch up. */
+			wheel->tick = until + 1;
+			break;
+		}
 
-	if (gsh_time_cmp(&mul->realtime, &current) > 0) {
-		*when = mul->realtime;
-		return delayed_on_break;
+		/* Level 0 slots only hold tasks for this very tick */
+		list = &wheel->slot[0][wheel->tick & DELAYED_WHEEL_MASK];
+		while ((task = LIST_FIRST(list)) != NULL) {
+			LIST_REMOVE(task, link);
+			--wheel->count;
+			LIST_INSERT_HEAD(&wheel->ready, task, link);
+		}
+		++wheel->tick;
+
+		/* Each level below that turned over pulls in the next
+		   slot of the one above. */
+		for (level = 1; level < DELAYED_WHEEL_LEVELS; level++) {
+			if (((wheel->tick >> ((level - 1) * DELAYED_WHEEL_BITS))
+			     & DELAYED_WHEEL_MASK) != 0)
+				break;
+			delayed_cascade(wheel, level);
+		}
 	}
+}
+
+/**
+ * @brief Find the tick at which the executor should next look
+ *
+ * This function must be called with the wheel mutex held.
+ *
+ * @param[in] wheel The wheel
+ *
+ * @return The earliest tick with work in level 0, or the start of
+ *         the next turn if level 0 is empty.
+ */
+
+static uint64_t delayed_next(struct delayed_wheel *wheel)
+{
+	uint64_t tick;
 
-	task = LIST_FIRST(&mul->list);
-	*func = task->func;
-	*arg = task->arg;
-	LIST_REMOVE(task, link);
-	gsh_free(task);
-	if (LIST_EMPTY(&mul->list)) {
-		avltree_remove(first, &tree);
-		gsh_free(mul);
+	for (tick = wheel->tick;
+	     tick < (wheel->tick | DELAYED_WHEEL_MASK) + 1; tick++) {
+		if (!LIST_EMPTY(&wheel->slot[0][tick & DELAYED_WHEEL_MASK]))
+			return tick;
 	}
 
-	return delayed_employed;
+	return tick;
 }
 
 /**
@@ -202,6 +324,7 @@ static enum delayed_employment delayed_get_work(struct timespec *when,
 void *delayed_thread(void *arg)
 {
 	struct delayed_thread *thr = arg;
+	struct delayed_wheel *wheel = thr->wheel;
 	int old_type = 0;
 	int old_state = 0;
 	sigset_t old_sigmask;
@@ -218,28 +341,37 @@ void *delayed_thread(void *arg)
 
 	pthread_sigmask(SIG_SETMASK, NULL, &old_sigmask);
 
-	PTHREAD_MUTEX_lock(&mtx);
+	PTHREAD_MUTEX_lock(&wheel->mtx);
 	while (delayed_state == delayed_running) {
-		struct timespec then;
-		void (*func)(void *);
-		void *farg;
-
-		switch (delayed_get_work(&then, &func, &farg)) {
-		case delayed_unemployed:
-			pthread_cond_wait(&cv, &mtx);
-			break;
-
-		case delayed_on_break:
-			pthread_cond_timedwait(&cv, &mtx, &then);
-			break;
+		struct timespec current, then;
+		struct delayed_task *task;
+
+		now(&current);
+		delayed_advance(wheel, delayed_ticks(&current, false));
+
+		task = LIST_FIRST(&wheel->ready);
+		if (task != NULL) {
+			LIST_REMOVE(task, link);
+			PTHREAD_MUTEX_unlock(&wheel->mtx);
+			task->func(task->arg);
+			gsh_free(task);
+			PTHREAD_MUTEX_lock(&wheel->mtx);
+			continue;
+		}
 
-		case delayed_employed:
-			PTHREAD_MUTEX_unlock(&mtx);
-			func(farg);
-			PTHREAD_MUTEX_lock(&mtx);
-			break;
+		if (wheel->count == 0) {
+			wheel->wake = UINT64_MAX;
+			pthread_cond_wait(&wheel->cv, &wheel->mtx);
+		} else {
+			wheel->wake = delayed_next(wheel);
+			then = delayed_base;
+			timespec_add_nsecs(wheel->wake * DELAYED_TICK, &then);
+			pthread_cond_timedwait(&wheel->cv, &wheel->mtx, &then);
 		}
 	}
+	PTHREAD_MUTEX_unlock(&wheel->mtx);
+
+	PTHREAD_MUTEX_lock(&mtx);
 	LIST_REMOVE(thr, link);
 	if (LIST_EMPTY(&thread_list))
 		pthread_cond_broadcast(&cv);
@@ -256,19 +388,26 @@ void *delayed_thread(void *arg)
 
 void delayed_start(void)
 {
-	/* Make this a parameter later */
-	const size_t threads_to_start = 1;
 	/* Thread attributes */
 	pthread_attr_t attr;
-	/* Thread index */
-	int i;
+	/* Wheel, level and slot index */
+	int i, j, k;
 
 	LIST_INIT(&thread_list);
-	avltree_init(&tree, comparator, 0);
-
-	if (threads_to_start == 0) {
-		LogFatal(COMPONENT_THREAD,
-			 "You can't execute tasks with zero threads.");
+	now(&delayed_base);
+
+	for (i = 0; i < DELAYED_SHARDS; ++i) {
+		struct delayed_wheel *wheel = &wheels[i];
+
+		PTHREAD_MUTEX_init(&wheel->mtx, NULL);
+		PTHREAD_COND_init(&wheel->cv, NULL);
+		wheel->tick = 0;
+		wheel->wake = UINT64_MAX;
+		wheel->count = 0;
+		LIST_INIT(&wheel->ready);
+		for (j = 0; j < DELAYED_WHEEL_LEVELS; ++j)
+			for (k = 0; k < DELAYED_WHEEL_SLOTS; ++k)
+				LIST_INIT(&wheel->slot[j][k]);
 	}
 
 	if (pthread_attr_init(&attr) != 0)
@@ -280,11 +419,12 @@ void delayed_start(void)
 	PTHREAD_MUTEX_lock(&mtx);
 	delayed_state = delayed_running;
 
-	for (i = 0; i < threads_to_start; ++i) {
+	for (i = 0; i < DELAYED_SHARDS; ++i) {
 		struct delayed_thread *thread =
 		    gsh_malloc(sizeof(struct delayed_thread));
 		int rc = 0;
 
+		thread->wheel = &wheels[i];
 		rc = pthread_create(&thread->id, &attr, delayed_thread, thread);
 		if (rc != 0) {
 			LogFatal(COMPONENT_THREAD,
@@ -304,13 +444,18 @@ void delayed_shutdown(void)
 {
 	int rc = -1;
 	struct timespec then;
+	int i;
 
 	now(&then);
 	then.tv_sec += 120;
 
 	PTHREAD_MUTEX_lock(&mtx);
 	delayed_state = delayed_stopping;
-	pthread_cond_broadcast(&cv);
+	for (i = 0; i < DELAYED_SHARDS; ++i) {
+		PTHREAD_MUTEX_lock(&wheels[i].mtx);
+		pthread_cond_broadcast(&wheels[i].cv);
+		PTHREAD_MUTEX_unlock(&wheels[i].mtx);
+	}
 	while ((rc != ETIMEDOUT) && !LIST_EMPTY(&thread_list))
 		rc = pthread_cond_timedwait(&cv, &mtx, &then);
 
@@ -331,6 +476,8 @@ void delayed_shutdown(void)
 /**
  * @brief Submit a new task
  *
+ * Tasks are spread over the wheels in turn.
+ *
  * @param[in] func  The function to run
  * @param[in] arg   The argument to run it with
  * @param[in] delay The dleay in nanoseconds
@@ -341,36 +488,24 @@ void delayed_shutdown(void)
 
 int delayed_submit(void (*func) (void *), void *arg, nsecs_elapsed_t delay)
 {
-	struct delayed_multi *mul = NULL;
-	struct delayed_task *task = NULL;
-	struct avltree_node *collision = NULL;
-	struct avltree_node *first = NULL;
-
-	mul = gsh_malloc(sizeof(struct delayed_multi));
-	task = gsh_malloc(sizeof(struct delayed_task));
+	struct delayed_wheel *wheel =
+	    &wheels[atomic_inc_uint32_t(&next_wheel) % DELAYED_SHARDS];
+	struct delayed_task *task = gsh_malloc(sizeof(struct delayed_task));
+	struct timespec then;
 
-	now(&mul->realtime);
-	timespec_add_nsecs(delay, &mul->realtime);
+	now(&then);
+	timespec_add_nsecs(delay, &then);
 
-	PTHREAD_MUTEX_lock(&mtx);
-	first = avltree_first(&tree);
-	collision = avltree_insert(&mul->node, &tree);
-	if (unlikely(collision)) {
-		gsh_free(mul);
-		/* There is already a node for this exact time in the
-		   tree.  Add our task to its list. */
-		mul =
-		    avltree_container_of(collision, struct delayed_multi, node);
-	} else {
-		LIST_INIT(&mul->list);
-	}
 	task->func = func;
 	task->arg = arg;
-	LIST_INSERT_HEAD(&mul->list, task, link);
-	if (!first || comparator(&mul->node, first) < 0)
-		pthread_cond_broadcast(&cv);
+	task->expire = delay == 0 ? 0 : delayed_ticks(&then, true);
 
-	PTHREAD_MUTEX_unlock(&mtx);
+	PTHREAD_MUTEX_lock(&wheel->mtx);
+	delayed_place(wheel, task);
+	if (task->expire < wheel->wake)
+		pthread_cond_signal(&wheel->cv);
+
+	PTHREAD_MUTEX_unlock(&wheel->mtx);
 
 	return 0;
 }
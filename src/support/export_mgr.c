@@ -64,6 +64,8 @@
 #include "nfs_exports.h"
 #include "nfs_proto_functions.h"
 #include "pnfs_utils.h"
+#include "lock_prof.h"
+#include "mdcache.h"
 
 struct timespec nfs_stats_time;
 struct timespec fsal_stats_time;
@@ -97,6 +99,249 @@ static struct glist_head mount_work;
   */
 static struct glist_head unexport_work;
 
+/**
+ * @brief One path component of an export path index
+ *
+ * Exports are indexed by fullpath and by pseudopath in a tree of
+ * path components, so finding the export covering a path costs one
+ * AVL lookup per component instead of a scan of every export.
+ */
+struct export_path_node {
+	/** Entry in the parent's children */
+	struct avltree_node node_k;
+	/** Components below this one */
+	struct avltree children;
+	/** Component above this one, NULL for the index root */
+	struct export_path_node *parent;
+	/** Exports whose path ends at this component, in insert order */
+	struct glist_head exports;
+	/** Component name, not NUL terminated */
+	const char *name;
+	int len;
+	char namebuf[];
+};
+
+/** Index of exports by fullpath, protected by export_by_id.lock */
+static struct export_path_node *export_by_path;
+
+/** Index of exports by pseudopath, protected by export_by_id.lock */
+static struct export_path_node *export_by_pseudo;
+
+static int export_path_cmpf(const struct avltree_node *lhs,
+			    const struct avltree_node *rhs)
+{
+	struct export_path_node *lk, *rk;
+	int rc;
+
+	lk = avltree_container_of(lhs, struct export_path_node, node_k);
+	rk = avltree_container_of(rhs, struct export_path_node, node_k);
+
+	rc = memcmp(lk->name, rk->name, MIN(lk->len, rk->len));
+	if (rc != 0)
+		return rc;
+
+	return lk->len - rk->len;
+}
+
+static struct export_path_node *export_path_node_alloc(const char *name,
+							 int len)
+{
+	struct export_path_node *node;
+
+	node = gsh_calloc(1, sizeof(*node) + len);
+	memcpy(node->namebuf, name, len);
+	node->name = node->namebuf;
+	node->len = len;
+	avltree_init(&node->children, export_path_cmpf, 0);
+	glist_init(&node->exports);
+
+	return node;
+}
+
+/**
+ * @brief Find, or add, a child component of an index node
+ *
+ * @param[in] parent  Node to look below
+ * @param[in] name    Component name
+ * @param[in] len     Length of name
+ * @param[in] create  Add the component if it is missing
+ *
+ * @return The child node, or NULL.
+ */
+static struct export_path_node *export_path_child(
+					struct export_path_node *parent,
+					const char *name, int len,
+					bool create)
+{
+	struct export_path_node key, *child;
+	struct avltree_node *node;
+
+	key.name = name;
+	key.len = len;
+
+	node = avltree_lookup(&key.node_k, &parent->children);
+	if (node != NULL)
+		return avltree_container_of(node, struct export_path_node,
+					    node_k);
+
+	if (!create)
+		return NULL;
+
+	child = export_path_node_alloc(name, len);
+	child->parent = parent;
+	avltree_insert(&child->node_k, &parent->children);
+
+	return child;
+}
+
+/**
+ * @brief Split the next component off a path
+ *
+ * A single trailing '/' is ignored, so "/" and "" are both the one
+ * empty component and are covered by the root export.
+ *
+ * @param[in,out] path  Start of the remaining path, NULL once consumed
+ * @param[in]     end   End of the path
+ * @param[out]    len   Length of the component
+ *
+ * @return Start of the component.
+ */
+static const char *export_path_next(const char **path, const char *end,
+				    int *len)
+{
+	const char *comp = *path;
+	const char *slash = memchr(comp, '/', end - comp);
+
+	if (slash == NULL) {
+		*len = end - comp;
+		*path = NULL;
+	} else {
+		*len = slash - comp;
+		*path = slash + 1;
+	}
+
+	return comp;
+}
+
+static const char *export_path_end(const char *path)
+{
+	size_t len = strlen(path);
+
+	if (len > 0 && path[len - 1] == '/')
+		len--;
+
+	return path + len;
+}
+
+/**
+ * @brief Add an export to a path index
+ *
+ * @note export_by_id.lock must be held for write.
+ *
+ * @param[in]  root   Index to add to
+ * @param[in]  path   Path of the export
+ * @param[in]  link   Export's list entry for this index
+ * @param[out] where  Export's node for this index
+ */
+static void export_path_index(struct export_path_node *root, const char *path,
+			      struct glist_head *link,
+			      struct export_path_node **where)
+{
+	const char *end = export_path_end(path);
+	struct export_path_node *node = root;
+	const char *comp;
+	int len;
+
+	while (path != NULL) {
+		comp = export_path_next(&path, end, &len);
+		node = export_path_child(node, comp, len, true);
+	}
+
+	glist_add_tail(&node->exports, link);
+	*where = node;
+}
+
+/**
+ * @brief Remove an export from a path index
+ *
+ * Components left with neither exports nor children are pruned.
+ *
+ * @note export_by_id.lock must be held for write.
+ *
+ * @param[in]     link   Export's list entry for this index
+ * @param[in,out] where  Export's node for this index
+ */
+static void export_path_unindex(struct glist_head *link,
+				struct export_path_node **where)
+{
+	struct export_path_node *node = *where;
+	struct export_path_node *parent;
+
+	if (node == NULL)
+		return;
+
+	glist_del(link);
+	*where = NULL;
+
+	while (node->parent != NULL && glist_empty(&node->exports) &&
+	       avltree_first(&node->children) == NULL) {
+		parent = node->parent;
+		avltree_remove(&node->node_k, &parent->children);
+		gsh_free(node);
+		node = parent;
+	}
+}
+
+/**
+ * @brief Find the index node with the longest match for a path
+ *
+ * Only components ending at a '/' of path or at its end can match, so
+ * /mnt/foo does not cover /mnt/foob.
+ *
+ * @note export_by_id.lock must be held.
+ *
+ * @param[in]  root         Index to search
+ * @param[in]  path         Path to look up
+ * @param[in]  exact_match  Only a node for the whole path matches
+ * @param[out] exact        The node returned is for the whole path
+ *
+ * @return The deepest node holding exports, or NULL.
+ */
+static struct export_path_node *export_path_lookup(
+					struct export_path_node *root,
+					const char *path, bool exact_match,
+					bool *exact)
+{
+	const char *end = export_path_end(path);
+	struct export_path_node *node = root;
+	struct export_path_node *best = NULL;
+	const char *comp;
+	int len;
+
+	*exact = false;
+
+	while (path != NULL) {
+		comp = export_path_next(&path, end, &len);
+		node = export_path_child(node, comp, len, false);
+
+		if (node == NULL)
+			break;
+
+		if (glist_empty(&node->exports))
+			continue;
+
+		if (path == NULL) {
+			*exact = true;
+			return node;
+		}
+
+		if (!exact_match)
+			best = node;
+	}
+
+	return best;
+}
+
 void export_add_to_mount_work(struct gsh_export *export)
 {
 	PTHREAD_RWLOCK_wrlock(&export_by_id.lock);
@@ -202,6 +447,9 @@ void export_revert(struct gsh_export *export)
 	avltree_remove(&export->node_k, &export_by_id.t);
 	glist_del(&export->exp_list);
 	glist_del(&export->exp_work);
+	export_path_unindex(&export->exp_path_list, &export->exp_path_node);
+	export_path_unindex(&export->exp_pseudo_list,
+			    &export->exp_pseudo_node);
 
 	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
 
@@ -255,6 +503,8 @@ struct gsh_export *alloc_export(void)
 
 	LogFullDebug(COMPONENT_EXPORT, "Allocated export %p", export);
 
+	glist_init(&export->exp_path_list);
+	glist_init(&export->exp_pseudo_list);
 	glist_init(&export->exp_state_list);
 	glist_init(&export->exp_lock_list);
 	glist_init(&export->exp_nlm_share_list);
@@ -262,6 +512,7 @@ struct gsh_export *alloc_export(void)
 	glist_init(&export->clients);
 
 	PTHREAD_RWLOCK_init(&export->lock, NULL);
+	throttle_init(&export->throttle);
 
 	return export;
 }
@@ -284,6 +535,7 @@ void free_export(struct gsh_export *export)
 	export_st = container_of(export, struct export_stats, export);
 	server_stats_free(&export_st->st);
 	PTHREAD_RWLOCK_destroy(&export->lock);
+	throttle_destroy(&export->throttle);
 	gsh_free(export_st);
 }
 
@@ -320,6 +572,12 @@ bool insert_gsh_export(struct gsh_export *export)
 	/* update cache */
 	atomic_store_voidptr(cache_slot, &export->node_k);
 	glist_add_tail(&exportlist, &export->exp_list);
+	export_path_index(export_by_path, export->fullpath,
+			  &export->exp_path_list, &export->exp_path_node);
+	if (export->pseudopath != NULL)
+		export_path_index(export_by_pseudo, export->pseudopath,
+				  &export->exp_pseudo_list,
+				  &export->exp_pseudo_node);
 	get_gsh_export_ref(export);		/* == 2 */
 
 	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
@@ -381,11 +639,14 @@ struct gsh_export *get_gsh_export(uint16_t export_id)
 /**
  * @brief Lookup the export manager struct by export path
  *
- * Gets an export entry from its path using a substring match and
- * linear search of the export list, assumes being called with
- * export manager lock held (such as from within foreach_gsh_export.
+ * Gets an export entry from its path using the longest match on
+ * whole path components, assumes being called with export manager
+ * lock held (such as from within foreach_gsh_export.
  * If path has a trailing '/', ignore it.
  *
+ * Of several exports with the same path, an exact match returns the
+ * first inserted and a partial match the last.
+ *
  * @param path        [IN] the path for the entry to be found.
  * @param exact_match [IN] the path must match exactly
  *
@@ -395,66 +656,22 @@ struct gsh_export *get_gsh_export(uint16_t export_id)
 struct gsh_export *get_gsh_export_by_path_locked(char *path,
 						 bool exact_match)
 {
-	struct gsh_export *export;
-	struct glist_head *glist;
-	int len_path = strlen(path);
-	int len_export;
-	struct gsh_export *ret_exp = NULL;
-	int len_ret = 0;
-
-	if (len_path > 1 && path[len_path - 1] == '/')
-		len_path--;
+	struct export_path_node *node;
+	struct gsh_export *ret_exp;
+	bool exact;
 
 	LogFullDebug(COMPONENT_EXPORT,
 		     "Searching for export matching path %s",
 		     path);
 
-	glist_for_each(glist, &exportlist) {
-		export = glist_entry(glist, struct gsh_export, exp_list);
-
-		len_export = strlen(export->fullpath);
-
-		if (len_path == 0 && len_export == 1) {
-			/* Special case for root match */
-			ret_exp = export;
-			len_ret = len_export;
-			break;
-		}
-
-		/* A path shorter than the full path cannot match.
-		 * Also skip if this export has a shorter path than
-		 * the previous match.
-		 */
-		if (len_path < len_export ||
-		    len_export < len_ret)
-			continue;
-
-		/* If partial match is not allowed, lengths must be the same */
-		if (exact_match && len_path != len_export)
-			continue;
-
-		/* if the char in fullpath just after the end of path is not '/'
-		 * it is a name token longer, i.e. /mnt/foo != /mnt/foob/
-		 */
-		if (len_export > 1 &&
-		    path[len_export] != '/' &&
-		    path[len_export] != '\0')
-			continue;
-
-		/* we agree on size, now compare the leading substring
-		 */
-		if (strncmp(export->fullpath, path, len_export) == 0) {
-			ret_exp = export;
-			len_ret = len_export;
+	node = export_path_lookup(export_by_path, path, exact_match, &exact);
+	if (node == NULL)
+		return NULL;
 
-			/* If we have found an exact match, exit loop. */
-			if (len_export == len_path)
-				break;
-		}
-	}
+	ret_exp = glist_entry(exact ? node->exports.next : node->exports.prev,
+			      struct gsh_export, exp_path_list);
 
-	if (ret_exp != NULL)
-		get_gsh_export_ref(ret_exp);
+	get_gsh_export_ref(ret_exp);
 
 	return ret_exp;
 }
@@ -501,76 +718,23 @@ struct gsh_export *get_gsh_export_by_path(char *path, bool exact_match)
 struct gsh_export *get_gsh_export_by_pseudo_locked(char *path,
 						   bool exact_match)
 {
-	struct gsh_export *export;
-	struct glist_head *glist;
-	int len_path = strlen(path);
-	int len_export;
-	struct gsh_export *ret_exp = NULL;
-	int len_ret = 0;
-
-	/* Ignore trailing slash in path */
-	if (len_path > 1 && path[len_path - 1] == '/')
-		len_path--;
+	struct export_path_node *node;
+	struct gsh_export *ret_exp;
+	bool exact;
 
 	LogFullDebug(COMPONENT_EXPORT,
 		     "Searching for export matching pseudo path %s",
 		     path);
 
-	glist_for_each(glist, &exportlist) {
-		export = glist_entry(glist, struct gsh_export, exp_list);
-
-		if (export->pseudopath == NULL)
-			continue;
-
-		len_export = strlen(export->pseudopath);
-
-		LogFullDebug(COMPONENT_EXPORT,
-			     "Comparing %s %d to %s %d",
-			     path, len_path,
-			     export->pseudopath, len_export);
-
-		if (len_path == 0 && len_export == 1) {
-			/* Special case for Pseudo root match */
-			ret_exp = export;
-			len_ret = len_export;
-			break;
-		}
-
-		/* A path shorter than the full path cannot match.
-		 * Also skip if this export has a shorter path than
-		 * the previous match.
-		 */
-		if (len_path < len_export ||
-		    len_export < len_ret)
-			continue;
-
-		/* If partial match is not allowed, lengths must be the same */
-		if (exact_match && len_path != len_export)
-			continue;
-
-		/* if the char in pseudopath just after the end of path is not
-		 * '/' it is a name token longer, i.e. /mnt/foo != /mnt/foob/
-		 */
-		if (len_export > 1 &&
-		    path[len_export] != '/' &&
-		    path[len_export] != '\0')
-			continue;
-
-		/* we agree on size, now compare the leading substring
-		 */
-		if (strncmp(export->pseudopath, path, len_export)
-		    == 0) {
-			ret_exp = export;
-			len_ret = len_export;
+	node = export_path_lookup(export_by_pseudo, path, exact_match,
+				  &exact);
+	if (node == NULL)
+		return NULL;
 
-			/* If we have found an exact match, exit loop. */
-			if (len_export == len_path)
-				break;
-		}
-	}
+	ret_exp = glist_entry(exact ? node->exports.next : node->exports.prev,
+			      struct gsh_export, exp_pseudo_list);
 
-	if (ret_exp != NULL)
-		get_gsh_export_ref(ret_exp);
+	get_gsh_export_ref(ret_exp);
 
 	return ret_exp;
 }
@@ -731,8 +895,12 @@ void remove_gsh_export(uint16_t export_id)
 
 		export = avltree_container_of(node, struct gsh_export, node_k);
 
-		/* Remove the export from the export list */
+		/* Remove the export from the export list and path indexes */
 		glist_del(&export->exp_list);
+		export_path_unindex(&export->exp_path_list,
+				    &export->exp_path_node);
+		export_path_unindex(&export->exp_pseudo_list,
+				    &export->exp_pseudo_node);
 
 		/* No new references will be granted. Idempotent. */
 		export->export_status = EXPORT_STALE;
@@ -784,6 +952,87 @@ bool foreach_gsh_export(bool(*cb) (struct gsh_export *exp, void *state),
 	return rc;
 }
 
+/**
+ * @brief Work shared by the threads of foreach_gsh_export_parallel
+ */
+
+struct export_parallel {
+	struct gsh_export **exports;
+	uint32_t count;
+	uint32_t next;		/*< Index of the next export to hand out */
+	void (*cb)(struct gsh_export *exp, void *state);
+	void *state;
+};
+
+static void export_parallel_work(struct export_parallel *par)
+{
+	uint32_t i;
+
+	while ((i = atomic_postinc_uint32_t(&par->next)) < par->count)
+		par->cb(par->exports[i], par->state);
+}
+
+static void *export_parallel_thread(void *arg)
+{
+	SetNameFunction("export_init");
+	export_parallel_work(arg);
+	return NULL;
+}
+
+/**
+ * @brief Do the callback on each of an array of exports in parallel
+ *
+ * The callbacks run on up to Export_Init_Threads threads, the caller's
+ * included, with no export manager lock held.  Returns once every
+ * callback has returned.  If threads cannot be started, the remaining
+ * work is done by the caller.
+ *
+ * @param exports [IN] Exports to work on, references held by the caller
+ * @param count   [IN] Number of exports
+ * @param cb      [IN] Callback function
+ * @param state   [IN] param block to pass
+ */
+
+void foreach_gsh_export_parallel(struct gsh_export **exports, uint32_t count,
+				 void (*cb)(struct gsh_export *exp,
+					    void *state),
+				 void *state)
+{
+	struct export_parallel par = {
+		.exports = exports,
+		.count = count,
+		.next = 0,
+		.cb = cb,
+		.state = state,
+	};
+	uint32_t nthreads = MIN(nfs_param.core_param.export_init_threads,
+				count);
+	pthread_t *threads = NULL;
+	uint32_t started = 0;
+	int rc;
+
+	if (nthreads > 1)
+		threads = gsh_calloc(nthreads - 1, sizeof(*threads));
+
+	for (started = 0; started + 1 < nthreads; started++) {
+		rc = pthread_create(&threads[started], NULL,
+				    export_parallel_thread, &par);
+		if (rc != 0) {
+			LogWarn(COMPONENT_EXPORT,
+				"Could not start export init thread: %s",
+				strerror(rc));
+			break;
+		}
+	}
+
+	export_parallel_work(&par);
+
+	while (started > 0)
+		pthread_join(threads[--started], NULL);
+
+	gsh_free(threads);
+}
+
 bool remove_one_export(struct gsh_export *export, void *state)
 {
 	export_add_to_unexport_work_locked(export);
@@ -900,6 +1149,11 @@ static struct gsh_export *lookup_export(DBusMessageIter *args, char **errormsg)
 		export = get_gsh_export(export_id);
 		if (export == NULL)
 			*errormsg = "Export id not found";
+		else
+			server_stats_merge(&container_of(export,
+							 struct export_stats,
+							 export)->st,
+					   &export->lock);
 	}
 	return export;
 }
@@ -1638,44 +1892,324 @@ static struct gsh_dbus_method export_update_export = {
 		 END_ARG_LIST}
 };
 
-static struct gsh_dbus_method *export_mgr_methods[] = {
-	&export_add_export,
-	&export_remove_export,
-	&export_display_export,
-	&export_show_exports,
-	&export_update_export,
-	NULL
-};
-
-/* org.ganesha.nfsd.exportmgr interface
+/**
+ * @brief Add or update exports from a config snippet
+ *
+ * The string holds one or more EXPORT {...} blocks.  Blocks for an
+ * existing Export_Id update it, the others add an export.  Nothing but
+ * the snippet is parsed.
+ *
+ * @param "config" [IN] The EXPORT blocks
+ *
+ * @return        true for success, false with error filled out for failure
  */
-static struct gsh_dbus_interface export_mgr_table = {
-	.name = "org.ganesha.nfsd.exportmgr",
-	.props = NULL,
-	.methods = export_mgr_methods,
-	.signals = NULL
-};
 
-/* org.ganesha.nfsd.exportstats interface
- */
+static bool gsh_export_applyexport(DBusMessageIter *args,
+				   DBusMessage *reply,
+				   DBusError *error)
+{
+	int exp_cnt;
+	bool status = true;
+	char *config_text = NULL;
+	config_file_t config_struct = NULL;
+	struct config_error_type err_type;
+	DBusMessageIter iter;
+	char *err_detail = NULL;
+	struct error_detail conf_errs = {NULL, 0, NULL};
+	size_t msg_size = sizeof("%d exports added or updated") + 10;
+	char *message;
+
+	/* Get the config */
+	if (dbus_message_iter_get_arg_type(args) == DBUS_TYPE_STRING)
+		dbus_message_iter_get_basic(args, &config_text);
+	else {
+		dbus_set_error(error, DBUS_ERROR_INVALID_ARGS,
+			       "Config is not a string. It is a (%c)",
+			       dbus_message_iter_get_arg_type(args));
+		status = false;
+		goto out;
+	}
+	LogInfo(COMPONENT_EXPORT, "Applying export config");
+
+	/* Create a memstream for parser+processing error messages */
+	if (!init_error_type(&err_type)) {
+		status = false;
+		goto out;
+	}
+
+	config_struct = config_ParseString(config_text, &err_type);
+	if (config_error_is_harmless(&err_type))
+		exp_cnt = load_config_from_parse(config_struct,
+						 &update_export_param,
+						 NULL,
+						 false,
+						 &err_type);
+	else
+		exp_cnt = -1;
+
+	report_config_errors(&err_type,
+			     &conf_errs,
+			     config_errs_to_dbus);
+	if (conf_errs.fp != NULL)
+		fclose(conf_errs.fp);
+
+	if (exp_cnt <= 0 || !config_error_is_harmless(&err_type)) {
+		err_detail = err_type_str(&err_type);
+		LogCrit(COMPONENT_EXPORT,
+			"Export config not applied because of %s errors",
+			err_detail != NULL ? err_detail : "unknown");
+		dbus_set_error(error, DBUS_ERROR_INVALID_ARGS,
+			       "Export config not applied because of %s errors. Details:\n%s",
+			       err_detail != NULL ? err_detail : "unknown",
+			       conf_errs.buf != NULL ? conf_errs.buf : "");
+		status = false;
+		goto out;
+	}
+
+	message = gsh_calloc(1, msg_size);
+	snprintf(message, msg_size, "%d exports added or updated", exp_cnt);
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &message);
+	gsh_free(message);
+
+out:
+	if (conf_errs.buf)
+		gsh_free(conf_errs.buf);
+	if (err_detail != NULL)
+		gsh_free(err_detail);
+	config_Free(config_struct);
+	return status;
+}
+
+static struct gsh_dbus_method export_apply_export = {
+	.name = "ApplyExport",
+	.method = gsh_export_applyexport,
+	.args =	{CONFIG_ARG,
+		 MESSAGE_REPLY,
+		 END_ARG_LIST}
+};
 
 /**
- * DBUS method to report NFSv3 I/O statistics
+ * DBUS method to warm the cache with a subtree of an export
  *
+ * The subtree is read in the background; WarmCacheProgress tells how
+ * far it got.
  */
 
-static bool get_nfsv3_export_io(DBusMessageIter *args,
-				DBusMessage *reply,
-				DBusError *error)
+static bool gsh_export_warmcache(DBusMessageIter *args,
+				 DBusMessage *reply,
+				 DBusError *error)
 {
-	struct gsh_export *export = NULL;
-	struct export_stats *export_st = NULL;
+	uint16_t export_id = 0;
+	uint32_t depth = 0, rate = 0;
+	dbus_bool_t symlinks = false;
+	char *path = NULL;
 	bool success = true;
 	char *errormsg = "OK";
 	DBusMessageIter iter;
 
 	dbus_message_iter_init_append(reply, &iter);
-	if (!nfs_param.core_param.enable_NFSSTATS)
+	success = arg_export_id(args, &export_id, &errormsg);
+	if (!success)
+		goto out;
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_STRING) {
+		success = false;
+		errormsg = "Path is not a string";
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &path);
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT32) {
+		success = false;
+		errormsg = "Depth is not a uint32";
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &depth);
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT32) {
+		success = false;
+		errormsg = "Rate is not a uint32";
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &rate);
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_BOOLEAN) {
+		success = false;
+		errormsg = "Symlinks is not a boolean";
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &symlinks);
+
+	success = mdcache_warm_start(export_id, path, depth, rate,
+				     symlinks, &errormsg);
+
+out:
+	dbus_status_reply(&iter, success, errormsg);
+	return true;
+}
+
+static struct gsh_dbus_method export_warm_cache = {
+	.name = "WarmCache",
+	.method = gsh_export_warmcache,
+	.args = {EXPORT_ID_ARG,
+		 WARM_PATH_ARG,
+		 WARM_DEPTH_ARG,
+		 WARM_RATE_ARG,
+		 WARM_SYMLINKS_ARG,
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report the progress of the last cache warm
+ *
+ */
+
+static bool gsh_export_warmcacheprogress(DBusMessageIter *args,
+					 DBusMessage *reply,
+					 DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	mdcache_dbus_warm(&iter);
+
+	return true;
+}
+
+static struct gsh_dbus_method export_warm_cache_progress = {
+	.name = "WarmCacheProgress",
+	.method = gsh_export_warmcacheprogress,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 WARM_PROGRESS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to stop the running cache warm
+ *
+ */
+
+static bool gsh_export_cancelwarmcache(DBusMessageIter *args,
+				       DBusMessage *reply,
+				       DBusError *error)
+{
+	bool success;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	success = mdcache_warm_cancel();
+	if (!success)
+		errormsg = "No cache warm is running";
+	dbus_status_reply(&iter, success, errormsg);
+
+	return true;
+}
+
+static struct gsh_dbus_method export_cancel_warm_cache = {
+	.name = "CancelWarmCache",
+	.method = gsh_export_cancelwarmcache,
+	.args = {STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to drop what is cached of an export
+ *
+ * Used to publish what changed behind an Immutable export.
+ */
+
+static bool gsh_export_invalidatecache(DBusMessageIter *args,
+				       DBusMessage *reply,
+				       DBusError *error)
+{
+	struct gsh_export *export;
+	uint16_t export_id;
+	bool success;
+	char *errormsg = "OK";
+	char msg[64];
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	success = arg_export_id(args, &export_id, &errormsg);
+	if (!success)
+		goto out;
+
+	export = get_gsh_export(export_id);
+	if (export == NULL) {
+		success = false;
+		errormsg = "Export id not found";
+		goto out;
+	}
+
+	(void) snprintf(msg, sizeof(msg), "%" PRIu64 " entries invalidated",
+			mdcache_export_invalidate(export));
+	errormsg = msg;
+	put_gsh_export(export);
+
+out:
+	dbus_status_reply(&iter, success, errormsg);
+	return true;
+}
+
+static struct gsh_dbus_method export_invalidate_cache = {
+	.name = "InvalidateCache",
+	.method = gsh_export_invalidatecache,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method *export_mgr_methods[] = {
+	&export_add_export,
+	&export_remove_export,
+	&export_display_export,
+	&export_show_exports,
+	&export_update_export,
+	&export_apply_export,
+	&export_warm_cache,
+	&export_warm_cache_progress,
+	&export_cancel_warm_cache,
+	&export_invalidate_cache,
+	NULL
+};
+
+/* org.ganesha.nfsd.exportmgr interface
+ */
+static struct gsh_dbus_interface export_mgr_table = {
+	.name = "org.ganesha.nfsd.exportmgr",
+	.props = NULL,
+	.methods = export_mgr_methods,
+	.signals = NULL
+};
+
+/* org.ganesha.nfsd.exportstats interface
+ */
+
+/**
+ * DBUS method to report NFSv3 I/O statistics
+ *
+ */
+
+static bool get_nfsv3_export_io(DBusMessageIter *args,
+				DBusMessage *reply,
+				DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	struct export_stats *export_st = NULL;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (!nfs_param.core_param.enable_NFSSTATS)
 		errormsg = "NFS stat counting disabled";
 	export = lookup_export(args, &errormsg);
 	if (export == NULL) {
@@ -1954,6 +2488,17 @@ static void reset_fsal_stats(void)
 	}
 }
 
+/* Reset the stats every FSAL layer of an export keeps */
+static bool reset_fsal_export_stats(struct gsh_export *export, void *state)
+{
+	struct fsal_export *exp;
+
+	for (exp = export->fsal_export; exp != NULL; exp = exp->sub_export)
+		exp->exp_ops.reset_stats(exp);
+
+	return true;
+}
+
 /**
  * DBUS method to reset all ops statistics
  *
@@ -1973,7 +2518,10 @@ static bool stats_reset(DBusMessageIter *args,
 	dbus_append_timestamp(&iter, &timestamp);
 
 	reset_fsal_stats();
+	(void) foreach_gsh_export(reset_fsal_export_stats, false, NULL);
 	reset_server_stats();
+	lock_prof_reset();
+	server_topk_reset();
 
 	return true;
 }
@@ -2052,6 +2600,18 @@ static bool stats_disable(DBusMessageIter *args,
 			 "Disabling NFS server statistics counting");
 		LogEvent(COMPONENT_CONFIG,
 			 "Disabling FSAL statistics counting");
+		nfs_param.core_param.enable_LATENCY_HIST = false;
+		LogEvent(COMPONENT_CONFIG,
+			 "Disabling latency histograms");
+		nfs_param.core_param.enable_STAGE_HIST = false;
+		LogEvent(COMPONENT_CONFIG,
+			 "Disabling stage histograms");
+		nfs_param.core_param.enable_TOP_TRACKING = false;
+		LogEvent(COMPONENT_CONFIG,
+			 "Disabling top tracking");
+		nfs_param.core_param.enable_USER_TRACKING = false;
+		LogEvent(COMPONENT_CONFIG,
+			 "Disabling user tracking");
 		/* reset all stats counters */
 		reset_fsal_stats();
 		reset_server_stats();
@@ -2070,6 +2630,31 @@ static bool stats_disable(DBusMessageIter *args,
 		/* reset fsal stats counters */
 		reset_fsal_stats();
 	}
+	if (strcmp(stat_type, "latency") == 0) {
+		nfs_param.core_param.enable_LATENCY_HIST = false;
+		LogEvent(COMPONENT_CONFIG,
+			 "Disabling latency histograms");
+	}
+	if (strcmp(stat_type, "stages") == 0) {
+		nfs_param.core_param.enable_STAGE_HIST = false;
+		LogEvent(COMPONENT_CONFIG,
+			 "Disabling stage histograms");
+	}
+	if (strcmp(stat_type, "top") == 0) {
+		nfs_param.core_param.enable_TOP_TRACKING = false;
+		LogEvent(COMPONENT_CONFIG,
+			 "Disabling top tracking");
+	}
+	if (strcmp(stat_type, "users") == 0) {
+		nfs_param.core_param.enable_USER_TRACKING = false;
+		LogEvent(COMPONENT_CONFIG,
+			 "Disabling user tracking");
+	}
+	if (strcmp(stat_type, "locks") == 0) {
+		lock_prof_enabled = false;
+		LogEvent(COMPONENT_CONFIG,
+			 "Disabling lock profiling");
+	}
 
 	dbus_status_reply(&iter, success, errormsg);
 	now(&timestamp);
@@ -2116,6 +2701,26 @@ static bool stats_enable(DBusMessageIter *args,
 				 "Enabling FSAL statistics counting");
 			now(&fsal_stats_time);
 		}
+		if (!nfs_param.core_param.enable_LATENCY_HIST) {
+			nfs_param.core_param.enable_LATENCY_HIST = true;
+			LogEvent(COMPONENT_CONFIG,
+				 "Enabling latency histograms");
+		}
+		if (!nfs_param.core_param.enable_STAGE_HIST) {
+			nfs_param.core_param.enable_STAGE_HIST = true;
+			LogEvent(COMPONENT_CONFIG,
+				 "Enabling stage histograms");
+		}
+		if (!nfs_param.core_param.enable_TOP_TRACKING) {
+			nfs_param.core_param.enable_TOP_TRACKING = true;
+			LogEvent(COMPONENT_CONFIG,
+				 "Enabling top tracking");
+		}
+		if (!nfs_param.core_param.enable_USER_TRACKING) {
+			nfs_param.core_param.enable_USER_TRACKING = true;
+			LogEvent(COMPONENT_CONFIG,
+				 "Enabling user tracking");
+		}
 	}
 	if (strcmp(stat_type, "nfs") == 0 &&
 			!nfs_param.core_param.enable_NFSSTATS) {
@@ -2131,6 +2736,40 @@ static bool stats_enable(DBusMessageIter *args,
 			 "Enabling FSAL statistics counting");
 		now(&fsal_stats_time);
 	}
+	if (strcmp(stat_type, "latency") == 0 &&
+			!nfs_param.core_param.enable_LATENCY_HIST) {
+		nfs_param.core_param.enable_LATENCY_HIST = true;
+		LogEvent(COMPONENT_CONFIG,
+			 "Enabling latency histograms");
+	}
+	if (strcmp(stat_type, "stages") == 0 &&
+			!nfs_param.core_param.enable_STAGE_HIST) {
+		nfs_param.core_param.enable_STAGE_HIST = true;
+		LogEvent(COMPONENT_CONFIG,
+			 "Enabling stage histograms");
+	}
+	if (strcmp(stat_type, "top") == 0 &&
+			!nfs_param.core_param.enable_TOP_TRACKING) {
+		nfs_param.core_param.enable_TOP_TRACKING = true;
+		LogEvent(COMPONENT_CONFIG,
+			 "Enabling top tracking");
+	}
+	if (strcmp(stat_type, "users") == 0 &&
+			!nfs_param.core_param.enable_USER_TRACKING) {
+		nfs_param.core_param.enable_USER_TRACKING = true;
+		LogEvent(COMPONENT_CONFIG,
+			 "Enabling user tracking");
+	}
+	if (strcmp(stat_type, "locks") == 0 && !lock_prof_enabled) {
+#ifdef ENABLE_LOCK_PROFILE
+		lock_prof_enabled = true;
+		LogEvent(COMPONENT_CONFIG,
+			 "Enabling lock profiling");
+#else
+		success = false;
+		errormsg = "Built without ENABLE_LOCK_PROFILE";
+#endif
+	}
 
 	dbus_status_reply(&iter, success, errormsg);
 	now(&timestamp);
@@ -2209,6 +2848,62 @@ static struct gsh_dbus_method fsal_statistics = {
 		 END_ARG_LIST}
 };
 
+/**
+ * DBUS method to gather the per export statistics of an FSAL stack
+ *
+ * Reports the topmost FSAL layer of the export that keeps any.
+ */
+static bool stats_fsal_export(DBusMessageIter *args,
+			      DBusMessage *reply,
+			      DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	struct fsal_export *exp = NULL;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	struct timespec timestamp;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export == NULL) {
+		success = false;
+	} else if (!nfs_param.core_param.enable_FSALSTATS) {
+		success = false;
+		errormsg = "FSAL stats disabled";
+	} else {
+		for (exp = export->fsal_export; exp != NULL;
+		     exp = exp->sub_export)
+			if (exp->exp_ops.extract_stats(exp, NULL))
+				break;
+		if (exp == NULL) {
+			success = false;
+			errormsg = "Export has no FSAL stats";
+		}
+	}
+
+	dbus_status_reply(&iter, success, errormsg);
+	if (success) {
+		now(&timestamp);
+		dbus_append_timestamp(&iter, &timestamp);
+		exp->exp_ops.extract_stats(exp, &iter);
+	}
+
+	if (export != NULL)
+		put_gsh_export(export);
+	return true;
+}
+
+static struct gsh_dbus_method fsal_export_statistics = {
+	.name = "GetFSALExportStats",
+	.method = stats_fsal_export,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 FSAL_EXPORT_OPS_REPLY,
+		 END_ARG_LIST}
+};
+
 #ifdef _USE_9P
 /**
  * DBUS method to report 9p I/O statistics
@@ -2302,49 +2997,807 @@ static struct gsh_dbus_method export_show_9p_op_stats = {
 		 OP_STATS_REPLY,
 		 END_ARG_LIST}
 };
-#endif
 
-static struct gsh_dbus_method export_show_total_ops = {
-	.name = "GetTotalOPS",
-	.method = get_nfsv_export_total_ops,
-	.args = {EXPORT_ID_ARG,
-		 STATUS_REPLY,
-		 TIMESTAMP_REPLY,
-		 TOTAL_OPS_REPLY,
-		 END_ARG_LIST}
-};
+/**
+ * DBUS method to report request queue classes
+ */
+static bool get_req_queue_stats(DBusMessageIter *args,
+				DBusMessage *reply,
+				DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
 
-static struct gsh_dbus_method global_show_total_ops = {
-	.name = "GetGlobalOPS",
-	.method = get_nfsv_global_total_ops,
-	.args = {STATUS_REPLY,
-		 TIMESTAMP_REPLY,
-		 TOTAL_OPS_REPLY,
-		 END_ARG_LIST}
-};
+	dbus_message_iter_init_append(reply, &iter);
+	if (!(nfs_param.core_param.core_options & CORE_OPTION_9P)) {
+		success = false;
+		errormsg = "9P is not enabled";
+	}
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		_9p_dbus_req_queues(&iter);
 
-static struct gsh_dbus_method global_show_fast_ops = {
-	.name = "GetFastOPS",
-	.method = get_nfsv_global_fast_ops,
-	.args = {STATUS_REPLY,
-		 TIMESTAMP_REPLY,
-		 TOTAL_OPS_REPLY,
-		 END_ARG_LIST}
-};
+	return true;
+}
 
-static struct gsh_dbus_method cache_inode_show = {
-	.name = "ShowCacheInode",
-	.method = show_cache_inode_stats,
+static struct gsh_dbus_method req_queue_show = {
+	.name = "GetReqQueueStats",
+	.method = get_req_queue_stats,
 	.args = {STATUS_REPLY,
 		 TIMESTAMP_REPLY,
-		 TOTAL_OPS_REPLY,
+		 REQ_QUEUES_REPLY,
 		 END_ARG_LIST}
 };
 
 /**
- * @brief Report all IO stats of all exports in one call
- *
- * @return
+ * DBUS method to report the adaptive worker pool
+ */
+static bool get_worker_pool(DBusMessageIter *args,
+			    DBusMessage *reply,
+			    DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (!(nfs_param.core_param.core_options & CORE_OPTION_9P)) {
+		success = false;
+		errormsg = "9P is not enabled";
+	}
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		_9p_dbus_worker_pool(&iter);
+
+	return true;
+}
+
+static struct gsh_dbus_method worker_pool_show = {
+	.name = "GetWorkerPool",
+	.method = get_worker_pool,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 WORKER_POOL_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * @brief Get the next uint32 argument
+ */
+static bool arg_uint32(DBusMessageIter *args, uint32_t *val)
+{
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT32)
+		return false;
+	dbus_message_iter_get_basic(args, val);
+	return true;
+}
+
+/**
+ * DBUS method to change the adaptive worker pool
+ *
+ * The parameters hold until the next SetWorkerPool or restart, a
+ * configuration reload does not change them.
+ */
+static bool set_worker_pool(DBusMessageIter *args,
+			    DBusMessage *reply,
+			    DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	dbus_bool_t enable;
+	uint32_t min, max, grow_wait, interval;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (!(nfs_param.core_param.core_options & CORE_OPTION_9P)) {
+		success = false;
+		errormsg = "9P is not enabled";
+	} else if (args == NULL ||
+		   dbus_message_iter_get_arg_type(args) != DBUS_TYPE_BOOLEAN) {
+		success = false;
+		errormsg = "Enable is not a boolean";
+	} else {
+		dbus_message_iter_get_basic(args, &enable);
+		if (!arg_uint32(args, &min) || !arg_uint32(args, &max) ||
+		    !arg_uint32(args, &grow_wait) ||
+		    !arg_uint32(args, &interval)) {
+			success = false;
+			errormsg = "Bounds, wait and interval must be uint32";
+		}
+	}
+	if (success)
+		success = _9p_worker_adapt_set(enable, min, max, grow_wait,
+					       interval, &errormsg);
+	dbus_status_reply(&iter, success, errormsg);
+
+	return true;
+}
+
+static struct gsh_dbus_method worker_pool_set = {
+	.name = "SetWorkerPool",
+	.method = set_worker_pool,
+	.args = {WORKER_ENABLE_ARG,
+		 WORKER_MIN_ARG,
+		 WORKER_MAX_ARG,
+		 WORKER_GROW_WAIT_ARG,
+		 WORKER_INTERVAL_ARG,
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+#endif
+
+#ifdef _HAVE_GSSAPI
+/**
+ * DBUS method to report RPCSEC_GSS crypto time
+ */
+static bool get_gss_stats(DBusMessageIter *args,
+			  DBusMessage *reply,
+			  DBusError *error)
+{
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, true, "OK");
+	server_dbus_gss_stats(&iter);
+
+	return true;
+}
+
+static struct gsh_dbus_method gss_stats_show = {
+	.name = "GetGSSStats",
+	.method = get_gss_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 GSS_STATS_REPLY,
+		 END_ARG_LIST}
+};
+#endif
+
+/**
+ * DBUS method to report the object pools
+ */
+static bool get_pool_stats(DBusMessageIter *args,
+			   DBusMessage *reply,
+			   DBusError *error)
+{
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, true, "OK");
+	pool_dbus_stats(&iter);
+
+	return true;
+}
+
+static struct gsh_dbus_method pool_stats_show = {
+	.name = "GetPoolStats",
+	.method = get_pool_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 POOL_STATS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report a latency histogram for the whole server
+ *
+ */
+
+static bool get_global_lat_hist(DBusMessageIter *args,
+				DBusMessage *reply,
+				DBusError *error)
+{
+	int nfs_vers;
+	uint32_t opcode;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	success = arg_lat_hist_op(args, false, &nfs_vers, &opcode,
+					  &errormsg);
+	if (success && !nfs_param.core_param.enable_LATENCY_HIST)
+		errormsg = "Latency histograms are disabled";
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		server_dbus_lat_hist(NULL, nfs_vers, opcode, &iter);
+	return true;
+}
+
+static struct gsh_dbus_method global_show_lat_hist = {
+	.name = "GetGlobalLatencyHist",
+	.method = get_global_lat_hist,
+	.args = {NFS_VERS_ARG,
+		 NFS_OP_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LAT_HIST_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report the stage histograms of an operation
+ *
+ */
+
+static bool get_stage_hist(DBusMessageIter *args,
+			   DBusMessage *reply,
+			   DBusError *error)
+{
+	int nfs_vers;
+	uint32_t opcode;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	success = arg_lat_hist_op(args, true, &nfs_vers, &opcode, &errormsg);
+	if (success && !nfs_param.core_param.enable_STAGE_HIST)
+		errormsg = "Stage histograms are disabled";
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		server_dbus_stage_hists(nfs_vers, opcode, &iter);
+	return true;
+}
+
+static struct gsh_dbus_method global_show_stage_hist = {
+	.name = "GetStageHist",
+	.method = get_stage_hist,
+	.args = {NFS_VERS_ARG,
+		 NFS_OP_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 STAGE_HIST_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report the hottest handles, clients or users
+ *
+ */
+
+static bool get_topk(DBusMessageIter *args,
+		     DBusMessage *reply,
+		     DBusError *error)
+{
+	enum topk_tracker tracker = TOPK_HANDLE_OPS;
+	uint32_t window = 0, count = 0;
+	char *who = NULL, *by = NULL;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (args == NULL ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_STRING) {
+		success = false;
+		errormsg = "Missing handles or clients";
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &who);
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_STRING) {
+		success = false;
+		errormsg = "Missing ops or bytes";
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &by);
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT32) {
+		success = false;
+		errormsg = "Window is not a uint32";
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &window);
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT32) {
+		success = false;
+		errormsg = "Count is not a uint32";
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &count);
+
+	if (strcmp(who, "handles") == 0 && strcmp(by, "ops") == 0)
+		tracker = TOPK_HANDLE_OPS;
+	else if (strcmp(who, "handles") == 0 && strcmp(by, "bytes") == 0)
+		tracker = TOPK_HANDLE_BYTES;
+	else if (strcmp(who, "clients") == 0 && strcmp(by, "ops") == 0)
+		tracker = TOPK_CLIENT_OPS;
+	else if (strcmp(who, "clients") == 0 && strcmp(by, "bytes") == 0)
+		tracker = TOPK_CLIENT_BYTES;
+	else if (strcmp(who, "users") == 0 && strcmp(by, "ops") == 0)
+		tracker = TOPK_USER_OPS;
+	else if (strcmp(who, "users") == 0 && strcmp(by, "bytes") == 0)
+		tracker = TOPK_USER_BYTES;
+	else if (strcmp(who, "users") == 0 && strcmp(by, "time") == 0)
+		tracker = TOPK_USER_TIME;
+	else {
+		success = false;
+		errormsg = "Track handles/clients/users by ops/bytes/time";
+		goto out;
+	}
+	if (strcmp(who, "users") == 0) {
+		if (!nfs_param.core_param.enable_USER_TRACKING)
+			errormsg = "User tracking is disabled";
+	} else if (!nfs_param.core_param.enable_TOP_TRACKING)
+		errormsg = "Top tracking is disabled";
+
+out:
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		server_topk_dbus(tracker, window, count, &iter);
+	return true;
+}
+
+static struct gsh_dbus_method global_show_topk = {
+	.name = "GetTopK",
+	.method = get_topk,
+	.args = {TOPK_WHO_ARG,
+		 TOPK_BY_ARG,
+		 TOPK_WINDOW_ARG,
+		 TOPK_COUNT_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 TOPK_COVERED_REPLY,
+		 TOPK_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report the lock sites that waited the most
+ *
+ */
+
+static bool get_lock_prof(DBusMessageIter *args,
+			  DBusMessage *reply,
+			  DBusError *error)
+{
+	uint32_t count = 0;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (args == NULL ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT32) {
+		success = false;
+		errormsg = "Site count is not a uint32";
+	} else {
+		dbus_message_iter_get_basic(args, &count);
+	}
+#ifndef ENABLE_LOCK_PROFILE
+	if (success) {
+		success = false;
+		errormsg = "Built without ENABLE_LOCK_PROFILE";
+	}
+#endif
+	if (success && !lock_prof_enabled)
+		errormsg = "Lock profiling is disabled";
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		lock_prof_dbus_append(&iter, count);
+	return true;
+}
+
+static struct gsh_dbus_method global_show_lock_prof = {
+	.name = "GetLockProfile",
+	.method = get_lock_prof,
+	.args = {LOCK_PROF_COUNT_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LOCK_PROF_SAMPLE_REPLY,
+		 LOCK_PROF_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report the memory of each subsystem
+ *
+ */
+
+static bool get_mem_acct(DBusMessageIter *args,
+			 DBusMessage *reply,
+			 DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+#ifndef ENABLE_MEM_ACCOUNTING
+	success = false;
+	errormsg = "Built without ENABLE_MEM_ACCOUNTING";
+#endif
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		mem_acct_dbus_append(&iter);
+	return true;
+}
+
+static struct gsh_dbus_method global_show_mem_acct = {
+	.name = "GetMemoryAccounting",
+	.method = get_mem_acct,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 MEM_ACCT_FLUSH_REPLY,
+		 MEM_ACCT_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report the requests dropped before execution
+ *
+ */
+
+static bool get_req_drops(DBusMessageIter *args,
+			  DBusMessage *reply,
+			  DBusError *error)
+{
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, true, "OK");
+	server_dbus_req_drops(&iter);
+	return true;
+}
+
+static struct gsh_dbus_method global_show_req_drops = {
+	.name = "GetRequestDrops",
+	.method = get_req_drops,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 REQ_DROPS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report whether busy connections are held back
+ *
+ */
+
+static bool get_admission(DBusMessageIter *args,
+			  DBusMessage *reply,
+			  DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (nfs_param.core_param.admission_high_requests == 0 &&
+	    nfs_param.core_param.admission_high_bytes == 0)
+		errormsg = "Admission control disabled";
+	dbus_status_reply(&iter, success, errormsg);
+	nfs_admission_dbus_append(&iter);
+	return true;
+}
+
+static struct gsh_dbus_method global_show_admission = {
+	.name = "GetAdmission",
+	.method = get_admission,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 ADMISSION_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report a latency histogram for an export
+ *
+ */
+
+static bool get_export_lat_hist(DBusMessageIter *args,
+				DBusMessage *reply,
+				DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	struct export_stats *export_st = NULL;
+	int nfs_vers;
+	uint32_t opcode;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export == NULL) {
+		success = false;
+	} else {
+		export_st = container_of(export, struct export_stats, export);
+		if (export_st->st.lat == NULL) {
+			success = false;
+			errormsg = "Export has no latency histograms";
+		}
+	}
+	dbus_message_iter_next(args);
+	if (success)
+		success = arg_lat_hist_op(args, false, &nfs_vers, &opcode,
+						  &errormsg);
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		server_dbus_lat_hist(&export_st->st, nfs_vers, opcode, &iter);
+
+	if (export != NULL)
+		put_gsh_export(export);
+	return true;
+}
+
+static struct gsh_dbus_method export_show_lat_hist = {
+	.name = "GetLatencyHist",
+	.method = get_export_lat_hist,
+	.args = {EXPORT_ID_ARG,
+		 NFS_VERS_ARG,
+		 NFS_OP_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LAT_HIST_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report the isolation partitions
+ *
+ */
+
+static bool get_partitions(DBusMessageIter *args,
+			   DBusMessage *reply,
+			   DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+	partition_dbus_append(&iter);
+	return true;
+}
+
+static struct gsh_dbus_method global_show_partitions = {
+	.name = "GetPartitions",
+	.method = get_partitions,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 PARTITIONS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report the live states and the memory they take
+ *
+ */
+
+static bool get_state_counts(DBusMessageIter *args,
+			     DBusMessage *reply,
+			     DBusError *error)
+{
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, true, "OK");
+	state_dbus_counts(&iter);
+	return true;
+}
+
+static struct gsh_dbus_method global_show_state_counts = {
+	.name = "GetStateCounts",
+	.method = get_state_counts,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 STATE_COUNTS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report the I/O buffer pool
+ *
+ */
+
+static bool get_iobuf_stats(DBusMessageIter *args,
+			    DBusMessage *reply,
+			    DBusError *error)
+{
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, true, "OK");
+	iobuf_dbus_stats(&iter);
+	return true;
+}
+
+static struct gsh_dbus_method global_show_iobufs = {
+	.name = "GetIOBuffers",
+	.method = get_iobuf_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 IOBUF_STATS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report an export's request throttle
+ *
+ */
+
+static bool get_export_throttle(DBusMessageIter *args,
+				DBusMessage *reply,
+				DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	dbus_status_reply(&iter, export != NULL, errormsg);
+	if (export == NULL)
+		return true;
+
+	server_dbus_throttle(&export->throttle,
+			     atomic_fetch_uint64_t(&export->max_iops),
+			     atomic_fetch_uint64_t(&export->max_bandwidth),
+			     &iter);
+	put_gsh_export(export);
+	return true;
+}
+
+static struct gsh_dbus_method export_show_throttle = {
+	.name = "GetThrottle",
+	.method = get_export_throttle,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 THROTTLE_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to override an export's throttle limits
+ *
+ * The limits hold until the next SetThrottle, whatever the
+ * configuration says.
+ */
+
+static bool set_export_throttle(DBusMessageIter *args,
+				DBusMessage *reply,
+				DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	uint64_t iops, bandwidth;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export == NULL)
+		success = false;
+	dbus_message_iter_next(args);
+	if (success)
+		success = arg_throttle(args, &iops, &bandwidth, &errormsg);
+	if (success)
+		throttle_set(&export->throttle, iops, bandwidth, true);
+	dbus_status_reply(&iter, success, errormsg);
+
+	if (export != NULL)
+		put_gsh_export(export);
+	return true;
+}
+
+static struct gsh_dbus_method export_set_throttle = {
+	.name = "SetThrottle",
+	.method = set_export_throttle,
+	.args = {EXPORT_ID_ARG,
+		 THROTTLE_IOPS_ARG,
+		 THROTTLE_BW_ARG,
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to put an export back on its configured throttle limits
+ *
+ */
+
+static bool clear_export_throttle(DBusMessageIter *args,
+				  DBusMessage *reply,
+				  DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export != NULL) {
+		throttle_clear(&export->throttle);
+		put_gsh_export(export);
+	}
+	dbus_status_reply(&iter, export != NULL, errormsg);
+	return true;
+}
+
+static struct gsh_dbus_method export_clear_throttle = {
+	.name = "ClearThrottle",
+	.method = clear_export_throttle,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method export_show_total_ops = {
+	.name = "GetTotalOPS",
+	.method = get_nfsv_export_total_ops,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 TOTAL_OPS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_total_ops = {
+	.name = "GetGlobalOPS",
+	.method = get_nfsv_global_total_ops,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 TOTAL_OPS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_fast_ops = {
+	.name = "GetFastOPS",
+	.method = get_nfsv_global_fast_ops,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 TOTAL_OPS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method cache_inode_show = {
+	.name = "ShowCacheInode",
+	.method = show_cache_inode_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 TOTAL_OPS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report each export's use of the metadata cache
+ *
+ */
+
+static bool show_cache_shares(DBusMessageIter *args,
+			      DBusMessage *reply,
+			      DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	mdcache_dbus_shares(&iter);
+
+	return true;
+}
+
+static struct gsh_dbus_method cache_shares_show = {
+	.name = "ShowCacheShares",
+	.method = show_cache_shares,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 CACHE_SHARES_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * @brief Report all IO stats of all exports in one call
+ *
+ * @return
  *	status
  *	error message
  *	time
@@ -2406,13 +3859,36 @@ static struct gsh_dbus_method *export_stats_methods[] = {
 #ifdef _USE_9P
 	&export_show_9p_io,
 	&export_show_9p_op_stats,
+	&req_queue_show,
+	&worker_pool_show,
+	&worker_pool_set,
+#endif
+#ifdef _HAVE_GSSAPI
+	&gss_stats_show,
 #endif
+	&pool_stats_show,
 	&global_show_total_ops,
 	&global_show_fast_ops,
+	&global_show_lat_hist,
+	&export_show_lat_hist,
+	&global_show_stage_hist,
+	&global_show_lock_prof,
+	&global_show_topk,
+	&global_show_mem_acct,
+	&global_show_req_drops,
+	&global_show_admission,
+	&global_show_partitions,
+	&global_show_state_counts,
+	&global_show_iobufs,
+	&export_show_throttle,
+	&export_set_throttle,
+	&export_clear_throttle,
 	&cache_inode_show,
+	&cache_shares_show,
 	&export_show_all_io,
 	&reset_statistics,
 	&fsal_statistics,
+	&fsal_export_statistics,
 	&enable_statistics,
 	&disable_statistics,
 	&status_stats,
@@ -2456,6 +3932,8 @@ void export_pkginit(void)
 	PTHREAD_RWLOCK_init(&export_by_id.lock, &rwlock_attr);
 	avltree_init(&export_by_id.t, export_id_cmpf, 0);
 	memset(&export_by_id.cache, 0, sizeof(export_by_id.cache));
+	export_by_path = export_path_node_alloc("", 0);
+	export_by_pseudo = export_path_node_alloc("", 0);
 
 	glist_init(&exportlist);
 	glist_init(&mount_work);
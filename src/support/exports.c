@@ -82,11 +82,18 @@ struct global_export_perms export_opt = {
 /* A second copy used in configuration, so we can atomically update the
  * primary set.
  */
+/** Bumped whenever export_opt changes, updated under export_opt_lock */
+static uint64_t export_opt_gen;
+
 struct global_export_perms export_opt_cfg = {
 	GLOBAL_EXPORT_PERMS_INITIALIZER
 };
 
 static void FreeClientList(struct glist_head *clients);
+static struct client_trie *client_trie_build(struct glist_head *clients);
+static void client_trie_free(struct client_trie *trie);
+static void export_set_client_trie(struct gsh_export *export,
+				   struct client_trie **trie);
 
 static int StrExportOptions(struct display_buffer *dspbuf,
 			    struct export_perms *p_perms)
@@ -954,6 +961,10 @@ static inline void update_atomic_fields(struct gsh_export *export,
 	atomic_store_uint64_t(&export->PrefReaddir, src->PrefReaddir);
 	atomic_store_uint64_t(&export->MaxOffsetWrite, src->MaxOffsetWrite);
 	atomic_store_uint64_t(&export->MaxOffsetRead, src->MaxOffsetRead);
+	atomic_store_uint64_t(&export->max_iops, src->max_iops);
+	atomic_store_uint64_t(&export->max_bandwidth, src->max_bandwidth);
+	atomic_store_voidptr((void **)&export->partition, src->partition);
+	atomic_store_uint32_t(&export->cache_share, src->cache_share);
 	atomic_store_uint32_t(&export->options, src->options);
 	atomic_store_uint32_t(&export->options_set, src->options_set);
 }
@@ -976,6 +987,8 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 				enum export_commit_type commit_type)
 {
 	struct gsh_export *export = self_struct, *probe_exp;
+	struct client_trie *trie;
+	char *partition_name;
 	int errcnt = 0;
 	char perms[1024] = "\0";
 	struct display_buffer dspbuf = {sizeof(perms), perms, perms};
@@ -1039,6 +1052,16 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 			errcnt++;
 		}
 	}
+	if (export->partition_name != NULL) {
+		export->partition = partition_lookup(export->partition_name);
+		if (export->partition == NULL) {
+			LogCrit(COMPONENT_CONFIG,
+				"Partition %s is not defined",
+				export->partition_name);
+			err_type->invalid = true;
+			errcnt++;
+		}
+	}
 	if (errcnt)
 		return errcnt;  /* have basic errors. don't even try more... */
 
@@ -1126,6 +1149,18 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 		/* Update atomic fields */
 		update_atomic_fields(probe_exp, export);
 
+		/* A config reload records the new hash once we return */
+		probe_exp->config_hash = 0;
+
+		/* Updating an immutable export is how what was published
+		 * behind it is made visible.
+		 */
+		if (atomic_fetch_uint32_t(&probe_exp->options) &
+		    EXPORT_OPTION_IMMUTABLE)
+			(void) mdcache_export_invalidate(probe_exp);
+
+		trie = client_trie_build(&export->clients);
+
 		/* Now take lock and swap out client list and export_perms... */
 		PTHREAD_RWLOCK_wrlock(&probe_exp->lock);
 
@@ -1142,9 +1177,18 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 			     export->clients.next, export->clients.prev);
 
 		glist_swap_lists(&probe_exp->clients, &export->clients);
+		export_set_client_trie(probe_exp, &trie);
+
+		/* The old name is disposed of with the new export */
+		partition_name = probe_exp->partition_name;
+		probe_exp->partition_name = export->partition_name;
+		export->partition_name = partition_name;
 
 		PTHREAD_RWLOCK_unlock(&probe_exp->lock);
 
+		/* The old trie refers to the old client list */
+		client_trie_free(trie);
+
 		/* We will need to dispose of the config export since we
 		 * updated the existing export.
 		 */
@@ -1264,6 +1308,9 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 		}
 	}
 
+	trie = client_trie_build(&export->clients);
+	export_set_client_trie(export, &trie);
+
 	if (!insert_gsh_export(export)) {
 		LogCrit(COMPONENT_CONFIG,
 			"Export id %d already in use.",
@@ -1404,6 +1451,7 @@ static int export_defaults_commit(void *node, void *link_mem,
 	/* Update under lock. */
 	PTHREAD_RWLOCK_wrlock(&export_opt_lock);
 	export_opt = export_opt_cfg;
+	atomic_inc_uint64_t(&export_opt_gen);
 	PTHREAD_RWLOCK_unlock(&export_opt_lock);
 
 	return 0;
@@ -1624,6 +1672,10 @@ static int client_adder(const char *token,
 
 static struct config_item client_params[] = {
 	CONF_EXPORT_PERMS(exportlist_client_entry__, client_perms),
+	CONF_ITEM_UI64("Max_IOPS", 0, UINT32_MAX, 0,
+		       exportlist_client_entry__, client_perms.max_iops),
+	CONF_ITEM_UI64("Max_Bandwidth", 0, UINT64_MAX, 0,
+		       exportlist_client_entry__, client_perms.max_bandwidth),
 	CONF_ITEM_PROC("Clients", noop_conf_init, client_adder,
 		       exportlist_client_entry__, cle_list),
 	CONFIG_EOL
@@ -1689,6 +1741,14 @@ static struct config_item fsal_params[] = {
 		       _struct_, MaxOffsetWrite),			\
 	CONF_ITEM_UI64("MaxOffsetRead", 512, UINT64_MAX, INT64_MAX,	\
 		       _struct_, MaxOffsetRead),			\
+	CONF_ITEM_UI64("Max_IOPS", 0, UINT32_MAX, 0,			\
+		       _struct_, max_iops),				\
+	CONF_ITEM_UI64("Max_Bandwidth", 0, UINT64_MAX, 0,		\
+		       _struct_, max_bandwidth),			\
+	CONF_ITEM_STR("Partition", 1, 255, NULL,			\
+		      _struct_, partition_name),			\
+	CONF_ITEM_UI32("Cache_Share", 0, 100, 0,			\
+		       _struct_, cache_share),				\
 	CONF_ITEM_BOOLBIT_SET("UseCookieVerifier",			\
 		false, EXPORT_OPTION_USE_COOKIE_VERIFIER,		\
 		_struct_, options, options_set),			\
@@ -1698,6 +1758,9 @@ static struct config_item fsal_params[] = {
 	CONF_ITEM_BOOLBIT_SET("Trust_Readdir_Negative_Cache",		\
 		false, EXPORT_OPTION_TRUST_READIR_NEGATIVE_CACHE,	\
 		_struct_, options, options_set),			\
+	CONF_ITEM_BOOLBIT_SET("Immutable",				\
+		false, EXPORT_OPTION_IMMUTABLE,				\
+		_struct_, options, options_set),			\
 	CONF_ITEM_BOOLBIT_SET("Disable_ACL",				\
 		false, EXPORT_OPTION_DISABLE_ACL,			\
 		_struct_, options, options_set),			\
@@ -1961,6 +2024,154 @@ err_out:
 	return -1;
 }
 
+/**
+ * @brief Hash of the EXPORT_DEFAULTS blocks of the last config load
+ */
+
+static uint64_t export_defaults_hash;
+
+/**
+ * @brief Generation of the last config load, see gsh_export.config_gen
+ */
+
+static uint64_t export_config_gen;
+
+/**
+ * @brief Find the export an EXPORT block of the config is for
+ *
+ * @param node [IN] the EXPORT block
+ *
+ * @return A reference to the export, NULL if there is none.
+ */
+
+static struct gsh_export *export_of_block(void *node)
+{
+	const char *value = config_block_value(node, "Export_Id");
+	unsigned long export_id;
+	char *end;
+
+	if (value == NULL)
+		return NULL;
+
+	errno = 0;
+	export_id = strtoul(value, &end, 0);
+	if (errno != 0 || *end != '\0' || export_id > UINT16_MAX)
+		return NULL;
+
+	return get_gsh_export(export_id);
+}
+
+/**
+ * @brief Remember which EXPORT block each export was loaded from
+ *
+ * An export found in the config is stamped with the current
+ * generation.  The first block for an export wins.
+ *
+ * @param node   [IN] the EXPORT block
+ * @param loaded [IN] the block was loaded without errors
+ */
+
+static void export_stamp_block(void *node, bool loaded)
+{
+	struct gsh_export *export = export_of_block(node);
+
+	if (export == NULL)
+		return;
+
+	if (export->config_gen != export_config_gen) {
+		export->config_hash = loaded ? config_node_hash(node) : 0;
+		export->config_gen = export_config_gen;
+	}
+
+	put_gsh_export(export);
+}
+
+/**
+ * @brief Find the EXPORT blocks of a config
+ *
+ * @return 0 or ENOENT when there are none, errno on errors.
+ */
+
+static int find_export_blocks(config_file_t in_config,
+			      struct config_node_list **config_list,
+			      struct config_error_type *err_type)
+{
+	*config_list = NULL;
+	return find_config_nodes(in_config, "EXPORT(Export_Id=*)",
+				 config_list, err_type);
+}
+
+/**
+ * @brief Exports collected for initialization or removal
+ */
+
+struct export_vec {
+	struct gsh_export **exports;
+	uint32_t count;
+	uint32_t size;
+};
+
+static bool collect_export_cb(struct gsh_export *exp, void *state)
+{
+	struct export_vec *vec = state;
+
+	if (vec->count == vec->size) {
+		vec->size = vec->size ? vec->size * 2 : 64;
+		vec->exports = gsh_realloc(vec->exports,
+					   vec->size * sizeof(*vec->exports));
+	}
+
+	get_gsh_export_ref(exp);
+	vec->exports[vec->count++] = exp;
+
+	return true;
+}
+
+static bool collect_stale_export_cb(struct gsh_export *exp, void *state)
+{
+	if (exp->export_id != 0 && exp->config_gen != 0 &&
+	    exp->config_gen != export_config_gen)
+		return collect_export_cb(exp, state);
+
+	return true;
+}
+
+/**
+ * @brief Unexport the exports that have left the config file
+ *
+ * Exports added over DBus were never in the config file and stay.
+ *
+ * @return The number of exports removed.
+ */
+
+static int remove_stale_exports(void)
+{
+	struct export_vec vec = { NULL, 0, 0 };
+	struct root_op_context root_op_context;
+	struct gsh_export *export;
+	uint32_t i;
+
+	foreach_gsh_export(collect_stale_export_cb, false, &vec);
+
+	for (i = 0; i < vec.count; i++) {
+		export = vec.exports[i];
+
+		init_root_op_context(&root_op_context, export,
+				     export->fsal_export, 0, 0,
+				     UNKNOWN_REQUEST);
+		unexport(export);
+		release_root_op_context();
+
+		LogInfo(COMPONENT_CONFIG,
+			"Export %d is no longer in the config, removed",
+			export->export_id);
+		put_gsh_export(export);
+	}
+
+	gsh_free(vec.exports);
+	return vec.count;
+}
+
 /**
  * @brief Read the export entries from the parsed configuration file.
  *
@@ -1973,6 +2184,7 @@ err_out:
 int ReadExports(config_file_t in_config,
 		struct config_error_type *err_type)
 {
+	struct config_node_list *config_list, *lp, *lp_next;
 	int rc, num_exp;
 
 	rc = load_config_from_parse(in_config,
@@ -1995,6 +2207,17 @@ int ReadExports(config_file_t in_config,
 		return -1;
 	}
 
+	export_defaults_hash = config_block_hash(in_config, "EXPORT_DEFAULTS");
+	export_config_gen++;
+
+	if (find_export_blocks(in_config, &config_list, err_type) == 0) {
+		for (lp = config_list; lp != NULL; lp = lp_next) {
+			lp_next = lp->next;
+			export_stamp_block(lp->tree_node, true);
+			gsh_free(lp);
+		}
+	}
+
 	rc = build_default_root(err_type);
 	if (rc < 0) {
 		LogCrit(COMPONENT_CONFIG, "No pseudo root!");
@@ -2007,16 +2230,24 @@ int ReadExports(config_file_t in_config,
 /**
  * @brief Reread the export entries from the parsed configuration file.
  *
+ * Only the EXPORT blocks that changed since the last load are applied,
+ * unless EXPORT_DEFAULTS changed.  Exports whose block is gone from the
+ * file are removed.
+ *
  * @param[in]  in_config    The file that contains the export list
  *
  * @return A negative value on error,
- *         the number of export entries else.
+ *         the number of export entries added or updated else.
  */
 
 int reread_exports(config_file_t in_config,
 		   struct config_error_type *err_type)
 {
-	int rc, num_exp;
+	struct config_node_list *config_list, *lp, *lp_next;
+	struct gsh_export *export;
+	uint64_t defaults_hash;
+	bool changed_defaults;
+	int rc, num_exp = 0, unchanged = 0, removed;
 
 	LogInfo(COMPONENT_CONFIG, "Reread exports");
 
@@ -2031,17 +2262,49 @@ int reread_exports(config_file_t in_config,
 		return -1;
 	}
 
-	num_exp = load_config_from_parse(in_config,
-					 &update_export_param,
-					 NULL,
-					 false,
-					 err_type);
+	defaults_hash = config_block_hash(in_config, "EXPORT_DEFAULTS");
+	changed_defaults = defaults_hash != export_defaults_hash;
+	export_defaults_hash = defaults_hash;
+	export_config_gen++;
 
-	if (num_exp < 0) {
+	rc = find_export_blocks(in_config, &config_list, err_type);
+	if (rc != 0 && rc != ENOENT) {
 		LogCrit(COMPONENT_CONFIG, "Export block error");
 		return -1;
 	}
 
+	for (lp = config_list; lp != NULL; lp = lp_next) {
+		lp_next = lp->next;
+
+		export = export_of_block(lp->tree_node);
+		if (export != NULL && !changed_defaults &&
+		    export->config_gen != export_config_gen &&
+		    export->config_hash == config_node_hash(lp->tree_node)) {
+			/* Same block as last time, nothing to do */
+			export->config_gen = export_config_gen;
+			unchanged++;
+		} else {
+			rc = load_config_from_node(lp->tree_node,
+						   &update_export_param,
+						   NULL,
+						   false,
+						   err_type);
+			if (rc == 0)
+				num_exp++;
+			export_stamp_block(lp->tree_node, rc == 0);
+		}
+
+		if (export != NULL)
+			put_gsh_export(export);
+		gsh_free(lp);
+	}
+
+	removed = remove_stale_exports();
+
+	LogEvent(COMPONENT_CONFIG,
+		 "Reread exports: %d added or updated, %d unchanged, %d removed",
+		 num_exp, unchanged, removed);
+
 	return num_exp;
 }
 
@@ -2090,6 +2353,8 @@ static void FreeClientList(struct glist_head *clients)
 
 void free_export_resources(struct gsh_export *export)
 {
+	client_trie_free(export->client_trie);
+	export->client_trie = NULL;
 	FreeClientList(&export->clients);
 	if (export->fsal_export != NULL) {
 		struct fsal_module *fsal = export->fsal_export->fsal;
@@ -2109,44 +2374,63 @@ void free_export_resources(struct gsh_export *export)
 		gsh_free(export->pseudopath);
 	if (export->FS_tag != NULL)
 		gsh_free(export->FS_tag);
+	if (export->partition_name != NULL)
+		gsh_free(export->partition_name);
 }
 
 /**
- * @brief pkginit callback to initialize exports from nfs_init
+ * @brief pkginit callback to initialize an export's root from nfs_init
  *
- * Assumes being called with the export_by_id.lock held.
- * true on success
+ * Called without the export_by_id.lock held.
  */
 
-static bool init_export_cb(struct gsh_export *exp, void *state)
+static void init_export_cb(struct gsh_export *exp, void *state)
 {
-	struct glist_head *errlist = state;
+	struct timespec start, end;
+	int rc;
 
-	if (init_export_root(exp)) {
-		glist_del(&exp->exp_list);
-		glist_add(errlist, &exp->exp_list);
+	now(&start);
+	rc = init_export_root(exp);
+	now(&end);
+
+	if (rc != 0) {
+		export_revert(exp);
+		return;
 	}
 
-	return true;
+	LogInfo(COMPONENT_EXPORT,
+		"Export %d root %s initialized in %" PRIu64 " ms",
+		exp->export_id, exp->fullpath,
+		timespec_diff(&start, &end) / NS_PER_MSEC);
 }
 
 /**
  * @brief Initialize exports over a live cache inode and fsal layer
+ *
+ * The export roots are looked up in parallel, each export going back
+ * out of the export list if its root can't be found.
  */
 
 void exports_pkginit(void)
 {
-	struct glist_head errlist;
-	struct glist_head *glist, *glistn;
-	struct gsh_export *export;
+	struct export_vec vec = { NULL, 0, 0 };
+	struct timespec start, end;
+	uint32_t i;
 
-	glist_init(&errlist);
-	foreach_gsh_export(init_export_cb, true, &errlist);
+	now(&start);
 
-	glist_for_each_safe(glist, glistn, &errlist) {
-		export = glist_entry(glist, struct gsh_export, exp_list);
-		export_revert(export);
-	}
+	foreach_gsh_export(collect_export_cb, false, &vec);
+	foreach_gsh_export_parallel(vec.exports, vec.count,
+				    init_export_cb, NULL);
+
+	for (i = 0; i < vec.count; i++)
+		put_gsh_export(vec.exports[i]);
+	gsh_free(vec.exports);
+
+	now(&end);
+	LogEvent(COMPONENT_EXPORT,
+		 "Initialized %u export roots in %" PRIu64 " ms",
+		 vec.count, timespec_diff(&start, &end) / NS_PER_MSEC);
 }
 
 /**
@@ -2233,7 +2517,8 @@ static void set_fs_max_rdwr_size(struct gsh_export *export, uint64_t maxread,
 /**
  * @brief Initialize the root cache inode for an export.
  *
- * Assumes being called with the export_by_id.lock held.
+ * May be called for several exports at once.  The export and root
+ * object locks are taken to publish the root.
  *
  * @param exp [IN] the export
  *
@@ -2372,6 +2657,9 @@ static void release_export(struct gsh_export *export)
 
 	export->fsal_export->exp_ops.prepare_unexport(export->fsal_export);
 
+	/* Drop what the workers' PUTFH caches hold of it */
+	nfs4_putfh_flush_export(export);
+
 	/* Release state belonging to this export */
 	state_release_export(export);
 
@@ -2409,30 +2697,219 @@ void unexport(struct gsh_export *export)
 		release_root_op_context();
 }
 
+/**
+ * @brief Node of a client_trie, one per prefix bit
+ */
+struct client_trie_node {
+	struct client_trie_node *child[2];
+	/** First network client with exactly this prefix, or NULL */
+	exportlist_client_entry_t *client;
+	/** Position of client in the export's client list */
+	int index;
+};
+
+/**
+ * @brief An export's network clients, indexed by prefix
+ *
+ * CLIENT blocks are matched first to last.  Network clients go in a
+ * binary trie per address family, so the earliest network client that
+ * contains an address is found in one walk down its bits.  Only the
+ * other kinds of client listed before that one need to be tried.
+ */
+struct client_trie {
+	struct client_trie_node *root[2];	/*< IPv4 and IPv6 */
+	/** Position of the first client that is not a network, or -1 */
+	int first_other;
+};
+
+static uint64_t clients_gen;	/*< atomic, last clients_gen handed out */
+
+#define CIDR_BIT(addr, i) (((addr)[(i) / 8] >> (7 - (i) % 8)) & 1)
+
+static void client_trie_insert(struct client_trie *trie,
+			       exportlist_client_entry_t *client, int index)
+{
+	CIDR *cidr = client->client.network.cidr;
+	int v6 = cidr->proto == CIDR_IPV6;
+	int i = v6 ? 0 : 96;
+	int last = i + cidr_get_pflen(cidr);
+	struct client_trie_node **node = &trie->root[v6];
+
+	/* Bits before the v4 part of a v4 address are not compared */
+	while (true) {
+		if (*node == NULL)
+			*node = gsh_calloc(1, sizeof(**node));
+		if (i == last)
+			break;
+		node = &(*node)->child[CIDR_BIT(cidr->addr, i)];
+		i++;
+	}
+
+	/* An earlier client with the same prefix always wins */
+	if ((*node)->client == NULL) {
+		(*node)->client = client;
+		(*node)->index = index;
+	}
+}
+
+static exportlist_client_entry_t *client_trie_lookup(struct client_trie *trie,
+						     CIDR *host, int *index)
+{
+	int v6 = host->proto == CIDR_IPV6;
+	int i = v6 ? 0 : 96;
+	struct client_trie_node *node = trie->root[v6];
+	exportlist_client_entry_t *best = NULL;
+
+	while (node != NULL) {
+		if (node->client != NULL &&
+		    (best == NULL || node->index < *index)) {
+			best = node->client;
+			*index = node->index;
+		}
+		if (i == 128)
+			break;
+		node = node->child[CIDR_BIT(host->addr, i)];
+		i++;
+	}
+
+	return best;
+}
+
+static void client_trie_free_node(struct client_trie_node *node)
+{
+	if (node == NULL)
+		return;
+
+	client_trie_free_node(node->child[0]);
+	client_trie_free_node(node->child[1]);
+	gsh_free(node);
+}
+
+static void client_trie_free(struct client_trie *trie)
+{
+	if (trie == NULL)
+		return;
+
+	client_trie_free_node(trie->root[0]);
+	client_trie_free_node(trie->root[1]);
+	gsh_free(trie);
+}
+
+/**
+ * @brief Compile a client list for client_match
+ *
+ * @param[in] clients Client list to compile
+ *
+ * @return The new trie, which refers into @a clients.
+ */
+static struct client_trie *client_trie_build(struct glist_head *clients)
+{
+	struct client_trie *trie = gsh_calloc(1, sizeof(*trie));
+	struct glist_head *glist;
+	exportlist_client_entry_t *client;
+	int index = 0;
+
+	trie->first_other = -1;
+
+	glist_for_each(glist, clients) {
+		client = glist_entry(glist, exportlist_client_entry_t,
+				     cle_list);
+
+		if (client->type == NETWORK_CLIENT &&
+		    client->client.network.cidr != NULL)
+			client_trie_insert(trie, client, index);
+		else if (trie->first_other < 0)
+			trie->first_other = index;
+
+		index++;
+	}
+
+	return trie;
+}
+
+/**
+ * @brief Install a compiled client list into an export
+ *
+ * The old trie, if any, is returned through @a trie for the caller to
+ * free once the export lock is dropped.
+ *
+ * @note The export lock must be held for write, or the export must not
+ *       be visible yet.
+ */
+static void export_set_client_trie(struct gsh_export *export,
+				   struct client_trie **trie)
+{
+	struct client_trie *old = export->client_trie;
+
+	export->client_trie = *trie;
+	export->clients_gen = atomic_inc_uint64_t(&clients_gen);
+	*trie = old;
+}
+
 /**
  * @brief Match a specific option in the client export list
  *
+ * Network clients are found through the export's client_trie; the list
+ * is only walked for other kinds of client placed ahead of the best
+ * network match.
+ *
  * @param[in]  hostaddr      Host to search for
- * @param[in]  clients       Client list to search
- * @param[out] client_found Matching entry
- * @param[in]  export_option Option to search for
+ * @param[in]  export        Export whose client list to search
+ * @param[out] cacheable     Whether the result depends only on hostaddr
+ *                           and the client list, and not on name or
+ *                           netgroup lookups that may change
  *
- * @return true if found, false otherwise.
+ * @return The first matching client, or NULL.
  */
 static exportlist_client_entry_t *client_match(sockaddr_t *hostaddr,
-					       struct gsh_export *export)
+					       struct gsh_export *export,
+					       bool *cacheable)
 {
 	struct glist_head *glist;
 	int rc;
+	bool timedout;
 	int ipvalid = -1;	/* -1 need to print, 0 - invalid, 1 - ok */
 	char hostname[MAXHOSTNAMELEN + 1];
 	char ipstring[SOCK_NAME_MAX + 1];
 	CIDR *host_prefix = NULL;
+	struct client_trie *trie = export->client_trie;
 	exportlist_client_entry_t *client;
+	exportlist_client_entry_t *net_client = NULL;
+	int net_index = 0;
+	int index = 0;
+
+	*cacheable = true;
+
+	if (hostaddr->ss_family == AF_INET6) {
+		host_prefix = cidr_from_in6addr(
+			&((struct sockaddr_in6 *)hostaddr)->sin6_addr);
+	} else {
+		host_prefix = cidr_from_inaddr(
+			&((struct sockaddr_in *)hostaddr)->sin_addr);
+	}
+
+	/* Without a trie, fall back to trying every client in turn */
+	if (trie != NULL) {
+		net_client = client_trie_lookup(trie, host_prefix, &net_index);
+
+		/* Nothing but network clients can come first */
+		if (trie->first_other < 0 ||
+		    (net_client != NULL && net_index < trie->first_other)) {
+			client = net_client;
+			goto out;
+		}
+	}
 
 	glist_for_each(glist, &export->clients) {
 		client = glist_entry(glist, exportlist_client_entry_t,
 				     cle_list);
+
+		/* The network client matched before any client after it */
+		if (net_client != NULL && index++ == net_index) {
+			client = net_client;
+			goto out;
+		}
+
 		LogClientListEntry(NIV_MID_DEBUG,
 				   COMPONENT_EXPORT,
 				   __LINE__,
@@ -2442,35 +2919,26 @@ static exportlist_client_entry_t *client_match(sockaddr_t *hostaddr,
 
 		switch (client->type) {
 		case NETWORK_CLIENT:
-			if (host_prefix == NULL) {
-				if (hostaddr->ss_family == AF_INET6) {
-					host_prefix = cidr_from_in6addr(
-						&((struct sockaddr_in6 *)
-							hostaddr)->sin6_addr);
-				} else {
-					host_prefix = cidr_from_inaddr(
-						&((struct sockaddr_in *)
-							hostaddr)->sin_addr);
-				}
-			}
-
-			if (cidr_contains(client->client.network.cidr,
+			/* Already matched through the client_trie */
+			if (trie == NULL &&
+			    cidr_contains(client->client.network.cidr,
 					  host_prefix) == 0) {
 				goto out;
 			}
 			break;
 
 		case NETGROUP_CLIENT:
-			/* Try to get the entry from th IP/name cache */
-			rc = nfs_ip_name_get(hostaddr, hostname,
-					     sizeof(hostname));
-
-			if (rc == IP_NAME_NOT_FOUND) {
-				/* IPaddr was not cached, add it to the cache */
-				rc = nfs_ip_name_add(hostaddr,
-						     hostname,
-						     sizeof(hostname));
-			}
+			*cacheable = false;
+
+			/* Get the entry from the IP/name cache, or resolve
+			 * it within Resolve_Timeout
+			 */
+			rc = nfs_ip_name_resolve(hostaddr, hostname,
+						 sizeof(hostname));
+
+			if (rc == IP_NAME_TIMEOUT &&
+			    nfs_ip_name_allow_on_timeout())
+				goto out;
 
 			if (rc != IP_NAME_SUCCESS)
 				break; /* Fatal failure */
@@ -2479,7 +2947,8 @@ static exportlist_client_entry_t *client_match(sockaddr_t *hostaddr,
 			 * name that was found
 			 */
 			if (ng_innetgr(client->client.netgroup.netgroupname,
-				    hostname)) {
+				       hostname, &timedout) ||
+			    (timedout && nfs_ip_name_allow_on_timeout())) {
 				goto out;
 			}
 			break;
@@ -2498,21 +2967,22 @@ static exportlist_client_entry_t *client_match(sockaddr_t *hostaddr,
 				goto out;
 			}
 
-			/* Try to get the entry from th IP/name cache */
-			rc = nfs_ip_name_get(hostaddr, hostname,
-					     sizeof(hostname));
+			*cacheable = false;
 
-			if (rc == IP_NAME_NOT_FOUND) {
-				/* IPaddr was not cached, add it to the cache */
+			/* Get the entry from the IP/name cache, or resolve
+			 * it within Resolve_Timeout
+			 */
 
-				/** @todo this change from 1.5 is not IPv6
-				 * useful.  come back to this and use the
-				 * string from client mgr inside req_ctx...
-				 */
-				rc = nfs_ip_name_add(hostaddr,
-						     hostname,
-						     sizeof(hostname));
-			}
+			/** @todo this change from 1.5 is not IPv6
+			 * useful.  come back to this and use the
+			 * string from client mgr inside req_ctx...
+			 */
+			rc = nfs_ip_name_resolve(hostaddr, hostname,
+						 sizeof(hostname));
+
+			if (rc == IP_NAME_TIMEOUT &&
+			    nfs_ip_name_allow_on_timeout())
+				goto out;
 
 			if (rc != IP_NAME_SUCCESS)
 				break;
@@ -2546,14 +3016,67 @@ static exportlist_client_entry_t *client_match(sockaddr_t *hostaddr,
 
 out:
 
-	if (host_prefix != NULL)
-		cidr_free(host_prefix);
+	cidr_free(host_prefix);
 
 	/* no export found for this option */
 	return client;
 
 }
 
+/**
+ * @brief Find the current request's remembered access to its export
+ *
+ * The resolved export_perms are remembered in the request's gsh_client,
+ * tagged with the export's clients_gen and the EXPORT_DEFAULTS
+ * generation, so they are forgotten when either is updated.
+ *
+ * @note The export lock must be held.
+ *
+ * @return true if op_ctx->export_perms has been filled in.
+ */
+static bool export_perms_cache_get(struct gsh_export *export)
+{
+	struct gsh_client *gclient = op_ctx->client;
+	struct client_match_cache *cm;
+	bool hit;
+
+	if (gclient == NULL || export->clients_gen == 0)
+		return false;
+
+	cm = &gclient->cm_cache[export->export_id % CLIENT_MATCH_CACHE_SIZE];
+
+	PTHREAD_RWLOCK_rdlock(&gclient->lock);
+	hit = cm->cm_gen == export->clients_gen &&
+	      cm->cm_opt_gen == atomic_fetch_uint64_t(&export_opt_gen);
+	if (hit)
+		*op_ctx->export_perms = cm->cm_perms;
+	PTHREAD_RWLOCK_unlock(&gclient->lock);
+
+	return hit;
+}
+
+/**
+ * @brief Remember the access just resolved for the current request
+ *
+ * @note The export lock and export_opt_lock must be held.
+ */
+static void export_perms_cache_put(struct gsh_export *export)
+{
+	struct gsh_client *gclient = op_ctx->client;
+	struct client_match_cache *cm;
+
+	if (gclient == NULL || export->clients_gen == 0)
+		return;
+
+	cm = &gclient->cm_cache[export->export_id % CLIENT_MATCH_CACHE_SIZE];
+
+	PTHREAD_RWLOCK_wrlock(&gclient->lock);
+	cm->cm_gen = export->clients_gen;
+	cm->cm_opt_gen = export_opt_gen;
+	cm->cm_perms = *op_ctx->export_perms;
+	PTHREAD_RWLOCK_unlock(&gclient->lock);
+}
+
 /**
  * @brief Checks if request security flavor is suffcient for the requested
  *        export
@@ -2783,6 +3306,7 @@ void export_check_access(void)
 	exportlist_client_entry_t *client = NULL;
 	sockaddr_t alt_hostaddr;
 	sockaddr_t *hostaddr = NULL;
+	bool cacheable = false;
 
 	assert(op_ctx != NULL);
 	assert(op_ctx->export_perms != NULL);
@@ -2800,6 +3324,12 @@ void export_check_access(void)
 		goto no_export;
 	}
 
+	/* Same client and export, and nothing updated since last time? */
+	if (export_perms_cache_get(op_ctx->ctx_export)) {
+		PTHREAD_RWLOCK_unlock(&op_ctx->ctx_export->lock);
+		return;
+	}
+
 	hostaddr = convert_ipv6_to_ipv4(op_ctx->caller_addr, &alt_hostaddr);
 
 	if (isMidDebug(COMPONENT_EXPORT)) {
@@ -2815,7 +3345,7 @@ void export_check_access(void)
 	}
 
 	/* Does the client match anyone on the client list? */
-	client = client_match(hostaddr, op_ctx->ctx_export);
+	client = client_match(hostaddr, op_ctx->ctx_export, &cacheable);
 	if (client != NULL) {
 		/* Take client options */
 		op_ctx->export_perms->options = client->client_perms.options &
@@ -2830,6 +3360,9 @@ void export_check_access(void)
 					client->client_perms.anonymous_gid;
 
 		op_ctx->export_perms->set = client->client_perms.set;
+		op_ctx->export_perms->max_iops = client->client_perms.max_iops;
+		op_ctx->export_perms->max_bandwidth =
+					client->client_perms.max_bandwidth;
 	}
 
 	/* Any options not set by the client, take from the export */
@@ -2943,6 +3476,9 @@ void export_check_access(void)
 			    perms);
 	}
 
+	if (cacheable)
+		export_perms_cache_put(op_ctx->ctx_export);
+
 	PTHREAD_RWLOCK_unlock(&export_opt_lock);
 
 	if (op_ctx->ctx_export != NULL) {
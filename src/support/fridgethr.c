@@ -43,11 +43,17 @@
 #include <pthread.h>
 #ifdef LINUX
 #include <sys/signal.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <limits.h>
+#include <unistd.h>
 #elif FREEBSD
 #include <signal.h>
 #endif
 #include "abstract_mem.h"
+#include "abstract_atomic.h"
 #include "fridgethr.h"
+#include "gsh_numa.h"
 #include "nfs_core.h"
 
 /**
@@ -97,6 +103,7 @@ int fridgethr_init(struct fridgethr **frout, const char *s,
 	frobj->p = *p;
 
 	frobj->s = NULL;
+	frobj->ring = NULL;
 	frobj->nthreads = 0;
 	frobj->nidle = 0;
 	frobj->flags = fridgethr_flag_none;
@@ -170,6 +177,21 @@ int fridgethr_init(struct fridgethr **frout, const char *s,
 			rc = EINVAL;
 			goto out;
 		}
+
+#ifdef LINUX
+		if (frobj->p.ring_size != 0) {
+			uint64_t size = 1;
+
+			while (size < frobj->p.ring_size)
+				size <<= 1;
+
+			frobj->ring = gsh_calloc(1, sizeof(*frobj->ring) +
+					size * sizeof(struct fridgethr_cell));
+			frobj->ring->mask = size - 1;
+			for (size = 0; size <= frobj->ring->mask; size++)
+				frobj->ring->cell[size].seq = size;
+		}
+#endif
 	} else if (frobj->p.flavor == fridgethr_flavor_looper) {
 		if (frobj->p.deferment != fridgethr_defer_fail) {
 			LogMajor(COMPONENT_THREAD,
@@ -201,6 +223,7 @@ int fridgethr_init(struct fridgethr **frout, const char *s,
 			attrinit = false;
 		}
 		if (frobj) {
+			gsh_free(frobj->ring);
 			if (frobj->s) {
 				gsh_free(frobj->s);
 				frobj->s = NULL;
@@ -221,6 +244,7 @@ int fridgethr_init(struct fridgethr **frout, const char *s,
 
 void fridgethr_destroy(struct fridgethr *fr)
 {
+	gsh_free(fr->ring);
 	PTHREAD_MUTEX_destroy(&fr->mtx);
 	pthread_attr_destroy(&fr->attr);
 	gsh_free(fr->s);
@@ -294,6 +318,186 @@ static bool fridgethr_deferredwork(struct fridgethr *fr)
 	return res;
 }
 
+#ifdef LINUX
+/** Attempts to take a job a waiting thread spins for, before it
+ *  sleeps on the futex. */
+#define FRIDGETHR_RING_SPIN 256
+
+static inline void fridgethr_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+}
+
+static inline int fridgethr_futex_wait(uint32_t *addr, uint32_t val,
+				       const struct timespec *timeout)
+{
+	return syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, timeout,
+		       NULL, 0);
+}
+
+static inline void fridgethr_futex_wake(uint32_t *addr, int count)
+{
+	(void) syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL,
+		       NULL, 0);
+}
+
+/**
+ * @brief Put a job on a ring
+ *
+ * @param[in] ring The ring
+ * @param[in] func The thing to do
+ * @param[in] arg  The thing to do it to
+ *
+ * @return false if the ring is full.
+ */
+
+static bool fridgethr_ring_push(struct fridgethr_ring *ring,
+				void (*func)(struct fridgethr_context *),
+				void *arg)
+{
+	struct fridgethr_cell *cell;
+	uint64_t pos = atomic_fetch_uint64_t(&ring->head);
+	int64_t dif;
+
+	for (;;) {
+		cell = &ring->cell[pos & ring->mask];
+		dif = (int64_t) (atomic_fetch_uint64_t(&cell->seq) - pos);
+		if (dif == 0) {
+			if (__sync_bool_compare_and_swap(&ring->head, pos,
+							 pos + 1))
+				break;
+		} else if (dif < 0) {
+			/* Not taken since the last lap */
+			return false;
+		}
+		pos = atomic_fetch_uint64_t(&ring->head);
+	}
+
+	cell->func = func;
+	cell->arg = arg;
+	atomic_store_uint64_t(&cell->seq, pos + 1);
+	return true;
+}
+
+/**
+ * @brief Take a job from a ring into a thread context
+ *
+ * @param[in]     ring The ring
+ * @param[in,out] fe   Fridge entry to load the job into
+ *
+ * @return false if the ring is empty.
+ */
+
+static bool fridgethr_ring_pop(struct fridgethr_ring *ring,
+			       struct fridgethr_entry *fe)
+{
+	struct fridgethr_cell *cell;
+	uint64_t pos = atomic_fetch_uint64_t(&ring->tail);
+	int64_t dif;
+
+	for (;;) {
+		cell = &ring->cell[pos & ring->mask];
+		dif = (int64_t) (atomic_fetch_uint64_t(&cell->seq) -
+				 (pos + 1));
+		if (dif == 0) {
+			if (__sync_bool_compare_and_swap(&ring->tail, pos,
+							 pos + 1))
+				break;
+		} else if (dif < 0) {
+			/* Not filled yet */
+			return false;
+		}
+		pos = atomic_fetch_uint64_t(&ring->tail);
+	}
+
+	fe->ctx.func = cell->func;
+	fe->ctx.arg = cell->arg;
+	atomic_store_uint64_t(&cell->seq, pos + ring->mask + 1);
+	return true;
+}
+
+/**
+ * @brief Wake every thread sleeping on a ring
+ *
+ * Used on state transitions, so they notice the new command.
+ *
+ * @param[in] fr The fridge
+ */
+
+static void fridgethr_ring_wake_all(struct fridgethr *fr)
+{
+	if (fr->ring == NULL)
+		return;
+
+	(void) atomic_inc_uint32_t(&fr->ring->futex);
+	fridgethr_futex_wake(&fr->ring->futex, INT_MAX);
+}
+
+/**
+ * @brief Wait for a job on the ring
+ *
+ * Spin a little, then sleep until a submitter wakes us, the command
+ * changes or thread_delay expires.
+ *
+ * @param[in]  fr        The fridge
+ * @param[in]  fe        Fridge entry to load the job into
+ * @param[out] timed_out Set if thread_delay expired
+ *
+ * @return true if a job was loaded.
+ */
+
+static bool fridgethr_ring_wait(struct fridgethr *fr,
+				struct fridgethr_entry *fe, bool *timed_out)
+{
+	struct fridgethr_ring *ring = fr->ring;
+	struct timespec timeout = { fr->p.thread_delay, 0 };
+	bool got = false;
+	uint32_t seq;
+	int spin;
+
+	(void) atomic_inc_uint32_t(&ring->waiters);
+	while (!got && fr->command == fridgethr_comm_run) {
+		for (spin = 0; spin < FRIDGETHR_RING_SPIN; spin++) {
+			got = fridgethr_ring_pop(ring, fe);
+			if (got)
+				break;
+			fridgethr_relax();
+		}
+		if (got)
+			break;
+
+		/* Count ourselves before the last look, so that a
+		   submitter either sees us or we see its job. */
+		(void) atomic_inc_uint32_t(&ring->sleepers);
+		seq = atomic_fetch_uint32_t(&ring->futex);
+		got = fridgethr_ring_pop(ring, fe);
+		if (!got && fr->command == fridgethr_comm_run &&
+		    fridgethr_futex_wait(&ring->futex, seq,
+					 fr->p.thread_delay > 0
+					 ? &timeout : NULL) != 0 &&
+		    errno == ETIMEDOUT)
+			*timed_out = true;
+		(void) atomic_dec_uint32_t(&ring->sleepers);
+
+		if (*timed_out)
+			break;
+	}
+	(void) atomic_dec_uint32_t(&ring->waiters);
+
+	/* A submitter that saw us waiting left its job to us */
+	if (!got)
+		got = fridgethr_ring_pop(ring, fe);
+
+	return got;
+}
+#else
+static inline void fridgethr_ring_wake_all(struct fridgethr *fr)
+{
+}
+#endif
+
 /**
  * @brief Get deferred work
  *
@@ -312,6 +516,11 @@ static bool fridgethr_deferredwork(struct fridgethr *fr)
 
 static bool fridgethr_getwork(struct fridgethr *fr, struct fridgethr_entry *fe)
 {
+#ifdef LINUX
+	if (fr->ring != NULL && fridgethr_ring_pop(fr->ring, fe))
+		return true;
+#endif
+
 	if ((fr->p.deferment == fridgethr_defer_block)
 	    || (fr->p.deferment == fridgethr_defer_fail)
 	    || glist_empty(&fr->deferment.work_q)) {
@@ -355,6 +564,19 @@ static bool fridgethr_freeze(struct fridgethr *fr,
 	/* Return code from system calls */
 	int rc = 0;
 
+#ifdef LINUX
+	if (fr->ring != NULL) {
+		bool timed_out = false;
+
+		if (fridgethr_ring_wait(fr, fe, &timed_out)) {
+			fe->ctx.woke = true;
+			return true;
+		}
+		if (timed_out)
+			rc = ETIMEDOUT;
+	}
+#endif
+
 	PTHREAD_MUTEX_lock(&fr->mtx);
  restart:
 	/* If we are not paused and there is work left to do in the
@@ -367,6 +589,7 @@ static bool fridgethr_freeze(struct fridgethr *fr,
 
 	/* rc would have been set in the while loop below */
 	if (((rc == ETIMEDOUT) && (fr->nthreads > fr->p.thr_min))
+	    || (fr->p.thr_max != 0 && fr->nthreads > fr->p.thr_max)
 	    || (fr->command == fridgethr_comm_stop)) {
 		/* We do this here since we already have the fridge
 		   lock. */
@@ -523,6 +746,10 @@ static void *fridgethr_start_routine(void *arg)
 
 	SetNameFunction(fr->s);
 
+	/* Before the thread allocates anything, so that it does so on
+	   its own node */
+	gsh_numa_bind_next(&fr->numa_next);
+
 	/* Excplicitly and definitely enable cancellation */
 	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_state);
 
@@ -803,6 +1030,62 @@ static int fridgethr_block(struct fridgethr *fr,
 	return rc;
 }
 
+/**
+ * @brief Slightly stupid workaround for an unlikely case
+ *
+ * @param[in] dummy Ignored
+ */
+static void fridgethr_noop(struct fridgethr_context *dummy)
+{
+	/* return */
+}
+
+#ifdef LINUX
+/**
+ * @brief Hand a job to the ring without taking the fridge lock
+ *
+ * The job is left on the ring for a thread already waiting on it.
+ * The fridge lock is only taken when nobody waits, to wake an idle
+ * thread or to spawn one.
+ *
+ * @param[in] fr   The fridge
+ * @param[in] func The thing to do
+ * @param[in] arg  The thing to do it to
+ *
+ * @return false if the job must go the usual way.
+ */
+
+static bool fridgethr_ring_submit(struct fridgethr *fr,
+				  void (*func)(struct fridgethr_context *),
+				  void *arg)
+{
+	struct fridgethr_ring *ring = fr->ring;
+
+	if (fr->command != fridgethr_comm_run ||
+	    !fridgethr_ring_push(ring, func, arg))
+		return false;
+
+	if (atomic_fetch_uint32_t(&ring->sleepers) > 0) {
+		(void) atomic_inc_uint32_t(&ring->futex);
+		fridgethr_futex_wake(&ring->futex, 1);
+	}
+	if (atomic_fetch_uint32_t(&ring->waiters) > 0)
+		return true;
+
+	PTHREAD_MUTEX_lock(&fr->mtx);
+	/* A thread woken with the noop finds the job on the ring */
+	if (fr->command == fridgethr_comm_run &&
+	    (fr->nidle == 0 || !fridgethr_dispatch(fr, fridgethr_noop, NULL))
+	    && ((fr->p.thr_max == 0) || (fr->nthreads < fr->p.thr_max))) {
+		/* Unlocks the fridge */
+		(void) fridgethr_spawn(fr, fridgethr_noop, NULL);
+		return true;
+	}
+	PTHREAD_MUTEX_unlock(&fr->mtx);
+	return true;
+}
+#endif
+
 /**
  * @brief Schedule a thread to perform a function
  *
@@ -833,6 +1116,11 @@ int fridgethr_submit(struct fridgethr *fr,
 		return EPIPE;
 	}
 
+#ifdef LINUX
+	if (fr->ring != NULL && fridgethr_ring_submit(fr, func, arg))
+		return 0;
+#endif
+
 	PTHREAD_MUTEX_lock(&fr->mtx);
 	if (fr->command == fridgethr_comm_stop) {
 		LogMajor(COMPONENT_THREAD,
@@ -988,6 +1276,8 @@ int fridgethr_pause(struct fridgethr *fr, pthread_mutex_t *mtx,
 	if (fr->nthreads == fr->nidle)
 		fridgethr_finish_transition(fr, true);
 
+	fridgethr_ring_wake_all(fr);
+
 	if (fr->p.wake_threads != NULL)
 		fr->p.wake_threads(fr->p.wake_threads_arg);
 
@@ -995,16 +1285,6 @@ int fridgethr_pause(struct fridgethr *fr, pthread_mutex_t *mtx,
 	return 0;
 }
 
-/**
- * @brief Slightly stupid workaround for an unlikely case
- *
- * @param[in] dummy Ignored
- */
-static void fridgethr_noop(struct fridgethr_context *dummy)
-{
-	/* return */
-}
-
 /**
  * @brief Stop execution in the fridge
  *
@@ -1068,6 +1348,8 @@ int fridgethr_stop(struct fridgethr *fr, pthread_mutex_t *mtx,
 		return 0;
 	}
 
+	fridgethr_ring_wake_all(fr);
+
 	/* If we're a blocking fridge, let everyone know it's time to
 	   fail. */
 	if ((fr->p.deferment == fridgethr_defer_block)
@@ -1331,8 +1613,8 @@ int fridgethr_sync_command(struct fridgethr *fr, fridgethr_comm_t command,
 /**
  * @brief Return true if a looper function should return
  *
- * For the moment, this checks if we're in the middle of a state
- * transition.
+ * That is if we're in the middle of a state transition, or if the
+ * fridge runs more threads than fridgethr_set_max() now allows.
  *
  * @param[in] ctx The thread context
  *
@@ -1348,7 +1630,8 @@ bool fridgethr_you_should_break(struct fridgethr_context *ctx)
 	struct fridgethr *fr = fe->fr;
 
 	/* No locking is needed as it is only read */
-	return fr->transitioning;
+	return fr->transitioning ||
+	       (fr->p.thr_max != 0 && fr->nthreads > fr->p.thr_max);
 }
 
 /**
@@ -1448,6 +1731,42 @@ void fridgethr_setwait(struct fridgethr_context *ctx, time_t thread_delay)
 	PTHREAD_MUTEX_unlock(&fr->mtx);
 }
 
+/**
+ * @brief Change the most threads a running fridge may have
+ *
+ * New threads are only started by later submissions.  Threads above a
+ * lowered maximum exit as they come back to the fridge, a looper
+ * function learns it should come back from fridgethr_you_should_break().
+ *
+ * @param[in,out] fr      The fridge
+ * @param[in]     thr_max New maximum, 0 for unbounded
+ */
+
+void fridgethr_set_max(struct fridgethr *fr, uint32_t thr_max)
+{
+	PTHREAD_MUTEX_lock(&fr->mtx);
+	fr->p.thr_max = thr_max;
+	if (thr_max != 0 && fr->p.thr_min > thr_max)
+		fr->p.thr_min = thr_max;
+	PTHREAD_MUTEX_unlock(&fr->mtx);
+}
+
+/**
+ * @brief Get the number of threads of a fridge
+ *
+ * @param[in] fr The fridge
+ */
+
+uint32_t fridgethr_nthreads(struct fridgethr *fr)
+{
+	uint32_t nthreads;
+
+	PTHREAD_MUTEX_lock(&fr->mtx);
+	nthreads = fr->nthreads;
+	PTHREAD_MUTEX_unlock(&fr->mtx);
+	return nthreads;
+}
+
 /**
  * @brief Get the wait time of a running fridge
  *
@@ -1515,6 +1834,7 @@ int general_fridge_init(void)
 	frp.thr_min = 0;
 	frp.flavor = fridgethr_flavor_worker;
 	frp.deferment = fridgethr_defer_queue;
+	frp.ring_size = 1024;
 
 	rc = fridgethr_init(&general_fridge, "Gen_Fridge", &frp);
 	if (rc != 0) {
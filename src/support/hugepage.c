@@ -0,0 +1,244 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file hugepage.c
+ * @brief Regions of memory on 2 MiB pages
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <unistd.h>
+#include "abstract_mem.h"
+#include "gsh_hugepage.h"
+#include "log.h"
+
+/**
+ * @brief Map a region from the hugetlbfs pool
+ *
+ * Fails unless enough huge pages are reserved, vm.nr_hugepages.
+ */
+static void *huge_map_hugetlb(size_t size)
+{
+#ifdef MAP_HUGETLB
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+	void *p;
+
+#ifdef MAP_HUGE_2MB
+	flags |= MAP_HUGE_2MB;
+#endif
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+
+	return p == MAP_FAILED ? NULL : p;
+#else
+	errno = ENOTSUP;
+	return NULL;
+#endif
+}
+
+/**
+ * @brief Map a huge page aligned region for transparent huge pages
+ *
+ * More is mapped than asked for, then trimmed, so the region starts on
+ * a huge page and all of it can be backed by them.
+ */
+static void *huge_map_thp(size_t size)
+{
+#ifdef MADV_HUGEPAGE
+	char *p, *base;
+	size_t head;
+
+	p = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+
+	base = (char *)roundup((uintptr_t) p, HUGE_PAGE_SIZE);
+	head = base - p;
+	if (head != 0)
+		(void) munmap(p, head);
+	(void) munmap(base + size, HUGE_PAGE_SIZE - head);
+
+	/* Fails when the kernel has no transparent huge pages */
+	if (madvise(base, size, MADV_HUGEPAGE) != 0) {
+		int err = errno;
+
+		(void) munmap(base, size);
+		errno = err;
+		return NULL;
+	}
+
+	return base;
+#else
+	errno = ENOTSUP;
+	return NULL;
+#endif
+}
+
+/**
+ * @brief Map a region, as strongly backed as can be
+ *
+ * @param[in] region  Region to set up
+ * @param[in] name    Its name, for logs and stats
+ * @param[in] want    How it should be backed, HUGE_PAGES_NONE for not
+ *		      at all
+ * @param[in] size    Bytes, rounded up to huge pages
+ */
+void huge_region_init(struct huge_region *region, const char *name,
+		      enum huge_pages want, size_t size)
+{
+	PTHREAD_MUTEX_init(&region->mtx, NULL);
+	region->name = name;
+	region->base = NULL;
+	region->size = 0;
+	region->used = 0;
+	region->backing = HUGE_PAGES_NONE;
+
+	size = roundup(size, HUGE_PAGE_SIZE);
+	if (want == HUGE_PAGES_NONE || size == 0)
+		return;
+
+	if (want == HUGE_PAGES_HUGETLB) {
+		region->base = huge_map_hugetlb(size);
+		if (region->base != NULL) {
+			region->backing = HUGE_PAGES_HUGETLB;
+		} else {
+			LogWarn(COMPONENT_INIT,
+				"Could not map %zu bytes of hugetlbfs pages for %s: %s, trying transparent huge pages",
+				size, name, strerror(errno));
+		}
+	}
+
+	if (region->base == NULL) {
+		region->base = huge_map_thp(size);
+		if (region->base != NULL) {
+			region->backing = HUGE_PAGES_THP;
+		} else {
+			LogWarn(COMPONENT_INIT,
+				"Could not map %zu bytes of transparent huge pages for %s: %s, using normal pages",
+				size, name, strerror(errno));
+			return;
+		}
+	}
+
+	region->size = size;
+
+	LogInfo(COMPONENT_INIT, "%s has %zu bytes of %s pages",
+		name, size, huge_pages_str(region->backing));
+}
+
+/**
+ * @brief Carve a piece of a region
+ *
+ * @param[in] region  Region
+ * @param[in] size    Bytes, rounded up to the page size
+ *
+ * @return The piece, page aligned, or NULL once the region is used up.
+ */
+void *huge_region_carve(struct huge_region *region, size_t size)
+{
+	void *p = NULL;
+
+	if (region->size == 0)
+		return NULL;
+
+	size = roundup(size, sysconf(_SC_PAGESIZE));
+
+	PTHREAD_MUTEX_lock(&region->mtx);
+
+	if (region->size - region->used >= size) {
+		p = region->base + region->used;
+		region->used += size;
+	}
+
+	PTHREAD_MUTEX_unlock(&region->mtx);
+
+	return p;
+}
+
+/**
+ * @brief Bytes of a region actually on huge pages
+ *
+ * Transparent huge pages are only given as the region is touched, and
+ * may be split later, so /proc/self/smaps is asked.  Reserved
+ * hugetlbfs pages always back the whole region.
+ *
+ * @param[in] region  Region
+ *
+ * @return Bytes on huge pages.
+ */
+uint64_t huge_region_backed(struct huge_region *region)
+{
+	char line[256], start[32];
+	uint64_t kbytes, backed = 0;
+	bool ours = false;
+	FILE *smaps;
+	int len;
+
+	if (region->backing != HUGE_PAGES_THP)
+		return region->size;
+
+	smaps = fopen("/proc/self/smaps", "r");
+	if (smaps == NULL)
+		return 0;
+
+	len = snprintf(start, sizeof(start), "%" PRIxPTR "-",
+		       (uintptr_t) region->base);
+
+	while (fgets(line, sizeof(line), smaps) != NULL) {
+		if (strncmp(line, start, len) == 0) {
+			ours = true;
+		} else if (ours &&
+			   sscanf(line, "AnonHugePages: %" SCNu64 " kB",
+				  &kbytes) == 1) {
+			backed = kbytes * 1024;
+			break;
+		}
+	}
+
+	fclose(smaps);
+
+	return backed;
+}
+
+/**
+ * @brief Name of a backing, for logs and stats
+ */
+const char *huge_pages_str(enum huge_pages backing)
+{
+	switch (backing) {
+	case HUGE_PAGES_NONE:
+		return "normal";
+	case HUGE_PAGES_THP:
+		return "transparent huge";
+	case HUGE_PAGES_HUGETLB:
+		return "hugetlbfs";
+	}
+
+	return "unknown";
+}
@@ -0,0 +1,373 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file iobuf.c
+ * @brief Recycled I/O data buffers
+ *
+ * Every buffer carries a small header in the page just in front of
+ * the data, so iobuf_free() can find its size class without any
+ * lookup.  That costs one page per buffer, which is noise for the
+ * large reads this is meant for.
+ *
+ * The global free lists are kept per NUMA node.  A buffer goes back
+ * to the list of the node it was allocated on, and is only reused
+ * from there, so its pages stay local to the threads using it.
+ */
+
+#include "config.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "gsh_intrinsic.h"
+#include "common_utils.h"
+#include "gsh_config.h"
+#include "gsh_iobuf.h"
+#include "gsh_numa.h"
+#include "gsh_hugepage.h"
+#include "log.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#include "server_stats_private.h"
+#endif
+
+#define IOBUF_MAGIC 0x10b0f0e5
+
+/** Class of buffers too big to be recycled */
+#define IOBUF_NO_CLASS UINT32_MAX
+
+/**
+ * @brief Header found just in front of the data
+ */
+struct iobuf_hdr {
+	struct iobuf_hdr *next;	/*< Free list link */
+	uint32_t magic;
+	uint32_t cls;		/*< Size class, or IOBUF_NO_CLASS */
+	uint32_t node;		/*< NUMA node it was allocated on */
+	bool huge;		/*< Carved from iobuf_huge, never released */
+	size_t size;		/*< Usable size */
+};
+
+/**
+ * @brief Global free list for one size class on one node
+ */
+struct iobuf_class {
+	pthread_mutex_t mtx;
+	struct iobuf_hdr *free;
+	uint32_t count;
+	GSH_CACHE_PAD(0);
+};
+
+/**
+ * @brief Per-thread cache for one size class
+ */
+struct iobuf_tcache {
+	struct iobuf_hdr *buf[IOBUF_TCACHE_DEPTH];
+	uint32_t count;
+};
+
+static struct iobuf_class (*iobuf_classes)[IOBUF_NCLASSES];
+static struct iobuf_stats iobuf_st;
+static struct huge_region iobuf_huge;
+static pthread_key_t iobuf_tcache_key;
+
+static __thread struct iobuf_tcache iobuf_tcache[IOBUF_NCLASSES];
+static __thread bool iobuf_tcache_registered;
+
+static inline void *iobuf_data(struct iobuf_hdr *hdr)
+{
+	return (char *)hdr + sizeof(*hdr);
+}
+
+static inline struct iobuf_hdr *iobuf_hdr(void *buf)
+{
+	return (struct iobuf_hdr *)((char *)buf - sizeof(struct iobuf_hdr));
+}
+
+static inline size_t iobuf_class_size(uint32_t cls)
+{
+	return (size_t) 1 << (cls + IOBUF_MIN_SHIFT);
+}
+
+static inline uint32_t iobuf_size_class(size_t size)
+{
+	uint32_t cls = 0;
+
+	while (cls < IOBUF_NCLASSES && iobuf_class_size(cls) < size)
+		cls++;
+
+	return cls < IOBUF_NCLASSES ? cls : IOBUF_NO_CLASS;
+}
+
+/**
+ * @brief Release a buffer back to the system
+ */
+static void iobuf_release(struct iobuf_hdr *hdr)
+{
+	hdr->magic = 0;
+	mem_acct_charge(MEM_TAG_BUFFER, -(int64_t)(IOBUF_ALIGN + hdr->size),
+			-1);
+	gsh_free((char *)iobuf_data(hdr) - IOBUF_ALIGN);
+}
+
+/**
+ * @brief Push a buffer on the global list of its class
+ */
+static void iobuf_push_global(struct iobuf_hdr *hdr)
+{
+	struct iobuf_class *c = &iobuf_classes[hdr->node][hdr->cls];
+
+	PTHREAD_MUTEX_lock(&c->mtx);
+	hdr->next = c->free;
+	c->free = hdr;
+	c->count++;
+	PTHREAD_MUTEX_unlock(&c->mtx);
+}
+
+/**
+ * @brief Flush a thread's cache to the global lists on thread exit
+ */
+static void iobuf_tcache_destroy(void *arg)
+{
+	struct iobuf_tcache *tc = arg;
+	uint32_t cls;
+
+	for (cls = 0; cls < IOBUF_NCLASSES; cls++) {
+		while (tc[cls].count > 0)
+			iobuf_push_global(tc[cls].buf[--tc[cls].count]);
+	}
+}
+
+/**
+ * @brief Initialize the I/O buffer pool
+ */
+void iobuf_pkginit(void)
+{
+	uint32_t nnodes = gsh_numa_nodes();
+	uint32_t cls, node;
+
+	iobuf_classes = gsh_calloc(nnodes, sizeof(*iobuf_classes));
+	for (node = 0; node < nnodes; node++) {
+		for (cls = 0; cls < IOBUF_NCLASSES; cls++)
+			PTHREAD_MUTEX_init(&iobuf_classes[node][cls].mtx,
+					   NULL);
+	}
+
+	if (pthread_key_create(&iobuf_tcache_key, iobuf_tcache_destroy) != 0)
+		LogFatal(COMPONENT_INIT,
+			 "Could not create I/O buffer thread cache key");
+
+	huge_region_init(&iobuf_huge, "I/O buffer pool",
+			 nfs_param.core_param.iobuf_huge_pages,
+			 nfs_param.core_param.iobuf_huge_size);
+
+	LogInfo(COMPONENT_INIT,
+		"I/O buffer pool keeps up to %" PRIu64 " idle bytes",
+		nfs_param.core_param.iobuf_pool_size);
+}
+
+/**
+ * @brief Get a page aligned buffer of at least @a size bytes
+ *
+ * @param[in] size Bytes needed
+ *
+ * @return The buffer.  Never fails, like gsh_malloc().
+ */
+void *iobuf_alloc(size_t size)
+{
+	uint32_t cls = iobuf_size_class(size);
+	uint32_t node = gsh_numa_local_node();
+	struct iobuf_hdr *hdr = NULL;
+	size_t bufsize;
+	char *p = NULL;
+	bool huge;
+
+	(void) atomic_inc_uint64_t(&iobuf_st.allocs);
+
+	if (cls != IOBUF_NO_CLASS) {
+		struct iobuf_tcache *tc = &iobuf_tcache[cls];
+		struct iobuf_class *c = &iobuf_classes[node][cls];
+
+		bufsize = iobuf_class_size(cls);
+
+		if (tc->count > 0) {
+			hdr = tc->buf[--tc->count];
+		} else if (atomic_fetch_uint32_t(&c->count) > 0) {
+			PTHREAD_MUTEX_lock(&c->mtx);
+			hdr = c->free;
+			if (hdr != NULL) {
+				c->free = hdr->next;
+				c->count--;
+			}
+			PTHREAD_MUTEX_unlock(&c->mtx);
+		}
+
+		if (hdr != NULL) {
+			(void) atomic_inc_uint64_t(&iobuf_st.reused);
+			if (!hdr->huge)
+				(void) atomic_sub_uint64_t(
+						&iobuf_st.idle_bytes, bufsize);
+			return iobuf_data(hdr);
+		}
+
+		/* Recycled for good, so from the huge pages if any are
+		 * left
+		 */
+		p = huge_region_carve(&iobuf_huge, IOBUF_ALIGN + bufsize);
+	} else {
+		bufsize = size;
+	}
+
+	huge = p != NULL;
+	if (!huge)
+		p = gsh_malloc_aligned(IOBUF_ALIGN, IOBUF_ALIGN + bufsize);
+
+	/* The header lives at the end of the leading page, so the data
+	 * stays aligned.
+	 */
+	hdr = (struct iobuf_hdr *)(p + IOBUF_ALIGN - sizeof(*hdr));
+	hdr->next = NULL;
+	hdr->magic = IOBUF_MAGIC;
+	hdr->cls = cls;
+	hdr->node = node;
+	hdr->huge = huge;
+	hdr->size = bufsize;
+	mem_acct_charge(MEM_TAG_BUFFER, IOBUF_ALIGN + bufsize, 1);
+
+	return iobuf_data(hdr);
+}
+
+/**
+ * @brief Return a buffer obtained from iobuf_alloc()
+ *
+ * @param[in] buf Buffer, may be NULL
+ */
+void iobuf_free(void *buf)
+{
+	struct iobuf_hdr *hdr;
+	struct iobuf_tcache *tc;
+
+	if (buf == NULL)
+		return;
+
+	hdr = iobuf_hdr(buf);
+	assert(hdr->magic == IOBUF_MAGIC);
+
+	if (hdr->cls == IOBUF_NO_CLASS) {
+		iobuf_release(hdr);
+		return;
+	}
+
+	/* Stay under the idle memory ceiling, huge page buffers can't be
+	 * released and don't count.
+	 */
+	if (!hdr->huge &&
+	    atomic_add_uint64_t(&iobuf_st.idle_bytes, hdr->size) >
+	    nfs_param.core_param.iobuf_pool_size) {
+		(void) atomic_sub_uint64_t(&iobuf_st.idle_bytes, hdr->size);
+		iobuf_release(hdr);
+		return;
+	}
+
+	/* Buffers of other nodes go straight home */
+	tc = &iobuf_tcache[hdr->cls];
+	if (tc->count < IOBUF_TCACHE_DEPTH &&
+	    hdr->node == gsh_numa_local_node()) {
+		if (unlikely(!iobuf_tcache_registered)) {
+			(void) pthread_setspecific(iobuf_tcache_key,
+						   iobuf_tcache);
+			iobuf_tcache_registered = true;
+		}
+		tc->buf[tc->count++] = hdr;
+		return;
+	}
+
+	iobuf_push_global(hdr);
+}
+
+/**
+ * @brief Snapshot the pool counters
+ *
+ * @param[out] stats Counters
+ */
+void iobuf_get_stats(struct iobuf_stats *stats)
+{
+	stats->allocs = atomic_fetch_uint64_t(&iobuf_st.allocs);
+	stats->reused = atomic_fetch_uint64_t(&iobuf_st.reused);
+	stats->idle_bytes = atomic_fetch_uint64_t(&iobuf_st.idle_bytes);
+	stats->huge_size = iobuf_huge.size;
+	PTHREAD_MUTEX_lock(&iobuf_huge.mtx);
+	stats->huge_used = iobuf_huge.used;
+	PTHREAD_MUTEX_unlock(&iobuf_huge.mtx);
+	stats->huge_backed = huge_region_backed(&iobuf_huge);
+	stats->huge_pages = huge_pages_str(iobuf_huge.backing);
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report the I/O buffer pool and its huge pages
+ *
+ * struct iobufs {
+ *	char *huge_pages;	(how the huge page region is backed)
+ *	uint64_t allocs;
+ *	uint64_t reused;
+ *	uint64_t idle_bytes;
+ *	uint64_t huge_size;
+ *	uint64_t huge_used;	(carved into buffers)
+ *	uint64_t huge_backed;	(actually on huge pages)
+ * }
+ *
+ * @param iter   [IN] iterator in reply stream to fill
+ */
+void iobuf_dbus_stats(DBusMessageIter *iter)
+{
+	DBusMessageIter struct_iter;
+	struct iobuf_stats stats;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	iobuf_get_stats(&stats);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+				       &stats.huge_pages);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.allocs);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.reused);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.idle_bytes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.huge_size);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.huge_used);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.huge_backed);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+#endif				/* USE_DBUS */
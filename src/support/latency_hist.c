@@ -0,0 +1,172 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file latency_hist.c
+ * @brief Log-linear latency histograms
+ */
+
+#include "config.h"
+#include <string.h>
+#include "abstract_mem.h"
+#include "latency_hist.h"
+
+/** Shard used by this thread, -1 until the first record */
+__thread int lat_hist_shard_ix = -1;
+
+static uint32_t lat_hist_next_shard;
+
+/**
+ * @brief Give the calling thread its shard
+ *
+ * Threads are dealt out round robin, which spreads a fixed pool of
+ * workers evenly without asking which CPU we are on for every
+ * record.
+ *
+ * @return The shard index
+ */
+int lat_hist_pick_shard(void)
+{
+	lat_hist_shard_ix = atomic_inc_uint32_t(&lat_hist_next_shard) %
+			    LAT_HIST_SHARDS;
+	return lat_hist_shard_ix;
+}
+
+/**
+ * @brief Get a histogram, allocating it on first use
+ *
+ * @param[in,out] histp Where the histogram hangs
+ *
+ * @return The histogram
+ */
+struct lat_hist *lat_hist_get(struct lat_hist **histp)
+{
+	struct lat_hist *hist = atomic_fetch_voidptr((void **)histp);
+
+	if (likely(hist != NULL))
+		return hist;
+
+	hist = gsh_calloc(1, sizeof(*hist));
+	if (!__sync_bool_compare_and_swap(histp, NULL, hist)) {
+		/* Somebody beat us to it */
+		gsh_free(hist);
+		hist = atomic_fetch_voidptr((void **)histp);
+	}
+
+	return hist;
+}
+
+/**
+ * @brief Smallest latency that lands in a bucket
+ *
+ * @param[in] ix  Bucket index
+ *
+ * @return Latency in nanoseconds
+ */
+uint64_t lat_hist_bucket_low(uint32_t ix)
+{
+	uint32_t group = ix / LAT_HIST_SUB;
+
+	if (group == 0)
+		return ix;
+
+	return (uint64_t) (LAT_HIST_SUB + ix % LAT_HIST_SUB) << (group - 1);
+}
+
+/**
+ * @brief Add up the shards of a histogram
+ *
+ * @param[in]  hist    Histogram, may be NULL
+ * @param[out] buckets LAT_HIST_BUCKETS counters
+ *
+ * @return Number of latencies recorded
+ */
+uint64_t lat_hist_merge(struct lat_hist *hist, uint64_t *buckets)
+{
+	uint64_t total = 0;
+	uint32_t ix, shard;
+
+	memset(buckets, 0, LAT_HIST_BUCKETS * sizeof(*buckets));
+
+	if (hist == NULL)
+		return 0;
+
+	for (shard = 0; shard < LAT_HIST_SHARDS; shard++) {
+		for (ix = 0; ix < LAT_HIST_BUCKETS; ix++)
+			buckets[ix] += atomic_fetch_uint64_t(
+					&hist->shard[shard].bucket[ix]);
+	}
+
+	for (ix = 0; ix < LAT_HIST_BUCKETS; ix++)
+		total += buckets[ix];
+
+	return total;
+}
+
+/**
+ * @brief Estimate a quantile from merged buckets
+ *
+ * @param[in] buckets  Merged counters
+ * @param[in] total    Sum of the counters
+ * @param[in] permille Quantile, in thousandths
+ *
+ * @return Lower bound of the bucket holding the quantile, in ns
+ */
+uint64_t lat_hist_quantile(const uint64_t *buckets, uint64_t total,
+			   uint32_t permille)
+{
+	uint64_t want = (total * permille + 999) / 1000;
+	uint64_t seen = 0;
+	uint32_t ix;
+
+	if (total == 0)
+		return 0;
+
+	for (ix = 0; ix < LAT_HIST_BUCKETS; ix++) {
+		seen += buckets[ix];
+		if (seen >= want)
+			break;
+	}
+
+	return lat_hist_bucket_low(ix < LAT_HIST_BUCKETS ?
+				   ix : LAT_HIST_BUCKETS - 1);
+}
+
+/**
+ * @brief Zero a histogram
+ *
+ * @param[in] hist  Histogram, may be NULL
+ */
+void lat_hist_reset(struct lat_hist *hist)
+{
+	uint32_t ix, shard;
+
+	if (hist == NULL)
+		return;
+
+	for (shard = 0; shard < LAT_HIST_SHARDS; shard++) {
+		for (ix = 0; ix < LAT_HIST_BUCKETS; ix++)
+			atomic_store_uint64_t(&hist->shard[shard].bucket[ix],
+					      0);
+	}
+}
@@ -0,0 +1,338 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file lock_prof.c
+ * @brief Lock contention profiler
+ *
+ * Nothing here may take a lock through the PTHREAD_* macros, sites
+ * are linked into lock_prof_sites without a lock.
+ */
+
+#include "config.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "abstract_atomic.h"
+#include "abstract_mem.h"
+#include "common_utils.h"
+#include "lock_prof.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+bool lock_prof_enabled;
+
+/** Acquisitions left until this thread samples a hold time */
+__thread uint32_t lock_prof_countdown = LOCK_PROF_SAMPLE;
+
+/** Sampled locks this thread holds, innermost last */
+__thread uint32_t lock_prof_nheld;
+
+static __thread struct {
+	void *lock;
+	struct lock_prof_site *site;
+	uint64_t start;
+} lock_prof_held[LOCK_PROF_HELD];
+
+/** Every site that was ever touched, newest first */
+static struct lock_prof_site *lock_prof_sites;
+
+static inline uint64_t lock_prof_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+static inline uint32_t lock_prof_bucket(uint64_t ns)
+{
+	uint32_t msb;
+
+	if (ns < 2)
+		return 0;
+
+	msb = 63 - __builtin_clzll(ns);
+	return msb < LOCK_PROF_BUCKETS ? msb : LOCK_PROF_BUCKETS - 1;
+}
+
+static void lock_prof_max(uint64_t *max, uint64_t ns)
+{
+	uint64_t cur = atomic_fetch_uint64_t(max);
+
+	while (ns > cur) {
+		uint64_t old = __sync_val_compare_and_swap(max, cur, ns);
+
+		if (old == cur)
+			break;
+		cur = old;
+	}
+}
+
+/**
+ * @brief Link a site into lock_prof_sites on first use
+ */
+static void lock_prof_register(struct lock_prof_site *site)
+{
+	struct lock_prof_site *head;
+
+	if (likely(atomic_fetch_uint32_t(&site->registered) != 0) ||
+	    !__sync_bool_compare_and_swap(&site->registered, 0, 1))
+		return;
+
+	do {
+		head = atomic_fetch_voidptr((void **)&lock_prof_sites);
+		site->next = head;
+	} while (!__sync_bool_compare_and_swap(&lock_prof_sites, head, site));
+}
+
+/**
+ * @brief Slow path of lock_prof_lock
+ *
+ * Waits for the lock if trying it failed, then samples the hold time
+ * if this thread's countdown ran out.
+ *
+ * @param[in] lock  pthread_mutex_t or pthread_rwlock_t
+ * @param[in] site  Call site
+ * @param[in] rc    What trying the lock returned
+ *
+ * @return What the pthread call returned.
+ */
+int lock_prof_acquire(void *lock, struct lock_prof_site *site, int rc)
+{
+	uint64_t start, end = 0;
+
+	if (rc != 0) {
+		start = lock_prof_now();
+		switch (site->kind) {
+		case LOCK_PROF_MUTEX:
+			rc = pthread_mutex_lock(lock);
+			break;
+		case LOCK_PROF_RDLOCK:
+			rc = pthread_rwlock_rdlock(lock);
+			break;
+		default:
+			rc = pthread_rwlock_wrlock(lock);
+			break;
+		}
+		if (rc != 0)
+			return rc;
+
+		end = lock_prof_now();
+		lock_prof_register(site);
+		(void)atomic_inc_uint64_t(&site->contended);
+		(void)atomic_add_uint64_t(&site->wait_ns, end - start);
+		(void)atomic_inc_uint64_t(
+			&site->wait_hist[lock_prof_bucket(end - start)]);
+		lock_prof_max(&site->max_wait_ns, end - start);
+
+		if (--lock_prof_countdown != 0)
+			return 0;
+	}
+
+	lock_prof_countdown = LOCK_PROF_SAMPLE;
+	if (lock_prof_nheld == LOCK_PROF_HELD)
+		return 0;
+
+	lock_prof_register(site);
+	lock_prof_held[lock_prof_nheld].lock = lock;
+	lock_prof_held[lock_prof_nheld].site = site;
+	lock_prof_held[lock_prof_nheld].start = end != 0 ? end
+							 : lock_prof_now();
+	lock_prof_nheld++;
+	return 0;
+}
+
+/**
+ * @brief Time the hold of a sampled lock being released
+ *
+ * A lock this thread does not hold sampled, because it was taken
+ * before profiling was enabled or by another thread, is ignored.
+ *
+ * @param[in] lock  Lock about to be unlocked
+ */
+void lock_prof_release_held(void *lock)
+{
+	struct lock_prof_site *site;
+	uint64_t hold;
+	int i;
+
+	for (i = lock_prof_nheld - 1; i >= 0; i--)
+		if (lock_prof_held[i].lock == lock)
+			break;
+	if (i < 0)
+		return;
+
+	site = lock_prof_held[i].site;
+	hold = lock_prof_now() - lock_prof_held[i].start;
+	lock_prof_nheld--;
+	memmove(&lock_prof_held[i], &lock_prof_held[i + 1],
+		(lock_prof_nheld - i) * sizeof(lock_prof_held[0]));
+
+	(void)atomic_inc_uint64_t(&site->sampled);
+	(void)atomic_add_uint64_t(&site->hold_ns, hold);
+	(void)atomic_inc_uint64_t(&site->hold_hist[lock_prof_bucket(hold)]);
+	lock_prof_max(&site->max_hold_ns, hold);
+}
+
+/**
+ * @brief Zero the counts of every site
+ *
+ * Like the other statistics, counts racing with a reset may survive
+ * it.
+ */
+void lock_prof_reset(void)
+{
+	struct lock_prof_site *site;
+
+	for (site = atomic_fetch_voidptr((void **)&lock_prof_sites);
+	     site != NULL; site = site->next)
+		memset(&site->contended, 0,
+		       sizeof(*site) -
+		       offsetof(struct lock_prof_site, contended));
+}
+
+#ifdef USE_DBUS
+
+static const char * const lock_prof_kinds[] = {
+	[LOCK_PROF_MUTEX] = "mutex",
+	[LOCK_PROF_RDLOCK] = "rdlock",
+	[LOCK_PROF_WRLOCK] = "wrlock",
+};
+
+static int lock_prof_cmp(const void *a, const void *b)
+{
+	uint64_t wa = (*(struct lock_prof_site * const *)a)->wait_ns;
+	uint64_t wb = (*(struct lock_prof_site * const *)b)->wait_ns;
+
+	return wa < wb ? 1 : wa > wb ? -1 : 0;
+}
+
+static void lock_prof_append_hist(DBusMessageIter *iter,
+				  const uint64_t *hist)
+{
+	DBusMessageIter array_iter, bucket_iter;
+	uint64_t low, count;
+	int i;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(tt)",
+					 &array_iter);
+	for (i = 0; i < LOCK_PROF_BUCKETS; i++) {
+		count = atomic_fetch_uint64_t((uint64_t *)&hist[i]);
+		if (count == 0)
+			continue;
+		low = i == 0 ? 0 : 1ULL << i;
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &bucket_iter);
+		dbus_message_iter_append_basic(&bucket_iter, DBUS_TYPE_UINT64,
+					       &low);
+		dbus_message_iter_append_basic(&bucket_iter, DBUS_TYPE_UINT64,
+					       &count);
+		dbus_message_iter_close_container(&array_iter, &bucket_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+
+/**
+ * @brief Report the sites that waited the most
+ *
+ * A timestamp, LOCK_PROF_SAMPLE, then for each site by decreasing
+ * wait time: file, lock expression, kind, line, waits, ns waited,
+ * longest wait, sampled holds, ns held by them, longest sampled hold
+ * and the wait and hold histograms as (low bound in ns, count) of
+ * their non empty buckets.
+ *
+ * @param iter   [IN] iterator in reply stream to fill
+ * @param count  [IN] most sites to report, 0 for all of them
+ */
+void lock_prof_dbus_append(DBusMessageIter *iter, uint32_t count)
+{
+	struct lock_prof_site *site, **sites = NULL;
+	DBusMessageIter array_iter, site_iter;
+	struct timespec timestamp;
+	uint32_t nsites = 0, sample = LOCK_PROF_SAMPLE, i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_UINT32, &sample);
+
+	for (site = atomic_fetch_voidptr((void **)&lock_prof_sites);
+	     site != NULL; site = site->next)
+		nsites++;
+	if (nsites != 0)
+		sites = gsh_malloc(nsites * sizeof(*sites));
+
+	/* Sites pushed since are left for the next report */
+	i = 0;
+	for (site = atomic_fetch_voidptr((void **)&lock_prof_sites);
+	     site != NULL && i < nsites; site = site->next)
+		sites[i++] = site;
+	qsort(sites, nsites, sizeof(*sites), lock_prof_cmp);
+	if (count == 0 || count > nsites)
+		count = nsites;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 "(sssutttttta(tt)a(tt))",
+					 &array_iter);
+	for (i = 0; i < count; i++) {
+		uint64_t val;
+
+		site = sites[i];
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &site_iter);
+		dbus_message_iter_append_basic(&site_iter, DBUS_TYPE_STRING,
+					       &site->file);
+		dbus_message_iter_append_basic(&site_iter, DBUS_TYPE_STRING,
+					       &site->name);
+		dbus_message_iter_append_basic(&site_iter, DBUS_TYPE_STRING,
+					       &lock_prof_kinds[site->kind]);
+		dbus_message_iter_append_basic(&site_iter, DBUS_TYPE_UINT32,
+					       &site->line);
+		val = atomic_fetch_uint64_t(&site->contended);
+		dbus_message_iter_append_basic(&site_iter, DBUS_TYPE_UINT64,
+					       &val);
+		val = atomic_fetch_uint64_t(&site->wait_ns);
+		dbus_message_iter_append_basic(&site_iter, DBUS_TYPE_UINT64,
+					       &val);
+		val = atomic_fetch_uint64_t(&site->max_wait_ns);
+		dbus_message_iter_append_basic(&site_iter, DBUS_TYPE_UINT64,
+					       &val);
+		val = atomic_fetch_uint64_t(&site->sampled);
+		dbus_message_iter_append_basic(&site_iter, DBUS_TYPE_UINT64,
+					       &val);
+		val = atomic_fetch_uint64_t(&site->hold_ns);
+		dbus_message_iter_append_basic(&site_iter, DBUS_TYPE_UINT64,
+					       &val);
+		val = atomic_fetch_uint64_t(&site->max_hold_ns);
+		dbus_message_iter_append_basic(&site_iter, DBUS_TYPE_UINT64,
+					       &val);
+		lock_prof_append_hist(&site_iter, site->wait_hist);
+		lock_prof_append_hist(&site_iter, site->hold_hist);
+		dbus_message_iter_close_container(&array_iter, &site_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+	gsh_free(sites);
+}
+#endif				/* USE_DBUS */
@@ -0,0 +1,187 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file mem_acct.c
+ * @brief Memory accounting per subsystem
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include "abstract_atomic.h"
+#include "abstract_mem.h"
+#include "common_utils.h"
+#include "mem_acct.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+/** Flushed charges of every thread */
+static struct {
+	int64_t bytes;
+	int64_t objects;
+} __attribute__((__aligned__(GSH_CACHE_LINE_SIZE)))
+	mem_acct_totals[MEM_TAGS];
+
+#ifdef ENABLE_MEM_ACCOUNTING
+
+__thread struct mem_acct_delta mem_acct_deltas[MEM_TAGS];
+__thread bool mem_acct_registered;
+
+static pthread_once_t mem_acct_once = PTHREAD_ONCE_INIT;
+static pthread_key_t mem_acct_key;
+
+static void mem_acct_flush_one(enum mem_tag tag)
+{
+	struct mem_acct_delta *delta = &mem_acct_deltas[tag];
+
+	(void)atomic_add_int64_t(&mem_acct_totals[tag].bytes, delta->bytes);
+	(void)atomic_add_int64_t(&mem_acct_totals[tag].objects,
+				 delta->objects);
+	delta->bytes = 0;
+	delta->objects = 0;
+}
+
+/**
+ * @brief Flush the deltas of an exiting thread
+ */
+static void mem_acct_thread_exit(void *arg)
+{
+	int tag;
+
+	for (tag = 0; tag < MEM_TAGS; tag++)
+		mem_acct_flush_one(tag);
+}
+
+static void mem_acct_pkginit(void)
+{
+	(void)pthread_key_create(&mem_acct_key, mem_acct_thread_exit);
+}
+
+/**
+ * @brief Add a thread's delta to the totals
+ *
+ * The first flush of a thread also arranges for the rest to be
+ * flushed when it exits.
+ *
+ * @param[in] tag  Subsystem whose delta to flush
+ */
+void mem_acct_flush(enum mem_tag tag)
+{
+	if (!mem_acct_registered) {
+		(void)pthread_once(&mem_acct_once, mem_acct_pkginit);
+		(void)pthread_setspecific(mem_acct_key, &mem_acct_registered);
+		mem_acct_registered = true;
+	}
+
+	mem_acct_flush_one(tag);
+}
+
+#endif				/* ENABLE_MEM_ACCOUNTING */
+
+/**
+ * @brief Bytes charged to a subsystem
+ *
+ * @param[in] tag  Subsystem
+ *
+ * @return The bytes, 0 when built without ENABLE_MEM_ACCOUNTING
+ */
+uint64_t mem_acct_bytes(enum mem_tag tag)
+{
+	int64_t bytes = atomic_fetch_int64_t(&mem_acct_totals[tag].bytes);
+
+	/* Unflushed frees can make it look negative for a while */
+	return bytes > 0 ? bytes : 0;
+}
+
+/**
+ * @brief Bytes charged to every subsystem but one
+ *
+ * @param[in] tag  Subsystem left out
+ *
+ * @return The bytes
+ */
+uint64_t mem_acct_bytes_except(enum mem_tag tag)
+{
+	uint64_t bytes = 0;
+	int i;
+
+	for (i = 0; i < MEM_TAGS; i++)
+		if (i != tag)
+			bytes += mem_acct_bytes(i);
+
+	return bytes;
+}
+
+#ifdef USE_DBUS
+
+static const char * const mem_acct_names[MEM_TAGS] = {
+	[MEM_TAG_MDCACHE] = "mdcache",
+	[MEM_TAG_STATE] = "state",
+	[MEM_TAG_DRC] = "drc",
+	[MEM_TAG_SESSION] = "session",
+	[MEM_TAG_REQUEST] = "request",
+	[MEM_TAG_BUFFER] = "buffer",
+};
+
+/**
+ * @brief Report the memory of each subsystem
+ *
+ * A timestamp, MEM_ACCT_FLUSH, then for each subsystem its name,
+ * bytes and objects.
+ *
+ * @param iter   [IN] iterator in reply stream to fill
+ */
+void mem_acct_dbus_append(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter, tag_iter;
+	struct timespec timestamp;
+	uint32_t flush = MEM_ACCT_FLUSH;
+	int64_t objects;
+	uint64_t bytes;
+	int tag;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_UINT32, &flush);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(stt)",
+					 &array_iter);
+	for (tag = 0; tag < MEM_TAGS; tag++) {
+		bytes = mem_acct_bytes(tag);
+		objects = atomic_fetch_int64_t(&mem_acct_totals[tag].objects);
+		if (objects < 0)
+			objects = 0;
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &tag_iter);
+		dbus_message_iter_append_basic(&tag_iter, DBUS_TYPE_STRING,
+					       &mem_acct_names[tag]);
+		dbus_message_iter_append_basic(&tag_iter, DBUS_TYPE_UINT64,
+					       &bytes);
+		dbus_message_iter_append_basic(&tag_iter, DBUS_TYPE_UINT64,
+					       &objects);
+		dbus_message_iter_close_container(&array_iter, &tag_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+#endif				/* USE_DBUS */
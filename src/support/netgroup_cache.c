@@ -29,6 +29,8 @@
 #include "abstract_atomic.h"
 #include "netdb.h"
 #include "abstract_mem.h"
+#include "fridgethr.h"
+#include "nfs_ip_stats.h"
 #include "netgroup_cache.h"
 
 /* Netgroup cache information */
@@ -72,6 +74,26 @@ pthread_rwlock_t ng_lock = PTHREAD_RWLOCK_INITIALIZER;
 static struct avltree pos_ng_tree;
 static struct avltree neg_ng_tree;
 
+/* Most innetgr calls run at once */
+#define NG_RESOLVE_THREADS 4
+
+/* An innetgr call in flight, threads checking the same host and group
+ * wait on it and give up after the NFS_IP_Name Resolve_Timeout.
+ */
+struct ng_pending {
+	struct glist_head ng_list;
+	pthread_cond_t ng_cv;
+	bool ng_done;
+	bool ng_result;
+	int ng_refcount;	/* resolver and waiters */
+	char *ng_group;
+	char *ng_host;
+};
+
+static pthread_mutex_t ng_pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static GLIST_HEAD(ng_pending_list);
+static struct fridgethr *ng_fridge;
+
 static inline int buffdesc_comparator(const struct gsh_buffdesc *buff1,
 				      const struct gsh_buffdesc *buff2)
 {
@@ -120,9 +142,24 @@ static bool ng_expired(struct avltree_node *node)
  */
 void ng_cache_init(void)
 {
+	struct fridgethr_params frp;
+	int rc;
+
 	avltree_init(&pos_ng_tree, ng_comparator, 0);
 	avltree_init(&neg_ng_tree, ng_comparator, 0);
 	memset(ng_cache, 0, NG_CACHE_SIZE * sizeof(struct avltree_node *));
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = NG_RESOLVE_THREADS;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&ng_fridge, "netgroup", &frp);
+	if (rc != 0) {
+		/* Netgroups will be looked up inline */
+		LogWarn(COMPONENT_IDMAPPER,
+			"Unable to initialize netgroup fridge: %d", rc);
+		ng_fridge = NULL;
+	}
 }
 
 static void ng_free(struct ng_cache_info *info)
@@ -261,13 +298,75 @@ expired:
 	return false;
 }
 
+/* Look up a host in a netgroup and cache the result */
+static bool ng_resolve(const char *group, const char *host)
+{
+	int rc;
+
+	rc = innetgr(group, host, NULL, NULL);
+
+	PTHREAD_RWLOCK_wrlock(&ng_lock);
+	if (rc)
+		ng_add(group, host, false);	/* positive lookup */
+	else
+		ng_add(group, host, true);	/* negative lookup */
+	PTHREAD_RWLOCK_unlock(&ng_lock);
+
+	return rc;
+}
+
+/* The caller must hold ng_pending_lock */
+static void ng_pending_put(struct ng_pending *pending)
+{
+	if (--pending->ng_refcount != 0)
+		return;
+
+	pthread_cond_destroy(&pending->ng_cv);
+	gsh_free(pending->ng_group);
+	gsh_free(pending->ng_host);
+	gsh_free(pending);
+}
+
+static void ng_resolve_job(struct fridgethr_context *ctx)
+{
+	struct ng_pending *pending = ctx->arg;
+	bool result;
+
+	result = ng_resolve(pending->ng_group, pending->ng_host);
+
+	PTHREAD_MUTEX_lock(&ng_pending_lock);
+	glist_del(&pending->ng_list);
+	pending->ng_result = result;
+	pending->ng_done = true;
+	pthread_cond_broadcast(&pending->ng_cv);
+	ng_pending_put(pending);
+	PTHREAD_MUTEX_unlock(&ng_pending_lock);
+}
+
 /**
  * @brief Verify if the given host is in the given netgroup or not
+ *
+ * Lookups run on the netgroup threads, one per host and group at a
+ * time.  A lookup that times out keeps running and caches its result
+ * for later callers.
+ *
+ * @param[in]  group    The netgroup
+ * @param[in]  host     The host
+ * @param[out] timedout Set if the lookup did not finish in time
+ *
+ * @return true if the host is known to be in the netgroup.
  */
-bool ng_innetgr(const char *group, const char *host)
+bool ng_innetgr(const char *group, const char *host, bool *timedout)
 {
+	struct ng_pending *pending = NULL;
+	struct glist_head *glist;
+	struct timespec deadline;
+	bool timed;
+	bool result = false;
 	int rc;
 
+	*timedout = false;
+
 	/* Check positive lookup and then negative lookup.  If absent in
 	 * both, then do a real innetgr call and cache the results.
 	 */
@@ -282,16 +381,64 @@ bool ng_innetgr(const char *group, const char *host)
 	}
 	PTHREAD_RWLOCK_unlock(&ng_lock);
 
-	rc = innetgr(group, host, NULL, NULL);
+	if (ng_fridge == NULL)
+		return ng_resolve(group, host);
 
-	PTHREAD_RWLOCK_wrlock(&ng_lock);
-	if (rc)
-		ng_add(group, host, false);	/* positive lookup */
+	timed = nfs_ip_name_deadline(&deadline);
+
+	PTHREAD_MUTEX_lock(&ng_pending_lock);
+
+	glist_for_each(glist, &ng_pending_list) {
+		struct ng_pending *p;
+
+		p = glist_entry(glist, struct ng_pending, ng_list);
+		if (strcmp(p->ng_group, group) == 0 &&
+		    strcmp(p->ng_host, host) == 0) {
+			pending = p;
+			break;
+		}
+	}
+
+	if (pending == NULL) {
+		pending = gsh_calloc(1, sizeof(struct ng_pending));
+		pthread_cond_init(&pending->ng_cv, NULL);
+		pending->ng_refcount = 1;
+		pending->ng_group = gsh_strdup(group);
+		pending->ng_host = gsh_strdup(host);
+
+		if (fridgethr_submit(ng_fridge, ng_resolve_job, pending) != 0) {
+			ng_pending_put(pending);
+			PTHREAD_MUTEX_unlock(&ng_pending_lock);
+			return ng_resolve(group, host);
+		}
+		glist_add_tail(&ng_pending_list, &pending->ng_list);
+	}
+
+	pending->ng_refcount++;
+	rc = 0;
+	while (!pending->ng_done && rc != ETIMEDOUT) {
+		if (timed)
+			rc = pthread_cond_timedwait(&pending->ng_cv,
+						    &ng_pending_lock,
+						    &deadline);
+		else
+			rc = pthread_cond_wait(&pending->ng_cv,
+					       &ng_pending_lock);
+	}
+
+	if (pending->ng_done)
+		result = pending->ng_result;
 	else
-		ng_add(group, host, true);	/* negative lookup */
-	PTHREAD_RWLOCK_unlock(&ng_lock);
+		*timedout = true;
+	ng_pending_put(pending);
 
-	return rc;
+	PTHREAD_MUTEX_unlock(&ng_pending_lock);
+
+	if (*timedout)
+		LogEvent(COMPONENT_EXPORT,
+			 "Netgroup lookup of %s in %s timed out", host, group);
+
+	return result;
 }
 
 /**
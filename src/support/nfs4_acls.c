@@ -6,9 +6,13 @@
 #include "nfs4_acls.h"
 #include "city.h"
 #include "common_utils.h"
+#include "abstract_atomic.h"
 
 pool_t *fsal_acl_pool;
 
+/** Last fsal_acl_t::id given out */
+static uint64_t fsal_acl_last_id;
+
 static int fsal_acl_hash_both(hash_parameter_t *, struct gsh_buffdesc *,
 			      uint32_t *, uint64_t *);
 static int compare_fsal_acl(struct gsh_buffdesc *, struct gsh_buffdesc *);
@@ -80,6 +84,7 @@ void nfs4_acl_free(fsal_acl_t *acl)
 	if (acl->aces)
 		nfs4_ace_free(acl->aces);
 
+	gsh_free(acl->gids);
 	pool_free(fsal_acl_pool, acl);
 }
 
@@ -100,6 +105,49 @@ static void nfs4_acl_entry_dec_ref(fsal_acl_t *acl)
 	LogDebug(COMPONENT_NFS_V4_ACL, "(acl, ref) = (%p, %u)", acl, acl->ref);
 }
 
+/**
+ * @brief Prepare a new ACL for cached access checks
+ *
+ * Gives it an id no other ACL will ever have, so that a check result
+ * can't be mistaken for another ACL's once this one is freed, and
+ * gathers the groups its ACEs name.
+ *
+ * @param[in,out] acl The ACL
+ */
+
+static void nfs4_acl_compile(fsal_acl_t *acl)
+{
+	gid_t gids[FSAL_ACL_MAX_GIDS];
+	uint32_t ngids = 0;
+	fsal_ace_t *pace;
+	uint32_t i;
+
+	for (pace = acl->aces; pace < acl->aces + acl->naces; pace++) {
+		if (IS_FSAL_ACE_SPECIAL_ID(*pace) ||
+		    !IS_FSAL_ACE_GROUP_ID(*pace))
+			continue;
+
+		for (i = 0; i < ngids; i++)
+			if (gids[i] == pace->who.gid)
+				break;
+		if (i < ngids)
+			continue;
+
+		if (ngids == FSAL_ACL_MAX_GIDS) {
+			/* Too many to track, never cache this one */
+			return;
+		}
+		gids[ngids++] = pace->who.gid;
+	}
+
+	if (ngids != 0) {
+		acl->gids = gsh_malloc(ngids * sizeof(gid_t));
+		memcpy(acl->gids, gids, ngids * sizeof(gid_t));
+	}
+	acl->ngids = ngids;
+	acl->id = atomic_inc_uint64_t(&fsal_acl_last_id);
+}
+
 fsal_acl_t *nfs4_acl_new_entry(fsal_acl_data_t *acldata,
 			       fsal_acl_status_t *status)
 {
@@ -154,6 +202,7 @@ fsal_acl_t *nfs4_acl_new_entry(fsal_acl_data_t *acldata,
 	acl->naces = acldata->naces;
 	acl->aces = acldata->aces;
 	acl->ref = 1;		/* We give out one reference */
+	nfs4_acl_compile(acl);
 
 	/* Build the value */
 	value.addr = acl;
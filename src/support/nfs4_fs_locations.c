@@ -28,6 +28,17 @@
 #include "nfs4_fs_locations.h"
 #include "fsal_types.h"
 #include "common_utils.h"
+#include "nfs_core.h"
+#include "sal_functions.h"
+
+/*
+ * This node's view of the cluster load, for Dynamic_Referrals.
+ * Refreshed by the reaper with nfs4_referral_refresh().
+ */
+static pthread_mutex_t referral_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t referral_load;		/*< Confirmed clients of this node */
+static uint64_t referral_peer_load;	/*< Of the least loaded peer */
+static char *referral_peer;		/*< Its server, NULL if none */
 
 static fsal_fs_locations_t *nfs4_fs_locations_alloc(const unsigned int count)
 {
@@ -120,3 +131,79 @@ fsal_fs_locations_t *nfs4_fs_locations_new(const char *fs_root,
 
 	return fs_locations;
 }
+
+/**
+ * @brief Publish this node's load and find the least loaded peer
+ *
+ * Does nothing unless Dynamic_Referrals is set.
+ */
+void nfs4_referral_refresh(void)
+{
+	uint64_t load, peer_load = 0;
+	char *peer = NULL;
+	int rc;
+
+	if (!nfs_param.nfsv4_param.dynamic_referrals)
+		return;
+
+	load = nfs_client_id_count_confirmed();
+	nfs_recovery_publish_load(load);
+
+	rc = nfs_recovery_least_loaded_peer(&peer_load, &peer);
+	if (rc < 0)
+		LogDebug(COMPONENT_NFS_V4, "No peer to refer clients to: %d",
+			 rc);
+
+	PTHREAD_MUTEX_lock(&referral_mutex);
+	gsh_free(referral_peer);
+	referral_load = load;
+	referral_peer_load = peer_load;
+	referral_peer = peer;
+	PTHREAD_MUTEX_unlock(&referral_mutex);
+
+	LogFullDebug(COMPONENT_NFS_V4,
+		     "Load %" PRIu64 ", least loaded peer %s at %" PRIu64,
+		     load, peer ? peer : "none", peer_load);
+}
+
+/**
+ * @brief Refer a client crossing into an export to a less loaded node
+ *
+ * Each referral counts against the peer until the next refresh, so
+ * that a burst of mounts is not all sent to the same node.
+ *
+ * @param[in] pseudopath Pseudo path of the export, the same on the peer
+ *
+ * @return fs_locations holding a reference, NULL if the client should
+ *         stay on this node.
+ */
+fsal_fs_locations_t *nfs4_referral_locations(const char *pseudopath)
+{
+	fsal_fs_locations_t *fs_locations = NULL;
+	utf8string *server;
+
+	PTHREAD_MUTEX_lock(&referral_mutex);
+
+	if (referral_peer == NULL ||
+	    referral_load < referral_peer_load +
+			    nfs_param.nfsv4_param.referral_load_slack)
+		goto out;
+
+	fs_locations = nfs4_fs_locations_new(pseudopath, pseudopath, 1);
+	if (fs_locations == NULL)
+		goto out;
+
+	server = &fs_locations->server[0];
+	server->utf8string_len = strlen(referral_peer);
+	server->utf8string_val = gsh_memdup(referral_peer,
+					    server->utf8string_len);
+	fs_locations->nservers = 1;
+
+	referral_peer_load++;
+
+	LogDebug(COMPONENT_NFS_V4, "Referring %s to %s", pseudopath,
+		 referral_peer);
+out:
+	PTHREAD_MUTEX_unlock(&referral_mutex);
+	return fs_locations;
+}
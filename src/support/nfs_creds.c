@@ -57,6 +57,9 @@
 #include "export_mgr.h"
 #include "uid2grp.h"
 #include "client_mgr.h"
+#include "abstract_atomic.h"
+#include "gsh_intrinsic.h"
+#include "city.h"
 
 /* Export permissions for root op context */
 uint32_t root_op_export_options = EXPORT_OPTION_ROOT |
@@ -237,7 +240,7 @@ int nfs_rpc_req2client_cred(struct svc_req *req, nfs_client_cred_t *pcred)
 }
 
 /**
- * @brief Get numeric credentials from request
+ * @brief Resolve the credentials of a request
  *
  * @todo This MUST be refactored to not use TI-RPC private structures.
  * Instead, export appropriate functions from lib(n)tirpc.
@@ -249,7 +252,7 @@ int nfs_rpc_req2client_cred(struct svc_req *req, nfs_client_cred_t *pcred)
  * @return NFS4_OK if successful, NFS4ERR_ACCESS otherwise.
  *
  */
-nfsstat4 nfs_req_creds(struct svc_req *req)
+static nfsstat4 nfs_req_creds_resolve(struct svc_req *req)
 {
 	unsigned int i;
 	const char *auth_label = "UNKNOWN";
@@ -500,6 +503,292 @@ out:
 	return NFS4_OK;
 }
 
+/**
+ * Resolved credentials are cached per thread, so that a caller sending
+ * request after request to the same export reuses what the first one
+ * resolved: squashing, anonymous ids and the managed group list.
+ *
+ * An entry is found by the raw credential, the AUTH_SYS ids and groups
+ * or the RPCSEC_GSS principal, together with every export setting that
+ * goes into the result.  It holds a reference on its group list and is
+ * used until the group list or the mapping expires, or the gids or
+ * idmapper cache is purged.  Results with a squashed copy of the group
+ * list are not cached.
+ */
+
+/** Entries in each thread's cache */
+#define CREDS_CACHE_SLOTS 16
+
+/** Longest raw credential cached */
+#define CREDS_CACHE_KEY 128
+
+struct creds_cache_ent {
+	uint64_t hash;		/*< Of flavor and key, 0 when empty */
+	uint32_t gen;		/*< creds_cache_gen when filled */
+	uint32_t flavor;
+	uint32_t keylen;
+	time_t expire;
+	/* Export settings the result depends on */
+	struct fsal_export *fsal_export;
+	uint32_t options;
+	uid_t anon_uid;
+	gid_t anon_gid;
+	/* Result */
+	struct user_cred original;	/*< Without the group list */
+	struct user_cred creds;		/*< Without the group list */
+	int cred_flags;
+	struct group_data *gdata;	/*< Managed group list, held */
+	char key[CREDS_CACHE_KEY];
+};
+
+/* Squashing and managed gids, the export options changing the result */
+#define CREDS_CACHE_OPTIONS (EXPORT_OPTION_SQUASH_TYPES | \
+			     EXPORT_OPTION_MANAGE_GIDS)
+
+static uint32_t creds_cache_gen;
+static pthread_once_t creds_cache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t creds_cache_key;
+static __thread struct creds_cache_ent *creds_cache;
+
+static void creds_cache_release(struct creds_cache_ent *ent)
+{
+	if (ent->gdata != NULL)
+		uid2grp_unref(ent->gdata);
+	ent->gdata = NULL;
+	ent->hash = 0;
+}
+
+/**
+ * @brief Release the cache of an exiting thread
+ */
+static void creds_cache_thread_exit(void *arg)
+{
+	struct creds_cache_ent *cache = arg;
+	int i;
+
+	for (i = 0; i < CREDS_CACHE_SLOTS; i++)
+		creds_cache_release(&cache[i]);
+	gsh_free(cache);
+}
+
+static void creds_cache_pkginit(void)
+{
+	(void)pthread_key_create(&creds_cache_key, creds_cache_thread_exit);
+}
+
+/**
+ * @brief Forget every thread's resolved credentials
+ *
+ * Called when the gids or idmapper cache is purged.  The entries are
+ * released as they are next looked at.
+ */
+void nfs_creds_cache_flush(void)
+{
+	(void)atomic_inc_uint32_t(&creds_cache_gen);
+}
+
+/**
+ * @brief Build the cache key of a request
+ *
+ * @param[in]  req  Request
+ * @param[out] key  Raw credential, CREDS_CACHE_KEY bytes
+ *
+ * @return Length of the key, 0 if the request can't be cached.
+ */
+static uint32_t creds_cache_make_key(struct svc_req *req, char *key)
+{
+	struct authunix_parms *aup;
+	uint32_t len;
+#ifdef _HAVE_GSSAPI
+	struct svc_rpc_gss_data *gd;
+#endif
+
+	switch (req->rq_msg.cb_cred.oa_flavor) {
+	case AUTH_SYS:
+		aup = (struct authunix_parms *)req->rq_msg.rq_cred_body;
+		len = sizeof(aup->aup_uid) + sizeof(aup->aup_gid) +
+		      aup->aup_len * sizeof(gid_t);
+		if (len > CREDS_CACHE_KEY)
+			return 0;
+		memcpy(key, &aup->aup_uid, sizeof(aup->aup_uid));
+		memcpy(key + sizeof(aup->aup_uid), &aup->aup_gid,
+		       sizeof(aup->aup_gid));
+		if (aup->aup_len != 0)
+			memcpy(key + sizeof(aup->aup_uid) +
+			       sizeof(aup->aup_gid),
+			       aup->aup_gids, aup->aup_len * sizeof(gid_t));
+		return len;
+
+#ifdef _HAVE_GSSAPI
+	case RPCSEC_GSS:
+		gd = SVCAUTH_PRIVATE(req->rq_auth);
+		if (gd->cname.length == 0 ||
+		    gd->cname.length > CREDS_CACHE_KEY)
+			return 0;
+		memcpy(key, gd->cname.value, gd->cname.length);
+		return gd->cname.length;
+#endif
+
+	default:
+		return 0;
+	}
+}
+
+/**
+ * @brief Whether an entry still holds for the request in op_ctx
+ */
+static bool creds_cache_match(struct creds_cache_ent *ent, uint64_t hash,
+			      uint32_t flavor, const char *key,
+			      uint32_t keylen)
+{
+	return ent->hash == hash && ent->flavor == flavor &&
+	       ent->keylen == keylen &&
+	       ent->fsal_export == op_ctx->fsal_export &&
+	       ent->options == (op_ctx->export_perms->options &
+				CREDS_CACHE_OPTIONS) &&
+	       ent->anon_uid == op_ctx->export_perms->anonymous_uid &&
+	       ent->anon_gid == op_ctx->export_perms->anonymous_gid &&
+	       memcmp(ent->key, key, keylen) == 0;
+}
+
+/**
+ * @brief Fill op_ctx from a cached entry
+ */
+static void creds_cache_apply(struct svc_req *req,
+			      struct creds_cache_ent *ent)
+{
+	struct authunix_parms *aup;
+
+	op_ctx->cred_flags &= CREDS_LOADED | CREDS_ANON;
+	op_ctx->cred_flags |= ent->cred_flags;
+
+	op_ctx->original_creds.caller_uid = ent->original.caller_uid;
+	op_ctx->original_creds.caller_gid = ent->original.caller_gid;
+	if (ent->flavor == AUTH_SYS) {
+		aup = (struct authunix_parms *)req->rq_msg.rq_cred_body;
+		op_ctx->original_creds.caller_glen = aup->aup_len;
+		op_ctx->original_creds.caller_garray = aup->aup_gids;
+	}
+
+	*op_ctx->creds = op_ctx->original_creds;
+	op_ctx->creds->caller_uid = ent->creds.caller_uid;
+	op_ctx->creds->caller_gid = ent->creds.caller_gid;
+	op_ctx->creds->caller_glen = ent->creds.caller_glen;
+
+	if (ent->gdata != NULL) {
+		if (op_ctx->caller_gdata == NULL) {
+			uid2grp_hold_group_data(ent->gdata);
+			op_ctx->caller_gdata = ent->gdata;
+		}
+		op_ctx->creds->caller_glen = op_ctx->caller_gdata->nbgroups;
+		op_ctx->creds->caller_garray = op_ctx->caller_gdata->groups;
+	}
+}
+
+/**
+ * @brief Remember the credentials just resolved in op_ctx
+ */
+static void creds_cache_fill(struct creds_cache_ent *ent, uint64_t hash,
+			     uint32_t flavor, const char *key,
+			     uint32_t keylen, uint32_t gen)
+{
+	bool managed = (op_ctx->cred_flags & MANAGED_GIDS) != 0 &&
+		       op_ctx->caller_gdata != NULL &&
+		       op_ctx->creds->caller_garray ==
+					op_ctx->caller_gdata->groups &&
+		       op_ctx->creds->caller_glen != 0;
+
+	/* A squashed copy of the group list belongs to the request */
+	if ((op_ctx->cred_flags & GARRAY_SQUASHED) != 0)
+		return;
+
+	creds_cache_release(ent);
+
+	if (managed) {
+		ent->gdata = op_ctx->caller_gdata;
+		uid2grp_hold_group_data(ent->gdata);
+		ent->expire = ent->gdata->epoch +
+			      nfs_param.core_param.manage_gids_expiration;
+	} else {
+		ent->expire = time(NULL) +
+			      ((op_ctx->cred_flags & CREDS_ANON) != 0
+			       ? nfs_param.core_param.negative_cache_expiration
+			       : nfs_param.core_param.manage_gids_expiration);
+	}
+
+	ent->gen = gen;
+	ent->flavor = flavor;
+	ent->keylen = keylen;
+	memcpy(ent->key, key, keylen);
+	ent->fsal_export = op_ctx->fsal_export;
+	ent->options = op_ctx->export_perms->options & CREDS_CACHE_OPTIONS;
+	ent->anon_uid = op_ctx->export_perms->anonymous_uid;
+	ent->anon_gid = op_ctx->export_perms->anonymous_gid;
+	ent->original = op_ctx->original_creds;
+	ent->original.caller_glen = 0;
+	ent->original.caller_garray = NULL;
+	ent->creds = *op_ctx->creds;
+	ent->creds.caller_garray = NULL;
+	ent->cred_flags = op_ctx->cred_flags & ~CREDS_LOADED;
+	ent->hash = hash;
+}
+
+/**
+ * @brief Get numeric credentials from request
+ *
+ * fills out creds in op_ctx, from the thread's cache when the same
+ * caller was resolved for the same export settings before.
+ *
+ * @param[in]  req              Incoming request.
+ *
+ * @return NFS4_OK if successful, NFS4ERR_ACCESS otherwise.
+ *
+ */
+nfsstat4 nfs_req_creds(struct svc_req *req)
+{
+	uint32_t flavor = req->rq_msg.cb_cred.oa_flavor;
+	struct creds_cache_ent *ent;
+	char key[CREDS_CACHE_KEY];
+	uint32_t keylen, gen;
+	nfsstat4 status;
+	uint64_t hash;
+
+	keylen = creds_cache_make_key(req, key);
+	if (keylen == 0)
+		return nfs_req_creds_resolve(req);
+
+	if (unlikely(creds_cache == NULL)) {
+		(void)pthread_once(&creds_cache_once, creds_cache_pkginit);
+		creds_cache = gsh_calloc(CREDS_CACHE_SLOTS,
+					 sizeof(*creds_cache));
+		(void)pthread_setspecific(creds_cache_key, creds_cache);
+	}
+
+	hash = CityHash64(key, keylen) ^ flavor;
+	if (hash == 0)
+		hash = 1;
+	ent = &creds_cache[hash % CREDS_CACHE_SLOTS];
+	gen = atomic_fetch_uint32_t(&creds_cache_gen);
+
+	if (creds_cache_match(ent, hash, flavor, key, keylen) &&
+	    ent->gen == gen && time(NULL) <= ent->expire) {
+		creds_cache_apply(req, ent);
+		op_ctx->cred_flags |= CREDS_LOADED;
+		LogMidDebugAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
+			       "cached creds uid=%u, gid=%u, glen=%d",
+			       op_ctx->creds->caller_uid,
+			       op_ctx->creds->caller_gid,
+			       op_ctx->creds->caller_glen);
+		return NFS4_OK;
+	}
+
+	status = nfs_req_creds_resolve(req);
+	if (status == NFS4_OK)
+		creds_cache_fill(ent, hash, flavor, key, keylen, gen);
+
+	return status;
+}
+
 /**
  * @brief Initialize request context and credentials.
  *
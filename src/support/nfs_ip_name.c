@@ -36,6 +36,7 @@
 #include "nfs_exports.h"
 #include "nfs_ip_stats.h"
 #include "config_parsing.h"
+#include "fridgethr.h"
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -311,6 +312,11 @@ int nfs_ip_name_remove(sockaddr_t *ipaddr)
  */
 #define IP_NAME_EXPIRATION 3600
 
+/**
+ * @brief Default value for ip_name_param.resolve_timeout, in ms
+ */
+#define IP_NAME_RESOLVE_TIMEOUT 5000
+
 
 /** @} */
 
@@ -326,6 +332,13 @@ struct ip_name_cache {
 	/** Expiration time for ip-name mappings.  Defautls to
 	    IP_NAME_Expiration, and settable with Expiration_Time. */
 	uint32_t expiration_time;
+	/** How long, in ms, a client match waits for a reverse DNS or
+	    netgroup lookup, 0 to wait for it to finish.  Defaults to
+	    IP_NAME_RESOLVE_TIMEOUT, settable with Resolve_Timeout. */
+	uint32_t resolve_timeout;
+	/** Whether a client entry whose lookup timed out matches.
+	    Defaults to false, settable with Allow_On_Timeout. */
+	bool allow_on_timeout;
 };
 
 static struct ip_name_cache ip_name_cache = {
@@ -334,7 +347,7 @@ static struct ip_name_cache ip_name_cache = {
 	.hash_param.compare_key = compare_ip_name,
 	.hash_param.key_to_str = display_ip_name_key,
 	.hash_param.val_to_str = display_ip_name_val,
-	.hash_param.flags = HT_FLAG_NONE,
+	.hash_param.flags = HT_FLAG_OPEN,
 };
 
 /**
@@ -346,6 +359,10 @@ static struct config_item ip_name_params[] = {
 		       ip_name_cache, hash_param.index_size),
 	CONF_ITEM_UI32("Expiration_Time", 1, 60*60*24, IP_NAME_EXPIRATION,
 		       ip_name_cache, expiration_time),
+	CONF_ITEM_UI32("Resolve_Timeout", 0, 60*1000, IP_NAME_RESOLVE_TIMEOUT,
+		       ip_name_cache, resolve_timeout),
+	CONF_ITEM_BOOL("Allow_On_Timeout", false,
+		       ip_name_cache, allow_on_timeout),
 	CONFIG_EOL
 };
 
@@ -379,6 +396,187 @@ struct config_block nfs_ip_name = {
 	.blk_desc.u.blk.commit = ip_name_commit
 };
 
+/**
+ * @brief Most reverse DNS lookups run at once
+ */
+#define IP_NAME_RESOLVE_THREADS 4
+
+/**
+ * @brief A reverse DNS lookup in flight
+ *
+ * Threads matching the same address wait on it rather than each
+ * querying DNS, and give up on it after Resolve_Timeout.
+ */
+
+struct ip_name_pending {
+	struct glist_head list;	/*< Entry in ip_name_pending_list */
+	pthread_cond_t cv;	/*< Signalled when done */
+	bool done;		/*< The lookup is finished */
+	int rc;			/*< Result of nfs_ip_name_add */
+	int refcount;		/*< Resolver and waiters */
+	sockaddr_t addr;
+	char hostname[MAXHOSTNAMELEN + 1];
+};
+
+static pthread_mutex_t ip_name_pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static GLIST_HEAD(ip_name_pending_list);
+static struct fridgethr *ip_name_fridge;
+
+/**
+ * @brief Compute the deadline for a lookup started now
+ *
+ * @param[out] deadline When the lookup times out
+ *
+ * @retval false if lookups wait until they finish.
+ */
+
+bool nfs_ip_name_deadline(struct timespec *deadline)
+{
+	uint32_t timeout = ip_name_cache.resolve_timeout;
+
+	if (timeout == 0)
+		return false;
+
+	clock_gettime(CLOCK_REALTIME, deadline);
+	deadline->tv_sec += timeout / 1000;
+	deadline->tv_nsec += (timeout % 1000) * 1000000;
+	if (deadline->tv_nsec >= 1000000000) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Whether a client entry whose lookup timed out matches
+ */
+
+bool nfs_ip_name_allow_on_timeout(void)
+{
+	return ip_name_cache.allow_on_timeout;
+}
+
+static void ip_name_pending_put(struct ip_name_pending *pending)
+{
+	if (--pending->refcount != 0)
+		return;
+
+	pthread_cond_destroy(&pending->cv);
+	gsh_free(pending);
+}
+
+static void ip_name_resolve_job(struct fridgethr_context *ctx)
+{
+	struct ip_name_pending *pending = ctx->arg;
+	int rc;
+
+	rc = nfs_ip_name_add(&pending->addr, pending->hostname,
+			     sizeof(pending->hostname));
+
+	PTHREAD_MUTEX_lock(&ip_name_pending_lock);
+	glist_del(&pending->list);
+	pending->rc = rc;
+	pending->done = true;
+	pthread_cond_broadcast(&pending->cv);
+	ip_name_pending_put(pending);
+	PTHREAD_MUTEX_unlock(&ip_name_pending_lock);
+}
+
+/**
+ * @brief Get the hostname of an address, resolving it if needed
+ *
+ * Lookups run on the resolver threads, one per address at a time.  A
+ * lookup that times out keeps running and caches its result for
+ * later callers.
+ *
+ * @param[in]  ipaddr   The address to resolve
+ * @param[out] hostname The hostname
+ * @param[in]  size     Size of hostname
+ *
+ * @return IP_NAME_SUCCESS, IP_NAME_TIMEOUT, or the error of
+ *         nfs_ip_name_add().
+ */
+
+int nfs_ip_name_resolve(sockaddr_t *ipaddr, char *hostname, size_t size)
+{
+	struct ip_name_pending *pending = NULL;
+	struct glist_head *glist;
+	struct timespec deadline;
+	bool timed;
+	int rc;
+
+	rc = nfs_ip_name_get(ipaddr, hostname, size);
+	if (rc != IP_NAME_NOT_FOUND)
+		return rc;
+
+	if (ip_name_fridge == NULL)
+		return nfs_ip_name_add(ipaddr, hostname, size);
+
+	timed = nfs_ip_name_deadline(&deadline);
+
+	PTHREAD_MUTEX_lock(&ip_name_pending_lock);
+
+	glist_for_each(glist, &ip_name_pending_list) {
+		struct ip_name_pending *p;
+
+		p = glist_entry(glist, struct ip_name_pending, list);
+		if (cmp_sockaddr(&p->addr, ipaddr, true)) {
+			pending = p;
+			break;
+		}
+	}
+
+	if (pending == NULL) {
+		pending = gsh_calloc(1, sizeof(struct ip_name_pending));
+		pthread_cond_init(&pending->cv, NULL);
+		pending->refcount = 1;
+		memcpy(&pending->addr, ipaddr, sizeof(sockaddr_t));
+
+		if (fridgethr_submit(ip_name_fridge, ip_name_resolve_job,
+				     pending) != 0) {
+			PTHREAD_MUTEX_unlock(&ip_name_pending_lock);
+			pthread_cond_destroy(&pending->cv);
+			gsh_free(pending);
+			return nfs_ip_name_add(ipaddr, hostname, size);
+		}
+		glist_add_tail(&ip_name_pending_list, &pending->list);
+	}
+
+	pending->refcount++;
+	rc = 0;
+	while (!pending->done && rc != ETIMEDOUT) {
+		if (timed)
+			rc = pthread_cond_timedwait(&pending->cv,
+						    &ip_name_pending_lock,
+						    &deadline);
+		else
+			rc = pthread_cond_wait(&pending->cv,
+					       &ip_name_pending_lock);
+	}
+
+	if (pending->done) {
+		rc = pending->rc;
+		if (rc == IP_NAME_SUCCESS)
+			strmaxcpy(hostname, pending->hostname, size);
+	} else {
+		rc = IP_NAME_TIMEOUT;
+	}
+	ip_name_pending_put(pending);
+
+	PTHREAD_MUTEX_unlock(&ip_name_pending_lock);
+
+	if (rc == IP_NAME_TIMEOUT) {
+		char ipstring[SOCK_NAME_MAX + 1];
+
+		sprint_sockip(ipaddr, ipstring, sizeof(ipstring));
+		LogEvent(COMPONENT_DISPATCH,
+			 "Reverse DNS lookup for %s timed out", ipstring);
+	}
+
+	return rc;
+}
+
 /**
  *
  * nfs_Init_ip_name: Init the hashtable for IP/name cache.
@@ -401,5 +599,23 @@ int nfs_Init_ip_name(void)
 	/* Set the expiration time */
 	expiration_time = ip_name_cache.expiration_time;
 
+	if (ip_name_fridge == NULL) {
+		struct fridgethr_params frp;
+		int rc;
+
+		memset(&frp, 0, sizeof(struct fridgethr_params));
+		frp.thr_max = IP_NAME_RESOLVE_THREADS;
+		frp.deferment = fridgethr_defer_queue;
+
+		rc = fridgethr_init(&ip_name_fridge, "ip_name", &frp);
+		if (rc != 0) {
+			/* Addresses will be resolved inline */
+			LogWarn(COMPONENT_INIT,
+				"NFS IP_NAME: Cannot init resolver threads: %d",
+				rc);
+			ip_name_fridge = NULL;
+		}
+	}
+
 	return IP_NAME_SUCCESS;
 }				/* nfs_Init_ip_name */
@@ -74,6 +74,19 @@ static struct config_item_list protocols[] = {
 	CONFIG_LIST_EOL
 };
 
+static struct config_item_list huge_page_modes[] = {
+	CONFIG_LIST_TOK("none", HUGE_PAGES_NONE),
+	CONFIG_LIST_TOK("thp", HUGE_PAGES_THP),
+	CONFIG_LIST_TOK("hugetlb", HUGE_PAGES_HUGETLB),
+	CONFIG_LIST_EOL
+};
+
+static struct config_item_list numa_policies[] = {
+	CONFIG_LIST_TOK("none", NUMA_POLICY_NONE),
+	CONFIG_LIST_TOK("local", NUMA_POLICY_LOCAL),
+	CONFIG_LIST_EOL
+};
+
 static struct config_item core_params[] = {
 	CONF_ITEM_UI16("NFS_Port", 0, UINT16_MAX, NFS_PORT,
 		       nfs_core_param, port[P_NFS]),
@@ -83,6 +96,22 @@ static struct config_item core_params[] = {
 		       nfs_core_param, port[P_NLM]),
 	CONF_ITEM_UI16("Rquota_Port", 0, UINT16_MAX, RQUOTA_PORT,
 		       nfs_core_param, port[P_RQUOTA]),
+	CONF_ITEM_UI16("NFS_RDMA_Port", 1, UINT16_MAX, NFS_RDMA_PORT,
+		       nfs_core_param, port[P_NFS_RDMA]),
+	CONF_ITEM_UI32("NFS_RDMA_Credits", 1, 1024, NFS_RDMA_CREDITS,
+		       nfs_core_param, rdma.credits),
+	CONF_ITEM_UI32("NFS_RDMA_Backlog", 1, 1024, NFS_RDMA_BACKLOG,
+		       nfs_core_param, rdma.backlog),
+	CONF_ITEM_BOOL("Enable_RPC_TLS", false,
+		       nfs_core_param, tls.enable),
+	CONF_ITEM_BOOL("RPC_TLS_Required", false,
+		       nfs_core_param, tls.required),
+	CONF_ITEM_PATH("RPC_TLS_Cert_File", 1, MAXPATHLEN, NULL,
+		       nfs_core_param, tls.cert_file),
+	CONF_ITEM_PATH("RPC_TLS_Key_File", 1, MAXPATHLEN, NULL,
+		       nfs_core_param, tls.key_file),
+	CONF_ITEM_PATH("RPC_TLS_CA_File", 1, MAXPATHLEN, NULL,
+		       nfs_core_param, tls.ca_file),
 	CONF_ITEM_IP_ADDR("Bind_Addr", "0.0.0.0",
 			  nfs_core_param, bind_addr),
 	CONF_ITEM_UI32("NFS_Program", 1, INT32_MAX, NFS_PROGRAM,
@@ -95,6 +124,38 @@ static struct config_item core_params[] = {
 		       nfs_core_param, program[P_RQUOTA]),
 	CONF_ITEM_UI32("Nb_Worker", 1, 1024*128, NB_WORKER_THREAD_DEFAULT,
 		       nfs_core_param, nb_worker),
+	CONF_ITEM_UI32("Req_Queue_Shards", 0, 1024, 1,
+		       nfs_core_param, req_queue_shards),
+	CONF_ITEM_UI32("Req_Queue_Weight_Latency", 1, 32, 8,
+		       nfs_core_param, req_queue.weight_latency),
+	CONF_ITEM_UI32("Req_Queue_Weight_Small_IO", 1, 32, 4,
+		       nfs_core_param, req_queue.weight_small_io),
+	CONF_ITEM_UI32("Req_Queue_Weight_Bulk_IO", 1, 32, 2,
+		       nfs_core_param, req_queue.weight_bulk_io),
+	CONF_ITEM_UI32("Req_Queue_Weight_Callback", 1, 32, 2,
+		       nfs_core_param, req_queue.weight_callback),
+	CONF_ITEM_UI32("Req_Queue_Bulk_Size", 0, UINT32_MAX, 32768,
+		       nfs_core_param, req_queue.bulk_size),
+	CONF_ITEM_BOOL("Worker_Adaptive", false,
+		       nfs_core_param, worker_adapt.enable),
+	CONF_ITEM_UI32("Worker_Min", 1, 1024*128, 16,
+		       nfs_core_param, worker_adapt.min),
+	CONF_ITEM_UI32("Worker_Max", 1, 1024*128, 1024,
+		       nfs_core_param, worker_adapt.max),
+	CONF_ITEM_UI32("Worker_Grow_Wait", 1, UINT32_MAX, 1000,
+		       nfs_core_param, worker_adapt.grow_wait),
+	CONF_ITEM_UI32("Worker_Adapt_Interval", 1, 60, 2,
+		       nfs_core_param, worker_adapt.interval),
+	CONF_ITEM_UI64("IO_Buffer_Pool_Size", 0, UINT64_MAX, 256 * 1024 * 1024,
+		       nfs_core_param, iobuf_pool_size),
+	CONF_ITEM_TOKEN("IO_Buffer_Huge_Pages", HUGE_PAGES_NONE,
+			huge_page_modes,
+			nfs_core_param, iobuf_huge_pages),
+	CONF_ITEM_UI64("IO_Buffer_Huge_Size", HUGE_PAGE_SIZE, UINT64_MAX,
+		       256 * 1024 * 1024,
+		       nfs_core_param, iobuf_huge_size),
+	CONF_ITEM_TOKEN("NUMA_Policy", NUMA_POLICY_NONE, numa_policies,
+			nfs_core_param, numa_policy),
 	CONF_ITEM_BOOL("Drop_IO_Errors", false,
 		       nfs_core_param, drop_io_errors),
 	CONF_ITEM_BOOL("Drop_Inval_Errors", false,
@@ -103,6 +164,10 @@ static struct config_item core_params[] = {
 		       nfs_core_param, drop_delay_errors),
 	CONF_ITEM_BOOL("DRC_Disabled", false,
 		       nfs_core_param, drc.disabled),
+	CONF_ITEM_BOOL("DRC_Encoded_Replies", false,
+		       nfs_core_param, drc.encoded),
+	CONF_ITEM_UI32("DRC_Encoded_Reply_Max", 64, 1024 * 1024,
+		       DRC_ENCODED_MAX, nfs_core_param, drc.encoded_max),
 	CONF_ITEM_UI32("DRC_TCP_Npart", 1, 20, DRC_TCP_NPART,
 		       nfs_core_param, drc.tcp.npart),
 	CONF_ITEM_UI32("DRC_TCP_Size", 1, 32767, DRC_TCP_SIZE,
@@ -115,6 +180,13 @@ static struct config_item core_params[] = {
 		       nfs_core_param, drc.tcp.recycle_npart),
 	CONF_ITEM_UI32("DRC_TCP_Recycle_Expire_S", 0, 60*60, 600,
 		       nfs_core_param, drc.tcp.recycle_expire_s),
+	CONF_ITEM_UI32("DRC_TCP_Idle_Shrink_S", 0, 60*60,
+		       DRC_TCP_IDLE_SHRINK_S,
+		       nfs_core_param, drc.tcp.idle_shrink_s),
+	CONF_ITEM_UI64("DRC_TCP_Adaptive_Budget", 0, UINT64_MAX, 0,
+		       nfs_core_param, drc.tcp.adaptive_budget),
+	CONF_ITEM_UI32("DRC_TCP_Hiwat_Min", 1, 256, DRC_TCP_HIWAT_MIN,
+		       nfs_core_param, drc.tcp.hiwat_min),
 	CONF_ITEM_BOOL("DRC_TCP_Checksum", DRC_TCP_CHECKSUM,
 		       nfs_core_param, drc.tcp.checksum),
 	CONF_ITEM_UI32("DRC_UDP_Npart", 1, 100, DRC_UDP_NPART,
@@ -139,6 +211,10 @@ static struct config_item core_params[] = {
 		       nfs_core_param, rpc.max_recv_buffer_size),
 	CONF_ITEM_UI32("RPC_Ioq_ThrdMax", 1, 1024*128, 200,
 		       nfs_core_param, rpc.ioq_thrd_max),
+	CONF_ITEM_UI32("RPC_Listeners", 1, RPC_LISTENERS_MAX, 1,
+		       nfs_core_param, rpc.listeners),
+	CONF_ITEM_UI32("RPC_Max_Events", 1, 65536, 1024,
+		       nfs_core_param, rpc.max_events),
 	CONF_ITEM_UI32("RPC_GSS_Npart", 1, 1021, 13,
 		       nfs_core_param, rpc.gss.ctx_hash_partitions),
 	CONF_ITEM_UI32("RPC_GSS_Max_Ctx", 1, 1024*1024, 16384,
@@ -173,10 +249,26 @@ static struct config_item core_params[] = {
 		       nfs_core_param, enable_FASTSTATS),
 	CONF_ITEM_BOOL("Enable_FSAL_Stats", false,
 		       nfs_core_param, enable_FSALSTATS),
+	CONF_ITEM_BOOL("Enable_Latency_Histograms", false,
+		       nfs_core_param, enable_LATENCY_HIST),
+	CONF_ITEM_BOOL("Enable_Stage_Histograms", false,
+		       nfs_core_param, enable_STAGE_HIST),
+	CONF_ITEM_BOOL("Enable_Top_Tracking", false,
+		       nfs_core_param, enable_TOP_TRACKING),
+	CONF_ITEM_BOOL("Enable_User_Tracking", false,
+		       nfs_core_param, enable_USER_TRACKING),
+	CONF_ITEM_BOOL("Enable_Per_Thread_Stats", false,
+		       nfs_core_param, enable_PERTHREAD_STATS),
 	CONF_ITEM_BOOL("Short_File_Handle", false,
 		       nfs_core_param, short_file_handle),
+	CONF_ITEM_BOOL("Cached_Pre_Op_Attrs", false,
+		       nfs_core_param, cached_pre_op_attrs),
 	CONF_ITEM_I64("Manage_Gids_Expiration", 0, 7*24*60*60, 30*60,
 			nfs_core_param, manage_gids_expiration),
+	CONF_ITEM_I64("Negative_Cache_Expiration", 0, 7*24*60*60, 60,
+			nfs_core_param, negative_cache_expiration),
+	CONF_ITEM_UI32("Export_Init_Threads", 1, 256, 16,
+		       nfs_core_param, export_init_threads),
 	CONF_ITEM_PATH("Plugins_Dir", 1, MAXPATHLEN, FSAL_MODULE_LOC,
 		       nfs_core_param, ganesha_modules_loc),
 	CONF_ITEM_UI32("heartbeat_freq", 0, 5000, 1000,
@@ -187,6 +279,40 @@ static struct config_item core_params[] = {
 		       nfs_core_param, mount_path_pseudo),
 	CONF_ITEM_STR("Dbus_Name_Prefix", 1, 255, NULL,
 		       nfs_core_param, dbus_name_prefix),
+	CONF_ITEM_UI32("Throttle_Max_Delay", 0, 10000, 100,
+		       nfs_core_param, throttle_max_delay),
+	CONF_ITEM_PATH("Stats_Shm_File", 1, MAXPATHLEN, NULL,
+		       nfs_core_param, stats_shm_file),
+	CONF_ITEM_UI32("Stats_Shm_Interval", 1, 3600, 10,
+		       nfs_core_param, stats_shm_interval),
+	CONF_ITEM_UI16("Stats_HTTP_Port", 0, UINT16_MAX, 0,
+		       nfs_core_param, stats_http_port),
+	CONF_ITEM_UI32("Rquota_Cache_Time", 0, 3600, RQUOTA_CACHE_TIME,
+		       nfs_core_param, rquota_cache_time),
+	CONF_ITEM_PATH("Capture_File", 1, MAXPATHLEN, NULL,
+		       nfs_core_param, capture_file),
+	CONF_ITEM_UI32("Capture_Ring_Size", 65536, 16777216, 1048576,
+		       nfs_core_param, capture_ring_size),
+	CONF_ITEM_UI32("Slow_Request_Threshold", 0, 3600000, 0,
+		       nfs_core_param, slow_request_threshold),
+	CONF_ITEM_UI32("Slow_Request_Log_Rate", 1, 10000, 10,
+		       nfs_core_param, slow_request_log_rate),
+	CONF_ITEM_UI32("Slow_Request_Sample", 1, 1000000, 1,
+		       nfs_core_param, slow_request_sample),
+	CONF_ITEM_UI32("Max_Request_Age", 0, 3600000, 0,
+		       nfs_core_param, max_request_age),
+	CONF_ITEM_UI32("Admission_High_Requests", 0, UINT32_MAX, 0,
+		       nfs_core_param, admission_high_requests),
+	CONF_ITEM_UI32("Admission_Low_Requests", 0, UINT32_MAX, 0,
+		       nfs_core_param, admission_low_requests),
+	CONF_ITEM_UI64("Admission_High_Bytes", 0, UINT64_MAX, 0,
+		       nfs_core_param, admission_high_bytes),
+	CONF_ITEM_UI64("Admission_Low_Bytes", 0, UINT64_MAX, 0,
+		       nfs_core_param, admission_low_bytes),
+	CONF_ITEM_UI32("Top_Tracking_Interval", 1, 3600, 10,
+		       nfs_core_param, top_tracking_interval),
+	CONF_ITEM_UI32("Top_Tracking_Entries", 8, 1024, 64,
+		       nfs_core_param, top_tracking_entries),
 	CONFIG_EOL
 };
 
@@ -215,6 +341,8 @@ static struct config_item krb5_params[] = {
 		       nfs_krb5_param, ccache_dir),
 	CONF_ITEM_BOOL("Active_krb5", true,
 		       nfs_krb5_param, active_krb5),
+	CONF_ITEM_UI32("Crypto_Threads", 0, 256, 8,
+		       nfs_krb5_param, crypto_threads),
 	CONFIG_EOL
 };
 
@@ -251,6 +379,10 @@ static struct config_item version4_params[] = {
 		       nfs_version4_parameter, lease_lifetime),
 	CONF_ITEM_UI32("Grace_Period", 0, 180, GRACE_PERIOD_DEFAULT,
 		       nfs_version4_parameter, grace_period),
+	CONF_ITEM_UI32("Min_Grace_Period", 0, 180, 0,
+		       nfs_version4_parameter, min_grace_period),
+	CONF_ITEM_UI32("Reclaim_Priority_Per_Client", 0, 65535, 16,
+		       nfs_version4_parameter, reclaim_priority_per_client),
 	CONF_ITEM_STR("DomainName", 1, MAXPATHLEN, DOMAINNAME_DEFAULT,
 		      nfs_version4_parameter, domainname),
 	CONF_ITEM_PATH("IdmapConf", 1, MAXPATHLEN, IDMAPCONF_DEFAULT,
@@ -263,6 +395,18 @@ static struct config_item version4_params[] = {
 		       nfs_version4_parameter, only_numeric_owners),
 	CONF_ITEM_BOOL("Delegations", false,
 		       nfs_version4_parameter, allow_delegations),
+	CONF_ITEM_BOOL("Directory_Delegations", false,
+		       nfs_version4_parameter, allow_dir_delegations),
+	CONF_ITEM_BOOL("Dynamic_Referrals", false,
+		       nfs_version4_parameter, dynamic_referrals),
+	CONF_ITEM_UI32("Referral_Load_Slack", 1, UINT32_MAX, 16,
+		       nfs_version4_parameter, referral_load_slack),
+	CONF_ITEM_BOOL("Courteous_Server", false,
+		       nfs_version4_parameter, courteous_server),
+	CONF_ITEM_UI32("Courtesy_Max_Time", 1, 604800, 86400,
+		       nfs_version4_parameter, courtesy_max_time),
+	CONF_ITEM_UI32("Max_Courtesy_Clients", 0, UINT32_MAX, 4096,
+		       nfs_version4_parameter, max_courtesy_clients),
 	CONF_ITEM_UI32("Deleg_Recall_Retry_Delay", 0, 10,
 			DELEG_RECALL_RETRY_DELAY_DEFAULT,
 			nfs_version4_parameter, deleg_recall_retry_delay),
@@ -277,6 +421,14 @@ static struct config_item version4_params[] = {
 		       minor_versions, nfs_version4_parameter, minor_versions),
 	CONF_ITEM_UI32("slot_table_size", 1, 1024, NFS41_NB_SLOTS_DEF,
 		       nfs_version4_parameter, nb_slots),
+	CONF_ITEM_UI64("Copy_Sync_Max", 0, UINT64_MAX, 16 * 1024 * 1024,
+		       nfs_version4_parameter, copy_sync_max),
+	CONF_ITEM_UI32("Copy_Threads", 0, 64, 4,
+		       nfs_version4_parameter, copy_threads),
+	CONF_ITEM_UI32("PUTFH_Cache_Size", 0, 64, 16,
+		       nfs_version4_parameter, putfh_cache_size),
+	CONF_ITEM_UI32("PUTFH_Resolve_Threads", 0, 64, 0,
+		       nfs_version4_parameter, putfh_resolve_threads),
 	CONFIG_EOL
 };
 
@@ -0,0 +1,247 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file numa.c
+ * @brief NUMA topology and thread placement
+ */
+
+#include "config.h"
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "gsh_config.h"
+#include "gsh_numa.h"
+#include "log.h"
+
+static pthread_once_t numa_once = PTHREAD_ONCE_INIT;
+
+static uint32_t numa_nnodes = 1;
+static uint32_t numa_ncpus;
+static uint32_t *numa_cpu_node;
+
+#ifdef LINUX
+static cpu_set_t *numa_node_cpus[GSH_NUMA_MAX_NODES];
+
+/**
+ * @brief Add a CPU to the set of its node
+ */
+static void numa_add_cpu(uint32_t node, unsigned int cpu)
+{
+	size_t setsize = CPU_ALLOC_SIZE(numa_ncpus);
+
+	numa_cpu_node[cpu] = node;
+
+	if (numa_node_cpus[node] == NULL) {
+		numa_node_cpus[node] = CPU_ALLOC(numa_ncpus);
+		if (numa_node_cpus[node] == NULL)
+			return;
+		CPU_ZERO_S(setsize, numa_node_cpus[node]);
+	}
+	CPU_SET_S(cpu, setsize, numa_node_cpus[node]);
+}
+
+/**
+ * @brief Read the NUMA node of each CPU from sysfs
+ */
+static void numa_init(void)
+{
+	const char *nodes = "/sys/devices/system/node";
+	char path[PATH_MAX];
+	struct dirent *de;
+	unsigned int node, first, last, cpu;
+	long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+	DIR *dir;
+	FILE *fp;
+	int c;
+
+	numa_ncpus = ncpus > 0 ? ncpus : 1;
+	numa_cpu_node = gsh_calloc(numa_ncpus, sizeof(*numa_cpu_node));
+
+	dir = opendir(nodes);
+	if (dir == NULL)
+		return;
+
+	while ((de = readdir(dir)) != NULL) {
+		if (sscanf(de->d_name, "node%u", &node) != 1 ||
+		    node >= GSH_NUMA_MAX_NODES)
+			continue;
+
+		(void) snprintf(path, sizeof(path), "%s/%s/cpulist", nodes,
+				de->d_name);
+		fp = fopen(path, "r");
+		if (fp == NULL)
+			continue;
+
+		/* A list of ranges, like 0-7,16-23 */
+		while (fscanf(fp, "%u", &first) == 1) {
+			last = first;
+			c = fgetc(fp);
+			if (c == '-') {
+				if (fscanf(fp, "%u", &last) != 1)
+					break;
+				c = fgetc(fp);
+			}
+			for (cpu = first; cpu <= last && cpu < numa_ncpus;
+			     cpu++)
+				numa_add_cpu(node, cpu);
+			if (c != ',')
+				break;
+		}
+		(void) fclose(fp);
+
+		if (node >= numa_nnodes)
+			numa_nnodes = node + 1;
+	}
+
+	(void) closedir(dir);
+}
+
+/**
+ * @brief Node of a CPU
+ */
+static uint32_t numa_cpu_to_node(int cpu)
+{
+	if (cpu < 0 || (uint32_t) cpu >= numa_ncpus)
+		return 0;
+
+	return numa_cpu_node[cpu];
+}
+#else
+static void numa_init(void)
+{
+	numa_ncpus = 1;
+}
+
+static uint32_t numa_cpu_to_node(int cpu)
+{
+	return 0;
+}
+#endif
+
+/**
+ * @brief Number of NUMA nodes
+ *
+ * @return At least 1, at most GSH_NUMA_MAX_NODES.
+ */
+uint32_t gsh_numa_nodes(void)
+{
+	(void) pthread_once(&numa_once, numa_init);
+	return numa_nnodes;
+}
+
+/**
+ * @brief NUMA node of the CPU the caller runs on
+ */
+uint32_t gsh_numa_local_node(void)
+{
+	(void) pthread_once(&numa_once, numa_init);
+#ifdef LINUX
+	return numa_cpu_to_node(sched_getcpu());
+#else
+	return 0;
+#endif
+}
+
+/**
+ * @brief NUMA node receiving the traffic of a socket
+ *
+ * This is the node of the CPU the kernel last processed incoming
+ * packets on, which follows the NIC queue the connection hashes to.
+ *
+ * @param[in] fd Connected socket
+ *
+ * @return The node, or -1 if it is not known yet.
+ */
+int gsh_numa_socket_node(int fd)
+{
+#if defined(LINUX) && defined(SO_INCOMING_CPU)
+	socklen_t len = sizeof(int);
+	int cpu;
+
+	(void) pthread_once(&numa_once, numa_init);
+	if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) != 0 ||
+	    cpu < 0)
+		return -1;
+
+	return numa_cpu_to_node(cpu);
+#else
+	return -1;
+#endif
+}
+
+/**
+ * @brief Pin the calling thread to the CPUs of a node
+ *
+ * Does nothing unless NUMA_Policy is Local.  Memory the thread
+ * touches first is then allocated on that node by the kernel.
+ *
+ * @param[in] node Node to run on
+ */
+void gsh_numa_bind(uint32_t node)
+{
+	if (nfs_param.core_param.numa_policy != NUMA_POLICY_LOCAL)
+		return;
+
+	(void) pthread_once(&numa_once, numa_init);
+	if (numa_nnodes < 2)
+		return;
+
+#ifdef LINUX
+	node %= numa_nnodes;
+	if (numa_node_cpus[node] == NULL)
+		return;
+
+	if (sched_setaffinity(0, CPU_ALLOC_SIZE(numa_ncpus),
+			      numa_node_cpus[node]) != 0)
+		LogWarn(COMPONENT_THREAD,
+			"Could not bind thread to NUMA node %" PRIu32
+			": %s", node, strerror(errno));
+	else
+		LogFullDebug(COMPONENT_THREAD,
+			     "Thread bound to NUMA node %" PRIu32, node);
+#endif
+}
+
+/**
+ * @brief Pin the calling thread to the next node of a pool
+ *
+ * Threads of a pool are spread over the nodes in turn.
+ *
+ * @param[in,out] next Counter of the pool
+ */
+void gsh_numa_bind_next(uint32_t *next)
+{
+	if (nfs_param.core_param.numa_policy != NUMA_POLICY_LOCAL)
+		return;
+
+	gsh_numa_bind(atomic_postinc_uint32_t(next));
+}
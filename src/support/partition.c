@@ -0,0 +1,376 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file partition.c
+ * @brief Isolation partitions of exports
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include "log.h"
+#include "fsal.h"
+#include "nfs_core.h"
+#include "export_mgr.h"
+#include "gsh_partition.h"
+#ifdef USE_DBUS
+#include "server_stats_private.h"
+#endif
+
+/**
+ * @brief All partitions
+ *
+ * Only added to while the configuration is read at start up, before
+ * any request is served, so it is walked without a lock.
+ */
+static struct glist_head partitions = GLIST_HEAD_INIT(partitions);
+
+/**
+ * @brief Find a partition
+ *
+ * @param[in] name  Name of the partition
+ *
+ * @return The partition, NULL if there is none of that name.
+ */
+struct gsh_partition *partition_lookup(const char *name)
+{
+	struct glist_head *glist;
+	struct gsh_partition *part;
+
+	glist_for_each(glist, &partitions) {
+		part = glist_entry(glist, struct gsh_partition, node);
+		if (strcmp(part->name, name) == 0)
+			return part;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Whether a slot of a partition is free for a request
+ *
+ * Caller must hold part->mtx.
+ */
+static inline bool partition_free(struct gsh_partition *part, bool reclaim)
+{
+	return part->active < part->max_workers &&
+	       (reclaim || part->queued_reclaim == 0);
+}
+
+/**
+ * @brief Take a slot of a partition
+ *
+ * Waits up to Max_Wait for one when all are taken, unless Max_Queue
+ * requests are waiting already.  A reclaim is given a freed slot before
+ * the other requests waiting.
+ *
+ * @param[in] part     The partition
+ * @param[in] reclaim  The request is a reclaim during grace
+ *
+ * @return true if a slot was taken.
+ */
+static bool partition_get(struct gsh_partition *part, bool reclaim)
+{
+	struct timespec deadline;
+	bool got = false;
+
+	PTHREAD_MUTEX_lock(&part->mtx);
+
+	if (partition_free(part, reclaim)) {
+		got = true;
+	} else if (part->queued < part->max_queue && part->max_wait != 0) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		timespec_add_nsecs((nsecs_elapsed_t) part->max_wait *
+				   NS_PER_MSEC, &deadline);
+		part->queued++;
+		part->waited++;
+		if (reclaim)
+			part->queued_reclaim++;
+
+		while (!partition_free(part, reclaim)) {
+			if (pthread_cond_timedwait(&part->cond, &part->mtx,
+						   &deadline) == ETIMEDOUT)
+				break;
+		}
+
+		part->queued--;
+		got = partition_free(part, reclaim);
+
+		/* The others may have been held back for this reclaim */
+		if (reclaim && --part->queued_reclaim == 0 &&
+		    part->queued != 0)
+			pthread_cond_broadcast(&part->cond);
+	}
+
+	if (got) {
+		part->active++;
+		part->admitted++;
+		if (part->active > part->peak)
+			part->peak = part->active;
+	} else {
+		part->deferred++;
+	}
+
+	PTHREAD_MUTEX_unlock(&part->mtx);
+
+	return got;
+}
+
+/**
+ * @brief Give back the partition slot a request holds
+ */
+void nfs_partition_exit(void)
+{
+	struct gsh_partition *part = op_ctx->partition;
+
+	if (part == NULL)
+		return;
+
+	PTHREAD_MUTEX_lock(&part->mtx);
+	part->active--;
+
+	/* A reclaim waiting must be the one to get the slot */
+	if (part->queued_reclaim != 0)
+		pthread_cond_broadcast(&part->cond);
+	else if (part->queued != 0)
+		pthread_cond_signal(&part->cond);
+	PTHREAD_MUTEX_unlock(&part->mtx);
+
+	op_ctx->partition = NULL;
+}
+
+/**
+ * @brief Hold a slot of the partition of the current export
+ *
+ * A request already holding a slot of another partition gives it back
+ * first, so a request never holds two.
+ *
+ * @param[in] reclaim  The request is a reclaim during grace, which
+ *                     waits ahead of the others
+ *
+ * @retval 0 the request may go on.
+ * @retval -1 the partition is full; the client should retry it later.
+ */
+int nfs_partition_enter(bool reclaim)
+{
+	struct gsh_export *export = op_ctx->ctx_export;
+	struct gsh_partition *part = NULL;
+
+	if (export != NULL)
+		part = atomic_fetch_voidptr((void **)&export->partition);
+
+	if (part == op_ctx->partition)
+		return 0;
+
+	nfs_partition_exit();
+
+	if (part == NULL)
+		return 0;
+
+	if (!partition_get(part, reclaim)) {
+		LogDebug(COMPONENT_DISPATCH,
+			 "Partition %s is full, deferring request",
+			 part->name);
+		return -1;
+	}
+
+	op_ctx->partition = part;
+	return 0;
+}
+
+/**
+ * @brief Initialize a PARTITION block
+ */
+static void *partition_init(void *link_mem, void *self_struct)
+{
+	static struct gsh_partition special_part;
+	struct gsh_partition *part = self_struct;
+
+	if (link_mem == (void *)~0UL) {
+		/* No PARTITION block, nothing is committed */
+		memset(&special_part, 0, sizeof(special_part));
+		return &special_part;
+	} else if (part == NULL) {
+		part = gsh_calloc(1, sizeof(*part));
+		PTHREAD_MUTEX_init(&part->mtx, NULL);
+		PTHREAD_COND_init(&part->cond, NULL);
+		return part;
+	}
+
+	/* free resources case */
+	PTHREAD_COND_destroy(&part->cond);
+	PTHREAD_MUTEX_destroy(&part->mtx);
+	gsh_free(part->name);
+	gsh_free(part);
+	return NULL;
+}
+
+/**
+ * @brief Commit a PARTITION block
+ */
+static int partition_commit(void *node, void *link_mem, void *self_struct,
+			    struct config_error_type *err_type)
+{
+	struct gsh_partition *part = self_struct;
+
+	if (partition_lookup(part->name) != NULL) {
+		LogCrit(COMPONENT_CONFIG,
+			"Partition %s already exists", part->name);
+		err_type->exists = true;
+		return 1;
+	}
+
+	glist_add_tail(&partitions, &part->node);
+
+	LogEvent(COMPONENT_CONFIG,
+		 "Partition %s created, %" PRIu32 " workers, %" PRIu32
+		 " queued for up to %" PRIu32 " ms",
+		 part->name, part->max_workers, part->max_queue,
+		 part->max_wait);
+	return 0;
+}
+
+/**
+ * @brief Table of PARTITION block parameters
+ */
+static struct config_item partition_items[] = {
+	CONF_MAND_STR("Name", 1, 255, NULL,
+		      gsh_partition, name),
+	CONF_ITEM_UI32("Max_Workers", 1, 65535, 16,
+		       gsh_partition, max_workers),
+	CONF_ITEM_UI32("Max_Queue", 0, 65535, 64,
+		       gsh_partition, max_queue),
+	CONF_ITEM_UI32("Max_Wait", 0, 60000, 1000,
+		       gsh_partition, max_wait),
+	CONFIG_EOL
+};
+
+/**
+ * @brief Top level definition for each PARTITION block
+ */
+static struct config_block partition_block = {
+	.dbus_interface_name = "org.ganesha.nfsd.config.partition",
+	.blk_desc.name = "PARTITION",
+	.blk_desc.type = CONFIG_BLOCK,
+	.blk_desc.u.blk.init = partition_init,
+	.blk_desc.u.blk.params = partition_items,
+	.blk_desc.u.blk.commit = partition_commit
+};
+
+/**
+ * @brief Read the PARTITION blocks from the parsed configuration file
+ *
+ * @param[in]  in_config  The parsed configuration
+ * @param[out] err_type   Errors found
+ *
+ * @return A negative value on error;
+ *         otherwise, the number of PARTITION blocks.
+ */
+int ReadPartitions(config_file_t in_config,
+		   struct config_error_type *err_type)
+{
+	int rc;
+
+	rc = load_config_from_parse(in_config,
+				    &partition_block,
+				    NULL,
+				    false,
+				    err_type);
+	if (!config_error_is_harmless(err_type))
+		return -1;
+
+	return rc;
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report the partitions and how full they are
+ *
+ * array of struct partition {
+ *	char *name;
+ *	uint32_t max_workers;
+ *	uint32_t max_queue;
+ *	uint32_t active;	(requests holding a slot)
+ *	uint32_t queued;	(requests waiting for one)
+ *	uint32_t peak;		(most slots held at once)
+ *	uint64_t admitted;
+ *	uint64_t waited;
+ *	uint64_t deferred;	(requests the client was asked to retry)
+ * }
+ *
+ * @param iter   [IN] iterator in reply stream to fill
+ */
+void partition_dbus_append(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter, struct_iter;
+	struct glist_head *glist;
+	struct gsh_partition *part;
+	struct timespec timestamp;
+	uint32_t active, queued, peak;
+	uint64_t admitted, waited, deferred;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 "(suuuuuttt)", &array_iter);
+	glist_for_each(glist, &partitions) {
+		part = glist_entry(glist, struct gsh_partition, node);
+
+		PTHREAD_MUTEX_lock(&part->mtx);
+		active = part->active;
+		queued = part->queued;
+		peak = part->peak;
+		admitted = part->admitted;
+		waited = part->waited;
+		deferred = part->deferred;
+		PTHREAD_MUTEX_unlock(&part->mtx);
+
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &part->name);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &part->max_workers);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &part->max_queue);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &active);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &queued);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &peak);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &admitted);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &waited);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &deferred);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+#endif				/* USE_DBUS */
@@ -0,0 +1,593 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file pool.c
+ * @brief Object pools with per-thread magazines
+ *
+ * This is the magazine layer of an object cache.  Each thread has two
+ * magazines per pool: a loaded one that it allocates from and frees
+ * to, and the previous one.  With both, a thread that frees and
+ * allocates around a magazine boundary doesn't go to the depot every
+ * time.  Full and empty magazines are swapped with the depot of the
+ * NUMA node the thread started on, so objects stay near the threads
+ * using them.
+ *
+ * Objects are taken from the general allocator one at a time, and
+ * given back one at a time once a depot holds as many full magazines
+ * as it keeps, so the memory of a pool shrinks after a burst.
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "gsh_intrinsic.h"
+#include "common_utils.h"
+#include "gsh_numa.h"
+#include "log.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#include "server_stats_private.h"
+#endif
+
+/** Objects held by a magazine */
+#define POOL_MAG_SIZE 32
+
+/** Full magazines a depot keeps, objects beyond are released */
+#define POOL_DEPOT_FULL 64
+
+/** Empty magazines a depot keeps */
+#define POOL_DEPOT_EMPTY 16
+
+/**
+ * @brief A stack of free objects
+ */
+struct pool_magazine {
+	struct pool_magazine *next;	/*< Depot list link */
+	uint32_t count;
+	void *objs[POOL_MAG_SIZE];
+};
+
+/**
+ * @brief Magazines of a pool shared by the threads of a NUMA node
+ */
+struct pool_depot {
+	pthread_mutex_t mtx;
+	struct pool_magazine *full;
+	struct pool_magazine *empty;
+	uint32_t nfull;
+	uint32_t nempty;
+	GSH_CACHE_PAD(0);
+};
+
+struct pool {
+	char *name;		/*< The name of the pool */
+	size_t object_size;	/*< The size of the objects created */
+	pool_object_fn constructor;
+	pool_object_fn destructor;
+	uint32_t id;		/*< Index of the thread caches for the pool */
+	uint64_t gen;		/*< Tells the pool from others that had id */
+	uint64_t created;	/*< Objects got from the general allocator */
+	uint64_t released;	/*< Objects given back to it */
+	uint64_t exchanges;	/*< Magazines swapped with a depot */
+	enum mem_tag mem_tag;	/*< Subsystem charged for the objects */
+	struct pool_depot depot[];	/*< One per NUMA node */
+};
+
+/**
+ * @brief The magazines of one thread for one pool
+ */
+struct pool_tcache {
+	uint64_t gen;		/*< Of the pool the magazines belong to */
+	size_t object_size;	/*< Of the pool, to uncharge after it goes */
+	enum mem_tag mem_tag;	/*< Of the pool, likewise */
+	struct pool_magazine *loaded;
+	struct pool_magazine *previous;
+};
+
+/**
+ * @brief The magazines of one thread, indexed by pool id
+ */
+struct pool_thread {
+	uint32_t node;		/*< Depot the thread uses */
+	uint32_t count;
+	struct pool_tcache cache[];
+};
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t pool_thread_key;
+
+/** Protects pool_table and pool_next_gen */
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pool_t **pool_table;
+static uint32_t pool_table_size;
+static uint64_t pool_next_gen = 1;
+
+static uint32_t pool_nnodes = 1;
+
+static __thread struct pool_thread *pool_thread;
+
+/**
+ * @brief Give the objects of a magazine back to the general allocator
+ *
+ * @param[in] pool	Pool they belong to
+ * @param[in] mag	Magazine, freed as well
+ */
+static void pool_release_magazine(pool_t *pool, struct pool_magazine *mag)
+{
+	while (mag->count > 0) {
+		void *object = mag->objs[--mag->count];
+
+		if (pool->destructor != NULL)
+			pool->destructor(object);
+		gsh_free(object);
+		(void) atomic_inc_uint64_t(&pool->released);
+		mem_acct_charge(pool->mem_tag, -(int64_t)pool->object_size, -1);
+	}
+
+	gsh_free(mag);
+}
+
+/**
+ * @brief Drop the magazines of a destroyed pool
+ *
+ * The destructor went with the pool, so the objects are just freed,
+ * and uncharged with what the thread cache kept of the pool.
+ *
+ * @param[in] tc	Thread cache left by the pool
+ */
+static void pool_tcache_drop(struct pool_tcache *tc)
+{
+	struct pool_magazine *mags[2] = { tc->loaded, tc->previous };
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (mags[i] == NULL)
+			continue;
+		while (mags[i]->count > 0) {
+			gsh_free(mags[i]->objs[--mags[i]->count]);
+			mem_acct_charge(tc->mem_tag,
+					-(int64_t)tc->object_size, -1);
+		}
+		gsh_free(mags[i]);
+	}
+
+	tc->loaded = NULL;
+	tc->previous = NULL;
+}
+
+/**
+ * @brief Put a magazine in a depot
+ *
+ * Full magazines a depot has no room for are released.
+ *
+ * @param[in] pool	Pool the magazine belongs to
+ * @param[in] node	Depot to use
+ * @param[in] mag	Magazine
+ */
+static void pool_depot_give(pool_t *pool, uint32_t node,
+			    struct pool_magazine *mag)
+{
+	struct pool_depot *depot = &pool->depot[node];
+
+	(void) atomic_inc_uint64_t(&pool->exchanges);
+
+	PTHREAD_MUTEX_lock(&depot->mtx);
+	if (mag->count > 0 && depot->nfull < POOL_DEPOT_FULL) {
+		mag->next = depot->full;
+		depot->full = mag;
+		depot->nfull++;
+		mag = NULL;
+	} else if (mag->count == 0 && depot->nempty < POOL_DEPOT_EMPTY) {
+		mag->next = depot->empty;
+		depot->empty = mag;
+		depot->nempty++;
+		mag = NULL;
+	}
+	PTHREAD_MUTEX_unlock(&depot->mtx);
+
+	if (mag != NULL)
+		pool_release_magazine(pool, mag);
+}
+
+/**
+ * @brief Take a magazine from a depot
+ *
+ * @param[in] pool	Pool
+ * @param[in] node	Depot to use
+ * @param[in] full	Take a full magazine rather than an empty one
+ *
+ * @return A full magazine, or NULL if there are none.  An empty
+ *         magazine, made if there are none.
+ */
+static struct pool_magazine *pool_depot_take(pool_t *pool, uint32_t node,
+					     bool full)
+{
+	struct pool_depot *depot = &pool->depot[node];
+	struct pool_magazine **head = full ? &depot->full : &depot->empty;
+	uint32_t *count = full ? &depot->nfull : &depot->nempty;
+	struct pool_magazine *mag = NULL;
+
+	if (atomic_fetch_uint32_t(count) > 0) {
+		PTHREAD_MUTEX_lock(&depot->mtx);
+		mag = *head;
+		if (mag != NULL) {
+			*head = mag->next;
+			(*count)--;
+		}
+		PTHREAD_MUTEX_unlock(&depot->mtx);
+	}
+
+	if (mag != NULL) {
+		(void) atomic_inc_uint64_t(&pool->exchanges);
+	} else if (!full) {
+		mag = gsh_malloc(sizeof(*mag));
+		mag->count = 0;
+	}
+
+	return mag;
+}
+
+/**
+ * @brief Give back the magazines of an exiting thread
+ *
+ * @param[in] arg	The thread's struct pool_thread
+ */
+static void pool_thread_exit(void *arg)
+{
+	struct pool_thread *pt = arg;
+	struct pool_tcache *tc;
+	pool_t *pool;
+	uint32_t id;
+
+	PTHREAD_MUTEX_lock(&pool_mutex);
+
+	for (id = 0; id < pt->count; id++) {
+		tc = &pt->cache[id];
+		pool = id < pool_table_size ? pool_table[id] : NULL;
+
+		if (pool == NULL || pool->gen != tc->gen) {
+			pool_tcache_drop(tc);
+			continue;
+		}
+
+		if (tc->loaded != NULL)
+			pool_depot_give(pool, pt->node, tc->loaded);
+		if (tc->previous != NULL)
+			pool_depot_give(pool, pt->node, tc->previous);
+	}
+
+	PTHREAD_MUTEX_unlock(&pool_mutex);
+
+	pool_thread = NULL;
+	gsh_free(pt);
+}
+
+/**
+ * @brief Set up what all pools share
+ */
+static void pool_pkginit(void)
+{
+	pool_nnodes = gsh_numa_nodes();
+
+	if (pthread_key_create(&pool_thread_key, pool_thread_exit) != 0)
+		LogFatal(COMPONENT_INIT,
+			 "Could not create pool thread cache key");
+}
+
+/**
+ * @brief Find the calling thread's magazines for a pool
+ *
+ * @param[in] pool	Pool
+ *
+ * @return The thread cache.
+ */
+static inline struct pool_tcache *pool_tcache(pool_t *pool)
+{
+	struct pool_thread *pt = pool_thread;
+	struct pool_tcache *tc;
+
+	if (unlikely(pt == NULL || pool->id >= pt->count)) {
+		uint32_t old = pt != NULL ? pt->count : 0;
+		uint32_t count = pool->id + 8;
+
+		pt = gsh_realloc(pt, sizeof(*pt) +
+				     count * sizeof(struct pool_tcache));
+		memset(&pt->cache[old], 0,
+		       (count - old) * sizeof(struct pool_tcache));
+		if (old == 0)
+			pt->node = gsh_numa_local_node();
+		pt->count = count;
+
+		pool_thread = pt;
+		(void) pthread_setspecific(pool_thread_key, pt);
+	}
+
+	tc = &pt->cache[pool->id];
+	if (unlikely(tc->gen != pool->gen)) {
+		/* Left over from a destroyed pool that had this id */
+		pool_tcache_drop(tc);
+		tc->gen = pool->gen;
+		tc->object_size = pool->object_size;
+		tc->mem_tag = pool->mem_tag;
+	}
+
+	return tc;
+}
+
+pool_t *pool_init__(const char *name, size_t object_size,
+		    pool_object_fn constructor, pool_object_fn destructor,
+		    const char *file, int line, const char *function)
+{
+	pool_t *pool;
+	uint32_t id, node;
+
+	(void) pthread_once(&pool_once, pool_pkginit);
+
+	pool = gsh_calloc__(1, sizeof(*pool) +
+			    pool_nnodes * sizeof(struct pool_depot),
+			    file, line, function);
+
+	pool->object_size = object_size;
+	pool->constructor = constructor;
+	pool->destructor = destructor;
+	pool->mem_tag = MEM_TAG_NONE;
+
+	if (name)
+		pool->name = gsh_strdup__(name, file, line, function);
+	else
+		pool->name = NULL;
+
+	for (node = 0; node < pool_nnodes; node++)
+		PTHREAD_MUTEX_init(&pool->depot[node].mtx, NULL);
+
+	PTHREAD_MUTEX_lock(&pool_mutex);
+
+	for (id = 0; id < pool_table_size; id++) {
+		if (pool_table[id] == NULL)
+			break;
+	}
+
+	if (id == pool_table_size) {
+		pool_table_size = pool_table_size ? pool_table_size * 2 : 32;
+		pool_table = gsh_realloc(pool_table,
+					 pool_table_size * sizeof(pool_t *));
+		memset(&pool_table[id], 0,
+		       (pool_table_size - id) * sizeof(pool_t *));
+	}
+
+	pool->id = id;
+	pool->gen = pool_next_gen++;
+	pool_table[id] = pool;
+
+	PTHREAD_MUTEX_unlock(&pool_mutex);
+
+	return pool;
+}
+
+void pool_destroy(pool_t *pool)
+{
+	struct pool_thread *pt = pool_thread;
+	struct pool_magazine *mag, *full, *empty;
+	uint32_t node;
+
+	PTHREAD_MUTEX_lock(&pool_mutex);
+	pool_table[pool->id] = NULL;
+	PTHREAD_MUTEX_unlock(&pool_mutex);
+
+	/* Other threads drop their magazines when they next use the id,
+	 * or exit.
+	 */
+	if (pt != NULL && pool->id < pt->count &&
+	    pt->cache[pool->id].gen == pool->gen) {
+		struct pool_tcache *tc = &pt->cache[pool->id];
+
+		if (tc->loaded != NULL)
+			pool_release_magazine(pool, tc->loaded);
+		if (tc->previous != NULL)
+			pool_release_magazine(pool, tc->previous);
+		memset(tc, 0, sizeof(*tc));
+	}
+
+	for (node = 0; node < pool_nnodes; node++) {
+		struct pool_depot *depot = &pool->depot[node];
+
+		PTHREAD_MUTEX_lock(&depot->mtx);
+		full = depot->full;
+		empty = depot->empty;
+		depot->full = NULL;
+		depot->empty = NULL;
+		depot->nfull = 0;
+		depot->nempty = 0;
+		PTHREAD_MUTEX_unlock(&depot->mtx);
+
+		while ((mag = full) != NULL) {
+			full = mag->next;
+			pool_release_magazine(pool, mag);
+		}
+		while ((mag = empty) != NULL) {
+			empty = mag->next;
+			gsh_free(mag);
+		}
+		PTHREAD_MUTEX_destroy(&depot->mtx);
+	}
+
+	gsh_free(pool->name);
+	gsh_free(pool);
+}
+
+void pool_set_mem_tag(pool_t *pool, enum mem_tag tag)
+{
+	pool->mem_tag = tag;
+}
+
+void *pool_alloc__(pool_t *pool, const char *file, int line,
+		   const char *function)
+{
+	struct pool_tcache *tc = pool_tcache(pool);
+	struct pool_magazine *mag;
+	void *object;
+
+	if (tc->loaded == NULL || tc->loaded->count == 0) {
+		if (tc->previous != NULL && tc->previous->count > 0) {
+			mag = tc->previous;
+			tc->previous = tc->loaded;
+			tc->loaded = mag;
+		} else {
+			mag = pool_depot_take(pool, pool_thread->node, true);
+			if (mag == NULL) {
+				/* Nothing cached anywhere near, get a new
+				 * one.
+				 */
+				(void) atomic_inc_uint64_t(&pool->created);
+				mem_acct_charge(pool->mem_tag,
+						pool->object_size, 1);
+				if (pool->constructor == NULL)
+					return gsh_calloc__(1,
+							    pool->object_size,
+							    file, line,
+							    function);
+				object = gsh_malloc__(pool->object_size, file,
+						      line, function);
+				pool->constructor(object);
+				return object;
+			}
+			/* Both of ours are empty, keep one */
+			if (tc->previous != NULL)
+				pool_depot_give(pool, pool_thread->node,
+						tc->previous);
+			tc->previous = tc->loaded;
+			tc->loaded = mag;
+		}
+	}
+
+	object = tc->loaded->objs[--tc->loaded->count];
+	if (pool->constructor == NULL)
+		memset(object, 0, pool->object_size);
+
+	return object;
+}
+
+void pool_free(pool_t *pool, void *object)
+{
+	struct pool_tcache *tc;
+	struct pool_magazine *mag;
+
+	if (object == NULL)
+		return;
+
+	tc = pool_tcache(pool);
+
+	if (tc->loaded == NULL || tc->loaded->count == POOL_MAG_SIZE) {
+		if (tc->previous != NULL &&
+		    tc->previous->count < POOL_MAG_SIZE) {
+			mag = tc->previous;
+			tc->previous = tc->loaded;
+			tc->loaded = mag;
+		} else {
+			/* Both of ours are full, keep one */
+			mag = pool_depot_take(pool, pool_thread->node, false);
+			if (tc->previous != NULL)
+				pool_depot_give(pool, pool_thread->node,
+						tc->previous);
+			tc->previous = tc->loaded;
+			tc->loaded = mag;
+		}
+	}
+
+	tc->loaded->objs[tc->loaded->count++] = object;
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report the objects held by each pool
+ *
+ * @param iter [IN] the iterator to append to
+ */
+
+void pool_dbus_stats(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter, struct_iter;
+	struct pool_magazine *mag;
+	struct timespec timestamp;
+	uint64_t size, created, released, objects, idle, exchanges;
+	uint32_t id, node;
+	pool_t *pool;
+	char *name;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 POOL_STATS_REPLY_ARRAY_TYPE,
+					 &array_iter);
+
+	PTHREAD_MUTEX_lock(&pool_mutex);
+
+	for (id = 0; id < pool_table_size; id++) {
+		pool = pool_table[id];
+		if (pool == NULL)
+			continue;
+
+		name = pool->name != NULL ? pool->name : "unnamed";
+		size = pool->object_size;
+		created = atomic_fetch_uint64_t(&pool->created);
+		released = atomic_fetch_uint64_t(&pool->released);
+		exchanges = atomic_fetch_uint64_t(&pool->exchanges);
+		objects = created - released;
+
+		idle = 0;
+		for (node = 0; node < pool_nnodes; node++) {
+			PTHREAD_MUTEX_lock(&pool->depot[node].mtx);
+			for (mag = pool->depot[node].full; mag != NULL;
+			     mag = mag->next)
+				idle += mag->count;
+			PTHREAD_MUTEX_unlock(&pool->depot[node].mtx);
+		}
+
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_STRING, &name);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &size);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &objects);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &idle);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &created);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &released);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &exchanges);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+
+	PTHREAD_MUTEX_unlock(&pool_mutex);
+
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+#endif
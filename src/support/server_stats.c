@@ -40,6 +40,7 @@
 #include "config.h"
 
 #include <time.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <stdint.h>
@@ -60,6 +61,9 @@
 #include "server_stats.h"
 #include <abstract_atomic.h>
 #include "nfs_proto_functions.h"
+#include "latency_hist.h"
+#include "gsh_stats_shm.h"
+#include "server_topk.h"
 
 #define NFS_V3_NB_COMMAND (NFSPROC3_COMMIT + 1)
 #define NFS_V4_NB_COMMAND 2
@@ -75,12 +79,12 @@
 #define NFS_pcp nfs_param.core_param
 #define NFS_program NFS_pcp.program
 
-#ifdef USE_DBUS
-
 struct op_name {
 	char *name;
 };
 
+#ifdef USE_DBUS
+
 static const struct op_name optqta[] = {
 	[RQUOTAPROC_GETQUOTA] = {.name = "GETQUOTA", },
 	[RQUOTAPROC_GETACTIVEQUOTA] = {.name = "GETACTIVEQUOTA", },
@@ -121,6 +125,8 @@ static const struct op_name optnlm[] = {
 	[NLMPROC4_FREE_ALL] = {.name = "FREE_ALL", },
 };
 
+#endif
+
 static const struct op_name optabv3[] = {
 	[NFSPROC3_NULL] = {.name = "NULL", },
 	[NFSPROC3_GETATTR] = {.name = "GETATTR", },
@@ -141,7 +147,7 @@ static const struct op_name optabv3[] = {
 	[NFSPROC3_READDIR] = {.name = "READDIR", },
 	[NFSPROC3_READDIRPLUS] = {.name = "READDIRPLUS", },
 	[NFSPROC3_FSSTAT] = {.name = "FSSTAT", },
-	[NFSPROC3_FSINFO] = {.name = "FSINFO	", },
+	[NFSPROC3_FSINFO] = {.name = "FSINFO", },
 	[NFSPROC3_PATHCONF] = {.name = "PATHCONF", },
 	[NFSPROC3_COMMIT] = {.name = "COMMIT", },
 };
@@ -226,8 +232,6 @@ static const struct op_name optabv4[] = {
 	[NFS4_OP_REMOVEXATTR] = {.name = "OP_REMOVEXATTR",},
 };
 
-#endif
-
 /* Classify protocol ops for stats purposes
  */
 
@@ -409,6 +413,30 @@ struct _9p_stats {
 };
 #endif
 
+/* per operation latency histograms
+ */
+struct lat_hists {
+	struct lat_hist *v3[NFSPROC3_COMMIT+1];
+	struct lat_hist *v4[NFS4_OP_LAST_ONE];
+};
+
+/* per operation histograms of the request stages, the NFSv4 slot past
+ * the last operation is for whole COMPOUNDs.  Operations of a COMPOUND
+ * only have the execute and FSAL stages.
+ */
+struct stage_hists {
+	struct lat_hist *v3[NFSPROC3_COMMIT+1][REQ_STAGE_COUNT];
+	struct lat_hist *v4[NFS4_OP_LAST_ONE+1][REQ_STAGE_COUNT];
+};
+
+static const char *const req_stage_names[REQ_STAGE_COUNT] = {
+	[REQ_STAGE_DECODE] = "decode",
+	[REQ_STAGE_QUEUE] = "queue",
+	[REQ_STAGE_EXECUTE] = "execute",
+	[REQ_STAGE_FSAL] = "fsal",
+	[REQ_STAGE_REPLY] = "reply",
+};
+
 struct global_stats {
 	struct nfsv3_stats nfsv3;
 	struct mnt_stats mnt;
@@ -422,6 +450,8 @@ struct global_stats {
 	struct nlm_ops lm;
 	struct mnt_ops mn;
 	struct qta_ops qt;
+	struct lat_hists lat;
+	struct stage_hists stages;
 };
 
 struct deleg_stats {
@@ -431,10 +461,24 @@ struct deleg_stats {
 				       recall */
 	uint32_t failed_recalls;    /* times client failed to process recall */
 	uint32_t num_revokes;	    /* Num revokes for the client */
+	uint32_t tot_grants;	    /* total num of delegations granted */
+	uint32_t recalls_avoided;   /* delegations the policy refused
+				       because they would likely be
+				       recalled */
+	uint32_t recall_returns;    /* recalled delegations returned */
+	uint64_t recall_latency;    /* seconds taken to return them */
 };
 
 static struct global_stats global_st;
 
+/* Requests dropped before execution, by enum req_drop, atomic */
+static uint64_t req_drops[REQ_DROP_COUNT];
+
+/* Slab used by this thread with Enable_Per_Thread_Stats
+ */
+static __thread int stats_slab_ix = -1;
+static uint32_t stats_next_slab;
+
 /* include the top level server_stats struct definition
  */
 #include "server_stats_private.h"
@@ -466,6 +510,81 @@ static struct nfsv3_stats *get_v3(struct gsh_stats *stats,
 	return stats->nfsv3;
 }
 
+static struct lat_hists *get_lat(struct gsh_stats *stats,
+				 pthread_rwlock_t *lock)
+{
+	if (unlikely(stats->lat == NULL)) {
+		PTHREAD_RWLOCK_wrlock(lock);
+		if (stats->lat == NULL)
+			stats->lat =
+			    gsh_calloc(1, sizeof(struct lat_hists));
+		PTHREAD_RWLOCK_unlock(lock);
+	}
+	return stats->lat;
+}
+
+/**
+ * @brief Get the slab this thread records into
+ *
+ * With Enable_Per_Thread_Stats, NFS requests are counted in one of
+ * STATS_SLABS private copies of the stats, picked per thread, and the
+ * copies are only added up into @a stats when they are read.  Threads
+ * then don't all hammer the same counters of a busy export or client.
+ *
+ * Once there are slabs, the members they cover belong to the merge:
+ * what was counted in @a stats before is handed to the first slab, and
+ * NFS requests keep counting into slabs even if the option is turned
+ * off, so server_stats_merge() may overwrite those members.
+ *
+ * @param stats [IN] the aggregated stats
+ * @param lock  [IN] the lock in the stats owning struct
+ *
+ * @return the stats to record into
+ */
+
+static struct gsh_stats *get_slab(struct gsh_stats *stats,
+				  pthread_rwlock_t *lock)
+{
+	struct gsh_stats *slabs;
+
+	if (op_ctx->req_type != NFS_REQUEST ||
+	    (!nfs_param.core_param.enable_PERTHREAD_STATS &&
+	     atomic_fetch_voidptr((void **)&stats->slabs) == NULL))
+		return stats;
+
+	if (unlikely(stats_slab_ix < 0))
+		stats_slab_ix = atomic_inc_uint32_t(&stats_next_slab) %
+				STATS_SLABS;
+
+	if (unlikely(atomic_fetch_voidptr((void **)&stats->slabs) == NULL)) {
+		PTHREAD_RWLOCK_wrlock(lock);
+		if (stats->slabs == NULL) {
+			slabs = gsh_calloc(STATS_SLABS,
+					   sizeof(struct gsh_stats));
+			/* Threads still counting into these carry on, the
+			 * counts are then the first slab's.
+			 */
+			slabs->nfsv3 = stats->nfsv3;
+			slabs->mnt = stats->mnt;
+			slabs->nlm4 = stats->nlm4;
+			slabs->rquota = stats->rquota;
+			slabs->nfsv40 = stats->nfsv40;
+			slabs->nfsv41 = stats->nfsv41;
+			slabs->nfsv42 = stats->nfsv42;
+			stats->nfsv3 = NULL;
+			stats->mnt = NULL;
+			stats->nlm4 = NULL;
+			stats->rquota = NULL;
+			stats->nfsv40 = NULL;
+			stats->nfsv41 = NULL;
+			stats->nfsv42 = NULL;
+			atomic_store_voidptr((void **)&stats->slabs, slabs);
+		}
+		PTHREAD_RWLOCK_unlock(lock);
+	}
+	return &stats->slabs[stats_slab_ix];
+}
+
 static struct mnt_stats *get_mnt(struct gsh_stats *stats,
 				 pthread_rwlock_t *lock)
 {
@@ -599,6 +718,87 @@ void record_latency(struct proto_op *op, nsecs_elapsed_t request_time,
 		(void)atomic_store_uint64_t(&op->queue_latency.max, qwait_time);
 }
 
+/**
+ * @brief Record an operation in the latency histograms
+ *
+ * @param lat          [IN] histograms of a client, export or the server
+ * @param nfs_vers     [IN] NFS_V3 or NFS_V4
+ * @param opcode       [IN] procedure or NFSv4 operation
+ * @param request_time [IN] time consumed by request
+ */
+static void record_lat_hist(struct lat_hists *lat, int nfs_vers,
+			    uint32_t opcode, nsecs_elapsed_t request_time)
+{
+	struct lat_hist **histp;
+
+	if (nfs_vers == NFS_V3 && opcode <= NFSPROC3_COMMIT)
+		histp = &lat->v3[opcode];
+	else if (nfs_vers == NFS_V4 && opcode < NFS4_OP_LAST_ONE)
+		histp = &lat->v4[opcode];
+	else
+		return;
+
+	lat_hist_record(lat_hist_get(histp), request_time);
+}
+
+/**
+ * @brief Record the stages of a request that was replied to
+ *
+ * Only NFSv3 procedures and NFSv4 COMPOUNDs are kept.
+ *
+ * @param reqdata [IN] the request
+ * @param stage   [IN] time spent in each stage
+ */
+void server_stats_stages_done(request_data_t *reqdata,
+			      const nsecs_elapsed_t *stage)
+{
+	struct svc_req *req = &reqdata->r_u.req.svc;
+	uint32_t proto_op = req->rq_msg.cb_proc;
+	struct lat_hist **hists;
+	int i;
+
+	if (!nfs_param.core_param.enable_STAGE_HIST ||
+	    req->rq_msg.cb_prog != NFS_PROGRAM)
+		return;
+	if (op_ctx->nfs_vers == NFS_V3 && proto_op <= NFSPROC3_COMMIT)
+		hists = global_st.stages.v3[proto_op];
+	else if (op_ctx->nfs_vers == NFS_V4 && proto_op == NFSPROC4_COMPOUND)
+		hists = global_st.stages.v4[NFS4_OP_LAST_ONE];
+	else
+		return;
+
+	for (i = 0; i < REQ_STAGE_COUNT; i++)
+		lat_hist_record(lat_hist_get(&hists[i]), stage[i]);
+}
+
+/**
+ * @brief Record the stages of an NFSv4 operation
+ *
+ * @param proto_op   [IN] the operation
+ * @param start_time [IN] when it started
+ * @param fsal_time  [IN] time it spent in the FSAL
+ */
+void server_stats_nfsv4_op_stages(int proto_op, nsecs_elapsed_t start_time,
+				  nsecs_elapsed_t fsal_time)
+{
+	struct lat_hist **hists = global_st.stages.v4[proto_op];
+	struct timespec current_time;
+	nsecs_elapsed_t latency;
+
+	if (!nfs_param.core_param.enable_STAGE_HIST)
+		return;
+
+	now(&current_time);
+	latency = timespec_diff(&nfs_ServerBootTime, &current_time) -
+		  start_time;
+	if (fsal_time > latency)
+		fsal_time = latency;
+
+	lat_hist_record(lat_hist_get(&hists[REQ_STAGE_EXECUTE]),
+			latency - fsal_time);
+	lat_hist_record(lat_hist_get(&hists[REQ_STAGE_FSAL]), fsal_time);
+}
+
 /**
  * @brief count the i/o stats
  *
@@ -848,6 +1048,10 @@ static void reset_deleg_stats(struct deleg_stats *deleg)
 	(void)atomic_store_uint32_t(&deleg->tot_recalls, 0);
 	(void)atomic_store_uint32_t(&deleg->failed_recalls, 0);
 	(void)atomic_store_uint32_t(&deleg->num_revokes, 0);
+	(void)atomic_store_uint32_t(&deleg->tot_grants, 0);
+	(void)atomic_store_uint32_t(&deleg->recalls_avoided, 0);
+	(void)atomic_store_uint32_t(&deleg->recall_returns, 0);
+	(void)atomic_store_uint64_t(&deleg->recall_latency, 0);
 }
 
 #ifdef _USE_9P
@@ -870,6 +1074,214 @@ static void reset__9P_stats(struct _9p_stats *_9p)
 	}
 }
 #endif
+
+#endif		/* USE_DBUS */
+
+/**
+ * @brief Add up per-thread stats slabs
+ *
+ * The sums are built on the side and stored in one go, so readers
+ * don't see counters going back to zero.
+ */
+
+static void merge_latency(struct op_latency *dst, struct op_latency *src)
+{
+	dst->latency += atomic_fetch_uint64_t(&src->latency);
+	if (src->min != 0 && (dst->min == 0 || dst->min > src->min))
+		dst->min = src->min;
+	if (dst->max < src->max)
+		dst->max = src->max;
+}
+
+static void merge_op(struct proto_op *dst, struct proto_op *src)
+{
+	dst->total += atomic_fetch_uint64_t(&src->total);
+	dst->errors += atomic_fetch_uint64_t(&src->errors);
+	dst->dups += atomic_fetch_uint64_t(&src->dups);
+	merge_latency(&dst->latency, &src->latency);
+	merge_latency(&dst->dup_latency, &src->dup_latency);
+	merge_latency(&dst->queue_latency, &src->queue_latency);
+}
+
+static void merge_xfer_op(struct xfer_op *dst, struct xfer_op *src)
+{
+	merge_op(&dst->cmd, &src->cmd);
+	dst->requested += atomic_fetch_uint64_t(&src->requested);
+	dst->transferred += atomic_fetch_uint64_t(&src->transferred);
+}
+
+static void merge_layout_op(struct layout_op *dst, struct layout_op *src)
+{
+	dst->total += atomic_fetch_uint64_t(&src->total);
+	dst->errors += atomic_fetch_uint64_t(&src->errors);
+	dst->delays += atomic_fetch_uint64_t(&src->delays);
+}
+
+static void merge_nfsv3_stats(struct nfsv3_stats *dst, struct nfsv3_stats *src)
+{
+	merge_op(&dst->cmds, &src->cmds);
+	merge_xfer_op(&dst->read, &src->read);
+	merge_xfer_op(&dst->write, &src->write);
+}
+
+static void merge_nfsv40_stats(struct nfsv40_stats *dst,
+			       struct nfsv40_stats *src)
+{
+	merge_op(&dst->compounds, &src->compounds);
+	dst->ops_per_compound += atomic_fetch_uint64_t(&src->ops_per_compound);
+	merge_xfer_op(&dst->read, &src->read);
+	merge_xfer_op(&dst->write, &src->write);
+}
+
+static void merge_nfsv41_stats(struct nfsv41_stats *dst,
+			       struct nfsv41_stats *src)
+{
+	merge_op(&dst->compounds, &src->compounds);
+	dst->ops_per_compound += atomic_fetch_uint64_t(&src->ops_per_compound);
+	merge_xfer_op(&dst->read, &src->read);
+	merge_xfer_op(&dst->write, &src->write);
+	merge_layout_op(&dst->getdevinfo, &src->getdevinfo);
+	merge_layout_op(&dst->layout_get, &src->layout_get);
+	merge_layout_op(&dst->layout_commit, &src->layout_commit);
+	merge_layout_op(&dst->layout_return, &src->layout_return);
+	merge_layout_op(&dst->recall, &src->recall);
+}
+
+static void merge_mnt_stats(struct mnt_stats *dst, struct mnt_stats *src)
+{
+	merge_op(&dst->v1_ops, &src->v1_ops);
+	merge_op(&dst->v3_ops, &src->v3_ops);
+}
+
+static void merge_rquota_stats(struct rquota_stats *dst,
+			       struct rquota_stats *src)
+{
+	merge_op(&dst->ops, &src->ops);
+	merge_op(&dst->ext_ops, &src->ext_ops);
+}
+
+static void merge_nlmv4_stats(struct nlmv4_stats *dst, struct nlmv4_stats *src)
+{
+	merge_op(&dst->ops, &src->ops);
+}
+
+/* Sum member _m_ of type _t_ over all slabs into stats->_m_
+ *
+ * Only the merge writes stats->_m_ once there are slabs (see
+ * get_slab()), and reset_gsh_stats() resets them together, so the sum
+ * replaces it.
+ */
+#define MERGE_SLABS(_stats_, _t_, _m_, _merge_)				\
+	do {								\
+		struct _t_ sum;						\
+		bool seen = false;					\
+		int i;							\
+									\
+		memset(&sum, 0, sizeof(sum));				\
+		for (i = 0; i < STATS_SLABS; i++) {			\
+			struct _t_ *sp = atomic_fetch_voidptr(		\
+				(void **)&(_stats_)->slabs[i]._m_);	\
+									\
+			if (sp != NULL) {				\
+				_merge_(&sum, sp);			\
+				seen = true;				\
+			}						\
+		}							\
+		if (seen) {						\
+			if ((_stats_)->_m_ == NULL)			\
+				(_stats_)->_m_ =			\
+				    gsh_calloc(1, sizeof(struct _t_));	\
+			*(_stats_)->_m_ = sum;				\
+		}							\
+	} while (0)
+
+/**
+ * @brief Bring the aggregated stats up to date
+ *
+ * Does nothing unless Enable_Per_Thread_Stats put something in slabs.
+ * Called by the DBus readers and the shared memory publisher before
+ * they look at @a stats.
+ *
+ * @param stats [IN] the aggregated stats
+ * @param lock  [IN] the lock in the stats owning struct
+ */
+
+void server_stats_merge(struct gsh_stats *stats, pthread_rwlock_t *lock)
+{
+	if (stats->slabs == NULL)
+		return;
+
+	PTHREAD_RWLOCK_wrlock(lock);
+	MERGE_SLABS(stats, nfsv3_stats, nfsv3, merge_nfsv3_stats);
+	MERGE_SLABS(stats, mnt_stats, mnt, merge_mnt_stats);
+	MERGE_SLABS(stats, nlmv4_stats, nlm4, merge_nlmv4_stats);
+	MERGE_SLABS(stats, rquota_stats, rquota, merge_rquota_stats);
+	MERGE_SLABS(stats, nfsv40_stats, nfsv40, merge_nfsv40_stats);
+	MERGE_SLABS(stats, nfsv41_stats, nfsv41, merge_nfsv41_stats);
+	MERGE_SLABS(stats, nfsv41_stats, nfsv42, merge_nfsv41_stats);
+	PTHREAD_RWLOCK_unlock(lock);
+}
+
+#ifdef USE_DBUS
+#ifdef _HAVE_GSSAPI
+/**
+ * @brief Report RPCSEC_GSS crypto time per service level
+ *
+ * @param iter [IN] the iterator to append to
+ */
+
+void server_dbus_gss_stats(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter, struct_iter;
+	struct gss_svc_stats *st;
+	struct timespec timestamp;
+	uint64_t requests, replies, offloaded;
+	uint64_t unwrap_avg, wrap_avg, queue_avg;
+	rpc_gss_svc_t svc;
+	char *name;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 GSS_STATS_REPLY_ARRAY_TYPE,
+					 &array_iter);
+	for (svc = RPCSEC_GSS_SVC_NONE; svc <= RPCSEC_GSS_SVC_PRIVACY;
+	     svc++) {
+		st = &gss_svc_stats[svc];
+		requests = atomic_fetch_uint64_t(&st->requests);
+		replies = atomic_fetch_uint64_t(&st->replies);
+		offloaded = atomic_fetch_uint64_t(&st->offloaded);
+		unwrap_avg = requests ?
+		    atomic_fetch_uint64_t(&st->unwrap_ns) / requests : 0;
+		wrap_avg = replies ?
+		    atomic_fetch_uint64_t(&st->wrap_ns) / replies : 0;
+		queue_avg = offloaded ?
+		    atomic_fetch_uint64_t(&st->queue_ns) / offloaded : 0;
+		name = (char *) str_gc_svc(svc);
+
+		dbus_message_iter_open_container(&array_iter,
+						 DBUS_TYPE_STRUCT, NULL,
+						 &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_STRING, &name);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &requests);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &unwrap_avg);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &replies);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &wrap_avg);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &offloaded);
+		dbus_message_iter_append_basic(&struct_iter,
+					       DBUS_TYPE_UINT64, &queue_avg);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+#endif
+
 #endif		/* USE_DBUS */
 
 /**
@@ -1181,6 +1593,36 @@ void server_stats_9p_done(u8 opc, struct _9p_request_data *req9p)
 }
 #endif
 
+static inline bool topk_enabled(void)
+{
+	return nfs_param.core_param.enable_TOP_TRACKING ||
+	       nfs_param.core_param.enable_USER_TRACKING;
+}
+
+/**
+ * @brief Count an operation of the handle, client and user of op_ctx
+ *
+ * @param[in] kind        Kind of operation
+ * @param[in] start_time  When it started
+ */
+static void record_topk_op(enum topk_class kind, nsecs_elapsed_t start_time)
+{
+	if (nfs_param.core_param.enable_TOP_TRACKING) {
+		if (op_ctx->top_fh != NULL && op_ctx->top_fh->len != 0)
+			server_topk_record(TOPK_HANDLE_OPS, op_ctx->top_fh,
+					   kind, 1);
+		server_topk_client(kind, 1, 0);
+	}
+	if (nfs_param.core_param.enable_USER_TRACKING) {
+		struct timespec current_time;
+
+		now(&current_time);
+		server_topk_user(kind, 1, 0,
+				 timespec_diff(&nfs_ServerBootTime,
+					       &current_time) - start_time);
+	}
+}
+
 /**
  * @brief record NFS op finished
  *
@@ -1195,6 +1637,20 @@ void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup)
 	struct svc_req *req = &reqdata->r_u.req.svc;
 	uint32_t proto_op = req->rq_msg.cb_proc;
 	uint32_t program_op = req->rq_msg.cb_prog;
+	bool lat_hist;
+
+	/* NFSv4 operations are counted one by one */
+	if (topk_enabled() && !dup &&
+	    !(program_op == NFS_PROGRAM && op_ctx->nfs_vers == NFS_V4)) {
+		enum topk_class kind = TOPK_META;
+
+		if (program_op == NFS_PROGRAM && proto_op == NFSPROC3_READ)
+			kind = TOPK_READ;
+		else if (program_op == NFS_PROGRAM &&
+			 proto_op == NFSPROC3_WRITE)
+			kind = TOPK_WRITE;
+		record_topk_op(kind, op_ctx->start_time);
+	}
 
 	if (!nfs_param.core_param.enable_NFSSTATS)
 		return;
@@ -1212,11 +1668,21 @@ void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup)
 
 	now(&current_time);
 	stop_time = timespec_diff(&nfs_ServerBootTime, &current_time);
+	lat_hist = nfs_param.core_param.enable_LATENCY_HIST && !dup &&
+		   program_op == NFS_PROGRAM && op_ctx->nfs_vers == NFS_V3;
+	if (lat_hist)
+		record_lat_hist(&global_st.lat, NFS_V3, proto_op,
+				stop_time - op_ctx->start_time);
 	if (client != NULL) {
 		struct server_stats *server_st;
 
 		server_st = container_of(client, struct server_stats, client);
-		record_stats(&server_st->st, &client->lock, reqdata,
+		if (lat_hist)
+			record_lat_hist(get_lat(&server_st->st, &client->lock),
+					NFS_V3, proto_op,
+					stop_time - op_ctx->start_time);
+		record_stats(get_slab(&server_st->st, &client->lock),
+			     &client->lock, reqdata,
 			     stop_time - op_ctx->start_time,
 			     op_ctx->queue_wait,
 			     rc == NFS_REQ_OK, dup, true);
@@ -1228,7 +1694,13 @@ void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup)
 		exp_st =
 		    container_of(op_ctx->ctx_export, struct export_stats,
 			    export);
-		record_stats(&exp_st->st, &op_ctx->ctx_export->lock, reqdata,
+		if (lat_hist)
+			record_lat_hist(get_lat(&exp_st->st,
+						&op_ctx->ctx_export->lock),
+					NFS_V3, proto_op,
+					stop_time - op_ctx->start_time);
+		record_stats(get_slab(&exp_st->st, &op_ctx->ctx_export->lock),
+			     &op_ctx->ctx_export->lock, reqdata,
 			     stop_time - op_ctx->start_time,
 			     op_ctx->queue_wait, rc == NFS_REQ_OK, dup, false);
 		(void)atomic_store_uint64_t(&op_ctx->ctx_export->last_update,
@@ -1248,6 +1720,31 @@ void server_stats_nfsv4_op_done(int proto_op,
 	struct gsh_client *client = op_ctx->client;
 	struct timespec current_time;
 	nsecs_elapsed_t stop_time;
+	bool lat_hist;
+
+	if (topk_enabled()) {
+		switch (proto_op) {
+		case NFS4_OP_PUTFH:
+		case NFS4_OP_PUTPUBFH:
+		case NFS4_OP_PUTROOTFH:
+		case NFS4_OP_GETFH:
+		case NFS4_OP_SAVEFH:
+		case NFS4_OP_RESTOREFH:
+		case NFS4_OP_SEQUENCE:
+			/* Only say what the others work on */
+			break;
+		case NFS4_OP_READ:
+		case NFS4_OP_READ_PLUS:
+			record_topk_op(TOPK_READ, start_time);
+			break;
+		case NFS4_OP_WRITE:
+			record_topk_op(TOPK_WRITE, start_time);
+			break;
+		default:
+			record_topk_op(TOPK_META, start_time);
+			break;
+		}
+	}
 
 	if (!nfs_param.core_param.enable_NFSSTATS)
 		return;
@@ -1259,12 +1756,21 @@ void server_stats_nfsv4_op_done(int proto_op,
 
 	now(&current_time);
 	stop_time = timespec_diff(&nfs_ServerBootTime, &current_time);
+	lat_hist = nfs_param.core_param.enable_LATENCY_HIST;
+	if (lat_hist)
+		record_lat_hist(&global_st.lat, NFS_V4, proto_op,
+				stop_time - start_time);
 
 	if (client != NULL) {
 		struct server_stats *server_st;
 
 		server_st = container_of(client, struct server_stats, client);
-		record_nfsv4_op(&server_st->st, &client->lock, proto_op,
+		if (lat_hist)
+			record_lat_hist(get_lat(&server_st->st, &client->lock),
+					NFS_V4, proto_op,
+					stop_time - start_time);
+		record_nfsv4_op(get_slab(&server_st->st, &client->lock),
+				&client->lock, proto_op,
 				op_ctx->nfs_minorvers, stop_time - start_time,
 				op_ctx->queue_wait, status);
 		(void)atomic_store_uint64_t(&client->last_update, stop_time);
@@ -1286,8 +1792,14 @@ void server_stats_nfsv4_op_done(int proto_op,
 		exp_st =
 		    container_of(op_ctx->ctx_export, struct export_stats,
 			    export);
-		record_nfsv4_op(&exp_st->st, &op_ctx->ctx_export->lock,
-				proto_op,
+		if (lat_hist)
+			record_lat_hist(get_lat(&exp_st->st,
+						&op_ctx->ctx_export->lock),
+					NFS_V4, proto_op,
+					stop_time - start_time);
+		record_nfsv4_op(get_slab(&exp_st->st,
+					 &op_ctx->ctx_export->lock),
+				&op_ctx->ctx_export->lock, proto_op,
 				op_ctx->nfs_minorvers, stop_time - start_time,
 				op_ctx->queue_wait, status);
 		(void)atomic_store_uint64_t(&op_ctx->ctx_export->last_update,
@@ -1315,7 +1827,8 @@ void server_stats_compound_done(int num_ops, int status)
 		struct server_stats *server_st;
 
 		server_st = container_of(client, struct server_stats, client);
-		record_compound(&server_st->st, &client->lock,
+		record_compound(get_slab(&server_st->st, &client->lock),
+				&client->lock,
 				op_ctx->nfs_minorvers,
 				num_ops, stop_time - op_ctx->start_time,
 				op_ctx->queue_wait, status == NFS4_OK);
@@ -1327,7 +1840,9 @@ void server_stats_compound_done(int num_ops, int status)
 		exp_st =
 		    container_of(op_ctx->ctx_export, struct export_stats,
 			    export);
-		record_compound(&exp_st->st, &op_ctx->ctx_export->lock,
+		record_compound(get_slab(&exp_st->st,
+					 &op_ctx->ctx_export->lock),
+				&op_ctx->ctx_export->lock,
 				op_ctx->nfs_minorvers, num_ops,
 				stop_time - op_ctx->start_time,
 				op_ctx->queue_wait, status == NFS4_OK);
@@ -1346,6 +1861,20 @@ void server_stats_compound_done(int num_ops, int status)
 void server_stats_io_done(size_t requested,
 			  size_t transferred, bool success, bool is_write)
 {
+	if (topk_enabled() && transferred != 0) {
+		enum topk_class kind = is_write ? TOPK_WRITE : TOPK_READ;
+
+		if (nfs_param.core_param.enable_TOP_TRACKING) {
+			if (op_ctx->top_fh != NULL && op_ctx->top_fh->len != 0)
+				server_topk_record(TOPK_HANDLE_BYTES,
+						   op_ctx->top_fh, kind,
+						   transferred);
+			server_topk_client(kind, 0, transferred);
+		}
+		if (nfs_param.core_param.enable_USER_TRACKING)
+			server_topk_user(kind, 0, transferred, 0);
+	}
+
 	if (!nfs_param.core_param.enable_NFSSTATS)
 		return;
 	if (op_ctx->client != NULL) {
@@ -1353,7 +1882,9 @@ void server_stats_io_done(size_t requested,
 
 		server_st = container_of(op_ctx->client, struct server_stats,
 					 client);
-		record_io_stats(&server_st->st, &op_ctx->client->lock,
+		record_io_stats(get_slab(&server_st->st,
+					 &op_ctx->client->lock),
+				&op_ctx->client->lock,
 				requested, transferred, success,
 				is_write);
 	}
@@ -1363,7 +1894,9 @@ void server_stats_io_done(size_t requested,
 		exp_st =
 		    container_of(op_ctx->ctx_export, struct export_stats,
 			    export);
-		record_io_stats(&exp_st->st, &op_ctx->ctx_export->lock,
+		record_io_stats(get_slab(&exp_st->st,
+					 &op_ctx->ctx_export->lock),
+				&op_ctx->ctx_export->lock,
 				requested, transferred, success, is_write);
 	}
 }
@@ -1391,6 +1924,7 @@ void inc_grants(struct gsh_client *client)
 		server_st = container_of(client, struct server_stats, client);
 		check_deleg_struct(&server_st->st, &client->lock);
 		server_st->st.deleg->curr_deleg_grants++;
+		server_st->st.deleg->tot_grants++;
 	}
 }
 void dec_grants(struct gsh_client *client)
@@ -1400,7 +1934,7 @@ void dec_grants(struct gsh_client *client)
 
 		server_st = container_of(client, struct server_stats, client);
 		check_deleg_struct(&server_st->st, &client->lock);
-		server_st->st.deleg->curr_deleg_grants++;
+		server_st->st.deleg->curr_deleg_grants--;
 	}
 }
 void inc_revokes(struct gsh_client *client)
@@ -1433,6 +1967,37 @@ void inc_failed_recalls(struct gsh_client *client)
 		server_st->st.deleg->failed_recalls++;
 	}
 }
+void inc_recalls_avoided(struct gsh_client *client)
+{
+	if (client != NULL) {
+		struct server_stats *server_st;
+
+		server_st = container_of(client, struct server_stats, client);
+		check_deleg_struct(&server_st->st, &client->lock);
+		server_st->st.deleg->recalls_avoided++;
+	}
+}
+void add_recall_latency(struct gsh_client *client, time_t latency)
+{
+	if (client != NULL) {
+		struct server_stats *server_st;
+
+		server_st = container_of(client, struct server_stats, client);
+		check_deleg_struct(&server_st->st, &client->lock);
+		server_st->st.deleg->recall_returns++;
+		server_st->st.deleg->recall_latency += latency;
+	}
+}
+
+/**
+ * @brief Count a request dropped before it was executed
+ *
+ * @param[in] why  What it was dropped for
+ */
+void server_stats_req_dropped(enum req_drop why)
+{
+	(void)atomic_inc_uint64_t(&req_drops[why]);
+}
 
 #ifdef USE_DBUS
 
@@ -1832,6 +2397,8 @@ void server_dbus_fill_io(DBusMessageIter *array_iter, uint16_t *export_id,
 void server_dbus_all_iostats(struct export_stats *export_statistics,
 			     DBusMessageIter *array_iter)
 {
+	server_stats_merge(&export_statistics->st,
+			   &export_statistics->export.lock);
 	if (export_statistics->st.nfsv3 != NULL) {
 		server_dbus_fill_io(array_iter,
 				    &(export_statistics->export.export_id),
@@ -1865,6 +2432,16 @@ void server_dbus_all_iostats(struct export_stats *export_statistics,
 	}
 }
 
+static void reset_lat_hists(struct lat_hists *lat)
+{
+	int i;
+
+	for (i = 0; i <= NFSPROC3_COMMIT; i++)
+		lat_hist_reset(lat->v3[i]);
+	for (i = 0; i < NFS4_OP_LAST_ONE; i++)
+		lat_hist_reset(lat->v4[i]);
+}
+
 void reset_gsh_stats(struct gsh_stats *st)
 {
 	if (st->nfsv3)
@@ -1883,12 +2460,32 @@ void reset_gsh_stats(struct gsh_stats *st)
 		reset_nlmv4_stats(st->nlm4);
 	if (st->deleg)
 		reset_deleg_stats(st->deleg);
+	if (st->lat)
+		reset_lat_hists(st->lat);
+	if (st->slabs) {
+		int i;
+
+		for (i = 0; i < STATS_SLABS; i++)
+			reset_gsh_stats(&st->slabs[i]);
+	}
 #ifdef _USE_9P
 	if (st->_9p)
 		reset__9P_stats(st->_9p);
 #endif
 }
 
+static void reset_stage_hists(struct stage_hists *stages)
+{
+	int i, j;
+
+	for (j = 0; j < REQ_STAGE_COUNT; j++) {
+		for (i = 0; i <= NFSPROC3_COMMIT; i++)
+			lat_hist_reset(stages->v3[i][j]);
+		for (i = 0; i <= NFS4_OP_LAST_ONE; i++)
+			lat_hist_reset(stages->v4[i][j]);
+	}
+}
+
 void reset_global_stats(void)
 {
 	int i;
@@ -1919,6 +2516,10 @@ void reset_global_stats(void)
 	reset_mnt_stats(&global_st.mnt);
 	reset_rquota_stats(&global_st.rquota);
 	reset_nlmv4_stats(&global_st.nlm4);
+	reset_lat_hists(&global_st.lat);
+	reset_stage_hists(&global_st.stages);
+	for (i = 0; i < REQ_DROP_COUNT; i++)
+		(void)atomic_store_uint64_t(&req_drops[i], 0);
 }
 
 void server_dbus_total_ops(struct export_stats *export_st,
@@ -1949,6 +2550,256 @@ void global_dbus_total_ops(DBusMessageIter *iter)
 	global_dbus_total(iter);
 }
 
+/**
+ * @brief Parse the NFS version and operation of a histogram query
+ *
+ * @param args      [IN] DBus arguments, at the version
+ * @param compound  [IN] whether COMPOUND is an NFSv4 operation, given
+ *                       as NFS4_OP_LAST_ONE
+ * @param nfs_vers  [OUT] NFS_V3 or NFS_V4
+ * @param opcode    [OUT] procedure or NFSv4 operation
+ * @param errormsg  [OUT] why the arguments are wrong
+ *
+ * @return true if the arguments name an operation
+ */
+bool arg_lat_hist_op(DBusMessageIter *args, bool compound, int *nfs_vers,
+		     uint32_t *opcode, char **errormsg)
+{
+	const struct op_name *optab;
+	char *version, *opname;
+	uint32_t nops, i;
+
+	if (args == NULL ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_STRING) {
+		*errormsg = "NFS version is not a string";
+		return false;
+	}
+	dbus_message_iter_get_basic(args, &version);
+	if (strcmp(version, "NFSv3") == 0) {
+		*nfs_vers = NFS_V3;
+		optab = optabv3;
+		nops = NFSPROC3_COMMIT + 1;
+	} else if (strcmp(version, "NFSv4") == 0) {
+		*nfs_vers = NFS_V4;
+		optab = optabv4;
+		nops = NFS4_OP_LAST_ONE;
+	} else {
+		*errormsg = "NFS version must be NFSv3 or NFSv4";
+		return false;
+	}
+
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_STRING) {
+		*errormsg = "Operation name is not a string";
+		return false;
+	}
+	dbus_message_iter_get_basic(args, &opname);
+	if (compound && *nfs_vers == NFS_V4 &&
+	    strcmp(opname, "COMPOUND") == 0) {
+		*opcode = NFS4_OP_LAST_ONE;
+		return true;
+	}
+	for (i = 0; i < nops; i++) {
+		if (optab[i].name != NULL && strcmp(opname, optab[i].name) == 0)
+			break;
+	}
+	if (i == nops) {
+		*errormsg = "Unknown operation";
+		return false;
+	}
+	*opcode = i;
+	return true;
+}
+
+/**
+ * @brief Report a latency histogram
+ *
+ * struct lat_hist {
+ *	uint64_t total;
+ *	uint64_t p50, p90, p99, p999;	(in nsecs)
+ *	struct {
+ *		uint64_t low;		(smallest latency in the bucket)
+ *		uint64_t count;
+ *	} buckets[];			(non-empty buckets only)
+ * }
+ *
+ * The shards are merged here, so the counts are a consistent enough
+ * view without stopping the workers.
+ *
+ * @param st        [IN] client or export stats, NULL for the server
+ * @param nfs_vers  [IN] NFS_V3 or NFS_V4
+ * @param opcode    [IN] procedure or NFSv4 operation
+ * @param iter      [IN] iterator in reply stream to fill
+ */
+void server_dbus_lat_hist(struct gsh_stats *st, int nfs_vers,
+			  uint32_t opcode, DBusMessageIter *iter)
+{
+	struct lat_hists *lat = st != NULL ? st->lat : &global_st.lat;
+	struct lat_hist *hist = NULL;
+	struct timespec timestamp;
+
+	if (lat != NULL)
+		hist = atomic_fetch_voidptr(nfs_vers == NFS_V3 ?
+					    (void **)&lat->v3[opcode] :
+					    (void **)&lat->v4[opcode]);
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_append_lat_hist(iter, hist);
+}
+
+/**
+ * @brief Report the stage histograms of an operation
+ *
+ * An array of (stage name, histogram in the LAT_HIST_REPLY layout),
+ * for the stages of Enable_Stage_Histograms: decode, queue, execute,
+ * fsal and reply.
+ *
+ * @param nfs_vers  [IN] NFS_V3 or NFS_V4
+ * @param opcode    [IN] procedure, NFSv4 operation or NFS4_OP_LAST_ONE
+ *                       for COMPOUNDs
+ * @param iter      [IN] iterator in reply stream to fill
+ */
+void server_dbus_stage_hists(int nfs_vers, uint32_t opcode,
+			     DBusMessageIter *iter)
+{
+	struct lat_hist **hists = nfs_vers == NFS_V3
+		? global_st.stages.v3[opcode] : global_st.stages.v4[opcode];
+	DBusMessageIter array_iter, stage_iter;
+	struct timespec timestamp;
+	int i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 "(s(ttttta(tt)))", &array_iter);
+	for (i = 0; i < REQ_STAGE_COUNT; i++) {
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &stage_iter);
+		dbus_message_iter_append_basic(&stage_iter, DBUS_TYPE_STRING,
+					       &req_stage_names[i]);
+		dbus_append_lat_hist(&stage_iter,
+				     atomic_fetch_voidptr((void **)&hists[i]));
+		dbus_message_iter_close_container(&array_iter, &stage_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+
+/**
+ * @brief Get the limits of a SetThrottle call
+ *
+ * @param args      [IN] iterator at the IOPS argument
+ * @param iops      [OUT] operations per second
+ * @param bandwidth [OUT] bytes per second
+ * @param errormsg  [OUT] reason for failure
+ *
+ * @return true if both limits were there
+ */
+bool arg_throttle(DBusMessageIter *args, uint64_t *iops, uint64_t *bandwidth,
+		  char **errormsg)
+{
+	if (args == NULL ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT64) {
+		*errormsg = "IOPS limit is not a uint64";
+		return false;
+	}
+	dbus_message_iter_get_basic(args, iops);
+
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT64) {
+		*errormsg = "Bandwidth limit is not a uint64";
+		return false;
+	}
+	dbus_message_iter_get_basic(args, bandwidth);
+	return true;
+}
+
+/**
+ * @brief Report a request throttle
+ *
+ * struct throttle {
+ *	bool overridden;	(limits were set over DBus)
+ *	uint64_t iops;		(0 for unlimited)
+ *	uint64_t bandwidth;	(bytes per second, 0 for unlimited)
+ *	uint64_t delayed;	(requests let through over budget)
+ *	uint64_t deferred;	(requests the client was told to retry)
+ *	uint64_t delay_ns;	(total time those were over budget by)
+ * }
+ *
+ * @param throttle  [IN] the throttle
+ * @param iops      [IN] operation limit in effect
+ * @param bandwidth [IN] byte limit in effect
+ * @param iter      [IN] iterator in reply stream to fill
+ */
+void server_dbus_throttle(struct gsh_throttle *throttle, uint64_t iops,
+			  uint64_t bandwidth, DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter struct_iter;
+	dbus_bool_t overridden;
+	uint64_t delayed, deferred, delay_ns;
+
+	PTHREAD_MUTEX_lock(&throttle->mtx);
+	overridden = throttle->overridden;
+	if (overridden) {
+		iops = throttle->iops;
+		bandwidth = throttle->bandwidth;
+	}
+	delayed = throttle->delayed;
+	deferred = throttle->deferred;
+	delay_ns = throttle->delay_ns;
+	PTHREAD_MUTEX_unlock(&throttle->mtx);
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_BOOLEAN,
+				       &overridden);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &iops);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &bandwidth);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &delayed);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &deferred);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &delay_ns);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+
+/**
+ * @brief Report the requests dropped before execution
+ *
+ * struct drops {
+ *	uint64_t xprt;		(their connection was gone)
+ *	uint64_t duplicate;	(a retransmission was in progress)
+ *	uint64_t age;		(older than Max_Request_Age)
+ * }
+ *
+ * @param iter   [IN] iterator in reply stream to fill
+ */
+void server_dbus_req_drops(DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter struct_iter;
+	uint64_t count;
+	int i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	for (i = 0; i < REQ_DROP_COUNT; i++) {
+		count = atomic_fetch_uint64_t(&req_drops[i]);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &count);
+	}
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+
 void reset_server_stats(void)
 {
 	reset_global_stats();
@@ -2052,6 +2903,7 @@ void server_dbus_delegations(struct deleg_stats *ds, DBusMessageIter *iter)
 {
 	struct timespec timestamp;
 	DBusMessageIter struct_iter;
+	uint32_t avg_latency;
 
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
@@ -2065,6 +2917,14 @@ void server_dbus_delegations(struct deleg_stats *ds, DBusMessageIter *iter)
 				       &ds->failed_recalls);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
 				       &ds->num_revokes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &ds->tot_grants);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &ds->recalls_avoided);
+	avg_latency = ds->recall_returns == 0 ? 0 :
+		      ds->recall_latency / ds->recall_returns;
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+				       &avg_latency);
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
 
@@ -2109,6 +2969,24 @@ void server_stats_free(struct gsh_stats *statsp)
 		gsh_free(statsp->nfsv42);
 		statsp->nfsv42 = NULL;
 	}
+	if (statsp->lat != NULL) {
+		int i;
+
+		for (i = 0; i <= NFSPROC3_COMMIT; i++)
+			gsh_free(statsp->lat->v3[i]);
+		for (i = 0; i < NFS4_OP_LAST_ONE; i++)
+			gsh_free(statsp->lat->v4[i]);
+		gsh_free(statsp->lat);
+		statsp->lat = NULL;
+	}
+	if (statsp->slabs != NULL) {
+		int i;
+
+		for (i = 0; i < STATS_SLABS; i++)
+			server_stats_free(&statsp->slabs[i]);
+		gsh_free(statsp->slabs);
+		statsp->slabs = NULL;
+	}
 #ifdef _USE_9P
 	if (statsp->_9p != NULL) {
 		u8 opc;
@@ -2123,4 +3001,99 @@ void server_stats_free(struct gsh_stats *statsp)
 #endif
 }
 
+
+static void shm_ops(struct gsh_stats_shm_ops *dst, struct proto_op *src)
+{
+	dst->ops = src->total;
+	dst->errors = src->errors;
+	dst->latency = src->latency.latency;
+	dst->queue_latency = src->queue_latency.latency;
+}
+
+static void shm_io(struct gsh_stats_shm_io *dst, struct xfer_op *src)
+{
+	shm_ops(&dst->cmd, &src->cmd);
+	dst->requested = src->requested;
+	dst->transferred = src->transferred;
+}
+
+static void shm_v3(struct gsh_stats_shm_proto_stats *dst,
+		   struct nfsv3_stats *src)
+{
+	shm_ops(&dst->ops, &src->cmds);
+	shm_io(&dst->read, &src->read);
+	shm_io(&dst->write, &src->write);
+}
+
+static void shm_v40(struct gsh_stats_shm_proto_stats *dst,
+		    struct nfsv40_stats *src)
+{
+	shm_ops(&dst->ops, &src->compounds);
+	shm_io(&dst->read, &src->read);
+	shm_io(&dst->write, &src->write);
+}
+
+static void shm_v41(struct gsh_stats_shm_proto_stats *dst,
+		    struct nfsv41_stats *src)
+{
+	shm_ops(&dst->ops, &src->compounds);
+	shm_io(&dst->read, &src->read);
+	shm_io(&dst->write, &src->write);
+}
+
+/**
+ * @brief Copy the server wide stats for the shared memory publisher
+ *
+ * @param hdr   [OUT] header receiving the per operation counts
+ * @param entry [OUT] entry receiving the totals
+ */
+
+void server_stats_shm_server(struct gsh_stats_shm_hdr *hdr,
+			     struct gsh_stats_shm_entry *entry)
+{
+	int i;
+
+	for (i = 0; i < GSH_STATS_SHM_V3_OPS && i <= NFSPROC3_COMMIT; i++) {
+		if (optabv3[i].name != NULL)
+			strlcpy(hdr->v3_ops[i].name, optabv3[i].name,
+				sizeof(hdr->v3_ops[i].name));
+		hdr->v3_ops[i].count = global_st.v3.op[i];
+	}
+	for (i = 0; i < GSH_STATS_SHM_V4_OPS && i < NFS4_OP_LAST_ONE; i++) {
+		if (optabv4[i].name != NULL)
+			strlcpy(hdr->v4_ops[i].name, optabv4[i].name,
+				sizeof(hdr->v4_ops[i].name));
+		hdr->v4_ops[i].count = global_st.v4.op[i];
+	}
+
+	shm_v3(&entry->proto[GSH_STATS_SHM_NFSV3], &global_st.nfsv3);
+	shm_v40(&entry->proto[GSH_STATS_SHM_NFSV40], &global_st.nfsv40);
+	shm_v41(&entry->proto[GSH_STATS_SHM_NFSV41], &global_st.nfsv41);
+	shm_v41(&entry->proto[GSH_STATS_SHM_NFSV42], &global_st.nfsv42);
+}
+
+/**
+ * @brief Copy export or client stats for the shared memory publisher
+ *
+ * @param st    [IN]  the stats
+ * @param lock  [IN]  the lock in the stats owning struct
+ * @param entry [OUT] entry receiving them, protocols never used are
+ *                    left alone
+ */
+
+void server_stats_shm_fill(struct gsh_stats *st, pthread_rwlock_t *lock,
+			   struct gsh_stats_shm_entry *entry)
+{
+	server_stats_merge(st, lock);
+
+	if (st->nfsv3 != NULL)
+		shm_v3(&entry->proto[GSH_STATS_SHM_NFSV3], st->nfsv3);
+	if (st->nfsv40 != NULL)
+		shm_v40(&entry->proto[GSH_STATS_SHM_NFSV40], st->nfsv40);
+	if (st->nfsv41 != NULL)
+		shm_v41(&entry->proto[GSH_STATS_SHM_NFSV41], st->nfsv41);
+	if (st->nfsv42 != NULL)
+		shm_v41(&entry->proto[GSH_STATS_SHM_NFSV42], st->nfsv42);
+}
+
 /** @} */
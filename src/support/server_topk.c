@@ -0,0 +1,531 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file server_topk.c
+ * @brief Hottest handles and clients
+ *
+ * A summary is a min-heap of its entries by count, to find the one to
+ * push out, and hash chains to find a key.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/param.h>
+#include "abstract_atomic.h"
+#include "abstract_mem.h"
+#include "common_utils.h"
+#include "city.h"
+#include "display.h"
+#include "gsh_config.h"
+#include "gsh_intrinsic.h"
+#include "client_mgr.h"
+#include "fsal.h"
+#include "server_topk.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+/** Summaries of each tracker and interval, one per shard */
+#define TOPK_SHARDS 8
+
+#define TOPK_NONE UINT32_MAX
+
+struct topk_entry {
+	struct topk_key key;
+	uint64_t count;
+	uint64_t error;		/*< Most of count that may not be its own */
+	uint64_t sub[TOPK_CLASSES];
+	uint32_t next;		/*< In its hash chain */
+	uint32_t heap_ix;
+};
+
+struct topk_summary {
+	uint64_t epoch;		/*< Interval counted, 0 if none */
+	uint32_t nentries;
+	uint32_t *chains;
+	uint32_t *heap;		/*< Smallest count first */
+	struct topk_entry *entries;
+};
+
+struct topk_shard {
+	pthread_mutex_t mtx;
+	uint32_t size;		/*< Entries of a summary */
+	uint32_t nchains;	/*< Power of two */
+	struct topk_summary sum[TOPK_TRACKERS][TOPK_EPOCHS];
+};
+
+static struct topk_shard *topk_shards[TOPK_SHARDS];
+static uint32_t topk_next_shard;
+static __thread int topk_shard_ix = -1;
+
+/**
+ * @brief Fill in a key
+ *
+ * @param[out] key  Key
+ * @param[in]  buf  Handle or client address
+ * @param[in]  len  Its length
+ */
+void server_topk_key(struct topk_key *key, const char *buf, uint32_t len)
+{
+	key->len = len;
+	if (len == 0)
+		return;
+	key->hash = CityHash64(buf, len);
+	memcpy(key->key, buf, MIN(len, TOPK_KEY_MAX));
+}
+
+static inline bool topk_key_eq(const struct topk_key *a,
+			       const struct topk_key *b)
+{
+	return a->hash == b->hash && a->len == b->len &&
+	       memcmp(a->key, b->key, MIN(a->len, TOPK_KEY_MAX)) == 0;
+}
+
+static uint32_t topk_find(const uint32_t *chains, uint32_t nchains,
+			  const struct topk_entry *entries,
+			  const struct topk_key *key)
+{
+	uint32_t ix = chains[key->hash & (nchains - 1)];
+
+	while (ix != TOPK_NONE && !topk_key_eq(&entries[ix].key, key))
+		ix = entries[ix].next;
+	return ix;
+}
+
+static void topk_link(uint32_t *chains, uint32_t nchains,
+		      struct topk_entry *entries, uint32_t ix)
+{
+	uint32_t *chain = &chains[entries[ix].key.hash & (nchains - 1)];
+
+	entries[ix].next = *chain;
+	*chain = ix;
+}
+
+static void topk_unlink(uint32_t *chains, uint32_t nchains,
+			struct topk_entry *entries, uint32_t ix)
+{
+	uint32_t *prev = &chains[entries[ix].key.hash & (nchains - 1)];
+
+	while (*prev != ix)
+		prev = &entries[*prev].next;
+	*prev = entries[ix].next;
+}
+
+static void topk_heap_set(struct topk_summary *sum, uint32_t pos,
+			  uint32_t ix)
+{
+	sum->heap[pos] = ix;
+	sum->entries[ix].heap_ix = pos;
+}
+
+static void topk_sift_up(struct topk_summary *sum, uint32_t pos)
+{
+	uint32_t ix = sum->heap[pos];
+	uint64_t count = sum->entries[ix].count;
+
+	while (pos > 0) {
+		uint32_t parent = (pos - 1) / 2;
+
+		if (sum->entries[sum->heap[parent]].count <= count)
+			break;
+		topk_heap_set(sum, pos, sum->heap[parent]);
+		pos = parent;
+	}
+	topk_heap_set(sum, pos, ix);
+}
+
+static void topk_sift_down(struct topk_summary *sum, uint32_t pos)
+{
+	uint32_t ix = sum->heap[pos];
+	uint64_t count = sum->entries[ix].count;
+
+	for (;;) {
+		uint32_t child = 2 * pos + 1;
+
+		if (child >= sum->nentries)
+			break;
+		if (child + 1 < sum->nentries &&
+		    sum->entries[sum->heap[child + 1]].count <
+		    sum->entries[sum->heap[child]].count)
+			child++;
+		if (sum->entries[sum->heap[child]].count >= count)
+			break;
+		topk_heap_set(sum, pos, sum->heap[child]);
+		pos = child;
+	}
+	topk_heap_set(sum, pos, ix);
+}
+
+/**
+ * @brief Get the calling thread's shard, allocating it on first use
+ */
+static struct topk_shard *topk_get_shard(void)
+{
+	struct topk_shard *shard;
+	struct topk_entry *entries;
+	uint32_t *heap, *chains;
+	uint32_t size, nchains, i, j;
+
+	if (unlikely(topk_shard_ix < 0))
+		topk_shard_ix = atomic_inc_uint32_t(&topk_next_shard) %
+				TOPK_SHARDS;
+
+	shard = atomic_fetch_voidptr((void **)&topk_shards[topk_shard_ix]);
+	if (likely(shard != NULL))
+		return shard;
+
+	size = nfs_param.core_param.top_tracking_entries;
+	for (nchains = 1; nchains < 2 * size; nchains <<= 1)
+		;
+
+	shard = gsh_calloc(1, sizeof(*shard));
+	entries = gsh_calloc(TOPK_TRACKERS * TOPK_EPOCHS * size,
+			     sizeof(*entries));
+	heap = gsh_calloc(TOPK_TRACKERS * TOPK_EPOCHS * size, sizeof(*heap));
+	chains = gsh_calloc(TOPK_TRACKERS * TOPK_EPOCHS * nchains,
+			    sizeof(*chains));
+	PTHREAD_MUTEX_init(&shard->mtx, NULL);
+	shard->size = size;
+	shard->nchains = nchains;
+	for (i = 0; i < TOPK_TRACKERS; i++) {
+		for (j = 0; j < TOPK_EPOCHS; j++) {
+			struct topk_summary *sum = &shard->sum[i][j];
+
+			sum->entries = entries;
+			entries += size;
+			sum->heap = heap;
+			heap += size;
+			sum->chains = chains;
+			chains += nchains;
+		}
+	}
+
+	if (!__sync_bool_compare_and_swap(&topk_shards[topk_shard_ix], NULL,
+					  shard)) {
+		/* Somebody beat us to it */
+		PTHREAD_MUTEX_destroy(&shard->mtx);
+		gsh_free(shard->sum[0][0].entries);
+		gsh_free(shard->sum[0][0].heap);
+		gsh_free(shard->sum[0][0].chains);
+		gsh_free(shard);
+		shard = atomic_fetch_voidptr(
+			(void **)&topk_shards[topk_shard_ix]);
+	}
+
+	return shard;
+}
+
+static inline uint64_t topk_epoch(void)
+{
+	return time(NULL) / nfs_param.core_param.top_tracking_interval;
+}
+
+/**
+ * @brief Count some weight for a key
+ *
+ * @param[in] tracker  What is counted
+ * @param[in] key      Handle or client
+ * @param[in] kind     Kind of operation the weight is for
+ * @param[in] weight   Operations or bytes
+ */
+void server_topk_record(enum topk_tracker tracker,
+			const struct topk_key *key, enum topk_class kind,
+			uint64_t weight)
+{
+	struct topk_shard *shard = topk_get_shard();
+	uint64_t epoch = topk_epoch();
+	struct topk_summary *sum = &shard->sum[tracker][epoch % TOPK_EPOCHS];
+	struct topk_entry *entry;
+	uint32_t ix;
+
+	PTHREAD_MUTEX_lock(&shard->mtx);
+
+	if (sum->epoch != epoch) {
+		/* Forget the interval this one counted last */
+		sum->epoch = epoch;
+		sum->nentries = 0;
+		memset(sum->chains, 0xff, shard->nchains * sizeof(uint32_t));
+	}
+
+	ix = topk_find(sum->chains, shard->nchains, sum->entries, key);
+	if (ix != TOPK_NONE) {
+		entry = &sum->entries[ix];
+		entry->count += weight;
+		entry->sub[kind] += weight;
+		topk_sift_down(sum, entry->heap_ix);
+	} else if (sum->nentries < shard->size) {
+		ix = sum->nentries++;
+		entry = &sum->entries[ix];
+		entry->key = *key;
+		entry->count = weight;
+		entry->error = 0;
+		memset(entry->sub, 0, sizeof(entry->sub));
+		entry->sub[kind] = weight;
+		topk_link(sum->chains, shard->nchains, sum->entries, ix);
+		topk_heap_set(sum, ix, ix);
+		topk_sift_up(sum, ix);
+	} else {
+		/* Take over the smallest count */
+		ix = sum->heap[0];
+		entry = &sum->entries[ix];
+		topk_unlink(sum->chains, shard->nchains, sum->entries, ix);
+		entry->key = *key;
+		entry->error = entry->count;
+		entry->count += weight;
+		memset(entry->sub, 0, sizeof(entry->sub));
+		entry->sub[kind] = weight;
+		topk_link(sum->chains, shard->nchains, sum->entries, ix);
+		topk_sift_down(sum, 0);
+	}
+
+	PTHREAD_MUTEX_unlock(&shard->mtx);
+}
+
+/**
+ * @brief Count an operation and its bytes for the client of op_ctx
+ *
+ * @param[in] kind   Kind of operation
+ * @param[in] ops    Operations, 0 to only count bytes
+ * @param[in] bytes  Bytes read or written
+ */
+void server_topk_client(enum topk_class kind, uint64_t ops,
+			uint64_t bytes)
+{
+	struct gsh_client *client = op_ctx->client;
+	struct topk_key key;
+
+	if (client == NULL || client->hostaddr_str == NULL)
+		return;
+
+	server_topk_key(&key, client->hostaddr_str,
+			strlen(client->hostaddr_str));
+	if (ops != 0)
+		server_topk_record(TOPK_CLIENT_OPS, &key, kind, ops);
+	if (bytes != 0)
+		server_topk_record(TOPK_CLIENT_BYTES, &key, kind, bytes);
+}
+
+/**
+ * @brief Count an operation, its bytes and time for the user of op_ctx
+ *
+ * The user is the uid the request credentials resolved to, before
+ * squashing; anonymous requests count for the anonymous uid.
+ *
+ * @param[in] kind   Kind of operation
+ * @param[in] ops    Operations, 0 to only count bytes
+ * @param[in] bytes  Bytes read or written
+ * @param[in] nsecs  Time the operations took
+ */
+void server_topk_user(enum topk_class kind, uint64_t ops, uint64_t bytes,
+		      uint64_t nsecs)
+{
+	struct topk_key key;
+	char buf[16];
+	uid_t uid;
+	int len;
+
+	if (op_ctx->creds == NULL ||
+	    (op_ctx->cred_flags & CREDS_LOADED) == 0)
+		return;
+
+	if ((op_ctx->cred_flags & CREDS_ANON) != 0)
+		uid = op_ctx->creds->caller_uid;
+	else
+		uid = op_ctx->original_creds.caller_uid;
+
+	len = snprintf(buf, sizeof(buf), "%u", (unsigned int) uid);
+	server_topk_key(&key, buf, len);
+	if (ops != 0)
+		server_topk_record(TOPK_USER_OPS, &key, kind, ops);
+	if (bytes != 0)
+		server_topk_record(TOPK_USER_BYTES, &key, kind, bytes);
+	if (nsecs != 0)
+		server_topk_record(TOPK_USER_TIME, &key, kind, nsecs);
+}
+
+/**
+ * @brief Forget everything counted
+ */
+void server_topk_reset(void)
+{
+	struct topk_shard *shard;
+	int i, j, k;
+
+	for (i = 0; i < TOPK_SHARDS; i++) {
+		shard = atomic_fetch_voidptr((void **)&topk_shards[i]);
+		if (shard == NULL)
+			continue;
+		PTHREAD_MUTEX_lock(&shard->mtx);
+		for (j = 0; j < TOPK_TRACKERS; j++)
+			for (k = 0; k < TOPK_EPOCHS; k++)
+				shard->sum[j][k].epoch = 0;
+		PTHREAD_MUTEX_unlock(&shard->mtx);
+	}
+}
+
+#ifdef USE_DBUS
+
+static int topk_cmp(const void *a, const void *b)
+{
+	uint64_t ca = ((const struct topk_entry *)a)->count;
+	uint64_t cb = ((const struct topk_entry *)b)->count;
+
+	return ca < cb ? 1 : ca > cb ? -1 : 0;
+}
+
+/**
+ * @brief Report the top keys of a tracker over a window
+ *
+ * The summaries of the intervals overlapping the last window seconds
+ * are added up, so the window is rounded up to whole intervals and
+ * cut to the TOPK_EPOCHS last ones.  A key's error adds up the errors
+ * of the summaries it was in, a key a summary dropped is not counted
+ * in it at all.
+ *
+ * A timestamp, the seconds covered, then for each key by decreasing
+ * count: the key, count, error and the read, write and other parts of
+ * the count.  Handles are shown in hex, ending with "..." if they were
+ * longer than TOPK_KEY_MAX.
+ *
+ * @param tracker  [IN] what is counted
+ * @param window   [IN] seconds to look back
+ * @param count    [IN] most keys to report, 0 for all of them
+ * @param iter     [IN] iterator in reply stream to fill
+ */
+void server_topk_dbus(enum topk_tracker tracker, uint32_t window,
+		      uint32_t count, DBusMessageIter *iter)
+{
+	uint32_t interval = nfs_param.core_param.top_tracking_interval;
+	struct topk_entry *merged;
+	uint32_t *chains;
+	uint32_t nmerged = 0, max = 0, nchains, nepochs, covered, i, j, ix;
+	DBusMessageIter array_iter, key_iter;
+	struct timespec timestamp;
+	time_t secs = time(NULL);
+	uint64_t epoch = secs / interval;
+	char str[2 * TOPK_KEY_MAX + 32];
+	char *keystr = str;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	nepochs = (window + interval - 1) / interval;
+	if (nepochs == 0)
+		nepochs = 1;
+	if (nepochs > TOPK_EPOCHS)
+		nepochs = TOPK_EPOCHS;
+	covered = (nepochs - 1) * interval + secs % interval + 1;
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_UINT32, &covered);
+
+	for (i = 0; i < TOPK_SHARDS; i++) {
+		struct topk_shard *shard;
+
+		shard = atomic_fetch_voidptr((void **)&topk_shards[i]);
+		if (shard != NULL)
+			max += nepochs * shard->size;
+	}
+	for (nchains = 1; nchains < 2 * max; nchains <<= 1)
+		;
+	merged = gsh_malloc((max + 1) * sizeof(*merged));
+	chains = gsh_malloc(nchains * sizeof(*chains));
+	memset(chains, 0xff, nchains * sizeof(*chains));
+
+	for (i = 0; i < TOPK_SHARDS; i++) {
+		struct topk_shard *shard;
+
+		shard = atomic_fetch_voidptr((void **)&topk_shards[i]);
+		if (shard == NULL)
+			continue;
+
+		PTHREAD_MUTEX_lock(&shard->mtx);
+		for (j = 0; j < nepochs && j <= epoch; j++) {
+			struct topk_summary *sum =
+				&shard->sum[tracker][(epoch - j) % TOPK_EPOCHS];
+			uint32_t k, c;
+
+			if (sum->epoch != epoch - j)
+				continue;
+
+			for (k = 0; k < sum->nentries; k++) {
+				struct topk_entry *entry = &sum->entries[k];
+
+				ix = topk_find(chains, nchains, merged,
+					       &entry->key);
+				if (ix == TOPK_NONE) {
+					ix = nmerged++;
+					merged[ix] = *entry;
+					topk_link(chains, nchains, merged, ix);
+					continue;
+				}
+				merged[ix].count += entry->count;
+				merged[ix].error += entry->error;
+				for (c = 0; c < TOPK_CLASSES; c++)
+					merged[ix].sub[c] += entry->sub[c];
+			}
+		}
+		PTHREAD_MUTEX_unlock(&shard->mtx);
+	}
+
+	qsort(merged, nmerged, sizeof(*merged), topk_cmp);
+	if (count == 0 || count > nmerged)
+		count = nmerged;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(sttttt)",
+					 &array_iter);
+	for (i = 0; i < count; i++) {
+		struct topk_entry *entry = &merged[i];
+		struct display_buffer dspbuf = {sizeof(str), str, str};
+		uint32_t len = MIN(entry->key.len, TOPK_KEY_MAX);
+
+		if (tracker == TOPK_HANDLE_OPS || tracker == TOPK_HANDLE_BYTES)
+			(void) display_opaque_bytes(&dspbuf, entry->key.key,
+						    len);
+		else
+			(void) display_len_cat(&dspbuf, entry->key.key, len);
+		if (entry->key.len > TOPK_KEY_MAX)
+			(void) display_cat(&dspbuf, "...");
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &key_iter);
+		dbus_message_iter_append_basic(&key_iter, DBUS_TYPE_STRING,
+					       &keystr);
+		dbus_message_iter_append_basic(&key_iter, DBUS_TYPE_UINT64,
+					       &entry->count);
+		dbus_message_iter_append_basic(&key_iter, DBUS_TYPE_UINT64,
+					       &entry->error);
+		for (j = 0; j < TOPK_CLASSES; j++)
+			dbus_message_iter_append_basic(&key_iter,
+						       DBUS_TYPE_UINT64,
+						       &entry->sub[j]);
+		dbus_message_iter_close_container(&array_iter, &key_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	gsh_free(chains);
+	gsh_free(merged);
+}
+#endif				/* USE_DBUS */
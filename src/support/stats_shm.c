@@ -0,0 +1,670 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file stats_shm.c
+ * @brief Stats published in shared memory, and over HTTP
+ *
+ * A looper thread copies the counters into the Stats_Shm_File
+ * mapping, see gsh_stats_shm.h for the layout.  With Stats_HTTP_Port
+ * another looper serves that file in the Prometheus text format.  It
+ * maps the file like any outside reader would, so neither a scrape
+ * nor its size makes a serving thread wait.
+ */
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "log.h"
+#include "abstract_atomic.h"
+#include "abstract_mem.h"
+#include "common_utils.h"
+#include "fridgethr.h"
+#include "nfs_core.h"
+#include "client_mgr.h"
+#include "export_mgr.h"
+#include "server_stats_private.h"
+#include "gsh_stats_shm.h"
+
+/** Entries of room kept beyond those in use, so that a few new
+ *  exports or clients don't remap the file. */
+#define STATS_SHM_SLACK 64
+
+/** Times a reader retries a snapshot torn by an update */
+#define STATS_SHM_RETRIES 16
+
+/** Publisher state, only touched by the publisher thread */
+static struct {
+	int fd;			/*< The shared file */
+	struct gsh_stats_shm_hdr *hdr;	/*< Its mapping */
+	size_t mapped;		/*< Bytes mapped */
+	uint32_t capacity;	/*< Entries that fit in the mapping */
+	uint32_t next;		/*< Entry being filled */
+} shm = {
+	.fd = -1,
+};
+
+static struct fridgethr *stats_shm_fridge;
+static struct fridgethr *stats_http_fridge;
+
+/** The listening socket of the HTTP endpoint */
+static int http_fd = -1;
+
+/**
+ * @brief Make room for a number of entries
+ *
+ * @param[in] entries Entries needed
+ *
+ * @return 0 on success, an errno otherwise.
+ */
+
+static int stats_shm_grow(uint32_t entries)
+{
+	size_t size;
+	void *map;
+
+	if (entries <= shm.capacity)
+		return 0;
+
+	entries += STATS_SHM_SLACK;
+	size = sizeof(struct gsh_stats_shm_hdr) +
+	       entries * sizeof(struct gsh_stats_shm_entry);
+
+	if (ftruncate(shm.fd, size) != 0)
+		return errno;
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm.fd, 0);
+	if (map == MAP_FAILED)
+		return errno;
+
+	if (shm.hdr != NULL)
+		munmap(shm.hdr, shm.mapped);
+
+	shm.hdr = map;
+	shm.mapped = size;
+	shm.capacity = entries;
+	return 0;
+}
+
+static bool stats_shm_count_export(struct gsh_export *exp, void *state)
+{
+	++*(uint32_t *)state;
+	return true;
+}
+
+static bool stats_shm_count_client(struct gsh_client *cl, void *state)
+{
+	++*(uint32_t *)state;
+	return true;
+}
+
+static bool stats_shm_export(struct gsh_export *exp, void *state)
+{
+	struct gsh_stats_shm_entry *entry;
+
+	if (shm.next == shm.capacity)
+		return false;
+
+	entry = &shm.hdr->entry[shm.next++];
+	entry->kind = GSH_STATS_SHM_EXPORT;
+	entry->id = exp->export_id;
+	strlcpy(entry->name,
+		exp->pseudopath != NULL ? exp->pseudopath : exp->fullpath,
+		sizeof(entry->name));
+	server_stats_shm_fill(&container_of(exp, struct export_stats,
+					    export)->st,
+			      &exp->lock, entry);
+	return true;
+}
+
+static bool stats_shm_client(struct gsh_client *cl, void *state)
+{
+	struct gsh_stats_shm_entry *entry;
+
+	if (shm.next == shm.capacity)
+		return false;
+
+	entry = &shm.hdr->entry[shm.next++];
+	entry->kind = GSH_STATS_SHM_CLIENT;
+	entry->id = 0;
+	strlcpy(entry->name, cl->hostaddr_str, sizeof(entry->name));
+	server_stats_shm_fill(&container_of(cl, struct server_stats,
+					    client)->st,
+			      &cl->lock, entry);
+	return true;
+}
+
+/**
+ * @brief Publish the stats once
+ *
+ * @param[in] ctx Thread context
+ */
+
+static void stats_shm_run(struct fridgethr_context *ctx)
+{
+	struct gsh_stats_shm_hdr *hdr;
+	struct timespec ts;
+	uint32_t entries = 1;
+	int rc;
+
+	SetNameFunction("stats_shm");
+
+	(void) foreach_gsh_export(stats_shm_count_export, false, &entries);
+	(void) foreach_gsh_client(stats_shm_count_client, &entries);
+
+	rc = stats_shm_grow(entries);
+	if (rc != 0) {
+		LogWarn(COMPONENT_MAIN,
+			"Could not grow %s to %" PRIu32 " entries: %s",
+			nfs_param.core_param.stats_shm_file, entries,
+			strerror(rc));
+	}
+
+	hdr = shm.hdr;
+	(void) atomic_inc_uint32_t(&hdr->seq);
+
+	memset(hdr->entry, 0,
+	       shm.capacity * sizeof(struct gsh_stats_shm_entry));
+	hdr->entry[0].kind = GSH_STATS_SHM_SERVER;
+	server_stats_shm_server(hdr, &hdr->entry[0]);
+	shm.next = 1;
+	(void) foreach_gsh_export(stats_shm_export, false, NULL);
+	(void) foreach_gsh_client(stats_shm_client, NULL);
+
+	now(&ts);
+	hdr->nentries = shm.next;
+	hdr->size = sizeof(struct gsh_stats_shm_hdr) +
+		    shm.next * sizeof(struct gsh_stats_shm_entry);
+	hdr->timestamp = timespec_to_nsecs(&ts);
+
+	(void) atomic_inc_uint32_t(&hdr->seq);
+}
+
+/**
+ * @brief Take a consistent copy of the published stats
+ *
+ * @param[out] len Bytes copied
+ *
+ * @return The copy, to be freed by the caller, or NULL.
+ */
+
+static struct gsh_stats_shm_hdr *stats_shm_snapshot(size_t *len)
+{
+	struct gsh_stats_shm_hdr *map, *copy = NULL;
+	struct stat st;
+	uint32_t seq;
+	int retry;
+	int fd;
+
+	fd = open(nfs_param.core_param.stats_shm_file, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) != 0 ||
+	    st.st_size < (off_t) sizeof(struct gsh_stats_shm_hdr)) {
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	for (retry = 0; retry < STATS_SHM_RETRIES; retry++) {
+		seq = atomic_fetch_uint32_t(&map->seq);
+		if (seq & 1) {
+			usleep(1000);
+			continue;
+		}
+
+		*len = MIN(atomic_fetch_uint64_t(&map->size), st.st_size);
+		copy = gsh_realloc(copy, *len);
+		memcpy(copy, map, *len);
+
+		if (atomic_fetch_uint32_t(&map->seq) == seq)
+			break;
+	}
+	munmap(map, st.st_size);
+
+	if (retry == STATS_SHM_RETRIES) {
+		gsh_free(copy);
+		return NULL;
+	}
+
+	/* Never trust more entries than were copied */
+	copy->nentries =
+	    MIN(copy->nentries,
+		(*len - sizeof(struct gsh_stats_shm_hdr)) /
+		sizeof(struct gsh_stats_shm_entry));
+	return copy;
+}
+
+static const char *const stats_shm_kinds[] = {
+	[GSH_STATS_SHM_SERVER] = "server",
+	[GSH_STATS_SHM_EXPORT] = "export",
+	[GSH_STATS_SHM_CLIENT] = "client",
+};
+
+static const char *const stats_shm_protos[GSH_STATS_SHM_PROTOS] = {
+	[GSH_STATS_SHM_NFSV3] = "nfsv3",
+	[GSH_STATS_SHM_NFSV40] = "nfsv40",
+	[GSH_STATS_SHM_NFSV41] = "nfsv41",
+	[GSH_STATS_SHM_NFSV42] = "nfsv42",
+};
+
+/**
+ * @brief A counter of the per protocol stats
+ */
+
+struct stats_shm_metric {
+	const char *name;
+	const char *help;
+	size_t offset;		/*< Into struct gsh_stats_shm_proto_stats */
+	bool ns;		/*< Nanoseconds, reported as seconds */
+};
+
+#define STATS_SHM_METRIC(_n, _h, _f, _ns) \
+	{ _n, _h, offsetof(struct gsh_stats_shm_proto_stats, _f), _ns }
+
+static const struct stats_shm_metric stats_shm_metrics[] = {
+	STATS_SHM_METRIC("ganesha_requests_total",
+			 "NFSv3 calls or NFSv4 COMPOUNDs", ops.ops, false),
+	STATS_SHM_METRIC("ganesha_request_errors_total",
+			 "Requests that failed", ops.errors, false),
+	STATS_SHM_METRIC("ganesha_request_latency_seconds_total",
+			 "Time spent executing requests", ops.latency, true),
+	STATS_SHM_METRIC("ganesha_request_queue_seconds_total",
+			 "Time requests waited to be executed",
+			 ops.queue_latency, true),
+	STATS_SHM_METRIC("ganesha_read_ops_total",
+			 "READ operations", read.cmd.ops, false),
+	STATS_SHM_METRIC("ganesha_read_bytes_total",
+			 "Bytes read", read.transferred, false),
+	STATS_SHM_METRIC("ganesha_read_latency_seconds_total",
+			 "Time spent executing READs", read.cmd.latency, true),
+	STATS_SHM_METRIC("ganesha_write_ops_total",
+			 "WRITE operations", write.cmd.ops, false),
+	STATS_SHM_METRIC("ganesha_write_bytes_total",
+			 "Bytes written", write.transferred, false),
+	STATS_SHM_METRIC("ganesha_write_latency_seconds_total",
+			 "Time spent executing WRITEs", write.cmd.latency,
+			 true),
+};
+
+/**
+ * @brief Print a label value, escaped as Prometheus wants it
+ */
+
+static void stats_http_label(FILE *out, const char *val, size_t max)
+{
+	size_t i;
+
+	for (i = 0; i < max && val[i] != '\0'; i++) {
+		if (val[i] == '\\' || val[i] == '"')
+			fputc('\\', out);
+		if (val[i] == '\n')
+			fputs("\\n", out);
+		else
+			fputc(val[i], out);
+	}
+}
+
+static void stats_http_ops(FILE *out, const char *proto,
+			   const struct gsh_stats_shm_op *ops, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (ops[i].name[0] == '\0')
+			continue;
+		fprintf(out, "ganesha_nfs_ops_total{proto=\"%s\",op=\"", proto);
+		stats_http_label(out, ops[i].name, sizeof(ops[i].name));
+		fprintf(out, "\"} %" PRIu64 "\n", ops[i].count);
+	}
+}
+
+/**
+ * @brief Format the published stats in the Prometheus text format
+ *
+ * @param[in]  snap The stats
+ * @param[out] len  Length of the text
+ *
+ * @return The text, to be freed by the caller.
+ */
+
+static char *stats_http_format(struct gsh_stats_shm_hdr *snap, size_t *len)
+{
+	char *text = NULL;
+	FILE *out = open_memstream(&text, len);
+	const struct stats_shm_metric *m;
+	uint32_t i;
+	int p;
+
+	if (out == NULL)
+		return NULL;
+
+	fputs("# HELP ganesha_stats_timestamp_seconds "
+	      "Time the stats were taken\n"
+	      "# TYPE ganesha_stats_timestamp_seconds gauge\n", out);
+	fprintf(out, "ganesha_stats_timestamp_seconds %.3f\n",
+		snap->timestamp / 1e9);
+
+	fputs("# HELP ganesha_nfs_ops_total Operations executed\n"
+	      "# TYPE ganesha_nfs_ops_total counter\n", out);
+	stats_http_ops(out, "nfsv3", snap->v3_ops, GSH_STATS_SHM_V3_OPS);
+	stats_http_ops(out, "nfsv4", snap->v4_ops, GSH_STATS_SHM_V4_OPS);
+
+	for (m = stats_shm_metrics;
+	     m < stats_shm_metrics +
+		 sizeof(stats_shm_metrics) / sizeof(stats_shm_metrics[0]);
+	     m++) {
+		fprintf(out, "# HELP %s %s\n# TYPE %s counter\n",
+			m->name, m->help, m->name);
+		for (i = 0; i < snap->nentries; i++) {
+			struct gsh_stats_shm_entry *e = &snap->entry[i];
+
+			if (e->kind < GSH_STATS_SHM_SERVER ||
+			    e->kind > GSH_STATS_SHM_CLIENT)
+				continue;
+
+			for (p = 0; p < GSH_STATS_SHM_PROTOS; p++) {
+				uint64_t val = *(uint64_t *)
+				    ((char *)&e->proto[p] + m->offset);
+
+				if (e->proto[p].ops.ops == 0)
+					continue;
+
+				fprintf(out, "%s{kind=\"%s\",proto=\"%s\"",
+					m->name, stats_shm_kinds[e->kind],
+					stats_shm_protos[p]);
+				if (e->kind == GSH_STATS_SHM_EXPORT)
+					fprintf(out, ",id=\"%" PRIu32 "\"",
+						e->id);
+				if (e->kind != GSH_STATS_SHM_SERVER) {
+					fputs(",name=\"", out);
+					stats_http_label(out, e->name,
+							 sizeof(e->name));
+					fputc('"', out);
+				}
+				if (m->ns)
+					fprintf(out, "} %.9f\n", val / 1e9);
+				else
+					fprintf(out, "} %" PRIu64 "\n", val);
+			}
+		}
+	}
+
+	fclose(out);
+	return text;
+}
+
+static void stats_http_write(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, buf, len);
+		if (n <= 0)
+			return;
+		buf += n;
+		len -= n;
+	}
+}
+
+/**
+ * @brief Answer one HTTP request
+ *
+ * Whatever is asked, the answer is the metrics.
+ *
+ * @param[in] fd The connection
+ */
+
+static void stats_http_serve(int fd)
+{
+	struct timeval tv = { 1, 0 };
+	struct gsh_stats_shm_hdr *snap;
+	char req[1024];
+	char head[128];
+	char *text = NULL;
+	size_t len = 0;
+	int n;
+
+	(void) setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	(void) setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	if (read(fd, req, sizeof(req)) <= 0)
+		return;
+
+	snap = stats_shm_snapshot(&len);
+	if (snap != NULL) {
+		text = stats_http_format(snap, &len);
+		gsh_free(snap);
+	}
+
+	if (text == NULL) {
+		static const char busy[] =
+		    "HTTP/1.0 503 Service Unavailable\r\n"
+		    "Content-Length: 0\r\n\r\n";
+
+		stats_http_write(fd, busy, sizeof(busy) - 1);
+		return;
+	}
+
+	n = snprintf(head, sizeof(head),
+		     "HTTP/1.0 200 OK\r\n"
+		     "Content-Type: text/plain; version=0.0.4\r\n"
+		     "Content-Length: %zu\r\n\r\n", len);
+	stats_http_write(fd, head, n);
+	stats_http_write(fd, text, len);
+	free(text);
+}
+
+/**
+ * @brief Serve HTTP requests until told to stop
+ *
+ * @param[in] ctx Thread context
+ */
+
+static void stats_http_run(struct fridgethr_context *ctx)
+{
+	struct pollfd pfd = { .fd = http_fd, .events = POLLIN };
+	int fd;
+
+	SetNameFunction("stats_http");
+
+	while (!fridgethr_you_should_break(ctx)) {
+		if (poll(&pfd, 1, 1000) <= 0)
+			continue;
+
+		fd = accept(http_fd, NULL, NULL);
+		if (fd < 0)
+			continue;
+
+		stats_http_serve(fd);
+		close(fd);
+	}
+}
+
+/**
+ * @brief Open the HTTP endpoint
+ *
+ * It listens on Bind_Addr, at Stats_HTTP_Port.
+ *
+ * @return 0 on success, an errno otherwise.
+ */
+
+static int stats_http_listen(void)
+{
+	struct sockaddr_storage addr = nfs_param.core_param.bind_addr;
+	uint16_t port = htons(nfs_param.core_param.stats_http_port);
+	socklen_t len;
+	int one = 1;
+
+	if (addr.ss_family == AF_INET6) {
+		((struct sockaddr_in6 *)&addr)->sin6_port = port;
+		len = sizeof(struct sockaddr_in6);
+	} else {
+		((struct sockaddr_in *)&addr)->sin_port = port;
+		len = sizeof(struct sockaddr_in);
+	}
+
+	http_fd = socket(addr.ss_family, SOCK_STREAM, 0);
+	if (http_fd < 0)
+		return errno;
+
+	(void) setsockopt(http_fd, SOL_SOCKET, SO_REUSEADDR, &one,
+			  sizeof(one));
+	if (bind(http_fd, (struct sockaddr *)&addr, len) != 0 ||
+	    listen(http_fd, 16) != 0) {
+		int rc = errno;
+
+		close(http_fd);
+		http_fd = -1;
+		return rc;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Start publishing the stats
+ *
+ * Nothing happens unless Stats_Shm_File is set.  Failures are logged,
+ * the server runs without published stats.
+ */
+
+void stats_shm_start(void)
+{
+	const char *file = nfs_param.core_param.stats_shm_file;
+	struct fridgethr_params frp;
+	int rc;
+
+	if (file == NULL)
+		return;
+
+	shm.fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (shm.fd < 0) {
+		LogCrit(COMPONENT_INIT, "Could not create %s: %s",
+			file, strerror(errno));
+		return;
+	}
+
+	rc = stats_shm_grow(1);
+	if (rc != 0) {
+		LogCrit(COMPONENT_INIT, "Could not map %s: %s",
+			file, strerror(rc));
+		close(shm.fd);
+		shm.fd = -1;
+		return;
+	}
+	shm.hdr->magic = GSH_STATS_SHM_MAGIC;
+	shm.hdr->version = GSH_STATS_SHM_VERSION;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = nfs_param.core_param.stats_shm_interval;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&stats_shm_fridge, "stats_shm", &frp);
+	if (rc == 0)
+		rc = fridgethr_submit(stats_shm_fridge, stats_shm_run, NULL);
+	if (rc != 0) {
+		LogCrit(COMPONENT_INIT,
+			"Unable to start stats publisher thread: %d", rc);
+		return;
+	}
+
+	if (nfs_param.core_param.stats_http_port == 0)
+		return;
+
+	rc = stats_http_listen();
+	if (rc != 0) {
+		LogCrit(COMPONENT_INIT,
+			"Could not listen for stats on port %" PRIu16 ": %s",
+			nfs_param.core_param.stats_http_port, strerror(rc));
+		return;
+	}
+
+	frp.thread_delay = 1;
+	rc = fridgethr_init(&stats_http_fridge, "stats_http", &frp);
+	if (rc == 0)
+		rc = fridgethr_submit(stats_http_fridge, stats_http_run, NULL);
+	if (rc != 0)
+		LogCrit(COMPONENT_INIT,
+			"Unable to start stats HTTP thread: %d", rc);
+}
+
+static void stats_shm_stop(struct fridgethr **fr)
+{
+	int rc;
+
+	if (*fr == NULL)
+		return;
+
+	rc = fridgethr_sync_command(*fr, fridgethr_comm_stop, 120);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_THREAD,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(*fr);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Failed shutting down stats thread: %d", rc);
+	}
+	fridgethr_destroy(*fr);
+	*fr = NULL;
+}
+
+/**
+ * @brief Stop publishing the stats
+ *
+ * The file is left behind with the last stats published.
+ */
+
+void stats_shm_shutdown(void)
+{
+	stats_shm_stop(&stats_http_fridge);
+	if (http_fd >= 0) {
+		close(http_fd);
+		http_fd = -1;
+	}
+
+	stats_shm_stop(&stats_shm_fridge);
+	if (shm.hdr != NULL) {
+		munmap(shm.hdr, shm.mapped);
+		shm.hdr = NULL;
+	}
+	if (shm.fd >= 0) {
+		close(shm.fd);
+		shm.fd = -1;
+	}
+}
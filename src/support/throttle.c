@@ -0,0 +1,300 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright 2026 Contributors to the NFS-Ganesha project
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file throttle.c
+ * @brief Per-client and per-export request throttling
+ */
+
+#include "config.h"
+#include <string.h>
+#include <time.h>
+#include "log.h"
+#include "fsal.h"
+#include "nfs_core.h"
+#include "client_mgr.h"
+#include "export_mgr.h"
+#include "gsh_throttle.h"
+
+/**
+ * @brief Initialize a throttle with no limits
+ *
+ * @param[in] throttle  The throttle
+ */
+void throttle_init(struct gsh_throttle *throttle)
+{
+	memset(throttle, 0, sizeof(*throttle));
+	PTHREAD_MUTEX_init(&throttle->mtx, NULL);
+	glist_init(&throttle->buckets);
+}
+
+/**
+ * @brief Release a throttle
+ *
+ * @param[in] throttle  The throttle
+ */
+void throttle_destroy(struct gsh_throttle *throttle)
+{
+	struct throttle_bucket *bucket;
+
+	while ((bucket = glist_first_entry(&throttle->buckets,
+					   struct throttle_bucket,
+					   node)) != NULL) {
+		glist_del(&bucket->node);
+		gsh_free(bucket);
+	}
+
+	PTHREAD_MUTEX_destroy(&throttle->mtx);
+}
+
+/**
+ * @brief Find or make a client's buckets for an export
+ *
+ * @param[in] throttle   The client's throttle, locked
+ * @param[in] export_id  The export
+ *
+ * @return The arrival times of the buckets.
+ */
+static struct throttle_tat *throttle_bucket(struct gsh_throttle *throttle,
+					    uint16_t export_id)
+{
+	struct glist_head *glist;
+	struct throttle_bucket *bucket;
+
+	glist_for_each(glist, &throttle->buckets) {
+		bucket = glist_entry(glist, struct throttle_bucket, node);
+		if (bucket->export_id == export_id)
+			return &bucket->tat;
+	}
+
+	bucket = gsh_calloc(1, sizeof(*bucket));
+	bucket->export_id = export_id;
+	glist_add(&throttle->buckets, &bucket->node);
+
+	return &bucket->tat;
+}
+
+/**
+ * @brief Override the configured limits
+ *
+ * @param[in] throttle   The throttle
+ * @param[in] iops       Operations per second, 0 for unlimited
+ * @param[in] bandwidth  Bytes per second, 0 for unlimited
+ * @param[in] overridden Whether these win over the configuration
+ */
+void throttle_set(struct gsh_throttle *throttle, uint64_t iops,
+		  uint64_t bandwidth, bool overridden)
+{
+	PTHREAD_MUTEX_lock(&throttle->mtx);
+	throttle->iops = iops;
+	throttle->bandwidth = bandwidth;
+	throttle->overridden = overridden;
+	PTHREAD_MUTEX_unlock(&throttle->mtx);
+}
+
+/**
+ * @brief Go back to the configured limits
+ *
+ * @param[in] throttle  The throttle
+ */
+void throttle_clear(struct gsh_throttle *throttle)
+{
+	throttle_set(throttle, 0, 0, false);
+}
+
+/**
+ * @brief Work out how long a cost must wait against one bucket
+ *
+ * @param[in]  tat     Current theoretical arrival time
+ * @param[in]  now_ns  Now
+ * @param[in]  cost    Operations or bytes
+ * @param[in]  rate    Per second, not 0
+ * @param[out] new_tat Arrival time once the cost is charged
+ *
+ * @return Nanoseconds to wait
+ */
+static uint64_t bucket_wait(uint64_t tat, uint64_t now_ns, uint64_t cost,
+			    uint64_t rate, uint64_t *new_tat)
+{
+	if (tat < now_ns)
+		tat = now_ns;
+
+	*new_tat = tat + cost * NS_PER_SEC / rate;
+
+	if (*new_tat <= now_ns + THROTTLE_BURST_NS)
+		return 0;
+
+	return *new_tat - now_ns - THROTTLE_BURST_NS;
+}
+
+/**
+ * @brief Work out how long a request must wait against a pair of buckets
+ *
+ * @param[in]  tat       Arrival times of the buckets, locked
+ * @param[in]  iops      Operation limit in effect
+ * @param[in]  bandwidth Byte limit in effect
+ * @param[in]  now_ns    Now
+ * @param[in]  bytes     Bytes the request moves
+ * @param[out] new_tat   Arrival times once it is charged
+ *
+ * @return Nanoseconds to wait
+ */
+static uint64_t throttle_wait(const struct throttle_tat *tat, uint64_t iops,
+			      uint64_t bandwidth, uint64_t now_ns,
+			      uint64_t bytes, struct throttle_tat *new_tat)
+{
+	uint64_t wait = 0, bytes_wait;
+
+	*new_tat = *tat;
+
+	if (iops != 0)
+		wait = bucket_wait(tat->ops, now_ns, 1, iops, &new_tat->ops);
+
+	if (bandwidth != 0 && bytes != 0) {
+		bytes_wait = bucket_wait(tat->bytes, now_ns, bytes,
+					 bandwidth, &new_tat->bytes);
+		if (bytes_wait > wait)
+			wait = bytes_wait;
+	}
+
+	return wait;
+}
+
+/**
+ * @brief Charge a request against its client and export
+ *
+ * Must be called with op_ctx set up for the request.  The limits the
+ * export's client entries set are kept against the client's buckets
+ * for that export.  The request never waits here, a worker held back
+ * for one client would be one less for all the others.
+ *
+ * @param[in] bytes  Bytes read or written, 0 for other operations
+ *
+ * @retval 0 the request may go ahead.
+ * @retval -1 the request is more than Throttle_Max_Delay over budget;
+ *	      the client should retry it later.
+ */
+int nfs_throttle(uint64_t bytes)
+{
+	struct gsh_client *client = op_ctx->client;
+	struct gsh_export *export = op_ctx->ctx_export;
+	struct gsh_throttle *ct = client != NULL ? &client->throttle : NULL;
+	struct gsh_throttle *et = export != NULL ? &export->throttle : NULL;
+	uint64_t c_iops = 0, c_bw = 0, e_iops = 0, e_bw = 0;
+	uint64_t c_wait = 0, e_wait = 0, wait;
+	struct throttle_tat *c_tat = NULL, c_new, e_new;
+	bool per_export = false;
+	uint64_t max_wait;
+	struct timespec ts;
+	uint64_t now_ns;
+
+	if (ct != NULL) {
+		if (atomic_fetch_uint32_t(&ct->overridden)) {
+			c_iops = atomic_fetch_uint64_t(&ct->iops);
+			c_bw = atomic_fetch_uint64_t(&ct->bandwidth);
+		} else if (op_ctx->export_perms != NULL) {
+			c_iops = op_ctx->export_perms->max_iops;
+			c_bw = op_ctx->export_perms->max_bandwidth;
+			per_export = export != NULL;
+		}
+		if (c_iops == 0 && c_bw == 0)
+			ct = NULL;
+	}
+
+	if (et != NULL) {
+		if (atomic_fetch_uint32_t(&et->overridden)) {
+			e_iops = atomic_fetch_uint64_t(&et->iops);
+			e_bw = atomic_fetch_uint64_t(&et->bandwidth);
+		} else {
+			e_iops = atomic_fetch_uint64_t(&export->max_iops);
+			e_bw = atomic_fetch_uint64_t(&export->max_bandwidth);
+		}
+		if (e_iops == 0 && e_bw == 0)
+			et = NULL;
+	}
+
+	if (ct == NULL && et == NULL)
+		return 0;
+
+	max_wait = (uint64_t) nfs_param.core_param.throttle_max_delay *
+		   NS_PER_MSEC;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now_ns = timespec_to_nsecs(&ts);
+
+	/* Always client before export */
+	if (ct != NULL) {
+		PTHREAD_MUTEX_lock(&ct->mtx);
+		c_tat = per_export ? throttle_bucket(ct, export->export_id)
+				   : &ct->tat;
+		c_wait = throttle_wait(c_tat, c_iops, c_bw, now_ns, bytes,
+				       &c_new);
+	}
+
+	if (et != NULL) {
+		PTHREAD_MUTEX_lock(&et->mtx);
+		e_wait = throttle_wait(&et->tat, e_iops, e_bw, now_ns, bytes,
+				       &e_new);
+	}
+
+	wait = c_wait > e_wait ? c_wait : e_wait;
+
+	if (wait > max_wait) {
+		/* Don't charge work we are turning away */
+		if (c_wait > max_wait)
+			ct->deferred++;
+		if (e_wait > max_wait)
+			et->deferred++;
+	} else {
+		if (ct != NULL) {
+			*c_tat = c_new;
+			if (c_wait != 0) {
+				ct->delayed++;
+				ct->delay_ns += c_wait;
+			}
+		}
+		if (et != NULL) {
+			et->tat = e_new;
+			if (e_wait != 0) {
+				et->delayed++;
+				et->delay_ns += e_wait;
+			}
+		}
+	}
+
+	if (et != NULL)
+		PTHREAD_MUTEX_unlock(&et->mtx);
+	if (ct != NULL)
+		PTHREAD_MUTEX_unlock(&ct->mtx);
+
+	if (wait > max_wait) {
+		LogDebug(COMPONENT_DISPATCH,
+			 "Request from %s for export %d over budget by %"
+			 PRIu64 " ns, deferring",
+			 client != NULL ? client->hostaddr_str : "unknown",
+			 export != NULL ? export->export_id : -1, wait);
+		return -1;
+	}
+
+	return 0;
+}
@@ -45,8 +45,51 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "common_utils.h"
+#include "abstract_atomic.h"
+#include "fridgethr.h"
 #include "uid2grp.h"
 
+/**
+ * @brief A group list being looked up
+ *
+ * Only one thread looks up the groups of a given user at a time,
+ * others wanting the same user wait for it and use what it cached.
+ */
+
+struct uid2grp_pending {
+	struct glist_head list;	/*< Entry in uid2grp_pending_list */
+	pthread_cond_t cv;	/*< Signalled when done */
+	bool done;		/*< The lookup is finished */
+	int refcount;		/*< Looking up thread and waiters */
+	bool by_name;		/*< Looked up by name, rather than UID */
+	uid_t uid;
+	struct gsh_buffdesc name;
+};
+
+/**
+ * @brief Lock protecting the lookups in flight
+ */
+
+static pthread_mutex_t uid2grp_pending_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Lookups in flight, there are at most a few
+ */
+
+static GLIST_HEAD(uid2grp_pending_list);
+
+/**
+ * @brief Threads looking up group lists before they expire
+ */
+
+static struct fridgethr *uid2grp_fridge;
+
+/**
+ * @brief Most group lists looked up ahead of expiry at once
+ */
+
+#define UID2GRP_PREFETCH_THREADS 4
+
 /* group_data has a reference counter. If it goes to zero, it implies
  * that it is out of the cache (AVL trees) and should be freed. The
  * reference count is 1 when we put it into AVL trees. We decrement when
@@ -199,6 +242,7 @@ static struct group_data *uid2grp_allocate_by_name(
 	PTHREAD_MUTEX_init(&gdata->lock, NULL);
 	gdata->epoch = time(NULL);
 	gdata->refcount = 0;
+	gdata->prefetching = 0;
 	return gdata;
 }
 
@@ -246,96 +290,309 @@ static struct group_data *uid2grp_allocate_by_uid(uid_t uid)
 	PTHREAD_MUTEX_init(&gdata->lock, NULL);
 	gdata->epoch = time(NULL);
 	gdata->refcount = 0;
+	gdata->prefetching = 0;
 	return gdata;
 }
 
+#define uid2grp_expired(gdata) (time(NULL) - (gdata)->epoch > \
+		nfs_param.core_param.manage_gids_expiration)
+
+/* Group lists are looked up again once they are this close to expiry */
+#define uid2grp_prefetch_due(gdata) (time(NULL) - (gdata)->epoch > \
+		nfs_param.core_param.manage_gids_expiration -	\
+		nfs_param.core_param.manage_gids_expiration / 4)
+
+static bool uid2grp_pending_match(struct uid2grp_pending *pending,
+				  const struct gsh_buffdesc *name, uid_t uid)
+{
+	if (name == NULL)
+		return !pending->by_name && pending->uid == uid;
+
+	return pending->by_name && pending->name.len == name->len &&
+	       memcmp(pending->name.addr, name->addr, name->len) == 0;
+}
+
+static void uid2grp_pending_put(struct uid2grp_pending *pending)
+{
+	if (--pending->refcount != 0)
+		return;
+
+	pthread_cond_destroy(&pending->cv);
+	gsh_free(pending);
+}
+
 /**
- * @brief Get supplementary groups given uname
+ * @brief Start to look up the groups of a user
  *
- * @param[in]  name  The name of the user
- * @param[out]  group_data
+ * @param[in] name  Name of the user, or NULL to look up by uid
+ * @param[in] uid   UID of the user
+ * @param[in] wait  Wait for a lookup of the same user in flight
  *
- * @return true if successful, false otherwise
+ * @return The lookup to finish with uid2grp_pending_done(), or NULL if
+ *         another thread looked up the user.
  */
-#define uid2grp_expired(gdata) (time(NULL) - (gdata)->epoch > \
-		nfs_param.core_param.manage_gids_expiration)
-bool name2grp(const struct gsh_buffdesc *name, struct group_data **gdata)
+
+static struct uid2grp_pending *uid2grp_pending_start(
+					const struct gsh_buffdesc *name,
+					uid_t uid, bool wait)
 {
-	bool success = false;
-	uid_t uid = -1;
+	struct uid2grp_pending *pending;
+	struct glist_head *glist;
+	size_t len = name != NULL ? name->len : 0;
 
-	PTHREAD_RWLOCK_rdlock(&uid2grp_user_lock);
-	success = uid2grp_lookup_by_uname(name, &uid, gdata);
+	PTHREAD_MUTEX_lock(&uid2grp_pending_lock);
 
-	/* Handle common case first */
-	if (success && !uid2grp_expired(*gdata)) {
-		uid2grp_hold_group_data(*gdata);
-		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
-		return success;
+	glist_for_each(glist, &uid2grp_pending_list) {
+		pending = glist_entry(glist, struct uid2grp_pending, list);
+
+		if (!uid2grp_pending_match(pending, name, uid))
+			continue;
+
+		if (wait) {
+			pending->refcount++;
+			while (!pending->done)
+				pthread_cond_wait(&pending->cv,
+						  &uid2grp_pending_lock);
+			uid2grp_pending_put(pending);
+		}
+
+		PTHREAD_MUTEX_unlock(&uid2grp_pending_lock);
+		return NULL;
 	}
-	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
 
-	if (success) {
+	pending = gsh_calloc(1, sizeof(struct uid2grp_pending) + len);
+	pthread_cond_init(&pending->cv, NULL);
+	pending->refcount = 1;
+	pending->by_name = name != NULL;
+	pending->uid = uid;
+	pending->name.addr = (char *)pending + sizeof(struct uid2grp_pending);
+	pending->name.len = len;
+	if (len != 0)
+		memcpy(pending->name.addr, name->addr, len);
+	glist_add_tail(&uid2grp_pending_list, &pending->list);
+
+	PTHREAD_MUTEX_unlock(&uid2grp_pending_lock);
+
+	return pending;
+}
+
+/**
+ * @brief Finish looking up the groups of a user and wake the waiters
+ */
+
+static void uid2grp_pending_done(struct uid2grp_pending *pending)
+{
+	PTHREAD_MUTEX_lock(&uid2grp_pending_lock);
+
+	glist_del(&pending->list);
+	pending->done = true;
+	pthread_cond_broadcast(&pending->cv);
+	uid2grp_pending_put(pending);
+
+	PTHREAD_MUTEX_unlock(&uid2grp_pending_lock);
+}
+
+/**
+ * @brief Look up the groups of a user and cache them
+ *
+ * @param[in] name    Name of the user, or NULL to look up by uid
+ * @param[in] uid     UID of the user
+ * @param[in] expired Remove the cached groups first
+ */
+
+static void uid2grp_fetch(const struct gsh_buffdesc *name, uid_t uid,
+			  bool expired)
+{
+	struct group_data *gdata;
+
+	if (expired) {
 		/* Cache entry is expired */
 		PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-		uid2grp_remove_by_uname(name);
+		if (name != NULL)
+			uid2grp_remove_by_uname(name);
+		else
+			uid2grp_remove_by_uid(uid);
 		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
 	}
 
-	*gdata = uid2grp_allocate_by_name(name);
-	PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-	if (*gdata)
-		uid2grp_add_user(*gdata);
-	success = uid2grp_lookup_by_uname(name, &uid, gdata);
-	if (success)
-		uid2grp_hold_group_data(*gdata);
-	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+	if (name != NULL)
+		gdata = uid2grp_allocate_by_name(name);
+	else
+		gdata = uid2grp_allocate_by_uid(uid);
 
-	return success;
+	if (gdata) {
+		PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
+		uid2grp_add_user(gdata);
+		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+	}
 }
 
 /**
- * @brief Get supplementary groups given uid
+ * @brief A user whose groups are about to expire
+ */
+
+struct uid2grp_prefetch {
+	uid_t uid;
+	struct gsh_buffdesc name;	/*< Empty to look up by uid */
+};
+
+static void uid2grp_prefetch_job(struct fridgethr_context *ctx)
+{
+	struct uid2grp_prefetch *req = ctx->arg;
+	const struct gsh_buffdesc *name = req->name.len != 0 ? &req->name
+							      : NULL;
+	struct uid2grp_pending *pending;
+
+	/* A lookup already in flight will refresh the entry */
+	pending = uid2grp_pending_start(name, req->uid, false);
+	if (pending != NULL) {
+		uid2grp_fetch(name, req->uid, false);
+		uid2grp_pending_done(pending);
+	}
+
+	gsh_free(req);
+}
+
+/**
+ * @brief Look up the groups of a user again before they expire
  *
- * @param[in]  uid  The uid of the user
- * @param[out]  group_data
+ * Only the first caller to find an entry due is queued, if the queue
+ * is refused the entry is looked up again when it expires.
+ */
+
+static void uid2grp_prefetch(struct group_data *gdata,
+			     const struct gsh_buffdesc *name, uid_t uid)
+{
+	struct uid2grp_prefetch *req;
+	size_t len = name != NULL ? name->len : 0;
+
+	if (uid2grp_fridge == NULL || !uid2grp_prefetch_due(gdata) ||
+	    atomic_inc_uint32_t(&gdata->prefetching) != 1)
+		return;
+
+	req = gsh_malloc(sizeof(struct uid2grp_prefetch) + len);
+	req->uid = uid;
+	req->name.addr = (char *)req + sizeof(struct uid2grp_prefetch);
+	req->name.len = len;
+	if (len != 0)
+		memcpy(req->name.addr, name->addr, len);
+
+	if (fridgethr_submit(uid2grp_fridge, uid2grp_prefetch_job,
+			     req) != 0)
+		gsh_free(req);
+}
+
+/**
+ * @brief Start the threads looking up group lists ahead of expiry
+ */
+
+void uid2grp_prefetch_init(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = UID2GRP_PREFETCH_THREADS;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&uid2grp_fridge, "uid2grp", &frp);
+	if (rc != 0) {
+		LogWarn(COMPONENT_IDMAPPER,
+			"Unable to initialize uid2grp prefetch fridge: %d",
+			rc);
+		uid2grp_fridge = NULL;
+	}
+}
+
+/**
+ * @brief Get supplementary groups given uname or uid
+ *
+ * On a miss, only one thread looks the user up, others wait for it
+ * and use what it cached.
+ *
+ * @param[in]  name  The name of the user, or NULL to look up by uid
+ * @param[in]  uid   The uid of the user
+ * @param[out] gdata group_data
  *
  * @return true if successful, false otherwise
  */
-bool uid2grp(uid_t uid, struct group_data **gdata)
+
+static bool uid2grp_get(const struct gsh_buffdesc *name, uid_t uid,
+			struct group_data **gdata)
 {
-	bool success = false;
+	struct uid2grp_pending *pending;
+	bool success;
+	bool expired;
+	uid_t found_uid = -1;
 
 	PTHREAD_RWLOCK_rdlock(&uid2grp_user_lock);
-	success = uid2grp_lookup_by_uid(uid, gdata);
+	if (name != NULL)
+		success = uid2grp_lookup_by_uname(name, &found_uid, gdata);
+	else
+		success = uid2grp_lookup_by_uid(uid, gdata);
+	expired = success && uid2grp_expired(*gdata);
 
 	/* Handle common case first */
-	if (success && !uid2grp_expired(*gdata)) {
+	if (success && !expired) {
 		uid2grp_hold_group_data(*gdata);
+		uid2grp_prefetch(*gdata, name, uid);
 		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
 		return success;
 	}
 	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
 
-	if (success) {
-		/* Cache entry is expired */
-		PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-		uid2grp_remove_by_uid(uid);
-		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+	pending = uid2grp_pending_start(name, uid, true);
+	if (pending != NULL) {
+		uid2grp_fetch(name, uid, expired);
+		uid2grp_pending_done(pending);
 	}
 
-	*gdata = uid2grp_allocate_by_uid(uid);
-	PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-	if (*gdata)
-		uid2grp_add_user(*gdata);
-	success = uid2grp_lookup_by_uid(uid, gdata);
-	if (success)
+	PTHREAD_RWLOCK_rdlock(&uid2grp_user_lock);
+	if (name != NULL)
+		success = uid2grp_lookup_by_uname(name, &found_uid, gdata);
+	else
+		success = uid2grp_lookup_by_uid(uid, gdata);
+
+	/* If we waited for a lookup that failed to refresh an expired
+	 * entry, look it up ourselves.
+	 */
+	expired = success && pending == NULL && uid2grp_expired(*gdata);
+	if (success && !expired)
 		uid2grp_hold_group_data(*gdata);
 	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
 
+	if (expired)
+		return uid2grp_get(name, uid, gdata);
+
 	return success;
 }
 
+/**
+ * @brief Get supplementary groups given uname
+ *
+ * @param[in]  name  The name of the user
+ * @param[out]  group_data
+ *
+ * @return true if successful, false otherwise
+ */
+bool name2grp(const struct gsh_buffdesc *name, struct group_data **gdata)
+{
+	return uid2grp_get(name, -1, gdata);
+}
+
+/**
+ * @brief Get supplementary groups given uid
+ *
+ * @param[in]  uid  The uid of the user
+ * @param[out]  group_data
+ *
+ * @return true if successful, false otherwise
+ */
+bool uid2grp(uid_t uid, struct group_data **gdata)
+{
+	return uid2grp_get(NULL, uid, gdata);
+}
+
 /*
  * All callers of uid2grp() and uname2grp must call this
  * when they are done accessing supplementary groups
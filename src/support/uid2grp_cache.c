@@ -184,6 +184,7 @@ void uid2grp_cache_init(void)
 	avltree_init(&uid_tree, uid_comparator, 0);
 	memset(uid_grplist_cache, 0,
 	       id_cache_size * sizeof(struct avltree_node *));
+	uid2grp_prefetch_init();
 }
 
 /* Remove given user/cache_info from the AVL trees
@@ -0,0 +1,399 @@
+#!/usr/bin/python
+#
+# Replay a request capture written with NFS_CORE_PARAM { Capture_File }.
+#
+# ./ganesha_replay.py [--speed N] [--clients N] <capture file> <mountpoint>
+# ./ganesha_replay.py --summary <capture file>
+#
+# The capture only has hashes of the handles, not names or data, so
+# the replay first builds a stand-in tree under the mountpoint: one
+# directory per handle used as one, one file per other handle, sized
+# for the largest read of it.  Each client of the capture is then
+# replayed by its own thread, in its own order, with the original
+# pacing scaled by --speed (0 replays as fast as possible).  NFSv3
+# procedures and NFSv4 operations are turned into the system calls
+# that cause them; mount with noac and lookupcache=none so that they
+# reach the server.  Operations that change the namespace are replayed
+# as a stat of their directory, leaving the tree as it was.
+#
+# Last, the count, errors and latency percentiles of every operation
+# are printed for the capture and for the replay.
+#
+# The capture is in the byte order of the server that wrote it; this
+# assumes little endian.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 3 of the License, or (at your option) any later version.
+#
+from __future__ import print_function
+import argparse
+import collections
+import fcntl
+import os
+import struct
+import sys
+import threading
+import time
+
+MAGIC = 0x47435054
+VERSION = 1
+
+REC_FILE = 1
+REC_REQ = 2
+REC_DROP = 3
+
+DROPPED = 0x1
+TRUNCATED = 0x2
+
+HDR = struct.Struct("<II")
+FILE = struct.Struct("<IIQ")
+REQ = struct.Struct("<QQQIIHHiHHHH16sHHI")
+OP = struct.Struct("<IiQQQQ")
+DROP = struct.Struct("<IIQ")
+
+NFS_PROGRAM = 100003
+
+NFS3_PROCS = ["NULL", "GETATTR", "SETATTR", "LOOKUP", "ACCESS", "READLINK",
+              "READ", "WRITE", "CREATE", "MKDIR", "SYMLINK", "MKNOD",
+              "REMOVE", "RMDIR", "RENAME", "LINK", "READDIR", "READDIRPLUS",
+              "FSSTAT", "FSINFO", "PATHCONF", "COMMIT"]
+
+NFS4_OPS = {3: "ACCESS", 4: "CLOSE", 5: "COMMIT", 6: "CREATE",
+            7: "DELEGPURGE", 8: "DELEGRETURN", 9: "GETATTR", 10: "GETFH",
+            11: "LINK", 12: "LOCK", 13: "LOCKT", 14: "LOCKU", 15: "LOOKUP",
+            16: "LOOKUPP", 17: "NVERIFY", 18: "OPEN", 19: "OPENATTR",
+            20: "OPEN_CONFIRM", 21: "OPEN_DOWNGRADE", 22: "PUTFH",
+            23: "PUTPUBFH", 24: "PUTROOTFH", 25: "READ", 26: "READDIR",
+            27: "READLINK", 28: "REMOVE", 29: "RENAME", 30: "RENEW",
+            31: "RESTOREFH", 32: "SAVEFH", 33: "SECINFO", 34: "SETATTR",
+            35: "SETCLIENTID", 36: "SETCLIENTID_CONFIRM", 37: "VERIFY",
+            38: "WRITE", 39: "RELEASE_LOCKOWNER", 40: "BACKCHANNEL_CTL",
+            41: "BIND_CONN_TO_SESSION", 42: "EXCHANGE_ID",
+            43: "CREATE_SESSION", 44: "DESTROY_SESSION", 45: "FREE_STATEID",
+            46: "GET_DIR_DELEGATION", 47: "GETDEVICEINFO",
+            48: "GETDEVICELIST", 49: "LAYOUTCOMMIT", 50: "LAYOUTGET",
+            51: "LAYOUTRETURN", 52: "SECINFO_NO_NAME", 53: "SEQUENCE",
+            54: "SET_SSV", 55: "TEST_STATEID", 56: "WANT_DELEGATION",
+            57: "DESTROY_CLIENTID", 58: "RECLAIM_COMPLETE", 59: "ALLOCATE",
+            60: "COPY", 61: "COPY_NOTIFY", 62: "DEALLOCATE",
+            63: "IO_ADVISE", 64: "LAYOUTERROR", 65: "LAYOUTSTATS",
+            66: "OFFLOAD_CANCEL", 67: "OFFLOAD_STATUS", 68: "READ_PLUS",
+            69: "SEEK", 70: "WRITE_SAME", 71: "CLONE"}
+
+# What to do for an operation, after its name
+REPLAY = {"READ": "read", "READ_PLUS": "read", "WRITE": "write",
+          "COMMIT": "fsync", "GETATTR": "stat", "ACCESS": "stat",
+          "FSSTAT": "statvfs", "FSINFO": "statvfs", "PATHCONF": "statvfs",
+          "READDIR": "listdir", "READDIRPLUS": "listdir",
+          "SETATTR": "utime", "LOCK": "lock", "LOCKU": "lock",
+          "LOCKT": "lock", "OPEN": "open", "LOOKUP": "lookup",
+          "LOOKUPP": "stat", "READLINK": "stat", "CREATE": "dirstat",
+          "MKDIR": "dirstat", "SYMLINK": "dirstat", "MKNOD": "dirstat",
+          "REMOVE": "dirstat", "RMDIR": "dirstat", "RENAME": "dirstat",
+          "LINK": "dirstat"}
+
+DIR_OPS = ("READDIR", "READDIRPLUS", "LOOKUP", "MKDIR", "CREATE", "SYMLINK",
+           "MKNOD", "REMOVE", "RMDIR", "RENAME", "LINK")
+
+
+class Op(object):
+    __slots__ = ("name", "status", "fh", "obj", "offset", "length")
+
+
+class Req(object):
+    __slots__ = ("ns", "latency", "queue_wait", "xid", "prog", "vers",
+                 "proc", "status", "export_id", "flags", "client",
+                 "minorversion", "ops")
+
+
+def records(data):
+    off = 0
+    while off + HDR.size <= len(data):
+        length, rtype = HDR.unpack_from(data, off)
+        if length < HDR.size or off + length > len(data):
+            sys.stderr.write("Truncated record at offset %d\n" % off)
+            return
+        yield rtype, data[off + HDR.size:off + length]
+        off += length
+
+
+def op_name(req, op):
+    if req.prog == NFS_PROGRAM and req.vers == 4 and req.proc == 1:
+        return NFS4_OPS.get(op, "OP%d" % op)
+    if req.prog == NFS_PROGRAM and req.vers == 3 and op < len(NFS3_PROCS):
+        return NFS3_PROCS[op]
+    return "%d.%d.%d" % (req.prog, req.vers, op)
+
+
+def load(path):
+    with open(path, "rb") as f:
+        data = f.read()
+
+    reqs = []
+    dropped = 0
+    start = None
+    for rtype, body in records(data):
+        if rtype == REC_FILE:
+            magic, version, start = FILE.unpack_from(body)
+            if magic != MAGIC or version != VERSION:
+                sys.exit("%s: not a version %d capture" % (path, VERSION))
+        elif rtype == REC_REQ:
+            f = REQ.unpack_from(body)
+            req = Req()
+            (req.ns, req.latency, req.queue_wait, req.xid, req.prog,
+             req.vers, req.proc, req.status, req.export_id, req.flags,
+             family, port, addr, req.minorversion, nops, _) = f
+            alen = 4 if family == 2 else 16
+            req.client = (family, addr[:alen], port)
+            req.ops = []
+            for i in range(nops):
+                o = OP.unpack_from(body, REQ.size + i * OP.size)
+                op = Op()
+                op.name = op_name(req, o[0])
+                op.status, op.fh, op.obj, op.offset, op.length = o[1:]
+                req.ops.append(op)
+            reqs.append(req)
+        elif rtype == REC_DROP:
+            dropped += DROP.unpack_from(body)[2]
+
+    if start is None:
+        sys.exit("%s: no capture header" % path)
+
+    # Threads write their own records, put them back in time order
+    reqs.sort(key=lambda r: r.ns)
+    return reqs, dropped
+
+
+class Tree(object):
+    """Stand-in objects for the handles of a capture."""
+
+    def __init__(self, root, reqs):
+        self.root = root
+        self.dirs = set()
+        self.parent = {}
+        self.size = collections.defaultdict(int)
+
+        for req in reqs:
+            for op in req.ops:
+                if op.fh == 0:
+                    continue
+                if op.name in DIR_OPS:
+                    self.dirs.add(op.fh)
+                if op.obj != 0 and op.obj != op.fh:
+                    self.parent.setdefault(op.obj, op.fh)
+                    if op.name == "MKDIR":
+                        self.dirs.add(op.obj)
+                if op.name in ("READ", "READ_PLUS", "WRITE"):
+                    end = op.offset + op.length
+                    self.size[op.fh] = max(self.size[op.fh], end)
+                elif op.name not in DIR_OPS:
+                    self.size.setdefault(op.fh, 0)
+
+        self.path = {}
+        for h in set(self.size) | self.dirs | set(self.parent):
+            self.path[h] = self.resolve(h)
+
+    def resolve(self, h):
+        parts = []
+        seen = set()
+        while h in self.parent and h not in seen:
+            seen.add(h)
+            parts.append("%016x" % h)
+            h = self.parent[h]
+        parts.append("%016x" % h)
+        return os.path.join(self.root, *reversed(parts))
+
+    def build(self):
+        dirs = sorted((self.path[h] for h in self.dirs), key=len)
+        for d in dirs:
+            if not os.path.isdir(d):
+                os.makedirs(d)
+        for h, size in self.size.items():
+            if h in self.dirs:
+                continue
+            p = self.path[h]
+            d = os.path.dirname(p)
+            if not os.path.isdir(d):
+                os.makedirs(d)
+            with open(p, "ab") as f:
+                if os.fstat(f.fileno()).st_size < size:
+                    f.truncate(size)
+
+    def dir_of(self, h):
+        p = self.path.get(h)
+        if p is None:
+            return self.root
+        return p if h in self.dirs else os.path.dirname(p)
+
+
+def replay_op(tree, op, fds):
+    what = REPLAY.get(op.name)
+    if what is None or op.fh == 0:
+        return False
+    p = tree.path.get(op.fh)
+    if p is None:
+        return False
+
+    if what == "stat":
+        os.stat(p)
+    elif what == "dirstat":
+        os.stat(tree.dir_of(op.fh))
+    elif what == "statvfs":
+        os.statvfs(p)
+    elif what == "listdir":
+        os.listdir(p)
+    elif what == "lookup":
+        os.stat(tree.path.get(op.obj, p))
+    elif what == "utime":
+        os.utime(p, None)
+    elif what == "open":
+        target = tree.path.get(op.obj)
+        if target is not None and op.obj not in tree.dirs:
+            os.close(os.open(target, os.O_RDWR))
+        else:
+            os.stat(p)
+    elif op.fh in tree.dirs:
+        os.stat(p)
+    else:
+        fd = fds.get(op.fh)
+        if fd is None:
+            fd = os.open(p, os.O_RDWR)
+            fds[op.fh] = fd
+        if what == "read":
+            os.pread(fd, max(op.length, 1), op.offset)
+        elif what == "write":
+            os.pwrite(fd, b"\0" * op.length, op.offset)
+        elif what == "fsync":
+            os.fsync(fd)
+        elif what == "lock":
+            kind = fcntl.LOCK_UN if op.name == "LOCKU" else fcntl.LOCK_EX
+            if op.name == "LOCKT":
+                kind |= fcntl.LOCK_NB
+            fcntl.lockf(fd, kind, op.length, op.offset)
+            if op.name == "LOCKT":
+                fcntl.lockf(fd, fcntl.LOCK_UN, op.length, op.offset)
+    return True
+
+
+def replay_client(tree, reqs, base, speed, stats, lock):
+    fds = {}
+    t0 = time.time()
+    local = collections.defaultdict(lambda: [0, 0, []])
+
+    for req in reqs:
+        if speed > 0:
+            delay = (req.ns - base) / 1e9 / speed - (time.time() - t0)
+            if delay > 0:
+                time.sleep(delay)
+        for op in req.ops:
+            s = time.time()
+            try:
+                if not replay_op(tree, op, fds):
+                    continue
+                err = 0
+            except (OSError, IOError):
+                err = 1
+            st = local[op.name]
+            st[0] += 1
+            st[1] += err
+            st[2].append(int((time.time() - s) * 1e9))
+
+    for fd in fds.values():
+        os.close(fd)
+
+    with lock:
+        for name, st in local.items():
+            t = stats[name]
+            t[0] += st[0]
+            t[1] += st[1]
+            t[2].extend(st[2])
+
+
+def percentile(sorted_lat, pct):
+    if not sorted_lat:
+        return 0
+    return sorted_lat[min(len(sorted_lat) - 1,
+                          int(len(sorted_lat) * pct / 100.0))]
+
+
+def report(title, stats):
+    print(title)
+    print("  %-20s %10s %8s %10s %10s %10s %10s" %
+          ("op", "count", "errors", "p50 us", "p90 us", "p99 us", "max us"))
+    for name in sorted(stats):
+        count, errors, lat = stats[name]
+        lat.sort()
+        print("  %-20s %10d %8d %10.1f %10.1f %10.1f %10.1f" %
+              (name, count, errors, percentile(lat, 50) / 1e3,
+               percentile(lat, 90) / 1e3, percentile(lat, 99) / 1e3,
+               (lat[-1] if lat else 0) / 1e3))
+
+
+def captured_stats(reqs):
+    """Per op stats of the capture, COMPOUNDs count for each op."""
+    stats = collections.defaultdict(lambda: [0, 0, []])
+    for req in reqs:
+        for op in req.ops:
+            st = stats[op.name]
+            st[0] += 1
+            st[1] += 1 if op.status != 0 else 0
+            st[2].append(req.latency)
+    return stats
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Replay a request capture")
+    parser.add_argument("capture")
+    parser.add_argument("mountpoint", nargs="?")
+    parser.add_argument("--speed", type=float, default=1.0,
+                        help="pacing factor, 0 for as fast as possible")
+    parser.add_argument("--clients", type=int, default=0,
+                        help="replay only the N busiest clients")
+    parser.add_argument("--summary", action="store_true",
+                        help="only print the stats of the capture")
+    args = parser.parse_args()
+
+    reqs, dropped = load(args.capture)
+    if dropped:
+        sys.stderr.write("%d requests were dropped from the capture\n" %
+                         dropped)
+    if not reqs:
+        sys.exit("%s: no request captured" % args.capture)
+
+    report("captured (%d requests)" % len(reqs), captured_stats(reqs))
+    if args.summary:
+        return
+    if args.mountpoint is None:
+        parser.error("a mountpoint is needed to replay")
+
+    clients = collections.OrderedDict()
+    for req in reqs:
+        clients.setdefault(req.client, []).append(req)
+    order = sorted(clients, key=lambda c: -len(clients[c]))
+    if args.clients > 0:
+        order = order[:args.clients]
+
+    tree = Tree(os.path.join(args.mountpoint, "ganesha_replay"),
+                [r for c in order for r in clients[c]])
+    tree.build()
+
+    stats = collections.defaultdict(lambda: [0, 0, []])
+    lock = threading.Lock()
+    threads = [threading.Thread(target=replay_client,
+                                args=(tree, clients[c], reqs[0].ns,
+                                      args.speed, stats, lock))
+               for c in order]
+    start = time.time()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+
+    report("replayed (%d clients in %.1f s)" % (len(threads),
+                                               time.time() - start), stats)
+
+
+if __name__ == "__main__":
+    main()
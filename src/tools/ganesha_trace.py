@@ -0,0 +1,157 @@
+#!/usr/bin/python
+#
+# Decode a binary trace written by the LOG { Trace {} } block.
+#
+# ./ganesha_trace.py <trace file> [<trace file> ...]
+#
+# Each message is printed as
+#   <date> <time> [<thread id>] <function> :<component> :<level> :<message>
+#
+# The trace is in the byte order of the server that wrote it; this
+# assumes little endian.
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 3 of the License, or (at your option) any later version.
+#
+from __future__ import print_function
+import re
+import struct
+import sys
+import time
+
+REC_SITE = 1
+REC_EVENT = 2
+REC_DROP = 3
+
+ARG_INT = 1
+ARG_LONG = 2
+ARG_DOUBLE = 3
+ARG_STR = 4
+
+NO_ARGS = 255
+
+LEVELS = ["NULL", "FATAL", "MAJ", "CRIT", "WARN", "EVENT", "INFO",
+          "DEBUG", "MID_DEBUG", "FULL_DEBUG"]
+
+CONV = re.compile(r"%([-+ #0'I]*)(\*|\d+)?(\.(\*|\d*))?"
+                  r"(hh|h|ll|l|q|j|z|t)?([diouxXcpeEfFgGaAs%])")
+
+
+def py_format(fmt):
+    """Turn a C format into one Python's % operator takes."""
+    def conv(m):
+        flags = m.group(1).replace("'", "").replace("I", "")
+        width = m.group(2) or ""
+        prec = m.group(3) or ""
+        c = m.group(6)
+        if c == "%":
+            return "%%"
+        if c == "u":
+            c = "d"
+        elif c == "p":
+            flags += "#"
+            c = "x"
+        elif c in "aA":
+            c = "e"
+        return "%" + flags + width + prec + c
+    return CONV.sub(conv, fmt)
+
+
+def records(data):
+    off = 0
+    while off + 8 <= len(data):
+        length, rtype = struct.unpack_from("<II", data, off)
+        if length < 8 or off + length > len(data):
+            sys.stderr.write("Truncated record at offset %d\n" % off)
+            return
+        yield rtype, data[off + 8:off + length]
+        off += length
+
+
+def parse_site(body):
+    sid, line, nargs = struct.unpack_from("<III", body, 0)
+    off = 12
+    types = []
+    if nargs != NO_ARGS:
+        types = list(bytearray(body[off:off + nargs]))
+        off += nargs
+    fmt, fname, func, comp = body[off:].split(b"\0")[:4]
+    return sid, {"line": line, "types": types, "traced": nargs != NO_ARGS,
+                 "fmt": fmt.decode("utf-8", "replace"),
+                 "pyfmt": py_format(fmt.decode("utf-8", "replace")),
+                 "file": fname.decode(), "func": func.decode(),
+                 "comp": comp.decode()}
+
+
+def parse_args(body, types):
+    off = 0
+    args = []
+    for t in types:
+        if t == ARG_INT:
+            args.append(struct.unpack_from("<i", body, off)[0])
+            off += 4
+        elif t == ARG_LONG:
+            args.append(struct.unpack_from("<Q", body, off)[0])
+            off += 8
+        elif t == ARG_DOUBLE:
+            args.append(struct.unpack_from("<d", body, off)[0])
+            off += 8
+        elif t == ARG_STR:
+            slen = struct.unpack_from("<H", body, off)[0]
+            off += 2
+            args.append(body[off:off + slen].decode("utf-8", "replace"))
+            off += slen
+    return args
+
+
+def stamp(ns):
+    return "%s.%06d" % (time.strftime("%d/%m/%Y %H:%M:%S",
+                                      time.localtime(ns // 1000000000)),
+                        (ns % 1000000000) // 1000)
+
+
+def decode(path):
+    with open(path, "rb") as f:
+        data = f.read()
+
+    # Sites may be written after events of other threads that use them
+    sites = {}
+    for rtype, body in records(data):
+        if rtype == REC_SITE:
+            sid, site = parse_site(body)
+            sites[sid] = site
+
+    for rtype, body in records(data):
+        if rtype == REC_EVENT:
+            sid, tid, ns, comp, level = struct.unpack_from("<IIQHH", body)
+            site = sites.get(sid)
+            if site is None:
+                print("%s [%d] unknown call site %d" % (stamp(ns), tid, sid))
+                continue
+            if site["traced"]:
+                args = parse_args(body[24:], site["types"])
+                try:
+                    msg = site["pyfmt"] % tuple(args)
+                except (TypeError, ValueError):
+                    msg = "%s %r" % (site["fmt"], args)
+            else:
+                msg = site["fmt"] + " (arguments not traced)"
+            lvl = LEVELS[level] if level < len(LEVELS) else str(level)
+            print("%s [%d] %s :%s :%s :%s" % (stamp(ns), tid, site["func"],
+                                              site["comp"], lvl, msg))
+        elif rtype == REC_DROP:
+            tid, _, count = struct.unpack_from("<IIQ", body)
+            print("[%d] %d messages dropped, trace buffer full" % (tid, count))
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit("Usage: %s <trace file> [<trace file> ...]" % sys.argv[0])
+    for path in sys.argv[1:]:
+        decode(path)
+
+
+if __name__ == "__main__":
+    main()